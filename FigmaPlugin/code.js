@@ -12,49 +12,131 @@ function clampDimension(value, fallback) {
   return Math.max(1, rounded);
 }
 
-function insertScreenshot(bytes, width, height) {
-  const image = figma.createImage(bytes);
+// Horizontal gap between the screenshots of a burst
+const ROW_SPACING = 40;
+
+// Hashes of the images already uploaded, by content key (the oldest are
+// evicted first)
+const IMAGE_CACHE_SIZE = 64;
+const imageHashes = new Map();
+
+// FNV-1a of the bytes, combined with the length: cheap compared to the upload
+// of the image, and collisions are checked by comparing the sizes as well
+function contentKey(bytes) {
+  let hash = 0x811c9dc5;
+  for (let i = 0; i < bytes.length; ++i) {
+    hash ^= bytes[i];
+    hash = Math.imul(hash, 0x01000193);
+  }
+  return `${bytes.length}:${(hash >>> 0).toString(16)}`;
+}
+
+// Return the hash of the image, uploading it only if it is not known yet
+function getImageHash(bytes) {
+  const key = contentKey(bytes);
+  const cached = imageHashes.get(key);
+  if (cached && figma.getImageByHash(cached)) {
+    // Refresh its position in the eviction order
+    imageHashes.delete(key);
+    imageHashes.set(key, cached);
+    return cached;
+  }
+
+  const hash = figma.createImage(bytes).hash;
+  imageHashes.delete(key);
+  imageHashes.set(key, hash);
+  if (imageHashes.size > IMAGE_CACHE_SIZE) {
+    imageHashes.delete(imageHashes.keys().next().value);
+  }
+  return hash;
+}
+
+function createScreenshotNode(screenshot) {
+  // The UI posts the Uint8Array as is (structured clone copies typed arrays
+  // without boxing each byte)
+  if (!(screenshot.bytes instanceof Uint8Array) || !screenshot.bytes.length) {
+    throw new Error('Empty PNG data');
+  }
 
   const node = figma.createRectangle();
-  node.resize(clampDimension(width, 100), clampDimension(height, 100));
+  // The screenshots of other devices (published by other scrcpy instances)
+  // have their own sequences
+  node.name = screenshot.serial
+      ? `Screenshot ${screenshot.serial} #${screenshot.seq || 0}`
+      : `Screenshot #${screenshot.seq || 0}`;
+  node.resize(clampDimension(screenshot.width, 100),
+              clampDimension(screenshot.height, 100));
   node.fills = [
     {
       type: 'IMAGE',
-      imageHash: image.hash,
+      imageHash: getImageHash(screenshot.bytes),
       scaleMode: 'FILL',
     },
   ];
+  return node;
+}
+
+// Wrap the screenshots of a burst in a horizontal auto-layout frame, so that
+// they can be moved (and reordered) together
+function createBurstFrame(nodes, screenshots) {
+  const frame = figma.createFrame();
+  const first = screenshots[0].seq || 0;
+  const last = screenshots[screenshots.length - 1].seq || 0;
+  frame.name = `Screenshots #${first}-${last}`;
+  frame.layoutMode = 'HORIZONTAL';
+  frame.primaryAxisSizingMode = 'AUTO';
+  frame.counterAxisSizingMode = 'AUTO';
+  frame.itemSpacing = ROW_SPACING;
+  frame.fills = [];
+  frame.clipsContent = false;
+  for (const node of nodes) {
+    frame.appendChild(node);
+  }
+  return frame;
+}
+
+// Insert the screenshots in a single pass, in capture order, centered on the
+// viewport (a burst is laid out as a row), then scroll once
+function insertScreenshots(screenshots) {
+  const nodes = screenshots.map(createScreenshotNode);
+  const root = nodes.length > 1 ? createBurstFrame(nodes, screenshots)
+                                : nodes[0];
 
   const center = figma.viewport.center;
-  node.x = center.x - node.width / 2;
-  node.y = center.y - node.height / 2;
+  root.x = center.x - root.width / 2;
+  root.y = center.y - root.height / 2;
+  figma.currentPage.appendChild(root);
 
-  figma.currentPage.appendChild(node);
-  figma.currentPage.selection = [node];
-  figma.viewport.scrollAndZoomIntoView([node]);
+  figma.currentPage.selection = [root];
+  figma.viewport.scrollAndZoomIntoView([root]);
 
-  return node;
+  return nodes;
 }
 
 figma.ui.onmessage = (msg) => {
-  if (!msg || msg.type !== 'insert-screenshot') {
+  if (!msg || msg.type !== 'insert-screenshots') {
     return;
   }
 
   try {
-    if (!Array.isArray(msg.bytes) || !msg.bytes.length) {
-      throw new Error('Empty PNG data');
+    if (!Array.isArray(msg.screenshots) || !msg.screenshots.length) {
+      throw new Error('No screenshot');
     }
 
-    const bytes = new Uint8Array(msg.bytes);
-    const node = insertScreenshot(bytes, msg.width, msg.height);
-    figma.notify(`Inserted screenshot ${node.width}x${node.height}`);
+    const nodes = insertScreenshots(msg.screenshots);
+    const last = nodes[nodes.length - 1];
+    if (nodes.length > 1) {
+      figma.notify(`Inserted ${nodes.length} screenshots`);
+    } else {
+      figma.notify(`Inserted screenshot ${last.width}x${last.height}`);
+    }
 
     figma.ui.postMessage({
       type: 'inserted',
-      seq: msg.seq || 0,
-      width: node.width,
-      height: node.height,
+      seq: msg.screenshots[msg.screenshots.length - 1].seq || 0,
+      count: nodes.length,
+      width: last.width,
+      height: last.height,
     });
   } catch (e) {
     figma.notify(`Insert failed: ${e.message}`, { error: true });
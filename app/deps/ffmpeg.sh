@@ -81,19 +81,10 @@ else
         --enable-muxer=wav
     )
 
-    if [[ "$HOST" == linux ]]
-    then
-        conf+=(
-            --enable-libv4l2
-            --enable-outdev=v4l2
-            --enable-encoder=rawvideo
-        )
-    else
-        # libavdevice is only used for V4L2 on Linux
-        conf+=(
-            --disable-avdevice
-        )
-    fi
+    # The V4L2 sink writes the frames directly, without libavdevice
+    conf+=(
+        --disable-avdevice
+    )
 
     if [[ "$LINK_TYPE" == static ]]
     then
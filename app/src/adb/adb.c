@@ -8,12 +8,14 @@
 #include <sys/types.h>
 
 #include "adb/adb_device.h"
+#include "adb/adb_native.h"
 #include "adb/adb_parser.h"
 #include "util/env.h"
 #include "util/file.h"
 #include "util/log.h"
 #include "util/process_intr.h"
 #include "util/str.h"
+#include "util/strbuf.h"
 
 /* Convenience macro to expand:
  *
@@ -28,6 +30,7 @@
 #define SC_ADB_COMMAND(...) { sc_adb_get_executable(), __VA_ARGS__, NULL }
 
 static char *adb_executable;
+static bool adb_native;
 
 bool
 sc_adb_init(void) {
@@ -69,6 +72,73 @@ sc_adb_get_executable(void) {
     return adb_executable;
 }
 
+void
+sc_adb_set_native(bool native) {
+    adb_native = native;
+}
+
+// Indicate if the request must be executed by the adb executable after an
+// attempt with the native client, and store the result of the native request
+// otherwise
+static bool
+sc_adb_native_fallback(struct sc_intr *intr, enum sc_adb_native_result result,
+                       const char *name, bool *ok) {
+    if (result == SC_ADB_NATIVE_UNAVAILABLE) {
+        if (!intr || !sc_intr_is_interrupted(intr)) {
+            LOGD("Native adb client unavailable for \"adb %s\", "
+                 "executing adb", name);
+            return true;
+        }
+        // Interrupted, do not retry
+        *ok = false;
+        return false;
+    }
+
+    *ok = result == SC_ADB_NATIVE_OK;
+    return false;
+}
+
+// Try to execute a `adb -s <serial> shell <args...>` command with the native
+// client.
+//
+// Return true if the command has been handled (then *ok tells if it
+// succeeded), or false if it must be executed by the adb executable.
+static bool
+sc_adb_native_shell_argv(struct sc_intr *intr, const char *const argv[],
+                         char *out, size_t cap, ssize_t *out_len,
+                         unsigned flags, bool *ok) {
+    assert(argv[1] && !strcmp(argv[1], "-s"));
+    assert(argv[2]);
+    assert(argv[3] && !strcmp(argv[3], "shell"));
+    const char *serial = argv[2];
+
+    // The device shell joins the arguments, like adb does
+    struct sc_strbuf buf;
+    if (!sc_strbuf_init(&buf, 64)) {
+        return false;
+    }
+    for (const char *const *arg = &argv[4]; *arg; ++arg) {
+        if ((arg != &argv[4] && !sc_strbuf_append_char(&buf, ' '))
+                || !sc_strbuf_append_str(&buf, *arg)) {
+            LOG_OOM();
+            free(buf.s);
+            return false;
+        }
+    }
+
+    size_t len;
+    enum sc_adb_native_result result =
+        sc_adb_native_shell(intr, serial, buf.s, out, cap, &len, flags);
+    free(buf.s);
+
+    if (sc_adb_native_fallback(intr, result, "shell", ok)) {
+        return false;
+    }
+
+    *out_len = *ok ? (ssize_t) len : -1;
+    return true;
+}
+
 // serialize argv to string "[arg1], [arg2], [arg3]"
 static size_t
 argv_to_string(const char *const *argv, char *buf, size_t bufsize) {
@@ -263,6 +333,16 @@ sc_adb_forward(struct sc_intr *intr, const char *serial, uint16_t local_port,
     }
 
     assert(serial);
+
+    if (adb_native) {
+        bool ok;
+        enum sc_adb_native_result result =
+            sc_adb_native_forward(intr, serial, local, remote, flags);
+        if (!sc_adb_native_fallback(intr, result, "forward", &ok)) {
+            return ok;
+        }
+    }
+
     const char *const argv[] =
         SC_ADB_COMMAND("-s", serial, "forward", local, remote);
 
@@ -279,6 +359,16 @@ sc_adb_forward_remove(struct sc_intr *intr, const char *serial,
     (void) r;
 
     assert(serial);
+
+    if (adb_native) {
+        bool ok;
+        enum sc_adb_native_result result =
+            sc_adb_native_forward_remove(intr, serial, local, flags);
+        if (!sc_adb_native_fallback(intr, result, "forward --remove", &ok)) {
+            return ok;
+        }
+    }
+
     const char *const argv[] =
         SC_ADB_COMMAND("-s", serial, "forward", "--remove", local);
 
@@ -303,6 +393,16 @@ sc_adb_reverse(struct sc_intr *intr, const char *serial,
     }
 
     assert(serial);
+
+    if (adb_native) {
+        bool ok;
+        enum sc_adb_native_result result =
+            sc_adb_native_reverse(intr, serial, remote, local, flags);
+        if (!sc_adb_native_fallback(intr, result, "reverse", &ok)) {
+            return ok;
+        }
+    }
+
     const char *const argv[] =
         SC_ADB_COMMAND("-s", serial, "reverse", remote, local);
 
@@ -322,6 +422,16 @@ sc_adb_reverse_remove(struct sc_intr *intr, const char *serial,
     }
 
     assert(serial);
+
+    if (adb_native) {
+        bool ok;
+        enum sc_adb_native_result result =
+            sc_adb_native_reverse_remove(intr, serial, remote, flags);
+        if (!sc_adb_native_fallback(intr, result, "reverse --remove", &ok)) {
+            return ok;
+        }
+    }
+
     const char *const argv[] =
         SC_ADB_COMMAND("-s", serial, "reverse", "--remove", remote);
 
@@ -332,37 +442,74 @@ sc_adb_reverse_remove(struct sc_intr *intr, const char *serial,
 bool
 sc_adb_push(struct sc_intr *intr, const char *serial, const char *local,
             const char *remote, unsigned flags) {
+    return sc_adb_push_files(intr, serial, &local, 1, remote, flags);
+}
+
+bool
+sc_adb_push_files(struct sc_intr *intr, const char *serial,
+                  const char *const *locals, size_t count, const char *remote,
+                  unsigned flags) {
+    assert(serial);
+    assert(count);
+
+    if (adb_native) {
+        bool ok;
+        enum sc_adb_native_result result =
+            sc_adb_native_push_files(intr, serial, locals, count, remote,
+                                     flags);
+        if (!sc_adb_native_fallback(intr, result, "push", &ok)) {
+            return ok;
+        }
+    }
+
+    // adb -s <serial> push <locals...> <remote>
+    size_t argc = count + 5;
+    const char **argv = malloc((argc + 1) * sizeof(*argv));
+    if (!argv) {
+        LOG_OOM();
+        return false;
+    }
+
+    argv[0] = sc_adb_get_executable();
+    argv[1] = "-s";
+    argv[2] = serial;
+    argv[3] = "push";
+    for (size_t i = 0; i < count; ++i) {
+        argv[4 + i] = locals[i];
+    }
+    argv[argc - 1] = remote;
+    argv[argc] = NULL;
+
 #ifdef _WIN32
     // Windows will parse the string, so the paths must be quoted
     // (see sys/win/command.c)
-    local = sc_str_quote(local);
-    if (!local) {
-        return SC_PROCESS_NONE;
-    }
-    remote = sc_str_quote(remote);
-    if (!remote) {
-        free((void *) local);
-        return SC_PROCESS_NONE;
+    for (size_t i = 4; i < argc; ++i) {
+        argv[i] = sc_str_quote(argv[i]);
+        if (!argv[i]) {
+            while (i-- > 4) {
+                free((void *) argv[i]);
+            }
+            free(argv);
+            return false;
+        }
     }
 #endif
 
-    assert(serial);
-    const char *const argv[] =
-        SC_ADB_COMMAND("-s", serial, "push", local, remote);
-
     sc_pid pid = sc_adb_execute(argv, flags);
 
 #ifdef _WIN32
-    free((void *) remote);
-    free((void *) local);
+    for (size_t i = 4; i < argc; ++i) {
+        free((void *) argv[i]);
+    }
 #endif
+    free(argv);
 
     return process_check_success_intr(intr, pid, "adb push", flags);
 }
 
 bool
 sc_adb_install(struct sc_intr *intr, const char *serial, const char *local,
-               unsigned flags) {
+               enum sc_adb_install_mode mode, unsigned flags) {
 #ifdef _WIN32
     // Windows will parse the string, so the local name must be quoted
     // (see sys/win/command.c)
@@ -372,11 +519,28 @@ sc_adb_install(struct sc_intr *intr, const char *serial, const char *local,
     }
 #endif
 
+    const char *mode_arg;
+    switch (mode) {
+        case SC_ADB_INSTALL_MODE_STREAMED:
+            mode_arg = "--streamed";
+            break;
+        case SC_ADB_INSTALL_MODE_INCREMENTAL:
+            mode_arg = "--incremental";
+            break;
+        default:
+            assert(mode == SC_ADB_INSTALL_MODE_DEFAULT);
+            mode_arg = NULL;
+            break;
+    }
+
     assert(serial);
-    const char *const argv[] =
+    // The APK must be the last argument
+    const char *const argv_mode[] =
+        SC_ADB_COMMAND("-s", serial, "install", "-r", mode_arg, local);
+    const char *const argv_default[] =
         SC_ADB_COMMAND("-s", serial, "install", "-r", local);
 
-    sc_pid pid = sc_adb_execute(argv, flags);
+    sc_pid pid = sc_adb_execute(mode_arg ? argv_mode : argv_default, flags);
 
 #ifdef _WIN32
     free((void *) local);
@@ -455,6 +619,21 @@ sc_adb_disconnect(struct sc_intr *intr, const char *ip_port, unsigned flags) {
 static bool
 sc_adb_list_devices(struct sc_intr *intr, unsigned flags,
                     struct sc_vec_adb_devices *out_vec) {
+    if (adb_native) {
+        char *output;
+        bool ok;
+        enum sc_adb_native_result result =
+            sc_adb_native_devices(intr, &output, flags);
+        if (!sc_adb_native_fallback(intr, result, "devices -l", &ok)) {
+            if (!ok) {
+                return false;
+            }
+            ok = sc_adb_parse_devices(output, out_vec);
+            free(output);
+            return ok;
+        }
+    }
+
     const char *const argv[] = SC_ADB_COMMAND("devices", "-l");
 
 #define BUFSIZE 65536
@@ -704,18 +883,25 @@ sc_adb_getprop(struct sc_intr *intr, const char *serial, const char *prop,
     const char *const argv[] =
         SC_ADB_COMMAND("-s", serial, "shell", "getprop", prop);
 
-    sc_pipe pout;
-    sc_pid pid = sc_adb_execute_p(argv, flags, &pout);
-    if (pid == SC_PROCESS_NONE) {
-        LOGE("Could not execute \"adb getprop\"");
-        return NULL;
-    }
-
     char buf[128];
-    ssize_t r = sc_pipe_read_all_intr(intr, pid, pout, buf, sizeof(buf) - 1);
-    sc_pipe_close(pout);
+    ssize_t r;
+    bool ok;
+    if (!adb_native || !sc_adb_native_shell_argv(intr, argv, buf,
+                                                 sizeof(buf) - 1, &r, flags,
+                                                 &ok)) {
+        sc_pipe pout;
+        sc_pid pid = sc_adb_execute_p(argv, flags, &pout);
+        if (pid == SC_PROCESS_NONE) {
+            LOGE("Could not execute \"adb getprop\"");
+            return NULL;
+        }
+
+        r = sc_pipe_read_all_intr(intr, pid, pout, buf, sizeof(buf) - 1);
+        sc_pipe_close(pout);
+
+        ok = process_check_success_intr(intr, pid, "adb getprop", flags);
+    }
 
-    bool ok = process_check_success_intr(intr, pid, "adb getprop", flags);
     if (!ok) {
         return NULL;
     }
@@ -819,6 +1005,28 @@ sc_adb_parse_keyguard_showing(const char *output, bool *out_showing) {
 static char *
 sc_adb_read_output(struct sc_intr *intr, const char *const argv[],
                    const char *cmd_name, size_t cap) {
+    if (adb_native) {
+        char *output = malloc(cap);
+        if (!output) {
+            LOG_OOM();
+            return NULL;
+        }
+
+        ssize_t r;
+        bool ok;
+        if (sc_adb_native_shell_argv(intr, argv, output, cap - 1, &r,
+                                     SC_ADB_SILENT, &ok)) {
+            if (!ok || r < 0) {
+                free(output);
+                return NULL;
+            }
+            output[r] = '\0';
+            return output;
+        }
+
+        free(output);
+    }
+
     sc_pipe pout;
     sc_pid pid = sc_adb_execute_p(argv, SC_ADB_SILENT, &pout);
     if (pid == SC_PROCESS_NONE) {
@@ -957,19 +1165,26 @@ sc_adb_get_device_ip(struct sc_intr *intr, const char *serial, unsigned flags) {
     const char *const argv[] =
         SC_ADB_COMMAND("-s", serial, "shell", "ip", "route");
 
-    sc_pipe pout;
-    sc_pid pid = sc_adb_execute_p(argv, flags, &pout);
-    if (pid == SC_PROCESS_NONE) {
-        LOGD("Could not execute \"ip route\"");
-        return NULL;
-    }
-
     // "adb shell ip route" output should contain only a few lines
     char buf[1024];
-    ssize_t r = sc_pipe_read_all_intr(intr, pid, pout, buf, sizeof(buf) - 1);
-    sc_pipe_close(pout);
+    ssize_t r;
+    bool ok;
+    if (!adb_native || !sc_adb_native_shell_argv(intr, argv, buf,
+                                                 sizeof(buf) - 1, &r, flags,
+                                                 &ok)) {
+        sc_pipe pout;
+        sc_pid pid = sc_adb_execute_p(argv, flags, &pout);
+        if (pid == SC_PROCESS_NONE) {
+            LOGD("Could not execute \"ip route\"");
+            return NULL;
+        }
+
+        r = sc_pipe_read_all_intr(intr, pid, pout, buf, sizeof(buf) - 1);
+        sc_pipe_close(pout);
+
+        ok = process_check_success_intr(intr, pid, "ip route", flags);
+    }
 
-    bool ok = process_check_success_intr(intr, pid, "ip route", flags);
     if (!ok) {
         return NULL;
     }
@@ -1010,3 +1225,26 @@ sc_adb_get_device_sdk_version(struct sc_intr *intr, const char *serial) {
 
     return value;
 }
+
+char *
+sc_adb_get_sha256sum(struct sc_intr *intr, const char *serial,
+                     const char *path) {
+    assert(serial);
+    assert(path);
+
+    const char *const argv[] =
+        SC_ADB_COMMAND("-s", serial, "shell", "sha256sum", path);
+
+    // The output is silent on error (e.g. if the file does not exist)
+    char *output = sc_adb_read_output(intr, argv, "adb shell sha256sum", 256);
+    if (!output) {
+        return NULL;
+    }
+
+    if (!sc_adb_parse_sha256sum(output)) {
+        free(output);
+        return NULL;
+    }
+
+    return output;
+}
@@ -24,6 +24,16 @@ sc_adb_destroy(void);
 const char *
 sc_adb_get_executable(void);
 
+/**
+ * Use the native adb client (talking directly to the adb server) when
+ * possible, instead of executing adb
+ *
+ * The adb executable is still used as a fallback, and to start and stop the
+ * adb server or the scrcpy server.
+ */
+void
+sc_adb_set_native(bool native);
+
 enum sc_adb_device_selector_type {
     SC_ADB_DEVICE_SELECT_ALL,
     SC_ADB_DEVICE_SELECT_SERIAL,
@@ -66,9 +76,30 @@ bool
 sc_adb_push(struct sc_intr *intr, const char *serial, const char *local,
             const char *remote, unsigned flags);
 
+/**
+ * Push several files at once (with a single adb session)
+ *
+ * If remote ends with '/', the files are pushed into that directory.
+ */
+bool
+sc_adb_push_files(struct sc_intr *intr, const char *serial,
+                  const char *const *locals, size_t count, const char *remote,
+                  unsigned flags);
+
+enum sc_adb_install_mode {
+    // Let adb decide
+    SC_ADB_INSTALL_MODE_DEFAULT,
+    // Stream the APK to the package manager, without pushing it to a
+    // temporary file first (Android >= 7)
+    SC_ADB_INSTALL_MODE_STREAMED,
+    // Start the app while the APK is still being transferred (Android >= 11,
+    // requires an APK Signature Scheme v4 file <apk>.idsig)
+    SC_ADB_INSTALL_MODE_INCREMENTAL,
+};
+
 bool
 sc_adb_install(struct sc_intr *intr, const char *serial, const char *local,
-               unsigned flags);
+               enum sc_adb_install_mode mode, unsigned flags);
 
 /**
  * Execute `adb tcpip <port>`
@@ -144,4 +175,14 @@ sc_adb_get_device_ip(struct sc_intr *intr, const char *serial, unsigned flags);
 uint16_t
 sc_adb_get_device_sdk_version(struct sc_intr *intr, const char *serial);
 
+/**
+ * Execute `adb shell sha256sum <path>`, and return the hexadecimal hash
+ *
+ * Return NULL if the file does not exist or the hash could not be retrieved.
+ * The result must be freed by the caller.
+ */
+char *
+sc_adb_get_sha256sum(struct sc_intr *intr, const char *serial,
+                     const char *path);
+
 #endif
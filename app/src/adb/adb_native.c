@@ -0,0 +1,627 @@
+#include "adb_native.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "adb/adb.h"
+#include "util/binary.h"
+#include "util/env.h"
+#include "util/file.h"
+#include "util/log.h"
+#include "util/net_intr.h"
+#include "util/str.h"
+
+#define SC_ADB_SERVER_PORT_DEFAULT 5037
+
+// Maximum size of a DATA chunk of the sync protocol
+#define SC_ADB_SYNC_DATA_MAX (64 * 1024)
+
+// Shell protocol v2 packet ids
+#define SC_ADB_SHELL_ID_STDOUT 1
+#define SC_ADB_SHELL_ID_STDERR 2
+#define SC_ADB_SHELL_ID_EXIT 3
+
+#define LOG_ADB_ERR(flags, fmt, ...) do { \
+        if (!((flags) & SC_ADB_NO_LOGERR)) { \
+            LOGE(fmt, ## __VA_ARGS__); \
+        } \
+    } while (0)
+
+static uint16_t
+sc_adb_native_get_server_port(void) {
+    uint16_t port = SC_ADB_SERVER_PORT_DEFAULT;
+
+    char *env = sc_get_env("ANDROID_ADB_SERVER_PORT");
+    if (env) {
+        long value;
+        if (sc_str_parse_integer(env, &value) && value > 0
+                && value <= 0xFFFF) {
+            port = value;
+        } else {
+            LOGW("Invalid ANDROID_ADB_SERVER_PORT: %s", env);
+        }
+        free(env);
+    }
+
+    return port;
+}
+
+static sc_socket
+sc_adb_native_connect(struct sc_intr *intr) {
+    sc_socket socket = net_socket();
+    if (socket == SC_SOCKET_NONE) {
+        return SC_SOCKET_NONE;
+    }
+
+    uint16_t port = sc_adb_native_get_server_port();
+    bool ok = net_connect_intr(intr, socket, IPV4_LOCALHOST, port);
+    if (!ok) {
+        LOGD("Could not connect to the adb server on port %" PRIu16, port);
+        net_close(socket);
+        return SC_SOCKET_NONE;
+    }
+
+    return socket;
+}
+
+static bool
+sc_adb_native_send_request(struct sc_intr *intr, sc_socket socket,
+                           const char *request) {
+    size_t len = strlen(request);
+    if (len > 0xFFFF) {
+        LOGE("adb request too long");
+        return false;
+    }
+
+    // The request is prefixed by its length, as 4 hexadecimal digits
+    char header[5];
+    snprintf(header, sizeof(header), "%04x", (unsigned) len);
+
+    ssize_t w = net_send_all_intr(intr, socket, header, 4);
+    if (w != 4) {
+        return false;
+    }
+
+    w = net_send_all_intr(intr, socket, request, len);
+    return w == (ssize_t) len;
+}
+
+// Read a string prefixed by its length (as 4 hexadecimal digits)
+static char *
+sc_adb_native_read_string(struct sc_intr *intr, sc_socket socket) {
+    char header[5];
+    ssize_t r = net_recv_all_intr(intr, socket, header, 4);
+    if (r != 4) {
+        return NULL;
+    }
+    header[4] = '\0';
+
+    char *endptr;
+    unsigned long len = strtoul(header, &endptr, 16);
+    if (*endptr != '\0') {
+        LOGW("Invalid length from the adb server");
+        return NULL;
+    }
+
+    char *str = malloc(len + 1);
+    if (!str) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    if (len) {
+        r = net_recv_all_intr(intr, socket, str, len);
+        if (r != (ssize_t) len) {
+            free(str);
+            return NULL;
+        }
+    }
+    str[len] = '\0';
+
+    return str;
+}
+
+static enum sc_adb_native_result
+sc_adb_native_read_status(struct sc_intr *intr, sc_socket socket,
+                          const char *name, unsigned flags) {
+    char status[4];
+    ssize_t r = net_recv_all_intr(intr, socket, status, sizeof(status));
+    if (r != sizeof(status)) {
+        LOGD("adb %s: could not read status", name);
+        return SC_ADB_NATIVE_UNAVAILABLE;
+    }
+
+    if (!memcmp(status, "OKAY", 4)) {
+        return SC_ADB_NATIVE_OK;
+    }
+
+    if (!memcmp(status, "FAIL", 4)) {
+        char *msg = sc_adb_native_read_string(intr, socket);
+        LOG_ADB_ERR(flags, "adb %s: %s", name, msg ? msg : "failed");
+        free(msg);
+        return SC_ADB_NATIVE_ERROR;
+    }
+
+    LOGW("adb %s: unexpected status from the adb server", name);
+    return SC_ADB_NATIVE_UNAVAILABLE;
+}
+
+// Send a request and read its status, on a new connection
+static sc_socket
+sc_adb_native_open(struct sc_intr *intr, const char *request,
+                   const char *name, unsigned flags,
+                   enum sc_adb_native_result *result) {
+    sc_socket socket = sc_adb_native_connect(intr);
+    if (socket == SC_SOCKET_NONE) {
+        *result = SC_ADB_NATIVE_UNAVAILABLE;
+        return SC_SOCKET_NONE;
+    }
+
+    if (!sc_adb_native_send_request(intr, socket, request)) {
+        net_close(socket);
+        *result = SC_ADB_NATIVE_UNAVAILABLE;
+        return SC_SOCKET_NONE;
+    }
+
+    *result = sc_adb_native_read_status(intr, socket, name, flags);
+    if (*result != SC_ADB_NATIVE_OK) {
+        net_close(socket);
+        return SC_SOCKET_NONE;
+    }
+
+    return socket;
+}
+
+// Open a connection to a device service (e.g. "shell:..." or "sync:")
+static sc_socket
+sc_adb_native_open_device(struct sc_intr *intr, const char *serial,
+                          const char *service, const char *name,
+                          unsigned flags, enum sc_adb_native_result *result) {
+    char *request;
+    if (asprintf(&request, "host:transport:%s", serial) == -1) {
+        LOG_OOM();
+        *result = SC_ADB_NATIVE_UNAVAILABLE;
+        return SC_SOCKET_NONE;
+    }
+
+    sc_socket socket = sc_adb_native_open(intr, request, name, flags, result);
+    free(request);
+    if (socket == SC_SOCKET_NONE) {
+        return SC_SOCKET_NONE;
+    }
+
+    // The connection is now bound to the device
+    if (!sc_adb_native_send_request(intr, socket, service)) {
+        net_close(socket);
+        *result = SC_ADB_NATIVE_UNAVAILABLE;
+        return SC_SOCKET_NONE;
+    }
+
+    *result = sc_adb_native_read_status(intr, socket, name, flags);
+    if (*result != SC_ADB_NATIVE_OK) {
+        net_close(socket);
+        return SC_SOCKET_NONE;
+    }
+
+    return socket;
+}
+
+enum sc_adb_native_result
+sc_adb_native_devices(struct sc_intr *intr, char **out, unsigned flags) {
+    enum sc_adb_native_result result;
+    sc_socket socket =
+        sc_adb_native_open(intr, "host:devices-l", "devices", flags, &result);
+    if (socket == SC_SOCKET_NONE) {
+        return result;
+    }
+
+    char *list = sc_adb_native_read_string(intr, socket);
+    net_close(socket);
+    if (!list) {
+        return SC_ADB_NATIVE_UNAVAILABLE;
+    }
+
+    // Add the header printed by `adb devices -l`, expected by the parser
+    char *output;
+    int r = asprintf(&output, "List of devices attached\n%s", list);
+    free(list);
+    if (r == -1) {
+        LOG_OOM();
+        return SC_ADB_NATIVE_UNAVAILABLE;
+    }
+
+    *out = output;
+    return SC_ADB_NATIVE_OK;
+}
+
+enum sc_adb_native_result
+sc_adb_native_track_devices(struct sc_intr *intr, sc_socket *socket,
+                            unsigned flags) {
+    enum sc_adb_native_result result;
+    *socket = sc_adb_native_open(intr, "host:track-devices-l", "track-devices",
+                                 flags, &result);
+    return result;
+}
+
+char *
+sc_adb_native_track_devices_next(struct sc_intr *intr, sc_socket socket) {
+    // Each change is notified by the whole list, in the same format as the
+    // reply to "host:devices-l"
+    char *list = sc_adb_native_read_string(intr, socket);
+    if (!list) {
+        return NULL;
+    }
+
+    char *output;
+    int r = asprintf(&output, "List of devices attached\n%s", list);
+    free(list);
+    if (r == -1) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    return output;
+}
+
+// Execute a forward/reverse request, which returns a second status once the
+// request is executed
+static enum sc_adb_native_result
+sc_adb_native_forward_request(struct sc_intr *intr, const char *serial,
+                              const char *request, bool device,
+                              const char *name, unsigned flags) {
+    enum sc_adb_native_result result;
+    sc_socket socket = device
+        ? sc_adb_native_open_device(intr, serial, request, name, flags, &result)
+        : sc_adb_native_open(intr, request, name, flags, &result);
+    if (socket == SC_SOCKET_NONE) {
+        return result;
+    }
+
+    result = sc_adb_native_read_status(intr, socket, name, flags);
+    net_close(socket);
+    return result;
+}
+
+enum sc_adb_native_result
+sc_adb_native_forward(struct sc_intr *intr, const char *serial,
+                      const char *local, const char *remote, unsigned flags) {
+    char *request;
+    if (asprintf(&request, "host-serial:%s:forward:%s;%s", serial, local,
+                 remote) == -1) {
+        LOG_OOM();
+        return SC_ADB_NATIVE_UNAVAILABLE;
+    }
+
+    enum sc_adb_native_result result =
+        sc_adb_native_forward_request(intr, serial, request, false, "forward",
+                                      flags);
+    free(request);
+    return result;
+}
+
+enum sc_adb_native_result
+sc_adb_native_forward_remove(struct sc_intr *intr, const char *serial,
+                             const char *local, unsigned flags) {
+    char *request;
+    if (asprintf(&request, "host-serial:%s:killforward:%s", serial,
+                 local) == -1) {
+        LOG_OOM();
+        return SC_ADB_NATIVE_UNAVAILABLE;
+    }
+
+    enum sc_adb_native_result result =
+        sc_adb_native_forward_request(intr, serial, request, false,
+                                      "forward --remove", flags);
+    free(request);
+    return result;
+}
+
+enum sc_adb_native_result
+sc_adb_native_reverse(struct sc_intr *intr, const char *serial,
+                      const char *remote, const char *local, unsigned flags) {
+    char *request;
+    if (asprintf(&request, "reverse:forward:%s;%s", remote, local) == -1) {
+        LOG_OOM();
+        return SC_ADB_NATIVE_UNAVAILABLE;
+    }
+
+    enum sc_adb_native_result result =
+        sc_adb_native_forward_request(intr, serial, request, true, "reverse",
+                                      flags);
+    free(request);
+    return result;
+}
+
+enum sc_adb_native_result
+sc_adb_native_reverse_remove(struct sc_intr *intr, const char *serial,
+                             const char *remote, unsigned flags) {
+    char *request;
+    if (asprintf(&request, "reverse:killforward:%s", remote) == -1) {
+        LOG_OOM();
+        return SC_ADB_NATIVE_UNAVAILABLE;
+    }
+
+    enum sc_adb_native_result result =
+        sc_adb_native_forward_request(intr, serial, request, true,
+                                      "reverse --remove", flags);
+    free(request);
+    return result;
+}
+
+static bool
+sc_adb_native_sync_send(struct sc_intr *intr, sc_socket socket, const char *id,
+                        uint32_t value, const void *data, size_t len) {
+    uint8_t header[8];
+    memcpy(header, id, 4);
+    sc_write32le(&header[4], value);
+
+    ssize_t w = net_send_all_intr(intr, socket, header, sizeof(header));
+    if (w != sizeof(header)) {
+        return false;
+    }
+
+    if (len) {
+        w = net_send_all_intr(intr, socket, data, len);
+        if (w != (ssize_t) len) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Return the remote path of the pushed file (like adb, if remote ends with
+// '/', the file is pushed into that directory)
+static char *
+sc_adb_native_get_push_path(const char *local, const char *remote) {
+    size_t len = strlen(remote);
+    if (!len || remote[len - 1] != '/') {
+        return strdup(remote);
+    }
+
+    const char *sep = strrchr(local, SC_PATH_SEPARATOR);
+    const char *name = sep ? sep + 1 : local;
+
+    char *path;
+    if (asprintf(&path, "%s%s", remote, name) == -1) {
+        return NULL;
+    }
+    return path;
+}
+
+// Push one file over an open sync session
+//
+// The session must not be reused on failure (the adb server closes it).
+static enum sc_adb_native_result
+sc_adb_native_sync_push_file(struct sc_intr *intr, sc_socket socket,
+                             FILE *file, const char *local, const char *remote,
+                             uint8_t *buf, unsigned flags) {
+    char *path = sc_adb_native_get_push_path(local, remote);
+    if (!path) {
+        LOG_OOM();
+        return SC_ADB_NATIVE_UNAVAILABLE;
+    }
+
+    // "SEND" <remote,mode>, with mode = regular file (0100000) | 0644
+    char *path_mode;
+    int r = asprintf(&path_mode, "%s,%d", path, 0100644);
+    free(path);
+    if (r == -1) {
+        LOG_OOM();
+        return SC_ADB_NATIVE_UNAVAILABLE;
+    }
+
+    // Any I/O error is reported as unavailable (so that the push is retried
+    // with the adb executable)
+    bool ok = sc_adb_native_sync_send(intr, socket, "SEND", r, path_mode, r);
+    free(path_mode);
+    if (!ok) {
+        return SC_ADB_NATIVE_UNAVAILABLE;
+    }
+
+    size_t n;
+    while ((n = fread(buf, 1, SC_ADB_SYNC_DATA_MAX, file)) > 0) {
+        ok = sc_adb_native_sync_send(intr, socket, "DATA", n, buf, n);
+        if (!ok) {
+            return SC_ADB_NATIVE_UNAVAILABLE;
+        }
+    }
+
+    if (ferror(file)) {
+        LOG_ADB_ERR(flags, "Could not read file: %s", local);
+        return SC_ADB_NATIVE_ERROR;
+    }
+
+    ok = sc_adb_native_sync_send(intr, socket, "DONE", (uint32_t) time(NULL),
+                                 NULL, 0);
+    if (!ok) {
+        return SC_ADB_NATIVE_UNAVAILABLE;
+    }
+
+    uint8_t reply[8];
+    ssize_t rr = net_recv_all_intr(intr, socket, reply, sizeof(reply));
+    if (rr != sizeof(reply)) {
+        return SC_ADB_NATIVE_UNAVAILABLE;
+    }
+
+    if (!memcmp(reply, "OKAY", 4)) {
+        return SC_ADB_NATIVE_OK;
+    }
+
+    if (!memcmp(reply, "FAIL", 4)) {
+        // The message length is in the header
+        uint32_t len = sc_read32le(&reply[4]);
+        char msg[256];
+        if (len >= sizeof(msg)) {
+            len = sizeof(msg) - 1;
+        }
+        rr = net_recv_all_intr(intr, socket, msg, len);
+        msg[rr > 0 ? (size_t) rr : 0] = '\0';
+        LOG_ADB_ERR(flags, "adb push %s: %s", local, msg);
+        return SC_ADB_NATIVE_ERROR;
+    }
+
+    LOGW("adb push: unexpected reply from the adb server");
+    return SC_ADB_NATIVE_UNAVAILABLE;
+}
+
+enum sc_adb_native_result
+sc_adb_native_push(struct sc_intr *intr, const char *serial, const char *local,
+                   const char *remote, unsigned flags) {
+    return sc_adb_native_push_files(intr, serial, &local, 1, remote, flags);
+}
+
+enum sc_adb_native_result
+sc_adb_native_push_files(struct sc_intr *intr, const char *serial,
+                         const char *const *locals, size_t count,
+                         const char *remote, unsigned flags) {
+    assert(count);
+
+    uint8_t *buf = malloc(SC_ADB_SYNC_DATA_MAX);
+    if (!buf) {
+        LOG_OOM();
+        return SC_ADB_NATIVE_UNAVAILABLE;
+    }
+
+    enum sc_adb_native_result result = SC_ADB_NATIVE_OK;
+    sc_socket socket = SC_SOCKET_NONE;
+
+    for (size_t i = 0; i < count; ++i) {
+        FILE *file = fopen(locals[i], "rb");
+        if (!file) {
+            LOG_ADB_ERR(flags, "Could not open file: %s", locals[i]);
+            result = SC_ADB_NATIVE_ERROR;
+            continue;
+        }
+
+        if (socket == SC_SOCKET_NONE) {
+            // Open the session lazily (it is closed after a failure)
+            enum sc_adb_native_result open_result;
+            socket = sc_adb_native_open_device(intr, serial, "sync:", "push",
+                                               flags, &open_result);
+            if (socket == SC_SOCKET_NONE) {
+                fclose(file);
+                result = open_result;
+                break;
+            }
+        }
+
+        enum sc_adb_native_result r =
+            sc_adb_native_sync_push_file(intr, socket, file, locals[i],
+                                         remote, buf, flags);
+        fclose(file);
+        if (r == SC_ADB_NATIVE_UNAVAILABLE) {
+            // The whole request will be retried with the adb executable
+            result = r;
+            break;
+        }
+        if (r == SC_ADB_NATIVE_ERROR) {
+            net_close(socket);
+            socket = SC_SOCKET_NONE;
+            result = r;
+        }
+    }
+
+    if (socket != SC_SOCKET_NONE) {
+        if (result != SC_ADB_NATIVE_UNAVAILABLE) {
+            // Terminate the sync session (ignore errors)
+            sc_adb_native_sync_send(intr, socket, "QUIT", 0, NULL, 0);
+        }
+        net_close(socket);
+    }
+
+    free(buf);
+    return result;
+}
+
+enum sc_adb_native_result
+sc_adb_native_shell(struct sc_intr *intr, const char *serial,
+                    const char *command, char *out, size_t cap,
+                    size_t *out_len, unsigned flags) {
+    char *service;
+    if (asprintf(&service, "shell,v2,raw:%s", command) == -1) {
+        LOG_OOM();
+        return SC_ADB_NATIVE_UNAVAILABLE;
+    }
+
+    enum sc_adb_native_result result;
+    // Do not log errors: the shell protocol v2 may not be supported by the
+    // device, in that case the adb executable will handle it
+    sc_socket socket =
+        sc_adb_native_open_device(intr, serial, service, "shell",
+                                  flags | SC_ADB_NO_LOGERR, &result);
+    free(service);
+    if (socket == SC_SOCKET_NONE) {
+        // Also fall back on FAIL
+        return SC_ADB_NATIVE_UNAVAILABLE;
+    }
+
+    size_t len = 0;
+    result = SC_ADB_NATIVE_UNAVAILABLE;
+
+    for (;;) {
+        // Packet: id (1 byte), length (4 bytes little-endian), data
+        uint8_t header[5];
+        ssize_t r = net_recv_all_intr(intr, socket, header, sizeof(header));
+        if (r != sizeof(header)) {
+            LOGD("adb shell: connection closed before the exit code");
+            break;
+        }
+
+        uint8_t id = header[0];
+        uint32_t remaining = sc_read32le(&header[1]);
+
+        if (id == SC_ADB_SHELL_ID_EXIT) {
+            uint8_t exit_code = 0;
+            if (remaining != 1
+                    || net_recv_all_intr(intr, socket, &exit_code, 1) != 1) {
+                break;
+            }
+            result = exit_code ? SC_ADB_NATIVE_ERROR : SC_ADB_NATIVE_OK;
+            if (exit_code) {
+                LOG_ADB_ERR(flags, "adb shell: exit code %u",
+                            (unsigned) exit_code);
+            }
+            break;
+        }
+
+        // Read (or discard) the packet data
+        bool ok = true;
+        while (remaining) {
+            char discard[256];
+            char *dst = discard;
+            size_t chunk = remaining < sizeof(discard) ? remaining
+                                                       : sizeof(discard);
+            if (id == SC_ADB_SHELL_ID_STDOUT && len < cap) {
+                dst = &out[len];
+                if (chunk > cap - len) {
+                    chunk = cap - len;
+                }
+            }
+
+            r = net_recv_all_intr(intr, socket, dst, chunk);
+            if (r != (ssize_t) chunk) {
+                ok = false;
+                break;
+            }
+
+            if (dst != discard) {
+                len += chunk;
+            }
+            remaining -= chunk;
+        }
+
+        if (!ok) {
+            break;
+        }
+    }
+
+    net_close(socket);
+
+    *out_len = len;
+    return result;
+}
@@ -0,0 +1,108 @@
+#ifndef SC_ADB_NATIVE_H
+#define SC_ADB_NATIVE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "util/intr.h"
+
+/**
+ * In-process client of the adb server (the "smart socket" protocol on
+ * localhost:5037), to avoid spawning an adb process for each operation.
+ *
+ * <https://android.googlesource.com/platform/packages/modules/adb/+/refs/heads/main/docs/dev/services.md>
+ */
+
+enum sc_adb_native_result {
+    SC_ADB_NATIVE_OK,
+    // The request has been rejected by the adb server (the error is logged)
+    SC_ADB_NATIVE_ERROR,
+    // The adb server could not be reached or did not behave as expected: the
+    // caller should fall back to the adb executable
+    SC_ADB_NATIVE_UNAVAILABLE,
+};
+
+/**
+ * Execute "host:devices-l"
+ *
+ * On success, *out receives the list in the same format as the output of
+ * `adb devices -l` (including the header). It must be freed by the caller.
+ */
+enum sc_adb_native_result
+sc_adb_native_devices(struct sc_intr *intr, char **out, unsigned flags);
+
+/**
+ * Execute "host:track-devices-l"
+ *
+ * On success, *socket receives the connection, on which the adb server sends
+ * the device list immediately, then each time it changes. It must be closed by
+ * the caller.
+ */
+enum sc_adb_native_result
+sc_adb_native_track_devices(struct sc_intr *intr, sc_socket *socket,
+                            unsigned flags);
+
+/**
+ * Wait for the next device list on a connection opened by
+ * sc_adb_native_track_devices()
+ *
+ * The list is in the same format as the output of `adb devices -l` (including
+ * the header). It must be freed by the caller.
+ *
+ * Return NULL if the connection is closed or interrupted.
+ */
+char *
+sc_adb_native_track_devices_next(struct sc_intr *intr, sc_socket socket);
+
+enum sc_adb_native_result
+sc_adb_native_forward(struct sc_intr *intr, const char *serial,
+                      const char *local, const char *remote, unsigned flags);
+
+enum sc_adb_native_result
+sc_adb_native_forward_remove(struct sc_intr *intr, const char *serial,
+                             const char *local, unsigned flags);
+
+enum sc_adb_native_result
+sc_adb_native_reverse(struct sc_intr *intr, const char *serial,
+                      const char *remote, const char *local, unsigned flags);
+
+enum sc_adb_native_result
+sc_adb_native_reverse_remove(struct sc_intr *intr, const char *serial,
+                             const char *remote, unsigned flags);
+
+/**
+ * Push a local file to the device (using the "sync:" service)
+ */
+enum sc_adb_native_result
+sc_adb_native_push(struct sc_intr *intr, const char *serial, const char *local,
+                   const char *remote, unsigned flags);
+
+/**
+ * Push several files to the device, in a single sync session
+ *
+ * If remote ends with '/', the files are pushed into that directory.
+ *
+ * The result is SC_ADB_NATIVE_ERROR if any file could not be pushed (the others
+ * are still pushed).
+ */
+enum sc_adb_native_result
+sc_adb_native_push_files(struct sc_intr *intr, const char *serial,
+                         const char *const *locals, size_t count,
+                         const char *remote, unsigned flags);
+
+/**
+ * Execute a shell command (using the shell protocol v2, to get the exit code)
+ *
+ * Up to cap bytes of stdout are written to out (the remaining is discarded),
+ * and the length is written to *out_len. Stderr is discarded.
+ *
+ * A non-zero exit code is reported as SC_ADB_NATIVE_ERROR.
+ */
+enum sc_adb_native_result
+sc_adb_native_shell(struct sc_intr *intr, const char *serial,
+                    const char *command, char *out, size_t cap,
+                    size_t *out_len, unsigned flags);
+
+#endif
@@ -199,6 +199,21 @@ sc_adb_parse_device_ip_from_line(char *line) {
     return strdup(ip);
 }
 
+bool
+sc_adb_parse_sha256sum(char *str) {
+    // The output looks like:
+    // "<64 hexadecimal digits>  /data/local/tmp/scrcpy-server.jar"
+    size_t len = strspn(str, "0123456789abcdef");
+    if (len != 64 || (str[len] != ' ' && str[len] != '\0'
+                                       && str[len] != '\r'
+                                       && str[len] != '\n')) {
+        return false;
+    }
+
+    str[len] = '\0';
+    return true;
+}
+
 char *
 sc_adb_parse_device_ip(char *str) {
     size_t idx_line = 0;
@@ -27,4 +27,15 @@ sc_adb_parse_devices(char *str, struct sc_vec_adb_devices *out_vec);
 char *
 sc_adb_parse_device_ip(char *str);
 
+/**
+ * Parse the hash from the output of `adb shell sha256sum <file>`
+ *
+ * The parameter must be a NUL-terminated string. On success, it is truncated
+ * to the 64 hexadecimal digits of the hash.
+ *
+ * Warning: this function modifies the buffer for optimization purposes.
+ */
+bool
+sc_adb_parse_sha256sum(char *str);
+
 #endif
@@ -0,0 +1,90 @@
+#include "adb_tracker.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "adb/adb.h"
+#include "adb/adb_native.h"
+#include "adb/adb_parser.h"
+#include "util/log.h"
+
+bool
+sc_adb_tracker_init(struct sc_adb_tracker *tracker) {
+    return sc_intr_init(&tracker->intr);
+}
+
+void
+sc_adb_tracker_destroy(struct sc_adb_tracker *tracker) {
+    sc_intr_destroy(&tracker->intr);
+}
+
+static int
+run_adb_tracker(void *data) {
+    struct sc_adb_tracker *tracker = data;
+    struct sc_intr *intr = &tracker->intr;
+
+    sc_socket socket;
+    enum sc_adb_native_result result =
+        sc_adb_native_track_devices(intr, &socket, SC_ADB_NO_LOGERR);
+    if (result != SC_ADB_NATIVE_OK) {
+        LOGD("Could not track adb devices");
+        goto end;
+    }
+
+    for (;;) {
+        char *list = sc_adb_native_track_devices_next(intr, socket);
+        if (!list) {
+            break;
+        }
+
+        struct sc_vec_adb_devices devices = SC_VECTOR_INITIALIZER;
+        bool ok = sc_adb_parse_devices(list, &devices);
+        free(list);
+        if (!ok) {
+            LOGW("Could not parse the tracked adb devices");
+            sc_adb_devices_destroy(&devices);
+            break;
+        }
+
+        tracker->cbs->on_devices(tracker, &devices, tracker->cbs_userdata);
+        sc_adb_devices_destroy(&devices);
+    }
+
+    net_close(socket);
+
+end:
+    if (!sc_intr_is_interrupted(intr)) {
+        LOGD("adb devices tracking ended");
+        tracker->cbs->on_ended(tracker, tracker->cbs_userdata);
+    }
+
+    return 0;
+}
+
+bool
+sc_adb_tracker_start(struct sc_adb_tracker *tracker,
+                     const struct sc_adb_tracker_callbacks *cbs,
+                     void *cbs_userdata) {
+    assert(cbs && cbs->on_devices && cbs->on_ended);
+    tracker->cbs = cbs;
+    tracker->cbs_userdata = cbs_userdata;
+
+    bool ok = sc_thread_create(&tracker->thread, run_adb_tracker,
+                               "scrcpy-adb-track", tracker);
+    if (!ok) {
+        LOGE("Could not start adb tracker thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_adb_tracker_stop(struct sc_adb_tracker *tracker) {
+    sc_intr_interrupt(&tracker->intr);
+}
+
+void
+sc_adb_tracker_join(struct sc_adb_tracker *tracker) {
+    sc_thread_join(&tracker->thread, NULL);
+}
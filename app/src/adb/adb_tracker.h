@@ -0,0 +1,52 @@
+#ifndef SC_ADB_TRACKER_H
+#define SC_ADB_TRACKER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+#include "adb/adb_device.h"
+#include "util/intr.h"
+#include "util/thread.h"
+
+/**
+ * Device tracker
+ *
+ * Receive the device list from the adb server ("host:track-devices-l") each
+ * time it changes, instead of polling it by executing `adb devices -l`.
+ */
+struct sc_adb_tracker {
+    sc_thread thread;
+    struct sc_intr intr;
+
+    const struct sc_adb_tracker_callbacks *cbs;
+    void *cbs_userdata;
+};
+
+struct sc_adb_tracker_callbacks {
+    // Called from the tracker thread on start and on every change
+    void (*on_devices)(struct sc_adb_tracker *tracker,
+                       struct sc_vec_adb_devices *devices, void *userdata);
+    // Called from the tracker thread if the devices could not be tracked
+    // anymore (not called if the tracker is stopped)
+    void (*on_ended)(struct sc_adb_tracker *tracker, void *userdata);
+};
+
+bool
+sc_adb_tracker_init(struct sc_adb_tracker *tracker);
+
+void
+sc_adb_tracker_destroy(struct sc_adb_tracker *tracker);
+
+bool
+sc_adb_tracker_start(struct sc_adb_tracker *tracker,
+                     const struct sc_adb_tracker_callbacks *cbs,
+                     void *cbs_userdata);
+
+void
+sc_adb_tracker_stop(struct sc_adb_tracker *tracker);
+
+void
+sc_adb_tracker_join(struct sc_adb_tracker *tracker);
+
+#endif
@@ -0,0 +1,445 @@
+#include "area_scaler.h"
+
+#include <assert.h>
+
+#include "util/log.h"
+
+// Maximum number of taps per axis (each bilinear tap averages up to 2x2
+// texels, so up to 16x downscaling is exact)
+#define SC_AREA_SCALER_MAX_TAPS 8u
+#define SC_AREA_SCALER_MAX_TAPS_STR "8"
+
+#define SC_AREA_SCALER_ATTRIB_POSITION 0
+#define SC_AREA_SCALER_ATTRIB_TEXCOORD 1
+
+// No #version: valid as GLSL 1.10 (OpenGL 2.0) and GLSL ES 1.00
+static const char *const vertex_shader_source =
+    "attribute vec2 a_position;\n"
+    "attribute vec2 a_texcoord;\n"
+    "varying vec2 v_texcoord;\n"
+    "void main() {\n"
+    "    v_texcoord = a_texcoord;\n"
+    "    gl_Position = vec4(a_position, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *const fragment_shader_source =
+    "#ifdef GL_ES\n"
+    "# ifdef GL_FRAGMENT_PRECISION_HIGH\n"
+    "precision highp float;\n"
+    "# else\n"
+    "precision mediump float;\n"
+    "# endif\n"
+    "#endif\n"
+    "#define MAX_TAPS " SC_AREA_SCALER_MAX_TAPS_STR "\n"
+    "uniform sampler2D tex_y;\n"
+    "uniform sampler2D tex_u; // interleaved UV for NV12\n"
+    "uniform sampler2D tex_v;\n"
+    "uniform int nv12;\n"
+    "uniform vec2 tap_step; // in texture coordinates\n"
+    "uniform vec2 tap_count;\n"
+    "uniform vec3 yuv_offset;\n"
+    "uniform mat3 yuv_matrix;\n"
+    "uniform int transfer; // 0: SDR, 1: PQ, 2: HLG\n"
+    "uniform float peak; // HDR peak, relative to the SDR reference white\n"
+    "varying vec2 v_texcoord;\n"
+    "vec3 sample_yuv(vec2 pos) {\n"
+    "    float y = texture2D(tex_y, pos).r;\n"
+    "    if (nv12 != 0) {\n"
+    "        return vec3(y, texture2D(tex_u, pos).ra);\n"
+    "    }\n"
+    "    return vec3(y, texture2D(tex_u, pos).r, texture2D(tex_v, pos).r);\n"
+    "}\n"
+    "vec3 pq_to_linear(vec3 e) {\n"
+    "    vec3 n = pow(e, vec3(1.0 / 78.84375));\n"
+    "    vec3 l = pow(max(n - 0.8359375, 0.0) / (18.8515625 - 18.6875 * n),\n"
+    "                 vec3(1.0 / 0.1593017578125));\n"
+    "    return l * (10000.0 / 203.0);\n"
+    "}\n"
+    "vec3 hlg_to_linear(vec3 e) {\n"
+    "    vec3 lo = e * e / 3.0;\n"
+    "    vec3 hi = (exp((e - 0.55991073) / 0.17883277) + 0.28466892) / 12.0;\n"
+    "    return mix(lo, hi, step(0.5, e)) / 0.26496256;\n"
+    "}\n"
+    "vec3 tone_map(vec3 rgb) {\n"
+    "    rgb = clamp(rgb, 0.0, 1.0);\n"
+    "    vec3 l = transfer == 1 ? pq_to_linear(rgb) : hlg_to_linear(rgb);\n"
+    "    // BT.2020 to BT.709 primaries, in linear light\n"
+    "    l = max(mat3(1.6605, -0.1246, -0.0182,\n"
+    "                 -0.5876, 1.1329, -0.1006,\n"
+    "                 -0.0728, -0.0083, 1.1187) * l, 0.0);\n"
+    "    // Extended Reinhard, mapping the peak to the SDR white\n"
+    "    l = l * (1.0 + l / (peak * peak)) / (1.0 + l);\n"
+    "    return pow(min(l, 1.0), vec3(1.0 / 2.2));\n"
+    "}\n"
+    "void main() {\n"
+    "    vec2 origin = v_texcoord - tap_step * (tap_count - 1.0) * 0.5;\n"
+    "    vec3 sum = vec3(0.0);\n"
+    "    for (int j = 0; j < MAX_TAPS; ++j) {\n"
+    "        if (float(j) >= tap_count.y) break;\n"
+    "        for (int i = 0; i < MAX_TAPS; ++i) {\n"
+    "            if (float(i) >= tap_count.x) break;\n"
+    "            sum += sample_yuv(origin + tap_step * vec2(i, j));\n"
+    "        }\n"
+    "    }\n"
+    "    vec3 yuv = sum / (tap_count.x * tap_count.y) + yuv_offset;\n"
+    "    vec3 rgb = yuv_matrix * yuv;\n"
+    "    if (transfer != 0) {\n"
+    "        rgb = tone_map(rgb);\n"
+    "    }\n"
+    "    gl_FragColor = vec4(rgb, 1.0);\n"
+    "}\n";
+
+// YUV to RGB conversions, matching the SDL renderers (the matrices are in
+// column-major order: the Y, U and V coefficients)
+static const struct sc_area_scaler_yuv {
+    GLfloat offset[3];
+    GLfloat matrix[9];
+} sc_area_scaler_yuv_jpeg = {
+    {0.f, -128.f / 255, -128.f / 255},
+    {1.f,    1.f,       1.f,
+     0.f,   -0.3441f,   1.772f,
+     1.402f, -0.7141f,  0.f},
+}, sc_area_scaler_yuv_bt601 = {
+    {-16.f / 255, -128.f / 255, -128.f / 255},
+    {1.1644f, 1.1644f, 1.1644f,
+     0.f,    -0.3918f, 2.0172f,
+     1.596f, -0.813f,  0.f},
+}, sc_area_scaler_yuv_bt709 = {
+    {-16.f / 255, -128.f / 255, -128.f / 255},
+    {1.1644f,  1.1644f, 1.1644f,
+     0.f,     -0.2132f, 2.1124f,
+     1.7927f, -0.5329f, 0.f},
+}, sc_area_scaler_yuv_bt2020 = {
+    {-16.f / 255, -128.f / 255, -128.f / 255},
+    {1.1644f,  1.1644f, 1.1644f,
+     0.f,     -0.1873f, 2.1418f,
+     1.6787f, -0.6504f, 0.f},
+};
+
+// Peak luminance assumed for tone mapping, relative to the SDR reference
+// white (203 nits for PQ, 75% signal for HLG)
+#define SC_AREA_SCALER_PQ_PEAK (1000.f / 203)
+#define SC_AREA_SCALER_HLG_PEAK (1.f / 0.26496256f)
+
+void
+sc_area_scaler_init(struct sc_area_scaler *scaler, struct sc_opengl *gl) {
+    assert(sc_opengl_has_shaders(gl));
+    scaler->gl = gl;
+    scaler->initialized = false;
+    scaler->failed = false;
+    scaler->program = 0;
+}
+
+static GLuint
+sc_area_scaler_compile_shader(struct sc_opengl *gl, GLenum type,
+                              const char *source) {
+    GLuint shader = gl->shader.CreateShader(type);
+    if (!shader) {
+        LOGW("Could not create shader");
+        return 0;
+    }
+
+    gl->shader.ShaderSource(shader, 1, &source, NULL);
+    gl->shader.CompileShader(shader);
+
+    GLint status;
+    gl->shader.GetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status) {
+        char log[512];
+        gl->shader.GetShaderInfoLog(shader, sizeof(log), NULL, log);
+        LOGW("Could not compile shader: %s", log);
+        gl->shader.DeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+static bool
+sc_area_scaler_create_program(struct sc_area_scaler *scaler) {
+    struct sc_opengl *gl = scaler->gl;
+
+    GLuint vs = sc_area_scaler_compile_shader(gl, GL_VERTEX_SHADER,
+                                              vertex_shader_source);
+    if (!vs) {
+        return false;
+    }
+
+    GLuint fs = sc_area_scaler_compile_shader(gl, GL_FRAGMENT_SHADER,
+                                              fragment_shader_source);
+    if (!fs) {
+        gl->shader.DeleteShader(vs);
+        return false;
+    }
+
+    GLuint program = gl->shader.CreateProgram();
+    if (!program) {
+        LOGW("Could not create shader program");
+        goto error_delete_shaders;
+    }
+
+    gl->shader.AttachShader(program, vs);
+    gl->shader.AttachShader(program, fs);
+    gl->shader.BindAttribLocation(program, SC_AREA_SCALER_ATTRIB_POSITION,
+                                  "a_position");
+    gl->shader.BindAttribLocation(program, SC_AREA_SCALER_ATTRIB_TEXCOORD,
+                                  "a_texcoord");
+    gl->shader.LinkProgram(program);
+
+    // The shaders are deleted once the program is deleted
+    gl->shader.DeleteShader(vs);
+    gl->shader.DeleteShader(fs);
+
+    GLint status;
+    gl->shader.GetProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) {
+        char log[512];
+        gl->shader.GetProgramInfoLog(program, sizeof(log), NULL, log);
+        LOGW("Could not link shader program: %s", log);
+        gl->shader.DeleteProgram(program);
+        return false;
+    }
+
+    scaler->program = program;
+    scaler->loc_tex_y = gl->shader.GetUniformLocation(program, "tex_y");
+    scaler->loc_tex_u = gl->shader.GetUniformLocation(program, "tex_u");
+    scaler->loc_tex_v = gl->shader.GetUniformLocation(program, "tex_v");
+    scaler->loc_nv12 = gl->shader.GetUniformLocation(program, "nv12");
+    scaler->loc_tap_step = gl->shader.GetUniformLocation(program, "tap_step");
+    scaler->loc_tap_count =
+        gl->shader.GetUniformLocation(program, "tap_count");
+    scaler->loc_yuv_offset =
+        gl->shader.GetUniformLocation(program, "yuv_offset");
+    scaler->loc_yuv_matrix =
+        gl->shader.GetUniformLocation(program, "yuv_matrix");
+    scaler->loc_transfer = gl->shader.GetUniformLocation(program, "transfer");
+    scaler->loc_peak = gl->shader.GetUniformLocation(program, "peak");
+
+    LOGI("Video shader enabled");
+    return true;
+
+error_delete_shaders:
+    gl->shader.DeleteShader(vs);
+    gl->shader.DeleteShader(fs);
+    return false;
+}
+
+static const struct sc_area_scaler_yuv *
+sc_area_scaler_get_yuv(struct sc_size texture_size,
+                       enum sc_area_scaler_transfer transfer) {
+    if (transfer != SC_AREA_SCALER_TRANSFER_SDR) {
+        // HDR video is BT.2020
+        return &sc_area_scaler_yuv_bt2020;
+    }
+
+    SDL_YUV_CONVERSION_MODE mode =
+        SDL_GetYUVConversionModeForResolution(texture_size.width,
+                                              texture_size.height);
+    switch (mode) {
+        case SDL_YUV_CONVERSION_JPEG:
+            return &sc_area_scaler_yuv_jpeg;
+        case SDL_YUV_CONVERSION_BT709:
+            return &sc_area_scaler_yuv_bt709;
+        default:
+            return &sc_area_scaler_yuv_bt601;
+    }
+}
+
+// Number of taps so that their spacing does not exceed 2 texels, for
+// `length` texels rendered to `extent` pixels
+static unsigned
+sc_area_scaler_get_tap_count(unsigned length, unsigned extent) {
+    unsigned count = (length + 2 * extent - 1) / (2 * extent);
+    return CLAMP(count, 1u, SC_AREA_SCALER_MAX_TAPS);
+}
+
+// Must be called with the texture bound (so that the renderer context is
+// current), with the texture coordinates scale returned by
+// SDL_GL_BindTexture()
+static bool
+sc_area_scaler_init_program(struct sc_area_scaler *scaler, float texw,
+                            float texh) {
+    if (texw != 1.f || texh != 1.f) {
+        // Rectangle texture (non-normalized coordinates), not supported
+        scaler->failed = true;
+        LOGW("Video shader disabled (non power-of-two textures not "
+             "supported)");
+        return false;
+    }
+
+    if (!scaler->initialized) {
+        scaler->initialized = true;
+        if (!sc_area_scaler_create_program(scaler)) {
+            scaler->failed = true;
+            LOGW("Video shader disabled");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void
+sc_area_scaler_prepare(struct sc_area_scaler *scaler, SDL_Texture *texture) {
+    if (scaler->initialized || scaler->failed) {
+        return;
+    }
+
+    float texw;
+    float texh;
+    if (SDL_GL_BindTexture(texture, &texw, &texh)) {
+        // Retried on first render
+        return;
+    }
+
+    sc_area_scaler_init_program(scaler, texw, texh);
+    SDL_GL_UnbindTexture(texture);
+}
+
+bool
+sc_area_scaler_render(struct sc_area_scaler *scaler, SDL_Renderer *renderer,
+                      SDL_Texture *texture, struct sc_size texture_size,
+                      bool nv12, enum sc_area_scaler_transfer transfer,
+                      const SDL_Rect *dst, enum sc_orientation orientation) {
+    if (scaler->failed || dst->w <= 0 || dst->h <= 0) {
+        return false;
+    }
+
+    if (SDL_GetRenderTarget(renderer)) {
+        // Only the window framebuffer is supported
+        return false;
+    }
+
+    int output_w;
+    int output_h;
+    if (SDL_GetRendererOutputSize(renderer, &output_w, &output_h)) {
+        return false;
+    }
+
+    // Flush the pending SDL render commands and make the renderer context
+    // current, with the Y, U and V (or UV) planes bound to the texture units
+    // 0, 1 and 2
+    float texw;
+    float texh;
+    if (SDL_GL_BindTexture(texture, &texw, &texh)) {
+        return false;
+    }
+
+    struct sc_opengl *gl = scaler->gl;
+
+    if (!sc_area_scaler_init_program(scaler, texw, texh)) {
+        SDL_GL_UnbindTexture(texture);
+        return false;
+    }
+
+    // Save the state changed below, which is tracked by the SDL renderer
+    GLint prev_program;
+    GLint prev_active_texture;
+    GLint prev_array_buffer;
+    GLint prev_viewport[4];
+    GLint prev_position_enabled;
+    GLint prev_texcoord_enabled;
+    gl->shader.GetIntegerv(GL_CURRENT_PROGRAM, &prev_program);
+    gl->shader.GetIntegerv(GL_ACTIVE_TEXTURE, &prev_active_texture);
+    gl->shader.GetIntegerv(GL_ARRAY_BUFFER_BINDING, &prev_array_buffer);
+    gl->shader.GetIntegerv(GL_VIEWPORT, prev_viewport);
+    gl->shader.GetVertexAttribiv(SC_AREA_SCALER_ATTRIB_POSITION,
+                                 GL_VERTEX_ATTRIB_ARRAY_ENABLED,
+                                 &prev_position_enabled);
+    gl->shader.GetVertexAttribiv(SC_AREA_SCALER_ATTRIB_TEXCOORD,
+                                 GL_VERTEX_ATTRIB_ARRAY_ENABLED,
+                                 &prev_texcoord_enabled);
+    GLboolean prev_blend = gl->shader.IsEnabled(GL_BLEND);
+
+    // The destination extent along each texture axis
+    bool swap = sc_orientation_is_swap(orientation);
+    int extent_x = swap ? dst->h : dst->w;
+    int extent_y = swap ? dst->w : dst->h;
+    unsigned taps_x =
+        sc_area_scaler_get_tap_count(texture_size.width, extent_x);
+    unsigned taps_y =
+        sc_area_scaler_get_tap_count(texture_size.height, extent_y);
+
+    const struct sc_area_scaler_yuv *yuv =
+        sc_area_scaler_get_yuv(texture_size, transfer);
+
+    gl->shader.UseProgram(scaler->program);
+    gl->shader.Uniform1i(scaler->loc_tex_y, 0);
+    gl->shader.Uniform1i(scaler->loc_tex_u, 1);
+    gl->shader.Uniform1i(scaler->loc_tex_v, 2);
+    gl->shader.Uniform1i(scaler->loc_nv12, nv12);
+    gl->shader.Uniform2f(scaler->loc_tap_step, 1.f / (extent_x * taps_x),
+                                               1.f / (extent_y * taps_y));
+    gl->shader.Uniform2f(scaler->loc_tap_count, taps_x, taps_y);
+    gl->shader.Uniform3f(scaler->loc_yuv_offset, yuv->offset[0],
+                         yuv->offset[1], yuv->offset[2]);
+    gl->shader.UniformMatrix3fv(scaler->loc_yuv_matrix, 1, GL_FALSE,
+                                yuv->matrix);
+    gl->shader.Uniform1i(scaler->loc_transfer, transfer);
+    float peak = transfer == SC_AREA_SCALER_TRANSFER_HLG
+               ? SC_AREA_SCALER_HLG_PEAK : SC_AREA_SCALER_PQ_PEAK;
+    gl->shader.Uniform1f(scaler->loc_peak, peak);
+
+    // Texture corners in clockwise order, starting from the top-left
+    static const GLfloat corners[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+    // Horizontally flipped (applied before the rotation, like SDL)
+    static const GLfloat mirror_corners[4][2] =
+        {{1, 0}, {0, 0}, {0, 1}, {1, 1}};
+    const GLfloat (*tex)[2] = sc_orientation_is_mirror(orientation)
+                            ? mirror_corners : corners;
+    unsigned rotation = sc_orientation_get_rotation(orientation);
+
+    // Destination corners (in normalized device coordinates), in the same
+    // order
+    GLfloat left = 2.f * dst->x / output_w - 1;
+    GLfloat right = 2.f * (dst->x + dst->w) / output_w - 1;
+    GLfloat top = 1 - 2.f * dst->y / output_h;
+    GLfloat bottom = 1 - 2.f * (dst->y + dst->h) / output_h;
+    GLfloat positions[4][2] = {
+        {left, top}, {right, top}, {right, bottom}, {left, bottom},
+    };
+
+    GLfloat vertices[4][4];
+    for (unsigned i = 0; i < 4; ++i) {
+        // Rotating clockwise moves each texture corner to the next
+        // destination corner
+        const GLfloat *t = tex[(i + 4 - rotation) % 4];
+        vertices[i][0] = positions[i][0];
+        vertices[i][1] = positions[i][1];
+        vertices[i][2] = t[0];
+        vertices[i][3] = t[1];
+    }
+
+    gl->shader.Viewport(0, 0, output_w, output_h);
+    gl->shader.Disable(GL_BLEND);
+    gl->shader.BindBuffer(GL_ARRAY_BUFFER, 0);
+    gl->shader.VertexAttribPointer(SC_AREA_SCALER_ATTRIB_POSITION, 2,
+                                   GL_FLOAT, GL_FALSE, sizeof(vertices[0]),
+                                   &vertices[0][0]);
+    gl->shader.VertexAttribPointer(SC_AREA_SCALER_ATTRIB_TEXCOORD, 2,
+                                   GL_FLOAT, GL_FALSE, sizeof(vertices[0]),
+                                   &vertices[0][2]);
+    gl->shader.EnableVertexAttribArray(SC_AREA_SCALER_ATTRIB_POSITION);
+    gl->shader.EnableVertexAttribArray(SC_AREA_SCALER_ATTRIB_TEXCOORD);
+
+    gl->shader.DrawArrays(GL_TRIANGLE_FAN, 0, 4);
+
+    // Restore the state
+    if (!prev_position_enabled) {
+        gl->shader.DisableVertexAttribArray(SC_AREA_SCALER_ATTRIB_POSITION);
+    }
+    if (!prev_texcoord_enabled) {
+        gl->shader.DisableVertexAttribArray(SC_AREA_SCALER_ATTRIB_TEXCOORD);
+    }
+    gl->shader.BindBuffer(GL_ARRAY_BUFFER, prev_array_buffer);
+    if (prev_blend) {
+        gl->shader.Enable(GL_BLEND);
+    }
+    gl->shader.Viewport(prev_viewport[0], prev_viewport[1], prev_viewport[2],
+                        prev_viewport[3]);
+    gl->shader.UseProgram(prev_program);
+    gl->shader.ActiveTexture(prev_active_texture);
+
+    SDL_GL_UnbindTexture(texture);
+    return true;
+}
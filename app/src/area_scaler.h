@@ -0,0 +1,82 @@
+#ifndef SC_AREA_SCALER_H
+#define SC_AREA_SCALER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+#include "coords.h"
+#include "opengl.h"
+#include "options.h"
+
+/**
+ * Downscale the video texture in a single pass, with a fragment shader
+ * averaging all the texels covered by each destination pixel (area
+ * averaging), and converting from YUV to RGB
+ *
+ * Contrary to mipmaps, nothing needs to be generated when the texture is
+ * updated.
+ *
+ * HDR frames (PQ or HLG transfer) are also tone mapped to SDR by the same
+ * shader.
+ *
+ * The shader is drawn directly with OpenGL calls, between the SDL renderer
+ * commands, restoring the OpenGL state it changes.
+ */
+struct sc_area_scaler {
+    struct sc_opengl *gl;
+
+    // The program is compiled lazily, with the renderer context current (it
+    // is released with the context)
+    bool initialized;
+    bool failed;
+    GLuint program;
+    GLint loc_tex_y;
+    GLint loc_tex_u;
+    GLint loc_tex_v;
+    GLint loc_nv12;
+    GLint loc_tap_step;
+    GLint loc_tap_count;
+    GLint loc_yuv_offset;
+    GLint loc_yuv_matrix;
+    GLint loc_transfer;
+    GLint loc_peak;
+};
+
+// Transfer function of the video frames
+enum sc_area_scaler_transfer {
+    SC_AREA_SCALER_TRANSFER_SDR,
+    SC_AREA_SCALER_TRANSFER_PQ, // SMPTE ST 2084 (HDR10)
+    SC_AREA_SCALER_TRANSFER_HLG, // ARIB STD-B67
+};
+
+void
+sc_area_scaler_init(struct sc_area_scaler *scaler, struct sc_opengl *gl);
+
+/**
+ * Compile the shader program ahead of the first render, with the context of
+ * the renderer owning `texture`
+ *
+ * It is otherwise compiled on the first render.
+ */
+void
+sc_area_scaler_prepare(struct sc_area_scaler *scaler, SDL_Texture *texture);
+
+/**
+ * Render the YUV `texture` (of format SDL_PIXELFORMAT_YV12 or
+ * SDL_PIXELFORMAT_NV12) to `dst`, like SDL_RenderCopyEx() would for the given
+ * orientation
+ *
+ * If `transfer` is not SDR, the frame (BT.2020) is tone mapped to SDR (BT.709).
+ *
+ * Return false if it could not render (the caller must then fall back to the
+ * SDL renderer).
+ */
+bool
+sc_area_scaler_render(struct sc_area_scaler *scaler, SDL_Renderer *renderer,
+                      SDL_Texture *texture, struct sc_size texture_size,
+                      bool nv12, enum sc_area_scaler_transfer transfer,
+                      const SDL_Rect *dst, enum sc_orientation orientation);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef SC_AUDIO_OUTPUT_H
+#define SC_AUDIO_OUTPUT_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Native low-latency audio output
+ *
+ * SDL adds its own buffering layer on top of the system audio API (notably on
+ * macOS). The native output instead requests the samples directly from the
+ * audio callback of the system (Core Audio on macOS, ALSA on Linux), with the
+ * smallest period supported by the device.
+ *
+ * The samples are interleaved 32-bit floats.
+ */
+
+#if defined(__APPLE__) || defined(HAVE_ALSA)
+# define SC_AUDIO_OUTPUT_NATIVE
+#endif
+
+#ifdef SC_AUDIO_OUTPUT_NATIVE
+
+// Called from the audio thread to fill `out` with `samples` samples (it must
+// never block)
+typedef void (*sc_audio_output_pull_fn)(void *userdata, uint8_t *out,
+                                        uint32_t samples);
+
+struct sc_audio_output;
+
+/**
+ * Open the default audio output device
+ *
+ * The period is the requested number of samples per callback. It is increased
+ * if the device does not support it.
+ *
+ * Return NULL on error.
+ */
+struct sc_audio_output *
+sc_audio_output_open(uint32_t sample_rate, uint8_t channels, uint32_t period,
+                     sc_audio_output_pull_fn pull, void *userdata);
+
+bool
+sc_audio_output_start(struct sc_audio_output *output);
+
+/**
+ * Stop the playback and close the device
+ */
+void
+sc_audio_output_close(struct sc_audio_output *output);
+
+#endif
+
+#endif
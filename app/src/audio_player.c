@@ -1,12 +1,43 @@
 #include "audio_player.h"
 
 #include "util/log.h"
+#include "util/thread.h"
+#include "util/trace.h"
 
 /** Downcast frame_sink to sc_audio_player */
 #define DOWNCAST(SINK) container_of(SINK, struct sc_audio_player, frame_sink)
 
 #define SC_SDL_SAMPLE_FMT AUDIO_F32
 
+static void
+sc_audio_player_update_av_sync(struct sc_audio_player *ap) {
+    // Before the playback starts, the buffered samples are not played yet
+    bool played = atomic_load_explicit(&ap->audioreg.played,
+                                       memory_order_relaxed);
+    int64_t pts;
+    if (!played || !sc_audio_regulator_get_next_pts(&ap->audioreg, &pts)) {
+        return;
+    }
+
+    // The samples pulled now are played after the output buffer
+    sc_tick now = sc_tick_now();
+    sc_tick offset = now + ap->output_buffer_duration - SC_TICK_FROM_US(pts);
+    sc_av_sync_update_audio(ap->av_sync, now, offset);
+}
+
+static void
+sc_audio_player_pull(void *userdata, uint8_t *out, uint32_t samples) {
+    struct sc_audio_player *ap = userdata;
+
+    if (ap->av_sync) {
+        sc_audio_player_update_av_sync(ap);
+    }
+
+    sc_tick start = sc_trace_begin();
+    sc_audio_regulator_pull(&ap->audioreg, out, samples);
+    sc_trace_end("audio regulator pull", start);
+}
+
 static void SDLCALL
 sc_audio_player_sdl_callback(void *userdata, uint8_t *stream, int len_int) {
     struct sc_audio_player *ap = userdata;
@@ -17,7 +48,76 @@ sc_audio_player_sdl_callback(void *userdata, uint8_t *stream, int len_int) {
     assert(len % ap->audioreg.sample_size == 0);
     uint32_t out_samples = len / ap->audioreg.sample_size;
 
-    sc_audio_regulator_pull(&ap->audioreg, stream, out_samples);
+    sc_audio_player_pull(ap, stream, out_samples);
+}
+
+#ifdef SC_AUDIO_OUTPUT_NATIVE
+static bool
+sc_audio_player_open_native(struct sc_audio_player *ap, uint32_t sample_rate,
+                            uint8_t nb_channels, uint32_t period) {
+    ap->native = sc_audio_output_open(sample_rate, nb_channels, period,
+                                      sc_audio_player_pull, ap);
+    if (!ap->native) {
+        return false;
+    }
+
+    if (!sc_audio_output_start(ap->native)) {
+        sc_audio_output_close(ap->native);
+        ap->native = NULL;
+        return false;
+    }
+
+    return true;
+}
+#endif
+
+static bool
+sc_audio_player_open_sdl(struct sc_audio_player *ap, uint32_t sample_rate,
+                         uint8_t nb_channels, uint32_t period) {
+    assert(period <= 0xFFFF);
+
+    SDL_AudioSpec desired = {
+        .freq = sample_rate,
+        .format = SC_SDL_SAMPLE_FMT,
+        .channels = nb_channels,
+        .samples = period,
+        .callback = sc_audio_player_sdl_callback,
+        .userdata = ap,
+    };
+    SDL_AudioSpec obtained;
+
+    ap->device = SDL_OpenAudioDevice(NULL, 0, &desired, &obtained, 0);
+    if (!ap->device) {
+        LOGE("Could not open audio device: %s", SDL_GetError());
+        return false;
+    }
+
+    SDL_PauseAudioDevice(ap->device, 0);
+    return true;
+}
+
+static bool
+sc_audio_player_open_output(struct sc_audio_player *ap, uint32_t sample_rate,
+                            uint8_t nb_channels, uint32_t period) {
+#ifdef SC_AUDIO_OUTPUT_NATIVE
+    ap->native = NULL;
+    if (ap->backend != SC_AUDIO_OUTPUT_BACKEND_SDL) {
+        if (sc_audio_player_open_native(ap, sample_rate, nb_channels,
+                                        period)) {
+            return true;
+        }
+
+        if (ap->backend == SC_AUDIO_OUTPUT_BACKEND_NATIVE) {
+            return false;
+        }
+
+        LOGW("Could not open the native audio output, fallback to SDL");
+    }
+#else
+    assert(ap->backend != SC_AUDIO_OUTPUT_BACKEND_NATIVE);
+#endif
+
+    return sc_audio_player_open_sdl(ap, sample_rate, nb_channels, period);
 }
 
 static bool
@@ -25,7 +125,11 @@ sc_audio_player_frame_sink_push(struct sc_frame_sink *sink,
                                 const AVFrame *frame) {
     struct sc_audio_player *ap = DOWNCAST(sink);
 
-    return sc_audio_regulator_push(&ap->audioreg, frame);
+    sc_tick start = sc_trace_begin();
+    bool ok = sc_audio_regulator_push(&ap->audioreg, frame);
+    sc_trace_end("audio regulator push", start);
+
+    return ok;
 }
 
 static bool
@@ -49,10 +153,14 @@ sc_audio_player_frame_sink_open(struct sc_frame_sink *sink,
 
     uint32_t target_buffering_samples =
         ap->target_buffering_delay * ctx->sample_rate / SC_TICK_FREQ;
+    uint32_t max_target_buffering_samples =
+        ap->max_target_buffering_delay * ctx->sample_rate / SC_TICK_FREQ;
 
     size_t sample_size = nb_channels * out_bytes_per_sample;
     bool ok = sc_audio_regulator_init(&ap->audioreg, sample_size, ctx,
-                                      target_buffering_samples);
+                                      target_buffering_samples,
+                                      max_target_buffering_samples,
+                                      ap->concealment);
     if (!ok) {
         return false;
     }
@@ -61,33 +169,21 @@ sc_audio_player_frame_sink_open(struct sc_frame_sink *sink,
                                                        / SC_TICK_FREQ;
     assert(aout_samples <= 0xFFFF);
 
-    SDL_AudioSpec desired = {
-        .freq = ctx->sample_rate,
-        .format = SC_SDL_SAMPLE_FMT,
-        .channels = nb_channels,
-        .samples = aout_samples,
-        .callback = sc_audio_player_sdl_callback,
-        .userdata = ap,
-    };
-    SDL_AudioSpec obtained;
-
-    ap->device = SDL_OpenAudioDevice(NULL, 0, &desired, &obtained, 0);
-    if (!ap->device) {
-        LOGE("Could not open audio device: %s", SDL_GetError());
+    ok = sc_audio_player_open_output(ap, ctx->sample_rate, nb_channels,
+                                     aout_samples);
+    if (!ok) {
         sc_audio_regulator_destroy(&ap->audioreg);
         return false;
     }
 
     // The thread calling open() is the thread calling push(), which fills the
-    // audio buffer consumed by the SDL audio thread.
+    // audio buffer consumed by the audio output thread.
     ok = sc_thread_set_priority(SC_THREAD_PRIORITY_TIME_CRITICAL);
     if (!ok) {
         ok = sc_thread_set_priority(SC_THREAD_PRIORITY_HIGH);
         (void) ok; // We don't care if it worked, at least we tried
     }
 
-    SDL_PauseAudioDevice(ap->device, 0);
-
     return true;
 }
 
@@ -95,18 +191,31 @@ static void
 sc_audio_player_frame_sink_close(struct sc_frame_sink *sink) {
     struct sc_audio_player *ap = DOWNCAST(sink);
 
-    assert(ap->device);
-    SDL_PauseAudioDevice(ap->device, 1);
-    SDL_CloseAudioDevice(ap->device);
+#ifdef SC_AUDIO_OUTPUT_NATIVE
+    if (ap->native) {
+        sc_audio_output_close(ap->native);
+    } else
+#endif
+    {
+        assert(ap->device);
+        SDL_PauseAudioDevice(ap->device, 1);
+        SDL_CloseAudioDevice(ap->device);
+    }
 
     sc_audio_regulator_destroy(&ap->audioreg);
 }
 
 void
 sc_audio_player_init(struct sc_audio_player *ap, sc_tick target_buffering,
-                     sc_tick output_buffer_duration) {
+                     sc_tick max_target_buffering,
+                     sc_tick output_buffer_duration,
+                     enum sc_audio_output_backend backend, bool concealment) {
     ap->target_buffering_delay = target_buffering;
+    ap->max_target_buffering_delay = max_target_buffering;
     ap->output_buffer_duration = output_buffer_duration;
+    ap->backend = backend;
+    ap->concealment = concealment;
+    ap->av_sync = NULL;
 
     static const struct sc_frame_sink_ops ops = {
         .open = sc_audio_player_frame_sink_open,
@@ -116,3 +225,9 @@ sc_audio_player_init(struct sc_audio_player *ap, sc_tick target_buffering,
 
     ap->frame_sink.ops = &ops;
 }
+
+void
+sc_audio_player_set_av_sync(struct sc_audio_player *ap,
+                            struct sc_av_sync *av_sync) {
+    ap->av_sync = av_sync;
+}
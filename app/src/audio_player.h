@@ -5,7 +5,10 @@
 
 #include <SDL2/SDL_audio.h>
 
+#include "audio_output.h"
 #include "audio_regulator.h"
+#include "av_sync.h"
+#include "options.h"
 #include "trait/frame_sink.h"
 #include "util/tick.h"
 
@@ -19,15 +22,38 @@ struct sc_audio_player {
     // value should be higher.
     sc_tick target_buffering_delay;
 
-    // SDL audio output buffer size
+    // If not 0, the target buffering adapts to the measured jitter, between
+    // target_buffering_delay and this value
+    sc_tick max_target_buffering_delay;
+
+    // Audio output buffer size
     sc_tick output_buffer_duration;
 
+    enum sc_audio_output_backend backend;
+
+    // Conceal underflows instead of inserting silence
+    bool concealment;
+
+    // If set, the audio clock is published for A/V sync (--av-sync)
+    struct sc_av_sync *av_sync;
+
+#ifdef SC_AUDIO_OUTPUT_NATIVE
+    struct sc_audio_output *native; // NULL if SDL is used
+#endif
     SDL_AudioDeviceID device;
     struct sc_audio_regulator audioreg;
 };
 
 void
 sc_audio_player_init(struct sc_audio_player *ap, sc_tick target_buffering,
-                     sc_tick audio_output_buffer);
+                     sc_tick max_target_buffering,
+                     sc_tick audio_output_buffer,
+                     enum sc_audio_output_backend backend, bool concealment);
+
+// Publish the audio clock to `av_sync` (it must be called before the player is
+// opened)
+void
+sc_audio_player_set_av_sync(struct sc_audio_player *ap,
+                            struct sc_av_sync *av_sync);
 
 #endif
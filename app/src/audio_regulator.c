@@ -8,6 +8,7 @@
 #include <libavutil/opt.h>
 
 #include "util/log.h"
+#include "util/tick.h"
 
 //#define SC_AUDIO_REGULATOR_DEBUG // uncomment to debug
 
@@ -54,8 +55,24 @@
  * Therefore, the regulator doesn't drop any sample on underflow. The
  * compensation mechanism will absorb the delay introduced by the inserted
  * silence.
+ *
+ * Unless disabled (--no-audio-concealment), the inserted samples are not
+ * silent: the last played samples are repeated with a fade-out (packet loss
+ * concealment), which makes short underflows much less audible.
+ *
+ * Optionally (--audio-buffer-max), the target buffering is adaptive: the
+ * regulator measures the jitter of packet arrivals (the spread of the transit
+ * delays, since the clock offset between the device and the computer is
+ * unknown but constant), and moves the target between --audio-buffer and
+ * --audio-buffer-max accordingly. The target increases immediately, but
+ * decreases slowly.
  */
 
+// Duration of the last played samples repeated on underflow
+#define SC_AUDIO_REGULATOR_PLC_PERIOD_MS 10
+// Duration of the fade-out of the concealment
+#define SC_AUDIO_REGULATOR_PLC_FADE_MS 40
+
 #define TO_BYTES(SAMPLES) sc_audiobuf_to_bytes(&ar->buf, (SAMPLES))
 #define TO_SAMPLES(BYTES) sc_audiobuf_to_samples(&ar->buf, (BYTES))
 
@@ -66,10 +83,8 @@ sc_audio_regulator_pull(struct sc_audio_regulator *ar, uint8_t *out,
     LOGD("[Audio] Audio regulator pulls %" PRIu32 " samples", out_samples);
 #endif
 
-    // A lock is necessary in the rare case where the producer needs to drop
-    // samples already pushed (when the buffer is full)
-    sc_mutex_lock(&ar->mutex);
-
+    // The target buffering is read only before playback starts (it may be
+    // updated by the producer afterwards)
     bool played = atomic_load_explicit(&ar->played, memory_order_relaxed);
     if (!played) {
         uint32_t buffered_samples = sc_audiobuf_can_read(&ar->buf);
@@ -84,14 +99,17 @@ sc_audio_regulator_pull(struct sc_audio_regulator *ar, uint8_t *out,
             // whole buffer with silence (len is small compared to the
             // arbitrary margin value).
             memset(out, 0, out_samples * ar->sample_size);
-            sc_mutex_unlock(&ar->mutex);
             return;
         }
     }
 
+    // The producer may drop old samples concurrently (when the buffer is
+    // full): sc_audiobuf_read() handles it without locking
     uint32_t read = sc_audiobuf_read(&ar->buf, out, out_samples);
 
-    sc_mutex_unlock(&ar->mutex);
+    if (ar->concealment) {
+        sc_audio_plc_record(&ar->plc, (const float *) out, read);
+    }
 
     if (read < out_samples) {
         uint32_t silence = out_samples - read;
@@ -104,10 +122,15 @@ sc_audio_regulator_pull(struct sc_audio_regulator *ar, uint8_t *out,
         LOGD("[Audio] Buffer underflow, inserting silence: %" PRIu32 " samples",
              silence);
 #endif
-        memset(out + TO_BYTES(read), 0, TO_BYTES(silence));
-
         bool received = atomic_load_explicit(&ar->received,
                                              memory_order_relaxed);
+        if (received && ar->concealment) {
+            sc_audio_plc_conceal(&ar->plc, (float *) (out + TO_BYTES(read)),
+                                 silence);
+        } else {
+            memset(out + TO_BYTES(read), 0, TO_BYTES(silence));
+        }
+
         if (received) {
             // Inserting additional samples immediately increases buffering
             atomic_fetch_add_explicit(&ar->underflow, silence,
@@ -115,7 +138,9 @@ sc_audio_regulator_pull(struct sc_audio_regulator *ar, uint8_t *out,
         }
     }
 
-    atomic_store_explicit(&ar->played, true, memory_order_relaxed);
+    // Release, so that the producer may update target_buffering once it
+    // observes that the playback started
+    atomic_store_explicit(&ar->played, true, memory_order_release);
 }
 
 static uint8_t *
@@ -137,6 +162,43 @@ sc_audio_regulator_get_swr_buf(struct sc_audio_regulator *ar,
     return ar->swr_buf;
 }
 
+static void
+sc_audio_regulator_update_target(struct sc_audio_regulator *ar) {
+    assert(ar->max_target_buffering);
+
+    int64_t min_transit = sc_percentile_window_get(&ar->transit, 0);
+    int64_t max_transit = sc_percentile_window_get(&ar->transit, 99);
+    sc_tick jitter = max_transit - min_transit;
+
+    int64_t needed = ar->min_target_buffering
+                   + jitter * ar->sample_rate / SC_TICK_FREQ;
+    needed = CLAMP(needed, ar->min_target_buffering, ar->max_target_buffering);
+
+    // Increase the target immediately, but decrease it slowly
+    sc_average_push(&ar->avg_target, needed);
+    uint32_t target = MAX(needed, (int64_t) sc_average_get(&ar->avg_target));
+    if (target != ar->target_buffering) {
+        LOGV("[Audio] Target buffering: %" PRIu32 " -> %" PRIu32 " samples "
+             "(jitter=%" PRItick "ms)", ar->target_buffering, target,
+             SC_TICK_TO_MS(jitter));
+        ar->target_buffering = target;
+    }
+}
+
+bool
+sc_audio_regulator_get_next_pts(struct sc_audio_regulator *ar, int64_t *pts) {
+    // A concurrent push may make the estimation off by one packet (the caller
+    // is expected to smooth the values)
+    int64_t pts_end = atomic_load_explicit(&ar->pts_end, memory_order_relaxed);
+    uint32_t can_read = sc_audiobuf_can_read(&ar->buf);
+    if (pts_end < 0 || !can_read) {
+        return false;
+    }
+
+    *pts = pts_end - can_read * INT64_C(1000000) / ar->sample_rate;
+    return true;
+}
+
 bool
 sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
     SwrContext *swr_ctx = ar->swr_ctx;
@@ -171,6 +233,11 @@ sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
                             / ar->sample_rate;
     ar->next_expected_pts = pts + packet_duration;
 
+    if (ar->max_target_buffering) {
+        // The pts is in microseconds, like sc_tick
+        sc_percentile_window_push(&ar->transit, sc_tick_now() - pts);
+    }
+
     int64_t swr_delay = swr_get_delay(swr_ctx, ar->sample_rate);
     // No need to av_rescale_rnd(), input and output sample rates are the same.
     // Add more space (256) for clock compensation.
@@ -210,24 +277,17 @@ sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
     if (written < samples) {
         uint32_t remaining = samples - written;
 
-        // All samples that could be written without locking have been written,
-        // now we need to lock to drop/consume old samples
-        sc_mutex_lock(&ar->mutex);
-
-        // Retry with the lock
+        // Retry, the consumer may have read samples in the meantime
         written += sc_audiobuf_write(&ar->buf,
                                      swr_buf + TO_BYTES(written),
                                      remaining);
         if (written < samples) {
             remaining = samples - written;
-            // Still insufficient, drop old samples to make space
-            skipped_samples = sc_audiobuf_read(&ar->buf, NULL, remaining);
-            assert(skipped_samples == remaining);
-        }
-
-        sc_mutex_unlock(&ar->mutex);
+            // Still insufficient, drop old samples to make space. The consumer
+            // may read concurrently, so fewer samples may be dropped, but in
+            // any case, there is enough space afterwards.
+            skipped_samples = sc_audiobuf_drop(&ar->buf, remaining);
 
-        if (written < samples) {
             // Now there is enough space
             uint32_t w = sc_audiobuf_write(&ar->buf,
                                            swr_buf + TO_BYTES(written),
@@ -237,9 +297,12 @@ sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
         }
     }
 
+    atomic_store_explicit(&ar->pts_end, ar->next_expected_pts,
+                          memory_order_relaxed);
+
     uint32_t underflow = 0;
     uint32_t max_buffered_samples;
-    bool played = atomic_load_explicit(&ar->played, memory_order_relaxed);
+    bool played = atomic_load_explicit(&ar->played, memory_order_acquire);
     if (played) {
         underflow = atomic_exchange_explicit(&ar->underflow, 0,
                                              memory_order_relaxed);
@@ -257,18 +320,10 @@ sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
 
     uint32_t can_read = sc_audiobuf_can_read(&ar->buf);
     if (can_read > max_buffered_samples) {
-        uint32_t skip_samples = 0;
-
-        sc_mutex_lock(&ar->mutex);
-        can_read = sc_audiobuf_can_read(&ar->buf);
-        if (can_read > max_buffered_samples) {
-            skip_samples = can_read - max_buffered_samples;
-            uint32_t r = sc_audiobuf_read(&ar->buf, NULL, skip_samples);
-            assert(r == skip_samples);
-            (void) r;
-            skipped_samples += skip_samples;
-        }
-        sc_mutex_unlock(&ar->mutex);
+        // The consumer may read concurrently, so fewer samples may be dropped
+        uint32_t skip_samples =
+            sc_audiobuf_drop(&ar->buf, can_read - max_buffered_samples);
+        skipped_samples += skip_samples;
 
         if (skip_samples) {
             if (played) {
@@ -322,6 +377,10 @@ sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
         // Recompute compensation every second
         ar->samples_since_resync = 0;
 
+        if (ar->max_target_buffering) {
+            sc_audio_regulator_update_target(ar);
+        }
+
         float avg = sc_average_get(&ar->avg_buffering);
         int diff = ar->target_buffering - avg;
 
@@ -364,7 +423,10 @@ sc_audio_regulator_push(struct sc_audio_regulator *ar, const AVFrame *frame) {
 
 bool
 sc_audio_regulator_init(struct sc_audio_regulator *ar, size_t sample_size,
-                        const AVCodecContext *ctx, uint32_t target_buffering) {
+                        const AVCodecContext *ctx, uint32_t target_buffering,
+                        uint32_t max_target_buffering, bool concealment) {
+    assert(!max_target_buffering || max_target_buffering >= target_buffering);
+
     SwrContext *swr_ctx = swr_alloc();
     if (!swr_ctx) {
         LOG_OOM();
@@ -394,24 +456,27 @@ sc_audio_regulator_init(struct sc_audio_regulator *ar, size_t sample_size,
         goto error_free_swr_ctx;
     }
 
-    bool ok = sc_mutex_init(&ar->mutex);
-    if (!ok) {
-        goto error_free_swr_ctx;
-    }
-
     ar->target_buffering = target_buffering;
+    ar->min_target_buffering = target_buffering;
+    ar->max_target_buffering = max_target_buffering;
     ar->sample_size = sample_size;
     ar->sample_rate = ctx->sample_rate;
 
-    // Use a ring-buffer of the target buffering size plus 1 second between the
-    // producer and the consumer. It's too big on purpose, to guarantee that
-    // the producer and the consumer will be able to access it in parallel
-    // without locking.
-    uint32_t audiobuf_samples = target_buffering + ar->sample_rate;
+    if (max_target_buffering) {
+        sc_percentile_window_init(&ar->transit);
+        // Smooth over 10 updates (one per second)
+        sc_average_init(&ar->avg_target, 10);
+    }
+
+    // Use a ring-buffer of the (maximal) target buffering size plus 1 second
+    // between the producer and the consumer. It's too big on purpose, so that
+    // the producer rarely needs to drop samples.
+    uint32_t audiobuf_samples = MAX(target_buffering, max_target_buffering)
+                              + ar->sample_rate;
 
-    ok = sc_audiobuf_init(&ar->buf, sample_size, audiobuf_samples);
+    bool ok = sc_audiobuf_init(&ar->buf, sample_size, audiobuf_samples);
     if (!ok) {
-        goto error_destroy_mutex;
+        goto error_free_swr_ctx;
     }
 
     size_t initial_swr_buf_size = TO_BYTES(4096);
@@ -422,6 +487,18 @@ sc_audio_regulator_init(struct sc_audio_regulator *ar, size_t sample_size,
     }
     ar->swr_buf_alloc_size = initial_swr_buf_size;
 
+    ar->concealment = concealment;
+    if (concealment) {
+        // The samples are interleaved floats (SC_AV_SAMPLE_FMT)
+        unsigned channels = sample_size / sizeof(float);
+        uint32_t period =
+            ar->sample_rate * SC_AUDIO_REGULATOR_PLC_PERIOD_MS / 1000;
+        uint32_t fade = ar->sample_rate * SC_AUDIO_REGULATOR_PLC_FADE_MS / 1000;
+        if (!sc_audio_plc_init(&ar->plc, channels, period, fade)) {
+            goto error_free_swr_buf;
+        }
+    }
+
     // Samples are produced and consumed by blocks, so the buffering must be
     // smoothed to get a relatively stable value.
     sc_average_init(&ar->avg_buffering, 128);
@@ -431,16 +508,17 @@ sc_audio_regulator_init(struct sc_audio_regulator *ar, size_t sample_size,
     atomic_init(&ar->played, false);
     atomic_init(&ar->received, false);
     atomic_init(&ar->underflow, 0);
+    atomic_init(&ar->pts_end, -1);
     ar->underflow_report = 0;
     ar->compensation_active = false;
     ar->next_expected_pts = 0;
 
     return true;
 
+error_free_swr_buf:
+    free(ar->swr_buf);
 error_destroy_audiobuf:
     sc_audiobuf_destroy(&ar->buf);
-error_destroy_mutex:
-    sc_mutex_destroy(&ar->mutex);
 error_free_swr_ctx:
     swr_free(&ar->swr_ctx);
 
@@ -449,8 +527,10 @@ error_free_swr_ctx:
 
 void
 sc_audio_regulator_destroy(struct sc_audio_regulator *ar) {
+    if (ar->concealment) {
+        sc_audio_plc_destroy(&ar->plc);
+    }
     free(ar->swr_buf);
     sc_audiobuf_destroy(&ar->buf);
-    sc_mutex_destroy(&ar->mutex);
     swr_free(&ar->swr_ctx);
 }
@@ -9,19 +9,31 @@
 #include <stdint.h>
 #include <libavcodec/avcodec.h>
 #include <libswresample/swresample.h>
+#include "util/audio_plc.h"
 #include "util/audiobuf.h"
 #include "util/average.h"
-#include "util/thread.h"
+#include "util/percentile.h"
 
 #define SC_AV_SAMPLE_FMT AV_SAMPLE_FMT_FLT
 
 struct sc_audio_regulator {
-    sc_mutex mutex;
-
     // Target buffering between the producer and the consumer (in samples)
     uint32_t target_buffering;
 
-    // Audio buffer to communicate between the receiver and the player
+    // Bounds of the adaptive target buffering (in samples)
+    // If max_target_buffering is 0, the target buffering is fixed.
+    uint32_t min_target_buffering;
+    uint32_t max_target_buffering;
+
+    // Transit delays (arrival time - pts) of the last packets, to measure the
+    // jitter (only used by the receiver thread, if adaptive)
+    struct sc_percentile_window transit;
+    // Required target buffering, smoothed so that the target decreases slowly
+    // (only used by the receiver thread, if adaptive)
+    struct sc_average avg_target;
+
+    // Lock-free audio buffer to communicate between the receiver and the
+    // player (the player never blocks)
     struct sc_audiobuf buf;
 
     // Resampler (only used from the receiver thread)
@@ -49,6 +61,11 @@ struct sc_audio_regulator {
     // Number of silence samples inserted since the last log
     uint32_t underflow_report;
 
+    // If set, the missing samples are concealed instead of replaced by silence
+    // (only used by the consumer thread)
+    bool concealment;
+    struct sc_audio_plc plc;
+
     // Non-zero compensation applied (only used by the receiver thread)
     bool compensation_active;
 
@@ -60,11 +77,15 @@ struct sc_audio_regulator {
 
     // PTS of the next expected packet (useful to detect discontinuities)
     int64_t next_expected_pts;
+
+    // PTS of the end of the samples written to the buffer (-1 if none yet)
+    atomic_int_least64_t pts_end;
 };
 
 bool
 sc_audio_regulator_init(struct sc_audio_regulator *ar, size_t sample_size,
-                        const AVCodecContext *ctx, uint32_t target_buffering);
+                        const AVCodecContext *ctx, uint32_t target_buffering,
+                        uint32_t max_target_buffering, bool concealment);
 
 void
 sc_audio_regulator_destroy(struct sc_audio_regulator *ar);
@@ -76,4 +97,13 @@ void
 sc_audio_regulator_pull(struct sc_audio_regulator *ar, uint8_t *out,
                         uint32_t samples);
 
+/**
+ * Estimate the PTS (in microseconds) of the next sample to be pulled
+ *
+ * It must be called from the consumer thread. Return false if the buffer is
+ * empty.
+ */
+bool
+sc_audio_regulator_get_next_pts(struct sc_audio_regulator *ar, int64_t *pts);
+
 #endif
@@ -0,0 +1,175 @@
+#include "av_pool.h"
+
+#include <assert.h>
+
+#include "util/log.h"
+
+bool
+sc_packet_pool_init(struct sc_packet_pool *pool) {
+    bool ok = sc_mutex_init(&pool->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    sc_vector_init(&pool->free_packets);
+
+    // Reserve the whole capacity upfront, so that releasing a packet never
+    // (re)allocates
+    ok = sc_vector_reserve(&pool->free_packets, SC_AV_POOL_MAX_CACHED);
+    if (!ok) {
+        LOG_OOM();
+        sc_mutex_destroy(&pool->mutex);
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_packet_pool_destroy(struct sc_packet_pool *pool) {
+    for (size_t i = 0; i < pool->free_packets.size; ++i) {
+        av_packet_free(&pool->free_packets.data[i]);
+    }
+    sc_vector_destroy(&pool->free_packets);
+    sc_mutex_destroy(&pool->mutex);
+}
+
+AVPacket *
+sc_packet_pool_get(struct sc_packet_pool *pool) {
+    AVPacket *packet = NULL;
+
+    sc_mutex_lock(&pool->mutex);
+    if (pool->free_packets.size) {
+        packet = pool->free_packets.data[--pool->free_packets.size];
+    }
+    sc_mutex_unlock(&pool->mutex);
+
+    if (!packet) {
+        packet = av_packet_alloc();
+        if (!packet) {
+            LOG_OOM();
+            return NULL;
+        }
+    }
+
+    return packet;
+}
+
+AVPacket *
+sc_packet_pool_ref(struct sc_packet_pool *pool, const AVPacket *packet) {
+    AVPacket *p = sc_packet_pool_get(pool);
+    if (!p) {
+        return NULL;
+    }
+
+    if (av_packet_ref(p, packet)) {
+        sc_packet_pool_put(pool, p);
+        return NULL;
+    }
+
+    return p;
+}
+
+void
+sc_packet_pool_put(struct sc_packet_pool *pool, AVPacket *packet) {
+    assert(packet);
+    av_packet_unref(packet);
+
+    sc_mutex_lock(&pool->mutex);
+    bool cached = pool->free_packets.size < SC_AV_POOL_MAX_CACHED;
+    if (cached) {
+        // The capacity is reserved, this may not fail
+        bool ok = sc_vector_push(&pool->free_packets, packet);
+        assert(ok);
+        (void) ok;
+    }
+    sc_mutex_unlock(&pool->mutex);
+
+    if (!cached) {
+        av_packet_free(&packet);
+    }
+}
+
+bool
+sc_frame_pool_init(struct sc_frame_pool *pool) {
+    bool ok = sc_mutex_init(&pool->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    sc_vector_init(&pool->free_frames);
+
+    ok = sc_vector_reserve(&pool->free_frames, SC_AV_POOL_MAX_CACHED);
+    if (!ok) {
+        LOG_OOM();
+        sc_mutex_destroy(&pool->mutex);
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_frame_pool_destroy(struct sc_frame_pool *pool) {
+    for (size_t i = 0; i < pool->free_frames.size; ++i) {
+        av_frame_free(&pool->free_frames.data[i]);
+    }
+    sc_vector_destroy(&pool->free_frames);
+    sc_mutex_destroy(&pool->mutex);
+}
+
+static AVFrame *
+sc_frame_pool_get(struct sc_frame_pool *pool) {
+    AVFrame *frame = NULL;
+
+    sc_mutex_lock(&pool->mutex);
+    if (pool->free_frames.size) {
+        frame = pool->free_frames.data[--pool->free_frames.size];
+    }
+    sc_mutex_unlock(&pool->mutex);
+
+    if (!frame) {
+        frame = av_frame_alloc();
+        if (!frame) {
+            LOG_OOM();
+            return NULL;
+        }
+    }
+
+    return frame;
+}
+
+AVFrame *
+sc_frame_pool_ref(struct sc_frame_pool *pool, const AVFrame *frame) {
+    AVFrame *f = sc_frame_pool_get(pool);
+    if (!f) {
+        return NULL;
+    }
+
+    if (av_frame_ref(f, frame)) {
+        LOG_OOM();
+        sc_frame_pool_put(pool, f);
+        return NULL;
+    }
+
+    return f;
+}
+
+void
+sc_frame_pool_put(struct sc_frame_pool *pool, AVFrame *frame) {
+    assert(frame);
+    av_frame_unref(frame);
+
+    sc_mutex_lock(&pool->mutex);
+    bool cached = pool->free_frames.size < SC_AV_POOL_MAX_CACHED;
+    if (cached) {
+        bool ok = sc_vector_push(&pool->free_frames, frame);
+        assert(ok);
+        (void) ok;
+    }
+    sc_mutex_unlock(&pool->mutex);
+
+    if (!cached) {
+        av_frame_free(&frame);
+    }
+}
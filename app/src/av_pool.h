@@ -0,0 +1,91 @@
+#ifndef SC_AV_POOL_H
+#define SC_AV_POOL_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+
+#include "util/thread.h"
+#include "util/vector.h"
+
+// Maximum number of released packets or frames kept for reuse
+#define SC_AV_POOL_MAX_CACHED 64
+
+// forward declarations
+typedef struct AVPacket AVPacket;
+typedef struct AVFrame AVFrame;
+
+/**
+ * A packet pool recycles the AVPacket structs, to avoid an allocation per
+ * packet in components queueing references to the packets they receive.
+ *
+ * The packet data is not copied: it is a reference to the (refcounted, and
+ * already pooled) buffer of the source packet.
+ *
+ * It is thread-safe: packets may be retrieved from one thread and released
+ * from another.
+ */
+struct sc_packet_pool {
+    sc_mutex mutex;
+    struct SC_VECTOR(AVPacket *) free_packets;
+};
+
+/**
+ * A frame pool recycles the AVFrame structs, similarly to the packet pool.
+ */
+struct sc_frame_pool {
+    sc_mutex mutex;
+    struct SC_VECTOR(AVFrame *) free_frames;
+};
+
+bool
+sc_packet_pool_init(struct sc_packet_pool *pool);
+
+void
+sc_packet_pool_destroy(struct sc_packet_pool *pool);
+
+/**
+ * Return a blank packet, or NULL on error
+ *
+ * The result must be released by sc_packet_pool_put().
+ */
+AVPacket *
+sc_packet_pool_get(struct sc_packet_pool *pool);
+
+/**
+ * Return a new reference to `packet`, or NULL on error
+ *
+ * The result must be released by sc_packet_pool_put().
+ */
+AVPacket *
+sc_packet_pool_ref(struct sc_packet_pool *pool, const AVPacket *packet);
+
+/**
+ * Unref `packet` and give it back to the pool
+ */
+void
+sc_packet_pool_put(struct sc_packet_pool *pool, AVPacket *packet);
+
+bool
+sc_frame_pool_init(struct sc_frame_pool *pool);
+
+void
+sc_frame_pool_destroy(struct sc_frame_pool *pool);
+
+/**
+ * Return a new reference to `frame`, or NULL on error
+ *
+ * The result must be released by sc_frame_pool_put().
+ */
+AVFrame *
+sc_frame_pool_ref(struct sc_frame_pool *pool, const AVFrame *frame);
+
+/**
+ * Unref `frame` and give it back to the pool
+ */
+void
+sc_frame_pool_put(struct sc_frame_pool *pool, AVFrame *frame);
+
+#endif
@@ -0,0 +1,46 @@
+#include "av_sync.h"
+
+// The audio clock is considered stalled if not updated for this duration
+#define SC_AV_SYNC_TIMEOUT SC_TICK_FROM_MS(500)
+
+// Weight of a new measure in the smoothed offset (1/SC_AV_SYNC_RANGE), the
+// measures being taken on each audio callback (every few milliseconds)
+#define SC_AV_SYNC_RANGE 64
+
+void
+sc_av_sync_init(struct sc_av_sync *sync) {
+    atomic_init(&sync->audio_offset, 0);
+    atomic_init(&sync->last_update, 0);
+}
+
+void
+sc_av_sync_update_audio(struct sc_av_sync *sync, sc_tick now,
+                        sc_tick offset) {
+    sc_tick last_update =
+        atomic_load_explicit(&sync->last_update, memory_order_relaxed);
+    if (last_update && now - last_update < SC_AV_SYNC_TIMEOUT) {
+        // Only this thread writes the offset, no need for a CAS loop
+        sc_tick avg =
+            atomic_load_explicit(&sync->audio_offset, memory_order_relaxed);
+        offset = avg + (offset - avg) / SC_AV_SYNC_RANGE;
+    }
+    // else first measure, or after a stall: restart the estimation
+
+    atomic_store_explicit(&sync->audio_offset, offset, memory_order_relaxed);
+    atomic_store_explicit(&sync->last_update, now, memory_order_release);
+}
+
+bool
+sc_av_sync_to_system_time(struct sc_av_sync *sync, sc_tick pts,
+                          sc_tick *system) {
+    sc_tick last_update =
+        atomic_load_explicit(&sync->last_update, memory_order_acquire);
+    if (!last_update || sc_tick_now() - last_update > SC_AV_SYNC_TIMEOUT) {
+        return false;
+    }
+
+    sc_tick offset =
+        atomic_load_explicit(&sync->audio_offset, memory_order_relaxed);
+    *system = pts + offset;
+    return true;
+}
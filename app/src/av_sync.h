@@ -0,0 +1,50 @@
+#ifndef SC_AV_SYNC_H
+#define SC_AV_SYNC_H
+
+#include "common.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "util/tick.h"
+
+/**
+ * Audio clock shared between the audio player and the video delay buffer
+ * (--av-sync)
+ *
+ * The audio player regularly publishes the offset between the stream time
+ * (PTS) and the system time at which the samples are actually played:
+ *
+ *     system time = PTS + audio_offset
+ *
+ * so that the video frames may be presented at the same time as the audio
+ * samples having the same PTS.
+ */
+struct sc_av_sync {
+    // Smoothed offset (only written by the audio thread)
+    atomic_int_least64_t audio_offset;
+    // Date of the last update (0 if never updated)
+    atomic_int_least64_t last_update;
+};
+
+void
+sc_av_sync_init(struct sc_av_sync *sync);
+
+/**
+ * Publish a new measure of the audio offset (from the audio thread only)
+ */
+void
+sc_av_sync_update_audio(struct sc_av_sync *sync, sc_tick now,
+                        sc_tick offset);
+
+/**
+ * Get the system time at which the sample having this PTS is played
+ *
+ * Return false if the audio clock is not available (no audio yet, or audio
+ * stalled).
+ */
+bool
+sc_av_sync_to_system_time(struct sc_av_sync *sync, sc_tick pts,
+                          sc_tick *system);
+
+#endif
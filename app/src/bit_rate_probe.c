@@ -0,0 +1,43 @@
+#include "bit_rate_probe.h"
+
+// Part of the throughput (in percent) to use for the video stream, to keep
+// some margin for throughput variations
+#define SC_BIT_RATE_PROBE_USAGE_PERCENT 70
+
+static uint16_t
+sc_bit_rate_probe_get_max_size(uint32_t bit_rate) {
+    // Do not encode a large video at a very low bit rate
+    if (bit_rate < 1500000) {
+        return 720;
+    }
+    if (bit_rate < 3000000) {
+        return 1024;
+    }
+    if (bit_rate < 5000000) {
+        return 1280;
+    }
+    return 0;
+}
+
+struct sc_bit_rate_probe_result
+sc_bit_rate_probe_choose(uint64_t throughput, uint32_t reserved,
+                         uint16_t max_size) {
+    uint64_t usable = throughput * SC_BIT_RATE_PROBE_USAGE_PERCENT / 100;
+    usable = usable > reserved ? usable - reserved : 0;
+
+    uint32_t bit_rate;
+    if (usable > SC_BIT_RATE_PROBE_MAX_BIT_RATE) {
+        bit_rate = SC_BIT_RATE_PROBE_MAX_BIT_RATE;
+    } else if (usable < SC_BIT_RATE_PROBE_MIN_BIT_RATE) {
+        bit_rate = SC_BIT_RATE_PROBE_MIN_BIT_RATE;
+    } else {
+        bit_rate = usable;
+    }
+
+    struct sc_bit_rate_probe_result result = {
+        .bit_rate = bit_rate,
+        // Never override the value requested by the user
+        .max_size = max_size ? 0 : sc_bit_rate_probe_get_max_size(bit_rate),
+    };
+    return result;
+}
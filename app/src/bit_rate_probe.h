@@ -0,0 +1,54 @@
+#ifndef SC_BIT_RATE_PROBE_H
+#define SC_BIT_RATE_PROBE_H
+
+#include "common.h"
+
+#include <stdint.h>
+
+/**
+ * Startup throughput probe (--video-bit-rate=auto)
+ *
+ * Once connected, the device sends a burst of random (incompressible) data on
+ * the video socket:
+ *
+ *     [. . . .]. . . . . . . . . . . . . . . ...
+ *      <-----> <-------------------------------...
+ *        size              data
+ *
+ * The client measures the throughput, then replies on the same socket with the
+ * video bit rate and the max size (0 to keep the value of the device) to use:
+ *
+ *     [. . . .|. .]
+ *      <-----> <->
+ *     bit_rate max_size
+ *
+ * The encoder is only started afterwards.
+ */
+
+// Never request more than the default bit rate: the probe is intended to
+// adapt to slow links (e.g. a remote device), not to increase the bit rate on
+// fast ones
+#define SC_BIT_RATE_PROBE_MAX_BIT_RATE 8000000
+#define SC_BIT_RATE_PROBE_MIN_BIT_RATE 500000
+
+// Sanity limit of the probe size announced by the device
+#define SC_BIT_RATE_PROBE_MAX_SIZE (16 * 1024 * 1024)
+
+struct sc_bit_rate_probe_result {
+    uint32_t bit_rate;
+    uint16_t max_size; // 0 to keep the value of the device
+};
+
+/**
+ * Choose the video bit rate and size for a measured throughput
+ *
+ * `reserved` is the bit rate used by the other streams (audio).
+ *
+ * `max_size` is the max size requested by the user (0 if none), which is never
+ * changed.
+ */
+struct sc_bit_rate_probe_result
+sc_bit_rate_probe_choose(uint64_t throughput, uint32_t reserved,
+                         uint16_t max_size);
+
+#endif
@@ -0,0 +1,514 @@
+#include "bridge_clip.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+
+#include "packet_merger.h"
+#include "util/log.h"
+
+/** Downcast packet sink to sc_bridge_clip */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_bridge_clip, packet_sink)
+
+#define SC_BRIDGE_CLIP_AVIO_BUFFER_SIZE 4096
+// Memory budget of the packets kept (the clip is shortened beyond)
+#define SC_BRIDGE_CLIP_MAX_BYTES (64 * 1024 * 1024)
+// Duration of the last packet of a clip, if it cannot be deduced (in us)
+#define SC_BRIDGE_CLIP_DEFAULT_PACKET_DURATION (1000000 / 60)
+
+static const AVRational SC_BRIDGE_CLIP_TIME_BASE = {1, 1000000}; // in us
+
+// Seekable in-memory output, so that the MP4 muxer can write the moov box
+// (and patch the sizes) at the end, without fragmenting the file
+struct sc_bridge_clip_output {
+    uint8_t *buf;
+    size_t len;
+    size_t cap;
+    size_t pos;
+};
+
+#ifdef SCRCPY_LAVF_HAS_AVIO_CONST_WRITE_PACKET
+static int
+sc_bridge_clip_write_packet(void *opaque, const uint8_t *buf, int buf_size) {
+#else
+static int
+sc_bridge_clip_write_packet(void *opaque, uint8_t *buf, int buf_size) {
+#endif
+    struct sc_bridge_clip_output *out = opaque;
+
+    assert(buf_size >= 0);
+    size_t size = buf_size;
+    size_t end = out->pos + size;
+    if (end > out->cap) {
+        size_t cap = MAX(out->cap * 2, end);
+        uint8_t *p = realloc(out->buf, cap);
+        if (!p) {
+            LOG_OOM();
+            return AVERROR(ENOMEM);
+        }
+        out->buf = p;
+        out->cap = cap;
+    }
+
+    if (out->pos > out->len) {
+        // Seeked beyond the end
+        memset(&out->buf[out->len], 0, out->pos - out->len);
+    }
+
+    memcpy(&out->buf[out->pos], buf, size);
+    out->pos = end;
+    out->len = MAX(out->len, end);
+    return buf_size;
+}
+
+static int64_t
+sc_bridge_clip_seek(void *opaque, int64_t offset, int whence) {
+    struct sc_bridge_clip_output *out = opaque;
+
+    int64_t base;
+    switch (whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE:
+            return out->len;
+        case SEEK_SET:
+            base = 0;
+            break;
+        case SEEK_CUR:
+            base = out->pos;
+            break;
+        case SEEK_END:
+            base = out->len;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+
+    int64_t pos = base + offset;
+    if (pos < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    out->pos = pos;
+    return pos;
+}
+
+static void
+sc_bridge_clip_free_packets(AVPacket **packets, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        av_packet_free(&packets[i]);
+    }
+}
+
+static bool
+sc_bridge_clip_mux(const AVCodecParameters *par, const AVPacket *config,
+                   AVPacket **packets, size_t count,
+                   struct sc_bridge_clip_output *out) {
+    assert(count);
+
+    const AVOutputFormat *format = av_guess_format("mp4", NULL, NULL);
+    if (!format) {
+        LOGE("Could not find mp4 muxer");
+        return false;
+    }
+
+    AVFormatContext *ctx = avformat_alloc_context();
+    if (!ctx) {
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = false;
+    unsigned char *buffer = NULL;
+
+    // AVFormatContext.oformat expects a pointer-to-non-const (see recorder.c)
+    ctx->oformat = (AVOutputFormat *) format;
+
+    AVStream *ostream = avformat_new_stream(ctx, NULL);
+    if (!ostream) {
+        LOG_OOM();
+        goto end;
+    }
+
+    int r = avcodec_parameters_copy(ostream->codecpar, par);
+    if (r < 0) {
+        goto end;
+    }
+
+    // The config packet (SPS/PPS for H.264) is the extradata
+    uint8_t *extradata =
+        av_mallocz(config->size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!extradata) {
+        LOG_OOM();
+        goto end;
+    }
+    memcpy(extradata, config->data, config->size);
+    av_free(ostream->codecpar->extradata);
+    ostream->codecpar->extradata = extradata;
+    ostream->codecpar->extradata_size = config->size;
+
+    buffer = av_malloc(SC_BRIDGE_CLIP_AVIO_BUFFER_SIZE);
+    if (!buffer) {
+        LOG_OOM();
+        goto end;
+    }
+
+    ctx->pb = avio_alloc_context(buffer, SC_BRIDGE_CLIP_AVIO_BUFFER_SIZE, 1,
+                                 out, NULL, sc_bridge_clip_write_packet,
+                                 sc_bridge_clip_seek);
+    if (!ctx->pb) {
+        LOG_OOM();
+        goto end;
+    }
+    // Now owned by ctx->pb
+    buffer = NULL;
+
+    // The moov box is written at the end (the "faststart" option would need
+    // to reopen the output by its url, there is none)
+    r = avformat_write_header(ctx, NULL);
+    if (r < 0) {
+        LOGE("Could not write the clip header");
+        goto end;
+    }
+
+    int64_t pts_origin = packets[0]->pts;
+    for (size_t i = 0; i < count; ++i) {
+        AVPacket *packet = packets[i];
+        if (i + 1 < count) {
+            packet->duration = packets[i + 1]->pts - packet->pts;
+        } else {
+            packet->duration = SC_BRIDGE_CLIP_DEFAULT_PACKET_DURATION;
+        }
+        // The new parameter sets must be stored in-band
+        if (!sc_packet_merger_inline_config(packet)) {
+            goto end;
+        }
+        packet->stream_index = 0;
+        packet->pts -= pts_origin;
+        packet->dts = packet->pts;
+        av_packet_rescale_ts(packet, SC_BRIDGE_CLIP_TIME_BASE,
+                             ostream->time_base);
+
+        r = av_write_frame(ctx, packet);
+        if (r < 0) {
+            LOGE("Could not write a clip packet");
+            goto end;
+        }
+    }
+
+    r = av_write_trailer(ctx);
+    if (r < 0) {
+        LOGE("Could not write the clip trailer");
+        goto end;
+    }
+
+    ok = ctx->pb->error >= 0;
+
+end:
+    av_free(buffer);
+    if (ctx->pb) {
+        // The buffer may have been reallocated by AVIO
+        av_freep(&ctx->pb->buffer);
+        avio_context_free(&ctx->pb);
+    }
+    avformat_free_context(ctx);
+    return ok;
+}
+
+static void
+sc_bridge_clip_publish(struct sc_bridge_clip *clip) {
+    AVCodecParameters *par = avcodec_parameters_alloc();
+    if (!par) {
+        LOG_OOM();
+        return;
+    }
+
+    AVPacket *config = NULL;
+    AVPacket **packets = NULL;
+    size_t count = 0;
+
+    // Only take references, the packets are remuxed outside the lock
+    sc_mutex_lock(&clip->mutex);
+    bool ok = clip->codec_ctx && clip->config && clip->packets.size;
+    if (ok) {
+        ok = avcodec_parameters_from_context(par, clip->codec_ctx) >= 0;
+    }
+    if (ok) {
+        config = av_packet_clone(clip->config);
+        packets = malloc(clip->packets.size * sizeof(*packets));
+        ok = config && packets;
+        for (size_t i = 0; ok && i < clip->packets.size; ++i) {
+            packets[i] = av_packet_clone(clip->packets.data[i]);
+            if (!packets[i]) {
+                ok = false;
+                break;
+            }
+            ++count;
+        }
+        if (!ok) {
+            LOG_OOM();
+        }
+    } else {
+        LOGW("No video to send as a clip");
+    }
+    sc_mutex_unlock(&clip->mutex);
+
+    if (ok) {
+        // Before muxing, which rescales the timestamps
+        int64_t duration_ms = (packets[count - 1]->pts - packets[0]->pts)
+                            / 1000;
+
+        struct sc_bridge_clip_output out = {0};
+        ok = sc_bridge_clip_mux(par, config, packets, count, &out);
+        if (ok) {
+            ok = sc_figma_bridge_publish_clip(clip->bridge, out.buf, out.len);
+            if (ok) {
+                LOGI("Clip queued to Figma Bridge (%" PRId64 " ms, "
+                     "%" SC_PRIsizet " bytes): "
+                     "http://127.0.0.1:%u/scrcpy-bridge/clip.mp4",
+                     duration_ms, out.len,
+                     (unsigned) sc_figma_bridge_get_port(clip->bridge));
+            }
+        } else {
+            LOGW("Could not create the clip");
+        }
+        free(out.buf);
+    }
+
+    if (packets) {
+        sc_bridge_clip_free_packets(packets, count);
+        free(packets);
+    }
+    av_packet_free(&config);
+    avcodec_parameters_free(&par);
+}
+
+static int
+run_bridge_clip(void *data) {
+    struct sc_bridge_clip *clip = data;
+
+    for (;;) {
+        sc_mutex_lock(&clip->mutex);
+        while (!clip->stopped && !clip->requested) {
+            sc_cond_wait(&clip->cond, &clip->mutex);
+        }
+        bool stopped = clip->stopped;
+        clip->requested = false;
+        sc_mutex_unlock(&clip->mutex);
+
+        if (stopped) {
+            break;
+        }
+
+        sc_bridge_clip_publish(clip);
+    }
+
+    return 0;
+}
+
+// The mutex must be locked
+static void
+sc_bridge_clip_drop_packets(struct sc_bridge_clip *clip, size_t count) {
+    assert(count <= clip->packets.size);
+    for (size_t i = 0; i < count; ++i) {
+        clip->packets_bytes -= clip->packets.data[i]->size;
+    }
+    sc_bridge_clip_free_packets(clip->packets.data, count);
+    sc_vector_remove_slice(&clip->packets, 0, count);
+}
+
+// Drop the packets which are not needed anymore (the mutex must be locked)
+static void
+sc_bridge_clip_trim(struct sc_bridge_clip *clip) {
+    assert(clip->packets.size);
+
+    AVPacket **packets = clip->packets.data;
+    size_t size = clip->packets.size;
+
+    // The clip must start on a keyframe: drop all the packets before the last
+    // keyframe older than the clip duration
+    int64_t cutoff = packets[size - 1]->pts
+                   - SC_TICK_TO_US(SC_BRIDGE_CLIP_DURATION);
+    size_t drop = 0;
+    for (size_t i = 1; i < size && packets[i]->pts <= cutoff; ++i) {
+        if (packets[i]->flags & AV_PKT_FLAG_KEY) {
+            drop = i;
+        }
+    }
+
+    if (clip->packets_bytes > SC_BRIDGE_CLIP_MAX_BYTES) {
+        // Over budget, drop at least the first group of pictures (possibly all
+        // the packets, until the next keyframe)
+        size_t i = MAX(drop, 1);
+        while (i < size && !(packets[i]->flags & AV_PKT_FLAG_KEY)) {
+            ++i;
+        }
+        drop = i;
+    }
+
+    if (drop) {
+        sc_bridge_clip_drop_packets(clip, drop);
+    }
+}
+
+static bool
+sc_bridge_clip_push(struct sc_bridge_clip *clip, const AVPacket *packet) {
+    bool is_config = packet->pts == AV_NOPTS_VALUE;
+    if (is_config) {
+        // On a new config (e.g. on device orientation change), the previous
+        // packets cannot be part of the same clip
+        sc_bridge_clip_drop_packets(clip, clip->packets.size);
+        av_packet_free(&clip->config);
+        clip->config = av_packet_clone(packet);
+        if (!clip->config) {
+            LOG_OOM();
+            return false;
+        }
+        return true;
+    }
+
+    if (!clip->config) {
+        // No config packet received
+        return true;
+    }
+
+    bool keyframe = packet->flags & AV_PKT_FLAG_KEY;
+    if (!clip->packets.size && !keyframe) {
+        // Wait for a keyframe
+        return true;
+    }
+
+    AVPacket *p = av_packet_clone(packet);
+    if (!p) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (!sc_vector_push(&clip->packets, p)) {
+        LOG_OOM();
+        av_packet_free(&p);
+        return false;
+    }
+    clip->packets_bytes += p->size;
+
+    sc_bridge_clip_trim(clip);
+    return true;
+}
+
+static bool
+sc_bridge_clip_packet_sink_open(struct sc_packet_sink *sink,
+                                AVCodecContext *ctx) {
+    struct sc_bridge_clip *clip = DOWNCAST(sink);
+
+    sc_mutex_lock(&clip->mutex);
+    clip->codec_ctx = ctx;
+    sc_mutex_unlock(&clip->mutex);
+
+    return true;
+}
+
+static void
+sc_bridge_clip_packet_sink_close(struct sc_packet_sink *sink) {
+    struct sc_bridge_clip *clip = DOWNCAST(sink);
+
+    sc_mutex_lock(&clip->mutex);
+    clip->codec_ctx = NULL;
+    av_packet_free(&clip->config);
+    sc_bridge_clip_drop_packets(clip, clip->packets.size);
+    sc_mutex_unlock(&clip->mutex);
+}
+
+static bool
+sc_bridge_clip_packet_sink_push(struct sc_packet_sink *sink,
+                                const AVPacket *packet) {
+    struct sc_bridge_clip *clip = DOWNCAST(sink);
+
+    sc_mutex_lock(&clip->mutex);
+    bool ok = sc_bridge_clip_push(clip, packet);
+    if (!ok) {
+        // The clips are optional, do not stop mirroring: start again from the
+        // next config packet
+        LOGW("Could not keep the video for clips");
+        av_packet_free(&clip->config);
+        sc_bridge_clip_drop_packets(clip, clip->packets.size);
+    }
+    sc_mutex_unlock(&clip->mutex);
+
+    return true;
+}
+
+bool
+sc_bridge_clip_init(struct sc_bridge_clip *clip,
+                    struct sc_figma_bridge *bridge) {
+    bool ok = sc_mutex_init(&clip->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&clip->cond);
+    if (!ok) {
+        sc_mutex_destroy(&clip->mutex);
+        return false;
+    }
+
+    clip->bridge = bridge;
+    clip->stopped = false;
+    clip->requested = false;
+    clip->codec_ctx = NULL;
+    clip->config = NULL;
+    sc_vector_init(&clip->packets);
+    clip->packets_bytes = 0;
+
+    static const struct sc_packet_sink_ops ops = {
+        .open = sc_bridge_clip_packet_sink_open,
+        .close = sc_bridge_clip_packet_sink_close,
+        .push = sc_bridge_clip_packet_sink_push,
+    };
+
+    clip->packet_sink.ops = &ops;
+
+    return true;
+}
+
+bool
+sc_bridge_clip_start(struct sc_bridge_clip *clip) {
+    bool ok = sc_thread_create(&clip->thread, run_bridge_clip,
+                               "scrcpy-clip", clip);
+    if (!ok) {
+        LOGE("Could not start bridge clip thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_bridge_clip_stop(struct sc_bridge_clip *clip) {
+    sc_mutex_lock(&clip->mutex);
+    clip->stopped = true;
+    sc_cond_signal(&clip->cond);
+    sc_mutex_unlock(&clip->mutex);
+}
+
+void
+sc_bridge_clip_join(struct sc_bridge_clip *clip) {
+    sc_thread_join(&clip->thread, NULL);
+}
+
+void
+sc_bridge_clip_destroy(struct sc_bridge_clip *clip) {
+    av_packet_free(&clip->config);
+    sc_bridge_clip_drop_packets(clip, clip->packets.size);
+    sc_vector_destroy(&clip->packets);
+    sc_cond_destroy(&clip->cond);
+    sc_mutex_destroy(&clip->mutex);
+}
+
+void
+sc_bridge_clip_request(struct sc_bridge_clip *clip) {
+    sc_mutex_lock(&clip->mutex);
+    clip->requested = true;
+    sc_cond_signal(&clip->cond);
+    sc_mutex_unlock(&clip->mutex);
+}
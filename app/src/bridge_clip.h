@@ -0,0 +1,72 @@
+#ifndef SC_BRIDGE_CLIP_H
+#define SC_BRIDGE_CLIP_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <libavcodec/avcodec.h>
+
+#include "figma_bridge.h"
+#include "trait/packet_sink.h"
+#include "util/thread.h"
+#include "util/tick.h"
+#include "util/vector.h"
+
+// Duration of video kept for a clip (it may be slightly longer, since a clip
+// must start on a keyframe)
+#define SC_BRIDGE_CLIP_DURATION SC_TICK_FROM_SEC(10)
+
+struct sc_bridge_clip_packets SC_VECTOR(AVPacket *);
+
+/**
+ * Instant replay clips for the Figma Bridge (/scrcpy-bridge/clip.mp4)
+ *
+ * It is a packet sink of the video demuxer, keeping (references to) the
+ * encoded packets of the last SC_BRIDGE_CLIP_DURATION. On request, they are
+ * remuxed (not re-encoded) to MP4 from a separate thread, and published to
+ * the bridge.
+ */
+struct sc_bridge_clip {
+    struct sc_packet_sink packet_sink; // packet sink trait
+
+    struct sc_figma_bridge *bridge;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool stopped;
+    bool requested;
+
+    // All the fields below are protected by the mutex
+
+    const AVCodecContext *codec_ctx; // valid between open() and close()
+    AVPacket *config; // NULL until the config packet is received
+    // The recent packets, starting with a keyframe
+    struct sc_bridge_clip_packets packets;
+    size_t packets_bytes;
+};
+
+bool
+sc_bridge_clip_init(struct sc_bridge_clip *clip,
+                    struct sc_figma_bridge *bridge);
+
+bool
+sc_bridge_clip_start(struct sc_bridge_clip *clip);
+
+void
+sc_bridge_clip_stop(struct sc_bridge_clip *clip);
+
+void
+sc_bridge_clip_join(struct sc_bridge_clip *clip);
+
+void
+sc_bridge_clip_destroy(struct sc_bridge_clip *clip);
+
+/**
+ * Request to publish the recent video as a clip (asynchronously)
+ */
+void
+sc_bridge_clip_request(struct sc_bridge_clip *clip);
+
+#endif
@@ -0,0 +1,679 @@
+#include "bridge_input.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/log.h"
+#include "util/str.h"
+
+// Maximum nesting of the ignored values (unknown fields)
+#define SC_BRIDGE_INPUT_MAX_DEPTH 8
+
+enum sc_bridge_input_field {
+    SC_BRIDGE_INPUT_FIELD_X = 1 << 0,
+    SC_BRIDGE_INPUT_FIELD_Y = 1 << 1,
+    SC_BRIDGE_INPUT_FIELD_POINTER = 1 << 2,
+    SC_BRIDGE_INPUT_FIELD_PRESSURE = 1 << 3,
+    SC_BRIDGE_INPUT_FIELD_KEYCODE = 1 << 4,
+    SC_BRIDGE_INPUT_FIELD_METASTATE = 1 << 5,
+    SC_BRIDGE_INPUT_FIELD_REPEAT = 1 << 6,
+};
+
+// The fields of a single event, as parsed
+struct sc_bridge_input_event {
+    char type[16];
+    char action[16];
+    char *text; // owned, NULL if absent
+    unsigned fields; // enum sc_bridge_input_field flags
+    double x;
+    double y;
+    double pointer;
+    double pressure;
+    double keycode;
+    double metastate;
+    double repeat;
+};
+
+struct sc_bridge_input_parser {
+    const char *p;
+    const char *error;
+};
+
+static void
+skip_ws(struct sc_bridge_input_parser *parser) {
+    while (*parser->p == ' ' || *parser->p == '\t' || *parser->p == '\n'
+            || *parser->p == '\r') {
+        ++parser->p;
+    }
+}
+
+static bool
+expect(struct sc_bridge_input_parser *parser, char c) {
+    skip_ws(parser);
+    if (*parser->p != c) {
+        parser->error = "Malformed JSON";
+        return false;
+    }
+    ++parser->p;
+    return true;
+}
+
+static bool
+parse_hex4(const char *s, uint32_t *out) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        char c = s[i];
+        uint32_t digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            return false;
+        }
+        value = (value << 4) | digit;
+    }
+    *out = value;
+    return true;
+}
+
+static size_t
+encode_utf8(uint32_t cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = 0xC0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = 0xE0 | (cp >> 12);
+        out[1] = 0x80 | ((cp >> 6) & 0x3F);
+        out[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    out[0] = 0xF0 | (cp >> 18);
+    out[1] = 0x80 | ((cp >> 12) & 0x3F);
+    out[2] = 0x80 | ((cp >> 6) & 0x3F);
+    out[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
+
+// Parse a JSON string, and return it unescaped (to be freed by free())
+static char *
+parse_string(struct sc_bridge_input_parser *parser) {
+    if (!expect(parser, '"')) {
+        return NULL;
+    }
+
+    // The unescaped string is never longer than the escaped one
+    const char *end = parser->p;
+    while (*end && *end != '"') {
+        if (*end == '\\' && end[1]) {
+            ++end;
+        }
+        ++end;
+    }
+    if (!*end) {
+        parser->error = "Unterminated JSON string";
+        return NULL;
+    }
+
+    char *str = malloc(end - parser->p + 1);
+    if (!str) {
+        LOG_OOM();
+        parser->error = "Out of memory";
+        return NULL;
+    }
+
+    size_t len = 0;
+    const char *p = parser->p;
+    while (p != end) {
+        char c = *p++;
+        if ((unsigned char) c < 0x20) {
+            goto error;
+        }
+        if (c != '\\') {
+            str[len++] = c;
+            continue;
+        }
+
+        c = *p++;
+        switch (c) {
+            case '"': str[len++] = '"'; break;
+            case '\\': str[len++] = '\\'; break;
+            case '/': str[len++] = '/'; break;
+            case 'b': str[len++] = '\b'; break;
+            case 'f': str[len++] = '\f'; break;
+            case 'n': str[len++] = '\n'; break;
+            case 'r': str[len++] = '\r'; break;
+            case 't': str[len++] = '\t'; break;
+            case 'u': {
+                // "\uXXXX" is 6 bytes, its UTF-8 encoding at most 3 (or 4 for
+                // a surrogate pair, encoded by 12 bytes)
+                uint32_t cp;
+                if (end - p < 4 || !parse_hex4(p, &cp)) {
+                    goto error;
+                }
+                p += 4;
+                if (cp >= 0xD800 && cp < 0xDC00) {
+                    uint32_t low;
+                    if (end - p < 6 || p[0] != '\\' || p[1] != 'u'
+                            || !parse_hex4(p + 2, &low)
+                            || low < 0xDC00 || low >= 0xE000) {
+                        goto error;
+                    }
+                    p += 6;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                } else if (cp >= 0xDC00 && cp < 0xE000) {
+                    goto error;
+                }
+                if (!cp) {
+                    // Could not be represented in a C string
+                    goto error;
+                }
+                len += encode_utf8(cp, &str[len]);
+                break;
+            }
+            default:
+                goto error;
+        }
+    }
+
+    str[len] = '\0';
+    parser->p = end + 1;
+    return str;
+
+error:
+    parser->error = "Invalid JSON string";
+    free(str);
+    return NULL;
+}
+
+static bool
+parse_number(struct sc_bridge_input_parser *parser, double *out) {
+    skip_ws(parser);
+    const char *p = parser->p;
+    if (*p != '-' && (*p < '0' || *p > '9')) {
+        parser->error = "Expected a number";
+        return false;
+    }
+
+    char *endptr;
+    double value = strtod(p, &endptr);
+    if (endptr == p || !isfinite(value)) {
+        parser->error = "Invalid number";
+        return false;
+    }
+
+    parser->p = endptr;
+    *out = value;
+    return true;
+}
+
+static bool
+skip_value(struct sc_bridge_input_parser *parser, unsigned depth) {
+    if (depth > SC_BRIDGE_INPUT_MAX_DEPTH) {
+        parser->error = "JSON nested too deeply";
+        return false;
+    }
+
+    skip_ws(parser);
+    char c = *parser->p;
+    if (c == '"') {
+        char *str = parse_string(parser);
+        if (!str) {
+            return false;
+        }
+        free(str);
+        return true;
+    }
+
+    if (c == '{' || c == '[') {
+        char close = c == '{' ? '}' : ']';
+        ++parser->p;
+        skip_ws(parser);
+        if (*parser->p == close) {
+            ++parser->p;
+            return true;
+        }
+        for (;;) {
+            if (c == '{') {
+                char *key = parse_string(parser);
+                if (!key) {
+                    return false;
+                }
+                free(key);
+                if (!expect(parser, ':')) {
+                    return false;
+                }
+            }
+            if (!skip_value(parser, depth + 1)) {
+                return false;
+            }
+            skip_ws(parser);
+            if (*parser->p == ',') {
+                ++parser->p;
+                continue;
+            }
+            return expect(parser, close);
+        }
+    }
+
+    static const char *const literals[] = {"true", "false", "null"};
+    for (size_t i = 0; i < ARRAY_LEN(literals); ++i) {
+        size_t len = strlen(literals[i]);
+        if (!strncmp(parser->p, literals[i], len)) {
+            parser->p += len;
+            return true;
+        }
+    }
+
+    double ignored;
+    return parse_number(parser, &ignored);
+}
+
+static bool
+parse_short_string(struct sc_bridge_input_parser *parser, char *out,
+                   size_t out_size) {
+    char *str = parse_string(parser);
+    if (!str) {
+        return false;
+    }
+
+    size_t len = strlen(str);
+    if (len >= out_size) {
+        free(str);
+        parser->error = "Unknown event type or action";
+        return false;
+    }
+
+    memcpy(out, str, len + 1);
+    free(str);
+    return true;
+}
+
+static bool
+parse_event(struct sc_bridge_input_parser *parser,
+            struct sc_bridge_input_event *event) {
+    memset(event, 0, sizeof(*event));
+
+    if (!expect(parser, '{')) {
+        parser->error = "Each event must be a JSON object";
+        return false;
+    }
+
+    skip_ws(parser);
+    if (*parser->p == '}') {
+        ++parser->p;
+        return true;
+    }
+
+    static const struct {
+        const char *name;
+        enum sc_bridge_input_field field;
+        size_t offset;
+    } numbers[] = {
+        {"x", SC_BRIDGE_INPUT_FIELD_X,
+            offsetof(struct sc_bridge_input_event, x)},
+        {"y", SC_BRIDGE_INPUT_FIELD_Y,
+            offsetof(struct sc_bridge_input_event, y)},
+        {"pointer", SC_BRIDGE_INPUT_FIELD_POINTER,
+            offsetof(struct sc_bridge_input_event, pointer)},
+        {"pressure", SC_BRIDGE_INPUT_FIELD_PRESSURE,
+            offsetof(struct sc_bridge_input_event, pressure)},
+        {"keycode", SC_BRIDGE_INPUT_FIELD_KEYCODE,
+            offsetof(struct sc_bridge_input_event, keycode)},
+        {"metastate", SC_BRIDGE_INPUT_FIELD_METASTATE,
+            offsetof(struct sc_bridge_input_event, metastate)},
+        {"repeat", SC_BRIDGE_INPUT_FIELD_REPEAT,
+            offsetof(struct sc_bridge_input_event, repeat)},
+    };
+
+    for (;;) {
+        char *key = parse_string(parser);
+        if (!key) {
+            return false;
+        }
+        if (!expect(parser, ':')) {
+            free(key);
+            return false;
+        }
+
+        bool ok;
+        if (!strcmp(key, "type")) {
+            ok = parse_short_string(parser, event->type, sizeof(event->type));
+        } else if (!strcmp(key, "action")) {
+            ok = parse_short_string(parser, event->action,
+                                    sizeof(event->action));
+        } else if (!strcmp(key, "text")) {
+            free(event->text);
+            event->text = parse_string(parser);
+            ok = event->text;
+        } else {
+            ok = false;
+            bool known = false;
+            for (size_t i = 0; i < ARRAY_LEN(numbers); ++i) {
+                if (!strcmp(key, numbers[i].name)) {
+                    double *value =
+                        (double *) ((char *) event + numbers[i].offset);
+                    ok = parse_number(parser, value);
+                    event->fields |= numbers[i].field;
+                    known = true;
+                    break;
+                }
+            }
+            if (!known) {
+                // Ignore unknown fields
+                ok = skip_value(parser, 1);
+            }
+        }
+        free(key);
+
+        if (!ok) {
+            return false;
+        }
+
+        skip_ws(parser);
+        if (*parser->p == ',') {
+            ++parser->p;
+            continue;
+        }
+        return expect(parser, '}');
+    }
+}
+
+static bool
+is_integer_in_range(double value, double min, double max) {
+    return value >= min && value <= max && value == (double) (int64_t) value;
+}
+
+static bool
+push_msg(struct sc_bridge_input_msgs *msgs, const struct sc_control_msg *msg,
+         struct sc_bridge_input_parser *parser) {
+    if (!sc_vector_push(msgs, *msg)) {
+        LOG_OOM();
+        parser->error = "Out of memory";
+        return false;
+    }
+    return true;
+}
+
+static bool
+push_touch(struct sc_bridge_input_parser *parser,
+           const struct sc_bridge_input_event *event,
+           struct sc_size frame_size, struct sc_bridge_input_msgs *msgs) {
+    unsigned required = SC_BRIDGE_INPUT_FIELD_X | SC_BRIDGE_INPUT_FIELD_Y;
+    if ((event->fields & required) != required) {
+        parser->error = "Missing touch position";
+        return false;
+    }
+
+    if (event->x < 0 || event->x >= frame_size.width
+            || event->y < 0 || event->y >= frame_size.height) {
+        parser->error = "Touch position out of the frame";
+        return false;
+    }
+
+    double pointer = 0;
+    if (event->fields & SC_BRIDGE_INPUT_FIELD_POINTER) {
+        pointer = event->pointer;
+        if (!is_integer_in_range(pointer, 0,
+                                 SC_BRIDGE_INPUT_MAX_POINTERS - 1)) {
+            parser->error = "Invalid pointer";
+            return false;
+        }
+    }
+
+    bool tap = !strcmp(event->type, "tap");
+    enum android_motionevent_action action;
+    if (tap || !strcmp(event->action, "down")) {
+        action = AMOTION_EVENT_ACTION_DOWN;
+    } else if (!strcmp(event->action, "up")) {
+        action = AMOTION_EVENT_ACTION_UP;
+    } else if (!strcmp(event->action, "move")) {
+        action = AMOTION_EVENT_ACTION_MOVE;
+    } else {
+        parser->error = "Invalid touch action";
+        return false;
+    }
+
+    float pressure = action == AMOTION_EVENT_ACTION_UP ? 0.f : 1.f;
+    if (event->fields & SC_BRIDGE_INPUT_FIELD_PRESSURE) {
+        if (event->pressure < 0 || event->pressure > 1) {
+            parser->error = "Invalid pressure";
+            return false;
+        }
+        pressure = event->pressure;
+    }
+
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT,
+        .inject_touch_event = {
+            .action = action,
+            .action_button = 0,
+            .buttons = 0,
+            .pointer_id = (uint64_t) pointer,
+            .position = {
+                .screen_size = frame_size,
+                .point = {
+                    .x = (int32_t) event->x,
+                    .y = (int32_t) event->y,
+                },
+            },
+            .pressure = pressure,
+        },
+    };
+    if (!push_msg(msgs, &msg, parser)) {
+        return false;
+    }
+
+    if (tap) {
+        msg.inject_touch_event.action = AMOTION_EVENT_ACTION_UP;
+        msg.inject_touch_event.pressure = 0.f;
+        return push_msg(msgs, &msg, parser);
+    }
+
+    return true;
+}
+
+static bool
+push_key(struct sc_bridge_input_parser *parser,
+         const struct sc_bridge_input_event *event,
+         struct sc_bridge_input_msgs *msgs) {
+    if (!(event->fields & SC_BRIDGE_INPUT_FIELD_KEYCODE)
+            || !is_integer_in_range(event->keycode, 0, UINT16_MAX)) {
+        parser->error = "Missing or invalid keycode";
+        return false;
+    }
+
+    double metastate = 0;
+    if (event->fields & SC_BRIDGE_INPUT_FIELD_METASTATE) {
+        metastate = event->metastate;
+        if (!is_integer_in_range(metastate, 0, INT32_MAX)) {
+            parser->error = "Invalid metastate";
+            return false;
+        }
+    }
+
+    double repeat = 0;
+    if (event->fields & SC_BRIDGE_INPUT_FIELD_REPEAT) {
+        repeat = event->repeat;
+        if (!is_integer_in_range(repeat, 0, UINT32_MAX)) {
+            parser->error = "Invalid repeat";
+            return false;
+        }
+    }
+
+    // A "press" (the default) is a down followed by an up
+    bool press = !*event->action || !strcmp(event->action, "press");
+    enum android_keyevent_action action;
+    if (press || !strcmp(event->action, "down")) {
+        action = AKEY_EVENT_ACTION_DOWN;
+    } else if (!strcmp(event->action, "up")) {
+        action = AKEY_EVENT_ACTION_UP;
+    } else {
+        parser->error = "Invalid key action";
+        return false;
+    }
+
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_KEYCODE,
+        .inject_keycode = {
+            .action = action,
+            .keycode = (enum android_keycode) event->keycode,
+            .repeat = (uint32_t) repeat,
+            .metastate = (enum android_metastate) metastate,
+        },
+    };
+    if (!push_msg(msgs, &msg, parser)) {
+        return false;
+    }
+
+    if (press) {
+        msg.inject_keycode.action = AKEY_EVENT_ACTION_UP;
+        msg.inject_keycode.repeat = 0;
+        return push_msg(msgs, &msg, parser);
+    }
+
+    return true;
+}
+
+static bool
+push_text(struct sc_bridge_input_parser *parser,
+          const struct sc_bridge_input_event *event,
+          struct sc_bridge_input_msgs *msgs) {
+    if (!event->text || !*event->text) {
+        parser->error = "Missing text";
+        return false;
+    }
+
+    // Split the text into msgs of the maximal size, on character boundaries
+    const char *text = event->text;
+    while (*text) {
+        size_t len = sc_str_utf8_truncation_index(
+                text, SC_CONTROL_MSG_INJECT_TEXT_MAX_LENGTH);
+        assert(len);
+        char *chunk = malloc(len + 1);
+        if (!chunk) {
+            LOG_OOM();
+            parser->error = "Out of memory";
+            return false;
+        }
+        memcpy(chunk, text, len);
+        chunk[len] = '\0';
+
+        struct sc_control_msg msg = {
+            .type = SC_CONTROL_MSG_TYPE_INJECT_TEXT,
+            .inject_text = {
+                .text = chunk,
+            },
+        };
+        if (!push_msg(msgs, &msg, parser)) {
+            free(chunk);
+            return false;
+        }
+
+        text += len;
+    }
+
+    return true;
+}
+
+static bool
+push_event(struct sc_bridge_input_parser *parser,
+           const struct sc_bridge_input_event *event,
+           struct sc_size frame_size, struct sc_bridge_input_msgs *msgs) {
+    if (!strcmp(event->type, "touch") || !strcmp(event->type, "tap")) {
+        return push_touch(parser, event, frame_size, msgs);
+    }
+    if (!strcmp(event->type, "key")) {
+        return push_key(parser, event, msgs);
+    }
+    if (!strcmp(event->type, "text")) {
+        return push_text(parser, event, msgs);
+    }
+
+    parser->error = "Unknown event type or action";
+    return false;
+}
+
+bool
+sc_bridge_input_parse(const char *json, struct sc_size frame_size,
+                      struct sc_bridge_input_msgs *msgs, const char **error) {
+    assert(!msgs->size);
+
+    struct sc_bridge_input_parser parser = {
+        .p = json,
+        .error = NULL,
+    };
+
+    if (!expect(&parser, '[')) {
+        *error = "The body must be a JSON array of events";
+        return false;
+    }
+
+    unsigned count = 0;
+    skip_ws(&parser);
+    if (*parser.p == ']') {
+        ++parser.p;
+    } else {
+        for (;;) {
+            if (++count > SC_BRIDGE_INPUT_MAX_EVENTS) {
+                parser.error = "Too many events";
+                goto error;
+            }
+
+            struct sc_bridge_input_event event;
+            bool ok = parse_event(&parser, &event);
+            if (ok) {
+                ok = push_event(&parser, &event, frame_size, msgs);
+            }
+            free(event.text);
+            if (!ok) {
+                goto error;
+            }
+
+            skip_ws(&parser);
+            if (*parser.p == ',') {
+                ++parser.p;
+                continue;
+            }
+            if (!expect(&parser, ']')) {
+                goto error;
+            }
+            break;
+        }
+    }
+
+    skip_ws(&parser);
+    if (*parser.p) {
+        parser.error = "Unexpected data after the JSON array";
+        goto error;
+    }
+
+    return true;
+
+error:
+    assert(parser.error);
+    *error = parser.error;
+    for (size_t i = 0; i < msgs->size; ++i) {
+        sc_control_msg_destroy(&msgs->data[i]);
+    }
+    sc_vector_clear(msgs);
+    return false;
+}
+
+void
+sc_bridge_input_msgs_destroy(struct sc_bridge_input_msgs *msgs) {
+    for (size_t i = 0; i < msgs->size; ++i) {
+        sc_control_msg_destroy(&msgs->data[i]);
+    }
+    sc_vector_destroy(msgs);
+}
@@ -0,0 +1,47 @@
+#ifndef SC_BRIDGE_INPUT_H
+#define SC_BRIDGE_INPUT_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+#include "control_msg.h"
+#include "coords.h"
+#include "util/vector.h"
+
+// Maximum number of events in a single batch
+#define SC_BRIDGE_INPUT_MAX_EVENTS 256
+// Pointer ids accepted for touch events (for multi-touch gestures)
+#define SC_BRIDGE_INPUT_MAX_POINTERS 10
+
+struct sc_bridge_input_msgs SC_VECTOR(struct sc_control_msg);
+
+/**
+ * Parse a batch of input events (the body of POST /scrcpy-bridge/input)
+ *
+ * The batch is a JSON array of events, for example:
+ *
+ *     [{"type":"touch","action":"down","x":100,"y":200},
+ *      {"type":"touch","action":"up","x":100,"y":200},
+ *      {"type":"key","keycode":66},
+ *      {"type":"text","text":"hello"}]
+ *
+ * The positions are expressed in pixels of the video frames, whose size is
+ * `frame_size`.
+ *
+ * On success, the resulting control msgs are appended to `msgs` (to be
+ * released by sc_bridge_input_msgs_destroy() if they are not pushed to the
+ * controller). On error, `msgs` is left empty and `*error` points to a static
+ * message describing the problem.
+ */
+bool
+sc_bridge_input_parse(const char *json, struct sc_size frame_size,
+                      struct sc_bridge_input_msgs *msgs, const char **error);
+
+/**
+ * Destroy the msgs (and the vector)
+ */
+void
+sc_bridge_input_msgs_destroy(struct sc_bridge_input_msgs *msgs);
+
+#endif
@@ -0,0 +1,316 @@
+#include "bridge_stream.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavutil/avutil.h>
+
+#include "control_msg.h"
+#include "packet_merger.h"
+#include "util/log.h"
+
+/** Downcast packet sink to sc_bridge_stream */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_bridge_stream, packet_sink)
+
+#define SC_BRIDGE_STREAM_AVIO_BUFFER_SIZE 4096
+
+static const AVRational SC_BRIDGE_STREAM_TIME_BASE = {1, 1000000}; // in us
+
+#ifdef SCRCPY_LAVF_HAS_AVIO_CONST_WRITE_PACKET
+static int
+sc_bridge_stream_write_packet(void *opaque, const uint8_t *buf, int buf_size) {
+#else
+static int
+sc_bridge_stream_write_packet(void *opaque, uint8_t *buf, int buf_size) {
+#endif
+    struct sc_bridge_stream *stream = opaque;
+
+    assert(buf_size >= 0);
+    size_t size = buf_size;
+    if (size > stream->cap - stream->len) {
+        size_t cap = MAX(stream->cap * 2, stream->len + size);
+        uint8_t *p = realloc(stream->buf, cap);
+        if (!p) {
+            LOG_OOM();
+            return AVERROR(ENOMEM);
+        }
+        stream->buf = p;
+        stream->cap = cap;
+    }
+
+    memcpy(&stream->buf[stream->len], buf, size);
+    stream->len += size;
+    return buf_size;
+}
+
+static void
+sc_bridge_stream_close_muxer(struct sc_bridge_stream *stream) {
+    AVIOContext *pb = stream->ctx->pb;
+    // The buffer may have been reallocated by AVIO
+    av_freep(&pb->buffer);
+    avio_context_free(&stream->ctx->pb);
+    avformat_free_context(stream->ctx);
+    stream->ctx = NULL;
+}
+
+static bool
+sc_bridge_stream_open_muxer(struct sc_bridge_stream *stream,
+                            const AVPacket *config) {
+    const AVOutputFormat *format = av_guess_format("mp4", NULL, NULL);
+    if (!format) {
+        LOGE("Could not find mp4 muxer");
+        return false;
+    }
+
+    AVFormatContext *ctx = avformat_alloc_context();
+    if (!ctx) {
+        LOG_OOM();
+        return false;
+    }
+
+    // AVFormatContext.oformat expects a pointer-to-non-const (see recorder.c)
+    ctx->oformat = (AVOutputFormat *) format;
+
+    AVStream *ostream = avformat_new_stream(ctx, NULL);
+    if (!ostream) {
+        LOG_OOM();
+        avformat_free_context(ctx);
+        return false;
+    }
+
+    int r = avcodec_parameters_from_context(ostream->codecpar,
+                                            stream->codec_ctx);
+    if (r < 0) {
+        avformat_free_context(ctx);
+        return false;
+    }
+
+    // The config packet (SPS/PPS for H.264) is the extradata
+    uint8_t *extradata =
+        av_mallocz(config->size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!extradata) {
+        LOG_OOM();
+        avformat_free_context(ctx);
+        return false;
+    }
+    memcpy(extradata, config->data, config->size);
+    ostream->codecpar->extradata = extradata;
+    ostream->codecpar->extradata_size = config->size;
+
+    unsigned char *buffer = av_malloc(SC_BRIDGE_STREAM_AVIO_BUFFER_SIZE);
+    if (!buffer) {
+        LOG_OOM();
+        avformat_free_context(ctx);
+        return false;
+    }
+
+    ctx->pb = avio_alloc_context(buffer, SC_BRIDGE_STREAM_AVIO_BUFFER_SIZE, 1,
+                                 stream, NULL, sc_bridge_stream_write_packet,
+                                 NULL);
+    if (!ctx->pb) {
+        LOG_OOM();
+        av_free(buffer);
+        avformat_free_context(ctx);
+        return false;
+    }
+
+    stream->ctx = ctx;
+
+    // Write the moov box immediately (without samples), then a fragment
+    // (moof + mdat) on each explicit flush
+    AVDictionary *opts = NULL;
+    av_dict_set(&opts, "movflags", "frag_custom+empty_moov+default_base_moof",
+                0);
+    r = avformat_write_header(ctx, &opts);
+    av_dict_free(&opts);
+    if (r < 0) {
+        LOGE("Could not write the live stream header");
+        sc_bridge_stream_close_muxer(stream);
+        return false;
+    }
+
+    avio_flush(ctx->pb);
+    return true;
+}
+
+static bool
+sc_bridge_stream_write(struct sc_bridge_stream *stream, AVPacket *packet) {
+    AVStream *ostream = stream->ctx->streams[0];
+
+    bool keyframe = packet->flags & AV_PKT_FLAG_KEY;
+
+    // The new parameter sets must be sent in-band
+    if (!sc_packet_merger_inline_config(packet)) {
+        return false;
+    }
+
+    packet->stream_index = 0;
+    packet->pts -= stream->pts_origin;
+    packet->dts = packet->pts;
+    av_packet_rescale_ts(packet, SC_BRIDGE_STREAM_TIME_BASE,
+                         ostream->time_base);
+
+    int r = av_write_frame(stream->ctx, packet);
+    if (r < 0) {
+        return false;
+    }
+
+    // Flush the fragment containing this single packet
+    r = av_write_frame(stream->ctx, NULL);
+    if (r < 0) {
+        return false;
+    }
+
+    avio_flush(stream->ctx->pb);
+    if (stream->ctx->pb->error < 0) {
+        return false;
+    }
+
+    bool ok = sc_figma_bridge_publish_stream_fragment(stream->bridge,
+                                                      stream->buf, stream->len,
+                                                      keyframe);
+    stream->len = 0;
+    return ok;
+}
+
+static void
+sc_bridge_stream_request_keyframe(struct sc_bridge_stream *stream) {
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_REQUEST_SYNC_FRAME;
+
+    if (!sc_controller_push_msg(stream->controller, &msg)) {
+        LOGW("Could not request a new keyframe");
+    }
+}
+
+static bool
+sc_bridge_stream_push(struct sc_bridge_stream *stream, const AVPacket *packet) {
+    bool is_config = packet->pts == AV_NOPTS_VALUE;
+    if (is_config) {
+        if (stream->ctx) {
+            // Ignore further config packets (e.g. on device orientation
+            // change). The next non-config packet will have the config
+            // packet data prepended.
+            return true;
+        }
+
+        if (!sc_bridge_stream_open_muxer(stream, packet)) {
+            return false;
+        }
+
+        bool ok = sc_figma_bridge_publish_stream_init(stream->bridge,
+                                                      stream->buf,
+                                                      stream->len);
+        stream->len = 0;
+        return ok;
+    }
+
+    if (!stream->ctx) {
+        // No config packet received
+        return false;
+    }
+
+    if (stream->controller
+            && sc_figma_bridge_take_keyframe_request(stream->bridge)) {
+        sc_bridge_stream_request_keyframe(stream);
+    }
+
+    if (stream->pts_origin == AV_NOPTS_VALUE) {
+        stream->pts_origin = packet->pts;
+    }
+
+    AVPacket *previous = stream->previous;
+    if (previous) {
+        // We now know the duration of the previous packet
+        previous->duration = packet->pts - previous->pts;
+        bool ok = sc_bridge_stream_write(stream, previous);
+        av_packet_unref(previous);
+        if (!ok) {
+            return false;
+        }
+    } else {
+        previous = av_packet_alloc();
+        if (!previous) {
+            LOG_OOM();
+            return false;
+        }
+        stream->previous = previous;
+    }
+
+    if (av_packet_ref(previous, packet)) {
+        LOG_OOM();
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+sc_bridge_stream_packet_sink_open(struct sc_packet_sink *sink,
+                                  AVCodecContext *ctx) {
+    struct sc_bridge_stream *stream = DOWNCAST(sink);
+    stream->codec_ctx = ctx;
+    return true;
+}
+
+static void
+sc_bridge_stream_packet_sink_close(struct sc_packet_sink *sink) {
+    struct sc_bridge_stream *stream = DOWNCAST(sink);
+
+    sc_figma_bridge_end_stream(stream->bridge);
+
+    if (stream->ctx) {
+        // The trailer is useless for a live stream, but it releases the
+        // muxer resources
+        av_write_trailer(stream->ctx);
+        sc_bridge_stream_close_muxer(stream);
+    }
+    av_packet_free(&stream->previous);
+    free(stream->buf);
+    stream->buf = NULL;
+    stream->len = 0;
+    stream->cap = 0;
+}
+
+static bool
+sc_bridge_stream_packet_sink_push(struct sc_packet_sink *sink,
+                                  const AVPacket *packet) {
+    struct sc_bridge_stream *stream = DOWNCAST(sink);
+
+    if (stream->failed) {
+        return true;
+    }
+
+    if (!sc_bridge_stream_push(stream, packet)) {
+        // The live stream is optional, do not stop mirroring
+        LOGW("Figma Bridge live stream failed, disabled");
+        stream->failed = true;
+        sc_figma_bridge_end_stream(stream->bridge);
+    }
+
+    return true;
+}
+
+void
+sc_bridge_stream_init(struct sc_bridge_stream *stream,
+                      struct sc_figma_bridge *bridge,
+                      struct sc_controller *controller) {
+    stream->bridge = bridge;
+    stream->controller = controller;
+    stream->codec_ctx = NULL;
+    stream->ctx = NULL;
+    stream->previous = NULL;
+    stream->pts_origin = AV_NOPTS_VALUE;
+    stream->failed = false;
+    stream->buf = NULL;
+    stream->len = 0;
+    stream->cap = 0;
+
+    static const struct sc_packet_sink_ops ops = {
+        .open = sc_bridge_stream_packet_sink_open,
+        .close = sc_bridge_stream_packet_sink_close,
+        .push = sc_bridge_stream_packet_sink_push,
+    };
+
+    stream->packet_sink.ops = &ops;
+}
@@ -0,0 +1,49 @@
+#ifndef SC_BRIDGE_STREAM_H
+#define SC_BRIDGE_STREAM_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+
+#include "controller.h"
+#include "figma_bridge.h"
+#include "trait/packet_sink.h"
+
+/**
+ * Live video stream for the Figma Bridge (/scrcpy-bridge/stream.mp4)
+ *
+ * It is a packet sink of the video demuxer. The encoded packets are remuxed
+ * (not re-encoded) as fragmented MP4, one fragment per packet, and published
+ * to the bridge, which serves them to any number of viewers.
+ */
+struct sc_bridge_stream {
+    struct sc_packet_sink packet_sink; // packet sink trait
+
+    struct sc_figma_bridge *bridge;
+    // To request a keyframe when a new viewer connects (may be NULL)
+    struct sc_controller *controller;
+
+    const AVCodecContext *codec_ctx; // valid between open() and close()
+    AVFormatContext *ctx; // NULL until the config packet is received
+    // A packet is written once the next one is received, to know its duration
+    AVPacket *previous;
+    int64_t pts_origin;
+    // Set on error, the stream is then disabled (without failing the session)
+    bool failed;
+
+    // Output of the muxer, published on each flush
+    uint8_t *buf;
+    size_t len;
+    size_t cap;
+};
+
+void
+sc_bridge_stream_init(struct sc_bridge_stream *stream,
+                      struct sc_figma_bridge *bridge,
+                      struct sc_controller *controller);
+
+#endif
@@ -1,6 +1,7 @@
 #include "cli.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <getopt.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -8,12 +9,14 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "audio_output.h"
 #include "options.h"
 #include "util/log.h"
 #include "util/net.h"
 #include "util/str.h"
 #include "util/strbuf.h"
 #include "util/term.h"
+#include "util/thread.h"
 #include "util/tick.h"
 
 #define STR_IMPL_(x) #x
@@ -33,6 +36,7 @@ enum {
     OPT_WINDOW_HEIGHT,
     OPT_WINDOW_BORDERLESS,
     OPT_MAX_FPS,
+    OPT_MAX_MEMORY,
     OPT_LOCK_VIDEO_ORIENTATION,
     OPT_DISPLAY,
     OPT_DISPLAY_ID,
@@ -114,6 +118,64 @@ enum {
     OPT_NO_VD_SYSTEM_DECORATIONS,
     OPT_NO_VD_DESTROY_CONTENT,
     OPT_DISPLAY_IME_POLICY,
+    OPT_SCREENSHOT_GPU_READBACK,
+    OPT_FRAME_PACING,
+    OPT_VIDEO_DECODER,
+    OPT_PRINT_LATENCY,
+    OPT_TRACE_FILE,
+    OPT_DECODER_THREADS,
+    OPT_RECORD_BUFFER,
+    OPT_RECORD_SEGMENT,
+    OPT_RECORD_KEEP,
+    OPT_AUDIO_BUFFER_MAX,
+    OPT_VIDEO_BIT_RATE_ADAPTIVE,
+    OPT_VIDEO_ROI,
+    OPT_VIDEO_IDLE_TIMEOUT,
+    OPT_KEEP_SERVER,
+    OPT_ADB_BATCH,
+    OPT_ADB_NATIVE,
+    OPT_MEASURE_INPUT_LATENCY,
+    OPT_PUSH_JOBS,
+    OPT_GAMEPAD_POLLING_RATE,
+    OPT_V4L2_SIZE,
+    OPT_V4L2_FORMAT,
+    OPT_VIDEO_BUFFER_PACKETS,
+    OPT_DUMP_STREAM,
+    OPT_REPLAY,
+    OPT_REPLAY_UNTHROTTLED,
+    OPT_VIDEO_UDP_PORT,
+    OPT_DIRECT_PORT,
+    OPT_VIDEO_SOCKET_BUFFER,
+    OPT_SOCKET_BUSY_POLL,
+    OPT_RENDER_SCALE,
+    OPT_DOWNSCALE_FILTER,
+    OPT_AUTO_SIZE,
+    OPT_SCREENSHOT_FROM_DEVICE,
+    OPT_SCREENSHOT_FORMAT,
+    OPT_SCREENSHOT_PNG_LEVEL,
+    OPT_REPLAY_BUFFER,
+    OPT_RECORD_TRANSCODE,
+    OPT_AUDIO_OUTPUT_BACKEND,
+    OPT_AV_SYNC,
+    OPT_VIDEO_ENCODER_PROFILE,
+    OPT_VIDEO_INTRA_REFRESH,
+    OPT_BENCHMARK_ENCODERS,
+    OPT_LATENCY_PROBE,
+    OPT_NO_AUDIO_CONCEALMENT,
+    OPT_VIDEO_HDR,
+    OPT_CPU_AFFINITY,
+    OPT_SHM_SINK,
+    OPT_IOSURFACE_SINK,
+    OPT_NO_SESSION_CACHE,
+    OPT_RECORD_INDEX,
+    OPT_UNFOCUSED_DECODE,
+    OPT_VIDEO_MODE,
+    OPT_THUMBNAIL_INTERVAL,
+    OPT_VIDEO_SQUARE,
+    OPT_TEXTURE_DAMAGE,
+    OPT_THERMAL_THROTTLE,
+    OPT_MULTIPLEX,
+    OPT_THROUGHPUT,
 };
 
 struct sc_option {
@@ -150,6 +212,25 @@ struct sc_getopt_adapter {
 };
 
 static const struct sc_option options[] = {
+    {
+        .longopt_id = OPT_ADB_BATCH,
+        .longopt = "adb-batch",
+        .text = "Check that the server on the device is up to date in the "
+                "same \"adb shell\" command which starts it, to save one adb "
+                "execution on startup (it is only pushed if it is outdated).\n"
+                "This is only relevant with --no-cleanup (otherwise, the "
+                "server is always pushed).",
+    },
+    {
+        .longopt_id = OPT_ADB_NATIVE,
+        .longopt = "adb-native",
+        .text = "Talk directly to the adb server (on localhost, port "
+                "$ANDROID_ADB_SERVER_PORT or 5037) to list the devices, push "
+                "the server and set up the tunnels, instead of executing adb "
+                "for each operation.\n"
+                "The adb executable is still used if the adb server could not "
+                "be reached, and to start it.",
+    },
     {
         .longopt_id = OPT_ALWAYS_ON_TOP,
         .longopt = "always-on-top",
@@ -179,6 +260,15 @@ static const struct sc_option options[] = {
                 "likelihood of buffer underrun (causing audio glitches).\n"
                 "Default is 50.",
     },
+    {
+        .longopt_id = OPT_AUDIO_BUFFER_MAX,
+        .longopt = "audio-buffer-max",
+        .argdesc = "ms",
+        .text = "Enable adaptive audio buffering: the buffering delay adapts "
+                "to the measured network jitter, between --audio-buffer and "
+                "this value (in milliseconds).\n"
+                "Default is 0 (fixed audio buffering).",
+    },
     {
         .longopt_id = OPT_AUDIO_CODEC,
         .longopt = "audio-codec",
@@ -244,22 +334,70 @@ static const struct sc_option options[] = {
                 "microphone and the device playback.\n"
                 "Default is output.",
     },
+    {
+        .longopt_id = OPT_AUDIO_OUTPUT_BACKEND,
+        .longopt = "audio-output-backend",
+        .argdesc = "backend",
+        .text = "Select the audio output backend.\n"
+                "Possible values are \"auto\", \"sdl\" and \"native\".\n"
+                "The native backend (Core Audio on macOS, ALSA on Linux) "
+                "pulls the samples with the smallest period supported by the "
+                "device, without the additional buffering of SDL.\n"
+                "With \"auto\", the native backend is used if available, "
+                "with a fallback to SDL.\n"
+                "Default is auto.",
+    },
     {
         .longopt_id = OPT_AUDIO_OUTPUT_BUFFER,
         .longopt = "audio-output-buffer",
         .argdesc = "ms",
-        .text = "Configure the size of the SDL audio output buffer (in "
+        .text = "Configure the size of the audio output buffer (in "
                 "milliseconds).\n"
                 "If you get \"robotic\" audio playback, you should test with "
                 "a higher value (10). Do not change this setting otherwise.\n"
                 "Default is 5.",
     },
+    {
+        .longopt_id = OPT_AUTO_SIZE,
+        .longopt = "auto-size",
+        .text = "Adapt the video size to the size of the window: the device "
+                "encodes at most the number of pixels actually displayed.\n"
+                "When the window is resized, the encoding is restarted with "
+                "a new maximum size (only for significant changes, at most "
+                "twice per second).\n"
+                "The value of --max-size, if any, is still an upper bound.",
+    },
+    {
+        .longopt_id = OPT_AV_SYNC,
+        .longopt = "av-sync",
+        .argdesc = "ms",
+        .optional_arg = true,
+        .text = "Synchronize the video with the audio: the frames are "
+                "presented when the audio having the same timestamp is "
+                "played, delayed by at most the given value (in "
+                "milliseconds).\n"
+                "This adds latency to the video (typically the audio "
+                "buffering), but keeps lip sync on long sessions.\n"
+                "Default is 200 if the option is given without value.",
+    },
+    {
+        .longopt_id = OPT_BENCHMARK_ENCODERS,
+        .longopt = "benchmark-encoders",
+        .text = "Benchmark the video encoders available on the device, on a "
+                "synthetic animation at several sizes and bit rates, and "
+                "report the frame rate, the encoding latency and the "
+                "stability of the output bit rate.\n"
+                "This may take some time (a few seconds per encoder).",
+    },
     {
         .shortopt = 'b',
         .longopt = "video-bit-rate",
         .argdesc = "value",
         .text = "Encode the video at the given bit rate, expressed in bits/s. "
                 "Unit suffixes are supported: 'K' (x1000) and 'M' (x1000000).\n"
+                "If the value is \"auto\", the throughput of the connection is "
+                "measured on startup to choose the bit rate (at most 8M) and, "
+                "unless --max-size is set, the video size.\n"
                 "Default is 8M (8000000).",
     },
     {
@@ -345,6 +483,18 @@ static const struct sc_option options[] = {
         .longopt = "codec-options",
         .argdesc = "key[:type]=value[,...]",
     },
+    {
+        .longopt_id = OPT_CPU_AFFINITY,
+        .longopt = "cpu-affinity",
+        .argdesc = "cpus",
+        .text = "Restrict the latency-critical threads (demuxing and "
+                "decoding, control, audio output) to the given CPUs, so that "
+                "they do not compete with other heavy workloads running on "
+                "the other CPUs.\n"
+                "The CPUs are given as a comma-separated list of indices or "
+                "ranges, e.g. \"0-3,6\".\n"
+                "Supported on Linux and Windows.",
+    },
     {
         .longopt_id = OPT_CROP,
         .longopt = "crop",
@@ -359,6 +509,28 @@ static const struct sc_option options[] = {
         .text = "Use USB device (if there is exactly one, like adb -d).\n"
                 "Also see -e (--select-tcpip).",
     },
+    {
+        .longopt_id = OPT_DECODER_THREADS,
+        .longopt = "decoder-threads",
+        .argdesc = "value",
+        .text = "Set the number of threads used by the software video decoder "
+                "(0 for auto).\n"
+                "Only slice threading is used (frame threading would add "
+                "latency), so it helps only for streams encoded with several "
+                "slices (or tiles).\n"
+                "Default is 0 (auto).",
+    },
+    {
+        .longopt_id = OPT_DIRECT_PORT,
+        .longopt = "direct-port",
+        .argdesc = "port",
+        .text = "Connect directly to the server on the given device TCP port, "
+                "instead of through an adb tunnel.\n"
+                "adb is only used to start the server (and to pass it a random "
+                "token, which authenticates the connections).\n"
+                "It only applies to a device connected over TCP/IP (see "
+                "--tcpip).",
+    },
     {
         .longopt_id = OPT_DISABLE_SCREENSAVER,
         .longopt = "disable-screensaver",
@@ -409,6 +581,31 @@ static const struct sc_option options[] = {
                 "before the rotation.\n"
                 "Default is 0.",
     },
+    {
+        .longopt_id = OPT_DOWNSCALE_FILTER,
+        .longopt = "downscale-filter",
+        .argdesc = "value",
+        .text = "Select the filter used when the video is rendered smaller "
+                "than its size.\n"
+                "Possible values are \"linear\", \"trilinear\" (mipmaps) and "
+                "\"area\" (a shader averaging all the pixels covered, in a "
+                "single pass, which does not need to generate mipmaps for "
+                "each frame).\n"
+                "\"trilinear\" requires OpenGL 3.0+ or OpenGL ES 2.0+, "
+                "\"area\" requires OpenGL 2.0+ or OpenGL ES 2.0+ (otherwise, "
+                "\"linear\" is used).\n"
+                "Default is \"trilinear\".",
+    },
+    {
+        .longopt_id = OPT_DUMP_STREAM,
+        .longopt = "dump-stream",
+        .argdesc = "file",
+        .text = "Write a raw copy of the video stream received from the device "
+                "(as sent by the server) to file, to play it later with "
+                "--replay.\n"
+                "If scrcpy reconnects to the device, the file contains only "
+                "the last session.",
+    },
     {
         .shortopt = 'e',
         .longopt = "select-tcpip",
@@ -437,6 +634,16 @@ static const struct sc_option options[] = {
         .longopt_id = OPT_FORWARD_ALL_CLICKS,
         .longopt = "forward-all-clicks",
     },
+    {
+        .longopt_id = OPT_FRAME_PACING,
+        .longopt = "frame-pacing",
+        .text = "Render at most one frame per display refresh (the most "
+                "recent one), instead of rendering each frame as soon as it "
+                "is decoded.\n"
+                "This avoids uploading frames that could never be displayed "
+                "when the device frame rate is higher than the display "
+                "refresh rate.",
+    },
     {
         .shortopt = 'G',
         .text = "Same as --gamepad=uhid, or --gamepad=aoa if --otg is set.",
@@ -454,6 +661,17 @@ static const struct sc_option options[] = {
                 "It may only work over USB.\n"
                 "Also see --keyboard and --mouse.",
     },
+    {
+        .longopt_id = OPT_GAMEPAD_POLLING_RATE,
+        .longopt = "gamepad-polling-rate",
+        .argdesc = "value",
+        .text = "Set the maximal rate (in Hz) at which gamepad axis changes "
+                "are sent to the device (only the latest state of each "
+                "gamepad is sent). Button changes are always sent "
+                "immediately.\n"
+                "0 means unlimited.\n"
+                "Default is 250.",
+    },
     {
         .shortopt = 'h',
         .longopt = "help",
@@ -463,6 +681,27 @@ static const struct sc_option options[] = {
         .shortopt = 'K',
         .text = "Same as --keyboard=uhid, or --keyboard=aoa if --otg is set.",
     },
+    {
+        .longopt_id = OPT_IOSURFACE_SINK,
+        .longopt = "iosurface-sink",
+        .text = "Upload the decoded video frames to IOSurfaces, whose id is "
+                "published on the Figma Bridge (/scrcpy-bridge/surface), so "
+                "that other applications can use them as GPU textures "
+                "without capturing the window.\n"
+                "This option is only available on macOS.",
+    },
+    {
+        .longopt_id = OPT_KEEP_SERVER,
+        .longopt = "keep-server",
+        .text = "Keep the server running on the device after scrcpy "
+                "terminates, and reuse it on the next start (if the scrcpy "
+                "version and the server options are the same), to skip "
+                "pushing and starting the server.\n"
+                "This implies --force-adb-forward.\n"
+                "The cleanup (see --no-cleanup) is only performed when the "
+                "server terminates. To stop it, execute: "
+                "`adb shell pkill -f com.genymobile.scrcpy.Server`.",
+    },
     {
         .longopt_id = OPT_KEYBOARD,
         .longopt = "keyboard",
@@ -492,6 +731,16 @@ static const struct sc_option options[] = {
         .longopt = "kill-adb-on-close",
         .text = "Kill adb when scrcpy terminates.",
     },
+    {
+        .longopt_id = OPT_LATENCY_PROBE,
+        .longopt = "latency-probe",
+        .text = "Measure the end-to-end latency: the client repeatedly sends "
+                "a code, which the device draws as a small pattern in the "
+                "top-left corner of the video, and measures the delay until "
+                "a frame containing it is presented.\n"
+                "Both instants are measured on the computer clock. The "
+                "p50/p95/p99 latencies are printed on exit.",
+    },
     {
         // deprecated
         //.shortopt = 'K', // old, reassigned
@@ -563,6 +812,29 @@ static const struct sc_option options[] = {
         .text = "Limit the frame rate of screen capture (officially supported "
                 "since Android 10, but may work on earlier versions).",
     },
+    {
+        .longopt_id = OPT_MAX_MEMORY,
+        .longopt = "max-memory",
+        .argdesc = "size",
+        .text = "Limit the memory used by the client buffers, in bytes.\n"
+                "Supports 'K' and 'M' suffixes (e.g. 256M). The budget is "
+                "shared between the decoded frames, the delay buffer and the "
+                "recording queue. If --max-size is not set, it is lowered to "
+                "fit the decoded frames in the budget. Over the budget, the "
+                "delay is reduced and packets waiting to be recorded are "
+                "spilled to a temporary file.\n"
+                "Default is 0 (unlimited).",
+    },
+    {
+        .longopt_id = OPT_MEASURE_INPUT_LATENCY,
+        .longopt = "measure-input-latency",
+        .text = "Measure the input latency: after an input event, the device "
+                "acknowledges the injection, and the first new frame "
+                "presented afterwards is considered to be its result.\n"
+                "The p50/p95/p99 of the round-trip, injection, render and "
+                "total latencies, and a histogram of the total latency, are "
+                "printed on exit.",
+    },
     {
         .longopt_id = OPT_MOUSE,
         .longopt = "mouse",
@@ -607,6 +879,15 @@ static const struct sc_option options[] = {
                 "Default is 'bhsn:++++' for SDK mouse, and '++++:bhsn' for AOA "
                 "and UHID.",
     },
+    {
+        .longopt_id = OPT_MULTIPLEX,
+        .longopt = "multiplex",
+        .text = "Carry the video, audio and control streams over a single "
+                "socket, instead of one socket each.\n"
+                "This saves the connection setup of the other sockets through "
+                "the adb tunnel, and the device messages (e.g. clipboard) are "
+                "sent before any pending video or audio data.",
+    },
     {
         .shortopt = 'n',
         .longopt = "no-control",
@@ -637,6 +918,15 @@ static const struct sc_option options[] = {
         .longopt = "no-audio",
         .text = "Disable audio forwarding.",
     },
+    {
+        .longopt_id = OPT_NO_AUDIO_CONCEALMENT,
+        .longopt = "no-audio-concealment",
+        .text = "By default, when audio packets arrive too late to be played, "
+                "the last played samples are repeated with a fade-out to hide "
+                "the gap.\n"
+                "This option disables this concealment: silence is inserted "
+                "instead.",
+    },
     {
         .longopt_id = OPT_NO_AUDIO_PLAYBACK,
         .longopt = "no-audio-playback",
@@ -648,7 +938,10 @@ static const struct sc_option options[] = {
         .text = "By default, scrcpy removes the server binary from the device "
                 "and restores the device state (show touches, stay awake and "
                 "power mode) on exit.\n"
-                "This option disables this cleanup."
+                "This option disables this cleanup.\n"
+                "Since the server binary is kept on the device, it is not "
+                "pushed again on the next start if it is unchanged (compared "
+                "using its SHA-256 hash)."
     },
     {
         .longopt_id = OPT_NO_CLIPBOARD_AUTOSYNC,
@@ -681,7 +974,8 @@ static const struct sc_option options[] = {
         .longopt = "no-mipmaps",
         .text = "If the renderer is OpenGL 3.0+ or OpenGL ES 2.0+, then "
                 "mipmaps are automatically generated to improve downscaling "
-                "quality. This option disables the generation of mipmaps.",
+                "quality. This option disables the generation of mipmaps.\n"
+                "Equivalent to --downscale-filter=linear.",
     },
     {
         .longopt_id = OPT_NO_MOUSE_HOVER,
@@ -694,6 +988,16 @@ static const struct sc_option options[] = {
         .longopt = "no-power-on",
         .text = "Do not power on the device on start.",
     },
+    {
+        .longopt_id = OPT_NO_SESSION_CACHE,
+        .longopt = "no-session-cache",
+        .text = "By default, scrcpy remembers a few facts about each device "
+                "(the window size and, with --no-cleanup, whether the server "
+                "on the device is up to date) to start faster on the next "
+                "launch.\n"
+                "This option disables this cache (it is neither read nor "
+                "written).",
+    },
     {
         .longopt_id = OPT_NO_VD_DESTROY_CONTENT,
         .longopt = "no-vd-destroy-content",
@@ -787,6 +1091,22 @@ static const struct sc_option options[] = {
         .text = "Start FPS counter, to print framerate logs to the console. "
                 "It can be started or stopped at any time with MOD+i.",
     },
+    {
+        .longopt_id = OPT_PRINT_LATENCY,
+        .longopt = "print-latency",
+        .text = "Measure the latency of each video frame at each stage of the "
+                "client pipeline (reception, decoding, texture upload and "
+                "present), and print the p50/p95/p99 of each stage on exit.",
+    },
+    {
+        .longopt_id = OPT_PUSH_JOBS,
+        .longopt = "push-jobs",
+        .argdesc = "value",
+        .text = "Set the number of files pushed in parallel (by separate adb "
+                "sessions) when several files are dropped to the device.\n"
+                "Consecutive files are also batched in a single adb session.\n"
+                "Default is 2.",
+    },
     {
         .longopt_id = OPT_PUSH_TARGET,
         .longopt = "push-target",
@@ -808,12 +1128,42 @@ static const struct sc_option options[] = {
         .longopt = "raw-key-events",
         .text = "Inject key events for all input keys, and ignore text events."
     },
+    {
+        .longopt_id = OPT_RECORD_BUFFER,
+        .longopt = "record-buffer",
+        .argdesc = "size",
+        .text = "Set the size of the recording write buffer, in bytes.\n"
+                "Unit suffixes are supported: 'K' (x1000) and 'M' (x1000000).\n"
+                "The file is written only when the buffer is full, which "
+                "avoids many small writes on slow or network drives.\n"
+                "Default is 0 (use the default FFmpeg I/O buffer).",
+    },
     {
         .longopt_id = OPT_RECORD_FORMAT,
         .longopt = "record-format",
         .argdesc = "format",
-        .text = "Force recording format (mp4, mkv, m4a, mka, opus, aac, flac "
-                "or wav).",
+        .text = "Force recording format (mp4, fmp4, mkv, m4a, mka, opus, aac, "
+                "flac or wav).\n"
+                "'fmp4' records a fragmented MP4, flushed at each video "
+                "keyframe: the memory usage does not grow with the recording "
+                "duration, and the file remains playable if scrcpy is "
+                "interrupted.",
+    },
+    {
+        .longopt_id = OPT_RECORD_INDEX,
+        .longopt = "record-index",
+        .text = "Write an index along with the recording file, as "
+                "\"<file>.index\": the position of each video keyframe, to "
+                "seek in a long recording without scanning the whole file.\n"
+                "Markers can be added to the index with MOD+Shift+m.",
+    },
+    {
+        .longopt_id = OPT_RECORD_KEEP,
+        .longopt = "record-keep",
+        .argdesc = "n",
+        .text = "Only keep the last n segment files (requires "
+                "--record-segment): older segments are deleted.\n"
+                "Default is 0 (keep all segments).",
     },
     {
         .longopt_id = OPT_RECORD_ORIENTATION,
@@ -824,6 +1174,31 @@ static const struct sc_option options[] = {
                 "the clockwise rotation in degrees.\n"
                 "Default is 0.",
     },
+    {
+        .longopt_id = OPT_RECORD_SEGMENT,
+        .longopt = "record-segment",
+        .argdesc = "seconds",
+        .text = "Split the recording into segment files of the given "
+                "duration, in seconds. A new file is started at the first "
+                "video keyframe after the duration has elapsed (the packets "
+                "are not re-encoded).\n"
+                "The segment index is inserted before the file extension: "
+                "file_0000.mp4, file_0001.mp4, etc.\n"
+                "See --record-keep.",
+    },
+    {
+        .longopt_id = OPT_RECORD_TRANSCODE,
+        .longopt = "record-transcode",
+        .argdesc = "codec[:bit_rate]",
+        .text = "Re-encode the recorded video with a hardware encoder "
+                "(VideoToolbox, VAAPI, NVENC, QSV, AMF or Media Foundation, "
+                "depending on the platform), from the decoded frames, "
+                "instead of recording the device stream as is.\n"
+                "Possible codecs are \"h264\" and \"h265\" (or \"hevc\"). "
+                "The bit rate supports the suffixes 'K' and 'M' (default is "
+                "4M).\n"
+                "For example: --record-transcode=hevc:2M",
+    },
     {
         .longopt_id = OPT_RENDER_DRIVER,
         .longopt = "render-driver",
@@ -834,6 +1209,46 @@ static const struct sc_option options[] = {
                 "\"opengles2\", \"opengles\", \"metal\" and \"software\".\n"
                 "<https://wiki.libsdl.org/SDL_HINT_RENDER_DRIVER>",
     },
+    {
+        .longopt_id = OPT_RENDER_SCALE,
+        .longopt = "render-scale",
+        .argdesc = "value",
+        .text = "With --new-display, render the display at a fraction of its "
+                "resolution (keeping the same density-independent layout), "
+                "and upscale it on the computer.\n"
+                "For example, --render-scale=0.5 divides the number of pixels "
+                "to render, encode and transmit by 4.\n"
+                "The value must be in the range [0.1; 1].\n"
+                "Default is 1.",
+    },
+    {
+        .longopt_id = OPT_REPLAY,
+        .longopt = "replay",
+        .argdesc = "file",
+        .text = "Play a video stream written by --dump-stream instead of "
+                "mirroring a device (no device is needed).\n"
+                "The stream is played in real time (see "
+                "--replay-unthrottled), and scrcpy exits at the end of the "
+                "stream.",
+    },
+    {
+        .longopt_id = OPT_REPLAY_BUFFER,
+        .longopt = "replay-buffer",
+        .argdesc = "seconds",
+        .text = "Keep the last encoded video and audio packets of the given "
+                "duration, in seconds, in memory (at most 64 MB), to save them "
+                "on demand to a new file with MOD+Shift+s (instant replay).\n"
+                "The file is written in the current directory, as "
+                "scrcpy_replay_YYYYMMDD_HHMMSS.mkv (the packets are not "
+                "re-encoded).",
+    },
+    {
+        .longopt_id = OPT_REPLAY_UNTHROTTLED,
+        .longopt = "replay-unthrottled",
+        .text = "With --replay, push the packets as fast as possible instead of "
+                "in real time (for benchmarking the decoding and the "
+                "rendering).",
+    },
     {
         .longopt_id = OPT_REQUIRE_AUDIO,
         .longopt = "require-audio",
@@ -852,7 +1267,10 @@ static const struct sc_option options[] = {
         .longopt = "serial",
         .argdesc = "serial",
         .text = "The device serial number. Mandatory only if several devices "
-                "are connected to adb.",
+                "are connected to adb.\n"
+                "Several serials may be passed, separated by ',', to mirror "
+                "several devices at once (each one in its own window, tiled "
+                "on the screen unless a window position or size is given).",
     },
     {
         .shortopt = 'S',
@@ -866,6 +1284,51 @@ static const struct sc_option options[] = {
         .text = "Set the screen off timeout while scrcpy is running (restore "
                 "the initial value on exit).",
     },
+    {
+        .longopt_id = OPT_SCREENSHOT_GPU_READBACK,
+        .longopt = "screenshot-gpu-readback",
+        .text = "Capture screenshots by reading back the frame rendered by the "
+                "GPU, instead of converting the decoded frame on the CPU.\n"
+                "If the renderer does not support render targets, the CPU "
+                "conversion is used.",
+    },
+    {
+        .longopt_id = OPT_SCREENSHOT_FROM_DEVICE,
+        .longopt = "screenshot-from-device",
+        .text = "Capture screenshots on the device, at its full resolution "
+                "(lossless PNG), instead of using the decoded video frame.\n"
+                "This is useful when the video is streamed at a reduced size "
+                "(see --max-size).",
+    },
+    {
+        .longopt_id = OPT_SCREENSHOT_FORMAT,
+        .longopt = "screenshot-format",
+        .argdesc = "format",
+        .text = "Select the format of the screenshots saved to a directory.\n"
+                "Possible values are \"png\" (lossless), \"jpeg\" and "
+                "\"webp\" (lossy, but much faster to encode and smaller).\n"
+                "Default is png.",
+    },
+    {
+        .longopt_id = OPT_SCREENSHOT_PNG_LEVEL,
+        .longopt = "screenshot-png-level",
+        .argdesc = "level",
+        .text = "Set the zlib compression level of the PNG screenshots, from "
+                "0 (no compression) to 9 (best compression).\n"
+                "Low levels are several times faster to encode for large "
+                "screenshots, at the cost of larger files.\n"
+                "By default, the encoder default level is used.",
+    },
+    {
+        .longopt_id = OPT_SHM_SINK,
+        .longopt = "shm-sink",
+        .argdesc = "file",
+        .text = "Publish the decoded video frames in a file mapped in memory "
+                "(e.g. /dev/shm/scrcpy), so that local processes can read "
+                "them without any encoding.\n"
+                "See doc/recording.md for the format of the file.\n"
+                "This option is not available on Windows.",
+    },
     {
         .longopt_id = OPT_SHORTCUT_MOD,
         .longopt = "shortcut-mod",
@@ -900,6 +1363,16 @@ static const struct sc_option options[] = {
                 "on exit.\n"
                 "It only shows physical touches (not clicks from scrcpy).",
     },
+    {
+        .longopt_id = OPT_SOCKET_BUSY_POLL,
+        .longopt = "socket-busy-poll",
+        .argdesc = "us",
+        .text = "Busy poll the network device for up to the given number of "
+                "microseconds when waiting for data on the sockets, to reduce "
+                "the receive latency at the cost of CPU usage.\n"
+                "Only supported on Linux (it may require CAP_NET_ADMIN).\n"
+                "Default is 0 (disabled).",
+    },
     {
         .longopt_id = OPT_TCPIP,
         .longopt = "tcpip",
@@ -915,12 +1388,64 @@ static const struct sc_option options[] = {
                 "this address before starting.\n"
                 "Prefix the address with a '+' to force a reconnection.",
     },
+    {
+        .longopt_id = OPT_TEXTURE_DAMAGE,
+        .longopt = "texture-damage",
+        .text = "Upload only the changed regions of each frame to the GPU "
+                "texture, rather than the whole frame.\n"
+                "This reduces the upload cost when the content is mostly "
+                "static, at the cost of a comparison with the previous frame "
+                "on the CPU. Frames from a hardware decoder are always "
+                "uploaded fully.",
+    },
+    {
+        .longopt_id = OPT_THERMAL_THROTTLE,
+        .longopt = "thermal-throttle",
+        .text = "Reduce the video bit rate (and, if the device keeps heating "
+                "up, cap the frame rate to 30 fps) when the device thermal "
+                "headroom runs low, before the device throttles itself.\n"
+                "The thermal state is displayed in the FPS counter panel "
+                "regardless of this option (if control is enabled).\n"
+                "This requires Android 10 (the thermal headroom requires "
+                "Android 11).",
+    },
+    {
+        .longopt_id = OPT_THROUGHPUT,
+        .longopt = "throughput",
+        .text = "Tune the pipeline for throughput rather than latency, for "
+                "headless sessions recording or forwarding the video to a "
+                "V4L2 device.\n"
+                "The video is decoded by several frames in parallel, every "
+                "frame is written to the V4L2 device (instead of only the "
+                "latest one), the video socket buffers and the recording "
+                "write buffer are enlarged (unless explicitly set), and the "
+                "SDL video subsystem is not initialized (so the clipboard is "
+                "not synchronized).\n"
+                "This requires --no-window, and --record or --v4l2-sink.",
+    },
+    {
+        .longopt_id = OPT_THUMBNAIL_INTERVAL,
+        .longopt = "thumbnail-interval",
+        .argdesc = "ms",
+        .text = "Set the interval between two frames (in milliseconds) with "
+                "--video-mode=thumbnail.\n"
+                "Default is 1000.",
+    },
     {
         .longopt_id = OPT_TIME_LIMIT,
         .longopt = "time-limit",
         .argdesc = "seconds",
         .text = "Set the maximum mirroring time, in seconds.",
     },
+    {
+        .longopt_id = OPT_TRACE_FILE,
+        .longopt = "trace-file",
+        .argdesc = "file.json",
+        .text = "Record the activity of the client threads (demuxer, decoder, "
+                "rendering, recorder, audio, controller, Figma Bridge), and "
+                "write it on exit as a Chrome trace-event JSON file (which "
+                "can be opened in Perfetto or chrome://tracing).",
+    },
     {
         .longopt_id = OPT_TUNNEL_HOST,
         .longopt = "tunnel-host",
@@ -940,6 +1465,21 @@ static const struct sc_option options[] = {
                 "Default is 0 (not forced): the local port used for "
                 "establishing the tunnel will be used.",
     },
+    {
+        .longopt_id = OPT_UNFOCUSED_DECODE,
+        .longopt = "unfocused-decode",
+        .argdesc = "value",
+        .text = "Reduce the video decoding cost while the window is not "
+                "focused (the focused window is always decoded at full "
+                "rate).\n"
+                "Possible values are \"full\" (decode all frames normally), "
+                "\"reduced\" (skip the deblocking filter, with a lower "
+                "image quality) and \"keyframes\" (decode only keyframes, "
+                "requested every second if control is enabled).\n"
+                "Default is \"full\" for a single device. When several "
+                "devices are mirrored (--serial=a,b,...), the default is "
+                "\"reduced\", or \"keyframes\" from 9 devices.",
+    },
     {
         .shortopt = 'v',
         .longopt = "version",
@@ -974,6 +1514,37 @@ static const struct sc_option options[] = {
                 "Default is 0 (no buffering).\n"
                 "This option is only available on Linux.",
     },
+    {
+        .longopt_id = OPT_V4L2_FORMAT,
+        .longopt = "v4l2-format",
+        .argdesc = "format",
+        .text = "Set the pixel format of the V4L2 sink.\n"
+                "Possible values are \"auto\", \"yuv420\", \"nv12\", "
+                "\"yuyv\" and \"rgb24\".\n"
+                "\"auto\" writes YUV420 (or NV12 frames from a hardware "
+                "decoder) without conversion.\n"
+                "Default is auto.\n"
+                "This option is only available on Linux.",
+    },
+    {
+        .longopt_id = OPT_V4L2_SIZE,
+        .longopt = "v4l2-size",
+        .argdesc = "<width>x<height>",
+        .text = "Scale the frames written to the V4L2 sink to the given "
+                "size.\n"
+                "By default, the size of the video is used.\n"
+                "This option is only available on Linux.",
+    },
+    {
+        .longopt_id = OPT_VIDEO_BIT_RATE_ADAPTIVE,
+        .longopt = "video-bit-rate-adaptive",
+        .text = "Periodically report the network conditions to the device, "
+                "so that it adapts the video bit rate (up to the value of "
+                "--video-bit-rate) to the available bandwidth. Under "
+                "sustained congestion at the minimal bit rate, the video size "
+                "is also reduced.\n"
+                "This option requires control.",
+    },
     {
         .longopt_id = OPT_VIDEO_BUFFER,
         .longopt = "video-buffer",
@@ -983,11 +1554,25 @@ static const struct sc_option options[] = {
                 "This increases latency to compensate for jitter.\n"
                 "Default is 0 (no buffering).",
     },
+    {
+        .longopt_id = OPT_VIDEO_BUFFER_PACKETS,
+        .longopt = "video-buffer-packets",
+        .text = "Apply the --video-buffer delay to the encoded packets, before "
+                "decoding, instead of the decoded frames.\n"
+                "This uses much less memory for large buffers (a few MB "
+                "instead of hundreds of MB for 1 second at 4K60). It is not "
+                "supported with a V4L2 sink.",
+    },
     {
         .longopt_id = OPT_VIDEO_CODEC,
         .longopt = "video-codec",
         .argdesc = "name",
-        .text = "Select a video codec (h264, h265 or av1).\n"
+        .text = "Select a video codec (h264, h265, av1 or auto).\n"
+                "'auto' selects the most efficient codec which the device can "
+                "encode in hardware and the computer can handle: with "
+                "--video-decoder=hw, the codecs supported by the hardware "
+                "decoder, or any codec if the video is not decoded (e.g. "
+                "recording only); h264 otherwise.\n"
                 "Default is h264.",
     },
     {
@@ -1002,6 +1587,16 @@ static const struct sc_option options[] = {
                 "Android documentation: "
                 "<https://d.android.com/reference/android/media/MediaFormat>",
     },
+    {
+        .longopt_id = OPT_VIDEO_DECODER,
+        .longopt = "video-decoder",
+        .argdesc = "value",
+        .text = "Select the video decoder (sw or hw).\n"
+                "'hw' uses the platform hardware decoder (VideoToolbox on "
+                "macOS, D3D11VA on Windows, VA-API on Linux), and falls back "
+                "to software decoding if it is not available.\n"
+                "Default is sw.",
+    },
     {
         .longopt_id = OPT_VIDEO_ENCODER,
         .longopt = "video-encoder",
@@ -1010,6 +1605,97 @@ static const struct sc_option options[] = {
                 "codec provided by --video-codec).\n"
                 "The available encoders can be listed by --list-encoders.",
     },
+    {
+        .longopt_id = OPT_VIDEO_ENCODER_PROFILE,
+        .longopt = "video-encoder-profile",
+        .argdesc = "profile",
+        .text = "Select the video encoder profile (default or low-latency).\n"
+                "'low-latency' requests the encoder to output each frame as "
+                "soon as possible (no B-frames, realtime priority, and known "
+                "vendor-specific low-latency keys), if supported. If the "
+                "encoder rejects this configuration, the default one is "
+                "used.\n"
+                "Options passed by --video-codec-options take precedence.\n"
+                "Default is default.",
+    },
+    {
+        .longopt_id = OPT_VIDEO_HDR,
+        .longopt = "video-hdr",
+        .text = "Encode the video in 10-bit (HEVC Main10 profile), to preserve "
+                "the HDR content rendered by the device.\n"
+                "HDR frames (PQ or HLG) are tone mapped on the GPU for "
+                "display (an OpenGL 2.0+ renderer is required).\n"
+                "Requires --video-codec=h265. If the encoder rejects the "
+                "Main10 profile, 8-bit is used.",
+    },
+    {
+        .longopt_id = OPT_VIDEO_IDLE_TIMEOUT,
+        .longopt = "video-idle-timeout",
+        .argdesc = "ms",
+        .text = "Suspend the video encoder on the device when its screen has "
+                "not changed for the given delay (in milliseconds), and "
+                "resume it on the next change. This saves encoder power and "
+                "bandwidth when the screen is static, at the cost of an "
+                "additional OpenGL copy of each frame on the device.\n"
+                "Default is 0 (disabled).",
+    },
+    {
+        .longopt_id = OPT_VIDEO_INTRA_REFRESH,
+        .longopt = "video-intra-refresh",
+        .argdesc = "frames",
+        .text = "Refresh the video progressively over the given number of "
+                "frames (intra refresh) instead of sending periodic "
+                "keyframes, to avoid the bit rate spikes of keyframes on "
+                "constrained links.\n"
+                "Keyframes are then only sent on demand (the recorder and the "
+                "decoder request one when they need it).\n"
+                "Requires Android 7+ and an encoder supporting intra "
+                "refresh.\n"
+                "Default is 0 (disabled).",
+    },
+    {
+        .longopt_id = OPT_VIDEO_MODE,
+        .longopt = "video-mode",
+        .argdesc = "mode",
+        .text = "Select the video mode (normal or thumbnail).\n"
+                "'thumbnail' streams a low resolution keyframe at a fixed "
+                "interval (see --thumbnail-interval), to overview many devices "
+                "at the cost of a few kbps each. Unless specified, the video "
+                "size is limited to 320 (--max-size) and the bit rate to "
+                "200K (--video-bit-rate).\n"
+                "Default is normal.",
+    },
+    {
+        .longopt_id = OPT_VIDEO_ROI,
+        .longopt = "video-roi",
+        .text = "Encode the region around the pointer with a better quality "
+                "(at the same bit rate).\n"
+                "This option requires control, and Android 14 or above (it "
+                "is ignored on older devices or if the encoder does not "
+                "support it).",
+    },
+    {
+        .longopt_id = OPT_VIDEO_SQUARE,
+        .longopt = "video-square",
+        .text = "Capture the display into a square video (large enough for "
+                "both orientations), so that a rotation only moves the content "
+                "within the video instead of restarting the encoder (which "
+                "freezes the video for a few hundred milliseconds).\n"
+                "Not supported with --crop, --capture-orientation or "
+                "--angle (the encoder is restarted on rotation).",
+    },
+    {
+        .longopt_id = OPT_VIDEO_SOCKET_BUFFER,
+        .longopt = "video-socket-buffer",
+        .argdesc = "size",
+        .text = "Set the size of the kernel buffers of the video socket, in "
+                "bytes (receive buffer on the computer, send buffer on the "
+                "device).\n"
+                "Supports 'K' and 'M' suffixes (e.g. 4M). A large buffer may "
+                "help to absorb the bursts of high bit rate streams.\n"
+                "Default is 0 (system default, automatically tuned on most "
+                "platforms).",
+    },
     {
         .longopt_id = OPT_VIDEO_SOURCE,
         .longopt = "video-source",
@@ -1018,6 +1704,18 @@ static const struct sc_option options[] = {
                 "Camera mirroring requires Android 12+.\n"
                 "Default is display.",
     },
+    {
+        .longopt_id = OPT_VIDEO_UDP_PORT,
+        .longopt = "video-udp-port",
+        .argdesc = "port",
+        .text = "Receive the video packets directly from the device over UDP "
+                "on the given device port, instead of over TCP through adb.\n"
+                "A lost packet does not delay the following ones: the frames "
+                "are dropped until the next keyframe (requested immediately "
+                "if control is enabled).\n"
+                "It only applies to a device connected over TCP/IP (see "
+                "--tcpip).",
+    },
     {
         .shortopt = 'w',
         .longopt = "stay-awake",
@@ -1187,6 +1885,14 @@ static const struct sc_shortcut shortcuts[] = {
         .shortcuts = { "MOD+i" },
         .text = "Enable/disable FPS counter (print frames/second in logs)",
     },
+    {
+        .shortcuts = { "MOD+Shift+s" },
+        .text = "Save the instant replay to a file (see --replay-buffer)",
+    },
+    {
+        .shortcuts = { "MOD+Shift+m" },
+        .text = "Add a marker to the recording index (see --record-index)",
+    },
     {
         .shortcuts = { "Ctrl+click-and-move" },
         .text = "Pinch-to-zoom and rotate from the center of the screen",
@@ -1605,169 +2311,539 @@ parse_bit_rate(const char *s, uint32_t *bit_rate) {
 }
 
 static bool
-parse_max_size(const char *s, uint16_t *max_size) {
-    long value;
-    bool ok = parse_integer_arg(s, &value, false, 0, 0xFFFF, "max size");
-    if (!ok) {
-        return false;
+parse_cpu_affinity(const char *s, uint64_t *cpus) {
+    // Comma-separated list of CPU indices or ranges, e.g. "0-3,6"
+    uint64_t mask = 0;
+    const char *p = s;
+    for (;;) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end != p && *end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+        }
+        if (end == p || first < 0 || last < first || last > 63) {
+            LOGE("Could not parse CPU affinity: %s (expected CPU indices or "
+                 "ranges between 0 and 63, e.g. 0-3,6)", s);
+            return false;
+        }
+
+        for (long i = first; i <= last; ++i) {
+            mask |= UINT64_C(1) << i;
+        }
+
+        if (*end == '\0') {
+            break;
+        }
+        if (*end != ',') {
+            LOGE("Could not parse CPU affinity: %s", s);
+            return false;
+        }
+        p = end + 1;
     }
 
-    *max_size = (uint16_t) value;
+    *cpus = mask;
     return true;
 }
 
 static bool
-parse_buffering_time(const char *s, sc_tick *tick) {
+parse_socket_buffer(const char *s, uint32_t *size) {
     long value;
-    // In practice, buffering time should not exceed a few seconds.
-    // Limit it to some arbitrary value (1 hour) to prevent 32-bit overflow
-    // when multiplied by the audio sample size and the number of samples per
-    // millisecond.
-    bool ok = parse_integer_arg(s, &value, false, 0, 60 * 60 * 1000,
-                                "buffering time");
+    // The size is passed to setsockopt() as an int
+    bool ok = parse_integer_arg(s, &value, true, 0, 0x7FFFFFFF,
+                                "socket buffer size");
     if (!ok) {
         return false;
     }
 
-    *tick = SC_TICK_FROM_MS(value);
+    *size = (uint32_t) value;
     return true;
 }
 
 static bool
-parse_audio_output_buffer(const char *s, sc_tick *tick) {
+parse_socket_busy_poll(const char *s, uint32_t *us) {
     long value;
-    bool ok = parse_integer_arg(s, &value, false, 0, 1000,
-                                "audio output buffer");
+    // More than 1 second of busy polling makes no sense
+    bool ok = parse_integer_arg(s, &value, false, 0, 1000000,
+                                "socket busy poll");
     if (!ok) {
         return false;
     }
 
-    *tick = SC_TICK_FROM_MS(value);
+    *us = (uint32_t) value;
     return true;
 }
 
 static bool
-parse_display_ime_policy(const char *s, enum sc_display_ime_policy *policy) {
-    if (!strcmp(s, "local")) {
-        *policy = SC_DISPLAY_IME_POLICY_LOCAL;
-        return true;
-    }
-    if (!strcmp(s, "fallback")) {
-        *policy = SC_DISPLAY_IME_POLICY_FALLBACK;
-        return true;
-    }
-    if (!strcmp(s, "hide")) {
-        *policy = SC_DISPLAY_IME_POLICY_HIDE;
-        return true;
-    }
-    LOGE("Unsupported display IME policy: %s (expected local, fallback or "
-         "hide)", s);
-    return false;
-}
-
-static bool
-parse_orientation(const char *s, enum sc_orientation *orientation) {
-    if (!strcmp(s, "0")) {
-        *orientation = SC_ORIENTATION_0;
-        return true;
-    }
-    if (!strcmp(s, "90")) {
-        *orientation = SC_ORIENTATION_90;
-        return true;
-    }
-    if (!strcmp(s, "180")) {
-        *orientation = SC_ORIENTATION_180;
-        return true;
-    }
-    if (!strcmp(s, "270")) {
-        *orientation = SC_ORIENTATION_270;
-        return true;
-    }
-    if (!strcmp(s, "flip0")) {
-        *orientation = SC_ORIENTATION_FLIP_0;
-        return true;
-    }
-    if (!strcmp(s, "flip90")) {
-        *orientation = SC_ORIENTATION_FLIP_90;
-        return true;
-    }
-    if (!strcmp(s, "flip180")) {
-        *orientation = SC_ORIENTATION_FLIP_180;
-        return true;
-    }
-    if (!strcmp(s, "flip270")) {
-        *orientation = SC_ORIENTATION_FLIP_270;
-        return true;
+parse_max_memory(const char *s, uint32_t *size) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, true, 0, 0x7FFFFFFF, "max memory");
+    if (!ok) {
+        return false;
     }
-    LOGE("Unsupported orientation: %s (expected 0, 90, 180, 270, flip0, "
-         "flip90, flip180 or flip270)", optarg);
-    return false;
-}
 
-static bool
-parse_capture_orientation(const char *s, enum sc_orientation *orientation,
-                          enum sc_orientation_lock *lock) {
-    if (*s == '\0') {
-        LOGE("Capture orientation may not be empty (expected 0, 90, 180, 270, "
-             "flip0, flip90, flip180 or flip270, possibly prefixed by '@')");
+    // Below a few MB, not even the decoded frames would fit
+    if (value && value < 0x1000000) {
+        LOGE("The memory budget must be at least 16M");
         return false;
     }
 
-    // Lock the orientation by a leading '@'
-    if (s[0] == '@') {
-        // Consume '@'
-        ++s;
-        if (*s == '\0') {
-            // Only '@': lock to the initial orientation (orientation is unused)
-            *lock = SC_ORIENTATION_LOCKED_INITIAL;
-            return true;
+    *size = (uint32_t) value;
+    return true;
+}
+
+// The decoder keeps several reference frames, and each frame sink may hold a
+// few more
+#define SC_MAX_MEMORY_DECODED_FRAMES 16
+
+static uint16_t
+compute_max_size_for_memory(uint32_t max_memory) {
+    // Half of the budget is reserved for the decoded frames
+    uint64_t frames_budget = max_memory / 2;
+
+    static const uint16_t max_sizes[] = {2560, 1920, 1600, 1280, 1024, 800};
+    for (unsigned i = 0; i < ARRAY_LEN(max_sizes); ++i) {
+        uint64_t size = max_sizes[i];
+        // YUV 4:2:0 frame, assuming the worst case (a square video)
+        uint64_t frame_bytes = size * size * 3 / 2;
+        if (frame_bytes * SC_MAX_MEMORY_DECODED_FRAMES <= frames_budget) {
+            return max_sizes[i];
         }
-        *lock = SC_ORIENTATION_LOCKED_VALUE;
-    } else {
-        *lock = SC_ORIENTATION_UNLOCKED;
     }
 
-    return parse_orientation(s, orientation);
+    return 640;
 }
 
 static bool
-parse_window_position(const char *s, int16_t *position) {
-    // special value for "auto"
-    static_assert(SC_WINDOW_POSITION_UNDEFINED == -0x8000, "unexpected value");
-
-    if (!strcmp(s, "auto")) {
-        *position = SC_WINDOW_POSITION_UNDEFINED;
-        return true;
-    }
-
+parse_max_size(const char *s, uint16_t *max_size) {
     long value;
-    bool ok = parse_integer_arg(s, &value, false, -0x7FFF, 0x7FFF,
-                                "window position");
+    bool ok = parse_integer_arg(s, &value, false, 0, 0xFFFF, "max size");
     if (!ok) {
         return false;
     }
 
-    *position = (int16_t) value;
+    *max_size = (uint16_t) value;
     return true;
 }
 
 static bool
-parse_window_dimension(const char *s, uint16_t *dimension) {
+parse_record_buffer(const char *s, size_t *size) {
     long value;
-    bool ok = parse_integer_arg(s, &value, false, 0, 0xFFFF,
-                                "window dimension");
+    bool ok = parse_integer_arg(s, &value, true, 0, 0x10000000,
+                                "record buffer");
     if (!ok) {
         return false;
     }
 
-    *dimension = (uint16_t) value;
+    if (value && value < 4096) {
+        LOGE("The record buffer must be at least 4096 bytes");
+        return false;
+    }
+
+    *size = (size_t) value;
     return true;
 }
 
 static bool
-parse_port_range(const char *s, struct sc_port_range *port_range) {
-    long values[2];
-    size_t count = parse_integers_arg(s, ':', 2, values, 0, 0xFFFF, "port");
+parse_record_segment(const char *s, sc_tick *tick) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 0x7FFFFFFF,
+                                "record segment");
+    if (!ok) {
+        return false;
+    }
+
+    *tick = SC_TICK_FROM_SEC(value);
+    return true;
+}
+
+static bool
+parse_replay_buffer(const char *s, sc_tick *tick) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 3600, "replay buffer");
+    if (!ok) {
+        return false;
+    }
+
+    *tick = SC_TICK_FROM_SEC(value);
+    return true;
+}
+
+static bool
+parse_record_transcode(const char *s, enum sc_codec *codec,
+                       uint32_t *bit_rate) {
+    const char *sep = strchr(s, ':');
+    size_t len = sep ? (size_t) (sep - s) : strlen(s);
+
+    if (len == 4 && !strncmp(s, "h264", len)) {
+        *codec = SC_CODEC_H264;
+    } else if ((len == 4 && !strncmp(s, "h265", len))
+            || (len == 4 && !strncmp(s, "hevc", len))) {
+        *codec = SC_CODEC_H265;
+    } else {
+        LOGE("Unsupported transcoding codec: %.*s (expected h264 or h265)",
+             (int) len, s);
+        return false;
+    }
+
+    if (!sep) {
+        *bit_rate = 0; // default
+        return true;
+    }
+
+    return parse_bit_rate(sep + 1, bit_rate);
+}
+
+static bool
+parse_record_keep(const char *s, unsigned *keep) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 0xFFFF, "record keep");
+    if (!ok) {
+        return false;
+    }
+
+    *keep = (unsigned) value;
+    return true;
+}
+
+static bool
+parse_decoder_threads(const char *s, uint16_t *threads) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 64, "decoder threads");
+    if (!ok) {
+        return false;
+    }
+
+    *threads = (uint16_t) value;
+    return true;
+}
+
+static bool
+parse_push_jobs(const char *s, uint8_t *jobs) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 8, "push jobs");
+    if (!ok) {
+        return false;
+    }
+
+    *jobs = (uint8_t) value;
+    return true;
+}
+
+static bool
+parse_gamepad_polling_rate(const char *s, uint16_t *rate) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 1000,
+                                "gamepad polling rate");
+    if (!ok) {
+        return false;
+    }
+
+    *rate = (uint16_t) value;
+    return true;
+}
+
+#ifdef HAVE_V4L2
+static bool
+parse_v4l2_size(const char *s, uint16_t *width, uint16_t *height) {
+    long values[2];
+    size_t count = parse_integers_arg(s, 'x', 2, values, 1, 0xFFFF,
+                                      "v4l2 size");
+    if (!count) {
+        return false;
+    }
+
+    if (count != 2) {
+        LOGE("Invalid v4l2 size: %s (expected <width>x<height>)", s);
+        return false;
+    }
+
+    *width = (uint16_t) values[0];
+    *height = (uint16_t) values[1];
+    return true;
+}
+
+static bool
+parse_v4l2_format(const char *s, enum sc_v4l2_format *format) {
+    if (!strcmp(s, "auto")) {
+        *format = SC_V4L2_FORMAT_AUTO;
+        return true;
+    }
+    if (!strcmp(s, "yuv420")) {
+        *format = SC_V4L2_FORMAT_YUV420;
+        return true;
+    }
+    if (!strcmp(s, "nv12")) {
+        *format = SC_V4L2_FORMAT_NV12;
+        return true;
+    }
+    if (!strcmp(s, "yuyv")) {
+        *format = SC_V4L2_FORMAT_YUYV;
+        return true;
+    }
+    if (!strcmp(s, "rgb24")) {
+        *format = SC_V4L2_FORMAT_RGB24;
+        return true;
+    }
+
+    LOGE("Unsupported v4l2 format: %s (expected auto, yuv420, nv12, yuyv or "
+         "rgb24)", s);
+    return false;
+}
+#endif
+
+static bool
+parse_buffering_time(const char *s, sc_tick *tick) {
+    long value;
+    // In practice, buffering time should not exceed a few seconds.
+    // Limit it to some arbitrary value (1 hour) to prevent 32-bit overflow
+    // when multiplied by the audio sample size and the number of samples per
+    // millisecond.
+    bool ok = parse_integer_arg(s, &value, false, 0, 60 * 60 * 1000,
+                                "buffering time");
+    if (!ok) {
+        return false;
+    }
+
+    *tick = SC_TICK_FROM_MS(value);
+    return true;
+}
+
+static bool
+parse_av_sync(const char *s, sc_tick *tick) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 10000,
+                                "A/V sync maximum delay");
+    if (!ok) {
+        return false;
+    }
+
+    *tick = SC_TICK_FROM_MS(value);
+    return true;
+}
+
+static bool
+parse_video_idle_timeout(const char *s, sc_tick *tick) {
+    long value;
+    // Must fit in 31 bits (as milliseconds) for the server
+    bool ok = parse_integer_arg(s, &value, false, 0, 0x7FFFFFFF,
+                                "video idle timeout");
+    if (!ok) {
+        return false;
+    }
+
+    *tick = SC_TICK_FROM_MS(value);
+    return true;
+}
+
+static bool
+parse_thumbnail_interval(const char *s, sc_tick *tick) {
+    long value;
+    // Below 100 ms, this is not a thumbnail anymore
+    bool ok = parse_integer_arg(s, &value, false, 100, 0x7FFFFFFF,
+                                "thumbnail interval");
+    if (!ok) {
+        return false;
+    }
+
+    *tick = SC_TICK_FROM_MS(value);
+    return true;
+}
+
+static bool
+parse_video_intra_refresh(const char *s, uint16_t *frames) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 0xFFFF,
+                                "video intra refresh period");
+    if (!ok) {
+        return false;
+    }
+
+    *frames = (uint16_t) value;
+    return true;
+}
+
+static bool
+parse_audio_output_buffer(const char *s, sc_tick *tick) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 1000,
+                                "audio output buffer");
+    if (!ok) {
+        return false;
+    }
+
+    *tick = SC_TICK_FROM_MS(value);
+    return true;
+}
+
+static bool
+parse_audio_output_backend(const char *s,
+                           enum sc_audio_output_backend *backend) {
+    if (!strcmp(s, "auto")) {
+        *backend = SC_AUDIO_OUTPUT_BACKEND_AUTO;
+        return true;
+    }
+    if (!strcmp(s, "sdl")) {
+        *backend = SC_AUDIO_OUTPUT_BACKEND_SDL;
+        return true;
+    }
+    if (!strcmp(s, "native")) {
+#ifdef SC_AUDIO_OUTPUT_NATIVE
+        *backend = SC_AUDIO_OUTPUT_BACKEND_NATIVE;
+        return true;
+#else
+        LOGE("Native audio output not supported on this platform (or scrcpy "
+             "built without ALSA)");
+        return false;
+#endif
+    }
+    LOGE("Unsupported audio output backend: %s (expected auto, sdl or "
+         "native)", s);
+    return false;
+}
+
+static bool
+parse_display_ime_policy(const char *s, enum sc_display_ime_policy *policy) {
+    if (!strcmp(s, "local")) {
+        *policy = SC_DISPLAY_IME_POLICY_LOCAL;
+        return true;
+    }
+    if (!strcmp(s, "fallback")) {
+        *policy = SC_DISPLAY_IME_POLICY_FALLBACK;
+        return true;
+    }
+    if (!strcmp(s, "hide")) {
+        *policy = SC_DISPLAY_IME_POLICY_HIDE;
+        return true;
+    }
+    LOGE("Unsupported display IME policy: %s (expected local, fallback or "
+         "hide)", s);
+    return false;
+}
+
+static bool
+parse_downscale_filter(const char *s, enum sc_downscale_filter *filter) {
+    if (!strcmp(s, "linear")) {
+        *filter = SC_DOWNSCALE_FILTER_LINEAR;
+        return true;
+    }
+    if (!strcmp(s, "trilinear")) {
+        *filter = SC_DOWNSCALE_FILTER_TRILINEAR;
+        return true;
+    }
+    if (!strcmp(s, "area")) {
+        *filter = SC_DOWNSCALE_FILTER_AREA;
+        return true;
+    }
+    LOGE("Unsupported downscale filter: %s (expected linear, trilinear or "
+         "area)", s);
+    return false;
+}
+
+static bool
+parse_orientation(const char *s, enum sc_orientation *orientation) {
+    if (!strcmp(s, "0")) {
+        *orientation = SC_ORIENTATION_0;
+        return true;
+    }
+    if (!strcmp(s, "90")) {
+        *orientation = SC_ORIENTATION_90;
+        return true;
+    }
+    if (!strcmp(s, "180")) {
+        *orientation = SC_ORIENTATION_180;
+        return true;
+    }
+    if (!strcmp(s, "270")) {
+        *orientation = SC_ORIENTATION_270;
+        return true;
+    }
+    if (!strcmp(s, "flip0")) {
+        *orientation = SC_ORIENTATION_FLIP_0;
+        return true;
+    }
+    if (!strcmp(s, "flip90")) {
+        *orientation = SC_ORIENTATION_FLIP_90;
+        return true;
+    }
+    if (!strcmp(s, "flip180")) {
+        *orientation = SC_ORIENTATION_FLIP_180;
+        return true;
+    }
+    if (!strcmp(s, "flip270")) {
+        *orientation = SC_ORIENTATION_FLIP_270;
+        return true;
+    }
+    LOGE("Unsupported orientation: %s (expected 0, 90, 180, 270, flip0, "
+         "flip90, flip180 or flip270)", optarg);
+    return false;
+}
+
+static bool
+parse_capture_orientation(const char *s, enum sc_orientation *orientation,
+                          enum sc_orientation_lock *lock) {
+    if (*s == '\0') {
+        LOGE("Capture orientation may not be empty (expected 0, 90, 180, 270, "
+             "flip0, flip90, flip180 or flip270, possibly prefixed by '@')");
+        return false;
+    }
+
+    // Lock the orientation by a leading '@'
+    if (s[0] == '@') {
+        // Consume '@'
+        ++s;
+        if (*s == '\0') {
+            // Only '@': lock to the initial orientation (orientation is unused)
+            *lock = SC_ORIENTATION_LOCKED_INITIAL;
+            return true;
+        }
+        *lock = SC_ORIENTATION_LOCKED_VALUE;
+    } else {
+        *lock = SC_ORIENTATION_UNLOCKED;
+    }
+
+    return parse_orientation(s, orientation);
+}
+
+static bool
+parse_window_position(const char *s, int16_t *position) {
+    // special value for "auto"
+    static_assert(SC_WINDOW_POSITION_UNDEFINED == -0x8000, "unexpected value");
+
+    if (!strcmp(s, "auto")) {
+        *position = SC_WINDOW_POSITION_UNDEFINED;
+        return true;
+    }
+
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, -0x7FFF, 0x7FFF,
+                                "window position");
+    if (!ok) {
+        return false;
+    }
+
+    *position = (int16_t) value;
+    return true;
+}
+
+static bool
+parse_window_dimension(const char *s, uint16_t *dimension) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 0xFFFF,
+                                "window dimension");
+    if (!ok) {
+        return false;
+    }
+
+    *dimension = (uint16_t) value;
+    return true;
+}
+
+static bool
+parse_port_range(const char *s, struct sc_port_range *port_range) {
+    long values[2];
+    size_t count = parse_integers_arg(s, ':', 2, values, 0, 0xFFFF, "port");
     if (!count) {
         return false;
     }
@@ -1938,6 +3014,9 @@ get_record_format(const char *name) {
     if (!strcmp(name, "wav")) {
         return SC_RECORD_FORMAT_WAV;
     }
+    if (!strcmp(name, "fmp4")) {
+        return SC_RECORD_FORMAT_FMP4;
+    }
     return 0;
 }
 
@@ -1945,8 +3024,8 @@ static bool
 parse_record_format(const char *optarg, enum sc_record_format *format) {
     enum sc_record_format fmt = get_record_format(optarg);
     if (!fmt) {
-        LOGE("Unsupported record format: %s (expected mp4, mkv, m4a, mka, "
-             "opus, aac, flac or wav)", optarg);
+        LOGE("Unsupported record format: %s (expected mp4, fmp4, mkv, m4a, "
+             "mka, opus, aac, flac or wav)", optarg);
         return false;
     }
 
@@ -1981,7 +3060,14 @@ guess_record_format(const char *filename) {
 }
 
 static bool
-parse_video_codec(const char *optarg, enum sc_codec *codec) {
+parse_video_codec(const char *optarg, enum sc_codec *codec, bool *negotiate) {
+    if (!strcmp(optarg, "auto")) {
+        // The actual codec is selected by the server
+        *codec = SC_CODEC_H264;
+        *negotiate = true;
+        return true;
+    }
+    *negotiate = false;
     if (!strcmp(optarg, "h264")) {
         *codec = SC_CODEC_H264;
         return true;
@@ -1994,7 +3080,8 @@ parse_video_codec(const char *optarg, enum sc_codec *codec) {
         *codec = SC_CODEC_AV1;
         return true;
     }
-    LOGE("Unsupported video codec: %s (expected h264, h265 or av1)", optarg);
+    LOGE("Unsupported video codec: %s (expected h264, h265, av1 or auto)",
+         optarg);
     return false;
 }
 
@@ -2021,6 +3108,44 @@ parse_audio_codec(const char *optarg, enum sc_codec *codec) {
     return false;
 }
 
+static bool
+parse_video_decoder(const char *optarg, enum sc_video_decoder *decoder) {
+    if (!strcmp(optarg, "sw")) {
+        *decoder = SC_VIDEO_DECODER_SW;
+        return true;
+    }
+
+    if (!strcmp(optarg, "hw")) {
+        *decoder = SC_VIDEO_DECODER_HW;
+        return true;
+    }
+
+    LOGE("Unsupported video decoder: %s (expected sw or hw)", optarg);
+    return false;
+}
+
+static bool
+parse_unfocused_decode(const char *optarg, enum sc_decode_budget *budget) {
+    if (!strcmp(optarg, "full")) {
+        *budget = SC_DECODE_BUDGET_FULL;
+        return true;
+    }
+
+    if (!strcmp(optarg, "reduced")) {
+        *budget = SC_DECODE_BUDGET_REDUCED;
+        return true;
+    }
+
+    if (!strcmp(optarg, "keyframes")) {
+        *budget = SC_DECODE_BUDGET_KEYFRAMES;
+        return true;
+    }
+
+    LOGE("Unsupported unfocused decode value: %s (expected full, reduced or "
+         "keyframes)", optarg);
+    return false;
+}
+
 static bool
 parse_video_source(const char *optarg, enum sc_video_source *source) {
     if (!strcmp(optarg, "display")) {
@@ -2037,6 +3162,48 @@ parse_video_source(const char *optarg, enum sc_video_source *source) {
     return false;
 }
 
+static bool
+parse_video_encoder_profile(const char *optarg,
+                            enum sc_video_encoder_profile *profile) {
+    if (!strcmp(optarg, "default")) {
+        *profile = SC_VIDEO_ENCODER_PROFILE_DEFAULT;
+        return true;
+    }
+
+    if (!strcmp(optarg, "low-latency")) {
+        *profile = SC_VIDEO_ENCODER_PROFILE_LOW_LATENCY;
+        return true;
+    }
+
+    LOGE("Unsupported video encoder profile: %s (expected default or "
+         "low-latency)", optarg);
+    return false;
+}
+
+// Defaults for --video-mode=thumbnail, unless explicitly specified
+#define SC_THUMBNAIL_DEFAULT_MAX_SIZE 320
+#define SC_THUMBNAIL_DEFAULT_BIT_RATE 200000
+
+// Defaults for --throughput, unless explicitly specified
+#define SC_THROUGHPUT_SOCKET_BUFFER (4 * 1024 * 1024)
+#define SC_THROUGHPUT_RECORD_BUFFER (1024 * 1024)
+
+static bool
+parse_video_mode(const char *optarg, enum sc_video_mode *mode) {
+    if (!strcmp(optarg, "normal")) {
+        *mode = SC_VIDEO_MODE_NORMAL;
+        return true;
+    }
+
+    if (!strcmp(optarg, "thumbnail")) {
+        *mode = SC_VIDEO_MODE_THUMBNAIL;
+        return true;
+    }
+
+    LOGE("Unsupported video mode: %s (expected normal or thumbnail)", optarg);
+    return false;
+}
+
 static bool
 parse_audio_source(const char *optarg, enum sc_audio_source *source) {
     if (!strcmp(optarg, "mic")) {
@@ -2256,6 +3423,56 @@ parse_screen_off_timeout(const char *s, sc_tick *tick) {
     return true;
 }
 
+static bool
+parse_screenshot_format(const char *s, enum sc_image_format *format) {
+    if (!strcmp(s, "png")) {
+        *format = SC_IMAGE_FORMAT_PNG;
+        return true;
+    }
+    if (!strcmp(s, "jpeg") || !strcmp(s, "jpg")) {
+        *format = SC_IMAGE_FORMAT_JPEG;
+        return true;
+    }
+    if (!strcmp(s, "webp")) {
+        *format = SC_IMAGE_FORMAT_WEBP;
+        return true;
+    }
+    LOGE("Unsupported screenshot format: %s (expected png, jpeg or webp)", s);
+    return false;
+}
+
+static bool
+parse_screenshot_png_level(const char *s, int8_t *level) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 9,
+                                "screenshot PNG level");
+    if (!ok) {
+        return false;
+    }
+
+    *level = (int8_t) value;
+    return true;
+}
+
+static bool
+parse_render_scale(const char *s, float *scale) {
+    char *endptr;
+    errno = 0;
+    float value = strtof(s, &endptr);
+    if (errno || endptr == s || *endptr != '\0') {
+        LOGE("Could not parse render scale: %s", s);
+        return false;
+    }
+
+    if (!(value >= .1f && value <= 1.f)) {
+        LOGE("Invalid render scale: %s (expected a value in [0.1; 1])", s);
+        return false;
+    }
+
+    *scale = value;
+    return true;
+}
+
 static bool
 parse_pause_on_exit(const char *s, enum sc_pause_on_exit *pause_on_exit) {
     if (!s || !strcmp(s, "true")) {
@@ -2368,9 +3585,15 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                      "use --video-bit-rate or --audio-bit-rate.");
                 return false;
             case 'b':
+                if (!strcmp(optarg, "auto")) {
+                    opts->video_bit_rate = 0;
+                    opts->video_bit_rate_auto = true;
+                    break;
+                }
                 if (!parse_bit_rate(optarg, &opts->video_bit_rate)) {
                     return false;
                 }
+                opts->video_bit_rate_auto = false;
                 break;
             case OPT_AUDIO_BIT_RATE:
                 if (!parse_bit_rate(optarg, &opts->audio_bit_rate)) {
@@ -2380,6 +3603,16 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             case OPT_CROP:
                 opts->crop = optarg;
                 break;
+            case OPT_CPU_AFFINITY:
+#ifdef SC_THREAD_HAS_CPU_AFFINITY
+                if (!parse_cpu_affinity(optarg, &opts->cpu_affinity)) {
+                    return false;
+                }
+                break;
+#else
+                LOGE("CPU affinity is not supported on this platform");
+                return false;
+#endif
             case OPT_DISPLAY:
                 LOGE("--display has been removed, use --display-id instead.");
                 return false;
@@ -2420,6 +3653,11 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             case OPT_MAX_FPS:
                 opts->max_fps = optarg;
                 break;
+            case OPT_MAX_MEMORY:
+                if (!parse_max_memory(optarg, &opts->max_memory)) {
+                    return false;
+                }
+                break;
             case 'm':
                 if (!parse_max_size(optarg, &opts->max_size)) {
                     return false;
@@ -2543,6 +3781,11 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             case OPT_PUSH_TARGET:
                 opts->push_target = optarg;
                 break;
+            case OPT_PUSH_JOBS:
+                if (!parse_push_jobs(optarg, &opts->push_jobs)) {
+                    return false;
+                }
+                break;
             case OPT_PREFER_TEXT:
                 if (opts->key_inject_mode != SC_KEY_INJECT_MODE_MIXED) {
                     LOGE("--prefer-text is incompatible with --raw-key-events");
@@ -2584,7 +3827,13 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                 opts->render_driver = optarg;
                 break;
             case OPT_NO_MIPMAPS:
-                opts->mipmaps = false;
+                opts->downscale_filter = SC_DOWNSCALE_FILTER_LINEAR;
+                break;
+            case OPT_DOWNSCALE_FILTER:
+                if (!parse_downscale_filter(optarg,
+                                            &opts->downscale_filter)) {
+                    return false;
+                }
                 break;
             case OPT_NO_KEY_REPEAT:
                 opts->forward_key_repeat = false;
@@ -2606,6 +3855,12 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             case OPT_VIDEO_ENCODER:
                 opts->video_encoder = optarg;
                 break;
+            case OPT_VIDEO_ENCODER_PROFILE:
+                if (!parse_video_encoder_profile(optarg,
+                                            &opts->video_encoder_profile)) {
+                    return false;
+                }
+                break;
             case OPT_AUDIO_ENCODER:
                 opts->audio_encoder = optarg;
                 break;
@@ -2639,6 +3894,23 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                     return false;
                 }
                 break;
+            case OPT_VIDEO_BUFFER_PACKETS:
+                opts->video_buffer_packets = true;
+                break;
+            case OPT_DUMP_STREAM:
+                opts->dump_stream = optarg;
+                break;
+            case OPT_REPLAY:
+                opts->replay = optarg;
+                break;
+            case OPT_REPLAY_BUFFER:
+                if (!parse_replay_buffer(optarg, &opts->replay_buffer)) {
+                    return false;
+                }
+                break;
+            case OPT_REPLAY_UNTHROTTLED:
+                opts->replay_unthrottled = true;
+                break;
             case OPT_NO_CLIPBOARD_AUTOSYNC:
                 opts->clipboard_autosync = false;
                 break;
@@ -2649,27 +3921,130 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             case OPT_NO_DOWNSIZE_ON_ERROR:
                 opts->downsize_on_error = false;
                 break;
-            case OPT_NO_VIDEO:
-                opts->video = false;
+            case OPT_NO_VIDEO:
+                opts->video = false;
+                break;
+            case OPT_NO_AUDIO:
+                opts->audio = false;
+                break;
+            case OPT_NO_CLEANUP:
+                opts->cleanup = false;
+                break;
+            case OPT_NO_POWER_ON:
+                opts->power_on = false;
+                break;
+            case OPT_NO_SESSION_CACHE:
+                opts->session_cache = false;
+                break;
+            case OPT_PRINT_FPS:
+                opts->start_fps_counter = true;
+                break;
+            case OPT_PRINT_LATENCY:
+                opts->print_latency = true;
+                break;
+            case OPT_VIDEO_BIT_RATE_ADAPTIVE:
+                opts->video_bit_rate_adaptive = true;
+                break;
+            case OPT_VIDEO_ROI:
+                opts->video_roi = true;
+                break;
+            case OPT_VIDEO_SQUARE:
+                opts->video_square = true;
+                break;
+            case OPT_TEXTURE_DAMAGE:
+                opts->texture_damage = true;
+                break;
+            case OPT_THERMAL_THROTTLE:
+                opts->thermal_throttle = true;
+                break;
+            case OPT_MULTIPLEX:
+                opts->multiplex = true;
+                break;
+            case OPT_THROUGHPUT:
+                opts->throughput = true;
+                break;
+            case OPT_VIDEO_SOCKET_BUFFER:
+                if (!parse_socket_buffer(optarg, &opts->video_socket_buffer)) {
+                    return false;
+                }
+                break;
+            case OPT_SOCKET_BUSY_POLL:
+                if (!parse_socket_busy_poll(optarg, &opts->socket_busy_poll)) {
+                    return false;
+                }
+                break;
+            case OPT_VIDEO_IDLE_TIMEOUT:
+                if (!parse_video_idle_timeout(optarg,
+                                              &opts->video_idle_timeout)) {
+                    return false;
+                }
+                break;
+            case OPT_VIDEO_INTRA_REFRESH:
+                if (!parse_video_intra_refresh(optarg,
+                                               &opts->video_intra_refresh)) {
+                    return false;
+                }
+                break;
+            case OPT_VIDEO_HDR:
+                opts->video_hdr = true;
+                break;
+            case OPT_TRACE_FILE:
+                opts->trace_file = optarg;
+                break;
+            case OPT_RECORD_BUFFER:
+                if (!parse_record_buffer(optarg, &opts->record_buffer)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_SEGMENT:
+                if (!parse_record_segment(optarg, &opts->record_segment)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_TRANSCODE:
+                if (!parse_record_transcode(optarg,
+                                            &opts->record_transcode_codec,
+                                            &opts->record_transcode_bit_rate)) {
+                    return false;
+                }
+                opts->record_transcode = true;
+                break;
+            case OPT_RECORD_INDEX:
+                opts->record_index = true;
+                break;
+            case OPT_RECORD_KEEP:
+                if (!parse_record_keep(optarg, &opts->record_keep)) {
+                    return false;
+                }
                 break;
-            case OPT_NO_AUDIO:
-                opts->audio = false;
+            case OPT_UNFOCUSED_DECODE:
+                if (!parse_unfocused_decode(optarg, &opts->unfocused_decode)) {
+                    return false;
+                }
                 break;
-            case OPT_NO_CLEANUP:
-                opts->cleanup = false;
+            case OPT_VIDEO_MODE:
+                if (!parse_video_mode(optarg, &opts->video_mode)) {
+                    return false;
+                }
                 break;
-            case OPT_NO_POWER_ON:
-                opts->power_on = false;
+            case OPT_THUMBNAIL_INTERVAL:
+                if (!parse_thumbnail_interval(optarg,
+                                              &opts->thumbnail_interval)) {
+                    return false;
+                }
                 break;
-            case OPT_PRINT_FPS:
-                opts->start_fps_counter = true;
+            case OPT_DECODER_THREADS:
+                if (!parse_decoder_threads(optarg, &opts->decoder_threads)) {
+                    return false;
+                }
                 break;
             case OPT_CODEC:
                 LOGE("--codec has been removed, "
                      "use --video-codec or --audio-codec.");
                 return false;
             case OPT_VIDEO_CODEC:
-                if (!parse_video_codec(optarg, &opts->video_codec)) {
+                if (!parse_video_codec(optarg, &opts->video_codec,
+                                       &opts->video_codec_auto)) {
                     return false;
                 }
                 break;
@@ -2685,6 +4060,24 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
 #else
                 LOGE("OTG mode (--otg) is disabled.");
                 return false;
+#endif
+            case OPT_IOSURFACE_SINK:
+#ifdef __APPLE__
+                opts->iosurface_sink = true;
+                break;
+#else
+                LOGE("IOSurface sink (--iosurface-sink) is only available on "
+                     "macOS.");
+                return false;
+#endif
+            case OPT_SHM_SINK:
+#ifdef HAVE_SHM_SINK
+                opts->shm_sink = optarg;
+                break;
+#else
+                LOGE("Shared memory sink (--shm-sink) is not supported on "
+                     "this platform.");
+                return false;
 #endif
             case OPT_V4L2_SINK:
 #ifdef HAVE_V4L2
@@ -2705,6 +4098,29 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                 LOGE("V4L2 (--v4l2-buffer) is disabled (or unsupported on this "
                      "platform).");
                 return false;
+#endif
+            case OPT_V4L2_SIZE:
+#ifdef HAVE_V4L2
+                if (!parse_v4l2_size(optarg, &opts->v4l2_width,
+                                     &opts->v4l2_height)) {
+                    return false;
+                }
+                break;
+#else
+                LOGE("V4L2 (--v4l2-size) is disabled (or unsupported on this "
+                     "platform).");
+                return false;
+#endif
+            case OPT_V4L2_FORMAT:
+#ifdef HAVE_V4L2
+                if (!parse_v4l2_format(optarg, &opts->v4l2_format)) {
+                    return false;
+                }
+                break;
+#else
+                LOGE("V4L2 (--v4l2-format) is disabled (or unsupported on this "
+                     "platform).");
+                return false;
 #endif
             case OPT_LIST_ENCODERS:
                 opts->list |= SC_OPTION_LIST_ENCODERS;
@@ -2721,6 +4137,15 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             case OPT_LIST_APPS:
                 opts->list |= SC_OPTION_LIST_APPS;
                 break;
+            case OPT_BENCHMARK_ENCODERS:
+                opts->list |= SC_OPTION_BENCHMARK_ENCODERS;
+                break;
+            case OPT_LATENCY_PROBE:
+                opts->latency_probe = true;
+                break;
+            case OPT_NO_AUDIO_CONCEALMENT:
+                opts->audio_concealment = false;
+                break;
             case OPT_REQUIRE_AUDIO:
                 opts->require_audio = true;
                 break;
@@ -2729,6 +4154,17 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                     return false;
                 }
                 break;
+            case OPT_AUDIO_BUFFER_MAX:
+                if (!parse_buffering_time(optarg, &opts->audio_buffer_max)) {
+                    return false;
+                }
+                break;
+            case OPT_AUDIO_OUTPUT_BACKEND:
+                if (!parse_audio_output_backend(optarg,
+                                                &opts->audio_output_backend)) {
+                    return false;
+                }
+                break;
             case OPT_AUDIO_OUTPUT_BUFFER:
                 if (!parse_audio_output_buffer(optarg,
                                                &opts->audio_output_buffer)) {
@@ -2740,6 +4176,16 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                     return false;
                 }
                 break;
+            case OPT_DIRECT_PORT:
+                if (!parse_port(optarg, &opts->direct_port)) {
+                    return false;
+                }
+                break;
+            case OPT_VIDEO_UDP_PORT:
+                if (!parse_port(optarg, &opts->video_udp_port)) {
+                    return false;
+                }
+                break;
             case OPT_AUDIO_SOURCE:
                 if (!parse_audio_source(optarg, &opts->audio_source)) {
                     return false;
@@ -2748,6 +4194,18 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             case OPT_KILL_ADB_ON_CLOSE:
                 opts->kill_adb_on_close = true;
                 break;
+            case OPT_KEEP_SERVER:
+                opts->keep_server = true;
+                break;
+            case OPT_ADB_BATCH:
+                opts->adb_batch = true;
+                break;
+            case OPT_ADB_NATIVE:
+                opts->adb_native = true;
+                break;
+            case OPT_MEASURE_INPUT_LATENCY:
+                opts->measure_input_latency = true;
+                break;
             case OPT_TIME_LIMIT:
                 if (!parse_time_limit(optarg, &opts->time_limit)) {
                     return false;
@@ -2794,9 +4252,30 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                     return false;
                 }
                 break;
+            case OPT_GAMEPAD_POLLING_RATE:
+                if (!parse_gamepad_polling_rate(optarg,
+                                                &opts->gamepad_polling_rate)) {
+                    return false;
+                }
+                break;
             case OPT_NEW_DISPLAY:
                 opts->new_display = optarg ? optarg : "";
                 break;
+            case OPT_AV_SYNC:
+                if (!optarg) {
+                    opts->av_sync = SC_TICK_FROM_MS(200);
+                } else if (!parse_av_sync(optarg, &opts->av_sync)) {
+                    return false;
+                }
+                break;
+            case OPT_AUTO_SIZE:
+                opts->auto_size = true;
+                break;
+            case OPT_RENDER_SCALE:
+                if (!parse_render_scale(optarg, &opts->render_scale)) {
+                    return false;
+                }
+                break;
             case OPT_START_APP:
                 opts->start_app = optarg;
                 break;
@@ -2806,6 +4285,32 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                     return false;
                 }
                 break;
+            case OPT_SCREENSHOT_GPU_READBACK:
+                opts->screenshot_gpu_readback = true;
+                break;
+            case OPT_SCREENSHOT_FROM_DEVICE:
+                opts->screenshot_from_device = true;
+                break;
+            case OPT_SCREENSHOT_FORMAT:
+                if (!parse_screenshot_format(optarg,
+                                             &opts->screenshot_format)) {
+                    return false;
+                }
+                break;
+            case OPT_SCREENSHOT_PNG_LEVEL:
+                if (!parse_screenshot_png_level(optarg,
+                                                &opts->screenshot_png_level)) {
+                    return false;
+                }
+                break;
+            case OPT_FRAME_PACING:
+                opts->frame_pacing = true;
+                break;
+            case OPT_VIDEO_DECODER:
+                if (!parse_video_decoder(optarg, &opts->video_decoder)) {
+                    return false;
+                }
+                break;
             case OPT_ANGLE:
                 opts->angle = optarg;
                 break;
@@ -2858,6 +4363,56 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
     v4l2 = !!opts->v4l2_device;
 #endif
 
+    if (opts->replay) {
+        if (otg) {
+            LOGE("--replay is incompatible with --otg");
+            return false;
+        }
+
+        if (v4l2) {
+            LOGE("--replay does not support a V4L2 sink");
+            return false;
+        }
+
+        if (opts->shm_sink) {
+            LOGE("--replay does not support a shared memory sink");
+            return false;
+        }
+
+        if (opts->dump_stream) {
+            LOGE("--replay is incompatible with --dump-stream");
+            return false;
+        }
+
+        if (!opts->video) {
+            LOGE("--replay requires video (the stream contains only video)");
+            return false;
+        }
+
+        // The replayed stream contains only the video, and there is no device
+        // to control
+        opts->audio = false;
+        opts->control = false;
+    } else if (opts->replay_unthrottled) {
+        LOGE("--replay-unthrottled requires --replay");
+        return false;
+    }
+
+    if (opts->serial && strchr(opts->serial, ',')) {
+        // Several devices, each one is mirrored by its own client
+        if (otg || opts->replay) {
+            LOGE("Several serials may not be passed with --otg or --replay");
+            return false;
+        }
+
+        if (opts->record_filename || v4l2 || opts->shm_sink
+                || opts->dump_stream || opts->trace_file) {
+            LOGE("--record, --v4l2-sink, --shm-sink, --dump-stream and "
+                 "--trace-file may not be shared by several devices");
+            return false;
+        }
+    }
+
     if (!opts->window) {
         // Without window, there cannot be any video playback
         opts->video_playback = false;
@@ -2876,8 +4431,9 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
     }
 
     if (opts->video && !opts->video_playback && !opts->record_filename
-            && !v4l2) {
-        LOGI("No video playback, no recording, no V4L2 sink: video disabled");
+            && !v4l2 && !opts->shm_sink) {
+        LOGI("No video playback, no recording, no V4L2 sink, no shared memory "
+             "sink: video disabled");
         opts->video = false;
     }
 
@@ -2886,6 +4442,11 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         opts->audio = false;
     }
 
+    if (opts->dump_stream && !opts->video) {
+        LOGE("--dump-stream requires video");
+        return false;
+    }
+
     if (!opts->video && !opts->audio && !opts->control && !otg) {
         LOGE("No video, no audio, no control, no OTG: nothing to do");
         return false;
@@ -2909,6 +4470,39 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         }
     }
 
+    if (opts->audio_buffer_max
+            && opts->audio_buffer_max < opts->audio_buffer) {
+        LOGE("--audio-buffer-max must not be lower than --audio-buffer");
+        return false;
+    }
+
+    if (opts->video_buffer_packets) {
+        if (!opts->video_buffer) {
+            LOGE("--video-buffer-packets requires --video-buffer");
+            return false;
+        }
+
+        if (v4l2) {
+            // The packets are delayed before the decoder, so the delay would
+            // also apply to the V4L2 sink
+            LOGE("--video-buffer-packets is not supported with a V4L2 sink");
+            return false;
+        }
+    }
+
+    if (opts->av_sync) {
+        if (!opts->video_playback || !opts->audio_playback) {
+            LOGE("--av-sync requires video and audio playback");
+            return false;
+        }
+
+        if (opts->video_buffer) {
+            // The video delay is driven by the audio clock
+            LOGE("--av-sync is incompatible with --video-buffer");
+            return false;
+        }
+    }
+
 #ifdef HAVE_V4L2
     if (v4l2) {
         if (!opts->video) {
@@ -2926,6 +4520,12 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         LOGE("V4L2 buffer value without V4L2 sink");
         return false;
     }
+
+    if ((opts->v4l2_width || opts->v4l2_format != SC_V4L2_FORMAT_AUTO)
+            && !opts->v4l2_device) {
+        LOGE("V4L2 size or format without V4L2 sink");
+        return false;
+    }
 #endif
 
     if (opts->control) {
@@ -3005,6 +4605,9 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             LOGE("--new-display is incompatible with --no-video");
             return false;
         }
+    } else if (opts->render_scale != 1.f) {
+        LOGE("--render-scale requires --new-display");
+        return false;
     }
 
     if (otg) {
@@ -3065,6 +4668,52 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         return false;
     }
 
+    if (opts->adb_batch && opts->cleanup) {
+        LOGW("--adb-batch has no effect without --no-cleanup");
+    }
+
+    if (opts->keep_server && !opts->force_adb_forward) {
+        // The server must listen, so that it may accept successive clients
+        LOGI("--keep-server is set, "
+             "--force-adb-forward automatically enabled.");
+        opts->force_adb_forward = true;
+    }
+
+    if (opts->video_udp_port) {
+        if (!opts->video) {
+            LOGE("--video-udp-port requires video");
+            return false;
+        }
+
+        if (opts->keep_server) {
+            LOGE("--video-udp-port is incompatible with --keep-server");
+            return false;
+        }
+
+        if (opts->dump_stream) {
+            LOGE("--video-udp-port is incompatible with --dump-stream");
+            return false;
+        }
+
+        if (opts->multiplex) {
+            LOGE("--video-udp-port is incompatible with --multiplex");
+            return false;
+        }
+    }
+
+    if (opts->direct_port) {
+        if (opts->keep_server) {
+            LOGE("--direct-port is incompatible with --keep-server");
+            return false;
+        }
+
+        if (opts->tunnel_host || opts->tunnel_port) {
+            LOGE("--direct-port is incompatible with --tunnel-host and "
+                 "--tunnel-port");
+            return false;
+        }
+    }
+
     if ((opts->tunnel_host || opts->tunnel_port) && !opts->force_adb_forward) {
         LOGI("Tunnel host/port is set, "
              "--force-adb-forward automatically enabled.");
@@ -3163,6 +4812,65 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         return false;
     }
 
+    if (opts->record_buffer && !opts->record_filename) {
+        LOGE("Record buffer specified without recording");
+        return false;
+    }
+
+    if (opts->throughput) {
+        if (opts->window) {
+            LOGE("--throughput requires --no-window");
+            return false;
+        }
+
+        if (!opts->record_filename && !v4l2) {
+            LOGE("--throughput requires --record or --v4l2-sink");
+            return false;
+        }
+
+        if (!opts->video_socket_buffer) {
+            opts->video_socket_buffer = SC_THROUGHPUT_SOCKET_BUFFER;
+        }
+
+        if (opts->record_filename && !opts->record_buffer) {
+            opts->record_buffer = SC_THROUGHPUT_RECORD_BUFFER;
+        }
+
+        if (opts->clipboard_autosync) {
+            // The clipboard requires the SDL video subsystem
+            LOGD("--throughput: clipboard autosync disabled");
+            opts->clipboard_autosync = false;
+        }
+    }
+
+    if (opts->record_segment && !opts->record_filename) {
+        LOGE("Record segment specified without recording");
+        return false;
+    }
+
+    if (opts->record_index && !opts->record_filename) {
+        LOGE("Record index specified without recording");
+        return false;
+    }
+
+    if (opts->record_keep && !opts->record_segment) {
+        LOGE("--record-keep requires --record-segment");
+        return false;
+    }
+
+    if (opts->replay_buffer) {
+        if (opts->replay) {
+            LOGE("--replay-buffer is incompatible with --replay");
+            return false;
+        }
+
+        if (!opts->window) {
+            LOGE("--replay-buffer requires a window (the replay is saved with "
+                 "MOD+Shift+s)");
+            return false;
+        }
+    }
+
     if (opts->record_filename) {
         if (!opts->video && !opts->audio) {
             LOGE("Video and audio disabled, nothing to record");
@@ -3222,6 +4930,7 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         }
 
         if ((opts->record_format == SC_RECORD_FORMAT_MP4 ||
+             opts->record_format == SC_RECORD_FORMAT_FMP4 ||
              opts->record_format == SC_RECORD_FORMAT_M4A)
                 && opts->audio_codec == SC_CODEC_RAW) {
             LOGE("Recording to MP4 container does not support RAW audio");
@@ -3229,6 +4938,18 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         }
     }
 
+    if (opts->record_transcode) {
+        if (!opts->record_filename) {
+            LOGE("--record-transcode requires --record");
+            return false;
+        }
+
+        if (!opts->video) {
+            LOGE("--record-transcode requires video");
+            return false;
+        }
+    }
+
     if (opts->audio_codec == SC_CODEC_FLAC && opts->audio_bit_rate) {
         LOGW("--audio-bit-rate is ignored for FLAC audio codec");
     }
@@ -3266,6 +4987,95 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             LOGE("Cannot start an Android app if control is disabled");
             return false;
         }
+        if (opts->video_bit_rate_adaptive) {
+            LOGE("Cannot adapt the video bit rate if control is disabled");
+            return false;
+        }
+        if (opts->video_roi) {
+            LOGE("Cannot encode the region around the pointer if control is "
+                 "disabled");
+            return false;
+        }
+        if (opts->auto_size) {
+            LOGE("Cannot adapt the video size if control is disabled");
+            return false;
+        }
+        if (opts->screenshot_from_device) {
+            LOGE("Cannot capture screenshots on the device if control is "
+                 "disabled");
+            return false;
+        }
+    }
+
+    if (opts->screenshot_from_device
+            && opts->video_source != SC_VIDEO_SOURCE_DISPLAY) {
+        LOGE("--screenshot-from-device is only available with "
+             "--video-source=display");
+        return false;
+    }
+
+    if (opts->video_square && (opts->video_source != SC_VIDEO_SOURCE_DISPLAY
+                               || opts->new_display)) {
+        LOGE("--video-square is only available with --video-source=display, "
+             "without --new-display");
+        return false;
+    }
+
+    if (opts->thermal_throttle && !opts->video) {
+        LOGE("--thermal-throttle requires video to be enabled");
+        return false;
+    }
+
+    if (opts->auto_size && !opts->video_playback) {
+        LOGW("--auto-size has no effect without video playback");
+        opts->auto_size = false;
+    }
+
+    if (opts->video_bit_rate_adaptive && !opts->video) {
+        LOGW("--video-bit-rate-adaptive has no effect without video");
+        opts->video_bit_rate_adaptive = false;
+    }
+
+    if (opts->video_bit_rate_auto) {
+        if (!opts->video) {
+            LOGW("--video-bit-rate=auto has no effect without video");
+            opts->video_bit_rate_auto = false;
+        } else if (opts->keep_server) {
+            // The probe is part of the connection protocol, a kept server
+            // must behave the same for all its clients
+            LOGE("--video-bit-rate=auto is incompatible with --keep-server");
+            return false;
+        }
+    }
+
+    if (opts->video_mode == SC_VIDEO_MODE_THUMBNAIL) {
+        if (!opts->video) {
+            LOGE("--video-mode=thumbnail requires video");
+            return false;
+        }
+        if (opts->video_bit_rate_auto) {
+            LOGE("--video-mode=thumbnail is incompatible with "
+                 "--video-bit-rate=auto");
+            return false;
+        }
+        if (opts->video_intra_refresh) {
+            LOGE("--video-mode=thumbnail is incompatible with "
+                 "--video-intra-refresh (all frames are keyframes)");
+            return false;
+        }
+        if (!opts->max_size) {
+            opts->max_size = SC_THUMBNAIL_DEFAULT_MAX_SIZE;
+        }
+        if (!opts->video_bit_rate) {
+            opts->video_bit_rate = SC_THUMBNAIL_DEFAULT_BIT_RATE;
+        }
+    }
+
+    if (opts->max_memory && !opts->max_size && opts->video_playback) {
+        // Degrade the resolution rather than exceed the budget
+        opts->max_size = compute_max_size_for_memory(opts->max_memory);
+        LOGI("Memory budget: video size limited to %u",
+             (unsigned) opts->max_size);
     }
 
 # ifdef _WIN32
@@ -3284,6 +5094,36 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         opts->start_fps_counter = false;
     }
 
+    if (opts->print_latency && !opts->video_playback) {
+        LOGW("--print-latency has no effect without video playback");
+        opts->print_latency = false;
+    }
+
+    if (opts->measure_input_latency
+            && (!opts->video_playback || !opts->control)) {
+        LOGW("--measure-input-latency has no effect without video playback "
+             "and control");
+        opts->measure_input_latency = false;
+    }
+
+    if (opts->latency_probe && (!opts->video_playback || !opts->control)) {
+        LOGW("--latency-probe has no effect without video playback and "
+             "control");
+        opts->latency_probe = false;
+    }
+
+    if (opts->iosurface_sink && !opts->video_playback) {
+        // The surface ids are published by the bridge, run by the window
+        LOGE("--iosurface-sink requires video playback");
+        return false;
+    }
+
+    if (opts->video_hdr
+            && (opts->video_codec != SC_CODEC_H265 || opts->video_codec_auto)) {
+        LOGE("--video-hdr requires --video-codec=h265");
+        return false;
+    }
+
     if (otg) {
         // OTG mode is compatible with only very few options.
         // Only report obvious errors.
@@ -61,6 +61,22 @@
 # define SCRCPY_LAVC_HAS_CODECPAR_CODEC_SIDEDATA
 #endif
 
+// Not documented in ffmpeg/doc/APIchanges, but the buffer parameter of the
+// write_packet callback of avio_alloc_context() is const since the libavformat
+// major bump 61 (FF_API_AVIO_WRITE_NONCONST).
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+# define SCRCPY_LAVF_HAS_AVIO_CONST_WRITE_PACKET
+#endif
+
+// In ffmpeg/doc/APIchanges:
+// 2024-09-xx - lavc 61.13.100 - avcodec.h
+//   Add avcodec_get_supported_config() and enum AVCodecConfig; deprecate
+//   AVCodec.pix_fmts, AVCodec.sample_fmts, AVCodec.supported_framerates,
+//   AVCodec.supported_samplerates and AVCodec.ch_layouts.
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(61, 13, 100)
+# define SCRCPY_LAVC_HAS_GET_SUPPORTED_CONFIG
+#endif
+
 #if SDL_VERSION_ATLEAST(2, 0, 6)
 // <https://github.com/libsdl-org/SDL/commit/d7a318de563125e5bb465b1000d6bc9576fbc6fc>
 # define SCRCPY_SDL_HAS_HINT_TOUCH_MOUSE_EVENTS
@@ -73,10 +89,12 @@
 
 #if SDL_VERSION_ATLEAST(2, 0, 16)
 # define SCRCPY_SDL_HAS_THREAD_PRIORITY_TIME_CRITICAL
+# define SCRCPY_SDL_HAS_UPDATE_NV_TEXTURE
 #endif
 
 #if SDL_VERSION_ATLEAST(2, 0, 18)
 # define SCRCPY_SDL_HAS_HINT_APP_NAME
+# define SCRCPY_SDL_HAS_RENDER_GEOMETRY
 #endif
 
 #if SDL_VERSION_ATLEAST(2, 0, 14)
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "hid/hid_mouse.h"
 #include "util/binary.h"
 #include "util/log.h"
 #include "util/str.h"
@@ -125,6 +126,32 @@ sc_control_msg_serialize(const struct sc_control_msg *msg, uint8_t *buf) {
             sc_write32be(&buf[24], msg->inject_touch_event.action_button);
             sc_write32be(&buf[28], msg->inject_touch_event.buttons);
             return 32;
+        case SC_CONTROL_MSG_TYPE_INJECT_TOUCH_BATCH: {
+            sc_write64be(&buf[1], msg->inject_touch_batch.pointer_id);
+            sc_write16be(&buf[9], msg->inject_touch_batch.screen_size.width);
+            sc_write16be(&buf[11], msg->inject_touch_batch.screen_size.height);
+            sc_write32be(&buf[13], msg->inject_touch_batch.buttons);
+            uint8_t count = msg->inject_touch_batch.count;
+            assert(count && count <= SC_CONTROL_MSG_TOUCH_BATCH_MAX_SAMPLES);
+            buf[17] = count;
+            sc_tick last = msg->inject_touch_batch.samples[count - 1].timestamp;
+            uint8_t *p = &buf[18];
+            for (uint8_t i = 0; i < count; ++i) {
+                const struct sc_point *point =
+                    &msg->inject_touch_batch.samples[i].point;
+                sc_write32be(&p[0], point->x);
+                sc_write32be(&p[4], point->y);
+                uint16_t sample_pressure = sc_float_to_u16fp(
+                        msg->inject_touch_batch.samples[i].pressure);
+                sc_write16be(&p[8], sample_pressure);
+                // Age of the sample relative to the last one, in microseconds
+                sc_tick age =
+                    last - msg->inject_touch_batch.samples[i].timestamp;
+                sc_write32be(&p[10], (uint32_t) SC_TICK_TO_US(age));
+                p += 14;
+            }
+            return p - buf;
+        }
         case SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT:
             write_position(&buf[1], &msg->inject_scroll_event.position);
             // Accept values in the range [-16, 16].
@@ -182,12 +209,38 @@ sc_control_msg_serialize(const struct sc_control_msg *msg, uint8_t *buf) {
             size_t len = write_string_tiny(&buf[1], msg->start_app.name, 255);
             return 1 + len;
         }
+        case SC_CONTROL_MSG_TYPE_VIDEO_FEEDBACK:
+            sc_write32be(&buf[1], msg->video_feedback.bit_rate);
+            sc_write16be(&buf[5], msg->video_feedback.delay);
+            sc_write16be(&buf[7], msg->video_feedback.backlog);
+            return 9;
+        case SC_CONTROL_MSG_TYPE_INPUT_PROBE:
+            sc_write64be(&buf[1], msg->input_probe.sequence);
+            return 9;
+        case SC_CONTROL_MSG_TYPE_SET_CLIPBOARD_CHUNK: {
+            uint16_t chunk_len = msg->set_clipboard_chunk.len;
+            assert(chunk_len <= SC_CONTROL_MSG_CLIPBOARD_CHUNK_SIZE);
+            sc_write64be(&buf[1], msg->set_clipboard_chunk.sequence);
+            buf[9] = msg->set_clipboard_chunk.flags;
+            sc_write16be(&buf[10], chunk_len);
+            memcpy(&buf[12], msg->set_clipboard_chunk.data, chunk_len);
+            return 12 + chunk_len;
+        }
+        case SC_CONTROL_MSG_TYPE_SET_VIEWPORT_SIZE:
+            sc_write16be(&buf[1], msg->set_viewport_size.width);
+            sc_write16be(&buf[3], msg->set_viewport_size.height);
+            return 5;
+        case SC_CONTROL_MSG_TYPE_LATENCY_PROBE:
+            buf[1] = msg->latency_probe.code;
+            return 2;
         case SC_CONTROL_MSG_TYPE_EXPAND_NOTIFICATION_PANEL:
         case SC_CONTROL_MSG_TYPE_EXPAND_SETTINGS_PANEL:
         case SC_CONTROL_MSG_TYPE_COLLAPSE_PANELS:
         case SC_CONTROL_MSG_TYPE_ROTATE_DEVICE:
         case SC_CONTROL_MSG_TYPE_OPEN_HARD_KEYBOARD_SETTINGS:
         case SC_CONTROL_MSG_TYPE_RESET_VIDEO:
+        case SC_CONTROL_MSG_TYPE_REQUEST_SYNC_FRAME:
+        case SC_CONTROL_MSG_TYPE_CAPTURE_SCREENSHOT:
             // no additional data
             return 1;
         default:
@@ -241,6 +294,25 @@ sc_control_msg_log(const struct sc_control_msg *msg) {
             }
             break;
         }
+        case SC_CONTROL_MSG_TYPE_INJECT_TOUCH_BATCH: {
+            uint8_t count = msg->inject_touch_batch.count;
+            const struct sc_point *last =
+                &msg->inject_touch_batch.samples[count - 1].point;
+            uint64_t id = msg->inject_touch_batch.pointer_id;
+            const char *pointer_name = get_well_known_pointer_id_name(id);
+            if (pointer_name) {
+                LOG_CMSG("touch batch [id=%s] samples=%u position=%" PRIi32
+                             ",%" PRIi32 " buttons=%06lx",
+                         pointer_name, (unsigned) count, last->x, last->y,
+                         (long) msg->inject_touch_batch.buttons);
+            } else {
+                LOG_CMSG("touch batch [id=%" PRIu64_ "] samples=%u position=%"
+                             PRIi32 ",%" PRIi32 " buttons=%06lx",
+                         id, (unsigned) count, last->x, last->y,
+                         (long) msg->inject_touch_batch.buttons);
+            }
+            break;
+        }
         case SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT:
             LOG_CMSG("scroll position=%" PRIi32 ",%" PRIi32 " hscroll=%f"
                          " vscroll=%f buttons=%06lx",
@@ -318,6 +390,36 @@ sc_control_msg_log(const struct sc_control_msg *msg) {
         case SC_CONTROL_MSG_TYPE_RESET_VIDEO:
             LOG_CMSG("reset video");
             break;
+        case SC_CONTROL_MSG_TYPE_REQUEST_SYNC_FRAME:
+            LOG_CMSG("request sync frame");
+            break;
+        case SC_CONTROL_MSG_TYPE_CAPTURE_SCREENSHOT:
+            LOG_CMSG("capture screenshot");
+            break;
+        case SC_CONTROL_MSG_TYPE_VIDEO_FEEDBACK:
+            LOG_CMSG("video feedback bit_rate=%" PRIu32 " delay=%" PRIu16
+                     "ms backlog=%" PRIu16, msg->video_feedback.bit_rate,
+                     msg->video_feedback.delay, msg->video_feedback.backlog);
+            break;
+        case SC_CONTROL_MSG_TYPE_INPUT_PROBE:
+            LOG_CMSG("input probe sequence=%" PRIu64_,
+                     msg->input_probe.sequence);
+            break;
+        case SC_CONTROL_MSG_TYPE_SET_CLIPBOARD_CHUNK:
+            LOG_CMSG("clipboard chunk %" PRIu64_ " flags=%02x len=%" PRIu16,
+                     msg->set_clipboard_chunk.sequence,
+                     (unsigned) msg->set_clipboard_chunk.flags,
+                     msg->set_clipboard_chunk.len);
+            break;
+        case SC_CONTROL_MSG_TYPE_SET_VIEWPORT_SIZE:
+            LOG_CMSG("viewport size %" PRIu16 "x%" PRIu16,
+                     msg->set_viewport_size.width,
+                     msg->set_viewport_size.height);
+            break;
+        case SC_CONTROL_MSG_TYPE_LATENCY_PROBE:
+            LOG_CMSG("latency probe code=%u",
+                     (unsigned) msg->latency_probe.code);
+            break;
         default:
             LOG_CMSG("unknown type: %u", (unsigned) msg->type);
             break;
@@ -334,6 +436,204 @@ sc_control_msg_is_droppable(const struct sc_control_msg *msg) {
         && msg->type != SC_CONTROL_MSG_TYPE_UHID_DESTROY;
 }
 
+static bool
+is_same_touch_pointer(const struct sc_control_msg *prev,
+                      const struct sc_control_msg *msg) {
+    return prev->inject_touch_event.action == msg->inject_touch_event.action
+        && prev->inject_touch_event.pointer_id
+            == msg->inject_touch_event.pointer_id
+        && prev->inject_touch_event.action_button
+            == msg->inject_touch_event.action_button
+        && prev->inject_touch_event.buttons
+            == msg->inject_touch_event.buttons;
+}
+
+static bool
+is_same_size(const struct sc_size *a, const struct sc_size *b) {
+    return a->width == b->width && a->height == b->height;
+}
+
+static bool
+append_touch_sample(struct sc_control_msg *batch,
+                    const struct sc_control_msg *msg) {
+    assert(batch->type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_BATCH);
+    assert(msg->type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT);
+
+    if (batch->inject_touch_batch.count
+                == SC_CONTROL_MSG_TOUCH_BATCH_MAX_SAMPLES
+            || batch->inject_touch_batch.pointer_id
+                != msg->inject_touch_event.pointer_id
+            || batch->inject_touch_batch.buttons
+                != msg->inject_touch_event.buttons
+            || !is_same_size(&batch->inject_touch_batch.screen_size,
+                             &msg->inject_touch_event.position.screen_size)) {
+        return false;
+    }
+
+    uint8_t i = batch->inject_touch_batch.count++;
+    batch->inject_touch_batch.samples[i].point =
+        msg->inject_touch_event.position.point;
+    batch->inject_touch_batch.samples[i].pressure =
+        msg->inject_touch_event.pressure;
+    batch->inject_touch_batch.samples[i].timestamp =
+        msg->inject_touch_event.timestamp;
+    return true;
+}
+
+static bool
+coalesce_touch_event(struct sc_control_msg *prev,
+                     const struct sc_control_msg *msg) {
+    enum android_motionevent_action action = msg->inject_touch_event.action;
+
+    if (prev->type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_BATCH) {
+        return action == AMOTION_EVENT_ACTION_MOVE
+            && !msg->inject_touch_event.action_button
+            && append_touch_sample(prev, msg);
+    }
+
+    assert(prev->type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT);
+    if (!is_same_touch_pointer(prev, msg)) {
+        return false;
+    }
+
+    if (action == AMOTION_EVENT_ACTION_HOVER_MOVE) {
+        // Only the last position of a hovering pointer matters
+        prev->inject_touch_event.position = msg->inject_touch_event.position;
+        prev->inject_touch_event.pressure = msg->inject_touch_event.pressure;
+        return true;
+    }
+
+    if (action != AMOTION_EVENT_ACTION_MOVE
+            || msg->inject_touch_event.action_button
+            || !is_same_size(&prev->inject_touch_event.position.screen_size,
+                             &msg->inject_touch_event.position.screen_size)) {
+        return false;
+    }
+
+    // Convert the previous move into a batch, then append the new sample
+    struct sc_control_msg batch = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_BATCH,
+        .inject_touch_batch = {
+            .pointer_id = prev->inject_touch_event.pointer_id,
+            .screen_size = prev->inject_touch_event.position.screen_size,
+            .buttons = prev->inject_touch_event.buttons,
+            .count = 1,
+        },
+    };
+    batch.inject_touch_batch.samples[0].point =
+        prev->inject_touch_event.position.point;
+    batch.inject_touch_batch.samples[0].pressure =
+        prev->inject_touch_event.pressure;
+    batch.inject_touch_batch.samples[0].timestamp =
+        prev->inject_touch_event.timestamp;
+
+    bool ok = append_touch_sample(&batch, msg);
+    assert(ok);
+    (void) ok;
+
+    *prev = batch;
+    return true;
+}
+
+static bool
+coalesce_scroll_event(struct sc_control_msg *prev,
+                      const struct sc_control_msg *msg) {
+    if (prev->inject_scroll_event.buttons != msg->inject_scroll_event.buttons) {
+        return false;
+    }
+
+    float hscroll = prev->inject_scroll_event.hscroll
+                  + msg->inject_scroll_event.hscroll;
+    float vscroll = prev->inject_scroll_event.vscroll
+                  + msg->inject_scroll_event.vscroll;
+    // The values are clamped on serialization, do not lose the excess
+    if (hscroll < -16 || hscroll > 16 || vscroll < -16 || vscroll > 16) {
+        return false;
+    }
+
+    prev->inject_scroll_event.position = msg->inject_scroll_event.position;
+    prev->inject_scroll_event.hscroll = hscroll;
+    prev->inject_scroll_event.vscroll = vscroll;
+    return true;
+}
+
+static bool
+coalesce_uhid_input(struct sc_control_msg *prev,
+                    const struct sc_control_msg *msg) {
+    if (prev->uhid_input.id != SC_HID_ID_MOUSE
+            || msg->uhid_input.id != SC_HID_ID_MOUSE) {
+        return false;
+    }
+
+    struct sc_hid_input hid_prev = {
+        .hid_id = prev->uhid_input.id,
+        .size = prev->uhid_input.size,
+    };
+    memcpy(hid_prev.data, prev->uhid_input.data, prev->uhid_input.size);
+
+    struct sc_hid_input hid_input = {
+        .hid_id = msg->uhid_input.id,
+        .size = msg->uhid_input.size,
+    };
+    memcpy(hid_input.data, msg->uhid_input.data, msg->uhid_input.size);
+
+    if (!sc_hid_mouse_merge_input(&hid_prev, &hid_input)) {
+        return false;
+    }
+
+    memcpy(prev->uhid_input.data, hid_prev.data, hid_prev.size);
+    return true;
+}
+
+static bool
+coalesce_inject_text(struct sc_control_msg *prev,
+                     const struct sc_control_msg *msg) {
+    size_t prev_len = strlen(prev->inject_text.text);
+    size_t len = strlen(msg->inject_text.text);
+    // Never truncated on serialization
+    if (prev_len + len > SC_CONTROL_MSG_INJECT_TEXT_MAX_LENGTH) {
+        return false;
+    }
+
+    char *text = realloc(prev->inject_text.text, prev_len + len + 1);
+    if (!text) {
+        LOG_OOM();
+        return false;
+    }
+
+    memcpy(text + prev_len, msg->inject_text.text, len + 1);
+    prev->inject_text.text = text;
+    // The text of msg is owned, it has been merged
+    free(msg->inject_text.text);
+    return true;
+}
+
+bool
+sc_control_msg_coalesce(struct sc_control_msg *prev,
+                        const struct sc_control_msg *msg) {
+    if (msg->type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT
+            && prev->type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_BATCH) {
+        return coalesce_touch_event(prev, msg);
+    }
+
+    if (prev->type != msg->type) {
+        return false;
+    }
+
+    switch (msg->type) {
+        case SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT:
+            return coalesce_touch_event(prev, msg);
+        case SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT:
+            return coalesce_scroll_event(prev, msg);
+        case SC_CONTROL_MSG_TYPE_UHID_INPUT:
+            return coalesce_uhid_input(prev, msg);
+        case SC_CONTROL_MSG_TYPE_INJECT_TEXT:
+            return coalesce_inject_text(prev, msg);
+        default:
+            return false;
+    }
+}
+
 void
 sc_control_msg_destroy(struct sc_control_msg *msg) {
     switch (msg->type) {
@@ -11,6 +11,7 @@
 #include "android/keycodes.h"
 #include "coords.h"
 #include "hid/hid_event.h"
+#include "util/tick.h"
 
 #define SC_CONTROL_MSG_MAX_SIZE (1 << 18) // 256k
 
@@ -18,6 +19,19 @@
 // type: 1 byte; sequence: 8 bytes; paste flag: 1 byte; length: 4 bytes
 #define SC_CONTROL_MSG_CLIPBOARD_TEXT_MAX_LENGTH (SC_CONTROL_MSG_MAX_SIZE - 14)
 
+// Clipboard texts bigger than this are sent in chunks of this size, with a
+// lower priority than the other messages
+#define SC_CONTROL_MSG_CLIPBOARD_CHUNK_SIZE 8192
+
+#define SC_CLIPBOARD_CHUNK_FLAG_FIRST 1
+#define SC_CLIPBOARD_CHUNK_FLAG_LAST 2
+#define SC_CLIPBOARD_CHUNK_FLAG_PASTE 4
+// The concatenated chunks are compressed (zlib format)
+#define SC_CLIPBOARD_CHUNK_FLAG_DEFLATE 8
+
+// Maximum number of samples of a single SC_CONTROL_MSG_TYPE_INJECT_TOUCH_BATCH
+#define SC_CONTROL_MSG_TOUCH_BATCH_MAX_SAMPLES 16
+
 #define SC_POINTER_ID_MOUSE UINT64_C(-1)
 #define SC_POINTER_ID_GENERIC_FINGER UINT64_C(-2)
 
@@ -43,6 +57,14 @@ enum sc_control_msg_type {
     SC_CONTROL_MSG_TYPE_OPEN_HARD_KEYBOARD_SETTINGS,
     SC_CONTROL_MSG_TYPE_START_APP,
     SC_CONTROL_MSG_TYPE_RESET_VIDEO,
+    SC_CONTROL_MSG_TYPE_VIDEO_FEEDBACK,
+    SC_CONTROL_MSG_TYPE_REQUEST_SYNC_FRAME,
+    SC_CONTROL_MSG_TYPE_INJECT_TOUCH_BATCH,
+    SC_CONTROL_MSG_TYPE_INPUT_PROBE,
+    SC_CONTROL_MSG_TYPE_SET_CLIPBOARD_CHUNK,
+    SC_CONTROL_MSG_TYPE_SET_VIEWPORT_SIZE,
+    SC_CONTROL_MSG_TYPE_CAPTURE_SCREENSHOT,
+    SC_CONTROL_MSG_TYPE_LATENCY_PROBE,
 };
 
 enum sc_copy_key {
@@ -70,7 +92,22 @@ struct sc_control_msg {
             uint64_t pointer_id;
             struct sc_position position;
             float pressure;
+            // Set by the controller when the msg is queued (not serialized)
+            sc_tick timestamp;
         } inject_touch_event;
+        struct {
+            // Successive moves of a single pointer, merged while queued, so
+            // that the device receives all the intermediate positions
+            uint64_t pointer_id;
+            struct sc_size screen_size;
+            enum android_motionevent_buttons buttons;
+            uint8_t count;
+            struct {
+                struct sc_point point;
+                float pressure;
+                sc_tick timestamp;
+            } samples[SC_CONTROL_MSG_TOUCH_BATCH_MAX_SAMPLES];
+        } inject_touch_batch;
         struct {
             struct sc_position position;
             float hscroll;
@@ -111,6 +148,28 @@ struct sc_control_msg {
         struct {
             char *name;
         } start_app;
+        struct {
+            uint32_t bit_rate; // received bit rate, in bits per second
+            uint16_t delay; // transit delay increase, in milliseconds
+            uint16_t backlog; // number of frames not rendered in time
+        } video_feedback;
+        struct {
+            uint64_t sequence;
+        } input_probe;
+        struct {
+            uint64_t sequence;
+            uint8_t flags; // SC_CLIPBOARD_CHUNK_FLAG_*
+            const uint8_t *data; // not owned
+            uint16_t len; // at most SC_CONTROL_MSG_CLIPBOARD_CHUNK_SIZE
+        } set_clipboard_chunk;
+        struct {
+            // size of the video area in the client window, in pixels
+            uint16_t width;
+            uint16_t height;
+        } set_viewport_size;
+        struct {
+            uint8_t code; // drawn on the next frames, 0 to disable
+        } latency_probe;
     };
 };
 
@@ -127,6 +186,18 @@ sc_control_msg_log(const struct sc_control_msg *msg);
 bool
 sc_control_msg_is_droppable(const struct sc_control_msg *msg);
 
+// Merge msg into prev (a message not sent yet), if msg only updates it:
+//  - touch moves of the same pointer are merged into a touch batch;
+//  - a hover move replaces a previous hover move of the same pointer;
+//  - scroll deltas are accumulated;
+//  - relative HID mouse reports with the same buttons state are summed;
+//  - texts are concatenated (up to SC_CONTROL_MSG_INJECT_TEXT_MAX_LENGTH).
+// Return true if msg has been merged (so it must not be sent separately). In
+// that case, the data owned by msg (the text) is released.
+bool
+sc_control_msg_coalesce(struct sc_control_msg *prev,
+                        const struct sc_control_msg *msg);
+
 void
 sc_control_msg_destroy(struct sc_control_msg *msg);
 
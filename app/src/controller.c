@@ -1,8 +1,16 @@
 #include "controller.h"
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_ZLIB
+# include <zlib.h>
+#endif
 
+#include "stats.h"
 #include "util/log.h"
+#include "util/str.h"
+#include "util/trace.h"
 
 // Drop droppable events above this limit
 #define SC_CONTROL_MSG_QUEUE_LIMIT 60
@@ -30,6 +38,9 @@ sc_controller_init(struct sc_controller *controller, sc_socket control_socket,
         return false;
     }
 
+    // The bulk queue grows if necessary
+    sc_vecdeque_init(&controller->bulk_queue);
+
     static const struct sc_receiver_callbacks receiver_cbs = {
         .on_ended = sc_controller_receiver_on_ended,
     };
@@ -38,6 +49,7 @@ sc_controller_init(struct sc_controller *controller, sc_socket control_socket,
                           controller);
     if (!ok) {
         sc_vecdeque_destroy(&controller->queue);
+        sc_vecdeque_destroy(&controller->bulk_queue);
         return false;
     }
 
@@ -45,6 +57,7 @@ sc_controller_init(struct sc_controller *controller, sc_socket control_socket,
     if (!ok) {
         sc_receiver_destroy(&controller->receiver);
         sc_vecdeque_destroy(&controller->queue);
+        sc_vecdeque_destroy(&controller->bulk_queue);
         return false;
     }
 
@@ -53,11 +66,15 @@ sc_controller_init(struct sc_controller *controller, sc_socket control_socket,
         sc_receiver_destroy(&controller->receiver);
         sc_mutex_destroy(&controller->mutex);
         sc_vecdeque_destroy(&controller->queue);
+        sc_vecdeque_destroy(&controller->bulk_queue);
         return false;
     }
 
     controller->control_socket = control_socket;
+    controller->mux = NULL;
     controller->stopped = false;
+    controller->clipboard.data = NULL;
+    controller->input_latency = NULL;
 
     assert(cbs && cbs->on_ended);
     controller->cbs = cbs;
@@ -69,9 +86,24 @@ sc_controller_init(struct sc_controller *controller, sc_socket control_socket,
 void
 sc_controller_configure(struct sc_controller *controller,
                         struct sc_acksync *acksync,
-                        struct sc_uhid_devices *uhid_devices) {
+                        struct sc_uhid_devices *uhid_devices,
+                        struct sc_input_latency *input_latency) {
     controller->receiver.acksync = acksync;
     controller->receiver.uhid_devices = uhid_devices;
+    controller->receiver.input_latency = input_latency;
+    controller->input_latency = input_latency;
+}
+
+void
+sc_controller_set_probe_acksync(struct sc_controller *controller,
+                                struct sc_acksync *probe_acksync) {
+    controller->receiver.probe_acksync = probe_acksync;
+}
+
+void
+sc_controller_set_mux(struct sc_controller *controller, struct sc_mux *mux) {
+    controller->mux = mux;
+    controller->receiver.mux = mux;
 }
 
 void
@@ -85,74 +117,391 @@ sc_controller_destroy(struct sc_controller *controller) {
         sc_control_msg_destroy(msg);
     }
     sc_vecdeque_destroy(&controller->queue);
+    while (!sc_vecdeque_is_empty(&controller->bulk_queue)) {
+        struct sc_control_msg *msg =
+            sc_vecdeque_popref(&controller->bulk_queue);
+        sc_control_msg_destroy(msg);
+    }
+    sc_vecdeque_destroy(&controller->bulk_queue);
+    free(controller->clipboard.data);
 
     sc_receiver_destroy(&controller->receiver);
 }
 
-bool
-sc_controller_push_msg(struct sc_controller *controller,
-                       const struct sc_control_msg *msg) {
-    if (sc_get_log_level() <= SC_LOG_LEVEL_VERBOSE) {
-        sc_control_msg_log(msg);
+static bool
+is_input_event(const struct sc_control_msg *msg) {
+    switch (msg->type) {
+        case SC_CONTROL_MSG_TYPE_INJECT_KEYCODE:
+            return msg->inject_keycode.action == AKEY_EVENT_ACTION_DOWN;
+        case SC_CONTROL_MSG_TYPE_INJECT_TEXT:
+        case SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT:
+        case SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT:
+            return true;
+        default:
+            return false;
     }
+}
+
+// An external probe must be acknowledged after all the msgs pushed before it,
+// whatever their lane
+static bool
+is_external_input_probe(const struct sc_control_msg *msg) {
+    return msg->type == SC_CONTROL_MSG_TYPE_INPUT_PROBE
+        && (msg->input_probe.sequence & SC_INPUT_PROBE_SEQUENCE_EXTERNAL);
+}
+
+static bool
+is_bulk(const struct sc_control_msg *msg) {
+    switch (msg->type) {
+        case SC_CONTROL_MSG_TYPE_INJECT_TEXT:
+        case SC_CONTROL_MSG_TYPE_SET_CLIPBOARD:
+        case SC_CONTROL_MSG_TYPE_UHID_CREATE:
+        case SC_CONTROL_MSG_TYPE_START_APP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Real-time msgs which must not overtake the pending bulk msgs (for example,
+// Ctrl+v must be injected after the clipboard is set, and UHID input must be
+// sent after the UHID device is created)
+static bool
+is_ordered_after_bulk(const struct sc_control_msg *msg) {
+    return msg->type == SC_CONTROL_MSG_TYPE_INJECT_KEYCODE
+        || msg->type == SC_CONTROL_MSG_TYPE_UHID_INPUT
+        || msg->type == SC_CONTROL_MSG_TYPE_UHID_DESTROY
+        || is_external_input_probe(msg);
+}
+
+// The mutex must be held
+static void
+update_queue_stats(struct sc_controller *controller) {
+    size_t size = sc_vecdeque_size(&controller->queue)
+                + sc_vecdeque_size(&controller->bulk_queue);
+    sc_stats_set(SC_STAT_CONTROLLER_QUEUE, size);
+}
 
+static bool
+push_msg(struct sc_controller *controller, const struct sc_control_msg *msg,
+         bool bulk) {
+    struct sc_control_msg_queue *queue = bulk ? &controller->bulk_queue
+                                              : &controller->queue;
     bool pushed = false;
 
     sc_mutex_lock(&controller->mutex);
-    size_t size = sc_vecdeque_size(&controller->queue);
-    if (size < SC_CONTROL_MSG_QUEUE_LIMIT) {
-        bool was_empty = sc_vecdeque_is_empty(&controller->queue);
-        sc_vecdeque_push_noresize(&controller->queue, *msg);
-        pushed = true;
-        if (was_empty) {
-            sc_cond_signal(&controller->msg_cond);
+    size_t size = sc_vecdeque_size(queue);
+    if (size) {
+        // The last queued msg has not been sent yet, so a move or a scroll
+        // may be merged into it (this keeps the queue short whatever the
+        // rate of the input device, without losing intermediate positions)
+        struct sc_control_msg *last = sc_vecdeque_back_ref(queue);
+        if (sc_control_msg_coalesce(last, msg)) {
+            sc_mutex_unlock(&controller->mutex);
+            return true;
         }
-    } else if (!sc_control_msg_is_droppable(msg)) {
-        bool ok = sc_vecdeque_push(&controller->queue, *msg);
+    }
+
+    if (size < SC_CONTROL_MSG_QUEUE_LIMIT
+            || !sc_control_msg_is_droppable(msg)) {
+        bool ok = sc_vecdeque_push(queue, *msg);
         if (ok) {
             pushed = true;
+            if (!size) {
+                sc_cond_signal(&controller->msg_cond);
+            }
         } else {
-            // A non-droppable event must be dropped anyway
             LOG_OOM();
         }
     }
     // Otherwise, the msg is discarded
 
+    update_queue_stats(controller);
     sc_mutex_unlock(&controller->mutex);
 
     return pushed;
 }
 
+static void
+push_input_probe(struct sc_controller *controller, bool bulk) {
+    uint64_t sequence =
+        sc_input_latency_start_probe(controller->input_latency);
+    if (sequence == SC_SEQUENCE_INVALID) {
+        // A probe is already in flight
+        return;
+    }
+
+    // Sent just after the input event, so the device acknowledges it once
+    // the event is injected
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INPUT_PROBE,
+        .input_probe = {
+            .sequence = sequence,
+        },
+    };
+    // If it is dropped, the probe will time out. It is pushed to the lane of
+    // the input event, so that it is not sent before it.
+    push_msg(controller, &msg, bulk);
+}
+
+// Prepare the payload of a chunked clipboard transfer (compressed if it
+// reduces the size)
 static bool
-process_msg(struct sc_controller *controller,
-            const struct sc_control_msg *msg, bool *eos) {
-    static uint8_t serialized_msg[SC_CONTROL_MSG_MAX_SIZE];
-    size_t length = sc_control_msg_serialize(msg, serialized_msg);
-    if (!length) {
-        *eos = false;
+init_clipboard_transfer(struct sc_clipboard_transfer *transfer,
+                        const char *text, bool paste, uint64_t sequence) {
+    size_t len = sc_str_utf8_truncation_index(
+            text, SC_CONTROL_MSG_CLIPBOARD_TEXT_MAX_LENGTH);
+
+    transfer->offset = 0;
+    transfer->sequence = sequence;
+    transfer->flags = paste ? SC_CLIPBOARD_CHUNK_FLAG_PASTE : 0;
+
+#ifdef HAVE_ZLIB
+    uLongf compressed_len = compressBound(len);
+    uint8_t *compressed = malloc(compressed_len);
+    if (!compressed) {
+        LOG_OOM();
+        return false;
+    }
+    int r = compress2(compressed, &compressed_len, (const Bytef *) text, len,
+                      Z_BEST_SPEED);
+    if (r == Z_OK && compressed_len < len) {
+        LOGD("Clipboard compressed from %" SC_PRIsizet " to %" SC_PRIsizet
+             " bytes", len, (size_t) compressed_len);
+        transfer->data = compressed;
+        transfer->size = compressed_len;
+        transfer->flags |= SC_CLIPBOARD_CHUNK_FLAG_DEFLATE;
+        return true;
+    }
+    free(compressed);
+#endif
+
+    transfer->data = malloc(len);
+    if (!transfer->data) {
+        LOG_OOM();
         return false;
     }
+    memcpy(transfer->data, text, len);
+    transfer->size = len;
+    return true;
+}
 
-    ssize_t w =
-        net_send_all(controller->control_socket, serialized_msg, length);
-    if ((size_t) w != length) {
-        *eos = true;
+// Send big clipboard texts in chunks, so that they do not delay other
+// messages (the ownership of the text is taken on success)
+static bool
+push_clipboard_transfer(struct sc_controller *controller,
+                        const struct sc_control_msg *msg) {
+    assert(msg->type == SC_CONTROL_MSG_TYPE_SET_CLIPBOARD);
+
+    struct sc_clipboard_transfer transfer;
+    bool ok = init_clipboard_transfer(&transfer, msg->set_clipboard.text,
+                                      msg->set_clipboard.paste,
+                                      msg->set_clipboard.sequence);
+    if (!ok) {
         return false;
     }
 
+    free(msg->set_clipboard.text);
+
+    sc_mutex_lock(&controller->mutex);
+    // A new clipboard content replaces any transfer in progress
+    free(controller->clipboard.data);
+    transfer.queued_before = sc_vecdeque_size(&controller->bulk_queue);
+    controller->clipboard = transfer;
+    sc_cond_signal(&controller->msg_cond);
+    sc_mutex_unlock(&controller->mutex);
+
     return true;
 }
 
+bool
+sc_controller_push_msg(struct sc_controller *controller,
+                       const struct sc_control_msg *msg) {
+    if (sc_get_log_level() <= SC_LOG_LEVEL_VERBOSE) {
+        sc_control_msg_log(msg);
+    }
+
+    if (msg->type == SC_CONTROL_MSG_TYPE_SET_CLIPBOARD
+            && msg->set_clipboard.text
+            && strlen(msg->set_clipboard.text)
+                > SC_CONTROL_MSG_CLIPBOARD_CHUNK_SIZE) {
+        return push_clipboard_transfer(controller, msg);
+    }
+
+    struct sc_control_msg queued = *msg;
+    if (queued.type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT) {
+        // Keep the time of each sample in case moves are batched
+        queued.inject_touch_event.timestamp = sc_tick_now();
+    }
+
+    bool bulk = is_bulk(&queued);
+    bool pushed = push_msg(controller, &queued, bulk);
+
+    if (pushed && controller->input_latency && is_input_event(&queued)) {
+        push_input_probe(controller, bulk);
+    }
+
+    return pushed;
+}
+
+bool
+sc_controller_push_input_probe(struct sc_controller *controller,
+                               uint64_t sequence) {
+    assert(controller->receiver.probe_acksync);
+    assert(sequence != SC_SEQUENCE_INVALID);
+    assert(!(sequence & SC_INPUT_PROBE_SEQUENCE_EXTERNAL));
+
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INPUT_PROBE,
+        .input_probe = {
+            .sequence = sequence | SC_INPUT_PROBE_SEQUENCE_EXTERNAL,
+        },
+    };
+    // In the real-time lane, but ordered after the bulk msgs
+    return push_msg(controller, &msg, false);
+}
+
+// Serialize the queued msgs into a single buffer while it contains less than
+// this amount, so that they are sent with a single write
+#define SC_CONTROL_MSG_BATCH_SIZE 4096
+
+// Serialize the next chunk of the clipboard transfer in progress
+//
+// The mutex must be held.
+static size_t
+serialize_clipboard_chunk(struct sc_controller *controller, uint8_t *buf) {
+    struct sc_clipboard_transfer *transfer = &controller->clipboard;
+    assert(transfer->data);
+
+    size_t remaining = transfer->size - transfer->offset;
+    size_t len = MIN(remaining, SC_CONTROL_MSG_CLIPBOARD_CHUNK_SIZE);
+
+    uint8_t flags = transfer->flags;
+    if (!transfer->offset) {
+        flags |= SC_CLIPBOARD_CHUNK_FLAG_FIRST;
+    }
+    if (len == remaining) {
+        flags |= SC_CLIPBOARD_CHUNK_FLAG_LAST;
+    }
+
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_SET_CLIPBOARD_CHUNK,
+        .set_clipboard_chunk = {
+            .sequence = transfer->sequence,
+            .flags = flags,
+            .data = transfer->data + transfer->offset,
+            .len = len,
+        },
+    };
+    size_t length = sc_control_msg_serialize(&msg, buf);
+
+    transfer->offset += len;
+    if (transfer->offset == transfer->size) {
+        free(transfer->data);
+        transfer->data = NULL;
+    }
+
+    return length;
+}
+
+static bool
+has_pending_bulk(struct sc_controller *controller) {
+    return !sc_vecdeque_is_empty(&controller->bulk_queue)
+        || controller->clipboard.data;
+}
+
+// Pop and serialize the msg at the front of the queue
+//
+// Return the length of the serialized data (0 on error).
+static size_t
+serialize_front_msg(struct sc_control_msg_queue *queue, uint8_t *buf,
+                    uint64_t *probe) {
+    struct sc_control_msg *msg = sc_vecdeque_popref(queue);
+    if (msg->type == SC_CONTROL_MSG_TYPE_INPUT_PROBE
+            && !is_external_input_probe(msg)) {
+        *probe = msg->input_probe.sequence;
+    }
+    size_t len = sc_control_msg_serialize(msg, buf);
+    sc_control_msg_destroy(msg);
+    return len;
+}
+
+// Serialize as many queued messages as possible into buf: the real-time ones
+// first, then the bulk ones (ending by a clipboard chunk) if there is enough
+// room
+//
+// The sequence of the input probe serialized, if any, is written to *probe.
+//
+// The mutex must be held, and there must be something to send.
+// Return the length of the serialized data (0 on error).
+static size_t
+serialize_msgs(struct sc_controller *controller, uint8_t *buf,
+               uint64_t *probe) {
+    *probe = SC_SEQUENCE_INVALID;
+
+    // There is always enough room for one more message while length is below
+    // SC_CONTROL_MSG_BATCH_SIZE
+    size_t length = 0;
+    while (length < SC_CONTROL_MSG_BATCH_SIZE
+            && !sc_vecdeque_is_empty(&controller->queue)) {
+        struct sc_control_msg *msg = sc_vecdeque_front_ref(&controller->queue);
+        if (is_ordered_after_bulk(msg) && has_pending_bulk(controller)) {
+            break;
+        }
+
+        size_t len = serialize_front_msg(&controller->queue, buf + length,
+                                         probe);
+        if (!len) {
+            return 0;
+        }
+        length += len;
+    }
+
+    struct sc_clipboard_transfer *transfer = &controller->clipboard;
+    while (length < SC_CONTROL_MSG_BATCH_SIZE
+            && !sc_vecdeque_is_empty(&controller->bulk_queue)) {
+        if (transfer->data) {
+            if (!transfer->queued_before) {
+                // The next bulk msgs have been pushed after the transfer
+                break;
+            }
+            --transfer->queued_before;
+        }
+
+        size_t len = serialize_front_msg(&controller->bulk_queue,
+                                         buf + length, probe);
+        if (!len) {
+            return 0;
+        }
+        length += len;
+    }
+
+    if (transfer->data && !transfer->queued_before
+            && length < SC_CONTROL_MSG_BATCH_SIZE) {
+        length += serialize_clipboard_chunk(controller, buf + length);
+    }
+
+    assert(length);
+    return length;
+}
+
 static int
 run_controller(void *data) {
     struct sc_controller *controller = data;
 
+    static uint8_t buf[SC_CONTROL_MSG_BATCH_SIZE + SC_CONTROL_MSG_MAX_SIZE];
+
+    // Input events must be forwarded immediately
+    bool ok = sc_thread_set_priority(SC_THREAD_PRIORITY_HIGH);
+    (void) ok; // We don't care if it worked
+
     bool error = false;
 
     for (;;) {
         sc_mutex_lock(&controller->mutex);
         while (!controller->stopped
-                && sc_vecdeque_is_empty(&controller->queue)) {
+                && sc_vecdeque_is_empty(&controller->queue)
+                && !has_pending_bulk(controller)) {
             sc_cond_wait(&controller->msg_cond, &controller->mutex);
         }
         if (controller->stopped) {
@@ -162,20 +511,32 @@ run_controller(void *data) {
             break;
         }
 
-        assert(!sc_vecdeque_is_empty(&controller->queue));
-        struct sc_control_msg msg = sc_vecdeque_pop(&controller->queue);
+        uint64_t probe;
+        size_t length = serialize_msgs(controller, buf, &probe);
+        update_queue_stats(controller);
         sc_mutex_unlock(&controller->mutex);
 
-        bool eos;
-        bool ok = process_msg(controller, &msg, &eos);
-        sc_control_msg_destroy(&msg);
-        if (!ok) {
-            if (eos) {
-                LOGD("Controller stopped (socket closed)");
-            } // else error already logged
-            error = !eos;
+        if (!length) {
+            // error already logged
+            error = true;
             break;
         }
+
+        sc_tick start = sc_trace_begin();
+        ssize_t w = controller->mux
+                  ? sc_mux_send_all(controller->mux, SC_MUX_STREAM_CONTROL,
+                                    buf, length)
+                  : net_send_all(controller->control_socket, buf, length);
+        sc_trace_end("controller send", start);
+        if ((size_t) w != length) {
+            LOGD("Controller stopped (socket closed)");
+            break;
+        }
+
+        if (probe != SC_SEQUENCE_INVALID) {
+            assert(controller->input_latency);
+            sc_input_latency_on_sent(controller->input_latency, probe);
+        }
     }
 
     controller->cbs->on_ended(controller, error, controller->cbs_userdata);
@@ -4,8 +4,11 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "control_msg.h"
+#include "input_latency.h"
+#include "mux.h"
 #include "receiver.h"
 #include "util/acksync.h"
 #include "util/net.h"
@@ -14,14 +17,32 @@
 
 struct sc_control_msg_queue SC_VECDEQUE(struct sc_control_msg);
 
+// A big clipboard text, sent in chunks when no other message is pending
+struct sc_clipboard_transfer {
+    uint8_t *data; // owned, NULL if there is no transfer in progress
+    size_t size;
+    size_t offset; // of the next chunk
+    uint64_t sequence;
+    uint8_t flags; // SC_CLIPBOARD_CHUNK_FLAG_PASTE and _DEFLATE
+    // Number of bulk msgs queued before the transfer, to be sent first
+    size_t queued_before;
+};
+
 struct sc_controller {
     sc_socket control_socket;
+    struct sc_mux *mux; // if set, used instead of control_socket
     sc_thread thread;
     sc_mutex mutex;
     sc_cond msg_cond;
     bool stopped;
+    // Real-time input events, always sent first
     struct sc_control_msg_queue queue;
+    // Bigger and less latency-sensitive msgs (text, clipboard, UHID creation,
+    // app start), sent once the real-time queue is empty
+    struct sc_control_msg_queue bulk_queue;
+    struct sc_clipboard_transfer clipboard; // the last part of the bulk lane
     struct sc_receiver receiver;
+    struct sc_input_latency *input_latency; // may be NULL
 
     const struct sc_controller_callbacks *cbs;
     void *cbs_userdata;
@@ -40,7 +61,27 @@ sc_controller_init(struct sc_controller *controller, sc_socket control_socket,
 void
 sc_controller_configure(struct sc_controller *controller,
                         struct sc_acksync *acksync,
-                        struct sc_uhid_devices *uhid_devices);
+                        struct sc_uhid_devices *uhid_devices,
+                        struct sc_input_latency *input_latency);
+
+/**
+ * Set the acksync on which the acknowledgments of the probes pushed by
+ * sc_controller_push_input_probe() are reported
+ *
+ * It must be called before sc_controller_start().
+ */
+void
+sc_controller_set_probe_acksync(struct sc_controller *controller,
+                                struct sc_acksync *probe_acksync);
+
+/**
+ * Send and receive the control stream on the multiplexed socket (--multiplex)
+ * instead of the control socket
+ *
+ * It must be called before sc_controller_start().
+ */
+void
+sc_controller_set_mux(struct sc_controller *controller, struct sc_mux *mux);
 
 void
 sc_controller_destroy(struct sc_controller *controller);
@@ -58,4 +99,16 @@ bool
 sc_controller_push_msg(struct sc_controller *controller,
                        const struct sc_control_msg *msg);
 
+/**
+ * Push an input probe, acknowledged by the device once all the msgs pushed
+ * before it are injected
+ *
+ * The acknowledgment is reported to the acksync set by
+ * sc_controller_set_probe_acksync(), with the flag
+ * SC_INPUT_PROBE_SEQUENCE_EXTERNAL removed.
+ */
+bool
+sc_controller_push_input_probe(struct sc_controller *controller,
+                               uint64_t sequence);
+
 #endif
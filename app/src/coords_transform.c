@@ -0,0 +1,98 @@
+#include "coords_transform.h"
+
+#include <assert.h>
+
+#define SC_COORDS_TRANSFORM_ONE ((int64_t) 1 << SC_COORDS_TRANSFORM_SHIFT)
+// The coefficients are rounded, so the result may be very slightly below an
+// exact integer value, which would then be rounded down to the previous one.
+// Add a bias larger than the accumulated error (< 2^-10 pixel for
+// coordinates up to 2^15), but still negligible.
+#define SC_COORDS_TRANSFORM_BIAS (SC_COORDS_TRANSFORM_ONE >> 9)
+
+// Divide, rounding to nearest (den > 0)
+static int64_t
+div_round(int64_t num, int64_t den) {
+    assert(den > 0);
+    if (num >= 0) {
+        return (num + den / 2) / den;
+    }
+    return -((-num + den / 2) / den);
+}
+
+void
+sc_coords_transform_init(struct sc_coords_transform *transform,
+                         int32_t rect_x, int32_t rect_y, int32_t rect_w,
+                         int32_t rect_h, struct sc_size content_size,
+                         enum sc_orientation orientation) {
+    assert(rect_w > 0 && rect_h > 0);
+
+    int64_t w = content_size.width;
+    int64_t h = content_size.height;
+
+    // Position in the content (before orientation): u = su * x + cu, and
+    // v = sv * y + cv
+    int64_t su = div_round(w * SC_COORDS_TRANSFORM_ONE, rect_w);
+    int64_t sv = div_round(h * SC_COORDS_TRANSFORM_ONE, rect_h);
+    int64_t cu = div_round(-rect_x * w * SC_COORDS_TRANSFORM_ONE, rect_w);
+    int64_t cv = div_round(-rect_y * h * SC_COORDS_TRANSFORM_ONE, rect_h);
+
+    // Orientation: x' = ax * u + bx * v + cx, and y' = ay * u + by * v + cy
+    int ax, bx, ay, by;
+    int64_t cx, cy;
+    switch (orientation) {
+        case SC_ORIENTATION_0:
+            ax = 1; bx = 0; cx = 0;
+            ay = 0; by = 1; cy = 0;
+            break;
+        case SC_ORIENTATION_90:
+            ax = 0; bx = 1; cx = 0;
+            ay = -1; by = 0; cy = w;
+            break;
+        case SC_ORIENTATION_180:
+            ax = -1; bx = 0; cx = w;
+            ay = 0; by = -1; cy = h;
+            break;
+        case SC_ORIENTATION_270:
+            ax = 0; bx = -1; cx = h;
+            ay = 1; by = 0; cy = 0;
+            break;
+        case SC_ORIENTATION_FLIP_0:
+            ax = -1; bx = 0; cx = w;
+            ay = 0; by = 1; cy = 0;
+            break;
+        case SC_ORIENTATION_FLIP_90:
+            ax = 0; bx = -1; cx = h;
+            ay = -1; by = 0; cy = w;
+            break;
+        case SC_ORIENTATION_FLIP_180:
+            ax = 1; bx = 0; cx = 0;
+            ay = 0; by = -1; cy = h;
+            break;
+        default:
+            assert(orientation == SC_ORIENTATION_FLIP_270);
+            ax = 0; bx = 1; cx = 0;
+            ay = 1; by = 0; cy = 0;
+            break;
+    }
+
+    transform->mxx = ax * su;
+    transform->mxy = bx * sv;
+    transform->tx = ax * cu + bx * cv + cx * SC_COORDS_TRANSFORM_ONE
+                  + SC_COORDS_TRANSFORM_BIAS;
+    transform->myx = ay * su;
+    transform->myy = by * sv;
+    transform->ty = ay * cu + by * cv + cy * SC_COORDS_TRANSFORM_ONE
+                  + SC_COORDS_TRANSFORM_BIAS;
+}
+
+void
+sc_coords_transform_scale_input(struct sc_coords_transform *transform,
+                                struct sc_size from, struct sc_size to) {
+    assert(from.width && from.height);
+
+    // x is multiplied by to.width / from.width, y by to.height / from.height
+    transform->mxx = div_round(transform->mxx * to.width, from.width);
+    transform->myx = div_round(transform->myx * to.width, from.width);
+    transform->mxy = div_round(transform->mxy * to.height, from.height);
+    transform->myy = div_round(transform->myy * to.height, from.height);
+}
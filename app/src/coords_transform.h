@@ -0,0 +1,64 @@
+#ifndef SC_COORDS_TRANSFORM_H
+#define SC_COORDS_TRANSFORM_H
+
+#include "common.h"
+
+#include <stdint.h>
+
+#include "coords.h"
+#include "options.h"
+
+// Number of fractional bits of the transform coefficients
+#define SC_COORDS_TRANSFORM_SHIFT 24
+
+/**
+ * Affine transform from window (or drawable) coordinates to frame
+ * coordinates, in fixed point:
+ *
+ *     x' = (mxx * x + mxy * y + tx) >> SHIFT
+ *     y' = (myx * x + myy * y + ty) >> SHIFT
+ *
+ * It is computed once when the layout changes (like AffineMatrix on the
+ * server side), so that each input event costs one multiply-add per axis.
+ */
+struct sc_coords_transform {
+    int64_t mxx, mxy, tx;
+    int64_t myx, myy, ty;
+};
+
+/**
+ * Compute the transform from drawable coordinates to frame coordinates
+ *
+ * The content rectangle (`rect_x`, `rect_y`, `rect_w`, `rect_h`) is mapped to
+ * the frame, for the given content size (the oriented frame size) and display
+ * orientation.
+ */
+void
+sc_coords_transform_init(struct sc_coords_transform *transform,
+                         int32_t rect_x, int32_t rect_y, int32_t rect_w,
+                         int32_t rect_h, struct sc_size content_size,
+                         enum sc_orientation orientation);
+
+/**
+ * Make the transform accept coordinates in a space of size `from` instead of
+ * `to` (e.g. window coordinates instead of drawable coordinates on HiDPI
+ * screens)
+ */
+void
+sc_coords_transform_scale_input(struct sc_coords_transform *transform,
+                                struct sc_size from, struct sc_size to);
+
+static inline struct sc_point
+sc_coords_transform_apply(const struct sc_coords_transform *transform,
+                          int32_t x, int32_t y) {
+    // Arithmetic right shift: round towards negative infinity, so that a
+    // point just outside the content is not mapped to its border
+    return (struct sc_point) {
+        .x = (transform->mxx * x + transform->mxy * y + transform->tx)
+                >> SC_COORDS_TRANSFORM_SHIFT,
+        .y = (transform->myx * x + transform->myy * y + transform->ty)
+                >> SC_COORDS_TRANSFORM_SHIFT,
+    };
+}
+
+#endif
@@ -1,14 +1,238 @@
 #include "decoder.h"
 
+#include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <libavcodec/packet.h>
 #include <libavutil/avutil.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
 
+#include "stats.h"
 #include "util/log.h"
+#include "util/trace.h"
 
 /** Downcast packet_sink to decoder */
 #define DOWNCAST(SINK) container_of(SINK, struct sc_decoder, packet_sink)
 
+// Number of frames the sinks may be behind before non-reference frames are
+// not decoded anymore
+#define SC_DECODER_DISCARD_NONREF_BACKLOG 2
+// Number of frames the sinks may be behind before skipping to a new keyframe
+#define SC_DECODER_KEYFRAME_BACKLOG 30
+// Minimal delay between two keyframe requests (a request restarts the
+// device encoder)
+#define SC_DECODER_KEYFRAME_REQUEST_INTERVAL SC_TICK_FROM_SEC(1)
+// Delay between two keyframe requests with SC_DECODE_BUDGET_KEYFRAMES
+#define SC_DECODER_BUDGET_KEYFRAME_INTERVAL SC_TICK_FROM_SEC(1)
+// Delay before requesting a keyframe again after a decoding error, if it has
+// not been received (the request or the keyframe may have been lost)
+#define SC_DECODER_RECOVERY_KEYFRAME_INTERVAL SC_TICK_FROM_MS(500)
+
+#if defined(__APPLE__)
+# define SC_DECODER_HW_DEVICE_TYPE AV_HWDEVICE_TYPE_VIDEOTOOLBOX
+#elif defined(_WIN32)
+# define SC_DECODER_HW_DEVICE_TYPE AV_HWDEVICE_TYPE_D3D11VA
+#else
+# define SC_DECODER_HW_DEVICE_TYPE AV_HWDEVICE_TYPE_VAAPI
+#endif
+
+static enum AVPixelFormat
+sc_decoder_get_format(AVCodecContext *ctx, const enum AVPixelFormat *fmts) {
+    struct sc_decoder *decoder = ctx->opaque;
+
+    for (const enum AVPixelFormat *fmt = fmts; *fmt != AV_PIX_FMT_NONE;
+            ++fmt) {
+        if (*fmt == decoder->hw_pix_fmt) {
+            return *fmt;
+        }
+    }
+
+    // The hardware decoder does not support this stream, let FFmpeg decode
+    // it in software (the frames will be converted to YUV420P if necessary)
+    LOGW("Decoder '%s': hardware pixel format not offered, "
+         "falling back to software decoding", decoder->name);
+    for (const enum AVPixelFormat *fmt = fmts; *fmt != AV_PIX_FMT_NONE;
+            ++fmt) {
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(*fmt);
+        if (desc && !(desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+            return *fmt;
+        }
+    }
+
+    return AV_PIX_FMT_NONE;
+}
+
+// Create a codec context (not opened yet) with the parameters of `ctx`
+static AVCodecContext *
+sc_decoder_new_context(struct sc_decoder *decoder, const AVCodecContext *ctx) {
+    AVCodecParameters *par = avcodec_parameters_alloc();
+    if (!par) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    AVCodecContext *new_ctx = avcodec_alloc_context3(ctx->codec);
+    if (!new_ctx) {
+        LOG_OOM();
+        avcodec_parameters_free(&par);
+        return NULL;
+    }
+
+    int ret = avcodec_parameters_from_context(par, ctx);
+    if (ret >= 0) {
+        ret = avcodec_parameters_to_context(new_ctx, par);
+    }
+    avcodec_parameters_free(&par);
+    if (ret < 0) {
+        LOGW("Decoder '%s': could not copy codec parameters", decoder->name);
+        avcodec_free_context(&new_ctx);
+        return NULL;
+    }
+
+    new_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    return new_ctx;
+}
+
+static bool
+sc_decoder_open_hw(struct sc_decoder *decoder, const AVCodecContext *ctx) {
+    enum AVHWDeviceType type = SC_DECODER_HW_DEVICE_TYPE;
+    const char *type_name = av_hwdevice_get_type_name(type);
+
+    decoder->hw_pix_fmt = AV_PIX_FMT_NONE;
+    for (int i = 0;; ++i) {
+        const AVCodecHWConfig *config = avcodec_get_hw_config(ctx->codec, i);
+        if (!config) {
+            LOGW("Decoder '%s': %s not supported by %s", decoder->name,
+                 type_name, ctx->codec->name);
+            return false;
+        }
+        if ((config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX)
+                && config->device_type == type) {
+            decoder->hw_pix_fmt = config->pix_fmt;
+            break;
+        }
+    }
+
+    AVCodecContext *hw_ctx = sc_decoder_new_context(decoder, ctx);
+    if (!hw_ctx) {
+        return false;
+    }
+
+    hw_ctx->opaque = decoder;
+    hw_ctx->get_format = sc_decoder_get_format;
+
+    AVBufferRef **cache = decoder->hw_device_cache;
+    bool reused = cache && *cache;
+    if (reused) {
+        hw_ctx->hw_device_ctx = av_buffer_ref(*cache);
+        if (!hw_ctx->hw_device_ctx) {
+            LOG_OOM();
+            goto error_free_ctx;
+        }
+        LOGD("Decoder '%s': reusing %s device", decoder->name, type_name);
+    } else {
+        int ret = av_hwdevice_ctx_create(&hw_ctx->hw_device_ctx, type, NULL,
+                                         NULL, 0);
+        if (ret < 0) {
+            LOGW("Decoder '%s': could not create %s device: %d", decoder->name,
+                 type_name, ret);
+            goto error_free_ctx;
+        }
+        if (cache) {
+            // On allocation failure, the device is just not cached
+            *cache = av_buffer_ref(hw_ctx->hw_device_ctx);
+        }
+    }
+
+    if (avcodec_open2(hw_ctx, ctx->codec, NULL) < 0) {
+        LOGW("Decoder '%s': could not open %s decoder", decoder->name,
+             type_name);
+        if (reused) {
+            // The device may have been lost, create a new one next time
+            av_buffer_unref(cache);
+        }
+        goto error_free_ctx;
+    }
+
+    decoder->sw_frame = av_frame_alloc();
+    if (!decoder->sw_frame) {
+        LOG_OOM();
+        goto error_free_ctx;
+    }
+
+    decoder->yuv_frame = av_frame_alloc();
+    if (!decoder->yuv_frame) {
+        LOG_OOM();
+        goto error_free_sw_frame;
+    }
+
+    decoder->sws_ctx = NULL;
+    decoder->hw_ctx = hw_ctx;
+
+    LOGI("Decoder '%s': using %s hardware decoding", decoder->name,
+         type_name);
+    return true;
+
+error_free_sw_frame:
+    av_frame_free(&decoder->sw_frame);
+error_free_ctx:
+    // also unrefs hw_ctx->hw_device_ctx
+    avcodec_free_context(&hw_ctx);
+
+    return false;
+}
+
+static void
+sc_decoder_close_hw(struct sc_decoder *decoder) {
+    sws_freeContext(decoder->sws_ctx);
+    av_frame_free(&decoder->yuv_frame);
+    av_frame_free(&decoder->sw_frame);
+    avcodec_free_context(&decoder->hw_ctx);
+}
+
+static bool
+sc_decoder_open_threaded(struct sc_decoder *decoder,
+                         const AVCodecContext *ctx) {
+    int thread_type = 0;
+    if (ctx->codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) {
+        thread_type |= FF_THREAD_SLICE;
+    }
+    if (decoder->frame_threading
+            && ctx->codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) {
+        thread_type |= FF_THREAD_FRAME;
+    }
+    if (!thread_type) {
+        LOGD("Decoder '%s': %s does not support threading",
+             decoder->name, ctx->codec->name);
+        return false;
+    }
+
+    AVCodecContext *threaded_ctx = sc_decoder_new_context(decoder, ctx);
+    if (!threaded_ctx) {
+        return false;
+    }
+
+    // Slice threading only by default: frame threading adds one frame of
+    // latency per thread
+    threaded_ctx->thread_count = decoder->threads;
+    threaded_ctx->thread_type = thread_type;
+
+    if (avcodec_open2(threaded_ctx, ctx->codec, NULL) < 0) {
+        LOGW("Decoder '%s': could not open threaded decoder", decoder->name);
+        avcodec_free_context(&threaded_ctx);
+        return false;
+    }
+
+    LOGD("Decoder '%s': using %d %s threads", decoder->name,
+         threaded_ctx->thread_count,
+         threaded_ctx->active_thread_type & FF_THREAD_FRAME ? "frame"
+                                                            : "slice");
+    decoder->threaded_ctx = threaded_ctx;
+    return true;
+}
+
 static bool
 sc_decoder_open(struct sc_decoder *decoder, AVCodecContext *ctx) {
     decoder->frame = av_frame_alloc();
@@ -17,12 +241,49 @@ sc_decoder_open(struct sc_decoder *decoder, AVCodecContext *ctx) {
         return false;
     }
 
+    // The frame sinks are opened with the software codec context: the
+    // frames produced by the hardware decoder are transferred to system
+    // memory, and converted to YUV420P unless they are NV12 (which the frame
+    // sinks accept as is) before being pushed
     if (!sc_frame_source_sinks_open(&decoder->frame_source, ctx)) {
         av_frame_free(&decoder->frame);
         return false;
     }
 
     decoder->ctx = ctx;
+    decoder->hw_ctx = NULL;
+    decoder->threaded_ctx = NULL;
+    decoder->decoded_frames = 0;
+    decoder->decode_time_total = 0;
+    decoder->decode_time_max = 0;
+    decoder->discarding_nonref = false;
+    decoder->waiting_keyframe = false;
+    decoder->last_keyframe_request = 0;
+    decoder->recovering = false;
+    decoder->repeat_pushed = false;
+    for (unsigned i = 0; i < SC_DECODER_SKIPPED_REPEATS; ++i) {
+        decoder->skipped_repeats[i] = AV_NOPTS_VALUE;
+    }
+    decoder->skipped_repeats_head = 0;
+    // A new codec context decodes all frames
+    decoder->applied_budget = SC_DECODE_BUDGET_FULL;
+
+    if (decoder->hw && ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        if (sc_decoder_open_hw(decoder, ctx)) {
+            decoder->ctx = decoder->hw_ctx;
+        } else {
+            LOGW("Decoder '%s': falling back to software decoding",
+                 decoder->name);
+        }
+    }
+
+    if (!decoder->hw_ctx && decoder->threads != 1
+            && ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        if (sc_decoder_open_threaded(decoder, ctx)) {
+            decoder->ctx = decoder->threaded_ctx;
+        }
+        // otherwise, decode on a single thread with the shared context
+    }
 
     return true;
 }
@@ -30,18 +291,288 @@ sc_decoder_open(struct sc_decoder *decoder, AVCodecContext *ctx) {
 static void
 sc_decoder_close(struct sc_decoder *decoder) {
     sc_frame_source_sinks_close(&decoder->frame_source);
+    if (decoder->hw_ctx) {
+        sc_decoder_close_hw(decoder);
+    }
+    avcodec_free_context(&decoder->threaded_ctx);
     av_frame_free(&decoder->frame);
+
+    if (decoder->decoded_frames) {
+        sc_tick avg = decoder->decode_time_total
+                    / (sc_tick) decoder->decoded_frames;
+        LOGD("Decoder '%s': %" PRIu64 " frames, decode time avg %" PRItick
+             "us, max %" PRItick "us", decoder->name, decoder->decoded_frames,
+             SC_TICK_TO_US(avg), SC_TICK_TO_US(decoder->decode_time_max));
+    }
+}
+
+static sc_tick
+sc_decoder_record_decode_time(struct sc_decoder *decoder, sc_tick start) {
+    sc_tick duration = sc_tick_now() - start;
+    ++decoder->decoded_frames;
+    decoder->decode_time_total += duration;
+    if (duration > decoder->decode_time_max) {
+        decoder->decode_time_max = duration;
+    }
+    LOGV("Decoder '%s': frame decoded in %" PRItick "us", decoder->name,
+         SC_TICK_TO_US(duration));
+    return duration;
+}
+
+// Return a YUV420P or NV12 frame in system memory for the frame decoded by
+// the hardware decoder (possibly the frame itself)
+static AVFrame *
+sc_decoder_download_frame(struct sc_decoder *decoder, AVFrame *frame) {
+    AVFrame *src = frame;
+    if (frame->format == decoder->hw_pix_fmt) {
+        int ret = av_hwframe_transfer_data(decoder->sw_frame, frame, 0);
+        if (ret < 0) {
+            LOGE("Decoder '%s': could not transfer hardware frame: %d",
+                 decoder->name, ret);
+            return NULL;
+        }
+        av_frame_copy_props(decoder->sw_frame, frame);
+        src = decoder->sw_frame;
+    }
+
+    if (src->format == AV_PIX_FMT_YUV420P || src->format == AV_PIX_FMT_NV12) {
+        return src;
+    }
+
+    // Other formats (e.g. P010 for 10-bit streams) are converted
+    decoder->sws_ctx =
+        sws_getCachedContext(decoder->sws_ctx, src->width, src->height,
+                             src->format, src->width, src->height,
+                             AV_PIX_FMT_YUV420P, SWS_POINT, NULL, NULL, NULL);
+    if (!decoder->sws_ctx) {
+        LOGE("Decoder '%s': could not convert %s frame", decoder->name,
+             av_get_pix_fmt_name(src->format));
+        return NULL;
+    }
+
+    // The sinks may keep a reference on the previous frame, so allocate a
+    // new buffer for each frame
+    AVFrame *yuv = decoder->yuv_frame;
+    yuv->format = AV_PIX_FMT_YUV420P;
+    yuv->width = src->width;
+    yuv->height = src->height;
+    if (av_frame_get_buffer(yuv, 0) < 0) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    sws_scale(decoder->sws_ctx, (const uint8_t *const *) src->data,
+              src->linesize, 0, src->height, yuv->data, yuv->linesize);
+    av_frame_copy_props(yuv, src);
+
+    return yuv;
+}
+
+static bool
+sc_decoder_request_keyframe(struct sc_decoder *decoder, sc_tick interval) {
+    if (!decoder->cbs || !decoder->cbs->on_keyframe_needed) {
+        return false;
+    }
+
+    sc_tick now = sc_tick_now();
+    if (decoder->last_keyframe_request
+            && now - decoder->last_keyframe_request < interval) {
+        return false;
+    }
+
+    if (!decoder->cbs->on_keyframe_needed(decoder, decoder->cbs_userdata)) {
+        return false;
+    }
+
+    decoder->last_keyframe_request = now;
+    return true;
+}
+
+static void
+sc_decoder_update_backpressure(struct sc_decoder *decoder) {
+    unsigned backlog =
+        sc_frame_source_sinks_get_backlog(&decoder->frame_source);
+
+    bool discard = backlog >= SC_DECODER_DISCARD_NONREF_BACKLOG;
+    if (discard != decoder->discarding_nonref) {
+        LOGD("Decoder '%s': %s non-reference frames", decoder->name,
+             discard ? "discarding" : "decoding");
+        decoder->ctx->skip_frame = discard ? AVDISCARD_NONREF
+                                           : AVDISCARD_DEFAULT;
+        decoder->discarding_nonref = discard;
+    }
+
+    if (backlog < SC_DECODER_KEYFRAME_BACKLOG || !decoder->cbs
+            || !decoder->cbs->on_keyframe_needed) {
+        return;
+    }
+
+    assert(!decoder->waiting_keyframe);
+    if (sc_decoder_request_keyframe(decoder,
+                                    SC_DECODER_KEYFRAME_REQUEST_INTERVAL)) {
+        LOGW("Decoder '%s': frames are not consumed fast enough, "
+             "skipping to the next keyframe", decoder->name);
+        decoder->waiting_keyframe = true;
+    }
+}
+
+static const char *
+sc_decoder_get_budget_name(enum sc_decode_budget budget) {
+    switch (budget) {
+        case SC_DECODE_BUDGET_REDUCED:
+            return "reduced";
+        case SC_DECODE_BUDGET_KEYFRAMES:
+            return "keyframes";
+        case SC_DECODE_BUDGET_PAUSED:
+            return "paused";
+        default:
+            return "full";
+    }
+}
+
+static bool
+sc_decoder_is_keyframes_only(enum sc_decode_budget budget) {
+    return budget == SC_DECODE_BUDGET_KEYFRAMES
+        || budget == SC_DECODE_BUDGET_PAUSED;
+}
+
+static void
+sc_decoder_apply_budget(struct sc_decoder *decoder) {
+    enum sc_decode_budget budget =
+        atomic_load_explicit(&decoder->budget, memory_order_relaxed);
+    if (budget == decoder->applied_budget) {
+        return;
+    }
+
+    LOGD("Decoder '%s': %s decoding budget", decoder->name,
+         sc_decoder_get_budget_name(budget));
+
+    // The deblocking filter is the most expensive step after the motion
+    // compensation, and its absence is barely visible on a small window
+    decoder->ctx->skip_loop_filter = budget == SC_DECODE_BUDGET_FULL
+                                   ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+
+    if (sc_decoder_is_keyframes_only(decoder->applied_budget)
+            && !sc_decoder_is_keyframes_only(budget)) {
+        // The frames the next ones depend on have not been decoded
+        decoder->waiting_keyframe = true;
+        // Do not wait for the next periodic keyframe
+        decoder->last_keyframe_request = 0;
+        sc_decoder_request_keyframe(decoder, 0);
+    }
+
+    decoder->applied_budget = budget;
+}
+
+static void
+sc_decoder_recover(struct sc_decoder *decoder, const char *reason) {
+    assert(decoder->ctx->codec_type == AVMEDIA_TYPE_VIDEO);
+
+    LOGW("Decoder '%s': %s, waiting for a keyframe", decoder->name, reason);
+
+    // Drop the frames still buffered, they may reference the broken one
+    avcodec_flush_buffers(decoder->ctx);
+
+    // Do not display the corrupted frames until the next keyframe, and
+    // request it immediately rather than waiting for the next periodic one
+    decoder->waiting_keyframe = true;
+    decoder->recovering = true;
+    sc_decoder_request_keyframe(decoder, 0);
+}
+
+static bool
+sc_decoder_is_corrupt(const AVFrame *frame) {
+    // decode_error_flags is set when the error concealment was used (the
+    // missing parts of the frame are guessed from the previous frames)
+    return (frame->flags & AV_FRAME_FLAG_CORRUPT) || frame->decode_error_flags;
+}
+
+static void
+sc_decoder_handle_repeat(struct sc_decoder *decoder, const AVPacket *packet) {
+    if (!(packet->flags & SC_AV_PKT_FLAG_REPEAT)) {
+        decoder->repeat_pushed = false;
+        return;
+    }
+
+    if (!decoder->repeat_pushed) {
+        decoder->repeat_pushed = true;
+        return;
+    }
+
+    // If all the slots are used, the oldest one is overwritten (its frame is
+    // just pushed)
+    unsigned head = decoder->skipped_repeats_head;
+    decoder->skipped_repeats[head] = packet->pts;
+    decoder->skipped_repeats_head = (head + 1) % SC_DECODER_SKIPPED_REPEATS;
+}
+
+static bool
+sc_decoder_consume_skipped_repeat(struct sc_decoder *decoder, int64_t pts) {
+    if (pts == AV_NOPTS_VALUE) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < SC_DECODER_SKIPPED_REPEATS; ++i) {
+        if (decoder->skipped_repeats[i] == pts) {
+            decoder->skipped_repeats[i] = AV_NOPTS_VALUE;
+            return true;
+        }
+    }
+
+    return false;
 }
 
 static bool
 sc_decoder_push(struct sc_decoder *decoder, const AVPacket *packet) {
     bool is_config = packet->pts == AV_NOPTS_VALUE;
     if (is_config) {
-        // nothing to do
+        // nothing to do: the config data is attached to the next packet as
+        // side data, which the FFmpeg decoder handles
         return true;
     }
 
+    bool video = decoder->ctx->codec_type == AVMEDIA_TYPE_VIDEO;
+    if (video) {
+        sc_decoder_apply_budget(decoder);
+
+        if (decoder->applied_budget == SC_DECODE_BUDGET_KEYFRAMES
+                && !(packet->flags & AV_PKT_FLAG_KEY)) {
+            // Not dropped because of a failure, do not count it
+            sc_decoder_request_keyframe(decoder,
+                                        SC_DECODER_BUDGET_KEYFRAME_INTERVAL);
+            return true;
+        }
+
+        if (decoder->applied_budget == SC_DECODE_BUDGET_PAUSED
+                && !(packet->flags & AV_PKT_FLAG_KEY)) {
+            // Nothing is displayed, do not even request keyframes
+            return true;
+        }
+    }
+
+    if (decoder->waiting_keyframe) {
+        if (!(packet->flags & AV_PKT_FLAG_KEY)) {
+            // Do not spend CPU time to decode frames which would be dropped
+            sc_stats_add(SC_STAT_VIDEO_PACKETS_DROPPED, 1);
+            if (decoder->recovering) {
+                sc_decoder_request_keyframe(decoder,
+                                        SC_DECODER_RECOVERY_KEYFRAME_INTERVAL);
+            }
+            return true;
+        }
+        decoder->waiting_keyframe = false;
+        decoder->recovering = false;
+    }
+
+    sc_decoder_handle_repeat(decoder, packet);
+
+    sc_tick start = sc_tick_now();
+
     int ret = avcodec_send_packet(decoder->ctx, packet);
+    if (video && ret == AVERROR_INVALIDDATA) {
+        sc_decoder_recover(decoder, "invalid packet");
+        return true;
+    }
     if (ret < 0 && ret != AVERROR(EAGAIN)) {
         LOGE("Decoder '%s': could not send video packet: %d",
              decoder->name, ret);
@@ -54,15 +585,49 @@ sc_decoder_push(struct sc_decoder *decoder, const AVPacket *packet) {
             break;
         }
 
+        if (video && ret == AVERROR_INVALIDDATA) {
+            sc_decoder_recover(decoder, "could not decode frame");
+            return true;
+        }
         if (ret) {
             LOGE("Decoder '%s', could not receive video frame: %d",
                  decoder->name, ret);
             return false;
         }
 
+        if (video && sc_decoder_is_corrupt(decoder->frame)) {
+            av_frame_unref(decoder->frame);
+            sc_decoder_recover(decoder, "corrupted frame");
+            return true;
+        }
+
         // a frame was received
-        bool ok = sc_frame_source_sinks_push(&decoder->frame_source,
-                                             decoder->frame);
+        sc_tick duration = sc_decoder_record_decode_time(decoder, start);
+        if (video) {
+            sc_stats_add(SC_STAT_FRAMES_DECODED, 1);
+            sc_stats_add(SC_STAT_DECODE_TIME_US, SC_TICK_TO_US(duration));
+        }
+
+        if (sc_decoder_consume_skipped_repeat(decoder, decoder->frame->pts)) {
+            // Same picture as the one already presented, do not upload it,
+            // just report it
+            sc_frame_source_sinks_push_repeat(&decoder->frame_source,
+                                              decoder->frame->pts);
+            av_frame_unref(decoder->frame);
+            continue;
+        }
+
+        AVFrame *frame = decoder->frame;
+        if (decoder->hw_ctx) {
+            frame = sc_decoder_download_frame(decoder, frame);
+        }
+
+        bool ok = frame
+               && sc_frame_source_sinks_push(&decoder->frame_source, frame);
+        if (decoder->hw_ctx) {
+            av_frame_unref(decoder->yuv_frame);
+            av_frame_unref(decoder->sw_frame);
+        }
         av_frame_unref(decoder->frame);
         if (!ok) {
             // Error already logged
@@ -70,6 +635,10 @@ sc_decoder_push(struct sc_decoder *decoder, const AVPacket *packet) {
         }
     }
 
+    if (video) {
+        sc_decoder_update_backpressure(decoder);
+    }
+
     return true;
 }
 
@@ -89,12 +658,28 @@ static bool
 sc_decoder_packet_sink_push(struct sc_packet_sink *sink,
                             const AVPacket *packet) {
     struct sc_decoder *decoder = DOWNCAST(sink);
-    return sc_decoder_push(decoder, packet);
+
+    sc_tick start = sc_trace_begin();
+    bool ok = sc_decoder_push(decoder, packet);
+    sc_trace_end("decode", start);
+
+    return ok;
 }
 
 void
-sc_decoder_init(struct sc_decoder *decoder, const char *name) {
+sc_decoder_init(struct sc_decoder *decoder, const char *name, bool hw,
+                unsigned threads, const struct sc_decoder_callbacks *cbs,
+                void *cbs_userdata) {
     decoder->name = name; // statically allocated
+    decoder->hw = hw;
+    decoder->hw_ctx = NULL;
+    decoder->hw_device_cache = NULL;
+    decoder->threads = threads;
+    decoder->frame_threading = false;
+    decoder->threaded_ctx = NULL;
+    decoder->cbs = cbs;
+    decoder->cbs_userdata = cbs_userdata;
+    atomic_init(&decoder->budget, SC_DECODE_BUDGET_FULL);
     sc_frame_source_init(&decoder->frame_source);
 
     static const struct sc_packet_sink_ops ops = {
@@ -105,3 +690,55 @@ sc_decoder_init(struct sc_decoder *decoder, const char *name) {
 
     decoder->packet_sink.ops = &ops;
 }
+
+void
+sc_decoder_set_hw_device_cache(struct sc_decoder *decoder,
+                               AVBufferRef **cache) {
+    assert(decoder->hw);
+    decoder->hw_device_cache = cache;
+}
+
+void
+sc_decoder_set_frame_threading(struct sc_decoder *decoder) {
+    decoder->frame_threading = true;
+}
+
+void
+sc_decoder_set_budget(struct sc_decoder *decoder,
+                      enum sc_decode_budget budget) {
+    assert(budget != SC_DECODE_BUDGET_AUTO);
+    atomic_store_explicit(&decoder->budget, budget, memory_order_relaxed);
+}
+
+bool
+sc_decoder_probe_hw(enum AVCodecID codec_id) {
+    const AVCodec *codec = avcodec_find_decoder(codec_id);
+    if (!codec) {
+        return false;
+    }
+
+    enum AVHWDeviceType type = SC_DECODER_HW_DEVICE_TYPE;
+    for (int i = 0;; ++i) {
+        const AVCodecHWConfig *config = avcodec_get_hw_config(codec, i);
+        if (!config) {
+            LOGD("Hardware decoding probe: %s not supported by %s",
+                 av_hwdevice_get_type_name(type), codec->name);
+            return false;
+        }
+        if ((config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX)
+                && config->device_type == type) {
+            break;
+        }
+    }
+
+    AVBufferRef *device = NULL;
+    int ret = av_hwdevice_ctx_create(&device, type, NULL, NULL, 0);
+    if (ret < 0) {
+        LOGD("Hardware decoding probe: could not create %s device: %d",
+             av_hwdevice_get_type_name(type), ret);
+        return false;
+    }
+
+    av_buffer_unref(&device);
+    return true;
+}
@@ -3,10 +3,19 @@
 
 #include "common.h"
 
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <libavcodec/avcodec.h>
 
+#include "options.h"
 #include "trait/frame_source.h"
 #include "trait/packet_sink.h"
+#include "util/tick.h"
+
+// Repeated frames being decoded, not to be pushed to the frame sinks (a
+// hardware decoder may output the frames a few packets later)
+#define SC_DECODER_SKIPPED_REPEATS 4
 
 struct sc_decoder {
     struct sc_packet_sink packet_sink; // packet sink trait
@@ -16,10 +25,114 @@ struct sc_decoder {
 
     AVCodecContext *ctx;
     AVFrame *frame;
+
+    // Hardware decoding (requested by the user, may be unavailable)
+    bool hw;
+    // Private codec context using a hardware device, NULL if decoding is
+    // performed in software
+    AVCodecContext *hw_ctx;
+    // Hardware device shared with the previous and next decoders (may be
+    // NULL, see sc_decoder_set_hw_device_cache())
+    AVBufferRef **hw_device_cache;
+    enum AVPixelFormat hw_pix_fmt;
+    AVFrame *sw_frame; // hardware frame transferred to system memory
+    AVFrame *yuv_frame; // frame converted to YUV420P for the frame sinks
+    struct SwsContext *sws_ctx;
+
+    // Number of slice threads for software decoding (0 for auto)
+    unsigned threads;
+    // Also decode several frames in parallel (see
+    // sc_decoder_set_frame_threading())
+    bool frame_threading;
+    // Private codec context configured for slice threading, NULL if the
+    // shared (single-threaded) codec context is used
+    AVCodecContext *threaded_ctx;
+
+    // Decoding time statistics (packet sent to frame received)
+    uint64_t decoded_frames;
+    sc_tick decode_time_total;
+    sc_tick decode_time_max;
+
+    // Backpressure from the frame sinks (see sc_frame_sink_ops.get_backlog)
+    bool discarding_nonref; // non-reference frames are not decoded
+    bool waiting_keyframe; // packets are dropped until the next keyframe
+    sc_tick last_keyframe_request; // 0 if none
+    // A decoding error occurred, the next frames would be corrupted until the
+    // next keyframe (requested again while it is not received)
+    bool recovering;
+
+    // The frames repeated by the device encoder while the screen does not
+    // change (SC_AV_PKT_FLAG_REPEAT) are still decoded (the next frames may
+    // reference them), but only the first one of a sequence, which refines
+    // the quality of the static picture, is pushed to the frame sinks
+    bool repeat_pushed;
+    int64_t skipped_repeats[SC_DECODER_SKIPPED_REPEATS]; // AV_NOPTS_VALUE if
+                                                         // unused
+    unsigned skipped_repeats_head;
+
+    // Decoding budget requested by sc_decoder_set_budget() (an enum
+    // sc_decode_budget), applied by the decoder on the next packet
+    atomic_int budget;
+    enum sc_decode_budget applied_budget;
+
+    const struct sc_decoder_callbacks *cbs;
+    void *cbs_userdata;
+};
+
+struct sc_decoder_callbacks {
+    // Called when the frame sinks stay behind, to request a new keyframe from
+    // the device. Return true if a keyframe has been requested.
+    bool (*on_keyframe_needed)(struct sc_decoder *decoder, void *userdata);
 };
 
 // The name must be statically allocated (e.g. a string literal)
+//
+// If hw is true, the decoder attempts to use a hardware decoder, and falls
+// back to software decoding if it is not available.
+//
+// The software decoder uses `threads` slice threads (0 for auto, 1 to
+// disable threading). Frame threading is not used by default, since it delays
+// each frame by one frame per thread.
+//
+// The callbacks are optional (cbs may be NULL).
+void
+sc_decoder_init(struct sc_decoder *decoder, const char *name, bool hw,
+                unsigned threads, const struct sc_decoder_callbacks *cbs,
+                void *cbs_userdata);
+
+// Reuse the hardware device stored in *cache (typically across reconnections),
+// rather than creating a new one on each open
+//
+// If *cache is NULL, the device created on open is stored in it. The caller
+// must unref *cache once no decoder uses it anymore. It must be called before
+// the decoder is opened.
+void
+sc_decoder_set_hw_device_cache(struct sc_decoder *decoder,
+                               AVBufferRef **cache);
+
+// Use frame threading in addition to slice threading, to decode more frames
+// per second at the cost of latency (--throughput)
+//
+// It must be called before the decoder is opened.
+void
+sc_decoder_set_frame_threading(struct sc_decoder *decoder);
+
+// Reduce the video decoding cost (for example while the window is not focused)
+//
+// It may be called from any thread, the budget is applied on the next packet.
+// With SC_DECODE_BUDGET_KEYFRAMES, a keyframe is requested every second
+// through the on_keyframe_needed callback (if any).
 void
-sc_decoder_init(struct sc_decoder *decoder, const char *name);
+sc_decoder_set_budget(struct sc_decoder *decoder,
+                      enum sc_decode_budget budget);
+
+// Return whether the codec may be decoded by the platform hardware decoder
+//
+// The codec must be supported by the FFmpeg hardware acceleration, and the
+// hardware device must be available. The actual hardware may still not
+// support the stream profile, in which case the decoder falls back to
+// software decoding.
+bool
+sc_decoder_probe_hw(enum AVCodecID codec_id);
 
 #endif
@@ -4,32 +4,68 @@
 #include <stdlib.h>
 #include <libavcodec/avcodec.h>
 
+#include "stats.h"
 #include "util/log.h"
 
 /** Downcast frame_sink to sc_delay_buffer */
 #define DOWNCAST(SINK) container_of(SINK, struct sc_delay_buffer, frame_sink)
+/** Downcast packet_sink to sc_delay_buffer */
+#define DOWNCAST_PACKET(SINK) \
+    container_of(SINK, struct sc_delay_buffer, packet_sink)
 
 static bool
-sc_delayed_frame_init(struct sc_delayed_frame *dframe, const AVFrame *frame) {
-    dframe->frame = av_frame_alloc();
-    if (!dframe->frame) {
-        LOG_OOM();
-        return false;
+sc_delayed_frame_init(struct sc_delay_buffer *db,
+                      struct sc_delayed_frame *dframe, const AVFrame *frame,
+                      const AVPacket *packet) {
+    if (frame) {
+        dframe->frame = sc_frame_pool_ref(&db->frame_pool, frame);
+        dframe->packet = NULL;
+        return dframe->frame;
     }
 
-    if (av_frame_ref(dframe->frame, frame)) {
-        LOG_OOM();
-        av_frame_free(&dframe->frame);
-        return false;
+    dframe->frame = NULL;
+    dframe->packet = sc_packet_pool_ref(&db->packet_pool, packet);
+    return dframe->packet;
+}
+
+static size_t
+sc_delayed_frame_size(const struct sc_delayed_frame *dframe) {
+    if (dframe->packet) {
+        return dframe->packet->size;
     }
 
-    return true;
+    // For hardware frames, only the reference to the surface is counted
+    size_t size = 0;
+    for (unsigned i = 0; i < AV_NUM_DATA_POINTERS && dframe->frame->buf[i];
+            ++i) {
+        size += dframe->frame->buf[i]->size;
+    }
+    return size;
+}
+
+static inline bool
+sc_delay_buffer_is_over_budget(struct sc_delay_buffer *db) {
+    return db->max_bytes && db->queue_bytes > db->max_bytes;
 }
 
 static void
-sc_delayed_frame_destroy(struct sc_delayed_frame *dframe) {
-    av_frame_unref(dframe->frame);
-    av_frame_free(&dframe->frame);
+sc_delayed_frame_destroy(struct sc_delay_buffer *db,
+                         struct sc_delayed_frame *dframe) {
+    if (dframe->frame) {
+        sc_frame_pool_put(&db->frame_pool, dframe->frame);
+    } else {
+        sc_packet_pool_put(&db->packet_pool, dframe->packet);
+    }
+}
+
+static bool
+sc_delay_buffer_sinks_push(struct sc_delay_buffer *db, const AVFrame *frame,
+                           const AVPacket *packet) {
+    if (frame) {
+        return sc_frame_source_sinks_push(&db->frame_source, frame);
+    }
+
+    return sc_packet_source_sinks_push(&db->packet_source, packet);
 }
 
 static int
@@ -51,15 +87,32 @@ run_buffering(void *data) {
         }
 
         struct sc_delayed_frame dframe = sc_vecdeque_pop(&db->queue);
+        size_t dframe_size = sc_delayed_frame_size(&dframe);
+        db->queue_bytes -= dframe_size;
+        sc_stats_add_gauge(SC_STAT_DELAY_BUFFER_BYTES, -(int32_t) dframe_size);
+
+        int64_t raw_pts = dframe.frame ? dframe.frame->pts
+                                       : dframe.packet->pts;
 
         sc_tick max_deadline = sc_tick_now() + db->delay;
         // PTS (written by the server) are expressed in microseconds
-        sc_tick pts = SC_TICK_FROM_US(dframe.frame->pts);
+        sc_tick pts = SC_TICK_FROM_US(raw_pts);
+
+        // Config packets have no PTS, they are only kept in order
+        bool timed_out = raw_pts == AV_NOPTS_VALUE;
+        // Over the memory budget, release the frame immediately
+        while (!db->stopped && !timed_out
+                && !sc_delay_buffer_is_over_budget(db)) {
+            sc_tick deadline;
+            if (!db->av_sync) {
+                deadline = sc_clock_to_system_time(&db->clock, pts)
+                         + db->delay;
+            } else if (!sc_av_sync_to_system_time(db->av_sync, pts,
+                                                  &deadline)) {
+                // No audio clock, do not delay
+                break;
+            }
 
-        bool timed_out = false;
-        while (!db->stopped && !timed_out) {
-            sc_tick deadline = sc_clock_to_system_time(&db->clock, pts)
-                             + db->delay;
             if (deadline > max_deadline) {
                 deadline = max_deadline;
             }
@@ -72,7 +125,7 @@ run_buffering(void *data) {
         sc_mutex_unlock(&db->mutex);
 
         if (stopped) {
-            sc_delayed_frame_destroy(&dframe);
+            sc_delayed_frame_destroy(db, &dframe);
             goto stopped;
         }
 
@@ -81,8 +134,8 @@ run_buffering(void *data) {
              pts, dframe.push_date, sc_tick_now());
 #endif
 
-        bool ok = sc_frame_source_sinks_push(&db->frame_source, dframe.frame);
-        sc_delayed_frame_destroy(&dframe);
+        bool ok = sc_delay_buffer_sinks_push(db, dframe.frame, dframe.packet);
+        sc_delayed_frame_destroy(db, &dframe);
         if (!ok) {
             LOGE("Delayed frame could not be pushed, stopping");
             sc_mutex_lock(&db->mutex);
@@ -99,8 +152,10 @@ stopped:
     // Flush queue
     while (!sc_vecdeque_is_empty(&db->queue)) {
         struct sc_delayed_frame *dframe = sc_vecdeque_popref(&db->queue);
-        sc_delayed_frame_destroy(dframe);
+        sc_delayed_frame_destroy(db, dframe);
     }
+    sc_stats_add_gauge(SC_STAT_DELAY_BUFFER_BYTES, -(int32_t) db->queue_bytes);
+    db->queue_bytes = 0;
 
     LOGD("Buffering thread ended");
 
@@ -108,21 +163,62 @@ stopped:
 }
 
 static bool
-sc_delay_buffer_frame_sink_open(struct sc_frame_sink *sink,
-                                const AVCodecContext *ctx) {
-    struct sc_delay_buffer *db = DOWNCAST(sink);
-    (void) ctx;
+sc_delay_buffer_pool_init(struct sc_delay_buffer *db) {
+    if (db->packets) {
+        return sc_packet_pool_init(&db->packet_pool);
+    }
+
+    return sc_frame_pool_init(&db->frame_pool);
+}
+
+static void
+sc_delay_buffer_pool_destroy(struct sc_delay_buffer *db) {
+    if (db->packets) {
+        sc_packet_pool_destroy(&db->packet_pool);
+    } else {
+        sc_frame_pool_destroy(&db->frame_pool);
+    }
+}
+
+static bool
+sc_delay_buffer_sinks_open(struct sc_delay_buffer *db,
+                           const AVCodecContext *frame_ctx,
+                           AVCodecContext *packet_ctx) {
+    if (db->packets) {
+        return sc_packet_source_sinks_open(&db->packet_source, packet_ctx);
+    }
+
+    return sc_frame_source_sinks_open(&db->frame_source, frame_ctx);
+}
+
+static void
+sc_delay_buffer_sinks_close(struct sc_delay_buffer *db) {
+    if (db->packets) {
+        sc_packet_source_sinks_close(&db->packet_source);
+    } else {
+        sc_frame_source_sinks_close(&db->frame_source);
+    }
+}
 
+static bool
+sc_delay_buffer_open(struct sc_delay_buffer *db,
+                     const AVCodecContext *frame_ctx,
+                     AVCodecContext *packet_ctx) {
     bool ok = sc_mutex_init(&db->mutex);
     if (!ok) {
         return false;
     }
 
-    ok = sc_cond_init(&db->queue_cond);
+    ok = sc_delay_buffer_pool_init(db);
     if (!ok) {
         goto error_destroy_mutex;
     }
 
+    ok = sc_cond_init(&db->queue_cond);
+    if (!ok) {
+        goto error_destroy_pool;
+    }
+
     ok = sc_cond_init(&db->wait_cond);
     if (!ok) {
         goto error_destroy_queue_cond;
@@ -130,9 +226,11 @@ sc_delay_buffer_frame_sink_open(struct sc_frame_sink *sink,
 
     sc_clock_init(&db->clock);
     sc_vecdeque_init(&db->queue);
+    db->queue_bytes = 0;
+    db->over_budget_logged = false;
     db->stopped = false;
 
-    if (!sc_frame_source_sinks_open(&db->frame_source, ctx)) {
+    if (!sc_delay_buffer_sinks_open(db, frame_ctx, packet_ctx)) {
         goto error_destroy_wait_cond;
     }
 
@@ -145,11 +243,13 @@ sc_delay_buffer_frame_sink_open(struct sc_frame_sink *sink,
     return true;
 
 error_close_sinks:
-    sc_frame_source_sinks_close(&db->frame_source);
+    sc_delay_buffer_sinks_close(db);
 error_destroy_wait_cond:
     sc_cond_destroy(&db->wait_cond);
 error_destroy_queue_cond:
     sc_cond_destroy(&db->queue_cond);
+error_destroy_pool:
+    sc_delay_buffer_pool_destroy(db);
 error_destroy_mutex:
     sc_mutex_destroy(&db->mutex);
 
@@ -157,9 +257,7 @@ error_destroy_mutex:
 }
 
 static void
-sc_delay_buffer_frame_sink_close(struct sc_frame_sink *sink) {
-    struct sc_delay_buffer *db = DOWNCAST(sink);
-
+sc_delay_buffer_close(struct sc_delay_buffer *db) {
     sc_mutex_lock(&db->mutex);
     db->stopped = true;
     sc_cond_signal(&db->queue_cond);
@@ -168,17 +266,19 @@ sc_delay_buffer_frame_sink_close(struct sc_frame_sink *sink) {
 
     sc_thread_join(&db->thread, NULL);
 
-    sc_frame_source_sinks_close(&db->frame_source);
+    sc_delay_buffer_sinks_close(db);
 
     sc_cond_destroy(&db->wait_cond);
     sc_cond_destroy(&db->queue_cond);
+    sc_delay_buffer_pool_destroy(db);
     sc_mutex_destroy(&db->mutex);
 }
 
+// Exactly one of frame and packet must be set
 static bool
-sc_delay_buffer_frame_sink_push(struct sc_frame_sink *sink,
-                                const AVFrame *frame) {
-    struct sc_delay_buffer *db = DOWNCAST(sink);
+sc_delay_buffer_push(struct sc_delay_buffer *db, const AVFrame *frame,
+                     const AVPacket *packet) {
+    assert(!frame != !packet);
 
     sc_mutex_lock(&db->mutex);
 
@@ -187,17 +287,27 @@ sc_delay_buffer_frame_sink_push(struct sc_frame_sink *sink,
         return false;
     }
 
-    sc_tick pts = SC_TICK_FROM_US(frame->pts);
-    sc_clock_update(&db->clock, sc_tick_now(), pts);
-    sc_cond_signal(&db->wait_cond);
+    int64_t raw_pts = frame ? frame->pts : packet->pts;
+
+    bool push_now;
+    if (raw_pts == AV_NOPTS_VALUE) {
+        // Config packet: it must not be delayed, only kept in order
+        push_now = sc_vecdeque_is_empty(&db->queue);
+    } else {
+        sc_tick pts = SC_TICK_FROM_US(raw_pts);
+        sc_clock_update(&db->clock, sc_tick_now(), pts);
+        sc_cond_signal(&db->wait_cond);
+
+        push_now = db->first_frame_asap && db->clock.range == 1;
+    }
 
-    if (db->first_frame_asap && db->clock.range == 1) {
+    if (push_now) {
         sc_mutex_unlock(&db->mutex);
-        return sc_frame_source_sinks_push(&db->frame_source, frame);
+        return sc_delay_buffer_sinks_push(db, frame, packet);
     }
 
     struct sc_delayed_frame dframe;
-    bool ok = sc_delayed_frame_init(&dframe, frame);
+    bool ok = sc_delayed_frame_init(db, &dframe, frame, packet);
     if (!ok) {
         sc_mutex_unlock(&db->mutex);
         return false;
@@ -209,11 +319,25 @@ sc_delay_buffer_frame_sink_push(struct sc_frame_sink *sink,
 
     ok = sc_vecdeque_push(&db->queue, dframe);
     if (!ok) {
+        sc_delayed_frame_destroy(db, &dframe);
         sc_mutex_unlock(&db->mutex);
         LOG_OOM();
         return false;
     }
 
+    size_t dframe_size = sc_delayed_frame_size(&dframe);
+    db->queue_bytes += dframe_size;
+    sc_stats_add_gauge(SC_STAT_DELAY_BUFFER_BYTES, dframe_size);
+
+    if (sc_delay_buffer_is_over_budget(db)) {
+        if (!db->over_budget_logged) {
+            LOGW("Delay buffer over the memory budget, reducing the delay");
+            db->over_budget_logged = true;
+        }
+        // Wake up the buffering thread to release the oldest frame now
+        sc_cond_signal(&db->wait_cond);
+    }
+
     sc_cond_signal(&db->queue_cond);
 
     sc_mutex_unlock(&db->mutex);
@@ -221,6 +345,54 @@ sc_delay_buffer_frame_sink_push(struct sc_frame_sink *sink,
     return true;
 }
 
+static bool
+sc_delay_buffer_frame_sink_open(struct sc_frame_sink *sink,
+                                const AVCodecContext *ctx) {
+    struct sc_delay_buffer *db = DOWNCAST(sink);
+    db->packets = false;
+    return sc_delay_buffer_open(db, ctx, NULL);
+}
+
+static void
+sc_delay_buffer_frame_sink_close(struct sc_frame_sink *sink) {
+    struct sc_delay_buffer *db = DOWNCAST(sink);
+    sc_delay_buffer_close(db);
+}
+
+static bool
+sc_delay_buffer_frame_sink_push(struct sc_frame_sink *sink,
+                                const AVFrame *frame) {
+    struct sc_delay_buffer *db = DOWNCAST(sink);
+    return sc_delay_buffer_push(db, frame, NULL);
+}
+
+static bool
+sc_delay_buffer_packet_sink_open(struct sc_packet_sink *sink,
+                                 AVCodecContext *ctx) {
+    struct sc_delay_buffer *db = DOWNCAST_PACKET(sink);
+    db->packets = true;
+    return sc_delay_buffer_open(db, NULL, ctx);
+}
+
+static void
+sc_delay_buffer_packet_sink_close(struct sc_packet_sink *sink) {
+    struct sc_delay_buffer *db = DOWNCAST_PACKET(sink);
+    sc_delay_buffer_close(db);
+}
+
+static bool
+sc_delay_buffer_packet_sink_push(struct sc_packet_sink *sink,
+                                 const AVPacket *packet) {
+    struct sc_delay_buffer *db = DOWNCAST_PACKET(sink);
+    return sc_delay_buffer_push(db, NULL, packet);
+}
+
+static void
+sc_delay_buffer_packet_sink_disable(struct sc_packet_sink *sink) {
+    struct sc_delay_buffer *db = DOWNCAST_PACKET(sink);
+    sc_packet_source_sinks_disable(&db->packet_source);
+}
+
 void
 sc_delay_buffer_init(struct sc_delay_buffer *db, sc_tick delay,
                      bool first_frame_asap) {
@@ -228,14 +400,37 @@ sc_delay_buffer_init(struct sc_delay_buffer *db, sc_tick delay,
 
     db->delay = delay;
     db->first_frame_asap = first_frame_asap;
+    db->packets = false;
+    db->max_bytes = 0;
+    db->av_sync = NULL;
 
     sc_frame_source_init(&db->frame_source);
+    sc_packet_source_init(&db->packet_source);
 
-    static const struct sc_frame_sink_ops ops = {
+    static const struct sc_frame_sink_ops frame_ops = {
         .open = sc_delay_buffer_frame_sink_open,
         .close = sc_delay_buffer_frame_sink_close,
         .push = sc_delay_buffer_frame_sink_push,
     };
 
-    db->frame_sink.ops = &ops;
+    static const struct sc_packet_sink_ops packet_ops = {
+        .open = sc_delay_buffer_packet_sink_open,
+        .close = sc_delay_buffer_packet_sink_close,
+        .push = sc_delay_buffer_packet_sink_push,
+        .disable = sc_delay_buffer_packet_sink_disable,
+    };
+
+    db->frame_sink.ops = &frame_ops;
+    db->packet_sink.ops = &packet_ops;
+}
+
+void
+sc_delay_buffer_set_max_bytes(struct sc_delay_buffer *db, size_t max_bytes) {
+    db->max_bytes = max_bytes;
+}
+
+void
+sc_delay_buffer_set_av_sync(struct sc_delay_buffer *db,
+                            struct sc_av_sync *av_sync) {
+    db->av_sync = av_sync;
 }
@@ -4,11 +4,16 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <libavcodec/avcodec.h>
 #include <libavutil/frame.h>
 
+#include "av_pool.h"
+#include "av_sync.h"
 #include "clock.h"
 #include "trait/frame_source.h"
 #include "trait/frame_sink.h"
+#include "trait/packet_source.h"
+#include "trait/packet_sink.h"
 #include "util/thread.h"
 #include "util/tick.h"
 #include "util/vecdeque.h"
@@ -17,9 +22,12 @@
 
 // forward declarations
 typedef struct AVFrame AVFrame;
+typedef struct AVPacket AVPacket;
 
 struct sc_delayed_frame {
+    // Exactly one of them is set, depending on the delay buffer domain
     AVFrame *frame;
+    AVPacket *packet;
 #ifdef SC_BUFFERING_DEBUG
     sc_tick push_date;
 #endif
@@ -27,12 +35,30 @@ struct sc_delayed_frame {
 
 struct sc_delayed_frame_queue SC_VECDEQUE(struct sc_delayed_frame);
 
+/**
+ * A delay buffer delays either the decoded frames (it is then inserted after
+ * the decoder, as a frame sink and source) or the encoded packets (it is then
+ * inserted before the decoder, as a packet sink and source).
+ *
+ * Delaying the packets requires much less memory (a 1s buffer at 4K60 holds
+ * a few MB of packets instead of hundreds of MB of frames), but the delay
+ * then applies to all the frame sinks of the decoder.
+ */
 struct sc_delay_buffer {
     struct sc_frame_source frame_source; // frame source trait
     struct sc_frame_sink frame_sink; // frame sink trait
 
+    struct sc_packet_source packet_source; // packet source trait
+    struct sc_packet_sink packet_sink; // packet sink trait
+
     sc_tick delay;
     bool first_frame_asap;
+    bool packets; // true if the delay buffer is used as a packet sink
+    // Memory budget of the queue (0 for unlimited)
+    size_t max_bytes;
+    // If set, the frames are released when the audio having the same PTS is
+    // played (the delay is then the maximum delay), NULL otherwise
+    struct sc_av_sync *av_sync;
 
     sc_thread thread;
     sc_mutex mutex;
@@ -41,6 +67,10 @@ struct sc_delay_buffer {
 
     struct sc_clock clock;
     struct sc_delayed_frame_queue queue;
+    struct sc_frame_pool frame_pool;
+    struct sc_packet_pool packet_pool;
+    size_t queue_bytes;
+    bool over_budget_logged;
     bool stopped;
 };
 
@@ -52,6 +82,8 @@ struct sc_delay_buffer_callbacks {
 /**
  * Initialize a delay buffer.
  *
+ * Either its frame sink or its packet sink may be used, not both.
+ *
  * \param delay a (strictly) positive delay
  * \param first_frame_asap if true, do not delay the first frame (useful for
                            a video stream).
@@ -60,4 +92,27 @@ void
 sc_delay_buffer_init(struct sc_delay_buffer *db, sc_tick delay,
                      bool first_frame_asap);
 
+/**
+ * Limit the memory held by the delayed frames
+ *
+ * Over the budget, the oldest frames are released before their deadline (the
+ * delay is temporarily reduced, no frame is dropped). Must be called before
+ * the delay buffer is opened.
+ *
+ * \param max_bytes the budget, or 0 for unlimited (the default)
+ */
+void
+sc_delay_buffer_set_max_bytes(struct sc_delay_buffer *db, size_t max_bytes);
+
+/**
+ * Release the frames according to the audio clock (--av-sync)
+ *
+ * The delay passed to sc_delay_buffer_init() becomes the maximum delay. While
+ * the audio clock is not available, the frames are not delayed. Must be called
+ * before the delay buffer is opened.
+ */
+void
+sc_delay_buffer_set_av_sync(struct sc_delay_buffer *db,
+                            struct sc_av_sync *av_sync);
+
 #endif
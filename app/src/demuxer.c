@@ -2,19 +2,178 @@
 
 #include <assert.h>
 #include <inttypes.h>
+#include <string.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/channel_layout.h>
 
+#include "av_pool.h"
 #include "packet_merger.h"
+#include "stats.h"
 #include "util/binary.h"
 #include "util/log.h"
+#include "util/trace.h"
+#include "util/vecdeque.h"
 
 #define SC_PACKET_HEADER_SIZE 12
 
 #define SC_PACKET_FLAG_CONFIG    (UINT64_C(1) << 63)
 #define SC_PACKET_FLAG_KEY_FRAME (UINT64_C(1) << 62)
+#define SC_PACKET_FLAG_REPEAT    (UINT64_C(1) << 61)
+
+#define SC_PACKET_PTS_MASK (SC_PACKET_FLAG_REPEAT - 1)
+
+// The stream is received by chunks of this size (larger packets are received
+// into their own buffer)
+#define SC_DEMUXER_CHUNK_SIZE (1 << 20)
+
+// Size of the packets received but not pushed to the sinks yet, over which the
+// reception waits for the sinks
+#define SC_DEMUXER_MAX_QUEUE_BYTES ((size_t) 64 * 1024 * 1024)
+
+/**
+ * Receive buffer
+ *
+ * The stream is read by large chunks, and the packets reference their data in
+ * place (the chunks are refcounted and come from a pool), so that receiving a
+ * packet typically requires neither allocation nor copy, and several packets
+ * may be received by a single syscall.
+ *
+ * The last AV_INPUT_BUFFER_PADDING_SIZE bytes of each chunk are never
+ * written (they remain zero), so that the data of any packet is always
+ * followed by at least AV_INPUT_BUFFER_PADDING_SIZE readable bytes.
+ */
+struct sc_demuxer_buffer {
+    AVBufferPool *pool;
+    AVBufferRef *chunk; // NULL until the first packet
+    size_t head; // start of the data not consumed yet
+    size_t tail; // end of the data received
+};
 
-#define SC_PACKET_PTS_MASK (SC_PACKET_FLAG_KEY_FRAME - 1)
+static bool
+sc_demuxer_buffer_init(struct sc_demuxer_buffer *buf) {
+    buf->pool = av_buffer_pool_init(SC_DEMUXER_CHUNK_SIZE
+                                        + AV_INPUT_BUFFER_PADDING_SIZE,
+                                    av_buffer_allocz);
+    if (!buf->pool) {
+        LOG_OOM();
+        return false;
+    }
+
+    buf->chunk = NULL;
+    buf->head = 0;
+    buf->tail = 0;
+    return true;
+}
+
+static void
+sc_demuxer_buffer_destroy(struct sc_demuxer_buffer *buf) {
+    av_buffer_unref(&buf->chunk);
+    // The pool is actually freed once all its buffers are released
+    av_buffer_pool_uninit(&buf->pool);
+}
+
+// Make sure that size bytes from head fit in the current chunk
+static bool
+sc_demuxer_buffer_reserve(struct sc_demuxer_buffer *buf, size_t size) {
+    assert(size <= SC_DEMUXER_CHUNK_SIZE);
+
+    if (buf->chunk && buf->head + size <= SC_DEMUXER_CHUNK_SIZE) {
+        return true;
+    }
+
+    size_t pending = buf->tail - buf->head;
+    if (buf->chunk && av_buffer_is_writable(buf->chunk)) {
+        // No packet references the chunk anymore, reuse it
+        memmove(buf->chunk->data, buf->chunk->data + buf->head, pending);
+    } else {
+        AVBufferRef *chunk = av_buffer_pool_get(buf->pool);
+        if (!chunk) {
+            LOG_OOM();
+            return false;
+        }
+
+        if (buf->chunk) {
+            // The packets still referencing the previous chunk keep it alive
+            memcpy(chunk->data, buf->chunk->data + buf->head, pending);
+            av_buffer_unref(&buf->chunk);
+        }
+        buf->chunk = chunk;
+    }
+
+    buf->head = 0;
+    buf->tail = pending;
+    return true;
+}
+
+static void
+sc_demuxer_dump(struct sc_demuxer *demuxer, const void *data, size_t len) {
+    if (fwrite(data, 1, len, demuxer->dump_file) != len) {
+        LOGW("Demuxer '%s': could not write the stream dump, dump stopped",
+             demuxer->name);
+        demuxer->dump_file = NULL;
+    }
+}
+
+// Receive up to len bytes (like net_recv())
+static ssize_t
+sc_demuxer_recv(struct sc_demuxer *demuxer, void *data, size_t len) {
+    ssize_t r;
+    if (demuxer->replay_file) {
+        size_t n = fread(data, 1, len, demuxer->replay_file);
+        if (!n && ferror(demuxer->replay_file)) {
+            LOGE("Demuxer '%s': could not read the replayed file",
+                 demuxer->name);
+            return -1;
+        }
+        r = n;
+    } else if (demuxer->mux) {
+        r = sc_mux_recv(demuxer->mux, demuxer->mux_stream, data, len);
+    } else {
+        r = net_recv(demuxer->socket, data, len);
+    }
+
+    if (r > 0 && demuxer->dump_file) {
+        sc_demuxer_dump(demuxer, data, r);
+    }
+
+    return r;
+}
+
+// Receive exactly len bytes
+static bool
+sc_demuxer_recv_all(struct sc_demuxer *demuxer, void *data, size_t len) {
+    uint8_t *p = data;
+    while (len) {
+        ssize_t r = sc_demuxer_recv(demuxer, p, len);
+        if (r <= 0) {
+            return false;
+        }
+        p += r;
+        len -= r;
+    }
+
+    return true;
+}
+
+// Receive until at least size bytes are available from head
+static bool
+sc_demuxer_buffer_fill(struct sc_demuxer *demuxer,
+                       struct sc_demuxer_buffer *buf, size_t size) {
+    if (!sc_demuxer_buffer_reserve(buf, size)) {
+        return false;
+    }
+
+    while (buf->tail - buf->head < size) {
+        ssize_t r = sc_demuxer_recv(demuxer, buf->chunk->data + buf->tail,
+                                    SC_DEMUXER_CHUNK_SIZE - buf->tail);
+        if (r <= 0) {
+            return false;
+        }
+        buf->tail += r;
+    }
+
+    return true;
+}
 
 static enum AVCodecID
 sc_demuxer_to_avcodec_id(uint32_t codec_id) {
@@ -54,8 +213,7 @@ sc_demuxer_to_avcodec_id(uint32_t codec_id) {
 static bool
 sc_demuxer_recv_codec_id(struct sc_demuxer *demuxer, uint32_t *codec_id) {
     uint8_t data[4];
-    ssize_t r = net_recv_all(demuxer->socket, data, 4);
-    if (r < 4) {
+    if (!sc_demuxer_recv_all(demuxer, data, 4)) {
         return false;
     }
 
@@ -67,8 +225,7 @@ static bool
 sc_demuxer_recv_video_size(struct sc_demuxer *demuxer, uint32_t *width,
                            uint32_t *height) {
     uint8_t data[8];
-    ssize_t r = net_recv_all(demuxer->socket, data, 8);
-    if (r < 8) {
+    if (!sc_demuxer_recv_all(demuxer, data, 8)) {
         return false;
     }
 
@@ -78,7 +235,8 @@ sc_demuxer_recv_video_size(struct sc_demuxer *demuxer, uint32_t *width,
 }
 
 static bool
-sc_demuxer_recv_packet(struct sc_demuxer *demuxer, AVPacket *packet) {
+sc_demuxer_recv_packet(struct sc_demuxer *demuxer,
+                       struct sc_demuxer_buffer *buf, AVPacket *packet) {
     // The video and audio streams contain a sequence of raw packets (as
     // provided by MediaCodec), each prefixed with a "meta" header.
     //
@@ -99,25 +257,48 @@ sc_demuxer_recv_packet(struct sc_demuxer *demuxer, AVPacket *packet) {
     // | `- key frame
     //  `-- config packet
 
-    uint8_t header[SC_PACKET_HEADER_SIZE];
-    ssize_t r = net_recv_all(demuxer->socket, header, SC_PACKET_HEADER_SIZE);
-    if (r < SC_PACKET_HEADER_SIZE) {
+    if (!sc_demuxer_buffer_fill(demuxer, buf, SC_PACKET_HEADER_SIZE)) {
         return false;
     }
 
+    const uint8_t *header = buf->chunk->data + buf->head;
     uint64_t pts_flags = sc_read64be(header);
     uint32_t len = sc_read32be(&header[8]);
     assert(len);
+    buf->head += SC_PACKET_HEADER_SIZE;
 
-    if (av_new_packet(packet, len)) {
-        LOG_OOM();
-        return false;
-    }
+    if (len <= SC_DEMUXER_CHUNK_SIZE) {
+        if (!sc_demuxer_buffer_fill(demuxer, buf, len)) {
+            return false;
+        }
 
-    r = net_recv_all(demuxer->socket, packet->data, len);
-    if (r < 0 || ((uint32_t) r) < len) {
-        av_packet_unref(packet);
-        return false;
+        // Reference the data in place
+        packet->buf = av_buffer_ref(buf->chunk);
+        if (!packet->buf) {
+            LOG_OOM();
+            return false;
+        }
+        packet->data = buf->chunk->data + buf->head;
+        packet->size = len;
+        buf->head += len;
+    } else {
+        // Too large for a chunk, receive into a dedicated buffer
+        if (av_new_packet(packet, len)) {
+            LOG_OOM();
+            return false;
+        }
+
+        size_t available = MIN(buf->tail - buf->head, len);
+        memcpy(packet->data, buf->chunk->data + buf->head, available);
+        buf->head += available;
+
+        size_t remaining = len - available;
+        if (remaining && !sc_demuxer_recv_all(demuxer,
+                                              packet->data + available,
+                                              remaining)) {
+            av_packet_unref(packet);
+            return false;
+        }
     }
 
     if (pts_flags & SC_PACKET_FLAG_CONFIG) {
@@ -129,17 +310,300 @@ sc_demuxer_recv_packet(struct sc_demuxer *demuxer, AVPacket *packet) {
     if (pts_flags & SC_PACKET_FLAG_KEY_FRAME) {
         packet->flags |= AV_PKT_FLAG_KEY;
     }
+    if (pts_flags & SC_PACKET_FLAG_REPEAT) {
+        packet->flags |= SC_AV_PKT_FLAG_REPEAT;
+    }
 
     packet->dts = packet->pts;
     return true;
 }
 
+static bool
+sc_demuxer_recv_udp_packet(struct sc_demuxer *demuxer, AVPacket *packet,
+                           bool *lost) {
+    struct sc_udp_video *udp = demuxer->udp;
+
+    for (;;) {
+        if (!sc_udp_video_recv(udp, lost)) {
+            return false;
+        }
+
+        // Same format as over TCP (see sc_demuxer_recv_packet())
+        uint64_t pts_flags = sc_read64be(udp->data);
+        uint32_t len = sc_read32be(&udp->data[8]);
+        if (udp->size != SC_PACKET_HEADER_SIZE + len || !len) {
+            LOGW("Demuxer '%s': invalid UDP packet", demuxer->name);
+            // Consider it lost
+            udp->lost = true;
+            continue;
+        }
+
+        if (av_new_packet(packet, len)) {
+            LOG_OOM();
+            return false;
+        }
+
+        memcpy(packet->data, udp->data + SC_PACKET_HEADER_SIZE, len);
+
+        if (pts_flags & SC_PACKET_FLAG_CONFIG) {
+            packet->pts = AV_NOPTS_VALUE;
+        } else {
+            packet->pts = pts_flags & SC_PACKET_PTS_MASK;
+        }
+
+        if (pts_flags & SC_PACKET_FLAG_KEY_FRAME) {
+            packet->flags |= AV_PKT_FLAG_KEY;
+        }
+        if (pts_flags & SC_PACKET_FLAG_REPEAT) {
+            packet->flags |= SC_AV_PKT_FLAG_REPEAT;
+        }
+
+        packet->dts = packet->pts;
+        return true;
+    }
+}
+
+// Wait until the packet must be pushed (for a realtime replay)
+//
+// Return false if the replay is stopped.
+static bool
+sc_demuxer_replay_wait(struct sc_demuxer *demuxer, int64_t pts) {
+    sc_tick deadline = 0;
+    if (demuxer->replay_realtime && pts != AV_NOPTS_VALUE) {
+        sc_tick now = sc_tick_now();
+        sc_tick pts_tick = SC_TICK_FROM_US(pts);
+        deadline = demuxer->replay_origin + pts_tick;
+        if (!demuxer->replay_origin || deadline > now + SC_TICK_FROM_SEC(1)) {
+            // First packet, or discontinuity in the PTS (e.g. the encoder has
+            // been restarted): resynchronize
+            demuxer->replay_origin = now - pts_tick;
+            deadline = now;
+        }
+    }
+
+    sc_mutex_lock(&demuxer->mutex);
+    bool timed_out = false;
+    while (!demuxer->stopped && !timed_out && deadline > sc_tick_now()) {
+        timed_out = !sc_cond_timedwait(&demuxer->cond, &demuxer->mutex,
+                                       deadline);
+    }
+    bool stopped = demuxer->stopped;
+    sc_mutex_unlock(&demuxer->mutex);
+
+    return !stopped;
+}
+
+/**
+ * Dispatcher
+ *
+ * The packets are received by the demuxer thread and pushed to the sinks
+ * (which may be slow, e.g. the decoder or the recorder) by a separate
+ * thread, so that the socket is always drained as fast as possible (a full
+ * socket buffer would make the device encoder back up).
+ */
+struct sc_demuxer_dispatcher {
+    struct sc_demuxer *demuxer;
+    bool must_merge_config_packet;
+    struct sc_packet_merger merger; // only accessed from the dispatch thread
+
+    struct sc_packet_pool pool;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    struct SC_VECDEQUE(AVPacket *) queue;
+    size_t queue_bytes;
+    bool eos; // no more packets will be queued
+    bool failed; // a sink failed, the packets are not dispatched anymore
+};
+
+static int
+run_dispatcher(void *data) {
+    struct sc_demuxer_dispatcher *dispatcher = data;
+    struct sc_demuxer *demuxer = dispatcher->demuxer;
+
+    for (;;) {
+        sc_mutex_lock(&dispatcher->mutex);
+        while (!dispatcher->eos && sc_vecdeque_is_empty(&dispatcher->queue)) {
+            sc_cond_wait(&dispatcher->cond, &dispatcher->mutex);
+        }
+
+        if (sc_vecdeque_is_empty(&dispatcher->queue)) {
+            assert(dispatcher->eos);
+            sc_mutex_unlock(&dispatcher->mutex);
+            break;
+        }
+
+        AVPacket *packet = sc_vecdeque_pop(&dispatcher->queue);
+        assert(dispatcher->queue_bytes >= (size_t) packet->size);
+        dispatcher->queue_bytes -= packet->size;
+        // There is room for the receiver
+        sc_cond_signal(&dispatcher->cond);
+        sc_mutex_unlock(&dispatcher->mutex);
+
+        bool ok = true;
+        if (dispatcher->must_merge_config_packet) {
+            // Prepend any config packet to the next media packet
+            ok = sc_packet_merger_merge(&dispatcher->merger, packet);
+        }
+
+        if (ok) {
+            sc_tick start = sc_trace_begin();
+            ok = sc_packet_source_sinks_push(&demuxer->packet_source, packet);
+            sc_trace_end("demuxer push", start);
+            // On error, the sink already logged its concrete error
+        }
+
+        sc_packet_pool_put(&dispatcher->pool, packet);
+
+        if (!ok) {
+            sc_mutex_lock(&dispatcher->mutex);
+            dispatcher->failed = true;
+            sc_cond_signal(&dispatcher->cond);
+            sc_mutex_unlock(&dispatcher->mutex);
+
+            // Report the error immediately, the demuxer thread may be blocked
+            // on the socket until the client stops
+            demuxer->cbs->on_ended(demuxer, SC_DEMUXER_STATUS_ERROR,
+                                   demuxer->cbs_userdata);
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static bool
+sc_demuxer_dispatcher_start(struct sc_demuxer_dispatcher *dispatcher,
+                            struct sc_demuxer *demuxer,
+                            bool must_merge_config_packet) {
+    dispatcher->demuxer = demuxer;
+    dispatcher->must_merge_config_packet = must_merge_config_packet;
+    dispatcher->queue_bytes = 0;
+    dispatcher->eos = false;
+    dispatcher->failed = false;
+    sc_vecdeque_init(&dispatcher->queue);
+
+    if (!sc_packet_pool_init(&dispatcher->pool)) {
+        return false;
+    }
+
+    if (!sc_mutex_init(&dispatcher->mutex)) {
+        goto error_destroy_pool;
+    }
+
+    if (!sc_cond_init(&dispatcher->cond)) {
+        goto error_destroy_mutex;
+    }
+
+    if (must_merge_config_packet) {
+        sc_packet_merger_init(&dispatcher->merger);
+    }
+
+    bool ok = sc_thread_create(&dispatcher->thread, run_dispatcher,
+                               "scrcpy-dispatch", dispatcher);
+    if (!ok) {
+        LOGE("Demuxer '%s': could not start dispatcher thread",
+             demuxer->name);
+        goto error_destroy_merger;
+    }
+
+    return true;
+
+error_destroy_merger:
+    if (must_merge_config_packet) {
+        sc_packet_merger_destroy(&dispatcher->merger);
+    }
+    sc_cond_destroy(&dispatcher->cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&dispatcher->mutex);
+error_destroy_pool:
+    sc_packet_pool_destroy(&dispatcher->pool);
+
+    return false;
+}
+
+// Signal the end of stream, wait for the queued packets to be dispatched, then
+// release the dispatcher
+//
+// Return false if a sink failed.
+static bool
+sc_demuxer_dispatcher_finish(struct sc_demuxer_dispatcher *dispatcher) {
+    sc_mutex_lock(&dispatcher->mutex);
+    dispatcher->eos = true;
+    sc_cond_signal(&dispatcher->cond);
+    sc_mutex_unlock(&dispatcher->mutex);
+
+    sc_thread_join(&dispatcher->thread, NULL);
+
+    // Packets not dispatched due to a sink failure
+    while (!sc_vecdeque_is_empty(&dispatcher->queue)) {
+        AVPacket *packet = sc_vecdeque_pop(&dispatcher->queue);
+        sc_packet_pool_put(&dispatcher->pool, packet);
+    }
+    sc_vecdeque_destroy(&dispatcher->queue);
+
+    if (dispatcher->must_merge_config_packet) {
+        sc_packet_merger_destroy(&dispatcher->merger);
+    }
+    sc_cond_destroy(&dispatcher->cond);
+    sc_mutex_destroy(&dispatcher->mutex);
+    sc_packet_pool_destroy(&dispatcher->pool);
+
+    return !dispatcher->failed;
+}
+
+// Queue a packet to be pushed to the sinks (the dispatcher takes ownership)
+//
+// Return false if a sink failed.
+static bool
+sc_demuxer_dispatcher_push(struct sc_demuxer_dispatcher *dispatcher,
+                           AVPacket *packet) {
+    sc_mutex_lock(&dispatcher->mutex);
+    // Wait for the sinks only if they are very late, to bound the memory
+    while (!dispatcher->failed
+            && dispatcher->queue_bytes >= SC_DEMUXER_MAX_QUEUE_BYTES) {
+        sc_cond_wait(&dispatcher->cond, &dispatcher->mutex);
+    }
+
+    if (dispatcher->failed) {
+        sc_mutex_unlock(&dispatcher->mutex);
+        sc_packet_pool_put(&dispatcher->pool, packet);
+        return false;
+    }
+
+    bool ok = sc_vecdeque_push(&dispatcher->queue, packet);
+    if (!ok) {
+        sc_mutex_unlock(&dispatcher->mutex);
+        LOG_OOM();
+        sc_packet_pool_put(&dispatcher->pool, packet);
+        return false;
+    }
+
+    dispatcher->queue_bytes += packet->size;
+    sc_cond_signal(&dispatcher->cond);
+    sc_mutex_unlock(&dispatcher->mutex);
+
+    return true;
+}
+
 static int
 run_demuxer(void *data) {
     struct sc_demuxer *demuxer = data;
 
     // Flag to report end-of-stream (i.e. device disconnected)
     enum sc_demuxer_status status = SC_DEMUXER_STATUS_ERROR;
+    // Whether on_ended() has already been called (by the dispatcher)
+    bool reported = false;
+
+    // The packets are decoded on this thread, on the critical path
+    bool raised = sc_thread_set_priority(SC_THREAD_PRIORITY_HIGH);
+    (void) raised; // We don't care if it worked
+
+    if (demuxer->udp && !sc_udp_video_handshake(demuxer->udp)) {
+        LOGE("Demuxer '%s': could not connect over UDP", demuxer->name);
+        goto end;
+    }
 
     uint32_t raw_codec_id;
     bool ok = sc_demuxer_recv_codec_id(demuxer, &raw_codec_id);
@@ -228,56 +692,94 @@ run_demuxer(void *data) {
     bool must_merge_config_packet = raw_codec_id == SC_CODEC_ID_H264
                                  || raw_codec_id == SC_CODEC_ID_H265;
 
-    struct sc_packet_merger merger;
+    bool video = codec->type == AVMEDIA_TYPE_VIDEO;
 
-    if (must_merge_config_packet) {
-        sc_packet_merger_init(&merger);
+    struct sc_demuxer_dispatcher dispatcher;
+    if (!sc_demuxer_dispatcher_start(&dispatcher, demuxer,
+                                     must_merge_config_packet)) {
+        goto finally_close_sinks;
     }
 
-    AVPacket *packet = av_packet_alloc();
-    if (!packet) {
-        LOG_OOM();
-        goto finally_close_sinks;
+    struct sc_demuxer_buffer buf;
+    if (!sc_demuxer_buffer_init(&buf)) {
+        goto finally_finish_dispatcher;
     }
 
+    // Over UDP, after a loss, drop the packets until the next keyframe
+    bool waiting_keyframe = false;
+
     for (;;) {
-        bool ok = sc_demuxer_recv_packet(demuxer, packet);
+        AVPacket *packet = sc_packet_pool_get(&dispatcher.pool);
+        if (!packet) {
+            break;
+        }
+
+        bool lost = false;
+        bool ok = demuxer->udp
+                ? sc_demuxer_recv_udp_packet(demuxer, packet, &lost)
+                : sc_demuxer_recv_packet(demuxer, &buf, packet);
         if (!ok) {
+            sc_packet_pool_put(&dispatcher.pool, packet);
             // end of stream
             status = SC_DEMUXER_STATUS_EOS;
             break;
         }
 
-        if (must_merge_config_packet) {
-            // Prepend any config packet to the next media packet
-            ok = sc_packet_merger_merge(&merger, packet);
-            if (!ok) {
-                av_packet_unref(packet);
-                break;
+        if (lost) {
+            LOGD("Demuxer '%s': packets lost, waiting for a keyframe",
+                 demuxer->name);
+            waiting_keyframe = true;
+            if (demuxer->cbs->on_packets_lost) {
+                demuxer->cbs->on_packets_lost(demuxer, demuxer->cbs_userdata);
             }
         }
 
-        ok = sc_packet_source_sinks_push(&demuxer->packet_source, packet);
-        av_packet_unref(packet);
-        if (!ok) {
-            // The sink already logged its concrete error
+        if (waiting_keyframe) {
+            bool config = packet->pts == AV_NOPTS_VALUE;
+            if (!config && !(packet->flags & AV_PKT_FLAG_KEY)) {
+                sc_packet_pool_put(&dispatcher.pool, packet);
+                continue;
+            }
+            if (!config) {
+                waiting_keyframe = false;
+            }
+        }
+
+        if (demuxer->replay_file
+                && !sc_demuxer_replay_wait(demuxer, packet->pts)) {
+            sc_packet_pool_put(&dispatcher.pool, packet);
+            status = SC_DEMUXER_STATUS_EOS;
+            break;
+        }
+
+        if (video) {
+            sc_stats_add(SC_STAT_VIDEO_PACKETS, 1);
+            sc_stats_add(SC_STAT_VIDEO_BYTES, packet->size);
+        } else {
+            sc_stats_add(SC_STAT_AUDIO_BYTES, packet->size);
+        }
+
+        if (!sc_demuxer_dispatcher_push(&dispatcher, packet)) {
             break;
         }
     }
 
     LOGD("Demuxer '%s': end of frames", demuxer->name);
 
-    if (must_merge_config_packet) {
-        sc_packet_merger_destroy(&merger);
+    sc_demuxer_buffer_destroy(&buf);
+finally_finish_dispatcher:
+    if (!sc_demuxer_dispatcher_finish(&dispatcher)) {
+        // The error has already been reported by the dispatcher
+        reported = true;
     }
-
-    av_packet_free(&packet);
 finally_close_sinks:
     sc_packet_source_sinks_close(&demuxer->packet_source);
 finally_free_context:
     avcodec_free_context(&codec_ctx);
 end:
-    demuxer->cbs->on_ended(demuxer, status, demuxer->cbs_userdata);
+    if (!reported) {
+        demuxer->cbs->on_ended(demuxer, status, demuxer->cbs_userdata);
+    }
 
     return 0;
 }
@@ -295,6 +797,82 @@ sc_demuxer_init(struct sc_demuxer *demuxer, const char *name, sc_socket socket,
 
     demuxer->cbs = cbs;
     demuxer->cbs_userdata = cbs_userdata;
+
+    demuxer->replay_file = NULL;
+    demuxer->dump_file = NULL;
+    demuxer->udp = NULL;
+    demuxer->mux = NULL;
+}
+
+void
+sc_demuxer_init_mux(struct sc_demuxer *demuxer, const char *name,
+                    struct sc_mux *mux, enum sc_mux_stream stream,
+                    const struct sc_demuxer_callbacks *cbs,
+                    void *cbs_userdata) {
+    assert(mux);
+
+    demuxer->name = name; // statically allocated
+    demuxer->socket = SC_SOCKET_NONE;
+    sc_packet_source_init(&demuxer->packet_source);
+
+    assert(cbs && cbs->on_ended);
+
+    demuxer->cbs = cbs;
+    demuxer->cbs_userdata = cbs_userdata;
+
+    demuxer->replay_file = NULL;
+    demuxer->dump_file = NULL;
+    demuxer->udp = NULL;
+    demuxer->mux = mux;
+    demuxer->mux_stream = stream;
+}
+
+bool
+sc_demuxer_init_replay(struct sc_demuxer *demuxer, const char *name,
+                       FILE *file, bool realtime,
+                       const struct sc_demuxer_callbacks *cbs,
+                       void *cbs_userdata) {
+    assert(file);
+
+    if (!sc_mutex_init(&demuxer->mutex)) {
+        return false;
+    }
+
+    if (!sc_cond_init(&demuxer->cond)) {
+        sc_mutex_destroy(&demuxer->mutex);
+        return false;
+    }
+
+    demuxer->name = name; // statically allocated
+    demuxer->socket = SC_SOCKET_NONE;
+    sc_packet_source_init(&demuxer->packet_source);
+
+    assert(cbs && cbs->on_ended);
+
+    demuxer->cbs = cbs;
+    demuxer->cbs_userdata = cbs_userdata;
+
+    demuxer->replay_file = file;
+    demuxer->replay_realtime = realtime;
+    demuxer->replay_origin = 0;
+    demuxer->stopped = false;
+    demuxer->dump_file = NULL;
+    demuxer->udp = NULL;
+    demuxer->mux = NULL;
+
+    return true;
+}
+
+void
+sc_demuxer_set_dump_file(struct sc_demuxer *demuxer, FILE *file) {
+    assert(!demuxer->replay_file);
+    demuxer->dump_file = file;
+}
+
+void
+sc_demuxer_set_udp(struct sc_demuxer *demuxer, struct sc_udp_video *udp) {
+    assert(!demuxer->replay_file);
+    demuxer->udp = udp;
 }
 
 bool
@@ -310,7 +888,27 @@ sc_demuxer_start(struct sc_demuxer *demuxer) {
     return true;
 }
 
+void
+sc_demuxer_stop(struct sc_demuxer *demuxer) {
+    if (!demuxer->replay_file) {
+        return;
+    }
+
+    sc_mutex_lock(&demuxer->mutex);
+    demuxer->stopped = true;
+    sc_cond_signal(&demuxer->cond);
+    sc_mutex_unlock(&demuxer->mutex);
+}
+
 void
 sc_demuxer_join(struct sc_demuxer *demuxer) {
     sc_thread_join(&demuxer->thread, NULL);
 }
+
+void
+sc_demuxer_destroy(struct sc_demuxer *demuxer) {
+    if (demuxer->replay_file) {
+        sc_cond_destroy(&demuxer->cond);
+        sc_mutex_destroy(&demuxer->mutex);
+    }
+}
@@ -4,19 +4,45 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stdio.h>
 
+#include "mux.h"
 #include "trait/packet_source.h"
+#include "udp_video.h"
 #include "util/net.h"
 #include "util/thread.h"
+#include "util/tick.h"
 
 struct sc_demuxer {
     struct sc_packet_source packet_source; // packet source trait
 
     const char *name; // must be statically allocated (e.g. a string literal)
 
-    sc_socket socket;
+    sc_socket socket; // SC_SOCKET_NONE when replaying a file
     sc_thread thread;
 
+    // Stream dumped by --dump-stream to replay (--replay) instead of reading
+    // the socket, NULL otherwise (owned by the caller)
+    FILE *replay_file;
+    bool replay_realtime; // throttle the packets according to their PTS
+    sc_tick replay_origin; // tick corresponding to PTS 0 (0 if not set yet)
+    sc_mutex mutex; // only initialized for a replay
+    sc_cond cond;
+    bool stopped;
+
+    // Copy of the received stream (--dump-stream), NULL if none (owned by the
+    // caller)
+    FILE *dump_file;
+
+    // If set, the packets are received over UDP (--video-udp-port), only the
+    // stream header is read from the socket (owned by the caller)
+    struct sc_udp_video *udp;
+
+    // If set, the stream is received on the multiplexed socket (--multiplex)
+    // instead of its own socket (owned by the caller)
+    struct sc_mux *mux;
+    enum sc_mux_stream mux_stream;
+
     const struct sc_demuxer_callbacks *cbs;
     void *cbs_userdata;
 };
@@ -30,6 +56,12 @@ enum sc_demuxer_status {
 struct sc_demuxer_callbacks {
     void (*on_ended)(struct sc_demuxer *demuxer, enum sc_demuxer_status,
                      void *userdata);
+
+    // Called when packets received over UDP have been lost (optional)
+    //
+    // The following packets are dropped until the next keyframe, so a new
+    // keyframe should be requested.
+    void (*on_packets_lost)(struct sc_demuxer *demuxer, void *userdata);
 };
 
 // The name must be statically allocated (e.g. a string literal)
@@ -37,10 +69,48 @@ void
 sc_demuxer_init(struct sc_demuxer *demuxer, const char *name, sc_socket socket,
                 const struct sc_demuxer_callbacks *cbs, void *cbs_userdata);
 
+// Read the stream `stream` from the multiplexed socket (--multiplex)
+//
+// The name must be statically allocated (e.g. a string literal)
+void
+sc_demuxer_init_mux(struct sc_demuxer *demuxer, const char *name,
+                    struct sc_mux *mux, enum sc_mux_stream stream,
+                    const struct sc_demuxer_callbacks *cbs, void *cbs_userdata);
+
+// Read the stream from a file written by --dump-stream instead of a socket
+//
+// If realtime is true, the packets are pushed according to their PTS,
+// otherwise as fast as possible.
+//
+// The name must be statically allocated (e.g. a string literal)
+bool
+sc_demuxer_init_replay(struct sc_demuxer *demuxer, const char *name,
+                       FILE *file, bool realtime,
+                       const struct sc_demuxer_callbacks *cbs,
+                       void *cbs_userdata);
+
+// Write a raw copy of everything read from the socket to `file` (it must be
+// called before sc_demuxer_start())
+void
+sc_demuxer_set_dump_file(struct sc_demuxer *demuxer, FILE *file);
+
+// Receive the packets over UDP (it must be called before sc_demuxer_start())
+void
+sc_demuxer_set_udp(struct sc_demuxer *demuxer, struct sc_udp_video *udp);
+
 bool
 sc_demuxer_start(struct sc_demuxer *demuxer);
 
+// Interrupt a replay (a socket demuxer is interrupted by its socket)
+void
+sc_demuxer_stop(struct sc_demuxer *demuxer);
+
 void
 sc_demuxer_join(struct sc_demuxer *demuxer);
 
+// Release the resources of a demuxer initialized by sc_demuxer_init_replay()
+// (nothing to do for a socket demuxer)
+void
+sc_demuxer_destroy(struct sc_demuxer *demuxer);
+
 #endif
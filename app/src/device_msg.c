@@ -71,6 +71,56 @@ sc_device_msg_deserialize(const uint8_t *buf, size_t len,
 
             return 5 + size;
         }
+        case DEVICE_MSG_TYPE_VIDEO_IDLE:
+            if (len < 2) {
+                return 0; // no complete message
+            }
+            msg->video_idle.idle = buf[1];
+            return 2;
+        case DEVICE_MSG_TYPE_INPUT_ACK:
+            if (len < 13) {
+                return 0; // no complete message
+            }
+            msg->input_ack.sequence = sc_read64be(&buf[1]);
+            msg->input_ack.inject_us = sc_read32be(&buf[9]);
+            return 13;
+        case DEVICE_MSG_TYPE_SCREENSHOT_CHUNK: {
+            if (len < 6) {
+                // at least flags + size
+                return 0; // no complete message
+            }
+            uint8_t flags = buf[1];
+            size_t size = sc_read32be(&buf[2]);
+            if (size > DEVICE_MSG_SCREENSHOT_CHUNK_MAX_SIZE) {
+                LOGE("Screenshot chunk too big: %" SC_PRIsizet, size);
+                return -1;
+            }
+            if (size > len - 6) {
+                return 0; // no complete message
+            }
+            uint8_t *data = NULL;
+            if (size) {
+                data = malloc(size);
+                if (!data) {
+                    LOG_OOM();
+                    return -1;
+                }
+                memcpy(data, &buf[6], size);
+            }
+
+            msg->screenshot_chunk.flags = flags;
+            msg->screenshot_chunk.size = size;
+            msg->screenshot_chunk.data = data;
+            return 6 + size;
+        }
+        case DEVICE_MSG_TYPE_THERMAL_STATE:
+            if (len < 5) {
+                return 0; // no complete message
+            }
+            msg->thermal_state.status = (int8_t) buf[1];
+            msg->thermal_state.level = buf[2];
+            msg->thermal_state.headroom = (int16_t) sc_read16be(&buf[3]);
+            return 5;
         default:
             LOGW("Unknown device message type: %d", (int) msg->type);
             return -1; // error, we cannot recover
@@ -86,6 +136,9 @@ sc_device_msg_destroy(struct sc_device_msg *msg) {
         case DEVICE_MSG_TYPE_UHID_OUTPUT:
             free(msg->uhid_output.data);
             break;
+        case DEVICE_MSG_TYPE_SCREENSHOT_CHUNK:
+            free(msg->screenshot_chunk.data);
+            break;
         default:
             // nothing to do
             break;
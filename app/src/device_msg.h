@@ -3,6 +3,7 @@
 
 #include "common.h"
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
@@ -10,11 +11,20 @@
 #define DEVICE_MSG_MAX_SIZE (1 << 18) // 256k
 // type: 1 byte; length: 4 bytes
 #define DEVICE_MSG_TEXT_MAX_LENGTH (DEVICE_MSG_MAX_SIZE - 5)
+// type: 1 byte; flags: 1 byte; length: 4 bytes
+#define DEVICE_MSG_SCREENSHOT_CHUNK_MAX_SIZE (DEVICE_MSG_MAX_SIZE - 6)
+
+#define SC_SCREENSHOT_CHUNK_FLAG_FIRST 1
+#define SC_SCREENSHOT_CHUNK_FLAG_LAST 2
 
 enum sc_device_msg_type {
     DEVICE_MSG_TYPE_CLIPBOARD,
     DEVICE_MSG_TYPE_ACK_CLIPBOARD,
     DEVICE_MSG_TYPE_UHID_OUTPUT,
+    DEVICE_MSG_TYPE_VIDEO_IDLE,
+    DEVICE_MSG_TYPE_INPUT_ACK,
+    DEVICE_MSG_TYPE_SCREENSHOT_CHUNK,
+    DEVICE_MSG_TYPE_THERMAL_STATE,
 };
 
 struct sc_device_msg {
@@ -31,6 +41,24 @@ struct sc_device_msg {
             uint16_t size;
             uint8_t *data; // owned, to be freed by free()
         } uhid_output;
+        struct {
+            bool idle;
+        } video_idle;
+        struct {
+            uint64_t sequence;
+            uint32_t inject_us; // injection duration, in microseconds
+        } input_ack;
+        struct {
+            // The concatenated chunks form a PNG image (empty on failure)
+            uint8_t flags; // SC_SCREENSHOT_CHUNK_FLAG_*
+            uint32_t size;
+            uint8_t *data; // owned, to be freed by free()
+        } screenshot_chunk;
+        struct {
+            int8_t status; // Android thermal status, -1 if unknown
+            uint8_t level; // throttle level applied by the server
+            int16_t headroom; // forecasted headroom in percent, -1 if unknown
+        } thermal_state;
     };
 };
 
@@ -2,9 +2,13 @@
 
 #include <assert.h>
 #include <inttypes.h>
+#include <stdlib.h>
 #include <string.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
 
+#include "sws.h"
 #include "util/log.h"
 
 static bool
@@ -30,12 +34,20 @@ sc_display_init_novideo_icon(struct sc_display *display,
 
 bool
 sc_display_init(struct sc_display *display, SDL_Window *window,
-                SDL_Surface *icon_novideo, bool mipmaps) {
+                SDL_Surface *icon_novideo,
+                enum sc_downscale_filter downscale_filter,
+                bool texture_damage) {
     display->renderer =
         SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
     if (!display->renderer) {
-        LOGE("Could not create renderer: %s", SDL_GetError());
-        return false;
+        // Typically in a virtual machine or a remote desktop without GPU
+        LOGW("Could not create accelerated renderer: %s", SDL_GetError());
+        display->renderer =
+            SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+        if (!display->renderer) {
+            LOGE("Could not create renderer: %s", SDL_GetError());
+            return false;
+        }
     }
 
     SDL_RendererInfo renderer_info;
@@ -43,7 +55,18 @@ sc_display_init(struct sc_display *display, SDL_Window *window,
     const char *renderer_name = r ? NULL : renderer_info.name;
     LOGI("Renderer: %s", renderer_name ? renderer_name : "(unknown)");
 
+    // The software renderer may also be selected by --render-driver=software
+    display->rgb = !r && (renderer_info.flags & SDL_RENDERER_SOFTWARE);
+    if (display->rgb) {
+        LOGI("Software renderer, frames converted to RGB by libswscale");
+    }
+    display->rgb_conv.sws_ctx = NULL;
+
     display->mipmaps = false;
+    display->mipmaps_dirty = false;
+    display->shaders = false;
+    display->area = false;
+    display->fast_scaling = false;
 
 #ifdef SC_DISPLAY_FORCE_OPENGL_CORE_PROFILE
     display->gl_context = NULL;
@@ -73,7 +96,25 @@ sc_display_init(struct sc_display *display, SDL_Window *window,
 
         LOGI("OpenGL version: %s", gl->version);
 
-        if (mipmaps) {
+        bool supports_shaders =
+            sc_opengl_version_at_least(gl, 2, 0, /* OpenGL 2.0+ */
+                                           2, 0  /* OpenGL ES 2.0+ */)
+            && sc_opengl_has_shaders(gl);
+        if (supports_shaders) {
+            // The shader is compiled on first render, it may still fail. It is
+            // also needed to tone map HDR frames, whatever the filter.
+            sc_area_scaler_init(&display->area_scaler, gl);
+            display->shaders = true;
+        }
+
+        if (downscale_filter == SC_DOWNSCALE_FILTER_AREA) {
+            if (supports_shaders) {
+                display->area = true;
+            } else {
+                LOGW("Area downscaling disabled "
+                     "(OpenGL 2.0+ or ES 2.0+ required)");
+            }
+        } else if (downscale_filter == SC_DOWNSCALE_FILTER_TRILINEAR) {
             bool supports_mipmaps =
                 sc_opengl_version_at_least(gl, 3, 0, /* OpenGL 3.0+ */
                                                2, 0  /* OpenGL ES 2.0+ */);
@@ -87,14 +128,33 @@ sc_display_init(struct sc_display *display, SDL_Window *window,
         } else {
             LOGI("Trilinear filtering disabled");
         }
-    } else if (mipmaps) {
+    } else if (downscale_filter == SC_DOWNSCALE_FILTER_AREA) {
+        LOGW("Area downscaling disabled (not an OpenGL renderer)");
+    } else if (downscale_filter == SC_DOWNSCALE_FILTER_TRILINEAR) {
         LOGD("Trilinear filtering disabled (not an OpenGL renderer)");
     }
 
     display->texture = NULL;
+    display->texture_format = display->rgb ? SC_DISPLAY_RGB_FORMAT
+                                           : SDL_PIXELFORMAT_YV12;
+    display->transfer = SC_AREA_SCALER_TRANSFER_SDR;
+    display->texture_size = (struct sc_size) {0, 0};
     display->pending.flags = 0;
     display->pending.frame = NULL;
     display->has_frame = false;
+    display->readback_texture = NULL;
+    display->readback_size = (struct sc_size) {0, 0};
+
+    display->damage_enabled = false;
+    if (texture_damage && display->rgb) {
+        LOGW("Texture damage tracking disabled (software renderer)");
+    } else if (texture_damage) {
+        if (sc_frame_damage_init(&display->damage)) {
+            display->damage_enabled = true;
+        } else {
+            LOGW("Texture damage tracking disabled");
+        }
+    }
 
     if (icon_novideo) {
         // Without video, set a static scrcpy icon as window content
@@ -104,6 +164,9 @@ sc_display_init(struct sc_display *display, SDL_Window *window,
             SDL_GL_DeleteContext(display->gl_context);
 #endif
             SDL_DestroyRenderer(display->renderer);
+            if (display->damage_enabled) {
+                sc_frame_damage_destroy(&display->damage);
+            }
             return false;
         }
     }
@@ -122,14 +185,21 @@ sc_display_destroy(struct sc_display *display) {
     if (display->texture) {
         SDL_DestroyTexture(display->texture);
     }
+    if (display->readback_texture) {
+        SDL_DestroyTexture(display->readback_texture);
+    }
     SDL_DestroyRenderer(display->renderer);
+    if (display->damage_enabled) {
+        sc_frame_damage_destroy(&display->damage);
+    }
+    sws_freeContext(display->rgb_conv.sws_ctx);
 }
 
 static SDL_Texture *
 sc_display_create_texture(struct sc_display *display,
                           struct sc_size size) {
     SDL_Renderer *renderer = display->renderer;
-    SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_YV12,
+    SDL_Texture *texture = SDL_CreateTexture(renderer, display->texture_format,
                                              SDL_TEXTUREACCESS_STREAMING,
                                              size.width, size.height);
     if (!texture) {
@@ -137,6 +207,11 @@ sc_display_create_texture(struct sc_display *display,
         return NULL;
     }
 
+    if (display->damage_enabled) {
+        // The new texture does not contain the previous frame
+        sc_frame_damage_reset(&display->damage);
+    }
+
     if (display->mipmaps) {
         struct sc_opengl *gl = &display->gl;
 
@@ -197,6 +272,7 @@ sc_display_apply_pending(struct sc_display *display) {
             return false;
         }
 
+        display->texture_size = display->pending.size;
         display->pending.flags &= ~SC_DISPLAY_PENDING_FLAG_SIZE;
     }
 
@@ -229,12 +305,20 @@ sc_display_set_texture_size_internal(struct sc_display *display,
         return false;
     }
 
+    display->texture_size = size;
+
     LOGI("Texture: %" PRIu16 "x%" PRIu16, size.width, size.height);
     return true;
 }
 
 enum sc_display_result
 sc_display_set_texture_size(struct sc_display *display, struct sc_size size) {
+    if (display->texture && display->texture_size.width == size.width
+            && display->texture_size.height == size.height) {
+        // Same size (typically on reconnection), keep the texture
+        return SC_DISPLAY_RESULT_OK;
+    }
+
     bool ok = sc_display_set_texture_size_internal(display, size);
     if (!ok) {
         sc_display_set_pending_size(display, size);
@@ -245,15 +329,253 @@ sc_display_set_texture_size(struct sc_display *display, struct sc_size size) {
     return SC_DISPLAY_RESULT_OK;
 }
 
+enum sc_display_result
+sc_display_prepare(struct sc_display *display, struct sc_size size,
+                   bool nv12) {
+    if (!display->has_frame && !display->rgb) {
+        // Otherwise, the format of the last frame is a better guess
+        SDL_PixelFormatEnum format = nv12 ? SDL_PIXELFORMAT_NV12
+                                          : SDL_PIXELFORMAT_YV12;
+        if (format != display->texture_format && display->texture) {
+            SDL_DestroyTexture(display->texture);
+            display->texture = NULL;
+        }
+        display->texture_format = format;
+    }
+
+    enum sc_display_result res = sc_display_set_texture_size(display, size);
+    if (res != SC_DISPLAY_RESULT_OK) {
+        return res;
+    }
+
+    if (display->area) {
+        // Do not wait for the first frame to compile the shader
+        sc_area_scaler_prepare(&display->area_scaler, display->texture);
+    }
+
+    return SC_DISPLAY_RESULT_OK;
+}
+
 static SDL_YUV_CONVERSION_MODE
 sc_display_to_sdl_color_range(enum AVColorRange color_range) {
     return color_range == AVCOL_RANGE_JPEG ? SDL_YUV_CONVERSION_JPEG
                                            : SDL_YUV_CONVERSION_AUTOMATIC;
 }
 
+static SDL_PixelFormatEnum
+sc_display_to_sdl_pixel_format(enum AVPixelFormat format) {
+    // Semi-planar frames (typically produced by hardware decoders) are
+    // uploaded as is, without repacking the chroma planes
+    return format == AV_PIX_FMT_NV12 ? SDL_PIXELFORMAT_NV12
+                                     : SDL_PIXELFORMAT_YV12;
+}
+
+static enum sc_area_scaler_transfer
+sc_display_to_transfer(enum AVColorTransferCharacteristic color_trc) {
+    switch (color_trc) {
+        case AVCOL_TRC_SMPTE2084:
+            return SC_AREA_SCALER_TRANSFER_PQ;
+        case AVCOL_TRC_ARIB_STD_B67:
+            return SC_AREA_SCALER_TRANSFER_HLG;
+        default:
+            return SC_AREA_SCALER_TRANSFER_SDR;
+    }
+}
+
+static bool
+sc_display_update_nv_texture(struct sc_display *display,
+                             const AVFrame *frame) {
+#ifdef SCRCPY_SDL_HAS_UPDATE_NV_TEXTURE
+    return !SDL_UpdateNVTexture(display->texture, NULL,
+                                frame->data[0], frame->linesize[0],
+                                frame->data[1], frame->linesize[1]);
+#else
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(display->texture, NULL, &pixels, &pitch)) {
+        return false;
+    }
+
+    // The locked buffer contains the Y plane followed by the interleaved UV
+    // plane (half height), both using the same pitch
+    int width = frame->width;
+    int height = frame->height;
+    uint8_t *dst = pixels;
+    for (int y = 0; y < height; ++y) {
+        memcpy(dst, frame->data[0] + y * frame->linesize[0], width);
+        dst += pitch;
+    }
+    int uv_width = (width + 1) & ~1;
+    int uv_height = (height + 1) / 2;
+    for (int y = 0; y < uv_height; ++y) {
+        memcpy(dst, frame->data[1] + y * frame->linesize[1], uv_width);
+        dst += pitch;
+    }
+
+    SDL_UnlockTexture(display->texture);
+    return true;
+#endif
+}
+
+static bool
+sc_display_update_yuv_texture_rect(struct sc_display *display,
+                                   const AVFrame *frame, const SDL_Rect *rect) {
+    // The chroma planes are subsampled by 2 in both directions
+    int cx = rect->x / 2;
+    int cy = rect->y / 2;
+    return !SDL_UpdateYUVTexture(display->texture, rect,
+                frame->data[0] + rect->y * frame->linesize[0] + rect->x,
+                frame->linesize[0],
+                frame->data[1] + cy * frame->linesize[1] + cx,
+                frame->linesize[1],
+                frame->data[2] + cy * frame->linesize[2] + cx,
+                frame->linesize[2]);
+}
+
+static bool
+sc_display_update_yuv_texture(struct sc_display *display,
+                              const AVFrame *frame) {
+    struct sc_frame_damage *damage = &display->damage;
+    int changed = display->damage_enabled
+                ? sc_frame_damage_compute(damage, frame) : -1;
+    if (changed < 0 || (unsigned) changed * 2 > damage->columns * damage->rows) {
+        // Beyond half of the tiles, a single upload is cheaper
+        return !SDL_UpdateYUVTexture(display->texture, NULL,
+                                     frame->data[0], frame->linesize[0],
+                                     frame->data[1], frame->linesize[1],
+                                     frame->data[2], frame->linesize[2]);
+    }
+
+    // Upload each run of consecutive changed tiles of a row at once
+    const int tile_size = SC_FRAME_DAMAGE_TILE_SIZE;
+    for (unsigned row = 0; row < damage->rows; ++row) {
+        const uint8_t *tiles = &damage->tiles[row * damage->columns];
+        unsigned column = 0;
+        while (column < damage->columns) {
+            if (!tiles[column]) {
+                ++column;
+                continue;
+            }
+
+            unsigned start = column;
+            while (column < damage->columns && tiles[column]) {
+                ++column;
+            }
+
+            SDL_Rect rect;
+            rect.x = start * tile_size;
+            rect.y = row * tile_size;
+            rect.w = MIN((int) column * tile_size, frame->width) - rect.x;
+            rect.h = MIN(tile_size, frame->height - rect.y);
+            if (!sc_display_update_yuv_texture_rect(display, frame, &rect)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static struct SwsContext *
+sc_display_create_rgb_conv(const AVFrame *frame) {
+    // Same size, so no filtering is needed: SWS_POINT is the cheapest scaler
+    struct SwsContext *ctx =
+        sc_sws_get_context(NULL, frame->width, frame->height, frame->format,
+                           frame->width, frame->height, AV_PIX_FMT_BGRA,
+                           SWS_POINT);
+    if (!ctx) {
+        return NULL;
+    }
+
+    const int *coefs = sws_getCoefficients(
+            frame->colorspace == AVCOL_SPC_BT709 ? SWS_CS_ITU709
+                                                 : SWS_CS_DEFAULT);
+    int src_full_range = frame->color_range == AVCOL_RANGE_JPEG;
+    // brightness 0, contrast 1.0 and saturation 1.0 (in 16.16 fixed point)
+    sws_setColorspaceDetails(ctx, coefs, src_full_range, coefs, 1,
+                             0, 1 << 16, 1 << 16);
+
+    return ctx;
+}
+
+static bool
+sc_display_update_rgb_texture(struct sc_display *display,
+                              const AVFrame *frame) {
+    assert(display->rgb);
+
+    bool same = display->rgb_conv.sws_ctx
+             && display->rgb_conv.width == frame->width
+             && display->rgb_conv.height == frame->height
+             && display->rgb_conv.format == frame->format
+             && display->rgb_conv.colorspace == frame->colorspace
+             && display->rgb_conv.color_range == frame->color_range;
+    if (!same) {
+        sws_freeContext(display->rgb_conv.sws_ctx);
+        display->rgb_conv.sws_ctx = sc_display_create_rgb_conv(frame);
+        if (!display->rgb_conv.sws_ctx) {
+            LOGE("Could not convert %s frame to RGB",
+                 av_get_pix_fmt_name(frame->format));
+            return false;
+        }
+        display->rgb_conv.width = frame->width;
+        display->rgb_conv.height = frame->height;
+        display->rgb_conv.format = frame->format;
+        display->rgb_conv.colorspace = frame->colorspace;
+        display->rgb_conv.color_range = frame->color_range;
+    }
+
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(display->texture, NULL, &pixels, &pitch)) {
+        return false;
+    }
+
+    // Convert directly into the texture memory
+    uint8_t *dst_data[4] = {pixels, NULL, NULL, NULL};
+    int dst_linesize[4] = {pitch, 0, 0, 0};
+    int ret = sws_scale(display->rgb_conv.sws_ctx,
+                        (const uint8_t *const *) frame->data, frame->linesize,
+                        0, frame->height, dst_data, dst_linesize);
+
+    SDL_UnlockTexture(display->texture);
+    return ret > 0;
+}
+
 static bool
 sc_display_update_texture_internal(struct sc_display *display,
                                    const AVFrame *frame) {
+    SDL_PixelFormatEnum format =
+        display->rgb ? SC_DISPLAY_RGB_FORMAT
+                     : sc_display_to_sdl_pixel_format(frame->format);
+    if (format != display->texture_format) {
+        // The decoder output format changed (e.g. fallback from hardware to
+        // software decoding), recreate the texture
+        LOGD("Texture format: %s", SDL_GetPixelFormatName(format));
+        display->texture_format = format;
+        if (display->texture) {
+            bool ok = sc_display_set_texture_size_internal(
+                            display, display->texture_size);
+            if (!ok) {
+                sc_display_set_pending_size(display, display->texture_size);
+                return false;
+            }
+        }
+    }
+
+    enum sc_area_scaler_transfer transfer =
+        sc_display_to_transfer(frame->color_trc);
+    if (transfer != display->transfer) {
+        display->transfer = transfer;
+        if (transfer == SC_AREA_SCALER_TRANSFER_SDR) {
+            LOGI("SDR video");
+        } else if (display->shaders) {
+            LOGI("HDR video, tone mapped to SDR");
+        } else {
+            LOGW("HDR video not tone mapped "
+                 "(OpenGL 2.0+ or ES 2.0+ required)");
+        }
+    }
+
     if (!display->has_frame) {
         // First frame
         display->has_frame = true;
@@ -264,24 +586,71 @@ sc_display_update_texture_internal(struct sc_display *display,
         SDL_SetYUVConversionMode(sdl_color_range);
     }
 
-    int ret = SDL_UpdateYUVTexture(display->texture, NULL,
-                                   frame->data[0], frame->linesize[0],
-                                   frame->data[1], frame->linesize[1],
-                                   frame->data[2], frame->linesize[2]);
-    if (ret) {
+    bool ok;
+    if (display->rgb) {
+        ok = sc_display_update_rgb_texture(display, frame);
+    } else if (format == SDL_PIXELFORMAT_NV12) {
+        ok = sc_display_update_nv_texture(display, frame);
+    } else {
+        ok = sc_display_update_yuv_texture(display, frame);
+    }
+    if (!ok) {
         LOGD("Could not update texture: %s", SDL_GetError());
+        if (display->damage_enabled) {
+            // The texture may be partially updated
+            sc_frame_damage_reset(&display->damage);
+        }
         return false;
     }
 
+    if (display->damage_enabled) {
+        // Only YUV 4:2:0 planar frames are kept (not NV12 frames)
+        sc_frame_damage_set_previous(&display->damage, frame);
+    }
+
     if (display->mipmaps) {
-        SDL_GL_BindTexture(display->texture, NULL, NULL);
-        display->gl.GenerateMipmap(GL_TEXTURE_2D);
-        SDL_GL_UnbindTexture(display->texture);
+        // Generating mipmaps stalls the pipeline, so defer it until the
+        // texture is actually rendered downscaled (frames uploaded but never
+        // rendered, or rendered at least at their native size, do not need
+        // them)
+        display->mipmaps_dirty = true;
     }
 
     return true;
 }
 
+static void
+sc_display_update_mipmaps(struct sc_display *display, int width, int height) {
+    assert(display->mipmaps);
+
+    if (!display->mipmaps_dirty) {
+        return;
+    }
+
+    bool downscaled = width < display->texture_size.width
+                   || height < display->texture_size.height;
+    if (!downscaled) {
+        // The minification filter is not used
+        return;
+    }
+
+    SDL_GL_BindTexture(display->texture, NULL, NULL);
+    display->gl.GenerateMipmap(GL_TEXTURE_2D);
+    SDL_GL_UnbindTexture(display->texture);
+
+    display->mipmaps_dirty = false;
+}
+
+static bool
+sc_display_is_downscaled(struct sc_display *display, const SDL_Rect *geometry,
+                         enum sc_orientation orientation) {
+    bool swap = sc_orientation_is_swap(orientation);
+    int width = swap ? geometry->h : geometry->w;
+    int height = swap ? geometry->w : geometry->h;
+    return width < display->texture_size.width
+        || height < display->texture_size.height;
+}
+
 enum sc_display_result
 sc_display_update_texture(struct sc_display *display, const AVFrame *frame) {
     bool ok = sc_display_update_texture_internal(display, frame);
@@ -313,6 +682,28 @@ sc_display_render(struct sc_display *display, const SDL_Rect *geometry,
     SDL_Renderer *renderer = display->renderer;
     SDL_Texture *texture = display->texture;
 
+    if (display->mipmaps) {
+        bool swap = sc_orientation_is_swap(orientation);
+        int width = swap ? geometry->h : geometry->w;
+        int height = swap ? geometry->w : geometry->h;
+        sc_display_update_mipmaps(display, width, height);
+    }
+
+    bool hdr = display->shaders
+            && display->transfer != SC_AREA_SCALER_TRANSFER_SDR;
+    if (geometry && (hdr || (display->area && !display->fast_scaling
+            && sc_display_is_downscaled(display, geometry, orientation)))) {
+        bool nv12 = display->texture_format == SDL_PIXELFORMAT_NV12;
+        bool ok = sc_area_scaler_render(&display->area_scaler, renderer,
+                                        texture, display->texture_size, nv12,
+                                        display->transfer, geometry,
+                                        orientation);
+        if (ok) {
+            return SC_DISPLAY_RESULT_OK;
+        }
+        // Otherwise, fall back to the SDL renderer
+    }
+
     if (orientation == SC_ORIENTATION_0) {
         int ret = SDL_RenderCopy(renderer, texture, NULL, geometry);
         if (ret) {
@@ -353,3 +744,89 @@ void
 sc_display_present(struct sc_display *display) {
     SDL_RenderPresent(display->renderer);
 }
+
+void
+sc_display_invalidate_texture(struct sc_display *display) {
+    if (display->damage_enabled) {
+        sc_frame_damage_reset(&display->damage);
+    }
+}
+
+bool
+sc_display_read_frame_rgba(struct sc_display *display, uint8_t **pixels,
+                           size_t *pitch, struct sc_size *size) {
+    SDL_Renderer *renderer = display->renderer;
+
+    if (!display->has_frame || display->pending.flags) {
+        // The texture does not contain the current frame
+        return false;
+    }
+
+    if (!SDL_RenderTargetSupported(renderer)) {
+        LOGD("Render targets not supported, cannot read back the frame");
+        return false;
+    }
+
+    int width;
+    int height;
+    if (SDL_QueryTexture(display->texture, NULL, NULL, &width, &height)) {
+        LOGW("Could not query texture: %s", SDL_GetError());
+        return false;
+    }
+
+    if (!display->readback_texture || display->readback_size.width != width
+            || display->readback_size.height != height) {
+        if (display->readback_texture) {
+            SDL_DestroyTexture(display->readback_texture);
+        }
+        display->readback_texture =
+            SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32,
+                              SDL_TEXTUREACCESS_TARGET, width, height);
+        if (!display->readback_texture) {
+            LOGW("Could not create readback texture: %s", SDL_GetError());
+            return false;
+        }
+        display->readback_size.width = width;
+        display->readback_size.height = height;
+    }
+
+    size_t row_size = (size_t) width * 4;
+    uint8_t *data = malloc(row_size * height);
+    if (!data) {
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = false;
+    if (SDL_SetRenderTarget(renderer, display->readback_texture)) {
+        LOGW("Could not set render target: %s", SDL_GetError());
+        goto end;
+    }
+
+    if (SDL_RenderCopy(renderer, display->texture, NULL, NULL)) {
+        LOGW("Could not render frame for readback: %s", SDL_GetError());
+        goto reset_target;
+    }
+
+    if (SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_RGBA32, data,
+                             (int) row_size)) {
+        LOGW("Could not read back frame: %s", SDL_GetError());
+        goto reset_target;
+    }
+
+    ok = true;
+
+reset_target:
+    SDL_SetRenderTarget(renderer, NULL);
+end:
+    if (!ok) {
+        free(data);
+        return false;
+    }
+
+    *pixels = data;
+    *pitch = row_size;
+    size->width = width;
+    size->height = height;
+    return true;
+}
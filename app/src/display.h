@@ -8,7 +8,9 @@
 #include <libavutil/frame.h>
 #include <SDL2/SDL.h>
 
+#include "area_scaler.h"
 #include "coords.h"
+#include "frame_damage.h"
 #include "opengl.h"
 #include "options.h"
 
@@ -16,9 +18,30 @@
 # define SC_DISPLAY_FORCE_OPENGL_CORE_PROFILE
 #endif
 
+// Texture format with the software renderer (the native format of SDL
+// surfaces on little-endian platforms, so no further conversion is needed)
+#define SC_DISPLAY_RGB_FORMAT SDL_PIXELFORMAT_BGRA32
+
 struct sc_display {
     SDL_Renderer *renderer;
     SDL_Texture *texture;
+    // SDL_PIXELFORMAT_YV12 or SDL_PIXELFORMAT_NV12, depending on the format
+    // of the decoded frames (or SC_DISPLAY_RGB_FORMAT if rgb is set)
+    SDL_PixelFormatEnum texture_format;
+    struct sc_size texture_size;
+
+    // The renderer is a software renderer: the frames are converted to RGB by
+    // libswscale (vectorized and multithreaded), which is much faster than the
+    // generic YUV conversion of SDL
+    bool rgb;
+    struct {
+        struct SwsContext *sws_ctx; // NULL if not initialized
+        int width;
+        int height;
+        enum AVPixelFormat format;
+        enum AVColorSpace colorspace;
+        enum AVColorRange color_range;
+    } rgb_conv;
 
     struct sc_opengl gl;
 #ifdef SC_DISPLAY_FORCE_OPENGL_CORE_PROFILE
@@ -26,6 +49,25 @@ struct sc_display {
 #endif
 
     bool mipmaps;
+    // The area scaler is available (OpenGL 2.0+ or ES 2.0+ with shaders)
+    bool shaders;
+    // Downscale with a shader instead of SDL (see area_scaler.h)
+    bool area;
+    // Temporarily render SDR frames with the cheapest scaling, without the
+    // area scaler (set by the owner during a live window resize)
+    bool fast_scaling;
+    struct sc_area_scaler area_scaler;
+    // Transfer function of the last frame (HDR frames are rendered by the area
+    // scaler, to tone map them)
+    enum sc_area_scaler_transfer transfer;
+    // The mipmaps do not match the texture content (they are generated
+    // lazily, only when the texture is rendered downscaled)
+    bool mipmaps_dirty;
+
+    // Upload only the changed tiles of the YUV 4:2:0 frames (--texture-damage)
+    bool damage_enabled;
+    // Its previous frame is the content of the texture
+    struct sc_frame_damage damage;
 
     struct {
 #define SC_DISPLAY_PENDING_FLAG_SIZE 1
@@ -36,6 +78,10 @@ struct sc_display {
     } pending;
 
     bool has_frame;
+
+    // Render target used to read back the frame (lazily created)
+    SDL_Texture *readback_texture;
+    struct sc_size readback_size;
 };
 
 enum sc_display_result {
@@ -46,7 +92,9 @@ enum sc_display_result {
 
 bool
 sc_display_init(struct sc_display *display, SDL_Window *window,
-                SDL_Surface *icon_novideo, bool mipmaps);
+                SDL_Surface *icon_novideo,
+                enum sc_downscale_filter downscale_filter,
+                bool texture_damage);
 
 void
 sc_display_destroy(struct sc_display *display);
@@ -54,6 +102,19 @@ sc_display_destroy(struct sc_display *display);
 enum sc_display_result
 sc_display_set_texture_size(struct sc_display *display, struct sc_size size);
 
+/**
+ * Prepare the rendering of the first frame: create the texture of the given
+ * size, in NV12 or YV12 (the expected format of the decoded frames), and
+ * compile the video shader if it is used
+ *
+ * This moves this work out of the path of the first frame. If the frames
+ * turn out to have another format, the texture is recreated on the first
+ * frame.
+ */
+enum sc_display_result
+sc_display_prepare(struct sc_display *display, struct sc_size size,
+                   bool nv12);
+
 enum sc_display_result
 sc_display_update_texture(struct sc_display *display, const AVFrame *frame);
 
@@ -64,4 +125,23 @@ sc_display_render(struct sc_display *display, const SDL_Rect *geometry,
 void
 sc_display_present(struct sc_display *display);
 
+/**
+ * Notify that the content of the texture may have been lost (on render device
+ * reset), so that the next frame is fully uploaded
+ */
+void
+sc_display_invalidate_texture(struct sc_display *display);
+
+/**
+ * Read back the current frame converted to RGBA8888 by the GPU
+ *
+ * The frame is rendered at its native size (without orientation) into an
+ * offscreen render target.
+ *
+ * On success, *pixels must be released by free().
+ */
+bool
+sc_display_read_frame_rgba(struct sc_display *display, uint8_t **pixels,
+                           size_t *pitch, struct sc_size *size);
+
 #endif
@@ -1,6 +1,7 @@
 #include "events.h"
 
 #include <assert.h>
+#include <stdatomic.h>
 
 #include "util/log.h"
 #include "util/thread.h"
@@ -21,6 +22,44 @@ sc_push_event_impl(uint32_t type, const char *name) {
     return true;
 }
 
+// One bit per user event type (relative to SDL_USEREVENT) pushed by
+// sc_notify_event() and not consumed yet
+static atomic_uint_least32_t sc_pending_events;
+
+static uint32_t
+sc_event_bit(uint32_t type) {
+    assert(type >= SDL_USEREVENT && type - SDL_USEREVENT < 32);
+    return UINT32_C(1) << (type - SDL_USEREVENT);
+}
+
+bool
+sc_notify_event_impl(uint32_t type, const char *name) {
+    uint32_t bit = sc_event_bit(type);
+    uint32_t pending = atomic_fetch_or_explicit(&sc_pending_events, bit,
+                                                memory_order_acq_rel);
+    if (pending & bit) {
+        // Already pending, the main thread will handle this notification too
+        return true;
+    }
+
+    bool ok = sc_push_event_impl(type, name);
+    if (!ok) {
+        // Allow a later notification to push the event
+        atomic_fetch_and_explicit(&sc_pending_events, ~bit,
+                                  memory_order_acq_rel);
+    }
+
+    return ok;
+}
+
+void
+sc_consume_event(uint32_t type) {
+    assert(sc_thread_get_id() == SC_MAIN_THREAD_ID);
+
+    atomic_fetch_and_explicit(&sc_pending_events, ~sc_event_bit(type),
+                              memory_order_acq_rel);
+}
+
 bool
 sc_post_to_main_thread(sc_runnable_fn run, void *userdata) {
     SDL_Event event = {
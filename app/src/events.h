@@ -21,6 +21,16 @@ enum {
     SC_EVENT_CONTROLLER_ERROR,
     SC_EVENT_AOA_OPEN_ERROR,
     SC_EVENT_SCREEN_SECURE_CONTENT,
+    SC_EVENT_SCREENSHOT_DONE,
+    SC_EVENT_SCREEN_OCCLUSION_CHANGED,
+    SC_EVENT_FRAME_PACING_DEADLINE,
+    SC_EVENT_VIDEO_IDLE_CHANGED,
+    SC_EVENT_FILE_PUSHER_PROGRESS,
+    SC_EVENT_AUTO_SIZE,
+    SC_EVENT_DEVICE_SCREENSHOT,
+    SC_EVENT_SCREEN_ANIMATION_TICK,
+    SC_EVENT_ADB_DEVICES_CHANGED,
+    SC_EVENT_SCREENSHOT_WRITES_CHANGED,
 };
 
 bool
@@ -28,6 +38,22 @@ sc_push_event_impl(uint32_t type, const char *name);
 
 #define sc_push_event(TYPE) sc_push_event_impl(TYPE, # TYPE)
 
+/**
+ * Push a user event without payload, unless the same event is already pending
+ *
+ * A burst of notifications from other threads costs a single event (and a
+ * single wakeup of the main thread). The main thread must call
+ * sc_consume_event() before handling the event, so that a notification
+ * posted during the handling pushes a new event.
+ */
+bool
+sc_notify_event_impl(uint32_t type, const char *name);
+
+#define sc_notify_event(TYPE) sc_notify_event_impl(TYPE, # TYPE)
+
+void
+sc_consume_event(uint32_t type);
+
 typedef void (*sc_runnable_fn)(void *userdata);
 
 bool
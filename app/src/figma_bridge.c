@@ -3,25 +3,223 @@
 #include <assert.h>
 #include <ctype.h>
 #include <inttypes.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
+#include <time.h>
+#ifndef _WIN32
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+#include <SDL2/SDL_error.h>
+#include <SDL2/SDL_filesystem.h>
+#include <SDL2/SDL_stdinc.h>
+
+#include "bridge_input.h"
+#include "controller.h"
+#include "util/binary.h"
 #include "util/log.h"
+#include "util/rand.h"
+#include "util/sha1.h"
+#include "util/str.h"
+#include "util/strbuf.h"
+#include "util/tick.h"
+#include "util/trace.h"
 
 #define SC_FIGMA_BRIDGE_BACKLOG 4
+// Maximum duration a client may wait for a new screenshot (?wait=<ms>)
+#define SC_FIGMA_BRIDGE_MAX_WAIT_MS 25000
+// Accepted clients waiting for a worker, beyond which 503 is returned
+#define SC_FIGMA_BRIDGE_MAX_PENDING 16
+// Timeout for each blocking send() or recv() on a client socket, so that a
+// stalled client cannot hold a worker forever
+#define SC_FIGMA_BRIDGE_IO_TIMEOUT SC_TICK_FROM_SEC(10)
+// Maximum duration a persistent connection may stay idle between requests
+#define SC_FIGMA_BRIDGE_IDLE_TIMEOUT_SEC 5
+#define SC_FIGMA_BRIDGE_KEEP_ALIVE_HEADERS \
+    "Connection: keep-alive\r\n" \
+    "Keep-Alive: timeout=" SC_STR(SC_FIGMA_BRIDGE_IDLE_TIMEOUT_SEC) "\r\n"
+// Maximum size of the precomposed headers of an image response
+#define SC_FIGMA_BRIDGE_IMAGE_HEADERS_MAX 512
+// Maximum size of the request line and headers
+#define SC_FIGMA_BRIDGE_REQUEST_MAX 8192
+// Maximum size of a request body
+#define SC_FIGMA_BRIDGE_BODY_MAX (64 * 1024)
+// Maximum size of a screenshot published by another instance
+#define SC_FIGMA_BRIDGE_PUBLISH_BODY_MAX (16 * 1024 * 1024)
+// Maximum time to wait for a batch of input events to be injected
+#define SC_FIGMA_BRIDGE_INPUT_ACK_TIMEOUT SC_TICK_FROM_SEC(5)
+// Interval of the pings sent to an idle WebSocket client, to detect that it
+// is gone
+#define SC_FIGMA_BRIDGE_WS_PING_INTERVAL SC_TICK_FROM_SEC(15)
+// Interval at which a WebSocket client is checked for incoming frames, while
+// waiting for a message to push
+#define SC_FIGMA_BRIDGE_WS_READ_INTERVAL SC_TICK_FROM_MS(100)
+// Maximum size of a data frame received from a WebSocket client (its content
+// is discarded)
+#define SC_FIGMA_BRIDGE_WS_RECV_MAX (64 * 1024)
+// Header of the binary messages sent to the WebSocket clients
+#define SC_FIGMA_BRIDGE_WS_HEADER_SIZE 16
+#define SC_FIGMA_BRIDGE_WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+enum sc_figma_bridge_ws_msg_type {
+    SC_FIGMA_BRIDGE_WS_MSG_SCREENSHOT = 1,
+    SC_FIGMA_BRIDGE_WS_MSG_DEVICE_STATE = 2,
+    SC_FIGMA_BRIDGE_WS_MSG_VIDEO_SIZE = 3,
+};
+// Maximum total PNG size kept in history (the latest is always kept)
+#define SC_FIGMA_BRIDGE_HISTORY_MAX_BYTES (64 * 1024 * 1024)
+// Same for each device of another instance, so that all the remote devices
+// cannot hold more than SC_FIGMA_BRIDGE_MAX_REMOTE_DEVICES times this amount
+#define SC_FIGMA_BRIDGE_REMOTE_HISTORY_MAX_BYTES (16 * 1024 * 1024)
+// Let the browser cache CORS preflight responses (in seconds)
+#define SC_FIGMA_BRIDGE_PREFLIGHT_MAX_AGE 600
+// Origins of the Figma plugin UI (an iframe with an opaque origin in the
+// desktop app, or served by figma.com), the only web pages allowed to inject
+// input events
+static const char *const sc_figma_bridge_input_origins[] = {
+    "null",
+    "https://www.figma.com",
+    "https://figma.com",
+};
+
+struct sc_figma_bridge_client {
+    sc_socket socket;
+    // Whether the connection is kept open after the current response
+    bool keep_alive;
+    // Received bytes not processed yet (may contain pipelined requests)
+    char buf[SC_FIGMA_BRIDGE_REQUEST_MAX + 1]; // +1 for '\0'
+    size_t len;
+    // Value of the If-None-Match header of the current request ("" if
+    // absent or too long)
+    char if_none_match[128];
+    // Entity tag of the current response ("" if none)
+    char etag[48];
+    // Whether the current request asks for a WebSocket upgrade, and its
+    // Sec-WebSocket-Key ("" if absent or invalid)
+    bool ws_upgrade;
+    char ws_key[32];
+    // Value of the Origin header of the current request ("" if absent), and
+    // whether it is present (it may be too long to be stored)
+    bool has_origin;
+    char origin[64];
+    // Whether the body of the current request is declared as JSON
+    bool json_body;
+    // Value of the X-Scrcpy-Relay-Secret header of the current request (""
+    // if absent or invalid)
+    char relay_secret[SC_FIGMA_BRIDGE_RELAY_SECRET_LEN + 1];
+};
+
+// Requested variant of a snapshot (see sc_figma_bridge_get_variant())
+struct sc_figma_bridge_variant_query {
+    double scale; // 0 for no scaling
+    uint16_t max_width; // 0 for unlimited
+    enum sc_image_format format;
+};
 
 struct sc_figma_bridge_snapshot {
-    uint64_t sequence;
-    uint8_t *png_data;
-    size_t png_size;
+    atomic_uint refcount;
+    // Unique among the snapshots of all the devices
+    uint64_t id;
+    uint64_t sequence; // in the store of its device
     uint16_t width;
     uint16_t height;
+    // Always PNG for published snapshots, but not for their variants
+    enum sc_image_format format;
+    // Headers of the 200 response serving the image, except the status line
+    // and the Connection header (see sc_figma_bridge_snapshot_compose())
+    size_t headers_len;
+    char headers[SC_FIGMA_BRIDGE_IMAGE_HEADERS_MAX];
+    size_t png_size;
+    uint8_t png_data[];
+};
+
+struct sc_figma_bridge_fragment {
+    atomic_uint refcount;
+    bool keyframe;
+    size_t size;
+    uint8_t data[];
 };
 
+static struct sc_figma_bridge_snapshot *
+sc_figma_bridge_snapshot_new(const uint8_t *png_data, size_t png_size,
+                             uint16_t width, uint16_t height) {
+    if (png_size > SIZE_MAX - sizeof(struct sc_figma_bridge_snapshot)) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    struct sc_figma_bridge_snapshot *snapshot =
+        malloc(sizeof(*snapshot) + png_size);
+    if (!snapshot) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    atomic_init(&snapshot->refcount, 1);
+    snapshot->id = 0; // set on publication
+    snapshot->sequence = 0; // set on publication
+    snapshot->format = SC_IMAGE_FORMAT_PNG;
+    snapshot->width = width;
+    snapshot->height = height;
+    snapshot->headers_len = 0; // set on publication
+    snapshot->png_size = png_size;
+    memcpy(snapshot->png_data, png_data, png_size);
+    return snapshot;
+}
+
+static struct sc_figma_bridge_snapshot *
+sc_figma_bridge_snapshot_ref(struct sc_figma_bridge_snapshot *snapshot) {
+    atomic_fetch_add_explicit(&snapshot->refcount, 1, memory_order_relaxed);
+    return snapshot;
+}
+
+static void
+sc_figma_bridge_snapshot_unref(struct sc_figma_bridge_snapshot *snapshot) {
+    unsigned prev = atomic_fetch_sub_explicit(&snapshot->refcount, 1,
+                                              memory_order_acq_rel);
+    assert(prev);
+    if (prev == 1) {
+        free(snapshot);
+    }
+}
+
+static struct sc_figma_bridge_fragment *
+sc_figma_bridge_fragment_new(const uint8_t *data, size_t size, bool keyframe) {
+    if (size > SIZE_MAX - sizeof(struct sc_figma_bridge_fragment)) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    struct sc_figma_bridge_fragment *fragment =
+        malloc(sizeof(*fragment) + size);
+    if (!fragment) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    atomic_init(&fragment->refcount, 1);
+    fragment->keyframe = keyframe;
+    fragment->size = size;
+    memcpy(fragment->data, data, size);
+    return fragment;
+}
+
+static struct sc_figma_bridge_fragment *
+sc_figma_bridge_fragment_ref(struct sc_figma_bridge_fragment *fragment) {
+    atomic_fetch_add_explicit(&fragment->refcount, 1, memory_order_relaxed);
+    return fragment;
+}
+
 static void
-sc_figma_bridge_snapshot_destroy(struct sc_figma_bridge_snapshot *snapshot) {
-    free(snapshot->png_data);
+sc_figma_bridge_fragment_unref(struct sc_figma_bridge_fragment *fragment) {
+    unsigned prev = atomic_fetch_sub_explicit(&fragment->refcount, 1,
+                                              memory_order_acq_rel);
+    assert(prev);
+    if (prev == 1) {
+        free(fragment);
+    }
 }
 
 static char *
@@ -71,32 +269,70 @@ sc_figma_bridge_base64_encode(const uint8_t *data, size_t len,
     return out;
 }
 
+// extra_headers, if not NULL, must be a sequence of "Name: value\r\n" lines
 static bool
-sc_figma_bridge_send_headers(sc_socket client, int code, const char *status,
-                             const char *content_type, size_t body_len) {
-    char headers[512];
+sc_figma_bridge_send_headers_ex(struct sc_figma_bridge_client *client, int code,
+                                const char *status, const char *content_type,
+                                size_t body_len, const char *extra_headers) {
+    // A response with an entity tag may be stored by the client, to be
+    // revalidated by a conditional request
+    char etag_headers[128] = "Cache-Control: no-store\r\n";
+    if (client->etag[0]) {
+        snprintf(etag_headers, sizeof(etag_headers),
+                 "Cache-Control: no-cache\r\n"
+                 "Access-Control-Expose-Headers: ETag\r\n"
+                 "ETag: %s\r\n", client->etag);
+    }
+
+    // A 304 response has no body, and describes the stored one
+    char content_headers[128] = "";
+    if (code != 304) {
+        snprintf(content_headers, sizeof(content_headers),
+                 "Content-Type: %s\r\n"
+                 "Content-Length: %" SC_PRIsizet "\r\n",
+                 content_type, body_len);
+    }
+
+    char headers[1024];
     int r = snprintf(headers, sizeof(headers),
                      "HTTP/1.1 %d %s\r\n"
-                     "Connection: close\r\n"
+                     "%s"
                      "Access-Control-Allow-Origin: *\r\n"
-                     "Access-Control-Allow-Methods: GET, OPTIONS\r\n"
-                     "Access-Control-Allow-Headers: *\r\n"
-                     "Cache-Control: no-store\r\n"
-                     "Content-Type: %s\r\n"
-                     "Content-Length: %" SC_PRIsizet "\r\n"
+                     "%s"
+                     "%s"
+                     "%s"
                      "\r\n",
-                     code, status, content_type, body_len);
+                     code, status,
+                     client->keep_alive ? SC_FIGMA_BRIDGE_KEEP_ALIVE_HEADERS
+                                        : "Connection: close\r\n",
+                     etag_headers, content_headers,
+                     extra_headers ? extra_headers : "");
     if (r < 0 || (size_t) r >= sizeof(headers)) {
         LOGW("Could not format Figma Bridge HTTP headers");
+        client->keep_alive = false;
+        return false;
+    }
+
+    if (net_send_all(client->socket, headers, (size_t) r) != r) {
+        client->keep_alive = false;
         return false;
     }
 
-    return net_send_all(client, headers, (size_t) r) == r;
+    return true;
+}
+
+static bool
+sc_figma_bridge_send_headers(struct sc_figma_bridge_client *client, int code,
+                             const char *status, const char *content_type,
+                             size_t body_len) {
+    return sc_figma_bridge_send_headers_ex(client, code, status, content_type,
+                                           body_len, NULL);
 }
 
 static void
-sc_figma_bridge_send_response(sc_socket client, int code, const char *status,
-                              const char *content_type, const char *body) {
+sc_figma_bridge_send_response(struct sc_figma_bridge_client *client, int code,
+                              const char *status, const char *content_type,
+                              const char *body) {
     size_t body_len = body ? strlen(body) : 0;
     if (!sc_figma_bridge_send_headers(client, code, status, content_type,
                                       body_len)) {
@@ -107,48 +343,130 @@ sc_figma_bridge_send_response(sc_socket client, int code, const char *status,
         return;
     }
 
-    ssize_t r = net_send_all(client, body, body_len);
+    ssize_t r = net_send_all(client->socket, body, body_len);
     if (r < 0 || (size_t) r != body_len) {
         LOGW("Could not write Figma Bridge HTTP response body");
+        client->keep_alive = false;
+    }
+}
+
+// Return true if the If-None-Match `list` contains `etag` (using the weak
+// comparison, as required for If-None-Match)
+static bool
+sc_figma_bridge_etag_matches(const char *list, const char *etag) {
+    size_t etag_len = strlen(etag);
+    const char *p = list;
+    for (;;) {
+        while (*p == ' ' || *p == '\t' || *p == ',') {
+            ++p;
+        }
+        if (!*p) {
+            return false;
+        }
+        if (*p == '*') {
+            return true;
+        }
+        if (!strncmp(p, "W/", 2)) {
+            p += 2;
+        }
+        if (!strncmp(p, etag, etag_len)) {
+            char c = p[etag_len];
+            if (!c || c == ',' || c == ' ' || c == '\t') {
+                return true;
+            }
+        }
+        p = strchr(p, ',');
+        if (!p) {
+            return false;
+        }
+    }
+}
+
+// The sequences restart on each run: prefix them by an instance id, so that a
+// version stored by a client during a previous run never matches
+static void
+sc_figma_bridge_format_etag(const struct sc_figma_bridge *bridge, uint64_t seq,
+                            char *etag, size_t size) {
+    snprintf(etag, size, "\"%" PRIx32 "-%" PRIu64 "\"", bridge->instance_id,
+             seq);
+}
+
+// Format the headers of the response serving the image once its sequence is
+// known, rather than on every request (the image is then served by a single
+// writev() of the status line, the Connection header, these headers and the
+// image data)
+//
+// They must match what sc_figma_bridge_send_headers_ex() would produce.
+static void
+sc_figma_bridge_snapshot_compose(const struct sc_figma_bridge *bridge,
+                                 struct sc_figma_bridge_snapshot *snapshot) {
+    char etag[48];
+    sc_figma_bridge_format_etag(bridge, snapshot->sequence, etag, sizeof(etag));
+
+    // The metadata is exposed as headers, so that the body is the image file
+    // as is (no base64, no JSON wrapping)
+    int r = snprintf(snapshot->headers, sizeof(snapshot->headers),
+                     "Access-Control-Allow-Origin: *\r\n"
+                     "Cache-Control: no-cache\r\n"
+                     "Access-Control-Expose-Headers: ETag\r\n"
+                     "ETag: %s\r\n"
+                     "Content-Type: %s\r\n"
+                     "Content-Length: %" SC_PRIsizet "\r\n"
+                     "Access-Control-Expose-Headers: X-Scrcpy-Seq, "
+                         "X-Scrcpy-Width, X-Scrcpy-Height\r\n"
+                     "X-Scrcpy-Seq: %" PRIu64 "\r\n"
+                     "X-Scrcpy-Width: %u\r\n"
+                     "X-Scrcpy-Height: %u\r\n"
+                     "\r\n",
+                     etag, sc_image_format_get_mime_type(snapshot->format),
+                     snapshot->png_size, snapshot->sequence,
+                     (unsigned) snapshot->width, (unsigned) snapshot->height);
+    // All the values are bounded
+    assert(r > 0 && (size_t) r < sizeof(snapshot->headers));
+    snapshot->headers_len = r;
+}
+
+// Set the entity tag of the response, identifying the version `seq` of the
+// requested resource
+//
+// If the client already has this version (If-None-Match), respond 304 Not
+// Modified and return true: the caller must not send anything else.
+static bool
+sc_figma_bridge_respond_not_modified(struct sc_figma_bridge *bridge,
+                                     struct sc_figma_bridge_client *client,
+                                     uint64_t seq) {
+    sc_figma_bridge_format_etag(bridge, seq, client->etag,
+                                sizeof(client->etag));
+
+    if (!client->if_none_match[0]
+            || !sc_figma_bridge_etag_matches(client->if_none_match,
+                                             client->etag)) {
+        return false;
     }
+
+    sc_figma_bridge_send_headers_ex(client, 304, "Not Modified", NULL, 0,
+                                    NULL);
+    return true;
 }
 
+// Find the value of the query parameter `name`
+// Return false if the parameter is absent.
 static bool
-sc_figma_bridge_parse_after_query(const char *query, uint64_t *after) {
-    *after = 0;
+sc_figma_bridge_find_query_param(const char *query, const char *name,
+                                 const char **value, size_t *len) {
     if (!query || !*query) {
-        return true;
+        return false;
     }
 
+    size_t name_len = strlen(name);
     const char *p = query;
     while (*p) {
         const char *sep = strchr(p, '&');
         size_t token_len = sep ? (size_t) (sep - p) : strlen(p);
-        if (token_len > 6 && !strncmp(p, "after=", 6)) {
-            const char *value = p + 6;
-            size_t value_len = token_len - 6;
-            if (!value_len) {
-                return false;
-            }
-            for (size_t i = 0; i < value_len; ++i) {
-                if (!isdigit((unsigned char) value[i])) {
-                    return false;
-                }
-            }
-
-            char tmp[32];
-            if (value_len >= sizeof(tmp)) {
-                return false;
-            }
-            memcpy(tmp, value, value_len);
-            tmp[value_len] = '\0';
-
-            char *endptr;
-            unsigned long long parsed = strtoull(tmp, &endptr, 10);
-            if (*endptr) {
-                return false;
-            }
-            *after = (uint64_t) parsed;
+        if (token_len > name_len && !strncmp(p, name, name_len)
+                && p[name_len] == '=') {
+            *value = p + name_len + 1;
+            *len = token_len - name_len - 1;
             return true;
         }
 
@@ -158,44 +476,356 @@ sc_figma_bridge_parse_after_query(const char *query, uint64_t *after) {
         p = sep + 1;
     }
 
+    return false;
+}
+
+// Parse the unsigned integer value of the query parameter `name`
+// Leave *value untouched if the parameter is absent.
+static bool
+sc_figma_bridge_parse_query_u64(const char *query, const char *name,
+                                uint64_t *value) {
+    const char *str;
+    size_t str_len;
+    if (!sc_figma_bridge_find_query_param(query, name, &str, &str_len)) {
+        return true;
+    }
+
+    if (!str_len) {
+        return false;
+    }
+    for (size_t i = 0; i < str_len; ++i) {
+        if (!isdigit((unsigned char) str[i])) {
+            return false;
+        }
+    }
+
+    char tmp[32];
+    if (str_len >= sizeof(tmp)) {
+        return false;
+    }
+    memcpy(tmp, str, str_len);
+    tmp[str_len] = '\0';
+
+    char *endptr;
+    unsigned long long parsed = strtoull(tmp, &endptr, 10);
+    if (*endptr) {
+        return false;
+    }
+    *value = (uint64_t) parsed;
     return true;
 }
 
+// Parse the image variant query parameters:
+//  - scale=<factor> (in (0, 1], e.g. 0.5)
+//  - max_width=<pixels>
+//  - format=png|jpeg|webp
 static bool
-sc_figma_bridge_snapshot_newer_than(struct sc_figma_bridge *bridge,
-                                    uint64_t after,
-                                    struct sc_figma_bridge_snapshot *snapshot) {
-    sc_mutex_lock(&bridge->mutex);
-    bool available = bridge->sequence > after && bridge->png_data
-                  && bridge->png_size;
-    if (!available) {
-        sc_mutex_unlock(&bridge->mutex);
+sc_figma_bridge_parse_variant_query(const char *query,
+                                    struct sc_figma_bridge_variant_query *vq) {
+    vq->scale = 0;
+    vq->max_width = 0;
+    vq->format = SC_IMAGE_FORMAT_PNG;
+
+    const char *str;
+    size_t len;
+    if (sc_figma_bridge_find_query_param(query, "scale", &str, &len)) {
+        char tmp[16];
+        if (!len || len >= sizeof(tmp)) {
+            return false;
+        }
+        memcpy(tmp, str, len);
+        tmp[len] = '\0';
+
+        char *endptr;
+        double value = strtod(tmp, &endptr);
+        // Reject "nan", "inf", and upscaling
+        if (*endptr || !(value > 0 && value <= 1)) {
+            return false;
+        }
+        vq->scale = value;
+    }
+
+    uint64_t width = 0;
+    if (!sc_figma_bridge_parse_query_u64(query, "max_width", &width)
+            || width > UINT16_MAX) {
         return false;
     }
+    vq->max_width = width;
 
-    uint8_t *data = malloc(bridge->png_size);
-    if (!data) {
-        sc_mutex_unlock(&bridge->mutex);
-        LOG_OOM();
+    if (sc_figma_bridge_find_query_param(query, "format", &str, &len)) {
+        if (!sc_image_format_parse(str, len, &vq->format)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+sc_figma_bridge_parse_snapshot_query(const char *query, uint64_t *after,
+                                     sc_tick *wait) {
+    uint64_t after_value = 0;
+    uint64_t wait_ms = 0;
+    if (!sc_figma_bridge_parse_query_u64(query, "after", &after_value)
+            || !sc_figma_bridge_parse_query_u64(query, "wait", &wait_ms)) {
         return false;
     }
 
-    memcpy(data, bridge->png_data, bridge->png_size);
-    snapshot->sequence = bridge->sequence;
-    snapshot->png_data = data;
-    snapshot->png_size = bridge->png_size;
-    snapshot->width = bridge->width;
-    snapshot->height = bridge->height;
-    sc_mutex_unlock(&bridge->mutex);
+    if (wait_ms > SC_FIGMA_BRIDGE_MAX_WAIT_MS) {
+        wait_ms = SC_FIGMA_BRIDGE_MAX_WAIT_MS;
+    }
+
+    *after = after_value;
+    *wait = SC_TICK_FROM_MS(wait_ms);
+    return true;
+}
+
+static void
+sc_figma_bridge_store_init(struct sc_figma_bridge_store *store,
+                           size_t max_history_bytes) {
+    store->sequence = 0;
+    for (unsigned i = 0; i < SC_FIGMA_BRIDGE_HISTORY_SIZE; ++i) {
+        store->history[i] = NULL;
+    }
+    store->oldest_sequence = 1;
+    store->history_bytes = 0;
+    store->max_history_bytes = max_history_bytes;
+}
+
+// Release the snapshots, the sequences restart from 1
+static void
+sc_figma_bridge_store_clear(struct sc_figma_bridge_store *store) {
+    for (unsigned i = 0; i < SC_FIGMA_BRIDGE_HISTORY_SIZE; ++i) {
+        if (store->history[i]) {
+            sc_figma_bridge_snapshot_unref(store->history[i]);
+        }
+    }
+    sc_figma_bridge_store_init(store, store->max_history_bytes);
+}
+
+// The mutex must be locked
+static struct sc_figma_bridge_snapshot *
+sc_figma_bridge_history_get(struct sc_figma_bridge_store *store, uint64_t seq) {
+    struct sc_figma_bridge_snapshot *snapshot =
+        store->history[seq % SC_FIGMA_BRIDGE_HISTORY_SIZE];
+    if (!snapshot || snapshot->sequence != seq) {
+        return NULL;
+    }
+    return snapshot;
+}
 
+// Register a long-poll, unless too many requests already hold a worker (the
+// request must then be answered immediately)
+//
+// The mutex must be locked.
+static bool
+sc_figma_bridge_long_poll_begin(struct sc_figma_bridge *bridge) {
+    if (bridge->long_polls + bridge->stream_viewers + bridge->ws_clients
+            >= SC_FIGMA_BRIDGE_MAX_LONG_POLLS) {
+        return false;
+    }
+    ++bridge->long_polls;
     return true;
 }
 
+// The mutex must be locked
+static void
+sc_figma_bridge_long_poll_end(struct sc_figma_bridge *bridge) {
+    assert(bridge->long_polls);
+    --bridge->long_polls;
+}
+
+// Wait up to `wait` for a snapshot newer than `after` to be published
+// (long-poll)
+//
+// The mutex must be locked.
+static void
+sc_figma_bridge_wait_newer_than(struct sc_figma_bridge *bridge,
+                                struct sc_figma_bridge_store *store,
+                                uint64_t after, sc_tick wait) {
+    if (wait <= 0 || store->sequence > after
+            || !sc_figma_bridge_long_poll_begin(bridge)) {
+        return;
+    }
+
+    sc_tick deadline = sc_tick_now() + wait;
+    while (bridge->running && store->sequence <= after) {
+        if (!sc_cond_timedwait(&bridge->cond, &bridge->mutex, deadline)) {
+            // timeout
+            break;
+        }
+    }
+
+    sc_figma_bridge_long_poll_end(bridge);
+}
+
+// Return a new reference to the latest snapshot if it is newer than `after`,
+// or NULL otherwise
+//
+// If there is none yet, wait up to `wait` for a new one to be published.
+static struct sc_figma_bridge_snapshot *
+sc_figma_bridge_snapshot_newer_than(struct sc_figma_bridge *bridge,
+                                    struct sc_figma_bridge_store *store,
+                                    uint64_t after, sc_tick wait) {
+    struct sc_figma_bridge_snapshot *snapshot = NULL;
+
+    sc_mutex_lock(&bridge->mutex);
+    sc_figma_bridge_wait_newer_than(bridge, store, after, wait);
+    if (store->sequence > after) {
+        snapshot = sc_figma_bridge_history_get(store, store->sequence);
+        assert(snapshot); // the latest is always kept
+        sc_figma_bridge_snapshot_ref(snapshot);
+    }
+    sc_mutex_unlock(&bridge->mutex);
+
+    return snapshot;
+}
+
+// Publish the snapshot (taking ownership) as the latest of the store
+//
+// Return its sequence.
+static uint64_t
+sc_figma_bridge_store_push(struct sc_figma_bridge *bridge,
+                           struct sc_figma_bridge_store *store,
+                           struct sc_figma_bridge_snapshot *snapshot) {
+    struct sc_figma_bridge_snapshot *evicted[SC_FIGMA_BRIDGE_HISTORY_SIZE];
+    unsigned evicted_count = 0;
+    size_t png_size = snapshot->png_size;
+
+    sc_mutex_lock(&bridge->mutex);
+    uint64_t seq = ++store->sequence;
+    snapshot->sequence = seq;
+    snapshot->id = bridge->next_snapshot_id++;
+    sc_figma_bridge_snapshot_compose(bridge, snapshot);
+
+    // Evict the oldest snapshots to make room for the new one
+    while (store->oldest_sequence < seq
+            && (seq - store->oldest_sequence >= SC_FIGMA_BRIDGE_HISTORY_SIZE
+                || store->history_bytes + png_size
+                        > store->max_history_bytes)) {
+        unsigned index = store->oldest_sequence % SC_FIGMA_BRIDGE_HISTORY_SIZE;
+        struct sc_figma_bridge_snapshot *old = store->history[index];
+        if (old) {
+            store->history_bytes -= old->png_size;
+            store->history[index] = NULL;
+            assert(evicted_count < SC_FIGMA_BRIDGE_HISTORY_SIZE);
+            evicted[evicted_count++] = old;
+        }
+        ++store->oldest_sequence;
+    }
+
+    unsigned index = seq % SC_FIGMA_BRIDGE_HISTORY_SIZE;
+    assert(!store->history[index]);
+    store->history[index] = snapshot;
+    store->history_bytes += png_size;
+    ++bridge->devices_generation;
+    sc_cond_broadcast(&bridge->cond);
+    sc_mutex_unlock(&bridge->mutex);
+
+    // Clients still being served keep their own reference
+    for (unsigned i = 0; i < evicted_count; ++i) {
+        sc_figma_bridge_snapshot_unref(evicted[i]);
+    }
+
+    return seq;
+}
+
+// Return a new reference to the image to send for `snapshot`: the snapshot
+// itself, or the requested variant, produced on the first request then cached
+// (NULL on error)
+static struct sc_figma_bridge_snapshot *
+sc_figma_bridge_get_variant(struct sc_figma_bridge *bridge,
+                            struct sc_figma_bridge_snapshot *snapshot,
+                            const struct sc_figma_bridge_variant_query *vq) {
+    struct sc_image_variant variant = {.format = vq->format};
+    sc_image_variant_compute_size(snapshot->width, snapshot->height, vq->scale,
+                                  vq->max_width, &variant.width,
+                                  &variant.height);
+    if (variant.format == SC_IMAGE_FORMAT_PNG
+            && variant.width == snapshot->width
+            && variant.height == snapshot->height) {
+        return sc_figma_bridge_snapshot_ref(snapshot);
+    }
+
+    struct sc_figma_bridge_snapshot *image = NULL;
+
+    sc_mutex_lock(&bridge->mutex);
+    for (unsigned i = 0; i < SC_FIGMA_BRIDGE_VARIANT_CACHE_SIZE; ++i) {
+        struct sc_figma_bridge_variant_entry *entry = &bridge->variants[i];
+        if (entry->image && entry->image->id == snapshot->id
+                && entry->variant.format == variant.format
+                && entry->variant.width == variant.width
+                && entry->variant.height == variant.height) {
+            image = sc_figma_bridge_snapshot_ref(entry->image);
+            break;
+        }
+    }
+    sc_mutex_unlock(&bridge->mutex);
+
+    if (image) {
+        return image;
+    }
+
+    // Decoding, scaling and encoding take time, do not hold the mutex
+    uint8_t *data;
+    size_t size;
+    bool ok = sc_image_variant_create(snapshot->png_data, snapshot->png_size,
+                                      &variant, &data, &size);
+    if (!ok) {
+        LOGW("Could not produce Figma Bridge image variant");
+        return NULL;
+    }
+
+    image = sc_figma_bridge_snapshot_new(data, size, variant.width,
+                                         variant.height);
+    free(data);
+    if (!image) {
+        return NULL;
+    }
+    image->id = snapshot->id;
+    image->sequence = snapshot->sequence;
+    image->format = variant.format;
+    sc_figma_bridge_snapshot_compose(bridge, image);
+
+    sc_mutex_lock(&bridge->mutex);
+    // Replace the oldest entry
+    struct sc_figma_bridge_variant_entry *entry =
+        &bridge->variants[bridge->next_variant];
+    bridge->next_variant =
+        (bridge->next_variant + 1) % SC_FIGMA_BRIDGE_VARIANT_CACHE_SIZE;
+    struct sc_figma_bridge_snapshot *evicted = entry->image;
+    entry->variant = variant;
+    entry->image = sc_figma_bridge_snapshot_ref(image);
+    sc_mutex_unlock(&bridge->mutex);
+
+    if (evicted) {
+        sc_figma_bridge_snapshot_unref(evicted);
+    }
+
+    LOGD("Figma Bridge produced %s variant %ux%u of screenshot #%" PRIu64
+         " (%" SC_PRIsizet " bytes)", sc_image_format_get_name(variant.format),
+         (unsigned) variant.width, (unsigned) variant.height,
+         image->sequence, size);
+    return image;
+}
+
+static void
+sc_figma_bridge_respond_variant_error(struct sc_figma_bridge_client *client) {
+    sc_figma_bridge_send_response(client, 500, "Internal Server Error",
+                                  "text/plain; charset=utf-8",
+                                  "Could not produce the image variant\n");
+}
+
 static void
-sc_figma_bridge_respond_latest(struct sc_figma_bridge *bridge, sc_socket client,
+sc_figma_bridge_respond_latest(struct sc_figma_bridge *bridge,
+                               struct sc_figma_bridge_store *store,
+                               struct sc_figma_bridge_client *client,
                                const char *query) {
     uint64_t after;
-    bool ok = sc_figma_bridge_parse_after_query(query, &after);
+    sc_tick wait;
+    struct sc_figma_bridge_variant_query vq;
+    bool ok = sc_figma_bridge_parse_snapshot_query(query, &after, &wait)
+           && sc_figma_bridge_parse_variant_query(query, &vq);
     if (!ok) {
         sc_figma_bridge_send_response(client, 400, "Bad Request",
                                       "text/plain; charset=utf-8",
@@ -203,26 +833,39 @@ sc_figma_bridge_respond_latest(struct sc_figma_bridge *bridge, sc_socket client,
         return;
     }
 
-    struct sc_figma_bridge_snapshot snapshot = {
-        .sequence = 0,
-        .png_data = NULL,
-        .png_size = 0,
-        .width = 0,
-        .height = 0,
-    };
-    bool has_snapshot =
-        sc_figma_bridge_snapshot_newer_than(bridge, after, &snapshot);
-    if (!has_snapshot) {
+    struct sc_figma_bridge_snapshot *snapshot =
+        sc_figma_bridge_snapshot_newer_than(bridge, store, after, wait);
+    if (!snapshot) {
         sc_figma_bridge_send_response(client, 204, "No Content",
                                       "application/json", NULL);
         return;
     }
 
+    if (sc_figma_bridge_respond_not_modified(bridge, client,
+                                             snapshot->sequence)) {
+        sc_figma_bridge_snapshot_unref(snapshot);
+        return;
+    }
+
+    struct sc_figma_bridge_snapshot *image =
+        sc_figma_bridge_get_variant(bridge, snapshot, &vq);
+    sc_figma_bridge_snapshot_unref(snapshot);
+    if (!image) {
+        sc_figma_bridge_respond_variant_error(client);
+        return;
+    }
+
+    uint64_t sequence = image->sequence;
+    uint16_t width = image->width;
+    uint16_t height = image->height;
+    // The key is "png_base64", "jpeg_base64" or "webp_base64"
+    const char *format_name = sc_image_format_get_name(image->format);
+
     size_t b64_len;
-    char *png_b64 = sc_figma_bridge_base64_encode(snapshot.png_data,
-                                                   snapshot.png_size, &b64_len);
-    sc_figma_bridge_snapshot_destroy(&snapshot);
-    if (!png_b64) {
+    char *image_b64 = sc_figma_bridge_base64_encode(image->png_data,
+                                                    image->png_size, &b64_len);
+    sc_figma_bridge_snapshot_unref(image);
+    if (!image_b64) {
         sc_figma_bridge_send_response(client, 500, "Internal Server Error",
                                       "text/plain; charset=utf-8",
                                       "Out of memory\n");
@@ -231,11 +874,11 @@ sc_figma_bridge_respond_latest(struct sc_figma_bridge *bridge, sc_socket client,
 
     int prefix_len =
         snprintf(NULL, 0,
-                 "{\"seq\":%" PRIu64 ",\"width\":%u,\"height\":%u,\"png_base64\":\"",
-                 snapshot.sequence, (unsigned) snapshot.width,
-                 (unsigned) snapshot.height);
+                 "{\"seq\":%" PRIu64 ",\"width\":%u,\"height\":%u,"
+                 "\"%s_base64\":\"",
+                 sequence, (unsigned) width, (unsigned) height, format_name);
     if (prefix_len < 0) {
-        free(png_b64);
+        free(image_b64);
         sc_figma_bridge_send_response(client, 500, "Internal Server Error",
                                       "text/plain; charset=utf-8",
                                       "Formatting error\n");
@@ -245,7 +888,7 @@ sc_figma_bridge_respond_latest(struct sc_figma_bridge *bridge, sc_socket client,
     size_t body_len = (size_t) prefix_len + b64_len + 2; // "\"}"
     char *body = malloc(body_len + 1);
     if (!body) {
-        free(png_b64);
+        free(image_b64);
         LOG_OOM();
         sc_figma_bridge_send_response(client, 500, "Internal Server Error",
                                       "text/plain; charset=utf-8",
@@ -255,17 +898,17 @@ sc_figma_bridge_respond_latest(struct sc_figma_bridge *bridge, sc_socket client,
 
     int written = snprintf(body, body_len + 1,
                            "{\"seq\":%" PRIu64 ",\"width\":%u,\"height\":%u,"
-                           "\"png_base64\":\"",
-                           snapshot.sequence, (unsigned) snapshot.width,
-                           (unsigned) snapshot.height);
+                           "\"%s_base64\":\"",
+                           sequence, (unsigned) width, (unsigned) height,
+                           format_name);
     assert(written == prefix_len);
 
-    memcpy(&body[written], png_b64, b64_len);
+    memcpy(&body[written], image_b64, b64_len);
     body[written + b64_len] = '"';
     body[written + b64_len + 1] = '}';
     body[body_len] = '\0';
 
-    free(png_b64);
+    free(image_b64);
 
     if (!sc_figma_bridge_send_headers(client, 200, "OK",
                                       "application/json; charset=utf-8",
@@ -274,83 +917,1953 @@ sc_figma_bridge_respond_latest(struct sc_figma_bridge *bridge, sc_socket client,
         return;
     }
 
-    ssize_t r = net_send_all(client, body, body_len);
+    ssize_t r = net_send_all(client->socket, body, body_len);
     free(body);
     if (r < 0 || (size_t) r != body_len) {
         LOGW("Could not write Figma Bridge JSON payload");
+        client->keep_alive = false;
     }
 }
 
 static void
-sc_figma_bridge_handle_client(struct sc_figma_bridge *bridge, sc_socket client) {
-    char req[4096];
-    ssize_t r = net_recv(client, req, sizeof(req) - 1);
-    if (r <= 0) {
-        return;
+sc_figma_bridge_send_image(struct sc_figma_bridge_client *client,
+                           const struct sc_figma_bridge_snapshot *snapshot) {
+    static const char status[] = "HTTP/1.1 200 OK\r\n";
+    const char *connection = client->keep_alive
+                           ? SC_FIGMA_BRIDGE_KEEP_ALIVE_HEADERS
+                           : "Connection: close\r\n";
+    assert(snapshot->headers_len);
+
+    // The snapshot is immutable, it is sent without holding the bridge mutex
+    // nor formatting anything
+    struct sc_net_buf bufs[] = {
+        {status, sizeof(status) - 1},
+        {connection, strlen(connection)},
+        {snapshot->headers, snapshot->headers_len},
+        {snapshot->png_data, snapshot->png_size},
+    };
+
+    size_t total = 0;
+    for (size_t i = 0; i < ARRAY_LEN(bufs); ++i) {
+        total += bufs[i].len;
     }
-    req[r] = '\0';
 
-    char *line_end = strstr(req, "\r\n");
-    if (!line_end) {
-        line_end = strchr(req, '\n');
+    ssize_t w = net_send_all_v(client->socket, bufs, ARRAY_LEN(bufs));
+    if (w < 0 || (size_t) w != total) {
+        LOGW("Could not write Figma Bridge image response");
+        client->keep_alive = false;
     }
-    if (!line_end) {
+}
+
+static void
+sc_figma_bridge_respond_latest_png(struct sc_figma_bridge *bridge,
+                                   struct sc_figma_bridge_store *store,
+                                   struct sc_figma_bridge_client *client,
+                                   const char *query) {
+    uint64_t after;
+    sc_tick wait;
+    struct sc_figma_bridge_variant_query vq;
+    bool ok = sc_figma_bridge_parse_snapshot_query(query, &after, &wait)
+           && sc_figma_bridge_parse_variant_query(query, &vq);
+    if (!ok) {
         sc_figma_bridge_send_response(client, 400, "Bad Request",
                                       "text/plain; charset=utf-8",
-                                      "Malformed request\n");
+                                      "Invalid query\n");
         return;
     }
-    *line_end = '\0';
 
-    char method[8];
-    char uri[1024];
-    if (sscanf(req, "%7s %1023s", method, uri) != 2) {
-        sc_figma_bridge_send_response(client, 400, "Bad Request",
-                                      "text/plain; charset=utf-8",
-                                      "Malformed request line\n");
+    struct sc_figma_bridge_snapshot *snapshot =
+        sc_figma_bridge_snapshot_newer_than(bridge, store, after, wait);
+    if (!snapshot) {
+        sc_figma_bridge_send_response(client, 204, "No Content",
+                                      sc_image_format_get_mime_type(vq.format),
+                                      NULL);
         return;
     }
 
-    if (!strcmp(method, "OPTIONS")) {
-        sc_figma_bridge_send_response(client, 204, "No Content",
-                                      "text/plain; charset=utf-8", NULL);
+    // Checked before encoding the variant, which is not needed if the client
+    // already has it
+    if (sc_figma_bridge_respond_not_modified(bridge, client,
+                                             snapshot->sequence)) {
+        sc_figma_bridge_snapshot_unref(snapshot);
         return;
     }
 
-    if (strcmp(method, "GET")) {
-        sc_figma_bridge_send_response(client, 405, "Method Not Allowed",
+    struct sc_figma_bridge_snapshot *image =
+        sc_figma_bridge_get_variant(bridge, snapshot, &vq);
+    sc_figma_bridge_snapshot_unref(snapshot);
+    if (!image) {
+        sc_figma_bridge_respond_variant_error(client);
+        return;
+    }
+
+    sc_figma_bridge_send_image(client, image);
+    sc_figma_bridge_snapshot_unref(image);
+}
+
+static void
+sc_figma_bridge_respond_snapshot_png(struct sc_figma_bridge *bridge,
+                                     struct sc_figma_bridge_store *store,
+                                     struct sc_figma_bridge_client *client,
+                                     const char *query) {
+    uint64_t seq = 0;
+    struct sc_figma_bridge_variant_query vq;
+    bool ok = sc_figma_bridge_parse_query_u64(query, "seq", &seq)
+           && sc_figma_bridge_parse_variant_query(query, &vq);
+    if (!ok || !seq) {
+        sc_figma_bridge_send_response(client, 400, "Bad Request",
                                       "text/plain; charset=utf-8",
-                                      "Only GET is supported\n");
+                                      "Invalid query\n");
         return;
     }
 
-    char *query = strchr(uri, '?');
-    if (query) {
-        *query = '\0';
-        ++query;
+    sc_mutex_lock(&bridge->mutex);
+    struct sc_figma_bridge_snapshot *snapshot =
+        sc_figma_bridge_history_get(store, seq);
+    if (snapshot) {
+        sc_figma_bridge_snapshot_ref(snapshot);
     }
+    sc_mutex_unlock(&bridge->mutex);
 
-    if (!strcmp(uri, "/scrcpy-bridge/health")) {
-        sc_figma_bridge_send_response(client, 200, "OK",
+    if (!snapshot) {
+        sc_figma_bridge_send_response(client, 404, "Not Found",
                                       "text/plain; charset=utf-8",
-                                      "ok\n");
+                                      "Snapshot not available\n");
         return;
     }
 
-    if (!strcmp(uri, "/scrcpy-bridge/latest")) {
-        sc_figma_bridge_respond_latest(bridge, client, query);
+    if (sc_figma_bridge_respond_not_modified(bridge, client,
+                                             snapshot->sequence)) {
+        sc_figma_bridge_snapshot_unref(snapshot);
         return;
     }
 
-    sc_figma_bridge_send_response(client, 404, "Not Found",
-                                  "text/plain; charset=utf-8", "Not found\n");
-}
-
+    struct sc_figma_bridge_snapshot *image =
+        sc_figma_bridge_get_variant(bridge, snapshot, &vq);
+    sc_figma_bridge_snapshot_unref(snapshot);
+    if (!image) {
+        sc_figma_bridge_respond_variant_error(client);
+        return;
+    }
+
+    sc_figma_bridge_send_image(client, image);
+    sc_figma_bridge_snapshot_unref(image);
+}
+
+// List the metadata of all the snapshots newer than `after` still available
+static void
+sc_figma_bridge_respond_since(struct sc_figma_bridge *bridge,
+                              struct sc_figma_bridge_store *store,
+                              struct sc_figma_bridge_client *client,
+                              const char *query) {
+    uint64_t after;
+    sc_tick wait;
+    bool ok = sc_figma_bridge_parse_snapshot_query(query, &after, &wait);
+    if (!ok) {
+        sc_figma_bridge_send_response(client, 400, "Bad Request",
+                                      "text/plain; charset=utf-8",
+                                      "Invalid query\n");
+        return;
+    }
+
+    struct sc_strbuf buf;
+    if (!sc_strbuf_init(&buf, 256)) {
+        sc_figma_bridge_send_response(client, 500, "Internal Server Error",
+                                      "text/plain; charset=utf-8",
+                                      "Out of memory\n");
+        return;
+    }
+
+    char item[128];
+    ok = true;
+
+    sc_mutex_lock(&bridge->mutex);
+    sc_figma_bridge_wait_newer_than(bridge, store, after, wait);
+    uint64_t latest = store->sequence;
+    bool has_new = latest > after;
+    if (has_new) {
+        int r = snprintf(item, sizeof(item),
+                         "{\"latest\":%" PRIu64 ",\"snapshots\":[", latest);
+        assert(r > 0 && (size_t) r < sizeof(item));
+        ok = sc_strbuf_append(&buf, item, r);
+
+        uint64_t first = MAX(after + 1, store->oldest_sequence);
+        for (uint64_t seq = first; ok && seq <= latest; ++seq) {
+            struct sc_figma_bridge_snapshot *snapshot =
+                sc_figma_bridge_history_get(store, seq);
+            if (!snapshot) {
+                continue;
+            }
+            r = snprintf(item, sizeof(item),
+                         "%s{\"seq\":%" PRIu64 ",\"width\":%u,"
+                             "\"height\":%u}",
+                         seq == first ? "" : ",", seq,
+                         (unsigned) snapshot->width,
+                         (unsigned) snapshot->height);
+            assert(r > 0 && (size_t) r < sizeof(item));
+            ok = sc_strbuf_append(&buf, item, r);
+        }
+    }
+    sc_mutex_unlock(&bridge->mutex);
+
+    if (ok && has_new) {
+        ok = sc_strbuf_append_staticstr(&buf, "]}");
+    }
+
+    if (!ok) {
+        free(buf.s);
+        sc_figma_bridge_send_response(client, 500, "Internal Server Error",
+                                      "text/plain; charset=utf-8",
+                                      "Out of memory\n");
+        return;
+    }
+
+    if (!has_new) {
+        free(buf.s);
+        sc_figma_bridge_send_response(client, 204, "No Content",
+                                      "application/json", NULL);
+        return;
+    }
+
+    sc_figma_bridge_send_response(client, 200, "OK",
+                                  "application/json; charset=utf-8", buf.s);
+    free(buf.s);
+}
+
+// Send the fragment, return false if the connection must be closed
+static bool
+sc_figma_bridge_send_fragment(struct sc_figma_bridge_client *client,
+                              const struct sc_figma_bridge_fragment *fragment) {
+    ssize_t r = net_send_all(client->socket, fragment->data, fragment->size);
+    return r >= 0 && (size_t) r == fragment->size;
+}
+
+// Stream the live video as fragmented MP4, until the viewer disconnects or
+// the stream ends
+static void
+sc_figma_bridge_respond_stream(struct sc_figma_bridge *bridge,
+                               struct sc_figma_bridge_client *client) {
+    // The length of the response is unknown, its end is the end of the
+    // connection
+    client->keep_alive = false;
+
+    sc_mutex_lock(&bridge->mutex);
+    if (!bridge->stream_init || bridge->stream_ended) {
+        sc_mutex_unlock(&bridge->mutex);
+        sc_figma_bridge_send_response(client, 503, "Service Unavailable",
+                                      "text/plain; charset=utf-8",
+                                      "No video stream\n");
+        return;
+    }
+    if (bridge->stream_viewers + bridge->ws_clients
+            >= SC_FIGMA_BRIDGE_MAX_STREAMS) {
+        sc_mutex_unlock(&bridge->mutex);
+        sc_figma_bridge_send_response(client, 503, "Service Unavailable",
+                                      "text/plain; charset=utf-8",
+                                      "Too many stream viewers\n");
+        return;
+    }
+    ++bridge->stream_viewers;
+    // Do not wait for the next periodic keyframe
+    bridge->stream_keyframe_requested = true;
+    struct sc_figma_bridge_fragment *init =
+        sc_figma_bridge_fragment_ref(bridge->stream_init);
+    uint64_t next = bridge->stream_sequence + 1;
+    sc_mutex_unlock(&bridge->mutex);
+
+    static const char headers[] =
+        "HTTP/1.1 200 OK\r\n"
+        "Connection: close\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "Cache-Control: no-store\r\n"
+        "Content-Type: video/mp4\r\n"
+        "\r\n";
+    bool ok = net_send_all(client->socket, headers, sizeof(headers) - 1)
+                == sizeof(headers) - 1
+           && sc_figma_bridge_send_fragment(client, init);
+    sc_figma_bridge_fragment_unref(init);
+
+    LOGD("Figma Bridge stream viewer connected");
+
+    // The viewer may only start decoding on a keyframe
+    bool started = false;
+    while (ok) {
+        sc_mutex_lock(&bridge->mutex);
+        while (bridge->running && !bridge->stream_ended
+                && bridge->stream_sequence < next) {
+            sc_cond_wait(&bridge->stream_cond, &bridge->mutex);
+        }
+        if (!bridge->running || bridge->stream_ended) {
+            sc_mutex_unlock(&bridge->mutex);
+            break;
+        }
+        if (bridge->stream_sequence - next
+                >= SC_FIGMA_BRIDGE_STREAM_FRAGMENTS) {
+            sc_mutex_unlock(&bridge->mutex);
+            LOGW("Figma Bridge stream viewer too slow, disconnected");
+            break;
+        }
+        unsigned index = next % SC_FIGMA_BRIDGE_STREAM_FRAGMENTS;
+        struct sc_figma_bridge_fragment *fragment =
+            sc_figma_bridge_fragment_ref(bridge->stream_fragments[index]);
+        sc_mutex_unlock(&bridge->mutex);
+
+        ++next;
+        if (started || fragment->keyframe) {
+            started = true;
+            ok = sc_figma_bridge_send_fragment(client, fragment);
+        }
+        sc_figma_bridge_fragment_unref(fragment);
+    }
+
+    LOGD("Figma Bridge stream viewer disconnected");
+
+    sc_mutex_lock(&bridge->mutex);
+    assert(bridge->stream_viewers);
+    --bridge->stream_viewers;
+    sc_mutex_unlock(&bridge->mutex);
+}
+
+// Send a WebSocket frame (unfragmented, unmasked) whose payload is the
+// concatenation of `header` and `data`
+static bool
+sc_figma_bridge_ws_send(struct sc_figma_bridge_client *client, uint8_t opcode,
+                        const uint8_t *header, size_t header_len,
+                        const uint8_t *data, size_t data_len) {
+    uint8_t buf[14 + SC_FIGMA_BRIDGE_WS_HEADER_SIZE];
+    assert(header_len <= SC_FIGMA_BRIDGE_WS_HEADER_SIZE);
+
+    size_t len = header_len + data_len;
+    size_t i = 0;
+    buf[i++] = 0x80 | opcode; // FIN
+    if (len < 126) {
+        buf[i++] = len;
+    } else if (len <= 0xFFFF) {
+        buf[i++] = 126;
+        sc_write16be(&buf[i], len);
+        i += 2;
+    } else {
+        buf[i++] = 127;
+        sc_write64be(&buf[i], len);
+        i += 8;
+    }
+    if (header_len) {
+        memcpy(&buf[i], header, header_len);
+        i += header_len;
+    }
+
+    if (net_send_all(client->socket, buf, i) != (ssize_t) i) {
+        return false;
+    }
+
+    return !data_len
+        || net_send_all(client->socket, data, data_len) == (ssize_t) data_len;
+}
+
+// Send a binary message: a 16-byte header (big-endian), followed by the data
+static bool
+sc_figma_bridge_ws_send_msg(struct sc_figma_bridge_client *client,
+                            enum sc_figma_bridge_ws_msg_type type,
+                            uint8_t value, uint16_t width, uint16_t height,
+                            uint64_t seq, const uint8_t *data,
+                            size_t data_len) {
+    uint8_t header[SC_FIGMA_BRIDGE_WS_HEADER_SIZE];
+    header[0] = type;
+    header[1] = value;
+    sc_write16be(&header[2], width);
+    sc_write16be(&header[4], height);
+    sc_write16be(&header[6], 0); // reserved
+    sc_write64be(&header[8], seq);
+    return sc_figma_bridge_ws_send(client, 0x2, header, sizeof(header), data,
+                                   data_len);
+}
+
+static void
+sc_figma_bridge_ws_send_close(struct sc_figma_bridge_client *client,
+                              uint16_t status_code) {
+    uint8_t payload[2];
+    sc_write16be(payload, status_code);
+    sc_figma_bridge_ws_send(client, 0x8, NULL, 0, payload, sizeof(payload));
+}
+
+// Receive a frame from the client, and answer it if it is a Close or a Ping
+// (the other frames are discarded)
+//
+// Return false if the connection must be closed.
+static bool
+sc_figma_bridge_ws_receive(struct sc_figma_bridge_client *client) {
+    // Up to 8 bytes of extended payload length, then the masking key
+    uint8_t header[2 + 8 + 4];
+    if (net_recv_all(client->socket, header, 2) != 2) {
+        return false;
+    }
+
+    uint8_t opcode = header[0] & 0xF;
+    bool masked = header[1] & 0x80;
+    uint64_t len = header[1] & 0x7F;
+    size_t ext_len = len == 126 ? 2 : len == 127 ? 8 : 0;
+    if (!masked) {
+        // The frames sent by a client must be masked
+        sc_figma_bridge_ws_send_close(client, 1002); // protocol error
+        return false;
+    }
+
+    ssize_t r = net_recv_all(client->socket, &header[2], ext_len + 4);
+    if (r < 0 || (size_t) r != ext_len + 4) {
+        return false;
+    }
+    if (ext_len == 2) {
+        len = sc_read16be(&header[2]);
+    } else if (ext_len == 8) {
+        len = sc_read64be(&header[2]);
+    }
+    const uint8_t *mask = &header[2 + ext_len];
+
+    bool control = opcode & 0x8;
+    if (control && len > 125) {
+        sc_figma_bridge_ws_send_close(client, 1002); // protocol error
+        return false;
+    }
+    if (len > SC_FIGMA_BRIDGE_WS_RECV_MAX) {
+        sc_figma_bridge_ws_send_close(client, 1009); // message too big
+        return false;
+    }
+
+    uint8_t payload[1024];
+    while (len > sizeof(payload)) {
+        // Only the payload of a data frame may not fit, it is not used
+        assert(!control);
+        r = net_recv_all(client->socket, payload, sizeof(payload));
+        if (r != sizeof(payload)) {
+            return false;
+        }
+        len -= sizeof(payload);
+    }
+
+    if (len) {
+        r = net_recv_all(client->socket, payload, len);
+        if (r < 0 || (size_t) r != len) {
+            return false;
+        }
+    }
+
+    if (opcode == 0x8) {
+        // Close: echo the status code, if any, then close the connection
+        for (size_t i = 0; i < len && i < 2; ++i) {
+            payload[i] ^= mask[i % 4];
+        }
+        sc_figma_bridge_ws_send(client, 0x8, NULL, 0, payload, MIN(len, 2));
+        return false;
+    }
+
+    if (opcode == 0x9) {
+        // Ping: answer a Pong with the same payload
+        for (size_t i = 0; i < len; ++i) {
+            payload[i] ^= mask[i % 4];
+        }
+        return sc_figma_bridge_ws_send(client, 0xA, NULL, 0, payload, len);
+    }
+
+    // Pongs and data frames are ignored
+    return true;
+}
+
+static void
+sc_figma_bridge_respond_ws(struct sc_figma_bridge *bridge,
+                           struct sc_figma_bridge_client *client,
+                           const char *query) {
+    if (!client->ws_upgrade || !client->ws_key[0]) {
+        sc_figma_bridge_send_headers_ex(client, 426, "Upgrade Required",
+                                        "text/plain; charset=utf-8", 0,
+                                        "Upgrade: websocket\r\n");
+        return;
+    }
+
+    // Only the screenshots newer than `after` are pushed (by default, only
+    // the ones published after the connection)
+    sc_mutex_lock(&bridge->mutex);
+    uint64_t after = bridge->store.sequence;
+    sc_mutex_unlock(&bridge->mutex);
+    if (!sc_figma_bridge_parse_query_u64(query, "after", &after)) {
+        sc_figma_bridge_send_response(client, 400, "Bad Request",
+                                      "text/plain; charset=utf-8",
+                                      "Invalid query\n");
+        return;
+    }
+
+    uint8_t digest[SC_SHA1_DIGEST_SIZE];
+    char key[sizeof(client->ws_key) + sizeof(SC_FIGMA_BRIDGE_WS_GUID)];
+    int key_len = snprintf(key, sizeof(key), "%s" SC_FIGMA_BRIDGE_WS_GUID,
+                           client->ws_key);
+    assert(key_len > 0 && (size_t) key_len < sizeof(key));
+    sc_sha1(key, key_len, digest);
+
+    size_t accept_len;
+    char *accept =
+        sc_figma_bridge_base64_encode(digest, sizeof(digest), &accept_len);
+    if (!accept) {
+        sc_figma_bridge_send_response(client, 500, "Internal Server Error",
+                                      "text/plain; charset=utf-8",
+                                      "Out of memory\n");
+        return;
+    }
+
+    sc_mutex_lock(&bridge->mutex);
+    if (bridge->stream_viewers + bridge->ws_clients
+            >= SC_FIGMA_BRIDGE_MAX_STREAMS) {
+        sc_mutex_unlock(&bridge->mutex);
+        free(accept);
+        sc_figma_bridge_send_response(client, 503, "Service Unavailable",
+                                      "text/plain; charset=utf-8",
+                                      "Too many clients\n");
+        return;
+    }
+    ++bridge->ws_clients;
+    sc_mutex_unlock(&bridge->mutex);
+
+    // The connection does not carry HTTP anymore
+    client->keep_alive = false;
+
+    char headers[256];
+    int r = snprintf(headers, sizeof(headers),
+                     "HTTP/1.1 101 Switching Protocols\r\n"
+                     "Upgrade: websocket\r\n"
+                     "Connection: Upgrade\r\n"
+                     "Sec-WebSocket-Accept: %s\r\n"
+                     "\r\n", accept);
+    free(accept);
+    assert(r > 0 && (size_t) r < sizeof(headers));
+    bool ok = net_send_all(client->socket, headers, r) == r;
+
+    LOGD("Figma Bridge WebSocket client connected");
+
+    // The client is also checked periodically for incoming frames, to answer
+    // its pings and its close request
+    uint64_t last_seq = after;
+    bool state_sent = false;
+    enum sc_figma_bridge_device_state sent_state =
+        SC_FIGMA_BRIDGE_DEVICE_CONNECTING;
+    struct sc_size sent_size = {0, 0};
+    sc_tick next_ping = sc_tick_now() + SC_FIGMA_BRIDGE_WS_PING_INTERVAL;
+    while (ok) {
+        while (ok && net_wait_readable(client->socket, 0)) {
+            ok = sc_figma_bridge_ws_receive(client);
+        }
+        if (!ok) {
+            break;
+        }
+
+        sc_tick deadline =
+            MIN(next_ping, sc_tick_now() + SC_FIGMA_BRIDGE_WS_READ_INTERVAL);
+        sc_mutex_lock(&bridge->mutex);
+        while (bridge->running && bridge->store.sequence <= last_seq
+                && state_sent && bridge->device_state == sent_state
+                && bridge->frame_size.width == sent_size.width
+                && bridge->frame_size.height == sent_size.height) {
+            if (!sc_cond_timedwait(&bridge->cond, &bridge->mutex, deadline)) {
+                // timeout
+                break;
+            }
+        }
+        if (!bridge->running) {
+            sc_mutex_unlock(&bridge->mutex);
+            break;
+        }
+
+        enum sc_figma_bridge_device_state state = bridge->device_state;
+        struct sc_size size = bridge->frame_size;
+        struct sc_figma_bridge_snapshot *snapshot = NULL;
+        if (bridge->store.sequence > last_seq) {
+            // Send the snapshots one by one, the oldest first (those evicted
+            // from the history meanwhile are skipped)
+            last_seq = MAX(last_seq + 1, bridge->store.oldest_sequence);
+            snapshot = sc_figma_bridge_history_get(&bridge->store, last_seq);
+            if (snapshot) {
+                sc_figma_bridge_snapshot_ref(snapshot);
+            }
+        }
+        sc_mutex_unlock(&bridge->mutex);
+
+        if (!state_sent || state != sent_state) {
+            ok = sc_figma_bridge_ws_send_msg(client,
+                                       SC_FIGMA_BRIDGE_WS_MSG_DEVICE_STATE,
+                                       state, 0, 0, 0, NULL, 0);
+            state_sent = true;
+            sent_state = state;
+        }
+
+        if (ok && (size.width != sent_size.width
+                    || size.height != sent_size.height)) {
+            ok = sc_figma_bridge_ws_send_msg(client,
+                                             SC_FIGMA_BRIDGE_WS_MSG_VIDEO_SIZE,
+                                             0, size.width, size.height, 0,
+                                             NULL, 0);
+            sent_size = size;
+        }
+
+        if (snapshot) {
+            // The snapshot is immutable, it is sent without holding the mutex
+            ok = ok && sc_figma_bridge_ws_send_msg(client,
+                                             SC_FIGMA_BRIDGE_WS_MSG_SCREENSHOT,
+                                             0, snapshot->width,
+                                             snapshot->height,
+                                             snapshot->sequence,
+                                             snapshot->png_data,
+                                             snapshot->png_size);
+            sc_figma_bridge_snapshot_unref(snapshot);
+        }
+
+        sc_tick now = sc_tick_now();
+        if (ok && now >= next_ping) {
+            ok = sc_figma_bridge_ws_send(client, 0x9, NULL, 0, NULL, 0);
+            next_ping = now + SC_FIGMA_BRIDGE_WS_PING_INTERVAL;
+        }
+    }
+
+    LOGD("Figma Bridge WebSocket client disconnected");
+
+    sc_mutex_lock(&bridge->mutex);
+    assert(bridge->ws_clients);
+    --bridge->ws_clients;
+    sc_mutex_unlock(&bridge->mutex);
+}
+
+static void
+sc_figma_bridge_respond_clip(struct sc_figma_bridge *bridge,
+                             struct sc_figma_bridge_client *client) {
+    sc_mutex_lock(&bridge->mutex);
+    struct sc_figma_bridge_fragment *clip =
+        bridge->clip ? sc_figma_bridge_fragment_ref(bridge->clip) : NULL;
+    uint64_t seq = bridge->clip_sequence;
+    sc_mutex_unlock(&bridge->mutex);
+
+    if (!clip) {
+        sc_figma_bridge_send_response(client, 204, "No Content", "video/mp4",
+                                      NULL);
+        return;
+    }
+
+    if (sc_figma_bridge_respond_not_modified(bridge, client, seq)) {
+        sc_figma_bridge_fragment_unref(clip);
+        return;
+    }
+
+    char extra_headers[128];
+    snprintf(extra_headers, sizeof(extra_headers),
+             "Access-Control-Expose-Headers: X-Scrcpy-Seq\r\n"
+             "X-Scrcpy-Seq: %" PRIu64 "\r\n", seq);
+
+    bool ok = sc_figma_bridge_send_headers_ex(client, 200, "OK", "video/mp4",
+                                              clip->size, extra_headers)
+           && sc_figma_bridge_send_fragment(client, clip);
+    if (!ok) {
+        LOGW("Could not write Figma Bridge clip payload");
+        client->keep_alive = false;
+    }
+
+    sc_figma_bridge_fragment_unref(clip);
+}
+
+static void
+sc_figma_bridge_respond_surface(struct sc_figma_bridge *bridge,
+                                struct sc_figma_bridge_client *client) {
+    sc_mutex_lock(&bridge->mutex);
+    uint64_t seq = bridge->surface_sequence;
+    uint32_t id = bridge->surface_id;
+    uint16_t width = bridge->surface_width;
+    uint16_t height = bridge->surface_height;
+    int64_t pts = bridge->surface_pts;
+    sc_mutex_unlock(&bridge->mutex);
+
+    if (!seq) {
+        sc_figma_bridge_send_response(client, 204, "No Content",
+                                      "application/json", NULL);
+        return;
+    }
+
+    char body[160];
+    snprintf(body, sizeof(body),
+             "{\"seq\":%" PRIu64 ",\"id\":%" PRIu32 ",\"width\":%u,"
+             "\"height\":%u,\"pts\":%" PRIi64 "}\n",
+             seq, id, width, height, pts);
+    sc_figma_bridge_send_response(client, 200, "OK", "application/json", body);
+}
+
+static void
+sc_figma_bridge_respond_input(struct sc_figma_bridge *bridge,
+                              struct sc_figma_bridge_client *client,
+                              const char *body, const char *query) {
+    uint64_t wait = 1;
+    if (!sc_figma_bridge_parse_query_u64(query, "wait", &wait)) {
+        sc_figma_bridge_send_response(client, 400, "Bad Request",
+                                      "text/plain; charset=utf-8",
+                                      "Invalid wait parameter\n");
+        return;
+    }
+
+    sc_mutex_lock(&bridge->mutex);
+    struct sc_size frame_size = bridge->frame_size;
+    sc_mutex_unlock(&bridge->mutex);
+
+    if (!frame_size.width || !frame_size.height) {
+        sc_figma_bridge_send_response(client, 503, "Service Unavailable",
+                                      "text/plain; charset=utf-8",
+                                      "No video frame yet\n");
+        return;
+    }
+
+    // Parse the whole batch before pushing anything, so that an invalid
+    // batch is not partially injected
+    struct sc_bridge_input_msgs msgs = SC_VECTOR_INITIALIZER;
+    const char *error;
+    if (!sc_bridge_input_parse(body, frame_size, &msgs, &error)) {
+        sc_bridge_input_msgs_destroy(&msgs);
+        char text[128];
+        snprintf(text, sizeof(text), "%s\n", error);
+        sc_figma_bridge_send_response(client, 400, "Bad Request",
+                                      "text/plain; charset=utf-8", text);
+        return;
+    }
+
+    // Batches from several clients must not be interleaved
+    sc_mutex_lock(&bridge->input_mutex);
+    struct sc_controller *controller = bridge->controller;
+    if (!controller) {
+        sc_mutex_unlock(&bridge->input_mutex);
+        sc_bridge_input_msgs_destroy(&msgs);
+        sc_figma_bridge_send_response(client, 503, "Service Unavailable",
+                                      "text/plain; charset=utf-8",
+                                      "Device not connected\n");
+        return;
+    }
+
+    // On success, the ownership of the msgs is transferred to the controller
+    size_t count = msgs.size;
+    size_t pushed = 0;
+    while (pushed < count
+            && sc_controller_push_msg(controller, &msgs.data[pushed])) {
+        ++pushed;
+    }
+    bool complete = pushed == count;
+
+    uint64_t sequence = SC_SEQUENCE_INVALID;
+    sc_tick start = sc_tick_now();
+    if (complete && wait) {
+        // Acknowledged by the device once all the msgs are injected
+        uint64_t next = bridge->input_sequence + 1;
+        if (sc_controller_push_input_probe(controller, next)) {
+            bridge->input_sequence = next;
+            sequence = next;
+        }
+    }
+    sc_mutex_unlock(&bridge->input_mutex);
+
+    for (size_t i = pushed; i < count; ++i) {
+        sc_control_msg_destroy(&msgs.data[i]);
+    }
+    sc_vector_destroy(&msgs);
+
+    if (!complete) {
+        LOGW("Figma Bridge input batch truncated (%" SC_PRIsizet "/%"
+             SC_PRIsizet " msgs queued)", pushed, count);
+        sc_figma_bridge_send_response(client, 503, "Service Unavailable",
+                                      "text/plain; charset=utf-8",
+                                      "Control queue full\n");
+        return;
+    }
+
+    bool acked = false;
+    if (sequence != SC_SEQUENCE_INVALID) {
+        enum sc_acksync_wait_result r =
+            sc_acksync_wait(&bridge->input_acksync, sequence,
+                            start + SC_FIGMA_BRIDGE_INPUT_ACK_TIMEOUT);
+        acked = r == SC_ACKSYNC_WAIT_OK;
+    }
+
+    char latency[32] = "null";
+    if (acked) {
+        snprintf(latency, sizeof(latency), "%" PRIi64,
+                 SC_TICK_TO_US(sc_tick_now() - start));
+    }
+
+    char text[128];
+    snprintf(text, sizeof(text),
+             "{\"msgs\":%" SC_PRIsizet ",\"acked\":%s,\"latency_us\":%s}\n",
+             pushed, acked ? "true" : "false", latency);
+    sc_figma_bridge_send_response(client, 200, "OK", "application/json", text);
+}
+
+static const struct sc_figma_bridge_metric {
+    enum sc_stat stat;
+    const char *name;
+    const char *help;
+    bool microseconds; // exported in seconds
+} sc_figma_bridge_metrics[] = {
+    {SC_STAT_VIDEO_PACKETS, "scrcpy_video_packets_total",
+     "Video packets received", false},
+    {SC_STAT_VIDEO_BYTES, "scrcpy_video_bytes_total",
+     "Video bytes received", false},
+    {SC_STAT_AUDIO_BYTES, "scrcpy_audio_bytes_total",
+     "Audio bytes received", false},
+    {SC_STAT_VIDEO_PACKETS_DROPPED, "scrcpy_video_packets_dropped_total",
+     "Video packets dropped by the decoder while waiting for a keyframe",
+     false},
+    {SC_STAT_FRAMES_DECODED, "scrcpy_frames_decoded_total",
+     "Video frames decoded", false},
+    {SC_STAT_DECODE_TIME_US, "scrcpy_decode_seconds_total",
+     "Time spent decoding video frames", true},
+    {SC_STAT_FRAMES_RENDERED, "scrcpy_frames_rendered_total",
+     "Video frames rendered", false},
+    {SC_STAT_FRAMES_SKIPPED, "scrcpy_frames_skipped_total",
+     "Video frames replaced before being rendered", false},
+    {SC_STAT_FRAMES_REPEATED, "scrcpy_frames_repeated_total",
+     "Video frames identical to the previous one, not rendered again",
+     false},
+    {SC_STAT_CONTROLLER_QUEUE, "scrcpy_controller_queue",
+     "Control messages waiting to be sent", false},
+    {SC_STAT_RECORDER_QUEUE, "scrcpy_recorder_queue",
+     "Packets waiting to be recorded", false},
+    {SC_STAT_RECORDER_QUEUE_BYTES, "scrcpy_recorder_queue_bytes",
+     "Memory held by the packets waiting to be recorded", false},
+    {SC_STAT_DELAY_BUFFER_BYTES, "scrcpy_delay_buffer_bytes",
+     "Memory held by the delay buffers", false},
+};
+
+static bool
+sc_figma_bridge_append_metric(struct sc_strbuf *buf,
+                              const struct sc_figma_bridge_metric *metric,
+                              uint64_t value) {
+    bool counter = metric->stat < SC_STAT_FIRST_GAUGE;
+    char item[256];
+    int r = snprintf(item, sizeof(item), "# HELP %s %s\n# TYPE %s %s\n%s ",
+                     metric->name, metric->help, metric->name,
+                     counter ? "counter" : "gauge", metric->name);
+    assert(r > 0 && (size_t) r < sizeof(item));
+    if (!sc_strbuf_append(buf, item, r)) {
+        return false;
+    }
+
+    if (metric->microseconds) {
+        r = snprintf(item, sizeof(item), "%" PRIu64 ".%06" PRIu64 "\n",
+                     value / 1000000, value % 1000000);
+    } else {
+        r = snprintf(item, sizeof(item), "%" PRIu64 "\n", value);
+    }
+    assert(r > 0 && (size_t) r < sizeof(item));
+    return sc_strbuf_append(buf, item, r);
+}
+
+static bool
+sc_figma_bridge_append_latency(struct sc_strbuf *buf) {
+    static const struct {
+        enum sc_stat stat;
+        const char *quantile;
+    } quantiles[] = {
+        {SC_STAT_LATENCY_P50_US, "0.5"},
+        {SC_STAT_LATENCY_P95_US, "0.95"},
+        {SC_STAT_LATENCY_P99_US, "0.99"},
+    };
+
+    uint32_t values[ARRAY_LEN(quantiles)];
+    bool available = false;
+    for (size_t i = 0; i < ARRAY_LEN(quantiles); ++i) {
+        values[i] = sc_stats_get(quantiles[i].stat);
+        available |= values[i] != 0;
+    }
+    if (!available) {
+        // Only measured with --print-latency
+        return true;
+    }
+
+    bool ok = sc_strbuf_append_staticstr(buf,
+        "# HELP scrcpy_latency_seconds Reception to present latency over the "
+            "last frames\n"
+        "# TYPE scrcpy_latency_seconds gauge\n");
+    if (!ok) {
+        return false;
+    }
+
+    for (size_t i = 0; i < ARRAY_LEN(quantiles); ++i) {
+        char item[128];
+        int r = snprintf(item, sizeof(item),
+                         "scrcpy_latency_seconds{quantile=\"%s\"} "
+                             "%" PRIu32 ".%06" PRIu32 "\n",
+                         quantiles[i].quantile, values[i] / 1000000,
+                         values[i] % 1000000);
+        assert(r > 0 && (size_t) r < sizeof(item));
+        if (!sc_strbuf_append(buf, item, r)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+sc_figma_bridge_append_thermal(struct sc_strbuf *buf) {
+    // The values are stored + 1 (0 if not reported by the device)
+    uint32_t status = sc_stats_get(SC_STAT_THERMAL_STATUS);
+    if (!status) {
+        return true;
+    }
+
+    uint32_t headroom = sc_stats_get(SC_STAT_THERMAL_HEADROOM_PCT);
+    uint32_t level = sc_stats_get(SC_STAT_THERMAL_THROTTLE);
+
+    char item[512];
+    int r = snprintf(item, sizeof(item),
+        "# HELP scrcpy_thermal_status Android thermal status of the device\n"
+        "# TYPE scrcpy_thermal_status gauge\n"
+        "scrcpy_thermal_status %" PRIu32 "\n"
+        "# HELP scrcpy_thermal_throttle_level Encoding throttle level applied "
+            "by the server\n"
+        "# TYPE scrcpy_thermal_throttle_level gauge\n"
+        "scrcpy_thermal_throttle_level %" PRIu32 "\n",
+        status - 1, level ? level - 1 : 0);
+    assert(r > 0 && (size_t) r < sizeof(item));
+    if (!sc_strbuf_append(buf, item, r)) {
+        return false;
+    }
+
+    if (headroom) {
+        r = snprintf(item, sizeof(item),
+            "# HELP scrcpy_thermal_headroom Forecasted thermal headroom of the "
+                "device (1 means throttled)\n"
+            "# TYPE scrcpy_thermal_headroom gauge\n"
+            "scrcpy_thermal_headroom %" PRIu32 ".%02" PRIu32 "\n",
+            (headroom - 1) / 100, (headroom - 1) % 100);
+        assert(r > 0 && (size_t) r < sizeof(item));
+        if (!sc_strbuf_append(buf, item, r)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void
+sc_figma_bridge_respond_metrics(struct sc_figma_bridge *bridge,
+                                struct sc_figma_bridge_client *client) {
+    uint64_t values[SC_STAT_COUNT];
+
+    sc_mutex_lock(&bridge->mutex);
+    for (unsigned i = 0; i < SC_STAT_FIRST_GAUGE; ++i) {
+        uint32_t value = sc_stats_get(i);
+        // Unsigned arithmetic handles the wrapping (as long as the counter
+        // does not wrap twice between two requests)
+        uint32_t delta = value - bridge->metrics_last[i];
+        bridge->metrics_totals[i] += delta;
+        bridge->metrics_last[i] = value;
+        values[i] = bridge->metrics_totals[i];
+    }
+    sc_mutex_unlock(&bridge->mutex);
+
+    for (unsigned i = SC_STAT_FIRST_GAUGE; i < SC_STAT_COUNT; ++i) {
+        values[i] = sc_stats_get(i);
+    }
+
+    struct sc_strbuf buf;
+    if (!sc_strbuf_init(&buf, 2048)) {
+        sc_figma_bridge_send_response(client, 500, "Internal Server Error",
+                                      "text/plain; charset=utf-8",
+                                      "Out of memory\n");
+        return;
+    }
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < ARRAY_LEN(sc_figma_bridge_metrics); ++i) {
+        const struct sc_figma_bridge_metric *metric =
+            &sc_figma_bridge_metrics[i];
+        ok = sc_figma_bridge_append_metric(&buf, metric, values[metric->stat]);
+    }
+
+    if (ok) {
+        ok = sc_figma_bridge_append_latency(&buf);
+    }
+
+    if (ok) {
+        ok = sc_figma_bridge_append_thermal(&buf);
+    }
+
+    if (!ok) {
+        free(buf.s);
+        sc_figma_bridge_send_response(client, 500, "Internal Server Error",
+                                      "text/plain; charset=utf-8",
+                                      "Out of memory\n");
+        return;
+    }
+
+    sc_figma_bridge_send_response(client, 200, "OK",
+                                  "text/plain; version=0.0.4; charset=utf-8",
+                                  buf.s);
+    free(buf.s);
+}
+
+// If `line` is the header `name` (case-insensitive), return its value
+static const char *
+sc_figma_bridge_header_value(const char *line, const char *name) {
+    size_t i = 0;
+    for (; name[i]; ++i) {
+        if (tolower((unsigned char) line[i]) != name[i]) {
+            return NULL;
+        }
+    }
+    if (line[i] != ':') {
+        return NULL;
+    }
+
+    const char *value = &line[i + 1];
+    while (*value == ' ' || *value == '\t') {
+        ++value;
+    }
+    return value;
+}
+
+// Return true if the comma-separated header value contains `token`
+// (case-insensitive)
+static bool
+sc_figma_bridge_header_has_token(const char *value, const char *token) {
+    size_t token_len = strlen(token);
+    const char *p = value;
+    while (*p) {
+        while (*p == ' ' || *p == '\t' || *p == ',') {
+            ++p;
+        }
+        size_t i = 0;
+        while (i < token_len && p[i]
+                && tolower((unsigned char) p[i]) == token[i]) {
+            ++i;
+        }
+        if (i == token_len && (!p[i] || p[i] == ',' || p[i] == ' '
+                                     || p[i] == '\t' || p[i] == '\r')) {
+            return true;
+        }
+        p = strchr(p, ',');
+        if (!p) {
+            break;
+        }
+    }
+    return false;
+}
+
+// Read until a full request head (request line and headers) is buffered
+//
+// Return the length of the head (including the terminating empty line), or 0
+// if the connection is closed, times out or fails.
+static size_t
+sc_figma_bridge_read_request(struct sc_figma_bridge_client *client,
+                             bool idle) {
+    bool idle_timeout = false;
+    for (;;) {
+        client->buf[client->len] = '\0';
+        char *end = strstr(client->buf, "\r\n\r\n");
+        if (end) {
+            return (size_t) (end - client->buf) + 4;
+        }
+        end = strstr(client->buf, "\n\n");
+        if (end) {
+            return (size_t) (end - client->buf) + 2;
+        }
+
+        if (client->len == SC_FIGMA_BRIDGE_REQUEST_MAX) {
+            client->keep_alive = false;
+            sc_figma_bridge_send_response(client, 431,
+                                      "Request Header Fields Too Large",
+                                      "text/plain; charset=utf-8",
+                                      "Request too large\n");
+            return 0;
+        }
+
+        // Between two requests on a persistent connection, wait at most for
+        // the idle timeout
+        bool want_idle_timeout = idle && !client->len;
+        if (want_idle_timeout != idle_timeout) {
+            sc_tick timeout = want_idle_timeout
+                    ? SC_TICK_FROM_SEC(SC_FIGMA_BRIDGE_IDLE_TIMEOUT_SEC)
+                    : SC_FIGMA_BRIDGE_IO_TIMEOUT;
+            if (!net_set_timeout(client->socket, timeout)) {
+                return 0;
+            }
+            idle_timeout = want_idle_timeout;
+        }
+
+        ssize_t r = net_recv(client->socket, &client->buf[client->len],
+                             SC_FIGMA_BRIDGE_REQUEST_MAX - client->len);
+        if (r <= 0) {
+            return 0;
+        }
+        client->len += r;
+
+        if (idle_timeout) {
+            if (!net_set_timeout(client->socket, SC_FIGMA_BRIDGE_IO_TIMEOUT)) {
+                return 0;
+            }
+            idle_timeout = false;
+        }
+    }
+}
+
+// Read the request body of `len` bytes, starting with the bytes already
+// buffered after the head (of `head_len` bytes)
+//
+// The number of bytes consumed from client->buf is written to *consumed.
+// Return the body (NUL-terminated, to be freed by free()), or NULL on error.
+static char *
+sc_figma_bridge_read_body(struct sc_figma_bridge_client *client,
+                          size_t head_len, size_t len, bool expect_continue,
+                          size_t *consumed) {
+    assert(head_len <= client->len);
+    char *body = malloc(len + 1);
+    if (!body) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    size_t buffered = MIN(client->len - head_len, len);
+    memcpy(body, &client->buf[head_len], buffered);
+    *consumed = head_len + buffered;
+
+    if (buffered < len) {
+        if (expect_continue) {
+            static const char cont[] = "HTTP/1.1 100 Continue\r\n\r\n";
+            ssize_t w = net_send_all(client->socket, cont, sizeof(cont) - 1);
+            if (w != sizeof(cont) - 1) {
+                free(body);
+                return NULL;
+            }
+        }
+
+        // The remaining bytes are received directly into the body
+        size_t remaining = len - buffered;
+        ssize_t r = net_recv_all(client->socket, body + buffered, remaining);
+        if (r < 0 || (size_t) r != remaining) {
+            free(body);
+            return NULL;
+        }
+    }
+
+    body[len] = '\0';
+    return body;
+}
+
+// The mutex must be locked
+static struct sc_figma_bridge_remote_device *
+sc_figma_bridge_find_remote(struct sc_figma_bridge *bridge,
+                            const char *serial) {
+    for (unsigned i = 0; i < SC_FIGMA_BRIDGE_MAX_REMOTE_DEVICES; ++i) {
+        struct sc_figma_bridge_remote_device *remote = &bridge->remotes[i];
+        if (!strcmp(remote->serial, serial)) {
+            return remote;
+        }
+    }
+    return NULL;
+}
+
+// Find the remote device, or register it in a free slot (or in the slot of
+// the device disconnected for the longest time)
+//
+// Return NULL if all the slots are used by connected devices.
+//
+// The mutex must be locked.
+static struct sc_figma_bridge_remote_device *
+sc_figma_bridge_register_remote(struct sc_figma_bridge *bridge,
+                                const char *serial) {
+    struct sc_figma_bridge_remote_device *remote =
+        sc_figma_bridge_find_remote(bridge, serial);
+    if (remote) {
+        return remote;
+    }
+
+    for (unsigned i = 0; i < SC_FIGMA_BRIDGE_MAX_REMOTE_DEVICES; ++i) {
+        struct sc_figma_bridge_remote_device *candidate = &bridge->remotes[i];
+        if (!candidate->serial[0]) {
+            remote = candidate;
+            break;
+        }
+        if (!candidate->connected
+                && (!remote || candidate->last_update < remote->last_update)) {
+            remote = candidate;
+        }
+    }
+
+    if (!remote) {
+        return NULL;
+    }
+
+    if (remote->serial[0]) {
+        LOGI("Figma Bridge: device %s replaced by %s", remote->serial, serial);
+        sc_figma_bridge_store_clear(&remote->store);
+    } else {
+        LOGI("Figma Bridge: device %s registered", serial);
+    }
+
+    size_t len = strlen(serial);
+    assert(len < sizeof(remote->serial));
+    memcpy(remote->serial, serial, len + 1);
+    remote->connected = false;
+    remote->last_update = sc_tick_now();
+    ++bridge->devices_generation;
+    return remote;
+}
+
+// Publish a screenshot of the device of another instance
+static void
+sc_figma_bridge_respond_publish(struct sc_figma_bridge *bridge,
+                                struct sc_figma_bridge_client *client,
+                                const char *serial, const char *query,
+                                const char *body, size_t body_len) {
+    uint64_t width = 0;
+    uint64_t height = 0;
+    bool ok = sc_figma_bridge_parse_query_u64(query, "width", &width)
+           && sc_figma_bridge_parse_query_u64(query, "height", &height);
+    if (!ok || !width || width > UINT16_MAX || !height || height > UINT16_MAX
+            || !body_len) {
+        sc_figma_bridge_send_response(client, 400, "Bad Request",
+                                      "text/plain; charset=utf-8",
+                                      "Invalid screenshot\n");
+        return;
+    }
+
+    struct sc_figma_bridge_snapshot *snapshot =
+        sc_figma_bridge_snapshot_new((const uint8_t *) body, body_len,
+                                     width, height);
+    if (!snapshot) {
+        sc_figma_bridge_send_response(client, 500, "Internal Server Error",
+                                      "text/plain; charset=utf-8",
+                                      "Out of memory\n");
+        return;
+    }
+
+    sc_mutex_lock(&bridge->mutex);
+    struct sc_figma_bridge_remote_device *remote =
+        sc_figma_bridge_register_remote(bridge, serial);
+    if (remote) {
+        // A connected device is never replaced, the slot remains valid
+        remote->connected = true;
+        remote->last_update = sc_tick_now();
+    }
+    sc_mutex_unlock(&bridge->mutex);
+
+    if (!remote) {
+        sc_figma_bridge_snapshot_unref(snapshot);
+        sc_figma_bridge_send_response(client, 503, "Service Unavailable",
+                                      "text/plain; charset=utf-8",
+                                      "Too many devices\n");
+        return;
+    }
+
+    uint64_t seq = sc_figma_bridge_store_push(bridge, &remote->store, snapshot);
+    LOGD("Figma Bridge queued screenshot #%" PRIu64 " of %s (%" SC_PRIsizet
+         " bytes)", seq, serial, body_len);
+
+    char json[64];
+    int r = snprintf(json, sizeof(json), "{\"seq\":%" PRIu64 "}", seq);
+    assert(r > 0 && (size_t) r < sizeof(json));
+    sc_figma_bridge_send_response(client, 200, "OK",
+                                  "application/json; charset=utf-8", json);
+}
+
+static void
+sc_figma_bridge_respond_disconnect(struct sc_figma_bridge *bridge,
+                                   struct sc_figma_bridge_client *client,
+                                   const char *serial) {
+    sc_mutex_lock(&bridge->mutex);
+    struct sc_figma_bridge_remote_device *remote =
+        sc_figma_bridge_find_remote(bridge, serial);
+    if (remote && remote->connected) {
+        remote->connected = false;
+        remote->last_update = sc_tick_now();
+        ++bridge->devices_generation;
+        sc_cond_broadcast(&bridge->cond);
+    }
+    sc_mutex_unlock(&bridge->mutex);
+
+    if (!remote) {
+        sc_figma_bridge_send_response(client, 404, "Not Found",
+                                      "text/plain; charset=utf-8",
+                                      "Unknown device\n");
+        return;
+    }
+
+    sc_figma_bridge_send_response(client, 204, "No Content",
+                                  "text/plain; charset=utf-8", NULL);
+}
+
+// List the devices whose screenshots are served
+//
+// With ?after=<generation>, wait up to ?wait=<ms> for a change (a new
+// screenshot of any device, a device added or disconnected).
+static void
+sc_figma_bridge_respond_devices(struct sc_figma_bridge *bridge,
+                                struct sc_figma_bridge_client *client,
+                                const char *query) {
+    uint64_t after;
+    sc_tick wait;
+    const char *value;
+    size_t value_len;
+    bool has_after = sc_figma_bridge_find_query_param(query, "after", &value,
+                                                      &value_len);
+    bool ok = sc_figma_bridge_parse_snapshot_query(query, &after, &wait);
+    if (!ok) {
+        sc_figma_bridge_send_response(client, 400, "Bad Request",
+                                      "text/plain; charset=utf-8",
+                                      "Invalid query\n");
+        return;
+    }
+
+    struct sc_strbuf buf;
+    if (!sc_strbuf_init(&buf, 256)) {
+        sc_figma_bridge_send_response(client, 500, "Internal Server Error",
+                                      "text/plain; charset=utf-8",
+                                      "Out of memory\n");
+        return;
+    }
+
+    char item[SC_FIGMA_BRIDGE_SERIAL_SIZE + 96];
+
+    sc_mutex_lock(&bridge->mutex);
+    if (has_after && wait > 0 && bridge->devices_generation <= after
+            && sc_figma_bridge_long_poll_begin(bridge)) {
+        sc_tick deadline = sc_tick_now() + wait;
+        while (bridge->running && bridge->devices_generation <= after) {
+            if (!sc_cond_timedwait(&bridge->cond, &bridge->mutex, deadline)) {
+                // timeout
+                break;
+            }
+        }
+        sc_figma_bridge_long_poll_end(bridge);
+    }
+
+    uint64_t generation = bridge->devices_generation;
+    bool changed = !has_after || generation > after;
+    if (changed) {
+        int r = snprintf(item, sizeof(item),
+                         "{\"generation\":%" PRIu64 ",\"devices\":[",
+                         generation);
+        assert(r > 0 && (size_t) r < sizeof(item));
+        ok = sc_strbuf_append(&buf, item, r);
+
+        bool first = true;
+        if (ok && bridge->serial[0]) {
+            bool connected =
+                bridge->device_state == SC_FIGMA_BRIDGE_DEVICE_CONNECTED;
+            r = snprintf(item, sizeof(item),
+                         "{\"serial\":\"%s\",\"local\":true,"
+                             "\"connected\":%s,\"latest\":%" PRIu64 "}",
+                         bridge->serial, connected ? "true" : "false",
+                         bridge->store.sequence);
+            assert(r > 0 && (size_t) r < sizeof(item));
+            ok = sc_strbuf_append(&buf, item, r);
+            first = false;
+        }
+
+        for (unsigned i = 0; ok && i < SC_FIGMA_BRIDGE_MAX_REMOTE_DEVICES;
+                ++i) {
+            struct sc_figma_bridge_remote_device *remote = &bridge->remotes[i];
+            if (!remote->serial[0]) {
+                continue;
+            }
+            r = snprintf(item, sizeof(item),
+                         "%s{\"serial\":\"%s\",\"local\":false,"
+                             "\"connected\":%s,\"latest\":%" PRIu64 "}",
+                         first ? "" : ",", remote->serial,
+                         remote->connected ? "true" : "false",
+                         remote->store.sequence);
+            assert(r > 0 && (size_t) r < sizeof(item));
+            ok = sc_strbuf_append(&buf, item, r);
+            first = false;
+        }
+    }
+    sc_mutex_unlock(&bridge->mutex);
+
+    if (ok && changed) {
+        ok = sc_strbuf_append_staticstr(&buf, "]}");
+    }
+
+    if (!ok) {
+        free(buf.s);
+        sc_figma_bridge_send_response(client, 500, "Internal Server Error",
+                                      "text/plain; charset=utf-8",
+                                      "Out of memory\n");
+        return;
+    }
+
+    if (!changed) {
+        free(buf.s);
+        sc_figma_bridge_send_response(client, 204, "No Content",
+                                      "application/json", NULL);
+        return;
+    }
+
+    sc_figma_bridge_send_response(client, 200, "OK",
+                                  "application/json; charset=utf-8", buf.s);
+    free(buf.s);
+}
+
+// Serve /scrcpy-bridge/<serial>/<endpoint> for the device of another instance
+// (only its screenshots are available)
+static void
+sc_figma_bridge_route_remote_request(struct sc_figma_bridge *bridge,
+                                     struct sc_figma_bridge_client *client,
+                                     bool post, const char *serial,
+                                     const char *endpoint, const char *query,
+                                     const char *body, size_t body_len) {
+    if (post) {
+        // Already authenticated (see sc_figma_bridge_is_relay_authorized())
+        if (!strcmp(endpoint, "publish")) {
+            sc_figma_bridge_respond_publish(bridge, client, serial, query,
+                                            body, body_len);
+        } else if (!strcmp(endpoint, "disconnect")) {
+            sc_figma_bridge_respond_disconnect(bridge, client, serial);
+        } else {
+            sc_figma_bridge_send_response(client, 405, "Method Not Allowed",
+                                          "text/plain; charset=utf-8",
+                                          "Only GET is supported\n");
+        }
+        return;
+    }
+
+    sc_mutex_lock(&bridge->mutex);
+    struct sc_figma_bridge_remote_device *remote =
+        sc_figma_bridge_find_remote(bridge, serial);
+    sc_mutex_unlock(&bridge->mutex);
+
+    if (!remote) {
+        sc_figma_bridge_send_response(client, 404, "Not Found",
+                                      "text/plain; charset=utf-8",
+                                      "Unknown device\n");
+        return;
+    }
+
+    struct sc_figma_bridge_store *store = &remote->store;
+    if (!strcmp(endpoint, "latest")) {
+        sc_figma_bridge_respond_latest(bridge, store, client, query);
+    } else if (!strcmp(endpoint, "latest.png")) {
+        sc_figma_bridge_respond_latest_png(bridge, store, client, query);
+    } else if (!strcmp(endpoint, "since")) {
+        sc_figma_bridge_respond_since(bridge, store, client, query);
+    } else if (!strcmp(endpoint, "snapshot.png")) {
+        sc_figma_bridge_respond_snapshot_png(bridge, store, client, query);
+    } else {
+        sc_figma_bridge_send_response(client, 404, "Not Found",
+                                      "text/plain; charset=utf-8",
+                                      "Not found\n");
+    }
+}
+
+// Whether the path of `uri` (possibly with a query) ends with `suffix`
+static bool
+sc_figma_bridge_uri_has_suffix(const char *uri, const char *suffix) {
+    size_t suffix_len = strlen(suffix);
+    size_t len = strcspn(uri, "?");
+    return len > suffix_len
+        && !strncmp(&uri[len - suffix_len], suffix, suffix_len);
+}
+
+// Whether `uri` (possibly with a query) is the input endpoint, of the device
+// of this instance or under a device serial
+static bool
+sc_figma_bridge_is_input_uri(const char *uri) {
+    return sc_figma_bridge_uri_has_suffix(uri, "/input");
+}
+
+// Whether the current request may inject input events: sent by a local
+// process (no Origin header) or by the Figma plugin
+static bool
+sc_figma_bridge_is_input_origin_allowed(
+        const struct sc_figma_bridge_client *client) {
+    if (!client->has_origin) {
+        return true;
+    }
+
+    for (size_t i = 0; i < ARRAY_LEN(sc_figma_bridge_input_origins); ++i) {
+        if (!strcmp(client->origin, sc_figma_bridge_input_origins[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void
+sc_figma_bridge_route_request(struct sc_figma_bridge *bridge,
+                              struct sc_figma_bridge_client *client,
+                              const char *method, char *uri,
+                              const char *body, size_t body_len) {
+    if (!strcmp(method, "OPTIONS")) {
+        // Only the Figma plugin may post input events from a web page (a
+        // JSON body requires this preflight request), everything else is
+        // read-only
+        const char *allow = sc_figma_bridge_is_input_uri(uri)
+                         && sc_figma_bridge_is_input_origin_allowed(client)
+            ? "Access-Control-Allow-Methods: POST, OPTIONS\r\n"
+              "Access-Control-Allow-Headers: Content-Type\r\n"
+            : "Access-Control-Allow-Methods: GET, OPTIONS\r\n"
+              "Access-Control-Allow-Headers: If-None-Match\r\n";
+        char extra_headers[256];
+        int r = snprintf(extra_headers, sizeof(extra_headers),
+                         "%sAccess-Control-Max-Age: "
+                             SC_STR(SC_FIGMA_BRIDGE_PREFLIGHT_MAX_AGE) "\r\n",
+                         allow);
+        assert(r > 0 && (size_t) r < sizeof(extra_headers));
+        (void) r;
+        sc_figma_bridge_send_headers_ex(client, 204, "No Content",
+                                        "text/plain; charset=utf-8", 0,
+                                        extra_headers);
+        return;
+    }
+
+    bool post = !strcmp(method, "POST");
+    if (strcmp(method, "GET") && !post) {
+        sc_figma_bridge_send_response(client, 405, "Method Not Allowed",
+                                      "text/plain; charset=utf-8",
+                                      "Only GET and POST are supported\n");
+        return;
+    }
+
+    char *query = strchr(uri, '?');
+    if (query) {
+        *query = '\0';
+        ++query;
+    }
+
+    // /scrcpy-bridge/<serial>/<endpoint> targets a specific device
+    static const char prefix[] = "/scrcpy-bridge/";
+    if (!strncmp(uri, prefix, sizeof(prefix) - 1)) {
+        char *name = &uri[sizeof(prefix) - 1];
+        char *slash = strchr(name, '/');
+        if (slash) {
+            size_t serial_len = slash - name;
+            if (!sc_figma_bridge_is_valid_serial(name, serial_len)) {
+                sc_figma_bridge_send_response(client, 404, "Not Found",
+                                              "text/plain; charset=utf-8",
+                                              "Unknown device\n");
+                return;
+            }
+
+            char serial[SC_FIGMA_BRIDGE_SERIAL_SIZE];
+            memcpy(serial, name, serial_len);
+            serial[serial_len] = '\0';
+
+            sc_mutex_lock(&bridge->mutex);
+            bool local = !strcmp(serial, bridge->serial);
+            sc_mutex_unlock(&bridge->mutex);
+
+            if (!local) {
+                sc_figma_bridge_route_remote_request(bridge, client, post,
+                                                     serial, slash + 1, query,
+                                                     body, body_len);
+                return;
+            }
+
+            // The device of this instance, serve /scrcpy-bridge/<endpoint>
+            memmove(name, slash + 1, strlen(slash + 1) + 1);
+        }
+    }
+
+    if (!strcmp(uri, "/scrcpy-bridge/input")) {
+        if (!post) {
+            sc_figma_bridge_send_response(client, 405, "Method Not Allowed",
+                                          "text/plain; charset=utf-8",
+                                          "Only POST is supported\n");
+            return;
+        }
+        if (!sc_figma_bridge_is_input_origin_allowed(client)) {
+            LOGW("Figma Bridge: input rejected from origin %s",
+                 client->origin[0] ? client->origin : "(too long)");
+            sc_figma_bridge_send_response(client, 403, "Forbidden",
+                                          "text/plain; charset=utf-8",
+                                          "Origin not allowed\n");
+            return;
+        }
+        if (!client->json_body) {
+            // A web page can only post JSON after a preflight request, which
+            // the other origins do not pass
+            sc_figma_bridge_send_response(client, 415,
+                                          "Unsupported Media Type",
+                                          "text/plain; charset=utf-8",
+                                          "Content-Type must be "
+                                              "application/json\n");
+            return;
+        }
+        sc_figma_bridge_respond_input(bridge, client, body, query);
+        return;
+    }
+
+    if (post) {
+        sc_figma_bridge_send_response(client, 405, "Method Not Allowed",
+                                      "text/plain; charset=utf-8",
+                                      "Only GET is supported\n");
+        return;
+    }
+
+    if (!strcmp(uri, "/scrcpy-bridge/health")) {
+        sc_figma_bridge_send_response(client, 200, "OK",
+                                      "text/plain; charset=utf-8",
+                                      "ok\n");
+        return;
+    }
+
+    if (!strcmp(uri, "/scrcpy-bridge/devices")) {
+        sc_figma_bridge_respond_devices(bridge, client, query);
+        return;
+    }
+
+    if (!strcmp(uri, "/scrcpy-bridge/latest")) {
+        sc_figma_bridge_respond_latest(bridge, &bridge->store, client, query);
+        return;
+    }
+
+    if (!strcmp(uri, "/scrcpy-bridge/latest.png")) {
+        sc_figma_bridge_respond_latest_png(bridge, &bridge->store, client,
+                                           query);
+        return;
+    }
+
+    if (!strcmp(uri, "/scrcpy-bridge/since")) {
+        sc_figma_bridge_respond_since(bridge, &bridge->store, client, query);
+        return;
+    }
+
+    if (!strcmp(uri, "/scrcpy-bridge/snapshot.png")) {
+        sc_figma_bridge_respond_snapshot_png(bridge, &bridge->store, client,
+                                             query);
+        return;
+    }
+
+    if (!strcmp(uri, "/scrcpy-bridge/metrics")) {
+        sc_figma_bridge_respond_metrics(bridge, client);
+        return;
+    }
+
+    if (!strcmp(uri, "/scrcpy-bridge/stream.mp4")) {
+        sc_figma_bridge_respond_stream(bridge, client);
+        return;
+    }
+
+    if (!strcmp(uri, "/scrcpy-bridge/clip.mp4")) {
+        sc_figma_bridge_respond_clip(bridge, client);
+        return;
+    }
+
+    if (!strcmp(uri, "/scrcpy-bridge/surface")) {
+        sc_figma_bridge_respond_surface(bridge, client);
+        return;
+    }
+
+    if (!strcmp(uri, "/scrcpy-bridge/ws")) {
+        sc_figma_bridge_respond_ws(bridge, client, query);
+        return;
+    }
+
+    sc_figma_bridge_send_response(client, 404, "Not Found",
+                                  "text/plain; charset=utf-8", "Not found\n");
+}
+
+// Whether the request is sent by another instance, to publish a screenshot of
+// its device (its body is much larger than the body of the other requests) or
+// to notify its disconnection
+static bool
+sc_figma_bridge_is_relay_request(const char *method, const char *uri) {
+    return !strcmp(method, "POST")
+        && (sc_figma_bridge_uri_has_suffix(uri, "/publish")
+            || sc_figma_bridge_uri_has_suffix(uri, "/disconnect"));
+}
+
+// Whether the current request is authenticated as sent by another instance:
+// not from a web page, and with the secret of this bridge
+static bool
+sc_figma_bridge_is_relay_authorized(
+        const struct sc_figma_bridge *bridge,
+        const struct sc_figma_bridge_client *client) {
+    if (client->has_origin) {
+        return false;
+    }
+
+    // Compare in constant time, not to leak the secret through timing
+    unsigned char diff = 0;
+    for (unsigned i = 0; i < SC_FIGMA_BRIDGE_RELAY_SECRET_LEN; ++i) {
+        diff |= client->relay_secret[i] ^ bridge->relay_secret[i];
+    }
+    return !diff;
+}
+
+// Handle the request whose head (of `head_len` bytes) is at the start of
+// client->buf
+//
+// Return the number of bytes of client->buf consumed by the request (its head
+// and the buffered part of its body).
+static size_t
+sc_figma_bridge_handle_request(struct sc_figma_bridge *bridge,
+                               struct sc_figma_bridge_client *client,
+                               size_t head_len) {
+    // Parse the head as a NUL-terminated string, but save the byte
+    // overwritten by the NUL terminator: it belongs to the body or to the
+    // next pipelined request, if any
+    char next = client->buf[head_len];
+    client->buf[head_len] = '\0';
+
+    char *req = client->buf;
+    char *line_end = strchr(req, '\n');
+    assert(line_end);
+    *line_end = '\0';
+    char *headers = line_end + 1;
+
+    char method[8];
+    char uri[1024];
+    char version[16];
+    int n = sscanf(req, "%7s %1023s %15s", method, uri, version);
+    if (n < 2) {
+        client->keep_alive = false;
+        sc_figma_bridge_send_response(client, 400, "Bad Request",
+                                      "text/plain; charset=utf-8",
+                                      "Malformed request line\n");
+        return head_len;
+    }
+
+    // HTTP/1.1 connections are persistent by default, not HTTP/1.0 ones
+    bool keep_alive = n == 3 && !strcmp(version, "HTTP/1.1");
+    uint64_t content_length = 0;
+    bool invalid_length = false;
+    bool chunked = false;
+    bool expect_continue = false;
+
+    char *line = headers;
+    while (*line) {
+        char *next_line = strchr(line, '\n');
+        if (next_line) {
+            *next_line++ = '\0';
+        } else {
+            next_line = line + strlen(line);
+        }
+
+        const char *value = sc_figma_bridge_header_value(line, "connection");
+        if (value) {
+            if (sc_figma_bridge_header_has_token(value, "close")) {
+                keep_alive = false;
+            } else if (sc_figma_bridge_header_has_token(value, "keep-alive")) {
+                keep_alive = true;
+            }
+        }
+
+        value = sc_figma_bridge_header_value(line, "content-length");
+        if (value) {
+            char *endptr;
+            content_length = strtoull(value, &endptr, 10);
+            if (!isdigit((unsigned char) *value)
+                    || (*endptr && *endptr != '\r')) {
+                invalid_length = true;
+            }
+        }
+
+        value = sc_figma_bridge_header_value(line, "transfer-encoding");
+        if (value) {
+            chunked = true;
+        }
+
+        value = sc_figma_bridge_header_value(line, "if-none-match");
+        if (value) {
+            size_t len = strcspn(value, "\r");
+            if (len < sizeof(client->if_none_match)) {
+                memcpy(client->if_none_match, value, len);
+                client->if_none_match[len] = '\0';
+            }
+        }
+
+        value = sc_figma_bridge_header_value(line, "upgrade");
+        if (value && sc_figma_bridge_header_has_token(value, "websocket")) {
+            client->ws_upgrade = true;
+        }
+
+        value = sc_figma_bridge_header_value(line, "sec-websocket-key");
+        if (value) {
+            // The base64 of 16 random bytes
+            size_t len = strcspn(value, " \t\r");
+            if (len == 24) {
+                memcpy(client->ws_key, value, len);
+                client->ws_key[len] = '\0';
+            }
+        }
+
+        value = sc_figma_bridge_header_value(line, "origin");
+        if (value) {
+            client->has_origin = true;
+            size_t len = strcspn(value, " \t\r");
+            if (len < sizeof(client->origin)) {
+                memcpy(client->origin, value, len);
+                client->origin[len] = '\0';
+            }
+        }
+
+        value = sc_figma_bridge_header_value(line, "content-type");
+        if (value) {
+            // The media type is case-insensitive, and may have parameters
+            static const char json[] = "application/json";
+            size_t len = strcspn(value, "; \t\r");
+            bool match = len == sizeof(json) - 1;
+            for (size_t i = 0; match && i < len; ++i) {
+                match = tolower((unsigned char) value[i]) == json[i];
+            }
+            client->json_body = match;
+        }
+
+        value = sc_figma_bridge_header_value(line, "x-scrcpy-relay-secret");
+        if (value) {
+            size_t len = strcspn(value, " \t\r");
+            if (len == SC_FIGMA_BRIDGE_RELAY_SECRET_LEN) {
+                memcpy(client->relay_secret, value, len);
+                client->relay_secret[len] = '\0';
+            }
+        }
+
+        value = sc_figma_bridge_header_value(line, "expect");
+        if (value && sc_figma_bridge_header_has_token(value, "100-continue")) {
+            expect_continue = true;
+        }
+
+        line = next_line;
+    }
+
+    // The head has been parsed
+    client->buf[head_len] = next;
+
+    if (!keep_alive) {
+        client->keep_alive = false;
+    }
+
+    if (client->keep_alive) {
+        sc_mutex_lock(&bridge->mutex);
+        // Do not hold a worker with an idle connection while other clients
+        // are waiting for one (or while stopping)
+        if (!bridge->running || !sc_vecdeque_is_empty(&bridge->pending)) {
+            client->keep_alive = false;
+        }
+        sc_mutex_unlock(&bridge->mutex);
+    }
+
+    // Without a valid length, the end of the body (and the start of the next
+    // request) could not be located
+    if (invalid_length || chunked) {
+        client->keep_alive = false;
+        sc_figma_bridge_send_response(client, 411, "Length Required",
+                                      "text/plain; charset=utf-8",
+                                      "A valid Content-Length is required\n");
+        return head_len;
+    }
+
+    bool relay = sc_figma_bridge_is_relay_request(method, uri);
+    if (relay && !sc_figma_bridge_is_relay_authorized(bridge, client)) {
+        // Rejected before receiving the (possibly large) body
+        LOGW("Figma Bridge: rejected unauthenticated request %s", uri);
+        client->keep_alive = false;
+        sc_figma_bridge_send_response(client, 403, "Forbidden",
+                                      "text/plain; charset=utf-8",
+                                      "Forbidden\n");
+        return head_len;
+    }
+
+    uint64_t body_max = relay ? SC_FIGMA_BRIDGE_PUBLISH_BODY_MAX
+                              : SC_FIGMA_BRIDGE_BODY_MAX;
+    if (content_length > body_max) {
+        client->keep_alive = false;
+        sc_figma_bridge_send_response(client, 413, "Content Too Large",
+                                      "text/plain; charset=utf-8",
+                                      "Request body too large\n");
+        return head_len;
+    }
+
+    size_t consumed = head_len;
+    char *body = NULL;
+    if (content_length) {
+        body = sc_figma_bridge_read_body(client, head_len,
+                                         (size_t) content_length,
+                                         expect_continue, &consumed);
+        if (!body) {
+            client->keep_alive = false;
+            return consumed;
+        }
+    }
+
+    sc_figma_bridge_route_request(bridge, client, method, uri,
+                                  body ? body : "", (size_t) content_length);
+    free(body);
+
+    return consumed;
+}
+
+static void
+sc_figma_bridge_handle_client(struct sc_figma_bridge *bridge,
+                              struct sc_figma_bridge_client *client) {
+    client->keep_alive = true;
+    client->len = 0;
+
+    bool idle = false;
+    while (client->keep_alive) {
+        client->if_none_match[0] = '\0';
+        client->etag[0] = '\0';
+        client->ws_upgrade = false;
+        client->ws_key[0] = '\0';
+        client->has_origin = false;
+        client->origin[0] = '\0';
+        client->json_body = false;
+        client->relay_secret[0] = '\0';
+
+        size_t head_len = sc_figma_bridge_read_request(client, idle);
+        if (!head_len) {
+            break;
+        }
+
+        size_t consumed =
+            sc_figma_bridge_handle_request(bridge, client, head_len);
+        assert(consumed <= client->len);
+
+        // Keep the pipelined requests received after this one
+        client->len -= consumed;
+        memmove(client->buf, &client->buf[consumed], client->len);
+        idle = true;
+    }
+}
+
+static int
+sc_figma_bridge_run_worker(void *userdata) {
+    struct sc_figma_bridge_worker *worker = userdata;
+    struct sc_figma_bridge *bridge = worker->bridge;
+    struct sc_figma_bridge_client conn;
+
+    for (;;) {
+        sc_mutex_lock(&bridge->mutex);
+        while (bridge->running && sc_vecdeque_is_empty(&bridge->pending)) {
+            sc_cond_wait(&bridge->pending_cond, &bridge->mutex);
+        }
+        if (!bridge->running) {
+            sc_mutex_unlock(&bridge->mutex);
+            break;
+        }
+        sc_socket client = sc_vecdeque_pop(&bridge->pending);
+        worker->client = client;
+        sc_mutex_unlock(&bridge->mutex);
+
+        conn.socket = client;
+        sc_tick start = sc_trace_begin();
+        sc_figma_bridge_handle_client(bridge, &conn);
+        sc_trace_end("figma request", start);
+
+        sc_mutex_lock(&bridge->mutex);
+        worker->client = SC_SOCKET_NONE;
+        sc_mutex_unlock(&bridge->mutex);
+
+        if (!net_close(client)) {
+            LOGW("Could not close Figma Bridge client socket");
+        }
+    }
+
+    return 0;
+}
+
 static int
 sc_figma_bridge_run(void *userdata) {
     struct sc_figma_bridge *bridge = userdata;
 
-    LOGI("Figma Bridge listening on http://127.0.0.1:%u/scrcpy-bridge/latest",
+    LOGI("Figma Bridge listening on http://127.0.0.1:%u/scrcpy-bridge/latest.png",
          (unsigned) bridge->port);
 
     for (;;) {
@@ -365,16 +2878,127 @@ sc_figma_bridge_run(void *userdata) {
             continue;
         }
 
-        sc_figma_bridge_handle_client(bridge, client);
+        if (!net_set_timeout(client, SC_FIGMA_BRIDGE_IO_TIMEOUT)) {
+            LOGW("Could not set Figma Bridge client socket timeout");
+        }
+
+        sc_mutex_lock(&bridge->mutex);
+        bool running = bridge->running;
+        bool full = sc_vecdeque_size(&bridge->pending)
+                        >= SC_FIGMA_BRIDGE_MAX_PENDING;
+        if (running && !full) {
+            // The capacity is reserved on init, this may not fail
+            sc_vecdeque_push_noresize(&bridge->pending, client);
+            sc_cond_signal(&bridge->pending_cond);
+        }
+        sc_mutex_unlock(&bridge->mutex);
+
+        if (running && !full) {
+            continue;
+        }
+
+        if (full) {
+            LOGW("Figma Bridge overloaded, client rejected");
+            struct sc_figma_bridge_client rejected = {
+                .socket = client,
+                .keep_alive = false,
+            };
+            sc_figma_bridge_send_response(&rejected, 503, "Service Unavailable",
+                                          "text/plain; charset=utf-8",
+                                          "Too many clients\n");
+        }
         if (!net_close(client)) {
             LOGW("Could not close Figma Bridge client socket");
         }
+        if (!running) {
+            break;
+        }
     }
 
     LOGD("Figma Bridge stopped");
     return 0;
 }
 
+char *
+sc_figma_bridge_get_relay_secret_path(uint16_t port) {
+    char *dir = SDL_GetPrefPath("Genymobile", "scrcpy");
+    if (!dir) {
+        LOGW("Could not get preferences directory: %s", SDL_GetError());
+        return NULL;
+    }
+
+    // The directory ends with a path separator
+    size_t size = strlen(dir) + sizeof("figma-bridge-65535.secret");
+    char *path = malloc(size);
+    if (!path) {
+        LOG_OOM();
+        SDL_free(dir);
+        return NULL;
+    }
+
+    int r = snprintf(path, size, "%sfigma-bridge-%u.secret", dir,
+                     (unsigned) port);
+    assert(r > 0 && (size_t) r < size);
+    (void) r;
+    SDL_free(dir);
+    return path;
+}
+
+static void
+sc_figma_bridge_generate_relay_secret(char *secret) {
+    uint8_t bytes[SC_FIGMA_BRIDGE_RELAY_SECRET_LEN / 2];
+    bool ok = false;
+#ifndef _WIN32
+    // sc_rand is only seeded by the current time, which could be guessed
+    FILE *file = fopen("/dev/urandom", "rb");
+    if (file) {
+        ok = fread(bytes, 1, sizeof(bytes), file) == sizeof(bytes);
+        fclose(file);
+    }
+#endif
+    if (!ok) {
+        struct sc_rand rand;
+        sc_rand_init(&rand);
+        for (size_t i = 0; i < sizeof(bytes); ++i) {
+            bytes[i] = sc_rand_u32(&rand);
+        }
+    }
+
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < sizeof(bytes); ++i) {
+        secret[2 * i] = hex[bytes[i] >> 4];
+        secret[2 * i + 1] = hex[bytes[i] & 0xF];
+    }
+    secret[SC_FIGMA_BRIDGE_RELAY_SECRET_LEN] = '\0';
+}
+
+static bool
+sc_figma_bridge_write_relay_secret(const char *path, const char *secret) {
+#ifdef _WIN32
+    // The preferences directory is private to the user
+    FILE *file = fopen(path, "w");
+#else
+    // Replace any file left by a previous run (its permissions are not
+    // trusted), the new one is readable by the user only
+    unlink(path);
+    FILE *file = NULL;
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd != -1) {
+        file = fdopen(fd, "w");
+        if (!file) {
+            close(fd);
+        }
+    }
+#endif
+    if (!file) {
+        return false;
+    }
+
+    bool ok = fputs(secret, file) >= 0;
+    ok &= !fclose(file);
+    return ok;
+}
+
 bool
 sc_figma_bridge_init(struct sc_figma_bridge *bridge, uint16_t port) {
     bool ok = sc_mutex_init(&bridge->mutex);
@@ -382,29 +3006,138 @@ sc_figma_bridge_init(struct sc_figma_bridge *bridge, uint16_t port) {
         return false;
     }
 
+    ok = sc_cond_init(&bridge->cond);
+    if (!ok) {
+        sc_mutex_destroy(&bridge->mutex);
+        return false;
+    }
+
+    ok = sc_cond_init(&bridge->pending_cond);
+    if (!ok) {
+        sc_cond_destroy(&bridge->cond);
+        sc_mutex_destroy(&bridge->mutex);
+        return false;
+    }
+
+    ok = sc_cond_init(&bridge->stream_cond);
+    if (!ok) {
+        sc_cond_destroy(&bridge->pending_cond);
+        sc_cond_destroy(&bridge->cond);
+        sc_mutex_destroy(&bridge->mutex);
+        return false;
+    }
+
+    ok = sc_mutex_init(&bridge->input_mutex);
+    if (!ok) {
+        goto error_destroy_stream_cond;
+    }
+
+    ok = sc_acksync_init(&bridge->input_acksync);
+    if (!ok) {
+        goto error_destroy_input_mutex;
+    }
+
+    sc_vecdeque_init(&bridge->pending);
+    if (!sc_vecdeque_reserve(&bridge->pending, SC_FIGMA_BRIDGE_MAX_PENDING)) {
+        LOG_OOM();
+        goto error_destroy_input_acksync;
+    }
+
+    for (unsigned i = 0; i < SC_FIGMA_BRIDGE_WORKERS; ++i) {
+        bridge->workers[i].bridge = bridge;
+        bridge->workers[i].client = SC_SOCKET_NONE;
+    }
+    bridge->worker_count = 0;
+
     bridge->running = false;
     bridge->port = port;
-    bridge->sequence = 0;
-    bridge->png_data = NULL;
-    bridge->png_size = 0;
-    bridge->width = 0;
-    bridge->height = 0;
+    bridge->serial[0] = '\0';
+    sc_figma_bridge_store_init(&bridge->store,
+                               SC_FIGMA_BRIDGE_HISTORY_MAX_BYTES);
+    for (unsigned i = 0; i < SC_FIGMA_BRIDGE_MAX_REMOTE_DEVICES; ++i) {
+        bridge->remotes[i].serial[0] = '\0';
+        bridge->remotes[i].connected = false;
+        sc_figma_bridge_store_init(&bridge->remotes[i].store,
+                                   SC_FIGMA_BRIDGE_REMOTE_HISTORY_MAX_BYTES);
+    }
+    bridge->long_polls = 0;
+    bridge->devices_generation = 0;
+    bridge->next_snapshot_id = 1;
+    for (unsigned i = 0; i < SC_FIGMA_BRIDGE_VARIANT_CACHE_SIZE; ++i) {
+        bridge->variants[i].image = NULL;
+    }
+    bridge->next_variant = 0;
+    bridge->stream_init = NULL;
+    for (unsigned i = 0; i < SC_FIGMA_BRIDGE_STREAM_FRAGMENTS; ++i) {
+        bridge->stream_fragments[i] = NULL;
+    }
+    bridge->stream_sequence = 0;
+    bridge->stream_ended = false;
+    bridge->stream_viewers = 0;
+    bridge->ws_clients = 0;
+    bridge->stream_keyframe_requested = false;
+    bridge->clip = NULL;
+    bridge->clip_sequence = 0;
+    bridge->surface_sequence = 0;
+    bridge->instance_id = (uint32_t) time(NULL);
+    bridge->frame_size = (struct sc_size) {0, 0};
+    bridge->device_state = SC_FIGMA_BRIDGE_DEVICE_CONNECTING;
+    bridge->controller = NULL;
+    bridge->input_sequence = 0;
+    for (unsigned i = 0; i < SC_STAT_FIRST_GAUGE; ++i) {
+        uint32_t value = sc_stats_get(i);
+        bridge->metrics_last[i] = value;
+        bridge->metrics_totals[i] = value;
+    }
 
     sc_socket server_socket = net_socket();
     if (server_socket == SC_SOCKET_NONE) {
-        sc_mutex_destroy(&bridge->mutex);
-        return false;
+        goto error_destroy_pending;
     }
 
     ok = net_listen(server_socket, IPV4_LOCALHOST, port, SC_FIGMA_BRIDGE_BACKLOG);
     if (!ok) {
         net_close(server_socket);
-        sc_mutex_destroy(&bridge->mutex);
-        return false;
+        goto error_destroy_pending;
     }
 
     bridge->server_socket = server_socket;
+
+    // Only written once the port is bound, the file of the instance serving
+    // the bridge must not be replaced
+    sc_figma_bridge_generate_relay_secret(bridge->relay_secret);
+    bridge->relay_secret_path = sc_figma_bridge_get_relay_secret_path(port);
+    if (bridge->relay_secret_path
+            && !sc_figma_bridge_write_relay_secret(bridge->relay_secret_path,
+                                                   bridge->relay_secret)) {
+        LOGW("Could not write %s, other instances could not publish to the "
+             "Figma Bridge", bridge->relay_secret_path);
+        free(bridge->relay_secret_path);
+        bridge->relay_secret_path = NULL;
+    }
+
     return true;
+
+error_destroy_pending:
+    sc_vecdeque_destroy(&bridge->pending);
+error_destroy_input_acksync:
+    sc_acksync_destroy(&bridge->input_acksync);
+error_destroy_input_mutex:
+    sc_mutex_destroy(&bridge->input_mutex);
+error_destroy_stream_cond:
+    sc_cond_destroy(&bridge->stream_cond);
+    sc_cond_destroy(&bridge->pending_cond);
+    sc_cond_destroy(&bridge->cond);
+    sc_mutex_destroy(&bridge->mutex);
+    return false;
+}
+
+static void
+sc_figma_bridge_join_workers(struct sc_figma_bridge *bridge) {
+    for (unsigned i = 0; i < bridge->worker_count; ++i) {
+        sc_thread_join(&bridge->workers[i].thread, NULL);
+    }
+    bridge->worker_count = 0;
 }
 
 bool
@@ -414,17 +3147,33 @@ sc_figma_bridge_start(struct sc_figma_bridge *bridge) {
     bridge->running = true;
     sc_mutex_unlock(&bridge->mutex);
 
+    for (unsigned i = 0; i < SC_FIGMA_BRIDGE_WORKERS; ++i) {
+        struct sc_figma_bridge_worker *worker = &bridge->workers[i];
+        bool ok = sc_thread_create(&worker->thread, sc_figma_bridge_run_worker,
+                                   "scrcpy-figma-w", worker);
+        if (!ok) {
+            LOGE("Could not start Figma Bridge worker thread");
+            goto error;
+        }
+        ++bridge->worker_count;
+    }
+
     bool ok = sc_thread_create(&bridge->thread, sc_figma_bridge_run,
-                               "scrcpy-figma-bridge", bridge);
+                               "scrcpy-figma", bridge);
     if (!ok) {
-        sc_mutex_lock(&bridge->mutex);
-        bridge->running = false;
-        sc_mutex_unlock(&bridge->mutex);
         LOGE("Could not start Figma Bridge thread");
-        return false;
+        goto error;
     }
 
     return true;
+
+error:
+    sc_mutex_lock(&bridge->mutex);
+    bridge->running = false;
+    sc_cond_broadcast(&bridge->pending_cond);
+    sc_mutex_unlock(&bridge->mutex);
+    sc_figma_bridge_join_workers(bridge);
+    return false;
 }
 
 void
@@ -435,10 +3184,30 @@ sc_figma_bridge_stop(struct sc_figma_bridge *bridge) {
         return;
     }
     bridge->running = false;
+    // Wake up idle workers and long-polling clients
+    sc_cond_broadcast(&bridge->pending_cond);
+    sc_cond_broadcast(&bridge->cond);
+    sc_cond_broadcast(&bridge->stream_cond);
+    // Interrupt clients blocked in send() or recv()
+    for (unsigned i = 0; i < bridge->worker_count; ++i) {
+        if (bridge->workers[i].client != SC_SOCKET_NONE) {
+            net_interrupt(bridge->workers[i].client);
+        }
+    }
     sc_mutex_unlock(&bridge->mutex);
 
+    // Wake up the clients waiting for an input acknowledgment
+    sc_acksync_interrupt(&bridge->input_acksync);
+
     net_interrupt(bridge->server_socket);
     sc_thread_join(&bridge->thread, NULL);
+    sc_figma_bridge_join_workers(bridge);
+
+    // Close the clients which have not been served
+    while (!sc_vecdeque_is_empty(&bridge->pending)) {
+        sc_socket client = sc_vecdeque_pop(&bridge->pending);
+        net_close(client);
+    }
 }
 
 void
@@ -446,14 +3215,50 @@ sc_figma_bridge_destroy(struct sc_figma_bridge *bridge) {
     net_close(bridge->server_socket);
     bridge->server_socket = SC_SOCKET_NONE;
 
-    sc_mutex_lock(&bridge->mutex);
-    free(bridge->png_data);
-    bridge->png_data = NULL;
-    bridge->png_size = 0;
-    bridge->width = 0;
-    bridge->height = 0;
-    sc_mutex_unlock(&bridge->mutex);
+    if (bridge->relay_secret_path) {
+        // Best effort, the file is replaced by the next instance anyway
+        remove(bridge->relay_secret_path);
+        free(bridge->relay_secret_path);
+    }
+
+    sc_figma_bridge_store_clear(&bridge->store);
+    for (unsigned i = 0; i < SC_FIGMA_BRIDGE_MAX_REMOTE_DEVICES; ++i) {
+        sc_figma_bridge_store_clear(&bridge->remotes[i].store);
+    }
+
+    for (unsigned i = 0; i < SC_FIGMA_BRIDGE_VARIANT_CACHE_SIZE; ++i) {
+        if (bridge->variants[i].image) {
+            sc_figma_bridge_snapshot_unref(bridge->variants[i].image);
+            bridge->variants[i].image = NULL;
+        }
+    }
+
+    if (bridge->stream_init) {
+        sc_figma_bridge_fragment_unref(bridge->stream_init);
+        bridge->stream_init = NULL;
+    }
+    for (unsigned i = 0; i < SC_FIGMA_BRIDGE_STREAM_FRAGMENTS; ++i) {
+        if (bridge->stream_fragments[i]) {
+            sc_figma_bridge_fragment_unref(bridge->stream_fragments[i]);
+            bridge->stream_fragments[i] = NULL;
+        }
+    }
 
+    if (bridge->clip) {
+        sc_figma_bridge_fragment_unref(bridge->clip);
+        bridge->clip = NULL;
+    }
+
+    assert(sc_vecdeque_is_empty(&bridge->pending));
+    sc_vecdeque_destroy(&bridge->pending);
+
+    assert(!bridge->controller);
+    sc_acksync_destroy(&bridge->input_acksync);
+    sc_mutex_destroy(&bridge->input_mutex);
+
+    sc_cond_destroy(&bridge->stream_cond);
+    sc_cond_destroy(&bridge->pending_cond);
+    sc_cond_destroy(&bridge->cond);
     sc_mutex_destroy(&bridge->mutex);
 }
 
@@ -464,28 +3269,187 @@ sc_figma_bridge_publish_png(struct sc_figma_bridge *bridge,
     assert(png_data);
     assert(png_size);
 
-    uint8_t *copy = malloc(png_size);
-    if (!copy) {
-        LOG_OOM();
+    // Copy outside the lock, the snapshot is never modified once published
+    struct sc_figma_bridge_snapshot *snapshot =
+        sc_figma_bridge_snapshot_new(png_data, png_size, width, height);
+    if (!snapshot) {
         return false;
     }
-    memcpy(copy, png_data, png_size);
 
-    sc_mutex_lock(&bridge->mutex);
-    free(bridge->png_data);
-    bridge->png_data = copy;
-    bridge->png_size = png_size;
-    bridge->width = width;
-    bridge->height = height;
-    ++bridge->sequence;
-    uint64_t seq = bridge->sequence;
-    sc_mutex_unlock(&bridge->mutex);
+    uint64_t seq = sc_figma_bridge_store_push(bridge, &bridge->store, snapshot);
 
     LOGI("Figma Bridge queued screenshot #%" PRIu64 " (%" SC_PRIsizet " bytes)",
          seq, png_size);
     return true;
 }
 
+bool
+sc_figma_bridge_publish_stream_init(struct sc_figma_bridge *bridge,
+                                    const uint8_t *data, size_t size) {
+    struct sc_figma_bridge_fragment *init =
+        sc_figma_bridge_fragment_new(data, size, false);
+    if (!init) {
+        return false;
+    }
+
+    sc_mutex_lock(&bridge->mutex);
+    assert(!bridge->stream_init);
+    bridge->stream_init = init;
+    sc_mutex_unlock(&bridge->mutex);
+
+    LOGI("Figma Bridge streaming video on "
+         "http://127.0.0.1:%u/scrcpy-bridge/stream.mp4",
+         (unsigned) bridge->port);
+    return true;
+}
+
+bool
+sc_figma_bridge_publish_stream_fragment(struct sc_figma_bridge *bridge,
+                                        const uint8_t *data, size_t size,
+                                        bool keyframe) {
+    // Copy outside the lock, the fragment is never modified once published
+    struct sc_figma_bridge_fragment *fragment =
+        sc_figma_bridge_fragment_new(data, size, keyframe);
+    if (!fragment) {
+        return false;
+    }
+
+    sc_mutex_lock(&bridge->mutex);
+    assert(bridge->stream_init);
+    uint64_t seq = ++bridge->stream_sequence;
+    unsigned index = seq % SC_FIGMA_BRIDGE_STREAM_FRAGMENTS;
+    // Viewers still sending it keep their own reference
+    struct sc_figma_bridge_fragment *evicted = bridge->stream_fragments[index];
+    bridge->stream_fragments[index] = fragment;
+    sc_cond_broadcast(&bridge->stream_cond);
+    sc_mutex_unlock(&bridge->mutex);
+
+    if (evicted) {
+        sc_figma_bridge_fragment_unref(evicted);
+    }
+
+    return true;
+}
+
+bool
+sc_figma_bridge_publish_clip(struct sc_figma_bridge *bridge,
+                             const uint8_t *data, size_t size) {
+    assert(data);
+    assert(size);
+
+    // Copy outside the lock, the clip is never modified once published
+    struct sc_figma_bridge_fragment *clip =
+        sc_figma_bridge_fragment_new(data, size, true);
+    if (!clip) {
+        return false;
+    }
+
+    sc_mutex_lock(&bridge->mutex);
+    // Clients still being served keep their own reference
+    struct sc_figma_bridge_fragment *previous = bridge->clip;
+    bridge->clip = clip;
+    ++bridge->clip_sequence;
+    sc_mutex_unlock(&bridge->mutex);
+
+    if (previous) {
+        sc_figma_bridge_fragment_unref(previous);
+    }
+
+    return true;
+}
+
+void
+sc_figma_bridge_publish_surface(struct sc_figma_bridge *bridge, uint32_t id,
+                                uint16_t width, uint16_t height, int64_t pts) {
+    sc_mutex_lock(&bridge->mutex);
+    bridge->surface_id = id;
+    bridge->surface_width = width;
+    bridge->surface_height = height;
+    bridge->surface_pts = pts;
+    ++bridge->surface_sequence;
+    sc_mutex_unlock(&bridge->mutex);
+}
+
+void
+sc_figma_bridge_end_stream(struct sc_figma_bridge *bridge) {
+    sc_mutex_lock(&bridge->mutex);
+    bridge->stream_ended = true;
+    sc_cond_broadcast(&bridge->stream_cond);
+    sc_mutex_unlock(&bridge->mutex);
+}
+
+bool
+sc_figma_bridge_take_keyframe_request(struct sc_figma_bridge *bridge) {
+    sc_mutex_lock(&bridge->mutex);
+    bool requested = bridge->stream_keyframe_requested;
+    bridge->stream_keyframe_requested = false;
+    sc_mutex_unlock(&bridge->mutex);
+    return requested;
+}
+
+void
+sc_figma_bridge_set_controller(struct sc_figma_bridge *bridge,
+                               struct sc_controller *controller) {
+    // Wait for the batch being pushed to the previous controller, if any
+    sc_mutex_lock(&bridge->input_mutex);
+    bridge->controller = controller;
+    sc_mutex_unlock(&bridge->input_mutex);
+}
+
+void
+sc_figma_bridge_set_frame_size(struct sc_figma_bridge *bridge,
+                               struct sc_size frame_size) {
+    sc_mutex_lock(&bridge->mutex);
+    bridge->frame_size = frame_size;
+    // Wake up the WebSocket clients
+    sc_cond_broadcast(&bridge->cond);
+    sc_mutex_unlock(&bridge->mutex);
+}
+
+void
+sc_figma_bridge_set_device_state(struct sc_figma_bridge *bridge,
+                                 enum sc_figma_bridge_device_state state) {
+    sc_mutex_lock(&bridge->mutex);
+    if (bridge->device_state != state) {
+        bridge->device_state = state;
+        // Listed by /scrcpy-bridge/devices
+        ++bridge->devices_generation;
+    }
+    // Wake up the WebSocket clients
+    sc_cond_broadcast(&bridge->cond);
+    sc_mutex_unlock(&bridge->mutex);
+}
+
+bool
+sc_figma_bridge_is_valid_serial(const char *serial, size_t len) {
+    if (!len || len >= SC_FIGMA_BRIDGE_SERIAL_SIZE) {
+        return false;
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        char c = serial[i];
+        if (!isalnum((unsigned char) c) && !strchr("._:-", c)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+sc_figma_bridge_set_serial(struct sc_figma_bridge *bridge, const char *serial) {
+    size_t len = strlen(serial);
+    if (!sc_figma_bridge_is_valid_serial(serial, len)) {
+        LOGW("Figma Bridge: device serial not usable in paths: %s", serial);
+        return;
+    }
+
+    sc_mutex_lock(&bridge->mutex);
+    memcpy(bridge->serial, serial, len + 1);
+    ++bridge->devices_generation;
+    sc_cond_broadcast(&bridge->cond);
+    sc_mutex_unlock(&bridge->mutex);
+}
+
 uint16_t
 sc_figma_bridge_get_port(const struct sc_figma_bridge *bridge) {
     return bridge->port;
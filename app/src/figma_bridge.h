@@ -7,22 +7,182 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "coords.h"
+#include "image_variant.h"
+#include "stats.h"
+#include "util/acksync.h"
 #include "util/net.h"
 #include "util/thread.h"
+#include "util/tick.h"
+#include "util/vecdeque.h"
 
-struct sc_figma_bridge {
+#define SC_FIGMA_BRIDGE_WORKERS 8
+// Number of recent snapshots kept for burst captures
+#define SC_FIGMA_BRIDGE_HISTORY_SIZE 32
+// Number of recent video fragments kept for the stream viewers (a viewer
+// lagging further behind is disconnected)
+#define SC_FIGMA_BRIDGE_STREAM_FRAGMENTS 64
+// Each stream viewer holds a worker, keep some for the other requests
+#define SC_FIGMA_BRIDGE_MAX_STREAMS (SC_FIGMA_BRIDGE_WORKERS - 2)
+// Each long-poll also holds a worker until it is answered (counted with the
+// stream viewers, the excess is answered immediately)
+#define SC_FIGMA_BRIDGE_MAX_LONG_POLLS (SC_FIGMA_BRIDGE_WORKERS - 2)
+// Number of downscaled/re-encoded snapshots kept (see ?scale=, ?max_width=
+// and ?format=)
+#define SC_FIGMA_BRIDGE_VARIANT_CACHE_SIZE 8
+// Size of the buffer of a device serial (in /scrcpy-bridge/<serial>/...)
+#define SC_FIGMA_BRIDGE_SERIAL_SIZE 64
+// Number of devices of other scrcpy instances whose screenshots may be
+// published to this bridge (see sc_figma_relay)
+#define SC_FIGMA_BRIDGE_MAX_REMOTE_DEVICES 8
+// Length of the secret authenticating the other instances (hexadecimal),
+// shared through a file readable by the user only (see
+// sc_figma_bridge_get_relay_secret_path())
+#define SC_FIGMA_BRIDGE_RELAY_SECRET_LEN 32
+
+// Immutable published screenshot, shared by reference between the publisher
+// and the clients being served (defined in figma_bridge.c)
+struct sc_figma_bridge_snapshot;
+// Immutable piece of the live video stream (defined in figma_bridge.c)
+struct sc_figma_bridge_fragment;
+
+struct sc_figma_bridge_client_queue SC_VECDEQUE(sc_socket);
+
+struct sc_controller;
+
+// State of the device connection, pushed to the WebSocket clients
+enum sc_figma_bridge_device_state {
+    SC_FIGMA_BRIDGE_DEVICE_CONNECTING,
+    SC_FIGMA_BRIDGE_DEVICE_CONNECTED,
+    SC_FIGMA_BRIDGE_DEVICE_DISCONNECTED,
+};
+
+struct sc_figma_bridge;
+
+struct sc_figma_bridge_variant_entry {
+    struct sc_image_variant variant;
+    // The variant image, owning one reference (its id and sequence are those
+    // of the source snapshot), or NULL if the entry is unused
+    struct sc_figma_bridge_snapshot *image;
+};
+
+// The recent snapshots of one device
+struct sc_figma_bridge_store {
+    uint64_t sequence; // sequence of the latest published snapshot
+    // Ring of the recent snapshots, each owning one reference: the snapshot
+    // #seq (if still available) is stored at index (seq % SIZE)
+    struct sc_figma_bridge_snapshot *history[SC_FIGMA_BRIDGE_HISTORY_SIZE];
+    uint64_t oldest_sequence; // sequence of the oldest snapshot in history
+    size_t history_bytes;
+    size_t max_history_bytes; // the latest is always kept
+};
+
+// Device of another scrcpy instance, which publishes its screenshots to this
+// bridge (the bridge port being already taken by this one)
+struct sc_figma_bridge_remote_device {
+    char serial[SC_FIGMA_BRIDGE_SERIAL_SIZE]; // "" if the slot is unused
+    // false once the instance has disconnected (its snapshots are kept until
+    // the slot is reused)
+    bool connected;
+    sc_tick last_update;
+    struct sc_figma_bridge_store store;
+};
+
+struct sc_figma_bridge_worker {
+    struct sc_figma_bridge *bridge;
     sc_thread thread;
+    // The client being served (SC_SOCKET_NONE if idle), so that stop() can
+    // interrupt it
+    sc_socket client;
+};
+
+struct sc_figma_bridge {
+    sc_thread thread; // accept thread
     sc_mutex mutex;
+    sc_cond cond; // signaled when a new snapshot is published
+    sc_cond pending_cond; // signaled when a client is queued
 
     sc_socket server_socket;
     bool running;
     uint16_t port;
+    // Distinguish the entity tags of this run from those of previous runs
+    uint32_t instance_id;
+
+    // Accepted clients waiting for a worker
+    struct sc_figma_bridge_client_queue pending;
+    struct sc_figma_bridge_worker workers[SC_FIGMA_BRIDGE_WORKERS];
+    unsigned worker_count; // number of started workers
+
+    // Serial of the device of this instance ("" until known)
+    char serial[SC_FIGMA_BRIDGE_SERIAL_SIZE];
+    // Snapshots of the device of this instance
+    struct sc_figma_bridge_store store;
+    // Devices of the other instances (/scrcpy-bridge/<serial>/...)
+    struct sc_figma_bridge_remote_device
+        remotes[SC_FIGMA_BRIDGE_MAX_REMOTE_DEVICES];
+    // Number of requests waiting for a change (see
+    // SC_FIGMA_BRIDGE_MAX_LONG_POLLS)
+    unsigned long_polls;
+    // Incremented on any change listed by /scrcpy-bridge/devices (a new
+    // snapshot of any device, a device added or disconnected)
+    uint64_t devices_generation;
+    // Identify the snapshots of all the devices (for the variant cache)
+    uint64_t next_snapshot_id;
+    // Secret required to publish to this bridge, and the file through which
+    // it is shared with the other instances (NULL if it could not be written)
+    char relay_secret[SC_FIGMA_BRIDGE_RELAY_SECRET_LEN + 1];
+    char *relay_secret_path;
+
+    // Cache of the variants produced on request, oldest replaced first
+    struct sc_figma_bridge_variant_entry
+        variants[SC_FIGMA_BRIDGE_VARIANT_CACHE_SIZE];
+    unsigned next_variant; // index of the next entry to replace
+
+    // 64-bit extension of the (wrapping) stats counters, updated on each
+    // /scrcpy-bridge/metrics request
+    uint32_t metrics_last[SC_STAT_FIRST_GAUGE];
+    uint64_t metrics_totals[SC_STAT_FIRST_GAUGE];
+
+    // Live fragmented MP4 stream (/scrcpy-bridge/stream.mp4)
+    sc_cond stream_cond; // signaled when a fragment is published
+    // Initialization segment (NULL until the stream is started)
+    struct sc_figma_bridge_fragment *stream_init;
+    // Ring of the recent fragments: the fragment #seq (if still available) is
+    // stored at index (seq % SIZE)
+    struct sc_figma_bridge_fragment *
+        stream_fragments[SC_FIGMA_BRIDGE_STREAM_FRAGMENTS];
+    uint64_t stream_sequence; // sequence of the latest published fragment
+    bool stream_ended;
+    unsigned stream_viewers;
+    // Each WebSocket client also holds a worker (counted with the stream
+    // viewers against SC_FIGMA_BRIDGE_MAX_STREAMS)
+    unsigned ws_clients;
+    // Set when a viewer waits for a keyframe to start
+    bool stream_keyframe_requested;
+
+    // Latest published clip (/scrcpy-bridge/clip.mp4), NULL if none
+    struct sc_figma_bridge_fragment *clip;
+    uint64_t clip_sequence;
+
+    // Latest frame shared in a surface (/scrcpy-bridge/surface), if
+    // surface_sequence is not 0
+    uint32_t surface_id;
+    uint16_t surface_width;
+    uint16_t surface_height;
+    int64_t surface_pts;
+    uint64_t surface_sequence;
 
-    uint64_t sequence;
-    uint8_t *png_data;
-    size_t png_size;
-    uint16_t width;
-    uint16_t height;
+    // Size of the video frames, in which the positions of the batched input
+    // events are expressed (0x0 until the first frame)
+    struct sc_size frame_size;
+    enum sc_figma_bridge_device_state device_state;
+
+    // Batched input events (POST /scrcpy-bridge/input)
+    sc_mutex input_mutex;
+    struct sc_controller *controller; // NULL if not connected
+    uint64_t input_sequence; // of the last probe pushed to the controller
+    // Acknowledgments of the probes, once the batches are injected
+    struct sc_acksync input_acksync;
 };
 
 bool
@@ -42,7 +202,107 @@ sc_figma_bridge_publish_png(struct sc_figma_bridge *bridge,
                             const uint8_t *png_data, size_t png_size,
                             uint16_t width, uint16_t height);
 
+/**
+ * Publish the initialization segment of the live video stream
+ *
+ * It must be called once, before any fragment.
+ */
+bool
+sc_figma_bridge_publish_stream_init(struct sc_figma_bridge *bridge,
+                                    const uint8_t *data, size_t size);
+
+/**
+ * Publish a fragment of the live video stream
+ *
+ * \param keyframe true if the fragment starts with a keyframe (a viewer may
+ *                 start from it)
+ */
+bool
+sc_figma_bridge_publish_stream_fragment(struct sc_figma_bridge *bridge,
+                                        const uint8_t *data, size_t size,
+                                        bool keyframe);
+
+/**
+ * Publish a video clip (a complete MP4 file), replacing the previous one
+ */
+bool
+sc_figma_bridge_publish_clip(struct sc_figma_bridge *bridge,
+                             const uint8_t *data, size_t size);
+
+/**
+ * Publish the id of the surface containing the latest frame (an IOSurface on
+ * macOS), for local processes to access the frame directly from the GPU
+ */
+void
+sc_figma_bridge_publish_surface(struct sc_figma_bridge *bridge, uint32_t id,
+                                uint16_t width, uint16_t height, int64_t pts);
+
+/**
+ * End the live video stream (the viewers are disconnected)
+ */
+void
+sc_figma_bridge_end_stream(struct sc_figma_bridge *bridge);
+
+/**
+ * Return true (once) if a new viewer waits for a keyframe
+ */
+bool
+sc_figma_bridge_take_keyframe_request(struct sc_figma_bridge *bridge);
+
+/**
+ * Set the controller to which the batched input events are pushed
+ *
+ * It may be NULL (the device is not connected). Once this function returns,
+ * the previous controller is not accessed anymore.
+ *
+ * The acknowledgments of the probes must be reported to
+ * bridge->input_acksync (see sc_controller_set_probe_acksync()).
+ */
+void
+sc_figma_bridge_set_controller(struct sc_figma_bridge *bridge,
+                               struct sc_controller *controller);
+
+/**
+ * Set the size of the video frames
+ *
+ * A change is pushed to the WebSocket clients (typically on device rotation).
+ */
+void
+sc_figma_bridge_set_frame_size(struct sc_figma_bridge *bridge,
+                               struct sc_size frame_size);
+
+/**
+ * Set the state of the device connection, pushed to the WebSocket clients
+ */
+void
+sc_figma_bridge_set_device_state(struct sc_figma_bridge *bridge,
+                                 enum sc_figma_bridge_device_state state);
+
+/**
+ * Set the serial of the device of this instance
+ *
+ * Its snapshots are then also available under /scrcpy-bridge/<serial>/.
+ */
+void
+sc_figma_bridge_set_serial(struct sc_figma_bridge *bridge, const char *serial);
+
+/**
+ * Check that the serial may be used in a bridge path
+ */
+bool
+sc_figma_bridge_is_valid_serial(const char *serial, size_t len);
+
 uint16_t
 sc_figma_bridge_get_port(const struct sc_figma_bridge *bridge);
 
+/**
+ * Return the path of the file containing the secret of the bridge listening
+ * on `port`, for the other instances to publish to it (see sc_figma_relay)
+ *
+ * The result must be freed by the caller using free(). It may return NULL on
+ * error.
+ */
+char *
+sc_figma_bridge_get_relay_secret_path(uint16_t port);
+
 #endif
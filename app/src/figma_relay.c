@@ -0,0 +1,211 @@
+#include "figma_relay.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/log.h"
+#include "util/net.h"
+#include "util/tick.h"
+
+// Timeout for each blocking operation, so that a stalled bridge cannot block
+// the screenshot worker (nor the exit) for long
+#define SC_FIGMA_RELAY_TIMEOUT SC_TICK_FROM_SEC(2)
+
+static sc_socket
+sc_figma_relay_connect(struct sc_figma_relay *relay) {
+    sc_socket socket = net_socket();
+    if (socket == SC_SOCKET_NONE) {
+        return SC_SOCKET_NONE;
+    }
+
+    if (!net_connect(socket, IPV4_LOCALHOST, relay->port)) {
+        net_close(socket);
+        return SC_SOCKET_NONE;
+    }
+
+    if (!net_set_timeout(socket, SC_FIGMA_RELAY_TIMEOUT)) {
+        net_close(socket);
+        return SC_SOCKET_NONE;
+    }
+
+    return socket;
+}
+
+// Send a request (on a new connection) and return the status code of the
+// response, or 0 on error
+static int
+sc_figma_relay_request(struct sc_figma_relay *relay, const char *method,
+                       const char *path, const char *content_type,
+                       const uint8_t *body, size_t body_len) {
+    char head[512];
+    int r = snprintf(head, sizeof(head),
+                     "%s %s HTTP/1.1\r\n"
+                     "Host: 127.0.0.1:%u\r\n"
+                     "Connection: close\r\n"
+                     "X-Scrcpy-Relay-Secret: %s\r\n"
+                     "Content-Type: %s\r\n"
+                     "Content-Length: %" SC_PRIsizet "\r\n"
+                     "\r\n",
+                     method, path, (unsigned) relay->port, relay->secret,
+                     content_type, body_len);
+    if (r < 0 || (size_t) r >= sizeof(head)) {
+        LOGE("Figma relay request too long");
+        return 0;
+    }
+
+    sc_socket socket = sc_figma_relay_connect(relay);
+    if (socket == SC_SOCKET_NONE) {
+        return 0;
+    }
+
+    int status = 0;
+    bool ok = net_send_all(socket, head, r) == r;
+    if (ok && body_len) {
+        ssize_t w = net_send_all(socket, body, body_len);
+        ok = w >= 0 && (size_t) w == body_len;
+    }
+
+    if (ok) {
+        // Only the status line is needed, the rest of the response is
+        // discarded by closing the connection
+        char line[64];
+        size_t len = 0;
+        while (len < sizeof(line) - 1 && !memchr(line, '\n', len)) {
+            ssize_t n = net_recv(socket, &line[len], sizeof(line) - 1 - len);
+            if (n <= 0) {
+                break;
+            }
+            len += n;
+        }
+        line[len] = '\0';
+
+        if (sscanf(line, "HTTP/1.%*c %d", &status) != 1) {
+            status = 0;
+        }
+    }
+
+    net_close(socket);
+    return status;
+}
+
+// Read the secret written by the bridge, required to publish to it
+static bool
+sc_figma_relay_read_secret(struct sc_figma_relay *relay) {
+    char *path = sc_figma_bridge_get_relay_secret_path(relay->port);
+    if (!path) {
+        return false;
+    }
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        LOGD("Could not open %s", path);
+        free(path);
+        return false;
+    }
+
+    size_t len = fread(relay->secret, 1, SC_FIGMA_BRIDGE_RELAY_SECRET_LEN,
+                       file);
+    fclose(file);
+    relay->secret[len] = '\0';
+
+    if (len != SC_FIGMA_BRIDGE_RELAY_SECRET_LEN) {
+        LOGW("Invalid Figma Bridge secret in %s", path);
+        free(path);
+        return false;
+    }
+
+    free(path);
+    return true;
+}
+
+bool
+sc_figma_relay_init(struct sc_figma_relay *relay, uint16_t port) {
+    relay->port = port;
+    relay->serial[0] = '\0';
+    relay->published = false;
+
+    if (!sc_figma_relay_read_secret(relay)) {
+        return false;
+    }
+
+    int status = sc_figma_relay_request(relay, "GET", "/scrcpy-bridge/health",
+                                        "text/plain", NULL, 0);
+    if (status != 200) {
+        return false;
+    }
+
+    bool ok = sc_mutex_init(&relay->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_figma_relay_destroy(struct sc_figma_relay *relay) {
+    if (relay->published) {
+        char path[sizeof(relay->serial) + 32];
+        int r = snprintf(path, sizeof(path), "/scrcpy-bridge/%s/disconnect",
+                         relay->serial);
+        assert(r > 0 && (size_t) r < sizeof(path));
+        (void) r;
+        // Best effort, the bridge may be gone
+        sc_figma_relay_request(relay, "POST", path, "text/plain", NULL, 0);
+    }
+
+    sc_mutex_destroy(&relay->mutex);
+}
+
+void
+sc_figma_relay_set_serial(struct sc_figma_relay *relay, const char *serial) {
+    size_t len = strlen(serial);
+    if (!sc_figma_bridge_is_valid_serial(serial, len)) {
+        LOGW("Figma relay: device serial not usable in paths: %s", serial);
+        return;
+    }
+
+    sc_mutex_lock(&relay->mutex);
+    memcpy(relay->serial, serial, len + 1);
+    sc_mutex_unlock(&relay->mutex);
+}
+
+bool
+sc_figma_relay_publish_png(struct sc_figma_relay *relay,
+                           const uint8_t *png_data, size_t png_size,
+                           uint16_t width, uint16_t height) {
+    char path[sizeof(relay->serial) + 64];
+
+    sc_mutex_lock(&relay->mutex);
+    bool has_serial = relay->serial[0];
+    int r = snprintf(path, sizeof(path),
+                     "/scrcpy-bridge/%s/publish?width=%u&height=%u",
+                     relay->serial, (unsigned) width, (unsigned) height);
+    sc_mutex_unlock(&relay->mutex);
+
+    if (!has_serial) {
+        LOGW("Figma relay: device serial unknown");
+        return false;
+    }
+    assert(r > 0 && (size_t) r < sizeof(path));
+
+    int status = sc_figma_relay_request(relay, "POST", path, "image/png",
+                                        png_data, png_size);
+    if (status != 200) {
+        if (status) {
+            LOGW("Figma relay: screenshot rejected by the bridge (HTTP %d)",
+                 status);
+        } else {
+            LOGW("Figma relay: bridge unreachable on port %u",
+                 (unsigned) relay->port);
+        }
+        return false;
+    }
+
+    // Only accessed from the screenshot worker thread, then on destroy
+    relay->published = true;
+    return true;
+}
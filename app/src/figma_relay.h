@@ -0,0 +1,59 @@
+#ifndef SC_FIGMA_RELAY_H
+#define SC_FIGMA_RELAY_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "figma_bridge.h"
+#include "util/thread.h"
+
+/**
+ * Publisher of the screenshots to the Figma Bridge of another scrcpy instance
+ *
+ * When several instances run, only the first one can bind the bridge port.
+ * The others publish their screenshots to its bridge, which serves them under
+ * /scrcpy-bridge/<serial>/ (so that the plugin only needs a single endpoint).
+ */
+struct sc_figma_relay {
+    sc_mutex mutex;
+    uint16_t port;
+    // Secret of the bridge, read from the file it writes (see
+    // sc_figma_bridge_get_relay_secret_path())
+    char secret[SC_FIGMA_BRIDGE_RELAY_SECRET_LEN + 1];
+    // Serial of the device of this instance ("" until known)
+    char serial[SC_FIGMA_BRIDGE_SERIAL_SIZE];
+    // Whether at least one screenshot has been published (the bridge is then
+    // notified of the disconnection on destroy)
+    bool published;
+};
+
+/**
+ * Initialize the relay, if a bridge already listens on `port`
+ */
+bool
+sc_figma_relay_init(struct sc_figma_relay *relay, uint16_t port);
+
+/**
+ * Notify the bridge that the device is disconnected, then destroy the relay
+ */
+void
+sc_figma_relay_destroy(struct sc_figma_relay *relay);
+
+/**
+ * Set the serial of the device of this instance (required to publish)
+ */
+void
+sc_figma_relay_set_serial(struct sc_figma_relay *relay, const char *serial);
+
+/**
+ * Publish a screenshot to the bridge (blocking)
+ */
+bool
+sc_figma_relay_publish_png(struct sc_figma_relay *relay,
+                           const uint8_t *png_data, size_t png_size,
+                           uint16_t width, uint16_t height);
+
+#endif
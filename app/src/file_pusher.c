@@ -1,14 +1,25 @@
 #include "file_pusher.h"
 
 #include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "adb/adb.h"
+#include "events.h"
+#include "util/file.h"
 #include "util/log.h"
+#include "util/tick.h"
 
 #define DEFAULT_PUSH_TARGET "/sdcard/Download/"
 
+// Maximum number of files pushed with a single adb session
+#define SC_FILE_PUSHER_BATCH_MAX 32
+
+// Install bigger APKs incrementally when possible
+#define SC_FILE_PUSHER_INCREMENTAL_MIN_SIZE (64 * 1024 * 1024)
+
 static void
 sc_file_pusher_request_destroy(struct sc_file_pusher_request *req) {
     free(req->file);
@@ -16,8 +27,9 @@ sc_file_pusher_request_destroy(struct sc_file_pusher_request *req) {
 
 bool
 sc_file_pusher_init(struct sc_file_pusher *fp, const char *serial,
-                    const char *push_target) {
+                    const char *push_target, unsigned job_count) {
     assert(serial);
+    assert(job_count && job_count <= SC_FILE_PUSHER_MAX_JOBS);
 
     sc_vecdeque_init(&fp->queue);
 
@@ -32,20 +44,19 @@ sc_file_pusher_init(struct sc_file_pusher *fp, const char *serial,
         return false;
     }
 
-    ok = sc_intr_init(&fp->intr);
-    if (!ok) {
-        sc_cond_destroy(&fp->event_cond);
-        sc_mutex_destroy(&fp->mutex);
-        return false;
+    unsigned i;
+    for (i = 0; i < job_count; ++i) {
+        ok = sc_intr_init(&fp->jobs[i].intr);
+        if (!ok) {
+            goto error_destroy_intrs;
+        }
+        fp->jobs[i].fp = fp;
     }
 
     fp->serial = strdup(serial);
     if (!fp->serial) {
         LOG_OOM();
-        sc_intr_destroy(&fp->intr);
-        sc_cond_destroy(&fp->event_cond);
-        sc_mutex_destroy(&fp->mutex);
-        return false;
+        goto error_destroy_intrs;
     }
 
     // lazy initialization
@@ -53,16 +64,32 @@ sc_file_pusher_init(struct sc_file_pusher *fp, const char *serial,
 
     fp->stopped = false;
 
+    fp->running = 0;
+    fp->done = 0;
+    fp->total = 0;
+    fp->job_count = job_count;
+    fp->sdk_version = 0;
+
     fp->push_target = push_target ? push_target : DEFAULT_PUSH_TARGET;
 
     return true;
+
+error_destroy_intrs:
+    while (i--) {
+        sc_intr_destroy(&fp->jobs[i].intr);
+    }
+    sc_cond_destroy(&fp->event_cond);
+    sc_mutex_destroy(&fp->mutex);
+    return false;
 }
 
 void
 sc_file_pusher_destroy(struct sc_file_pusher *fp) {
     sc_cond_destroy(&fp->event_cond);
     sc_mutex_destroy(&fp->mutex);
-    sc_intr_destroy(&fp->intr);
+    for (unsigned i = 0; i < fp->job_count; ++i) {
+        sc_intr_destroy(&fp->jobs[i].intr);
+    }
     free(fp->serial);
 
     while (!sc_vecdeque_is_empty(&fp->queue)) {
@@ -72,6 +99,14 @@ sc_file_pusher_destroy(struct sc_file_pusher *fp) {
     }
 }
 
+static void
+sc_file_pusher_notify_progress(void) {
+    // The panel displays the progress
+    // Coalesced: the progress is read by the main thread when it handles the
+    // event, so intermediate updates are not lost
+    sc_notify_event(SC_EVENT_FILE_PUSHER_PROGRESS);
+}
+
 bool
 sc_file_pusher_request(struct sc_file_pusher *fp,
                        enum sc_file_pusher_action action, char *file) {
@@ -100,24 +135,180 @@ sc_file_pusher_request(struct sc_file_pusher *fp,
         return false;
     }
 
+    ++fp->total;
+
     if (was_empty) {
-        sc_cond_signal(&fp->event_cond);
+        sc_cond_broadcast(&fp->event_cond);
     }
     sc_mutex_unlock(&fp->mutex);
 
+    sc_file_pusher_notify_progress();
+
     return true;
 }
 
-static int
-run_file_pusher(void *data) {
-    struct sc_file_pusher *fp = data;
-    struct sc_intr *intr = &fp->intr;
+void
+sc_file_pusher_get_progress(struct sc_file_pusher *fp, unsigned *done,
+                            unsigned *total) {
+    sc_mutex_lock(&fp->mutex);
+    *done = fp->done;
+    *total = fp->total;
+    sc_mutex_unlock(&fp->mutex);
+}
 
-    const char *serial = fp->serial;
-    assert(serial);
+// Pop the next request, followed by the next consecutive push requests (to
+// push them with a single adb session), leaving a share of the queue to the
+// other jobs
+//
+// The mutex must be held, and the queue must not be empty.
+static size_t
+sc_file_pusher_pop_batch(struct sc_file_pusher *fp,
+                         struct sc_file_pusher_request *reqs) {
+    assert(!sc_vecdeque_is_empty(&fp->queue));
+
+    size_t size = sc_vecdeque_size(&fp->queue);
+    size_t share = (size + fp->job_count - 1) / fp->job_count;
+    size_t max = MIN(share, SC_FILE_PUSHER_BATCH_MAX);
+
+    size_t count = 0;
+    reqs[count++] = sc_vecdeque_pop(&fp->queue);
+    if (reqs[0].action == SC_FILE_PUSHER_ACTION_PUSH_FILE) {
+        while (count < max && !sc_vecdeque_is_empty(&fp->queue)) {
+            struct sc_file_pusher_request *next =
+                sc_vecdeque_front_ref(&fp->queue);
+            if (next->action != SC_FILE_PUSHER_ACTION_PUSH_FILE) {
+                break;
+            }
+            reqs[count++] = sc_vecdeque_pop(&fp->queue);
+        }
+    }
+
+    return count;
+}
+
+// Return the device SDK version (retrieved on first use), or 0 if unknown
+static uint16_t
+sc_file_pusher_get_sdk_version(struct sc_file_pusher *fp,
+                               struct sc_intr *intr) {
+    sc_mutex_lock(&fp->mutex);
+    uint16_t sdk_version = fp->sdk_version;
+    sc_mutex_unlock(&fp->mutex);
+
+    if (!sdk_version) {
+        sc_tick start = sc_tick_now();
+        sdk_version = sc_adb_get_device_sdk_version(intr, fp->serial);
+        LOGD("Device SDK version: %" PRIu16 " (retrieved in %" PRItick " ms)",
+             sdk_version, SC_TICK_TO_MS(sc_tick_now() - start));
+
+        sc_mutex_lock(&fp->mutex);
+        fp->sdk_version = sdk_version;
+        sc_mutex_unlock(&fp->mutex);
+    }
+
+    return sdk_version;
+}
+
+static enum sc_adb_install_mode
+sc_file_pusher_get_install_mode(uint16_t sdk_version, const char *apk,
+                                uint64_t size) {
+    // Android >= 11
+    if (sdk_version >= 30 && size >= SC_FILE_PUSHER_INCREMENTAL_MIN_SIZE) {
+        // Incremental installation requires the v4 signature file
+        char *idsig;
+        if (asprintf(&idsig, "%s.idsig", apk) == -1) {
+            LOG_OOM();
+        } else {
+            uint64_t idsig_size;
+            bool found = sc_file_get_size(idsig, &idsig_size);
+            free(idsig);
+            if (found) {
+                return SC_ADB_INSTALL_MODE_INCREMENTAL;
+            }
+        }
+    }
+
+    // Android >= 7
+    if (sdk_version >= 24) {
+        return SC_ADB_INSTALL_MODE_STREAMED;
+    }
+
+    return SC_ADB_INSTALL_MODE_DEFAULT;
+}
+
+static void
+sc_file_pusher_install(struct sc_file_pusher *fp, struct sc_intr *intr,
+                       const char *apk) {
+    uint64_t size;
+    if (!sc_file_get_size(apk, &size)) {
+        LOGE("Could not access %s", apk);
+        return;
+    }
+
+    uint16_t sdk_version = sc_file_pusher_get_sdk_version(fp, intr);
+    enum sc_adb_install_mode mode =
+        sc_file_pusher_get_install_mode(sdk_version, apk, size);
+    const char *mode_name = mode == SC_ADB_INSTALL_MODE_INCREMENTAL
+                          ? "incremental"
+                          : mode == SC_ADB_INSTALL_MODE_STREAMED ? "streamed"
+                                                                 : "default";
+
+    LOGI("Installing %s (%" PRIu64 " MB, %s mode)...", apk,
+         size / (1024 * 1024), mode_name);
+
+    sc_tick start = sc_tick_now();
+    bool ok = sc_adb_install(intr, fp->serial, apk, mode, 0);
+    sc_tick duration = sc_tick_now() - start;
+    if (ok) {
+        LOGI("%s successfully installed in %" PRItick " ms", apk,
+             SC_TICK_TO_MS(duration));
+    } else {
+        LOGE("Failed to install %s", apk);
+    }
+}
+
+static void
+sc_file_pusher_push(struct sc_file_pusher *fp, struct sc_intr *intr,
+                    struct sc_file_pusher_request *reqs, size_t count) {
+    const char *files[SC_FILE_PUSHER_BATCH_MAX];
+    for (size_t i = 0; i < count; ++i) {
+        assert(reqs[i].action == SC_FILE_PUSHER_ACTION_PUSH_FILE);
+        files[i] = reqs[i].file;
+    }
 
     const char *push_target = fp->push_target;
-    assert(push_target);
+
+    if (count == 1) {
+        LOGI("Pushing %s...", files[0]);
+    } else {
+        LOGI("Pushing %" SC_PRIsizet " files...", count);
+    }
+
+    bool ok = sc_adb_push_files(intr, fp->serial, files, count, push_target,
+                                0);
+    if (count == 1) {
+        if (ok) {
+            LOGI("%s successfully pushed to %s", files[0], push_target);
+        } else {
+            LOGE("Failed to push %s to %s", files[0], push_target);
+        }
+    } else {
+        if (ok) {
+            LOGI("%" SC_PRIsizet " files successfully pushed to %s", count,
+                 push_target);
+        } else {
+            LOGE("Failed to push some of %" SC_PRIsizet " files to %s", count,
+                 push_target);
+        }
+    }
+}
+
+static int
+run_file_pusher(void *data) {
+    struct sc_file_pusher_job *job = data;
+    struct sc_file_pusher *fp = job->fp;
+    struct sc_intr *intr = &job->intr;
+
+    struct sc_file_pusher_request reqs[SC_FILE_PUSHER_BATCH_MAX];
 
     for (;;) {
         sc_mutex_lock(&fp->mutex);
@@ -130,41 +321,55 @@ run_file_pusher(void *data) {
             break;
         }
 
-        assert(!sc_vecdeque_is_empty(&fp->queue));
-        struct sc_file_pusher_request req = sc_vecdeque_pop(&fp->queue);
+        size_t count = sc_file_pusher_pop_batch(fp, reqs);
+        fp->running += count;
         sc_mutex_unlock(&fp->mutex);
 
-        if (req.action == SC_FILE_PUSHER_ACTION_INSTALL_APK) {
-            LOGI("Installing %s...", req.file);
-            bool ok = sc_adb_install(intr, serial, req.file, 0);
-            if (ok) {
-                LOGI("%s successfully installed", req.file);
-            } else {
-                LOGE("Failed to install %s", req.file);
-            }
+        if (reqs[0].action == SC_FILE_PUSHER_ACTION_INSTALL_APK) {
+            assert(count == 1);
+            sc_file_pusher_install(fp, intr, reqs[0].file);
         } else {
-            LOGI("Pushing %s...", req.file);
-            bool ok = sc_adb_push(intr, serial, req.file, push_target, 0);
-            if (ok) {
-                LOGI("%s successfully pushed to %s", req.file, push_target);
-            } else {
-                LOGE("Failed to push %s to %s", req.file, push_target);
-            }
+            sc_file_pusher_push(fp, intr, reqs, count);
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            sc_file_pusher_request_destroy(&reqs[i]);
+        }
+
+        sc_mutex_lock(&fp->mutex);
+        fp->running -= count;
+        fp->done += count;
+        if (!fp->running && sc_vecdeque_is_empty(&fp->queue)) {
+            // The series of requests is complete
+            fp->done = 0;
+            fp->total = 0;
         }
+        sc_mutex_unlock(&fp->mutex);
 
-        sc_file_pusher_request_destroy(&req);
+        sc_file_pusher_notify_progress();
     }
     return 0;
 }
 
 bool
 sc_file_pusher_start(struct sc_file_pusher *fp) {
-    LOGD("Starting file_pusher thread");
-
-    bool ok = sc_thread_create(&fp->thread, run_file_pusher, "scrcpy-file", fp);
-    if (!ok) {
-        LOGE("Could not start file_pusher thread");
-        return false;
+    LOGD("Starting file_pusher threads");
+
+    for (unsigned i = 0; i < fp->job_count; ++i) {
+        struct sc_file_pusher_job *job = &fp->jobs[i];
+        bool ok = sc_thread_create(&job->thread, run_file_pusher,
+                                   "scrcpy-file", job);
+        if (!ok) {
+            LOGE("Could not start file_pusher thread");
+            sc_mutex_lock(&fp->mutex);
+            fp->stopped = true;
+            sc_cond_broadcast(&fp->event_cond);
+            sc_mutex_unlock(&fp->mutex);
+            while (i--) {
+                sc_thread_join(&fp->jobs[i].thread, NULL);
+            }
+            return false;
+        }
     }
 
     return true;
@@ -175,8 +380,10 @@ sc_file_pusher_stop(struct sc_file_pusher *fp) {
     if (fp->initialized) {
         sc_mutex_lock(&fp->mutex);
         fp->stopped = true;
-        sc_cond_signal(&fp->event_cond);
-        sc_intr_interrupt(&fp->intr);
+        sc_cond_broadcast(&fp->event_cond);
+        for (unsigned i = 0; i < fp->job_count; ++i) {
+            sc_intr_interrupt(&fp->jobs[i].intr);
+        }
         sc_mutex_unlock(&fp->mutex);
     }
 }
@@ -184,6 +391,8 @@ sc_file_pusher_stop(struct sc_file_pusher *fp) {
 void
 sc_file_pusher_join(struct sc_file_pusher *fp) {
     if (fp->initialized) {
-        sc_thread_join(&fp->thread, NULL);
+        for (unsigned i = 0; i < fp->job_count; ++i) {
+            sc_thread_join(&fp->jobs[i].thread, NULL);
+        }
     }
 }
@@ -4,6 +4,7 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "util/intr.h"
 #include "util/thread.h"
@@ -21,22 +22,41 @@ struct sc_file_pusher_request {
 
 struct sc_file_pusher_request_queue SC_VECDEQUE(struct sc_file_pusher_request);
 
+// Maximum number of requests processed in parallel
+#define SC_FILE_PUSHER_MAX_JOBS 8
+
+struct sc_file_pusher;
+
+struct sc_file_pusher_job {
+    struct sc_file_pusher *fp;
+    sc_thread thread;
+    struct sc_intr intr;
+};
+
 struct sc_file_pusher {
     char *serial;
     const char *push_target;
-    sc_thread thread;
     sc_mutex mutex;
     sc_cond event_cond;
     bool stopped;
     bool initialized;
     struct sc_file_pusher_request_queue queue;
 
-    struct sc_intr intr;
+    // Progress of the current series of requests (reset once they are all
+    // processed)
+    unsigned running; // number of requests being processed
+    unsigned done;
+    unsigned total;
+
+    uint16_t sdk_version; // 0 if not retrieved yet
+
+    unsigned job_count;
+    struct sc_file_pusher_job jobs[SC_FILE_PUSHER_MAX_JOBS];
 };
 
 bool
 sc_file_pusher_init(struct sc_file_pusher *fp, const char *serial,
-                    const char *push_target);
+                    const char *push_target, unsigned job_count);
 
 void
 sc_file_pusher_destroy(struct sc_file_pusher *fp);
@@ -55,4 +75,14 @@ bool
 sc_file_pusher_request(struct sc_file_pusher *fp,
                        enum sc_file_pusher_action action, char *file);
 
+/**
+ * Get the progress of the current series of requests
+ *
+ * The total is 0 if there is no pending request. An
+ * SC_EVENT_FILE_PUSHER_PROGRESS event is pushed whenever it changes.
+ */
+void
+sc_file_pusher_get_progress(struct sc_file_pusher *fp, unsigned *done,
+                            unsigned *total);
+
 #endif
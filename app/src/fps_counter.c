@@ -22,6 +22,7 @@ sc_fps_counter_init(struct sc_fps_counter *counter) {
 
     counter->thread_started = false;
     atomic_init(&counter->started, 0);
+    counter->idle = false;
     // no need to initialize the other fields, they are unused until started
 
     return true;
@@ -43,16 +44,50 @@ set_started(struct sc_fps_counter *counter, bool started) {
     atomic_store_explicit(&counter->started, started, memory_order_release);
 }
 
+// must be called with mutex locked
+static unsigned
+get_captured_fps(struct sc_fps_counter *counter) {
+    // Use the device timestamps rather than the reception time: frames
+    // captured in batches are received in bursts, but their timestamps are
+    // evenly spaced
+    if (!counter->nr_captured || counter->interval_start_pts == -1) {
+        return 0;
+    }
+
+    int64_t duration = counter->last_pts - counter->interval_start_pts;
+    if (duration <= 0) {
+        return 0;
+    }
+
+    return (unsigned) ((counter->nr_captured * INT64_C(1000000) + duration / 2)
+                            / duration);
+}
+
 // must be called with mutex locked
 static void
 display_fps(struct sc_fps_counter *counter) {
+    if (counter->idle && !counter->nr_rendered && !counter->nr_skipped) {
+        if (!counter->idle_reported) {
+            LOGI("0 fps (device screen idle)");
+            counter->idle_reported = true;
+        }
+        return;
+    }
+
     unsigned rendered_per_second =
         counter->nr_rendered * SC_TICK_FREQ / SC_FPS_COUNTER_INTERVAL;
-    if (counter->nr_skipped) {
-        LOGI("%u fps (+%u frames skipped)", rendered_per_second,
-                                            counter->nr_skipped);
+    double mbps =
+        counter->sample.values[SC_STAT_VIDEO_BYTES] * 8 / 1000000.;
+    unsigned captured_per_second = get_captured_fps(counter);
+    if (counter->nr_skipped && captured_per_second) {
+        LOGI("%u fps (+%u frames skipped, captured at %u fps), %.2f Mbit/s",
+             rendered_per_second, counter->nr_skipped, captured_per_second,
+             mbps);
+    } else if (counter->nr_skipped) {
+        LOGI("%u fps (+%u frames skipped), %.2f Mbit/s", rendered_per_second,
+             counter->nr_skipped, mbps);
     } else {
-        LOGI("%u fps", rendered_per_second);
+        LOGI("%u fps, %.2f Mbit/s", rendered_per_second, mbps);
     }
 }
 
@@ -63,9 +98,14 @@ check_interval_expired(struct sc_fps_counter *counter, sc_tick now) {
         return;
     }
 
+    sc_stats_sampler_sample(&counter->sampler, now, &counter->sample);
+    counter->has_sample = true;
+
     display_fps(counter);
     counter->nr_rendered = 0;
     counter->nr_skipped = 0;
+    counter->nr_captured = 0;
+    counter->interval_start_pts = counter->last_pts;
     // add a multiple of the interval
     uint32_t elapsed_slices =
         (now - counter->next_timestamp) / SC_FPS_COUNTER_INTERVAL + 1;
@@ -98,9 +138,16 @@ bool
 sc_fps_counter_start(struct sc_fps_counter *counter) {
     sc_mutex_lock(&counter->mutex);
     counter->interrupted = false;
-    counter->next_timestamp = sc_tick_now() + SC_FPS_COUNTER_INTERVAL;
+    sc_tick now = sc_tick_now();
+    counter->next_timestamp = now + SC_FPS_COUNTER_INTERVAL;
+    sc_stats_sampler_init(&counter->sampler, now);
+    counter->has_sample = false;
     counter->nr_rendered = 0;
     counter->nr_skipped = 0;
+    counter->nr_captured = 0;
+    counter->last_pts = -1;
+    counter->interval_start_pts = -1;
+    counter->idle_reported = false;
     sc_mutex_unlock(&counter->mutex);
 
     set_started(counter, true);
@@ -161,6 +208,8 @@ sc_fps_counter_join(struct sc_fps_counter *counter) {
 
 void
 sc_fps_counter_add_rendered_frame(struct sc_fps_counter *counter) {
+    sc_stats_add(SC_STAT_FRAMES_RENDERED, 1);
+
     if (!is_started(counter)) {
         return;
     }
@@ -174,6 +223,8 @@ sc_fps_counter_add_rendered_frame(struct sc_fps_counter *counter) {
 
 void
 sc_fps_counter_add_skipped_frame(struct sc_fps_counter *counter) {
+    sc_stats_add(SC_STAT_FRAMES_SKIPPED, 1);
+
     if (!is_started(counter)) {
         return;
     }
@@ -184,3 +235,51 @@ sc_fps_counter_add_skipped_frame(struct sc_fps_counter *counter) {
     ++counter->nr_skipped;
     sc_mutex_unlock(&counter->mutex);
 }
+
+void
+sc_fps_counter_add_captured_frame(struct sc_fps_counter *counter, int64_t pts) {
+    if (!is_started(counter)) {
+        return;
+    }
+
+    sc_mutex_lock(&counter->mutex);
+    sc_tick now = sc_tick_now();
+    check_interval_expired(counter, now);
+    if (counter->interval_start_pts == -1 || pts <= counter->last_pts) {
+        // First frame, or the timestamps have been reset (e.g. the encoder
+        // has been restarted): start measuring from this frame
+        counter->interval_start_pts = pts;
+        counter->nr_captured = 0;
+    } else {
+        ++counter->nr_captured;
+    }
+    counter->last_pts = pts;
+    sc_mutex_unlock(&counter->mutex);
+}
+
+bool
+sc_fps_counter_get_sample(struct sc_fps_counter *counter,
+                          struct sc_stats_sample *sample) {
+    if (!is_started(counter)) {
+        return false;
+    }
+
+    sc_mutex_lock(&counter->mutex);
+    bool has_sample = counter->has_sample;
+    if (has_sample) {
+        *sample = counter->sample;
+    }
+    sc_mutex_unlock(&counter->mutex);
+
+    return has_sample;
+}
+
+void
+sc_fps_counter_set_idle(struct sc_fps_counter *counter, bool idle) {
+    sc_mutex_lock(&counter->mutex);
+    counter->idle = idle;
+    if (!idle) {
+        counter->idle_reported = false;
+    }
+    sc_mutex_unlock(&counter->mutex);
+}
@@ -5,7 +5,9 @@
 
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 
+#include "stats.h"
 #include "util/thread.h"
 #include "util/tick.h"
 
@@ -24,7 +26,21 @@ struct sc_fps_counter {
     bool interrupted;
     unsigned nr_rendered;
     unsigned nr_skipped;
+    // frames received from the device, with their timestamps, to report the
+    // capture rate when it differs from the rendering rate (e.g. a high speed
+    // camera delivers frames in batches, so most of them are skipped)
+    unsigned nr_captured;
+    int64_t last_pts; // -1 if none
+    int64_t interval_start_pts; // -1 if none
     sc_tick next_timestamp;
+    // the device reported that its screen is static (no frames are sent)
+    bool idle;
+    bool idle_reported;
+
+    // session metrics (see stats.h), sampled on each interval
+    struct sc_stats_sampler sampler;
+    struct sc_stats_sample sample;
+    bool has_sample;
 };
 
 bool
@@ -56,4 +72,20 @@ sc_fps_counter_add_rendered_frame(struct sc_fps_counter *counter);
 void
 sc_fps_counter_add_skipped_frame(struct sc_fps_counter *counter);
 
+// Register a frame received from the device, with its timestamp (in
+// microseconds)
+void
+sc_fps_counter_add_captured_frame(struct sc_fps_counter *counter, int64_t pts);
+
+// Get the metrics sampled on the last interval
+//
+// Return false if the counter is stopped or no interval has elapsed yet.
+bool
+sc_fps_counter_get_sample(struct sc_fps_counter *counter,
+                          struct sc_stats_sample *sample);
+
+// While idle, the absence of frames is not reported as 0 fps
+void
+sc_fps_counter_set_idle(struct sc_fps_counter *counter, bool idle);
+
 #endif
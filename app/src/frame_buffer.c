@@ -2,87 +2,82 @@
 
 #include <assert.h>
 
-#include "util/log.h"
+#include "util/trace.h"
+
+#define SC_FRAME_BUFFER_INDEX_MASK 0x3
+#define SC_FRAME_BUFFER_FRESH 0x4
 
 bool
 sc_frame_buffer_init(struct sc_frame_buffer *fb) {
-    fb->pending_frame = av_frame_alloc();
-    if (!fb->pending_frame) {
-        LOG_OOM();
-        return false;
-    }
-
-    fb->tmp_frame = av_frame_alloc();
-    if (!fb->tmp_frame) {
-        LOG_OOM();
-        av_frame_free(&fb->pending_frame);
-        return false;
-    }
-
-    bool ok = sc_mutex_init(&fb->mutex);
-    if (!ok) {
-        av_frame_free(&fb->pending_frame);
-        av_frame_free(&fb->tmp_frame);
-        return false;
+    for (unsigned i = 0; i < 3; ++i) {
+        fb->frames[i] = NULL;
     }
 
+    fb->back = 0;
+    fb->front = 1;
     // there is initially no frame, so consider it has already been consumed
-    fb->pending_frame_consumed = true;
+    atomic_init(&fb->pending, 2);
+    atomic_init(&fb->skipped_count, 0);
 
     return true;
 }
 
 void
 sc_frame_buffer_destroy(struct sc_frame_buffer *fb) {
-    sc_mutex_destroy(&fb->mutex);
-    av_frame_free(&fb->pending_frame);
-    av_frame_free(&fb->tmp_frame);
-}
-
-static inline void
-swap_frames(AVFrame **lhs, AVFrame **rhs) {
-    AVFrame *tmp = *lhs;
-    *lhs = *rhs;
-    *rhs = tmp;
+    for (unsigned i = 0; i < 3; ++i) {
+        if (fb->frames[i]) {
+            sc_shared_frame_release(fb->frames[i]);
+        }
+    }
 }
 
-bool
-sc_frame_buffer_push(struct sc_frame_buffer *fb, const AVFrame *frame,
+void
+sc_frame_buffer_push(struct sc_frame_buffer *fb, struct sc_shared_frame *frame,
                      bool *previous_frame_skipped) {
-    // Use a temporary frame to preserve pending_frame in case of error.
-    // tmp_frame is an empty frame, no need to call av_frame_unref() beforehand.
-    int r = av_frame_ref(fb->tmp_frame, frame);
-    if (r) {
-        LOGE("Could not ref frame: %d", r);
-        return false;
+    sc_tick start = sc_trace_begin();
+
+    // The back frame is always empty here
+    assert(!fb->frames[fb->back]);
+    fb->frames[fb->back] = sc_shared_frame_acquire(frame);
+
+    // Publish the back frame, and take the previous pending frame as the new
+    // back frame (release: the frame must be visible to the consumer)
+    unsigned prev = atomic_exchange_explicit(&fb->pending,
+                                             fb->back | SC_FRAME_BUFFER_FRESH,
+                                             memory_order_acq_rel);
+    fb->back = prev & SC_FRAME_BUFFER_INDEX_MASK;
+
+    bool skipped = prev & SC_FRAME_BUFFER_FRESH;
+    if (skipped) {
+        // The previous frame has never been consumed, drop it
+        sc_shared_frame_release(fb->frames[fb->back]);
+        fb->frames[fb->back] = NULL;
+        atomic_fetch_add_explicit(&fb->skipped_count, 1, memory_order_relaxed);
     }
 
-    sc_mutex_lock(&fb->mutex);
-
-    // Now that av_frame_ref() succeeded, we can replace the previous
-    // pending_frame
-    swap_frames(&fb->pending_frame, &fb->tmp_frame);
-    av_frame_unref(fb->tmp_frame);
-
     if (previous_frame_skipped) {
-        *previous_frame_skipped = !fb->pending_frame_consumed;
+        *previous_frame_skipped = skipped;
     }
-    fb->pending_frame_consumed = false;
-
-    sc_mutex_unlock(&fb->mutex);
 
-    return true;
+    sc_trace_end("frame buffer push", start);
 }
 
-void
-sc_frame_buffer_consume(struct sc_frame_buffer *fb, AVFrame *dst) {
-    sc_mutex_lock(&fb->mutex);
-    assert(!fb->pending_frame_consumed);
-    fb->pending_frame_consumed = true;
-
-    av_frame_move_ref(dst, fb->pending_frame);
-    // av_frame_move_ref() resets its source frame, so no need to call
-    // av_frame_unref()
+struct sc_shared_frame *
+sc_frame_buffer_consume(struct sc_frame_buffer *fb) {
+    // Take the pending frame, and give back the (empty) front frame
+    unsigned prev = atomic_exchange_explicit(&fb->pending, fb->front,
+                                             memory_order_acq_rel);
+    assert(prev & SC_FRAME_BUFFER_FRESH);
+    fb->front = prev & SC_FRAME_BUFFER_INDEX_MASK;
+    atomic_store_explicit(&fb->skipped_count, 0, memory_order_relaxed);
+
+    struct sc_shared_frame *frame = fb->frames[fb->front];
+    assert(frame);
+    fb->frames[fb->front] = NULL;
+    return frame;
+}
 
-    sc_mutex_unlock(&fb->mutex);
+unsigned
+sc_frame_buffer_get_skipped_count(struct sc_frame_buffer *fb) {
+    return atomic_load_explicit(&fb->skipped_count, memory_order_relaxed);
 }
@@ -3,13 +3,10 @@
 
 #include "common.h"
 
+#include <stdatomic.h>
 #include <stdbool.h>
-#include <libavutil/frame.h>
 
-#include "util/thread.h"
-
-// forward declarations
-typedef struct AVFrame AVFrame;
+#include "shared_frame.h"
 
 /**
  * A frame buffer holds 1 pending frame, which is the last frame received from
@@ -18,15 +15,32 @@ typedef struct AVFrame AVFrame;
  * If a pending frame has not been consumed when the producer pushes a new
  * frame, then it is lost. The intent is to always provide access to the very
  * last frame to minimize latency.
+ *
+ * It is a lock-free triple buffer, for a single producer and a single
+ * consumer: the producer writes to its back frame, the consumer reads from its
+ * front frame, and each side swaps its frame with the pending one atomically.
+ * Therefore, neither side ever waits for the other.
+ *
+ * The frames are shared (see sc_shared_frame): pushing a frame only acquires
+ * a reference, so several frame buffers may hold the same frame without any
+ * copy or allocation.
  */
 
 struct sc_frame_buffer {
-    AVFrame *pending_frame;
-    AVFrame *tmp_frame; // To preserve the pending frame on error
+    // NULL if empty
+    struct sc_shared_frame *frames[3];
 
-    sc_mutex mutex;
+    // Owned by the producer
+    unsigned back;
+    // Owned by the consumer
+    unsigned front;
+    // Index of the pending frame, with SC_FRAME_BUFFER_FRESH set if it has not
+    // been consumed yet
+    atomic_uint pending;
 
-    bool pending_frame_consumed;
+    // Number of frames replaced before being consumed since the last
+    // consumption
+    atomic_uint skipped_count;
 };
 
 bool
@@ -35,11 +49,23 @@ sc_frame_buffer_init(struct sc_frame_buffer *fb);
 void
 sc_frame_buffer_destroy(struct sc_frame_buffer *fb);
 
-bool
-sc_frame_buffer_push(struct sc_frame_buffer *fb, const AVFrame *frame,
+// Must be called from the producer thread only
+//
+// The frame buffer acquires its own reference to the frame.
+void
+sc_frame_buffer_push(struct sc_frame_buffer *fb, struct sc_shared_frame *frame,
                      bool *skipped);
 
-void
-sc_frame_buffer_consume(struct sc_frame_buffer *fb, AVFrame *dst);
+// Must be called from the consumer thread only, once for each push which did
+// not report the previous frame as skipped
+//
+// The caller takes ownership of the returned reference, and must release it
+// by sc_shared_frame_release().
+struct sc_shared_frame *
+sc_frame_buffer_consume(struct sc_frame_buffer *fb);
+
+// Return the number of frames skipped since the last consumption
+unsigned
+sc_frame_buffer_get_skipped_count(struct sc_frame_buffer *fb);
 
 #endif
@@ -0,0 +1,131 @@
+#include "frame_damage.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <libavutil/pixfmt.h>
+
+#include "util/log.h"
+
+bool
+sc_frame_damage_init(struct sc_frame_damage *damage) {
+    damage->previous = av_frame_alloc();
+    if (!damage->previous) {
+        LOG_OOM();
+        return false;
+    }
+
+    damage->tiles = NULL;
+    damage->tiles_capacity = 0;
+    damage->columns = 0;
+    damage->rows = 0;
+    return true;
+}
+
+void
+sc_frame_damage_destroy(struct sc_frame_damage *damage) {
+    av_frame_free(&damage->previous);
+    free(damage->tiles);
+}
+
+void
+sc_frame_damage_reset(struct sc_frame_damage *damage) {
+    av_frame_unref(damage->previous);
+}
+
+static bool
+sc_frame_damage_is_supported(const AVFrame *frame) {
+    return frame->format == AV_PIX_FMT_YUV420P
+        || frame->format == AV_PIX_FMT_YUVJ420P;
+}
+
+static bool
+sc_frame_damage_rect_changed(const AVFrame *a, const AVFrame *b, int plane,
+                             int x, int y, int w, int h) {
+    const uint8_t *pa = a->data[plane] + y * a->linesize[plane] + x;
+    const uint8_t *pb = b->data[plane] + y * b->linesize[plane] + x;
+    for (int i = 0; i < h; ++i) {
+        // memcmp() is vectorized by the C library
+        if (memcmp(pa, pb, w)) {
+            return true;
+        }
+        pa += a->linesize[plane];
+        pb += b->linesize[plane];
+    }
+    return false;
+}
+
+static bool
+sc_frame_damage_tile_changed(const AVFrame *a, const AVFrame *b,
+                             unsigned column, unsigned row) {
+    int x = column * SC_FRAME_DAMAGE_TILE_SIZE;
+    int y = row * SC_FRAME_DAMAGE_TILE_SIZE;
+    int w = MIN(SC_FRAME_DAMAGE_TILE_SIZE, b->width - x);
+    int h = MIN(SC_FRAME_DAMAGE_TILE_SIZE, b->height - y);
+
+    if (sc_frame_damage_rect_changed(a, b, 0, x, y, w, h)) {
+        return true;
+    }
+
+    // The chroma planes are subsampled by 2 in both directions
+    int cx = x / 2;
+    int cy = y / 2;
+    int cw = MIN(SC_FRAME_DAMAGE_TILE_SIZE / 2, (b->width + 1) / 2 - cx);
+    int ch = MIN(SC_FRAME_DAMAGE_TILE_SIZE / 2, (b->height + 1) / 2 - cy);
+    return sc_frame_damage_rect_changed(a, b, 1, cx, cy, cw, ch)
+        || sc_frame_damage_rect_changed(a, b, 2, cx, cy, cw, ch);
+}
+
+int
+sc_frame_damage_compute(struct sc_frame_damage *damage, const AVFrame *frame) {
+    const AVFrame *previous = damage->previous;
+    if (!previous->data[0] || !sc_frame_damage_is_supported(frame)
+            || previous->format != frame->format
+            || previous->width != frame->width
+            || previous->height != frame->height) {
+        return -1;
+    }
+
+    unsigned columns = (frame->width + SC_FRAME_DAMAGE_TILE_SIZE - 1)
+                     / SC_FRAME_DAMAGE_TILE_SIZE;
+    unsigned rows = (frame->height + SC_FRAME_DAMAGE_TILE_SIZE - 1)
+                  / SC_FRAME_DAMAGE_TILE_SIZE;
+    size_t count = (size_t) columns * rows;
+    if (count > damage->tiles_capacity) {
+        uint8_t *tiles = realloc(damage->tiles, count);
+        if (!tiles) {
+            LOG_OOM();
+            return -1;
+        }
+        damage->tiles = tiles;
+        damage->tiles_capacity = count;
+    }
+    damage->columns = columns;
+    damage->rows = rows;
+
+    int changed = 0;
+    for (unsigned row = 0; row < rows; ++row) {
+        for (unsigned column = 0; column < columns; ++column) {
+            bool tile_changed =
+                sc_frame_damage_tile_changed(previous, frame, column, row);
+            damage->tiles[row * columns + column] = tile_changed;
+            changed += tile_changed;
+        }
+    }
+
+    return changed;
+}
+
+void
+sc_frame_damage_set_previous(struct sc_frame_damage *damage,
+                             const AVFrame *frame) {
+    av_frame_unref(damage->previous);
+    if (!sc_frame_damage_is_supported(frame)) {
+        return;
+    }
+
+    int r = av_frame_ref(damage->previous, frame);
+    if (r) {
+        LOGW("Could not ref frame: %d", r);
+        // The next frame will be fully uploaded
+    }
+}
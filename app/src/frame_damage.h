@@ -0,0 +1,64 @@
+#ifndef SC_FRAME_DAMAGE_H
+#define SC_FRAME_DAMAGE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libavutil/frame.h>
+
+// Size of the tiles, in pixels of the luma plane (even, so that the chroma
+// planes of 4:2:0 frames are split on the same grid)
+#define SC_FRAME_DAMAGE_TILE_SIZE 64
+
+/**
+ * Detect the tiles of a YUV 4:2:0 planar frame which changed since the
+ * previous frame
+ *
+ * Most UI frames only change a small region (a blinking cursor, a spinner...),
+ * so that only the changed tiles need to be uploaded to the texture.
+ */
+struct sc_frame_damage {
+    AVFrame *previous; // reference to the previous frame (empty if none)
+    uint8_t *tiles; // 1 for each changed tile, row by row
+    size_t tiles_capacity;
+    unsigned columns;
+    unsigned rows;
+};
+
+bool
+sc_frame_damage_init(struct sc_frame_damage *damage);
+
+void
+sc_frame_damage_destroy(struct sc_frame_damage *damage);
+
+/**
+ * Forget the previous frame (typically because the texture has been
+ * recreated), so that the next frame is fully changed
+ */
+void
+sc_frame_damage_reset(struct sc_frame_damage *damage);
+
+/**
+ * Compare the frame to the previous one
+ *
+ * Return the number of changed tiles (flagged in `damage->tiles`, on a grid of
+ * `damage->columns` x `damage->rows`), or -1 if the whole frame must be
+ * considered changed (no previous frame, different size or format, or
+ * allocation failure).
+ */
+int
+sc_frame_damage_compute(struct sc_frame_damage *damage, const AVFrame *frame);
+
+/**
+ * Keep a reference to the frame, to compare the next one against it
+ *
+ * It must be called once the frame is fully applied (on error, the previous
+ * frame is forgotten).
+ */
+void
+sc_frame_damage_set_previous(struct sc_frame_damage *damage,
+                             const AVFrame *frame);
+
+#endif
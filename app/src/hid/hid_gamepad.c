@@ -208,6 +208,7 @@ sc_hid_gamepad_slot_init(struct sc_hid_gamepad_slot *slot,
     slot->axis_right_y = AXIS_RESCALE(0);
     slot->axis_left_trigger = 0;
     slot->axis_right_trigger = 0;
+    slot->dirty = false;
 }
 
 static ssize_t
@@ -223,10 +224,12 @@ sc_hid_gamepad_slot_find(struct sc_hid_gamepad *hid, uint32_t gamepad_id) {
 }
 
 void
-sc_hid_gamepad_init(struct sc_hid_gamepad *hid) {
+sc_hid_gamepad_init(struct sc_hid_gamepad *hid, sc_tick poll_interval) {
     for (size_t i = 0; i < SC_MAX_GAMEPADS; ++i) {
         hid->slots[i].gamepad_id = SC_GAMEPAD_ID_INVALID;
     }
+    hid->poll_interval = poll_interval;
+    hid->last_flush = 0;
 }
 
 static inline uint16_t
@@ -368,9 +371,8 @@ sc_hid_gamepad_get_button_id(enum sc_gamepad_button button) {
 }
 
 bool
-sc_hid_gamepad_generate_input_from_button(struct sc_hid_gamepad *hid,
-                                          struct sc_hid_input *hid_input,
-                                const struct sc_gamepad_button_event *event) {
+sc_hid_gamepad_process_button(struct sc_hid_gamepad *hid,
+                              const struct sc_gamepad_button_event *event) {
     if ((event->button < 0) || (event->button > 15)) {
         return false;
     }
@@ -379,7 +381,7 @@ sc_hid_gamepad_generate_input_from_button(struct sc_hid_gamepad *hid,
 
     ssize_t slot_idx = sc_hid_gamepad_slot_find(hid, gamepad_id);
     if (slot_idx == -1) {
-        LOGW("Axis event for unknown gamepad %" PRIu32, gamepad_id);
+        LOGW("Button event for unknown gamepad %" PRIu32, gamepad_id);
         return false;
     }
 
@@ -393,28 +395,43 @@ sc_hid_gamepad_generate_input_from_button(struct sc_hid_gamepad *hid,
         return false;
     }
 
+    uint32_t buttons = slot->buttons;
     if (event->action == SC_ACTION_DOWN) {
-        slot->buttons |= button;
+        buttons |= button;
     } else {
         assert(event->action == SC_ACTION_UP);
-        slot->buttons &= ~button;
+        buttons &= ~button;
     }
 
-    uint16_t hid_id = sc_hid_gamepad_slot_get_id(slot_idx);
-    sc_hid_gamepad_event_from_slot(hid_id, slot, hid_input);
+    if (buttons == slot->buttons) {
+        return false;
+    }
+
+    slot->buttons = buttons;
+    slot->dirty = true;
+    return true;
+}
+
+static bool
+sc_hid_gamepad_update_axis(struct sc_hid_gamepad_slot *slot, uint16_t *axis,
+                           uint16_t value) {
+    if (*axis == value) {
+        return false;
+    }
 
+    *axis = value;
+    slot->dirty = true;
     return true;
 }
 
 bool
-sc_hid_gamepad_generate_input_from_axis(struct sc_hid_gamepad *hid,
-                                        struct sc_hid_input *hid_input,
-                                const struct sc_gamepad_axis_event *event) {
+sc_hid_gamepad_process_axis(struct sc_hid_gamepad *hid,
+                            const struct sc_gamepad_axis_event *event) {
     uint32_t gamepad_id = event->gamepad_id;
 
     ssize_t slot_idx = sc_hid_gamepad_slot_find(hid, gamepad_id);
     if (slot_idx == -1) {
-        LOGW("Button event for unknown gamepad %" PRIu32, gamepad_id);
+        LOGW("Axis event for unknown gamepad %" PRIu32, gamepad_id);
         return false;
     }
 
@@ -424,31 +441,52 @@ sc_hid_gamepad_generate_input_from_axis(struct sc_hid_gamepad *hid,
 
     switch (event->axis) {
         case SC_GAMEPAD_AXIS_LEFTX:
-            slot->axis_left_x = AXIS_RESCALE(event->value);
-            break;
+            return sc_hid_gamepad_update_axis(slot, &slot->axis_left_x,
+                                              AXIS_RESCALE(event->value));
         case SC_GAMEPAD_AXIS_LEFTY:
-            slot->axis_left_y = AXIS_RESCALE(event->value);
-            break;
+            return sc_hid_gamepad_update_axis(slot, &slot->axis_left_y,
+                                              AXIS_RESCALE(event->value));
         case SC_GAMEPAD_AXIS_RIGHTX:
-            slot->axis_right_x = AXIS_RESCALE(event->value);
-            break;
+            return sc_hid_gamepad_update_axis(slot, &slot->axis_right_x,
+                                              AXIS_RESCALE(event->value));
         case SC_GAMEPAD_AXIS_RIGHTY:
-            slot->axis_right_y = AXIS_RESCALE(event->value);
-            break;
+            return sc_hid_gamepad_update_axis(slot, &slot->axis_right_y,
+                                              AXIS_RESCALE(event->value));
         case SC_GAMEPAD_AXIS_LEFT_TRIGGER:
             // Trigger is always positive between 0 and 32767
-            slot->axis_left_trigger = MAX(0, event->value);
-            break;
+            return sc_hid_gamepad_update_axis(slot, &slot->axis_left_trigger,
+                                              MAX(0, event->value));
         case SC_GAMEPAD_AXIS_RIGHT_TRIGGER:
             // Trigger is always positive between 0 and 32767
-            slot->axis_right_trigger = MAX(0, event->value);
-            break;
+            return sc_hid_gamepad_update_axis(slot, &slot->axis_right_trigger,
+                                              MAX(0, event->value));
         default:
             return false;
     }
+}
 
-    uint16_t hid_id = sc_hid_gamepad_slot_get_id(slot_idx);
-    sc_hid_gamepad_event_from_slot(hid_id, slot, hid_input);
+sc_tick
+sc_hid_gamepad_get_flush_delay(struct sc_hid_gamepad *hid, sc_tick now) {
+    sc_tick next_flush = hid->last_flush + hid->poll_interval;
+    return now < next_flush ? next_flush - now : 0;
+}
 
-    return true;
+size_t
+sc_hid_gamepad_flush(struct sc_hid_gamepad *hid,
+                     struct sc_hid_input hid_inputs[SC_MAX_GAMEPADS],
+                     sc_tick now) {
+    size_t count = 0;
+    for (size_t i = 0; i < SC_MAX_GAMEPADS; ++i) {
+        struct sc_hid_gamepad_slot *slot = &hid->slots[i];
+        if (slot->gamepad_id == SC_GAMEPAD_ID_INVALID || !slot->dirty) {
+            continue;
+        }
+
+        uint16_t hid_id = sc_hid_gamepad_slot_get_id(i);
+        sc_hid_gamepad_event_from_slot(hid_id, slot, &hid_inputs[count++]);
+        slot->dirty = false;
+    }
+
+    hid->last_flush = now;
+    return count;
 }
@@ -8,6 +8,7 @@
 
 #include "hid/hid_event.h"
 #include "input_events.h"
+#include "util/tick.h"
 
 #define SC_MAX_GAMEPADS 8
 #define SC_HID_ID_GAMEPAD_FIRST 3
@@ -22,14 +23,18 @@ struct sc_hid_gamepad_slot {
     uint16_t axis_right_y;
     uint16_t axis_left_trigger;
     uint16_t axis_right_trigger;
+    bool dirty; // the state changed since the last report
 };
 
 struct sc_hid_gamepad {
     struct sc_hid_gamepad_slot slots[SC_MAX_GAMEPADS];
+    // Minimal interval between two flushes of axis changes (0 for no limit)
+    sc_tick poll_interval;
+    sc_tick last_flush;
 };
 
 void
-sc_hid_gamepad_init(struct sc_hid_gamepad *hid);
+sc_hid_gamepad_init(struct sc_hid_gamepad *hid, sc_tick poll_interval);
 
 bool
 sc_hid_gamepad_generate_open(struct sc_hid_gamepad *hid,
@@ -41,14 +46,27 @@ sc_hid_gamepad_generate_close(struct sc_hid_gamepad *hid,
                               struct sc_hid_close *hid_close,
                               uint32_t gamepad_id);
 
+// Update the state of the gamepad; return true if it changed
 bool
-sc_hid_gamepad_generate_input_from_button(struct sc_hid_gamepad *hid,
-                                          struct sc_hid_input *hid_input,
-                                const struct sc_gamepad_button_event *event);
+sc_hid_gamepad_process_button(struct sc_hid_gamepad *hid,
+                              const struct sc_gamepad_button_event *event);
 
+// Update the state of the gamepad; return true if it changed
 bool
-sc_hid_gamepad_generate_input_from_axis(struct sc_hid_gamepad *hid,
-                                        struct sc_hid_input *hid_input,
-                                const struct sc_gamepad_axis_event *event);
+sc_hid_gamepad_process_axis(struct sc_hid_gamepad *hid,
+                            const struct sc_gamepad_axis_event *event);
+
+// Return the delay before the pending changes may be flushed (0 if they may be
+// flushed immediately)
+sc_tick
+sc_hid_gamepad_get_flush_delay(struct sc_hid_gamepad *hid, sc_tick now);
+
+// Generate one input report per gamepad whose state changed since the last
+// flush (only the latest state of each gamepad is reported).
+// Return the number of reports written to hid_inputs.
+size_t
+sc_hid_gamepad_flush(struct sc_hid_gamepad *hid,
+                     struct sc_hid_input hid_inputs[SC_MAX_GAMEPADS],
+                     sc_tick now);
 
 #endif
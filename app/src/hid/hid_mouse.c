@@ -1,6 +1,8 @@
 #include "hid_mouse.h"
 
+#include <assert.h>
 #include <stdint.h>
+#include <string.h>
 
 // 1 byte for buttons + padding, 1 byte for X position, 1 byte for Y position,
 // 1 byte for wheel motion, 1 byte for hozizontal scrolling
@@ -211,6 +213,45 @@ sc_hid_mouse_generate_input_from_scroll(struct sc_hid_input *hid_input,
     return true;
 }
 
+static bool
+sc_hid_mouse_add_rel(uint8_t *acc, uint8_t value) {
+    int sum = (int8_t) *acc + (int8_t) value;
+    if (sum < -127 || sum > 127) {
+        return false;
+    }
+    *acc = (uint8_t) sum;
+    return true;
+}
+
+bool
+sc_hid_mouse_merge_input(struct sc_hid_input *prev,
+                         const struct sc_hid_input *hid_input) {
+    if (prev->hid_id != SC_HID_ID_MOUSE
+            || hid_input->hid_id != SC_HID_ID_MOUSE) {
+        return false;
+    }
+
+    assert(prev->size == SC_HID_MOUSE_INPUT_SIZE);
+    assert(hid_input->size == SC_HID_MOUSE_INPUT_SIZE);
+
+    // A button change must be reported at its position in the motion
+    if (prev->data[0] != hid_input->data[0]) {
+        return false;
+    }
+
+    // Only merge if the sums fit, so that no motion is lost by clamping
+    uint8_t merged[SC_HID_MOUSE_INPUT_SIZE];
+    memcpy(merged, prev->data, SC_HID_MOUSE_INPUT_SIZE);
+    for (int i = 1; i < SC_HID_MOUSE_INPUT_SIZE; ++i) {
+        if (!sc_hid_mouse_add_rel(&merged[i], hid_input->data[i])) {
+            return false;
+        }
+    }
+
+    memcpy(prev->data, merged, SC_HID_MOUSE_INPUT_SIZE);
+    return true;
+}
+
 void sc_hid_mouse_generate_open(struct sc_hid_open *hid_open) {
     hid_open->hid_id = SC_HID_ID_MOUSE;
     hid_open->report_desc = SC_HID_MOUSE_REPORT_DESC;
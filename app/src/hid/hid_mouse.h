@@ -26,4 +26,11 @@ bool
 sc_hid_mouse_generate_input_from_scroll(struct sc_hid_input *hid_input,
                                     const struct sc_mouse_scroll_event *event);
 
+// Merge hid_input into prev (a mouse report not sent yet) if both have the
+// same buttons state and the accumulated motions and scrolls fit in a report.
+// Return true if hid_input has been merged (so it must not be sent).
+bool
+sc_hid_mouse_merge_input(struct sc_hid_input *prev,
+                         const struct sc_hid_input *hid_input);
+
 #endif
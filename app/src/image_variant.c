@@ -0,0 +1,308 @@
+#include "image_variant.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+
+#include "png_decoder.h"
+#include "png_encoder.h"
+#include "util/log.h"
+
+// JPEG quality scale (2 is the best, 31 the worst)
+#define SC_IMAGE_VARIANT_JPEG_QSCALE 3
+
+static const char *const sc_image_format_names[] = {
+    [SC_IMAGE_FORMAT_PNG] = "png",
+    [SC_IMAGE_FORMAT_JPEG] = "jpeg",
+    [SC_IMAGE_FORMAT_WEBP] = "webp",
+};
+
+bool
+sc_image_format_parse(const char *s, size_t len, enum sc_image_format *format) {
+    for (unsigned i = 0; i < ARRAY_LEN(sc_image_format_names); ++i) {
+        const char *name = sc_image_format_names[i];
+        if (strlen(name) == len && !strncmp(s, name, len)) {
+            *format = i;
+            return true;
+        }
+    }
+
+    if (len == 3 && !strncmp(s, "jpg", 3)) {
+        *format = SC_IMAGE_FORMAT_JPEG;
+        return true;
+    }
+
+    return false;
+}
+
+const char *
+sc_image_format_get_name(enum sc_image_format format) {
+    assert(format < ARRAY_LEN(sc_image_format_names));
+    return sc_image_format_names[format];
+}
+
+const char *
+sc_image_format_get_mime_type(enum sc_image_format format) {
+    switch (format) {
+        case SC_IMAGE_FORMAT_PNG:
+            return "image/png";
+        case SC_IMAGE_FORMAT_JPEG:
+            return "image/jpeg";
+        case SC_IMAGE_FORMAT_WEBP:
+            return "image/webp";
+        default:
+            assert(!"unexpected image format");
+            return NULL;
+    }
+}
+
+void
+sc_image_variant_compute_size(uint16_t width, uint16_t height, double scale,
+                              uint16_t max_width, uint16_t *out_width,
+                              uint16_t *out_height) {
+    assert(width && height);
+    assert(scale >= 0 && scale <= 1);
+
+    uint32_t w = width;
+    if (scale > 0) {
+        w = (uint32_t) (width * scale + 0.5);
+    }
+    if (max_width && w > max_width) {
+        w = max_width;
+    }
+    if (!w) {
+        w = 1;
+    }
+
+    if (w >= width) {
+        // Never upscale
+        *out_width = width;
+        *out_height = height;
+        return;
+    }
+
+    uint32_t h = ((uint32_t) height * w + width / 2) / width;
+    *out_width = w;
+    *out_height = h ? h : 1;
+}
+
+static AVFrame *
+sc_image_variant_scale(const AVFrame *src, uint16_t width, uint16_t height,
+                       enum AVPixelFormat format) {
+    AVFrame *frame = av_frame_alloc();
+    if (!frame) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    frame->width = width;
+    frame->height = height;
+    frame->format = format;
+    if (av_frame_get_buffer(frame, 0)) {
+        LOG_OOM();
+        av_frame_free(&frame);
+        return NULL;
+    }
+
+    // Downscaling a screenshot (text, thin lines): use an area-averaging
+    // filter rather than the default bicubic
+    struct SwsContext *sws_ctx =
+        sws_getContext(src->width, src->height, src->format, width, height,
+                       format, SWS_AREA, NULL, NULL, NULL);
+    if (!sws_ctx) {
+        LOGW("Could not initialize conversion context for image variant");
+        av_frame_free(&frame);
+        return NULL;
+    }
+
+    int ret = sws_scale(sws_ctx, (const uint8_t * const *) src->data,
+                        src->linesize, 0, src->height, frame->data,
+                        frame->linesize);
+    sws_freeContext(sws_ctx);
+    if (ret <= 0) {
+        LOGW("Could not scale image variant");
+        av_frame_free(&frame);
+        return NULL;
+    }
+
+    return frame;
+}
+
+static bool
+sc_image_variant_encode(enum sc_image_format format, AVFrame *frame,
+                        uint8_t **data, size_t *size) {
+    assert(format != SC_IMAGE_FORMAT_PNG); // use sc_png_encode_rgba8888()
+
+    enum AVCodecID codec_id = format == SC_IMAGE_FORMAT_JPEG
+                            ? AV_CODEC_ID_MJPEG : AV_CODEC_ID_WEBP;
+    const AVCodec *codec = avcodec_find_encoder(codec_id);
+    if (!codec) {
+        LOGW("%s encoder not available", sc_image_format_get_name(format));
+        return false;
+    }
+
+    bool ok = false;
+
+    AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
+    if (!codec_ctx) {
+        LOG_OOM();
+        return false;
+    }
+
+    codec_ctx->width = frame->width;
+    codec_ctx->height = frame->height;
+    codec_ctx->pix_fmt = frame->format;
+    codec_ctx->time_base = (AVRational) {1, 1};
+    if (format == SC_IMAGE_FORMAT_JPEG) {
+        codec_ctx->color_range = AVCOL_RANGE_JPEG;
+        codec_ctx->flags |= AV_CODEC_FLAG_QSCALE;
+        codec_ctx->global_quality = FF_QP2LAMBDA * SC_IMAGE_VARIANT_JPEG_QSCALE;
+        // With a fixed quality scale, the quality of each frame is used
+        frame->quality = codec_ctx->global_quality;
+    }
+
+    if (avcodec_open2(codec_ctx, codec, NULL) < 0) {
+        LOGW("Could not open %s encoder", sc_image_format_get_name(format));
+        goto free_codec_ctx;
+    }
+
+    AVPacket *packet = av_packet_alloc();
+    if (!packet) {
+        LOG_OOM();
+        goto free_codec_ctx;
+    }
+
+    int ret = avcodec_send_frame(codec_ctx, frame);
+    if (ret < 0) {
+        LOGW("Could not send frame to %s encoder: %d",
+             sc_image_format_get_name(format), ret);
+        goto free_packet;
+    }
+
+    ret = avcodec_receive_packet(codec_ctx, packet);
+    if (ret < 0) {
+        LOGW("Could not receive %s packet: %d",
+             sc_image_format_get_name(format), ret);
+        goto free_packet;
+    }
+
+    assert(packet->size > 0);
+    uint8_t *out = malloc(packet->size);
+    if (!out) {
+        LOG_OOM();
+        av_packet_unref(packet);
+        goto free_packet;
+    }
+    memcpy(out, packet->data, packet->size);
+
+    *data = out;
+    *size = packet->size;
+    av_packet_unref(packet);
+    ok = true;
+
+free_packet:
+    av_packet_free(&packet);
+free_codec_ctx:
+    avcodec_free_context(&codec_ctx);
+
+    return ok;
+}
+
+static enum AVPixelFormat
+sc_image_variant_get_pixel_format(enum sc_image_format format) {
+    switch (format) {
+        case SC_IMAGE_FORMAT_PNG:
+            return AV_PIX_FMT_RGBA;
+        case SC_IMAGE_FORMAT_JPEG:
+            // The MJPEG encoder expects full range YUV
+            return AV_PIX_FMT_YUVJ420P;
+        case SC_IMAGE_FORMAT_WEBP:
+            return AV_PIX_FMT_YUV420P;
+        default:
+            assert(!"unexpected image format");
+            return AV_PIX_FMT_NONE;
+    }
+}
+
+bool
+sc_image_variant_create(const uint8_t *png_data, size_t png_size,
+                        const struct sc_image_variant *variant,
+                        uint8_t **data, size_t *size) {
+    assert(png_data && png_size);
+    assert(variant->width && variant->height);
+    assert(data && size);
+
+    AVFrame *src = sc_png_decode(png_data, png_size);
+    if (!src) {
+        return false;
+    }
+
+    enum AVPixelFormat pix_fmt =
+        sc_image_variant_get_pixel_format(variant->format);
+    AVFrame *frame = sc_image_variant_scale(src, variant->width,
+                                            variant->height, pix_fmt);
+    av_frame_free(&src);
+    if (!frame) {
+        return false;
+    }
+
+    bool ok;
+    if (variant->format == SC_IMAGE_FORMAT_PNG) {
+        ok = sc_png_encode_rgba8888(frame->data[0], frame->linesize[0],
+                                    variant->width, variant->height, data,
+                                    size);
+    } else {
+        ok = sc_image_variant_encode(variant->format, frame, data, size);
+    }
+
+    av_frame_free(&frame);
+    return ok;
+}
+
+bool
+sc_image_encode_rgba8888(enum sc_image_format format, int png_level,
+                         const uint8_t *pixels, size_t pitch, uint16_t width,
+                         uint16_t height, uint8_t **data, size_t *size) {
+    assert(pixels);
+    assert(width && height);
+    assert(data && size);
+
+    if (format == SC_IMAGE_FORMAT_PNG) {
+        return sc_png_encode_rgba8888_level(pixels, pitch, width, height,
+                                            png_level, data, size);
+    }
+
+    if (pitch > INT_MAX) {
+        LOGW("Image too large");
+        return false;
+    }
+
+    AVFrame *src = av_frame_alloc();
+    if (!src) {
+        LOG_OOM();
+        return false;
+    }
+
+    // The frame is not refcounted, it is only read for the conversion
+    src->data[0] = (uint8_t *) pixels;
+    src->linesize[0] = (int) pitch;
+    src->width = width;
+    src->height = height;
+    src->format = AV_PIX_FMT_RGBA;
+
+    enum AVPixelFormat pix_fmt = sc_image_variant_get_pixel_format(format);
+    AVFrame *frame = sc_image_variant_scale(src, width, height, pix_fmt);
+    av_frame_free(&src);
+    if (!frame) {
+        return false;
+    }
+
+    bool ok = sc_image_variant_encode(format, frame, data, size);
+    av_frame_free(&frame);
+    return ok;
+}
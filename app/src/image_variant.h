@@ -0,0 +1,69 @@
+#ifndef SC_IMAGE_VARIANT_H
+#define SC_IMAGE_VARIANT_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum sc_image_format {
+    SC_IMAGE_FORMAT_PNG,
+    SC_IMAGE_FORMAT_JPEG,
+    SC_IMAGE_FORMAT_WEBP,
+};
+
+/**
+ * A downscaled and/or re-encoded version of a screenshot
+ */
+struct sc_image_variant {
+    enum sc_image_format format;
+    uint16_t width;
+    uint16_t height;
+};
+
+bool
+sc_image_format_parse(const char *s, size_t len, enum sc_image_format *format);
+
+const char *
+sc_image_format_get_name(enum sc_image_format format);
+
+const char *
+sc_image_format_get_mime_type(enum sc_image_format format);
+
+/**
+ * Compute the size of a variant of a `width`x`height` image
+ *
+ * The image is scaled by `scale` (in (0, 1], or 0 for no scaling), then
+ * limited to `max_width` (0 for unlimited). The aspect ratio is preserved,
+ * and the image is never upscaled.
+ */
+void
+sc_image_variant_compute_size(uint16_t width, uint16_t height, double scale,
+                              uint16_t max_width, uint16_t *out_width,
+                              uint16_t *out_height);
+
+/**
+ * Produce a variant of a PNG image
+ *
+ * On success, *data must be released by free().
+ */
+bool
+sc_image_variant_create(const uint8_t *png_data, size_t png_size,
+                        const struct sc_image_variant *variant,
+                        uint8_t **data, size_t *size);
+
+/**
+ * Encode an RGBA8888 image to the given format, without scaling
+ *
+ * The PNG compression level (from 0 to 9, or SC_PNG_COMPRESSION_DEFAULT) is
+ * ignored for other formats.
+ *
+ * On success, *data must be released by free().
+ */
+bool
+sc_image_encode_rgba8888(enum sc_image_format format, int png_level,
+                         const uint8_t *pixels, size_t pitch, uint16_t width,
+                         uint16_t height, uint8_t **data, size_t *size);
+
+#endif
@@ -0,0 +1,184 @@
+#include "input_latency.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "util/log.h"
+
+// A probe not completed after this delay is abandoned (e.g. the input event
+// did not change the content, or the probe has been dropped)
+#define SC_INPUT_LATENCY_PROBE_TIMEOUT SC_TICK_FROM_SEC(1)
+
+static const char *const stage_names[] = {
+    [SC_INPUT_LATENCY_STAGE_DISPATCH] = "dispatch",
+    [SC_INPUT_LATENCY_STAGE_RTT] = "rtt",
+    [SC_INPUT_LATENCY_STAGE_INJECT] = "inject",
+    [SC_INPUT_LATENCY_STAGE_RENDER] = "render",
+    [SC_INPUT_LATENCY_STAGE_TOTAL] = "total",
+};
+
+// Upper bounds (exclusive, in ms) of the histogram buckets (the last one is
+// unbounded)
+static const unsigned bucket_bounds[SC_INPUT_LATENCY_BUCKET_COUNT - 1] = {
+    16, 33, 50, 75, 100, 200,
+};
+
+bool
+sc_input_latency_init(struct sc_input_latency *il) {
+    bool ok = sc_mutex_init(&il->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    il->state = SC_INPUT_LATENCY_STATE_IDLE;
+    il->sequence = SC_SEQUENCE_INVALID;
+    il->queued = 0;
+    il->sent = 0;
+    il->acked = 0;
+    for (unsigned i = 0; i < SC_INPUT_LATENCY_STAGE_COUNT; ++i) {
+        sc_percentile_window_init(&il->stages[i]);
+    }
+    memset(il->histogram, 0, sizeof(il->histogram));
+    il->measured = 0;
+
+    return true;
+}
+
+void
+sc_input_latency_destroy(struct sc_input_latency *il) {
+    sc_mutex_destroy(&il->mutex);
+}
+
+uint64_t
+sc_input_latency_start_probe(struct sc_input_latency *il) {
+    sc_tick now = sc_tick_now();
+
+    uint64_t sequence = SC_SEQUENCE_INVALID;
+
+    sc_mutex_lock(&il->mutex);
+    if (il->state == SC_INPUT_LATENCY_STATE_IDLE
+            || now - il->queued >= SC_INPUT_LATENCY_PROBE_TIMEOUT) {
+        // Like for the clipboard, sequences are strictly increasing, so late
+        // acks of abandoned probes are ignored
+        sequence = ++il->sequence;
+        il->state = SC_INPUT_LATENCY_STATE_QUEUED;
+        il->queued = now;
+    }
+    sc_mutex_unlock(&il->mutex);
+
+    return sequence;
+}
+
+void
+sc_input_latency_on_sent(struct sc_input_latency *il, uint64_t sequence) {
+    sc_tick now = sc_tick_now();
+
+    sc_mutex_lock(&il->mutex);
+    if (il->state == SC_INPUT_LATENCY_STATE_QUEUED
+            && il->sequence == sequence) {
+        il->state = SC_INPUT_LATENCY_STATE_SENT;
+        il->sent = now;
+    }
+    sc_mutex_unlock(&il->mutex);
+}
+
+void
+sc_input_latency_on_ack(struct sc_input_latency *il, uint64_t sequence,
+                        uint32_t inject_us) {
+    sc_tick now = sc_tick_now();
+
+    sc_mutex_lock(&il->mutex);
+    if (il->state == SC_INPUT_LATENCY_STATE_SENT
+            && il->sequence == sequence) {
+        il->state = SC_INPUT_LATENCY_STATE_ACKED;
+        il->acked = now;
+        sc_percentile_window_push(&il->stages[SC_INPUT_LATENCY_STAGE_RTT],
+                                  now - il->sent);
+        sc_percentile_window_push(&il->stages[SC_INPUT_LATENCY_STAGE_INJECT],
+                                  SC_TICK_FROM_US(inject_us));
+    }
+    sc_mutex_unlock(&il->mutex);
+}
+
+void
+sc_input_latency_on_dispatched(struct sc_input_latency *il, sc_tick duration) {
+    sc_mutex_lock(&il->mutex);
+    sc_percentile_window_push(&il->stages[SC_INPUT_LATENCY_STAGE_DISPATCH],
+                              duration);
+    sc_mutex_unlock(&il->mutex);
+}
+
+void
+sc_input_latency_on_uploaded(struct sc_input_latency *il) {
+    sc_mutex_lock(&il->mutex);
+    if (il->state == SC_INPUT_LATENCY_STATE_ACKED) {
+        il->state = SC_INPUT_LATENCY_STATE_UPLOADED;
+    }
+    sc_mutex_unlock(&il->mutex);
+}
+
+void
+sc_input_latency_on_presented(struct sc_input_latency *il) {
+    sc_tick now = sc_tick_now();
+
+    sc_mutex_lock(&il->mutex);
+    if (il->state == SC_INPUT_LATENCY_STATE_UPLOADED) {
+        sc_tick total = now - il->sent;
+        sc_percentile_window_push(&il->stages[SC_INPUT_LATENCY_STAGE_RENDER],
+                                  now - il->acked);
+        sc_percentile_window_push(&il->stages[SC_INPUT_LATENCY_STAGE_TOTAL],
+                                  total);
+
+        unsigned bucket = 0;
+        while (bucket < SC_INPUT_LATENCY_BUCKET_COUNT - 1
+                && SC_TICK_TO_MS(total) >= bucket_bounds[bucket]) {
+            ++bucket;
+        }
+        ++il->histogram[bucket];
+        ++il->measured;
+
+        il->state = SC_INPUT_LATENCY_STATE_IDLE;
+    }
+    sc_mutex_unlock(&il->mutex);
+}
+
+void
+sc_input_latency_print(struct sc_input_latency *il) {
+    sc_mutex_lock(&il->mutex);
+
+    LOGI("Input latency (ms), %" PRIu64 " inputs measured:", il->measured);
+    LOGI("    %-8s %8s %8s %8s", "stage", "p50", "p95", "p99");
+    for (unsigned i = 0; i < SC_INPUT_LATENCY_STAGE_COUNT; ++i) {
+        const struct sc_percentile_window *window = &il->stages[i];
+        if (!window->count) {
+            LOGI("    %-8s %8s %8s %8s", stage_names[i], "-", "-", "-");
+            continue;
+        }
+
+        double p50 = sc_percentile_window_get(window, 50) / 1000.;
+        double p95 = sc_percentile_window_get(window, 95) / 1000.;
+        double p99 = sc_percentile_window_get(window, 99) / 1000.;
+        LOGI("    %-8s %8.3f %8.3f %8.3f", stage_names[i], p50, p95, p99);
+    }
+
+    if (il->measured) {
+        LOGI("Total input latency histogram:");
+        for (unsigned i = 0; i < SC_INPUT_LATENCY_BUCKET_COUNT; ++i) {
+            uint64_t count = il->histogram[i];
+            // Bar of at most 40 characters
+            unsigned len = count * 40 / il->measured;
+            char bar[41];
+            memset(bar, '#', len);
+            bar[len] = '\0';
+            if (i < SC_INPUT_LATENCY_BUCKET_COUNT - 1) {
+                LOGI("    < %3u ms %8" PRIu64 " %s", bucket_bounds[i], count,
+                     bar);
+            } else {
+                LOGI("    >=%3u ms %8" PRIu64 " %s", bucket_bounds[i - 1],
+                     count, bar);
+            }
+        }
+    }
+
+    sc_mutex_unlock(&il->mutex);
+}
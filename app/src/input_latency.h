@@ -0,0 +1,107 @@
+#ifndef SC_INPUT_LATENCY_H
+#define SC_INPUT_LATENCY_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/acksync.h"
+#include "util/percentile.h"
+#include "util/thread.h"
+#include "util/tick.h"
+
+enum sc_input_latency_stage {
+    // SDL event handled by the screen -> passed to the input manager (UI
+    // thread, measured for all the input events, not only the probes)
+    SC_INPUT_LATENCY_STAGE_DISPATCH,
+    // Probe sent to the device -> ack received
+    SC_INPUT_LATENCY_STAGE_RTT,
+    // Control message received by the device -> event injected (device clock)
+    SC_INPUT_LATENCY_STAGE_INJECT,
+    // Ack received -> first new frame presented
+    SC_INPUT_LATENCY_STAGE_RENDER,
+    // Probe sent to the device -> first new frame presented
+    SC_INPUT_LATENCY_STAGE_TOTAL,
+    SC_INPUT_LATENCY_STAGE_COUNT,
+};
+
+// Buckets of the histogram of the total latency (ms)
+#define SC_INPUT_LATENCY_BUCKET_COUNT 7
+
+enum sc_input_latency_state {
+    SC_INPUT_LATENCY_STATE_IDLE,
+    SC_INPUT_LATENCY_STATE_QUEUED,
+    SC_INPUT_LATENCY_STATE_SENT,
+    SC_INPUT_LATENCY_STATE_ACKED,
+    // A new frame has been uploaded after the ack, but not presented yet
+    SC_INPUT_LATENCY_STATE_UPLOADED,
+};
+
+/**
+ * Input latency tracer (--measure-input-latency)
+ *
+ * After an input event, the controller sends a probe (with a sequence
+ * number) to the device, which acknowledges it once the event is injected.
+ * The first new frame presented after the ack is considered to be the result
+ * of the input event (this is an approximation: the frame may have been
+ * captured just before the injection).
+ *
+ * There is at most one probe in flight.
+ */
+struct sc_input_latency {
+    sc_mutex mutex;
+
+    enum sc_input_latency_state state;
+    uint64_t sequence; // of the current probe
+    sc_tick queued;
+    sc_tick sent;
+    sc_tick acked;
+
+    struct sc_percentile_window stages[SC_INPUT_LATENCY_STAGE_COUNT];
+    uint64_t histogram[SC_INPUT_LATENCY_BUCKET_COUNT];
+    uint64_t measured;
+};
+
+bool
+sc_input_latency_init(struct sc_input_latency *il);
+
+void
+sc_input_latency_destroy(struct sc_input_latency *il);
+
+/**
+ * Start a new probe, if none is in flight (called by the controller after an
+ * input event)
+ *
+ * Return the sequence of the new probe, or SC_SEQUENCE_INVALID.
+ */
+uint64_t
+sc_input_latency_start_probe(struct sc_input_latency *il);
+
+// Called (from the controller thread) once the probe is sent
+void
+sc_input_latency_on_sent(struct sc_input_latency *il, uint64_t sequence);
+
+// Called (from the receiver thread) on probe acknowledgment
+void
+sc_input_latency_on_ack(struct sc_input_latency *il, uint64_t sequence,
+                        uint32_t inject_us);
+
+// Called (from the main thread) when an input event is passed to the input
+// manager, `duration` after the screen started handling it
+void
+sc_input_latency_on_dispatched(struct sc_input_latency *il, sc_tick duration);
+
+// Called (from the main thread) when a new frame is uploaded to the texture
+void
+sc_input_latency_on_uploaded(struct sc_input_latency *il);
+
+// Called (from the main thread) when the last uploaded frame is presented
+void
+sc_input_latency_on_presented(struct sc_input_latency *il);
+
+// Log the p50/p95/p99 of each stage and the histogram of the total latency
+void
+sc_input_latency_print(struct sc_input_latency *il);
+
+#endif
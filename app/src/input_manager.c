@@ -14,6 +14,13 @@
 
 #define SC_EDGE_GESTURE_TOLERANCE 96
 
+// The relative motion events are injected as HID mouse reports, which clamp
+// each motion to [-127, 127]
+#define SC_MOTION_MAX_MERGED_REL 127
+// Maximum delay of a merged motion, in milliseconds, when new motion events
+// are received continuously
+#define SC_MOTION_MAX_MERGE_DELAY_MS 4
+
 void
 sc_input_manager_init(struct sc_input_manager *im,
                       const struct sc_input_manager_params *params) {
@@ -43,6 +50,8 @@ sc_input_manager_init(struct sc_input_manager *im,
 
     im->mouse_buttons_state = 0;
 
+    im->motion.pending = false;
+
     im->last_keycode = SDLK_UNKNOWN;
     im->last_mod = 0;
     im->key_repeat = 0;
@@ -66,6 +75,9 @@ sc_input_manager_configure(struct sc_input_manager *im,
     im->kp = kp;
     im->mp = mp;
     im->gp = gp;
+
+    // The merged motion was for the previous mouse processor
+    im->motion.pending = false;
 }
 
 static void
@@ -193,9 +205,12 @@ get_device_clipboard(struct sc_input_manager *im, enum sc_copy_key copy_key) {
     return true;
 }
 
+// If sent is not NULL, it is set to false when the request is skipped because
+// the device clipboard is already up-to-date (in that case, it will not be
+// acknowledged)
 static bool
 set_device_clipboard(struct sc_input_manager *im, bool paste,
-                     uint64_t sequence) {
+                     uint64_t sequence, bool *sent) {
     assert(im->controller && im->kp);
 
     char *text = SDL_GetClipboardText();
@@ -204,10 +219,21 @@ set_device_clipboard(struct sc_input_manager *im, bool paste,
         return false;
     }
 
+    struct sc_receiver *receiver = &im->controller->receiver;
+    if (sent) {
+        if (sc_receiver_is_clipboard_synced(receiver, text)) {
+            LOGD("Device clipboard unchanged");
+            SDL_free(text);
+            *sent = false;
+            return true;
+        }
+        *sent = true;
+    }
+
     char *text_dup = strdup(text);
-    SDL_free(text);
     if (!text_dup) {
         LOGW("Could not strdup input text");
+        SDL_free(text);
         return false;
     }
 
@@ -219,10 +245,15 @@ set_device_clipboard(struct sc_input_manager *im, bool paste,
 
     if (!sc_controller_push_msg(im->controller, &msg)) {
         free(text_dup);
+        SDL_free(text);
         LOGW("Could not request 'set device clipboard'");
         return false;
     }
 
+    // text_dup may already be freed (by the controller), use the original text
+    sc_receiver_set_clipboard_synced(receiver, text);
+    SDL_free(text);
+
     return true;
 }
 
@@ -239,6 +270,29 @@ set_display_power(struct sc_input_manager *im, bool on) {
     }
 }
 
+static void
+save_instant_replay(struct sc_input_manager *im) {
+    struct sc_instant_replay *replay = im->screen->instant_replay;
+    if (!replay) {
+        LOGW("Instant replay is disabled (see --replay-buffer)");
+        return;
+    }
+
+    // Written asynchronously
+    sc_instant_replay_save(replay);
+}
+
+static void
+add_recording_marker(struct sc_input_manager *im) {
+    struct sc_recorder *recorder = im->screen->recorder;
+    if (!recorder) {
+        LOGW("Recording index is disabled (see --record-index)");
+        return;
+    }
+
+    sc_recorder_add_marker(recorder);
+}
+
 static void
 switch_fps_counter_state(struct sc_input_manager *im) {
     struct sc_fps_counter *fps_counter = &im->screen->fps_counter;
@@ -434,12 +488,20 @@ sc_input_manager_process_key(struct sc_input_manager *im,
                 }
                 return;
             case SDLK_s:
-                if (im->kp && !shift && !repeat && !paused) {
+                if (shift) {
+                    if (!repeat && down) {
+                        save_instant_replay(im);
+                    }
+                } else if (im->kp && !repeat && !paused) {
                     action_app_switch(im, action);
                 }
                 return;
             case SDLK_m:
-                if (im->kp && !shift && !repeat && !paused) {
+                if (shift) {
+                    if (!repeat && down) {
+                        add_recording_marker(im);
+                    }
+                } else if (im->kp && !repeat && !paused) {
                     action_menu(im, action);
                 }
                 return;
@@ -521,7 +583,8 @@ sc_input_manager_process_key(struct sc_input_manager *im,
                     } else {
                         // store the text in the device clipboard and paste,
                         // without requesting an acknowledgment
-                        set_device_clipboard(im, true, SC_SEQUENCE_INVALID);
+                        set_device_clipboard(im, true, SC_SEQUENCE_INVALID,
+                                             NULL);
                     }
                 }
                 return;
@@ -596,13 +659,14 @@ sc_input_manager_process_key(struct sc_input_manager *im,
 
         // Synchronize the computer clipboard to the device clipboard before
         // sending Ctrl+v, to allow seamless copy-paste.
-        bool ok = set_device_clipboard(im, false, sequence);
+        bool sent;
+        bool ok = set_device_clipboard(im, false, sequence, &sent);
         if (!ok) {
             LOGW("Clipboard could not be synchronized, Ctrl+v not injected");
             return;
         }
 
-        if (im->kp->async_paste) {
+        if (sent && im->kp->async_paste) {
             // The key processor must wait for this ack before injecting Ctrl+v
             ack_to_wait = sequence;
             // Increment only when the request succeeded
@@ -650,6 +714,63 @@ sc_input_manager_get_position(struct sc_input_manager *im, int32_t x,
     };
 }
 
+static void
+sc_input_manager_flush_mouse_motion(struct sc_input_manager *im) {
+    if (!im->motion.pending) {
+        return;
+    }
+
+    assert(im->mp && im->mp->relative_mode);
+
+    struct sc_mouse_motion_event evt = {
+        .position = sc_input_manager_get_position(im, 0, 0),
+        .pointer_id = SC_POINTER_ID_MOUSE,
+        .xrel = im->motion.xrel,
+        .yrel = im->motion.yrel,
+        .buttons_state = im->mouse_buttons_state,
+    };
+
+    im->motion.pending = false;
+
+    assert(im->mp->ops->process_mouse_motion);
+    im->mp->ops->process_mouse_motion(im->mp, &evt);
+}
+
+static void
+sc_input_manager_merge_mouse_motion(struct sc_input_manager *im,
+                                    const SDL_MouseMotionEvent *event) {
+    assert(im->mp->relative_mode);
+
+    if (im->motion.pending) {
+        int32_t xrel = im->motion.xrel + event->xrel;
+        int32_t yrel = im->motion.yrel + event->yrel;
+        if (abs(xrel) > SC_MOTION_MAX_MERGED_REL
+                || abs(yrel) > SC_MOTION_MAX_MERGED_REL) {
+            // The merged motion would be clamped
+            sc_input_manager_flush_mouse_motion(im);
+        } else {
+            im->motion.xrel = xrel;
+            im->motion.yrel = yrel;
+        }
+    }
+
+    if (!im->motion.pending) {
+        im->motion.pending = true;
+        im->motion.xrel = event->xrel;
+        im->motion.yrel = event->yrel;
+        im->motion.timestamp = event->timestamp;
+    }
+
+    // Flush once all the motion events received at once are merged. Any
+    // other event also flushes the merged motion before being processed, so
+    // that the order with the button transitions is preserved.
+    bool expired = event->timestamp - im->motion.timestamp
+                        >= SC_MOTION_MAX_MERGE_DELAY_MS;
+    if (expired || !SDL_HasEvent(SDL_MOUSEMOTION)) {
+        sc_input_manager_flush_mouse_motion(im);
+    }
+}
+
 static void
 sc_input_manager_process_mouse_motion(struct sc_input_manager *im,
                                       const SDL_MouseMotionEvent *event) {
@@ -658,6 +779,13 @@ sc_input_manager_process_mouse_motion(struct sc_input_manager *im,
         return;
     }
 
+    if (im->mp->relative_mode) {
+        // No virtual finger in relative mode
+        assert(!im->vfinger_down);
+        sc_input_manager_merge_mouse_motion(im, event);
+        return;
+    }
+
     struct sc_mouse_motion_event evt = {
         .position = sc_input_manager_get_position(im, event->x, event->y),
         .pointer_id = im->vfinger_down ? SC_POINTER_ID_GENERIC_FINGER
@@ -693,9 +821,9 @@ sc_input_manager_process_touch(struct sc_input_manager *im,
         return;
     }
 
-    int dw;
-    int dh;
-    SDL_GL_GetDrawableSize(im->screen->window, &dw, &dh);
+    // Cached by the screen (updated on resize)
+    int dw = im->screen->drawable_size.width;
+    int dh = im->screen->drawable_size.height;
 
     // SDL touch event coordinates are normalized in the range [0; 1]
     int32_t x = event->x * dw;
@@ -1038,6 +1166,11 @@ sc_input_manager_handle_event(struct sc_input_manager *im,
                               const SDL_Event *event) {
     bool control = im->controller;
     bool paused = im->screen->paused;
+
+    if (event->type != SDL_MOUSEMOTION) {
+        sc_input_manager_flush_mouse_motion(im);
+    }
+
     switch (event->type) {
         case SDL_TEXTINPUT:
             if (!im->kp || paused) {
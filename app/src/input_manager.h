@@ -36,6 +36,15 @@ struct sc_input_manager {
 
     uint8_t mouse_buttons_state; // OR of enum sc_mouse_button values
 
+    // In relative mode, the motion events received at once (gaming mice may
+    // report up to 8000 events per second) are merged into a single event
+    struct {
+        bool pending;
+        int32_t xrel;
+        int32_t yrel;
+        uint32_t timestamp; // SDL timestamp of the first merged event
+    } motion;
+
     // Tracks the number of identical consecutive shortcut key down events.
     // Not to be confused with event->repeat, which counts the number of
     // system-generated repeated key presses.
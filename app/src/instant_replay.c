@@ -0,0 +1,547 @@
+#include "instant_replay.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "options.h"
+#include "recorder.h"
+#include "util/log.h"
+
+/** Downcast packet sink to sc_instant_replay_stream */
+#define DOWNCAST(SINK) \
+    container_of(SINK, struct sc_instant_replay_stream, packet_sink)
+
+// Buffered packets of a stream, taken (by reference) for a save
+struct sc_instant_replay_snapshot {
+    // Copy of the codec parameters, NULL if the stream is not saved
+    AVCodecContext *codec_ctx;
+    AVPacket *config;
+    AVPacket **packets;
+    size_t count;
+};
+
+static void
+sc_instant_replay_free_packets(AVPacket **packets, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        av_packet_free(&packets[i]);
+    }
+}
+
+// The mutex must be locked
+static void
+sc_instant_replay_drop(struct sc_instant_replay *replay,
+                       struct sc_instant_replay_stream *stream, size_t count) {
+    struct sc_instant_replay_packets *packets = &stream->packets;
+    assert(count <= packets->size);
+
+    for (size_t i = 0; i < count; ++i) {
+        replay->bytes -= packets->data[i]->size;
+    }
+    sc_instant_replay_free_packets(packets->data, count);
+    sc_vector_remove_slice(packets, 0, count);
+}
+
+// Return the index of the first keyframe after the first packet (or the
+// number of packets if there is none)
+static size_t
+sc_instant_replay_next_keyframe(const struct sc_instant_replay_packets *packets,
+                                size_t from) {
+    size_t i = from;
+    while (i < packets->size && !(packets->data[i]->flags & AV_PKT_FLAG_KEY)) {
+        ++i;
+    }
+    return i;
+}
+
+// Drop the packets which are not needed anymore (the mutex must be locked)
+static void
+sc_instant_replay_trim(struct sc_instant_replay *replay) {
+    struct sc_instant_replay_packets *vp = &replay->video.packets;
+    struct sc_instant_replay_packets *ap = &replay->audio.packets;
+
+    int64_t last_pts = INT64_MIN;
+    if (vp->size) {
+        last_pts = vp->data[vp->size - 1]->pts;
+    }
+    if (ap->size) {
+        last_pts = MAX(last_pts, ap->data[ap->size - 1]->pts);
+    }
+    if (last_pts == INT64_MIN) {
+        return;
+    }
+
+    int64_t cutoff = last_pts - SC_TICK_TO_US(replay->duration);
+
+    // The video must start on a keyframe: drop all the packets before the
+    // last keyframe older than the duration
+    size_t drop = 0;
+    for (size_t i = 1; i < vp->size && vp->data[i]->pts <= cutoff; ++i) {
+        if (vp->data[i]->flags & AV_PKT_FLAG_KEY) {
+            drop = i;
+        }
+    }
+    if (drop) {
+        sc_instant_replay_drop(replay, &replay->video, drop);
+    }
+
+    // Over budget, drop the oldest groups of pictures
+    while (replay->bytes > replay->max_bytes && vp->size) {
+        drop = sc_instant_replay_next_keyframe(vp, 1);
+        sc_instant_replay_drop(replay, &replay->video, drop);
+    }
+
+    // Do not keep audio before the start of the video
+    int64_t audio_start = vp->size ? vp->data[0]->pts : cutoff;
+    drop = 0;
+    while (drop < ap->size && ap->data[drop]->pts < audio_start) {
+        ++drop;
+    }
+
+    // Audio only: drop the oldest packets over budget
+    size_t bytes = replay->bytes;
+    for (size_t i = 0; i < drop; ++i) {
+        bytes -= ap->data[i]->size;
+    }
+    while (bytes > replay->max_bytes && drop < ap->size) {
+        bytes -= ap->data[drop++]->size;
+    }
+
+    if (drop) {
+        sc_instant_replay_drop(replay, &replay->audio, drop);
+    }
+}
+
+static bool
+sc_instant_replay_push(struct sc_instant_replay_stream *stream,
+                       const AVPacket *packet) {
+    struct sc_instant_replay *replay = stream->replay;
+
+    bool is_config = packet->pts == AV_NOPTS_VALUE;
+    if (is_config) {
+        if (stream->video) {
+            // On a new config (e.g. on device orientation change), the
+            // previous packets cannot be saved in the same file
+            sc_instant_replay_drop(replay, stream, stream->packets.size);
+        }
+        av_packet_free(&stream->config);
+        stream->config = av_packet_clone(packet);
+        if (!stream->config) {
+            LOG_OOM();
+            return false;
+        }
+        return true;
+    }
+
+    bool keyframe = packet->flags & AV_PKT_FLAG_KEY;
+    if (stream->video && !stream->packets.size && !keyframe) {
+        // Wait for a keyframe
+        return true;
+    }
+
+    AVPacket *p = av_packet_clone(packet);
+    if (!p) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (!sc_vector_push(&stream->packets, p)) {
+        LOG_OOM();
+        av_packet_free(&p);
+        return false;
+    }
+    replay->bytes += p->size;
+
+    sc_instant_replay_trim(replay);
+    return true;
+}
+
+static void
+sc_instant_replay_snapshot_destroy(struct sc_instant_replay_snapshot *snap) {
+    avcodec_free_context(&snap->codec_ctx);
+    av_packet_free(&snap->config);
+    if (snap->packets) {
+        sc_instant_replay_free_packets(snap->packets, snap->count);
+        free(snap->packets);
+    }
+}
+
+// Take references to the buffered packets (the mutex must be locked)
+static bool
+sc_instant_replay_snapshot(struct sc_instant_replay_stream *stream,
+                           struct sc_instant_replay_snapshot *snap) {
+    snap->codec_ctx = NULL;
+    snap->config = NULL;
+    snap->packets = NULL;
+    snap->count = 0;
+
+    const struct sc_instant_replay_packets *packets = &stream->packets;
+    if (!stream->codec_ctx || !packets->size) {
+        // Nothing to save for this stream
+        return true;
+    }
+
+    if (!stream->config
+            && stream->codec_ctx->codec_id != AV_CODEC_ID_PCM_S16LE) {
+        // The packets could not be decoded
+        return true;
+    }
+
+    AVCodecParameters *par = avcodec_parameters_alloc();
+    if (!par) {
+        LOG_OOM();
+        return false;
+    }
+
+    // The recorder needs a codec context, but the demuxer one may be closed
+    // while saving: make a copy
+    snap->codec_ctx = avcodec_alloc_context3(NULL);
+    bool ok = snap->codec_ctx
+           && avcodec_parameters_from_context(par, stream->codec_ctx) >= 0
+           && avcodec_parameters_to_context(snap->codec_ctx, par) >= 0;
+    avcodec_parameters_free(&par);
+    if (!ok) {
+        LOG_OOM();
+        goto error;
+    }
+
+    if (stream->config) {
+        snap->config = av_packet_clone(stream->config);
+        if (!snap->config) {
+            LOG_OOM();
+            goto error;
+        }
+    }
+
+    snap->packets = malloc(packets->size * sizeof(*snap->packets));
+    if (!snap->packets) {
+        LOG_OOM();
+        goto error;
+    }
+
+    for (size_t i = 0; i < packets->size; ++i) {
+        snap->packets[i] = av_packet_clone(packets->data[i]);
+        if (!snap->packets[i]) {
+            LOG_OOM();
+            goto error;
+        }
+        ++snap->count;
+    }
+
+    return true;
+
+error:
+    sc_instant_replay_snapshot_destroy(snap);
+    snap->codec_ctx = NULL;
+    snap->packets = NULL;
+    snap->count = 0;
+    return false;
+}
+
+static bool
+sc_instant_replay_push_all(struct sc_packet_sink *sink,
+                           const struct sc_instant_replay_snapshot *snap) {
+    if (snap->config && !sink->ops->push(sink, snap->config)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < snap->count; ++i) {
+        if (!sink->ops->push(sink, snap->packets[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void
+sc_instant_replay_on_recorder_ended(struct sc_recorder *recorder, bool success,
+                                    void *userdata) {
+    (void) recorder;
+
+    bool *result = userdata;
+    *result = success;
+}
+
+static void
+sc_instant_replay_write(struct sc_instant_replay_snapshot *video,
+                        struct sc_instant_replay_snapshot *audio,
+                        const char *filename) {
+    bool has_video = video->codec_ctx;
+    bool has_audio = audio->codec_ctx;
+    assert(has_video || has_audio);
+
+    static const struct sc_recorder_callbacks cbs = {
+        .on_ended = sc_instant_replay_on_recorder_ended,
+    };
+
+    // The packets are only referenced (they are already in memory): no
+    // write buffer, no segments
+    bool success = false;
+    struct sc_recorder recorder;
+    if (!sc_recorder_init(&recorder, filename, SC_RECORD_FORMAT_MKV, 0, 0, 0,
+                          has_video, has_audio, SC_ORIENTATION_0, &cbs,
+                          &success)) {
+        return;
+    }
+
+    if (!sc_recorder_start(&recorder)) {
+        sc_recorder_destroy(&recorder);
+        return;
+    }
+
+    struct sc_packet_sink *video_sink = &recorder.video_packet_sink;
+    struct sc_packet_sink *audio_sink = &recorder.audio_packet_sink;
+    bool video_open = false;
+    bool audio_open = false;
+    bool ok = true;
+
+    if (has_video) {
+        video_open = video_sink->ops->open(video_sink, video->codec_ctx);
+        ok = video_open;
+    }
+    if (ok && has_audio) {
+        audio_open = audio_sink->ops->open(audio_sink, audio->codec_ctx);
+        ok = audio_open;
+    }
+    if (ok && has_video) {
+        ok = sc_instant_replay_push_all(video_sink, video);
+    }
+    if (ok && has_audio) {
+        ok = sc_instant_replay_push_all(audio_sink, audio);
+    }
+
+    if (!ok) {
+        // Do not write a partial replay
+        sc_recorder_stop(&recorder);
+    }
+
+    // Closing the sinks finishes the recording
+    if (video_open) {
+        video_sink->ops->close(video_sink);
+    }
+    if (audio_open) {
+        audio_sink->ops->close(audio_sink);
+    }
+    if (!video_open && !audio_open) {
+        sc_recorder_stop(&recorder);
+    }
+
+    sc_recorder_join(&recorder);
+    sc_recorder_destroy(&recorder);
+
+    if (success) {
+        LOGI("Instant replay saved: %s", filename);
+    } else {
+        LOGE("Could not save instant replay");
+    }
+}
+
+static void
+sc_instant_replay_process(struct sc_instant_replay *replay) {
+    struct sc_instant_replay_snapshot video;
+    struct sc_instant_replay_snapshot audio;
+
+    sc_mutex_lock(&replay->mutex);
+    bool ok = sc_instant_replay_snapshot(&replay->video, &video);
+    if (ok) {
+        ok = sc_instant_replay_snapshot(&replay->audio, &audio);
+        if (!ok) {
+            sc_instant_replay_snapshot_destroy(&video);
+        }
+    }
+    sc_mutex_unlock(&replay->mutex);
+
+    if (!ok) {
+        return;
+    }
+
+    if (!video.codec_ctx && !audio.codec_ctx) {
+        LOGW("Instant replay: nothing to save yet");
+        goto end;
+    }
+
+    time_t now = time(NULL);
+    struct tm local_tm = {0};
+#ifdef _WIN32
+    localtime_s(&local_tm, &now);
+#else
+    localtime_r(&now, &local_tm);
+#endif
+
+    char filename[64];
+    snprintf(filename, sizeof(filename),
+             "scrcpy_replay_%04d%02d%02d_%02d%02d%02d.mkv",
+             local_tm.tm_year + 1900, local_tm.tm_mon + 1, local_tm.tm_mday,
+             local_tm.tm_hour, local_tm.tm_min, local_tm.tm_sec);
+
+    sc_instant_replay_write(&video, &audio, filename);
+
+end:
+    sc_instant_replay_snapshot_destroy(&video);
+    sc_instant_replay_snapshot_destroy(&audio);
+}
+
+static int
+run_instant_replay(void *data) {
+    struct sc_instant_replay *replay = data;
+
+    for (;;) {
+        sc_mutex_lock(&replay->mutex);
+        while (!replay->stopped && !replay->requested) {
+            sc_cond_wait(&replay->cond, &replay->mutex);
+        }
+        bool stopped = replay->stopped;
+        replay->requested = false;
+        sc_mutex_unlock(&replay->mutex);
+
+        if (stopped) {
+            break;
+        }
+
+        sc_instant_replay_process(replay);
+    }
+
+    return 0;
+}
+
+static bool
+sc_instant_replay_packet_sink_open(struct sc_packet_sink *sink,
+                                   AVCodecContext *ctx) {
+    struct sc_instant_replay_stream *stream = DOWNCAST(sink);
+    struct sc_instant_replay *replay = stream->replay;
+
+    sc_mutex_lock(&replay->mutex);
+    stream->codec_ctx = ctx;
+    sc_mutex_unlock(&replay->mutex);
+
+    return true;
+}
+
+static void
+sc_instant_replay_packet_sink_close(struct sc_packet_sink *sink) {
+    struct sc_instant_replay_stream *stream = DOWNCAST(sink);
+    struct sc_instant_replay *replay = stream->replay;
+
+    sc_mutex_lock(&replay->mutex);
+    stream->codec_ctx = NULL;
+    av_packet_free(&stream->config);
+    sc_instant_replay_drop(replay, stream, stream->packets.size);
+    sc_mutex_unlock(&replay->mutex);
+}
+
+static bool
+sc_instant_replay_packet_sink_push(struct sc_packet_sink *sink,
+                                   const AVPacket *packet) {
+    struct sc_instant_replay_stream *stream = DOWNCAST(sink);
+    struct sc_instant_replay *replay = stream->replay;
+
+    sc_mutex_lock(&replay->mutex);
+    bool ok = sc_instant_replay_push(stream, packet);
+    if (!ok) {
+        // The replay is optional, do not stop mirroring: start again from the
+        // next packets
+        LOGW("Could not keep the packets for instant replay");
+        sc_instant_replay_drop(replay, stream, stream->packets.size);
+    }
+    sc_mutex_unlock(&replay->mutex);
+
+    return true;
+}
+
+static void
+sc_instant_replay_stream_init(struct sc_instant_replay_stream *stream,
+                              struct sc_instant_replay *replay, bool video) {
+    stream->replay = replay;
+    stream->video = video;
+    stream->codec_ctx = NULL;
+    stream->config = NULL;
+    sc_vector_init(&stream->packets);
+
+    static const struct sc_packet_sink_ops ops = {
+        .open = sc_instant_replay_packet_sink_open,
+        .close = sc_instant_replay_packet_sink_close,
+        .push = sc_instant_replay_packet_sink_push,
+    };
+
+    stream->packet_sink.ops = &ops;
+}
+
+static void
+sc_instant_replay_stream_destroy(struct sc_instant_replay_stream *stream) {
+    av_packet_free(&stream->config);
+    sc_instant_replay_drop(stream->replay, stream, stream->packets.size);
+    sc_vector_destroy(&stream->packets);
+}
+
+bool
+sc_instant_replay_init(struct sc_instant_replay *replay, sc_tick duration,
+                       size_t max_bytes) {
+    assert(duration > 0);
+    assert(max_bytes);
+
+    bool ok = sc_mutex_init(&replay->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&replay->cond);
+    if (!ok) {
+        sc_mutex_destroy(&replay->mutex);
+        return false;
+    }
+
+    replay->duration = duration;
+    replay->max_bytes = max_bytes;
+    replay->stopped = false;
+    replay->requested = false;
+    replay->bytes = 0;
+
+    sc_instant_replay_stream_init(&replay->video, replay, true);
+    sc_instant_replay_stream_init(&replay->audio, replay, false);
+
+    return true;
+}
+
+bool
+sc_instant_replay_start(struct sc_instant_replay *replay) {
+    bool ok = sc_thread_create(&replay->thread, run_instant_replay,
+                               "scrcpy-replay", replay);
+    if (!ok) {
+        LOGE("Could not start instant replay thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_instant_replay_stop(struct sc_instant_replay *replay) {
+    sc_mutex_lock(&replay->mutex);
+    replay->stopped = true;
+    sc_cond_signal(&replay->cond);
+    sc_mutex_unlock(&replay->mutex);
+}
+
+void
+sc_instant_replay_join(struct sc_instant_replay *replay) {
+    sc_thread_join(&replay->thread, NULL);
+}
+
+void
+sc_instant_replay_destroy(struct sc_instant_replay *replay) {
+    sc_instant_replay_stream_destroy(&replay->video);
+    sc_instant_replay_stream_destroy(&replay->audio);
+    assert(!replay->bytes);
+    sc_cond_destroy(&replay->cond);
+    sc_mutex_destroy(&replay->mutex);
+}
+
+void
+sc_instant_replay_save(struct sc_instant_replay *replay) {
+    sc_mutex_lock(&replay->mutex);
+    replay->requested = true;
+    sc_cond_signal(&replay->cond);
+    sc_mutex_unlock(&replay->mutex);
+}
@@ -0,0 +1,78 @@
+#ifndef SC_INSTANT_REPLAY_H
+#define SC_INSTANT_REPLAY_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <libavcodec/avcodec.h>
+
+#include "trait/packet_sink.h"
+#include "util/thread.h"
+#include "util/tick.h"
+#include "util/vector.h"
+
+// Memory bound of the packets kept, whatever the duration
+#define SC_INSTANT_REPLAY_MAX_BYTES ((size_t) 64 * 1024 * 1024)
+
+struct sc_instant_replay_packets SC_VECTOR(AVPacket *);
+
+struct sc_instant_replay_stream {
+    struct sc_packet_sink packet_sink; // packet sink trait
+    struct sc_instant_replay *replay;
+    bool video;
+
+    // All the fields below are protected by the replay mutex
+
+    const AVCodecContext *codec_ctx; // valid between open() and close()
+    AVPacket *config; // NULL if none (yet)
+    // The recent packets (the video ones start with a keyframe)
+    struct sc_instant_replay_packets packets;
+};
+
+/**
+ * Instant replay buffer (--replay-buffer)
+ *
+ * It keeps (references to) the encoded video and audio packets of the last
+ * `duration`, bounded in memory. On request, they are written to a new file
+ * by a sc_recorder (from a separate thread), without re-encoding.
+ */
+struct sc_instant_replay {
+    struct sc_instant_replay_stream video;
+    struct sc_instant_replay_stream audio;
+
+    sc_tick duration;
+    size_t max_bytes;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool stopped;
+    bool requested;
+
+    size_t bytes; // total size of the packets kept (protected by mutex)
+};
+
+bool
+sc_instant_replay_init(struct sc_instant_replay *replay, sc_tick duration,
+                       size_t max_bytes);
+
+bool
+sc_instant_replay_start(struct sc_instant_replay *replay);
+
+void
+sc_instant_replay_stop(struct sc_instant_replay *replay);
+
+void
+sc_instant_replay_join(struct sc_instant_replay *replay);
+
+void
+sc_instant_replay_destroy(struct sc_instant_replay *replay);
+
+/**
+ * Request to save the buffered packets to a new file (asynchronously)
+ */
+void
+sc_instant_replay_save(struct sc_instant_replay *replay);
+
+#endif
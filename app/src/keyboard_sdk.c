@@ -11,7 +11,6 @@
 #include "control_msg.h"
 #include "controller.h"
 #include "input_events.h"
-#include "util/intmap.h"
 #include "util/log.h"
 
 /** Downcast key processor to sc_keyboard_sdk */
@@ -26,145 +25,165 @@ convert_keycode_action(enum sc_action action) {
     return AKEY_EVENT_ACTION_UP;
 }
 
+// The conversion tables are indexed directly by keycode, for a constant-time
+// lookup on every key event. SDL keycodes are either the character produced
+// by the key (all below 128 for the keys converted here), or the scancode with
+// SDLK_SCANCODE_MASK set: both ranges are mapped to a single index range.
+#define SC_KEYCODE_TABLE_SIZE (128 + SDL_NUM_SCANCODES)
+#define SC_KC_INDEX(K) \
+    ((K) & SDLK_SCANCODE_MASK ? 128 + ((K) & ~SDLK_SCANCODE_MASK) : (K))
+
+// Return -1 if the keycode is out of the tables
+static int
+sc_keycode_index(enum sc_keycode keycode) {
+    if (keycode & SDLK_SCANCODE_MASK) {
+        int scancode = keycode & ~SDLK_SCANCODE_MASK;
+        return scancode < SDL_NUM_SCANCODES ? 128 + scancode : -1;
+    }
+    return keycode >= 0 && keycode < 128 ? (int) keycode : -1;
+}
+
 static bool
 convert_keycode(enum sc_keycode from, enum android_keycode *to, uint16_t mod,
                 enum sc_key_inject_mode key_inject_mode) {
     // Navigation keys and ENTER.
     // Used in all modes.
-    static const struct sc_intmap_entry special_keys[] = {
-        {SC_KEYCODE_RETURN,    AKEYCODE_ENTER},
-        {SC_KEYCODE_KP_ENTER,  AKEYCODE_NUMPAD_ENTER},
-        {SC_KEYCODE_ESCAPE,    AKEYCODE_ESCAPE},
-        {SC_KEYCODE_BACKSPACE, AKEYCODE_DEL},
-        {SC_KEYCODE_TAB,       AKEYCODE_TAB},
-        {SC_KEYCODE_PAGEUP,    AKEYCODE_PAGE_UP},
-        {SC_KEYCODE_DELETE,    AKEYCODE_FORWARD_DEL},
-        {SC_KEYCODE_HOME,      AKEYCODE_MOVE_HOME},
-        {SC_KEYCODE_END,       AKEYCODE_MOVE_END},
-        {SC_KEYCODE_PAGEDOWN,  AKEYCODE_PAGE_DOWN},
-        {SC_KEYCODE_RIGHT,     AKEYCODE_DPAD_RIGHT},
-        {SC_KEYCODE_LEFT,      AKEYCODE_DPAD_LEFT},
-        {SC_KEYCODE_DOWN,      AKEYCODE_DPAD_DOWN},
-        {SC_KEYCODE_UP,        AKEYCODE_DPAD_UP},
-        {SC_KEYCODE_LCTRL,     AKEYCODE_CTRL_LEFT},
-        {SC_KEYCODE_RCTRL,     AKEYCODE_CTRL_RIGHT},
-        {SC_KEYCODE_LSHIFT,    AKEYCODE_SHIFT_LEFT},
-        {SC_KEYCODE_RSHIFT,    AKEYCODE_SHIFT_RIGHT},
-        {SC_KEYCODE_LALT,      AKEYCODE_ALT_LEFT},
-        {SC_KEYCODE_RALT,      AKEYCODE_ALT_RIGHT},
-        {SC_KEYCODE_LGUI,      AKEYCODE_META_LEFT},
-        {SC_KEYCODE_RGUI,      AKEYCODE_META_RIGHT},
+    static const uint16_t special_keys[SC_KEYCODE_TABLE_SIZE] = {
+        [SC_KC_INDEX(SC_KEYCODE_RETURN)]    = AKEYCODE_ENTER,
+        [SC_KC_INDEX(SC_KEYCODE_KP_ENTER)]  = AKEYCODE_NUMPAD_ENTER,
+        [SC_KC_INDEX(SC_KEYCODE_ESCAPE)]    = AKEYCODE_ESCAPE,
+        [SC_KC_INDEX(SC_KEYCODE_BACKSPACE)] = AKEYCODE_DEL,
+        [SC_KC_INDEX(SC_KEYCODE_TAB)]       = AKEYCODE_TAB,
+        [SC_KC_INDEX(SC_KEYCODE_PAGEUP)]    = AKEYCODE_PAGE_UP,
+        [SC_KC_INDEX(SC_KEYCODE_DELETE)]    = AKEYCODE_FORWARD_DEL,
+        [SC_KC_INDEX(SC_KEYCODE_HOME)]      = AKEYCODE_MOVE_HOME,
+        [SC_KC_INDEX(SC_KEYCODE_END)]       = AKEYCODE_MOVE_END,
+        [SC_KC_INDEX(SC_KEYCODE_PAGEDOWN)]  = AKEYCODE_PAGE_DOWN,
+        [SC_KC_INDEX(SC_KEYCODE_RIGHT)]     = AKEYCODE_DPAD_RIGHT,
+        [SC_KC_INDEX(SC_KEYCODE_LEFT)]      = AKEYCODE_DPAD_LEFT,
+        [SC_KC_INDEX(SC_KEYCODE_DOWN)]      = AKEYCODE_DPAD_DOWN,
+        [SC_KC_INDEX(SC_KEYCODE_UP)]        = AKEYCODE_DPAD_UP,
+        [SC_KC_INDEX(SC_KEYCODE_LCTRL)]     = AKEYCODE_CTRL_LEFT,
+        [SC_KC_INDEX(SC_KEYCODE_RCTRL)]     = AKEYCODE_CTRL_RIGHT,
+        [SC_KC_INDEX(SC_KEYCODE_LSHIFT)]    = AKEYCODE_SHIFT_LEFT,
+        [SC_KC_INDEX(SC_KEYCODE_RSHIFT)]    = AKEYCODE_SHIFT_RIGHT,
+        [SC_KC_INDEX(SC_KEYCODE_LALT)]      = AKEYCODE_ALT_LEFT,
+        [SC_KC_INDEX(SC_KEYCODE_RALT)]      = AKEYCODE_ALT_RIGHT,
+        [SC_KC_INDEX(SC_KEYCODE_LGUI)]      = AKEYCODE_META_LEFT,
+        [SC_KC_INDEX(SC_KEYCODE_RGUI)]      = AKEYCODE_META_RIGHT,
     };
 
     // Numpad navigation keys.
     // Used in all modes, when NumLock and Shift are disabled.
-    static const struct sc_intmap_entry kp_nav_keys[] = {
-        {SC_KEYCODE_KP_0,      AKEYCODE_INSERT},
-        {SC_KEYCODE_KP_1,      AKEYCODE_MOVE_END},
-        {SC_KEYCODE_KP_2,      AKEYCODE_DPAD_DOWN},
-        {SC_KEYCODE_KP_3,      AKEYCODE_PAGE_DOWN},
-        {SC_KEYCODE_KP_4,      AKEYCODE_DPAD_LEFT},
-        {SC_KEYCODE_KP_6,      AKEYCODE_DPAD_RIGHT},
-        {SC_KEYCODE_KP_7,      AKEYCODE_MOVE_HOME},
-        {SC_KEYCODE_KP_8,      AKEYCODE_DPAD_UP},
-        {SC_KEYCODE_KP_9,      AKEYCODE_PAGE_UP},
-        {SC_KEYCODE_KP_PERIOD, AKEYCODE_FORWARD_DEL},
+    static const uint16_t kp_nav_keys[SC_KEYCODE_TABLE_SIZE] = {
+        [SC_KC_INDEX(SC_KEYCODE_KP_0)]      = AKEYCODE_INSERT,
+        [SC_KC_INDEX(SC_KEYCODE_KP_1)]      = AKEYCODE_MOVE_END,
+        [SC_KC_INDEX(SC_KEYCODE_KP_2)]      = AKEYCODE_DPAD_DOWN,
+        [SC_KC_INDEX(SC_KEYCODE_KP_3)]      = AKEYCODE_PAGE_DOWN,
+        [SC_KC_INDEX(SC_KEYCODE_KP_4)]      = AKEYCODE_DPAD_LEFT,
+        [SC_KC_INDEX(SC_KEYCODE_KP_6)]      = AKEYCODE_DPAD_RIGHT,
+        [SC_KC_INDEX(SC_KEYCODE_KP_7)]      = AKEYCODE_MOVE_HOME,
+        [SC_KC_INDEX(SC_KEYCODE_KP_8)]      = AKEYCODE_DPAD_UP,
+        [SC_KC_INDEX(SC_KEYCODE_KP_9)]      = AKEYCODE_PAGE_UP,
+        [SC_KC_INDEX(SC_KEYCODE_KP_PERIOD)] = AKEYCODE_FORWARD_DEL,
     };
 
     // Letters and space.
     // Used in non-text mode.
-    static const struct sc_intmap_entry alphaspace_keys[] = {
-        {SC_KEYCODE_a,         AKEYCODE_A},
-        {SC_KEYCODE_b,         AKEYCODE_B},
-        {SC_KEYCODE_c,         AKEYCODE_C},
-        {SC_KEYCODE_d,         AKEYCODE_D},
-        {SC_KEYCODE_e,         AKEYCODE_E},
-        {SC_KEYCODE_f,         AKEYCODE_F},
-        {SC_KEYCODE_g,         AKEYCODE_G},
-        {SC_KEYCODE_h,         AKEYCODE_H},
-        {SC_KEYCODE_i,         AKEYCODE_I},
-        {SC_KEYCODE_j,         AKEYCODE_J},
-        {SC_KEYCODE_k,         AKEYCODE_K},
-        {SC_KEYCODE_l,         AKEYCODE_L},
-        {SC_KEYCODE_m,         AKEYCODE_M},
-        {SC_KEYCODE_n,         AKEYCODE_N},
-        {SC_KEYCODE_o,         AKEYCODE_O},
-        {SC_KEYCODE_p,         AKEYCODE_P},
-        {SC_KEYCODE_q,         AKEYCODE_Q},
-        {SC_KEYCODE_r,         AKEYCODE_R},
-        {SC_KEYCODE_s,         AKEYCODE_S},
-        {SC_KEYCODE_t,         AKEYCODE_T},
-        {SC_KEYCODE_u,         AKEYCODE_U},
-        {SC_KEYCODE_v,         AKEYCODE_V},
-        {SC_KEYCODE_w,         AKEYCODE_W},
-        {SC_KEYCODE_x,         AKEYCODE_X},
-        {SC_KEYCODE_y,         AKEYCODE_Y},
-        {SC_KEYCODE_z,         AKEYCODE_Z},
-        {SC_KEYCODE_SPACE,     AKEYCODE_SPACE},
+    static const uint16_t alphaspace_keys[SC_KEYCODE_TABLE_SIZE] = {
+        [SC_KC_INDEX(SC_KEYCODE_a)]     = AKEYCODE_A,
+        [SC_KC_INDEX(SC_KEYCODE_b)]     = AKEYCODE_B,
+        [SC_KC_INDEX(SC_KEYCODE_c)]     = AKEYCODE_C,
+        [SC_KC_INDEX(SC_KEYCODE_d)]     = AKEYCODE_D,
+        [SC_KC_INDEX(SC_KEYCODE_e)]     = AKEYCODE_E,
+        [SC_KC_INDEX(SC_KEYCODE_f)]     = AKEYCODE_F,
+        [SC_KC_INDEX(SC_KEYCODE_g)]     = AKEYCODE_G,
+        [SC_KC_INDEX(SC_KEYCODE_h)]     = AKEYCODE_H,
+        [SC_KC_INDEX(SC_KEYCODE_i)]     = AKEYCODE_I,
+        [SC_KC_INDEX(SC_KEYCODE_j)]     = AKEYCODE_J,
+        [SC_KC_INDEX(SC_KEYCODE_k)]     = AKEYCODE_K,
+        [SC_KC_INDEX(SC_KEYCODE_l)]     = AKEYCODE_L,
+        [SC_KC_INDEX(SC_KEYCODE_m)]     = AKEYCODE_M,
+        [SC_KC_INDEX(SC_KEYCODE_n)]     = AKEYCODE_N,
+        [SC_KC_INDEX(SC_KEYCODE_o)]     = AKEYCODE_O,
+        [SC_KC_INDEX(SC_KEYCODE_p)]     = AKEYCODE_P,
+        [SC_KC_INDEX(SC_KEYCODE_q)]     = AKEYCODE_Q,
+        [SC_KC_INDEX(SC_KEYCODE_r)]     = AKEYCODE_R,
+        [SC_KC_INDEX(SC_KEYCODE_s)]     = AKEYCODE_S,
+        [SC_KC_INDEX(SC_KEYCODE_t)]     = AKEYCODE_T,
+        [SC_KC_INDEX(SC_KEYCODE_u)]     = AKEYCODE_U,
+        [SC_KC_INDEX(SC_KEYCODE_v)]     = AKEYCODE_V,
+        [SC_KC_INDEX(SC_KEYCODE_w)]     = AKEYCODE_W,
+        [SC_KC_INDEX(SC_KEYCODE_x)]     = AKEYCODE_X,
+        [SC_KC_INDEX(SC_KEYCODE_y)]     = AKEYCODE_Y,
+        [SC_KC_INDEX(SC_KEYCODE_z)]     = AKEYCODE_Z,
+        [SC_KC_INDEX(SC_KEYCODE_SPACE)] = AKEYCODE_SPACE,
     };
 
     // Numbers and punctuation keys.
     // Used in raw mode only.
-    static const struct sc_intmap_entry numbers_punct_keys[] = {
-        {SC_KEYCODE_HASH,          AKEYCODE_POUND},
-        {SC_KEYCODE_PERCENT,       AKEYCODE_PERIOD},
-        {SC_KEYCODE_QUOTE,         AKEYCODE_APOSTROPHE},
-        {SC_KEYCODE_ASTERISK,      AKEYCODE_STAR},
-        {SC_KEYCODE_PLUS,          AKEYCODE_PLUS},
-        {SC_KEYCODE_COMMA,         AKEYCODE_COMMA},
-        {SC_KEYCODE_MINUS,         AKEYCODE_MINUS},
-        {SC_KEYCODE_PERIOD,        AKEYCODE_PERIOD},
-        {SC_KEYCODE_SLASH,         AKEYCODE_SLASH},
-        {SC_KEYCODE_0,             AKEYCODE_0},
-        {SC_KEYCODE_1,             AKEYCODE_1},
-        {SC_KEYCODE_2,             AKEYCODE_2},
-        {SC_KEYCODE_3,             AKEYCODE_3},
-        {SC_KEYCODE_4,             AKEYCODE_4},
-        {SC_KEYCODE_5,             AKEYCODE_5},
-        {SC_KEYCODE_6,             AKEYCODE_6},
-        {SC_KEYCODE_7,             AKEYCODE_7},
-        {SC_KEYCODE_8,             AKEYCODE_8},
-        {SC_KEYCODE_9,             AKEYCODE_9},
-        {SC_KEYCODE_SEMICOLON,     AKEYCODE_SEMICOLON},
-        {SC_KEYCODE_EQUALS,        AKEYCODE_EQUALS},
-        {SC_KEYCODE_AT,            AKEYCODE_AT},
-        {SC_KEYCODE_LEFTBRACKET,   AKEYCODE_LEFT_BRACKET},
-        {SC_KEYCODE_BACKSLASH,     AKEYCODE_BACKSLASH},
-        {SC_KEYCODE_RIGHTBRACKET,  AKEYCODE_RIGHT_BRACKET},
-        {SC_KEYCODE_BACKQUOTE,     AKEYCODE_GRAVE},
-        {SC_KEYCODE_KP_1,          AKEYCODE_NUMPAD_1},
-        {SC_KEYCODE_KP_2,          AKEYCODE_NUMPAD_2},
-        {SC_KEYCODE_KP_3,          AKEYCODE_NUMPAD_3},
-        {SC_KEYCODE_KP_4,          AKEYCODE_NUMPAD_4},
-        {SC_KEYCODE_KP_5,          AKEYCODE_NUMPAD_5},
-        {SC_KEYCODE_KP_6,          AKEYCODE_NUMPAD_6},
-        {SC_KEYCODE_KP_7,          AKEYCODE_NUMPAD_7},
-        {SC_KEYCODE_KP_8,          AKEYCODE_NUMPAD_8},
-        {SC_KEYCODE_KP_9,          AKEYCODE_NUMPAD_9},
-        {SC_KEYCODE_KP_0,          AKEYCODE_NUMPAD_0},
-        {SC_KEYCODE_KP_DIVIDE,     AKEYCODE_NUMPAD_DIVIDE},
-        {SC_KEYCODE_KP_MULTIPLY,   AKEYCODE_NUMPAD_MULTIPLY},
-        {SC_KEYCODE_KP_MINUS,      AKEYCODE_NUMPAD_SUBTRACT},
-        {SC_KEYCODE_KP_PLUS,       AKEYCODE_NUMPAD_ADD},
-        {SC_KEYCODE_KP_PERIOD,     AKEYCODE_NUMPAD_DOT},
-        {SC_KEYCODE_KP_EQUALS,     AKEYCODE_NUMPAD_EQUALS},
-        {SC_KEYCODE_KP_LEFTPAREN,  AKEYCODE_NUMPAD_LEFT_PAREN},
-        {SC_KEYCODE_KP_RIGHTPAREN, AKEYCODE_NUMPAD_RIGHT_PAREN},
+    static const uint16_t numbers_punct_keys[SC_KEYCODE_TABLE_SIZE] = {
+        [SC_KC_INDEX(SC_KEYCODE_HASH)]          = AKEYCODE_POUND,
+        [SC_KC_INDEX(SC_KEYCODE_PERCENT)]       = AKEYCODE_PERIOD,
+        [SC_KC_INDEX(SC_KEYCODE_QUOTE)]         = AKEYCODE_APOSTROPHE,
+        [SC_KC_INDEX(SC_KEYCODE_ASTERISK)]      = AKEYCODE_STAR,
+        [SC_KC_INDEX(SC_KEYCODE_PLUS)]          = AKEYCODE_PLUS,
+        [SC_KC_INDEX(SC_KEYCODE_COMMA)]         = AKEYCODE_COMMA,
+        [SC_KC_INDEX(SC_KEYCODE_MINUS)]         = AKEYCODE_MINUS,
+        [SC_KC_INDEX(SC_KEYCODE_PERIOD)]        = AKEYCODE_PERIOD,
+        [SC_KC_INDEX(SC_KEYCODE_SLASH)]         = AKEYCODE_SLASH,
+        [SC_KC_INDEX(SC_KEYCODE_0)]             = AKEYCODE_0,
+        [SC_KC_INDEX(SC_KEYCODE_1)]             = AKEYCODE_1,
+        [SC_KC_INDEX(SC_KEYCODE_2)]             = AKEYCODE_2,
+        [SC_KC_INDEX(SC_KEYCODE_3)]             = AKEYCODE_3,
+        [SC_KC_INDEX(SC_KEYCODE_4)]             = AKEYCODE_4,
+        [SC_KC_INDEX(SC_KEYCODE_5)]             = AKEYCODE_5,
+        [SC_KC_INDEX(SC_KEYCODE_6)]             = AKEYCODE_6,
+        [SC_KC_INDEX(SC_KEYCODE_7)]             = AKEYCODE_7,
+        [SC_KC_INDEX(SC_KEYCODE_8)]             = AKEYCODE_8,
+        [SC_KC_INDEX(SC_KEYCODE_9)]             = AKEYCODE_9,
+        [SC_KC_INDEX(SC_KEYCODE_SEMICOLON)]     = AKEYCODE_SEMICOLON,
+        [SC_KC_INDEX(SC_KEYCODE_EQUALS)]        = AKEYCODE_EQUALS,
+        [SC_KC_INDEX(SC_KEYCODE_AT)]            = AKEYCODE_AT,
+        [SC_KC_INDEX(SC_KEYCODE_LEFTBRACKET)]   = AKEYCODE_LEFT_BRACKET,
+        [SC_KC_INDEX(SC_KEYCODE_BACKSLASH)]     = AKEYCODE_BACKSLASH,
+        [SC_KC_INDEX(SC_KEYCODE_RIGHTBRACKET)]  = AKEYCODE_RIGHT_BRACKET,
+        [SC_KC_INDEX(SC_KEYCODE_BACKQUOTE)]     = AKEYCODE_GRAVE,
+        [SC_KC_INDEX(SC_KEYCODE_KP_1)]          = AKEYCODE_NUMPAD_1,
+        [SC_KC_INDEX(SC_KEYCODE_KP_2)]          = AKEYCODE_NUMPAD_2,
+        [SC_KC_INDEX(SC_KEYCODE_KP_3)]          = AKEYCODE_NUMPAD_3,
+        [SC_KC_INDEX(SC_KEYCODE_KP_4)]          = AKEYCODE_NUMPAD_4,
+        [SC_KC_INDEX(SC_KEYCODE_KP_5)]          = AKEYCODE_NUMPAD_5,
+        [SC_KC_INDEX(SC_KEYCODE_KP_6)]          = AKEYCODE_NUMPAD_6,
+        [SC_KC_INDEX(SC_KEYCODE_KP_7)]          = AKEYCODE_NUMPAD_7,
+        [SC_KC_INDEX(SC_KEYCODE_KP_8)]          = AKEYCODE_NUMPAD_8,
+        [SC_KC_INDEX(SC_KEYCODE_KP_9)]          = AKEYCODE_NUMPAD_9,
+        [SC_KC_INDEX(SC_KEYCODE_KP_0)]          = AKEYCODE_NUMPAD_0,
+        [SC_KC_INDEX(SC_KEYCODE_KP_DIVIDE)]     = AKEYCODE_NUMPAD_DIVIDE,
+        [SC_KC_INDEX(SC_KEYCODE_KP_MULTIPLY)]   = AKEYCODE_NUMPAD_MULTIPLY,
+        [SC_KC_INDEX(SC_KEYCODE_KP_MINUS)]      = AKEYCODE_NUMPAD_SUBTRACT,
+        [SC_KC_INDEX(SC_KEYCODE_KP_PLUS)]       = AKEYCODE_NUMPAD_ADD,
+        [SC_KC_INDEX(SC_KEYCODE_KP_PERIOD)]     = AKEYCODE_NUMPAD_DOT,
+        [SC_KC_INDEX(SC_KEYCODE_KP_EQUALS)]     = AKEYCODE_NUMPAD_EQUALS,
+        [SC_KC_INDEX(SC_KEYCODE_KP_LEFTPAREN)]  = AKEYCODE_NUMPAD_LEFT_PAREN,
+        [SC_KC_INDEX(SC_KEYCODE_KP_RIGHTPAREN)] = AKEYCODE_NUMPAD_RIGHT_PAREN,
     };
 
-    const struct sc_intmap_entry *entry =
-        SC_INTMAP_FIND_ENTRY(special_keys, from);
-    if (entry) {
-        *to = entry->value;
+    int index = sc_keycode_index(from);
+    if (index < 0) {
+        return false;
+    }
+
+    if (special_keys[index]) {
+        *to = special_keys[index];
         return true;
     }
 
     if (!(mod & (SC_MOD_NUM | SC_MOD_LSHIFT | SC_MOD_RSHIFT))) {
         // Handle Numpad events when Num Lock is disabled
         // If SHIFT is pressed, a text event will be sent instead
-        entry = SC_INTMAP_FIND_ENTRY(kp_nav_keys, from);
-        if (entry) {
-            *to = entry->value;
+        if (kp_nav_keys[index]) {
+            *to = kp_nav_keys[index];
             return true;
         }
     }
@@ -176,18 +195,15 @@ convert_keycode(enum sc_keycode from, enum android_keycode *to, uint16_t mod,
     }
 
     // Handle letters and space
-    entry = SC_INTMAP_FIND_ENTRY(alphaspace_keys, from);
-    if (entry) {
-        *to = entry->value;
+    if (alphaspace_keys[index]) {
+        *to = alphaspace_keys[index];
         return true;
     }
 
-    if (key_inject_mode == SC_KEY_INJECT_MODE_RAW) {
-        entry = SC_INTMAP_FIND_ENTRY(numbers_punct_keys, from);
-        if (entry) {
-            *to = entry->value;
-            return true;
-        }
+    if (key_inject_mode == SC_KEY_INJECT_MODE_RAW
+            && numbers_punct_keys[index]) {
+        *to = numbers_punct_keys[index];
+        return true;
     }
 
     return false;
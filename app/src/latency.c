@@ -0,0 +1,260 @@
+#include "latency.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <libavutil/avutil.h>
+
+#include "stats.h"
+#include "util/log.h"
+
+/** Downcast sinks to sc_latency */
+#define DOWNCAST_PACKET(SINK) \
+    container_of(SINK, struct sc_latency, packet_sink)
+#define DOWNCAST_FRAME(SINK) container_of(SINK, struct sc_latency, frame_sink)
+
+// Number of presented frames between updates of the latency metrics
+#define SC_LATENCY_STATS_INTERVAL 32
+
+static const char *const stage_names[] = {
+    [SC_LATENCY_STAGE_DEVICE] = "device",
+    [SC_LATENCY_STAGE_DECODE] = "decode",
+    [SC_LATENCY_STAGE_UPLOAD] = "upload",
+    [SC_LATENCY_STAGE_PRESENT] = "present",
+    [SC_LATENCY_STAGE_TOTAL] = "total",
+};
+
+// Must be called with the mutex locked
+static struct sc_latency_frame *
+sc_latency_find(struct sc_latency *latency, int64_t pts) {
+    // Search from the most recent entry
+    for (unsigned i = 1; i <= SC_LATENCY_MAX_FRAMES; ++i) {
+        unsigned index = (latency->next + SC_LATENCY_MAX_FRAMES - i)
+                       % SC_LATENCY_MAX_FRAMES;
+        struct sc_latency_frame *frame = &latency->frames[index];
+        if (frame->pts == pts) {
+            return frame;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+sc_latency_on_recv(struct sc_latency *latency, int64_t pts) {
+    sc_tick now = sc_tick_now();
+
+    sc_mutex_lock(&latency->mutex);
+
+    struct sc_latency_frame *frame = &latency->frames[latency->next];
+    latency->next = (latency->next + 1) % SC_LATENCY_MAX_FRAMES;
+    frame->pts = pts;
+    frame->recv = now;
+    frame->decoded = 0;
+    frame->uploaded = 0;
+
+    // The PTS is in microseconds, like sc_tick
+    sc_tick offset = now - SC_TICK_FROM_US(pts);
+    if (!latency->has_min_offset || offset < latency->min_offset) {
+        latency->min_offset = offset;
+        latency->has_min_offset = true;
+    }
+    sc_percentile_window_push(&latency->stages[SC_LATENCY_STAGE_DEVICE],
+                              offset - latency->min_offset);
+
+    sc_mutex_unlock(&latency->mutex);
+}
+
+static void
+sc_latency_on_decoded(struct sc_latency *latency, int64_t pts) {
+    sc_tick now = sc_tick_now();
+
+    sc_mutex_lock(&latency->mutex);
+
+    struct sc_latency_frame *frame = sc_latency_find(latency, pts);
+    if (frame && !frame->decoded) {
+        frame->decoded = now;
+        sc_percentile_window_push(&latency->stages[SC_LATENCY_STAGE_DECODE],
+                                  now - frame->recv);
+    }
+
+    sc_mutex_unlock(&latency->mutex);
+}
+
+void
+sc_latency_on_uploaded(struct sc_latency *latency, int64_t pts) {
+    sc_tick now = sc_tick_now();
+
+    sc_mutex_lock(&latency->mutex);
+
+    struct sc_latency_frame *frame = sc_latency_find(latency, pts);
+    if (frame && frame->decoded && !frame->uploaded) {
+        frame->uploaded = now;
+        sc_percentile_window_push(&latency->stages[SC_LATENCY_STAGE_UPLOAD],
+                                  now - frame->decoded);
+        // If the previous uploaded frame has not been presented, it never
+        // will be
+        latency->uploaded_pts = pts;
+    }
+
+    sc_mutex_unlock(&latency->mutex);
+}
+
+// must be called with mutex locked
+static void
+sc_latency_update_stats(struct sc_latency *latency) {
+    const struct sc_percentile_window *window =
+        &latency->stages[SC_LATENCY_STAGE_TOTAL];
+    assert(window->count);
+    sc_stats_set(SC_STAT_LATENCY_P50_US,
+                 SC_TICK_TO_US(sc_percentile_window_get(window, 50)));
+    sc_stats_set(SC_STAT_LATENCY_P95_US,
+                 SC_TICK_TO_US(sc_percentile_window_get(window, 95)));
+    sc_stats_set(SC_STAT_LATENCY_P99_US,
+                 SC_TICK_TO_US(sc_percentile_window_get(window, 99)));
+}
+
+void
+sc_latency_on_presented(struct sc_latency *latency) {
+    sc_tick now = sc_tick_now();
+
+    sc_mutex_lock(&latency->mutex);
+
+    if (latency->uploaded_pts != AV_NOPTS_VALUE) {
+        struct sc_latency_frame *frame =
+            sc_latency_find(latency, latency->uploaded_pts);
+        if (frame && frame->uploaded) {
+            sc_percentile_window_push(
+                    &latency->stages[SC_LATENCY_STAGE_PRESENT],
+                    now - frame->uploaded);
+            sc_percentile_window_push(&latency->stages[SC_LATENCY_STAGE_TOTAL],
+                                      now - frame->recv);
+            ++latency->presented;
+            if (!(latency->presented % SC_LATENCY_STATS_INTERVAL)) {
+                sc_latency_update_stats(latency);
+            }
+        }
+        latency->uploaded_pts = AV_NOPTS_VALUE;
+    }
+
+    sc_mutex_unlock(&latency->mutex);
+}
+
+void
+sc_latency_print(struct sc_latency *latency) {
+    sc_mutex_lock(&latency->mutex);
+
+    LOGI("Latency over the last frames (ms), %" PRIu64 " frames presented:",
+         latency->presented);
+    LOGI("    %-8s %8s %8s %8s", "stage", "p50", "p95", "p99");
+    for (unsigned i = 0; i < SC_LATENCY_STAGE_COUNT; ++i) {
+        const struct sc_percentile_window *window = &latency->stages[i];
+        if (!window->count) {
+            LOGI("    %-8s %8s %8s %8s", stage_names[i], "-", "-", "-");
+            continue;
+        }
+
+        double p50 = sc_percentile_window_get(window, 50) / 1000.;
+        double p95 = sc_percentile_window_get(window, 95) / 1000.;
+        double p99 = sc_percentile_window_get(window, 99) / 1000.;
+        LOGI("    %-8s %8.2f %8.2f %8.2f", stage_names[i], p50, p95, p99);
+    }
+
+    sc_mutex_unlock(&latency->mutex);
+}
+
+static bool
+sc_latency_packet_sink_open(struct sc_packet_sink *sink, AVCodecContext *ctx) {
+    (void) sink;
+    (void) ctx;
+    return true;
+}
+
+static void
+sc_latency_packet_sink_close(struct sc_packet_sink *sink) {
+    (void) sink;
+}
+
+static bool
+sc_latency_packet_sink_push(struct sc_packet_sink *sink,
+                            const AVPacket *packet) {
+    struct sc_latency *latency = DOWNCAST_PACKET(sink);
+
+    bool is_config = packet->pts == AV_NOPTS_VALUE;
+    if (!is_config) {
+        sc_latency_on_recv(latency, packet->pts);
+    }
+
+    return true;
+}
+
+static bool
+sc_latency_frame_sink_open(struct sc_frame_sink *sink,
+                           const AVCodecContext *ctx) {
+    (void) sink;
+    (void) ctx;
+    return true;
+}
+
+static void
+sc_latency_frame_sink_close(struct sc_frame_sink *sink) {
+    (void) sink;
+}
+
+static bool
+sc_latency_frame_sink_push(struct sc_frame_sink *sink, const AVFrame *frame) {
+    struct sc_latency *latency = DOWNCAST_FRAME(sink);
+    sc_latency_on_decoded(latency, frame->pts);
+    return true;
+}
+
+static unsigned
+sc_latency_frame_sink_get_backlog(struct sc_frame_sink *sink) {
+    (void) sink;
+    // Only the frames which are presented are measured, the other sinks
+    // decide whether the frames may be dropped
+    return UINT_MAX;
+}
+
+bool
+sc_latency_init(struct sc_latency *latency) {
+    bool ok = sc_mutex_init(&latency->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < SC_LATENCY_MAX_FRAMES; ++i) {
+        latency->frames[i].pts = AV_NOPTS_VALUE;
+    }
+    latency->next = 0;
+    latency->uploaded_pts = AV_NOPTS_VALUE;
+    latency->has_min_offset = false;
+    latency->min_offset = 0;
+    for (unsigned i = 0; i < SC_LATENCY_STAGE_COUNT; ++i) {
+        sc_percentile_window_init(&latency->stages[i]);
+    }
+    latency->presented = 0;
+
+    static const struct sc_packet_sink_ops packet_sink_ops = {
+        .open = sc_latency_packet_sink_open,
+        .close = sc_latency_packet_sink_close,
+        .push = sc_latency_packet_sink_push,
+    };
+
+    static const struct sc_frame_sink_ops frame_sink_ops = {
+        .open = sc_latency_frame_sink_open,
+        .close = sc_latency_frame_sink_close,
+        .push = sc_latency_frame_sink_push,
+        .get_backlog = sc_latency_frame_sink_get_backlog,
+    };
+
+    latency->packet_sink.ops = &packet_sink_ops;
+    latency->frame_sink.ops = &frame_sink_ops;
+
+    return true;
+}
+
+void
+sc_latency_destroy(struct sc_latency *latency) {
+    sc_mutex_destroy(&latency->mutex);
+}
@@ -0,0 +1,87 @@
+#ifndef SC_LATENCY_H
+#define SC_LATENCY_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "trait/frame_sink.h"
+#include "trait/packet_sink.h"
+#include "util/percentile.h"
+#include "util/thread.h"
+#include "util/tick.h"
+
+// Number of in-flight frames tracked (received but not presented yet)
+#define SC_LATENCY_MAX_FRAMES 64
+
+enum sc_latency_stage {
+    // Device capture to client reception, relative to the fastest frame
+    // observed (the device and client clocks are not synchronized)
+    SC_LATENCY_STAGE_DEVICE,
+    // Client reception to decoded frame
+    SC_LATENCY_STAGE_DECODE,
+    // Decoded frame to texture upload (including any --video-buffer delay)
+    SC_LATENCY_STAGE_UPLOAD,
+    // Texture upload to present
+    SC_LATENCY_STAGE_PRESENT,
+    // Client reception to present
+    SC_LATENCY_STAGE_TOTAL,
+    SC_LATENCY_STAGE_COUNT,
+};
+
+struct sc_latency_frame {
+    int64_t pts; // AV_NOPTS_VALUE for an unused entry
+    sc_tick recv;
+    sc_tick decoded; // 0 if not decoded yet
+    sc_tick uploaded; // 0 if not uploaded yet
+};
+
+/**
+ * Per-frame latency tracer (--print-latency)
+ *
+ * It is a packet sink of the video demuxer (to stamp the reception) and a
+ * frame sink of the video decoder (to stamp the decoding). The screen reports
+ * the texture upload and the present.
+ *
+ * Frames are identified by their PTS.
+ */
+struct sc_latency {
+    struct sc_packet_sink packet_sink; // packet sink trait
+    struct sc_frame_sink frame_sink; // frame sink trait
+
+    sc_mutex mutex;
+
+    struct sc_latency_frame frames[SC_LATENCY_MAX_FRAMES];
+    unsigned next; // index of the next entry to use
+
+    // Last uploaded frame, not presented yet (AV_NOPTS_VALUE if none)
+    int64_t uploaded_pts;
+
+    // Minimal (device PTS -> client reception) offset observed
+    bool has_min_offset;
+    sc_tick min_offset;
+
+    struct sc_percentile_window stages[SC_LATENCY_STAGE_COUNT];
+    uint64_t presented;
+};
+
+bool
+sc_latency_init(struct sc_latency *latency);
+
+void
+sc_latency_destroy(struct sc_latency *latency);
+
+// Called (from the main thread) when a frame is uploaded to the texture
+void
+sc_latency_on_uploaded(struct sc_latency *latency, int64_t pts);
+
+// Called (from the main thread) when the last uploaded frame is presented
+void
+sc_latency_on_presented(struct sc_latency *latency);
+
+// Log the p50/p95/p99 of each stage
+void
+sc_latency_print(struct sc_latency *latency);
+
+#endif
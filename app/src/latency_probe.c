@@ -0,0 +1,167 @@
+#include "latency_probe.h"
+
+#include <inttypes.h>
+
+#include "util/log.h"
+
+// Must match LatencyProbe.java
+#define SC_LATENCY_PROBE_CELL_COUNT 10
+#define SC_LATENCY_PROBE_MIN_CELL_SIZE 16
+
+// A probe not presented after this delay is abandoned (e.g. the message or
+// the frame has been dropped), and a new one is sent
+#define SC_LATENCY_PROBE_TIMEOUT SC_TICK_FROM_SEC(1)
+
+// Luma thresholds of the white and black markers (limited range: 16..235)
+#define SC_LATENCY_PROBE_WHITE_MIN 160
+#define SC_LATENCY_PROBE_BLACK_MAX 96
+
+// Number of samples per cell, along each axis
+#define SC_LATENCY_PROBE_SAMPLES 4
+
+void
+sc_latency_probe_init(struct sc_latency_probe *probe) {
+    probe->code = 0;
+    probe->sent = 0;
+    probe->detected = false;
+    probe->unsupported_format_logged = false;
+    sc_percentile_window_init(&probe->window);
+    probe->measured = 0;
+    probe->lost = 0;
+}
+
+static unsigned
+sc_latency_probe_get_cell_size(int width, int height) {
+    unsigned size = (unsigned) (width < height ? width : height);
+    size = (size / 24) & ~15u;
+    return size > SC_LATENCY_PROBE_MIN_CELL_SIZE
+         ? size : SC_LATENCY_PROBE_MIN_CELL_SIZE;
+}
+
+// Average luma of the center of a cell (the edges may be blurred by the
+// encoding)
+static unsigned
+sc_latency_probe_read_cell(const AVFrame *frame, unsigned cell_size,
+                           unsigned index) {
+    unsigned x0 = index * cell_size + cell_size / 4;
+    unsigned y0 = cell_size / 4;
+    unsigned step = cell_size / 2 / SC_LATENCY_PROBE_SAMPLES;
+
+    unsigned sum = 0;
+    for (unsigned j = 0; j < SC_LATENCY_PROBE_SAMPLES; ++j) {
+        const uint8_t *line = frame->data[0]
+                            + (y0 + j * step) * frame->linesize[0];
+        for (unsigned i = 0; i < SC_LATENCY_PROBE_SAMPLES; ++i) {
+            sum += line[x0 + i * step];
+        }
+    }
+
+    return sum / (SC_LATENCY_PROBE_SAMPLES * SC_LATENCY_PROBE_SAMPLES);
+}
+
+// Return the code drawn on the frame, or -1 if there is none
+static int
+sc_latency_probe_decode(const AVFrame *frame) {
+    unsigned cell_size =
+        sc_latency_probe_get_cell_size(frame->width, frame->height);
+    if ((unsigned) frame->width < SC_LATENCY_PROBE_CELL_COUNT * cell_size
+            || (unsigned) frame->height < cell_size) {
+        return -1;
+    }
+
+    unsigned white = sc_latency_probe_read_cell(frame, cell_size, 0);
+    unsigned black = sc_latency_probe_read_cell(frame, cell_size, 1);
+    if (white < SC_LATENCY_PROBE_WHITE_MIN
+            || black > SC_LATENCY_PROBE_BLACK_MAX) {
+        // No pattern
+        return -1;
+    }
+
+    unsigned threshold = (white + black) / 2;
+    int code = 0;
+    for (unsigned i = 2; i < SC_LATENCY_PROBE_CELL_COUNT; ++i) {
+        unsigned value = sc_latency_probe_read_cell(frame, cell_size, i);
+        code = (code << 1) | (value > threshold);
+    }
+
+    return code;
+}
+
+void
+sc_latency_probe_on_uploaded(struct sc_latency_probe *probe,
+                             const AVFrame *frame) {
+    if (!probe->code || probe->detected) {
+        return;
+    }
+
+    // The luma plane is the first one for all the supported formats
+    if (frame->format != AV_PIX_FMT_YUV420P
+            && frame->format != AV_PIX_FMT_YUVJ420P
+            && frame->format != AV_PIX_FMT_NV12) {
+        if (!probe->unsupported_format_logged) {
+            LOGW("Latency probe: unsupported frame format: %d", frame->format);
+            probe->unsupported_format_logged = true;
+        }
+        return;
+    }
+
+    probe->detected = sc_latency_probe_decode(frame) == probe->code;
+}
+
+static void
+sc_latency_probe_send(struct sc_latency_probe *probe,
+                      struct sc_controller *controller, sc_tick now) {
+    // Consecutive codes are always different, and never 0
+    uint8_t code = probe->code == UINT8_MAX ? 1 : probe->code + 1;
+
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_LATENCY_PROBE;
+    msg.latency_probe.code = code;
+
+    if (!sc_controller_push_msg(controller, &msg)) {
+        LOGW("Could not request latency probe");
+        return;
+    }
+
+    probe->code = code;
+    probe->sent = now;
+    probe->detected = false;
+}
+
+void
+sc_latency_probe_on_presented(struct sc_latency_probe *probe,
+                              struct sc_controller *controller) {
+    if (!controller) {
+        return;
+    }
+
+    sc_tick now = sc_tick_now();
+
+    if (probe->code) {
+        if (probe->detected) {
+            sc_percentile_window_push(&probe->window, now - probe->sent);
+            ++probe->measured;
+        } else if (now - probe->sent >= SC_LATENCY_PROBE_TIMEOUT) {
+            ++probe->lost;
+        } else {
+            // Still in flight
+            return;
+        }
+    }
+
+    sc_latency_probe_send(probe, controller, now);
+}
+
+void
+sc_latency_probe_print(struct sc_latency_probe *probe) {
+    LOGI("End-to-end latency (ms), %" PRIu64 " probes measured, %" PRIu64
+         " lost:", probe->measured, probe->lost);
+    if (!probe->window.count) {
+        return;
+    }
+
+    double p50 = sc_percentile_window_get(&probe->window, 50) / 1000.;
+    double p95 = sc_percentile_window_get(&probe->window, 95) / 1000.;
+    double p99 = sc_percentile_window_get(&probe->window, 99) / 1000.;
+    LOGI("    p50 %8.3f    p95 %8.3f    p99 %8.3f", p50, p95, p99);
+}
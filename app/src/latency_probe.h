@@ -0,0 +1,58 @@
+#ifndef SC_LATENCY_PROBE_H
+#define SC_LATENCY_PROBE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavutil/frame.h>
+
+#include "controller.h"
+#include "util/percentile.h"
+#include "util/tick.h"
+
+/**
+ * End-to-end latency probe (--latency-probe)
+ *
+ * The client sends a code (1..255) to the device, which draws it as a test
+ * pattern over the captured frames (see LatencyProbe.java). The latency is
+ * the delay between the sending of the code and the presentation of the
+ * first frame containing it.
+ *
+ * Both instants are measured on the client clock, so this does not depend on
+ * the synchronization of the device clock.
+ *
+ * The next code is sent as soon as the previous one is presented, so there is
+ * at most one probe in flight. All the functions are called from the main
+ * thread.
+ */
+struct sc_latency_probe {
+    uint8_t code; // of the probe in flight, 0 if none
+    sc_tick sent;
+    bool detected; // the code has been found in an uploaded frame
+    bool unsupported_format_logged;
+
+    struct sc_percentile_window window;
+    uint64_t measured;
+    uint64_t lost;
+};
+
+void
+sc_latency_probe_init(struct sc_latency_probe *probe);
+
+// Called when a new frame is uploaded to the texture
+void
+sc_latency_probe_on_uploaded(struct sc_latency_probe *probe,
+                             const AVFrame *frame);
+
+// Called when the last uploaded frame is presented (the controller may be
+// NULL if the session is not running)
+void
+sc_latency_probe_on_presented(struct sc_latency_probe *probe,
+                              struct sc_controller *controller);
+
+// Log the p50/p95/p99 of the measured latencies
+void
+sc_latency_probe_print(struct sc_latency_probe *probe);
+
+#endif
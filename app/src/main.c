@@ -2,19 +2,19 @@
 
 #include <stdbool.h>
 #include <stdio.h>
-#ifdef HAVE_V4L2
-# include <libavdevice/avdevice.h>
-#endif
 #define SDL_MAIN_HANDLED // avoid link error on Linux Windows Subsystem
 #include <SDL2/SDL.h>
 
 #include "cli.h"
+#include "multi.h"
 #include "options.h"
+#include "replay.h"
 #include "scrcpy.h"
 #include "usb/scrcpy_otg.h"
 #include "util/log.h"
 #include "util/net.h"
 #include "util/thread.h"
+#include "util/trace.h"
 #include "version.h"
 
 #ifdef _WIN32
@@ -69,14 +69,12 @@ main_scrcpy(int argc, char *argv[]) {
     // The current thread is the main thread
     SC_MAIN_THREAD_ID = sc_thread_get_id();
 
-#ifdef SCRCPY_LAVF_REQUIRES_REGISTER_ALL
-    av_register_all();
+#ifdef SC_THREAD_HAS_CPU_AFFINITY
+    sc_thread_set_critical_cpus(args.opts.cpu_affinity);
 #endif
 
-#ifdef HAVE_V4L2
-    if (args.opts.v4l2_device) {
-        avdevice_register_all();
-    }
+#ifdef SCRCPY_LAVF_REQUIRES_REGISTER_ALL
+    av_register_all();
 #endif
 
     if (!net_init()) {
@@ -86,13 +84,32 @@ main_scrcpy(int argc, char *argv[]) {
 
     sc_log_configure();
 
+    if (args.opts.trace_file && !sc_trace_init(args.opts.trace_file)) {
+        ret = SCRCPY_EXIT_FAILURE;
+        goto end;
+    }
+
+    if (args.opts.replay) {
+        ret = scrcpy_replay(&args.opts);
+    } else if (scrcpy_multi_requested(&args.opts)) {
+        ret = scrcpy_multi(&args.opts, argc, argv);
+    } else {
 #ifdef HAVE_USB
-    ret = args.opts.otg ? scrcpy_otg(&args.opts) : scrcpy(&args.opts);
+        ret = args.opts.otg ? scrcpy_otg(&args.opts) : scrcpy(&args.opts);
 #else
-    ret = scrcpy(&args.opts);
+        ret = scrcpy(&args.opts);
 #endif
+    }
+
+    if (args.opts.trace_file) {
+        // All the threads have been joined
+        sc_trace_destroy();
+    }
 
 end:
+    // Write the pending logs
+    sc_log_shutdown();
+
     if (args.pause_on_exit == SC_PAUSE_ON_EXIT_TRUE ||
             (args.pause_on_exit == SC_PAUSE_ON_EXIT_IF_ERROR &&
                 ret != SCRCPY_EXIT_SUCCESS)) {
@@ -0,0 +1,260 @@
+#include "multi.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "util/file.h"
+#include "util/log.h"
+#include "util/process.h"
+
+// --serial= plus the serial
+#define SC_MULTI_SERIAL_ARG_SIZE 128
+// --window-height= plus a 16-bit value
+#define SC_MULTI_GEOMETRY_ARG_SIZE 32
+// --decoder-threads= plus a 16-bit value
+#define SC_MULTI_THREADS_ARG_SIZE 32
+// --serial, --decoder-threads, --unfocused-decode and 4 geometry arguments
+#define SC_MULTI_EXTRA_ARGS 7
+// From this number of devices, the unfocused windows only decode keyframes
+#define SC_MULTI_KEYFRAMES_ONLY_DEVICES 9
+
+struct sc_multi_device {
+    const char *serial;
+    sc_pid pid;
+    char serial_arg[SC_MULTI_SERIAL_ARG_SIZE];
+    char threads_arg[SC_MULTI_THREADS_ARG_SIZE];
+    char geometry_args[4][SC_MULTI_GEOMETRY_ARG_SIZE];
+};
+
+bool
+scrcpy_multi_requested(const struct scrcpy_options *options) {
+    return options->serial && strchr(options->serial, ',');
+}
+
+static size_t
+sc_multi_split_serials(char *serials, struct sc_multi_device *devices) {
+    size_t count = 0;
+    char *s = serials;
+    for (;;) {
+        char *sep = strchr(s, ',');
+        if (sep) {
+            *sep = '\0';
+        }
+        if (*s) {
+            if (count == SC_MULTI_MAX_DEVICES) {
+                LOGE("Too many devices (max %d)", SC_MULTI_MAX_DEVICES);
+                return 0;
+            }
+            devices[count++].serial = s;
+        }
+        if (!sep) {
+            return count;
+        }
+        s = sep + 1;
+    }
+}
+
+static bool
+sc_multi_has_geometry(const struct scrcpy_options *options) {
+    return options->window_x != SC_WINDOW_POSITION_UNDEFINED
+        || options->window_y != SC_WINDOW_POSITION_UNDEFINED
+        || options->window_width
+        || options->window_height;
+}
+
+static bool
+sc_multi_get_usable_bounds(SDL_Rect *bounds) {
+    if (SDL_Init(SDL_INIT_VIDEO)) {
+        LOGW("Could not initialize SDL: %s", SDL_GetError());
+        return false;
+    }
+
+    bool ok = !SDL_GetDisplayUsableBounds(0, bounds);
+    if (!ok) {
+        LOGW("Could not get the display bounds: %s", SDL_GetError());
+    }
+
+    SDL_Quit();
+    return ok;
+}
+
+static void
+sc_multi_tile(struct sc_multi_device *devices, size_t count,
+              const SDL_Rect *bounds) {
+    unsigned cols = 1;
+    while (cols * cols < count) {
+        ++cols;
+    }
+    unsigned rows = (count + cols - 1) / cols;
+
+    int width = bounds->w / cols;
+    int height = bounds->h / rows;
+
+    for (size_t i = 0; i < count; ++i) {
+        char (*args)[SC_MULTI_GEOMETRY_ARG_SIZE] = devices[i].geometry_args;
+        int x = bounds->x + (i % cols) * width;
+        int y = bounds->y + (i / cols) * height;
+        snprintf(args[0], sizeof(*args), "--window-x=%d", x);
+        snprintf(args[1], sizeof(*args), "--window-y=%d", y);
+        snprintf(args[2], sizeof(*args), "--window-width=%d", width);
+        snprintf(args[3], sizeof(*args), "--window-height=%d", height);
+    }
+}
+
+static unsigned
+sc_multi_get_decoder_threads(size_t count) {
+    // Share the cores between the video decoders of all the clients, rather
+    // than letting each one start as many slice threads as there are cores
+    int cpus = SDL_GetCPUCount();
+    unsigned threads = cpus > 0 ? (unsigned) cpus / count : 1;
+    return MAX(threads, 1);
+}
+
+// Return the --unfocused-decode argument to add (NULL if none)
+static const char *
+sc_multi_get_unfocused_decode_arg(const struct scrcpy_options *options,
+                                  size_t count) {
+    if (options->unfocused_decode != SC_DECODE_BUDGET_AUTO) {
+        // Explicitly requested, already in the arguments
+        return NULL;
+    }
+
+    // Most windows are small and not focused: keep the total decoding cost
+    // roughly constant as the number of devices grows
+    return count >= SC_MULTI_KEYFRAMES_ONLY_DEVICES
+         ? "--unfocused-decode=keyframes"
+         : "--unfocused-decode=reduced";
+}
+
+static bool
+sc_multi_start(struct sc_multi_device *device, const char *executable,
+               int argc, char *argv[], unsigned decoder_threads,
+               const char *unfocused_decode_arg, bool tiled) {
+    int r = snprintf(device->serial_arg, sizeof(device->serial_arg),
+                     "--serial=%s", device->serial);
+    if (r < 0 || (size_t) r >= sizeof(device->serial_arg)) {
+        LOGE("Serial too long: %s", device->serial);
+        return false;
+    }
+
+    const char **cmd = malloc((argc + SC_MULTI_EXTRA_ARGS + 1) * sizeof(*cmd));
+    if (!cmd) {
+        LOG_OOM();
+        return false;
+    }
+
+    // Same arguments, the last --serial overrides the list
+    size_t i = 0;
+    cmd[i++] = executable;
+    for (int j = 1; j < argc; ++j) {
+        cmd[i++] = argv[j];
+    }
+    cmd[i++] = device->serial_arg;
+    if (decoder_threads) {
+        snprintf(device->threads_arg, sizeof(device->threads_arg),
+                 "--decoder-threads=%u", decoder_threads);
+        cmd[i++] = device->threads_arg;
+    }
+    if (unfocused_decode_arg) {
+        cmd[i++] = unfocused_decode_arg;
+    }
+    if (tiled) {
+        for (unsigned j = 0; j < 4; ++j) {
+            cmd[i++] = device->geometry_args[j];
+        }
+    }
+    cmd[i] = NULL;
+
+    enum sc_process_result result = sc_process_execute(cmd, &device->pid, 0);
+    free(cmd);
+
+    if (result != SC_PROCESS_SUCCESS) {
+        LOGE("Could not start scrcpy for device %s", device->serial);
+        return false;
+    }
+
+    LOGI("Device %s: started", device->serial);
+    return true;
+}
+
+enum scrcpy_exit_code
+scrcpy_multi(const struct scrcpy_options *options, int argc, char *argv[]) {
+    assert(scrcpy_multi_requested(options));
+
+    enum scrcpy_exit_code ret = SCRCPY_EXIT_FAILURE;
+
+    char *serials = strdup(options->serial);
+    if (!serials) {
+        LOG_OOM();
+        return ret;
+    }
+
+    char *executable = sc_file_get_executable_path();
+    if (!executable) {
+        LOGE("Could not get the executable path");
+        goto free_serials;
+    }
+
+    struct sc_multi_device devices[SC_MULTI_MAX_DEVICES];
+    size_t count = sc_multi_split_serials(serials, devices);
+    if (!count) {
+        goto free_executable;
+    }
+
+    // Tile the windows, unless the user requested an explicit geometry (the
+    // same for all the windows)
+    bool tiled = false;
+    SDL_Rect bounds;
+    if (options->window && !sc_multi_has_geometry(options)
+            && sc_multi_get_usable_bounds(&bounds)) {
+        sc_multi_tile(devices, count, &bounds);
+        tiled = true;
+    }
+
+    // Unless explicitly requested, split the decoding threads (0 means that
+    // --decoder-threads is not added to the arguments)
+    unsigned decoder_threads = 0;
+    if (!options->decoder_threads) {
+        decoder_threads = sc_multi_get_decoder_threads(count);
+        LOGD("Using %u decoder threads per device", decoder_threads);
+    }
+
+    const char *unfocused_decode_arg =
+        sc_multi_get_unfocused_decode_arg(options, count);
+
+    bool ok = true;
+    for (size_t i = 0; i < count; ++i) {
+        if (!sc_multi_start(&devices[i], executable, argc, argv,
+                            decoder_threads, unfocused_decode_arg, tiled)) {
+            devices[i].pid = SC_PROCESS_NONE;
+            ok = false;
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (devices[i].pid == SC_PROCESS_NONE) {
+            continue;
+        }
+
+        sc_exit_code exit_code = sc_process_wait(devices[i].pid, true);
+        if (exit_code) {
+            LOGW("Device %s: exited with code %" SC_PRIexitcode,
+                 devices[i].serial, exit_code);
+            ok = false;
+        } else {
+            LOGI("Device %s: exited", devices[i].serial);
+        }
+    }
+
+    ret = ok ? SCRCPY_EXIT_SUCCESS : SCRCPY_EXIT_FAILURE;
+
+free_executable:
+    free(executable);
+free_serials:
+    free(serials);
+
+    return ret;
+}
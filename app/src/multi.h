@@ -0,0 +1,26 @@
+#ifndef SC_MULTI_H
+#define SC_MULTI_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+#include "options.h"
+#include "scrcpy.h"
+
+#define SC_MULTI_MAX_DEVICES 32
+
+/**
+ * Return whether several devices are selected (`--serial=a,b,c`)
+ */
+bool
+scrcpy_multi_requested(const struct scrcpy_options *options);
+
+/**
+ * Mirror several devices, by running one scrcpy client per serial (with the
+ * same arguments), their windows being tiled on the screen
+ */
+enum scrcpy_exit_code
+scrcpy_multi(const struct scrcpy_options *options, int argc, char *argv[]);
+
+#endif
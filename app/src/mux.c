@@ -0,0 +1,273 @@
+#include "mux.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/binary.h"
+#include "util/log.h"
+
+// Return the credit once a quarter of the window has been read, rather than
+// after every read
+#define SC_MUX_CREDIT_THRESHOLD (SC_MUX_WINDOW_SIZE / 4)
+
+void
+sc_mux_buffer_init(struct sc_mux_buffer *buf) {
+    buf->data = NULL;
+    buf->head = 0;
+    buf->size = 0;
+    buf->cap = 0;
+}
+
+void
+sc_mux_buffer_destroy(struct sc_mux_buffer *buf) {
+    free(buf->data);
+}
+
+bool
+sc_mux_buffer_push(struct sc_mux_buffer *buf, const uint8_t *data,
+                   size_t len) {
+    if (buf->head + buf->size + len > buf->cap) {
+        // Move the unread data to the start of the buffer first
+        if (buf->size) {
+            memmove(buf->data, buf->data + buf->head, buf->size);
+        }
+        buf->head = 0;
+
+        if (buf->size + len > buf->cap) {
+            size_t cap = buf->cap ? buf->cap : SC_MUX_MAX_CHUNK_SIZE;
+            while (cap < buf->size + len) {
+                cap *= 2;
+            }
+            uint8_t *p = realloc(buf->data, cap);
+            if (!p) {
+                LOG_OOM();
+                return false;
+            }
+            buf->data = p;
+            buf->cap = cap;
+        }
+    }
+
+    memcpy(buf->data + buf->head + buf->size, data, len);
+    buf->size += len;
+    return true;
+}
+
+size_t
+sc_mux_buffer_pop(struct sc_mux_buffer *buf, uint8_t *data, size_t len) {
+    if (len > buf->size) {
+        len = buf->size;
+    }
+    if (!len) {
+        return 0;
+    }
+    memcpy(data, buf->data + buf->head, len);
+    buf->size -= len;
+    // Restart from the beginning whenever the buffer is empty
+    buf->head = buf->size ? buf->head + len : 0;
+    return len;
+}
+
+bool
+sc_mux_init(struct sc_mux *mux, sc_socket socket) {
+    bool ok = sc_mutex_init(&mux->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_mutex_init(&mux->send_mutex);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    ok = sc_cond_init(&mux->data_cond);
+    if (!ok) {
+        goto error_destroy_send_mutex;
+    }
+
+    for (unsigned i = 0; i < SC_MUX_STREAM_COUNT; ++i) {
+        sc_mux_buffer_init(&mux->buffers[i]);
+        mux->consumed[i] = 0;
+    }
+
+    mux->socket = socket;
+    mux->closed = false;
+
+    return true;
+
+error_destroy_send_mutex:
+    sc_mutex_destroy(&mux->send_mutex);
+error_destroy_mutex:
+    sc_mutex_destroy(&mux->mutex);
+
+    return false;
+}
+
+void
+sc_mux_destroy(struct sc_mux *mux) {
+    for (unsigned i = 0; i < SC_MUX_STREAM_COUNT; ++i) {
+        sc_mux_buffer_destroy(&mux->buffers[i]);
+    }
+    sc_cond_destroy(&mux->data_cond);
+    sc_mutex_destroy(&mux->send_mutex);
+    sc_mutex_destroy(&mux->mutex);
+}
+
+static bool
+sc_mux_push(struct sc_mux *mux, enum sc_mux_stream stream,
+            const uint8_t *data, size_t len) {
+    struct sc_mux_buffer *buf = &mux->buffers[stream];
+
+    sc_mutex_lock(&mux->mutex);
+    // The device never sends more than the window (the data read but not
+    // credited yet is not buffered anymore)
+    if (buf->size + mux->consumed[stream] + len > SC_MUX_WINDOW_SIZE) {
+        sc_mutex_unlock(&mux->mutex);
+        LOGE("Multiplexed stream %d exceeds its window", (int) stream);
+        return false;
+    }
+
+    bool ok = !mux->closed && sc_mux_buffer_push(buf, data, len);
+    if (ok) {
+        sc_cond_broadcast(&mux->data_cond);
+    }
+    sc_mutex_unlock(&mux->mutex);
+
+    return ok;
+}
+
+static int
+run_mux(void *data) {
+    struct sc_mux *mux = data;
+
+    for (;;) {
+        uint8_t header[SC_MUX_HEADER_SIZE];
+        ssize_t r = net_recv_all(mux->socket, header, sizeof(header));
+        if (r != sizeof(header)) {
+            LOGD("Multiplexed socket closed");
+            break;
+        }
+
+        uint8_t stream = header[0];
+        uint32_t len = sc_read32be(&header[1]);
+        if (stream >= SC_MUX_STREAM_COUNT || !len
+                || len > SC_MUX_MAX_CHUNK_SIZE) {
+            LOGE("Invalid multiplexed frame (stream %" PRIu8 ", length %"
+                 PRIu32 ")", stream, len);
+            break;
+        }
+
+        r = net_recv_all(mux->socket, mux->recv_buf, len);
+        if (r != (ssize_t) len) {
+            LOGD("Multiplexed socket closed");
+            break;
+        }
+
+        if (!sc_mux_push(mux, stream, mux->recv_buf, len)) {
+            break;
+        }
+    }
+
+    sc_mutex_lock(&mux->mutex);
+    mux->closed = true;
+    // Wake up all the consumers
+    sc_cond_broadcast(&mux->data_cond);
+    sc_mutex_unlock(&mux->mutex);
+
+    return 0;
+}
+
+bool
+sc_mux_start(struct sc_mux *mux) {
+    LOGD("Starting multiplexer thread");
+
+    bool ok = sc_thread_create(&mux->thread, run_mux, "scrcpy-mux", mux);
+    if (!ok) {
+        LOGE("Could not start multiplexer thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_mux_join(struct sc_mux *mux) {
+    sc_thread_join(&mux->thread, NULL);
+}
+
+static bool
+sc_mux_send_credit(struct sc_mux *mux, enum sc_mux_stream stream,
+                   uint32_t credit) {
+    uint8_t header[SC_MUX_HEADER_SIZE];
+    header[0] = SC_MUX_CREDIT | stream;
+    sc_write32be(&header[1], credit);
+
+    sc_mutex_lock(&mux->send_mutex);
+    ssize_t w = net_send_all(mux->socket, header, sizeof(header));
+    sc_mutex_unlock(&mux->send_mutex);
+
+    return w == sizeof(header);
+}
+
+ssize_t
+sc_mux_recv(struct sc_mux *mux, enum sc_mux_stream stream, void *buf,
+            size_t len) {
+    assert(stream < SC_MUX_STREAM_COUNT);
+    struct sc_mux_buffer *buffer = &mux->buffers[stream];
+
+    sc_mutex_lock(&mux->mutex);
+    while (!mux->closed && !buffer->size) {
+        sc_cond_wait(&mux->data_cond, &mux->mutex);
+    }
+
+    size_t r = sc_mux_buffer_pop(buffer, buf, len);
+    uint32_t credit = 0;
+    mux->consumed[stream] += r;
+    if (mux->consumed[stream] >= SC_MUX_CREDIT_THRESHOLD) {
+        credit = mux->consumed[stream];
+        mux->consumed[stream] = 0;
+    }
+    sc_mutex_unlock(&mux->mutex);
+
+    if (credit && !sc_mux_send_credit(mux, stream, credit)) {
+        LOGD("Could not send multiplexed credit");
+    }
+
+    // 0 on close, like net_recv()
+    return r;
+}
+
+ssize_t
+sc_mux_send_all(struct sc_mux *mux, enum sc_mux_stream stream, const void *buf,
+                size_t len) {
+    assert(stream < SC_MUX_STREAM_COUNT);
+    const uint8_t *data = buf;
+
+    sc_mutex_lock(&mux->send_mutex);
+    size_t sent = 0;
+    while (sent < len) {
+        size_t chunk = len - sent;
+        if (chunk > SC_MUX_MAX_CHUNK_SIZE) {
+            chunk = SC_MUX_MAX_CHUNK_SIZE;
+        }
+
+        // Send the header and the payload at once (the socket has
+        // TCP_NODELAY set)
+        mux->send_buf[0] = stream;
+        sc_write32be(&mux->send_buf[1], chunk);
+        memcpy(&mux->send_buf[SC_MUX_HEADER_SIZE], data + sent, chunk);
+
+        size_t total = SC_MUX_HEADER_SIZE + chunk;
+        ssize_t w = net_send_all(mux->socket, mux->send_buf, total);
+        if (w != (ssize_t) total) {
+            sc_mutex_unlock(&mux->send_mutex);
+            return sent ? (ssize_t) sent : -1;
+        }
+        sent += chunk;
+    }
+    sc_mutex_unlock(&mux->send_mutex);
+
+    return sent;
+}
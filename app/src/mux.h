@@ -0,0 +1,126 @@
+#ifndef SC_MUX_H
+#define SC_MUX_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "util/net.h"
+#include "util/thread.h"
+
+/**
+ * Demultiplexing of the streams received on a single socket (--multiplex)
+ *
+ * By default, the video, audio and control streams each have their own
+ * socket, each connected in turn through the adb tunnel. In multiplexed mode,
+ * a single socket is connected, and the streams are sent in frames:
+ *
+ *     [.][. . . .]. . . . . . . . . ...
+ *      ^ <------> <--------------...
+ *   stream  len        payload
+ *
+ *  - stream: the stream id (enum sc_mux_stream)
+ *  - len: the payload length (at most SC_MUX_MAX_CHUNK_SIZE)
+ *
+ * The device meta and the throughput probe (if any) are exchanged on the
+ * socket before the first frame.
+ *
+ * A thread reads the frames and buffers the payloads per stream, to be read
+ * by the existing consumers (the demuxers and the receiver) instead of their
+ * own socket. The device sends the control frames before any pending video or
+ * audio frame.
+ *
+ * The device sends at most SC_MUX_WINDOW_SIZE bytes of a stream not read yet
+ * by its consumer. Once read, the credit is returned in a frame without
+ * payload, whose stream id has the SC_MUX_CREDIT flag set and whose len field
+ * is the number of bytes read. Therefore, a stream which is not consumed (e.g.
+ * the audio stream once the player is stuck) never blocks the others.
+ */
+
+#define SC_MUX_HEADER_SIZE 5
+#define SC_MUX_MAX_CHUNK_SIZE 16384
+#define SC_MUX_WINDOW_SIZE (8 * 1024 * 1024)
+#define SC_MUX_CREDIT 0x80
+
+enum sc_mux_stream {
+    SC_MUX_STREAM_VIDEO,
+    SC_MUX_STREAM_AUDIO,
+    SC_MUX_STREAM_CONTROL,
+    SC_MUX_STREAM_COUNT,
+};
+
+// Received data of a stream, not read yet
+struct sc_mux_buffer {
+    uint8_t *data;
+    size_t head; // offset of the first unread byte
+    size_t size; // number of unread bytes
+    size_t cap;
+};
+
+struct sc_mux {
+    sc_socket socket; // not owned
+    sc_thread thread;
+
+    sc_mutex mutex;
+    sc_cond data_cond; // signaled when data is received or on close
+    struct sc_mux_buffer buffers[SC_MUX_STREAM_COUNT];
+    // Number of bytes read but not credited yet, per stream
+    uint32_t consumed[SC_MUX_STREAM_COUNT];
+    bool closed;
+
+    // Only accessed by the mux thread
+    uint8_t recv_buf[SC_MUX_MAX_CHUNK_SIZE];
+
+    sc_mutex send_mutex;
+    uint8_t send_buf[SC_MUX_HEADER_SIZE + SC_MUX_MAX_CHUNK_SIZE];
+};
+
+void
+sc_mux_buffer_init(struct sc_mux_buffer *buf);
+
+void
+sc_mux_buffer_destroy(struct sc_mux_buffer *buf);
+
+// Append `len` bytes
+bool
+sc_mux_buffer_push(struct sc_mux_buffer *buf, const uint8_t *data,
+                   size_t len);
+
+// Consume up to `len` bytes, return the number of bytes consumed
+size_t
+sc_mux_buffer_pop(struct sc_mux_buffer *buf, uint8_t *data, size_t len);
+
+bool
+sc_mux_init(struct sc_mux *mux, sc_socket socket);
+
+void
+sc_mux_destroy(struct sc_mux *mux);
+
+bool
+sc_mux_start(struct sc_mux *mux);
+
+// The thread ends when the socket is closed or interrupted
+void
+sc_mux_join(struct sc_mux *mux);
+
+/**
+ * Receive up to `len` bytes of a stream (like net_recv())
+ *
+ * Return 0 once the socket is closed and all the received data of the stream
+ * has been read.
+ */
+ssize_t
+sc_mux_recv(struct sc_mux *mux, enum sc_mux_stream stream, void *buf,
+            size_t len);
+
+/**
+ * Send `len` bytes on a stream (like net_send_all())
+ */
+ssize_t
+sc_mux_send_all(struct sc_mux *mux, enum sc_mux_stream stream, const void *buf,
+                size_t len);
+
+#endif
@@ -5,6 +5,53 @@
 #include <string.h>
 #include <SDL2/SDL.h>
 
+static void
+sc_opengl_init_shader_functions(struct sc_opengl *gl) {
+#define SC_GL_LOAD(NAME) \
+    if (!(gl->shader.NAME = SDL_GL_GetProcAddress("gl" #NAME))) { \
+        goto missing; \
+    }
+    SC_GL_LOAD(GetIntegerv);
+    SC_GL_LOAD(IsEnabled);
+    SC_GL_LOAD(Enable);
+    SC_GL_LOAD(Disable);
+    SC_GL_LOAD(Viewport);
+    SC_GL_LOAD(ActiveTexture);
+    SC_GL_LOAD(BindBuffer);
+    SC_GL_LOAD(CreateShader);
+    SC_GL_LOAD(ShaderSource);
+    SC_GL_LOAD(CompileShader);
+    SC_GL_LOAD(GetShaderiv);
+    SC_GL_LOAD(GetShaderInfoLog);
+    SC_GL_LOAD(DeleteShader);
+    SC_GL_LOAD(CreateProgram);
+    SC_GL_LOAD(AttachShader);
+    SC_GL_LOAD(BindAttribLocation);
+    SC_GL_LOAD(LinkProgram);
+    SC_GL_LOAD(GetProgramiv);
+    SC_GL_LOAD(GetProgramInfoLog);
+    SC_GL_LOAD(DeleteProgram);
+    SC_GL_LOAD(UseProgram);
+    SC_GL_LOAD(GetUniformLocation);
+    SC_GL_LOAD(Uniform1i);
+    SC_GL_LOAD(Uniform1f);
+    SC_GL_LOAD(Uniform2f);
+    SC_GL_LOAD(Uniform3f);
+    SC_GL_LOAD(UniformMatrix3fv);
+    SC_GL_LOAD(GetVertexAttribiv);
+    SC_GL_LOAD(EnableVertexAttribArray);
+    SC_GL_LOAD(DisableVertexAttribArray);
+    SC_GL_LOAD(VertexAttribPointer);
+    // Loaded last: sc_opengl_has_shaders() checks it
+    SC_GL_LOAD(DrawArrays);
+#undef SC_GL_LOAD
+
+    return;
+
+missing:
+    memset(&gl->shader, 0, sizeof(gl->shader));
+}
+
 void
 sc_opengl_init(struct sc_opengl *gl) {
     gl->GetString = SDL_GL_GetProcAddress("glGetString");
@@ -19,6 +66,8 @@ sc_opengl_init(struct sc_opengl *gl) {
     // optional
     gl->GenerateMipmap = SDL_GL_GetProcAddress("glGenerateMipmap");
 
+    sc_opengl_init_shader_functions(gl);
+
     const char *version = (const char *) gl->GetString(GL_VERSION);
     assert(version);
     gl->version = version;
@@ -23,11 +23,61 @@ struct sc_opengl {
 
     void
     (*GenerateMipmap)(GLenum target);
+
+    // Used to render with custom shaders (OpenGL 2.0+ or OpenGL ES 2.0+),
+    // all NULL if not available (see sc_opengl_has_shaders())
+    struct {
+        void (*GetIntegerv)(GLenum pname, GLint *data);
+        GLboolean (*IsEnabled)(GLenum cap);
+        void (*Enable)(GLenum cap);
+        void (*Disable)(GLenum cap);
+        void (*Viewport)(GLint x, GLint y, GLsizei width, GLsizei height);
+        void (*ActiveTexture)(GLenum texture);
+        void (*BindBuffer)(GLenum target, GLuint buffer);
+        GLuint (*CreateShader)(GLenum type);
+        void (*ShaderSource)(GLuint shader, GLsizei count,
+                             const GLchar *const *string, const GLint *length);
+        void (*CompileShader)(GLuint shader);
+        void (*GetShaderiv)(GLuint shader, GLenum pname, GLint *params);
+        void (*GetShaderInfoLog)(GLuint shader, GLsizei max_length,
+                                 GLsizei *length, GLchar *info_log);
+        void (*DeleteShader)(GLuint shader);
+        GLuint (*CreateProgram)(void);
+        void (*AttachShader)(GLuint program, GLuint shader);
+        void (*BindAttribLocation)(GLuint program, GLuint index,
+                                   const GLchar *name);
+        void (*LinkProgram)(GLuint program);
+        void (*GetProgramiv)(GLuint program, GLenum pname, GLint *params);
+        void (*GetProgramInfoLog)(GLuint program, GLsizei max_length,
+                                  GLsizei *length, GLchar *info_log);
+        void (*DeleteProgram)(GLuint program);
+        void (*UseProgram)(GLuint program);
+        GLint (*GetUniformLocation)(GLuint program, const GLchar *name);
+        void (*Uniform1i)(GLint location, GLint v0);
+        void (*Uniform1f)(GLint location, GLfloat v0);
+        void (*Uniform2f)(GLint location, GLfloat v0, GLfloat v1);
+        void (*Uniform3f)(GLint location, GLfloat v0, GLfloat v1, GLfloat v2);
+        void (*UniformMatrix3fv)(GLint location, GLsizei count,
+                                 GLboolean transpose, const GLfloat *value);
+        void (*GetVertexAttribiv)(GLuint index, GLenum pname, GLint *params);
+        void (*EnableVertexAttribArray)(GLuint index);
+        void (*DisableVertexAttribArray)(GLuint index);
+        void (*VertexAttribPointer)(GLuint index, GLint size, GLenum type,
+                                    GLboolean normalized, GLsizei stride,
+                                    const void *pointer);
+        void (*DrawArrays)(GLenum mode, GLint first, GLsizei count);
+    } shader;
 };
 
 void
 sc_opengl_init(struct sc_opengl *gl);
 
+// Whether all the functions in gl->shader are available
+static inline bool
+sc_opengl_has_shaders(struct sc_opengl *gl) {
+    return gl->shader.DrawArrays;
+}
+
 bool
 sc_opengl_version_at_least(struct sc_opengl *gl,
                            int minver_major, int minver_minor,
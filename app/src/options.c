@@ -6,9 +6,21 @@ const struct scrcpy_options scrcpy_options_default = {
     .serial = NULL,
     .crop = NULL,
     .record_filename = NULL,
+    .record_buffer = 0,
+    .record_segment = 0,
+    .replay_buffer = 0,
+    .record_keep = 0,
+    .record_index = false,
+    .record_transcode = false,
+    .record_transcode_codec = SC_CODEC_H265,
+    .record_transcode_bit_rate = 0,
     .window_title = NULL,
     .push_target = NULL,
     .render_driver = NULL,
+    .trace_file = NULL,
+    .dump_stream = NULL,
+    .replay = NULL,
+    .replay_unthrottled = false,
     .video_codec_options = NULL,
     .audio_codec_options = NULL,
     .video_encoder = NULL,
@@ -19,13 +31,22 @@ const struct scrcpy_options scrcpy_options_default = {
     .camera_fps = 0,
     .log_level = SC_LOG_LEVEL_INFO,
     .video_codec = SC_CODEC_H264,
+    .video_codec_auto = false,
     .audio_codec = SC_CODEC_OPUS,
     .video_source = SC_VIDEO_SOURCE_DISPLAY,
+    .video_encoder_profile = SC_VIDEO_ENCODER_PROFILE_DEFAULT,
+    .video_mode = SC_VIDEO_MODE_NORMAL,
+    .thumbnail_interval = SC_TICK_FROM_SEC(1),
+    .video_decoder = SC_VIDEO_DECODER_SW,
+    .decoder_threads = 0,
+    .unfocused_decode = SC_DECODE_BUDGET_AUTO,
+    .push_jobs = 2,
     .audio_source = SC_AUDIO_SOURCE_AUTO,
     .record_format = SC_RECORD_FORMAT_AUTO,
     .keyboard_input_mode = SC_KEYBOARD_INPUT_MODE_AUTO,
     .mouse_input_mode = SC_MOUSE_INPUT_MODE_AUTO,
     .gamepad_input_mode = SC_GAMEPAD_INPUT_MODE_DISABLED,
+    .gamepad_polling_rate = 250,
     .mouse_bindings = {
         .pri = {
             .right_click = SC_MOUSE_BINDING_AUTO,
@@ -47,9 +68,15 @@ const struct scrcpy_options scrcpy_options_default = {
     },
     .tunnel_host = 0,
     .tunnel_port = 0,
+    .video_udp_port = 0,
+    .direct_port = 0,
+    .video_socket_buffer = 0,
+    .socket_busy_poll = 0,
     .shortcut_mods = SC_SHORTCUT_MOD_LALT | SC_SHORTCUT_MOD_LSUPER,
     .max_size = 0,
+    .max_memory = 0,
     .video_bit_rate = 0,
+    .video_bit_rate_auto = false,
     .audio_bit_rate = 0,
     .max_fps = NULL,
     .capture_orientation = SC_ORIENTATION_0,
@@ -63,14 +90,24 @@ const struct scrcpy_options scrcpy_options_default = {
     .window_height = 0,
     .display_id = 0,
     .video_buffer = 0,
+    .video_buffer_packets = false,
     .audio_buffer = -1, // depends on the audio format,
+    .audio_buffer_max = 0,
     .audio_output_buffer = SC_TICK_FROM_MS(5),
+    .audio_output_backend = SC_AUDIO_OUTPUT_BACKEND_AUTO,
+    .audio_concealment = true,
+    .av_sync = 0,
     .time_limit = 0,
     .screen_off_timeout = -1,
 #ifdef HAVE_V4L2
     .v4l2_device = NULL,
     .v4l2_buffer = 0,
+    .v4l2_format = SC_V4L2_FORMAT_AUTO,
+    .v4l2_width = 0,
+    .v4l2_height = 0,
 #endif
+    .shm_sink = NULL,
+    .iosurface_sink = false,
 #ifdef HAVE_USB
     .otg = false,
 #endif
@@ -83,7 +120,26 @@ const struct scrcpy_options scrcpy_options_default = {
     .turn_screen_off = false,
     .key_inject_mode = SC_KEY_INJECT_MODE_MIXED,
     .window_borderless = false,
-    .mipmaps = true,
+    .downscale_filter = SC_DOWNSCALE_FILTER_TRILINEAR,
+    .texture_damage = false,
+    .screenshot_gpu_readback = false,
+    .screenshot_from_device = false,
+    .screenshot_format = SC_IMAGE_FORMAT_PNG,
+    .screenshot_png_level = -1, // SC_PNG_COMPRESSION_DEFAULT
+    .frame_pacing = false,
+    .print_latency = false,
+    .measure_input_latency = false,
+    .latency_probe = false,
+    .video_bit_rate_adaptive = false,
+    .video_roi = false,
+    .video_square = false,
+    .thermal_throttle = false,
+    .multiplex = false,
+    .throughput = false,
+    .video_idle_timeout = 0,
+    .video_intra_refresh = 0,
+    .video_hdr = false,
+    .cpu_affinity = 0,
     .stay_awake = false,
     .force_adb_forward = false,
     .disable_screensaver = false,
@@ -103,12 +159,18 @@ const struct scrcpy_options scrcpy_options_default = {
     .audio = true,
     .require_audio = false,
     .kill_adb_on_close = false,
+    .keep_server = false,
+    .adb_batch = false,
+    .adb_native = false,
+    .session_cache = true,
     .camera_high_speed = false,
     .list = 0,
     .window = true,
     .mouse_hover = true,
     .audio_dup = false,
     .new_display = NULL,
+    .render_scale = 1.f,
+    .auto_size = false,
     .start_app = NULL,
     .angle = NULL,
     .vd_destroy_content = true,
@@ -5,8 +5,10 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include "image_variant.h"
 #include "util/tick.h"
 
 enum sc_log_level {
@@ -27,6 +29,7 @@ enum sc_record_format {
     SC_RECORD_FORMAT_AAC,
     SC_RECORD_FORMAT_FLAC,
     SC_RECORD_FORMAT_WAV,
+    SC_RECORD_FORMAT_FMP4,
 };
 
 static inline bool
@@ -54,6 +57,35 @@ enum sc_video_source {
     SC_VIDEO_SOURCE_CAMERA,
 };
 
+enum sc_video_encoder_profile {
+    SC_VIDEO_ENCODER_PROFILE_DEFAULT,
+    SC_VIDEO_ENCODER_PROFILE_LOW_LATENCY,
+};
+
+enum sc_video_mode {
+    SC_VIDEO_MODE_NORMAL,
+    // Low resolution keyframes at a fixed interval (--video-mode=thumbnail)
+    SC_VIDEO_MODE_THUMBNAIL,
+};
+
+enum sc_video_decoder {
+    SC_VIDEO_DECODER_SW,
+    SC_VIDEO_DECODER_HW,
+};
+
+enum sc_decode_budget {
+    SC_DECODE_BUDGET_AUTO, // FULL for a single device, REDUCED or KEYFRAMES
+                           // for several devices
+    SC_DECODE_BUDGET_FULL,
+    // Skip the in-loop deblocking filter
+    SC_DECODE_BUDGET_REDUCED,
+    // Decode only the keyframes (requested every second if control is enabled)
+    SC_DECODE_BUDGET_KEYFRAMES,
+    // Decode only the periodic keyframes, never requested (while the display
+    // is paused)
+    SC_DECODE_BUDGET_PAUSED,
+};
+
 enum sc_audio_source {
     SC_AUDIO_SOURCE_AUTO, // OUTPUT for video DISPLAY, MIC for video CAMERA
     SC_AUDIO_SOURCE_OUTPUT,
@@ -69,6 +101,12 @@ enum sc_audio_source {
     SC_AUDIO_SOURCE_VOICE_PERFORMANCE,
 };
 
+enum sc_audio_output_backend {
+    SC_AUDIO_OUTPUT_BACKEND_AUTO, // native if available, SDL otherwise
+    SC_AUDIO_OUTPUT_BACKEND_SDL,
+    SC_AUDIO_OUTPUT_BACKEND_NATIVE,
+};
+
 enum sc_camera_facing {
     SC_CAMERA_FACING_ANY,
     SC_CAMERA_FACING_FRONT,
@@ -97,6 +135,12 @@ enum sc_orientation_lock {
     SC_ORIENTATION_LOCKED_INITIAL, // lock to initial device orientation
 };
 
+enum sc_downscale_filter {
+    SC_DOWNSCALE_FILTER_LINEAR,
+    SC_DOWNSCALE_FILTER_TRILINEAR, // mipmaps
+    SC_DOWNSCALE_FILTER_AREA, // shader
+};
+
 enum sc_display_ime_policy {
     SC_DISPLAY_IME_POLICY_UNDEFINED,
     SC_DISPLAY_IME_POLICY_LOCAL,
@@ -225,15 +269,41 @@ struct sc_port_range {
     uint16_t last;
 };
 
+enum sc_v4l2_format {
+    SC_V4L2_FORMAT_AUTO, // YUV420, or NV12 for frames from a hardware decoder
+    SC_V4L2_FORMAT_YUV420,
+    SC_V4L2_FORMAT_NV12,
+    SC_V4L2_FORMAT_YUYV,
+    SC_V4L2_FORMAT_RGB24,
+};
+
 #define SC_WINDOW_POSITION_UNDEFINED (-0x8000)
 
+static inline sc_tick
+sc_gamepad_poll_interval(uint16_t polling_rate) {
+    return polling_rate ? SC_TICK_FREQ / polling_rate : 0;
+}
+
 struct scrcpy_options {
     const char *serial;
     const char *crop;
     const char *record_filename;
+    size_t record_buffer;
+    sc_tick record_segment;
+    sc_tick replay_buffer; // 0 if disabled
+    unsigned record_keep;
+    bool record_index;
+    // Re-encode the recorded video (--record-transcode)
+    bool record_transcode;
+    enum sc_codec record_transcode_codec;
+    uint32_t record_transcode_bit_rate; // 0 for the default
     const char *window_title;
     const char *push_target;
     const char *render_driver;
+    const char *trace_file;
+    const char *dump_stream; // file to dump the raw video stream to
+    const char *replay; // dumped stream to play instead of a device
+    bool replay_unthrottled; // replay as fast as possible
     const char *video_codec_options;
     const char *audio_codec_options;
     const char *video_encoder;
@@ -244,21 +314,37 @@ struct scrcpy_options {
     uint16_t camera_fps;
     enum sc_log_level log_level;
     enum sc_codec video_codec;
+    bool video_codec_auto; // negotiated with the device
     enum sc_codec audio_codec;
     enum sc_video_source video_source;
+    enum sc_video_encoder_profile video_encoder_profile;
+    enum sc_video_mode video_mode;
+    sc_tick thumbnail_interval;
+    enum sc_video_decoder video_decoder;
+    uint16_t decoder_threads;
+    // Decoding budget while the window is not focused (--unfocused-decode)
+    enum sc_decode_budget unfocused_decode;
+    uint8_t push_jobs;
     enum sc_audio_source audio_source;
     enum sc_record_format record_format;
     enum sc_keyboard_input_mode keyboard_input_mode;
     enum sc_mouse_input_mode mouse_input_mode;
     enum sc_gamepad_input_mode gamepad_input_mode;
+    uint16_t gamepad_polling_rate; // in Hz, 0 for unlimited
     struct sc_mouse_bindings mouse_bindings;
     enum sc_camera_facing camera_facing;
     struct sc_port_range port_range;
     uint32_t tunnel_host;
     uint16_t tunnel_port;
+    uint16_t video_udp_port;
+    uint16_t direct_port;
+    uint32_t video_socket_buffer; // in bytes, 0 for the system default
+    uint32_t socket_busy_poll; // in microseconds, 0 to disable
     uint8_t shortcut_mods; // OR of enum sc_shortcut_mod values
     uint16_t max_size;
+    uint32_t max_memory; // in bytes, 0 for unlimited
     uint32_t video_bit_rate;
+    bool video_bit_rate_auto; // --video-bit-rate=auto
     uint32_t audio_bit_rate;
     const char *max_fps; // float to be parsed by the server
     const char *angle; // float to be parsed by the server
@@ -273,14 +359,24 @@ struct scrcpy_options {
     uint16_t window_height;
     uint32_t display_id;
     sc_tick video_buffer;
+    bool video_buffer_packets; // delay the packets instead of the frames
     sc_tick audio_buffer;
+    sc_tick audio_buffer_max; // 0 for a fixed audio buffer
     sc_tick audio_output_buffer;
+    enum sc_audio_output_backend audio_output_backend;
+    bool audio_concealment; // conceal late audio packets instead of silence
+    sc_tick av_sync; // maximum video delay for A/V sync, 0 if disabled
     sc_tick time_limit;
     sc_tick screen_off_timeout;
 #ifdef HAVE_V4L2
     const char *v4l2_device;
     sc_tick v4l2_buffer;
+    enum sc_v4l2_format v4l2_format;
+    uint16_t v4l2_width; // 0 for the size of the video
+    uint16_t v4l2_height;
 #endif
+    const char *shm_sink; // file of the shared memory sink, or NULL
+    bool iosurface_sink;
 #ifdef HAVE_USB
     bool otg;
 #endif
@@ -293,7 +389,26 @@ struct scrcpy_options {
     bool turn_screen_off;
     enum sc_key_inject_mode key_inject_mode;
     bool window_borderless;
-    bool mipmaps;
+    enum sc_downscale_filter downscale_filter;
+    bool texture_damage;
+    bool screenshot_gpu_readback;
+    bool screenshot_from_device;
+    enum sc_image_format screenshot_format;
+    int8_t screenshot_png_level; // SC_PNG_COMPRESSION_DEFAULT if not set
+    bool frame_pacing;
+    bool print_latency;
+    bool measure_input_latency;
+    bool latency_probe;
+    bool video_bit_rate_adaptive;
+    bool video_roi;
+    bool video_square;
+    bool thermal_throttle;
+    bool multiplex;
+    bool throughput;
+    sc_tick video_idle_timeout;
+    uint16_t video_intra_refresh; // in frames, 0 for periodic keyframes
+    bool video_hdr; // HEVC Main10
+    uint64_t cpu_affinity; // CPUs of the latency-critical threads, 0 for all
     bool stay_awake;
     bool force_adb_forward;
     bool disable_screensaver;
@@ -313,17 +428,25 @@ struct scrcpy_options {
     bool audio;
     bool require_audio;
     bool kill_adb_on_close;
+    bool keep_server;
+    bool adb_batch;
+    bool adb_native;
+    bool session_cache;
     bool camera_high_speed;
 #define SC_OPTION_LIST_ENCODERS 0x1
 #define SC_OPTION_LIST_DISPLAYS 0x2
 #define SC_OPTION_LIST_CAMERAS 0x4
 #define SC_OPTION_LIST_CAMERA_SIZES 0x8
 #define SC_OPTION_LIST_APPS 0x10
+// Like the lists, the server just prints the result then exits
+#define SC_OPTION_BENCHMARK_ENCODERS 0x20
     uint8_t list;
     bool window;
     bool mouse_hover;
     bool audio_dup;
     const char *new_display; // [<width>x<height>][/<dpi>] parsed by the server
+    float render_scale; // scale of the new display resolution, in (0; 1]
+    bool auto_size;
     const char *start_app;
     bool vd_destroy_content;
     bool vd_system_decorations;
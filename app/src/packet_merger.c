@@ -32,16 +32,16 @@ sc_packet_merger_merge(struct sc_packet_merger *merger, AVPacket *packet) {
         memcpy(merger->config, packet->data, packet->size);
         merger->config_size = packet->size;
     } else if (merger->config) {
-        size_t config_size = merger->config_size;
-        size_t media_size = packet->size;
-
-        if (av_grow_packet(packet, config_size)) {
+        // Only the (small) config is copied, the media payload is untouched
+        uint8_t *data = av_packet_new_side_data(packet,
+                                                AV_PKT_DATA_NEW_EXTRADATA,
+                                                merger->config_size);
+        if (!data) {
             LOG_OOM();
             return false;
         }
 
-        memmove(packet->data + config_size, packet->data, media_size);
-        memcpy(packet->data, merger->config, config_size);
+        memcpy(data, merger->config, merger->config_size);
 
         free(merger->config);
         merger->config = NULL;
@@ -50,3 +50,47 @@ sc_packet_merger_merge(struct sc_packet_merger *merger, AVPacket *packet) {
 
     return true;
 }
+
+static const AVPacketSideData *
+sc_packet_merger_find_config(const AVPacket *packet) {
+    // Iterate directly, the size type of av_packet_get_side_data() depends on
+    // the FFmpeg version
+    for (int i = 0; i < packet->side_data_elems; ++i) {
+        const AVPacketSideData *sd = &packet->side_data[i];
+        if (sd->type == AV_PKT_DATA_NEW_EXTRADATA && sd->size) {
+            return sd;
+        }
+    }
+
+    return NULL;
+}
+
+bool
+sc_packet_merger_has_config(const AVPacket *packet) {
+    return sc_packet_merger_find_config(packet);
+}
+
+bool
+sc_packet_merger_inline_config(AVPacket *packet) {
+    const AVPacketSideData *sd = sc_packet_merger_find_config(packet);
+    if (!sd) {
+        return true;
+    }
+
+    size_t config_size = sd->size;
+    size_t media_size = packet->size;
+
+    // The side data is not affected by av_grow_packet()
+    if (av_grow_packet(packet, config_size)) {
+        LOG_OOM();
+        return false;
+    }
+
+    memmove(packet->data + config_size, packet->data, media_size);
+    memcpy(packet->data, sd->data, config_size);
+
+    // The packets from the demuxer have no other side data
+    av_packet_free_side_data(packet);
+
+    return true;
+}
@@ -13,11 +13,16 @@
  * device orientation change).
  *
  * Every time a config packet is received, it must be sent alone (for recorder
- * extradata), then concatenated to the next media packet (for correct decoding
+ * extradata), then provided with the next media packet (for correct decoding
  * and recording).
  *
- * This helper reads every input packet and modifies each media packet which
- * immediately follows a config packet to prepend the config packet payload.
+ * This helper reads every input packet and attaches the config packet payload
+ * to the media packet which immediately follows it, as
+ * AV_PKT_DATA_NEW_EXTRADATA side data (which the FFmpeg decoders handle), so
+ * that the (possibly large) keyframe payload is not copied.
+ *
+ * The sinks which need the config in-band (typically to mux the packets) call
+ * sc_packet_merger_inline_config() on their own copy of the packet.
  */
 
 struct sc_packet_merger {
@@ -34,10 +39,27 @@ sc_packet_merger_destroy(struct sc_packet_merger *merger);
 /**
  * If the packet is a config packet, then keep its data for later.
  * Otherwise (if the packet is a media packet), then if a config packet is
- * pending, prepend the config packet to this packet (so the packet is
- * modified!).
+ * pending, attach the config packet data to this packet as side data (so the
+ * packet is modified!).
  */
 bool
 sc_packet_merger_merge(struct sc_packet_merger *merger, AVPacket *packet);
 
+/**
+ * If the packet has config data attached by sc_packet_merger_merge(), prepend
+ * it to the packet payload (and remove the side data)
+ *
+ * This copies the packet payload, so only the sinks which need the config
+ * in-band should call it.
+ */
+bool
+sc_packet_merger_inline_config(AVPacket *packet);
+
+/**
+ * Return true if the packet has config data attached by
+ * sc_packet_merger_merge()
+ */
+bool
+sc_packet_merger_has_config(const AVPacket *packet);
+
 #endif
@@ -0,0 +1,76 @@
+#include "png_decoder.h"
+
+#include <limits.h>
+#include <string.h>
+#include <libavcodec/avcodec.h>
+
+#include "util/log.h"
+
+AVFrame *
+sc_png_decode(const uint8_t *png_data, size_t png_size) {
+    const AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_PNG);
+    if (!codec) {
+        LOGW("PNG decoder not available");
+        return NULL;
+    }
+
+    if (png_size > INT_MAX) {
+        LOGW("PNG too large");
+        return NULL;
+    }
+
+    AVFrame *result = NULL;
+
+    AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
+    if (!codec_ctx) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    if (avcodec_open2(codec_ctx, codec, NULL) < 0) {
+        LOGW("Could not open PNG decoder");
+        goto free_codec_ctx;
+    }
+
+    AVPacket *packet = av_packet_alloc();
+    if (!packet) {
+        LOG_OOM();
+        goto free_codec_ctx;
+    }
+
+    // The decoder requires a padded buffer
+    if (av_new_packet(packet, png_size)) {
+        LOG_OOM();
+        goto free_packet;
+    }
+    memcpy(packet->data, png_data, png_size);
+
+    AVFrame *frame = av_frame_alloc();
+    if (!frame) {
+        LOG_OOM();
+        goto free_packet;
+    }
+
+    int ret = avcodec_send_packet(codec_ctx, packet);
+    if (ret < 0) {
+        LOGW("Could not send PNG to decoder: %d", ret);
+        av_frame_free(&frame);
+        goto free_packet;
+    }
+
+    ret = avcodec_receive_frame(codec_ctx, frame);
+    if (ret < 0) {
+        LOGW("Could not decode PNG: %d", ret);
+        av_frame_free(&frame);
+        goto free_packet;
+    }
+
+    result = frame;
+
+free_packet:
+    av_packet_free(&packet);
+free_codec_ctx:
+    avcodec_free_context(&codec_ctx);
+
+    return result;
+}
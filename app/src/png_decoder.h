@@ -0,0 +1,18 @@
+#ifndef SC_PNG_DECODER_H
+#define SC_PNG_DECODER_H
+
+#include "common.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <libavutil/frame.h>
+
+/**
+ * Decode a PNG image from memory (with the FFmpeg PNG decoder)
+ *
+ * On success, the returned frame must be released by av_frame_free().
+ */
+AVFrame *
+sc_png_decode(const uint8_t *png_data, size_t png_size);
+
+#endif
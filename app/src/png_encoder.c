@@ -0,0 +1,137 @@
+#include "png_encoder.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+
+#include "util/log.h"
+#ifdef __APPLE__
+# include "sys/darwin/clipboard.h"
+#endif
+
+static bool
+sc_png_encode_rgba8888_ffmpeg(const uint8_t *data, size_t pitch,
+                              uint16_t width, uint16_t height, int level,
+                              uint8_t **png_data, size_t *png_size) {
+    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
+    if (!codec) {
+        LOGW("PNG encoder not available");
+        return false;
+    }
+
+    if (pitch > INT_MAX) {
+        LOGW("Image too large for PNG encoding");
+        return false;
+    }
+
+    bool ok = false;
+
+    AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
+    if (!codec_ctx) {
+        LOG_OOM();
+        return false;
+    }
+
+    codec_ctx->width = width;
+    codec_ctx->height = height;
+    codec_ctx->pix_fmt = AV_PIX_FMT_RGBA;
+    codec_ctx->time_base = (AVRational) {1, 1};
+    if (level != SC_PNG_COMPRESSION_DEFAULT) {
+        // Passed to zlib as is
+        codec_ctx->compression_level = level;
+    }
+
+    if (avcodec_open2(codec_ctx, codec, NULL) < 0) {
+        LOGW("Could not open PNG encoder");
+        goto free_codec_ctx;
+    }
+
+    AVFrame *frame = av_frame_alloc();
+    if (!frame) {
+        LOG_OOM();
+        goto free_codec_ctx;
+    }
+
+    // The frame is not refcounted, the encoder copies the data if needed
+    frame->data[0] = (uint8_t *) data;
+    frame->linesize[0] = (int) pitch;
+    frame->width = width;
+    frame->height = height;
+    frame->format = AV_PIX_FMT_RGBA;
+
+    AVPacket *packet = av_packet_alloc();
+    if (!packet) {
+        LOG_OOM();
+        goto free_frame;
+    }
+
+    int ret = avcodec_send_frame(codec_ctx, frame);
+    if (ret < 0) {
+        LOGW("Could not send frame to PNG encoder: %d", ret);
+        goto free_packet;
+    }
+
+    ret = avcodec_receive_packet(codec_ctx, packet);
+    if (ret < 0) {
+        LOGW("Could not receive PNG packet: %d", ret);
+        goto free_packet;
+    }
+
+    assert(packet->size > 0);
+    uint8_t *out = malloc(packet->size);
+    if (!out) {
+        LOG_OOM();
+        av_packet_unref(packet);
+        goto free_packet;
+    }
+    memcpy(out, packet->data, packet->size);
+
+    *png_data = out;
+    *png_size = packet->size;
+    av_packet_unref(packet);
+    ok = true;
+
+free_packet:
+    av_packet_free(&packet);
+free_frame:
+    av_frame_free(&frame);
+free_codec_ctx:
+    avcodec_free_context(&codec_ctx);
+
+    return ok;
+}
+
+bool
+sc_png_encode_rgba8888_level(const uint8_t *data, size_t pitch,
+                             uint16_t width, uint16_t height, int level,
+                             uint8_t **png_data, size_t *png_size) {
+    assert(data);
+    assert(pitch >= (size_t) width * 4);
+    assert(level == SC_PNG_COMPRESSION_DEFAULT || (level >= 0 && level <= 9));
+    assert(png_data && png_size);
+
+#ifdef __APPLE__
+    if (level == SC_PNG_COMPRESSION_DEFAULT) {
+        if (sc_darwin_encode_png_rgba8888(data, pitch, width, height, png_data,
+                                          png_size)) {
+            return true;
+        }
+        LOGD("Native PNG encoding failed, fallback to FFmpeg");
+    }
+#endif
+
+    return sc_png_encode_rgba8888_ffmpeg(data, pitch, width, height, level,
+                                         png_data, png_size);
+}
+
+bool
+sc_png_encode_rgba8888(const uint8_t *data, size_t pitch, uint16_t width,
+                       uint16_t height, uint8_t **png_data, size_t *png_size) {
+    return sc_png_encode_rgba8888_level(data, pitch, width, height,
+                                        SC_PNG_COMPRESSION_DEFAULT, png_data,
+                                        png_size);
+}
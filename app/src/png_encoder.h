@@ -0,0 +1,38 @@
+#ifndef SC_PNG_ENCODER_H
+#define SC_PNG_ENCODER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Encode an RGBA8888 image to PNG in memory
+ *
+ * On macOS, the native encoder is used. Elsewhere (or if it fails), the
+ * FFmpeg PNG encoder is used.
+ *
+ * On success, *png_data must be released by free().
+ */
+bool
+sc_png_encode_rgba8888(const uint8_t *data, size_t pitch, uint16_t width,
+                       uint16_t height, uint8_t **png_data, size_t *png_size);
+
+// Use the default zlib compression level
+#define SC_PNG_COMPRESSION_DEFAULT -1
+
+/**
+ * Same as sc_png_encode_rgba8888(), with a zlib compression level (from 0 to
+ * 9, or SC_PNG_COMPRESSION_DEFAULT)
+ *
+ * Low levels are much faster for large images, at the cost of larger files.
+ * The native macOS encoder does not expose the level, so it is only used for
+ * SC_PNG_COMPRESSION_DEFAULT.
+ */
+bool
+sc_png_encode_rgba8888_level(const uint8_t *data, size_t pitch,
+                             uint16_t width, uint16_t height, int level,
+                             uint8_t **png_data, size_t *png_size);
+
+#endif
@@ -2,14 +2,27 @@
 
 #include <assert.h>
 #include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
 #include <SDL2/SDL_clipboard.h>
+#include <SDL2/SDL_events.h>
 
 #include "device_msg.h"
 #include "events.h"
+#include "stats.h"
 #include "util/log.h"
 #include "util/str.h"
 #include "util/thread.h"
 
+// Never accumulate more than this for a single screenshot (do not trust the
+// server)
+#define SC_RECEIVER_SCREENSHOT_MAX_SIZE (64 * 1024 * 1024)
+
+struct sc_clipboard_task_data {
+    struct sc_receiver *receiver;
+    char *text;
+};
+
 struct sc_uhid_output_task_data {
     struct sc_uhid_devices *uhid_devices;
     uint16_t id;
@@ -26,8 +39,15 @@ sc_receiver_init(struct sc_receiver *receiver, sc_socket control_socket,
     }
 
     receiver->control_socket = control_socket;
+    receiver->mux = NULL;
     receiver->acksync = NULL;
     receiver->uhid_devices = NULL;
+    receiver->input_latency = NULL;
+    receiver->probe_acksync = NULL;
+    receiver->has_clipboard_hash = false;
+    receiver->screenshot_receiving = false;
+    receiver->screenshot_data = NULL;
+    receiver->screenshot_size = 0;
 
     assert(cbs && cbs->on_ended);
     receiver->cbs = cbs;
@@ -38,14 +58,47 @@ sc_receiver_init(struct sc_receiver *receiver, sc_socket control_socket,
 
 void
 sc_receiver_destroy(struct sc_receiver *receiver) {
+    free(receiver->screenshot_data);
     sc_mutex_destroy(&receiver->mutex);
 }
 
+static void
+hash_text(const char *text, uint8_t digest[SC_SHA256_DIGEST_SIZE]) {
+    struct sc_sha256 sha;
+    sc_sha256_init(&sha);
+    sc_sha256_update(&sha, text, strlen(text));
+    sc_sha256_final(&sha, digest);
+}
+
+void
+sc_receiver_set_clipboard_synced(struct sc_receiver *receiver,
+                                 const char *text) {
+    assert(sc_thread_get_id() == SC_MAIN_THREAD_ID);
+    hash_text(text, receiver->clipboard_hash);
+    receiver->has_clipboard_hash = true;
+}
+
+bool
+sc_receiver_is_clipboard_synced(struct sc_receiver *receiver,
+                                const char *text) {
+    assert(sc_thread_get_id() == SC_MAIN_THREAD_ID);
+    if (!receiver->has_clipboard_hash) {
+        return false;
+    }
+
+    uint8_t digest[SC_SHA256_DIGEST_SIZE];
+    hash_text(text, digest);
+    return !memcmp(digest, receiver->clipboard_hash, sizeof(digest));
+}
+
 static void
 task_set_clipboard(void *userdata) {
     assert(sc_thread_get_id() == SC_MAIN_THREAD_ID);
 
-    char *text = userdata;
+    struct sc_clipboard_task_data *data = userdata;
+    char *text = data->text;
+
+    sc_receiver_set_clipboard_synced(data->receiver, text);
 
     char *current = SDL_GetClipboardText();
     bool same = current && !strcmp(current, text);
@@ -58,6 +111,7 @@ task_set_clipboard(void *userdata) {
     }
 
     free(text);
+    free(data);
 }
 
 static void
@@ -73,17 +127,101 @@ task_uhid_output(void *userdata) {
     free(data);
 }
 
+static void
+sc_receiver_reset_screenshot(struct sc_receiver *receiver) {
+    free(receiver->screenshot_data);
+    receiver->screenshot_receiving = false;
+    receiver->screenshot_data = NULL;
+    receiver->screenshot_size = 0;
+}
+
+static void
+process_screenshot_chunk(struct sc_receiver *receiver,
+                         struct sc_device_msg *msg) {
+    uint8_t flags = msg->screenshot_chunk.flags;
+    size_t size = msg->screenshot_chunk.size;
+
+    if (flags & SC_SCREENSHOT_CHUNK_FLAG_FIRST) {
+        // A new transfer replaces any previous incomplete one
+        sc_receiver_reset_screenshot(receiver);
+        receiver->screenshot_receiving = true;
+    } else if (!receiver->screenshot_receiving) {
+        LOGW("Unexpected screenshot chunk, ignored");
+        sc_device_msg_destroy(msg);
+        return;
+    }
+
+    if (size) {
+        if (size > SC_RECEIVER_SCREENSHOT_MAX_SIZE - receiver->screenshot_size) {
+            LOGW("Device screenshot too big, ignored");
+            sc_receiver_reset_screenshot(receiver);
+            sc_device_msg_destroy(msg);
+            return;
+        }
+
+        size_t new_size = receiver->screenshot_size + size;
+        uint8_t *data = realloc(receiver->screenshot_data, new_size);
+        if (!data) {
+            LOG_OOM();
+            sc_receiver_reset_screenshot(receiver);
+            sc_device_msg_destroy(msg);
+            return;
+        }
+
+        memcpy(&data[receiver->screenshot_size], msg->screenshot_chunk.data,
+               size);
+        receiver->screenshot_data = data;
+        receiver->screenshot_size = new_size;
+    }
+    sc_device_msg_destroy(msg);
+
+    if (!(flags & SC_SCREENSHOT_CHUNK_FLAG_LAST)) {
+        return;
+    }
+
+    LOGD("Device screenshot received (%" SC_PRIsizet " bytes)",
+         receiver->screenshot_size);
+
+    // The event owns the data (NULL if the capture failed on the device)
+    SDL_Event event = {
+        .user = {
+            .type = SC_EVENT_DEVICE_SCREENSHOT,
+            .code = (Sint32) receiver->screenshot_size,
+            .data1 = receiver->screenshot_data,
+        },
+    };
+    if (SDL_PushEvent(&event) < 0) {
+        LOGW("Could not post device screenshot event: %s", SDL_GetError());
+        free(receiver->screenshot_data);
+    }
+
+    receiver->screenshot_receiving = false;
+    receiver->screenshot_data = NULL;
+    receiver->screenshot_size = 0;
+}
+
 static void
 process_msg(struct sc_receiver *receiver, struct sc_device_msg *msg) {
     switch (msg->type) {
         case DEVICE_MSG_TYPE_CLIPBOARD: {
+            struct sc_clipboard_task_data *data = malloc(sizeof(*data));
+            if (!data) {
+                LOG_OOM();
+                sc_device_msg_destroy(msg);
+                return;
+            }
+
+            // It is guaranteed that the receiver will still be valid when the
+            // main thread will process it (like for UHID output below)
+            data->receiver = receiver;
             // Take ownership of the text (do not destroy the msg)
-            char *text = msg->clipboard.text;
+            data->text = msg->clipboard.text;
 
-            bool ok = sc_post_to_main_thread(task_set_clipboard, text);
+            bool ok = sc_post_to_main_thread(task_set_clipboard, data);
             if (!ok) {
                 LOGW("Could not post clipboard to main thread");
-                free(text);
+                free(data->text);
+                free(data);
                 return;
             }
 
@@ -150,6 +288,59 @@ process_msg(struct sc_receiver *receiver, struct sc_device_msg *msg) {
             }
 
             break;
+        case DEVICE_MSG_TYPE_VIDEO_IDLE: {
+            LOGD("Video %s", msg->video_idle.idle ? "idle" : "active");
+
+            SDL_Event event = {
+                .user = {
+                    .type = SC_EVENT_VIDEO_IDLE_CHANGED,
+                    .code = msg->video_idle.idle ? 1 : 0,
+                },
+            };
+            if (SDL_PushEvent(&event) < 0) {
+                LOGW("Could not post video idle event: %s", SDL_GetError());
+            }
+            break;
+        }
+        case DEVICE_MSG_TYPE_INPUT_ACK:
+            if (msg->input_ack.sequence & SC_INPUT_PROBE_SEQUENCE_EXTERNAL) {
+                if (!receiver->probe_acksync) {
+                    LOGE("Received unexpected input probe ack");
+                    return;
+                }
+
+                sc_acksync_ack(receiver->probe_acksync,
+                               msg->input_ack.sequence
+                                   & ~SC_INPUT_PROBE_SEQUENCE_EXTERNAL);
+                break;
+            }
+
+            if (!receiver->input_latency) {
+                LOGE("Received unexpected input ack");
+                return;
+            }
+
+            sc_input_latency_on_ack(receiver->input_latency,
+                                    msg->input_ack.sequence,
+                                    msg->input_ack.inject_us);
+            // No allocation to free in the msg
+            break;
+        case DEVICE_MSG_TYPE_SCREENSHOT_CHUNK:
+            process_screenshot_chunk(receiver, msg);
+            break;
+        case DEVICE_MSG_TYPE_THERMAL_STATE: {
+            int status = msg->thermal_state.status;
+            int headroom = msg->thermal_state.headroom;
+            LOGD("Device thermal status: %d, headroom: %d%%, throttle level: %u",
+                 status, headroom, (unsigned) msg->thermal_state.level);
+            // Negative values (unknown) are stored as 0
+            sc_stats_set(SC_STAT_THERMAL_STATUS, MAX(status + 1, 0));
+            sc_stats_set(SC_STAT_THERMAL_HEADROOM_PCT, MAX(headroom + 1, 0));
+            sc_stats_set(SC_STAT_THERMAL_THROTTLE,
+                         msg->thermal_state.level + 1);
+            // No allocation to free in the msg
+            break;
+        }
     }
 }
 
@@ -188,8 +379,11 @@ run_receiver(void *data) {
 
     for (;;) {
         assert(head < DEVICE_MSG_MAX_SIZE);
-        ssize_t r = net_recv(receiver->control_socket, buf + head,
-                             DEVICE_MSG_MAX_SIZE - head);
+        size_t len = DEVICE_MSG_MAX_SIZE - head;
+        ssize_t r = receiver->mux
+                  ? sc_mux_recv(receiver->mux, SC_MUX_STREAM_CONTROL,
+                                buf + head, len)
+                  : net_recv(receiver->control_socket, buf + head, len);
         if (r <= 0) {
             LOGD("Receiver stopped");
             // device disconnected: keep error=false
@@ -4,21 +4,46 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 
+#include "input_latency.h"
+#include "mux.h"
 #include "uhid/uhid_output.h"
 #include "util/acksync.h"
 #include "util/net.h"
+#include "util/sha256.h"
 #include "util/thread.h"
 
+// Flag of the sequences of the input probes pushed by
+// sc_controller_push_input_probe(), to distinguish their acknowledgments from
+// those of the probes measuring the input latency
+#define SC_INPUT_PROBE_SEQUENCE_EXTERNAL (UINT64_C(1) << 63)
+
 // receive events from the device
 // managed by the controller
 struct sc_receiver {
     sc_socket control_socket;
+    // If set, the control stream is received on the multiplexed socket
+    // instead of control_socket
+    struct sc_mux *mux;
     sc_thread thread;
     sc_mutex mutex;
 
     struct sc_acksync *acksync;
     struct sc_uhid_devices *uhid_devices;
+    struct sc_input_latency *input_latency; // may be NULL
+    // Acknowledgments of the probes pushed by sc_controller_push_input_probe()
+    struct sc_acksync *probe_acksync; // may be NULL
+
+    // Hash of the last clipboard content synchronized between the device and
+    // the computer, to never send an unchanged clipboard (main thread only)
+    bool has_clipboard_hash;
+    uint8_t clipboard_hash[SC_SHA256_DIGEST_SIZE];
+
+    // Screenshot being received in chunks (receiver thread only)
+    bool screenshot_receiving;
+    uint8_t *screenshot_data;
+    size_t screenshot_size;
 
     const struct sc_receiver_callbacks *cbs;
     void *cbs_userdata;
@@ -40,6 +65,21 @@ sc_receiver_start(struct sc_receiver *receiver);
 
 // no sc_receiver_stop(), it will automatically stop on control_socket shutdown
 
+/**
+ * Record that the device clipboard contains text (main thread only)
+ */
+void
+sc_receiver_set_clipboard_synced(struct sc_receiver *receiver,
+                                 const char *text);
+
+/**
+ * Indicate whether text is known to be the device clipboard content (main
+ * thread only)
+ */
+bool
+sc_receiver_is_clipboard_synced(struct sc_receiver *receiver,
+                                const char *text);
+
 void
 sc_receiver_join(struct sc_receiver *receiver);
 
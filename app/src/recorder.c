@@ -2,6 +2,7 @@
 
 #include <assert.h>
 #include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <libavcodec/avcodec.h>
@@ -9,8 +10,13 @@
 #include <libavutil/time.h>
 #include <libavutil/display.h>
 
+#include "packet_merger.h"
+#include "stats.h"
+#include "util/binary.h"
+#include "util/file.h"
 #include "util/log.h"
 #include "util/str.h"
+#include "util/trace.h"
 
 /** Downcast packet sinks to recorder */
 #define DOWNCAST_VIDEO(SINK) \
@@ -20,6 +26,9 @@
 
 static const AVRational SCRCPY_TIME_BASE = {1, 1000000}; // timestamps in us
 
+#define SC_RECORDER_INDEX_SUFFIX ".index"
+#define SC_RECORDER_INDEX_HEADER "# scrcpy recording index v1"
+
 static const AVOutputFormat *
 find_muxer(const char *name) {
 #ifdef SCRCPY_LAVF_HAS_NEW_MUXER_ITERATOR_API
@@ -37,27 +46,178 @@ find_muxer(const char *name) {
     return oformat;
 }
 
+// Serialized pts, dts, duration, flags and stream index of a spilled packet
+#define SC_RECORDER_SPILL_HEADER_LEN 32
+
+static inline bool
+sc_recorder_queue_has_spilled(const struct sc_recorder_queue *queue) {
+    return queue->spill_initialized && !sc_spill_log_is_empty(&queue->spill);
+}
+
+static inline bool
+sc_recorder_queue_is_empty(const struct sc_recorder_queue *queue) {
+    return sc_vecdeque_is_empty(&queue->packets)
+        && !sc_recorder_queue_has_spilled(queue);
+}
+
+static inline size_t
+sc_recorder_queue_size(const struct sc_recorder_queue *queue) {
+    size_t spilled = queue->spill_initialized ? queue->spill.count : 0;
+    return queue->packets.size + spilled;
+}
+
+static void
+sc_recorder_update_queue_stats(struct sc_recorder *recorder) {
+    sc_stats_set(SC_STAT_RECORDER_QUEUE,
+                 sc_recorder_queue_size(&recorder->video_queue)
+                    + sc_recorder_queue_size(&recorder->audio_queue));
+    sc_stats_set(SC_STAT_RECORDER_QUEUE_BYTES,
+                 MIN(recorder->queue_bytes, UINT32_MAX));
+}
+
+// Append the packet to the spill file of the queue
+static bool
+sc_recorder_spill(struct sc_recorder *recorder,
+                  struct sc_recorder_queue *queue, const AVPacket *packet,
+                  int stream_index) {
+    sc_mutex_assert(&recorder->mutex);
+
+    if (recorder->spill_failed) {
+        return false;
+    }
+
+    if (!queue->spill_initialized) {
+        if (!sc_spill_log_init(&queue->spill)) {
+            recorder->spill_failed = true;
+            return false;
+        }
+        queue->spill_initialized = true;
+    }
+
+    // The spill log only stores the payload, so the config side data must be
+    // inlined (this copy is rare: only after a new config)
+    AVPacket *merged = NULL;
+    if (sc_packet_merger_has_config(packet)) {
+        merged = av_packet_clone(packet);
+        if (!merged || !sc_packet_merger_inline_config(merged)) {
+            LOG_OOM();
+            av_packet_free(&merged);
+            return false;
+        }
+        packet = merged;
+    }
+
+    uint8_t header[SC_RECORDER_SPILL_HEADER_LEN];
+    sc_write64be(header, (uint64_t) packet->pts);
+    sc_write64be(&header[8], (uint64_t) packet->dts);
+    sc_write64be(&header[16], (uint64_t) packet->duration);
+    sc_write32be(&header[24], (uint32_t) packet->flags);
+    sc_write32be(&header[28], (uint32_t) stream_index);
+
+    bool ok = sc_spill_log_append(&queue->spill, header, sizeof(header),
+                                  packet->data, packet->size);
+    av_packet_free(&merged);
+    if (!ok) {
+        recorder->spill_failed = true;
+        return false;
+    }
+
+    if (!recorder->spilled_packets) {
+        LOGW("Recording queue over the memory budget, spilling packets to "
+             "disk");
+    }
+    ++recorder->spilled_packets;
+
+    return true;
+}
+
+// Read back the next packet from the spill file of the queue
+//
+// The file is read with the mutex locked, but the producers only wait if they
+// spill packets too.
 static AVPacket *
-sc_recorder_packet_ref(const AVPacket *packet) {
-    AVPacket *p = av_packet_alloc();
-    if (!p) {
+sc_recorder_unspill(struct sc_recorder *recorder,
+                    struct sc_recorder_queue *queue) {
+    sc_mutex_assert(&recorder->mutex);
+    assert(sc_recorder_queue_has_spilled(queue));
+
+    uint8_t header[SC_RECORDER_SPILL_HEADER_LEN];
+    uint32_t size;
+    if (!sc_spill_log_read_header(&queue->spill, header, sizeof(header),
+                                  &size)) {
+        return NULL;
+    }
+
+    AVPacket *packet = sc_packet_pool_get(&recorder->packet_pool);
+    if (!packet) {
+        return NULL;
+    }
+
+    if (av_new_packet(packet, size)) {
         LOG_OOM();
+        sc_packet_pool_put(&recorder->packet_pool, packet);
         return NULL;
     }
 
-    if (av_packet_ref(p, packet)) {
-        av_packet_free(&p);
+    if (!sc_spill_log_read_payload(&queue->spill, packet->data)) {
+        sc_packet_pool_put(&recorder->packet_pool, packet);
         return NULL;
     }
 
-    return p;
+    packet->pts = (int64_t) sc_read64be(header);
+    packet->dts = (int64_t) sc_read64be(&header[8]);
+    packet->duration = (int64_t) sc_read64be(&header[16]);
+    packet->flags = (int) sc_read32be(&header[24]);
+    packet->stream_index = (int) sc_read32be(&header[28]);
+
+    sc_recorder_update_queue_stats(recorder);
+    return packet;
+}
+
+// Return NULL on error (if the packet could not be read back from disk)
+static AVPacket *
+sc_recorder_queue_pop(struct sc_recorder *recorder,
+                      struct sc_recorder_queue *queue) {
+    sc_mutex_assert(&recorder->mutex);
+
+    if (sc_vecdeque_is_empty(&queue->packets)) {
+        // The spilled packets are always more recent than the packets in
+        // memory
+        return sc_recorder_unspill(recorder, queue);
+    }
+
+    AVPacket *packet = sc_vecdeque_pop(&queue->packets);
+    assert(recorder->queue_bytes >= (size_t) packet->size);
+    recorder->queue_bytes -= packet->size;
+    sc_recorder_update_queue_stats(recorder);
+    return packet;
+}
+
+static void
+sc_recorder_queue_clear(struct sc_recorder *recorder,
+                        struct sc_recorder_queue *queue) {
+    while (!sc_vecdeque_is_empty(&queue->packets)) {
+        AVPacket *p = sc_recorder_queue_pop(recorder, queue);
+        sc_packet_pool_put(&recorder->packet_pool, p);
+    }
+    if (queue->spill_initialized) {
+        sc_spill_log_clear(&queue->spill);
+    }
+    sc_recorder_update_queue_stats(recorder);
+}
+
+static void
+sc_recorder_queue_init(struct sc_recorder_queue *queue) {
+    sc_vecdeque_init(&queue->packets);
+    queue->spill_initialized = false;
 }
 
 static void
-sc_recorder_queue_clear(struct sc_recorder_queue *queue) {
-    while (!sc_vecdeque_is_empty(queue)) {
-        AVPacket *p = sc_vecdeque_pop(queue);
-        av_packet_free(&p);
+sc_recorder_queue_destroy(struct sc_recorder_queue *queue) {
+    assert(sc_vecdeque_is_empty(&queue->packets));
+    sc_vecdeque_destroy(&queue->packets);
+    if (queue->spill_initialized) {
+        sc_spill_log_destroy(&queue->spill);
     }
 }
 
@@ -65,6 +225,7 @@ static const char *
 sc_recorder_get_format_name(enum sc_record_format format) {
     switch (format) {
         case SC_RECORD_FORMAT_MP4:
+        case SC_RECORD_FORMAT_FMP4:
         case SC_RECORD_FORMAT_M4A:
         case SC_RECORD_FORMAT_AAC:
             return "mp4";
@@ -82,6 +243,175 @@ sc_recorder_get_format_name(enum sc_record_format format) {
     }
 }
 
+static const char *
+sc_recorder_get_current_filename(struct sc_recorder *recorder) {
+    return recorder->segment_duration ? recorder->segment_filename
+                                      : recorder->filename;
+}
+
+/**
+ * Insert the segment index before the file extension:
+ * "file.mp4" -> "file_0001.mp4"
+ */
+static char *
+sc_recorder_get_segment_filename(const char *filename, unsigned index) {
+    const char *sep = strrchr(filename, SC_PATH_SEPARATOR);
+    const char *basename = sep ? sep + 1 : filename;
+    const char *ext = strrchr(basename, '.');
+    if (!ext || ext == basename) {
+        // no extension (or a hidden file)
+        ext = filename + strlen(filename);
+    }
+    size_t prefix_len = ext - filename;
+
+    // '_' + at most 10 digits + '\0'
+    size_t len = prefix_len + strlen(ext) + 12;
+    char *name = malloc(len);
+    if (!name) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    snprintf(name, len, "%.*s_%04u%s", (int) prefix_len, filename, index, ext);
+    return name;
+}
+
+static void
+sc_recorder_open_index(struct sc_recorder *recorder, const char *filename) {
+    assert(recorder->index);
+    assert(!recorder->index_file);
+
+    char *path = sc_str_concat(filename, SC_RECORDER_INDEX_SUFFIX);
+    if (!path) {
+        return;
+    }
+
+    FILE *file = fopen(path, "w");
+    if (!file || fprintf(file, SC_RECORDER_INDEX_HEADER "\n"
+                               "# <type> <pts_us> <offset>\n") < 0) {
+        // The recording itself is not affected
+        LOGW("Could not write recording index: %s", path);
+        if (file) {
+            fclose(file);
+        }
+        free(path);
+        return;
+    }
+
+    free(path);
+    recorder->index_file = file;
+}
+
+static void
+sc_recorder_close_index(struct sc_recorder *recorder) {
+    if (recorder->index_file) {
+        fclose(recorder->index_file);
+        recorder->index_file = NULL;
+    }
+}
+
+static void
+sc_recorder_remove_index(const char *filename) {
+    char *path = sc_str_concat(filename, SC_RECORDER_INDEX_SUFFIX);
+    if (path) {
+        sc_file_remove(path);
+        free(path);
+    }
+}
+
+static void
+sc_recorder_write_index_entry(struct sc_recorder *recorder, const char *type,
+                              int64_t pts, int64_t offset) {
+    assert(recorder->index_file);
+
+    // Flush each entry, so that the index is usable during the recording (and
+    // after a crash). There is typically one keyframe every few seconds.
+    int ret = fprintf(recorder->index_file, "%s %" PRIi64 " %" PRIi64 "\n",
+                      type, pts, offset);
+    if (ret < 0 || fflush(recorder->index_file)) {
+        LOGW("Could not write recording index, index disabled");
+        sc_recorder_close_index(recorder);
+    }
+}
+
+static void
+sc_recorder_update_index(struct sc_recorder *recorder,
+                         const struct sc_recorder_stream *st,
+                         const AVPacket *packet, int64_t pts, int64_t offset) {
+    if (!recorder->index) {
+        return;
+    }
+
+    unsigned markers = atomic_exchange_explicit(&recorder->pending_markers, 0,
+                                                memory_order_relaxed);
+
+    if (!recorder->index_file || pts == AV_NOPTS_VALUE) {
+        return;
+    }
+
+    if (st == &recorder->video_stream && packet->flags & AV_PKT_FLAG_KEY) {
+        sc_recorder_write_index_entry(recorder, "keyframe", pts, offset);
+    }
+
+    for (unsigned i = 0; i < markers && recorder->index_file; ++i) {
+        sc_recorder_write_index_entry(recorder, "marker", pts, offset);
+        LOGI("Recording marker added at %" PRIi64 ".%03" PRIi64 "s",
+             pts / 1000000, pts / 1000 % 1000);
+    }
+}
+
+static void
+sc_recorder_segments_clear(struct sc_recorder_segments *segments) {
+    while (!sc_vecdeque_is_empty(segments)) {
+        char *name = sc_vecdeque_pop(segments);
+        free(name);
+    }
+}
+
+/**
+ * Select the filename of the next segment, and delete the oldest segments so
+ * that at most segment_keep files (including the new one) exist
+ */
+static bool
+sc_recorder_next_segment(struct sc_recorder *recorder) {
+    assert(recorder->segment_duration);
+
+    char *filename = sc_recorder_get_segment_filename(recorder->filename,
+                                                      recorder->segment_index);
+    if (!filename) {
+        return false;
+    }
+
+    if (recorder->segment_keep) {
+        while (sc_vecdeque_size(&recorder->segments)
+                >= recorder->segment_keep) {
+            char *oldest = sc_vecdeque_pop(&recorder->segments);
+            if (sc_file_remove(oldest)) {
+                LOGD("Recording segment deleted: %s", oldest);
+            } else {
+                LOGW("Could not delete recording segment: %s", oldest);
+            }
+            if (recorder->index) {
+                sc_recorder_remove_index(oldest);
+            }
+            free(oldest);
+        }
+
+        char *name = strdup(filename);
+        if (!name || !sc_vecdeque_push(&recorder->segments, name)) {
+            LOG_OOM();
+            free(name);
+            free(filename);
+            return false;
+        }
+    }
+
+    free(recorder->segment_filename);
+    recorder->segment_filename = filename;
+    ++recorder->segment_index;
+    return true;
+}
+
 static bool
 sc_recorder_set_extradata(AVStream *ostream, const AVPacket *packet) {
     uint8_t *extradata = av_malloc(packet->size * sizeof(uint8_t));
@@ -107,6 +437,18 @@ static bool
 sc_recorder_write_stream(struct sc_recorder *recorder,
                          struct sc_recorder_stream *st, AVPacket *packet) {
     AVStream *stream = recorder->ctx->streams[st->index];
+    // The new parameter sets (e.g. on device orientation change) must be
+    // stored in-band
+    if (!sc_packet_merger_inline_config(packet)) {
+        return false;
+    }
+    if (recorder->segment_duration) {
+        // Each segment starts at 0
+        packet->pts -= recorder->segment_start;
+        packet->dts = packet->pts;
+    }
+    // In microseconds, relative to the current file
+    int64_t index_pts = packet->pts;
     sc_recorder_rescale_packet(stream, packet);
     if (st->last_pts != AV_NOPTS_VALUE && packet->pts <= st->last_pts) {
         LOGD("Fixing PTS non monotonically increasing in stream %d "
@@ -117,7 +459,25 @@ sc_recorder_write_stream(struct sc_recorder *recorder,
     } else {
         st->last_pts = packet->pts;
     }
-    return av_interleaved_write_frame(recorder->ctx, packet) >= 0;
+    bool fragment_boundary = recorder->format == SC_RECORD_FORMAT_FMP4
+                          && packet->flags & AV_PKT_FLAG_KEY
+                          && st == &recorder->video_stream;
+
+    // The packet may be delayed by the interleaving, so its data will be
+    // written at or after the current position
+    int64_t offset = avio_tell(recorder->ctx->pb);
+    // Read the flags before the packet is consumed by the muxer
+    sc_recorder_update_index(recorder, st, packet, index_pts, offset);
+
+    sc_tick start = sc_trace_begin();
+    bool ok = av_interleaved_write_frame(recorder->ctx, packet) >= 0;
+    if (ok && fragment_boundary) {
+        // The muxer has just written the previous fragment, do not keep it
+        // in the write buffer
+        avio_flush(recorder->ctx->pb);
+    }
+    sc_trace_end("record write", start);
+    return ok;
 }
 
 static inline bool
@@ -130,8 +490,89 @@ sc_recorder_write_audio(struct sc_recorder *recorder, AVPacket *packet) {
     return sc_recorder_write_stream(recorder, &recorder->audio_stream, packet);
 }
 
+#ifdef SCRCPY_LAVF_HAS_AVIO_CONST_WRITE_PACKET
+static int
+sc_recorder_write_packet(void *opaque, const uint8_t *buf, int buf_size) {
+#else
+static int
+sc_recorder_write_packet(void *opaque, uint8_t *buf, int buf_size) {
+#endif
+    struct sc_recorder *recorder = opaque;
+
+    sc_tick start = sc_tick_now();
+    // The file context is unbuffered (AVIO_FLAG_DIRECT): the whole buffer is
+    // written at once
+    avio_write(recorder->file_pb, buf, buf_size);
+    recorder->write_time += sc_tick_now() - start;
+
+    int ret = recorder->file_pb->error;
+    if (ret < 0) {
+        return ret;
+    }
+
+    recorder->bytes_written += buf_size;
+    ++recorder->write_count;
+    return buf_size;
+}
+
+static int64_t
+sc_recorder_seek(void *opaque, int64_t offset, int whence) {
+    struct sc_recorder *recorder = opaque;
+    if (whence & AVSEEK_SIZE) {
+        return avio_size(recorder->file_pb);
+    }
+    return avio_seek(recorder->file_pb, offset, whence & ~AVSEEK_FORCE);
+}
+
+static bool
+sc_recorder_open_buffered_io(struct sc_recorder *recorder,
+                             const char *file_url) {
+    assert(recorder->buffer_size);
+
+    int ret = avio_open(&recorder->file_pb, file_url,
+                        AVIO_FLAG_WRITE | AVIO_FLAG_DIRECT);
+    if (ret < 0) {
+        return false;
+    }
+
+    // av_malloc() returns a buffer suitably aligned for any I/O
+    unsigned char *buffer = av_malloc(recorder->buffer_size);
+    if (!buffer) {
+        LOG_OOM();
+        avio_closep(&recorder->file_pb);
+        return false;
+    }
+
+    AVIOContext *pb =
+        avio_alloc_context(buffer, recorder->buffer_size, 1, recorder, NULL,
+                           sc_recorder_write_packet, sc_recorder_seek);
+    if (!pb) {
+        LOG_OOM();
+        av_free(buffer);
+        avio_closep(&recorder->file_pb);
+        return false;
+    }
+
+    recorder->ctx->pb = pb;
+    // Only write when the buffer is full (or on seek), not after each packet
+    recorder->ctx->flush_packets = 0;
+    return true;
+}
+
+static void
+sc_recorder_close_buffered_io(struct sc_recorder *recorder) {
+    AVIOContext *pb = recorder->ctx->pb;
+    avio_flush(pb);
+    // The buffer may have been reallocated by AVIO
+    av_freep(&pb->buffer);
+    avio_context_free(&recorder->ctx->pb);
+    avio_closep(&recorder->file_pb);
+}
+
 static bool
 sc_recorder_open_output_file(struct sc_recorder *recorder) {
+    const char *filename = sc_recorder_get_current_filename(recorder);
+
     const char *format_name = sc_recorder_get_format_name(recorder->format);
     assert(format_name);
     const AVOutputFormat *format = find_muxer(format_name);
@@ -146,16 +587,21 @@ sc_recorder_open_output_file(struct sc_recorder *recorder) {
         return false;
     }
 
-    char *file_url = sc_str_concat("file:", recorder->filename);
+    char *file_url = sc_str_concat("file:", filename);
     if (!file_url) {
         avformat_free_context(recorder->ctx);
         return false;
     }
 
-    int ret = avio_open(&recorder->ctx->pb, file_url, AVIO_FLAG_WRITE);
+    bool ok;
+    if (recorder->buffer_size) {
+        ok = sc_recorder_open_buffered_io(recorder, file_url);
+    } else {
+        ok = avio_open(&recorder->ctx->pb, file_url, AVIO_FLAG_WRITE) >= 0;
+    }
     free(file_url);
-    if (ret < 0) {
-        LOGE("Failed to open output file: %s", recorder->filename);
+    if (!ok) {
+        LOGE("Failed to open output file: %s", filename);
         avformat_free_context(recorder->ctx);
         return false;
     }
@@ -169,25 +615,77 @@ sc_recorder_open_output_file(struct sc_recorder *recorder) {
     av_dict_set(&recorder->ctx->metadata, "comment",
                 "Recorded by scrcpy " SCRCPY_VERSION, 0);
 
-    LOGI("Recording started to %s file: %s", format_name, recorder->filename);
+    if (recorder->index) {
+        sc_recorder_open_index(recorder, filename);
+    }
+
+    LOGI("Recording started to %s file: %s", format_name, filename);
     return true;
 }
 
+static void
+sc_recorder_close_output_io(struct sc_recorder *recorder) {
+    sc_recorder_close_index(recorder);
+
+    if (!recorder->ctx->pb) {
+        // already closed (on segment change failure)
+        return;
+    }
+
+    if (recorder->buffer_size) {
+        sc_recorder_close_buffered_io(recorder);
+    } else {
+        avio_closep(&recorder->ctx->pb);
+    }
+}
+
 static void
 sc_recorder_close_output_file(struct sc_recorder *recorder) {
-    avio_close(recorder->ctx->pb);
+    sc_recorder_close_output_io(recorder);
     avformat_free_context(recorder->ctx);
 }
 
+static void
+sc_recorder_log_stats(struct sc_recorder *recorder) {
+    sc_mutex_lock(&recorder->mutex);
+    size_t max_queue_depth = recorder->max_queue_depth;
+    uint64_t dropped_packets = recorder->dropped_packets;
+    uint64_t spilled_packets = recorder->spilled_packets;
+    sc_mutex_unlock(&recorder->mutex);
+
+    if (spilled_packets) {
+        LOGI("Recording: %" PRIu64 " packets spilled to disk (over the "
+             "memory budget)", spilled_packets);
+    }
+
+    if (dropped_packets) {
+        LOGW("Recording: %" PRIu64 " packets dropped (over the memory budget)",
+             dropped_packets);
+    }
+
+    if (recorder->buffer_size && recorder->write_count) {
+        double mib = recorder->bytes_written / (1024. * 1024.);
+        double secs = recorder->write_time / (double) SC_TICK_FROM_SEC(1);
+        LOGI("Recording: %.1f MiB written in %" PRIu64 " writes "
+             "(%.1f MiB/s), max queue depth: %" SC_PRIsizet " packets",
+             mib, recorder->write_count, secs > 0 ? mib / secs : 0.,
+             max_queue_depth);
+    } else {
+        LOGI("Recording: max queue depth: %" SC_PRIsizet " packets",
+             max_queue_depth);
+    }
+}
+
 static inline bool
 sc_recorder_must_wait_for_config_packets(struct sc_recorder *recorder) {
-    if (recorder->video && sc_vecdeque_is_empty(&recorder->video_queue)) {
+    if (recorder->video
+            && sc_recorder_queue_is_empty(&recorder->video_queue)) {
         // The video queue is empty
         return true;
     }
 
     if (recorder->audio && recorder->audio_expects_config_packet
-            && sc_vecdeque_is_empty(&recorder->audio_queue)) {
+            && sc_recorder_queue_is_empty(&recorder->audio_queue)) {
         // The audio queue is empty (when audio is enabled)
         return true;
     }
@@ -196,6 +694,33 @@ sc_recorder_must_wait_for_config_packets(struct sc_recorder *recorder) {
     return false;
 }
 
+static bool
+sc_recorder_write_header(struct sc_recorder *recorder) {
+    AVDictionary *opts = NULL;
+    if (recorder->format == SC_RECORD_FORMAT_FMP4) {
+        // Write the moov atom upfront, then a fragment (moof + mdat) per
+        // video keyframe, so that the muxer does not keep the index of the
+        // whole recording in memory, and the file is playable up to the last
+        // fragment
+        av_dict_set(&opts, "movflags",
+                    "frag_keyframe+empty_moov+default_base_moof", 0);
+        if (!recorder->video) {
+            // Without video, fragment every second
+            av_dict_set(&opts, "frag_duration", "1000000", 0);
+        }
+    }
+
+    bool ok = avformat_write_header(recorder->ctx, &opts) >= 0;
+    av_dict_free(&opts);
+    if (!ok) {
+        LOGE("Failed to write header to %s",
+             sc_recorder_get_current_filename(recorder));
+        return false;
+    }
+
+    return true;
+}
+
 static bool
 sc_recorder_process_header(struct sc_recorder *recorder) {
     sc_mutex_lock(&recorder->mutex);
@@ -207,7 +732,8 @@ sc_recorder_process_header(struct sc_recorder *recorder) {
         sc_cond_wait(&recorder->cond, &recorder->mutex);
     }
 
-    if (recorder->video && sc_vecdeque_is_empty(&recorder->video_queue)) {
+    if (recorder->video
+            && sc_recorder_queue_is_empty(&recorder->video_queue)) {
         assert(recorder->stopped);
         // If the recorder is stopped, don't process anything if there are not
         // at least video packets
@@ -216,22 +742,32 @@ sc_recorder_process_header(struct sc_recorder *recorder) {
     }
 
     AVPacket *video_pkt = NULL;
-    if (!sc_vecdeque_is_empty(&recorder->video_queue)) {
+    if (!sc_recorder_queue_is_empty(&recorder->video_queue)) {
         assert(recorder->video);
-        video_pkt = sc_vecdeque_pop(&recorder->video_queue);
+        video_pkt = sc_recorder_queue_pop(recorder, &recorder->video_queue);
     }
 
     AVPacket *audio_pkt = NULL;
     if (recorder->audio_expects_config_packet &&
-            !sc_vecdeque_is_empty(&recorder->audio_queue)) {
+            !sc_recorder_queue_is_empty(&recorder->audio_queue)) {
         assert(recorder->audio);
-        audio_pkt = sc_vecdeque_pop(&recorder->audio_queue);
+        audio_pkt = sc_recorder_queue_pop(recorder, &recorder->audio_queue);
     }
 
+    // The config packets are never spilled (they are the first packets)
+    bool ok = (video_pkt || sc_recorder_queue_is_empty(&recorder->video_queue))
+           && (audio_pkt || !recorder->audio_expects_config_packet
+                         || sc_recorder_queue_is_empty(&recorder->audio_queue));
+
     sc_mutex_unlock(&recorder->mutex);
 
     int ret = false;
 
+    if (!ok) {
+        LOGE("Could not read the first recorded packets");
+        goto end;
+    }
+
     if (video_pkt) {
         if (video_pkt->pts != AV_NOPTS_VALUE) {
             LOGE("The first video packet is not a config packet");
@@ -262,25 +798,167 @@ sc_recorder_process_header(struct sc_recorder *recorder) {
         }
     }
 
-    bool ok = avformat_write_header(recorder->ctx, NULL) >= 0;
-    if (!ok) {
-        LOGE("Failed to write header to %s", recorder->filename);
-        goto end;
-    }
-
-    ret = true;
+    ret = sc_recorder_write_header(recorder);
 
 end:
     if (video_pkt) {
-        av_packet_free(&video_pkt);
+        sc_packet_pool_put(&recorder->packet_pool, video_pkt);
     }
     if (audio_pkt) {
-        av_packet_free(&audio_pkt);
+        sc_packet_pool_put(&recorder->packet_pool, audio_pkt);
     }
 
     return ret;
 }
 
+static bool
+sc_recorder_set_orientation(AVStream *stream, enum sc_orientation orientation) {
+    assert(!sc_orientation_is_mirror(orientation));
+
+    uint8_t *raw_data;
+#ifdef SCRCPY_LAVC_HAS_CODECPAR_CODEC_SIDEDATA
+    AVPacketSideData *sd =
+        av_packet_side_data_new(&stream->codecpar->coded_side_data,
+                                &stream->codecpar->nb_coded_side_data,
+                                AV_PKT_DATA_DISPLAYMATRIX,
+                                sizeof(int32_t) * 9, 0);
+    if (!sd) {
+        LOG_OOM();
+        return false;
+    }
+
+    raw_data = sd->data;
+#else
+    raw_data = av_stream_new_side_data(stream, AV_PKT_DATA_DISPLAYMATRIX,
+                                      sizeof(int32_t) * 9);
+    if (!raw_data) {
+        LOG_OOM();
+        return false;
+    }
+#endif
+
+    int32_t *matrix = (int32_t *) raw_data;
+
+    unsigned rotation = orientation;
+    unsigned angle = rotation * 90;
+
+    av_display_rotation_set(matrix, angle);
+
+    return true;
+}
+
+static bool
+sc_recorder_copy_streams(struct sc_recorder *recorder,
+                         const AVFormatContext *src) {
+    AVFormatContext *dst = recorder->ctx;
+    assert(!dst->nb_streams);
+
+    for (unsigned i = 0; i < src->nb_streams; ++i) {
+        AVStream *stream = avformat_new_stream(dst, NULL);
+        if (!stream) {
+            LOG_OOM();
+            return false;
+        }
+
+        // Also copy the extradata (and the display matrix, stored in the
+        // coded side data if available)
+        int r = avcodec_parameters_copy(stream->codecpar,
+                                        src->streams[i]->codecpar);
+        if (r < 0) {
+            LOG_OOM();
+            return false;
+        }
+    }
+
+#ifndef SCRCPY_LAVC_HAS_CODECPAR_CODEC_SIDEDATA
+    if (recorder->video && recorder->orientation != SC_ORIENTATION_0) {
+        AVStream *stream = dst->streams[recorder->video_stream.index];
+        if (!sc_recorder_set_orientation(stream, recorder->orientation)) {
+            return false;
+        }
+    }
+#endif
+
+    return true;
+}
+
+static void
+sc_recorder_request_keyframe(struct sc_recorder *recorder) {
+    if (recorder->cbs->on_keyframe_needed
+            && !atomic_exchange(&recorder->keyframe_requested, true)) {
+        LOGD("Recorder: requesting a keyframe");
+        recorder->cbs->on_keyframe_needed(recorder, recorder->cbs_userdata);
+    }
+}
+
+static bool
+sc_recorder_must_start_segment(struct sc_recorder *recorder,
+                               const AVPacket *packet) {
+    // Both are in microseconds
+    if (!recorder->segment_duration
+            || packet->pts - recorder->segment_start
+                < recorder->segment_duration) {
+        return false;
+    }
+
+    // Video segments must start on a keyframe (audio packets are always
+    // independent)
+    bool is_video = recorder->video;
+    if (is_video && !(packet->flags & AV_PKT_FLAG_KEY)) {
+        // Do not wait for the next periodic keyframe (possibly far away)
+        sc_recorder_request_keyframe(recorder);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Finish the current segment file and start the next one at `pts`
+ *
+ * The streams are copied from the current muxer context: the packets are not
+ * re-encoded.
+ */
+static bool
+sc_recorder_start_next_segment(struct sc_recorder *recorder, int64_t pts) {
+    int ret = av_write_trailer(recorder->ctx);
+    if (ret < 0) {
+        LOGE("Failed to write trailer to %s", recorder->segment_filename);
+        return false;
+    }
+
+    LOGI("Recording segment complete: %s", recorder->segment_filename);
+
+    AVFormatContext *previous = recorder->ctx;
+    sc_recorder_close_output_io(recorder);
+
+    if (!sc_recorder_next_segment(recorder)) {
+        return false;
+    }
+
+    if (!sc_recorder_open_output_file(recorder)) {
+        // Keep the previous (closed) context, to be freed by the caller
+        recorder->ctx = previous;
+        return false;
+    }
+
+    bool ok = sc_recorder_copy_streams(recorder, previous);
+    avformat_free_context(previous);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_recorder_write_header(recorder);
+    if (!ok) {
+        return false;
+    }
+
+    recorder->segment_start = pts;
+    recorder->video_stream.last_pts = AV_NOPTS_VALUE;
+    recorder->audio_stream.last_pts = AV_NOPTS_VALUE;
+    return true;
+}
+
 static bool
 sc_recorder_process_packets(struct sc_recorder *recorder) {
     int64_t pts_origin = AV_NOPTS_VALUE;
@@ -304,12 +982,12 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
 
         while (!recorder->stopped) {
             if (recorder->video && !video_pkt &&
-                    !sc_vecdeque_is_empty(&recorder->video_queue)) {
+                    !sc_recorder_queue_is_empty(&recorder->video_queue)) {
                 // A new packet may be assigned to video_pkt and be processed
                 break;
             }
             if (recorder->audio && !audio_pkt
-                    && !sc_vecdeque_is_empty(&recorder->audio_queue)) {
+                    && !sc_recorder_queue_is_empty(&recorder->audio_queue)) {
                 // A new packet may be assigned to audio_pkt and be processed
                 break;
             }
@@ -322,24 +1000,38 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
         // If there is no video, then the video_queue will remain empty forever
         // and video_pkt will always be NULL.
         assert(recorder->video || (!video_pkt
-                && sc_vecdeque_is_empty(&recorder->video_queue)));
+                && sc_recorder_queue_is_empty(&recorder->video_queue)));
 
         // If there is no audio, then the audio_queue will remain empty forever
         // and audio_pkt will always be NULL.
         assert(recorder->audio || (!audio_pkt
-                && sc_vecdeque_is_empty(&recorder->audio_queue)));
+                && sc_recorder_queue_is_empty(&recorder->audio_queue)));
+
+        bool popped = true;
+        if (!video_pkt
+                && !sc_recorder_queue_is_empty(&recorder->video_queue)) {
+            video_pkt = sc_recorder_queue_pop(recorder,
+                                              &recorder->video_queue);
+            popped = video_pkt;
+        }
 
-        if (!video_pkt && !sc_vecdeque_is_empty(&recorder->video_queue)) {
-            video_pkt = sc_vecdeque_pop(&recorder->video_queue);
+        if (popped && !audio_pkt
+                && !sc_recorder_queue_is_empty(&recorder->audio_queue)) {
+            audio_pkt = sc_recorder_queue_pop(recorder,
+                                              &recorder->audio_queue);
+            popped = audio_pkt;
         }
 
-        if (!audio_pkt && !sc_vecdeque_is_empty(&recorder->audio_queue)) {
-            audio_pkt = sc_vecdeque_pop(&recorder->audio_queue);
+        if (!popped) {
+            sc_mutex_unlock(&recorder->mutex);
+            LOGE("Could not read recorded packet back from disk");
+            error = true;
+            goto end;
         }
 
         if (recorder->stopped && !video_pkt && !audio_pkt) {
-            assert(sc_vecdeque_is_empty(&recorder->video_queue));
-            assert(sc_vecdeque_is_empty(&recorder->audio_queue));
+            assert(sc_recorder_queue_is_empty(&recorder->video_queue));
+            assert(sc_recorder_queue_is_empty(&recorder->audio_queue));
             sc_mutex_unlock(&recorder->mutex);
             break;
         }
@@ -352,12 +1044,12 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
         // change). The next non-config packet will have the config packet
         // data prepended.
         if (video_pkt && video_pkt->pts == AV_NOPTS_VALUE) {
-            av_packet_free(&video_pkt);
+            sc_packet_pool_put(&recorder->packet_pool, video_pkt);
             video_pkt = NULL;
         }
 
         if (audio_pkt && audio_pkt->pts == AV_NOPTS_VALUE) {
-            av_packet_free(&audio_pkt);
+            sc_packet_pool_put(&recorder->packet_pool, audio_pkt);
             audio_pkt = NULL;
         }
 
@@ -398,7 +1090,7 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
                                              - video_pkt_previous->pts;
 
                 bool ok = sc_recorder_write_video(recorder, video_pkt_previous);
-                av_packet_free(&video_pkt_previous);
+                sc_packet_pool_put(&recorder->packet_pool, video_pkt_previous);
                 if (!ok) {
                     LOGE("Could not record video packet");
                     error = true;
@@ -406,6 +1098,21 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
                 }
             }
 
+            if (video_pkt->flags & AV_PKT_FLAG_KEY) {
+                // Any requested keyframe has been received
+                atomic_store(&recorder->keyframe_requested, false);
+            }
+
+            if (sc_recorder_must_start_segment(recorder, video_pkt)) {
+                bool ok = sc_recorder_start_next_segment(recorder,
+                                                         video_pkt->pts);
+                if (!ok) {
+                    LOGE("Could not start a new recording segment");
+                    error = true;
+                    goto end;
+                }
+            }
+
             video_pkt_previous = video_pkt;
             video_pkt = NULL;
         }
@@ -414,6 +1121,26 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
             audio_pkt->pts -= pts_origin;
             audio_pkt->dts = audio_pkt->pts;
 
+            if (!recorder->video
+                    && sc_recorder_must_start_segment(recorder, audio_pkt)) {
+                bool ok = sc_recorder_start_next_segment(recorder,
+                                                         audio_pkt->pts);
+                if (!ok) {
+                    LOGE("Could not start a new recording segment");
+                    error = true;
+                    goto end;
+                }
+            }
+
+            if (audio_pkt->pts < recorder->segment_start) {
+                // The packet belongs to the previous segment, which has
+                // already been written on the video keyframe
+                LOGD("Dropping audio packet before the segment start");
+                sc_packet_pool_put(&recorder->packet_pool, audio_pkt);
+                audio_pkt = NULL;
+                continue;
+            }
+
             bool ok = sc_recorder_write_audio(recorder, audio_pkt);
             if (!ok) {
                 LOGE("Could not record audio packet");
@@ -421,7 +1148,7 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
                 goto end;
             }
 
-            av_packet_free(&audio_pkt);
+            sc_packet_pool_put(&recorder->packet_pool, audio_pkt);
             audio_pkt = NULL;
         }
     }
@@ -438,21 +1165,22 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
             // will still be valid
             LOGW("Could not record last packet");
         }
-        av_packet_free(&last);
+        sc_packet_pool_put(&recorder->packet_pool, last);
     }
 
     int ret = av_write_trailer(recorder->ctx);
     if (ret < 0) {
-        LOGE("Failed to write trailer to %s", recorder->filename);
+        LOGE("Failed to write trailer to %s",
+             sc_recorder_get_current_filename(recorder));
         error = false;
     }
 
 end:
     if (video_pkt) {
-        av_packet_free(&video_pkt);
+        sc_packet_pool_put(&recorder->packet_pool, video_pkt);
     }
     if (audio_pkt) {
-        av_packet_free(&audio_pkt);
+        sc_packet_pool_put(&recorder->packet_pool, audio_pkt);
     }
 
     return !error;
@@ -460,13 +1188,24 @@ end:
 
 static bool
 sc_recorder_record(struct sc_recorder *recorder) {
+    if (recorder->segment_duration && !sc_recorder_next_segment(recorder)) {
+        return false;
+    }
+
     bool ok = sc_recorder_open_output_file(recorder);
     if (!ok) {
         return false;
     }
 
+    sc_mutex_lock(&recorder->mutex);
+    recorder->output_open = true;
+    // Wake up the packet sinks waiting to add their stream
+    sc_cond_broadcast(&recorder->cond);
+    sc_mutex_unlock(&recorder->mutex);
+
     ok = sc_recorder_process_packets(recorder);
     sc_recorder_close_output_file(recorder);
+    sc_recorder_log_stats(recorder);
     return ok;
 }
 
@@ -483,17 +1222,24 @@ run_recorder(void *data) {
     sc_mutex_lock(&recorder->mutex);
     // Prevent the producer to push any new packet
     recorder->stopped = true;
+    // The packet sinks may wait for the output file to be open
+    sc_cond_broadcast(&recorder->cond);
     // Discard pending packets
-    sc_recorder_queue_clear(&recorder->video_queue);
-    sc_recorder_queue_clear(&recorder->audio_queue);
+    sc_recorder_queue_clear(recorder, &recorder->video_queue);
+    sc_recorder_queue_clear(recorder, &recorder->audio_queue);
     sc_mutex_unlock(&recorder->mutex);
 
+    // The current segment, if segmented
+    const char *filename = sc_recorder_get_current_filename(recorder);
+    if (!filename) {
+        // Failed before the first segment
+        filename = recorder->filename;
+    }
     if (success) {
         const char *format_name = sc_recorder_get_format_name(recorder->format);
-        LOGI("Recording complete to %s file: %s", format_name,
-                                                  recorder->filename);
+        LOGI("Recording complete to %s file: %s", format_name, filename);
     } else {
-        LOGE("Recording failed to %s", recorder->filename);
+        LOGE("Recording failed to %s", filename);
     }
 
     LOGD("Recorder thread ended");
@@ -503,42 +1249,6 @@ run_recorder(void *data) {
     return 0;
 }
 
-static bool
-sc_recorder_set_orientation(AVStream *stream, enum sc_orientation orientation) {
-    assert(!sc_orientation_is_mirror(orientation));
-
-    uint8_t *raw_data;
-#ifdef SCRCPY_LAVC_HAS_CODECPAR_CODEC_SIDEDATA
-    AVPacketSideData *sd =
-        av_packet_side_data_new(&stream->codecpar->coded_side_data,
-                                &stream->codecpar->nb_coded_side_data,
-                                AV_PKT_DATA_DISPLAYMATRIX,
-                                sizeof(int32_t) * 9, 0);
-    if (!sd) {
-        LOG_OOM();
-        return false;
-    }
-
-    raw_data = sd->data;
-#else
-    raw_data = av_stream_new_side_data(stream, AV_PKT_DATA_DISPLAYMATRIX,
-                                      sizeof(int32_t) * 9);
-    if (!raw_data) {
-        LOG_OOM();
-        return false;
-    }
-#endif
-
-    int32_t *matrix = (int32_t *) raw_data;
-
-    unsigned rotation = orientation;
-    unsigned angle = rotation * 90;
-
-    av_display_rotation_set(matrix, angle);
-
-    return true;
-}
-
 static bool
 sc_recorder_video_packet_sink_open(struct sc_packet_sink *sink,
                                    AVCodecContext *ctx) {
@@ -547,6 +1257,10 @@ sc_recorder_video_packet_sink_open(struct sc_packet_sink *sink,
     assert(!recorder->video_init);
 
     sc_mutex_lock(&recorder->mutex);
+    // The stream can only be added once the output file is open
+    while (!recorder->stopped && !recorder->output_open) {
+        sc_cond_wait(&recorder->cond, &recorder->mutex);
+    }
     if (recorder->stopped) {
         sc_mutex_unlock(&recorder->mutex);
         return false;
@@ -596,6 +1310,75 @@ sc_recorder_video_packet_sink_close(struct sc_packet_sink *sink) {
     sc_mutex_unlock(&recorder->mutex);
 }
 
+static void
+sc_recorder_update_queue_depth(struct sc_recorder *recorder) {
+    sc_mutex_assert(&recorder->mutex);
+
+    sc_recorder_update_queue_stats(recorder);
+    size_t depth = sc_recorder_queue_size(&recorder->video_queue)
+                 + sc_recorder_queue_size(&recorder->audio_queue);
+    if (depth > recorder->max_queue_depth) {
+        recorder->max_queue_depth = depth;
+    }
+}
+
+// Return true if the packet must not be kept in memory
+static bool
+sc_recorder_is_over_budget(struct sc_recorder *recorder,
+                           struct sc_recorder_queue *queue,
+                           const AVPacket *packet) {
+    sc_mutex_assert(&recorder->mutex);
+
+    if (sc_recorder_queue_has_spilled(queue)) {
+        // Preserve the order
+        return true;
+    }
+
+    if (!recorder->max_queue_bytes || packet->pts == AV_NOPTS_VALUE) {
+        // Config packets are always kept in memory
+        return false;
+    }
+
+    return recorder->queue_bytes + packet->size > recorder->max_queue_bytes;
+}
+
+// Return true if the packet must be dropped, when it could not be spilled
+static bool
+sc_recorder_must_drop(struct sc_recorder *recorder, const AVPacket *packet,
+                      bool video, bool over) {
+    sc_mutex_assert(&recorder->mutex);
+
+    if (packet->pts == AV_NOPTS_VALUE) {
+        // Never drop config packets, the stream could not be decoded
+        return false;
+    }
+
+    if (video) {
+        if (recorder->video_dropping) {
+            // Once a video packet is dropped, the following ones reference
+            // it: resume on a keyframe only
+            if (over || !(packet->flags & AV_PKT_FLAG_KEY)) {
+                if (!over) {
+                    // The queue is not full anymore
+                    sc_recorder_request_keyframe(recorder);
+                }
+                return true;
+            }
+            recorder->video_dropping = false;
+            return false;
+        }
+        if (over) {
+            recorder->video_dropping = true;
+        }
+    }
+
+    if (over && !recorder->dropped_packets) {
+        LOGW("Recording queue over the memory budget, dropping packets");
+    }
+
+    return over;
+}
+
 static bool
 sc_recorder_video_packet_sink_push(struct sc_packet_sink *sink,
                                    const AVPacket *packet) {
@@ -611,22 +1394,43 @@ sc_recorder_video_packet_sink_push(struct sc_packet_sink *sink,
         return false;
     }
 
-    AVPacket *rec = sc_recorder_packet_ref(packet);
+    struct sc_recorder_queue *queue = &recorder->video_queue;
+    int stream_index = recorder->video_stream.index;
+
+    bool over = sc_recorder_is_over_budget(recorder, queue, packet);
+    if (over && sc_recorder_spill(recorder, queue, packet, stream_index)) {
+        sc_recorder_update_queue_depth(recorder);
+        sc_cond_signal(&recorder->cond);
+        sc_mutex_unlock(&recorder->mutex);
+        return true;
+    }
+
+    if (sc_recorder_must_drop(recorder, packet, true, over)) {
+        ++recorder->dropped_packets;
+        sc_mutex_unlock(&recorder->mutex);
+        return true;
+    }
+
+    AVPacket *rec = sc_packet_pool_ref(&recorder->packet_pool, packet);
     if (!rec) {
         LOG_OOM();
         sc_mutex_unlock(&recorder->mutex);
         return false;
     }
 
-    rec->stream_index = recorder->video_stream.index;
+    rec->stream_index = stream_index;
 
-    bool ok = sc_vecdeque_push(&recorder->video_queue, rec);
+    bool ok = sc_vecdeque_push(&queue->packets, rec);
     if (!ok) {
         LOG_OOM();
         sc_mutex_unlock(&recorder->mutex);
         return false;
     }
 
+    recorder->queue_bytes += rec->size;
+
+    sc_recorder_update_queue_depth(recorder);
+
     sc_cond_signal(&recorder->cond);
 
     sc_mutex_unlock(&recorder->mutex);
@@ -642,6 +1446,14 @@ sc_recorder_audio_packet_sink_open(struct sc_packet_sink *sink,
     assert(!recorder->audio_init);
 
     sc_mutex_lock(&recorder->mutex);
+    // The stream can only be added once the output file is open
+    while (!recorder->stopped && !recorder->output_open) {
+        sc_cond_wait(&recorder->cond, &recorder->mutex);
+    }
+    if (recorder->stopped) {
+        sc_mutex_unlock(&recorder->mutex);
+        return false;
+    }
 
     AVStream *stream = avformat_new_stream(recorder->ctx, ctx->codec);
     if (!stream) {
@@ -698,22 +1510,43 @@ sc_recorder_audio_packet_sink_push(struct sc_packet_sink *sink,
         return false;
     }
 
-    AVPacket *rec = sc_recorder_packet_ref(packet);
+    struct sc_recorder_queue *queue = &recorder->audio_queue;
+    int stream_index = recorder->audio_stream.index;
+
+    bool over = sc_recorder_is_over_budget(recorder, queue, packet);
+    if (over && sc_recorder_spill(recorder, queue, packet, stream_index)) {
+        sc_recorder_update_queue_depth(recorder);
+        sc_cond_signal(&recorder->cond);
+        sc_mutex_unlock(&recorder->mutex);
+        return true;
+    }
+
+    if (sc_recorder_must_drop(recorder, packet, false, over)) {
+        ++recorder->dropped_packets;
+        sc_mutex_unlock(&recorder->mutex);
+        return true;
+    }
+
+    AVPacket *rec = sc_packet_pool_ref(&recorder->packet_pool, packet);
     if (!rec) {
         LOG_OOM();
         sc_mutex_unlock(&recorder->mutex);
         return false;
     }
 
-    rec->stream_index = recorder->audio_stream.index;
+    rec->stream_index = stream_index;
 
-    bool ok = sc_vecdeque_push(&recorder->audio_queue, rec);
+    bool ok = sc_vecdeque_push(&queue->packets, rec);
     if (!ok) {
         LOG_OOM();
         sc_mutex_unlock(&recorder->mutex);
         return false;
     }
 
+    recorder->queue_bytes += rec->size;
+
+    sc_recorder_update_queue_depth(recorder);
+
     sc_cond_signal(&recorder->cond);
 
     sc_mutex_unlock(&recorder->mutex);
@@ -744,8 +1577,9 @@ sc_recorder_stream_init(struct sc_recorder_stream *stream) {
 
 bool
 sc_recorder_init(struct sc_recorder *recorder, const char *filename,
-                 enum sc_record_format format, bool video, bool audio,
-                 enum sc_orientation orientation,
+                 enum sc_record_format format, size_t buffer_size,
+                 sc_tick segment_duration, unsigned segment_keep, bool video,
+                 bool audio, enum sc_orientation orientation,
                  const struct sc_recorder_callbacks *cbs, void *cbs_userdata) {
     assert(!sc_orientation_is_mirror(orientation));
 
@@ -765,15 +1599,21 @@ sc_recorder_init(struct sc_recorder *recorder, const char *filename,
         goto error_mutex_destroy;
     }
 
+    ok = sc_packet_pool_init(&recorder->packet_pool);
+    if (!ok) {
+        goto error_cond_destroy;
+    }
+
     assert(video || audio);
     recorder->video = video;
     recorder->audio = audio;
 
     recorder->orientation = orientation;
 
-    sc_vecdeque_init(&recorder->video_queue);
-    sc_vecdeque_init(&recorder->audio_queue);
+    sc_recorder_queue_init(&recorder->video_queue);
+    sc_recorder_queue_init(&recorder->audio_queue);
     recorder->stopped = false;
+    recorder->output_open = false;
 
     recorder->video_init = false;
     recorder->audio_init = false;
@@ -784,6 +1624,29 @@ sc_recorder_init(struct sc_recorder *recorder, const char *filename,
     sc_recorder_stream_init(&recorder->audio_stream);
 
     recorder->format = format;
+    recorder->buffer_size = buffer_size;
+    recorder->file_pb = NULL;
+    recorder->bytes_written = 0;
+    recorder->write_count = 0;
+    recorder->write_time = 0;
+    recorder->max_queue_depth = 0;
+    recorder->dropped_packets = 0;
+    recorder->spilled_packets = 0;
+    recorder->max_queue_bytes = 0;
+    recorder->queue_bytes = 0;
+    recorder->video_dropping = false;
+    recorder->spill_failed = false;
+    recorder->index = false;
+    recorder->index_file = NULL;
+    atomic_init(&recorder->pending_markers, 0);
+    atomic_init(&recorder->keyframe_requested, false);
+
+    recorder->segment_duration = segment_duration;
+    recorder->segment_keep = segment_keep;
+    recorder->segment_index = 0;
+    recorder->segment_start = 0;
+    recorder->segment_filename = NULL;
+    sc_vecdeque_init(&recorder->segments);
 
     assert(cbs && cbs->on_ended);
     recorder->cbs = cbs;
@@ -812,6 +1675,8 @@ sc_recorder_init(struct sc_recorder *recorder, const char *filename,
 
     return true;
 
+error_cond_destroy:
+    sc_cond_destroy(&recorder->cond);
 error_mutex_destroy:
     sc_mutex_destroy(&recorder->mutex);
 error_free_filename:
@@ -820,6 +1685,25 @@ error_free_filename:
     return false;
 }
 
+void
+sc_recorder_set_max_queue_bytes(struct sc_recorder *recorder,
+                                size_t max_queue_bytes) {
+    recorder->max_queue_bytes = max_queue_bytes;
+}
+
+void
+sc_recorder_enable_index(struct sc_recorder *recorder) {
+    recorder->index = true;
+}
+
+void
+sc_recorder_add_marker(struct sc_recorder *recorder) {
+    assert(recorder->index);
+
+    atomic_fetch_add_explicit(&recorder->pending_markers, 1,
+                              memory_order_relaxed);
+}
+
 bool
 sc_recorder_start(struct sc_recorder *recorder) {
     bool ok = sc_thread_create(&recorder->thread, run_recorder,
@@ -847,6 +1731,12 @@ sc_recorder_join(struct sc_recorder *recorder) {
 
 void
 sc_recorder_destroy(struct sc_recorder *recorder) {
+    sc_recorder_queue_destroy(&recorder->video_queue);
+    sc_recorder_queue_destroy(&recorder->audio_queue);
+    sc_recorder_segments_clear(&recorder->segments);
+    sc_vecdeque_destroy(&recorder->segments);
+    free(recorder->segment_filename);
+    sc_packet_pool_destroy(&recorder->packet_pool);
     sc_cond_destroy(&recorder->cond);
     sc_mutex_destroy(&recorder->mutex);
     free(recorder->filename);
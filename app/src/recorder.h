@@ -3,17 +3,39 @@
 
 #include "common.h"
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <libavcodec/packet.h>
 #include <libavformat/avformat.h>
 
+#include "av_pool.h"
 #include "options.h"
 #include "trait/packet_sink.h"
+#include "util/spill_log.h"
 #include "util/thread.h"
 #include "util/vecdeque.h"
 
-struct sc_recorder_queue SC_VECDEQUE(AVPacket *);
+// Memory kept by the queued packets when no budget is set (--max-memory)
+#define SC_RECORDER_DEFAULT_MAX_QUEUE_BYTES ((size_t) 64 * 1024 * 1024)
+
+struct sc_recorder_packets SC_VECDEQUE(AVPacket *);
+
+/**
+ * Packets waiting to be written
+ *
+ * Over the memory budget, the packets are appended to a spill file, and read
+ * back in order once the packets in memory have been written.
+ */
+struct sc_recorder_queue {
+    struct sc_recorder_packets packets;
+    // Once a packet is spilled, the following ones are spilled too until the
+    // spill file is drained, to preserve the order
+    struct sc_spill_log spill;
+    bool spill_initialized;
+};
+struct sc_recorder_segments SC_VECDEQUE(char *);
 
 struct sc_recorder_stream {
     int index;
@@ -41,6 +63,48 @@ struct sc_recorder {
     enum sc_record_format format;
     AVFormatContext *ctx;
 
+    // Duration of each segment file (0 to record a single file)
+    sc_tick segment_duration;
+    // Number of segment files to keep (0 to keep all)
+    unsigned segment_keep;
+    // Only accessed from the recorder thread
+    unsigned segment_index;
+    int64_t segment_start; // pts of the first packet of the current segment
+    char *segment_filename; // the file currently written (if segmented)
+    struct sc_recorder_segments segments; // oldest first, if segment_keep
+
+    // Size of the write buffer (0 for the default AVIO buffer)
+    size_t buffer_size;
+    // Unbuffered file context, written by the buffered ctx->pb (only if
+    // buffer_size is not 0)
+    AVIOContext *file_pb;
+
+    // Recording statistics, reported at the end of the recording
+    uint64_t bytes_written; // only if buffer_size is not 0
+    uint64_t write_count; // only if buffer_size is not 0
+    sc_tick write_time; // only if buffer_size is not 0
+    size_t max_queue_depth; // protected by mutex
+    uint64_t dropped_packets; // protected by mutex
+    uint64_t spilled_packets; // protected by mutex
+
+    // Memory budget of the queues (0 for unlimited)
+    size_t max_queue_bytes;
+    size_t queue_bytes; // protected by mutex
+    // If the packets could not be spilled to disk, they are dropped: the video
+    // packets until the next keyframe
+    bool video_dropping; // protected by mutex
+    bool spill_failed; // protected by mutex
+
+    // Write a sidecar index along with each recording file (--record-index)
+    bool index;
+    FILE *index_file; // only accessed from the recorder thread
+    // Markers requested by sc_recorder_add_marker(), not written yet
+    atomic_uint pending_markers;
+
+    // Set when a keyframe is requested, reset on the next video keyframe (to
+    // request only once per keyframe)
+    atomic_bool keyframe_requested;
+
     sc_thread thread;
     sc_mutex mutex;
     sc_cond cond;
@@ -48,6 +112,11 @@ struct sc_recorder {
     bool stopped;
     struct sc_recorder_queue video_queue;
     struct sc_recorder_queue audio_queue;
+    struct sc_packet_pool packet_pool;
+
+    // Set once the output file is open, the streams may then be added from
+    // the packet sinks open() (protected by mutex)
+    bool output_open;
 
     // wake up the recorder thread once the video or audio codec is known
     bool video_init;
@@ -65,14 +134,57 @@ struct sc_recorder {
 struct sc_recorder_callbacks {
     void (*on_ended)(struct sc_recorder *recorder, bool success,
                      void *userdata);
+
+    // Optional: called (from any recorder thread) when the recorder needs a
+    // keyframe before the next periodic one (to start a new segment, or to
+    // resume after dropping video packets). If NULL, the recorder just waits.
+    void (*on_keyframe_needed)(struct sc_recorder *recorder, void *userdata);
 };
 
 bool
 sc_recorder_init(struct sc_recorder *recorder, const char *filename,
-                 enum sc_record_format format, bool video, bool audio,
-                 enum sc_orientation orientation,
+                 enum sc_record_format format, size_t buffer_size,
+                 sc_tick segment_duration, unsigned segment_keep, bool video,
+                 bool audio, enum sc_orientation orientation,
                  const struct sc_recorder_callbacks *cbs, void *cbs_userdata);
 
+/**
+ * Limit the memory held by the packets waiting to be written
+ *
+ * Over the budget, packets are spilled to a temporary file, and read back in
+ * order when the recorder catches up. If the file could not be written,
+ * packets are dropped (the recording is then incomplete but still playable).
+ * Must be called before sc_recorder_start().
+ *
+ * \param max_queue_bytes the budget, or 0 for unlimited (the default)
+ */
+void
+sc_recorder_set_max_queue_bytes(struct sc_recorder *recorder,
+                                size_t max_queue_bytes);
+
+/**
+ * Write a sidecar index along with each recording file
+ *
+ * The index "<file>.index" is a text file listing, for each video keyframe
+ * and each marker (see sc_recorder_add_marker()), its PTS (in microseconds,
+ * relative to the file) and a byte offset in the file from which to scan to
+ * reach its data. It allows to seek in a long recording without reading the
+ * whole file.
+ *
+ * Must be called before sc_recorder_start().
+ */
+void
+sc_recorder_enable_index(struct sc_recorder *recorder);
+
+/**
+ * Add a marker to the recording index at the current position
+ *
+ * The marker is written along with the next recorded packet. Callable from any
+ * thread.
+ */
+void
+sc_recorder_add_marker(struct sc_recorder *recorder);
+
 bool
 sc_recorder_start(struct sc_recorder *recorder);
 
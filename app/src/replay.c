@@ -0,0 +1,311 @@
+#include "replay.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <SDL2/SDL.h>
+
+#include "decoder.h"
+#include "delay_buffer.h"
+#include "demuxer.h"
+#include "events.h"
+#include "latency.h"
+#include "recorder.h"
+#include "screen.h"
+#include "util/log.h"
+
+struct scrcpy_replay {
+    struct sc_screen screen;
+    struct sc_demuxer demuxer;
+    struct sc_decoder decoder;
+    struct sc_delay_buffer video_buffer;
+    struct sc_recorder recorder;
+    struct sc_latency latency;
+};
+
+static void
+sc_replay_demuxer_on_ended(struct sc_demuxer *demuxer,
+                           enum sc_demuxer_status status, void *userdata) {
+    (void) demuxer;
+    (void) userdata;
+
+    if (status == SC_DEMUXER_STATUS_EOS) {
+        // End of the replayed stream
+        sc_push_event(SC_EVENT_DEVICE_DISCONNECTED);
+    } else {
+        sc_push_event(SC_EVENT_DEMUXER_ERROR);
+    }
+}
+
+static void
+sc_replay_recorder_on_ended(struct sc_recorder *recorder, bool success,
+                            void *userdata) {
+    (void) recorder;
+    (void) userdata;
+
+    if (!success) {
+        sc_push_event(SC_EVENT_RECORDER_ERROR);
+    }
+}
+
+static enum scrcpy_exit_code
+event_loop(struct scrcpy_replay *s, bool has_screen) {
+    SDL_Event event;
+    while (SDL_WaitEvent(&event)) {
+        switch (event.type) {
+            case SC_EVENT_DEVICE_DISCONNECTED:
+                LOGI("End of replay");
+                return SCRCPY_EXIT_SUCCESS;
+            case SC_EVENT_DEMUXER_ERROR:
+                LOGE("Demuxer error");
+                return SCRCPY_EXIT_FAILURE;
+            case SC_EVENT_RECORDER_ERROR:
+                LOGE("Recorder error");
+                return SCRCPY_EXIT_FAILURE;
+            case SDL_QUIT:
+                LOGD("User requested to quit");
+                return SCRCPY_EXIT_SUCCESS;
+            case SC_EVENT_RUN_ON_MAIN_THREAD: {
+                sc_runnable_fn run = event.user.data1;
+                void *userdata = event.user.data2;
+                run(userdata);
+                break;
+            }
+            default:
+                if (has_screen && !sc_screen_handle_event(&s->screen, &event)) {
+                    return SCRCPY_EXIT_FAILURE;
+                }
+                break;
+        }
+    }
+    return SCRCPY_EXIT_FAILURE;
+}
+
+static void
+terminate_event_loop(void) {
+    sc_reject_new_runnables();
+
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+        if (event.type == SC_EVENT_RUN_ON_MAIN_THREAD) {
+            // Make sure all posted runnables are run, to avoid memory leaks
+            sc_runnable_fn run = event.user.data1;
+            void *userdata = event.user.data2;
+            run(userdata);
+        }
+    }
+}
+
+enum scrcpy_exit_code
+scrcpy_replay(struct scrcpy_options *options) {
+    static struct scrcpy_replay scrcpy_replay;
+    struct scrcpy_replay *s = &scrcpy_replay;
+
+    // The replayed stream contains only the video, and there is no device
+    assert(options->replay);
+    assert(!options->audio);
+    assert(!options->control);
+
+    if (options->render_driver
+            && !SDL_SetHint(SDL_HINT_RENDER_DRIVER, options->render_driver)) {
+        LOGW("Could not set render driver");
+    }
+
+    if (!SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1")) {
+        LOGW("Could not enable linear filtering");
+    }
+
+    if (SDL_Init(SDL_INIT_EVENTS)) {
+        LOGE("Could not initialize SDL: %s", SDL_GetError());
+        return SCRCPY_EXIT_FAILURE;
+    }
+
+    atexit(SDL_Quit);
+
+    if (options->video_playback && SDL_Init(SDL_INIT_VIDEO)) {
+        LOGE("Could not initialize SDL video: %s", SDL_GetError());
+        return SCRCPY_EXIT_FAILURE;
+    }
+
+    enum scrcpy_exit_code ret = SCRCPY_EXIT_FAILURE;
+
+    bool latency_initialized = false;
+    bool screen_initialized = false;
+    bool demuxer_initialized = false;
+    bool demuxer_started = false;
+    bool recorder_initialized = false;
+    bool recorder_started = false;
+
+    FILE *file = fopen(options->replay, "rb");
+    if (!file) {
+        LOGE("Could not open replay file: %s", options->replay);
+        return SCRCPY_EXIT_FAILURE;
+    }
+
+    if (options->print_latency) {
+        if (!sc_latency_init(&s->latency)) {
+            goto end;
+        }
+        latency_initialized = true;
+    }
+
+    if (options->video_playback) {
+        struct sc_screen_params screen_params = {
+            .video = true,
+            .controller = NULL,
+            .fp = NULL,
+            .kp = NULL,
+            .mp = NULL,
+            .gp = NULL,
+            .mouse_bindings = options->mouse_bindings,
+            .legacy_paste = options->legacy_paste,
+            .clipboard_autosync = false,
+            .shortcut_mods = options->shortcut_mods,
+            .window_title = options->window_title ? options->window_title
+                                                  : options->replay,
+            .always_on_top = options->always_on_top,
+            .window_x = options->window_x,
+            .window_y = options->window_y,
+            .window_width = options->window_width,
+            .window_height = options->window_height,
+            .window_borderless = options->window_borderless,
+            .orientation = options->display_orientation,
+            .downscale_filter = options->downscale_filter,
+            .texture_damage = options->texture_damage,
+            .screenshot_gpu_readback = options->screenshot_gpu_readback,
+            .screenshot_format = options->screenshot_format,
+            .screenshot_png_level = options->screenshot_png_level,
+            .frame_pacing = options->frame_pacing,
+            .latency = latency_initialized ? &s->latency : NULL,
+            .input_latency = NULL,
+            .fullscreen = options->fullscreen,
+            .start_fps_counter = options->start_fps_counter,
+        };
+
+        if (!sc_screen_init(&s->screen, &screen_params)) {
+            goto end;
+        }
+        screen_initialized = true;
+        sc_screen_set_connection_state(&s->screen,
+                                       SC_SCREEN_CONNECTION_RUNNING);
+    }
+
+    static const struct sc_demuxer_callbacks demuxer_cbs = {
+        .on_ended = sc_replay_demuxer_on_ended,
+    };
+    if (!sc_demuxer_init_replay(&s->demuxer, "video", file,
+                                !options->replay_unthrottled, &demuxer_cbs,
+                                NULL)) {
+        goto end;
+    }
+    demuxer_initialized = true;
+
+    if (options->video_playback) {
+        if (latency_initialized) {
+            // Added before the decoder, to stamp the packets on reception
+            sc_packet_source_add_sink(&s->demuxer.packet_source,
+                                      &s->latency.packet_sink);
+        }
+
+        bool hw = options->video_decoder == SC_VIDEO_DECODER_HW;
+        sc_decoder_init(&s->decoder, "video", hw, options->decoder_threads,
+                        NULL, NULL);
+
+        struct sc_packet_source *packets = &s->demuxer.packet_source;
+        if (options->video_buffer_packets) {
+            assert(options->video_buffer);
+            sc_delay_buffer_init(&s->video_buffer, options->video_buffer,
+                                 true);
+            sc_packet_source_add_sink(packets, &s->video_buffer.packet_sink);
+            packets = &s->video_buffer.packet_source;
+        }
+        sc_packet_source_add_sink(packets, &s->decoder.packet_sink);
+
+        struct sc_frame_source *frames = &s->decoder.frame_source;
+        if (latency_initialized) {
+            sc_frame_source_add_sink(frames, &s->latency.frame_sink);
+        }
+        if (options->video_buffer && !options->video_buffer_packets) {
+            sc_delay_buffer_init(&s->video_buffer, options->video_buffer,
+                                 true);
+            sc_frame_source_add_sink(frames, &s->video_buffer.frame_sink);
+            frames = &s->video_buffer.frame_source;
+        }
+        sc_frame_source_add_sink(frames, &s->screen.frame_sink);
+    }
+
+    if (options->record_filename) {
+        static const struct sc_recorder_callbacks recorder_cbs = {
+            .on_ended = sc_replay_recorder_on_ended,
+        };
+        if (!sc_recorder_init(&s->recorder, options->record_filename,
+                              options->record_format, options->record_buffer,
+                              options->record_segment, options->record_keep,
+                              true, false, options->record_orientation,
+                              &recorder_cbs, NULL)) {
+            goto end;
+        }
+        recorder_initialized = true;
+
+        if (!sc_recorder_start(&s->recorder)) {
+            goto end;
+        }
+        recorder_started = true;
+
+        sc_packet_source_add_sink(&s->demuxer.packet_source,
+                                  &s->recorder.video_packet_sink);
+    }
+
+    if (!sc_demuxer_start(&s->demuxer)) {
+        goto end;
+    }
+    demuxer_started = true;
+
+    ret = event_loop(s, screen_initialized);
+    terminate_event_loop();
+    LOGD("quit...");
+
+    if (screen_initialized) {
+        sc_screen_hide_window(&s->screen);
+    }
+
+end:
+    if (demuxer_started) {
+        sc_demuxer_stop(&s->demuxer);
+    }
+    if (recorder_initialized) {
+        sc_recorder_stop(&s->recorder);
+    }
+    if (screen_initialized) {
+        sc_screen_interrupt(&s->screen);
+    }
+
+    if (demuxer_started) {
+        sc_demuxer_join(&s->demuxer);
+    }
+    if (demuxer_initialized) {
+        sc_demuxer_destroy(&s->demuxer);
+    }
+
+    if (recorder_started) {
+        sc_recorder_join(&s->recorder);
+    }
+    if (recorder_initialized) {
+        sc_recorder_destroy(&s->recorder);
+    }
+
+    if (screen_initialized) {
+        sc_screen_join(&s->screen);
+        sc_screen_destroy(&s->screen);
+    }
+
+    if (latency_initialized) {
+        sc_latency_print(&s->latency);
+        sc_latency_destroy(&s->latency);
+    }
+
+    fclose(file);
+
+    return ret;
+}
@@ -0,0 +1,13 @@
+#ifndef SC_REPLAY_H
+#define SC_REPLAY_H
+
+#include "common.h"
+
+#include "options.h"
+#include "scrcpy.h"
+
+// Play a video stream dumped by --dump-stream, without any device
+enum scrcpy_exit_code
+scrcpy_replay(struct scrcpy_options *options);
+
+#endif
@@ -16,7 +16,10 @@
 #endif
 
 #include "adb/adb.h"
+#include "adb/adb_tracker.h"
 #include "audio_player.h"
+#include "bridge_clip.h"
+#include "bridge_stream.h"
 #include "controller.h"
 #include "decoder.h"
 #include "delay_buffer.h"
@@ -24,13 +27,22 @@
 #include "events.h"
 #include "file_pusher.h"
 #include "keyboard_sdk.h"
+#include "input_latency.h"
+#include "instant_replay.h"
+#include "latency.h"
+#include "latency_probe.h"
 #include "mouse_sdk.h"
+#include "mux.h"
 #include "recorder.h"
 #include "screen.h"
 #include "server.h"
+#include "session_cache.h"
+#include "transcoder.h"
+#include "udp_video.h"
 #include "uhid/gamepad_uhid.h"
 #include "uhid/keyboard_uhid.h"
 #include "uhid/mouse_uhid.h"
+#include "video_feedback.h"
 #ifdef HAVE_USB
 # include "usb/aoa_hid.h"
 # include "usb/gamepad_aoa.h"
@@ -46,6 +58,12 @@
 #ifdef HAVE_V4L2
 # include "v4l2_sink.h"
 #endif
+#ifdef HAVE_SHM_SINK
+# include "shm_sink.h"
+#endif
+#ifdef __APPLE__
+# include "sys/darwin/iosurface_sink.h"
+#endif
 
 struct scrcpy {
     struct sc_server server;
@@ -53,15 +71,34 @@ struct scrcpy {
     struct sc_audio_player audio_player;
     struct sc_demuxer video_demuxer;
     struct sc_demuxer audio_demuxer;
+    struct sc_udp_video udp_video;
     struct sc_decoder video_decoder;
+    // Hardware decoding device, kept across reconnections
+    AVBufferRef *video_hw_device;
     struct sc_decoder audio_decoder;
     struct sc_recorder recorder;
+    struct sc_transcoder transcoder;
     struct sc_delay_buffer video_buffer;
+    struct sc_av_sync av_sync;
+    struct sc_latency latency;
+    struct sc_input_latency input_latency;
+    struct sc_latency_probe latency_probe;
+    struct sc_video_feedback video_feedback;
+    struct sc_bridge_stream bridge_stream;
+    struct sc_bridge_clip bridge_clip;
+    struct sc_instant_replay instant_replay;
 #ifdef HAVE_V4L2
     struct sc_v4l2_sink v4l2_sink;
     struct sc_delay_buffer v4l2_buffer;
+#endif
+#ifdef HAVE_SHM_SINK
+    struct sc_shm_sink shm_sink;
+#endif
+#ifdef __APPLE__
+    struct sc_iosurface_sink iosurface_sink;
 #endif
     struct sc_controller controller;
+    struct sc_mux mux;
     struct sc_file_pusher file_pusher;
 #ifdef HAVE_USB
     struct sc_usb usb;
@@ -91,6 +128,13 @@ struct scrcpy {
 #endif
     };
     struct sc_timeout timeout;
+    // Track the device while reconnecting, to retry as soon as it reappears
+    struct sc_adb_tracker adb_tracker;
+    // Serial of the device to reconnect to (owned)
+    char *device_serial;
+    // Whether the device is listed by the adb server (written by the tracker
+    // thread, true if unknown)
+    atomic_bool device_available;
 };
 
 struct sc_secure_content_monitor {
@@ -104,6 +148,10 @@ struct sc_secure_content_monitor {
 
 #define SC_SECURE_CONTENT_POLL_INTERVAL_MS 1200
 
+// Delay before reconnecting, doubled on each failed attempt
+#define SC_RECONNECT_DELAY_MIN_MS 100
+#define SC_RECONNECT_DELAY_MAX_MS 1000
+
 static bool
 sc_push_secure_content_event(bool detected) {
     SDL_Event event = {
@@ -355,26 +403,76 @@ terminate_event_loop(void) {
     }
 }
 
+static void
+sc_adb_tracker_on_devices(struct sc_adb_tracker *tracker,
+                          struct sc_vec_adb_devices *devices, void *userdata) {
+    (void) tracker;
+    struct scrcpy *s = userdata;
+
+    bool available = false;
+    for (size_t i = 0; i < devices->size; ++i) {
+        const struct sc_adb_device *device = &devices->data[i];
+        if (!strcmp(device->serial, s->device_serial)
+                && !strcmp(device->state, "device")) {
+            available = true;
+            break;
+        }
+    }
+
+    atomic_store_explicit(&s->device_available, available,
+                          memory_order_relaxed);
+    sc_push_event(SC_EVENT_ADB_DEVICES_CHANGED);
+}
+
+static void
+sc_adb_tracker_on_ended(struct sc_adb_tracker *tracker, void *userdata) {
+    (void) tracker;
+    struct scrcpy *s = userdata;
+
+    // The availability is unknown, fall back to retrying periodically
+    atomic_store_explicit(&s->device_available, true, memory_order_relaxed);
+    sc_push_event(SC_EVENT_ADB_DEVICES_CHANGED);
+}
+
 static bool
 wait_retry_delay(struct scrcpy *s, bool has_screen, uint32_t delay_ms) {
     uint64_t deadline = SDL_GetTicks64() + delay_ms;
+    bool device_lost = false;
 
     for (;;) {
+        bool available = atomic_load_explicit(&s->device_available,
+                                              memory_order_relaxed);
+        if (!available) {
+            device_lost = true;
+        }
+
         uint64_t now = SDL_GetTicks64();
-        if (now >= deadline) {
+        if (available && (device_lost || now >= deadline)) {
+            // If the device had disappeared, retry as soon as it is back
             return true;
         }
 
         SDL_Event event;
-        uint32_t timeout = (uint32_t) (deadline - now);
-        if (!SDL_WaitEventTimeout(&event, timeout)) {
-            // timeout
-            return true;
+        if (!available) {
+            // Do not poll, the tracker notifies when the device reappears
+            if (!SDL_WaitEvent(&event)) {
+                LOGE("Could not wait for event: %s", SDL_GetError());
+                return false;
+            }
+        } else {
+            uint32_t timeout = (uint32_t) (deadline - now);
+            if (!SDL_WaitEventTimeout(&event, timeout)) {
+                // timeout
+                return true;
+            }
         }
 
         switch (event.type) {
             case SDL_QUIT:
                 return false;
+            case SC_EVENT_ADB_DEVICES_CHANGED:
+                // The availability is checked on the next iteration
+                break;
             case SC_EVENT_RUN_ON_MAIN_THREAD: {
                 sc_runnable_fn run = event.user.data1;
                 void *userdata = event.user.data2;
@@ -465,6 +563,46 @@ sc_audio_demuxer_on_ended(struct sc_demuxer *demuxer,
     }
 }
 
+static bool
+sc_request_sync_frame(struct sc_controller *controller) {
+    // Request a keyframe from the running encoder, without restarting the
+    // capture
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_REQUEST_SYNC_FRAME;
+
+    if (!sc_controller_push_msg(controller, &msg)) {
+        LOGW("Could not request a new keyframe");
+        return false;
+    }
+
+    return true;
+}
+
+static void
+sc_video_demuxer_on_packets_lost(struct sc_demuxer *demuxer, void *userdata) {
+    (void) demuxer;
+
+    struct sc_controller *controller = userdata;
+    sc_request_sync_frame(controller);
+}
+
+static bool
+sc_video_decoder_on_keyframe_needed(struct sc_decoder *decoder,
+                                    void *userdata) {
+    (void) decoder;
+
+    struct sc_controller *controller = userdata;
+    return sc_request_sync_frame(controller);
+}
+
+static void
+sc_recorder_on_keyframe_needed(struct sc_recorder *recorder, void *userdata) {
+    (void) recorder;
+
+    struct sc_controller *controller = userdata;
+    sc_request_sync_frame(controller);
+}
+
 static void
 sc_controller_on_ended(struct sc_controller *controller, bool error,
                        void *userdata) {
@@ -538,6 +676,26 @@ init_sdl_gamepads(void) {
     }
 }
 
+// Opening the audio backend and enumerating the HID devices take a noticeable
+// part of the startup time, but are not needed before the device is
+// connected: they are initialized while the server is pushed and started.
+static bool
+init_sdl_deferred_subsystems(const struct scrcpy_options *options) {
+    if (options->audio_playback && SDL_Init(SDL_INIT_AUDIO)) {
+        LOGE("Could not initialize SDL audio: %s", SDL_GetError());
+        return false;
+    }
+
+    if (options->control
+            && options->gamepad_input_mode != SC_GAMEPAD_INPUT_MODE_DISABLED
+            && SDL_Init(SDL_INIT_GAMECONTROLLER)) {
+        LOGE("Could not initialize SDL gamepad: %s", SDL_GetError());
+        return false;
+    }
+
+    return true;
+}
+
 static void
 set_waiting_window_title(struct scrcpy *s, const struct scrcpy_options *options) {
     if (!options->window) {
@@ -556,6 +714,60 @@ set_waiting_window_title(struct scrcpy *s, const struct scrcpy_options *options)
     }
 }
 
+// Return whether the decoded video frames are consumed by other components
+// than the screen
+static bool
+scrcpy_has_other_video_frame_sinks(const struct scrcpy_options *options) {
+    // The transcoder re-encodes the decoded frames
+    bool has = options->record_transcode;
+#ifdef HAVE_V4L2
+    has |= !!options->v4l2_device;
+#endif
+    has |= !!options->shm_sink;
+#ifdef __APPLE__
+    has |= options->iosurface_sink;
+#endif
+    return has;
+}
+
+static bool
+scrcpy_needs_video_decoder(const struct scrcpy_options *options) {
+    return options->video_playback
+        || scrcpy_has_other_video_frame_sinks(options);
+}
+
+// Write the video codecs which the client can handle, from the most to the
+// least efficient, for the server to select the first one it can encode
+static void
+scrcpy_list_negotiable_video_codecs(const struct scrcpy_options *options,
+                                    char *buf, size_t len) {
+    static const struct {
+        enum AVCodecID id;
+        const char *name;
+    } codecs[] = {
+        {AV_CODEC_ID_AV1, "av1"},
+        {AV_CODEC_ID_HEVC, "h265"},
+    };
+
+    bool decode = scrcpy_needs_video_decoder(options);
+    bool hw = options->video_decoder == SC_VIDEO_DECODER_HW;
+
+    size_t pos = 0;
+    for (size_t i = 0; i < ARRAY_LEN(codecs); ++i) {
+        // Without decoding, the packets are only recorded (or forwarded)
+        if (!decode || (hw && sc_decoder_probe_hw(codecs[i].id))) {
+            int r = snprintf(buf + pos, len - pos, "%s,", codecs[i].name);
+            assert(r > 0 && (size_t) r < len - pos);
+            pos += r;
+        }
+    }
+
+    // H.264 is always supported, by the software decoder if necessary
+    int r = snprintf(buf + pos, len - pos, "h264");
+    assert(r > 0 && (size_t) r < len - pos);
+    (void) r;
+}
+
 enum scrcpy_exit_code
 scrcpy(struct scrcpy_options *options) {
     static struct scrcpy scrcpy;
@@ -599,18 +811,34 @@ scrcpy(struct scrcpy_options *options) {
         }
     }
 
-    if (options->audio_playback && SDL_Init(SDL_INIT_AUDIO)) {
-        LOGE("Could not initialize SDL audio: %s", SDL_GetError());
-        return ret;
+    // The audio and gamepad subsystems are initialized once the server is
+    // started (see init_sdl_deferred_subsystems())
+    bool sdl_deferred_initialized = false;
+
+    sdl_configure(options->video_playback, options->disable_screensaver);
+
+    bool latency_initialized = false;
+    if (options->print_latency) {
+        if (!sc_latency_init(&s->latency)) {
+            return ret;
+        }
+        latency_initialized = true;
     }
 
-    if (options->gamepad_input_mode != SC_GAMEPAD_INPUT_MODE_DISABLED
-            && SDL_Init(SDL_INIT_GAMECONTROLLER)) {
-        LOGE("Could not initialize SDL gamepad: %s", SDL_GetError());
-        return ret;
+    bool input_latency_initialized = false;
+    if (options->measure_input_latency) {
+        if (!sc_input_latency_init(&s->input_latency)) {
+            if (latency_initialized) {
+                sc_latency_destroy(&s->latency);
+            }
+            return ret;
+        }
+        input_latency_initialized = true;
     }
 
-    sdl_configure(options->video_playback, options->disable_screensaver);
+    if (options->latency_probe) {
+        sc_latency_probe_init(&s->latency_probe);
+    }
 
     bool screen_initialized = false;
     if (options->window) {
@@ -634,18 +862,58 @@ scrcpy(struct scrcpy_options *options) {
             .window_height = options->window_height,
             .window_borderless = options->window_borderless,
             .orientation = options->display_orientation,
-            .mipmaps = options->mipmaps,
+            .downscale_filter = options->downscale_filter,
+            .texture_damage = options->texture_damage,
+            .render_scale = options->render_scale,
+            .screenshot_gpu_readback = options->screenshot_gpu_readback,
+            .hw_decoder = options->video_decoder == SC_VIDEO_DECODER_HW,
+            .screenshot_from_device = options->screenshot_from_device,
+            .screenshot_format = options->screenshot_format,
+            .screenshot_png_level = options->screenshot_png_level,
+            .frame_pacing = options->frame_pacing,
+            .auto_size = options->auto_size,
+            // Without several devices, the windows are decoded at full cost
+            .unfocused_decode =
+                options->unfocused_decode == SC_DECODE_BUDGET_AUTO
+                    ? SC_DECODE_BUDGET_FULL : options->unfocused_decode,
+            .pause_decode = !scrcpy_has_other_video_frame_sinks(options),
+            .latency = latency_initialized ? &s->latency : NULL,
+            .input_latency = input_latency_initialized ? &s->input_latency
+                                                       : NULL,
+            .latency_probe = options->latency_probe ? &s->latency_probe
+                                                    : NULL,
             .fullscreen = options->fullscreen,
             .start_fps_counter = options->start_fps_counter,
         };
 
         if (!sc_screen_init(&s->screen, &screen_params)) {
+            if (latency_initialized) {
+                sc_latency_destroy(&s->latency);
+            }
+            if (input_latency_initialized) {
+                sc_input_latency_destroy(&s->input_latency);
+            }
             return ret;
         }
         screen_initialized = true;
         set_waiting_window_title(s, options);
     }
 
+    char video_codecs[sizeof("av1,h265,h264")];
+    if (options->video && options->video_codec_auto) {
+        scrcpy_list_negotiable_video_codecs(options, video_codecs,
+                                            sizeof(video_codecs));
+        LOGD("Negotiable video codecs: %s", video_codecs);
+    }
+
+    s->video_hw_device = NULL;
+    s->device_serial = NULL;
+    atomic_init(&s->device_available, true);
+    bool adb_tracker_initialized = false;
+    bool adb_tracker_started = false;
+    // Reset once connected
+    uint32_t retry_delay_ms = SC_RECONNECT_DELAY_MIN_MS;
+
     static const struct sc_server_callbacks cbs = {
         .on_connection_failed = sc_server_on_connection_failed,
         .on_connected = sc_server_on_connected,
@@ -657,11 +925,22 @@ scrcpy(struct scrcpy_options *options) {
         bool file_pusher_initialized = false;
         bool recorder_initialized = false;
         bool recorder_started = false;
+        bool bridge_clip_initialized = false;
+        bool bridge_clip_started = false;
+        bool instant_replay_initialized = false;
+        bool instant_replay_started = false;
 #ifdef HAVE_V4L2
         bool v4l2_sink_initialized = false;
+#endif
+#ifdef HAVE_SHM_SINK
+        bool shm_sink_initialized = false;
 #endif
         bool video_demuxer_started = false;
         bool audio_demuxer_started = false;
+        FILE *dump_file = NULL;
+        bool udp_video_initialized = false;
+        bool mux_initialized = false;
+        bool mux_started = false;
 #ifdef HAVE_USB
         bool aoa_hid_initialized = false;
         bool keyboard_aoa_initialized = false;
@@ -695,16 +974,26 @@ scrcpy(struct scrcpy_options *options) {
             .select_tcpip = options->select_tcpip,
             .log_level = options->log_level,
             .video_codec = options->video_codec,
+            .video_codecs = options->video && options->video_codec_auto
+                          ? video_codecs : NULL,
             .audio_codec = options->audio_codec,
             .video_source = options->video_source,
+            .video_encoder_profile = options->video_encoder_profile,
+            .video_mode = options->video_mode,
+            .thumbnail_interval = options->thumbnail_interval,
             .audio_source = options->audio_source,
             .camera_facing = options->camera_facing,
             .crop = options->crop,
             .port_range = options->port_range,
             .tunnel_host = options->tunnel_host,
             .tunnel_port = options->tunnel_port,
+            .video_udp_port = options->video_udp_port,
+            .direct_port = options->direct_port,
+            .video_socket_buffer = options->video_socket_buffer,
+            .socket_busy_poll = options->socket_busy_poll,
             .max_size = options->max_size,
             .video_bit_rate = options->video_bit_rate,
+            .video_bit_rate_probe = options->video_bit_rate_auto,
             .audio_bit_rate = options->audio_bit_rate,
             .max_fps = options->max_fps,
             .angle = options->angle,
@@ -714,6 +1003,7 @@ scrcpy(struct scrcpy_options *options) {
             .control = options->control,
             .display_id = options->display_id,
             .new_display = options->new_display,
+            .render_scale = options->render_scale,
             .display_ime_policy = options->display_ime_policy,
             .video = options->video,
             .audio = options->audio,
@@ -732,11 +1022,23 @@ scrcpy(struct scrcpy_options *options) {
             .power_off_on_close = options->power_off_on_close,
             .clipboard_autosync = options->clipboard_autosync,
             .downsize_on_error = options->downsize_on_error,
+            .video_roi = options->video_roi,
+            .video_square = options->video_square,
+            .thermal_throttle = options->thermal_throttle,
+            .multiplex = options->multiplex,
+            .video_idle_timeout = options->video_idle_timeout,
+            .video_intra_refresh = options->video_intra_refresh,
+            .video_hdr = options->video_hdr,
+            .latency_probe = options->latency_probe,
             .tcpip = options->tcpip,
             .tcpip_dst = options->tcpip_dst,
             .cleanup = options->cleanup,
             .power_on = options->power_on,
             .kill_adb_on_close = options->kill_adb_on_close,
+            .keep_server = options->keep_server,
+            .adb_batch = options->adb_batch,
+            .adb_native = options->adb_native,
+            .session_cache = options->session_cache,
             .camera_high_speed = options->camera_high_speed,
             .vd_destroy_content = options->vd_destroy_content,
             .vd_system_decorations = options->vd_system_decorations,
@@ -763,6 +1065,16 @@ scrcpy(struct scrcpy_options *options) {
             goto session_end;
         }
 
+        if (!sdl_deferred_initialized) {
+            // The server is pushed and started asynchronously meanwhile
+            if (!init_sdl_deferred_subsystems(options)) {
+                ret = SCRCPY_EXIT_FAILURE;
+                stop = true;
+                goto session_end;
+            }
+            sdl_deferred_initialized = true;
+        }
+
         enum sc_await_server_result await_res =
             await_for_server(screen_initialized ? &s->screen : NULL);
         if (await_res == SC_AWAIT_SERVER_RESULT_CONNECTION_FAILED) {
@@ -793,10 +1105,28 @@ scrcpy(struct scrcpy_options *options) {
         }
 
         LOGD("Server connected");
+        retry_delay_ms = SC_RECONNECT_DELAY_MIN_MS;
 
         const char *serial = s->server.serial;
         assert(serial);
 
+        if (screen_initialized) {
+            sc_screen_set_device_serial(&s->screen, serial);
+            const struct sc_session_cache *cache = &s->server.session_cache;
+            sc_screen_set_cached_window_size(&s->screen, cache->video_size,
+                                             cache->window_size);
+        }
+
+        if (!s->device_serial && !options->tcpip) {
+            // With --tcpip, the device would not reappear without a new
+            // "adb connect", so it is not tracked
+            s->device_serial = strdup(serial);
+            if (!s->device_serial) {
+                LOG_OOM();
+                // not fatal, the reconnection just retries periodically
+            }
+        }
+
         if (screen_initialized && options->video_playback) {
             bool ok = sc_secure_content_monitor_init(&secure_monitor, serial);
             if (ok) {
@@ -815,41 +1145,161 @@ scrcpy(struct scrcpy_options *options) {
 
         if (options->video_playback && options->control) {
             if (!sc_file_pusher_init(&s->file_pusher, serial,
-                                     options->push_target)) {
+                                     options->push_target,
+                                     options->push_jobs)) {
                 goto session_end;
             }
             fp = &s->file_pusher;
             file_pusher_initialized = true;
         }
 
+        // With --multiplex, all the streams are received on a single socket
+        struct sc_mux *mux = NULL;
+        if (s->server.mux_socket != SC_SOCKET_NONE) {
+            if (!sc_mux_init(&s->mux, s->server.mux_socket)) {
+                goto session_end;
+            }
+            mux_initialized = true;
+            mux = &s->mux;
+        }
+
         if (options->video) {
+            // On packet loss over UDP, a new keyframe can only be requested if
+            // control is enabled
             static const struct sc_demuxer_callbacks video_demuxer_cbs = {
                 .on_ended = sc_video_demuxer_on_ended,
+                .on_packets_lost = sc_video_demuxer_on_packets_lost,
             };
-            sc_demuxer_init(&s->video_demuxer, "video", s->server.video_socket,
-                            &video_demuxer_cbs, NULL);
+            static const struct sc_demuxer_callbacks video_demuxer_cbs_nc = {
+                .on_ended = sc_video_demuxer_on_ended,
+            };
+            const struct sc_demuxer_callbacks *cbs =
+                options->control ? &video_demuxer_cbs : &video_demuxer_cbs_nc;
+            if (mux) {
+                sc_demuxer_init_mux(&s->video_demuxer, "video", mux,
+                                    SC_MUX_STREAM_VIDEO, cbs, &s->controller);
+            } else {
+                sc_demuxer_init(&s->video_demuxer, "video",
+                                s->server.video_socket, cbs, &s->controller);
+            }
+
+            if (s->server.video_udp_socket != SC_SOCKET_NONE) {
+                if (!sc_udp_video_init(&s->udp_video,
+                                       s->server.video_udp_socket, scid)) {
+                    goto session_end;
+                }
+                udp_video_initialized = true;
+                sc_demuxer_set_udp(&s->video_demuxer, &s->udp_video);
+            }
+
+            if (options->dump_stream) {
+                // Overwritten on reconnection, a dump must contain a single
+                // stream
+                dump_file = fopen(options->dump_stream, "wb");
+                if (!dump_file) {
+                    LOGE("Could not open dump file: %s", options->dump_stream);
+                    goto session_end;
+                }
+                sc_demuxer_set_dump_file(&s->video_demuxer, dump_file);
+            }
         }
 
         if (options->audio) {
             static const struct sc_demuxer_callbacks audio_demuxer_cbs = {
                 .on_ended = sc_audio_demuxer_on_ended,
             };
-            sc_demuxer_init(&s->audio_demuxer, "audio", s->server.audio_socket,
-                            &audio_demuxer_cbs, options);
+            if (mux) {
+                sc_demuxer_init_mux(&s->audio_demuxer, "audio", mux,
+                                    SC_MUX_STREAM_AUDIO, &audio_demuxer_cbs,
+                                    options);
+            } else {
+                sc_demuxer_init(&s->audio_demuxer, "audio",
+                                s->server.audio_socket, &audio_demuxer_cbs,
+                                options);
+            }
         }
 
-        bool needs_video_decoder = options->video_playback;
+        bool needs_video_decoder = scrcpy_needs_video_decoder(options);
         bool needs_audio_decoder = options->audio_playback;
-#ifdef HAVE_V4L2
-        needs_video_decoder |= !!options->v4l2_device;
-#endif
+        if (latency_initialized) {
+            // Added before the decoder, to stamp the packets on reception
+            sc_packet_source_add_sink(&s->video_demuxer.packet_source,
+                                      &s->latency.packet_sink);
+        }
         if (needs_video_decoder) {
-            sc_decoder_init(&s->video_decoder, "video");
+            bool hw = options->video_decoder == SC_VIDEO_DECODER_HW;
+
+            // A new keyframe can only be requested if control is enabled
+            // (the controller is initialized before the demuxer is started)
+            static const struct sc_decoder_callbacks video_decoder_cbs = {
+                .on_keyframe_needed = sc_video_decoder_on_keyframe_needed,
+            };
+            const struct sc_decoder_callbacks *cbs =
+                options->control ? &video_decoder_cbs : NULL;
+            sc_decoder_init(&s->video_decoder, "video", hw,
+                            options->decoder_threads, cbs, &s->controller);
+            if (hw) {
+                // Do not recreate the device on reconnection
+                sc_decoder_set_hw_device_cache(&s->video_decoder,
+                                               &s->video_hw_device);
+            }
+            if (options->throughput) {
+                // No window: no frame is presented interactively
+                sc_decoder_set_frame_threading(&s->video_decoder);
+            }
+
+            struct sc_packet_source *src = &s->video_demuxer.packet_source;
+            if (options->video_playback && options->video_buffer_packets) {
+                // Delay the packets before decoding (only the screen consumes
+                // the decoded frames, this is checked by the cli)
+                assert(options->video_buffer);
+                sc_delay_buffer_init(&s->video_buffer, options->video_buffer,
+                                     true);
+                sc_delay_buffer_set_max_bytes(&s->video_buffer,
+                                              options->max_memory / 4);
+                sc_packet_source_add_sink(src, &s->video_buffer.packet_sink);
+                src = &s->video_buffer.packet_source;
+            }
+            sc_packet_source_add_sink(src, &s->video_decoder.packet_sink);
+
+            if (screen_initialized) {
+                sc_screen_set_video_decoder(&s->screen, &s->video_decoder);
+            }
+        }
+        if (options->video_bit_rate_adaptive) {
+            // The controller is initialized before the demuxer is started
+            struct sc_frame_source *frames =
+                needs_video_decoder ? &s->video_decoder.frame_source : NULL;
+            sc_video_feedback_init(&s->video_feedback, &s->controller, frames);
             sc_packet_source_add_sink(&s->video_demuxer.packet_source,
-                                      &s->video_decoder.packet_sink);
+                                      &s->video_feedback.packet_sink);
+        }
+        if (screen_initialized && s->screen.figma_bridge_ready) {
+            // Serve the encoded stream to the Figma Bridge viewers (remuxed,
+            // not re-encoded)
+            struct sc_controller *controller =
+                options->control ? &s->controller : NULL;
+            sc_bridge_stream_init(&s->bridge_stream, &s->screen.figma_bridge,
+                                  controller);
+            sc_packet_source_add_sink(&s->video_demuxer.packet_source,
+                                      &s->bridge_stream.packet_sink);
+
+            // Keep the recent packets for the clips (an optional feature, do
+            // not fail on error)
+            if (sc_bridge_clip_init(&s->bridge_clip,
+                                    &s->screen.figma_bridge)) {
+                bridge_clip_initialized = true;
+                if (sc_bridge_clip_start(&s->bridge_clip)) {
+                    bridge_clip_started = true;
+                    sc_packet_source_add_sink(
+                        &s->video_demuxer.packet_source,
+                        &s->bridge_clip.packet_sink);
+                    s->screen.bridge_clip = &s->bridge_clip;
+                }
+            }
         }
         if (needs_audio_decoder) {
-            sc_decoder_init(&s->audio_decoder, "audio");
+            sc_decoder_init(&s->audio_decoder, "audio", false, 1, NULL, NULL);
             sc_packet_source_add_sink(&s->audio_demuxer.packet_source,
                                       &s->audio_decoder.packet_sink);
         }
@@ -858,20 +1308,61 @@ scrcpy(struct scrcpy_options *options) {
             static const struct sc_recorder_callbacks recorder_cbs = {
                 .on_ended = sc_recorder_on_ended,
             };
+            // With intra refresh, the device sends keyframes on demand only.
+            // They can only be requested if control is enabled, and only if
+            // the recorded packets are those of the device encoder.
+            static const struct sc_recorder_callbacks recorder_cbs_keyframes = {
+                .on_ended = sc_recorder_on_ended,
+                .on_keyframe_needed = sc_recorder_on_keyframe_needed,
+            };
+            bool request_keyframes = options->video_intra_refresh
+                                  && options->control
+                                  && !options->record_transcode;
             if (!sc_recorder_init(&s->recorder, options->record_filename,
-                                  options->record_format, options->video,
+                                  options->record_format,
+                                  options->record_buffer,
+                                  options->record_segment,
+                                  options->record_keep, options->video,
                                   options->audio, options->record_orientation,
-                                  &recorder_cbs, NULL)) {
+                                  request_keyframes ? &recorder_cbs_keyframes
+                                                    : &recorder_cbs,
+                                  &s->controller)) {
                 goto session_end;
             }
             recorder_initialized = true;
 
+            // The decoded frames take half of the memory budget (see
+            // --max-memory), the delay buffer and the recorder a quarter each.
+            // Without budget, the recorder queue is still bounded (the
+            // packets are spilled to disk if the writes stall).
+            size_t max_queue_bytes = options->max_memory
+                                   ? options->max_memory / 4
+                                   : SC_RECORDER_DEFAULT_MAX_QUEUE_BYTES;
+            sc_recorder_set_max_queue_bytes(&s->recorder, max_queue_bytes);
+            if (options->record_index) {
+                sc_recorder_enable_index(&s->recorder);
+            }
+
             if (!sc_recorder_start(&s->recorder)) {
                 goto session_end;
             }
             recorder_started = true;
 
-            if (options->video) {
+            if (options->record_index && screen_initialized) {
+                s->screen.recorder = &s->recorder;
+            }
+
+            if (options->video && options->record_transcode) {
+                // Record the frames re-encoded by the transcoder instead of
+                // the device stream
+                sc_transcoder_init(&s->transcoder,
+                                   options->record_transcode_codec,
+                                   options->record_transcode_bit_rate);
+                sc_packet_source_add_sink(&s->transcoder.packet_source,
+                                          &s->recorder.video_packet_sink);
+                sc_frame_source_add_sink(&s->video_decoder.frame_source,
+                                         &s->transcoder.frame_sink);
+            } else if (options->video) {
                 sc_packet_source_add_sink(&s->video_demuxer.packet_source,
                                           &s->recorder.video_packet_sink);
             }
@@ -881,6 +1372,30 @@ scrcpy(struct scrcpy_options *options) {
             }
         }
 
+        if (options->replay_buffer && screen_initialized) {
+            if (!sc_instant_replay_init(&s->instant_replay,
+                                        options->replay_buffer,
+                                        SC_INSTANT_REPLAY_MAX_BYTES)) {
+                goto session_end;
+            }
+            instant_replay_initialized = true;
+
+            if (!sc_instant_replay_start(&s->instant_replay)) {
+                goto session_end;
+            }
+            instant_replay_started = true;
+
+            if (options->video) {
+                sc_packet_source_add_sink(&s->video_demuxer.packet_source,
+                                          &s->instant_replay.video.packet_sink);
+            }
+            if (options->audio) {
+                sc_packet_source_add_sink(&s->audio_demuxer.packet_source,
+                                          &s->instant_replay.audio.packet_sink);
+            }
+            s->screen.instant_replay = &s->instant_replay;
+        }
+
         if (options->control) {
             static const struct sc_controller_callbacks controller_cbs = {
                 .on_ended = sc_controller_on_ended,
@@ -892,6 +1407,10 @@ scrcpy(struct scrcpy_options *options) {
             }
             controller_initialized = true;
 
+            if (mux) {
+                sc_controller_set_mux(&s->controller, mux);
+            }
+
             controller = &s->controller;
 
 #ifdef HAVE_USB
@@ -967,7 +1486,9 @@ scrcpy(struct scrcpy_options *options) {
                 }
 
                 if (use_gamepad_aoa) {
-                    sc_gamepad_aoa_init(&s->gamepad_aoa, &s->aoa);
+                    sc_tick interval =
+                        sc_gamepad_poll_interval(options->gamepad_polling_rate);
+                    sc_gamepad_aoa_init(&s->gamepad_aoa, &s->aoa, interval);
                     gp = &s->gamepad_aoa.gamepad_processor;
                     gamepad_aoa_initialized = true;
                 }
@@ -1020,7 +1541,10 @@ aoa_complete:
             }
 
             if (options->gamepad_input_mode == SC_GAMEPAD_INPUT_MODE_UHID) {
-                sc_gamepad_uhid_init(&s->gamepad_uhid, &s->controller);
+                sc_tick interval =
+                    sc_gamepad_poll_interval(options->gamepad_polling_rate);
+                sc_gamepad_uhid_init(&s->gamepad_uhid, &s->controller,
+                                     interval);
                 gp = &s->gamepad_uhid.gamepad_processor;
             }
 
@@ -1030,7 +1554,15 @@ aoa_complete:
                 uhid_devices = &s->uhid_devices;
             }
 
-            sc_controller_configure(&s->controller, acksync, uhid_devices);
+            struct sc_input_latency *input_latency =
+                input_latency_initialized ? &s->input_latency : NULL;
+            sc_controller_configure(&s->controller, acksync, uhid_devices,
+                                    input_latency);
+            if (screen_initialized && s->screen.figma_bridge_ready) {
+                // For the batched input events of the bridge
+                sc_controller_set_probe_acksync(
+                        &s->controller, &s->screen.figma_bridge.input_acksync);
+            }
 
             if (!sc_controller_start(&s->controller)) {
                 goto session_end;
@@ -1052,9 +1584,28 @@ aoa_complete:
 
             if (options->video_playback) {
                 struct sc_frame_source *src = &s->video_decoder.frame_source;
-                if (options->video_buffer) {
+                if (latency_initialized) {
+                    sc_frame_source_add_sink(src, &s->latency.frame_sink);
+                }
+                if (options->av_sync) {
+                    // The frames are delayed until the audio having the same
+                    // PTS is played (the audio player is initialized below)
+                    assert(!options->video_buffer);
+                    sc_av_sync_init(&s->av_sync);
+                    sc_delay_buffer_init(&s->video_buffer, options->av_sync,
+                                         true);
+                    sc_delay_buffer_set_av_sync(&s->video_buffer,
+                                                &s->av_sync);
+                    sc_delay_buffer_set_max_bytes(&s->video_buffer,
+                                                  options->max_memory / 4);
+                    sc_frame_source_add_sink(src, &s->video_buffer.frame_sink);
+                    src = &s->video_buffer.frame_source;
+                } else if (options->video_buffer
+                        && !options->video_buffer_packets) {
                     sc_delay_buffer_init(&s->video_buffer,
                                          options->video_buffer, true);
+                    sc_delay_buffer_set_max_bytes(&s->video_buffer,
+                                                  options->max_memory / 4);
                     sc_frame_source_add_sink(src, &s->video_buffer.frame_sink);
                     src = &s->video_buffer.frame_source;
                 }
@@ -1065,21 +1616,34 @@ aoa_complete:
 
         if (options->audio_playback) {
             sc_audio_player_init(&s->audio_player, options->audio_buffer,
-                                 options->audio_output_buffer);
+                                 options->audio_buffer_max,
+                                 options->audio_output_buffer,
+                                 options->audio_output_backend,
+                                 options->audio_concealment);
+            if (options->av_sync) {
+                sc_audio_player_set_av_sync(&s->audio_player, &s->av_sync);
+            }
             sc_frame_source_add_sink(&s->audio_decoder.frame_source,
                                      &s->audio_player.frame_sink);
         }
 
 #ifdef HAVE_V4L2
         if (options->v4l2_device) {
-            if (!sc_v4l2_sink_init(&s->v4l2_sink, options->v4l2_device)) {
+            if (!sc_v4l2_sink_init(&s->v4l2_sink, options->v4l2_device,
+                                   options->v4l2_format, options->v4l2_width,
+                                   options->v4l2_height)) {
                 goto session_end;
             }
+            if (options->throughput) {
+                sc_v4l2_sink_set_queued(&s->v4l2_sink);
+            }
 
             struct sc_frame_source *src = &s->video_decoder.frame_source;
             if (options->v4l2_buffer) {
                 sc_delay_buffer_init(&s->v4l2_buffer, options->v4l2_buffer,
                                      true);
+                sc_delay_buffer_set_max_bytes(&s->v4l2_buffer,
+                                              options->max_memory / 4);
                 sc_frame_source_add_sink(src, &s->v4l2_buffer.frame_sink);
                 src = &s->v4l2_buffer.frame_source;
             }
@@ -1090,6 +1654,41 @@ aoa_complete:
         }
 #endif
 
+#ifdef HAVE_SHM_SINK
+        if (options->shm_sink) {
+            if (!sc_shm_sink_init(&s->shm_sink, options->shm_sink)) {
+                goto session_end;
+            }
+
+            sc_frame_source_add_sink(&s->video_decoder.frame_source,
+                                     &s->shm_sink.frame_sink);
+
+            shm_sink_initialized = true;
+        }
+#endif
+
+#ifdef __APPLE__
+        if (options->iosurface_sink) {
+            assert(screen_initialized);
+            struct sc_figma_bridge *bridge = s->screen.figma_bridge_ready
+                                           ? &s->screen.figma_bridge : NULL;
+            if (!bridge) {
+                LOGW("Figma Bridge not available, IOSurface ids are not "
+                     "published");
+            }
+            sc_iosurface_sink_init(&s->iosurface_sink, bridge);
+            sc_frame_source_add_sink(&s->video_decoder.frame_source,
+                                     &s->iosurface_sink.frame_sink);
+        }
+#endif
+
+        if (mux) {
+            if (!sc_mux_start(mux)) {
+                goto session_end;
+            }
+            mux_started = true;
+        }
+
         if (options->video) {
             if (!sc_demuxer_start(&s->video_demuxer)) {
                 goto session_end;
@@ -1167,12 +1766,26 @@ aoa_complete:
             retry = true;
         } else {
             stop = true;
+            struct sc_size content_size;
+            struct sc_size window_size;
+            if (screen_initialized && options->session_cache
+                    && sc_screen_get_window_size_to_cache(&s->screen,
+                                                          &content_size,
+                                                          &window_size)) {
+                // Restored on the next launch
+                sc_session_cache_set_window_size(serial, content_size,
+                                                 window_size);
+            }
             if (screen_initialized && options->video_playback) {
                 sc_screen_hide_window(&s->screen);
             }
         }
 
 session_end:
+        if (screen_initialized) {
+            sc_screen_set_video_decoder(&s->screen, NULL);
+        }
+
         if (secure_monitor_started) {
             sc_secure_content_monitor_stop(&secure_monitor);
         }
@@ -1206,8 +1819,21 @@ session_end:
             sc_file_pusher_stop(&s->file_pusher);
         }
         if (recorder_initialized) {
+            if (screen_initialized) {
+                s->screen.recorder = NULL;
+            }
             sc_recorder_stop(&s->recorder);
         }
+        if (bridge_clip_initialized) {
+            if (screen_initialized) {
+                s->screen.bridge_clip = NULL;
+            }
+            sc_bridge_clip_stop(&s->bridge_clip);
+        }
+        if (instant_replay_initialized) {
+            s->screen.instant_replay = NULL;
+            sc_instant_replay_stop(&s->instant_replay);
+        }
 
         if (screen_initialized) {
             sc_screen_set_input_processors(&s->screen, NULL, NULL, NULL, NULL,
@@ -1242,6 +1868,12 @@ session_end:
         if (video_demuxer_started) {
             sc_demuxer_join(&s->video_demuxer);
         }
+        if (dump_file) {
+            fclose(dump_file);
+        }
+        if (udp_video_initialized) {
+            sc_udp_video_destroy(&s->udp_video);
+        }
 
         if (audio_demuxer_started) {
             sc_demuxer_join(&s->audio_demuxer);
@@ -1253,6 +1885,12 @@ session_end:
         }
 #endif
 
+#ifdef HAVE_SHM_SINK
+        if (shm_sink_initialized) {
+            sc_shm_sink_destroy(&s->shm_sink);
+        }
+#endif
+
 #ifdef HAVE_USB
         if (aoa_hid_initialized) {
             sc_aoa_join(&s->aoa);
@@ -1270,6 +1908,14 @@ session_end:
             sc_controller_destroy(&s->controller);
         }
 
+        // The multiplexer thread ends once the server socket is interrupted
+        if (mux_started) {
+            sc_mux_join(&s->mux);
+        }
+        if (mux_initialized) {
+            sc_mux_destroy(&s->mux);
+        }
+
         if (recorder_started) {
             sc_recorder_join(&s->recorder);
         }
@@ -1277,6 +1923,20 @@ session_end:
             sc_recorder_destroy(&s->recorder);
         }
 
+        if (bridge_clip_started) {
+            sc_bridge_clip_join(&s->bridge_clip);
+        }
+        if (bridge_clip_initialized) {
+            sc_bridge_clip_destroy(&s->bridge_clip);
+        }
+
+        if (instant_replay_started) {
+            sc_instant_replay_join(&s->instant_replay);
+        }
+        if (instant_replay_initialized) {
+            sc_instant_replay_destroy(&s->instant_replay);
+        }
+
         if (file_pusher_initialized) {
             sc_file_pusher_join(&s->file_pusher);
             sc_file_pusher_destroy(&s->file_pusher);
@@ -1291,16 +1951,55 @@ session_end:
             break;
         }
 
-        if (!wait_retry_delay(s, screen_initialized, 1000)) {
+        if (!adb_tracker_initialized && s->device_serial) {
+            adb_tracker_initialized = sc_adb_tracker_init(&s->adb_tracker);
+            if (adb_tracker_initialized) {
+                static const struct sc_adb_tracker_callbacks tracker_cbs = {
+                    .on_devices = sc_adb_tracker_on_devices,
+                    .on_ended = sc_adb_tracker_on_ended,
+                };
+                adb_tracker_started =
+                    sc_adb_tracker_start(&s->adb_tracker, &tracker_cbs, s);
+            }
+        }
+
+        if (!wait_retry_delay(s, screen_initialized, retry_delay_ms)) {
             ret = SCRCPY_EXIT_SUCCESS;
             break;
         }
+        // The device may take a while to come back, do not retry too often
+        retry_delay_ms = MIN(retry_delay_ms * 2, SC_RECONNECT_DELAY_MAX_MS);
+    }
+
+    av_buffer_unref(&s->video_hw_device);
+
+    if (adb_tracker_started) {
+        sc_adb_tracker_stop(&s->adb_tracker);
+        sc_adb_tracker_join(&s->adb_tracker);
     }
+    if (adb_tracker_initialized) {
+        sc_adb_tracker_destroy(&s->adb_tracker);
+    }
+    free(s->device_serial);
 
     if (screen_initialized) {
         sc_screen_join(&s->screen);
         sc_screen_destroy(&s->screen);
     }
 
+    if (latency_initialized) {
+        sc_latency_print(&s->latency);
+        sc_latency_destroy(&s->latency);
+    }
+
+    if (input_latency_initialized) {
+        sc_input_latency_print(&s->input_latency);
+        sc_input_latency_destroy(&s->input_latency);
+    }
+
+    if (options->latency_probe) {
+        sc_latency_probe_print(&s->latency_probe);
+    }
+
     return ret;
 }
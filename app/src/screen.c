@@ -1,22 +1,19 @@
 #include "screen.h"
 
 #include <assert.h>
-#include <ctype.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
-#ifdef __APPLE__
-# include <unistd.h>
-#endif
 #include <SDL2/SDL.h>
-#include <libswscale/swscale.h>
 
 #include "events.h"
+#include "file_pusher.h"
 #include "icon.h"
 #include "options.h"
 #include "util/log.h"
+#include "util/trace.h"
 #ifdef __APPLE__
 # include "sys/darwin/clipboard.h"
 # include "sys/darwin/font.h"
@@ -35,6 +32,9 @@
 #define UI_TOGGLE_TOP_OFFSET 20
 #define UI_SETTINGS_BUTTON_SIZE 40
 #define UI_SETTINGS_BOTTOM_OFFSET 20
+#define UI_PUSH_PROGRESS_HEIGHT 4
+#define UI_PUSH_PROGRESS_GAP 12
+#define UI_PANEL_TEXTURE_HEIGHT_STEP 256
 #define UI_SETTINGS_MENU_WIDTH 232
 #define UI_SETTINGS_MENU_ITEM_HEIGHT 32
 #define UI_SETTINGS_MENU_PADDING 8
@@ -47,22 +47,29 @@
 #define UI_BUTTON_FEEDBACK_DURATION_MS \
     (UI_BUTTON_FEEDBACK_IN_MS + UI_BUTTON_FEEDBACK_HOLD_MS \
      + UI_BUTTON_FEEDBACK_OUT_MS)
+#define UI_ANIMATION_TICK_MS 16
 #define UI_STATUS_LABEL_HEIGHT 22
+// Minimum size of a selected screenshot region, in frame pixels
+#define UI_REGION_SELECT_MIN_SIZE 4
 #define UI_WAITING_LABEL "Please connect a device"
 #define UI_SECURE_LABEL "Please unlock on device"
-#define UI_SCREENSHOT_ICON_PATH_ENV "SCRCPY_SCREENSHOT_ICON_PATH"
-#define UI_SCREENSHOT_CHECK_ICON_PATH_ENV "SCRCPY_SCREENSHOT_CHECK_ICON_PATH"
-#define UI_SCREENSHOT_BUTTON_BG_PATH_ENV "SCRCPY_SCREENSHOT_BUTTON_BG_PATH"
-#define UI_INPUT_TOGGLE_ICON_PATH_ENV "SCRCPY_INPUT_TOGGLE_ICON_PATH"
-#define UI_INPUT_TOGGLE_BUTTON_BG_PATH_ENV "SCRCPY_INPUT_TOGGLE_BUTTON_BG_PATH"
-#define UI_SETTINGS_ICON_PATH_ENV "SCRCPY_SETTINGS_ICON_PATH"
 #define UI_SETTINGS_COPY_LABEL "COPY TO CLIPBOARD"
 #define UI_SETTINGS_SAVE_LABEL "SAVE IMAGE TO"
 #define UI_SETTINGS_FIGMA_LABEL "SEND TO FIGMA BRIDGE"
+#define UI_SETTINGS_CLIP_LABEL "SEND CLIP TO FIGMA"
 #define UI_SETTINGS_FOLDER_LABEL "SELECT FOLDER"
 #define UI_SETTINGS_FOLDER_SET_LABEL "FOLDER SELECTED"
 #define UI_FONT_PATH_ENV "SCRCPY_UI_FONT_PATH"
 #define FIGMA_BRIDGE_PORT 27184
+// Used if the display refresh rate is unknown
+#define FRAME_PACING_DEFAULT_REFRESH_RATE 60
+// Tolerance for rendering a frame slightly before the next refresh (SDL
+// timers have a millisecond resolution)
+#define FRAME_PACING_SLACK SC_TICK_FROM_MS(1)
+
+// Delay after the last content size change before requesting the device to
+// encode at the new size (each request restarts the encoder)
+#define AUTO_SIZE_DELAY_MS 500
 
 #define DOWNCAST(SINK) container_of(SINK, struct sc_screen, frame_sink)
 
@@ -73,30 +80,14 @@ static void
 sc_screen_draw_text_centered(struct sc_screen *screen, const SDL_Rect *area,
                              const char *text, uint8_t r, uint8_t g, uint8_t b);
 
-static bool
-sc_screen_load_screenshot_icon(struct sc_screen *screen);
-
-static bool
-sc_screen_load_screenshot_check_icon(struct sc_screen *screen);
-
-static bool
-sc_screen_load_screenshot_button_bg(struct sc_screen *screen);
-
-static bool
-sc_screen_load_input_toggle_icon(struct sc_screen *screen);
-
-static bool
-sc_screen_load_input_toggle_button_bg(struct sc_screen *screen);
-
-static bool
-sc_screen_load_settings_icon(struct sc_screen *screen);
-
 static void
 sc_screen_set_input_enabled(struct sc_screen *screen, bool enabled);
 
+static bool
+sc_screen_apply_frame(struct sc_screen *screen);
+
 static void
-sc_screen_fill_rounded_rect(SDL_Renderer *renderer, const SDL_Rect *rect,
-                            int radius);
+sc_screen_update_decode_budget(struct sc_screen *screen);
 
 static inline struct sc_size
 get_oriented_size(struct sc_size size, enum sc_orientation orientation) {
@@ -148,21 +139,29 @@ get_drawable_size(const struct sc_screen *screen) {
     return size;
 }
 
+// Query the window and drawable sizes
+//
+// They only change on resize or on display change, so they are cached rather
+// than queried on each input event or render (on macOS, each query goes
+// through Cocoa).
+static void
+sc_screen_update_window_sizes(struct sc_screen *screen) {
+    screen->window_size = get_window_size(screen);
+    screen->drawable_size = get_drawable_size(screen);
+}
+
 static int
 scale_window_to_drawable(const struct sc_screen *screen, int value,
                          bool x_axis) {
-    int ww;
-    int wh;
-    SDL_GetWindowSize(screen->window, &ww, &wh);
-
-    struct sc_size drawable_size = get_drawable_size(screen);
-    int window_size = x_axis ? ww : wh;
-    int drawable_axis = x_axis ? drawable_size.width : drawable_size.height;
-    if (window_size <= 0) {
+    int window_axis = x_axis ? screen->window_size.width
+                             : screen->window_size.height;
+    int drawable_axis = x_axis ? screen->drawable_size.width
+                               : screen->drawable_size.height;
+    if (window_axis <= 0) {
         return value;
     }
 
-    return (int64_t) value * drawable_axis / window_size;
+    return (int64_t) value * drawable_axis / window_axis;
 }
 
 static inline bool
@@ -282,9 +281,83 @@ sc_screen_is_relative_mode(struct sc_screen *screen) {
     return screen->im.mp && screen->im.mp->relative_mode;
 }
 
+// Whether the window content may be seen (even if it is not focused)
+static inline bool
+sc_screen_is_visible(struct sc_screen *screen) {
+    return !screen->window_hidden && !screen->minimized
+        && !screen->window_occluded;
+}
+
+static void
+sc_screen_update_hit_regions(struct sc_screen *screen) {
+    // Topmost first: the menu is drawn over the panel, the buttons over the
+    // panel background
+    const struct sc_screen_hit_region regions[] = {
+        {screen->settings_menu_copy_rect, SC_SCREEN_UI_TARGET_MENU_COPY},
+        {screen->settings_menu_save_rect, SC_SCREEN_UI_TARGET_MENU_SAVE},
+        {screen->settings_menu_figma_rect, SC_SCREEN_UI_TARGET_MENU_FIGMA},
+        {screen->settings_menu_clip_rect, SC_SCREEN_UI_TARGET_MENU_CLIP},
+        {screen->settings_menu_directory_rect,
+         SC_SCREEN_UI_TARGET_MENU_DIRECTORY},
+        {screen->settings_menu_rect, SC_SCREEN_UI_TARGET_MENU},
+        {screen->screenshot_button_rect,
+         SC_SCREEN_UI_TARGET_SCREENSHOT_BUTTON},
+        {screen->input_toggle_button_rect, SC_SCREEN_UI_TARGET_INPUT_TOGGLE},
+        {screen->settings_button_rect, SC_SCREEN_UI_TARGET_SETTINGS_BUTTON},
+        {screen->panel_rect, SC_SCREEN_UI_TARGET_PANEL},
+    };
+    static_assert(ARRAY_LEN(regions) == ARRAY_LEN(screen->hit_regions),
+                  "Missing hit region");
+
+    unsigned count = 0;
+    for (unsigned i = 0; i < ARRAY_LEN(regions); ++i) {
+        // Skip the empty rects
+        if (regions[i].rect.w && regions[i].rect.h) {
+            screen->hit_regions[count++] = regions[i];
+        }
+    }
+    screen->hit_region_count = count;
+}
+
+static SDL_Rect
+sc_screen_compute_mirror_slot(struct sc_screen *screen) {
+    int viewport_width = screen->panel_rect.x;
+    int viewport_height = screen->panel_rect.h;
+    if (viewport_width <= 0 || viewport_height <= 0) {
+        return (SDL_Rect) {0, 0, 0, 0};
+    }
+
+    int pad_x = scale_window_to_drawable(screen, UI_LEFT_PADDING_X, true);
+    int pad_y = scale_window_to_drawable(screen, UI_LEFT_PADDING_Y, false);
+    int slot_w = MAX(0, viewport_width - 2 * pad_x);
+    int slot_h = MAX(0, viewport_height - 2 * pad_y);
+    if (!slot_w || !slot_h) {
+        return (SDL_Rect) {0, 0, 0, 0};
+    }
+
+    int rect_w = slot_w;
+    int rect_h = slot_h;
+    bool keep_width = (int64_t) slot_w * UI_MIRROR_ASPECT_H
+                    <= (int64_t) slot_h * UI_MIRROR_ASPECT_W;
+    if (keep_width) {
+        rect_h = (int64_t) slot_w * UI_MIRROR_ASPECT_H / UI_MIRROR_ASPECT_W;
+    } else {
+        rect_w = (int64_t) slot_h * UI_MIRROR_ASPECT_W / UI_MIRROR_ASPECT_H;
+    }
+
+    SDL_Rect rect = {
+        .x = (viewport_width - rect_w) / 2,
+        .y = (viewport_height - rect_h) / 2,
+        .w = rect_w,
+        .h = rect_h,
+    };
+    return rect;
+}
+
 static void
 sc_screen_update_ui_rects(struct sc_screen *screen) {
-    struct sc_size drawable_size = get_drawable_size(screen);
+    struct sc_size window_size = screen->window_size;
+    struct sc_size drawable_size = screen->drawable_size;
     bool show_panel = screen->connection_state == SC_SCREEN_CONNECTION_RUNNING;
     int panel_width = 0;
     if (show_panel) {
@@ -297,6 +370,12 @@ sc_screen_update_ui_rects(struct sc_screen *screen) {
     screen->panel_rect.w = panel_width;
     screen->panel_rect.h = drawable_size.height;
 
+    screen->panel_window_x = drawable_size.width
+        ? (int64_t) screen->panel_rect.x * window_size.width
+                                         / drawable_size.width
+        : 0;
+    screen->mirror_slot = sc_screen_compute_mirror_slot(screen);
+
     int button_width = scale_window_to_drawable(screen, UI_BUTTON_WIDTH, true);
     int button_height = scale_window_to_drawable(screen, UI_BUTTON_HEIGHT, false);
     int toggle_button_size =
@@ -344,14 +423,16 @@ sc_screen_update_ui_rects(struct sc_screen *screen) {
     menu_gap = MAX(0, menu_gap);
     menu_item_height = MAX(1, menu_item_height);
     int menu_height =
-        menu_padding * 2 + menu_item_height * 4 + menu_gap * 3;
+        menu_padding * 2 + menu_item_height * 5 + menu_gap * 4;
 
     if (!show_panel || !menu_width || !menu_height) {
         screen->settings_menu_rect = (SDL_Rect) {0, 0, 0, 0};
         screen->settings_menu_copy_rect = (SDL_Rect) {0, 0, 0, 0};
         screen->settings_menu_save_rect = (SDL_Rect) {0, 0, 0, 0};
         screen->settings_menu_figma_rect = (SDL_Rect) {0, 0, 0, 0};
+        screen->settings_menu_clip_rect = (SDL_Rect) {0, 0, 0, 0};
         screen->settings_menu_directory_rect = (SDL_Rect) {0, 0, 0, 0};
+        sc_screen_update_hit_regions(screen);
         return;
     }
 
@@ -392,58 +473,57 @@ sc_screen_update_ui_rects(struct sc_screen *screen) {
         .h = menu_item_height,
     };
     item_y += menu_item_height + menu_gap;
+    screen->settings_menu_clip_rect = (SDL_Rect) {
+        .x = item_x,
+        .y = item_y,
+        .w = item_w,
+        .h = menu_item_height,
+    };
+    item_y += menu_item_height + menu_gap;
     screen->settings_menu_directory_rect = (SDL_Rect) {
         .x = item_x,
         .y = item_y,
         .w = item_w,
         .h = menu_item_height,
     };
+
+    sc_screen_update_hit_regions(screen);
 }
 
-static SDL_Rect
-sc_screen_get_mirror_slot(struct sc_screen *screen) {
-    int viewport_width = screen->panel_rect.x;
-    int viewport_height = screen->panel_rect.h;
-    if (viewport_width <= 0 || viewport_height <= 0) {
-        return (SDL_Rect) {0, 0, 0, 0};
-    }
+static inline bool
+sc_screen_ui_target_is_menu(enum sc_screen_ui_target target) {
+    return target >= SC_SCREEN_UI_TARGET_MENU;
+}
 
-    int pad_x = scale_window_to_drawable(screen, UI_LEFT_PADDING_X, true);
-    int pad_y = scale_window_to_drawable(screen, UI_LEFT_PADDING_Y, false);
-    int slot_w = MAX(0, viewport_width - 2 * pad_x);
-    int slot_h = MAX(0, viewport_height - 2 * pad_y);
-    if (!slot_w || !slot_h) {
-        return (SDL_Rect) {0, 0, 0, 0};
+// Return the topmost sidebar element at (x, y), in drawable coordinates
+static enum sc_screen_ui_target
+sc_screen_hit_test(struct sc_screen *screen, int32_t x, int32_t y) {
+    bool menu_open = screen->settings_menu_open;
+    if (!menu_open && x < screen->panel_rect.x) {
+        // Over the video (the settings menu is the only element outside the
+        // panel): nothing to test
+        return SC_SCREEN_UI_TARGET_NONE;
     }
 
-    int rect_w = slot_w;
-    int rect_h = slot_h;
-    bool keep_width = (int64_t) slot_w * UI_MIRROR_ASPECT_H
-                    <= (int64_t) slot_h * UI_MIRROR_ASPECT_W;
-    if (keep_width) {
-        rect_h = (int64_t) slot_w * UI_MIRROR_ASPECT_H / UI_MIRROR_ASPECT_W;
-    } else {
-        rect_w = (int64_t) slot_h * UI_MIRROR_ASPECT_W / UI_MIRROR_ASPECT_H;
+    for (unsigned i = 0; i < screen->hit_region_count; ++i) {
+        const struct sc_screen_hit_region *region = &screen->hit_regions[i];
+        if (!menu_open && sc_screen_ui_target_is_menu(region->target)) {
+            continue;
+        }
+        if (point_in_rect(x, y, &region->rect)) {
+            return region->target;
+        }
     }
 
-    SDL_Rect rect = {
-        .x = (viewport_width - rect_w) / 2,
-        .y = (viewport_height - rect_h) / 2,
-        .w = rect_w,
-        .h = rect_h,
-    };
-    return rect;
+    return SC_SCREEN_UI_TARGET_NONE;
 }
 
 static void
-sc_screen_update_content_rect(struct sc_screen *screen) {
-    assert(screen->video);
-
-    sc_screen_update_ui_rects(screen);
+sc_screen_compute_content_rect(struct sc_screen *screen) {
     struct sc_size content_size = screen->content_size;
 
     SDL_Rect *rect = &screen->rect;
-    SDL_Rect mirror_slot = sc_screen_get_mirror_slot(screen);
+    SDL_Rect mirror_slot = screen->mirror_slot;
     if (!mirror_slot.w || !mirror_slot.h) {
         rect->x = 0;
         rect->y = 0;
@@ -474,175 +554,105 @@ sc_screen_update_content_rect(struct sc_screen *screen) {
     }
 }
 
-static bool
-sc_screen_load_screenshot_icon(struct sc_screen *screen) {
-    const char *path = getenv(UI_SCREENSHOT_ICON_PATH_ENV);
-    if (!path || !*path) {
-        return true;
-    }
-
-    SDL_Surface *surface = scrcpy_icon_load_from_path(path);
-    if (!surface) {
-        LOGW("Could not load screenshot icon: %s", path);
-        return false;
-    }
+static uint32_t
+sc_screen_on_auto_size_timer(uint32_t interval, void *userdata) {
+    (void) interval;
+    (void) userdata;
 
-    SDL_Texture *texture =
-        SDL_CreateTextureFromSurface(screen->display.renderer, surface);
-    if (!texture) {
-        LOGW("Could not create screenshot icon texture: %s", SDL_GetError());
-        scrcpy_icon_destroy(surface);
-        return false;
-    }
+    sc_notify_event(SC_EVENT_AUTO_SIZE);
 
-    screen->screenshot_icon = texture;
-    screen->screenshot_icon_width = surface->w;
-    screen->screenshot_icon_height = surface->h;
-    scrcpy_icon_destroy(surface);
-    return true;
+    // One-shot timer
+    return 0;
 }
 
-static bool
-sc_screen_load_screenshot_check_icon(struct sc_screen *screen) {
-    const char *path = getenv(UI_SCREENSHOT_CHECK_ICON_PATH_ENV);
-    if (!path || !*path) {
-        return true;
-    }
+static void
+sc_screen_schedule_auto_size(struct sc_screen *screen) {
+    assert(screen->auto_size);
 
-    SDL_Surface *surface = scrcpy_icon_load_from_path(path);
-    if (!surface) {
-        LOGW("Could not load screenshot check icon: %s", path);
-        return false;
+    struct sc_size size = {
+        .width = screen->rect.w,
+        .height = screen->rect.h,
+    };
+    if (size.width == screen->auto_size_pending.width
+            && size.height == screen->auto_size_pending.height) {
+        return;
     }
+    screen->auto_size_pending = size;
 
-    SDL_Texture *texture =
-        SDL_CreateTextureFromSurface(screen->display.renderer, surface);
-    if (!texture) {
-        LOGW("Could not create screenshot check icon texture: %s",
-             SDL_GetError());
-        scrcpy_icon_destroy(surface);
-        return false;
+    // Wait for the size to be stable (e.g. while the window is being resized)
+    if (screen->auto_size_timer) {
+        SDL_RemoveTimer(screen->auto_size_timer);
+    }
+    screen->auto_size_timer =
+        SDL_AddTimer(AUTO_SIZE_DELAY_MS, sc_screen_on_auto_size_timer, NULL);
+    if (!screen->auto_size_timer) {
+        LOGW("Could not add auto size timer: %s", SDL_GetError());
     }
-
-    screen->screenshot_check_icon = texture;
-    screen->screenshot_check_icon_width = surface->w;
-    screen->screenshot_check_icon_height = surface->h;
-    scrcpy_icon_destroy(surface);
-    return true;
 }
 
-static bool
-sc_screen_load_screenshot_button_bg(struct sc_screen *screen) {
-    const char *path = getenv(UI_SCREENSHOT_BUTTON_BG_PATH_ENV);
-    if (!path || !*path) {
-        return true;
+static void
+sc_screen_send_auto_size(struct sc_screen *screen) {
+    struct sc_size size = screen->auto_size_pending;
+    if (!screen->im.controller
+            || (size.width == screen->auto_size_sent.width
+                && size.height == screen->auto_size_sent.height)) {
+        return;
     }
 
-    SDL_Surface *surface = scrcpy_icon_load_from_path(path);
-    if (!surface) {
-        LOGW("Could not load screenshot button background: %s", path);
-        return false;
-    }
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_SET_VIEWPORT_SIZE;
+    msg.set_viewport_size.width = MIN(size.width, 0xFFFF);
+    msg.set_viewport_size.height = MIN(size.height, 0xFFFF);
 
-    SDL_Texture *texture =
-        SDL_CreateTextureFromSurface(screen->display.renderer, surface);
-    if (!texture) {
-        LOGW("Could not create screenshot button background texture: %s",
-             SDL_GetError());
-        scrcpy_icon_destroy(surface);
-        return false;
+    if (!sc_controller_push_msg(screen->im.controller, &msg)) {
+        LOGW("Could not request 'set viewport size'");
+        return;
     }
 
-    screen->screenshot_button_bg = texture;
-    screen->screenshot_button_bg_width = surface->w;
-    screen->screenshot_button_bg_height = surface->h;
-    scrcpy_icon_destroy(surface);
-    return true;
+    screen->auto_size_sent = size;
 }
 
-static bool
-sc_screen_load_input_toggle_icon(struct sc_screen *screen) {
-    const char *path = getenv(UI_INPUT_TOGGLE_ICON_PATH_ENV);
-    if (!path || !*path) {
-        return true;
-    }
-
-    SDL_Surface *surface = scrcpy_icon_load_from_path(path);
-    if (!surface) {
-        LOGW("Could not load input toggle icon: %s", path);
-        return false;
-    }
-
-    SDL_Texture *texture =
-        SDL_CreateTextureFromSurface(screen->display.renderer, surface);
-    if (!texture) {
-        LOGW("Could not create input toggle icon texture: %s", SDL_GetError());
-        scrcpy_icon_destroy(surface);
-        return false;
-    }
-
-    screen->input_toggle_icon = texture;
-    screen->input_toggle_icon_width = surface->w;
-    screen->input_toggle_icon_height = surface->h;
-    scrcpy_icon_destroy(surface);
-    return true;
+static void
+sc_screen_invalidate_layout(struct sc_screen *screen) {
+    ++screen->layout_gen;
 }
 
-static bool
-sc_screen_load_input_toggle_button_bg(struct sc_screen *screen) {
-    const char *path = getenv(UI_INPUT_TOGGLE_BUTTON_BG_PATH_ENV);
-    if (!path || !*path) {
-        return true;
-    }
+// Recompute the content rect (and the UI rects) if the geometry changed since
+// the last call
+static void
+sc_screen_update_content_rect(struct sc_screen *screen) {
+    assert(screen->video);
 
-    SDL_Surface *surface = scrcpy_icon_load_from_path(path);
-    if (!surface) {
-        LOGW("Could not load input toggle button background: %s", path);
-        return false;
+    if (screen->content_rect_gen == screen->layout_gen) {
+        return;
     }
+    screen->content_rect_gen = screen->layout_gen;
 
-    SDL_Texture *texture =
-        SDL_CreateTextureFromSurface(screen->display.renderer, surface);
-    if (!texture) {
-        LOGW("Could not create input toggle button background texture: %s",
-             SDL_GetError());
-        scrcpy_icon_destroy(surface);
-        return false;
-    }
+    // The layout is invalidated whenever the geometry may have changed
+    sc_screen_update_window_sizes(screen);
 
-    screen->input_toggle_button_bg = texture;
-    screen->input_toggle_button_bg_width = surface->w;
-    screen->input_toggle_button_bg_height = surface->h;
-    scrcpy_icon_destroy(surface);
-    return true;
-}
+    sc_screen_update_ui_rects(screen);
+    sc_screen_compute_content_rect(screen);
 
-static bool
-sc_screen_load_settings_icon(struct sc_screen *screen) {
-    const char *path = getenv(UI_SETTINGS_ICON_PATH_ENV);
-    if (!path || !*path) {
-        return true;
+    const SDL_Rect *rect = &screen->rect;
+    if (!rect->w || !rect->h) {
+        return;
     }
 
-    SDL_Surface *surface = scrcpy_icon_load_from_path(path);
-    if (!surface) {
-        LOGW("Could not load settings icon: %s", path);
-        return false;
+    if (screen->auto_size) {
+        sc_screen_schedule_auto_size(screen);
     }
 
-    SDL_Texture *texture =
-        SDL_CreateTextureFromSurface(screen->display.renderer, surface);
-    if (!texture) {
-        LOGW("Could not create settings icon texture: %s", SDL_GetError());
-        scrcpy_icon_destroy(surface);
-        return false;
+    // Computed once here rather than on each input event
+    sc_coords_transform_init(&screen->drawable_to_frame, rect->x, rect->y,
+                             rect->w, rect->h, screen->content_size,
+                             screen->orientation);
+    screen->window_to_frame = screen->drawable_to_frame;
+    if (screen->window_size.width && screen->window_size.height) {
+        sc_coords_transform_scale_input(&screen->window_to_frame,
+                                        screen->window_size,
+                                        screen->drawable_size);
     }
-
-    screen->settings_icon = texture;
-    screen->settings_icon_width = surface->w;
-    screen->settings_icon_height = surface->h;
-    scrcpy_icon_destroy(surface);
-    return true;
 }
 
 // render the texture to the renderer
@@ -652,7 +662,7 @@ sc_screen_load_settings_icon(struct sc_screen *screen) {
 static void
 sc_screen_draw_idle_placeholder(struct sc_screen *screen) {
     SDL_Renderer *renderer = screen->display.renderer;
-    SDL_Rect mirror = sc_screen_get_mirror_slot(screen);
+    SDL_Rect mirror = screen->mirror_slot;
     if (!mirror.w || !mirror.h) {
         return;
     }
@@ -675,122 +685,73 @@ sc_screen_draw_idle_placeholder(struct sc_screen *screen) {
     }
 }
 
-static const uint8_t *
-sc_screen_get_button_glyph(char c) {
-    static const uint8_t glyph_space[7] = {0, 0, 0, 0, 0, 0, 0};
-    static const uint8_t glyph_a[7] = {
-        0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11,
-    };
-    static const uint8_t glyph_b[7] = {
-        0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E,
-    };
-    static const uint8_t glyph_c[7] = {
-        0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E,
-    };
-    static const uint8_t glyph_d[7] = {
-        0x1E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x1E,
-    };
-    static const uint8_t glyph_e[7] = {
-        0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F,
-    };
-    static const uint8_t glyph_f[7] = {
-        0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10,
-    };
-    static const uint8_t glyph_g[7] = {
-        0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0E,
-    };
-    static const uint8_t glyph_h[7] = {
-        0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11,
-    };
-    static const uint8_t glyph_i[7] = {
-        0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x1F,
-    };
-    static const uint8_t glyph_k[7] = {
-        0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11,
-    };
-    static const uint8_t glyph_l[7] = {
-        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F,
-    };
-    static const uint8_t glyph_n[7] = {
-        0x11, 0x19, 0x15, 0x13, 0x11, 0x11, 0x11,
-    };
-    static const uint8_t glyph_o[7] = {
-        0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E,
-    };
-    static const uint8_t glyph_m[7] = {
-        0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11,
-    };
-    static const uint8_t glyph_p[7] = {
-        0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10,
-    };
-    static const uint8_t glyph_r[7] = {
-        0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11,
-    };
-    static const uint8_t glyph_s[7] = {
-        0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E,
-    };
-    static const uint8_t glyph_t[7] = {
-        0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
-    };
-    static const uint8_t glyph_u[7] = {
-        0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E,
-    };
-    static const uint8_t glyph_v[7] = {
-        0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04,
-    };
-    static const uint8_t glyph_y[7] = {
-        0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04,
-    };
+#ifdef __APPLE__
+// Return the cached texture for the text, rasterizing it on cache miss (the
+// least recently used entry is evicted)
+//
+// The point size is expressed in drawable pixels, so it already depends on
+// the HiDPI scale.
+static const struct sc_screen_text_cache_entry *
+sc_screen_get_text_texture(struct sc_screen *screen, const char *font_path,
+                           const char *text, int point_size, uint8_t r,
+                           uint8_t g, uint8_t b) {
+    uint32_t now = ++screen->text_cache_clock;
+
+    struct sc_screen_text_cache_entry *lru = &screen->text_cache[0];
+    for (size_t i = 0; i < SC_SCREEN_TEXT_CACHE_SIZE; ++i) {
+        struct sc_screen_text_cache_entry *entry = &screen->text_cache[i];
+        if (entry->texture
+                && entry->point_size == point_size
+                && entry->r == r
+                && entry->g == g
+                && entry->b == b
+                && !strcmp(entry->value, text)) {
+            entry->last_used = now;
+            return entry;
+        }
 
-    switch (toupper((unsigned char) c)) {
-        case ' ':
-            return glyph_space;
-        case 'A':
-            return glyph_a;
-        case 'B':
-            return glyph_b;
-        case 'C':
-            return glyph_c;
-        case 'D':
-            return glyph_d;
-        case 'E':
-            return glyph_e;
-        case 'F':
-            return glyph_f;
-        case 'G':
-            return glyph_g;
-        case 'H':
-            return glyph_h;
-        case 'I':
-            return glyph_i;
-        case 'K':
-            return glyph_k;
-        case 'L':
-            return glyph_l;
-        case 'M':
-            return glyph_m;
-        case 'N':
-            return glyph_n;
-        case 'O':
-            return glyph_o;
-        case 'P':
-            return glyph_p;
-        case 'R':
-            return glyph_r;
-        case 'S':
-            return glyph_s;
-        case 'T':
-            return glyph_t;
-        case 'U':
-            return glyph_u;
-        case 'V':
-            return glyph_v;
-        case 'Y':
-            return glyph_y;
-        default:
-            return glyph_space;
+        if (lru->texture
+                && (!entry->texture || entry->last_used < lru->last_used)) {
+            lru = entry;
+        }
+    }
+
+    if (strlen(text) >= sizeof(lru->value)) {
+        // Could not be matched by the next lookups
+        LOGW("UI text too long to be cached: %s", text);
+        return NULL;
+    }
+
+    uint16_t tex_w = 0;
+    uint16_t tex_h = 0;
+    SDL_Texture *texture = sc_darwin_font_create_text_texture(
+        screen->display.renderer, font_path, text, r, g, b, point_size,
+        &tex_w, &tex_h);
+    if (!texture) {
+        return NULL;
+    }
+
+    if (!tex_w || !tex_h) {
+        SDL_DestroyTexture(texture);
+        return NULL;
     }
+
+    if (lru->texture) {
+        SDL_DestroyTexture(lru->texture);
+    }
+
+    lru->texture = texture;
+    lru->width = tex_w;
+    lru->height = tex_h;
+    lru->point_size = point_size;
+    lru->r = r;
+    lru->g = g;
+    lru->b = b;
+    lru->last_used = now;
+    memcpy(lru->value, text, strlen(text) + 1);
+    return lru;
 }
+#endif
 
 static void
 sc_screen_draw_text_centered(struct sc_screen *screen, const SDL_Rect *area,
@@ -805,41 +766,12 @@ sc_screen_draw_text_centered(struct sc_screen *screen, const SDL_Rect *area,
     const char *font_path = getenv(UI_FONT_PATH_ENV);
     if (font_path && *font_path) {
         int point_size = CLAMP(area->h * 3 / 4, 8, 96);
-        bool cache_hit = screen->text_cache_texture
-                      && screen->text_cache_point_size == point_size
-                      && screen->text_cache_r == r
-                      && screen->text_cache_g == g
-                      && screen->text_cache_b == b
-                      && !strcmp(screen->text_cache_value, text);
-
-        if (!cache_hit) {
-            if (screen->text_cache_texture) {
-                SDL_DestroyTexture(screen->text_cache_texture);
-                screen->text_cache_texture = NULL;
-            }
-
-            uint16_t tex_w = 0;
-            uint16_t tex_h = 0;
-            SDL_Texture *texture = sc_darwin_font_create_text_texture(
-                renderer, font_path, text, r, g, b, point_size, &tex_w, &tex_h);
-            if (texture) {
-                screen->text_cache_texture = texture;
-                screen->text_cache_width = tex_w;
-                screen->text_cache_height = tex_h;
-                screen->text_cache_point_size = point_size;
-                screen->text_cache_r = r;
-                screen->text_cache_g = g;
-                screen->text_cache_b = b;
-                snprintf(screen->text_cache_value,
-                         sizeof(screen->text_cache_value), "%s", text);
-            }
-        }
-
-        if (screen->text_cache_texture
-                && screen->text_cache_width
-                && screen->text_cache_height) {
-            int tex_w = screen->text_cache_width;
-            int tex_h = screen->text_cache_height;
+        const struct sc_screen_text_cache_entry *entry =
+            sc_screen_get_text_texture(screen, font_path, text, point_size,
+                                       r, g, b);
+        if (entry) {
+            int tex_w = entry->width;
+            int tex_h = entry->height;
             bool fit_width = (int64_t) area->w * tex_h
                            <= (int64_t) area->h * tex_w;
             SDL_Rect dst;
@@ -855,7 +787,7 @@ sc_screen_draw_text_centered(struct sc_screen *screen, const SDL_Rect *area,
                 dst.y = area->y;
             }
 
-            SDL_RenderCopy(renderer, screen->text_cache_texture, NULL, &dst);
+            SDL_RenderCopy(renderer, entry->texture, NULL, &dst);
             return;
         }
     }
@@ -863,38 +795,20 @@ sc_screen_draw_text_centered(struct sc_screen *screen, const SDL_Rect *area,
 
     int padding = MAX(2, area->h / 8);
     int max_scale_w =
-        (area->w - 2 * padding) / (int) (len * 5 + (len - 1));
-    int max_scale_h = (area->h - 2 * padding) / 7;
+        (area->w - 2 * padding) / (int) (len * SC_UI_GLYPH_WIDTH + (len - 1));
+    int max_scale_h = (area->h - 2 * padding) / SC_UI_GLYPH_HEIGHT;
     int scale = MAX(1, MIN(max_scale_w, max_scale_h));
 
-    int glyph_width = 5 * scale;
+    int glyph_width = SC_UI_GLYPH_WIDTH * scale;
     int spacing = scale;
     int text_width = (int) len * glyph_width + (int) (len - 1) * spacing;
-    int text_height = 7 * scale;
+    int text_height = SC_UI_GLYPH_HEIGHT * scale;
     int start_x = area->x + (area->w - text_width) / 2;
     int start_y = area->y + (area->h - text_height) / 2;
 
     SDL_SetRenderDrawColor(renderer, r, g, b, 255);
-
-    int x = start_x;
-    for (size_t i = 0; i < len; ++i) {
-        const uint8_t *rows = sc_screen_get_button_glyph(text[i]);
-        for (int row = 0; row < 7; ++row) {
-            for (int col = 0; col < 5; ++col) {
-                if (!(rows[row] & (1 << (4 - col)))) {
-                    continue;
-                }
-                SDL_Rect pixel = {
-                    .x = x + col * scale,
-                    .y = start_y + row * scale,
-                    .w = scale,
-                    .h = scale,
-                };
-                SDL_RenderFillRect(renderer, &pixel);
-            }
-        }
-        x += glyph_width + spacing;
-    }
+    sc_ui_atlas_draw_text(&screen->ui_atlas, text, start_x, start_y, scale,
+                          spacing);
 }
 
 static SDL_Rect
@@ -966,9 +880,27 @@ sc_screen_get_screenshot_button_feedback_progress(struct sc_screen *screen) {
     return 1.0f - sc_ease_cubic_0_04_04_1(phase);
 }
 
+// Draw a panel icon, return false if it is not available
+static bool
+sc_screen_draw_ui_icon(struct sc_screen *screen, enum sc_ui_icon icon,
+                       const SDL_Rect *dst, uint8_t r, uint8_t g, uint8_t b,
+                       uint8_t a) {
+    const SDL_Rect *src = sc_ui_icons_get(&screen->ui_icons, icon);
+    if (!src) {
+        return false;
+    }
+
+    // All the icons share the same texture, set both modulations each time
+    SDL_Texture *texture = screen->ui_icons.texture;
+    SDL_SetTextureColorMod(texture, r, g, b);
+    SDL_SetTextureAlphaMod(texture, a);
+    SDL_RenderCopy(screen->display.renderer, texture, src, dst);
+    return true;
+}
+
 static void
 sc_screen_draw_button_icon(struct sc_screen *screen, const SDL_Rect *button) {
-    if (!screen->screenshot_icon) {
+    if (!sc_ui_icons_get(&screen->ui_icons, SC_UI_ICON_SCREENSHOT)) {
         return;
     }
 
@@ -981,21 +913,17 @@ sc_screen_draw_button_icon(struct sc_screen *screen, const SDL_Rect *button) {
     uint8_t camera_alpha = (uint8_t) ((1.0f - progress) * 255.0f);
     uint8_t check_alpha = (uint8_t) (progress * 255.0f);
 
-    SDL_SetTextureColorMod(screen->screenshot_icon, 40, 40, 48);
-    SDL_SetTextureAlphaMod(screen->screenshot_icon, camera_alpha);
-    SDL_RenderCopy(screen->display.renderer, screen->screenshot_icon, NULL, &dst);
-
-    if (screen->screenshot_check_icon && check_alpha) {
-        SDL_SetTextureColorMod(screen->screenshot_check_icon, 40, 40, 48);
-        SDL_SetTextureAlphaMod(screen->screenshot_check_icon, check_alpha);
-        SDL_RenderCopy(screen->display.renderer, screen->screenshot_check_icon,
-                       NULL, &dst);
+    sc_screen_draw_ui_icon(screen, SC_UI_ICON_SCREENSHOT, &dst, 40, 40, 48,
+                           camera_alpha);
+    if (check_alpha) {
+        sc_screen_draw_ui_icon(screen, SC_UI_ICON_SCREENSHOT_CHECK, &dst, 40,
+                               40, 48, check_alpha);
     }
 }
 
 static void
 sc_screen_draw_toggle_icon(struct sc_screen *screen, const SDL_Rect *button) {
-    if (!screen->input_toggle_icon) {
+    if (!sc_ui_icons_get(&screen->ui_icons, SC_UI_ICON_INPUT_TOGGLE)) {
         return;
     }
 
@@ -1014,14 +942,13 @@ sc_screen_draw_toggle_icon(struct sc_screen *screen, const SDL_Rect *button) {
         .h = icon_h,
     };
 
-    SDL_SetTextureColorMod(screen->input_toggle_icon, 40, 40, 48);
-    SDL_RenderCopy(screen->display.renderer, screen->input_toggle_icon, NULL,
-                   &dst);
+    sc_screen_draw_ui_icon(screen, SC_UI_ICON_INPUT_TOGGLE, &dst, 40, 40, 48,
+                           255);
 }
 
 static void
 sc_screen_draw_settings_icon(struct sc_screen *screen, const SDL_Rect *button) {
-    if (!screen->settings_icon) {
+    if (!sc_ui_icons_get(&screen->ui_icons, SC_UI_ICON_SETTINGS)) {
         sc_screen_draw_text_centered(screen, button, "S", 40, 40, 48);
         return;
     }
@@ -1041,8 +968,7 @@ sc_screen_draw_settings_icon(struct sc_screen *screen, const SDL_Rect *button) {
         .h = icon_h,
     };
 
-    SDL_SetTextureColorMod(screen->settings_icon, 40, 40, 48);
-    SDL_RenderCopy(screen->display.renderer, screen->settings_icon, NULL, &dst);
+    sc_screen_draw_ui_icon(screen, SC_UI_ICON_SETTINGS, &dst, 40, 40, 48, 255);
 }
 
 #ifndef __APPLE__
@@ -1069,7 +995,7 @@ sc_screen_draw_settings_menu_item(struct sc_screen *screen,
     }
 
     SDL_SetRenderDrawColor(screen->display.renderer, r, g, b, 255);
-    sc_screen_fill_rounded_rect(screen->display.renderer, rect, rect->h / 2);
+    sc_ui_atlas_fill_rounded_rect(&screen->ui_atlas, rect, rect->h / 2);
 
     if (selected) {
         sc_screen_draw_text_centered(screen, rect, label, 40, 40, 48);
@@ -1085,8 +1011,8 @@ sc_screen_draw_settings_menu(struct sc_screen *screen) {
     }
 
     SDL_SetRenderDrawColor(screen->display.renderer, 44, 44, 48, 255);
-    sc_screen_fill_rounded_rect(screen->display.renderer, &screen->settings_menu_rect,
-                                screen->settings_menu_rect.h / 8);
+    sc_ui_atlas_fill_rounded_rect(&screen->ui_atlas, &screen->settings_menu_rect,
+                                  screen->settings_menu_rect.h / 8);
 
     sc_screen_draw_settings_menu_item(screen, &screen->settings_menu_copy_rect,
                                       UI_SETTINGS_COPY_LABEL,
@@ -1106,6 +1032,11 @@ sc_screen_draw_settings_menu(struct sc_screen *screen) {
                                           == SC_SCREENSHOT_ACTION_SEND_TO_FIGMA_BRIDGE,
                                       screen->settings_menu_figma_hovered);
 
+    // An action, not a screenshot destination: never selected
+    sc_screen_draw_settings_menu_item(screen, &screen->settings_menu_clip_rect,
+                                      UI_SETTINGS_CLIP_LABEL, false,
+                                      screen->settings_menu_clip_hovered);
+
     const char *folder_label = screen->screenshot_directory[0]
                              ? UI_SETTINGS_FOLDER_SET_LABEL
                              : UI_SETTINGS_FOLDER_LABEL;
@@ -1121,6 +1052,7 @@ sc_screen_close_settings_menu(struct sc_screen *screen) {
     screen->settings_menu_copy_hovered = false;
     screen->settings_menu_save_hovered = false;
     screen->settings_menu_figma_hovered = false;
+    screen->settings_menu_clip_hovered = false;
     screen->settings_menu_directory_hovered = false;
 }
 
@@ -1131,74 +1063,18 @@ sc_color_lerp(uint8_t from, uint8_t to, float t) {
     return (uint8_t) mixed;
 }
 
+// Draw the panel background and buttons, translated by -offset_x
 static void
-sc_screen_fill_circle(SDL_Renderer *renderer, int cx, int cy, int radius) {
-    for (int y = -radius; y <= radius; ++y) {
-        int dx = radius;
-        while (dx > 0 && dx * dx + y * y > radius * radius) {
-            --dx;
-        }
-        SDL_Rect row = {
-            .x = cx - dx,
-            .y = cy + y,
-            .w = 2 * dx + 1,
-            .h = 1,
-        };
-        SDL_RenderFillRect(renderer, &row);
-    }
-}
-
-static void
-sc_screen_fill_rounded_rect(SDL_Renderer *renderer, const SDL_Rect *rect,
-                            int radius) {
-    radius = CLAMP(radius, 0, MIN(rect->w, rect->h) / 2);
-    if (!radius) {
-        SDL_RenderFillRect(renderer, rect);
-        return;
-    }
-
-    SDL_Rect middle = {
-        .x = rect->x + radius,
-        .y = rect->y,
-        .w = rect->w - 2 * radius,
-        .h = rect->h,
-    };
-    SDL_Rect left = {
-        .x = rect->x,
-        .y = rect->y + radius,
-        .w = radius,
-        .h = rect->h - 2 * radius,
-    };
-    SDL_Rect right = {
-        .x = rect->x + rect->w - radius,
-        .y = rect->y + radius,
-        .w = radius,
-        .h = rect->h - 2 * radius,
-    };
-    SDL_RenderFillRect(renderer, &middle);
-    SDL_RenderFillRect(renderer, &left);
-    SDL_RenderFillRect(renderer, &right);
-
-    sc_screen_fill_circle(renderer, rect->x + radius, rect->y + radius, radius);
-    sc_screen_fill_circle(renderer, rect->x + rect->w - radius - 1,
-                          rect->y + radius, radius);
-    sc_screen_fill_circle(renderer, rect->x + radius,
-                          rect->y + rect->h - radius - 1, radius);
-    sc_screen_fill_circle(renderer, rect->x + rect->w - radius - 1,
-                          rect->y + rect->h - radius - 1, radius);
-}
-
-static void
-sc_screen_draw_panel(struct sc_screen *screen) {
+sc_screen_draw_panel_chrome(struct sc_screen *screen, int offset_x) {
     SDL_Renderer *renderer = screen->display.renderer;
-    if (!screen->panel_rect.w) {
-        return;
-    }
 
+    SDL_Rect panel = screen->panel_rect;
+    panel.x -= offset_x;
     SDL_SetRenderDrawColor(renderer, 50, 50, 50, 255);
-    SDL_RenderFillRect(renderer, &screen->panel_rect);
+    SDL_RenderFillRect(renderer, &panel);
 
     SDL_Rect button = screen->screenshot_button_rect;
+    button.x -= offset_x;
     bool enabled = screen->has_frame;
 
     uint8_t r = 196;
@@ -1226,16 +1102,15 @@ sc_screen_draw_panel(struct sc_screen *screen) {
         b = sc_color_lerp(b, 89, feedback);
     }
 
-    if (screen->screenshot_button_bg) {
-        SDL_SetTextureColorMod(screen->screenshot_button_bg, r, g, b);
-        SDL_RenderCopy(renderer, screen->screenshot_button_bg, NULL, &button);
-    } else {
+    if (!sc_screen_draw_ui_icon(screen, SC_UI_ICON_SCREENSHOT_BUTTON_BG,
+                                &button, r, g, b, 255)) {
         SDL_SetRenderDrawColor(renderer, r, g, b, 255);
-        sc_screen_fill_rounded_rect(renderer, &button, button.w / 2);
+        sc_ui_atlas_fill_rounded_rect(&screen->ui_atlas, &button, button.w / 2);
     }
     sc_screen_draw_button_icon(screen, &button);
 
     SDL_Rect toggle = screen->input_toggle_button_rect;
+    toggle.x -= offset_x;
     uint8_t tr;
     uint8_t tg;
     uint8_t tb;
@@ -1267,16 +1142,15 @@ sc_screen_draw_panel(struct sc_screen *screen) {
         }
     }
 
-    if (screen->input_toggle_button_bg) {
-        SDL_SetTextureColorMod(screen->input_toggle_button_bg, tr, tg, tb);
-        SDL_RenderCopy(renderer, screen->input_toggle_button_bg, NULL, &toggle);
-    } else {
+    if (!sc_screen_draw_ui_icon(screen, SC_UI_ICON_INPUT_TOGGLE_BUTTON_BG,
+                                &toggle, tr, tg, tb, 255)) {
         SDL_SetRenderDrawColor(renderer, tr, tg, tb, 255);
-        sc_screen_fill_rounded_rect(renderer, &toggle, toggle.w / 2);
+        sc_ui_atlas_fill_rounded_rect(&screen->ui_atlas, &toggle, toggle.w / 2);
     }
     sc_screen_draw_toggle_icon(screen, &toggle);
 
     SDL_Rect settings = screen->settings_button_rect;
+    settings.x -= offset_x;
     uint8_t sr = 217;
     uint8_t sg = 217;
     uint8_t sb = 217;
@@ -1290,18 +1164,419 @@ sc_screen_draw_panel(struct sc_screen *screen) {
         sb = 229;
     }
 
-    if (screen->input_toggle_button_bg) {
-        SDL_SetTextureColorMod(screen->input_toggle_button_bg, sr, sg, sb);
-        SDL_RenderCopy(renderer, screen->input_toggle_button_bg, NULL, &settings);
-    } else {
+    if (!sc_screen_draw_ui_icon(screen, SC_UI_ICON_INPUT_TOGGLE_BUTTON_BG,
+                                &settings, sr, sg, sb, 255)) {
         SDL_SetRenderDrawColor(renderer, sr, sg, sb, 255);
-        sc_screen_fill_rounded_rect(renderer, &settings, settings.w / 2);
+        sc_ui_atlas_fill_rounded_rect(&screen->ui_atlas, &settings, settings.w / 2);
     }
     sc_screen_draw_settings_icon(screen, &settings);
 
-#ifndef __APPLE__
-    sc_screen_draw_settings_menu(screen);
+    if (screen->push_total) {
+        // Progress of the files dropped to the device, above the settings
+        // button
+        int height =
+            MAX(1, scale_window_to_drawable(screen, UI_PUSH_PROGRESS_HEIGHT,
+                                            false));
+        int gap = scale_window_to_drawable(screen, UI_PUSH_PROGRESS_GAP, false);
+        SDL_Rect track = {
+            .x = screen->screenshot_button_rect.x - offset_x,
+            .y = MAX(0, settings.y - gap - height),
+            .w = screen->screenshot_button_rect.w,
+            .h = height,
+        };
+        SDL_SetRenderDrawColor(renderer, 80, 80, 80, 255);
+        SDL_RenderFillRect(renderer, &track);
+
+        SDL_Rect bar = track;
+        bar.w = (int64_t) track.w * screen->push_done / screen->push_total;
+        if (bar.w) {
+            SDL_SetRenderDrawColor(renderer, 255, 199, 0, 255);
+            SDL_RenderFillRect(renderer, &bar);
+        }
+    }
+
+    if (screen->screenshot_pending_writes) {
+        // Screenshots still being written to the directory, below the
+        // screenshot button (red once no more screenshots can be saved)
+        int height =
+            MAX(1, scale_window_to_drawable(screen, UI_PUSH_PROGRESS_HEIGHT,
+                                            false));
+        int gap = scale_window_to_drawable(screen, UI_PUSH_PROGRESS_GAP, false);
+        SDL_Rect track = {
+            .x = button.x,
+            .y = button.y + button.h + gap,
+            .w = button.w,
+            .h = height,
+        };
+        SDL_SetRenderDrawColor(renderer, 80, 80, 80, 255);
+        SDL_RenderFillRect(renderer, &track);
+
+        unsigned pending = MIN(screen->screenshot_pending_writes,
+                               SC_SCREENSHOT_WRITER_MAX_PENDING);
+        SDL_Rect bar = track;
+        bar.w = (int64_t) track.w * pending / SC_SCREENSHOT_WRITER_MAX_PENDING;
+        if (pending == SC_SCREENSHOT_WRITER_MAX_PENDING) {
+            SDL_SetRenderDrawColor(renderer, 235, 87, 87, 255);
+        } else {
+            SDL_SetRenderDrawColor(renderer, 255, 199, 0, 255);
+        }
+        SDL_RenderFillRect(renderer, &bar);
+    }
+}
+
+static void
+sc_screen_get_panel_state(struct sc_screen *screen,
+                          struct sc_screen_panel_state *state) {
+    // Zero the padding too, the states are compared with memcmp()
+    memset(state, 0, sizeof(*state));
+    state->panel_rect = screen->panel_rect;
+    state->screenshot_button_rect = screen->screenshot_button_rect;
+    state->input_toggle_button_rect = screen->input_toggle_button_rect;
+    state->settings_button_rect = screen->settings_button_rect;
+    state->screenshot_button_feedback =
+        sc_screen_get_screenshot_button_feedback_progress(screen);
+    state->has_frame = screen->has_frame;
+    state->screenshot_button_hovered = screen->screenshot_button_hovered;
+    state->screenshot_button_pressed = screen->screenshot_button_pressed;
+    state->input_toggle_button_hovered = screen->input_toggle_button_hovered;
+    state->input_toggle_button_pressed = screen->input_toggle_button_pressed;
+    state->settings_button_hovered = screen->settings_button_hovered;
+    state->settings_button_pressed = screen->settings_button_pressed;
+    state->settings_menu_open = screen->settings_menu_open;
+    state->input_enabled = screen->input_enabled;
+    state->push_done = screen->push_done;
+    state->push_total = screen->push_total;
+    state->screenshot_pending_writes = screen->screenshot_pending_writes;
+}
+
+// Redraw the cached panel texture if the panel state changed
+//
+// Return false if the panel could not be rendered to a texture, in that case
+// it must be drawn directly.
+static bool
+sc_screen_update_panel_texture(struct sc_screen *screen) {
+    SDL_Renderer *renderer = screen->display.renderer;
+    if (!SDL_RenderTargetSupported(renderer)) {
+        return false;
+    }
+
+    struct sc_screen_panel_state state;
+    sc_screen_get_panel_state(screen, &state);
+    if (screen->panel_texture_valid
+            && !memcmp(&state, &screen->panel_texture_state, sizeof(state))) {
+        // Up-to-date, nothing to draw
+        return true;
+    }
+
+    int width = screen->panel_rect.w;
+    int height = screen->panel_rect.h;
+    // The texture height is rounded up, so that it is not recreated on every
+    // step of a live resize (only the top of the texture is used)
+    int texture_height = (height + UI_PANEL_TEXTURE_HEIGHT_STEP - 1)
+                       / UI_PANEL_TEXTURE_HEIGHT_STEP
+                       * UI_PANEL_TEXTURE_HEIGHT_STEP;
+    if (!screen->panel_texture || screen->panel_texture_size.width != width
+            || screen->panel_texture_size.height < height
+            || screen->panel_texture_size.height
+                >= height + 2 * UI_PANEL_TEXTURE_HEIGHT_STEP) {
+        if (screen->panel_texture) {
+            SDL_DestroyTexture(screen->panel_texture);
+        }
+        screen->panel_texture_valid = false;
+        screen->panel_texture =
+            SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+                              SDL_TEXTUREACCESS_TARGET, width,
+                              texture_height);
+        if (!screen->panel_texture) {
+            LOGW("Could not create panel texture: %s", SDL_GetError());
+            return false;
+        }
+        screen->panel_texture_size.width = width;
+        screen->panel_texture_size.height = texture_height;
+    }
+
+    if (SDL_SetRenderTarget(renderer, screen->panel_texture)) {
+        LOGW("Could not set render target: %s", SDL_GetError());
+        return false;
+    }
+
+    sc_screen_draw_panel_chrome(screen, screen->panel_rect.x);
+
+    SDL_SetRenderTarget(renderer, NULL);
+
+    screen->panel_texture_state = state;
+    screen->panel_texture_valid = true;
+    return true;
+}
+
+static void
+sc_screen_draw_panel(struct sc_screen *screen) {
+    if (!screen->panel_rect.w || !screen->panel_rect.h) {
+        return;
+    }
+
+    if (sc_screen_update_panel_texture(screen)) {
+        SDL_Rect src = {
+            .x = 0,
+            .y = 0,
+            .w = screen->panel_rect.w,
+            .h = screen->panel_rect.h,
+        };
+        SDL_RenderCopy(screen->display.renderer, screen->panel_texture, &src,
+                       &screen->panel_rect);
+    } else {
+        sc_screen_draw_panel_chrome(screen, 0);
+    }
+
+#ifndef __APPLE__
+    // The menu overlaps the video, it is drawn directly (only while open)
+    sc_screen_draw_settings_menu(screen);
+#endif
+}
+
+#ifdef __APPLE__
+static_assert(sizeof(SC_SCREEN_STATS_CHARS) - 1
+                  <= SC_DARWIN_FONT_GLYPH_ATLAS_MAX_CHARS,
+              "Too many stats overlay characters");
+
+// Return the glyphs of the custom UI font for the stats overlay, rasterized
+// only when the point size changes
+//
+// The overlay text changes on every refresh, so it must not go through the
+// text texture cache (which would rasterize and evict an entry each time).
+static const struct sc_screen_stats_glyphs *
+sc_screen_get_stats_glyphs(struct sc_screen *screen, const char *font_path,
+                           uint16_t point_size) {
+    struct sc_screen_stats_glyphs *glyphs = &screen->stats_glyphs;
+    if (glyphs->point_size != point_size) {
+        if (glyphs->texture) {
+            SDL_DestroyTexture(glyphs->texture);
+        }
+
+        // On error, do not retry on every frame for the same point size
+        glyphs->point_size = point_size;
+        glyphs->texture = sc_darwin_font_create_glyph_atlas(
+            screen->display.renderer, font_path, SC_SCREEN_STATS_CHARS,
+            point_size, glyphs->x, &glyphs->height);
+        if (!glyphs->texture) {
+            LOGW("Could not rasterize the stats overlay glyphs");
+        }
+    }
+
+    return glyphs->texture ? glyphs : NULL;
+}
+
+// Unsupported characters are rendered as a space
+static unsigned
+sc_screen_get_stats_glyph_index(char c) {
+    const char *p = strchr(SC_SCREEN_STATS_CHARS, c);
+    return p && *p ? p - SC_SCREEN_STATS_CHARS : 0;
+}
+
+static int
+sc_screen_get_stats_glyph_width(const struct sc_screen_stats_glyphs *glyphs,
+                                unsigned index) {
+    // Exclude the gutter
+    return glyphs->x[index + 1] - glyphs->x[index] - 1;
+}
+
+static int
+sc_screen_get_stats_text_width(const struct sc_screen_stats_glyphs *glyphs,
+                               const char *text) {
+    int width = 0;
+    for (const char *c = text; *c; ++c) {
+        unsigned index = sc_screen_get_stats_glyph_index(*c);
+        width += sc_screen_get_stats_glyph_width(glyphs, index);
+    }
+    return width;
+}
+
+static void
+sc_screen_draw_stats_text(struct sc_screen *screen,
+                          const struct sc_screen_stats_glyphs *glyphs,
+                          const char *text, int x, int y) {
+    for (const char *c = text; *c; ++c) {
+        unsigned index = sc_screen_get_stats_glyph_index(*c);
+        int width = sc_screen_get_stats_glyph_width(glyphs, index);
+        if (*c != ' ') {
+            SDL_Rect src = {
+                .x = glyphs->x[index],
+                .y = 0,
+                .w = width,
+                .h = glyphs->height,
+            };
+            SDL_Rect dst = {
+                .x = x,
+                .y = y,
+                .w = width,
+                .h = glyphs->height,
+            };
+            SDL_RenderCopy(screen->display.renderer, glyphs->texture, &src,
+                           &dst);
+        }
+        x += width;
+    }
+}
 #endif
+
+static void
+sc_screen_draw_stats_background(struct sc_screen *screen, const SDL_Rect *bg) {
+    SDL_Renderer *renderer = screen->display.renderer;
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 160);
+    SDL_RenderFillRect(renderer, bg);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+}
+
+static const char *
+sc_screen_get_thermal_status_name(uint32_t status) {
+    // android.os.PowerManager.THERMAL_STATUS_* (SHUTDOWN, the last one, is
+    // displayed as "MAX", since the glyphs have no 'W')
+    static const char *const names[] = {
+        "NONE", "LIGHT", "MODERATE", "SEVERE", "CRITICAL", "EMERGENCY",
+    };
+    return status < ARRAY_LEN(names) ? names[status] : "MAX";
+}
+
+// Draw the session metrics over the video, while the FPS counter is started
+static void
+sc_screen_draw_stats(struct sc_screen *screen) {
+    struct sc_stats_sample sample;
+    if (!sc_fps_counter_get_sample(&screen->fps_counter, &sample)) {
+        return;
+    }
+
+    const uint32_t *v = sample.values;
+    uint32_t video_kbps = (uint64_t) v[SC_STAT_VIDEO_BYTES] * 8 / 1000;
+    uint32_t audio_kbps = (uint64_t) v[SC_STAT_AUDIO_BYTES] * 8 / 1000;
+
+    char lines[7][64];
+    snprintf(lines[0], sizeof(lines[0]), "VIDEO %" PRIu32 ".%02" PRIu32
+             " MBIT/S %" PRIu32 " PKT/S", video_kbps / 1000,
+             video_kbps % 1000 / 10, v[SC_STAT_VIDEO_PACKETS]);
+    snprintf(lines[1], sizeof(lines[1]), "AUDIO %" PRIu32 " KBIT/S",
+             audio_kbps);
+    snprintf(lines[2], sizeof(lines[2]), "DECODED %" PRIu32 "/S DROPPED %"
+             PRIu32 "/S", v[SC_STAT_FRAMES_DECODED],
+             v[SC_STAT_VIDEO_PACKETS_DROPPED]);
+    snprintf(lines[3], sizeof(lines[3]), "RENDERED %" PRIu32 "/S SKIPPED %"
+             PRIu32 "/S", v[SC_STAT_FRAMES_RENDERED],
+             v[SC_STAT_FRAMES_SKIPPED]);
+    snprintf(lines[4], sizeof(lines[4]), "CONTROL QUEUE %" PRIu32
+             " RECORD QUEUE %" PRIu32, v[SC_STAT_CONTROLLER_QUEUE],
+             v[SC_STAT_RECORDER_QUEUE]);
+    snprintf(lines[5], sizeof(lines[5]), "MEMORY RECORD %" PRIu32
+             " KB DELAY %" PRIu32 " KB", v[SC_STAT_RECORDER_QUEUE_BYTES] / 1024,
+             v[SC_STAT_DELAY_BUFFER_BYTES] / 1024);
+    unsigned count = 6;
+
+    // The thermal state is only known if reported by the device (the values
+    // are stored + 1)
+    uint32_t thermal_status = v[SC_STAT_THERMAL_STATUS];
+    uint32_t thermal_headroom = v[SC_STAT_THERMAL_HEADROOM_PCT];
+    if (thermal_status) {
+        // The UI glyphs have no '%', the headroom is written as a ratio
+        char headroom[32] = "";
+        if (thermal_headroom) {
+            snprintf(headroom, sizeof(headroom), " HEADROOM %" PRIu32 ".%02"
+                     PRIu32, (thermal_headroom - 1) / 100,
+                     (thermal_headroom - 1) % 100);
+        }
+        snprintf(lines[count++], sizeof(lines[0]), "THERMAL %s%s THROTTLE %"
+                 PRIu32, sc_screen_get_thermal_status_name(thermal_status - 1),
+                 headroom, v[SC_STAT_THERMAL_THROTTLE] - 1);
+    }
+
+    int scale = MAX(1, scale_window_to_drawable(screen, 2, false));
+    int margin = 4 * scale;
+
+#ifdef __APPLE__
+    const char *font_path = getenv(UI_FONT_PATH_ENV);
+    if (font_path && *font_path) {
+        uint16_t point_size = CLAMP(10 * scale, 8, 96);
+        const struct sc_screen_stats_glyphs *glyphs =
+            sc_screen_get_stats_glyphs(screen, font_path, point_size);
+        if (glyphs) {
+            int max_width = 0;
+            for (unsigned i = 0; i < count; ++i) {
+                int width = sc_screen_get_stats_text_width(glyphs, lines[i]);
+                max_width = MAX(max_width, width);
+            }
+
+            SDL_Rect bg = {
+                .x = screen->rect.x,
+                .y = screen->rect.y,
+                .w = max_width + 2 * margin,
+                .h = (int) count * glyphs->height + 2 * margin,
+            };
+            sc_screen_draw_stats_background(screen, &bg);
+
+            // The glyphs are white
+            for (unsigned i = 0; i < count; ++i) {
+                sc_screen_draw_stats_text(screen, glyphs, lines[i],
+                                          bg.x + margin, bg.y + margin
+                                              + (int) i * glyphs->height);
+            }
+            return;
+        }
+    }
+#endif
+
+    int line_height = (SC_UI_GLYPH_HEIGHT + 3) * scale;
+    size_t max_len = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        max_len = MAX(max_len, strlen(lines[i]));
+    }
+
+    SDL_Rect bg = {
+        .x = screen->rect.x,
+        .y = screen->rect.y,
+        .w = (int) max_len * (SC_UI_GLYPH_WIDTH + 1) * scale + 2 * margin,
+        .h = (int) count * line_height + 2 * margin - 3 * scale,
+    };
+
+    sc_screen_draw_stats_background(screen, &bg);
+
+    SDL_SetRenderDrawColor(screen->display.renderer, 255, 255, 255, 255);
+    for (unsigned i = 0; i < count; ++i) {
+        sc_ui_atlas_draw_text(&screen->ui_atlas, lines[i], bg.x + margin,
+                              bg.y + margin + (int) i * line_height, scale,
+                              scale);
+    }
+}
+
+// Draw the selection of the region to capture, while it is dragged
+static void
+sc_screen_draw_region_select(struct sc_screen *screen) {
+    if (!screen->region_select_active) {
+        return;
+    }
+
+    int32_t x0 = screen->region_select_start.x;
+    int32_t y0 = screen->region_select_start.y;
+    int32_t x1 = screen->region_select_end.x;
+    int32_t y1 = screen->region_select_end.y;
+    sc_screen_hidpi_scale_coords(screen, &x0, &y0);
+    sc_screen_hidpi_scale_coords(screen, &x1, &y1);
+
+    SDL_Rect selection = {
+        .x = MIN(x0, x1),
+        .y = MIN(y0, y1),
+        .w = abs(x1 - x0) + 1,
+        .h = abs(y1 - y0) + 1,
+    };
+    SDL_Rect rect;
+    if (!SDL_IntersectRect(&selection, &screen->rect, &rect)) {
+        return;
+    }
+
+    SDL_Renderer *renderer = screen->display.renderer;
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 48);
+    SDL_RenderFillRect(renderer, &rect);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    SDL_RenderDrawRect(renderer, &rect);
 }
 
 static enum sc_display_result
@@ -1309,8 +1584,9 @@ sc_screen_draw_video(struct sc_screen *screen, bool update_content_rect) {
     assert(screen->video);
 
     if (update_content_rect) {
-        sc_screen_update_content_rect(screen);
+        sc_screen_invalidate_layout(screen);
     }
+    sc_screen_update_content_rect(screen);
 
     SDL_SetRenderDrawColor(screen->display.renderer, 28, 28, 28, 255);
     enum sc_display_result res = sc_display_render(&screen->display,
@@ -1332,6 +1608,8 @@ sc_screen_draw_video(struct sc_screen *screen, bool update_content_rect) {
             sc_screen_draw_text_centered(screen, &label_area, UI_SECURE_LABEL,
                                          255, 255, 255);
         }
+        sc_screen_draw_stats(screen);
+        sc_screen_draw_region_select(screen);
         sc_screen_draw_panel(screen);
     }
     return res;
@@ -1339,10 +1617,25 @@ sc_screen_draw_video(struct sc_screen *screen, bool update_content_rect) {
 
 static void
 sc_screen_render(struct sc_screen *screen, bool update_content_rect) {
+    sc_tick start = sc_trace_begin();
     enum sc_display_result res = sc_screen_draw_video(screen,
                                                       update_content_rect);
+    sc_trace_end("render", start);
     if (res == SC_DISPLAY_RESULT_OK) {
+        start = sc_trace_begin();
         sc_display_present(&screen->display);
+        sc_trace_end("present", start);
+        screen->last_present = sc_tick_now();
+        if (screen->latency) {
+            sc_latency_on_presented(screen->latency);
+        }
+        if (screen->input_latency) {
+            sc_input_latency_on_presented(screen->input_latency);
+        }
+        if (screen->latency_probe) {
+            sc_latency_probe_on_presented(screen->latency_probe,
+                                          screen->im.controller);
+        }
     }
     (void) res; // any error already logged
 }
@@ -1378,7 +1671,17 @@ sc_screen_render_current_state(struct sc_screen *screen, bool update_content) {
         return;
     }
 
-    if (!screen->window_focused) {
+    if (!sc_screen_is_visible(screen)) {
+        return;
+    }
+
+    if (screen->frame_upload_skipped) {
+        if (update_content) {
+            sc_screen_invalidate_layout(screen);
+        }
+        sc_screen_update_content_rect(screen);
+        // This also renders
+        sc_screen_apply_frame(screen);
         return;
     }
 
@@ -1403,129 +1706,73 @@ sc_screen_set_input_enabled(struct sc_screen *screen, bool enabled) {
     sc_mouse_capture_set_active(&screen->mc, capture_active);
 }
 
+static uint32_t
+sc_screen_on_animation_timer(uint32_t interval, void *userdata) {
+    (void) userdata;
+
+    // Coalesced: if the main thread is late, the ticks are not accumulated
+    sc_notify_event(SC_EVENT_SCREEN_ANIMATION_TICK);
+
+    // Periodic timer, removed by the main thread once the animation is done
+    return interval;
+}
+
+static void
+sc_screen_stop_animation_timer(struct sc_screen *screen) {
+    if (screen->animation_timer) {
+        SDL_RemoveTimer(screen->animation_timer);
+        screen->animation_timer = 0;
+    }
+}
+
 static void
 sc_screen_animate_screenshot_button_feedback(struct sc_screen *screen) {
     if (!screen->video || !screen->panel_rect.w) {
         return;
     }
 
+    // The progress only depends on the elapsed time, so the animation does not
+    // block the event loop: any render (on a new frame or on a tick) draws its
+    // current state
     screen->screenshot_button_feedback_active = true;
     screen->screenshot_button_feedback_start_ms = SDL_GetTicks();
-    while (true) {
-        uint32_t now = SDL_GetTicks();
-        uint32_t elapsed = now - screen->screenshot_button_feedback_start_ms;
-        if (elapsed >= UI_BUTTON_FEEDBACK_DURATION_MS) {
-            break;
-        }
-        screen->screenshot_button_feedback_progress =
-            sc_screen_get_screenshot_button_feedback_progress(screen);
-        sc_screen_render_current_state(screen, false);
-        SDL_Delay(16);
-    }
-    screen->screenshot_button_feedback_active = false;
-    screen->screenshot_button_feedback_progress = 0.0f;
-    sc_screen_render_current_state(screen, false);
-}
-
-static bool
-sc_screen_capture_screenshot_rgba(struct sc_screen *screen, uint8_t **pixels_out,
-                                  size_t *pitch_out, int *width_out,
-                                  int *height_out) {
-    assert(screen->video);
-    assert(pixels_out && pitch_out && width_out && height_out);
-
-    if (!screen->has_frame || !screen->frame) {
-        LOGW("No video frame available to capture");
-        return false;
-    }
 
-    int width = screen->frame->width;
-    int height = screen->frame->height;
-    if (width <= 0 || height <= 0) {
-        LOGW("Invalid screenshot size");
-        return false;
-    }
-
-    if ((size_t) width > SIZE_MAX / 4u) {
-        LOGW("Screenshot size is too large");
-        return false;
-    }
-
-    size_t pitch = (size_t) width * 4;
-    if ((size_t) height > SIZE_MAX / pitch) {
-        LOGW("Screenshot buffer is too large");
-        return false;
-    }
-
-    size_t size = (size_t) height * pitch;
-    uint8_t *pixels = malloc(size);
-    if (!pixels) {
-        LOG_OOM();
-        return false;
-    }
-
-    struct SwsContext *sws_ctx =
-        sws_getContext(width, height, screen->frame->format,
-                       width, height, AV_PIX_FMT_RGBA, SWS_BILINEAR,
-                       NULL, NULL, NULL);
-    if (!sws_ctx) {
-        free(pixels);
-        LOGW("Could not initialize conversion context for screenshot");
-        return false;
-    }
-
-    uint8_t *dst_data[4] = {pixels, NULL, NULL, NULL};
-    int dst_linesize[4] = {(int) pitch, 0, 0, 0};
-    int ret = sws_scale(sws_ctx,
-                        (const uint8_t * const *) screen->frame->data,
-                        screen->frame->linesize,
-                        0, height,
-                        dst_data, dst_linesize);
-    sws_freeContext(sws_ctx);
-
-    if (ret <= 0) {
-        free(pixels);
-        LOGW("Could not convert frame for screenshot");
-        return false;
+    if (!screen->animation_timer) {
+        screen->animation_timer =
+            SDL_AddTimer(UI_ANIMATION_TICK_MS, sc_screen_on_animation_timer,
+                         NULL);
+        if (!screen->animation_timer) {
+            LOGW("Could not add animation timer: %s", SDL_GetError());
+        }
     }
 
-    *pixels_out = pixels;
-    *pitch_out = pitch;
-    *width_out = width;
-    *height_out = height;
-    return true;
+    sc_screen_render_current_state(screen, false);
 }
 
-static bool
-sc_screen_copy_screenshot_to_clipboard(struct sc_screen *screen) {
-    assert(screen->video);
-
-    uint8_t *pixels = NULL;
-    size_t pitch = 0;
-    int width = 0;
-    int height = 0;
-    bool prepared =
-        sc_screen_capture_screenshot_rgba(screen, &pixels, &pitch, &width,
-                                          &height);
-    if (!prepared) {
-        return false;
-    }
+static void
+sc_screen_on_animation_tick(struct sc_screen *screen) {
+    if (screen->screenshot_button_feedback_active) {
+        uint32_t elapsed =
+            SDL_GetTicks() - screen->screenshot_button_feedback_start_ms;
+        if (elapsed < UI_BUTTON_FEEDBACK_DURATION_MS) {
+            // If a frame has just been presented, it already contains the
+            // current state of the panel
+            sc_tick since_present = sc_tick_now() - screen->last_present;
+            if (since_present >= SC_TICK_FROM_MS(UI_ANIMATION_TICK_MS)) {
+                // The video texture is reused as is, only the panel texture
+                // is redrawn
+                sc_screen_render_current_state(screen, false);
+            }
+            return;
+        }
 
-    bool ok = false;
-#ifdef __APPLE__
-    ok = sc_darwin_clipboard_set_image_rgba8888(pixels, pitch, width, height);
-    if (!ok) {
-        LOGW("Could not copy screenshot image to the macOS clipboard");
+        screen->screenshot_button_feedback_active = false;
+        screen->screenshot_button_feedback_progress = 0.0f;
+        sc_screen_render_current_state(screen, false);
     }
-#else
-    LOGW("Screenshot clipboard image is only implemented on macOS");
-#endif
-    free(pixels);
 
-    if (ok) {
-        LOGI("Screenshot copied to clipboard (%dx%d)", width, height);
-    }
-    return ok;
+    // No animation is running anymore
+    sc_screen_stop_animation_timer(screen);
 }
 
 static bool
@@ -1545,214 +1792,263 @@ sc_screen_choose_screenshot_directory(struct sc_screen *screen) {
 #endif
 }
 
-static bool
-sc_screen_save_screenshot_to_directory(struct sc_screen *screen) {
-    assert(screen->video);
-
-#ifndef __APPLE__
-    LOGW("Saving screenshots to files is only implemented on macOS");
-    return false;
-#else
-    if (!screen->screenshot_directory[0]
-            && !sc_screen_choose_screenshot_directory(screen)) {
-        return false;
+static void
+sc_screen_send_clip(struct sc_screen *screen) {
+    if (!screen->bridge_clip) {
+        LOGW("Clips require the Figma Bridge and the video stream");
+        return;
     }
 
-    uint8_t *pixels = NULL;
-    size_t pitch = 0;
-    int width = 0;
-    int height = 0;
-    bool prepared =
-        sc_screen_capture_screenshot_rgba(screen, &pixels, &pitch, &width,
-                                          &height);
-    if (!prepared) {
+    // Remuxed asynchronously
+    sc_bridge_clip_request(screen->bridge_clip);
+}
+
+static bool
+sc_screen_request_device_screenshot(struct sc_screen *screen,
+                                    enum sc_screenshot_action action,
+                                    const struct sc_screenshot_region *region) {
+    if (screen->device_screenshot_pending) {
+        LOGW("A device screenshot is already pending");
         return false;
     }
 
-    time_t now = time(NULL);
-    struct tm local_tm = {0};
-#ifdef _WIN32
-    localtime_s(&local_tm, &now);
-#else
-    localtime_r(&now, &local_tm);
-#endif
-    uint32_t millis = SDL_GetTicks() % 1000;
-
-    char filename[128];
-    snprintf(filename, sizeof(filename),
-             "screenshot_%04d%02d%02d_%02d%02d%02d_%03u_%dx%d.png",
-             local_tm.tm_year + 1900, local_tm.tm_mon + 1, local_tm.tm_mday,
-             local_tm.tm_hour, local_tm.tm_min, local_tm.tm_sec,
-             (unsigned) millis, width, height);
-
-    char output_path[sizeof(screen->screenshot_directory) + sizeof(filename) + 2];
-    int written = snprintf(output_path, sizeof(output_path), "%s/%s",
-                           screen->screenshot_directory, filename);
-    if (written < 0 || (size_t) written >= sizeof(output_path)) {
-        free(pixels);
-        LOGW("Screenshot output path is too long");
+    if (!screen->im.controller) {
+        LOGW("Device screenshots require control");
         return false;
     }
 
-    bool ok = sc_darwin_write_png_rgba8888(output_path, pixels, pitch, width,
-                                           height);
-    free(pixels);
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_CAPTURE_SCREENSHOT;
 
-    if (!ok) {
-        LOGW("Could not save screenshot to %s", output_path);
+    if (!sc_controller_push_msg(screen->im.controller, &msg)) {
+        LOGW("Could not request 'capture screenshot'");
         return false;
     }
 
-    LOGI("Screenshot saved to %s", output_path);
+    // Delivered on SC_EVENT_DEVICE_SCREENSHOT
+    screen->device_screenshot_pending = true;
+    screen->device_screenshot_action = action;
+    screen->device_screenshot_has_region = region;
+    if (region) {
+        screen->device_screenshot_region = *region;
+    }
     return true;
-#endif
 }
 
-static bool
-sc_screen_read_binary_file(const char *path, uint8_t **data_out,
-                           size_t *size_out) {
-    FILE *file = fopen(path, "rb");
-    if (!file) {
-        return false;
+static void
+sc_screen_on_device_screenshot(struct sc_screen *screen, uint8_t *png,
+                               size_t size) {
+    if (!screen->device_screenshot_pending) {
+        LOGW("Unexpected device screenshot, ignored");
+        free(png);
+        return;
     }
 
-    if (fseek(file, 0, SEEK_END)) {
-        fclose(file);
-        return false;
-    }
+    screen->device_screenshot_pending = false;
 
-    long file_size = ftell(file);
-    if (file_size <= 0) {
-        fclose(file);
-        return false;
+    if (!png) {
+        LOGW("Could not capture screenshot on the device");
+        return;
     }
 
-    if (fseek(file, 0, SEEK_SET)) {
-        fclose(file);
-        return false;
+    const struct sc_screenshot_region *region =
+        screen->device_screenshot_has_region ? &screen->device_screenshot_region
+                                             : NULL;
+
+    // The PNG is decoded, cropped, converted and delivered by the worker
+    sc_screenshot_worker_request_png(&screen->screenshot_worker,
+                                     screen->device_screenshot_action, png,
+                                     size, region, screen->screenshot_directory);
+}
+
+// Capture the whole frame, or only `region` (in frame coordinates) if not NULL
+static bool
+sc_screen_take_screenshot(struct sc_screen *screen, bool force_clipboard,
+                          const struct sc_screenshot_region *region) {
+    assert(screen->video);
+
+    enum sc_screenshot_action action = screen->screenshot_action;
+    if (force_clipboard) {
+        action = SC_SCREENSHOT_ACTION_COPY_TO_CLIPBOARD;
     }
 
-    size_t size = (size_t) file_size;
-    uint8_t *data = malloc(size);
-    if (!data) {
-        fclose(file);
-        LOG_OOM();
+    if (!screen->screenshot_worker_initialized) {
+        LOGW("Screenshots are unavailable");
         return false;
     }
 
-    size_t r = fread(data, 1, size, file);
-    fclose(file);
-    if (r != size) {
-        free(data);
+    if (!screen->has_frame || !screen->frame) {
+        LOGW("No video frame available to capture");
         return false;
     }
 
-    *data_out = data;
-    *size_out = size;
-    return true;
-}
-
-static bool
-sc_screen_send_screenshot_to_figma_bridge(struct sc_screen *screen) {
-    assert(screen->video);
-
+    if (action == SC_SCREENSHOT_ACTION_SAVE_TO_DIRECTORY) {
+        if (screen->screenshot_pending_writes
+                >= SC_SCREENSHOT_WRITER_MAX_PENDING) {
+            // Back-pressure: the directory cannot keep up
+            LOGW("Too many screenshots being saved, please wait");
+            return false;
+        }
 #ifndef __APPLE__
-    (void) screen;
-    LOGW("Figma Bridge is only implemented on macOS");
-    return false;
-#else
-    if (!screen->figma_bridge_ready) {
-        LOGW("Figma Bridge is unavailable");
+        LOGW("Saving screenshots to files is only implemented on macOS");
         return false;
+#else
+        // The directory chooser must run on the main thread
+        if (!screen->screenshot_directory[0]
+                && !sc_screen_choose_screenshot_directory(screen)) {
+            return false;
+        }
+#endif
     }
 
-    uint8_t *pixels = NULL;
-    size_t pitch = 0;
-    int width = 0;
-    int height = 0;
-    bool prepared =
-        sc_screen_capture_screenshot_rgba(screen, &pixels, &pitch, &width,
-                                          &height);
-    if (!prepared) {
-        return false;
+    if (screen->screenshot_from_device) {
+        return sc_screen_request_device_screenshot(screen, action, region);
     }
 
-    char tmp_path[] = "/tmp/scrcpy_ui_figma_bridge_XXXXXX";
-    int fd = mkstemp(tmp_path);
-    if (fd == -1) {
-        free(pixels);
-        LOGW("Could not create temporary file for Figma Bridge screenshot");
-        return false;
+    if (screen->screenshot_gpu_readback && !screen->frame_upload_skipped) {
+        // The frame is already converted to RGB by the GPU for rendering,
+        // read it back instead of converting it again on the CPU
+        uint8_t *pixels;
+        size_t pitch;
+        struct sc_size size;
+        if (sc_display_read_frame_rgba(&screen->display, &pixels, &pitch,
+                                       &size)) {
+            return sc_screenshot_worker_request_rgba(
+                    &screen->screenshot_worker, action, pixels, pitch,
+                    size.width, size.height, region,
+                    screen->screenshot_directory);
+        }
+        LOGD("GPU readback failed, fallback to CPU conversion");
     }
-    close(fd);
 
-    bool saved = sc_darwin_write_png_rgba8888(tmp_path, pixels, pitch, width,
-                                              height);
-    free(pixels);
-    if (!saved) {
-        unlink(tmp_path);
-        LOGW("Could not encode screenshot for Figma Bridge");
-        return false;
+    // The conversion, encoding and delivery are performed asynchronously, the
+    // button feedback is animated on SC_EVENT_SCREENSHOT_DONE
+    return sc_screenshot_worker_request(&screen->screenshot_worker, action,
+                                        screen->frame->frame, region,
+                                        screen->screenshot_directory);
+}
+
+static void
+sc_screen_arm_region_select(struct sc_screen *screen) {
+    if (!screen->has_frame) {
+        return;
     }
 
-    uint8_t *png_data = NULL;
-    size_t png_size = 0;
-    bool read_ok = sc_screen_read_binary_file(tmp_path, &png_data, &png_size);
-    unlink(tmp_path);
-    if (!read_ok) {
-        LOGW("Could not read Figma Bridge screenshot data");
-        return false;
+    screen->region_select_armed = true;
+    screen->region_select_active = false;
+    LOGI("Drag over the video to select the region to capture (Esc to cancel)");
+}
+
+static void
+sc_screen_cancel_region_select(struct sc_screen *screen) {
+    bool was_active = screen->region_select_active;
+    screen->region_select_armed = false;
+    screen->region_select_active = false;
+    if (was_active) {
+        sc_screen_render_current_state(screen, false);
     }
+}
 
-    bool ok =
-        sc_figma_bridge_publish_png(&screen->figma_bridge, png_data, png_size,
-                                    (uint16_t) width, (uint16_t) height);
-    free(png_data);
-    if (!ok) {
-        LOGW("Could not queue screenshot to Figma Bridge");
-        return false;
+// Capture the selected region, converted to frame coordinates
+static void
+sc_screen_capture_region_select(struct sc_screen *screen) {
+    struct sc_point p0 =
+        sc_screen_convert_window_to_frame_coords(screen,
+                                                 screen->region_select_start.x,
+                                                 screen->region_select_start.y);
+    struct sc_point p1 =
+        sc_screen_convert_window_to_frame_coords(screen,
+                                                 screen->region_select_end.x,
+                                                 screen->region_select_end.y);
+
+    // The frame may be rotated on screen, so the corners may be swapped
+    int32_t fw = screen->frame_size.width;
+    int32_t fh = screen->frame_size.height;
+    int32_t x0 = CLAMP(MIN(p0.x, p1.x), 0, fw);
+    int32_t y0 = CLAMP(MIN(p0.y, p1.y), 0, fh);
+    int32_t x1 = CLAMP(MAX(p0.x, p1.x), 0, fw);
+    int32_t y1 = CLAMP(MAX(p0.y, p1.y), 0, fh);
+    if (x1 - x0 < UI_REGION_SELECT_MIN_SIZE
+            || y1 - y0 < UI_REGION_SELECT_MIN_SIZE) {
+        LOGI("Selected region too small, screenshot cancelled");
+        return;
     }
 
-    LOGI("Screenshot queued to Figma Bridge (http://127.0.0.1:%u/scrcpy-bridge/latest)",
-         (unsigned) sc_figma_bridge_get_port(&screen->figma_bridge));
-    return true;
-#endif
+    struct sc_screenshot_region region = {
+        .ref_size = screen->frame_size,
+        .point = {x0, y0},
+        .size = {x1 - x0, y1 - y0},
+    };
+    sc_screen_take_screenshot(screen, false, &region);
 }
 
+// Handle the events while the region selection is armed
+//
+// Return true if the event is consumed.
 static bool
-sc_screen_take_screenshot(struct sc_screen *screen, bool force_clipboard) {
-    enum sc_screenshot_action action = screen->screenshot_action;
-    if (force_clipboard) {
-        action = SC_SCREENSHOT_ACTION_COPY_TO_CLIPBOARD;
-    }
+sc_screen_handle_region_select_event(struct sc_screen *screen,
+                                     const SDL_Event *event) {
+    assert(screen->region_select_armed);
 
-    bool ok;
-    switch (action) {
-        case SC_SCREENSHOT_ACTION_COPY_TO_CLIPBOARD:
-            ok = sc_screen_copy_screenshot_to_clipboard(screen);
-            break;
-        case SC_SCREENSHOT_ACTION_SAVE_TO_DIRECTORY:
-            ok = sc_screen_save_screenshot_to_directory(screen);
-            break;
-        case SC_SCREENSHOT_ACTION_SEND_TO_FIGMA_BRIDGE:
-            ok = sc_screen_send_screenshot_to_figma_bridge(screen);
-            break;
+    switch (event->type) {
+        case SDL_KEYDOWN:
+            if (event->key.keysym.sym == SDLK_ESCAPE) {
+                sc_screen_cancel_region_select(screen);
+                LOGI("Region screenshot cancelled");
+                return true;
+            }
+            return false;
+        case SDL_MOUSEMOTION:
+            if (!screen->region_select_active) {
+                return false;
+            }
+            screen->region_select_end.x = event->motion.x;
+            screen->region_select_end.y = event->motion.y;
+            sc_screen_render_current_state(screen, false);
+            return true;
+        case SDL_MOUSEBUTTONDOWN: {
+            if (event->button.button != SDL_BUTTON_LEFT) {
+                return true;
+            }
+            int32_t x = event->button.x;
+            int32_t y = event->button.y;
+            sc_screen_hidpi_scale_coords(screen, &x, &y);
+            SDL_Point p = {x, y};
+            if (!screen->has_frame || !SDL_PointInRect(&p, &screen->rect)) {
+                // Clicking outside the video cancels the selection
+                sc_screen_cancel_region_select(screen);
+                return false;
+            }
+            screen->region_select_active = true;
+            screen->region_select_start.x = event->button.x;
+            screen->region_select_start.y = event->button.y;
+            screen->region_select_end = screen->region_select_start;
+            sc_screen_render_current_state(screen, false);
+            return true;
+        }
+        case SDL_MOUSEBUTTONUP:
+            if (event->button.button != SDL_BUTTON_LEFT
+                    || !screen->region_select_active) {
+                return screen->region_select_active;
+            }
+            screen->region_select_end.x = event->button.x;
+            screen->region_select_end.y = event->button.y;
+            sc_screen_cancel_region_select(screen);
+            if (screen->has_frame) {
+                sc_screen_capture_region_select(screen);
+            }
+            return true;
         default:
-            ok = false;
-            break;
-    }
-
-    if (ok) {
-        sc_screen_animate_screenshot_button_feedback(screen);
+            return false;
     }
-    return ok;
 }
 
 static bool
 sc_screen_handle_panel_event(struct sc_screen *screen, const SDL_Event *event) {
     assert(screen->video);
 
-    sc_screen_update_ui_rects(screen);
+    // The layout is updated on resize and on connection state change, not on
+    // each event
     if (!screen->panel_rect.w) {
         screen->sidebar_drag_armed = false;
         screen->sidebar_drag_active = false;
@@ -1806,25 +2102,18 @@ sc_screen_handle_panel_event(struct sc_screen *screen, const SDL_Event *event) {
             int32_t x = event->motion.x;
             int32_t y = event->motion.y;
             sc_screen_hidpi_scale_coords(screen, &x, &y);
+            enum sc_screen_ui_target target = sc_screen_hit_test(screen, x, y);
             bool in_button = screen->has_frame
-                          && point_in_rect(x, y, &screen->screenshot_button_rect);
-            bool in_toggle = point_in_rect(x, y, &screen->input_toggle_button_rect);
-            bool in_settings = point_in_rect(x, y, &screen->settings_button_rect);
-            bool in_panel = point_in_rect(x, y, &screen->panel_rect);
-            bool in_menu = screen->settings_menu_open
-                        && point_in_rect(x, y, &screen->settings_menu_rect);
-            bool in_menu_copy = in_menu
-                             && point_in_rect(x, y,
-                                              &screen->settings_menu_copy_rect);
-            bool in_menu_save = in_menu
-                             && point_in_rect(x, y,
-                                              &screen->settings_menu_save_rect);
-            bool in_menu_figma = in_menu
-                              && point_in_rect(x, y,
-                                               &screen->settings_menu_figma_rect);
-            bool in_menu_dir = in_menu
-                            && point_in_rect(x, y,
-                                             &screen->settings_menu_directory_rect);
+                && target == SC_SCREEN_UI_TARGET_SCREENSHOT_BUTTON;
+            bool in_toggle = target == SC_SCREEN_UI_TARGET_INPUT_TOGGLE;
+            bool in_settings = target == SC_SCREEN_UI_TARGET_SETTINGS_BUTTON;
+            bool in_panel = target != SC_SCREEN_UI_TARGET_NONE
+                         && !sc_screen_ui_target_is_menu(target);
+            bool in_menu_copy = target == SC_SCREEN_UI_TARGET_MENU_COPY;
+            bool in_menu_save = target == SC_SCREEN_UI_TARGET_MENU_SAVE;
+            bool in_menu_figma = target == SC_SCREEN_UI_TARGET_MENU_FIGMA;
+            bool in_menu_clip = target == SC_SCREEN_UI_TARGET_MENU_CLIP;
+            bool in_menu_dir = target == SC_SCREEN_UI_TARGET_MENU_DIRECTORY;
 
             if (in_button != screen->screenshot_button_hovered
                     || in_toggle != screen->input_toggle_button_hovered
@@ -1832,6 +2121,7 @@ sc_screen_handle_panel_event(struct sc_screen *screen, const SDL_Event *event) {
                     || in_menu_copy != screen->settings_menu_copy_hovered
                     || in_menu_save != screen->settings_menu_save_hovered
                     || in_menu_figma != screen->settings_menu_figma_hovered
+                    || in_menu_clip != screen->settings_menu_clip_hovered
                     || in_menu_dir != screen->settings_menu_directory_hovered) {
                 screen->screenshot_button_hovered = in_button;
                 screen->input_toggle_button_hovered = in_toggle;
@@ -1839,6 +2129,7 @@ sc_screen_handle_panel_event(struct sc_screen *screen, const SDL_Event *event) {
                 screen->settings_menu_copy_hovered = in_menu_copy;
                 screen->settings_menu_save_hovered = in_menu_save;
                 screen->settings_menu_figma_hovered = in_menu_figma;
+                screen->settings_menu_clip_hovered = in_menu_clip;
                 screen->settings_menu_directory_hovered = in_menu_dir;
                 if (!in_button) {
                     screen->screenshot_button_pressed = false;
@@ -1861,25 +2152,18 @@ sc_screen_handle_panel_event(struct sc_screen *screen, const SDL_Event *event) {
             int32_t x = event->button.x;
             int32_t y = event->button.y;
             sc_screen_hidpi_scale_coords(screen, &x, &y);
-            bool in_panel = point_in_rect(x, y, &screen->panel_rect);
+            enum sc_screen_ui_target target = sc_screen_hit_test(screen, x, y);
+            bool in_menu = sc_screen_ui_target_is_menu(target);
+            bool in_panel = target != SC_SCREEN_UI_TARGET_NONE && !in_menu;
             bool in_button = screen->has_frame
-                          && point_in_rect(x, y, &screen->screenshot_button_rect);
-            bool in_toggle = point_in_rect(x, y, &screen->input_toggle_button_rect);
-            bool in_settings = point_in_rect(x, y, &screen->settings_button_rect);
-            bool in_menu = screen->settings_menu_open
-                        && point_in_rect(x, y, &screen->settings_menu_rect);
-            bool in_menu_copy = in_menu
-                             && point_in_rect(x, y,
-                                              &screen->settings_menu_copy_rect);
-            bool in_menu_save = in_menu
-                             && point_in_rect(x, y,
-                                              &screen->settings_menu_save_rect);
-            bool in_menu_figma = in_menu
-                              && point_in_rect(x, y,
-                                               &screen->settings_menu_figma_rect);
-            bool in_menu_dir = in_menu
-                            && point_in_rect(x, y,
-                                             &screen->settings_menu_directory_rect);
+                && target == SC_SCREEN_UI_TARGET_SCREENSHOT_BUTTON;
+            bool in_toggle = target == SC_SCREEN_UI_TARGET_INPUT_TOGGLE;
+            bool in_settings = target == SC_SCREEN_UI_TARGET_SETTINGS_BUTTON;
+            bool in_menu_copy = target == SC_SCREEN_UI_TARGET_MENU_COPY;
+            bool in_menu_save = target == SC_SCREEN_UI_TARGET_MENU_SAVE;
+            bool in_menu_figma = target == SC_SCREEN_UI_TARGET_MENU_FIGMA;
+            bool in_menu_clip = target == SC_SCREEN_UI_TARGET_MENU_CLIP;
+            bool in_menu_dir = target == SC_SCREEN_UI_TARGET_MENU_DIRECTORY;
 
             if (event->button.button == SDL_BUTTON_LEFT) {
                 bool down = event->type == SDL_MOUSEBUTTONDOWN;
@@ -1938,8 +2222,10 @@ sc_screen_handle_panel_event(struct sc_screen *screen, const SDL_Event *event) {
                     bool activate = in_button;
                     screen->screenshot_button_pressed = false;
                     sc_screen_render_current_state(screen, false);
-                    if (activate) {
-                        sc_screen_take_screenshot(screen, false);
+                    if (activate && (SDL_GetModState() & KMOD_SHIFT)) {
+                        sc_screen_arm_region_select(screen);
+                    } else if (activate) {
+                        sc_screen_take_screenshot(screen, false, NULL);
                     }
                     return true;
                 }
@@ -1970,6 +2256,7 @@ sc_screen_handle_panel_event(struct sc_screen *screen, const SDL_Event *event) {
                                 event->button.y,
                                 save_selected,
                                 figma_selected,
+                                screen->bridge_clip != NULL,
                                 screen->screenshot_directory[0]
                                     ? screen->screenshot_directory
                                     : NULL);
@@ -1993,6 +2280,9 @@ sc_screen_handle_panel_event(struct sc_screen *screen, const SDL_Event *event) {
                                 screen->screenshot_action =
                                     SC_SCREENSHOT_ACTION_SEND_TO_FIGMA_BRIDGE;
                                 break;
+                            case SC_DARWIN_SETTINGS_MENU_ACTION_SEND_CLIP_TO_FIGMA_BRIDGE:
+                                sc_screen_send_clip(screen);
+                                break;
                             case SC_DARWIN_SETTINGS_MENU_ACTION_NONE:
                             default:
                                 break;
@@ -2022,6 +2312,9 @@ sc_screen_handle_panel_event(struct sc_screen *screen, const SDL_Event *event) {
                         screen->screenshot_action =
                             SC_SCREENSHOT_ACTION_SEND_TO_FIGMA_BRIDGE;
                         sc_screen_close_settings_menu(screen);
+                    } else if (in_menu_clip) {
+                        sc_screen_send_clip(screen);
+                        sc_screen_close_settings_menu(screen);
                     } else if (in_menu_dir) {
                         sc_screen_choose_screenshot_directory(screen);
                         sc_screen_close_settings_menu(screen);
@@ -2073,14 +2366,96 @@ event_watcher(void *data, SDL_Event *event) {
 
     if (event->type == SDL_WINDOWEVENT
             && event->window.event == SDL_WINDOWEVENT_RESIZED) {
+        // Throttled to the display refresh rate: rendering more often is only
+        // wasted (the final size is rendered once the main loop handles the
+        // queued resize events)
+        sc_tick now = sc_tick_now();
+        if (screen->live_resize_render_time
+                && now - screen->live_resize_render_time
+                    < screen->frame_period) {
+            return 0;
+        }
+        screen->live_resize_render_time = now;
+        sc_screen_update_window_sizes(screen);
+
         // In practice, it seems to always be called from the same thread in
         // that specific case. Anyway, it's just a workaround.
+        // The current video texture is just scaled, with the cheapest filter.
+        screen->display.fast_scaling = true;
         sc_screen_render_current_state(screen, true);
+        screen->display.fast_scaling = false;
     }
     return 0;
 }
 #endif
 
+static void
+sc_screen_update_frame_period(struct sc_screen *screen) {
+    int refresh_rate = 0;
+
+    int display_index = SDL_GetWindowDisplayIndex(screen->window);
+    SDL_DisplayMode mode;
+    if (display_index >= 0
+            && !SDL_GetCurrentDisplayMode(display_index, &mode)) {
+        refresh_rate = mode.refresh_rate;
+    }
+
+    if (refresh_rate <= 0) {
+        refresh_rate = FRAME_PACING_DEFAULT_REFRESH_RATE;
+    }
+
+    sc_tick period = SC_TICK_FROM_SEC(1) / refresh_rate;
+    if (period != screen->frame_period) {
+        LOGD("Frame pacing: display refresh rate %d Hz", refresh_rate);
+        screen->frame_period = period;
+    }
+}
+
+static uint32_t
+sc_screen_on_frame_pacing_timer(uint32_t interval, void *userdata) {
+    (void) interval;
+    (void) userdata;
+
+    // Wake up the UI thread to render the latest frame
+    sc_notify_event(SC_EVENT_FRAME_PACING_DEADLINE);
+
+    // One-shot timer
+    return 0;
+}
+
+// Return true if the pending frame must be rendered later (the timer to
+// render it on the next display refresh is armed)
+static bool
+sc_screen_defer_frame(struct sc_screen *screen) {
+    assert(screen->frame_pacing);
+    assert(!screen->frame_pacing_waiting);
+
+    if (screen->paused || !screen->has_frame) {
+        return false;
+    }
+
+    sc_tick now = sc_tick_now();
+    sc_tick next_refresh = screen->last_present + screen->frame_period;
+    if (now >= next_refresh - FRAME_PACING_SLACK) {
+        return false;
+    }
+
+    // Round up to the next millisecond
+    uint32_t delay_ms = SC_TICK_TO_MS(next_refresh - now + SC_TICK_FROM_MS(1)
+                                                         - 1);
+    screen->frame_pacing_timer =
+        SDL_AddTimer(delay_ms, sc_screen_on_frame_pacing_timer, NULL);
+    if (!screen->frame_pacing_timer) {
+        LOGW("Could not add frame pacing timer: %s", SDL_GetError());
+        return false;
+    }
+
+    // Meanwhile, new frames replace the pending one in the frame buffer (and
+    // are counted as skipped)
+    screen->frame_pacing_waiting = true;
+    return true;
+}
+
 static bool
 sc_screen_frame_sink_open(struct sc_frame_sink *sink,
                           const AVCodecContext *ctx) {
@@ -2128,16 +2503,19 @@ sc_screen_frame_sink_close(struct sc_frame_sink *sink) {
 }
 
 static bool
-sc_screen_frame_sink_push(struct sc_frame_sink *sink, const AVFrame *frame) {
+sc_screen_frame_sink_push_shared(struct sc_frame_sink *sink,
+                                 struct sc_shared_frame *frame) {
     struct sc_screen *screen = DOWNCAST(sink);
     assert(screen->video);
 
-    bool previous_skipped;
-    bool ok = sc_frame_buffer_push(&screen->fb, frame, &previous_skipped);
-    if (!ok) {
-        return false;
+    if (frame->frame->pts != AV_NOPTS_VALUE) {
+        sc_fps_counter_add_captured_frame(&screen->fps_counter,
+                                          frame->frame->pts);
     }
 
+    bool previous_skipped;
+    sc_frame_buffer_push(&screen->fb, frame, &previous_skipped);
+
     if (previous_skipped) {
         sc_fps_counter_add_skipped_frame(&screen->fps_counter);
         // The SC_EVENT_NEW_FRAME triggered for the previous frame will consume
@@ -2153,6 +2531,26 @@ sc_screen_frame_sink_push(struct sc_frame_sink *sink, const AVFrame *frame) {
     return true;
 }
 
+static void
+sc_screen_frame_sink_push_repeat(struct sc_frame_sink *sink, int64_t pts) {
+    struct sc_screen *screen = DOWNCAST(sink);
+    assert(screen->video);
+
+    // The picture on screen is still up to date: count the frame without
+    // waking up the UI thread (it is not rendered, so it must not inflate the
+    // rendered frames)
+    if (pts != AV_NOPTS_VALUE) {
+        sc_fps_counter_add_captured_frame(&screen->fps_counter, pts);
+    }
+    sc_stats_add(SC_STAT_FRAMES_REPEATED, 1);
+}
+
+static unsigned
+sc_screen_frame_sink_get_backlog(struct sc_frame_sink *sink) {
+    struct sc_screen *screen = DOWNCAST(sink);
+    return sc_frame_buffer_get_skipped_count(&screen->fb);
+}
+
 bool
 sc_screen_init(struct sc_screen *screen,
                const struct sc_screen_params *params) {
@@ -2169,33 +2567,21 @@ sc_screen_init(struct sc_screen *screen,
     screen->settings_menu_copy_rect = (SDL_Rect) {0, 0, 0, 0};
     screen->settings_menu_save_rect = (SDL_Rect) {0, 0, 0, 0};
     screen->settings_menu_figma_rect = (SDL_Rect) {0, 0, 0, 0};
+    screen->settings_menu_clip_rect = (SDL_Rect) {0, 0, 0, 0};
     screen->settings_menu_directory_rect = (SDL_Rect) {0, 0, 0, 0};
-    screen->screenshot_button_bg = NULL;
-    screen->screenshot_button_bg_width = 0;
-    screen->screenshot_button_bg_height = 0;
-    screen->input_toggle_button_bg = NULL;
-    screen->input_toggle_button_bg_width = 0;
-    screen->input_toggle_button_bg_height = 0;
-    screen->screenshot_icon = NULL;
-    screen->screenshot_icon_width = 0;
-    screen->screenshot_icon_height = 0;
-    screen->screenshot_check_icon = NULL;
-    screen->screenshot_check_icon_width = 0;
-    screen->screenshot_check_icon_height = 0;
-    screen->input_toggle_icon = NULL;
-    screen->input_toggle_icon_width = 0;
-    screen->input_toggle_icon_height = 0;
-    screen->settings_icon = NULL;
-    screen->settings_icon_width = 0;
-    screen->settings_icon_height = 0;
-    screen->text_cache_texture = NULL;
-    screen->text_cache_width = 0;
-    screen->text_cache_height = 0;
-    screen->text_cache_point_size = 0;
-    screen->text_cache_r = 0;
-    screen->text_cache_g = 0;
-    screen->text_cache_b = 0;
-    screen->text_cache_value[0] = '\0';
+    screen->hit_region_count = 0;
+    screen->panel_window_x = 0;
+    screen->window_size = (struct sc_size) {0, 0};
+    screen->drawable_size = (struct sc_size) {0, 0};
+    for (size_t i = 0; i < SC_SCREEN_TEXT_CACHE_SIZE; ++i) {
+        screen->text_cache[i].texture = NULL;
+    }
+    screen->text_cache_clock = 0;
+    screen->stats_glyphs.texture = NULL;
+    screen->stats_glyphs.point_size = 0;
+    screen->panel_texture = NULL;
+    screen->panel_texture_size = (struct sc_size) {0, 0};
+    screen->panel_texture_valid = false;
     screen->screenshot_button_hovered = false;
     screen->screenshot_button_pressed = false;
     screen->input_toggle_button_hovered = false;
@@ -2206,6 +2592,7 @@ sc_screen_init(struct sc_screen *screen,
     screen->settings_menu_copy_hovered = false;
     screen->settings_menu_save_hovered = false;
     screen->settings_menu_figma_hovered = false;
+    screen->settings_menu_clip_hovered = false;
     screen->settings_menu_directory_hovered = false;
     screen->sidebar_drag_armed = false;
     screen->sidebar_drag_active = false;
@@ -2213,22 +2600,70 @@ sc_screen_init(struct sc_screen *screen,
     screen->sidebar_drag_mouse_start_y = 0;
     screen->sidebar_drag_window_start_x = 0;
     screen->sidebar_drag_window_start_y = 0;
+    screen->region_select_armed = false;
+    screen->region_select_active = false;
     screen->input_enabled = false;
+    screen->push_done = 0;
+    screen->push_total = 0;
+    screen->screenshot_pending_writes = 0;
     screen->screenshot_action = SC_SCREENSHOT_ACTION_COPY_TO_CLIPBOARD;
     screen->screenshot_directory[0] = '\0';
     screen->figma_bridge_ready = false;
+    screen->figma_relay_ready = false;
+    screen->bridge_clip = NULL;
+    screen->instant_replay = NULL;
+    screen->recorder = NULL;
+    screen->video_decoder = NULL;
+    screen->screenshot_worker_initialized = false;
+    screen->screenshot_gpu_readback = params->screenshot_gpu_readback;
+    screen->expect_nv12 = params->hw_decoder;
+    screen->screenshot_from_device = params->screenshot_from_device;
+    screen->device_screenshot_pending = false;
+    screen->device_screenshot_action = SC_SCREENSHOT_ACTION_COPY_TO_CLIPBOARD;
+    screen->device_screenshot_has_region = false;
     screen->screenshot_button_feedback_active = false;
     screen->screenshot_button_feedback_start_ms = 0;
     screen->screenshot_button_feedback_progress = 0.0f;
     screen->window_focused = true;
+    screen->window_hidden = false;
+    screen->window_occluded = false;
+    screen->frame_upload_skipped = false;
+#ifdef __APPLE__
+    screen->occlusion_observer = NULL;
+#endif
     screen->secure_content_detected = false;
     screen->connection_state = SC_SCREEN_CONNECTION_CONNECTING;
     screen->fullscreen = false;
     screen->maximized = false;
     screen->minimized = false;
+    screen->cached_content_size = (struct sc_size) {0, 0};
+    screen->cached_window_size = (struct sc_size) {0, 0};
     screen->paused = false;
+    screen->frame = NULL;
     screen->resume_frame = NULL;
     screen->orientation = SC_ORIENTATION_0;
+    // content_rect_gen != layout_gen, so that the first update computes it
+    screen->layout_gen = 1;
+    screen->content_rect_gen = 0;
+    screen->mirror_slot = (SDL_Rect) {0, 0, 0, 0};
+    screen->render_scale = params->render_scale;
+    screen->frame_pacing = params->frame_pacing;
+    assert(params->unfocused_decode != SC_DECODE_BUDGET_AUTO);
+    screen->unfocused_decode = params->unfocused_decode;
+    screen->pause_decode = params->pause_decode;
+    screen->latency = params->latency;
+    screen->input_latency = params->input_latency;
+    screen->latency_probe = params->latency_probe;
+    screen->frame_period = 0;
+    screen->live_resize_render_time = 0;
+    screen->last_present = 0;
+    screen->frame_pacing_waiting = false;
+    screen->frame_pacing_timer = 0;
+    screen->auto_size = params->auto_size;
+    screen->auto_size_pending = (struct sc_size) {0, 0};
+    screen->auto_size_sent = (struct sc_size) {0, 0};
+    screen->auto_size_timer = 0;
+    screen->animation_timer = 0;
 
     screen->video = params->video;
 
@@ -2248,6 +2683,10 @@ sc_screen_init(struct sc_screen *screen,
         goto error_destroy_frame_buffer;
     }
 
+    // Decode the panel icons while the window is created and the server
+    // connects; they are uploaded on the first frame
+    sc_ui_icons_init(&screen->ui_icons);
+
     if (screen->video) {
         screen->orientation = params->orientation;
         if (screen->orientation != SC_ORIENTATION_0) {
@@ -2295,6 +2734,8 @@ sc_screen_init(struct sc_screen *screen,
         goto error_destroy_fps_counter;
     }
 
+    sc_screen_update_window_sizes(screen);
+
 #ifdef __APPLE__
     if (!params->window_borderless) {
         bool native_ok =
@@ -2303,6 +2744,16 @@ sc_screen_init(struct sc_screen *screen,
             LOGW("Could not configure native macOS window chrome");
         }
     }
+
+    if (params->video) {
+        // SDL does not report when the window is fully covered
+        screen->occlusion_observer =
+            sc_darwin_window_observe_occlusion(screen->window,
+                                               SC_EVENT_SCREEN_OCCLUSION_CHANGED);
+        if (!screen->occlusion_observer) {
+            LOGW("Could not observe the window occlusion state");
+        }
+    }
 #endif
 
     SDL_Surface *icon = scrcpy_icon_load();
@@ -2320,9 +2771,10 @@ sc_screen_init(struct sc_screen *screen,
     }
 
     SDL_Surface *icon_novideo = params->video ? NULL : icon;
-    bool mipmaps = params->video && params->mipmaps;
+    enum sc_downscale_filter downscale_filter =
+        params->video ? params->downscale_filter : SC_DOWNSCALE_FILTER_LINEAR;
     ok = sc_display_init(&screen->display, screen->window, icon_novideo,
-                         mipmaps);
+                         downscale_filter, params->texture_damage);
     if (icon) {
         scrcpy_icon_destroy(icon);
     }
@@ -2330,18 +2782,10 @@ sc_screen_init(struct sc_screen *screen,
         goto error_destroy_window;
     }
 
-    sc_screen_load_screenshot_button_bg(screen);
-    sc_screen_load_input_toggle_button_bg(screen);
-    sc_screen_load_screenshot_icon(screen);
-    sc_screen_load_screenshot_check_icon(screen);
-    sc_screen_load_input_toggle_icon(screen);
-    sc_screen_load_settings_icon(screen);
+    sc_ui_atlas_init(&screen->ui_atlas, screen->display.renderer);
 
-    screen->frame = av_frame_alloc();
-    if (!screen->frame) {
-        LOG_OOM();
-        goto error_destroy_display;
-    }
+    // Also used to throttle the rendering during live resizes
+    sc_screen_update_frame_period(screen);
 
     struct sc_input_manager_params im_params = {
         .controller = params->controller,
@@ -2370,7 +2814,9 @@ sc_screen_init(struct sc_screen *screen,
     static const struct sc_frame_sink_ops ops = {
         .open = sc_screen_frame_sink_open,
         .close = sc_screen_frame_sink_close,
-        .push = sc_screen_frame_sink_push,
+        .push_shared = sc_screen_frame_sink_push_shared,
+        .get_backlog = sc_screen_frame_sink_get_backlog,
+        .push_repeat = sc_screen_frame_sink_push_repeat,
     };
 
     screen->frame_sink.ops = &ops;
@@ -2392,7 +2838,27 @@ sc_screen_init(struct sc_screen *screen,
         }
 
         if (!screen->figma_bridge_ready) {
-            LOGW("Could not start Figma Bridge endpoint");
+            // Another instance may already serve the bridge
+            screen->figma_relay_ready =
+                sc_figma_relay_init(&screen->figma_relay, FIGMA_BRIDGE_PORT);
+            if (screen->figma_relay_ready) {
+                LOGI("Figma Bridge served by another instance, screenshots "
+                     "are published to it");
+            } else {
+                LOGW("Could not start Figma Bridge endpoint");
+            }
+        }
+
+        struct sc_figma_bridge *bridge =
+            screen->figma_bridge_ready ? &screen->figma_bridge : NULL;
+        struct sc_figma_relay *relay =
+            screen->figma_relay_ready ? &screen->figma_relay : NULL;
+        screen->screenshot_worker_initialized =
+            sc_screenshot_worker_init(&screen->screenshot_worker, bridge,
+                                      relay, params->screenshot_format,
+                                      params->screenshot_png_level);
+        if (!screen->screenshot_worker_initialized) {
+            LOGW("Could not initialize screenshot worker");
         }
     }
 
@@ -2405,11 +2871,10 @@ sc_screen_init(struct sc_screen *screen,
 
     return true;
 
-error_destroy_display:
-    sc_display_destroy(&screen->display);
 error_destroy_window:
     SDL_DestroyWindow(screen->window);
 error_destroy_fps_counter:
+    sc_ui_icons_destroy(&screen->ui_icons);
     sc_fps_counter_destroy(&screen->fps_counter);
 error_destroy_frame_buffer:
     sc_frame_buffer_destroy(&screen->fb);
@@ -2445,8 +2910,17 @@ sc_screen_show_initial_window(struct sc_screen *screen) {
 
     struct sc_size window_size;
     if (!screen->req.width && !screen->req.height) {
-        // Keep the initial default startup size on first connection.
-        window_size = get_window_size(screen);
+        if (screen->cached_window_size.width
+                && screen->cached_content_size.width
+                        == screen->content_size.width
+                && screen->cached_content_size.height
+                        == screen->content_size.height) {
+            // Restore the size of the previous session for this device
+            window_size = screen->cached_window_size;
+        } else {
+            // Keep the initial default startup size on first connection.
+            window_size = get_window_size(screen);
+        }
     } else {
         window_size = get_initial_optimal_size(screen->content_size,
                                                screen->req.width,
@@ -2468,6 +2942,7 @@ sc_screen_show_initial_window(struct sc_screen *screen) {
         sc_fps_counter_start(&screen->fps_counter);
     }
 
+    sc_screen_invalidate_layout(screen);
     sc_screen_update_content_rect(screen);
 }
 
@@ -2479,11 +2954,17 @@ sc_screen_hide_window(struct sc_screen *screen) {
 void
 sc_screen_interrupt(struct sc_screen *screen) {
     sc_fps_counter_interrupt(&screen->fps_counter);
+    if (screen->screenshot_worker_initialized) {
+        sc_screenshot_worker_stop(&screen->screenshot_worker);
+    }
 }
 
 void
 sc_screen_join(struct sc_screen *screen) {
     sc_fps_counter_join(&screen->fps_counter);
+    if (screen->screenshot_worker_initialized) {
+        sc_screenshot_worker_join(&screen->screenshot_worker);
+    }
 }
 
 void
@@ -2491,34 +2972,52 @@ sc_screen_destroy(struct sc_screen *screen) {
 #ifndef NDEBUG
     assert(!screen->open);
 #endif
+    if (screen->screenshot_worker_initialized) {
+        // The worker references the Figma Bridge, destroy it first
+        sc_screenshot_worker_destroy(&screen->screenshot_worker);
+        screen->screenshot_worker_initialized = false;
+    }
     if (screen->figma_bridge_ready) {
         sc_figma_bridge_stop(&screen->figma_bridge);
         sc_figma_bridge_destroy(&screen->figma_bridge);
         screen->figma_bridge_ready = false;
     }
-    if (screen->screenshot_button_bg) {
-        SDL_DestroyTexture(screen->screenshot_button_bg);
+    if (screen->figma_relay_ready) {
+        sc_figma_relay_destroy(&screen->figma_relay);
+        screen->figma_relay_ready = false;
     }
-    if (screen->input_toggle_button_bg) {
-        SDL_DestroyTexture(screen->input_toggle_button_bg);
+    sc_ui_icons_destroy(&screen->ui_icons);
+    for (size_t i = 0; i < SC_SCREEN_TEXT_CACHE_SIZE; ++i) {
+        if (screen->text_cache[i].texture) {
+            SDL_DestroyTexture(screen->text_cache[i].texture);
+        }
+    }
+    if (screen->stats_glyphs.texture) {
+        SDL_DestroyTexture(screen->stats_glyphs.texture);
     }
-    if (screen->screenshot_icon) {
-        SDL_DestroyTexture(screen->screenshot_icon);
+    if (screen->panel_texture) {
+        SDL_DestroyTexture(screen->panel_texture);
     }
-    if (screen->screenshot_check_icon) {
-        SDL_DestroyTexture(screen->screenshot_check_icon);
+    sc_ui_atlas_destroy(&screen->ui_atlas);
+    sc_display_destroy(&screen->display);
+    if (screen->frame) {
+        sc_shared_frame_release(screen->frame);
     }
-    if (screen->input_toggle_icon) {
-        SDL_DestroyTexture(screen->input_toggle_icon);
+    if (screen->resume_frame) {
+        sc_shared_frame_release(screen->resume_frame);
     }
-    if (screen->settings_icon) {
-        SDL_DestroyTexture(screen->settings_icon);
+    if (screen->frame_pacing_waiting) {
+        SDL_RemoveTimer(screen->frame_pacing_timer);
     }
-    if (screen->text_cache_texture) {
-        SDL_DestroyTexture(screen->text_cache_texture);
+    if (screen->auto_size_timer) {
+        SDL_RemoveTimer(screen->auto_size_timer);
     }
-    sc_display_destroy(&screen->display);
-    av_frame_free(&screen->frame);
+    sc_screen_stop_animation_timer(screen);
+#ifdef __APPLE__
+    if (screen->occlusion_observer) {
+        sc_darwin_window_unobserve_occlusion(screen->occlusion_observer);
+    }
+#endif
     SDL_DestroyWindow(screen->window);
     sc_fps_counter_destroy(&screen->fps_counter);
     sc_frame_buffer_destroy(&screen->fb);
@@ -2567,6 +3066,7 @@ set_content_size(struct sc_screen *screen, struct sc_size new_content_size) {
     }
 
     screen->content_size = new_content_size;
+    sc_screen_invalidate_layout(screen);
 }
 
 static void
@@ -2605,6 +3105,7 @@ sc_screen_set_orientation(struct sc_screen *screen,
     set_content_size(screen, new_content_size);
 
     screen->orientation = orientation;
+    sc_screen_invalidate_layout(screen);
     LOGI("Display orientation set to %s", sc_orientation_get_name(orientation));
 
     sc_screen_render(screen, true);
@@ -2621,8 +3122,11 @@ sc_screen_init_size(struct sc_screen *screen) {
         get_oriented_size(screen->frame_size, screen->orientation);
     screen->content_size = content_size;
 
+    // The first frame is typically still being received: create the texture
+    // and compile the shader meanwhile
     enum sc_display_result res =
-        sc_display_set_texture_size(&screen->display, screen->frame_size);
+        sc_display_prepare(&screen->display, screen->frame_size,
+                           screen->expect_nv12);
     return res != SC_DISPLAY_RESULT_ERROR;
 }
 
@@ -2638,6 +3142,9 @@ prepare_for_frame(struct sc_screen *screen, struct sc_size new_frame_size) {
 
     // frame dimension changed
     screen->frame_size = new_frame_size;
+    if (screen->figma_bridge_ready) {
+        sc_figma_bridge_set_frame_size(&screen->figma_bridge, new_frame_size);
+    }
 
     struct sc_size new_content_size =
         get_oriented_size(new_frame_size, screen->orientation);
@@ -2652,9 +3159,18 @@ static bool
 sc_screen_apply_frame(struct sc_screen *screen) {
     assert(screen->video);
 
+    if (screen->has_frame && !sc_screen_is_visible(screen)) {
+        // Nobody can see it, do not upload nor render the frame; it is kept in
+        // screen->frame to be applied once the window becomes visible
+        screen->frame_upload_skipped = true;
+        sc_fps_counter_add_skipped_frame(&screen->fps_counter);
+        return true;
+    }
+    screen->frame_upload_skipped = false;
+
     sc_fps_counter_add_rendered_frame(&screen->fps_counter);
 
-    AVFrame *frame = screen->frame;
+    const AVFrame *frame = screen->frame->frame;
     struct sc_size new_frame_size = {frame->width, frame->height};
     enum sc_display_result res = prepare_for_frame(screen, new_frame_size);
     if (res == SC_DISPLAY_RESULT_ERROR) {
@@ -2674,9 +3190,22 @@ sc_screen_apply_frame(struct sc_screen *screen) {
         return true;
     }
 
+    if (screen->latency) {
+        sc_latency_on_uploaded(screen->latency, frame->pts);
+    }
+    if (screen->input_latency) {
+        sc_input_latency_on_uploaded(screen->input_latency);
+    }
+    if (screen->latency_probe) {
+        sc_latency_probe_on_uploaded(screen->latency_probe, frame);
+    }
+
     if (!screen->has_frame) {
         screen->has_frame = true;
         screen->connection_state = SC_SCREEN_CONNECTION_RUNNING;
+        sc_screen_invalidate_layout(screen);
+        // The panel is shown from now on
+        sc_ui_icons_upload(&screen->ui_icons, screen->display.renderer);
         // this is the very first frame, show the window
         sc_screen_show_initial_window(screen);
 
@@ -2686,7 +3215,7 @@ sc_screen_apply_frame(struct sc_screen *screen) {
         }
     }
 
-    if (screen->window_focused) {
+    if (sc_screen_is_visible(screen)) {
         sc_screen_render(screen, false);
     }
     return true;
@@ -2696,22 +3225,20 @@ static bool
 sc_screen_update_frame(struct sc_screen *screen) {
     assert(screen->video);
 
+    struct sc_shared_frame *frame = sc_frame_buffer_consume(&screen->fb);
+
     if (screen->paused) {
-        if (!screen->resume_frame) {
-            screen->resume_frame = av_frame_alloc();
-            if (!screen->resume_frame) {
-                LOG_OOM();
-                return false;
-            }
-        } else {
-            av_frame_unref(screen->resume_frame);
+        if (screen->resume_frame) {
+            sc_shared_frame_release(screen->resume_frame);
         }
-        sc_frame_buffer_consume(&screen->fb, screen->resume_frame);
+        screen->resume_frame = frame;
         return true;
     }
 
-    av_frame_unref(screen->frame);
-    sc_frame_buffer_consume(&screen->fb, screen->frame);
+    if (screen->frame) {
+        sc_shared_frame_release(screen->frame);
+    }
+    screen->frame = frame;
     return sc_screen_apply_frame(screen);
 }
 
@@ -2727,7 +3254,9 @@ sc_screen_set_paused(struct sc_screen *screen, bool paused) {
     if (screen->paused && screen->resume_frame) {
         // If display screen was paused, refresh the frame immediately, even if
         // the new state is also paused.
-        av_frame_free(&screen->frame);
+        if (screen->frame) {
+            sc_shared_frame_release(screen->frame);
+        }
         screen->frame = screen->resume_frame;
         screen->resume_frame = NULL;
         sc_screen_apply_frame(screen);
@@ -2742,6 +3271,21 @@ sc_screen_set_paused(struct sc_screen *screen, bool paused) {
     }
 
     screen->paused = paused;
+
+    // The decoder resumes from a new keyframe
+    sc_screen_update_decode_budget(screen);
+}
+
+static enum sc_figma_bridge_device_state
+to_bridge_device_state(enum sc_screen_connection_state state) {
+    switch (state) {
+        case SC_SCREEN_CONNECTION_CONNECTING:
+            return SC_FIGMA_BRIDGE_DEVICE_CONNECTING;
+        case SC_SCREEN_CONNECTION_RUNNING:
+            return SC_FIGMA_BRIDGE_DEVICE_CONNECTED;
+        default:
+            return SC_FIGMA_BRIDGE_DEVICE_DISCONNECTED;
+    }
 }
 
 void
@@ -2753,9 +3297,21 @@ sc_screen_set_connection_state(struct sc_screen *screen,
         return;
     }
 
+    if (screen->figma_bridge_ready) {
+        sc_figma_bridge_set_device_state(&screen->figma_bridge,
+                                         to_bridge_device_state(state));
+    }
+
+    sc_screen_invalidate_layout(screen);
+
+    // The panel is only shown while running
+    sc_screen_update_ui_rects(screen);
+
     if (state != SC_SCREEN_CONNECTION_RUNNING) {
         screen->has_frame = false;
+        screen->frame_upload_skipped = false;
         screen->paused = false;
+        sc_screen_update_decode_budget(screen);
         screen->secure_content_detected = false;
         screen->screenshot_button_hovered = false;
         screen->screenshot_button_pressed = false;
@@ -2773,7 +3329,7 @@ sc_screen_set_connection_state(struct sc_screen *screen,
             sc_mouse_capture_set_active(&screen->mc, false);
         }
 
-        if (screen->window_focused) {
+        if (sc_screen_is_visible(screen)) {
             sc_screen_render_idle(screen);
         }
         return;
@@ -2793,6 +3349,10 @@ sc_screen_set_input_processors(struct sc_screen *screen,
     sc_input_manager_configure(&screen->im, controller, fp, kp, mp, gp);
     bool relative_mode = sc_screen_is_relative_mode(screen);
 
+    if (screen->figma_bridge_ready) {
+        sc_figma_bridge_set_controller(&screen->figma_bridge, controller);
+    }
+
     if (relative_mode != was_relative_mode) {
         bool active = screen->input_enabled && relative_mode
                    && (!screen->video || screen->has_frame)
@@ -2801,12 +3361,66 @@ sc_screen_set_input_processors(struct sc_screen *screen,
     }
 }
 
+static void
+sc_screen_update_decode_budget(struct sc_screen *screen) {
+    if (screen->video_decoder) {
+        // The focused window is always decoded at full cost, unless paused
+        enum sc_decode_budget budget;
+        if (screen->paused && screen->pause_decode) {
+            budget = SC_DECODE_BUDGET_PAUSED;
+        } else if (screen->window_focused) {
+            budget = SC_DECODE_BUDGET_FULL;
+        } else {
+            budget = screen->unfocused_decode;
+        }
+        sc_decoder_set_budget(screen->video_decoder, budget);
+    }
+}
+
+void
+sc_screen_set_video_decoder(struct sc_screen *screen,
+                            struct sc_decoder *decoder) {
+    screen->video_decoder = decoder;
+    sc_screen_update_decode_budget(screen);
+}
+
+void
+sc_screen_set_device_serial(struct sc_screen *screen, const char *serial) {
+    if (screen->figma_bridge_ready) {
+        sc_figma_bridge_set_serial(&screen->figma_bridge, serial);
+    } else if (screen->figma_relay_ready) {
+        sc_figma_relay_set_serial(&screen->figma_relay, serial);
+    }
+}
+
 void
 sc_screen_set_window_title(struct sc_screen *screen, const char *title) {
     assert(title);
     SDL_SetWindowTitle(screen->window, title);
 }
 
+void
+sc_screen_set_cached_window_size(struct sc_screen *screen,
+                                 struct sc_size content_size,
+                                 struct sc_size window_size) {
+    screen->cached_content_size = content_size;
+    screen->cached_window_size = window_size;
+}
+
+bool
+sc_screen_get_window_size_to_cache(struct sc_screen *screen,
+                                   struct sc_size *content_size,
+                                   struct sc_size *window_size) {
+    if (!screen->video || !screen->has_frame || screen->fullscreen
+            || screen->maximized || screen->minimized) {
+        return false;
+    }
+
+    *content_size = screen->content_size;
+    *window_size = get_window_size(screen);
+    return true;
+}
+
 void
 sc_screen_toggle_fullscreen(struct sc_screen *screen) {
     assert(screen->video);
@@ -2883,7 +3497,15 @@ sc_screen_resize_to_pixel_perfect(struct sc_screen *screen) {
         screen->maximized = false;
     }
 
+    // If the device renders at a lower resolution, 1:1 is relative to its
+    // nominal resolution (the frame is upscaled)
     struct sc_size content_size = screen->content_size;
+    if (screen->render_scale != 1.f) {
+        float width = content_size.width / screen->render_scale + .5f;
+        float height = content_size.height / screen->render_scale + .5f;
+        content_size.width = MIN(width, 0x7FFF - UI_PANEL_WIDTH);
+        content_size.height = MIN(height, 0x7FFF);
+    }
     SDL_SetWindowSize(screen->window, content_size.width + UI_PANEL_WIDTH,
                       content_size.height);
     LOGD("Resized to pixel-perfect: %ux%u",
@@ -2975,8 +3597,91 @@ sc_screen_copy_session_log_to_clipboard(void) {
     return true;
 }
 
+// Whether the pointer event may be forwarded to the device directly, without
+// the sidebar, shortcut and mouse capture handling (which would ignore it)
+static bool
+sc_screen_is_fast_path_event(struct sc_screen *screen,
+                             const SDL_Event *event) {
+    int32_t x;
+    switch (event->type) {
+        case SDL_MOUSEMOTION:
+            x = event->motion.x;
+            break;
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            x = event->button.x;
+            break;
+        case SDL_FINGERMOTION:
+        case SDL_FINGERDOWN:
+        case SDL_FINGERUP:
+            // Never handled by the sidebar
+            x = -1;
+            break;
+        default:
+            return false;
+    }
+
+    if (!screen->video || !screen->has_frame || !screen->input_enabled
+            || sc_screen_is_relative_mode(screen)) {
+        return false;
+    }
+
+    // The sidebar must have no state to update (e.g. a hovered button to
+    // reset when the pointer leaves it, or a window drag in progress, which
+    // implies sidebar_drag_armed)
+    if (screen->settings_menu_open || screen->sidebar_drag_armed
+            || screen->screenshot_button_hovered
+            || screen->screenshot_button_pressed
+            || screen->input_toggle_button_hovered
+            || screen->input_toggle_button_pressed
+            || screen->settings_button_hovered
+            || screen->settings_button_pressed) {
+        return false;
+    }
+
+    // Left of the panel, in window coordinates (no HiDPI conversion)
+    return x < screen->panel_window_x;
+}
+
+static void
+sc_screen_dispatch_input_event(struct sc_screen *screen,
+                               const SDL_Event *event, sc_tick start) {
+    if (screen->input_latency) {
+        sc_input_latency_on_dispatched(screen->input_latency,
+                                       sc_tick_now() - start);
+    }
+    sc_input_manager_handle_event(&screen->im, event);
+}
+
+// Whether another size change is already queued
+static bool
+sc_screen_has_pending_size_change(void) {
+    SDL_Event events[16];
+    int count = SDL_PeepEvents(events, ARRAY_LEN(events), SDL_PEEKEVENT,
+                               SDL_WINDOWEVENT, SDL_WINDOWEVENT);
+    for (int i = 0; i < count; ++i) {
+        if (events[i].window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool
 sc_screen_handle_event(struct sc_screen *screen, const SDL_Event *event) {
+    // Only measured with --measure-input-latency
+    sc_tick start = screen->input_latency ? sc_tick_now() : 0;
+
+    if (screen->region_select_armed
+            && sc_screen_handle_region_select_event(screen, event)) {
+        return true;
+    }
+
+    if (sc_screen_is_fast_path_event(screen, event)) {
+        sc_screen_dispatch_input_event(screen, event, start);
+        return true;
+    }
+
     switch (event->type) {
         case SC_EVENT_SCREEN_INIT_SIZE: {
             // The initial size is passed via screen->frame_size
@@ -2988,6 +3693,24 @@ sc_screen_handle_event(struct sc_screen *screen, const SDL_Event *event) {
             return true;
         }
         case SC_EVENT_NEW_FRAME: {
+            if (screen->frame_pacing && sc_screen_defer_frame(screen)) {
+                // Rendered on SC_EVENT_FRAME_PACING_DEADLINE
+                return true;
+            }
+            bool ok = sc_screen_update_frame(screen);
+            if (!ok) {
+                LOGE("Frame update failed\n");
+                return false;
+            }
+            return true;
+        }
+        case SC_EVENT_FRAME_PACING_DEADLINE: {
+            sc_consume_event(SC_EVENT_FRAME_PACING_DEADLINE);
+            if (!screen->frame_pacing_waiting) {
+                return true;
+            }
+            screen->frame_pacing_waiting = false;
+            screen->frame_pacing_timer = 0;
             bool ok = sc_screen_update_frame(screen);
             if (!ok) {
                 LOGE("Frame update failed\n");
@@ -2995,6 +3718,51 @@ sc_screen_handle_event(struct sc_screen *screen, const SDL_Event *event) {
             }
             return true;
         }
+        case SC_EVENT_AUTO_SIZE:
+            sc_consume_event(SC_EVENT_AUTO_SIZE);
+            sc_screen_send_auto_size(screen);
+            return true;
+        case SC_EVENT_DEVICE_SCREENSHOT:
+            // The event owns the PNG data (NULL on failure)
+            sc_screen_on_device_screenshot(screen, event->user.data1,
+                                           (size_t) event->user.code);
+            return true;
+        case SC_EVENT_SCREENSHOT_DONE:
+            if (event->user.code) {
+                sc_screen_animate_screenshot_button_feedback(screen);
+            }
+            return true;
+        case SC_EVENT_SCREEN_ANIMATION_TICK:
+            sc_consume_event(SC_EVENT_SCREEN_ANIMATION_TICK);
+            sc_screen_on_animation_tick(screen);
+            return true;
+        case SC_EVENT_SCREENSHOT_WRITES_CHANGED:
+            sc_consume_event(SC_EVENT_SCREENSHOT_WRITES_CHANGED);
+            if (screen->screenshot_worker_initialized) {
+                screen->screenshot_pending_writes =
+                    sc_screenshot_worker_get_pending_writes(
+                        &screen->screenshot_worker);
+                sc_screen_render_current_state(screen, false);
+            }
+            return true;
+        case SC_EVENT_FILE_PUSHER_PROGRESS:
+            sc_consume_event(SC_EVENT_FILE_PUSHER_PROGRESS);
+            if (screen->im.fp) {
+                sc_file_pusher_get_progress(screen->im.fp, &screen->push_done,
+                                            &screen->push_total);
+                sc_screen_render_current_state(screen, false);
+            }
+            return true;
+        case SC_EVENT_VIDEO_IDLE_CHANGED:
+            // The device does not send frames while its screen is static
+            sc_fps_counter_set_idle(&screen->fps_counter, event->user.code != 0);
+            return true;
+        case SC_EVENT_SCREEN_OCCLUSION_CHANGED:
+            screen->window_occluded = event->user.code != 0;
+            if (!screen->window_occluded) {
+                sc_screen_render_current_state(screen, true);
+            }
+            return true;
         case SC_EVENT_SCREEN_SECURE_CONTENT: {
             bool detected = event->user.code != 0;
             if (screen->secure_content_detected != detected) {
@@ -3005,6 +3773,12 @@ sc_screen_handle_event(struct sc_screen *screen, const SDL_Event *event) {
             }
             return true;
         }
+        case SDL_RENDER_TARGETS_RESET:
+        case SDL_RENDER_DEVICE_RESET:
+            // The content of render targets is lost
+            screen->panel_texture_valid = false;
+            sc_display_invalidate_texture(&screen->display);
+            return true;
         case SDL_WINDOWEVENT:
             if (!screen->video) {
                 if (event->window.event == SDL_WINDOWEVENT_EXPOSED) {
@@ -3014,20 +3788,63 @@ sc_screen_handle_event(struct sc_screen *screen, const SDL_Event *event) {
             }
 
             switch (event->window.event) {
+                case SDL_WINDOWEVENT_SHOWN:
+                case SDL_WINDOWEVENT_SIZE_CHANGED:
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+                case SDL_WINDOWEVENT_DISPLAY_CHANGED:
+#endif
+                    // Keep the cached sizes up-to-date even if the layout is
+                    // not recomputed immediately
+                    sc_screen_update_window_sizes(screen);
+                    break;
+                default:
+                    break;
+            }
+
+            switch (event->window.event) {
+                case SDL_WINDOWEVENT_SHOWN:
+                    screen->window_hidden = false;
+                    sc_screen_render_current_state(screen, true);
+                    break;
+                case SDL_WINDOWEVENT_HIDDEN:
+                    screen->window_hidden = true;
+                    break;
                 case SDL_WINDOWEVENT_EXPOSED:
+                    // The geometry is unchanged, only redraw
+                    sc_screen_render_current_state(screen, false);
+                    break;
                 case SDL_WINDOWEVENT_SIZE_CHANGED:
+                    if (sc_screen_has_pending_size_change()) {
+                        // Only render the last size of a burst (e.g. the
+                        // events queued during a live resize)
+                        sc_screen_invalidate_layout(screen);
+                        break;
+                    }
+                    screen->live_resize_render_time = 0;
                     sc_screen_render_current_state(screen, true);
                     break;
+                case SDL_WINDOWEVENT_MOVED:
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+                case SDL_WINDOWEVENT_DISPLAY_CHANGED:
+#endif
+                    if (screen->frame_pacing) {
+                        // The window may be on a display with a different
+                        // refresh rate
+                        sc_screen_update_frame_period(screen);
+                    }
+                    break;
                 case SDL_WINDOWEVENT_FOCUS_GAINED:
                     screen->window_focused = true;
+                    sc_screen_update_decode_budget(screen);
                     if (screen->input_enabled && sc_screen_is_relative_mode(screen)
                             && screen->has_frame) {
                         sc_mouse_capture_set_active(&screen->mc, true);
                     }
-                    sc_screen_render_current_state(screen, true);
+                    sc_screen_render_current_state(screen, false);
                     break;
                 case SDL_WINDOWEVENT_FOCUS_LOST:
                     screen->window_focused = false;
+                    sc_screen_update_decode_budget(screen);
                     screen->sidebar_drag_armed = false;
                     screen->sidebar_drag_active = false;
                     if (sc_screen_is_relative_mode(screen)) {
@@ -3087,7 +3904,7 @@ sc_screen_handle_event(struct sc_screen *screen, const SDL_Event *event) {
 
     if (screen->video && !screen->input_enabled
             && sc_screen_is_copy_screenshot_shortcut(event)) {
-        sc_screen_take_screenshot(screen, true);
+        sc_screen_take_screenshot(screen, true, NULL);
         return true;
     }
 
@@ -3103,7 +3920,7 @@ sc_screen_handle_event(struct sc_screen *screen, const SDL_Event *event) {
     }
 
     if (screen->input_enabled || !sc_screen_is_control_event(event)) {
-        sc_input_manager_handle_event(&screen->im, event);
+        sc_screen_dispatch_input_event(screen, event, start);
     }
     return true;
 }
@@ -3113,77 +3930,36 @@ sc_screen_convert_drawable_to_frame_coords(struct sc_screen *screen,
                                            int32_t x, int32_t y) {
     assert(screen->video);
 
-    enum sc_orientation orientation = screen->orientation;
-
-    int32_t w = screen->content_size.width;
-    int32_t h = screen->content_size.height;
-
-    // screen->rect must be initialized to avoid a division by zero
+    // screen->rect must be initialized for the transform to be valid
     assert(screen->rect.w && screen->rect.h);
 
-    x = (int64_t) (x - screen->rect.x) * w / screen->rect.w;
-    y = (int64_t) (y - screen->rect.y) * h / screen->rect.h;
-
-    struct sc_point result;
-    switch (orientation) {
-        case SC_ORIENTATION_0:
-            result.x = x;
-            result.y = y;
-            break;
-        case SC_ORIENTATION_90:
-            result.x = y;
-            result.y = w - x;
-            break;
-        case SC_ORIENTATION_180:
-            result.x = w - x;
-            result.y = h - y;
-            break;
-        case SC_ORIENTATION_270:
-            result.x = h - y;
-            result.y = x;
-            break;
-        case SC_ORIENTATION_FLIP_0:
-            result.x = w - x;
-            result.y = y;
-            break;
-        case SC_ORIENTATION_FLIP_90:
-            result.x = h - y;
-            result.y = w - x;
-            break;
-        case SC_ORIENTATION_FLIP_180:
-            result.x = x;
-            result.y = h - y;
-            break;
-        default:
-            assert(orientation == SC_ORIENTATION_FLIP_270);
-            result.x = y;
-            result.y = x;
-            break;
-    }
-
-    return result;
+    return sc_coords_transform_apply(&screen->drawable_to_frame, x, y);
 }
 
 struct sc_point
 sc_screen_convert_window_to_frame_coords(struct sc_screen *screen,
                                          int32_t x, int32_t y) {
-    sc_screen_hidpi_scale_coords(screen, &x, &y);
-    return sc_screen_convert_drawable_to_frame_coords(screen, x, y);
+    assert(screen->video);
+    assert(screen->rect.w && screen->rect.h);
+
+    return sc_coords_transform_apply(&screen->window_to_frame, x, y);
 }
 
 struct sc_point
 sc_screen_convert_window_to_frame_coords_tolerant(struct sc_screen *screen,
                                                   int32_t x, int32_t y,
                                                   int32_t tolerance) {
+    if (tolerance <= 0) {
+        return sc_screen_convert_window_to_frame_coords(screen, x, y);
+    }
+
     sc_screen_hidpi_scale_coords(screen, &x, &y);
 
-    if (tolerance > 0 && screen->rect.w > 0 && screen->rect.h > 0) {
-        int ww;
-        int wh;
-        int dw;
-        int dh;
-        SDL_GetWindowSize(screen->window, &ww, &wh);
-        SDL_GL_GetDrawableSize(screen->window, &dw, &dh);
+    if (screen->rect.w > 0 && screen->rect.h > 0) {
+        int ww = screen->window_size.width;
+        int wh = screen->window_size.height;
+        int dw = screen->drawable_size.width;
+        int dh = screen->drawable_size.height;
         if (ww > 0 && wh > 0) {
             int tol_x = (int64_t) tolerance * dw / ww;
             int tol_y = (int64_t) tolerance * dh / wh;
@@ -3210,10 +3986,15 @@ sc_screen_convert_window_to_frame_coords_tolerant(struct sc_screen *screen,
 
 void
 sc_screen_hidpi_scale_coords(struct sc_screen *screen, int32_t *x, int32_t *y) {
-    // take the HiDPI scaling (dw/ww and dh/wh) into account
-    int ww, wh, dw, dh;
-    SDL_GetWindowSize(screen->window, &ww, &wh);
-    SDL_GL_GetDrawableSize(screen->window, &dw, &dh);
+    // take the HiDPI scaling (dw/ww and dh/wh) into account (the sizes are
+    // updated with the layout, on each resize)
+    int ww = screen->window_size.width;
+    int wh = screen->window_size.height;
+    int dw = screen->drawable_size.width;
+    int dh = screen->drawable_size.height;
+    if (!ww || !wh) {
+        return;
+    }
 
     // scale for HiDPI (64 bits for intermediate multiplications)
     *x = (int64_t) *x * dw / ww;
@@ -10,21 +10,105 @@
 #include <libavutil/frame.h>
 #include <libavutil/pixfmt.h>
 
+#include "bridge_clip.h"
 #include "controller.h"
 #include "coords.h"
+#include "coords_transform.h"
+#include "decoder.h"
 #include "display.h"
 #include "figma_bridge.h"
+#include "figma_relay.h"
 #include "fps_counter.h"
 #include "frame_buffer.h"
 #include "input_manager.h"
+#include "input_latency.h"
+#include "latency_probe.h"
+#include "instant_replay.h"
+#include "latency.h"
 #include "mouse_capture.h"
 #include "options.h"
+#include "recorder.h"
+#include "screenshot.h"
 #include "trait/key_processor.h"
 #include "trait/frame_sink.h"
 #include "trait/mouse_processor.h"
+#include "ui_atlas.h"
+#include "ui_icons.h"
+#include "util/tick.h"
 
 struct sc_file_pusher;
 
+// Everything the sidebar panel rendering depends on, to know when its cached
+// texture must be redrawn
+struct sc_screen_panel_state {
+    SDL_Rect panel_rect;
+    SDL_Rect screenshot_button_rect;
+    SDL_Rect input_toggle_button_rect;
+    SDL_Rect settings_button_rect;
+    float screenshot_button_feedback;
+    bool has_frame;
+    bool screenshot_button_hovered;
+    bool screenshot_button_pressed;
+    bool input_toggle_button_hovered;
+    bool input_toggle_button_pressed;
+    bool settings_button_hovered;
+    bool settings_button_pressed;
+    bool settings_menu_open;
+    bool input_enabled;
+    unsigned push_done;
+    unsigned push_total; // 0 if no file is being pushed
+    unsigned screenshot_pending_writes;
+};
+
+// Sidebar elements reacting to the mouse
+enum sc_screen_ui_target {
+    SC_SCREEN_UI_TARGET_NONE,
+    SC_SCREEN_UI_TARGET_PANEL, // the panel background
+    SC_SCREEN_UI_TARGET_SCREENSHOT_BUTTON,
+    SC_SCREEN_UI_TARGET_INPUT_TOGGLE,
+    SC_SCREEN_UI_TARGET_SETTINGS_BUTTON,
+    // The settings menu targets, only hit while the menu is open
+    SC_SCREEN_UI_TARGET_MENU, // the menu background
+    SC_SCREEN_UI_TARGET_MENU_COPY,
+    SC_SCREEN_UI_TARGET_MENU_SAVE,
+    SC_SCREEN_UI_TARGET_MENU_FIGMA,
+    SC_SCREEN_UI_TARGET_MENU_CLIP,
+    SC_SCREEN_UI_TARGET_MENU_DIRECTORY,
+    SC_SCREEN_UI_TARGET_COUNT,
+};
+
+struct sc_screen_hit_region {
+    SDL_Rect rect;
+    enum sc_screen_ui_target target;
+};
+
+#define SC_SCREEN_TEXT_CACHE_SIZE 8
+
+// Rasterized text texture (only used with a custom UI font on macOS)
+struct sc_screen_text_cache_entry {
+    SDL_Texture *texture; // NULL if the entry is unused
+    uint16_t width;
+    uint16_t height;
+    uint16_t point_size;
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    uint32_t last_used; // for LRU eviction
+    char value[128];
+};
+
+// Characters of the stats overlay, rasterized once per point size with a
+// custom UI font (only used on macOS)
+#define SC_SCREEN_STATS_CHARS " ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789./:"
+
+struct sc_screen_stats_glyphs {
+    SDL_Texture *texture; // NULL if not rasterized (or if it failed)
+    uint16_t point_size; // 0 if not rasterized
+    uint16_t height;
+    // The glyph of SC_SCREEN_STATS_CHARS[i] spans [x[i], x[i+1] - 1)
+    uint16_t x[sizeof(SC_SCREEN_STATS_CHARS)];
+};
+
 enum sc_screen_connection_state {
     SC_SCREEN_CONNECTION_CONNECTING,
     SC_SCREEN_CONNECTION_RUNNING,
@@ -32,12 +116,6 @@ enum sc_screen_connection_state {
     SC_SCREEN_CONNECTION_FAILED,
 };
 
-enum sc_screenshot_action {
-    SC_SCREENSHOT_ACTION_COPY_TO_CLIPBOARD,
-    SC_SCREENSHOT_ACTION_SAVE_TO_DIRECTORY,
-    SC_SCREENSHOT_ACTION_SEND_TO_FIGMA_BRIDGE,
-};
-
 struct sc_screen {
     struct sc_frame_sink frame_sink; // frame sink trait
 
@@ -48,6 +126,7 @@ struct sc_screen {
     bool video;
 
     struct sc_display display;
+    struct sc_ui_atlas ui_atlas;
     struct sc_input_manager im;
     struct sc_mouse_capture mc; // only used in mouse relative mode
     struct sc_frame_buffer fb;
@@ -74,8 +153,18 @@ struct sc_screen {
 
     // client orientation
     enum sc_orientation orientation;
+    // the device renders at this scale of its nominal resolution, so the
+    // nominal size of the content is content_size / render_scale
+    float render_scale;
     // rectangle of the content (excluding black borders)
     struct SDL_Rect rect;
+    // Bumped on any change of the geometry (window size, content size,
+    // orientation, panel visibility); rect and the coordinates transforms are
+    // recomputed only if content_rect_gen differs
+    unsigned layout_gen;
+    unsigned content_rect_gen;
+    // Slot of the mirrored content in the viewport, updated with panel_rect
+    struct SDL_Rect mirror_slot;
     struct SDL_Rect panel_rect;
     struct SDL_Rect screenshot_button_rect;
     struct SDL_Rect input_toggle_button_rect;
@@ -84,33 +173,33 @@ struct sc_screen {
     struct SDL_Rect settings_menu_copy_rect;
     struct SDL_Rect settings_menu_save_rect;
     struct SDL_Rect settings_menu_figma_rect;
+    struct SDL_Rect settings_menu_clip_rect;
     struct SDL_Rect settings_menu_directory_rect;
-    SDL_Texture *screenshot_button_bg;
-    uint16_t screenshot_button_bg_width;
-    uint16_t screenshot_button_bg_height;
-    SDL_Texture *input_toggle_button_bg;
-    uint16_t input_toggle_button_bg_width;
-    uint16_t input_toggle_button_bg_height;
-    SDL_Texture *screenshot_icon;
-    uint16_t screenshot_icon_width;
-    uint16_t screenshot_icon_height;
-    SDL_Texture *screenshot_check_icon;
-    uint16_t screenshot_check_icon_width;
-    uint16_t screenshot_check_icon_height;
-    SDL_Texture *input_toggle_icon;
-    uint16_t input_toggle_icon_width;
-    uint16_t input_toggle_icon_height;
-    SDL_Texture *settings_icon;
-    uint16_t settings_icon_width;
-    uint16_t settings_icon_height;
-    SDL_Texture *text_cache_texture;
-    uint16_t text_cache_width;
-    uint16_t text_cache_height;
-    uint16_t text_cache_point_size;
-    uint8_t text_cache_r;
-    uint8_t text_cache_g;
-    uint8_t text_cache_b;
-    char text_cache_value[128];
+    // The rects above as a hit-testing table, topmost first, rebuilt with
+    // the layout (not on each mouse event)
+    struct sc_screen_hit_region hit_regions[SC_SCREEN_UI_TARGET_COUNT - 1];
+    unsigned hit_region_count;
+    // panel_rect.x in window coordinates (rounded down), to test mouse events
+    // without HiDPI conversion
+    int32_t panel_window_x;
+    // Window and drawable sizes, cached (updated on resize, display change
+    // and layout invalidation) rather than queried on each event
+    struct sc_size window_size;
+    struct sc_size drawable_size;
+    // Mapping of window and drawable coordinates to frame coordinates,
+    // updated with rect (meaningful only if rect is not empty)
+    struct sc_coords_transform window_to_frame;
+    struct sc_coords_transform drawable_to_frame;
+    struct sc_ui_icons ui_icons;
+    struct sc_screen_text_cache_entry text_cache[SC_SCREEN_TEXT_CACHE_SIZE];
+    uint32_t text_cache_clock;
+    struct sc_screen_stats_glyphs stats_glyphs;
+    // Render target caching the sidebar panel, redrawn only when its state
+    // changes
+    SDL_Texture *panel_texture;
+    struct sc_size panel_texture_size;
+    struct sc_screen_panel_state panel_texture_state;
+    bool panel_texture_valid;
     bool screenshot_button_hovered;
     bool screenshot_button_pressed;
     bool input_toggle_button_hovered;
@@ -121,6 +210,7 @@ struct sc_screen {
     bool settings_menu_copy_hovered;
     bool settings_menu_save_hovered;
     bool settings_menu_figma_hovered;
+    bool settings_menu_clip_hovered;
     bool settings_menu_directory_hovered;
     bool sidebar_drag_armed;
     bool sidebar_drag_active;
@@ -128,26 +218,105 @@ struct sc_screen {
     int32_t sidebar_drag_mouse_start_y;
     int32_t sidebar_drag_window_start_x;
     int32_t sidebar_drag_window_start_y;
+    // Capture of a region selected by dragging over the video (armed by
+    // shift+click on the screenshot button), the corners of the selection
+    // are in window coordinates
+    bool region_select_armed;
+    bool region_select_active;
+    struct sc_point region_select_start;
+    struct sc_point region_select_end;
     bool input_enabled;
+    // Progress of the files dropped to the device (push_total is 0 if none)
+    unsigned push_done;
+    unsigned push_total;
+    // Screenshots being written to the directory
+    unsigned screenshot_pending_writes;
     enum sc_screenshot_action screenshot_action;
     char screenshot_directory[1024];
     bool figma_bridge_ready;
     struct sc_figma_bridge figma_bridge;
+    // Publish the screenshots to the bridge of another instance, if the
+    // bridge port is already taken (only if !figma_bridge_ready)
+    bool figma_relay_ready;
+    struct sc_figma_relay figma_relay;
+    // Recent video kept for the Figma Bridge clips (NULL if unavailable), set
+    // by the owner while the video stream is running
+    struct sc_bridge_clip *bridge_clip;
+    // Instant replay buffer (NULL if disabled), set by the owner while the
+    // streams are running
+    struct sc_instant_replay *instant_replay;
+    // Recorder to add markers to (NULL if there is no recording index), set
+    // by the owner while the recorder is running
+    struct sc_recorder *recorder;
+    // Video decoder whose budget follows the window focus (NULL if none), set
+    // by the owner while the decoder is running
+    struct sc_decoder *video_decoder;
+    // Decoding budget while the window is not focused
+    enum sc_decode_budget unfocused_decode;
+    // Decode only the periodic keyframes while paused (the screen is the only
+    // consumer of the decoded frames)
+    bool pause_decode;
+    bool screenshot_worker_initialized;
+    struct sc_screenshot_worker screenshot_worker;
+    // Expected format of the frames, to prepare the texture before the first
+    // frame
+    bool expect_nv12;
+    bool screenshot_gpu_readback;
+    // Request the screenshots to the device (received asynchronously)
+    bool screenshot_from_device;
+    bool device_screenshot_pending;
+    enum sc_screenshot_action device_screenshot_action;
+    bool device_screenshot_has_region;
+    struct sc_screenshot_region device_screenshot_region;
     bool screenshot_button_feedback_active;
     uint32_t screenshot_button_feedback_start_ms;
     float screenshot_button_feedback_progress;
     bool window_focused;
+    bool window_hidden;
+    bool window_occluded; // fully covered by other windows (macOS only)
+    // The last frame has not been uploaded because the window is not visible
+    bool frame_upload_skipped;
+#ifdef __APPLE__
+    void *occlusion_observer;
+#endif
     bool secure_content_detected;
     enum sc_screen_connection_state connection_state;
     bool has_frame;
     bool fullscreen;
     bool maximized;
     bool minimized;
+    // Window size left by the user in the previous session for this content
+    // size (0 if unknown), used for the initial window if no size is requested
+    struct sc_size cached_content_size;
+    struct sc_size cached_window_size;
 
-    AVFrame *frame;
+    struct sc_shared_frame *frame; // NULL until the first frame
 
     bool paused;
-    AVFrame *resume_frame;
+    struct sc_shared_frame *resume_frame;
+
+    // Frame pacing: render at most one frame per display refresh
+    bool frame_pacing;
+    sc_tick frame_period; // display refresh period
+    // Last render from the event watcher during a live resize (0 if none)
+    sc_tick live_resize_render_time;
+    sc_tick last_present; // time of the last frame presented
+    // A frame is pending until the next refresh (the timer is armed)
+    bool frame_pacing_waiting;
+    SDL_TimerID frame_pacing_timer;
+
+    // Request the device to encode at the size of the content rectangle
+    bool auto_size;
+    struct sc_size auto_size_pending; // the size to send on timeout
+    struct sc_size auto_size_sent; // the last size sent to the device
+    SDL_TimerID auto_size_timer; // 0 if not armed
+
+    // Periodic timer driving the panel animations, 0 if none is running
+    SDL_TimerID animation_timer;
+
+    struct sc_latency *latency; // may be NULL
+    struct sc_input_latency *input_latency; // may be NULL
+    struct sc_latency_probe *latency_probe; // may be NULL
 };
 
 struct sc_screen_params {
@@ -175,7 +344,27 @@ struct sc_screen_params {
     bool window_borderless;
 
     enum sc_orientation orientation;
-    bool mipmaps;
+    enum sc_downscale_filter downscale_filter;
+    // upload only the changed regions of the frames
+    bool texture_damage;
+    // the frames are expected from a hardware decoder (in NV12)
+    bool hw_decoder;
+    // the device renders at this scale of its nominal resolution
+    float render_scale;
+    bool screenshot_gpu_readback;
+    bool screenshot_from_device;
+    enum sc_image_format screenshot_format;
+    int screenshot_png_level;
+    bool frame_pacing;
+    bool auto_size;
+    // Decoding budget while the window is not focused (not AUTO)
+    enum sc_decode_budget unfocused_decode;
+    // Reduce the decoding while paused (only if no other component consumes
+    // the decoded frames)
+    bool pause_decode;
+    struct sc_latency *latency; // may be NULL
+    struct sc_input_latency *input_latency; // may be NULL
+    struct sc_latency_probe *latency_probe; // may be NULL
 
     bool fullscreen;
     bool start_fps_counter;
@@ -238,9 +427,36 @@ sc_screen_set_input_processors(struct sc_screen *screen,
                                struct sc_mouse_processor *mp,
                                struct sc_gamepad_processor *gp);
 
+// Set the video decoder whose budget follows the window focus (NULL to unset)
+void
+sc_screen_set_video_decoder(struct sc_screen *screen,
+                            struct sc_decoder *decoder);
+
+// Set the serial of the device, to serve its screenshots under
+// /scrcpy-bridge/<serial>/
+void
+sc_screen_set_device_serial(struct sc_screen *screen, const char *serial);
+
 void
 sc_screen_set_window_title(struct sc_screen *screen, const char *title);
 
+// Set the window size of the previous session for the given content size (the
+// video size, oriented), to be restored on the first frame if it matches
+void
+sc_screen_set_cached_window_size(struct sc_screen *screen,
+                                 struct sc_size content_size,
+                                 struct sc_size window_size);
+
+// Get the current window size and the content size it applies to, to restore
+// them on the next session
+//
+// Return false if there is nothing to restore (no frame yet, or the window is
+// fullscreen, maximized or minimized).
+bool
+sc_screen_get_window_size_to_cache(struct sc_screen *screen,
+                                   struct sc_size *content_size,
+                                   struct sc_size *window_size);
+
 // react to SDL events
 // If this function returns false, scrcpy must exit with an error.
 bool
@@ -0,0 +1,740 @@
+#include "screenshot.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <SDL2/SDL_events.h>
+#include <SDL2/SDL_timer.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+
+#include "events.h"
+#include "png_decoder.h"
+#include "png_encoder.h"
+#include "sws.h"
+#include "util/image_hash.h"
+#include "util/log.h"
+#ifdef __APPLE__
+# include "sys/darwin/clipboard.h"
+#endif
+
+// Do not accumulate frames if the worker cannot keep up
+#define SC_SCREENSHOT_QUEUE_LIMIT 8
+
+// Part of an image to capture, in pixels of this image
+struct sc_screenshot_crop {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+static void
+sc_screenshot_request_destroy(struct sc_screenshot_request *req) {
+    av_frame_free(&req->frame);
+    free(req->pixels);
+    free(req->png);
+    free(req->directory);
+}
+
+bool
+sc_screenshot_worker_init(struct sc_screenshot_worker *worker,
+                          struct sc_figma_bridge *figma_bridge,
+                          struct sc_figma_relay *figma_relay,
+                          enum sc_image_format format, int png_level) {
+    sc_vecdeque_init(&worker->queue);
+
+    bool ok = sc_mutex_init(&worker->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&worker->event_cond);
+    if (!ok) {
+        sc_mutex_destroy(&worker->mutex);
+        return false;
+    }
+
+    ok = sc_screenshot_writer_init(&worker->writer);
+    if (!ok) {
+        sc_cond_destroy(&worker->event_cond);
+        sc_mutex_destroy(&worker->mutex);
+        return false;
+    }
+
+    // lazy initialization
+    worker->initialized = false;
+
+    worker->stopped = false;
+    worker->figma_bridge = figma_bridge;
+    worker->figma_relay = figma_relay;
+    worker->format = format;
+    worker->png_level = png_level;
+    worker->sws_ctx = NULL;
+    worker->has_published_hash = false;
+    worker->published_hash = 0;
+
+    return true;
+}
+
+void
+sc_screenshot_worker_destroy(struct sc_screenshot_worker *worker) {
+    sc_cond_destroy(&worker->event_cond);
+    sc_mutex_destroy(&worker->mutex);
+
+    while (!sc_vecdeque_is_empty(&worker->queue)) {
+        struct sc_screenshot_request *req = sc_vecdeque_popref(&worker->queue);
+        assert(req);
+        sc_screenshot_request_destroy(req);
+    }
+    sc_vecdeque_destroy(&worker->queue);
+
+    sws_freeContext(worker->sws_ctx);
+    sc_screenshot_writer_destroy(&worker->writer);
+}
+
+static bool
+sc_screenshot_worker_push(struct sc_screenshot_worker *worker,
+                          struct sc_screenshot_request *req,
+                          const struct sc_screenshot_region *region,
+                          const char *directory) {
+    req->has_region = region;
+    if (region) {
+        req->region = *region;
+    }
+
+    // start the worker if it's used for the first time
+    if (!worker->initialized) {
+        if (!sc_screenshot_worker_start(worker)) {
+            sc_screenshot_request_destroy(req);
+            return false;
+        }
+        worker->initialized = true;
+    }
+
+    if (req->action == SC_SCREENSHOT_ACTION_SAVE_TO_DIRECTORY) {
+        assert(directory);
+        req->directory = strdup(directory);
+        if (!req->directory) {
+            LOG_OOM();
+            sc_screenshot_request_destroy(req);
+            return false;
+        }
+    }
+
+    sc_mutex_lock(&worker->mutex);
+    if (sc_vecdeque_size(&worker->queue) >= SC_SCREENSHOT_QUEUE_LIMIT) {
+        sc_mutex_unlock(&worker->mutex);
+        LOGW("Too many pending screenshots, screenshot dropped");
+        sc_screenshot_request_destroy(req);
+        return false;
+    }
+
+    bool was_empty = sc_vecdeque_is_empty(&worker->queue);
+    bool res = sc_vecdeque_push(&worker->queue, *req);
+    if (!res) {
+        LOG_OOM();
+        sc_mutex_unlock(&worker->mutex);
+        sc_screenshot_request_destroy(req);
+        return false;
+    }
+
+    if (was_empty) {
+        sc_cond_signal(&worker->event_cond);
+    }
+    sc_mutex_unlock(&worker->mutex);
+
+    return true;
+}
+
+bool
+sc_screenshot_worker_request(struct sc_screenshot_worker *worker,
+                             enum sc_screenshot_action action,
+                             const AVFrame *frame,
+                             const struct sc_screenshot_region *region,
+                             const char *directory) {
+    struct sc_screenshot_request req = {
+        .action = action,
+        .frame = NULL,
+        .pixels = NULL,
+        .png = NULL,
+        .directory = NULL,
+    };
+
+    req.frame = av_frame_alloc();
+    if (!req.frame) {
+        LOG_OOM();
+        return false;
+    }
+
+    // Reference the frame buffers, without copying the pixels
+    if (av_frame_ref(req.frame, frame)) {
+        LOG_OOM();
+        sc_screenshot_request_destroy(&req);
+        return false;
+    }
+
+    return sc_screenshot_worker_push(worker, &req, region, directory);
+}
+
+bool
+sc_screenshot_worker_request_rgba(struct sc_screenshot_worker *worker,
+                                  enum sc_screenshot_action action,
+                                  uint8_t *pixels, size_t pitch, int width,
+                                  int height,
+                                  const struct sc_screenshot_region *region,
+                                  const char *directory) {
+    assert(pixels);
+
+    struct sc_screenshot_request req = {
+        .action = action,
+        .frame = NULL,
+        .pixels = pixels,
+        .pitch = pitch,
+        .width = width,
+        .height = height,
+        .png = NULL,
+        .directory = NULL,
+    };
+
+    return sc_screenshot_worker_push(worker, &req, region, directory);
+}
+
+bool
+sc_screenshot_worker_request_png(struct sc_screenshot_worker *worker,
+                                 enum sc_screenshot_action action,
+                                 uint8_t *png, size_t png_size,
+                                 const struct sc_screenshot_region *region,
+                                 const char *directory) {
+    assert(png && png_size);
+
+    struct sc_screenshot_request req = {
+        .action = action,
+        .frame = NULL,
+        .pixels = NULL,
+        .png = png,
+        .png_size = png_size,
+        .directory = NULL,
+    };
+
+    return sc_screenshot_worker_push(worker, &req, region, directory);
+}
+
+// Map the region to an image of `width`x`height`, with its top-left corner
+// aligned on (1 << log2_align_w, 1 << log2_align_h) pixels (the chroma
+// subsampling of the source)
+//
+// Return false if the resulting crop is empty.
+static bool
+sc_screenshot_map_region(const struct sc_screenshot_region *region,
+                         int width, int height, int log2_align_w,
+                         int log2_align_h, struct sc_screenshot_crop *crop) {
+    int ref_w = region->ref_size.width;
+    int ref_h = region->ref_size.height;
+    if (!ref_w || !ref_h) {
+        return false;
+    }
+
+    // Round outwards, so that the selection is fully included
+    int64_t x0 = (int64_t) region->point.x * width / ref_w;
+    int64_t y0 = (int64_t) region->point.y * height / ref_h;
+    int64_t x1 = ((int64_t) (region->point.x + region->size.width) * width
+                    + ref_w - 1) / ref_w;
+    int64_t y1 = ((int64_t) (region->point.y + region->size.height) * height
+                    + ref_h - 1) / ref_h;
+
+    x0 = CLAMP(x0, 0, width) & ~(int64_t) ((1 << log2_align_w) - 1);
+    y0 = CLAMP(y0, 0, height) & ~(int64_t) ((1 << log2_align_h) - 1);
+    x1 = CLAMP(x1, 0, width);
+    y1 = CLAMP(y1, 0, height);
+    if (x1 <= x0 || y1 <= y0) {
+        return false;
+    }
+
+    crop->x = x0;
+    crop->y = y0;
+    crop->width = x1 - x0;
+    crop->height = y1 - y0;
+    return true;
+}
+
+// Compute the part of the frame to capture (the whole frame if `region` is
+// NULL)
+static bool
+sc_screenshot_get_frame_crop(const AVFrame *frame,
+                             const struct sc_screenshot_region *region,
+                             struct sc_screenshot_crop *crop) {
+    if (!region) {
+        crop->x = 0;
+        crop->y = 0;
+        crop->width = frame->width;
+        crop->height = frame->height;
+        return true;
+    }
+
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL
+                                 | AV_PIX_FMT_FLAG_BITSTREAM
+                                 | AV_PIX_FMT_FLAG_PAL))) {
+        LOGW("Could not crop screenshot (unsupported pixel format)");
+        return false;
+    }
+
+    if (!sc_screenshot_map_region(region, frame->width, frame->height,
+                                  desc->log2_chroma_w, desc->log2_chroma_h,
+                                  crop)) {
+        LOGW("Empty screenshot region");
+        return false;
+    }
+
+    return true;
+}
+
+// Convert the cropped part of the frame to RGBA8888 into `pixels` (of the
+// crop size)
+static bool
+sc_screenshot_convert_rgba(struct sc_screenshot_worker *worker,
+                           const AVFrame *frame,
+                           const struct sc_screenshot_crop *crop,
+                           uint8_t *pixels, size_t pitch) {
+    int width = crop->width;
+    int height = crop->height;
+
+    // Point each plane to the top-left corner of the crop, so that only the
+    // cropped slice is converted (the alignment of the crop on the chroma
+    // subsampling is guaranteed by sc_screenshot_get_frame_crop())
+    const uint8_t *src_data[4];
+    for (unsigned i = 0; i < 4; ++i) {
+        src_data[i] = frame->data[i];
+    }
+    if (crop->x || crop->y) {
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+        assert(desc);
+        bool rgb = desc->flags & AV_PIX_FMT_FLAG_RGB;
+        for (unsigned c = 0; c < desc->nb_components; ++c) {
+            const AVComponentDescriptor *comp = &desc->comp[c];
+            bool chroma = !rgb && (c == 1 || c == 2);
+            int x = chroma ? crop->x >> desc->log2_chroma_w : crop->x;
+            int y = chroma ? crop->y >> desc->log2_chroma_h : crop->y;
+            // The components packed in the same plane get the same pointer
+            src_data[comp->plane] = frame->data[comp->plane]
+                                  + (ptrdiff_t) y * frame->linesize[comp->plane]
+                                  + (ptrdiff_t) x * comp->step;
+        }
+    }
+
+    // The source and destination sizes are the same, so no filtering is
+    // needed: SWS_POINT is the cheapest scaler.
+    // The context is only recreated if the crop size or format changed.
+    worker->sws_ctx =
+        sc_sws_get_context(worker->sws_ctx, width, height, frame->format,
+                           width, height, AV_PIX_FMT_RGBA, SWS_POINT);
+    if (!worker->sws_ctx) {
+        LOGW("Could not initialize conversion context for screenshot");
+        return false;
+    }
+
+    uint8_t *dst_data[4] = {pixels, NULL, NULL, NULL};
+    int dst_linesize[4] = {(int) pitch, 0, 0, 0};
+    int ret = sws_scale(worker->sws_ctx, src_data, frame->linesize, 0, height,
+                        dst_data, dst_linesize);
+
+    if (ret <= 0) {
+        LOGW("Could not convert frame for screenshot");
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+sc_screenshot_capture_rgba(struct sc_screenshot_worker *worker,
+                           const AVFrame *frame,
+                           const struct sc_screenshot_region *region,
+                           uint8_t **pixels_out, size_t *pitch_out,
+                           int *width_out, int *height_out) {
+    assert(pixels_out && pitch_out && width_out && height_out);
+
+    if (frame->width <= 0 || frame->height <= 0) {
+        LOGW("Invalid screenshot size");
+        return false;
+    }
+
+    struct sc_screenshot_crop crop;
+    if (!sc_screenshot_get_frame_crop(frame, region, &crop)) {
+        return false;
+    }
+
+    int width = crop.width;
+    int height = crop.height;
+
+    if ((size_t) width > SIZE_MAX / 4u) {
+        LOGW("Screenshot size is too large");
+        return false;
+    }
+
+    size_t pitch = (size_t) width * 4;
+    if ((size_t) height > SIZE_MAX / pitch) {
+        LOGW("Screenshot buffer is too large");
+        return false;
+    }
+
+    size_t size = (size_t) height * pitch;
+    uint8_t *pixels = malloc(size);
+    if (!pixels) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (!sc_screenshot_convert_rgba(worker, frame, &crop, pixels, pitch)) {
+        free(pixels);
+        return false;
+    }
+
+    *pixels_out = pixels;
+    *pitch_out = pitch;
+    *width_out = width;
+    *height_out = height;
+    return true;
+}
+
+#ifdef __APPLE__
+// Convert the frame directly into the pixels of the clipboard image, without
+// an intermediate RGBA buffer
+static bool
+sc_screenshot_copy_frame_to_clipboard(struct sc_screenshot_worker *worker,
+                                      const AVFrame *frame,
+                                      const struct sc_screenshot_region *region) {
+    if (frame->width <= 0 || frame->height <= 0 || frame->width > 0xFFFF
+            || frame->height > 0xFFFF) {
+        LOGW("Invalid screenshot size");
+        return false;
+    }
+
+    struct sc_screenshot_crop crop;
+    if (!sc_screenshot_get_frame_crop(frame, region, &crop)) {
+        return false;
+    }
+
+    int width = crop.width;
+    int height = crop.height;
+
+    uint8_t *pixels;
+    size_t pitch;
+    struct sc_darwin_image *image =
+        sc_darwin_image_create_rgba8888(width, height, &pixels, &pitch);
+    if (!image) {
+        LOGW("Could not create screenshot clipboard image");
+        return false;
+    }
+
+    bool ok = sc_screenshot_convert_rgba(worker, frame, &crop, pixels, pitch);
+    if (ok) {
+        ok = sc_darwin_clipboard_set_image(image);
+        if (ok) {
+            LOGI("Screenshot copied to clipboard (%dx%d)", width, height);
+        } else {
+            LOGW("Could not copy screenshot image to the macOS clipboard");
+        }
+    }
+
+    sc_darwin_image_destroy(image);
+    return ok;
+}
+#endif
+
+static bool
+sc_screenshot_copy_to_clipboard(const uint8_t *pixels, size_t pitch,
+                                int width, int height) {
+    bool ok = false;
+#ifdef __APPLE__
+    ok = sc_darwin_clipboard_set_image_rgba8888(pixels, pitch, width, height);
+    if (!ok) {
+        LOGW("Could not copy screenshot image to the macOS clipboard");
+    }
+#else
+    (void) pixels;
+    (void) pitch;
+    LOGW("Screenshot clipboard image is only implemented on macOS");
+#endif
+
+    if (ok) {
+        LOGI("Screenshot copied to clipboard (%dx%d)", width, height);
+    }
+    return ok;
+}
+
+static bool
+sc_screenshot_save_to_directory(struct sc_screenshot_worker *worker,
+                                const char *directory, const uint8_t *pixels,
+                                size_t pitch, int width, int height) {
+#ifndef __APPLE__
+    (void) worker;
+    (void) directory;
+    (void) pixels;
+    (void) pitch;
+    (void) width;
+    (void) height;
+    LOGW("Saving screenshots to files is only implemented on macOS");
+    return false;
+#else
+    time_t now = time(NULL);
+    struct tm local_tm = {0};
+    localtime_r(&now, &local_tm);
+    uint32_t millis = SDL_GetTicks() % 1000;
+
+    char filename[128];
+    snprintf(filename, sizeof(filename),
+             "screenshot_%04d%02d%02d_%02d%02d%02d_%03u_%dx%d.%s",
+             local_tm.tm_year + 1900, local_tm.tm_mon + 1, local_tm.tm_mday,
+             local_tm.tm_hour, local_tm.tm_min, local_tm.tm_sec,
+             (unsigned) millis, width, height,
+             sc_image_format_get_name(worker->format));
+
+    // Do not encode a screenshot which could not be written (the size is not
+    // known yet, so only the number of pending writes is checked)
+    if (sc_screenshot_writer_is_full(&worker->writer, 0)) {
+        LOGW("Too many screenshots being saved, screenshot dropped");
+        return false;
+    }
+
+    uint8_t *data = NULL;
+    size_t size = 0;
+    bool encoded = sc_image_encode_rgba8888(worker->format, worker->png_level,
+                                            pixels, pitch, width, height,
+                                            &data, &size);
+    if (!encoded) {
+        LOGW("Could not encode screenshot");
+        return false;
+    }
+
+    size_t output_path_size = strlen(directory) + sizeof(filename) + 2;
+    char *output_path = malloc(output_path_size);
+    if (!output_path) {
+        LOG_OOM();
+        free(data);
+        return false;
+    }
+
+    snprintf(output_path, output_path_size, "%s/%s", directory, filename);
+
+    // Written asynchronously (the directory may be on a slow file system)
+    bool ok = sc_screenshot_writer_push(&worker->writer, output_path, data,
+                                        size);
+    free(output_path);
+    return ok;
+#endif
+}
+
+static bool
+sc_screenshot_send_to_figma_bridge(struct sc_screenshot_worker *worker,
+                                   const uint8_t *pixels, size_t pitch,
+                                   int width, int height) {
+    struct sc_figma_bridge *bridge = worker->figma_bridge;
+    struct sc_figma_relay *relay = worker->figma_relay;
+    if (!bridge && !relay) {
+        LOGW("Figma Bridge is unavailable");
+        return false;
+    }
+
+    // Much cheaper than encoding: do not encode and publish the same image
+    // again (the size is part of the hash)
+    uint64_t hash = sc_image_hash_rgba8888(pixels, pitch, width, height);
+    if (worker->has_published_hash && hash == worker->published_hash) {
+        LOGI("Screenshot unchanged, not published again to Figma Bridge");
+        return true;
+    }
+
+    uint8_t *png_data = NULL;
+    size_t png_size = 0;
+    bool encoded = sc_png_encode_rgba8888_level(pixels, pitch, width, height,
+                                                worker->png_level, &png_data,
+                                                &png_size);
+    if (!encoded) {
+        LOGW("Could not encode screenshot for Figma Bridge");
+        return false;
+    }
+
+    bool ok = bridge
+        ? sc_figma_bridge_publish_png(bridge, png_data, png_size,
+                                      (uint16_t) width, (uint16_t) height)
+        : sc_figma_relay_publish_png(relay, png_data, png_size,
+                                     (uint16_t) width, (uint16_t) height);
+    free(png_data);
+    if (!ok) {
+        LOGW("Could not queue screenshot to Figma Bridge");
+        return false;
+    }
+
+    worker->has_published_hash = true;
+    worker->published_hash = hash;
+
+    if (bridge) {
+        LOGI("Screenshot queued to Figma Bridge (http://127.0.0.1:%u/scrcpy-bridge/latest.png)",
+             (unsigned) sc_figma_bridge_get_port(bridge));
+    } else {
+        LOGI("Screenshot published to the Figma Bridge of another instance "
+             "(http://127.0.0.1:%u/scrcpy-bridge/%s/latest.png)",
+             (unsigned) relay->port, relay->serial);
+    }
+    return true;
+}
+
+static bool
+sc_screenshot_process(struct sc_screenshot_worker *worker,
+                      const struct sc_screenshot_request *req) {
+    const struct sc_screenshot_region *region =
+        req->has_region ? &req->region : NULL;
+    uint8_t *pixels = req->pixels;
+    size_t pitch = req->pitch;
+    int width = req->width;
+    int height = req->height;
+    // The pixels converted here, if any
+    uint8_t *converted = NULL;
+    bool ok;
+    if (pixels && region) {
+        // Already converted (GPU readback): only point to the region
+        struct sc_screenshot_crop crop;
+        if (!sc_screenshot_map_region(region, width, height, 0, 0, &crop)) {
+            LOGW("Empty screenshot region");
+            return false;
+        }
+        pixels += (size_t) crop.y * pitch + (size_t) crop.x * 4;
+        width = crop.width;
+        height = crop.height;
+    } else if (!pixels) {
+        const AVFrame *frame = req->frame;
+        AVFrame *decoded = NULL;
+        if (req->png) {
+            // Decoded here rather than on the UI thread
+            decoded = sc_png_decode(req->png, req->png_size);
+            if (!decoded) {
+                LOGW("Could not decode device screenshot");
+                return false;
+            }
+            frame = decoded;
+        }
+
+        assert(frame);
+#ifdef __APPLE__
+        if (req->action == SC_SCREENSHOT_ACTION_COPY_TO_CLIPBOARD) {
+            ok = sc_screenshot_copy_frame_to_clipboard(worker, frame, region);
+            av_frame_free(&decoded);
+            return ok;
+        }
+#endif
+        ok = sc_screenshot_capture_rgba(worker, frame, region, &converted,
+                                        &pitch, &width, &height);
+        av_frame_free(&decoded);
+        if (!ok) {
+            return false;
+        }
+        pixels = converted;
+    }
+
+    switch (req->action) {
+        case SC_SCREENSHOT_ACTION_COPY_TO_CLIPBOARD:
+            ok = sc_screenshot_copy_to_clipboard(pixels, pitch, width, height);
+            break;
+        case SC_SCREENSHOT_ACTION_SAVE_TO_DIRECTORY:
+            ok = sc_screenshot_save_to_directory(worker, req->directory,
+                                                 pixels, pitch, width, height);
+            break;
+        case SC_SCREENSHOT_ACTION_SEND_TO_FIGMA_BRIDGE:
+            ok = sc_screenshot_send_to_figma_bridge(worker, pixels, pitch,
+                                                    width, height);
+            break;
+        default:
+            assert(!"unexpected screenshot action");
+            ok = false;
+            break;
+    }
+
+    free(converted);
+    return ok;
+}
+
+static void
+sc_screenshot_push_done_event(bool ok) {
+    SDL_Event event = {
+        .user = {
+            .type = SC_EVENT_SCREENSHOT_DONE,
+            .code = ok ? 1 : 0,
+        },
+    };
+
+    int ret = SDL_PushEvent(&event);
+    if (ret < 0) {
+        LOGW("Could not post screenshot event: %s", SDL_GetError());
+    }
+}
+
+static int
+run_screenshot_worker(void *data) {
+    struct sc_screenshot_worker *worker = data;
+
+    for (;;) {
+        sc_mutex_lock(&worker->mutex);
+        while (!worker->stopped && sc_vecdeque_is_empty(&worker->queue)) {
+            sc_cond_wait(&worker->event_cond, &worker->mutex);
+        }
+        if (worker->stopped) {
+            // stop immediately, do not process further requests
+            sc_mutex_unlock(&worker->mutex);
+            break;
+        }
+
+        assert(!sc_vecdeque_is_empty(&worker->queue));
+        struct sc_screenshot_request req = sc_vecdeque_pop(&worker->queue);
+        sc_mutex_unlock(&worker->mutex);
+
+        bool ok = sc_screenshot_process(worker, &req);
+        sc_screenshot_request_destroy(&req);
+
+        sc_screenshot_push_done_event(ok);
+    }
+    return 0;
+}
+
+bool
+sc_screenshot_worker_start(struct sc_screenshot_worker *worker) {
+    LOGD("Starting screenshot thread");
+
+    bool ok = sc_thread_create(&worker->thread, run_screenshot_worker,
+                               "scrcpy-shot", worker);
+    if (!ok) {
+        LOGE("Could not start screenshot thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_screenshot_worker_stop(struct sc_screenshot_worker *worker) {
+    if (worker->initialized) {
+        sc_mutex_lock(&worker->mutex);
+        worker->stopped = true;
+        sc_cond_signal(&worker->event_cond);
+        sc_mutex_unlock(&worker->mutex);
+    }
+}
+
+void
+sc_screenshot_worker_join(struct sc_screenshot_worker *worker) {
+    if (worker->initialized) {
+        sc_thread_join(&worker->thread, NULL);
+    }
+
+    // The worker thread pushes the writes, so it must be joined first
+    sc_screenshot_writer_stop(&worker->writer);
+    sc_screenshot_writer_join(&worker->writer);
+}
+
+unsigned
+sc_screenshot_worker_get_pending_writes(struct sc_screenshot_worker *worker) {
+    return sc_screenshot_writer_get_pending(&worker->writer);
+}
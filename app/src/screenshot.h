@@ -0,0 +1,148 @@
+#ifndef SC_SCREENSHOT_H
+#define SC_SCREENSHOT_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libavutil/frame.h>
+
+#include "coords.h"
+#include "figma_bridge.h"
+#include "figma_relay.h"
+#include "image_variant.h"
+#include "screenshot_writer.h"
+#include "util/thread.h"
+#include "util/vecdeque.h"
+
+struct SwsContext;
+
+enum sc_screenshot_action {
+    SC_SCREENSHOT_ACTION_COPY_TO_CLIPBOARD,
+    SC_SCREENSHOT_ACTION_SAVE_TO_DIRECTORY,
+    SC_SCREENSHOT_ACTION_SEND_TO_FIGMA_BRIDGE,
+};
+
+// Region of a screenshot, in pixels of an image of size `ref_size` (the video
+// frame), scaled if the captured image has another size
+struct sc_screenshot_region {
+    struct sc_size ref_size;
+    struct sc_point point; // top-left corner
+    struct sc_size size;
+};
+
+struct sc_screenshot_request {
+    enum sc_screenshot_action action;
+    // Only capture a region of the image (only this region is converted and
+    // encoded)
+    bool has_region;
+    struct sc_screenshot_region region;
+    // Either frame, pixels or png is set
+    AVFrame *frame;
+    // Already converted RGBA8888 image (owned)
+    uint8_t *pixels;
+    size_t pitch;
+    int width;
+    int height;
+    // PNG image captured on the device (owned)
+    uint8_t *png;
+    size_t png_size;
+    char *directory; // only for SC_SCREENSHOT_ACTION_SAVE_TO_DIRECTORY
+};
+
+struct sc_screenshot_request_queue SC_VECDEQUE(struct sc_screenshot_request);
+
+/**
+ * Convert, encode and deliver screenshots from a separate thread, so that the
+ * UI thread is not blocked.
+ *
+ * Once a request is processed, a SC_EVENT_SCREENSHOT_DONE event is pushed,
+ * with user.code set to 1 on success or 0 on failure.
+ */
+struct sc_screenshot_worker {
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond event_cond;
+    bool stopped;
+    bool initialized;
+    struct sc_screenshot_request_queue queue;
+
+    // May be NULL, not owned
+    struct sc_figma_bridge *figma_bridge;
+    // Used if figma_bridge is NULL (the bridge of another instance), may be
+    // NULL, not owned
+    struct sc_figma_relay *figma_relay;
+
+    // Write the saved files, so that a slow file system does not block the
+    // next screenshots
+    struct sc_screenshot_writer writer;
+
+    // Format of the saved files
+    enum sc_image_format format;
+    // zlib compression level of the PNG images (or SC_PNG_COMPRESSION_DEFAULT)
+    int png_level;
+
+    // Conversion context, reused as long as the frame size and format do not
+    // change (only accessed from the worker thread)
+    struct SwsContext *sws_ctx;
+
+    // Hash of the last image published to the Figma Bridge, to avoid
+    // publishing the same image again (only accessed from the worker thread)
+    bool has_published_hash;
+    uint64_t published_hash;
+};
+
+bool
+sc_screenshot_worker_init(struct sc_screenshot_worker *worker,
+                          struct sc_figma_bridge *figma_bridge,
+                          struct sc_figma_relay *figma_relay,
+                          enum sc_image_format format, int png_level);
+
+void
+sc_screenshot_worker_destroy(struct sc_screenshot_worker *worker);
+
+bool
+sc_screenshot_worker_start(struct sc_screenshot_worker *worker);
+
+void
+sc_screenshot_worker_stop(struct sc_screenshot_worker *worker);
+
+// The screenshots being saved are written before the writer terminates
+void
+sc_screenshot_worker_join(struct sc_screenshot_worker *worker);
+
+// Get the number of screenshots being saved (callable from any thread)
+unsigned
+sc_screenshot_worker_get_pending_writes(struct sc_screenshot_worker *worker);
+
+// Capture `frame` (by reference, the caller keeps ownership)
+// `region` may be NULL to capture the whole frame
+// `directory` is only used (and copied) for SC_SCREENSHOT_ACTION_SAVE_TO_DIRECTORY
+bool
+sc_screenshot_worker_request(struct sc_screenshot_worker *worker,
+                             enum sc_screenshot_action action,
+                             const AVFrame *frame,
+                             const struct sc_screenshot_region *region,
+                             const char *directory);
+
+// Same as sc_screenshot_worker_request(), for an already converted RGBA8888
+// image (take ownership of pixels, and will free() it)
+bool
+sc_screenshot_worker_request_rgba(struct sc_screenshot_worker *worker,
+                                  enum sc_screenshot_action action,
+                                  uint8_t *pixels, size_t pitch, int width,
+                                  int height,
+                                  const struct sc_screenshot_region *region,
+                                  const char *directory);
+
+// Same as sc_screenshot_worker_request(), for a PNG image (take ownership of
+// png, and will free() it)
+bool
+sc_screenshot_worker_request_png(struct sc_screenshot_worker *worker,
+                                 enum sc_screenshot_action action,
+                                 uint8_t *png, size_t png_size,
+                                 const struct sc_screenshot_region *region,
+                                 const char *directory);
+
+#endif
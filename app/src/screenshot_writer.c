@@ -0,0 +1,262 @@
+#include "screenshot_writer.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
+
+#include "events.h"
+#include "util/log.h"
+
+#define SC_SCREENSHOT_WRITER_TMP_SUFFIX ".part"
+
+static void
+sc_screenshot_write_destroy(struct sc_screenshot_write *write) {
+    free(write->path);
+    free(write->data);
+}
+
+bool
+sc_screenshot_writer_init(struct sc_screenshot_writer *writer) {
+    sc_vecdeque_init(&writer->queue);
+
+    bool ok = sc_mutex_init(&writer->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&writer->event_cond);
+    if (!ok) {
+        sc_mutex_destroy(&writer->mutex);
+        return false;
+    }
+
+    // lazy initialization
+    writer->initialized = false;
+
+    writer->stopped = false;
+    writer->pending_bytes = 0;
+    writer->pending = 0;
+
+    return true;
+}
+
+void
+sc_screenshot_writer_destroy(struct sc_screenshot_writer *writer) {
+    sc_cond_destroy(&writer->event_cond);
+    sc_mutex_destroy(&writer->mutex);
+
+    while (!sc_vecdeque_is_empty(&writer->queue)) {
+        struct sc_screenshot_write *write = sc_vecdeque_popref(&writer->queue);
+        assert(write);
+        sc_screenshot_write_destroy(write);
+    }
+    sc_vecdeque_destroy(&writer->queue);
+}
+
+static void
+sc_screenshot_writer_notify(void) {
+    // The panel displays the pending writes
+    sc_notify_event(SC_EVENT_SCREENSHOT_WRITES_CHANGED);
+}
+
+static bool
+sc_screenshot_writer_sync(FILE *file) {
+    if (fflush(file)) {
+        return false;
+    }
+
+#ifdef _WIN32
+    return !_commit(_fileno(file));
+#else
+    return !fsync(fileno(file));
+#endif
+}
+
+static bool
+sc_screenshot_writer_write_file(const struct sc_screenshot_write *write) {
+    size_t len = strlen(write->path);
+    char *tmp_path = malloc(len + sizeof(SC_SCREENSHOT_WRITER_TMP_SUFFIX));
+    if (!tmp_path) {
+        LOG_OOM();
+        return false;
+    }
+    memcpy(tmp_path, write->path, len);
+    memcpy(tmp_path + len, SC_SCREENSHOT_WRITER_TMP_SUFFIX,
+           sizeof(SC_SCREENSHOT_WRITER_TMP_SUFFIX));
+
+    bool ok = false;
+    FILE *file = fopen(tmp_path, "wb");
+    if (file) {
+        ok = fwrite(write->data, 1, write->size, file) == write->size;
+        ok = ok && sc_screenshot_writer_sync(file);
+        ok &= !fclose(file);
+    }
+
+    // The file only appears under its final name once fully written
+    ok = ok && !rename(tmp_path, write->path);
+    if (!ok) {
+        remove(tmp_path);
+    }
+
+    free(tmp_path);
+    return ok;
+}
+
+static int
+run_screenshot_writer(void *data) {
+    struct sc_screenshot_writer *writer = data;
+
+    for (;;) {
+        sc_mutex_lock(&writer->mutex);
+        while (!writer->stopped && sc_vecdeque_is_empty(&writer->queue)) {
+            sc_cond_wait(&writer->event_cond, &writer->mutex);
+        }
+        if (sc_vecdeque_is_empty(&writer->queue)) {
+            // stopped, and all the pending screenshots are written
+            assert(writer->stopped);
+            sc_mutex_unlock(&writer->mutex);
+            break;
+        }
+
+        struct sc_screenshot_write write = sc_vecdeque_pop(&writer->queue);
+        sc_mutex_unlock(&writer->mutex);
+
+        if (sc_screenshot_writer_write_file(&write)) {
+            LOGI("Screenshot saved to %s", write.path);
+        } else {
+            LOGW("Could not save screenshot to %s", write.path);
+        }
+
+        sc_mutex_lock(&writer->mutex);
+        assert(writer->pending);
+        assert(writer->pending_bytes >= write.size);
+        --writer->pending;
+        writer->pending_bytes -= write.size;
+        sc_mutex_unlock(&writer->mutex);
+
+        sc_screenshot_write_destroy(&write);
+        sc_screenshot_writer_notify();
+    }
+
+    LOGD("Screenshot writer stopped");
+    return 0;
+}
+
+static bool
+sc_screenshot_writer_start(struct sc_screenshot_writer *writer) {
+    LOGD("Starting screenshot writer thread");
+
+    bool ok = sc_thread_create(&writer->thread, run_screenshot_writer,
+                               "scrcpy-shotw", writer);
+    if (!ok) {
+        LOGE("Could not start screenshot writer thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_screenshot_writer_stop(struct sc_screenshot_writer *writer) {
+    if (writer->initialized) {
+        sc_mutex_lock(&writer->mutex);
+        writer->stopped = true;
+        sc_cond_signal(&writer->event_cond);
+        sc_mutex_unlock(&writer->mutex);
+    }
+}
+
+void
+sc_screenshot_writer_join(struct sc_screenshot_writer *writer) {
+    if (writer->initialized) {
+        sc_thread_join(&writer->thread, NULL);
+    }
+}
+
+static bool
+sc_screenshot_writer_is_full_locked(struct sc_screenshot_writer *writer,
+                                    size_t size) {
+    sc_mutex_assert(&writer->mutex);
+
+    if (writer->pending >= SC_SCREENSHOT_WRITER_MAX_PENDING) {
+        return true;
+    }
+
+    // A single screenshot larger than the limit is accepted if nothing else
+    // is pending
+    return writer->pending
+        && writer->pending_bytes + size > SC_SCREENSHOT_WRITER_MAX_PENDING_BYTES;
+}
+
+bool
+sc_screenshot_writer_is_full(struct sc_screenshot_writer *writer, size_t size) {
+    sc_mutex_lock(&writer->mutex);
+    bool full = sc_screenshot_writer_is_full_locked(writer, size);
+    sc_mutex_unlock(&writer->mutex);
+    return full;
+}
+
+bool
+sc_screenshot_writer_push(struct sc_screenshot_writer *writer,
+                          const char *path, uint8_t *data, size_t size) {
+    // start the writer if it's used for the first time
+    if (!writer->initialized) {
+        if (!sc_screenshot_writer_start(writer)) {
+            free(data);
+            return false;
+        }
+        writer->initialized = true;
+    }
+
+    struct sc_screenshot_write write = {
+        .path = strdup(path),
+        .data = data,
+        .size = size,
+    };
+    if (!write.path) {
+        LOG_OOM();
+        free(data);
+        return false;
+    }
+
+    sc_mutex_lock(&writer->mutex);
+    if (sc_screenshot_writer_is_full_locked(writer, size)) {
+        sc_mutex_unlock(&writer->mutex);
+        LOGW("Too many screenshots being saved, screenshot dropped");
+        sc_screenshot_write_destroy(&write);
+        return false;
+    }
+
+    bool was_empty = sc_vecdeque_is_empty(&writer->queue);
+    bool ok = sc_vecdeque_push(&writer->queue, write);
+    if (!ok) {
+        sc_mutex_unlock(&writer->mutex);
+        LOG_OOM();
+        sc_screenshot_write_destroy(&write);
+        return false;
+    }
+
+    ++writer->pending;
+    writer->pending_bytes += size;
+    if (was_empty) {
+        sc_cond_signal(&writer->event_cond);
+    }
+    sc_mutex_unlock(&writer->mutex);
+
+    sc_screenshot_writer_notify();
+    return true;
+}
+
+unsigned
+sc_screenshot_writer_get_pending(struct sc_screenshot_writer *writer) {
+    sc_mutex_lock(&writer->mutex);
+    unsigned pending = writer->pending;
+    sc_mutex_unlock(&writer->mutex);
+    return pending;
+}
@@ -0,0 +1,88 @@
+#ifndef SC_SCREENSHOT_WRITER_H
+#define SC_SCREENSHOT_WRITER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/thread.h"
+#include "util/vecdeque.h"
+
+// Bounds of the writes queued at any time: beyond them, new screenshots are
+// rejected rather than accumulated in memory (the destination is too slow,
+// typically a network share or a synced folder)
+#define SC_SCREENSHOT_WRITER_MAX_PENDING 4
+#define SC_SCREENSHOT_WRITER_MAX_PENDING_BYTES (64 * 1024 * 1024)
+
+struct sc_screenshot_write {
+    char *path; // owned
+    uint8_t *data; // owned
+    size_t size;
+};
+
+struct sc_screenshot_write_queue SC_VECDEQUE(struct sc_screenshot_write);
+
+/**
+ * Write the encoded screenshots to their files from a separate thread, so
+ * that a slow file system does not block the capture of the next screenshots.
+ *
+ * Each file is written to a temporary name in the same directory, synced,
+ * then renamed, so that a partial file is never visible under its final name.
+ *
+ * Each time the number of pending writes changes, a
+ * SC_EVENT_SCREENSHOT_WRITES_CHANGED event is notified.
+ */
+struct sc_screenshot_writer {
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond event_cond;
+    bool stopped;
+    bool initialized;
+    struct sc_screenshot_write_queue queue;
+    // Size of the data queued or being written
+    size_t pending_bytes;
+    // Number of writes queued or being written
+    unsigned pending;
+};
+
+bool
+sc_screenshot_writer_init(struct sc_screenshot_writer *writer);
+
+void
+sc_screenshot_writer_destroy(struct sc_screenshot_writer *writer);
+
+// The pending writes are completed before the thread terminates
+void
+sc_screenshot_writer_stop(struct sc_screenshot_writer *writer);
+
+void
+sc_screenshot_writer_join(struct sc_screenshot_writer *writer);
+
+/**
+ * Whether a new write of `size` bytes would be rejected
+ *
+ * This allows to not encode a screenshot which could not be written anyway.
+ */
+bool
+sc_screenshot_writer_is_full(struct sc_screenshot_writer *writer, size_t size);
+
+/**
+ * Queue the write of `data` to `path`
+ *
+ * Take ownership of `data` (even on error), `path` is copied.
+ *
+ * Return false if the queue is full.
+ */
+bool
+sc_screenshot_writer_push(struct sc_screenshot_writer *writer,
+                          const char *path, uint8_t *data, size_t size);
+
+/**
+ * Get the number of writes not completed yet (callable from any thread)
+ */
+unsigned
+sc_screenshot_writer_get_pending(struct sc_screenshot_writer *writer);
+
+#endif
@@ -8,11 +8,15 @@
 #include <sys/types.h>
 
 #include "adb/adb.h"
+#include "bit_rate_probe.h"
+#include "util/binary.h"
 #include "util/env.h"
 #include "util/file.h"
 #include "util/log.h"
 #include "util/net_intr.h"
 #include "util/process.h"
+#include "util/rand.h"
+#include "util/sha256.h"
 #include "util/str.h"
 
 #define SC_SERVER_FILENAME "scrcpy-server"
@@ -23,6 +27,9 @@
 #define SC_ADB_PORT_DEFAULT 5555
 #define SC_SOCKET_NAME_PREFIX "scrcpy_"
 
+// Exit code of the batched "adb shell" if the server on the device is outdated
+#define SC_SERVER_EXIT_OUTDATED 42
+
 static char *
 get_server_path(void) {
     char *server_path = sc_get_env("SCRCPY_SERVER_PATH");
@@ -53,8 +60,35 @@ get_server_path(void) {
     return server_path;
 }
 
+// Indicate if the server on the device is the same as the local one
 static bool
-push_server(struct sc_intr *intr, const char *serial) {
+is_server_up_to_date(struct sc_intr *intr, const char *serial,
+                     const char *server_path) {
+    char local_hash[SC_SHA256_HEX_SIZE];
+    if (!sc_sha256_file(server_path, local_hash)) {
+        return false;
+    }
+
+    char *device_hash =
+        sc_adb_get_sha256sum(intr, serial, SC_DEVICE_SERVER_PATH);
+    if (!device_hash) {
+        // Not pushed yet (or sha256sum is not available on the device)
+        return false;
+    }
+
+    bool same = !strcmp(local_hash, device_hash);
+    free(device_hash);
+    return same;
+}
+
+// If check_device is true, then the push is skipped if the server already
+// present on the device is the same as the local one. It is only relevant if
+// the server is not removed from the device on exit (--no-cleanup).
+//
+// If present is not NULL, it is set to true if the push has been skipped.
+static bool
+push_server(struct sc_intr *intr, const char *serial, bool check_device,
+            bool *present) {
     char *server_path = get_server_path();
     if (!server_path) {
         return false;
@@ -64,11 +98,49 @@ push_server(struct sc_intr *intr, const char *serial) {
         free(server_path);
         return false;
     }
+
+    if (check_device && is_server_up_to_date(intr, serial, server_path)) {
+        LOGD("Server already present on the device, not pushed");
+        free(server_path);
+        if (present) {
+            *present = true;
+        }
+        return true;
+    }
+
     bool ok = sc_adb_push(intr, serial, server_path, SC_DEVICE_SERVER_PATH, 0);
     free(server_path);
     return ok;
 }
 
+static bool
+get_local_server_hash(char hex[SC_SHA256_HEX_SIZE]) {
+    char *server_path = get_server_path();
+    if (!server_path) {
+        return false;
+    }
+
+    bool ok = sc_sha256_file(server_path, hex);
+    free(server_path);
+    return ok;
+}
+
+struct sc_server_push {
+    struct sc_server *server;
+    bool check_device;
+    bool present;
+    bool ok;
+};
+
+static int
+run_push(void *data) {
+    struct sc_server_push *push = data;
+    struct sc_server *server = push->server;
+    push->ok = push_server(&server->push_intr, server->serial,
+                           push->check_device, &push->present);
+    return 0;
+}
+
 static const char *
 log_level_to_server_string(enum sc_log_level level) {
     switch (level) {
@@ -201,54 +273,15 @@ validate_string(const char *s) {
     return true;
 }
 
-static sc_pid
-execute_server(struct sc_server *server,
-               const struct sc_server_params *params) {
-    sc_pid pid = SC_PROCESS_NONE;
-
-    const char *serial = server->serial;
-    assert(serial);
-
-    const char *cmd[128];
-    unsigned count = 0;
-    cmd[count++] = sc_adb_get_executable();
-    cmd[count++] = "-s";
-    cmd[count++] = serial;
-    cmd[count++] = "shell";
-    cmd[count++] = "CLASSPATH=" SC_DEVICE_SERVER_PATH;
-    cmd[count++] = "app_process";
-
-#ifdef SERVER_DEBUGGER
-    uint16_t sdk_version = sc_adb_get_device_sdk_version(&server->intr, serial);
-    if (!sdk_version) {
-        LOGE("Could not determine SDK version");
-        return 0;
-    }
-
-# define SERVER_DEBUGGER_PORT "5005"
-    const char *dbg;
-    if (sdk_version < 28) {
-        // Android < 9
-        dbg = "-agentlib:jdwp=transport=dt_socket,suspend=y,server=y,address="
-              SERVER_DEBUGGER_PORT;
-    } else if (sdk_version < 30) {
-        // Android >= 9 && Android < 11
-        dbg = "-XjdwpProvider:internal -XjdwpOptions:transport=dt_socket,"
-              "suspend=y,server=y,address=" SERVER_DEBUGGER_PORT;
-    } else {
-        // Android >= 11
-        // Contrary to the other methods, this does not suspend on start.
-        // <https://github.com/Genymobile/scrcpy/pull/5466>
-        dbg = "-XjdwpProvider:adbconnection";
-    }
-    cmd[count++] = dbg;
-#endif
-
-    cmd[count++] = "/"; // unused
-    cmd[count++] = "com.genymobile.scrcpy.Server";
-    cmd[count++] = SCRCPY_VERSION;
+// Append the server parameters (except the scid) to cmd
+// On error, the strings already appended must still be freed by the caller.
+static bool
+sc_server_append_params(struct sc_server *server,
+                        const struct sc_server_params *params,
+                        const char **cmd, unsigned *pcount) {
+    unsigned count = *pcount;
+    bool ok = false;
 
-    unsigned dyn_idx = count; // from there, the strings are allocated
 #define ADD_PARAM(fmt, ...) do { \
         char *p; \
         if (asprintf(&p, fmt, ## __VA_ARGS__) == -1) { \
@@ -262,7 +295,6 @@ execute_server(struct sc_server *server,
         } \
     } while(0)
 
-    ADD_PARAM("scid=%08x", params->scid);
     ADD_PARAM("log_level=%s", log_level_to_server_string(params->log_level));
 
     if (!params->video) {
@@ -271,6 +303,9 @@ execute_server(struct sc_server *server,
     if (params->video_bit_rate) {
         ADD_PARAM("video_bit_rate=%" PRIu32, params->video_bit_rate);
     }
+    if (params->video_bit_rate_probe) {
+        ADD_PARAM("video_bit_rate_probe=true");
+    }
     if (!params->audio) {
         ADD_PARAM("audio=false");
     }
@@ -281,6 +316,10 @@ execute_server(struct sc_server *server,
         ADD_PARAM("video_codec=%s",
                   sc_server_get_codec_name(params->video_codec));
     }
+    if (params->video_codecs) {
+        VALIDATE_STRING(params->video_codecs);
+        ADD_PARAM("video_codecs=%s", params->video_codecs);
+    }
     if (params->audio_codec != SC_CODEC_OPUS) {
         ADD_PARAM("audio_codec=%s",
             sc_server_get_codec_name(params->audio_codec));
@@ -289,6 +328,16 @@ execute_server(struct sc_server *server,
         assert(params->video_source == SC_VIDEO_SOURCE_CAMERA);
         ADD_PARAM("video_source=camera");
     }
+    if (params->video_encoder_profile != SC_VIDEO_ENCODER_PROFILE_DEFAULT) {
+        assert(params->video_encoder_profile
+                == SC_VIDEO_ENCODER_PROFILE_LOW_LATENCY);
+        ADD_PARAM("video_encoder_profile=low-latency");
+    }
+    if (params->video_mode == SC_VIDEO_MODE_THUMBNAIL) {
+        ADD_PARAM("video_mode=thumbnail");
+        uint64_t ms = SC_TICK_TO_MS(params->thumbnail_interval);
+        ADD_PARAM("thumbnail_interval=%" PRIu64, ms);
+    }
     // If audio is enabled, an "auto" audio source must have been resolved
     assert(params->audio_source != SC_AUDIO_SOURCE_AUTO || !params->audio);
     if (params->audio_source != SC_AUDIO_SOURCE_OUTPUT && params->audio) {
@@ -395,6 +444,41 @@ execute_server(struct sc_server *server,
         // By default, downsize_on_error is true
         ADD_PARAM("downsize_on_error=false");
     }
+    if (params->video_roi) {
+        ADD_PARAM("video_roi=true");
+    }
+    if (params->video_square) {
+        ADD_PARAM("video_square=true");
+    }
+    if (params->thermal_throttle) {
+        ADD_PARAM("thermal_throttle=true");
+    }
+    if (params->multiplex) {
+        ADD_PARAM("multiplex=true");
+    }
+    if (server->video_udp_addr) {
+        ADD_PARAM("video_udp_port=%" PRIu16, params->video_udp_port);
+    }
+    if (params->video_socket_buffer) {
+        ADD_PARAM("video_socket_buffer=%" PRIu32, params->video_socket_buffer);
+    }
+    if (server->direct_addr) {
+        ADD_PARAM("direct_port=%" PRIu16, params->direct_port);
+        ADD_PARAM("direct_token=%016" PRIx64, server->direct_token);
+    }
+    if (params->video_idle_timeout) {
+        uint64_t ms = SC_TICK_TO_MS(params->video_idle_timeout);
+        ADD_PARAM("video_idle_timeout=%" PRIu64, ms);
+    }
+    if (params->video_intra_refresh) {
+        ADD_PARAM("video_intra_refresh=%" PRIu16, params->video_intra_refresh);
+    }
+    if (params->video_hdr) {
+        ADD_PARAM("video_hdr=true");
+    }
+    if (params->latency_probe) {
+        ADD_PARAM("latency_probe=true");
+    }
     if (!params->cleanup) {
         // By default, cleanup is true
         ADD_PARAM("cleanup=false");
@@ -403,10 +487,16 @@ execute_server(struct sc_server *server,
         // By default, power_on is true
         ADD_PARAM("power_on=false");
     }
+    if (params->keep_server) {
+        ADD_PARAM("keep_server=true");
+    }
     if (params->new_display) {
         VALIDATE_STRING(params->new_display);
         ADD_PARAM("new_display=%s", params->new_display);
     }
+    if (params->render_scale != 1.f) {
+        ADD_PARAM("render_scale=%g", (double) params->render_scale);
+    }
     if (params->display_ime_policy != SC_DISPLAY_IME_POLICY_UNDEFINED) {
         ADD_PARAM("display_ime_policy=%s",
             sc_server_get_display_ime_policy_name(params->display_ime_policy));
@@ -432,8 +522,131 @@ execute_server(struct sc_server *server,
     if (params->list & SC_OPTION_LIST_APPS) {
         ADD_PARAM("list_apps=true");
     }
+    if (params->list & SC_OPTION_BENCHMARK_ENCODERS) {
+        ADD_PARAM("benchmark_encoders=true");
+    }
 
 #undef ADD_PARAM
+#undef VALIDATE_STRING
+
+    ok = true;
+
+end:
+    *pcount = count;
+    return ok;
+}
+
+// With --keep-server, the scid (and thus the device socket name) is derived
+// from the scrcpy version and the server parameters, so that a client only
+// reuses a running server started with the same version and options.
+static bool
+sc_server_compute_keep_scid(struct sc_server *server, uint32_t *scid) {
+    const char *cmd[128];
+    unsigned count = 0;
+    bool ok = sc_server_append_params(server, &server->params, cmd, &count);
+    if (ok) {
+        // FNV-1a
+        uint32_t hash = 0x811C9DC5;
+        const char *version = SCRCPY_VERSION;
+        for (unsigned i = 0; i <= count; ++i) {
+            const char *str = i ? cmd[i - 1] : version;
+            // Include the terminating '\0' as a separator
+            do {
+                hash = (hash ^ (uint8_t) *str) * 0x01000193;
+            } while (*str++);
+        }
+        // Only use 31 bits to avoid issues with signed values on the Java-side
+        *scid = hash & 0x7FFFFFFF;
+    }
+
+    for (unsigned i = 0; i < count; ++i) {
+        free((char *) cmd[i]);
+    }
+
+    return ok;
+}
+
+// If batch_hash is not NULL, then the server is only started if the SHA-256 of
+// the server on the device is batch_hash, in the same "adb shell" command
+// (otherwise, the command exits with SC_SERVER_EXIT_OUTDATED).
+static sc_pid
+execute_server(struct sc_server *server,
+               const struct sc_server_params *params,
+               const char *batch_hash) {
+    sc_pid pid = SC_PROCESS_NONE;
+
+    const char *serial = server->serial;
+    assert(serial);
+
+    const char *cmd[128];
+    unsigned count = 0;
+    cmd[count++] = sc_adb_get_executable();
+    cmd[count++] = "-s";
+    cmd[count++] = serial;
+    cmd[count++] = "shell";
+
+    char hash_pattern[SC_SHA256_HEX_SIZE + 1];
+    if (batch_hash) {
+        // The arguments are joined by adb and executed by the device shell:
+        //   sha256sum <path> | grep -q ^<hash> || exit 42 ; CLASSPATH=...
+        // (without quotes, since they are not properly escaped on Windows)
+        snprintf(hash_pattern, sizeof(hash_pattern), "^%s", batch_hash);
+        cmd[count++] = "sha256sum";
+        cmd[count++] = SC_DEVICE_SERVER_PATH;
+        cmd[count++] = "|";
+        cmd[count++] = "grep";
+        cmd[count++] = "-q";
+        cmd[count++] = hash_pattern;
+        cmd[count++] = "||";
+        cmd[count++] = "exit";
+        cmd[count++] = SC_STR(SC_SERVER_EXIT_OUTDATED);
+        cmd[count++] = ";";
+    }
+
+    cmd[count++] = "CLASSPATH=" SC_DEVICE_SERVER_PATH;
+    cmd[count++] = "app_process";
+
+#ifdef SERVER_DEBUGGER
+    uint16_t sdk_version = sc_adb_get_device_sdk_version(&server->intr, serial);
+    if (!sdk_version) {
+        LOGE("Could not determine SDK version");
+        return 0;
+    }
+
+# define SERVER_DEBUGGER_PORT "5005"
+    const char *dbg;
+    if (sdk_version < 28) {
+        // Android < 9
+        dbg = "-agentlib:jdwp=transport=dt_socket,suspend=y,server=y,address="
+              SERVER_DEBUGGER_PORT;
+    } else if (sdk_version < 30) {
+        // Android >= 9 && Android < 11
+        dbg = "-XjdwpProvider:internal -XjdwpOptions:transport=dt_socket,"
+              "suspend=y,server=y,address=" SERVER_DEBUGGER_PORT;
+    } else {
+        // Android >= 11
+        // Contrary to the other methods, this does not suspend on start.
+        // <https://github.com/Genymobile/scrcpy/pull/5466>
+        dbg = "-XjdwpProvider:adbconnection";
+    }
+    cmd[count++] = dbg;
+#endif
+
+    cmd[count++] = "/"; // unused
+    cmd[count++] = "com.genymobile.scrcpy.Server";
+    cmd[count++] = SCRCPY_VERSION;
+
+    unsigned dyn_idx = count; // from there, the strings are allocated
+
+    char *scid;
+    if (asprintf(&scid, "scid=%08x", params->scid) == -1) {
+        goto end;
+    }
+    cmd[count++] = scid;
+
+    if (!sc_server_append_params(server, params, cmd, &count)) {
+        goto end;
+    }
 
     cmd[count++] = NULL;
 
@@ -464,9 +677,33 @@ end:
 }
 
 static bool
-connect_and_read_byte(struct sc_intr *intr, sc_socket socket,
+sc_server_connect_socket(struct sc_server *server, sc_socket socket,
+                         uint32_t host, uint16_t port) {
+    bool ok = net_connect_intr(&server->intr, socket, host, port);
+    if (!ok) {
+        return false;
+    }
+
+    if (server->direct_addr) {
+        // The server only accepts the direct connections starting with the
+        // token it received on its command line
+        uint8_t token[8];
+        sc_write64be(token, server->direct_token);
+        ssize_t w = net_send_all_intr(&server->intr, socket, token,
+                                      sizeof(token));
+        if (w != sizeof(token)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+connect_and_read_byte(struct sc_server *server, sc_socket socket,
                       uint32_t tunnel_host, uint16_t tunnel_port) {
-    bool ok = net_connect_intr(intr, socket, tunnel_host, tunnel_port);
+    bool ok = sc_server_connect_socket(server, socket, tunnel_host,
+                                       tunnel_port);
     if (!ok) {
         return false;
     }
@@ -474,7 +711,7 @@ connect_and_read_byte(struct sc_intr *intr, sc_socket socket,
     char byte;
     // the connection may succeed even if the server behind the "adb tunnel"
     // is not listening, so read one byte to detect a working connection
-    if (net_recv_intr(intr, socket, &byte, 1) != 1) {
+    if (net_recv_intr(&server->intr, socket, &byte, 1) != 1) {
         // the server is not listening yet behind the adb tunnel
         return false;
     }
@@ -489,7 +726,7 @@ connect_to_server(struct sc_server *server, unsigned attempts, sc_tick delay,
         LOGD("Remaining connection attempts: %u", attempts);
         sc_socket socket = net_socket();
         if (socket != SC_SOCKET_NONE) {
-            bool ok = connect_and_read_byte(&server->intr, socket, host, port);
+            bool ok = connect_and_read_byte(server, socket, host, port);
             if (ok) {
                 // it worked!
                 return socket;
@@ -521,12 +758,17 @@ sc_server_init(struct sc_server *server, const struct sc_server_params *params,
     // The allocated data in params (const char *) must remain valid until the
     // end of the program
     server->params = *params;
+    server->session_cache.server_hash[0] = '\0';
+    server->session_cache.video_size = (struct sc_size) {0, 0};
+    server->session_cache.window_size = (struct sc_size) {0, 0};
 
     bool ok = sc_adb_init();
     if (!ok) {
         return false;
     }
 
+    sc_adb_set_native(params->adb_native);
+
     ok = sc_mutex_init(&server->mutex);
     if (!ok) {
         sc_adb_destroy();
@@ -548,6 +790,15 @@ sc_server_init(struct sc_server *server, const struct sc_server_params *params,
         return false;
     }
 
+    ok = sc_intr_init(&server->push_intr);
+    if (!ok) {
+        sc_intr_destroy(&server->intr);
+        sc_cond_destroy(&server->cond_stopped);
+        sc_mutex_destroy(&server->mutex);
+        sc_adb_destroy();
+        return false;
+    }
+
     server->serial = NULL;
     server->device_socket_name = NULL;
     server->stopped = false;
@@ -555,6 +806,11 @@ sc_server_init(struct sc_server *server, const struct sc_server_params *params,
     server->video_socket = SC_SOCKET_NONE;
     server->audio_socket = SC_SOCKET_NONE;
     server->control_socket = SC_SOCKET_NONE;
+    server->mux_socket = SC_SOCKET_NONE;
+    server->video_udp_addr = 0;
+    server->video_udp_socket = SC_SOCKET_NONE;
+    server->direct_addr = 0;
+    server->direct_token = 0;
 
     sc_adb_tunnel_init(&server->tunnel);
 
@@ -586,10 +842,105 @@ device_read_info(struct sc_intr *intr, sc_socket device_socket,
 }
 
 static bool
-sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
+sc_server_probe_bit_rate(struct sc_server *server, sc_socket socket) {
+    const struct sc_server_params *params = &server->params;
+    struct sc_intr *intr = &server->intr;
+
+    uint8_t header[4];
+    ssize_t r = net_recv_all_intr(intr, socket, header, sizeof(header));
+    if (r != sizeof(header)) {
+        LOGE("Could not receive the throughput probe");
+        return false;
+    }
+
+    uint32_t size = sc_read32be(header);
+    if (!size || size > SC_BIT_RATE_PROBE_MAX_SIZE) {
+        LOGE("Invalid throughput probe size: %" PRIu32, size);
+        return false;
+    }
+
+    // The clock starts on the first received chunk, to exclude the latency
+    uint8_t buf[16384];
+    sc_tick start = 0;
+    uint32_t received = 0;
+    uint32_t measured = 0;
+    while (received < size) {
+        r = net_recv_intr(intr, socket, buf, MIN(sizeof(buf), size - received));
+        if (r <= 0) {
+            LOGE("Could not receive the throughput probe");
+            return false;
+        }
+
+        if (!received) {
+            start = sc_tick_now();
+        } else {
+            measured += r;
+        }
+        received += r;
+    }
+
+    sc_tick duration = sc_tick_now() - start;
+    // If the whole probe was received at once, the link is fast enough
+    uint64_t throughput = duration > 0
+                        ? (uint64_t) measured * 8 * SC_TICK_FREQ / duration
+                        : UINT64_MAX / 100;
+
+    uint32_t reserved = 0;
+    if (params->audio) {
+        // The audio stream also consumes some throughput (default is 128K)
+        reserved = params->audio_bit_rate ? params->audio_bit_rate : 128000;
+    }
+
+    struct sc_bit_rate_probe_result result =
+        sc_bit_rate_probe_choose(throughput, reserved, params->max_size);
+
+    LOGI("Measured throughput: %" PRIu64 " kbps, video bit rate: %" PRIu32
+         " bps", throughput / 1000, result.bit_rate);
+    if (result.max_size) {
+        LOGI("Video max size: %" PRIu16, result.max_size);
+    }
+
+    uint8_t reply[6];
+    sc_write32be(reply, result.bit_rate);
+    sc_write16be(&reply[4], result.max_size);
+    ssize_t w = net_send_all_intr(intr, socket, reply, sizeof(reply));
+    if (w != sizeof(reply)) {
+        LOGE("Could not send the video bit rate");
+        return false;
+    }
+
+    return true;
+}
+
+static void
+sc_server_tune_sockets(struct sc_server *server, sc_socket video_socket,
+                       sc_socket audio_socket, sc_socket control_socket) {
+    const struct sc_server_params *params = &server->params;
+
+    // Failures are not fatal (errors are already logged)
+
+    if (video_socket != SC_SOCKET_NONE && params->video_socket_buffer) {
+        net_set_recv_buffer_size(video_socket,
+                                 (int) params->video_socket_buffer);
+    }
+
+    if (params->socket_busy_poll) {
+        sc_socket sockets[] = {video_socket, audio_socket, control_socket};
+        for (size_t i = 0; i < ARRAY_LEN(sockets); ++i) {
+            if (sockets[i] != SC_SOCKET_NONE) {
+                net_set_busy_poll(sockets[i], params->socket_busy_poll);
+            }
+        }
+    }
+}
+
+static bool
+sc_server_connect_to(struct sc_server *server, struct sc_server_info *info,
+                     unsigned attempts) {
     struct sc_adb_tunnel *tunnel = &server->tunnel;
 
-    assert(tunnel->enabled);
+    // In direct mode, no adb tunnel is used
+    assert(tunnel->enabled != !!server->direct_addr);
 
     const char *serial = server->serial;
     assert(serial);
@@ -597,12 +948,21 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
     bool video = server->params.video;
     bool audio = server->params.audio;
     bool control = server->params.control;
+    bool multiplex = server->params.multiplex;
 
     sc_socket video_socket = SC_SOCKET_NONE;
     sc_socket audio_socket = SC_SOCKET_NONE;
     sc_socket control_socket = SC_SOCKET_NONE;
-    if (!tunnel->forward) {
-        if (video) {
+    sc_socket mux_socket = SC_SOCKET_NONE;
+    sc_socket video_udp_socket = SC_SOCKET_NONE;
+    if (tunnel->enabled && !tunnel->forward) {
+        if (multiplex) {
+            // All the streams are carried by a single socket
+            mux_socket = net_accept_intr(&server->intr, tunnel->server_socket);
+            if (mux_socket == SC_SOCKET_NONE) {
+                goto fail;
+            }
+        } else if (video) {
             video_socket =
                 net_accept_intr(&server->intr, tunnel->server_socket);
             if (video_socket == SC_SOCKET_NONE) {
@@ -610,7 +970,7 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
             }
         }
 
-        if (audio) {
+        if (!multiplex && audio) {
             audio_socket =
                 net_accept_intr(&server->intr, tunnel->server_socket);
             if (audio_socket == SC_SOCKET_NONE) {
@@ -618,7 +978,7 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
             }
         }
 
-        if (control) {
+        if (!multiplex && control) {
             control_socket =
                 net_accept_intr(&server->intr, tunnel->server_socket);
             if (control_socket == SC_SOCKET_NONE) {
@@ -626,17 +986,23 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
             }
         }
     } else {
-        uint32_t tunnel_host = server->params.tunnel_host;
-        if (!tunnel_host) {
-            tunnel_host = IPV4_LOCALHOST;
-        }
+        uint32_t tunnel_host;
+        uint16_t tunnel_port;
+        if (server->direct_addr) {
+            tunnel_host = server->direct_addr;
+            tunnel_port = server->params.direct_port;
+        } else {
+            tunnel_host = server->params.tunnel_host;
+            if (!tunnel_host) {
+                tunnel_host = IPV4_LOCALHOST;
+            }
 
-        uint16_t tunnel_port = server->params.tunnel_port;
-        if (!tunnel_port) {
-            tunnel_port = tunnel->local_port;
+            tunnel_port = server->params.tunnel_port;
+            if (!tunnel_port) {
+                tunnel_port = tunnel->local_port;
+            }
         }
 
-        unsigned attempts = 100;
         sc_tick delay = SC_TICK_FROM_MS(100);
         sc_socket first_socket = connect_to_server(server, attempts, delay,
                                                    tunnel_host, tunnel_port);
@@ -644,11 +1010,13 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
             goto fail;
         }
 
-        if (video) {
+        if (multiplex) {
+            mux_socket = first_socket;
+        } else if (video) {
             video_socket = first_socket;
         }
 
-        if (audio) {
+        if (!multiplex && audio) {
             if (!video) {
                 audio_socket = first_socket;
             } else {
@@ -656,15 +1024,15 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
                 if (audio_socket == SC_SOCKET_NONE) {
                     goto fail;
                 }
-                bool ok = net_connect_intr(&server->intr, audio_socket,
-                                           tunnel_host, tunnel_port);
+                bool ok = sc_server_connect_socket(server, audio_socket,
+                                                   tunnel_host, tunnel_port);
                 if (!ok) {
                     goto fail;
                 }
             }
         }
 
-        if (control) {
+        if (!multiplex && control) {
             if (!video && !audio) {
                 control_socket = first_socket;
             } else {
@@ -672,8 +1040,8 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
                 if (control_socket == SC_SOCKET_NONE) {
                     goto fail;
                 }
-                bool ok = net_connect_intr(&server->intr, control_socket,
-                                           tunnel_host, tunnel_port);
+                bool ok = sc_server_connect_socket(server, control_socket,
+                                                   tunnel_host, tunnel_port);
                 if (!ok) {
                     goto fail;
                 }
@@ -689,11 +1057,27 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
         (void) ok; // error already logged
     }
 
-    // we don't need the adb tunnel anymore
-    sc_adb_tunnel_close(tunnel, &server->intr, serial,
-                        server->device_socket_name);
+    if (mux_socket != SC_SOCKET_NONE) {
+        // The device messages are sent on the multiplexed socket
+        bool ok = net_set_tcp_nodelay(mux_socket, true);
+        (void) ok; // error already logged
+
+        // The receive buffer is shared by all the streams
+        sc_server_tune_sockets(server, mux_socket, SC_SOCKET_NONE,
+                               SC_SOCKET_NONE);
+    } else {
+        sc_server_tune_sockets(server, video_socket, audio_socket,
+                               control_socket);
+    }
+
+    if (tunnel->enabled) {
+        // we don't need the adb tunnel anymore
+        sc_adb_tunnel_close(tunnel, &server->intr, serial,
+                            server->device_socket_name);
+    }
 
-    sc_socket first_socket = video ? video_socket
+    sc_socket first_socket = multiplex ? mux_socket
+                           : video ? video_socket
                            : audio ? audio_socket
                                    : control_socket;
 
@@ -703,13 +1087,46 @@ sc_server_connect_to(struct sc_server *server, struct sc_server_info *info) {
         goto fail;
     }
 
-    assert(!video || video_socket != SC_SOCKET_NONE);
-    assert(!audio || audio_socket != SC_SOCKET_NONE);
-    assert(!control || control_socket != SC_SOCKET_NONE);
+    if (video && server->params.video_bit_rate_probe) {
+        // In multiplexed mode, the probe is received before the first frame
+        ok = sc_server_probe_bit_rate(server, multiplex ? mux_socket
+                                                        : video_socket);
+        if (!ok) {
+            goto fail;
+        }
+    }
+
+    assert(multiplex || !video || video_socket != SC_SOCKET_NONE);
+    assert(multiplex || !audio || audio_socket != SC_SOCKET_NONE);
+    assert(multiplex || !control || control_socket != SC_SOCKET_NONE);
+    assert(!multiplex || mux_socket != SC_SOCKET_NONE);
+
+    if (video && server->video_udp_addr) {
+        // The datagrams are sent directly by the device, not through adb
+        video_udp_socket = net_udp_socket();
+        if (video_udp_socket == SC_SOCKET_NONE) {
+            goto fail;
+        }
+
+        ok = net_connect(video_udp_socket, server->video_udp_addr,
+                         server->params.video_udp_port);
+        if (!ok) {
+            goto fail;
+        }
+
+        // Unlike TCP, there is no flow control: the datagrams which do not fit
+        // in the receive buffer are lost
+        if (server->params.video_socket_buffer) {
+            net_set_recv_buffer_size(video_udp_socket,
+                                     (int) server->params.video_socket_buffer);
+        }
+    }
 
     server->video_socket = video_socket;
     server->audio_socket = audio_socket;
     server->control_socket = control_socket;
+    server->mux_socket = mux_socket;
+    server->video_udp_socket = video_udp_socket;
 
     return true;
 
@@ -732,6 +1149,18 @@ fail:
         }
     }
 
+    if (mux_socket != SC_SOCKET_NONE) {
+        if (!net_close(mux_socket)) {
+            LOGW("Could not close multiplexed socket");
+        }
+    }
+
+    if (video_udp_socket != SC_SOCKET_NONE) {
+        if (!net_close(video_udp_socket)) {
+            LOGW("Could not close video UDP socket");
+        }
+    }
+
     if (tunnel->enabled) {
         // Always leave this function with tunnel disabled
         sc_adb_tunnel_close(tunnel, &server->intr, serial,
@@ -937,12 +1366,198 @@ sc_server_kill_adb_if_requested(struct sc_server *server) {
     }
 }
 
+static bool
+sc_server_init_device_socket_name(struct sc_server *server) {
+    int r = asprintf(&server->device_socket_name, SC_SOCKET_NAME_PREFIX "%08x",
+                     server->params.scid);
+    if (r == -1) {
+        LOG_OOM();
+        return false;
+    }
+    assert(r == sizeof(SC_SOCKET_NAME_PREFIX) - 1 + 8);
+    assert(server->device_socket_name);
+
+    return true;
+}
+
+// Try to connect to a server kept running on the device by a previous scrcpy
+// instance (--keep-server), without pushing or starting anything
+static bool
+sc_server_connect_to_kept(struct sc_server *server) {
+    const struct sc_server_params *params = &server->params;
+    assert(params->keep_server);
+    assert(params->force_adb_forward);
+
+    bool ok = sc_server_compute_keep_scid(server, &server->params.scid);
+    if (!ok) {
+        LOGE("Could not compute the server id");
+        return false;
+    }
+
+    ok = sc_server_init_device_socket_name(server);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_adb_tunnel_open(&server->tunnel, &server->intr, server->serial,
+                            server->device_socket_name, params->port_range,
+                            params->force_adb_forward);
+    if (!ok) {
+        goto error;
+    }
+
+    // A single attempt: if no server is listening, start a new one
+    ok = sc_server_connect_to(server, &server->info, 1);
+    // The tunnel is always closed by server_connect_to()
+    if (!ok) {
+        goto error;
+    }
+
+    return true;
+
+error:
+    free(server->device_socket_name);
+    server->device_socket_name = NULL;
+    return false;
+}
+
+// Push the server (if requested) and open the adb tunnel concurrently, since
+// they are independent
+static bool
+sc_server_prepare(struct sc_server *server, bool push, bool check_device,
+                  bool *present) {
+    const struct sc_server_params *params = &server->params;
+
+    struct sc_server_push push_data = {
+        .server = server,
+        .check_device = check_device,
+        .present = false,
+        .ok = true,
+    };
+
+    sc_thread push_thread;
+    bool push_async = false;
+    if (push) {
+        push_async = sc_thread_create(&push_thread, run_push, "scrcpy-push",
+                                      &push_data);
+        if (!push_async) {
+            LOGW("Could not create push thread, pushing synchronously");
+            run_push(&push_data);
+        }
+    }
+
+    bool ok = true;
+    // In direct mode, the client connects to the device without any tunnel
+    if (push_data.ok && !server->direct_addr) {
+        ok = sc_adb_tunnel_open(&server->tunnel, &server->intr, server->serial,
+                                server->device_socket_name,
+                                params->port_range, params->force_adb_forward);
+    }
+
+    if (push_async) {
+        sc_thread_join(&push_thread, NULL);
+    }
+
+    if (!push_data.ok) {
+        if (ok && server->tunnel.enabled) {
+            sc_adb_tunnel_close(&server->tunnel, &server->intr, server->serial,
+                                server->device_socket_name);
+        }
+        return false;
+    }
+
+    *present = push_data.present;
+    return ok;
+}
+
+// Reset the interruptor after a failed attempt, unless sc_server_stop() has
+// been called
+static bool
+sc_server_reset_intr(struct sc_server *server) {
+    sc_mutex_lock(&server->mutex);
+    bool stopped = server->stopped;
+    if (!stopped) {
+        // sc_server_stop() interrupts with the mutex locked, so it cannot
+        // race with the reset
+        sc_intr_reset(&server->intr);
+    }
+    sc_mutex_unlock(&server->mutex);
+
+    return !stopped;
+}
+
+static void
+sc_server_wait_stopped(struct sc_server *server) {
+    // Wait for server_stop()
+    sc_mutex_lock(&server->mutex);
+    while (!server->stopped) {
+        sc_cond_wait(&server->cond_stopped, &server->mutex);
+    }
+    sc_mutex_unlock(&server->mutex);
+
+    // Interrupt sockets to wake up socket blocking calls on the server
+
+    if (server->video_socket != SC_SOCKET_NONE) {
+        // There is no video_socket if --no-video is set
+        net_interrupt(server->video_socket);
+    }
+
+    if (server->audio_socket != SC_SOCKET_NONE) {
+        // There is no audio_socket if --no-audio is set
+        net_interrupt(server->audio_socket);
+    }
+
+    if (server->control_socket != SC_SOCKET_NONE) {
+        // There is no control_socket if --no-control is set
+        net_interrupt(server->control_socket);
+    }
+
+    if (server->mux_socket != SC_SOCKET_NONE) {
+        // Only set with --multiplex
+        net_interrupt(server->mux_socket);
+    }
+
+    if (server->video_udp_socket != SC_SOCKET_NONE) {
+        net_interrupt(server->video_udp_socket);
+    }
+}
+
+// Return the IPv4 address of a device connected over TCP/IP (its serial is
+// "ip:port"), or 0
+static uint32_t
+sc_server_get_tcpip_ipv4(const char *serial) {
+    if (sc_adb_device_get_type(serial) != SC_ADB_DEVICE_TYPE_TCPIP) {
+        return 0;
+    }
+
+    const char *colon = strchr(serial, ':');
+    assert(colon);
+
+    char ip[sizeof("xxx.xxx.xxx.xxx")];
+    size_t len = colon - serial;
+    if (len >= sizeof(ip)) {
+        return 0;
+    }
+
+    memcpy(ip, serial, len);
+    ip[len] = '\0';
+
+    uint32_t ipv4;
+    if (!net_parse_ipv4(ip, &ipv4)) {
+        return 0;
+    }
+
+    return ipv4;
+}
+
 static int
 run_server(void *data) {
     struct sc_server *server = data;
 
     const struct sc_server_params *params = &server->params;
 
+    sc_tick start = sc_tick_now();
+
     // Execute "adb start-server" before "adb devices" so that daemon starting
     // output/errors is correctly printed in the console ("adb devices" output
     // is parsed, so it is not output)
@@ -1028,15 +1643,61 @@ run_server(void *data) {
     assert(serial);
     LOGD("Device serial: %s", serial);
 
-    ok = push_server(&server->intr, serial);
-    if (!ok) {
-        goto error_connection_failed;
+    if (params->session_cache) {
+        if (sc_session_cache_load(&server->session_cache, serial)) {
+            LOGD("Session cache loaded");
+        }
+    }
+
+    if (params->video && params->video_udp_port) {
+        server->video_udp_addr = sc_server_get_tcpip_ipv4(serial);
+        if (!server->video_udp_addr) {
+            LOGW("The device is not connected over TCP/IP (IPv4), the video "
+                 "packets will be received over TCP");
+        }
+    }
+
+    if (params->direct_port) {
+        server->direct_addr = sc_server_get_tcpip_ipv4(serial);
+        if (server->direct_addr) {
+            struct sc_rand rand;
+            sc_rand_init(&rand);
+            server->direct_token = sc_rand_u64(&rand);
+        } else {
+            LOGW("The device is not connected over TCP/IP (IPv4), connecting "
+                 "through an adb tunnel");
+        }
+    }
+
+    sc_tick selection_duration = sc_tick_now() - start;
+
+    if (params->keep_server && !params->list) {
+        if (sc_server_connect_to_kept(server)) {
+            LOGI("Reusing the server running on the device");
+            server->cbs->on_connected(server, server->cbs_userdata);
+
+            // The server will wait for the next client
+            sc_server_wait_stopped(server);
+            sc_server_kill_adb_if_requested(server);
+            return 0;
+        }
+
+        if (sc_intr_is_interrupted(&server->intr)) {
+            goto error_connection_failed;
+        }
+
+        LOGD("No server to reuse, starting a new one");
     }
 
     // If --list-* is passed, then the server just prints the requested data
     // then exits.
     if (params->list) {
-        sc_pid pid = execute_server(server, params);
+        ok = push_server(&server->intr, serial, !params->cleanup, NULL);
+        if (!ok) {
+            goto error_connection_failed;
+        }
+
+        sc_pid pid = execute_server(server, params, NULL);
         if (pid == SC_PROCESS_NONE) {
             goto error_connection_failed;
         }
@@ -1047,94 +1708,135 @@ run_server(void *data) {
         return 0;
     }
 
-    int r = asprintf(&server->device_socket_name, SC_SOCKET_NAME_PREFIX "%08x",
-                     params->scid);
-    if (r == -1) {
-        LOG_OOM();
-        goto error_connection_failed;
-    }
-    assert(r == sizeof(SC_SOCKET_NAME_PREFIX) - 1 + 8);
-    assert(server->device_socket_name);
-
-    ok = sc_adb_tunnel_open(&server->tunnel, &server->intr, serial,
-                            server->device_socket_name, params->port_range,
-                            params->force_adb_forward);
+    ok = sc_server_init_device_socket_name(server);
     if (!ok) {
         goto error_connection_failed;
     }
 
-    // server will connect to our server socket
-    sc_pid pid = execute_server(server, params);
-    if (pid == SC_PROCESS_NONE) {
-        sc_adb_tunnel_close(&server->tunnel, &server->intr, serial,
-                            server->device_socket_name);
-        goto error_connection_failed;
+    // The server binary is only kept on the device with --no-cleanup
+    bool check_device = !params->cleanup;
+
+    // With --adb-batch, the hash check is executed by the same "adb shell" as
+    // the server, and the server is only pushed if it is outdated. This is
+    // also done speculatively if the server was up to date on the device
+    // during the previous session.
+    char batch_hash[SC_SHA256_HEX_SIZE];
+    bool has_batch_hash = check_device
+        && (params->adb_batch || server->session_cache.server_hash[0])
+        && get_local_server_hash(batch_hash);
+    bool batch = has_batch_hash
+        && (params->adb_batch
+            || !strcmp(batch_hash, server->session_cache.server_hash));
+    if (batch && !params->adb_batch) {
+        LOGD("Server known to be on the device, checked on start");
     }
 
-    static const struct sc_process_listener listener = {
-        .on_terminated = sc_server_on_terminated,
-    };
+    sc_tick prepare_start = sc_tick_now();
+    sc_tick prepare_duration;
+    sc_pid pid;
     struct sc_process_observer observer;
-    ok = sc_process_observer_init(&observer, pid, &listener, server);
-    if (!ok) {
-        sc_process_terminate(pid);
-        sc_process_wait(pid, true); // ignore exit code
-        sc_adb_tunnel_close(&server->tunnel, &server->intr, serial,
-                            server->device_socket_name);
-        goto error_connection_failed;
-    }
 
-    ok = sc_server_connect_to(server, &server->info);
-    // The tunnel is always closed by server_connect_to()
-    if (!ok) {
+    // Whether the server on the device is confirmed to be the local one
+    // without having been pushed
+    bool present = false;
+
+    for (;;) {
+        ok = sc_server_prepare(server, !batch, check_device, &present);
+        if (!ok) {
+            goto error_connection_failed;
+        }
+
+        // Push and tunnel
+        prepare_duration = sc_tick_now() - prepare_start;
+
+        // server will connect to our server socket
+        pid = execute_server(server, params, batch ? batch_hash : NULL);
+        if (pid == SC_PROCESS_NONE) {
+            if (server->tunnel.enabled) {
+                sc_adb_tunnel_close(&server->tunnel, &server->intr, serial,
+                                    server->device_socket_name);
+            }
+            goto error_connection_failed;
+        }
+
+        static const struct sc_process_listener listener = {
+            .on_terminated = sc_server_on_terminated,
+        };
+        ok = sc_process_observer_init(&observer, pid, &listener, server);
+        if (!ok) {
+            sc_process_terminate(pid);
+            sc_process_wait(pid, true); // ignore exit code
+            if (server->tunnel.enabled) {
+                sc_adb_tunnel_close(&server->tunnel, &server->intr, serial,
+                                    server->device_socket_name);
+            }
+            goto error_connection_failed;
+        }
+
+        ok = sc_server_connect_to(server, &server->info, 100);
+        // The tunnel is always closed by server_connect_to()
+        if (ok) {
+            // In batch mode, the server only starts if it is up to date
+            present |= batch;
+            break;
+        }
+
         sc_process_terminate(pid);
-        sc_process_wait(pid, true); // ignore exit code
+        sc_exit_code exit_code = sc_process_wait(pid, true);
         sc_process_observer_join(&observer);
         sc_process_observer_destroy(&observer);
-        goto error_connection_failed;
-    }
 
-    // Now connected
-    server->cbs->on_connected(server, server->cbs_userdata);
+        if (!batch || exit_code != SC_SERVER_EXIT_OUTDATED
+                || !sc_server_reset_intr(server)) {
+            goto error_connection_failed;
+        }
 
-    // Wait for server_stop()
-    sc_mutex_lock(&server->mutex);
-    while (!server->stopped) {
-        sc_cond_wait(&server->cond_stopped, &server->mutex);
+        LOGD("Server outdated on the device, pushing");
+        batch = false;
+        prepare_start = sc_tick_now();
     }
-    sc_mutex_unlock(&server->mutex);
 
-    // Interrupt sockets to wake up socket blocking calls on the server
+    sc_tick now = sc_tick_now();
+    LOGD("Startup timings: device selection %" PRItick " ms, "
+         "push and tunnel %" PRItick " ms, server start %" PRItick " ms",
+         SC_TICK_TO_MS(selection_duration), SC_TICK_TO_MS(prepare_duration),
+         SC_TICK_TO_MS(now - prepare_start - prepare_duration));
 
-    if (server->video_socket != SC_SOCKET_NONE) {
-        // There is no video_socket if --no-video is set
-        net_interrupt(server->video_socket);
+    if (present && params->session_cache) {
+        // Only record a server confirmed on the device (a pushed server may
+        // not be checkable, for example without sha256sum on the device)
+        if (has_batch_hash || get_local_server_hash(batch_hash)) {
+            if (strcmp(batch_hash, server->session_cache.server_hash)) {
+                sc_session_cache_set_server_hash(serial, batch_hash);
+            }
+        }
     }
 
-    if (server->audio_socket != SC_SOCKET_NONE) {
-        // There is no audio_socket if --no-audio is set
-        net_interrupt(server->audio_socket);
-    }
+    // Now connected
+    server->cbs->on_connected(server, server->cbs_userdata);
 
-    if (server->control_socket != SC_SOCKET_NONE) {
-        // There is no control_socket if --no-control is set
-        net_interrupt(server->control_socket);
-    }
+    sc_server_wait_stopped(server);
 
-    // Give some delay for the server to terminate properly
-#define WATCHDOG_DELAY SC_TICK_FROM_SEC(1)
-    sc_tick deadline = sc_tick_now() + WATCHDOG_DELAY;
-    bool terminated = sc_process_observer_timedwait(&observer, deadline);
-
-    // After this delay, kill the server if it's not dead already.
-    // On some devices, closing the sockets is not sufficient to wake up the
-    // blocking calls while the device is asleep.
-    if (!terminated) {
-        // The process may have terminated since the check, but it is not
-        // reaped (closed) yet, so its PID is still valid, and it is ok to call
-        // sc_process_terminate() even in that case.
-        LOGW("Killing the server...");
+    if (params->keep_server) {
+        // The server runs in its own session on the device, and waits for the
+        // next client: only terminate the local "adb shell" process
         sc_process_terminate(pid);
+    } else {
+        // Give some delay for the server to terminate properly
+#define WATCHDOG_DELAY SC_TICK_FROM_SEC(1)
+        sc_tick deadline = sc_tick_now() + WATCHDOG_DELAY;
+        bool terminated = sc_process_observer_timedwait(&observer, deadline);
+
+        // After this delay, kill the server if it's not dead already.
+        // On some devices, closing the sockets is not sufficient to wake up
+        // the blocking calls while the device is asleep.
+        if (!terminated) {
+            // The process may have terminated since the check, but it is not
+            // reaped (closed) yet, so its PID is still valid, and it is ok to
+            // call sc_process_terminate() even in that case.
+            LOGW("Killing the server...");
+            sc_process_terminate(pid);
+        }
     }
 
     sc_process_observer_join(&observer);
@@ -1170,6 +1872,7 @@ sc_server_stop(struct sc_server *server) {
     server->stopped = true;
     sc_cond_signal(&server->cond_stopped);
     sc_intr_interrupt(&server->intr);
+    sc_intr_interrupt(&server->push_intr);
     sc_mutex_unlock(&server->mutex);
 }
 
@@ -1189,9 +1892,16 @@ sc_server_destroy(struct sc_server *server) {
     if (server->control_socket != SC_SOCKET_NONE) {
         net_close(server->control_socket);
     }
+    if (server->mux_socket != SC_SOCKET_NONE) {
+        net_close(server->mux_socket);
+    }
+    if (server->video_udp_socket != SC_SOCKET_NONE) {
+        net_close(server->video_udp_socket);
+    }
 
     free(server->serial);
     free(server->device_socket_name);
+    sc_intr_destroy(&server->push_intr);
     sc_intr_destroy(&server->intr);
     sc_cond_destroy(&server->cond_stopped);
     sc_mutex_destroy(&server->mutex);
@@ -8,6 +8,7 @@
 
 #include "adb/adb_tunnel.h"
 #include "options.h"
+#include "session_cache.h"
 #include "util/intr.h"
 #include "util/net.h"
 #include "util/thread.h"
@@ -23,8 +24,14 @@ struct sc_server_params {
     const char *req_serial;
     enum sc_log_level log_level;
     enum sc_codec video_codec;
+    // Comma-separated video codecs, in order of preference, to let the server
+    // select the codec (NULL to use video_codec)
+    const char *video_codecs;
     enum sc_codec audio_codec;
     enum sc_video_source video_source;
+    enum sc_video_encoder_profile video_encoder_profile;
+    enum sc_video_mode video_mode;
+    sc_tick thumbnail_interval;
     enum sc_audio_source audio_source;
     enum sc_camera_facing camera_facing;
     const char *crop;
@@ -39,8 +46,14 @@ struct sc_server_params {
     struct sc_port_range port_range;
     uint32_t tunnel_host;
     uint16_t tunnel_port;
+    uint16_t video_udp_port; // 0 to receive the video packets over TCP
+    uint16_t direct_port; // 0 to connect through an adb tunnel
+    uint32_t video_socket_buffer; // in bytes, 0 for the system default
+    uint32_t socket_busy_poll; // in microseconds, 0 to disable
     uint16_t max_size;
     uint32_t video_bit_rate;
+    // Measure the throughput on connection to choose the video bit rate
+    bool video_bit_rate_probe;
     uint32_t audio_bit_rate;
     const char *max_fps; // float to be parsed by the server
     const char *angle; // float to be parsed by the server
@@ -50,6 +63,7 @@ struct sc_server_params {
     bool control;
     uint32_t display_id;
     const char *new_display;
+    float render_scale;
     enum sc_display_ime_policy display_ime_policy;
     bool video;
     bool audio;
@@ -60,6 +74,14 @@ struct sc_server_params {
     bool power_off_on_close;
     bool clipboard_autosync;
     bool downsize_on_error;
+    bool video_roi;
+    bool video_square;
+    bool thermal_throttle;
+    bool multiplex;
+    sc_tick video_idle_timeout;
+    uint16_t video_intra_refresh;
+    bool video_hdr;
+    bool latency_probe;
     bool tcpip;
     const char *tcpip_dst;
     bool select_usb;
@@ -67,6 +89,10 @@ struct sc_server_params {
     bool cleanup;
     bool power_on;
     bool kill_adb_on_close;
+    bool keep_server;
+    bool adb_batch;
+    bool adb_native;
+    bool session_cache;
     bool camera_high_speed;
     bool vd_destroy_content;
     bool vd_system_decorations;
@@ -79,6 +105,9 @@ struct sc_server {
     char *serial;
     char *device_socket_name;
 
+    // Loaded once the device is selected (empty if disabled)
+    struct sc_session_cache session_cache;
+
     sc_thread thread;
     struct sc_server_info info; // initialized once connected
 
@@ -87,11 +116,27 @@ struct sc_server {
     bool stopped;
 
     struct sc_intr intr;
+    struct sc_intr push_intr; // the push is executed concurrently
     struct sc_adb_tunnel tunnel;
 
     sc_socket video_socket;
     sc_socket audio_socket;
     sc_socket control_socket;
+    // With --multiplex, the single socket carrying all the streams (the other
+    // sockets are not connected)
+    sc_socket mux_socket;
+
+    // Device IPv4 address to receive the video packets over UDP from, 0 if
+    // disabled (the device is not connected over TCP/IP)
+    uint32_t video_udp_addr;
+    sc_socket video_udp_socket; // connected to video_udp_addr
+
+    // Device IPv4 address to connect to directly on params.direct_port, 0 to
+    // connect through the adb tunnel
+    uint32_t direct_addr;
+    // Random token sent on each direct connection, so that the server only
+    // accepts this client
+    uint64_t direct_token;
 
     const struct sc_server_callbacks *cbs;
     void *cbs_userdata;
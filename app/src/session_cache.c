@@ -0,0 +1,237 @@
+#include "session_cache.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_filesystem.h>
+#include <SDL2/SDL_stdinc.h>
+
+#include "util/log.h"
+#include "util/strbuf.h"
+
+#define SC_SESSION_CACHE_HEADER "# scrcpy session cache v1"
+#define SC_SESSION_CACHE_TMP_SUFFIX ".part"
+
+// The cache may be updated from the server thread and from the main thread
+static SDL_SpinLock sc_session_cache_lock = 0;
+
+static void
+sc_session_cache_reset(struct sc_session_cache *cache) {
+    cache->server_hash[0] = '\0';
+    cache->video_size = (struct sc_size) {0, 0};
+    cache->window_size = (struct sc_size) {0, 0};
+}
+
+static char *
+sc_session_cache_get_path(const char *serial) {
+    char *dir = SDL_GetPrefPath("Genymobile", "scrcpy");
+    if (!dir) {
+        LOGD("Could not get preferences directory: %s", SDL_GetError());
+        return NULL;
+    }
+
+    struct sc_strbuf buf;
+    if (!sc_strbuf_init(&buf, 256)) {
+        LOG_OOM();
+        SDL_free(dir);
+        return NULL;
+    }
+
+    // The directory ends with a path separator
+    bool ok = sc_strbuf_append_str(&buf, dir)
+           && sc_strbuf_append_staticstr(&buf, "session-");
+    SDL_free(dir);
+
+    // The serial may contain characters not allowed in a file name (for
+    // example ':' for TCP/IP devices)
+    for (const char *c = serial; ok && *c; ++c) {
+        bool allowed = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z')
+                    || (*c >= '0' && *c <= '9') || *c == '.' || *c == '-';
+        ok = sc_strbuf_append_char(&buf, allowed ? *c : '_');
+    }
+
+    ok = ok && sc_strbuf_append_staticstr(&buf, ".txt");
+    if (!ok) {
+        LOG_OOM();
+        free(buf.s);
+        return NULL;
+    }
+
+    return buf.s;
+}
+
+static bool
+sc_session_cache_parse_size(const char *value, struct sc_size *size) {
+    char *endptr;
+    long width = strtol(value, &endptr, 10);
+    if (*endptr != 'x') {
+        return false;
+    }
+    long height = strtol(endptr + 1, &endptr, 10);
+    if (*endptr != '\0' || width <= 0 || width > 0xFFFF
+            || height <= 0 || height > 0xFFFF) {
+        return false;
+    }
+
+    size->width = width;
+    size->height = height;
+    return true;
+}
+
+static void
+sc_session_cache_parse_line(struct sc_session_cache *cache, char *line) {
+    char *value = strchr(line, '=');
+    if (!value) {
+        return;
+    }
+    *value++ = '\0';
+
+    if (!strcmp(line, "server_sha256")) {
+        if (strlen(value) == SC_SHA256_HEX_SIZE - 1) {
+            memcpy(cache->server_hash, value, SC_SHA256_HEX_SIZE);
+        }
+    } else if (!strcmp(line, "video_size")) {
+        sc_session_cache_parse_size(value, &cache->video_size);
+    } else if (!strcmp(line, "window_size")) {
+        sc_session_cache_parse_size(value, &cache->window_size);
+    }
+    // Unknown keys are ignored
+}
+
+static bool
+sc_session_cache_read(struct sc_session_cache *cache, const char *path) {
+    sc_session_cache_reset(cache);
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+
+    char line[128];
+    bool ok = fgets(line, sizeof(line), file)
+           && !strncmp(line, SC_SESSION_CACHE_HEADER,
+                       sizeof(SC_SESSION_CACHE_HEADER) - 1);
+    if (ok) {
+        while (fgets(line, sizeof(line), file)) {
+            line[strcspn(line, "\r\n")] = '\0';
+            sc_session_cache_parse_line(cache, line);
+        }
+    }
+
+    fclose(file);
+    return ok;
+}
+
+static bool
+sc_session_cache_write(const struct sc_session_cache *cache,
+                       const char *path) {
+    size_t len = strlen(path);
+    char *tmp_path = malloc(len + sizeof(SC_SESSION_CACHE_TMP_SUFFIX));
+    if (!tmp_path) {
+        LOG_OOM();
+        return false;
+    }
+    memcpy(tmp_path, path, len);
+    memcpy(tmp_path + len, SC_SESSION_CACHE_TMP_SUFFIX,
+           sizeof(SC_SESSION_CACHE_TMP_SUFFIX));
+
+    bool ok = false;
+    FILE *file = fopen(tmp_path, "w");
+    if (file) {
+        ok = fprintf(file, SC_SESSION_CACHE_HEADER "\n") > 0;
+        if (ok && cache->server_hash[0]) {
+            ok = fprintf(file, "server_sha256=%s\n", cache->server_hash) > 0;
+        }
+        if (ok && cache->video_size.width && cache->window_size.width) {
+            ok = fprintf(file, "video_size=%" PRIu16 "x%" PRIu16 "\n"
+                               "window_size=%" PRIu16 "x%" PRIu16 "\n",
+                         cache->video_size.width, cache->video_size.height,
+                         cache->window_size.width,
+                         cache->window_size.height) > 0;
+        }
+        ok &= !fclose(file);
+    }
+
+#ifdef _WIN32
+    if (ok) {
+        // rename() does not replace an existing file on Windows
+        remove(path);
+    }
+#endif
+    // Never leave a partial cache under its final name
+    ok = ok && !rename(tmp_path, path);
+    if (!ok) {
+        remove(tmp_path);
+    }
+
+    free(tmp_path);
+    return ok;
+}
+
+bool
+sc_session_cache_load(struct sc_session_cache *cache, const char *serial) {
+    char *path = sc_session_cache_get_path(serial);
+    if (!path) {
+        sc_session_cache_reset(cache);
+        return false;
+    }
+
+    SDL_AtomicLock(&sc_session_cache_lock);
+    bool ok = sc_session_cache_read(cache, path);
+    SDL_AtomicUnlock(&sc_session_cache_lock);
+
+    free(path);
+    return ok;
+}
+
+// Load the current cache, apply the change, and save it
+static bool
+sc_session_cache_update(const char *serial, const char *server_hash,
+                        const struct sc_size *video_size,
+                        const struct sc_size *window_size) {
+    char *path = sc_session_cache_get_path(serial);
+    if (!path) {
+        return false;
+    }
+
+    SDL_AtomicLock(&sc_session_cache_lock);
+
+    struct sc_session_cache cache;
+    // On error, write a new cache
+    sc_session_cache_read(&cache, path);
+
+    if (server_hash) {
+        assert(strlen(server_hash) == SC_SHA256_HEX_SIZE - 1);
+        memcpy(cache.server_hash, server_hash, SC_SHA256_HEX_SIZE);
+    }
+    if (video_size) {
+        assert(window_size);
+        cache.video_size = *video_size;
+        cache.window_size = *window_size;
+    }
+
+    bool ok = sc_session_cache_write(&cache, path);
+
+    SDL_AtomicUnlock(&sc_session_cache_lock);
+
+    if (!ok) {
+        LOGD("Could not write session cache: %s", path);
+    }
+
+    free(path);
+    return ok;
+}
+
+bool
+sc_session_cache_set_server_hash(const char *serial, const char *server_hash) {
+    return sc_session_cache_update(serial, server_hash, NULL, NULL);
+}
+
+bool
+sc_session_cache_set_window_size(const char *serial, struct sc_size video_size,
+                                 struct sc_size window_size) {
+    return sc_session_cache_update(serial, NULL, &video_size, &window_size);
+}
@@ -0,0 +1,50 @@
+#ifndef SC_SESSION_CACHE_H
+#define SC_SESSION_CACHE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+#include "coords.h"
+#include "util/sha256.h"
+
+/**
+ * Facts learned about a device during the previous sessions, to skip the
+ * confirmations already made on the next launch
+ *
+ * They are stored in one small text file per device (by serial) in the user
+ * preferences directory. Any of them may be outdated: the cache is only used
+ * to take a faster path first, which falls back when something has changed.
+ */
+struct sc_session_cache {
+    // SHA-256 of the server last known to be present on the device (empty if
+    // unknown)
+    char server_hash[SC_SHA256_HEX_SIZE];
+    // Last video size, and the window size the user left it at (0 if unknown)
+    struct sc_size video_size;
+    struct sc_size window_size;
+};
+
+/**
+ * Load the cache of the device
+ *
+ * On error (typically, the first time for this device), the cache is empty
+ * and false is returned. Nothing is logged in that case.
+ */
+bool
+sc_session_cache_load(struct sc_session_cache *cache, const char *serial);
+
+/**
+ * Record that the server of hash `server_hash` is present on the device
+ */
+bool
+sc_session_cache_set_server_hash(const char *serial, const char *server_hash);
+
+/**
+ * Record the window size for the given video size
+ */
+bool
+sc_session_cache_set_window_size(const char *serial, struct sc_size video_size,
+                                 struct sc_size window_size);
+
+#endif
@@ -0,0 +1,53 @@
+#include "shared_frame.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "util/log.h"
+
+struct sc_shared_frame *
+sc_shared_frame_new(const AVFrame *frame) {
+    struct sc_shared_frame *sf = malloc(sizeof(*sf));
+    if (!sf) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    sf->frame = av_frame_alloc();
+    if (!sf->frame) {
+        LOG_OOM();
+        free(sf);
+        return NULL;
+    }
+
+    int r = av_frame_ref(sf->frame, frame);
+    if (r) {
+        LOGE("Could not ref frame: %d", r);
+        av_frame_free(&sf->frame);
+        free(sf);
+        return NULL;
+    }
+
+    atomic_init(&sf->refs, 1);
+    return sf;
+}
+
+struct sc_shared_frame *
+sc_shared_frame_acquire(struct sc_shared_frame *sf) {
+    assert(sf);
+    // Relaxed: the caller already holds a reference, so the frame is visible
+    atomic_fetch_add_explicit(&sf->refs, 1, memory_order_relaxed);
+    return sf;
+}
+
+void
+sc_shared_frame_release(struct sc_shared_frame *sf) {
+    assert(sf);
+    unsigned prev = atomic_fetch_sub_explicit(&sf->refs, 1,
+                                              memory_order_acq_rel);
+    assert(prev);
+    if (prev == 1) {
+        av_frame_free(&sf->frame);
+        free(sf);
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef SC_SHARED_FRAME_H
+#define SC_SHARED_FRAME_H
+
+#include "common.h"
+
+#include <stdatomic.h>
+#include <libavutil/frame.h>
+
+// forward declarations
+typedef struct AVFrame AVFrame;
+
+/**
+ * A shared frame is a read-only reference to a decoded frame, which may be
+ * held by several consumers at the same time.
+ *
+ * A frame source wraps each frame only once, then every frame sink keeping
+ * the frame just increments the reference count. This avoids to create a
+ * separate AVFrame reference (an AVFrame and one AVBufferRef per plane) for
+ * each sink.
+ *
+ * The frame must not be modified once shared.
+ */
+struct sc_shared_frame {
+    AVFrame *frame;
+    atomic_uint refs;
+};
+
+/**
+ * Create a new shared frame referencing `frame`, or return NULL on error
+ *
+ * The caller owns the first reference.
+ */
+struct sc_shared_frame *
+sc_shared_frame_new(const AVFrame *frame);
+
+/**
+ * Acquire a new reference (may be called from any thread)
+ */
+struct sc_shared_frame *
+sc_shared_frame_acquire(struct sc_shared_frame *sf);
+
+/**
+ * Release a reference (may be called from any thread), and free the frame if
+ * it was the last one
+ */
+void
+sc_shared_frame_release(struct sc_shared_frame *sf);
+
+#endif
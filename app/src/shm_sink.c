@@ -0,0 +1,406 @@
+#include "shm_sink.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "util/log.h"
+
+/** Downcast frame_sink to sc_shm_sink */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_shm_sink, frame_sink)
+
+#define SC_SHM_SINK_HEADER_SIZE 64
+#define SC_SHM_SINK_SLOT_HEADER_SIZE 64
+#define SC_SHM_SINK_PAGE_SIZE 4096
+
+static_assert(sizeof(struct sc_shm_sink_header) == SC_SHM_SINK_HEADER_SIZE,
+              "Unexpected shm header size");
+static_assert(sizeof(struct sc_shm_sink_slot) == SC_SHM_SINK_SLOT_HEADER_SIZE,
+              "Unexpected shm slot header size");
+
+#define SC_SHM_SINK_MAX_PLANES 3
+
+struct sc_shm_plane {
+    const uint8_t *data;
+    size_t linesize;
+    size_t row_size;
+    size_t rows;
+};
+
+static unsigned
+get_planes(const AVFrame *frame, uint32_t *format,
+           struct sc_shm_plane planes[SC_SHM_SINK_MAX_PLANES]) {
+    size_t chroma_width = (frame->width + 1) / 2;
+    size_t chroma_height = (frame->height + 1) / 2;
+
+    planes[0] = (struct sc_shm_plane) {
+        .data = frame->data[0],
+        .linesize = frame->linesize[0],
+        .row_size = frame->width,
+        .rows = frame->height,
+    };
+
+    if (frame->format == AV_PIX_FMT_NV12) {
+        *format = SC_SHM_SINK_FORMAT_NV12;
+        planes[1] = (struct sc_shm_plane) {
+            .data = frame->data[1],
+            .linesize = frame->linesize[1],
+            .row_size = 2 * chroma_width,
+            .rows = chroma_height,
+        };
+        return 2;
+    }
+
+    assert(frame->format == AV_PIX_FMT_YUV420P);
+    *format = SC_SHM_SINK_FORMAT_YUV420P;
+    for (unsigned i = 1; i < 3; ++i) {
+        planes[i] = (struct sc_shm_plane) {
+            .data = frame->data[i],
+            .linesize = frame->linesize[i],
+            .row_size = chroma_width,
+            .rows = chroma_height,
+        };
+    }
+    return 3;
+}
+
+static inline struct sc_shm_sink_header *
+get_header(struct sc_shm_sink *ss) {
+    return (struct sc_shm_sink_header *) ss->map;
+}
+
+static bool
+sc_shm_sink_map(struct sc_shm_sink *ss, size_t map_size) {
+    if (ftruncate(ss->fd, map_size)) {
+        LOGE("Could not resize %s: %s", ss->path, strerror(errno));
+        return false;
+    }
+
+    uint8_t *map =
+        mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, ss->fd, 0);
+    if (map == MAP_FAILED) {
+        LOGE("Could not map %s: %s", ss->path, strerror(errno));
+        return false;
+    }
+
+    if (ss->map) {
+        munmap(ss->map, ss->map_size);
+    }
+    ss->map = map;
+    ss->map_size = map_size;
+    return true;
+}
+
+// Make the slots large enough for a frame of the given size
+static bool
+sc_shm_sink_reserve(struct sc_shm_sink *ss, int width, int height) {
+    // Reserve for the largest dimension in both directions, so that the file
+    // is not resized on device rotation
+    size_t max = MAX(width, height);
+    size_t chroma = (max + 1) / 2;
+    size_t data_size = max * max + 2 * chroma * chroma;
+
+    size_t slot_size = SC_SHM_SINK_SLOT_HEADER_SIZE + data_size;
+    // Align to the page size
+    slot_size = (slot_size + SC_SHM_SINK_PAGE_SIZE - 1)
+              & ~(size_t) (SC_SHM_SINK_PAGE_SIZE - 1);
+
+    if (slot_size <= ss->slot_size) {
+        return true;
+    }
+
+    size_t map_size =
+        SC_SHM_SINK_HEADER_SIZE + SC_SHM_SINK_SLOTS * slot_size;
+    if (!sc_shm_sink_map(ss, map_size)) {
+        return false;
+    }
+
+    ss->slot_size = slot_size;
+
+    struct sc_shm_sink_header *header = get_header(ss);
+    for (unsigned i = 0; i < SC_SHM_SINK_SLOTS; ++i) {
+        struct sc_shm_sink_slot *slot = (struct sc_shm_sink_slot *)
+            (ss->map + SC_SHM_SINK_HEADER_SIZE + i * slot_size);
+        atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+        slot->size = 0;
+    }
+    atomic_store_explicit(&header->slot_size, slot_size,
+                          memory_order_relaxed);
+    atomic_fetch_add_explicit(&header->generation, 1, memory_order_release);
+
+    LOGD("shm sink: %" SC_PRIsizet " bytes per slot", slot_size);
+    return true;
+}
+
+static bool
+write_frame(struct sc_shm_sink *ss, const AVFrame *frame) {
+    if (!sc_shm_sink_reserve(ss, frame->width, frame->height)) {
+        return false;
+    }
+
+    uint32_t format;
+    struct sc_shm_plane planes[SC_SHM_SINK_MAX_PLANES];
+    unsigned count = get_planes(frame, &format, planes);
+
+    uint64_t frame_number = ss->frame_count;
+    size_t index = frame_number % SC_SHM_SINK_SLOTS;
+    uint8_t *base = ss->map + SC_SHM_SINK_HEADER_SIZE + index * ss->slot_size;
+    struct sc_shm_sink_slot *slot = (struct sc_shm_sink_slot *) base;
+
+    // Make the seq odd before writing the frame
+    uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    uint8_t *dst = base + SC_SHM_SINK_SLOT_HEADER_SIZE;
+    for (unsigned i = 0; i < count; ++i) {
+        const struct sc_shm_plane *plane = &planes[i];
+        if (plane->linesize == plane->row_size) {
+            size_t size = plane->row_size * plane->rows;
+            memcpy(dst, plane->data, size);
+            dst += size;
+        } else {
+            for (size_t row = 0; row < plane->rows; ++row) {
+                memcpy(dst, plane->data + row * plane->linesize,
+                       plane->row_size);
+                dst += plane->row_size;
+            }
+        }
+    }
+
+    slot->format = format;
+    slot->width = frame->width;
+    slot->height = frame->height;
+    slot->pts = frame->pts;
+    slot->frame_number = frame_number;
+    slot->size = dst - (base + SC_SHM_SINK_SLOT_HEADER_SIZE);
+    assert(SC_SHM_SINK_SLOT_HEADER_SIZE + slot->size <= ss->slot_size);
+
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+
+    ss->frame_count = frame_number + 1;
+    atomic_store_explicit(&get_header(ss)->frame_count, ss->frame_count,
+                          memory_order_release);
+
+    return true;
+}
+
+static int
+run_shm_sink(void *data) {
+    struct sc_shm_sink *ss = data;
+
+    for (;;) {
+        sc_mutex_lock(&ss->mutex);
+
+        while (!ss->stopped && !ss->has_frame) {
+            sc_cond_wait(&ss->cond, &ss->mutex);
+        }
+
+        if (ss->stopped) {
+            sc_mutex_unlock(&ss->mutex);
+            break;
+        }
+
+        ss->has_frame = false;
+        sc_mutex_unlock(&ss->mutex);
+
+        struct sc_shared_frame *shared = sc_frame_buffer_consume(&ss->fb);
+        bool ok = write_frame(ss, shared->frame);
+        sc_shared_frame_release(shared);
+        if (!ok) {
+            LOGE("Could not write frame to shm sink");
+            break;
+        }
+    }
+
+    LOGD("Shm sink thread ended");
+
+    return 0;
+}
+
+// Map the file, keeping its content if it has been written by a previous
+// session (so that the readers do not need to open it again on reconnection)
+static bool
+sc_shm_sink_open_file(struct sc_shm_sink *ss) {
+    // The frames are private, do not make the file readable by other users
+    ss->fd = open(ss->path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (ss->fd < 0) {
+        LOGE("Could not open %s: %s", ss->path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(ss->fd, &st)) {
+        LOGE("Could not stat %s: %s", ss->path, strerror(errno));
+        goto error_close_fd;
+    }
+
+    ss->map = NULL;
+    ss->map_size = 0;
+    ss->slot_size = 0;
+    ss->frame_count = 0;
+
+    // Never shrink the file, it may be mapped by readers
+    size_t map_size = MAX((size_t) st.st_size, SC_SHM_SINK_HEADER_SIZE);
+    if (!sc_shm_sink_map(ss, map_size)) {
+        goto error_close_fd;
+    }
+
+    struct sc_shm_sink_header *header = get_header(ss);
+    uint64_t slot_size =
+        atomic_load_explicit(&header->slot_size, memory_order_relaxed);
+    bool reuse = !memcmp(header->magic, SC_SHM_SINK_MAGIC, 8)
+              && header->version == SC_SHM_SINK_VERSION
+              && header->slot_count == SC_SHM_SINK_SLOTS
+              && SC_SHM_SINK_HEADER_SIZE + SC_SHM_SINK_SLOTS * slot_size
+                    <= map_size;
+    if (reuse) {
+        ss->slot_size = slot_size;
+        ss->frame_count = atomic_load_explicit(&header->frame_count,
+                                               memory_order_relaxed);
+    } else {
+        memset(header, 0, SC_SHM_SINK_HEADER_SIZE);
+        memcpy(header->magic, SC_SHM_SINK_MAGIC, 8);
+        header->version = SC_SHM_SINK_VERSION;
+        header->slot_count = SC_SHM_SINK_SLOTS;
+        atomic_store_explicit(&header->generation, 1, memory_order_release);
+    }
+
+    return true;
+
+error_close_fd:
+    close(ss->fd);
+    return false;
+}
+
+static bool
+sc_shm_sink_open(struct sc_shm_sink *ss, const AVCodecContext *ctx) {
+    (void) ctx;
+
+    bool ok = sc_frame_buffer_init(&ss->fb);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_mutex_init(&ss->mutex);
+    if (!ok) {
+        goto error_frame_buffer_destroy;
+    }
+
+    ok = sc_cond_init(&ss->cond);
+    if (!ok) {
+        goto error_mutex_destroy;
+    }
+
+    ok = sc_shm_sink_open_file(ss);
+    if (!ok) {
+        goto error_cond_destroy;
+    }
+
+    ss->has_frame = false;
+    ss->stopped = false;
+
+    LOGD("Starting shm sink thread");
+    ok = sc_thread_create(&ss->thread, run_shm_sink, "scrcpy-shm", ss);
+    if (!ok) {
+        LOGE("Could not start shm sink thread");
+        goto error_unmap;
+    }
+
+    LOGI("Shared memory sink started to file: %s", ss->path);
+
+    return true;
+
+error_unmap:
+    munmap(ss->map, ss->map_size);
+    close(ss->fd);
+error_cond_destroy:
+    sc_cond_destroy(&ss->cond);
+error_mutex_destroy:
+    sc_mutex_destroy(&ss->mutex);
+error_frame_buffer_destroy:
+    sc_frame_buffer_destroy(&ss->fb);
+
+    return false;
+}
+
+static void
+sc_shm_sink_close(struct sc_shm_sink *ss) {
+    sc_mutex_lock(&ss->mutex);
+    ss->stopped = true;
+    sc_cond_signal(&ss->cond);
+    sc_mutex_unlock(&ss->mutex);
+
+    sc_thread_join(&ss->thread, NULL);
+
+    // The file is kept, the readers may still map it
+    munmap(ss->map, ss->map_size);
+    close(ss->fd);
+    sc_cond_destroy(&ss->cond);
+    sc_mutex_destroy(&ss->mutex);
+    sc_frame_buffer_destroy(&ss->fb);
+}
+
+static bool
+sc_shm_sink_push(struct sc_shm_sink *ss, struct sc_shared_frame *frame) {
+    bool previous_skipped;
+    sc_frame_buffer_push(&ss->fb, frame, &previous_skipped);
+
+    if (!previous_skipped) {
+        sc_mutex_lock(&ss->mutex);
+        ss->has_frame = true;
+        sc_cond_signal(&ss->cond);
+        sc_mutex_unlock(&ss->mutex);
+    }
+
+    return true;
+}
+
+static bool
+sc_shm_frame_sink_open(struct sc_frame_sink *sink, const AVCodecContext *ctx) {
+    struct sc_shm_sink *ss = DOWNCAST(sink);
+    return sc_shm_sink_open(ss, ctx);
+}
+
+static void
+sc_shm_frame_sink_close(struct sc_frame_sink *sink) {
+    struct sc_shm_sink *ss = DOWNCAST(sink);
+    sc_shm_sink_close(ss);
+}
+
+static bool
+sc_shm_frame_sink_push_shared(struct sc_frame_sink *sink,
+                              struct sc_shared_frame *frame) {
+    struct sc_shm_sink *ss = DOWNCAST(sink);
+    return sc_shm_sink_push(ss, frame);
+}
+
+bool
+sc_shm_sink_init(struct sc_shm_sink *ss, const char *path) {
+    ss->path = strdup(path);
+    if (!ss->path) {
+        LOG_OOM();
+        return false;
+    }
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = sc_shm_frame_sink_open,
+        .close = sc_shm_frame_sink_close,
+        .push_shared = sc_shm_frame_sink_push_shared,
+    };
+
+    ss->frame_sink.ops = &ops;
+
+    return true;
+}
+
+void
+sc_shm_sink_destroy(struct sc_shm_sink *ss) {
+    free(ss->path);
+}
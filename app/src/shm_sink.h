@@ -0,0 +1,97 @@
+#ifndef SC_SHM_SINK_H
+#define SC_SHM_SINK_H
+
+#include "common.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+#include "frame_buffer.h"
+#include "trait/frame_sink.h"
+#include "util/thread.h"
+
+/**
+ * Shared memory frame sink
+ *
+ * Publish the decoded frames in a file mapped in memory (typically in
+ * /dev/shm), so that local processes can read them without any encoding or
+ * copy through a socket.
+ *
+ * The file contains a header followed by SC_SHM_SINK_SLOTS slots, each slot
+ * containing a frame header followed by the planes of the frame, without
+ * padding. All the fields are in native byte order.
+ *
+ * Each slot is protected by a seqlock: its `seq` is odd while the frame is
+ * written. A reader must read `seq`, copy (or process) the frame, then read
+ * `seq` again: if it is odd or if it changed, the frame has been overwritten
+ * in the meantime and must be discarded.
+ */
+
+#define SC_SHM_SINK_MAGIC "SCRCPYFB"
+#define SC_SHM_SINK_VERSION 1
+#define SC_SHM_SINK_SLOTS 3
+
+// Values of the format field
+#define SC_SHM_SINK_FORMAT_YUV420P 0 // I420: Y, then U, then V
+#define SC_SHM_SINK_FORMAT_NV12 1 // Y, then interleaved UV
+
+// The file header and the slot headers are 64 bytes long
+struct sc_shm_sink_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_count;
+    // Incremented each time the file is resized: the reader must then map it
+    // again
+    atomic_uint_least32_t generation;
+    uint32_t reserved0;
+    // Size of each slot (including its header), the first slot being at offset
+    // 64
+    atomic_uint_least64_t slot_size;
+    // Number of frames written so far: the latest frame is in the slot
+    // (frame_count - 1) % slot_count
+    atomic_uint_least64_t frame_count;
+    uint8_t reserved1[24];
+};
+
+struct sc_shm_sink_slot {
+    atomic_uint_least32_t seq;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    int64_t pts; // in microseconds
+    uint64_t frame_number; // 0 for the first frame
+    uint64_t size; // size of the data following this header
+    uint8_t reserved[24];
+};
+
+struct sc_shm_sink {
+    struct sc_frame_sink frame_sink; // frame sink trait
+
+    struct sc_frame_buffer fb;
+
+    char *path;
+    int fd;
+
+    // Mapping of the whole file
+    uint8_t *map;
+    size_t map_size;
+    size_t slot_size;
+    uint64_t frame_count;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool has_frame;
+    bool stopped;
+};
+
+bool
+sc_shm_sink_init(struct sc_shm_sink *ss, const char *path);
+
+void
+sc_shm_sink_destroy(struct sc_shm_sink *ss);
+
+#endif
@@ -0,0 +1,63 @@
+#include "stats.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+
+// 32-bit counters are lock-free everywhere; they may wrap, only the
+// differences between samples are used
+static atomic_uint sc_stats[SC_STAT_COUNT];
+
+void
+sc_stats_add(enum sc_stat stat, uint32_t value) {
+    assert(stat < SC_STAT_FIRST_GAUGE);
+    atomic_fetch_add_explicit(&sc_stats[stat], value, memory_order_relaxed);
+}
+
+void
+sc_stats_set(enum sc_stat stat, uint32_t value) {
+    assert(stat >= SC_STAT_FIRST_GAUGE && stat < SC_STAT_COUNT);
+    atomic_store_explicit(&sc_stats[stat], value, memory_order_relaxed);
+}
+
+void
+sc_stats_add_gauge(enum sc_stat stat, int32_t delta) {
+    assert(stat >= SC_STAT_FIRST_GAUGE && stat < SC_STAT_COUNT);
+    // Unsigned arithmetic handles negative deltas
+    atomic_fetch_add_explicit(&sc_stats[stat], (uint32_t) delta,
+                              memory_order_relaxed);
+}
+
+uint32_t
+sc_stats_get(enum sc_stat stat) {
+    assert(stat < SC_STAT_COUNT);
+    return atomic_load_explicit(&sc_stats[stat], memory_order_relaxed);
+}
+
+void
+sc_stats_sampler_init(struct sc_stats_sampler *sampler, sc_tick now) {
+    for (unsigned i = 0; i < SC_STAT_FIRST_GAUGE; ++i) {
+        sampler->last[i] = sc_stats_get(i);
+    }
+    sampler->last_date = now;
+}
+
+void
+sc_stats_sampler_sample(struct sc_stats_sampler *sampler, sc_tick now,
+                        struct sc_stats_sample *sample) {
+    sc_tick elapsed = now - sampler->last_date;
+
+    for (unsigned i = 0; i < SC_STAT_FIRST_GAUGE; ++i) {
+        uint32_t value = sc_stats_get(i);
+        // Unsigned arithmetic handles the wrapping
+        uint32_t delta = value - sampler->last[i];
+        sampler->last[i] = value;
+        sample->values[i] =
+            elapsed > 0 ? (uint64_t) delta * SC_TICK_FREQ / elapsed : 0;
+    }
+
+    for (unsigned i = SC_STAT_FIRST_GAUGE; i < SC_STAT_COUNT; ++i) {
+        sample->values[i] = sc_stats_get(i);
+    }
+
+    sampler->last_date = now;
+}
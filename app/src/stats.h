@@ -0,0 +1,89 @@
+#ifndef SC_STATS_H
+#define SC_STATS_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/tick.h"
+
+/**
+ * Session metrics, updated by the components at each stage of the pipeline
+ *
+ * Each metric is a single atomic, updated with a relaxed operation (no lock),
+ * so that it may be updated unconditionally from any thread. The values are
+ * sampled periodically by the FPS counter thread.
+ */
+enum sc_stat {
+    // Counters (monotonic, reported as a rate)
+    SC_STAT_VIDEO_PACKETS,
+    SC_STAT_VIDEO_BYTES,
+    SC_STAT_AUDIO_BYTES,
+    SC_STAT_VIDEO_PACKETS_DROPPED, // by the decoder, waiting for a keyframe
+    SC_STAT_FRAMES_DECODED,
+    SC_STAT_FRAMES_RENDERED,
+    SC_STAT_FRAMES_SKIPPED, // by the screen, replaced before being rendered
+    SC_STAT_FRAMES_REPEATED, // identical to the previous one, not rendered
+    SC_STAT_DECODE_TIME_US, // total video decoding time, in microseconds
+
+    // Gauges (current value)
+    SC_STAT_CONTROLLER_QUEUE, // pending control messages
+    SC_STAT_RECORDER_QUEUE, // pending packets to record
+    SC_STAT_RECORDER_QUEUE_BYTES, // memory held by the pending packets
+    SC_STAT_DELAY_BUFFER_BYTES, // memory held by the delay buffers
+    // Reception to present latency percentiles, in microseconds (only
+    // updated with --print-latency)
+    SC_STAT_LATENCY_P50_US,
+    SC_STAT_LATENCY_P95_US,
+    SC_STAT_LATENCY_P99_US,
+    // Thermal state reported by the device, as the value + 1 (0 if unknown,
+    // since 0 is a valid value)
+    SC_STAT_THERMAL_STATUS, // Android thermal status
+    SC_STAT_THERMAL_HEADROOM_PCT, // forecasted headroom, in percent
+    SC_STAT_THERMAL_THROTTLE, // throttle level applied by the server
+
+    SC_STAT_COUNT,
+};
+
+#define SC_STAT_FIRST_GAUGE SC_STAT_CONTROLLER_QUEUE
+
+struct sc_stats_sample {
+    // Rate per second for counters, value for gauges
+    uint32_t values[SC_STAT_COUNT];
+};
+
+// Add `value` to a counter
+void
+sc_stats_add(enum sc_stat stat, uint32_t value);
+
+// Set the current value of a gauge
+void
+sc_stats_set(enum sc_stat stat, uint32_t value);
+
+// Add a (possibly negative) delta to a gauge shared by several components
+void
+sc_stats_add_gauge(enum sc_stat stat, int32_t delta);
+
+// Get the raw value of a metric (a counter may wrap)
+uint32_t
+sc_stats_get(enum sc_stat stat);
+
+/**
+ * State to compute the counter rates between successive samples
+ */
+struct sc_stats_sampler {
+    uint32_t last[SC_STAT_COUNT];
+    sc_tick last_date;
+};
+
+void
+sc_stats_sampler_init(struct sc_stats_sampler *sampler, sc_tick now);
+
+// Sample all the metrics (the counters are converted to rates since the
+// previous call)
+void
+sc_stats_sampler_sample(struct sc_stats_sampler *sampler, sc_tick now,
+                        struct sc_stats_sample *sample);
+
+#endif
@@ -0,0 +1,55 @@
+#include "sws.h"
+
+#include <stdint.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+
+#include "util/log.h"
+
+static bool
+sc_sws_has_option(struct SwsContext *ctx, const char *name, int64_t value) {
+    int64_t current;
+    return av_opt_get_int(ctx, name, 0, &current) >= 0 && current == value;
+}
+
+struct SwsContext *
+sc_sws_get_context(struct SwsContext *ctx, int src_width, int src_height,
+                   enum AVPixelFormat src_format, int dst_width,
+                   int dst_height, enum AVPixelFormat dst_format, int flags) {
+    if (ctx) {
+        bool same = sc_sws_has_option(ctx, "srcw", src_width)
+                 && sc_sws_has_option(ctx, "srch", src_height)
+                 && sc_sws_has_option(ctx, "src_format", src_format)
+                 && sc_sws_has_option(ctx, "dstw", dst_width)
+                 && sc_sws_has_option(ctx, "dsth", dst_height)
+                 && sc_sws_has_option(ctx, "dst_format", dst_format)
+                 && sc_sws_has_option(ctx, "sws_flags", flags);
+        if (same) {
+            return ctx;
+        }
+        sws_freeContext(ctx);
+    }
+
+    ctx = sws_alloc_context();
+    if (!ctx) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    av_opt_set_int(ctx, "srcw", src_width, 0);
+    av_opt_set_int(ctx, "srch", src_height, 0);
+    av_opt_set_int(ctx, "src_format", src_format, 0);
+    av_opt_set_int(ctx, "dstw", dst_width, 0);
+    av_opt_set_int(ctx, "dsth", dst_height, 0);
+    av_opt_set_int(ctx, "dst_format", dst_format, 0);
+    av_opt_set_int(ctx, "sws_flags", flags, 0);
+    // 0 means one thread per core (ignored if the option does not exist)
+    av_opt_set_int(ctx, "threads", 0, 0);
+
+    if (sws_init_context(ctx, NULL, NULL) < 0) {
+        sws_freeContext(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
@@ -0,0 +1,27 @@
+#ifndef SC_SWS_H
+#define SC_SWS_H
+
+#include "common.h"
+
+#include <libavutil/pixfmt.h>
+
+struct SwsContext;
+
+/**
+ * Equivalent to sws_getCachedContext(), but the conversion is split on all
+ * the cores
+ *
+ * The existing context `ctx` (may be NULL) is returned if it matches the
+ * parameters, otherwise it is freed and a new one is created.
+ *
+ * The "threads" option is only supported by libswscale from FFmpeg 5.0:
+ * before, the conversion is single-threaded.
+ *
+ * Return NULL on error (`ctx` is freed).
+ */
+struct SwsContext *
+sc_sws_get_context(struct SwsContext *ctx, int src_width, int src_height,
+                   enum AVPixelFormat src_format, int dst_width,
+                   int dst_height, enum AVPixelFormat dst_format, int flags);
+
+#endif
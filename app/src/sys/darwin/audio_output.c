@@ -0,0 +1,174 @@
+#include "audio_output.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <AudioToolbox/AudioToolbox.h>
+#include <CoreAudio/CoreAudio.h>
+
+#include "util/log.h"
+
+struct sc_audio_output {
+    AudioComponentInstance unit;
+    size_t sample_size;
+    sc_audio_output_pull_fn pull;
+    void *userdata;
+};
+
+static OSStatus
+sc_audio_output_render(void *userdata, AudioUnitRenderActionFlags *flags,
+                       const AudioTimeStamp *timestamp, UInt32 bus,
+                       UInt32 frames, AudioBufferList *data) {
+    (void) flags;
+    (void) timestamp;
+    (void) bus;
+    (void) frames;
+
+    struct sc_audio_output *output = userdata;
+
+    // The format is interleaved, so there is a single buffer
+    assert(data->mNumberBuffers == 1);
+    AudioBuffer *buf = &data->mBuffers[0];
+    assert(buf->mDataByteSize % output->sample_size == 0);
+    uint32_t samples = buf->mDataByteSize / output->sample_size;
+
+    output->pull(output->userdata, buf->mData, samples);
+    return noErr;
+}
+
+static void
+sc_audio_output_set_period(AudioComponentInstance unit, uint32_t period) {
+    AudioDeviceID device;
+    UInt32 size = sizeof(device);
+    OSStatus status =
+        AudioUnitGetProperty(unit, kAudioOutputUnitProperty_CurrentDevice,
+                             kAudioUnitScope_Global, 0, &device, &size);
+    if (status != noErr) {
+        LOGW("Could not get the audio output device: %d", (int) status);
+        return;
+    }
+
+    AudioObjectPropertyAddress addr = {
+        .mSelector = kAudioDevicePropertyBufferFrameSizeRange,
+        .mScope = kAudioObjectPropertyScopeGlobal,
+        .mElement = 0, // kAudioObjectPropertyElementMain
+    };
+    AudioValueRange range;
+    size = sizeof(range);
+    status = AudioObjectGetPropertyData(device, &addr, 0, NULL, &size, &range);
+    if (status == noErr) {
+        // The smallest period supported by the device
+        period = CLAMP(period, (uint32_t) range.mMinimum,
+                       (uint32_t) range.mMaximum);
+    }
+
+    // The buffer frame size is set for this process only
+    UInt32 frames = period;
+    status = AudioUnitSetProperty(unit, kAudioDevicePropertyBufferFrameSize,
+                                  kAudioUnitScope_Global, 0, &frames,
+                                  sizeof(frames));
+    if (status != noErr) {
+        LOGW("Could not set the audio output period: %d", (int) status);
+        return;
+    }
+
+    LOGD("Audio output period: %" PRIu32 " samples", (uint32_t) frames);
+}
+
+struct sc_audio_output *
+sc_audio_output_open(uint32_t sample_rate, uint8_t channels, uint32_t period,
+                     sc_audio_output_pull_fn pull, void *userdata) {
+    struct sc_audio_output *output = malloc(sizeof(*output));
+    if (!output) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    output->sample_size = channels * sizeof(float);
+    output->pull = pull;
+    output->userdata = userdata;
+
+    AudioComponentDescription desc = {
+        .componentType = kAudioUnitType_Output,
+        .componentSubType = kAudioUnitSubType_DefaultOutput,
+        .componentManufacturer = kAudioUnitManufacturer_Apple,
+    };
+    AudioComponent component = AudioComponentFindNext(NULL, &desc);
+    if (!component) {
+        LOGE("Could not find the default audio output unit");
+        goto error_free_output;
+    }
+
+    OSStatus status = AudioComponentInstanceNew(component, &output->unit);
+    if (status != noErr) {
+        LOGE("Could not create the audio output unit: %d", (int) status);
+        goto error_free_output;
+    }
+
+    AudioStreamBasicDescription format = {
+        .mSampleRate = sample_rate,
+        .mFormatID = kAudioFormatLinearPCM,
+        .mFormatFlags = kAudioFormatFlagIsFloat | kAudioFormatFlagIsPacked,
+        .mBytesPerPacket = output->sample_size,
+        .mFramesPerPacket = 1,
+        .mBytesPerFrame = output->sample_size,
+        .mChannelsPerFrame = channels,
+        .mBitsPerChannel = 32,
+    };
+    status = AudioUnitSetProperty(output->unit, kAudioUnitProperty_StreamFormat,
+                                  kAudioUnitScope_Input, 0, &format,
+                                  sizeof(format));
+    if (status != noErr) {
+        LOGE("Could not set the audio output format: %d", (int) status);
+        goto error_dispose_unit;
+    }
+
+    AURenderCallbackStruct cb = {
+        .inputProc = sc_audio_output_render,
+        .inputProcRefCon = output,
+    };
+    status = AudioUnitSetProperty(output->unit,
+                                  kAudioUnitProperty_SetRenderCallback,
+                                  kAudioUnitScope_Input, 0, &cb, sizeof(cb));
+    if (status != noErr) {
+        LOGE("Could not set the audio output callback: %d", (int) status);
+        goto error_dispose_unit;
+    }
+
+    sc_audio_output_set_period(output->unit, period);
+
+    status = AudioUnitInitialize(output->unit);
+    if (status != noErr) {
+        LOGE("Could not initialize the audio output unit: %d", (int) status);
+        goto error_dispose_unit;
+    }
+
+    return output;
+
+error_dispose_unit:
+    AudioComponentInstanceDispose(output->unit);
+error_free_output:
+    free(output);
+
+    return NULL;
+}
+
+bool
+sc_audio_output_start(struct sc_audio_output *output) {
+    OSStatus status = AudioOutputUnitStart(output->unit);
+    if (status != noErr) {
+        LOGE("Could not start the audio output: %d", (int) status);
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_audio_output_close(struct sc_audio_output *output) {
+    // Once stopped, the render callback is not called anymore
+    AudioOutputUnitStop(output->unit);
+    AudioUnitUninitialize(output->unit);
+    AudioComponentInstanceDispose(output->unit);
+    free(output);
+}
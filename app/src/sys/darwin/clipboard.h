@@ -5,6 +5,25 @@
 #include <stddef.h>
 #include <stdint.h>
 
+// Opaque RGBA8888 image, whose pixels are owned by the system
+struct sc_darwin_image;
+
+/**
+ * Create an image, and return a pointer to its (uninitialized) pixels, so that
+ * they can be written directly without an intermediate buffer
+ *
+ * The pitch may be larger than width * 4.
+ */
+struct sc_darwin_image *
+sc_darwin_image_create_rgba8888(uint16_t width, uint16_t height,
+                                uint8_t **pixels, size_t *pitch);
+
+void
+sc_darwin_image_destroy(struct sc_darwin_image *image);
+
+bool
+sc_darwin_clipboard_set_image(struct sc_darwin_image *image);
+
 bool
 sc_darwin_clipboard_set_image_rgba8888(const uint8_t *data, size_t pitch,
                                        uint16_t width, uint16_t height);
@@ -12,8 +31,10 @@ sc_darwin_clipboard_set_image_rgba8888(const uint8_t *data, size_t pitch,
 bool
 sc_darwin_choose_directory(char *path, size_t path_size);
 
+// On success, *png_data must be released by free()
 bool
-sc_darwin_write_png_rgba8888(const char *path, const uint8_t *data,
-                             size_t pitch, uint16_t width, uint16_t height);
+sc_darwin_encode_png_rgba8888(const uint8_t *data, size_t pitch,
+                              uint16_t width, uint16_t height,
+                              uint8_t **png_data, size_t *png_size);
 
 #endif
@@ -2,11 +2,12 @@
 
 #import <AppKit/AppKit.h>
 
+#include <stdlib.h>
 #include <string.h>
 
 static NSBitmapImageRep *
-sc_darwin_create_image_rep_rgba8888(const uint8_t *data, size_t pitch,
-                                    uint16_t width, uint16_t height) {
+sc_darwin_alloc_image_rep_rgba8888(uint16_t width, uint16_t height) {
+    // With bytesPerRow:0, the row size is chosen (and aligned) by AppKit
     NSBitmapImageRep *rep =
         [[NSBitmapImageRep alloc] initWithBitmapDataPlanes:NULL
                                                 pixelsWide:width
@@ -16,27 +17,79 @@ sc_darwin_create_image_rep_rgba8888(const uint8_t *data, size_t pitch,
                                                   hasAlpha:YES
                                                   isPlanar:NO
                                             colorSpaceName:NSDeviceRGBColorSpace
-                                               bytesPerRow:width * 4
+                                               bytesPerRow:0
                                               bitsPerPixel:32];
     if (!rep) {
         return nil;
     }
 
-    unsigned char *dest = [rep bitmapData];
-    if (!dest) {
+    if (![rep bitmapData]) {
         [rep release];
         return nil;
     }
 
-    size_t dest_pitch = (size_t) width * 4;
+    return rep;
+}
+
+static NSBitmapImageRep *
+sc_darwin_create_image_rep_rgba8888(const uint8_t *data, size_t pitch,
+                                    uint16_t width, uint16_t height) {
+    NSBitmapImageRep *rep = sc_darwin_alloc_image_rep_rgba8888(width, height);
+    if (!rep) {
+        return nil;
+    }
+
+    unsigned char *dest = [rep bitmapData];
+    size_t dest_pitch = [rep bytesPerRow];
+    size_t row_size = (size_t) width * 4;
     for (uint16_t y = 0; y < height; ++y) {
         memcpy(dest + (size_t) y * dest_pitch, data + (size_t) y * pitch,
-               dest_pitch);
+               row_size);
     }
 
     return rep;
 }
 
+struct sc_darwin_image *
+sc_darwin_image_create_rgba8888(uint16_t width, uint16_t height,
+                                uint8_t **pixels, size_t *pitch) {
+    NSBitmapImageRep *rep = sc_darwin_alloc_image_rep_rgba8888(width, height);
+    if (!rep) {
+        return NULL;
+    }
+
+    *pixels = [rep bitmapData];
+    *pitch = [rep bytesPerRow];
+    return (struct sc_darwin_image *) rep;
+}
+
+void
+sc_darwin_image_destroy(struct sc_darwin_image *image) {
+    NSBitmapImageRep *rep = (NSBitmapImageRep *) image;
+    [rep release];
+}
+
+static bool
+sc_darwin_clipboard_set_image_rep(NSBitmapImageRep *rep) {
+    NSSize size = NSMakeSize([rep pixelsWide], [rep pixelsHigh]);
+    NSImage *image = [[NSImage alloc] initWithSize:size];
+    [image addRepresentation:rep];
+
+    NSPasteboard *pasteboard = [NSPasteboard generalPasteboard];
+    [pasteboard clearContents];
+    BOOL ok = [pasteboard writeObjects:[NSArray arrayWithObject:image]];
+
+    [image release];
+    return ok == YES;
+}
+
+bool
+sc_darwin_clipboard_set_image(struct sc_darwin_image *image) {
+    @autoreleasepool {
+        return sc_darwin_clipboard_set_image_rep((NSBitmapImageRep *) image);
+    }
+}
+
 bool
 sc_darwin_clipboard_set_image_rgba8888(const uint8_t *data, size_t pitch,
                                        uint16_t width, uint16_t height) {
@@ -47,18 +100,9 @@ sc_darwin_clipboard_set_image_rgba8888(const uint8_t *data, size_t pitch,
             return false;
         }
 
-        NSImage *image =
-            [[NSImage alloc] initWithSize:NSMakeSize(width, height)];
-        [image addRepresentation:rep];
-
-        NSPasteboard *pasteboard = [NSPasteboard generalPasteboard];
-        [pasteboard clearContents];
-        BOOL ok = [pasteboard
-            writeObjects:[NSArray arrayWithObject:image]];
-
-        [image release];
+        bool ok = sc_darwin_clipboard_set_image_rep(rep);
         [rep release];
-        return ok == YES;
+        return ok;
     }
 }
 
@@ -102,33 +146,47 @@ sc_darwin_choose_directory(char *path, size_t path_size) {
     }
 }
 
-bool
-sc_darwin_write_png_rgba8888(const char *path, const uint8_t *data,
-                             size_t pitch, uint16_t width, uint16_t height) {
-    if (!path || !*path) {
-        return false;
+// Return an autoreleased NSData, or nil on error
+static NSData *
+sc_darwin_create_png_data_rgba8888(const uint8_t *data, size_t pitch,
+                                   uint16_t width, uint16_t height) {
+    NSBitmapImageRep *rep =
+        sc_darwin_create_image_rep_rgba8888(data, pitch, width, height);
+    if (!rep) {
+        return nil;
     }
 
+    NSData *png_data =
+        [rep representationUsingType:NSBitmapImageFileTypePNG
+                          properties:@{}];
+    [rep release];
+    return png_data;
+}
+
+bool
+sc_darwin_encode_png_rgba8888(const uint8_t *data, size_t pitch,
+                              uint16_t width, uint16_t height,
+                              uint8_t **png_data, size_t *png_size) {
     @autoreleasepool {
-        NSBitmapImageRep *rep =
-            sc_darwin_create_image_rep_rgba8888(data, pitch, width, height);
-        if (!rep) {
+        NSData *encoded =
+            sc_darwin_create_png_data_rgba8888(data, pitch, width, height);
+        if (!encoded) {
             return false;
         }
 
-        NSData *png_data =
-            [rep representationUsingType:NSBitmapImageFileTypePNG
-                              properties:@{}];
-        [rep release];
-        if (!png_data) {
+        size_t size = [encoded length];
+        if (!size) {
             return false;
         }
 
-        NSString *ns_path = [NSString stringWithUTF8String:path];
-        if (!ns_path) {
+        uint8_t *out = malloc(size);
+        if (!out) {
             return false;
         }
+        memcpy(out, [encoded bytes], size);
 
-        return [png_data writeToFile:ns_path atomically:YES] == YES;
+        *png_data = out;
+        *png_size = size;
+        return true;
     }
 }
@@ -17,4 +17,25 @@ sc_darwin_font_create_text_texture(SDL_Renderer *renderer,
                                    uint16_t *out_width,
                                    uint16_t *out_height);
 
+#define SC_DARWIN_FONT_GLYPH_ATLAS_MAX_CHARS 64
+
+/**
+ * Rasterize each character of `chars` once, in white, side by side in a
+ * single texture
+ *
+ * The glyph of chars[i] spans the columns [glyph_x[i], glyph_x[i+1] - 1) of
+ * the texture (`glyph_x` must have room for strlen(chars) + 1 values), over
+ * the whole texture height, written to `out_height`.
+ *
+ * Text drawn from this atlas (tinted by color modulation) costs one copy per
+ * character, whatever the text, so it suits values changing on every frame.
+ */
+SDL_Texture *
+sc_darwin_font_create_glyph_atlas(SDL_Renderer *renderer,
+                                  const char *font_path,
+                                  const char *chars,
+                                  uint16_t point_size,
+                                  uint16_t *glyph_x,
+                                  uint16_t *out_height);
+
 #endif
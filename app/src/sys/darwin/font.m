@@ -8,6 +8,126 @@
 
 #import <CoreText/CoreText.h>
 
+// Must be called from an autorelease pool
+static CTFontRef
+sc_darwin_font_create_ct_font(const char *font_path, uint16_t point_size) {
+    CFStringRef path_string =
+        CFStringCreateWithCString(NULL, font_path, kCFStringEncodingUTF8);
+    if (!path_string) {
+        return NULL;
+    }
+
+    CFURLRef font_url = CFURLCreateWithFileSystemPath(
+        NULL, path_string, kCFURLPOSIXPathStyle, false);
+    CFRelease(path_string);
+    if (!font_url) {
+        return NULL;
+    }
+
+    CGDataProviderRef provider = CGDataProviderCreateWithURL(font_url);
+    CFRelease(font_url);
+    if (!provider) {
+        return NULL;
+    }
+
+    CGFontRef cg_font = CGFontCreateWithDataProvider(provider);
+    CGDataProviderRelease(provider);
+    if (!cg_font) {
+        return NULL;
+    }
+
+    CTFontRef ct_font =
+        CTFontCreateWithGraphicsFont(cg_font, (CGFloat) point_size, NULL, NULL);
+    CGFontRelease(cg_font);
+    return ct_font;
+}
+
+// Create a line of `text` drawn with `ct_font` in the given color
+static CTLineRef
+sc_darwin_font_create_line(CTFontRef ct_font, const char *text, uint8_t r,
+                           uint8_t g, uint8_t b) {
+    CFStringRef text_cf =
+        CFStringCreateWithCString(NULL, text, kCFStringEncodingUTF8);
+    if (!text_cf) {
+        return NULL;
+    }
+
+    CGColorSpaceRef color_space = CGColorSpaceCreateDeviceRGB();
+    CGFloat color_components[4] = {
+        r / 255.0f,
+        g / 255.0f,
+        b / 255.0f,
+        1.0f,
+    };
+    CGColorRef color = CGColorCreate(color_space, color_components);
+    CGColorSpaceRelease(color_space);
+    if (!color) {
+        CFRelease(text_cf);
+        return NULL;
+    }
+
+    const void *keys[2] = {kCTFontAttributeName,
+                           kCTForegroundColorAttributeName};
+    const void *values[2] = {ct_font, color};
+    CFDictionaryRef attributes = CFDictionaryCreate(
+        NULL, keys, values, 2,
+        &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    CGColorRelease(color);
+    if (!attributes) {
+        CFRelease(text_cf);
+        return NULL;
+    }
+
+    CFAttributedStringRef attributed =
+        CFAttributedStringCreate(NULL, text_cf, attributes);
+    CFRelease(attributes);
+    CFRelease(text_cf);
+    if (!attributed) {
+        return NULL;
+    }
+
+    CTLineRef line = CTLineCreateWithAttributedString(attributed);
+    CFRelease(attributed);
+    return line;
+}
+
+// Upload the RGBA pixels rasterized by CoreGraphics to a new texture
+static SDL_Texture *
+sc_darwin_font_create_texture(SDL_Renderer *renderer, const uint8_t *pixels,
+                              int width, int height, size_t pitch) {
+    SDL_Texture *texture =
+        SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+                          SDL_TEXTUREACCESS_STATIC, width, height);
+    if (!texture) {
+        return NULL;
+    }
+
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    if (SDL_UpdateTexture(texture, NULL, pixels, (int) pitch)) {
+        SDL_DestroyTexture(texture);
+        return NULL;
+    }
+
+    return texture;
+}
+
+static CGContextRef
+sc_darwin_font_create_context(uint8_t *pixels, int width, int height,
+                              size_t pitch) {
+    CGColorSpaceRef draw_space = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context =
+        CGBitmapContextCreate(pixels, (size_t) width, (size_t) height, 8,
+                              pitch, draw_space,
+                              kCGImageAlphaPremultipliedLast
+                              | kCGBitmapByteOrder32Big);
+    CGColorSpaceRelease(draw_space);
+    if (context) {
+        CGContextSetShouldAntialias(context, true);
+        CGContextSetAllowsAntialiasing(context, true);
+    }
+    return context;
+}
+
 SDL_Texture *
 sc_darwin_font_create_text_texture(SDL_Renderer *renderer,
                                    const char *font_path,
@@ -22,84 +142,14 @@ sc_darwin_font_create_text_texture(SDL_Renderer *renderer,
     }
 
     @autoreleasepool {
-        CFStringRef path_string =
-            CFStringCreateWithCString(NULL, font_path, kCFStringEncodingUTF8);
-        if (!path_string) {
-            return NULL;
-        }
-
-        CFURLRef font_url = CFURLCreateWithFileSystemPath(
-            NULL, path_string, kCFURLPOSIXPathStyle, false);
-        CFRelease(path_string);
-        if (!font_url) {
-            return NULL;
-        }
-
-        CGDataProviderRef provider = CGDataProviderCreateWithURL(font_url);
-        CFRelease(font_url);
-        if (!provider) {
-            return NULL;
-        }
-
-        CGFontRef cg_font = CGFontCreateWithDataProvider(provider);
-        CGDataProviderRelease(provider);
-        if (!cg_font) {
-            return NULL;
-        }
-
-        CTFontRef ct_font =
-            CTFontCreateWithGraphicsFont(cg_font, (CGFloat) point_size,
-                                         NULL, NULL);
-        CGFontRelease(cg_font);
+        CTFontRef ct_font = sc_darwin_font_create_ct_font(font_path,
+                                                          point_size);
         if (!ct_font) {
             return NULL;
         }
 
-        CFStringRef text_cf =
-            CFStringCreateWithCString(NULL, text, kCFStringEncodingUTF8);
-        if (!text_cf) {
-            CFRelease(ct_font);
-            return NULL;
-        }
-
-        CGColorSpaceRef color_space = CGColorSpaceCreateDeviceRGB();
-        CGFloat color_components[4] = {
-            r / 255.0f,
-            g / 255.0f,
-            b / 255.0f,
-            1.0f,
-        };
-        CGColorRef color = CGColorCreate(color_space, color_components);
-        CGColorSpaceRelease(color_space);
-        if (!color) {
-            CFRelease(text_cf);
-            CFRelease(ct_font);
-            return NULL;
-        }
-
-        const void *keys[2] = {kCTFontAttributeName,
-                               kCTForegroundColorAttributeName};
-        const void *values[2] = {ct_font, color};
-        CFDictionaryRef attributes = CFDictionaryCreate(
-            NULL, keys, values, 2,
-            &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
-        CGColorRelease(color);
+        CTLineRef line = sc_darwin_font_create_line(ct_font, text, r, g, b);
         CFRelease(ct_font);
-        if (!attributes) {
-            CFRelease(text_cf);
-            return NULL;
-        }
-
-        CFAttributedStringRef attributed =
-            CFAttributedStringCreate(NULL, text_cf, attributes);
-        CFRelease(attributes);
-        CFRelease(text_cf);
-        if (!attributed) {
-            return NULL;
-        }
-
-        CTLineRef line = CTLineCreateWithAttributedString(attributed);
-        CFRelease(attributed);
         if (!line) {
             return NULL;
         }
@@ -119,44 +169,119 @@ sc_darwin_font_create_text_texture(SDL_Renderer *renderer,
             return NULL;
         }
 
-        CGColorSpaceRef draw_space = CGColorSpaceCreateDeviceRGB();
         CGContextRef context =
-            CGBitmapContextCreate(pixels, (size_t) width, (size_t) height, 8,
-                                  pitch, draw_space,
-                                  kCGImageAlphaPremultipliedLast
-                                  | kCGBitmapByteOrder32Big);
-        CGColorSpaceRelease(draw_space);
+            sc_darwin_font_create_context(pixels, width, height, pitch);
         if (!context) {
             free(pixels);
             CFRelease(line);
             return NULL;
         }
 
-        CGContextSetShouldAntialias(context, true);
-        CGContextSetAllowsAntialiasing(context, true);
         CGContextSetTextPosition(context, 0.0, descent);
         CTLineDraw(line, context);
         CGContextRelease(context);
         CFRelease(line);
 
         SDL_Texture *texture =
-            SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
-                              SDL_TEXTUREACCESS_STATIC, width, height);
+            sc_darwin_font_create_texture(renderer, pixels, width, height,
+                                          pitch);
+        free(pixels);
         if (!texture) {
-            free(pixels);
             return NULL;
         }
 
-        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
-        if (SDL_UpdateTexture(texture, NULL, pixels, (int) pitch)) {
-            SDL_DestroyTexture(texture);
-            free(pixels);
+        *out_width = (uint16_t) CLAMP(width, 0, 0xFFFF);
+        *out_height = (uint16_t) CLAMP(height, 0, 0xFFFF);
+        return texture;
+    }
+}
+
+SDL_Texture *
+sc_darwin_font_create_glyph_atlas(SDL_Renderer *renderer,
+                                  const char *font_path,
+                                  const char *chars,
+                                  uint16_t point_size,
+                                  uint16_t *glyph_x,
+                                  uint16_t *out_height) {
+    size_t len = chars ? strlen(chars) : 0;
+    if (!renderer || !font_path || !*font_path || !len
+            || len > SC_DARWIN_FONT_GLYPH_ATLAS_MAX_CHARS || !glyph_x
+            || !out_height) {
+        return NULL;
+    }
+
+    @autoreleasepool {
+        CTFontRef ct_font = sc_darwin_font_create_ct_font(font_path,
+                                                          point_size);
+        if (!ct_font) {
             return NULL;
         }
-        free(pixels);
 
-        *out_width = (uint16_t) CLAMP(width, 0, 0xFFFF);
-        *out_height = (uint16_t) CLAMP(height, 0, 0xFFFF);
+        CGFloat ascent = CTFontGetAscent(ct_font);
+        CGFloat descent = CTFontGetDescent(ct_font);
+        CGFloat leading = CTFontGetLeading(ct_font);
+        int height = MAX(1, (int) ceil(ascent + descent + leading));
+
+        // One line per glyph, so that each glyph is positioned at an integral
+        // x in the atlas (the glyphs are drawn in white, to be tinted by the
+        // texture color modulation)
+        CTLineRef lines[SC_DARWIN_FONT_GLYPH_ATLAS_MAX_CHARS];
+        int x = 0;
+        size_t count = 0;
+        for (; count < len; ++count) {
+            char text[2] = {chars[count], '\0'};
+            lines[count] = sc_darwin_font_create_line(ct_font, text, 255, 255,
+                                                      255);
+            if (!lines[count]) {
+                break;
+            }
+
+            double advance =
+                CTLineGetTypographicBounds(lines[count], NULL, NULL, NULL);
+            glyph_x[count] = x;
+            // 1-pixel gutter between glyphs
+            x += MAX(1, (int) ceil(advance)) + 1;
+        }
+        glyph_x[count] = x;
+        CFRelease(ct_font);
+
+        SDL_Texture *texture = NULL;
+        uint8_t *pixels = NULL;
+        CGContextRef context = NULL;
+        size_t pitch = (size_t) x * 4;
+        if (count < len || x > 0xFFFF) {
+            goto end;
+        }
+
+        pixels = calloc((size_t) height, pitch);
+        if (!pixels) {
+            goto end;
+        }
+
+        context = sc_darwin_font_create_context(pixels, x, height, pitch);
+        if (!context) {
+            goto end;
+        }
+
+        for (size_t i = 0; i < len; ++i) {
+            CGContextSetTextPosition(context, glyph_x[i], descent);
+            CTLineDraw(lines[i], context);
+        }
+
+        texture = sc_darwin_font_create_texture(renderer, pixels, x, height,
+                                                pitch);
+        if (texture) {
+            *out_height = (uint16_t) CLAMP(height, 0, 0xFFFF);
+        }
+
+end:
+        if (context) {
+            CGContextRelease(context);
+        }
+        free(pixels);
+        for (size_t i = 0; i < count; ++i) {
+            CFRelease(lines[i]);
+        }
         return texture;
     }
 }
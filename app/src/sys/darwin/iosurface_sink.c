@@ -0,0 +1,304 @@
+#include "sys/darwin/iosurface_sink.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+#include <IOSurface/IOSurface.h>
+
+#include "util/log.h"
+
+/** Downcast frame_sink to sc_iosurface_sink */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_iosurface_sink, frame_sink)
+
+static void
+sc_iosurface_sink_release_buffers(struct sc_iosurface_sink *is) {
+    for (unsigned i = 0; i < SC_IOSURFACE_SINK_SURFACES; ++i) {
+        if (is->buffers[i]) {
+            CVPixelBufferRelease(is->buffers[i]);
+            is->buffers[i] = NULL;
+        }
+    }
+}
+
+static CVPixelBufferRef
+sc_iosurface_sink_create_buffer(int width, int height) {
+    // The surfaces must be global to be looked up by id from other processes
+    // (kIOSurfaceIsGlobal is deprecated, but the alternative, sending mach
+    // ports, requires a dedicated IPC channel)
+    int one = 1;
+    CFNumberRef global = CFNumberCreate(NULL, kCFNumberIntType, &one);
+    if (!global) {
+        return NULL;
+    }
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+    const void *surface_keys[] = {kIOSurfaceIsGlobal};
+#pragma clang diagnostic pop
+    const void *surface_values[] = {global};
+    CFDictionaryRef surface_props =
+        CFDictionaryCreate(NULL, surface_keys, surface_values, 1,
+                           &kCFTypeDictionaryKeyCallBacks,
+                           &kCFTypeDictionaryValueCallBacks);
+    CFRelease(global);
+    if (!surface_props) {
+        return NULL;
+    }
+
+    const void *keys[] = {kCVPixelBufferIOSurfacePropertiesKey};
+    const void *values[] = {surface_props};
+    CFDictionaryRef attrs =
+        CFDictionaryCreate(NULL, keys, values, 1,
+                           &kCFTypeDictionaryKeyCallBacks,
+                           &kCFTypeDictionaryValueCallBacks);
+    CFRelease(surface_props);
+    if (!attrs) {
+        return NULL;
+    }
+
+    CVPixelBufferRef buffer;
+    CVReturn ret =
+        CVPixelBufferCreate(NULL, width, height,
+                            kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange,
+                            attrs, &buffer);
+    CFRelease(attrs);
+    if (ret != kCVReturnSuccess) {
+        LOGE("Could not create IOSurface pixel buffer: %d", (int) ret);
+        return NULL;
+    }
+
+    return buffer;
+}
+
+static bool
+sc_iosurface_sink_create_buffers(struct sc_iosurface_sink *is, int width,
+                                 int height) {
+    sc_iosurface_sink_release_buffers(is);
+
+    for (unsigned i = 0; i < SC_IOSURFACE_SINK_SURFACES; ++i) {
+        is->buffers[i] = sc_iosurface_sink_create_buffer(width, height);
+        if (!is->buffers[i]) {
+            sc_iosurface_sink_release_buffers(is);
+            return false;
+        }
+    }
+
+    is->width = width;
+    is->height = height;
+    is->next = 0;
+
+    LOGD("IOSurface sink: %dx%d", width, height);
+    return true;
+}
+
+static void
+copy_plane(uint8_t *dst, size_t dst_stride, const uint8_t *src,
+           size_t src_stride, size_t row_size, size_t rows) {
+    for (size_t row = 0; row < rows; ++row) {
+        memcpy(dst + row * dst_stride, src + row * src_stride, row_size);
+    }
+}
+
+static bool
+write_frame(struct sc_iosurface_sink *is, const AVFrame *frame) {
+    if (frame->width != is->width || frame->height != is->height) {
+        if (!sc_iosurface_sink_create_buffers(is, frame->width,
+                                              frame->height)) {
+            return false;
+        }
+    }
+
+    CVPixelBufferRef buffer = is->buffers[is->next];
+    is->next = (is->next + 1) % SC_IOSURFACE_SINK_SURFACES;
+
+    if (CVPixelBufferLockBaseAddress(buffer, 0) != kCVReturnSuccess) {
+        LOGE("Could not lock IOSurface pixel buffer");
+        return false;
+    }
+
+    size_t chroma_width = (frame->width + 1) / 2;
+    size_t chroma_height = (frame->height + 1) / 2;
+
+    uint8_t *y = CVPixelBufferGetBaseAddressOfPlane(buffer, 0);
+    size_t y_stride = CVPixelBufferGetBytesPerRowOfPlane(buffer, 0);
+    copy_plane(y, y_stride, frame->data[0], frame->linesize[0], frame->width,
+               frame->height);
+
+    uint8_t *uv = CVPixelBufferGetBaseAddressOfPlane(buffer, 1);
+    size_t uv_stride = CVPixelBufferGetBytesPerRowOfPlane(buffer, 1);
+    if (frame->format == AV_PIX_FMT_NV12) {
+        copy_plane(uv, uv_stride, frame->data[1], frame->linesize[1],
+                   2 * chroma_width, chroma_height);
+    } else {
+        assert(frame->format == AV_PIX_FMT_YUV420P);
+        // Interleave U and V
+        for (size_t row = 0; row < chroma_height; ++row) {
+            const uint8_t *u = frame->data[1] + row * frame->linesize[1];
+            const uint8_t *v = frame->data[2] + row * frame->linesize[2];
+            uint8_t *dst = uv + row * uv_stride;
+            for (size_t i = 0; i < chroma_width; ++i) {
+                dst[2 * i] = u[i];
+                dst[2 * i + 1] = v[i];
+            }
+        }
+    }
+
+    CVPixelBufferUnlockBaseAddress(buffer, 0);
+
+    IOSurfaceRef surface = CVPixelBufferGetIOSurface(buffer);
+    assert(surface);
+    IOSurfaceID id = IOSurfaceGetID(surface);
+    if (is->bridge) {
+        sc_figma_bridge_publish_surface(is->bridge, id, frame->width,
+                                        frame->height, frame->pts);
+    }
+
+    return true;
+}
+
+static int
+run_iosurface_sink(void *data) {
+    struct sc_iosurface_sink *is = data;
+
+    for (;;) {
+        sc_mutex_lock(&is->mutex);
+
+        while (!is->stopped && !is->has_frame) {
+            sc_cond_wait(&is->cond, &is->mutex);
+        }
+
+        if (is->stopped) {
+            sc_mutex_unlock(&is->mutex);
+            break;
+        }
+
+        is->has_frame = false;
+        sc_mutex_unlock(&is->mutex);
+
+        struct sc_shared_frame *shared = sc_frame_buffer_consume(&is->fb);
+        bool ok = write_frame(is, shared->frame);
+        sc_shared_frame_release(shared);
+        if (!ok) {
+            LOGE("Could not write frame to IOSurface");
+            break;
+        }
+    }
+
+    LOGD("IOSurface sink thread ended");
+
+    return 0;
+}
+
+static bool
+sc_iosurface_sink_open(struct sc_iosurface_sink *is) {
+    bool ok = sc_frame_buffer_init(&is->fb);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_mutex_init(&is->mutex);
+    if (!ok) {
+        goto error_frame_buffer_destroy;
+    }
+
+    ok = sc_cond_init(&is->cond);
+    if (!ok) {
+        goto error_mutex_destroy;
+    }
+
+    // The surfaces are created on the first frame
+    for (unsigned i = 0; i < SC_IOSURFACE_SINK_SURFACES; ++i) {
+        is->buffers[i] = NULL;
+    }
+    is->width = 0;
+    is->height = 0;
+    is->next = 0;
+
+    is->has_frame = false;
+    is->stopped = false;
+
+    LOGD("Starting IOSurface sink thread");
+    ok = sc_thread_create(&is->thread, run_iosurface_sink, "scrcpy-iosurf",
+                          is);
+    if (!ok) {
+        LOGE("Could not start IOSurface sink thread");
+        goto error_cond_destroy;
+    }
+
+    return true;
+
+error_cond_destroy:
+    sc_cond_destroy(&is->cond);
+error_mutex_destroy:
+    sc_mutex_destroy(&is->mutex);
+error_frame_buffer_destroy:
+    sc_frame_buffer_destroy(&is->fb);
+
+    return false;
+}
+
+static void
+sc_iosurface_sink_close(struct sc_iosurface_sink *is) {
+    sc_mutex_lock(&is->mutex);
+    is->stopped = true;
+    sc_cond_signal(&is->cond);
+    sc_mutex_unlock(&is->mutex);
+
+    sc_thread_join(&is->thread, NULL);
+
+    sc_iosurface_sink_release_buffers(is);
+    sc_cond_destroy(&is->cond);
+    sc_mutex_destroy(&is->mutex);
+    sc_frame_buffer_destroy(&is->fb);
+}
+
+static bool
+sc_iosurface_sink_push(struct sc_iosurface_sink *is,
+                       struct sc_shared_frame *frame) {
+    bool previous_skipped;
+    sc_frame_buffer_push(&is->fb, frame, &previous_skipped);
+
+    if (!previous_skipped) {
+        sc_mutex_lock(&is->mutex);
+        is->has_frame = true;
+        sc_cond_signal(&is->cond);
+        sc_mutex_unlock(&is->mutex);
+    }
+
+    return true;
+}
+
+static bool
+sc_iosurface_frame_sink_open(struct sc_frame_sink *sink,
+                             const AVCodecContext *ctx) {
+    (void) ctx;
+    struct sc_iosurface_sink *is = DOWNCAST(sink);
+    return sc_iosurface_sink_open(is);
+}
+
+static void
+sc_iosurface_frame_sink_close(struct sc_frame_sink *sink) {
+    struct sc_iosurface_sink *is = DOWNCAST(sink);
+    sc_iosurface_sink_close(is);
+}
+
+static bool
+sc_iosurface_frame_sink_push_shared(struct sc_frame_sink *sink,
+                                    struct sc_shared_frame *frame) {
+    struct sc_iosurface_sink *is = DOWNCAST(sink);
+    return sc_iosurface_sink_push(is, frame);
+}
+
+void
+sc_iosurface_sink_init(struct sc_iosurface_sink *is,
+                       struct sc_figma_bridge *bridge) {
+    is->bridge = bridge;
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = sc_iosurface_frame_sink_open,
+        .close = sc_iosurface_frame_sink_close,
+        .push_shared = sc_iosurface_frame_sink_push_shared,
+    };
+
+    is->frame_sink.ops = &ops;
+}
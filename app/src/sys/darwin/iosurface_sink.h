@@ -0,0 +1,50 @@
+#ifndef SC_DARWIN_IOSURFACE_SINK_H
+#define SC_DARWIN_IOSURFACE_SINK_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <CoreVideo/CoreVideo.h>
+
+#include "figma_bridge.h"
+#include "frame_buffer.h"
+#include "trait/frame_sink.h"
+#include "util/thread.h"
+
+// Number of surfaces written in turn, so that a reader has the time to use a
+// surface before it is overwritten
+#define SC_IOSURFACE_SINK_SURFACES 3
+
+/**
+ * IOSurface frame sink (macOS)
+ *
+ * Upload each decoded frame to an IOSurface (NV12, 4:2:0 video range), whose
+ * id is published on the bridge (/scrcpy-bridge/surface), so that other local
+ * applications can look it up and use it as a GPU texture directly.
+ */
+struct sc_iosurface_sink {
+    struct sc_frame_sink frame_sink; // frame sink trait
+
+    struct sc_frame_buffer fb;
+
+    struct sc_figma_bridge *bridge;
+
+    // Pixel buffers backed by global IOSurfaces, created for the frame size
+    CVPixelBufferRef buffers[SC_IOSURFACE_SINK_SURFACES];
+    int width;
+    int height;
+    unsigned next; // index of the next buffer to write
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool has_frame;
+    bool stopped;
+};
+
+void
+sc_iosurface_sink_init(struct sc_iosurface_sink *is,
+                       struct sc_figma_bridge *bridge);
+
+#endif
@@ -11,15 +11,28 @@ enum sc_darwin_settings_menu_action {
     SC_DARWIN_SETTINGS_MENU_ACTION_COPY_TO_CLIPBOARD = 1,
     SC_DARWIN_SETTINGS_MENU_ACTION_SAVE_TO_DIRECTORY = 2,
     SC_DARWIN_SETTINGS_MENU_ACTION_SEND_TO_FIGMA_BRIDGE = 3,
+    SC_DARWIN_SETTINGS_MENU_ACTION_SEND_CLIP_TO_FIGMA_BRIDGE = 4,
 };
 
 bool
 sc_darwin_window_configure_native_chrome(SDL_Window *window);
 
+// Push an SDL event of type `event_type` (with user.code set to whether the
+// window is occluded) whenever the window occlusion state changes
+//
+// Return an observer to release by sc_darwin_window_unobserve_occlusion(), or
+// NULL on error.
+void *
+sc_darwin_window_observe_occlusion(SDL_Window *window, uint32_t event_type);
+
+void
+sc_darwin_window_unobserve_occlusion(void *observer);
+
 enum sc_darwin_settings_menu_action
 sc_darwin_window_show_settings_menu(SDL_Window *window, int32_t x, int32_t y,
                                     bool save_selected,
                                     bool figma_selected,
+                                    bool clip_available,
                                     const char *save_directory);
 
 #endif
@@ -1,5 +1,6 @@
 #include "sys/darwin/window.h"
 
+#include <SDL2/SDL_events.h>
 #include <SDL2/SDL_syswm.h>
 
 #import <AppKit/AppKit.h>
@@ -60,10 +61,46 @@ sc_darwin_window_configure_native_chrome(SDL_Window *window) {
     return true;
 }
 
+void *
+sc_darwin_window_observe_occlusion(SDL_Window *window, uint32_t event_type) {
+    NSWindow *ns_window = sc_darwin_window_get_native_window(window);
+    if (!ns_window) {
+        return NULL;
+    }
+
+    @autoreleasepool {
+        NSNotificationCenter *center = [NSNotificationCenter defaultCenter];
+        id observer = [center
+            addObserverForName:NSWindowDidChangeOcclusionStateNotification
+                        object:ns_window
+                         queue:nil
+                    usingBlock:^(NSNotification *notification) {
+            (void) notification;
+            bool visible =
+                ns_window.occlusionState & NSWindowOcclusionStateVisible;
+
+            SDL_Event event;
+            SDL_zero(event);
+            event.type = event_type;
+            event.user.code = !visible;
+            SDL_PushEvent(&event);
+        }];
+        return [observer retain];
+    }
+}
+
+void
+sc_darwin_window_unobserve_occlusion(void *observer) {
+    id obj = (id) observer;
+    [[NSNotificationCenter defaultCenter] removeObserver:obj];
+    [obj release];
+}
+
 enum sc_darwin_settings_menu_action
 sc_darwin_window_show_settings_menu(SDL_Window *window, int32_t x, int32_t y,
                                     bool save_selected,
                                     bool figma_selected,
+                                    bool clip_available,
                                     const char *save_directory) {
     NSWindow *ns_window = sc_darwin_window_get_native_window(window);
     if (!ns_window) {
@@ -79,6 +116,8 @@ sc_darwin_window_show_settings_menu(SDL_Window *window, int32_t x, int32_t y,
         ScSettingsMenuActionTarget *target =
             [[ScSettingsMenuActionTarget alloc] init];
         NSMenu *menu = [[NSMenu alloc] initWithTitle:@"Settings"];
+        // So that the clip item may be disabled explicitly
+        menu.autoenablesItems = NO;
 
         NSMenuItem *section_item =
             [[NSMenuItem alloc] initWithTitle:@"Screenshot destination"
@@ -135,6 +174,18 @@ sc_darwin_window_show_settings_menu(SDL_Window *window, int32_t x, int32_t y,
         [menu addItem:figma_item];
         [figma_item release];
 
+        [menu addItem:[NSMenuItem separatorItem]];
+
+        NSMenuItem *clip_item =
+            [[NSMenuItem alloc] initWithTitle:@"Send Clip to Figma Bridge"
+                                       action:@selector(onMenuItem:)
+                                keyEquivalent:@""];
+        clip_item.target = target;
+        clip_item.tag = SC_DARWIN_SETTINGS_MENU_ACTION_SEND_CLIP_TO_FIGMA_BRIDGE;
+        clip_item.enabled = clip_available ? YES : NO;
+        [menu addItem:clip_item];
+        [clip_item release];
+
         NSRect bounds = [content_view bounds];
         NSPoint location = NSMakePoint((CGFloat) x,
                                        bounds.size.height - (CGFloat) y);
@@ -152,6 +203,8 @@ sc_darwin_window_show_settings_menu(SDL_Window *window, int32_t x, int32_t y,
                 return SC_DARWIN_SETTINGS_MENU_ACTION_SAVE_TO_DIRECTORY;
             case SC_DARWIN_SETTINGS_MENU_ACTION_SEND_TO_FIGMA_BRIDGE:
                 return SC_DARWIN_SETTINGS_MENU_ACTION_SEND_TO_FIGMA_BRIDGE;
+            case SC_DARWIN_SETTINGS_MENU_ACTION_SEND_CLIP_TO_FIGMA_BRIDGE:
+                return SC_DARWIN_SETTINGS_MENU_ACTION_SEND_CLIP_TO_FIGMA_BRIDGE;
             default:
                 return SC_DARWIN_SETTINGS_MENU_ACTION_NONE;
         }
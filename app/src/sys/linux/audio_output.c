@@ -0,0 +1,282 @@
+#include "audio_output.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <alsa/asoundlib.h>
+
+#include "util/log.h"
+#include "util/thread.h"
+
+// Number of periods in the ALSA buffer
+#define SC_AUDIO_OUTPUT_PERIODS 2
+
+// Maximum duration of a wait for the device, to check the stop flag regularly
+#define SC_AUDIO_OUTPUT_WAIT_TIMEOUT_MS 100
+
+struct sc_audio_output {
+    snd_pcm_t *pcm;
+    // If false, the samples are written by snd_pcm_writei() from buf
+    bool mmap;
+    uint8_t *buf;
+
+    size_t sample_size;
+    snd_pcm_uframes_t period;
+    sc_audio_output_pull_fn pull;
+    void *userdata;
+
+    sc_thread thread;
+    bool started;
+    atomic_bool stopped;
+};
+
+// Recover from an underrun (or a suspend)
+static bool
+sc_audio_output_recover(struct sc_audio_output *output, int err) {
+    int r = snd_pcm_recover(output->pcm, err, 1);
+    if (r < 0) {
+        LOGE("Audio output error: %s", snd_strerror(r));
+        return false;
+    }
+
+    return true;
+}
+
+// Write one period, pulled directly into the device buffer if possible
+static bool
+sc_audio_output_write_period(struct sc_audio_output *output) {
+    if (!output->mmap) {
+        output->pull(output->userdata, output->buf, output->period);
+        snd_pcm_sframes_t w =
+            snd_pcm_writei(output->pcm, output->buf, output->period);
+        return w >= 0 || sc_audio_output_recover(output, w);
+    }
+
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset;
+    snd_pcm_uframes_t frames = output->period;
+    int r = snd_pcm_mmap_begin(output->pcm, &areas, &offset, &frames);
+    if (r < 0) {
+        return sc_audio_output_recover(output, r);
+    }
+
+    // The access is interleaved, so all the channels share the first area
+    uint8_t *data = (uint8_t *) areas[0].addr + areas[0].first / 8
+                  + offset * output->sample_size;
+    output->pull(output->userdata, data, frames);
+
+    snd_pcm_sframes_t c = snd_pcm_mmap_commit(output->pcm, offset, frames);
+    if (c < 0 || (snd_pcm_uframes_t) c != frames) {
+        return sc_audio_output_recover(output, c < 0 ? c : -EPIPE);
+    }
+
+    return true;
+}
+
+static int
+run_audio_output(void *data) {
+    struct sc_audio_output *output = data;
+
+    bool ok = sc_thread_set_priority(SC_THREAD_PRIORITY_TIME_CRITICAL);
+    if (!ok) {
+        ok = sc_thread_set_priority(SC_THREAD_PRIORITY_HIGH);
+        (void) ok; // We don't care if it worked, at least we tried
+    }
+
+    while (!atomic_load_explicit(&output->stopped, memory_order_relaxed)) {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(output->pcm);
+        if (avail < 0) {
+            if (!sc_audio_output_recover(output, avail)) {
+                break;
+            }
+            continue;
+        }
+
+        if ((snd_pcm_uframes_t) avail < output->period) {
+            // Wake up once a period can be written
+            int r = snd_pcm_wait(output->pcm, SC_AUDIO_OUTPUT_WAIT_TIMEOUT_MS);
+            if (r < 0 && !sc_audio_output_recover(output, r)) {
+                break;
+            }
+            continue;
+        }
+
+        if (!sc_audio_output_write_period(output)) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static bool
+sc_audio_output_configure(struct sc_audio_output *output, uint32_t sample_rate,
+                          uint8_t channels, uint32_t period) {
+    snd_pcm_t *pcm = output->pcm;
+
+    snd_pcm_hw_params_t *hw;
+    snd_pcm_hw_params_alloca(&hw);
+
+    int r = snd_pcm_hw_params_any(pcm, hw);
+    if (r < 0) {
+        goto error;
+    }
+
+    // Prefer writing directly into the device buffer
+    output->mmap = !snd_pcm_hw_params_set_access(pcm, hw,
+                                          SND_PCM_ACCESS_MMAP_INTERLEAVED);
+    if (!output->mmap) {
+        r = snd_pcm_hw_params_set_access(pcm, hw,
+                                         SND_PCM_ACCESS_RW_INTERLEAVED);
+        if (r < 0) {
+            goto error;
+        }
+    }
+
+    r = snd_pcm_hw_params_set_format(pcm, hw, SND_PCM_FORMAT_FLOAT);
+    if (r < 0) {
+        goto error;
+    }
+
+    r = snd_pcm_hw_params_set_channels(pcm, hw, channels);
+    if (r < 0) {
+        goto error;
+    }
+
+    r = snd_pcm_hw_params_set_rate(pcm, hw, sample_rate, 0);
+    if (r < 0) {
+        goto error;
+    }
+
+    // The smallest period supported by the device
+    snd_pcm_uframes_t min_period;
+    int dir = 0;
+    snd_pcm_uframes_t frames = period;
+    if (!snd_pcm_hw_params_get_period_size_min(hw, &min_period, &dir)
+            && frames < min_period) {
+        frames = min_period;
+    }
+
+    dir = 0;
+    r = snd_pcm_hw_params_set_period_size_near(pcm, hw, &frames, &dir);
+    if (r < 0) {
+        goto error;
+    }
+
+    snd_pcm_uframes_t buffer_size = frames * SC_AUDIO_OUTPUT_PERIODS;
+    r = snd_pcm_hw_params_set_buffer_size_near(pcm, hw, &buffer_size);
+    if (r < 0) {
+        goto error;
+    }
+
+    r = snd_pcm_hw_params(pcm, hw);
+    if (r < 0) {
+        goto error;
+    }
+
+    dir = 0;
+    snd_pcm_hw_params_get_period_size(hw, &frames, &dir);
+    output->period = frames;
+
+    snd_pcm_sw_params_t *sw;
+    snd_pcm_sw_params_alloca(&sw);
+
+    r = snd_pcm_sw_params_current(pcm, sw);
+    if (r < 0) {
+        goto error;
+    }
+
+    // Start as soon as a period is written, wake up for each period
+    r = snd_pcm_sw_params_set_start_threshold(pcm, sw, frames);
+    if (r < 0) {
+        goto error;
+    }
+
+    r = snd_pcm_sw_params_set_avail_min(pcm, sw, frames);
+    if (r < 0) {
+        goto error;
+    }
+
+    r = snd_pcm_sw_params(pcm, sw);
+    if (r < 0) {
+        goto error;
+    }
+
+    LOGD("Audio output period: %lu samples (%s)", (unsigned long) frames,
+         output->mmap ? "mmap" : "rw");
+    return true;
+
+error:
+    LOGE("Could not configure the audio output: %s", snd_strerror(r));
+    return false;
+}
+
+struct sc_audio_output *
+sc_audio_output_open(uint32_t sample_rate, uint8_t channels, uint32_t period,
+                     sc_audio_output_pull_fn pull, void *userdata) {
+    struct sc_audio_output *output = malloc(sizeof(*output));
+    if (!output) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    output->sample_size = channels * sizeof(float);
+    output->pull = pull;
+    output->userdata = userdata;
+    output->buf = NULL;
+    output->started = false;
+    atomic_init(&output->stopped, false);
+
+    int r = snd_pcm_open(&output->pcm, "default", SND_PCM_STREAM_PLAYBACK, 0);
+    if (r < 0) {
+        LOGE("Could not open the audio output device: %s", snd_strerror(r));
+        goto error_free_output;
+    }
+
+    if (!sc_audio_output_configure(output, sample_rate, channels, period)) {
+        goto error_close_pcm;
+    }
+
+    if (!output->mmap) {
+        output->buf = malloc(output->period * output->sample_size);
+        if (!output->buf) {
+            LOG_OOM();
+            goto error_close_pcm;
+        }
+    }
+
+    return output;
+
+error_close_pcm:
+    snd_pcm_close(output->pcm);
+error_free_output:
+    free(output);
+
+    return NULL;
+}
+
+bool
+sc_audio_output_start(struct sc_audio_output *output) {
+    bool ok = sc_thread_create(&output->thread, run_audio_output,
+                               "scrcpy-aout", output);
+    if (!ok) {
+        LOGE("Could not start audio output thread");
+        return false;
+    }
+
+    output->started = true;
+    return true;
+}
+
+void
+sc_audio_output_close(struct sc_audio_output *output) {
+    if (output->started) {
+        atomic_store_explicit(&output->stopped, true, memory_order_relaxed);
+        sc_thread_join(&output->thread, NULL);
+    }
+
+    snd_pcm_drop(output->pcm);
+    snd_pcm_close(output->pcm);
+    free(output->buf);
+    free(output);
+}
@@ -94,3 +94,22 @@ sc_file_is_regular(const char *path) {
     return S_ISREG(path_stat.st_mode);
 }
 
+bool
+sc_file_get_size(const char *path, uint64_t *size) {
+    struct stat path_stat;
+
+    if (stat(path, &path_stat)) {
+        return false;
+    }
+    *size = path_stat.st_size;
+    return true;
+}
+
+bool
+sc_file_remove(const char *path) {
+    if (unlink(path)) {
+        perror("unlink");
+        return false;
+    }
+    return true;
+}
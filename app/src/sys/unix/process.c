@@ -9,6 +9,12 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#if defined(__linux__)
+# include <poll.h>
+# include <sys/syscall.h>
+#elif defined(__APPLE__)
+# include <sys/event.h>
+#endif
 
 #include "util/log.h"
 
@@ -223,6 +229,201 @@ sc_process_close(pid_t pid) {
     sc_process_wait(pid, true); // ignore exit code
 }
 
+#if defined(__linux__) && defined(SYS_pidfd_open)
+# define SC_PROCESS_WAITSET_PIDFD
+
+static int
+sc_pidfd_open(pid_t pid) {
+    return syscall(SYS_pidfd_open, pid, 0);
+}
+#elif defined(__APPLE__)
+# define SC_PROCESS_WAITSET_KQUEUE
+#endif
+
+#if defined(SC_PROCESS_WAITSET_PIDFD) || defined(SC_PROCESS_WAITSET_KQUEUE)
+static bool
+sc_process_waitset_set_flags(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    return flags != -1
+        && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1
+        && fcntl(fd, F_SETFD, FD_CLOEXEC) != -1;
+}
+
+static void
+sc_process_waitset_drain(struct sc_process_waitset *ws) {
+    char buf[16];
+    while (read(ws->wakeup_pipe[0], buf, sizeof(buf)) > 0) {
+        // discard the pending wakeups
+    }
+}
+#endif
+
+bool
+sc_process_waitset_init(struct sc_process_waitset *ws) {
+#if defined(SC_PROCESS_WAITSET_PIDFD) || defined(SC_PROCESS_WAITSET_KQUEUE)
+# ifdef SC_PROCESS_WAITSET_PIDFD
+    // pidfd_open() requires Linux 5.3
+    int fd = sc_pidfd_open(getpid());
+    if (fd == -1) {
+        return false;
+    }
+    close(fd);
+# endif
+
+    if (pipe(ws->wakeup_pipe)) {
+        perror("pipe");
+        return false;
+    }
+
+    if (!sc_process_waitset_set_flags(ws->wakeup_pipe[0])
+            || !sc_process_waitset_set_flags(ws->wakeup_pipe[1])) {
+        perror("fcntl");
+        close(ws->wakeup_pipe[0]);
+        close(ws->wakeup_pipe[1]);
+        return false;
+    }
+
+    return true;
+#else
+    (void) ws;
+    return false;
+#endif
+}
+
+void
+sc_process_waitset_destroy(struct sc_process_waitset *ws) {
+    close(ws->wakeup_pipe[0]);
+    close(ws->wakeup_pipe[1]);
+}
+
+#ifdef SC_PROCESS_WAITSET_PIDFD
+int
+sc_process_waitset_wait(struct sc_process_waitset *ws, const pid_t *pids,
+                        unsigned count) {
+    assert(count <= SC_PROCESS_WAITSET_MAX);
+
+    struct pollfd fds[SC_PROCESS_WAITSET_MAX + 1];
+    int result = SC_PROCESS_WAITSET_ERROR;
+
+    unsigned opened = 0;
+    for (; opened < count; ++opened) {
+        int fd = sc_pidfd_open(pids[opened]);
+        if (fd == -1) {
+            // ESRCH: the process does not exist anymore (not a child which
+            // has not been waited yet, so this should not happen)
+            result = errno == ESRCH ? (int) opened : SC_PROCESS_WAITSET_ERROR;
+            goto end;
+        }
+        fds[opened].fd = fd;
+        fds[opened].events = POLLIN;
+    }
+
+    fds[count].fd = ws->wakeup_pipe[0];
+    fds[count].events = POLLIN;
+
+    int r;
+    do {
+        r = poll(fds, count + 1, -1);
+    } while (r == -1 && errno == EINTR);
+
+    if (r == -1) {
+        perror("poll");
+        goto end;
+    }
+
+    for (unsigned i = 0; i < count; ++i) {
+        if (fds[i].revents) {
+            result = i;
+            goto end;
+        }
+    }
+
+    assert(fds[count].revents);
+    sc_process_waitset_drain(ws);
+    result = SC_PROCESS_WAITSET_WAKEUP;
+
+end:
+    for (unsigned i = 0; i < opened; ++i) {
+        close(fds[i].fd);
+    }
+
+    return result;
+}
+#elif defined(SC_PROCESS_WAITSET_KQUEUE)
+int
+sc_process_waitset_wait(struct sc_process_waitset *ws, const pid_t *pids,
+                        unsigned count) {
+    assert(count <= SC_PROCESS_WAITSET_MAX);
+
+    int kq = kqueue();
+    if (kq == -1) {
+        perror("kqueue");
+        return SC_PROCESS_WAITSET_ERROR;
+    }
+
+    int result = SC_PROCESS_WAITSET_ERROR;
+
+    struct kevent change;
+    EV_SET(&change, ws->wakeup_pipe[0], EVFILT_READ, EV_ADD, 0, 0, NULL);
+    if (kevent(kq, &change, 1, NULL, 0, NULL) == -1) {
+        perror("kevent");
+        goto end;
+    }
+
+    for (unsigned i = 0; i < count; ++i) {
+        EV_SET(&change, pids[i], EVFILT_PROC, EV_ADD | EV_ONESHOT, NOTE_EXIT,
+               0, (void *) (uintptr_t) i);
+        if (kevent(kq, &change, 1, NULL, 0, NULL) == -1) {
+            // ESRCH: the process has already terminated
+            result = errno == ESRCH ? (int) i : SC_PROCESS_WAITSET_ERROR;
+            goto end;
+        }
+    }
+
+    struct kevent event;
+    int r;
+    do {
+        r = kevent(kq, NULL, 0, &event, 1, NULL);
+    } while (r == -1 && errno == EINTR);
+
+    if (r != 1) {
+        perror("kevent");
+        goto end;
+    }
+
+    if (event.filter == EVFILT_PROC) {
+        result = (int) (uintptr_t) event.udata;
+    } else {
+        assert(event.filter == EVFILT_READ);
+        sc_process_waitset_drain(ws);
+        result = SC_PROCESS_WAITSET_WAKEUP;
+    }
+
+end:
+    close(kq);
+    return result;
+}
+#else
+int
+sc_process_waitset_wait(struct sc_process_waitset *ws, const pid_t *pids,
+                        unsigned count) {
+    (void) ws;
+    (void) pids;
+    (void) count;
+    // sc_process_waitset_init() always fails
+    assert(!"unsupported");
+    return SC_PROCESS_WAITSET_ERROR;
+}
+#endif
+
+void
+sc_process_waitset_wakeup(struct sc_process_waitset *ws) {
+    char c = 0;
+    if (write(ws->wakeup_pipe[1], &c, 1) == -1 && errno != EAGAIN) {
+        perror("write");
+    }
+}
+
 ssize_t
 sc_pipe_read(int pipe, char *data, size_t len) {
     return read(pipe, data, len);
@@ -2,6 +2,7 @@
 
 #include <windows.h>
 
+#include <io.h>
 #include <sys/stat.h>
 
 #include "util/log.h"
@@ -41,3 +42,39 @@ sc_file_is_regular(const char *path) {
     return S_ISREG(path_stat.st_mode);
 }
 
+bool
+sc_file_get_size(const char *path, uint64_t *size) {
+    wchar_t *wide_path = sc_str_to_wchars(path);
+    if (!wide_path) {
+        LOG_OOM();
+        return false;
+    }
+
+    struct _stat64 path_stat;
+    int r = _wstat64(wide_path, &path_stat);
+    free(wide_path);
+
+    if (r) {
+        return false;
+    }
+    *size = path_stat.st_size;
+    return true;
+}
+
+bool
+sc_file_remove(const char *path) {
+    wchar_t *wide_path = sc_str_to_wchars(path);
+    if (!wide_path) {
+        LOG_OOM();
+        return false;
+    }
+
+    int r = _wunlink(wide_path);
+    free(wide_path);
+
+    if (r) {
+        perror("unlink");
+        return false;
+    }
+    return true;
+}
@@ -3,6 +3,7 @@
 #include <processthreadsapi.h>
 
 #include <assert.h>
+#include <string.h>
 
 #include "util/log.h"
 #include "util/str.h"
@@ -243,6 +244,58 @@ sc_process_close(HANDLE handle) {
     (void) closed;
 }
 
+bool
+sc_process_waitset_init(struct sc_process_waitset *ws) {
+    // auto-reset
+    ws->wakeup_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (!ws->wakeup_event) {
+        LOGE("Could not create event");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_process_waitset_destroy(struct sc_process_waitset *ws) {
+    CloseHandle(ws->wakeup_event);
+}
+
+int
+sc_process_waitset_wait(struct sc_process_waitset *ws, const HANDLE *handles,
+                        unsigned count) {
+    static_assert(SC_PROCESS_WAITSET_MAX < MAXIMUM_WAIT_OBJECTS,
+                  "Too many objects to wait");
+    assert(count <= SC_PROCESS_WAITSET_MAX);
+
+    HANDLE objects[SC_PROCESS_WAITSET_MAX + 1];
+    memcpy(objects, handles, count * sizeof(*handles));
+    objects[count] = ws->wakeup_event;
+
+    DWORD r = WaitForMultipleObjects(count + 1, objects, FALSE, INFINITE);
+    if (r < WAIT_OBJECT_0 + count) {
+        return r - WAIT_OBJECT_0;
+    }
+    if (r == WAIT_OBJECT_0 + count) {
+        return SC_PROCESS_WAITSET_WAKEUP;
+    }
+
+    // Find the handle which could not be waited, to not fail forever
+    for (unsigned i = 0; i < count; ++i) {
+        DWORD rs = WaitForSingleObject(handles[i], 0);
+        if (rs == WAIT_OBJECT_0 || rs == WAIT_FAILED) {
+            return i;
+        }
+    }
+
+    return SC_PROCESS_WAITSET_ERROR;
+}
+
+void
+sc_process_waitset_wakeup(struct sc_process_waitset *ws) {
+    SetEvent(ws->wakeup_event);
+}
+
 ssize_t
 sc_pipe_read(HANDLE pipe, char *data, size_t len) {
     DWORD r;
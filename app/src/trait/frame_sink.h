@@ -4,8 +4,11 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <libavcodec/avcodec.h>
 
+#include "shared_frame.h"
+
 /**
  * Frame sink trait.
  *
@@ -19,7 +22,38 @@ struct sc_frame_sink_ops {
     /* The codec context is valid until the sink is closed */
     bool (*open)(struct sc_frame_sink *sink, const AVCodecContext *ctx);
     void (*close)(struct sc_frame_sink *sink);
+    /* Video frames are either YUV420P or NV12 (from hardware decoding) */
     bool (*push)(struct sc_frame_sink *sink, const AVFrame *frame);
+
+    /*
+     * Receive the frame as a shared frame, to keep it without creating a new
+     * AVFrame reference (the sink must acquire its own reference)
+     *
+     * This function is optional. If it is implemented, it is called instead
+     * of push() (which may then be NULL).
+     */
+    bool (*push_shared)(struct sc_frame_sink *sink,
+                        struct sc_shared_frame *frame);
+
+    /*
+     * Return the number of frames dropped by the sink since it last consumed
+     * a frame, i.e. how far (in frames) its consumer is behind
+     *
+     * This function is optional. Sinks which do not implement it need every
+     * frame (they are never considered behind).
+     */
+    unsigned (*get_backlog)(struct sc_frame_sink *sink);
+
+    /*
+     * Notify that the device sent a frame identical to the last one pushed
+     * (with a static screen), with its timestamp
+     *
+     * The frame itself is not pushed: the sink keeps the last one.
+     *
+     * This function is optional. Sinks which do not implement it just do not
+     * receive these frames.
+     */
+    void (*push_repeat)(struct sc_frame_sink *sink, int64_t pts);
 };
 
 #endif
@@ -1,6 +1,7 @@
 #include "frame_source.h"
 
 #include <assert.h>
+#include <limits.h>
 
 void
 sc_frame_source_init(struct sc_frame_source *source) {
@@ -13,6 +14,7 @@ sc_frame_source_add_sink(struct sc_frame_source *source,
     assert(source->sink_count < SC_FRAME_SOURCE_MAX_SINKS);
     assert(sink);
     assert(sink->ops);
+    assert(sink->ops->push || sink->ops->push_shared);
     source->sinks[source->sink_count++] = sink;
 }
 
@@ -50,12 +52,59 @@ bool
 sc_frame_source_sinks_push(struct sc_frame_source *source,
                             const AVFrame *frame) {
     assert(source->sink_count);
+
+    // Wrapped lazily, only once for all the sinks accepting shared frames
+    struct sc_shared_frame *shared = NULL;
+
+    bool ok = true;
+    for (unsigned i = 0; ok && i < source->sink_count; ++i) {
+        struct sc_frame_sink *sink = source->sinks[i];
+        if (sink->ops->push_shared) {
+            if (!shared) {
+                shared = sc_shared_frame_new(frame);
+                if (!shared) {
+                    return false;
+                }
+            }
+            ok = sink->ops->push_shared(sink, shared);
+        } else {
+            ok = sink->ops->push(sink, frame);
+        }
+    }
+
+    if (shared) {
+        sc_shared_frame_release(shared);
+    }
+
+    return ok;
+}
+
+void
+sc_frame_source_sinks_push_repeat(struct sc_frame_source *source, int64_t pts) {
+    assert(source->sink_count);
     for (unsigned i = 0; i < source->sink_count; ++i) {
         struct sc_frame_sink *sink = source->sinks[i];
-        if (!sink->ops->push(sink, frame)) {
-            return false;
+        if (sink->ops->push_repeat) {
+            sink->ops->push_repeat(sink, pts);
         }
     }
+}
 
-    return true;
+unsigned
+sc_frame_source_sinks_get_backlog(struct sc_frame_source *source) {
+    assert(source->sink_count);
+    unsigned backlog = UINT_MAX;
+    for (unsigned i = 0; i < source->sink_count; ++i) {
+        struct sc_frame_sink *sink = source->sinks[i];
+        if (!sink->ops->get_backlog) {
+            // This sink needs every frame
+            return 0;
+        }
+        unsigned sink_backlog = sink->ops->get_backlog(sink);
+        if (sink_backlog < backlog) {
+            backlog = sink_backlog;
+        }
+    }
+
+    return backlog;
 }
@@ -7,7 +7,7 @@
 
 #include "trait/frame_sink.h"
 
-#define SC_FRAME_SOURCE_MAX_SINKS 2
+#define SC_FRAME_SOURCE_MAX_SINKS 6
 
 /**
  * Frame source trait
@@ -37,4 +37,13 @@ bool
 sc_frame_source_sinks_push(struct sc_frame_source *source,
                            const AVFrame *frame);
 
+// Notify the sinks of a frame identical to the last one pushed (see
+// sc_frame_sink_ops)
+void
+sc_frame_source_sinks_push_repeat(struct sc_frame_source *source, int64_t pts);
+
+// Return the minimal backlog of all the sinks (see sc_frame_sink_ops)
+unsigned
+sc_frame_source_sinks_get_backlog(struct sc_frame_source *source);
+
 #endif
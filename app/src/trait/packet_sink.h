@@ -6,6 +6,10 @@
 #include <stdbool.h>
 #include <libavcodec/avcodec.h>
 
+// Set in AVPacket.flags (beyond the FFmpeg flags) on a frame produced by the
+// device encoder to repeat the last frame while the screen did not change
+#define SC_AV_PKT_FLAG_REPEAT (1 << 30)
+
 /**
  * Packet sink trait.
  *
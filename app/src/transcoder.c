@@ -0,0 +1,666 @@
+#include "transcoder.h"
+
+#include <assert.h>
+#include <string.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+
+#include "util/log.h"
+
+/** Downcast frame_sink to sc_transcoder */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_transcoder, frame_sink)
+
+// Frames waiting to be encoded, beyond which the oldest frames are dropped
+#define SC_TRANSCODER_MAX_QUEUED_FRAMES 64
+// Keyframe interval (in frames), a trade-off between size and seeking
+#define SC_TRANSCODER_GOP_SIZE 300
+#define SC_TRANSCODER_DEFAULT_BIT_RATE 4000000
+
+// Same timestamps as the demuxer packets
+static const AVRational SC_TRANSCODER_TIME_BASE = {1, 1000000};
+
+// Hardware encoders, in order of preference
+static const char *const sc_transcoder_h264_encoders[] = {
+#if defined(__APPLE__)
+    "h264_videotoolbox",
+#elif defined(_WIN32)
+    "h264_nvenc",
+    "h264_qsv",
+    "h264_amf",
+    "h264_mf",
+#else
+    "h264_vaapi",
+    "h264_nvenc",
+    "h264_qsv",
+#endif
+    NULL,
+};
+
+static const char *const sc_transcoder_h265_encoders[] = {
+#if defined(__APPLE__)
+    "hevc_videotoolbox",
+#elif defined(_WIN32)
+    "hevc_nvenc",
+    "hevc_qsv",
+    "hevc_amf",
+    "hevc_mf",
+#else
+    "hevc_vaapi",
+    "hevc_nvenc",
+    "hevc_qsv",
+#endif
+    NULL,
+};
+
+static const enum AVPixelFormat *
+sc_transcoder_get_pix_fmts(const AVCodec *codec) {
+#ifdef SCRCPY_LAVC_HAS_GET_SUPPORTED_CONFIG
+    const void *fmts;
+    int ret = avcodec_get_supported_config(NULL, codec,
+                                           AV_CODEC_CONFIG_PIX_FORMAT, 0,
+                                           &fmts, NULL);
+    return ret < 0 ? NULL : fmts;
+#else
+    return codec->pix_fmts;
+#endif
+}
+
+static bool
+sc_transcoder_has_pix_fmt(const enum AVPixelFormat *fmts,
+                          enum AVPixelFormat fmt) {
+    for (; *fmts != AV_PIX_FMT_NONE; ++fmts) {
+        if (*fmts == fmt) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Return the input format of the encoder in system memory (frames in another
+// format are converted), or AV_PIX_FMT_NONE if the encoder only accepts
+// hardware frames
+static enum AVPixelFormat
+sc_transcoder_select_sw_format(const AVCodec *codec, enum AVPixelFormat input) {
+    const enum AVPixelFormat *fmts = sc_transcoder_get_pix_fmts(codec);
+    if (!fmts) {
+        // Unknown
+        return AV_PIX_FMT_YUV420P;
+    }
+
+    // Prefer the format of the decoded frames, to avoid a conversion
+    const enum AVPixelFormat candidates[] = {
+        input, AV_PIX_FMT_NV12, AV_PIX_FMT_YUV420P,
+    };
+    for (size_t i = 0; i < ARRAY_LEN(candidates); ++i) {
+        if (sc_transcoder_has_pix_fmt(fmts, candidates[i])) {
+            return candidates[i];
+        }
+    }
+
+    return AV_PIX_FMT_NONE;
+}
+
+// Configure the encoder to receive frames in hardware memory (e.g. VAAPI),
+// uploaded from NV12 frames
+static bool
+sc_transcoder_init_hw_frames(AVCodecContext *ctx, const AVCodec *codec) {
+    const AVCodecHWConfig *config = NULL;
+    for (int i = 0;; ++i) {
+        config = avcodec_get_hw_config(codec, i);
+        if (!config) {
+            return false;
+        }
+        if (config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_FRAMES_CTX) {
+            break;
+        }
+    }
+
+    const char *type_name = av_hwdevice_get_type_name(config->device_type);
+
+    AVBufferRef *device = NULL;
+    int ret = av_hwdevice_ctx_create(&device, config->device_type, NULL, NULL,
+                                     0);
+    if (ret < 0) {
+        LOGW("Transcoder: could not create %s device: %d", type_name, ret);
+        return false;
+    }
+
+    AVBufferRef *frames = av_hwframe_ctx_alloc(device);
+    av_buffer_unref(&device); // referenced by the frames context
+    if (!frames) {
+        LOG_OOM();
+        return false;
+    }
+
+    AVHWFramesContext *frames_ctx = (AVHWFramesContext *) frames->data;
+    frames_ctx->format = config->pix_fmt;
+    frames_ctx->sw_format = AV_PIX_FMT_NV12;
+    frames_ctx->width = ctx->width;
+    frames_ctx->height = ctx->height;
+    frames_ctx->initial_pool_size = 4;
+
+    ret = av_hwframe_ctx_init(frames);
+    if (ret < 0) {
+        LOGW("Transcoder: could not initialize %s frames: %d", type_name, ret);
+        av_buffer_unref(&frames);
+        return false;
+    }
+
+    ctx->pix_fmt = config->pix_fmt;
+    ctx->hw_frames_ctx = frames; // the context takes ownership
+    return true;
+}
+
+static AVCodecContext *
+sc_transcoder_open_codec(struct sc_transcoder *transcoder,
+                         const AVCodec *codec, const AVFrame *frame) {
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    if (!ctx) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    ctx->width = frame->width;
+    ctx->height = frame->height;
+    ctx->time_base = SC_TRANSCODER_TIME_BASE;
+    // The frame rate is variable, this is only a hint for the rate control
+    ctx->framerate = (AVRational) {60, 1};
+    ctx->bit_rate = transcoder->bit_rate ? transcoder->bit_rate
+                                         : SC_TRANSCODER_DEFAULT_BIT_RATE;
+    ctx->gop_size = SC_TRANSCODER_GOP_SIZE;
+    // The recorder expects packets in presentation order (dts == pts)
+    ctx->max_b_frames = 0;
+    // Provide the parameter sets in the extradata (for the config packet)
+    ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    ctx->color_range = frame->color_range;
+    ctx->colorspace = frame->colorspace;
+    ctx->color_primaries = frame->color_primaries;
+    ctx->color_trc = frame->color_trc;
+
+    enum AVPixelFormat sw_format =
+        sc_transcoder_select_sw_format(codec, frame->format);
+    if (sw_format != AV_PIX_FMT_NONE) {
+        ctx->pix_fmt = sw_format;
+    } else if (!sc_transcoder_init_hw_frames(ctx, codec)) {
+        avcodec_free_context(&ctx);
+        return NULL;
+    }
+
+    if (avcodec_open2(ctx, codec, NULL) < 0) {
+        LOGW("Transcoder: could not open %s encoder", codec->name);
+        avcodec_free_context(&ctx);
+        return NULL;
+    }
+
+    if (!ctx->extradata_size) {
+        LOGW("Transcoder: %s encoder did not provide the parameter sets",
+             codec->name);
+        avcodec_free_context(&ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+static bool
+sc_transcoder_open_encoder(struct sc_transcoder *transcoder,
+                           const AVFrame *frame) {
+    assert(!transcoder->ctx);
+
+    const char *const *names = transcoder->codec == SC_CODEC_H264
+                             ? sc_transcoder_h264_encoders
+                             : sc_transcoder_h265_encoders;
+
+    for (; *names; ++names) {
+        const AVCodec *codec = avcodec_find_encoder_by_name(*names);
+        if (!codec) {
+            continue;
+        }
+
+        AVCodecContext *ctx =
+            sc_transcoder_open_codec(transcoder, codec, frame);
+        if (ctx) {
+            LOGI("Transcoder: encoding %dx%d with %s", frame->width,
+                 frame->height, codec->name);
+            transcoder->ctx = ctx;
+            return true;
+        }
+    }
+
+    LOGE("Transcoder: no hardware %s encoder available",
+         transcoder->codec == SC_CODEC_H264 ? "H.264" : "H.265");
+    return false;
+}
+
+static bool
+sc_transcoder_push_config(struct sc_transcoder *transcoder) {
+    AVCodecContext *ctx = transcoder->ctx;
+    AVPacket *packet = transcoder->packet;
+
+    if (av_new_packet(packet, ctx->extradata_size) < 0) {
+        LOG_OOM();
+        return false;
+    }
+
+    memcpy(packet->data, ctx->extradata, ctx->extradata_size);
+    packet->pts = AV_NOPTS_VALUE;
+    packet->dts = AV_NOPTS_VALUE;
+
+    bool ok = sc_packet_source_sinks_push(&transcoder->packet_source, packet);
+    av_packet_unref(packet);
+    return ok;
+}
+
+// Prepend the parameter sets to the packet, so that the stream can be decoded
+// after a resolution change (like the packets merged by the demuxer)
+static bool
+sc_transcoder_prepend_config(struct sc_transcoder *transcoder,
+                             AVPacket *packet) {
+    AVCodecContext *ctx = transcoder->ctx;
+
+    AVPacket *merged = av_packet_alloc();
+    if (!merged) {
+        LOG_OOM();
+        return false;
+    }
+
+    size_t size = ctx->extradata_size + packet->size;
+    if (av_new_packet(merged, size) < 0) {
+        LOG_OOM();
+        av_packet_free(&merged);
+        return false;
+    }
+
+    memcpy(merged->data, ctx->extradata, ctx->extradata_size);
+    memcpy(merged->data + ctx->extradata_size, packet->data, packet->size);
+    av_packet_copy_props(merged, packet);
+
+    av_packet_unref(packet);
+    av_packet_move_ref(packet, merged);
+    av_packet_free(&merged);
+    return true;
+}
+
+static bool
+sc_transcoder_receive_packets(struct sc_transcoder *transcoder) {
+    AVPacket *packet = transcoder->packet;
+
+    for (;;) {
+        int ret = avcodec_receive_packet(transcoder->ctx, packet);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            return true;
+        }
+        if (ret < 0) {
+            LOGE("Transcoder: could not encode frame: %d", ret);
+            return false;
+        }
+
+        // Packets are in presentation order
+        packet->dts = packet->pts;
+
+        bool ok = true;
+        if (!transcoder->sinks_open) {
+            // The sinks are opened once, with the parameters of the first
+            // encoder
+            ok = avcodec_parameters_to_context(transcoder->out_ctx,
+                                               transcoder->out_par) >= 0;
+            if (!ok) {
+                LOG_OOM();
+            } else {
+                ok = sc_packet_source_sinks_open(&transcoder->packet_source,
+                                                 transcoder->out_ctx);
+            }
+            if (ok) {
+                transcoder->sinks_open = true;
+                ok = sc_transcoder_push_config(transcoder);
+            }
+        } else if (transcoder->merge_config) {
+            ok = sc_transcoder_prepend_config(transcoder, packet);
+        }
+        transcoder->merge_config = false;
+
+        if (ok) {
+            ok = sc_packet_source_sinks_push(&transcoder->packet_source,
+                                             packet);
+        }
+        av_packet_unref(packet);
+        if (!ok) {
+            return false;
+        }
+    }
+}
+
+// Encode the remaining frames, and close the encoder
+static bool
+sc_transcoder_close_encoder(struct sc_transcoder *transcoder) {
+    assert(transcoder->ctx);
+
+    bool ok = avcodec_send_frame(transcoder->ctx, NULL) >= 0
+           && sc_transcoder_receive_packets(transcoder);
+
+    avcodec_free_context(&transcoder->ctx);
+    return ok;
+}
+
+// Return the frame in the encoder input format (in system or hardware memory)
+static AVFrame *
+sc_transcoder_prepare_frame(struct sc_transcoder *transcoder,
+                            const AVFrame *frame) {
+    AVCodecContext *ctx = transcoder->ctx;
+    bool hw = ctx->hw_frames_ctx;
+    enum AVPixelFormat sw_format = hw ? AV_PIX_FMT_NV12 : ctx->pix_fmt;
+
+    const AVFrame *src = frame;
+    if (frame->format != sw_format) {
+        AVFrame *sw_frame = transcoder->sw_frame;
+        if (sw_frame->format != sw_format || sw_frame->width != frame->width
+                || sw_frame->height != frame->height) {
+            av_frame_unref(sw_frame);
+            sw_frame->format = sw_format;
+            sw_frame->width = frame->width;
+            sw_frame->height = frame->height;
+            if (av_frame_get_buffer(sw_frame, 0) < 0) {
+                LOG_OOM();
+                av_frame_unref(sw_frame);
+                return NULL;
+            }
+        } else if (av_frame_make_writable(sw_frame) < 0) {
+            // The encoder may still reference the previous frame
+            LOG_OOM();
+            return NULL;
+        }
+
+        transcoder->sws_ctx =
+            sws_getCachedContext(transcoder->sws_ctx, frame->width,
+                                 frame->height, frame->format, frame->width,
+                                 frame->height, sw_format, SWS_POINT, NULL,
+                                 NULL, NULL);
+        if (!transcoder->sws_ctx) {
+            LOGE("Transcoder: could not convert %s frame",
+                 av_get_pix_fmt_name(frame->format));
+            return NULL;
+        }
+
+        sws_scale(transcoder->sws_ctx, (const uint8_t *const *) frame->data,
+                  frame->linesize, 0, frame->height, sw_frame->data,
+                  sw_frame->linesize);
+        av_frame_copy_props(sw_frame, frame);
+        src = sw_frame;
+    }
+
+    AVFrame *enc_frame = transcoder->enc_frame;
+    if (hw) {
+        int ret = av_hwframe_get_buffer(ctx->hw_frames_ctx, enc_frame, 0);
+        if (ret < 0) {
+            LOGE("Transcoder: could not allocate hardware frame: %d", ret);
+            return NULL;
+        }
+        ret = av_hwframe_transfer_data(enc_frame, src, 0);
+        if (ret < 0) {
+            LOGE("Transcoder: could not upload frame: %d", ret);
+            av_frame_unref(enc_frame);
+            return NULL;
+        }
+        av_frame_copy_props(enc_frame, src);
+    } else if (av_frame_ref(enc_frame, src) < 0) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    // Let the encoder choose the keyframes
+    enc_frame->pict_type = AV_PICTURE_TYPE_NONE;
+    return enc_frame;
+}
+
+static bool
+sc_transcoder_encode(struct sc_transcoder *transcoder, const AVFrame *frame) {
+    AVCodecContext *ctx = transcoder->ctx;
+    if (ctx && (frame->width != ctx->width || frame->height != ctx->height)) {
+        // The resolution changed (e.g. on device rotation): start a new
+        // encoder
+        LOGD("Transcoder: new size %dx%d", frame->width, frame->height);
+        if (!sc_transcoder_close_encoder(transcoder)) {
+            return false;
+        }
+        transcoder->merge_config = true;
+        ctx = NULL;
+    }
+
+    if (!ctx) {
+        if (!sc_transcoder_open_encoder(transcoder, frame)) {
+            return false;
+        }
+        ctx = transcoder->ctx;
+
+        if (!transcoder->sinks_open) {
+            // Keep the parameters of the first encoder for the sinks, which
+            // may use the codec context until they are closed
+            if (avcodec_parameters_from_context(transcoder->out_par,
+                                                ctx) < 0) {
+                LOG_OOM();
+                return false;
+            }
+        }
+    }
+
+    AVFrame *enc_frame = sc_transcoder_prepare_frame(transcoder, frame);
+    if (!enc_frame) {
+        return false;
+    }
+
+    int ret = avcodec_send_frame(ctx, enc_frame);
+    av_frame_unref(enc_frame);
+    if (ret < 0) {
+        LOGE("Transcoder: could not send frame: %d", ret);
+        return false;
+    }
+
+    return sc_transcoder_receive_packets(transcoder);
+}
+
+static int
+run_transcoder(void *data) {
+    struct sc_transcoder *transcoder = data;
+
+    for (;;) {
+        sc_mutex_lock(&transcoder->mutex);
+
+        while (!transcoder->stopped
+                && sc_vecdeque_is_empty(&transcoder->queue)) {
+            sc_cond_wait(&transcoder->cond, &transcoder->mutex);
+        }
+
+        if (sc_vecdeque_is_empty(&transcoder->queue)) {
+            // Stopped, and all the frames have been encoded
+            assert(transcoder->stopped);
+            sc_mutex_unlock(&transcoder->mutex);
+            break;
+        }
+
+        struct sc_shared_frame *shared = sc_vecdeque_pop(&transcoder->queue);
+        sc_mutex_unlock(&transcoder->mutex);
+
+        bool ok = sc_transcoder_encode(transcoder, shared->frame);
+        sc_shared_frame_release(shared);
+        if (!ok) {
+            LOGE("Transcoder: stopped, the recording is incomplete");
+            break;
+        }
+    }
+
+    if (transcoder->ctx) {
+        sc_transcoder_close_encoder(transcoder);
+    }
+
+    if (transcoder->sinks_open) {
+        sc_packet_source_sinks_close(&transcoder->packet_source);
+    }
+
+    LOGD("Transcoder thread ended");
+
+    return 0;
+}
+
+static void
+sc_transcoder_clear_queue(struct sc_transcoder *transcoder) {
+    while (!sc_vecdeque_is_empty(&transcoder->queue)) {
+        struct sc_shared_frame *shared = sc_vecdeque_pop(&transcoder->queue);
+        sc_shared_frame_release(shared);
+    }
+}
+
+static bool
+sc_transcoder_frame_sink_open(struct sc_frame_sink *sink,
+                              const AVCodecContext *ctx) {
+    struct sc_transcoder *transcoder = DOWNCAST(sink);
+    (void) ctx;
+
+    bool ok = sc_mutex_init(&transcoder->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&transcoder->cond);
+    if (!ok) {
+        goto error_mutex_destroy;
+    }
+
+    transcoder->packet = av_packet_alloc();
+    if (!transcoder->packet) {
+        LOG_OOM();
+        goto error_cond_destroy;
+    }
+
+    transcoder->enc_frame = av_frame_alloc();
+    if (!transcoder->enc_frame) {
+        LOG_OOM();
+        goto error_free_packet;
+    }
+
+    transcoder->sw_frame = av_frame_alloc();
+    if (!transcoder->sw_frame) {
+        LOG_OOM();
+        goto error_free_enc_frame;
+    }
+
+    transcoder->out_par = avcodec_parameters_alloc();
+    if (!transcoder->out_par) {
+        LOG_OOM();
+        goto error_free_sw_frame;
+    }
+
+    transcoder->out_ctx = avcodec_alloc_context3(NULL);
+    if (!transcoder->out_ctx) {
+        LOG_OOM();
+        goto error_free_out_par;
+    }
+
+    sc_vecdeque_init(&transcoder->queue);
+    transcoder->ctx = NULL;
+    transcoder->sws_ctx = NULL;
+    transcoder->stopped = false;
+    transcoder->sinks_open = false;
+    transcoder->merge_config = false;
+
+    LOGD("Starting transcoder thread");
+    ok = sc_thread_create(&transcoder->thread, run_transcoder,
+                          "scrcpy-transcode", transcoder);
+    if (!ok) {
+        LOGE("Could not start transcoder thread");
+        goto error_free_out_ctx;
+    }
+
+    return true;
+
+error_free_out_ctx:
+    avcodec_free_context(&transcoder->out_ctx);
+error_free_out_par:
+    avcodec_parameters_free(&transcoder->out_par);
+error_free_sw_frame:
+    av_frame_free(&transcoder->sw_frame);
+error_free_enc_frame:
+    av_frame_free(&transcoder->enc_frame);
+error_free_packet:
+    av_packet_free(&transcoder->packet);
+error_cond_destroy:
+    sc_cond_destroy(&transcoder->cond);
+error_mutex_destroy:
+    sc_mutex_destroy(&transcoder->mutex);
+
+    return false;
+}
+
+static void
+sc_transcoder_frame_sink_close(struct sc_frame_sink *sink) {
+    struct sc_transcoder *transcoder = DOWNCAST(sink);
+
+    // The frames already queued are still encoded
+    sc_mutex_lock(&transcoder->mutex);
+    transcoder->stopped = true;
+    sc_cond_signal(&transcoder->cond);
+    sc_mutex_unlock(&transcoder->mutex);
+
+    sc_thread_join(&transcoder->thread, NULL);
+
+    // Not empty if the transcoder thread failed
+    sc_transcoder_clear_queue(transcoder);
+    sc_vecdeque_destroy(&transcoder->queue);
+
+    sws_freeContext(transcoder->sws_ctx);
+    avcodec_free_context(&transcoder->out_ctx);
+    avcodec_parameters_free(&transcoder->out_par);
+    av_frame_free(&transcoder->sw_frame);
+    av_frame_free(&transcoder->enc_frame);
+    av_packet_free(&transcoder->packet);
+    sc_cond_destroy(&transcoder->cond);
+    sc_mutex_destroy(&transcoder->mutex);
+}
+
+static bool
+sc_transcoder_frame_sink_push_shared(struct sc_frame_sink *sink,
+                                     struct sc_shared_frame *frame) {
+    struct sc_transcoder *transcoder = DOWNCAST(sink);
+
+    sc_mutex_lock(&transcoder->mutex);
+
+    if (sc_vecdeque_size(&transcoder->queue)
+            >= SC_TRANSCODER_MAX_QUEUED_FRAMES) {
+        // The encoder does not keep up, do not block the decoder
+        LOGW("Transcoder: frame dropped");
+        struct sc_shared_frame *old = sc_vecdeque_pop(&transcoder->queue);
+        sc_shared_frame_release(old);
+    }
+
+    bool ok = sc_vecdeque_push(&transcoder->queue, frame);
+    if (!ok) {
+        sc_mutex_unlock(&transcoder->mutex);
+        LOG_OOM();
+        return false;
+    }
+
+    sc_shared_frame_acquire(frame);
+    sc_cond_signal(&transcoder->cond);
+    sc_mutex_unlock(&transcoder->mutex);
+
+    return true;
+}
+
+void
+sc_transcoder_init(struct sc_transcoder *transcoder, enum sc_codec codec,
+                   uint32_t bit_rate) {
+    assert(codec == SC_CODEC_H264 || codec == SC_CODEC_H265);
+
+    transcoder->codec = codec;
+    transcoder->bit_rate = bit_rate;
+
+    sc_packet_source_init(&transcoder->packet_source);
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = sc_transcoder_frame_sink_open,
+        .close = sc_transcoder_frame_sink_close,
+        .push_shared = sc_transcoder_frame_sink_push_shared,
+    };
+
+    transcoder->frame_sink.ops = &ops;
+}
@@ -0,0 +1,66 @@
+#ifndef SC_TRANSCODER_H
+#define SC_TRANSCODER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+#include "options.h"
+#include "shared_frame.h"
+#include "trait/frame_sink.h"
+#include "trait/packet_source.h"
+#include "util/thread.h"
+#include "util/vecdeque.h"
+
+struct sc_transcoder_queue SC_VECDEQUE(struct sc_shared_frame *);
+
+/**
+ * Re-encode the decoded video frames with a hardware encoder (for
+ * --record-transcode)
+ *
+ * It is a frame sink of the video decoder, and a packet source providing the
+ * new encoded stream (typically to the recorder), with the same conventions
+ * as the demuxer: a config packet first, then packets timestamped in
+ * microseconds.
+ */
+struct sc_transcoder {
+    struct sc_frame_sink frame_sink; // frame sink trait
+    struct sc_packet_source packet_source; // packet source trait
+
+    enum sc_codec codec;
+    uint32_t bit_rate;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool stopped;
+    struct sc_transcoder_queue queue; // protected by mutex
+
+    // All the fields below are only accessed from the transcoder thread
+
+    // The encoder is opened on the first frame, once the size is known
+    AVCodecContext *ctx;
+    AVPacket *packet;
+    // Frame converted to the encoder input format (in system or in hardware
+    // memory), if necessary
+    AVFrame *enc_frame;
+    AVFrame *sw_frame;
+    struct SwsContext *sws_ctx;
+
+    // The packet sinks are opened once (on the first packet), with a copy of
+    // the parameters of the first encoder (the encoder is replaced on
+    // resolution change)
+    AVCodecParameters *out_par;
+    AVCodecContext *out_ctx;
+    bool sinks_open;
+    // Prepend the new parameter sets to the next packet
+    bool merge_config;
+};
+
+void
+sc_transcoder_init(struct sc_transcoder *transcoder, enum sc_codec codec,
+                   uint32_t bit_rate);
+
+#endif
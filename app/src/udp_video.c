@@ -0,0 +1,197 @@
+#include "udp_video.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/binary.h"
+#include "util/log.h"
+
+// Larger than any datagram the device may send
+#define SC_UDP_VIDEO_DATAGRAM_BUFFER_SIZE 65536
+
+#define SC_UDP_VIDEO_HELLO_INTERVAL SC_TICK_FROM_MS(100)
+#define SC_UDP_VIDEO_HELLO_ATTEMPTS 50
+
+bool
+sc_udp_video_init(struct sc_udp_video *udp, sc_socket socket, uint32_t scid) {
+    udp->datagram = malloc(SC_UDP_VIDEO_DATAGRAM_BUFFER_SIZE);
+    if (!udp->datagram) {
+        LOG_OOM();
+        return false;
+    }
+
+    udp->socket = socket;
+    udp->scid = scid;
+    udp->data = NULL;
+    udp->size = 0;
+    udp->cap = 0;
+    udp->seq = 0;
+    udp->next_index = 0;
+    udp->count = 0;
+    udp->assembling = false;
+    udp->next_seq = 0;
+    udp->has_next_seq = false;
+    udp->lost = false;
+
+    return true;
+}
+
+void
+sc_udp_video_destroy(struct sc_udp_video *udp) {
+    free(udp->data);
+    free(udp->datagram);
+}
+
+bool
+sc_udp_video_handshake(struct sc_udp_video *udp) {
+    uint8_t hello[SC_UDP_VIDEO_HELLO_SIZE];
+    sc_write32be(hello, udp->scid);
+
+    if (!net_set_timeout(udp->socket, SC_UDP_VIDEO_HELLO_INTERVAL)) {
+        return false;
+    }
+
+    bool acked = false;
+    for (unsigned i = 0; !acked && i < SC_UDP_VIDEO_HELLO_ATTEMPTS; ++i) {
+        // The server may not listen yet: any error is ignored until the
+        // last attempt
+        net_send(udp->socket, hello, sizeof(hello));
+
+        ssize_t r = net_recv(udp->socket, udp->datagram,
+                             SC_UDP_VIDEO_DATAGRAM_BUFFER_SIZE);
+        if (r == 0) {
+            // The socket has been interrupted
+            return false;
+        }
+
+        acked = r == sizeof(hello) && !memcmp(udp->datagram, hello, r);
+    }
+
+    if (!acked) {
+        LOGE("UDP video: no answer from the device");
+        return false;
+    }
+
+    // Block indefinitely from now on
+    if (!net_set_timeout(udp->socket, 0)) {
+        return false;
+    }
+
+    LOGD("UDP video: connected");
+    return true;
+}
+
+static bool
+sc_udp_video_append(struct sc_udp_video *udp, const uint8_t *data,
+                    size_t len) {
+    if (udp->size + len > udp->cap) {
+        size_t cap = MAX(udp->cap * 2, udp->size + len);
+        uint8_t *p = realloc(udp->data, cap);
+        if (!p) {
+            LOG_OOM();
+            return false;
+        }
+        udp->data = p;
+        udp->cap = cap;
+    }
+
+    memcpy(udp->data + udp->size, data, len);
+    udp->size += len;
+    return true;
+}
+
+static void
+sc_udp_video_drop(struct sc_udp_video *udp, uint32_t seq) {
+    // The current packet is lost, wait for the next one
+    udp->assembling = false;
+    udp->lost = true;
+    udp->next_seq = seq + 1;
+    udp->has_next_seq = true;
+}
+
+enum sc_udp_video_result
+sc_udp_video_push(struct sc_udp_video *udp, const uint8_t *datagram,
+                  size_t len) {
+    if (len == SC_UDP_VIDEO_HELLO_SIZE) {
+        // The device sends its acknowledgement several times
+        return SC_UDP_VIDEO_INCOMPLETE;
+    }
+
+    if (len < SC_UDP_VIDEO_HEADER_SIZE) {
+        LOGW("UDP video: unexpected datagram (%zu bytes)", len);
+        return SC_UDP_VIDEO_INCOMPLETE;
+    }
+
+    uint32_t seq = sc_read32be(datagram);
+    uint16_t index = sc_read16be(&datagram[4]);
+    uint16_t count = sc_read16be(&datagram[6]);
+    if (!count || index >= count) {
+        LOGW("UDP video: invalid fragment %" PRIu16 "/%" PRIu16,
+             index, count);
+        return SC_UDP_VIDEO_INCOMPLETE;
+    }
+
+    if (udp->has_next_seq && (int32_t) (seq - udp->next_seq) < 0) {
+        // Late or duplicated datagram from a previous packet, ignore
+        return SC_UDP_VIDEO_INCOMPLETE;
+    }
+
+    if (index == 0) {
+        if (udp->assembling
+                || (udp->has_next_seq && seq != udp->next_seq)) {
+            // The previous packet is incomplete, or some packets have not
+            // been received at all
+            udp->lost = true;
+        }
+
+        udp->assembling = true;
+        udp->seq = seq;
+        udp->count = count;
+        udp->next_index = 0;
+        udp->size = 0;
+    } else if (!udp->assembling || seq != udp->seq
+            || index != udp->next_index || count != udp->count) {
+        // The first fragments of this packet are missing (or reordered)
+        sc_udp_video_drop(udp, seq);
+        return SC_UDP_VIDEO_INCOMPLETE;
+    }
+
+    if (!sc_udp_video_append(udp, datagram + SC_UDP_VIDEO_HEADER_SIZE,
+                             len - SC_UDP_VIDEO_HEADER_SIZE)) {
+        return SC_UDP_VIDEO_ERROR;
+    }
+
+    if (++udp->next_index < count) {
+        return SC_UDP_VIDEO_INCOMPLETE;
+    }
+
+    udp->assembling = false;
+    udp->next_seq = seq + 1;
+    udp->has_next_seq = true;
+    return SC_UDP_VIDEO_PACKET;
+}
+
+bool
+sc_udp_video_recv(struct sc_udp_video *udp, bool *lost) {
+    for (;;) {
+        ssize_t r = net_recv(udp->socket, udp->datagram,
+                             SC_UDP_VIDEO_DATAGRAM_BUFFER_SIZE);
+        if (r <= 0) {
+            return false;
+        }
+
+        enum sc_udp_video_result result =
+            sc_udp_video_push(udp, udp->datagram, r);
+        if (result == SC_UDP_VIDEO_ERROR) {
+            return false;
+        }
+
+        if (result == SC_UDP_VIDEO_PACKET) {
+            *lost = udp->lost;
+            udp->lost = false;
+            return true;
+        }
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef SC_UDP_VIDEO_H
+#define SC_UDP_VIDEO_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/net.h"
+
+/**
+ * Reception of the video packets over UDP (--video-udp-port)
+ *
+ * Over TCP, a single lost segment on Wi-Fi blocks all the following data until
+ * it is retransmitted. Over UDP, the lost packets are just missing, and the
+ * decoding resumes from the next keyframe.
+ *
+ * The stream header (codec id and video size) is still received on the TCP
+ * video socket; only the packets are sent over UDP.
+ *
+ * Each packet (the 12-byte packet header followed by the payload, exactly as
+ * sent over TCP) is split into fragments, each sent in its own datagram
+ * prefixed by an 8-byte header:
+ *
+ *     [. . . .|. .|. .]. . . . . . . . . . ...
+ *      <-----> <-> <-> <---------------------...
+ *        seq  index count      fragment
+ *
+ *  - seq: the sequence number of the packet, incremented for each packet
+ *  - index: the index of the fragment in the packet
+ *  - count: the number of fragments of the packet
+ *
+ * Any missing or out-of-order fragment invalidates the packet it belongs to.
+ *
+ * Before sending anything, the device waits for a "hello" datagram from the
+ * client (the 4-byte scid, so that the stream is not sent to anyone else) and
+ * acknowledges it by sending it back (several times, in case some are lost).
+ */
+
+#define SC_UDP_VIDEO_HEADER_SIZE 8
+#define SC_UDP_VIDEO_HELLO_SIZE 4
+
+struct sc_udp_video {
+    sc_socket socket; // connected to the device, not owned
+    uint32_t scid;
+
+    uint8_t *datagram; // receive buffer
+
+    // Packet being reassembled
+    uint8_t *data;
+    size_t size;
+    size_t cap;
+    uint32_t seq;
+    uint16_t next_index;
+    uint16_t count;
+    bool assembling;
+
+    uint32_t next_seq; // expected sequence number of the next packet
+    bool has_next_seq;
+
+    // Whether packets have been lost since the last complete packet
+    bool lost;
+};
+
+enum sc_udp_video_result {
+    SC_UDP_VIDEO_INCOMPLETE,
+    SC_UDP_VIDEO_PACKET, // a packet is available in data/size
+    SC_UDP_VIDEO_ERROR,
+};
+
+bool
+sc_udp_video_init(struct sc_udp_video *udp, sc_socket socket, uint32_t scid);
+
+void
+sc_udp_video_destroy(struct sc_udp_video *udp);
+
+/**
+ * Send the "hello" datagram until the device acknowledges it
+ */
+bool
+sc_udp_video_handshake(struct sc_udp_video *udp);
+
+/**
+ * Process a received datagram
+ *
+ * On SC_UDP_VIDEO_PACKET, the reassembled packet is available in `udp->data`
+ * (`udp->size` bytes) until the next call.
+ */
+enum sc_udp_video_result
+sc_udp_video_push(struct sc_udp_video *udp, const uint8_t *datagram,
+                  size_t len);
+
+/**
+ * Receive datagrams until a packet is complete
+ *
+ * `lost` is set to true if packets have been lost before this one.
+ *
+ * Return false if the socket is closed or on error.
+ */
+bool
+sc_udp_video_recv(struct sc_udp_video *udp, bool *lost);
+
+#endif
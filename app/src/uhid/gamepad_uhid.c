@@ -4,7 +4,9 @@
 #include <inttypes.h>
 #include <string.h>
 #include <SDL2/SDL_gamecontroller.h>
+#include <SDL2/SDL_timer.h>
 
+#include "events.h"
 #include "hid/hid_gamepad.h"
 #include "input_events.h"
 #include "util/log.h"
@@ -99,18 +101,61 @@ sc_gamepad_processor_process_gamepad_removed(struct sc_gamepad_processor *gp,
     sc_gamepad_uhid_send_close(gamepad, &hid_close);
 }
 
+static void
+sc_gamepad_uhid_flush(struct sc_gamepad_uhid *gamepad) {
+    struct sc_hid_input hid_inputs[SC_MAX_GAMEPADS];
+    size_t count = sc_hid_gamepad_flush(&gamepad->hid, hid_inputs,
+                                        sc_tick_now());
+    for (size_t i = 0; i < count; ++i) {
+        sc_gamepad_uhid_send_input(gamepad, &hid_inputs[i], "gamepad");
+    }
+}
+
+static void
+sc_gamepad_uhid_run_flush(void *userdata) {
+    struct sc_gamepad_uhid *gamepad = userdata;
+
+    gamepad->flush_timer = 0;
+    sc_gamepad_uhid_flush(gamepad);
+}
+
+static uint32_t SDLCALL
+sc_gamepad_uhid_on_flush_timer(uint32_t interval, void *userdata) {
+    (void) interval;
+
+    // Called from the SDL timer thread
+    sc_post_to_main_thread(sc_gamepad_uhid_run_flush, userdata);
+    return 0; // single-shot
+}
+
 static void
 sc_gamepad_processor_process_gamepad_axis(struct sc_gamepad_processor *gp,
                                 const struct sc_gamepad_axis_event *event) {
     struct sc_gamepad_uhid *gamepad = DOWNCAST(gp);
 
-    struct sc_hid_input hid_input;
-    if (!sc_hid_gamepad_generate_input_from_axis(&gamepad->hid, &hid_input,
-                                                 event)) {
+    if (!sc_hid_gamepad_process_axis(&gamepad->hid, event)) {
+        return;
+    }
+
+    if (gamepad->flush_timer) {
+        // The latest state will be reported on timeout
         return;
     }
 
-    sc_gamepad_uhid_send_input(gamepad, &hid_input, "gamepad axis");
+    sc_tick delay = sc_hid_gamepad_get_flush_delay(&gamepad->hid,
+                                                   sc_tick_now());
+    if (delay) {
+        // Round up to the next millisecond
+        uint32_t delay_ms = SC_TICK_TO_MS(delay + SC_TICK_FROM_MS(1) - 1);
+        gamepad->flush_timer =
+            SDL_AddTimer(delay_ms, sc_gamepad_uhid_on_flush_timer, gamepad);
+        if (gamepad->flush_timer) {
+            return;
+        }
+        LOGW("Could not add gamepad flush timer: %s", SDL_GetError());
+    }
+
+    sc_gamepad_uhid_flush(gamepad);
 }
 
 static void
@@ -118,22 +163,23 @@ sc_gamepad_processor_process_gamepad_button(struct sc_gamepad_processor *gp,
                                 const struct sc_gamepad_button_event *event) {
     struct sc_gamepad_uhid *gamepad = DOWNCAST(gp);
 
-    struct sc_hid_input hid_input;
-    if (!sc_hid_gamepad_generate_input_from_button(&gamepad->hid, &hid_input,
-                                                   event)) {
+    if (!sc_hid_gamepad_process_button(&gamepad->hid, event)) {
         return;
     }
 
-    sc_gamepad_uhid_send_input(gamepad, &hid_input, "gamepad button");
-
+    // Buttons are never delayed, so that no press is lost (pending axis
+    // changes are reported at the same time)
+    sc_gamepad_uhid_flush(gamepad);
 }
 
 void
 sc_gamepad_uhid_init(struct sc_gamepad_uhid *gamepad,
-                     struct sc_controller *controller) {
-    sc_hid_gamepad_init(&gamepad->hid);
+                     struct sc_controller *controller,
+                     sc_tick poll_interval) {
+    sc_hid_gamepad_init(&gamepad->hid, poll_interval);
 
     gamepad->controller = controller;
+    gamepad->flush_timer = 0;
 
     static const struct sc_gamepad_processor_ops ops = {
         .process_gamepad_added = sc_gamepad_processor_process_gamepad_added,
@@ -3,6 +3,8 @@
 
 #include "common.h"
 
+#include <SDL2/SDL_timer.h>
+
 #include "controller.h"
 #include "hid/hid_gamepad.h"
 #include "trait/gamepad_processor.h"
@@ -12,10 +14,12 @@ struct sc_gamepad_uhid {
 
     struct sc_hid_gamepad hid;
     struct sc_controller *controller;
+    SDL_TimerID flush_timer; // 0 if no flush is scheduled
 };
 
 void
 sc_gamepad_uhid_init(struct sc_gamepad_uhid *mouse,
-                     struct sc_controller *controller);
+                     struct sc_controller *controller,
+                     sc_tick poll_interval);
 
 #endif
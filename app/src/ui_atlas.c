@@ -0,0 +1,453 @@
+#include "ui_atlas.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/log.h"
+
+#define SC_UI_ATLAS_WIDTH 128
+#define SC_UI_ATLAS_HEIGHT 152
+// The circle occupies the top-left square of the atlas
+#define SC_UI_ATLAS_CIRCLE_SIZE 128
+// The glyphs are stored below the circle, in cells with a 1-pixel gutter
+#define SC_UI_ATLAS_GLYPHS_Y 128
+#define SC_UI_ATLAS_GLYPH_CELL_WIDTH (SC_UI_GLYPH_WIDTH + 1)
+#define SC_UI_ATLAS_GLYPH_CELL_HEIGHT (SC_UI_GLYPH_HEIGHT + 1)
+#define SC_UI_ATLAS_GLYPHS_PER_ROW 16
+// An opaque block to fill plain rectangles (sampled away from its borders)
+#define SC_UI_ATLAS_SOLID_X 120
+#define SC_UI_ATLAS_SOLID_Y 136
+#define SC_UI_ATLAS_SOLID_SIZE 4
+
+// Maximum number of quads drawn by a single SDL_RenderGeometry() call
+#define SC_UI_ATLAS_BATCH_QUADS 64
+
+// The characters supported by sc_ui_atlas_get_glyph(), in atlas order
+#define SC_UI_ATLAS_GLYPH_CHARS " ABCDEFGHIKLMNOPQRSTUVY0123456789./:"
+
+#ifdef SCRCPY_SDL_HAS_RENDER_GEOMETRY
+struct sc_ui_atlas_batch {
+    SDL_Vertex vertices[4 * SC_UI_ATLAS_BATCH_QUADS];
+    int indices[6 * SC_UI_ATLAS_BATCH_QUADS];
+    unsigned count; // number of quads
+    SDL_Color color;
+};
+
+static void
+sc_ui_atlas_batch_init(struct sc_ui_atlas *atlas,
+                       struct sc_ui_atlas_batch *batch) {
+    batch->count = 0;
+    SDL_Color *c = &batch->color;
+    SDL_GetRenderDrawColor(atlas->renderer, &c->r, &c->g, &c->b, &c->a);
+}
+
+static void
+sc_ui_atlas_batch_flush(struct sc_ui_atlas *atlas,
+                        struct sc_ui_atlas_batch *batch) {
+    if (!batch->count) {
+        return;
+    }
+
+    int ret = SDL_RenderGeometry(atlas->renderer, atlas->texture,
+                                 batch->vertices, 4 * batch->count,
+                                 batch->indices, 6 * batch->count);
+    if (ret) {
+        LOGW("Could not render UI geometry: %s", SDL_GetError());
+    }
+    batch->count = 0;
+}
+
+static void
+sc_ui_atlas_batch_add(struct sc_ui_atlas *atlas,
+                      struct sc_ui_atlas_batch *batch, const SDL_Rect *dst,
+                      const SDL_Rect *src) {
+    if (dst->w <= 0 || dst->h <= 0) {
+        return;
+    }
+
+    if (batch->count == SC_UI_ATLAS_BATCH_QUADS) {
+        sc_ui_atlas_batch_flush(atlas, batch);
+    }
+
+    float x0 = dst->x;
+    float y0 = dst->y;
+    float x1 = dst->x + dst->w;
+    float y1 = dst->y + dst->h;
+    float u0 = (float) src->x / SC_UI_ATLAS_WIDTH;
+    float v0 = (float) src->y / SC_UI_ATLAS_HEIGHT;
+    float u1 = (float) (src->x + src->w) / SC_UI_ATLAS_WIDTH;
+    float v1 = (float) (src->y + src->h) / SC_UI_ATLAS_HEIGHT;
+
+    SDL_Vertex *v = &batch->vertices[4 * batch->count];
+    v[0] = (SDL_Vertex) {{x0, y0}, batch->color, {u0, v0}};
+    v[1] = (SDL_Vertex) {{x1, y0}, batch->color, {u1, v0}};
+    v[2] = (SDL_Vertex) {{x1, y1}, batch->color, {u1, v1}};
+    v[3] = (SDL_Vertex) {{x0, y1}, batch->color, {u0, v1}};
+
+    int base = 4 * batch->count;
+    int *i = &batch->indices[6 * batch->count];
+    i[0] = base;
+    i[1] = base + 1;
+    i[2] = base + 2;
+    i[3] = base;
+    i[4] = base + 2;
+    i[5] = base + 3;
+
+    ++batch->count;
+}
+
+static void
+sc_ui_atlas_batch_add_solid(struct sc_ui_atlas *atlas,
+                            struct sc_ui_atlas_batch *batch,
+                            const SDL_Rect *dst) {
+    static const SDL_Rect solid = {
+        .x = SC_UI_ATLAS_SOLID_X + 1,
+        .y = SC_UI_ATLAS_SOLID_Y + 1,
+        .w = SC_UI_ATLAS_SOLID_SIZE - 2,
+        .h = SC_UI_ATLAS_SOLID_SIZE - 2,
+    };
+    sc_ui_atlas_batch_add(atlas, batch, dst, &solid);
+}
+
+// The glyph rows, in the order of SC_UI_ATLAS_GLYPH_CHARS
+static const uint8_t sc_ui_atlas_glyphs[][SC_UI_GLYPH_HEIGHT] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // ' '
+    {0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}, // 'A'
+    {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E}, // 'B'
+    {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E}, // 'C'
+    {0x1E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x1E}, // 'D'
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F}, // 'E'
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10}, // 'F'
+    {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0E}, // 'G'
+    {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}, // 'H'
+    {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x1F}, // 'I'
+    {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}, // 'K'
+    {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F}, // 'L'
+    {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11}, // 'M'
+    {0x11, 0x19, 0x15, 0x13, 0x11, 0x11, 0x11}, // 'N'
+    {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, // 'O'
+    {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10}, // 'P'
+    {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D}, // 'Q'
+    {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11}, // 'R'
+    {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E}, // 'S'
+    {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, // 'T'
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, // 'U'
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04}, // 'V'
+    {0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04}, // 'Y'
+    {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}, // '0'
+    {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E}, // '1'
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}, // '2'
+    {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E}, // '3'
+    {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}, // '4'
+    {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E}, // '5'
+    {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}, // '6'
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}, // '7'
+    {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}, // '8'
+    {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}, // '9'
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C}, // '.'
+    {0x01, 0x01, 0x02, 0x04, 0x08, 0x10, 0x10}, // '/'
+    {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00}, // ':'
+};
+
+static_assert(ARRAY_LEN(sc_ui_atlas_glyphs)
+                  == sizeof(SC_UI_ATLAS_GLYPH_CHARS) - 1,
+              "Glyph table and atlas characters mismatch");
+
+// Return the atlas index of the glyph for `c` (unsupported characters are
+// rendered as a space)
+static unsigned
+sc_ui_atlas_get_glyph_index(char c) {
+    const char *chars = SC_UI_ATLAS_GLYPH_CHARS;
+    const char *p = strchr(chars, toupper((unsigned char) c));
+    return p && *p ? p - chars : 0;
+}
+
+static SDL_Rect
+sc_ui_atlas_get_glyph_rect(char c) {
+    unsigned index = sc_ui_atlas_get_glyph_index(c);
+    return (SDL_Rect) {
+        .x = (index % SC_UI_ATLAS_GLYPHS_PER_ROW) * SC_UI_ATLAS_GLYPH_CELL_WIDTH,
+        .y = SC_UI_ATLAS_GLYPHS_Y
+           + (index / SC_UI_ATLAS_GLYPHS_PER_ROW) * SC_UI_ATLAS_GLYPH_CELL_HEIGHT,
+        .w = SC_UI_GLYPH_WIDTH,
+        .h = SC_UI_GLYPH_HEIGHT,
+    };
+}
+
+static void
+sc_ui_atlas_rasterize(uint8_t *pixels) {
+    // Opaque white texels are tinted by the vertex colors, the others are
+    // fully transparent
+    memset(pixels, 0, SC_UI_ATLAS_WIDTH * SC_UI_ATLAS_HEIGHT * 4);
+#define SET_TEXEL(X, Y) memset(&pixels[((Y) * SC_UI_ATLAS_WIDTH + (X)) * 4], \
+                               0xFF, 4)
+
+    int radius = SC_UI_ATLAS_CIRCLE_SIZE / 2;
+    for (int y = 0; y < SC_UI_ATLAS_CIRCLE_SIZE; ++y) {
+        for (int x = 0; x < SC_UI_ATLAS_CIRCLE_SIZE; ++x) {
+            // Test the texel center
+            int dx = 2 * x + 1 - 2 * radius;
+            int dy = 2 * y + 1 - 2 * radius;
+            if (dx * dx + dy * dy <= 4 * radius * radius) {
+                SET_TEXEL(x, y);
+            }
+        }
+    }
+
+    const char *chars = SC_UI_ATLAS_GLYPH_CHARS;
+    for (const char *c = chars; *c; ++c) {
+        SDL_Rect cell = sc_ui_atlas_get_glyph_rect(*c);
+        const uint8_t *rows = sc_ui_atlas_get_glyph(*c);
+        for (int row = 0; row < SC_UI_GLYPH_HEIGHT; ++row) {
+            for (int col = 0; col < SC_UI_GLYPH_WIDTH; ++col) {
+                if (rows[row] & (1 << (SC_UI_GLYPH_WIDTH - 1 - col))) {
+                    SET_TEXEL(cell.x + col, cell.y + row);
+                }
+            }
+        }
+    }
+
+    for (int y = 0; y < SC_UI_ATLAS_SOLID_SIZE; ++y) {
+        for (int x = 0; x < SC_UI_ATLAS_SOLID_SIZE; ++x) {
+            SET_TEXEL(SC_UI_ATLAS_SOLID_X + x, SC_UI_ATLAS_SOLID_Y + y);
+        }
+    }
+#undef SET_TEXEL
+}
+
+static SDL_Texture *
+sc_ui_atlas_create_texture(SDL_Renderer *renderer) {
+    uint8_t *pixels = malloc(SC_UI_ATLAS_WIDTH * SC_UI_ATLAS_HEIGHT * 4);
+    if (!pixels) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    sc_ui_atlas_rasterize(pixels);
+
+    SDL_Texture *texture =
+        SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32,
+                          SDL_TEXTUREACCESS_STATIC, SC_UI_ATLAS_WIDTH,
+                          SC_UI_ATLAS_HEIGHT);
+    if (!texture) {
+        LOGW("Could not create UI atlas texture: %s", SDL_GetError());
+        free(pixels);
+        return NULL;
+    }
+
+    if (SDL_UpdateTexture(texture, NULL, pixels, SC_UI_ATLAS_WIDTH * 4)) {
+        LOGW("Could not upload UI atlas texture: %s", SDL_GetError());
+        SDL_DestroyTexture(texture);
+        free(pixels);
+        return NULL;
+    }
+    free(pixels);
+
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    // Keep the glyph pixels and the shape edges sharp, like the
+    // SDL_RenderFillRect() fallback
+    SDL_SetTextureScaleMode(texture, SDL_ScaleModeNearest);
+
+    return texture;
+}
+#endif
+
+void
+sc_ui_atlas_init(struct sc_ui_atlas *atlas, SDL_Renderer *renderer) {
+    atlas->renderer = renderer;
+#ifdef SCRCPY_SDL_HAS_RENDER_GEOMETRY
+    atlas->texture = sc_ui_atlas_create_texture(renderer);
+#else
+    atlas->texture = NULL;
+#endif
+}
+
+void
+sc_ui_atlas_destroy(struct sc_ui_atlas *atlas) {
+    if (atlas->texture) {
+        SDL_DestroyTexture(atlas->texture);
+    }
+}
+
+static void
+sc_ui_atlas_fallback_fill_circle(SDL_Renderer *renderer, int cx, int cy,
+                                 int radius) {
+    for (int y = -radius; y <= radius; ++y) {
+        int dx = radius;
+        while (dx > 0 && dx * dx + y * y > radius * radius) {
+            --dx;
+        }
+        SDL_Rect row = {
+            .x = cx - dx,
+            .y = cy + y,
+            .w = 2 * dx + 1,
+            .h = 1,
+        };
+        SDL_RenderFillRect(renderer, &row);
+    }
+}
+
+void
+sc_ui_atlas_fill_circle(struct sc_ui_atlas *atlas, int cx, int cy,
+                        int radius) {
+#ifdef SCRCPY_SDL_HAS_RENDER_GEOMETRY
+    if (atlas->texture) {
+        static const SDL_Rect circle = {
+            0, 0, SC_UI_ATLAS_CIRCLE_SIZE, SC_UI_ATLAS_CIRCLE_SIZE,
+        };
+        SDL_Rect dst = {
+            .x = cx - radius,
+            .y = cy - radius,
+            .w = 2 * radius + 1,
+            .h = 2 * radius + 1,
+        };
+
+        struct sc_ui_atlas_batch batch;
+        sc_ui_atlas_batch_init(atlas, &batch);
+        sc_ui_atlas_batch_add(atlas, &batch, &dst, &circle);
+        sc_ui_atlas_batch_flush(atlas, &batch);
+        return;
+    }
+#endif
+
+    sc_ui_atlas_fallback_fill_circle(atlas->renderer, cx, cy, radius);
+}
+
+void
+sc_ui_atlas_fill_rounded_rect(struct sc_ui_atlas *atlas, const SDL_Rect *rect,
+                              int radius) {
+    SDL_Renderer *renderer = atlas->renderer;
+
+    radius = CLAMP(radius, 0, MIN(rect->w, rect->h) / 2);
+    if (!radius) {
+        SDL_RenderFillRect(renderer, rect);
+        return;
+    }
+
+    SDL_Rect middle = {
+        .x = rect->x + radius,
+        .y = rect->y,
+        .w = rect->w - 2 * radius,
+        .h = rect->h,
+    };
+    SDL_Rect left = {
+        .x = rect->x,
+        .y = rect->y + radius,
+        .w = radius,
+        .h = rect->h - 2 * radius,
+    };
+    SDL_Rect right = {
+        .x = rect->x + rect->w - radius,
+        .y = rect->y + radius,
+        .w = radius,
+        .h = rect->h - 2 * radius,
+    };
+
+#ifdef SCRCPY_SDL_HAS_RENDER_GEOMETRY
+    if (atlas->texture) {
+        // Each corner is a quadrant of the circle
+        int half = SC_UI_ATLAS_CIRCLE_SIZE / 2;
+        struct {
+            SDL_Rect dst;
+            SDL_Rect src;
+        } corners[] = {
+            {{rect->x, rect->y, radius, radius},
+             {0, 0, half, half}},
+            {{rect->x + rect->w - radius, rect->y, radius, radius},
+             {half, 0, half, half}},
+            {{rect->x, rect->y + rect->h - radius, radius, radius},
+             {0, half, half, half}},
+            {{rect->x + rect->w - radius, rect->y + rect->h - radius, radius,
+              radius},
+             {half, half, half, half}},
+        };
+
+        struct sc_ui_atlas_batch batch;
+        sc_ui_atlas_batch_init(atlas, &batch);
+        sc_ui_atlas_batch_add_solid(atlas, &batch, &middle);
+        sc_ui_atlas_batch_add_solid(atlas, &batch, &left);
+        sc_ui_atlas_batch_add_solid(atlas, &batch, &right);
+        for (size_t i = 0; i < ARRAY_LEN(corners); ++i) {
+            sc_ui_atlas_batch_add(atlas, &batch, &corners[i].dst,
+                                  &corners[i].src);
+        }
+        sc_ui_atlas_batch_flush(atlas, &batch);
+        return;
+    }
+#endif
+
+    SDL_RenderFillRect(renderer, &middle);
+    SDL_RenderFillRect(renderer, &left);
+    SDL_RenderFillRect(renderer, &right);
+
+    sc_ui_atlas_fallback_fill_circle(renderer, rect->x + radius,
+                                     rect->y + radius, radius);
+    sc_ui_atlas_fallback_fill_circle(renderer, rect->x + rect->w - radius - 1,
+                                     rect->y + radius, radius);
+    sc_ui_atlas_fallback_fill_circle(renderer, rect->x + radius,
+                                     rect->y + rect->h - radius - 1, radius);
+    sc_ui_atlas_fallback_fill_circle(renderer, rect->x + rect->w - radius - 1,
+                                     rect->y + rect->h - radius - 1, radius);
+}
+
+void
+sc_ui_atlas_draw_text(struct sc_ui_atlas *atlas, const char *text, int x,
+                      int y, int scale, int spacing) {
+    int glyph_width = SC_UI_GLYPH_WIDTH * scale;
+
+#ifdef SCRCPY_SDL_HAS_RENDER_GEOMETRY
+    if (atlas->texture) {
+        struct sc_ui_atlas_batch batch;
+        sc_ui_atlas_batch_init(atlas, &batch);
+        for (const char *c = text; *c; ++c) {
+            if (*c != ' ') {
+                SDL_Rect src = sc_ui_atlas_get_glyph_rect(*c);
+                SDL_Rect dst = {
+                    .x = x,
+                    .y = y,
+                    .w = glyph_width,
+                    .h = SC_UI_GLYPH_HEIGHT * scale,
+                };
+                sc_ui_atlas_batch_add(atlas, &batch, &dst, &src);
+            }
+            x += glyph_width + spacing;
+        }
+        sc_ui_atlas_batch_flush(atlas, &batch);
+        return;
+    }
+#endif
+
+    for (const char *c = text; *c; ++c) {
+        const uint8_t *rows = sc_ui_atlas_get_glyph(*c);
+        for (int row = 0; row < SC_UI_GLYPH_HEIGHT; ++row) {
+            // Fill each horizontal run of set pixels with a single rect
+            int col = 0;
+            while (col < SC_UI_GLYPH_WIDTH) {
+                if (!(rows[row] & (1 << (SC_UI_GLYPH_WIDTH - 1 - col)))) {
+                    ++col;
+                    continue;
+                }
+                int run_start = col;
+                do {
+                    ++col;
+                } while (col < SC_UI_GLYPH_WIDTH
+                        && rows[row] & (1 << (SC_UI_GLYPH_WIDTH - 1 - col)));
+                SDL_Rect run = {
+                    .x = x + run_start * scale,
+                    .y = y + row * scale,
+                    .w = (col - run_start) * scale,
+                    .h = scale,
+                };
+                SDL_RenderFillRect(atlas->renderer, &run);
+            }
+        }
+        x += glyph_width + spacing;
+    }
+}
+
+const uint8_t *
+sc_ui_atlas_get_glyph(char c) {
+    return sc_ui_atlas_glyphs[sc_ui_atlas_get_glyph_index(c)];
+}
@@ -0,0 +1,54 @@
+#ifndef SC_UI_ATLAS_H
+#define SC_UI_ATLAS_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+// Width and height (in pixels) of the bitmap font glyphs
+#define SC_UI_GLYPH_WIDTH 5
+#define SC_UI_GLYPH_HEIGHT 7
+
+/**
+ * Texture containing pre-rasterized UI shapes (a circle, for rounded
+ * corners) and the bitmap font glyphs, so that each shape or string is drawn
+ * by a single SDL_RenderGeometry() call (instead of one SDL_RenderFillRect()
+ * per scanline or per glyph pixel).
+ *
+ * All drawing functions use the current renderer draw color. If the atlas
+ * texture is not available (e.g. SDL < 2.0.18), they fall back to
+ * SDL_RenderFillRect().
+ */
+struct sc_ui_atlas {
+    SDL_Renderer *renderer;
+    SDL_Texture *texture; // may be NULL
+};
+
+// Never fails: on error, the fallback rendering is used
+void
+sc_ui_atlas_init(struct sc_ui_atlas *atlas, SDL_Renderer *renderer);
+
+void
+sc_ui_atlas_destroy(struct sc_ui_atlas *atlas);
+
+void
+sc_ui_atlas_fill_circle(struct sc_ui_atlas *atlas, int cx, int cy, int radius);
+
+void
+sc_ui_atlas_fill_rounded_rect(struct sc_ui_atlas *atlas, const SDL_Rect *rect,
+                              int radius);
+
+// Draw `text` at (x, y), each glyph pixel being scaled to `scale` x `scale`
+// pixels, with `spacing` pixels between glyphs
+void
+sc_ui_atlas_draw_text(struct sc_ui_atlas *atlas, const char *text, int x,
+                      int y, int scale, int spacing);
+
+// Return the SC_UI_GLYPH_HEIGHT rows of the glyph for `c` (the
+// SC_UI_GLYPH_WIDTH low bits of each row, most significant bit on the left)
+const uint8_t *
+sc_ui_atlas_get_glyph(char c);
+
+#endif
@@ -0,0 +1,294 @@
+#include "ui_icons.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "icon.h"
+#include "util/log.h"
+
+// Space around each icon in the atlas, filled with copies of its border
+// pixels so that linear filtering never samples a neighbor
+#define SC_UI_ICONS_PADDING 1
+// Used if the renderer does not report its maximum texture size
+#define SC_UI_ICONS_DEFAULT_MAX_SIZE 2048
+
+static const struct {
+    const char *env;
+    const char *desc;
+} sc_ui_icon_sources[SC_UI_ICON_COUNT] = {
+    [SC_UI_ICON_SCREENSHOT_BUTTON_BG] = {
+        "SCRCPY_SCREENSHOT_BUTTON_BG_PATH", "screenshot button background",
+    },
+    [SC_UI_ICON_INPUT_TOGGLE_BUTTON_BG] = {
+        "SCRCPY_INPUT_TOGGLE_BUTTON_BG_PATH", "input toggle button background",
+    },
+    [SC_UI_ICON_SCREENSHOT] = {
+        "SCRCPY_SCREENSHOT_ICON_PATH", "screenshot icon",
+    },
+    [SC_UI_ICON_SCREENSHOT_CHECK] = {
+        "SCRCPY_SCREENSHOT_CHECK_ICON_PATH", "screenshot check icon",
+    },
+    [SC_UI_ICON_INPUT_TOGGLE] = {
+        "SCRCPY_INPUT_TOGGLE_ICON_PATH", "input toggle icon",
+    },
+    [SC_UI_ICON_SETTINGS] = {
+        "SCRCPY_SETTINGS_ICON_PATH", "settings icon",
+    },
+};
+
+static bool
+sc_ui_icons_has_source(void) {
+    for (unsigned i = 0; i < SC_UI_ICON_COUNT; ++i) {
+        const char *path = getenv(sc_ui_icon_sources[i].env);
+        if (path && *path) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void
+sc_ui_icons_decode(struct sc_ui_icons *icons) {
+    for (unsigned i = 0; i < SC_UI_ICON_COUNT; ++i) {
+        const char *path = getenv(sc_ui_icon_sources[i].env);
+        if (!path || !*path) {
+            continue;
+        }
+
+        SDL_Surface *surface = scrcpy_icon_load_from_path(path);
+        if (!surface) {
+            LOGW("Could not load %s: %s", sc_ui_icon_sources[i].desc, path);
+            continue;
+        }
+
+        // Convert now, so that the upload is a plain copy
+        SDL_Surface *rgba =
+            SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+        scrcpy_icon_destroy(surface);
+        if (!rgba) {
+            LOGW("Could not convert %s: %s", sc_ui_icon_sources[i].desc,
+                 SDL_GetError());
+            continue;
+        }
+
+        icons->surfaces[i] = rgba;
+    }
+}
+
+static int
+run_ui_icons_loader(void *data) {
+    struct sc_ui_icons *icons = data;
+    sc_ui_icons_decode(icons);
+    return 0;
+}
+
+void
+sc_ui_icons_init(struct sc_ui_icons *icons) {
+    for (unsigned i = 0; i < SC_UI_ICON_COUNT; ++i) {
+        icons->surfaces[i] = NULL;
+        icons->rects[i] = (SDL_Rect) {0, 0, 0, 0};
+    }
+    icons->uploaded = false;
+    icons->texture = NULL;
+    icons->thread_started = false;
+
+    if (!sc_ui_icons_has_source()) {
+        // Nothing to decode, do not start a thread
+        return;
+    }
+
+    icons->thread_started =
+        sc_thread_create(&icons->thread, run_ui_icons_loader, "scrcpy-icons",
+                         icons);
+    if (!icons->thread_started) {
+        LOGW("Could not start icons loader thread");
+    }
+}
+
+static void
+sc_ui_icons_wait(struct sc_ui_icons *icons) {
+    if (icons->thread_started) {
+        sc_thread_join(&icons->thread, NULL);
+        icons->thread_started = false;
+    } else if (!icons->uploaded) {
+        // The thread could not be started (or there is nothing to decode)
+        sc_ui_icons_decode(icons);
+    }
+}
+
+// Place the icons in rows, left to right, then top to bottom
+static bool
+sc_ui_icons_pack(struct sc_ui_icons *icons, int max_width, int max_height,
+                 int *width, int *height) {
+    int x = 0;
+    int y = 0;
+    int row_height = 0;
+    int w = 0;
+
+    for (unsigned i = 0; i < SC_UI_ICON_COUNT; ++i) {
+        SDL_Surface *surface = icons->surfaces[i];
+        if (!surface) {
+            continue;
+        }
+
+        int cell_w = surface->w + 2 * SC_UI_ICONS_PADDING;
+        int cell_h = surface->h + 2 * SC_UI_ICONS_PADDING;
+        if (cell_w > max_width) {
+            LOGW("Icon too large: %dx%d", surface->w, surface->h);
+            return false;
+        }
+
+        if (x + cell_w > max_width) {
+            // Next row
+            x = 0;
+            y += row_height;
+            row_height = 0;
+        }
+
+        icons->rects[i] = (SDL_Rect) {
+            .x = x + SC_UI_ICONS_PADDING,
+            .y = y + SC_UI_ICONS_PADDING,
+            .w = surface->w,
+            .h = surface->h,
+        };
+
+        x += cell_w;
+        w = MAX(w, x);
+        row_height = MAX(row_height, cell_h);
+    }
+
+    int h = y + row_height;
+    if (h > max_height) {
+        LOGW("Icons too large: %dx%d", w, h);
+        return false;
+    }
+
+    *width = w;
+    *height = h;
+    return true;
+}
+
+static inline uint32_t *
+sc_ui_icons_pixel(SDL_Surface *surface, int x, int y) {
+    uint8_t *row = (uint8_t *) surface->pixels + (size_t) y * surface->pitch;
+    return (uint32_t *) row + x;
+}
+
+static void
+sc_ui_icons_copy(SDL_Surface *atlas, SDL_Surface *surface,
+                 const SDL_Rect *rect) {
+    // Copy each row, extended left and right by its border pixels, then
+    // duplicate the first and last rows above and below
+    for (int y = -SC_UI_ICONS_PADDING; y < rect->h + SC_UI_ICONS_PADDING;
+            ++y) {
+        int sy = y < 0 ? 0 : y >= rect->h ? rect->h - 1 : y;
+        const uint32_t *src = sc_ui_icons_pixel(surface, 0, sy);
+        uint32_t *dst = sc_ui_icons_pixel(atlas, rect->x, rect->y + y);
+
+        memcpy(dst, src, rect->w * sizeof(*dst));
+        for (int x = 1; x <= SC_UI_ICONS_PADDING; ++x) {
+            dst[-x] = src[0];
+            dst[rect->w - 1 + x] = src[rect->w - 1];
+        }
+    }
+}
+
+static SDL_Texture *
+sc_ui_icons_create_texture(struct sc_ui_icons *icons, SDL_Renderer *renderer) {
+    SDL_RendererInfo info;
+    int max_width = SC_UI_ICONS_DEFAULT_MAX_SIZE;
+    int max_height = SC_UI_ICONS_DEFAULT_MAX_SIZE;
+    if (!SDL_GetRendererInfo(renderer, &info)) {
+        if (info.max_texture_width) {
+            max_width = info.max_texture_width;
+        }
+        if (info.max_texture_height) {
+            max_height = info.max_texture_height;
+        }
+    }
+
+    int width;
+    int height;
+    if (!sc_ui_icons_pack(icons, max_width, max_height, &width, &height)) {
+        return NULL;
+    }
+
+    SDL_Surface *atlas =
+        SDL_CreateRGBSurfaceWithFormat(0, width, height, 32,
+                                       SDL_PIXELFORMAT_RGBA32);
+    if (!atlas) {
+        LOGW("Could not create icons atlas: %s", SDL_GetError());
+        return NULL;
+    }
+
+    // Transparent between the cells
+    memset(atlas->pixels, 0, (size_t) atlas->pitch * height);
+
+    for (unsigned i = 0; i < SC_UI_ICON_COUNT; ++i) {
+        if (icons->surfaces[i]) {
+            sc_ui_icons_copy(atlas, icons->surfaces[i], &icons->rects[i]);
+        }
+    }
+
+    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, atlas);
+    SDL_FreeSurface(atlas);
+    if (!texture) {
+        LOGW("Could not create icons texture: %s", SDL_GetError());
+        return NULL;
+    }
+
+    return texture;
+}
+
+static void
+sc_ui_icons_free_surfaces(struct sc_ui_icons *icons) {
+    for (unsigned i = 0; i < SC_UI_ICON_COUNT; ++i) {
+        if (icons->surfaces[i]) {
+            SDL_FreeSurface(icons->surfaces[i]);
+            icons->surfaces[i] = NULL;
+        }
+    }
+}
+
+void
+sc_ui_icons_upload(struct sc_ui_icons *icons, SDL_Renderer *renderer) {
+    if (icons->uploaded) {
+        return;
+    }
+
+    sc_ui_icons_wait(icons);
+    icons->uploaded = true;
+
+    bool any = false;
+    for (unsigned i = 0; i < SC_UI_ICON_COUNT; ++i) {
+        if (icons->surfaces[i]) {
+            any = true;
+            break;
+        }
+    }
+
+    if (any) {
+        icons->texture = sc_ui_icons_create_texture(icons, renderer);
+    }
+    if (!icons->texture) {
+        for (unsigned i = 0; i < SC_UI_ICON_COUNT; ++i) {
+            icons->rects[i] = (SDL_Rect) {0, 0, 0, 0};
+        }
+    }
+
+    // The pixels are now owned by the texture
+    sc_ui_icons_free_surfaces(icons);
+}
+
+void
+sc_ui_icons_destroy(struct sc_ui_icons *icons) {
+    if (icons->thread_started) {
+        sc_thread_join(&icons->thread, NULL);
+    }
+    sc_ui_icons_free_surfaces(icons);
+    if (icons->texture) {
+        SDL_DestroyTexture(icons->texture);
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef SC_UI_ICONS_H
+#define SC_UI_ICONS_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+#include "util/thread.h"
+
+enum sc_ui_icon {
+    SC_UI_ICON_SCREENSHOT_BUTTON_BG,
+    SC_UI_ICON_INPUT_TOGGLE_BUTTON_BG,
+    SC_UI_ICON_SCREENSHOT,
+    SC_UI_ICON_SCREENSHOT_CHECK,
+    SC_UI_ICON_INPUT_TOGGLE,
+    SC_UI_ICON_SETTINGS,
+    SC_UI_ICON_COUNT,
+};
+
+/**
+ * Panel icons (optional images provided through environment variables)
+ *
+ * The images are decoded by a background thread, started as soon as possible
+ * (so that it runs while the window is created and the server connects), then
+ * packed into a single texture on upload.
+ */
+struct sc_ui_icons {
+    sc_thread thread;
+    bool thread_started;
+
+    // Written by the loader thread, read after it is joined
+    SDL_Surface *surfaces[SC_UI_ICON_COUNT];
+
+    bool uploaded;
+    SDL_Texture *texture; // the atlas containing all the icons, may be NULL
+    SDL_Rect rects[SC_UI_ICON_COUNT]; // location in the atlas, empty if absent
+};
+
+// Start decoding the icons in the background (never fails: on error, they
+// are decoded on upload)
+void
+sc_ui_icons_init(struct sc_ui_icons *icons);
+
+// Wait for the decoding and create the atlas texture (only the first call has
+// an effect)
+void
+sc_ui_icons_upload(struct sc_ui_icons *icons, SDL_Renderer *renderer);
+
+void
+sc_ui_icons_destroy(struct sc_ui_icons *icons);
+
+// Return the location of `icon` in icons->texture, or NULL if it is not
+// available
+static inline const SDL_Rect *
+sc_ui_icons_get(const struct sc_ui_icons *icons, enum sc_ui_icon icon) {
+    const SDL_Rect *rect = &icons->rects[icon];
+    return rect->w ? rect : NULL;
+}
+
+#endif
@@ -4,10 +4,12 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <libusb-1.0/libusb.h>
 
 #include "events.h"
+#include "hid/hid_mouse.h"
 #include "util/log.h"
 #include "util/str.h"
 #include "util/tick.h"
@@ -24,6 +26,10 @@
 // Drop droppable events above this limit
 #define SC_AOA_EVENT_QUEUE_LIMIT 60
 
+// Maximum number of HID events submitted but not completed yet (the control
+// transfers are queued in order on the endpoint 0)
+#define SC_AOA_MAX_INFLIGHT 4
+
 struct sc_vec_hid_ids SC_VECTOR(uint16_t);
 
 static void
@@ -78,7 +84,17 @@ sc_aoa_init(struct sc_aoa *aoa, struct sc_usb *usb,
         return false;
     }
 
+    if (!sc_cond_init(&aoa->inflight_cond)) {
+        sc_cond_destroy(&aoa->event_cond);
+        sc_mutex_destroy(&aoa->mutex);
+        sc_vecdeque_destroy(&aoa->queue);
+        return false;
+    }
+
     aoa->stopped = false;
+    // Async transfers are completed by the libusb event thread, if any
+    aoa->async = usb->has_libusb_event_thread;
+    aoa->inflight = 0;
     aoa->acksync = acksync;
     aoa->usb = usb;
 
@@ -89,6 +105,7 @@ void
 sc_aoa_destroy(struct sc_aoa *aoa) {
     sc_vecdeque_destroy(&aoa->queue);
 
+    sc_cond_destroy(&aoa->inflight_cond);
     sc_cond_destroy(&aoa->event_cond);
     sc_mutex_destroy(&aoa->mutex);
 }
@@ -178,6 +195,99 @@ sc_aoa_send_hid_event(struct sc_aoa *aoa,
     return true;
 }
 
+static void LIBUSB_CALL
+sc_aoa_on_hid_event_sent(struct libusb_transfer *transfer) {
+    struct sc_aoa *aoa = transfer->user_data;
+
+    if (transfer->status == LIBUSB_TRANSFER_NO_DEVICE) {
+        sc_usb_check_disconnected(aoa->usb, LIBUSB_ERROR_NO_DEVICE);
+    } else if (transfer->status != LIBUSB_TRANSFER_COMPLETED) {
+        LOGW("Could not send HID event to USB device (status %d)",
+             (int) transfer->status);
+    }
+
+    sc_mutex_lock(&aoa->mutex);
+    assert(aoa->inflight);
+    --aoa->inflight;
+    sc_cond_signal(&aoa->inflight_cond);
+    sc_mutex_unlock(&aoa->mutex);
+
+    // The transfer and its buffer are freed by libusb on return
+}
+
+static bool
+sc_aoa_submit_hid_event(struct sc_aoa *aoa,
+                        const struct sc_hid_input *hid_input) {
+    sc_mutex_lock(&aoa->mutex);
+    while (!aoa->stopped && aoa->inflight >= SC_AOA_MAX_INFLIGHT) {
+        sc_cond_wait(&aoa->inflight_cond, &aoa->mutex);
+    }
+    bool stopped = aoa->stopped;
+    sc_mutex_unlock(&aoa->mutex);
+
+    if (stopped) {
+        return false;
+    }
+
+    struct libusb_transfer *transfer = libusb_alloc_transfer(0);
+    if (!transfer) {
+        LOG_OOM();
+        return false;
+    }
+
+    // The buffer contains the setup packet followed by the data
+    unsigned char *buf = malloc(LIBUSB_CONTROL_SETUP_SIZE + hid_input->size);
+    if (!buf) {
+        LOG_OOM();
+        libusb_free_transfer(transfer);
+        return false;
+    }
+
+    // Same request as sc_aoa_send_hid_event()
+    uint8_t request_type = LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR;
+    libusb_fill_control_setup(buf, request_type, ACCESSORY_SEND_HID_EVENT,
+                              hid_input->hid_id, 0, hid_input->size);
+    memcpy(buf + LIBUSB_CONTROL_SETUP_SIZE, hid_input->data, hid_input->size);
+    libusb_fill_control_transfer(transfer, aoa->usb->handle, buf,
+                                 sc_aoa_on_hid_event_sent, aoa,
+                                 DEFAULT_TIMEOUT);
+    transfer->flags = LIBUSB_TRANSFER_FREE_BUFFER
+                    | LIBUSB_TRANSFER_FREE_TRANSFER;
+
+    sc_mutex_lock(&aoa->mutex);
+    ++aoa->inflight;
+    sc_mutex_unlock(&aoa->mutex);
+
+    int result = libusb_submit_transfer(transfer);
+    if (result < 0) {
+        LOGE("SEND_HID_EVENT: libusb error: %s", libusb_strerror(result));
+        sc_mutex_lock(&aoa->mutex);
+        --aoa->inflight;
+        sc_mutex_unlock(&aoa->mutex);
+        // The callback will not be called, release the transfer explicitly
+        libusb_free_transfer(transfer); // also frees buf (FREE_BUFFER)
+        sc_usb_check_disconnected(aoa->usb, result);
+        return false;
+    }
+
+    return true;
+}
+
+static void
+sc_aoa_wait_inflight(struct sc_aoa *aoa) {
+    // The libusb event thread may already be stopped, so handle the events
+    // from this thread until all the pending transfers are completed (they
+    // complete at the latest on timeout)
+    sc_mutex_lock(&aoa->mutex);
+    while (aoa->inflight) {
+        sc_mutex_unlock(&aoa->mutex);
+        struct timeval tv = {.tv_sec = 0, .tv_usec = 100000};
+        libusb_handle_events_timeout_completed(aoa->usb->context, &tv, NULL);
+        sc_mutex_lock(&aoa->mutex);
+    }
+    sc_mutex_unlock(&aoa->mutex);
+}
+
 static bool
 sc_aoa_unregister_hid(struct sc_aoa *aoa, uint16_t accessory_id) {
     uint8_t request_type = LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR;
@@ -234,6 +344,20 @@ sc_aoa_push_input_with_ack_to_wait(struct sc_aoa *aoa,
     bool pushed = false;
 
     size_t size = sc_vecdeque_size(&aoa->queue);
+    if (size && ack_to_wait == SC_SEQUENCE_INVALID) {
+        // The last queued event has not been sent yet (the AOA thread pops
+        // an event before its transfer), so a mouse report may be merged into
+        // it while the previous transfer is in flight: the queue stays short
+        // whatever the rate of the mouse
+        struct sc_aoa_event *last = sc_vecdeque_back_ref(&aoa->queue);
+        if (last->type == SC_AOA_EVENT_TYPE_INPUT
+                && last->input.ack_to_wait == SC_SEQUENCE_INVALID
+                && sc_hid_mouse_merge_input(&last->input.hid, hid_input)) {
+            sc_mutex_unlock(&aoa->mutex);
+            return true;
+        }
+    }
+
     if (size < SC_AOA_EVENT_QUEUE_LIMIT) {
         bool was_empty = sc_vecdeque_is_empty(&aoa->queue);
 
@@ -347,7 +471,8 @@ sc_aoa_process_event(struct sc_aoa *aoa, struct sc_aoa_event *event,
             }
 
             struct sc_hid_input *hid_input = &event->input.hid;
-            bool ok = sc_aoa_send_hid_event(aoa, hid_input);
+            bool ok = aoa->async ? sc_aoa_submit_hid_event(aoa, hid_input)
+                                 : sc_aoa_send_hid_event(aoa, hid_input);
             if (!ok) {
                 LOGW("Could not send HID event to USB device: %" PRIu16,
                      hid_input->hid_id);
@@ -430,6 +555,10 @@ run_aoa_thread(void *data) {
         }
     }
 
+    if (aoa->async) {
+        sc_aoa_wait_inflight(aoa);
+    }
+
     // Explicitly unregister all registered HID ids before exiting
     for (size_t i = 0; i < vec_open.size; ++i) {
         uint16_t hid_id = vec_open.data[i];
@@ -462,6 +591,7 @@ sc_aoa_stop(struct sc_aoa *aoa) {
     sc_mutex_lock(&aoa->mutex);
     aoa->stopped = true;
     sc_cond_signal(&aoa->event_cond);
+    sc_cond_signal(&aoa->inflight_cond);
     sc_mutex_unlock(&aoa->mutex);
 
     if (aoa->acksync) {
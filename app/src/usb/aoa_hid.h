@@ -45,6 +45,13 @@ struct sc_aoa {
     bool stopped;
     struct sc_aoa_event_queue queue;
 
+    // If set, HID events are sent by asynchronous transfers, completed on the
+    // libusb event thread, so that the next event may be submitted before the
+    // previous one is acknowledged by the device
+    bool async;
+    unsigned inflight; // number of pending async transfers, protected by mutex
+    sc_cond inflight_cond;
+
     struct sc_acksync *acksync;
 };
 
@@ -1,7 +1,9 @@
 #include "gamepad_aoa.h"
 
 #include <stdbool.h>
+#include <SDL2/SDL_timer.h>
 
+#include "events.h"
 #include "input_events.h"
 #include "util/log.h"
 
@@ -41,20 +43,63 @@ sc_gamepad_processor_process_gamepad_removed(struct sc_gamepad_processor *gp,
     }
 }
 
+static void
+sc_gamepad_aoa_flush(struct sc_gamepad_aoa *gamepad) {
+    struct sc_hid_input hid_inputs[SC_MAX_GAMEPADS];
+    size_t count = sc_hid_gamepad_flush(&gamepad->hid, hid_inputs,
+                                        sc_tick_now());
+    for (size_t i = 0; i < count; ++i) {
+        if (!sc_aoa_push_input(gamepad->aoa, &hid_inputs[i])) {
+            LOGW("Could not push AOA HID input (gamepad)");
+        }
+    }
+}
+
+static void
+sc_gamepad_aoa_run_flush(void *userdata) {
+    struct sc_gamepad_aoa *gamepad = userdata;
+
+    gamepad->flush_timer = 0;
+    sc_gamepad_aoa_flush(gamepad);
+}
+
+static uint32_t SDLCALL
+sc_gamepad_aoa_on_flush_timer(uint32_t interval, void *userdata) {
+    (void) interval;
+
+    // Called from the SDL timer thread
+    sc_post_to_main_thread(sc_gamepad_aoa_run_flush, userdata);
+    return 0; // single-shot
+}
+
 static void
 sc_gamepad_processor_process_gamepad_axis(struct sc_gamepad_processor *gp,
                                 const struct sc_gamepad_axis_event *event) {
     struct sc_gamepad_aoa *gamepad = DOWNCAST(gp);
 
-    struct sc_hid_input hid_input;
-    if (!sc_hid_gamepad_generate_input_from_axis(&gamepad->hid, &hid_input,
-                                                 event)) {
+    if (!sc_hid_gamepad_process_axis(&gamepad->hid, event)) {
+        return;
+    }
+
+    if (gamepad->flush_timer) {
+        // The latest state will be reported on timeout
         return;
     }
 
-    if (!sc_aoa_push_input(gamepad->aoa, &hid_input)) {
-        LOGW("Could not push AOA HID input (gamepad axis)");
+    sc_tick delay = sc_hid_gamepad_get_flush_delay(&gamepad->hid,
+                                                   sc_tick_now());
+    if (delay) {
+        // Round up to the next millisecond
+        uint32_t delay_ms = SC_TICK_TO_MS(delay + SC_TICK_FROM_MS(1) - 1);
+        gamepad->flush_timer =
+            SDL_AddTimer(delay_ms, sc_gamepad_aoa_on_flush_timer, gamepad);
+        if (gamepad->flush_timer) {
+            return;
+        }
+        LOGW("Could not add gamepad flush timer: %s", SDL_GetError());
     }
+
+    sc_gamepad_aoa_flush(gamepad);
 }
 
 static void
@@ -62,22 +107,22 @@ sc_gamepad_processor_process_gamepad_button(struct sc_gamepad_processor *gp,
                                 const struct sc_gamepad_button_event *event) {
     struct sc_gamepad_aoa *gamepad = DOWNCAST(gp);
 
-    struct sc_hid_input hid_input;
-    if (!sc_hid_gamepad_generate_input_from_button(&gamepad->hid, &hid_input,
-                                                   event)) {
+    if (!sc_hid_gamepad_process_button(&gamepad->hid, event)) {
         return;
     }
 
-    if (!sc_aoa_push_input(gamepad->aoa, &hid_input)) {
-        LOGW("Could not push AOA HID input (gamepad button)");
-    }
+    // Buttons are never delayed, so that no press is lost (pending axis
+    // changes are reported at the same time)
+    sc_gamepad_aoa_flush(gamepad);
 }
 
 void
-sc_gamepad_aoa_init(struct sc_gamepad_aoa *gamepad, struct sc_aoa *aoa) {
+sc_gamepad_aoa_init(struct sc_gamepad_aoa *gamepad, struct sc_aoa *aoa,
+                    sc_tick poll_interval) {
     gamepad->aoa = aoa;
+    gamepad->flush_timer = 0;
 
-    sc_hid_gamepad_init(&gamepad->hid);
+    sc_hid_gamepad_init(&gamepad->hid, poll_interval);
 
     static const struct sc_gamepad_processor_ops ops = {
         .process_gamepad_added = sc_gamepad_processor_process_gamepad_added,
@@ -91,6 +136,8 @@ sc_gamepad_aoa_init(struct sc_gamepad_aoa *gamepad, struct sc_aoa *aoa) {
 
 void
 sc_gamepad_aoa_destroy(struct sc_gamepad_aoa *gamepad) {
-    (void) gamepad;
-    // Do nothing, gamepad->aoa will automatically unregister all devices
+    if (gamepad->flush_timer) {
+        SDL_RemoveTimer(gamepad->flush_timer);
+    }
+    // gamepad->aoa will automatically unregister all devices
 }
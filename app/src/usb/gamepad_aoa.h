@@ -3,6 +3,8 @@
 
 #include "common.h"
 
+#include <SDL2/SDL_timer.h>
+
 #include "hid/hid_gamepad.h"
 #include "usb/aoa_hid.h"
 #include "trait/gamepad_processor.h"
@@ -12,10 +14,12 @@ struct sc_gamepad_aoa {
 
     struct sc_hid_gamepad hid;
     struct sc_aoa *aoa;
+    SDL_TimerID flush_timer; // 0 if no flush is scheduled
 };
 
 void
-sc_gamepad_aoa_init(struct sc_gamepad_aoa *gamepad, struct sc_aoa *aoa);
+sc_gamepad_aoa_init(struct sc_gamepad_aoa *gamepad, struct sc_aoa *aoa,
+                    sc_tick poll_interval);
 
 void
 sc_gamepad_aoa_destroy(struct sc_gamepad_aoa *gamepad);
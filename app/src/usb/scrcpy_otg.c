@@ -48,6 +48,12 @@ event_loop(struct scrcpy_otg *s) {
             case SDL_QUIT:
                 LOGD("User requested to quit");
                 return SCRCPY_EXIT_SUCCESS;
+            case SC_EVENT_RUN_ON_MAIN_THREAD: {
+                sc_runnable_fn run = event.user.data1;
+                void *userdata = event.user.data2;
+                run(userdata);
+                break;
+            }
             default:
                 sc_screen_otg_handle_event(&s->screen_otg, &event);
                 break;
@@ -173,7 +179,9 @@ scrcpy_otg(struct scrcpy_options *options) {
     }
 
     if (enable_gamepad) {
-        sc_gamepad_aoa_init(&s->gamepad, &s->aoa);
+        sc_tick interval =
+            sc_gamepad_poll_interval(options->gamepad_polling_rate);
+        sc_gamepad_aoa_init(&s->gamepad, &s->aoa, interval);
         gamepad = &s->gamepad;
     }
 
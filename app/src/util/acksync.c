@@ -35,7 +35,8 @@ sc_acksync_ack(struct sc_acksync *as, uint64_t sequence) {
     assert(sequence >= as->ack);
 
     as->ack = sequence;
-    sc_cond_signal(&as->cond);
+    // There may be several waiters, for different sequences
+    sc_cond_broadcast(&as->cond);
 
     sc_mutex_unlock(&as->mutex);
 }
@@ -70,6 +71,6 @@ void
 sc_acksync_interrupt(struct sc_acksync *as) {
     sc_mutex_lock(&as->mutex);
     as->stopped = true;
-    sc_cond_signal(&as->cond);
+    sc_cond_broadcast(&as->cond);
     sc_mutex_unlock(&as->mutex);
 }
@@ -0,0 +1,81 @@
+#include "audio_plc.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/log.h"
+
+bool
+sc_audio_plc_init(struct sc_audio_plc *plc, unsigned channels, uint32_t period,
+                  uint32_t fade) {
+    assert(channels);
+    assert(period);
+
+    plc->history = malloc(period * channels * sizeof(float));
+    if (!plc->history) {
+        LOG_OOM();
+        return false;
+    }
+
+    plc->channels = channels;
+    plc->period = period;
+    plc->len = 0;
+    plc->fade = fade;
+    plc->concealed = 0;
+
+    return true;
+}
+
+void
+sc_audio_plc_destroy(struct sc_audio_plc *plc) {
+    free(plc->history);
+}
+
+void
+sc_audio_plc_record(struct sc_audio_plc *plc, const float *samples,
+                    uint32_t count) {
+    if (!count) {
+        return;
+    }
+
+    unsigned channels = plc->channels;
+    if (count >= plc->period) {
+        // Keep only the last period
+        memcpy(plc->history, samples + (count - plc->period) * channels,
+               plc->period * channels * sizeof(float));
+        plc->len = plc->period;
+    } else {
+        // Keep the most recent part of the history, then append the samples
+        uint32_t keep = MIN(plc->len, plc->period - count);
+        memmove(plc->history, plc->history + (plc->len - keep) * channels,
+                keep * channels * sizeof(float));
+        memcpy(plc->history + keep * channels, samples,
+               count * channels * sizeof(float));
+        plc->len = keep + count;
+    }
+
+    plc->concealed = 0;
+}
+
+void
+sc_audio_plc_conceal(struct sc_audio_plc *plc, float *out, uint32_t count) {
+    unsigned channels = plc->channels;
+
+    uint32_t i = 0;
+    if (plc->len) {
+        for (; i < count && plc->concealed < plc->fade; ++i) {
+            // Linear fade-out, so that the repetition is not audible as such
+            float gain = 1.f - (float) plc->concealed / plc->fade;
+            const float *src =
+                &plc->history[(plc->concealed % plc->len) * channels];
+            for (unsigned c = 0; c < channels; ++c) {
+                out[i * channels + c] = gain * src[c];
+            }
+            ++plc->concealed;
+        }
+    }
+
+    // Silence after the fade-out
+    memset(out + i * channels, 0, (count - i) * channels * sizeof(float));
+}
@@ -0,0 +1,44 @@
+#ifndef SC_AUDIO_PLC_H
+#define SC_AUDIO_PLC_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Audio packet loss concealment
+ *
+ * When samples are missing (typically because packets arrive too late), play
+ * the last received samples again, faded out, instead of inserting silence.
+ *
+ * The samples are interleaved floats.
+ */
+struct sc_audio_plc {
+    float *history; // the last received samples
+    unsigned channels;
+    uint32_t period; // capacity of history, in samples
+    uint32_t len; // number of valid samples in history
+    uint32_t fade; // duration of the fade-out, in samples
+    uint32_t concealed; // samples concealed since the last received sample
+};
+
+// `period` is the number of last samples repeated, `fade` the duration (in
+// samples) after which the concealment produces silence
+bool
+sc_audio_plc_init(struct sc_audio_plc *plc, unsigned channels, uint32_t period,
+                  uint32_t fade);
+
+void
+sc_audio_plc_destroy(struct sc_audio_plc *plc);
+
+// Record received samples
+void
+sc_audio_plc_record(struct sc_audio_plc *plc, const float *samples,
+                    uint32_t count);
+
+// Generate `count` samples replacing missing ones
+void
+sc_audio_plc_conceal(struct sc_audio_plc *plc, float *out, uint32_t count);
+
+#endif
@@ -38,42 +38,47 @@ sc_audiobuf_read(struct sc_audiobuf *buf, void *to_, uint32_t samples_count) {
 
     uint8_t *to = to_;
 
-    // Only the reader thread can write tail without synchronization, so
-    // memory_order_relaxed is sufficient
-    uint32_t tail = atomic_load_explicit(&buf->tail, memory_order_relaxed);
-
-    // The head cursor is updated after the data is written to the array
-    uint32_t head = atomic_load_explicit(&buf->head, memory_order_acquire);
+    // The writer may also move tail forward (sc_audiobuf_drop())
+    uint32_t tail = atomic_load_explicit(&buf->tail, memory_order_acquire);
 
-    uint32_t can_read = (buf->alloc_size + head - tail) % buf->alloc_size;
-    if (!can_read) {
-        return 0;
-    }
-    if (samples_count > can_read) {
-        samples_count = can_read;
-    }
+    for (;;) {
+        // The head cursor is updated after the data is written to the array
+        uint32_t head = atomic_load_explicit(&buf->head, memory_order_acquire);
 
-    if (to) {
-        uint32_t right_count = buf->alloc_size - tail;
-        if (right_count > samples_count) {
-            right_count = samples_count;
+        uint32_t can_read = (buf->alloc_size + head - tail) % buf->alloc_size;
+        if (!can_read) {
+            return 0;
         }
-        memcpy(to,
-               buf->data + (tail * buf->sample_size),
-               right_count * buf->sample_size);
-
-        if (samples_count > right_count) {
-            uint32_t left_count = samples_count - right_count;
-            memcpy(to + (right_count * buf->sample_size),
-                   buf->data,
-                   left_count * buf->sample_size);
+        uint32_t count = MIN(samples_count, can_read);
+
+        if (to) {
+            uint32_t right_count = buf->alloc_size - tail;
+            if (right_count > count) {
+                right_count = count;
+            }
+            memcpy(to,
+                   buf->data + (tail * buf->sample_size),
+                   right_count * buf->sample_size);
+
+            if (count > right_count) {
+                uint32_t left_count = count - right_count;
+                memcpy(to + (right_count * buf->sample_size),
+                       buf->data,
+                       left_count * buf->sample_size);
+            }
         }
-    }
 
-    uint32_t new_tail = (tail + samples_count) % buf->alloc_size;
-    atomic_store_explicit(&buf->tail, new_tail, memory_order_release);
+        uint32_t new_tail = (tail + count) % buf->alloc_size;
+        if (atomic_compare_exchange_weak_explicit(&buf->tail, &tail, new_tail,
+                                                  memory_order_release,
+                                                  memory_order_acquire)) {
+            return count;
+        }
 
-    return samples_count;
+        // The writer dropped samples concurrently, so the data copied may
+        // have been overwritten: retry from the new tail (updated by the
+        // compare-and-swap)
+    }
 }
 
 uint32_t
@@ -151,3 +156,30 @@ sc_audiobuf_write_silence(struct sc_audiobuf *buf, uint32_t samples_count) {
 
     return samples_count;
 }
+
+uint32_t
+sc_audiobuf_drop(struct sc_audiobuf *buf, uint32_t samples_count) {
+    // Only the writer thread can write head, so memory_order_relaxed is
+    // sufficient
+    uint32_t head = atomic_load_explicit(&buf->head, memory_order_relaxed);
+
+    // The tail cursor is updated after the data is consumed by the reader
+    uint32_t tail = atomic_load_explicit(&buf->tail, memory_order_acquire);
+
+    for (;;) {
+        uint32_t can_read = (buf->alloc_size + head - tail) % buf->alloc_size;
+        uint32_t count = MIN(samples_count, can_read);
+        if (!count) {
+            return 0;
+        }
+
+        // Once tail is updated, the writer may overwrite the dropped samples,
+        // so the writes must not be reordered before (acquire)
+        uint32_t new_tail = (tail + count) % buf->alloc_size;
+        if (atomic_compare_exchange_weak_explicit(&buf->tail, &tail, new_tail,
+                                                  memory_order_acq_rel,
+                                                  memory_order_acquire)) {
+            return count;
+        }
+    }
+}
@@ -9,10 +9,17 @@
 #include <stddef.h>
 #include <stdint.h>
 
+// Assumed size of a cache line, to avoid false sharing
+#define SC_AUDIOBUF_CACHE_LINE_SIZE 64
+
 /**
- * Wrapper around bytebuf to read and write samples
+ * Lock-free single-producer single-consumer ring buffer of samples
  *
  * Each sample takes sample_size bytes.
+ *
+ * The writer may also drop the oldest samples (when the buffer is full) using
+ * sc_audiobuf_drop(), so the tail cursor is updated by compare-and-swap: the
+ * reader never blocks.
  */
 struct sc_audiobuf {
     uint8_t *data;
@@ -20,6 +27,9 @@ struct sc_audiobuf {
     size_t sample_size;
 
     atomic_uint_least32_t head; // writer cursor, in samples
+    // Keep head and tail on separate cache lines, since they are written by
+    // different threads
+    uint8_t pad[SC_AUDIOBUF_CACHE_LINE_SIZE];
     atomic_uint_least32_t tail; // reader cursor, in samples
     // empty: tail == head
     // full: ((tail + 1) % alloc_size) == head
@@ -53,6 +63,17 @@ sc_audiobuf_write(struct sc_audiobuf *buf, const void *from,
 uint32_t
 sc_audiobuf_write_silence(struct sc_audiobuf *buf, uint32_t samples);
 
+/**
+ * Drop (at most) the `samples` oldest samples
+ *
+ * It must be called from the writer thread. It may drop fewer samples if the
+ * reader consumed them concurrently.
+ *
+ * Return the number of samples dropped.
+ */
+uint32_t
+sc_audiobuf_drop(struct sc_audiobuf *buf, uint32_t samples);
+
 static inline uint32_t
 sc_audiobuf_capacity(struct sc_audiobuf *buf) {
     assert(buf->alloc_size);
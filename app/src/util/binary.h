@@ -63,6 +63,11 @@ sc_read64be(const uint8_t *buf) {
     return ((uint64_t) msb << 32) | lsb;
 }
 
+static inline uint32_t
+sc_read32le(const uint8_t *buf) {
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t) buf[3] << 24);
+}
+
 /**
  * Convert a float between 0 and 1 to an unsigned 16-bit fixed-point value
  */
@@ -4,6 +4,7 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef _WIN32
 # define SC_PATH_SEPARATOR '\\'
@@ -46,4 +47,18 @@ sc_file_get_local_path(const char *name);
 bool
 sc_file_is_regular(const char *path);
 
+/**
+ * Get the size of a file (in bytes)
+ *
+ * Nothing is logged on error (this may be used to check if a file exists).
+ */
+bool
+sc_file_get_size(const char *path, uint64_t *size);
+
+/**
+ * Delete a file
+ */
+bool
+sc_file_remove(const char *path);
+
 #endif
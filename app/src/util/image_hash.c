@@ -0,0 +1,71 @@
+#include "image_hash.h"
+
+#include <assert.h>
+
+// 64-bit FNV-1a
+#define SC_FNV_OFFSET_BASIS UINT64_C(0xcbf29ce484222325)
+#define SC_FNV_PRIME UINT64_C(0x100000001b3)
+
+static inline uint64_t
+sc_fnv_update(uint64_t hash, uint8_t byte) {
+    return (hash ^ byte) * SC_FNV_PRIME;
+}
+
+static uint64_t
+sc_fnv_update32(uint64_t hash, uint32_t value) {
+    for (unsigned i = 0; i < 4; ++i) {
+        hash = sc_fnv_update(hash, value >> (i * 8));
+    }
+    return hash;
+}
+
+static uint64_t
+sc_image_hash_cell_luma(const uint8_t *pixels, size_t pitch, unsigned x0,
+                        unsigned x1, unsigned y0, unsigned y1) {
+    uint64_t sum = 0;
+    for (unsigned y = y0; y < y1; ++y) {
+        const uint8_t *p = pixels + y * pitch + x0 * 4;
+        for (unsigned x = x0; x < x1; ++x) {
+            // BT.601 luma, in fixed point (the weights sum to 256)
+            sum += (77 * p[0] + 150 * p[1] + 29 * p[2]) >> 8;
+            p += 4;
+        }
+    }
+
+    uint64_t count = (uint64_t) (x1 - x0) * (y1 - y0);
+    return sum / count;
+}
+
+uint64_t
+sc_image_hash_rgba8888(const uint8_t *pixels, size_t pitch, unsigned width,
+                       unsigned height) {
+    assert(pixels);
+    assert(width && height);
+    assert(pitch >= (size_t) width * 4);
+
+    uint64_t hash = SC_FNV_OFFSET_BASIS;
+    hash = sc_fnv_update32(hash, width);
+    hash = sc_fnv_update32(hash, height);
+
+    for (unsigned row = 0; row < SC_IMAGE_HASH_GRID; ++row) {
+        unsigned y0 = row * height / SC_IMAGE_HASH_GRID;
+        unsigned y1 = (row + 1) * height / SC_IMAGE_HASH_GRID;
+        if (y0 == y1) {
+            // Image smaller than the grid
+            continue;
+        }
+        for (unsigned col = 0; col < SC_IMAGE_HASH_GRID; ++col) {
+            unsigned x0 = col * width / SC_IMAGE_HASH_GRID;
+            unsigned x1 = (col + 1) * width / SC_IMAGE_HASH_GRID;
+            if (x0 == x1) {
+                continue;
+            }
+            uint64_t luma =
+                sc_image_hash_cell_luma(pixels, pitch, x0, x1, y0, y1);
+            // Ignore the least significant bits (noise)
+            hash = sc_fnv_update(hash, luma >> 2);
+        }
+    }
+
+    return hash;
+}
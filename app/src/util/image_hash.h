@@ -0,0 +1,25 @@
+#ifndef SC_IMAGE_HASH_H
+#define SC_IMAGE_HASH_H
+
+#include "common.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of cells of the downsampled image, in each dimension
+#define SC_IMAGE_HASH_GRID 32
+
+/**
+ * Compute a perceptual hash of an RGBA8888 image
+ *
+ * The image is downsampled to SC_IMAGE_HASH_GRID x SC_IMAGE_HASH_GRID cells,
+ * whose average luma (quantized to 6 bits) is hashed along with the image
+ * size. Two images have the same hash if they are the same size and differ
+ * at most by noise (but a change visible at the scale of a cell, like a
+ * modified text, changes the hash).
+ */
+uint64_t
+sc_image_hash_rgba8888(const uint8_t *pixels, size_t pitch, unsigned width,
+                       unsigned height);
+
+#endif
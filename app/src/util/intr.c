@@ -74,6 +74,15 @@ sc_intr_interrupt(struct sc_intr *intr) {
     sc_mutex_unlock(&intr->mutex);
 }
 
+void
+sc_intr_reset(struct sc_intr *intr) {
+    sc_mutex_lock(&intr->mutex);
+    assert(intr->socket == SC_SOCKET_NONE);
+    assert(intr->process == SC_PROCESS_NONE);
+    atomic_store_explicit(&intr->interrupted, false, memory_order_relaxed);
+    sc_mutex_unlock(&intr->mutex);
+}
+
 void
 sc_intr_destroy(struct sc_intr *intr) {
     assert(intr->socket == SC_SOCKET_NONE);
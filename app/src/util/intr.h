@@ -58,6 +58,14 @@ sc_intr_set_process(struct sc_intr *intr, sc_pid socket);
 void
 sc_intr_interrupt(struct sc_intr *intr);
 
+/**
+ * Reset the interrupted state, to reuse the interruptor
+ *
+ * No component must be registered.
+ */
+void
+sc_intr_reset(struct sc_intr *intr);
+
 /**
  * Read the interrupted state
  *
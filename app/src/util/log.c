@@ -9,86 +9,83 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
 #include <libavutil/log.h>
 
-#define SC_SESSION_LOG_MAX_LENGTH (1 << 20) // 1 MiB
-#define SC_SESSION_LOG_INITIAL_CAPACITY 4096
+#define SC_SESSION_LOG_CAPACITY (1 << 20) // 1 MiB
+#define SC_SESSION_LOG_MAX_LINES (1 << 14)
+#define SC_LOG_QUEUE_CAPACITY 1024
 
+// The session log is a circular buffer of text, allocated on the first log,
+// with a circular buffer of line lengths to drop the oldest lines as a whole.
+// Appending a line only copies it (nothing is moved), so the lock is held
+// briefly.
 static SDL_SpinLock sc_session_log_lock = 0;
 static char *sc_session_log;
+static size_t sc_session_log_head; // offset of the oldest byte
 static size_t sc_session_log_len;
-static size_t sc_session_log_cap;
+static uint32_t sc_session_log_lines[SC_SESSION_LOG_MAX_LINES];
+static size_t sc_session_log_lines_head; // index of the oldest line
+static size_t sc_session_log_lines_count;
 
-static bool
-sc_session_log_reserve(size_t required) {
-    if (required <= sc_session_log_cap) {
-        return true;
-    }
-
-    size_t new_cap = sc_session_log_cap
-        ? sc_session_log_cap
-        : SC_SESSION_LOG_INITIAL_CAPACITY;
-    while (new_cap < required) {
-        new_cap *= 2;
-    }
-
-    char *new_buf = realloc(sc_session_log, new_cap);
-    if (!new_buf) {
-        return false;
-    }
-
-    sc_session_log = new_buf;
-    sc_session_log_cap = new_cap;
-    return true;
+static void
+sc_session_log_drop_oldest_line(void) {
+    assert(sc_session_log_lines_count);
+    size_t line_len = sc_session_log_lines[sc_session_log_lines_head];
+    assert(line_len <= sc_session_log_len);
+
+    sc_session_log_head =
+        (sc_session_log_head + line_len) % SC_SESSION_LOG_CAPACITY;
+    sc_session_log_len -= line_len;
+    sc_session_log_lines_head =
+        (sc_session_log_lines_head + 1) % SC_SESSION_LOG_MAX_LINES;
+    --sc_session_log_lines_count;
 }
 
 static void
-sc_session_log_trim(size_t append_len) {
-    size_t required = sc_session_log_len + append_len;
-    if (required <= SC_SESSION_LOG_MAX_LENGTH) {
-        return;
-    }
-
-    size_t drop = required - SC_SESSION_LOG_MAX_LENGTH;
-    if (drop >= sc_session_log_len) {
-        sc_session_log_len = 0;
-        return;
-    }
-
-    // Trim full lines when possible.
-    while (drop < sc_session_log_len && sc_session_log[drop] != '\n') {
-        ++drop;
-    }
-    if (drop < sc_session_log_len) {
-        ++drop; // include '\n'
-    }
-
-    memmove(sc_session_log, &sc_session_log[drop], sc_session_log_len - drop);
-    sc_session_log_len -= drop;
+sc_session_log_write(const char *data, size_t len) {
+    size_t tail =
+        (sc_session_log_head + sc_session_log_len) % SC_SESSION_LOG_CAPACITY;
+    size_t first = MIN(len, SC_SESSION_LOG_CAPACITY - tail);
+    memcpy(&sc_session_log[tail], data, first);
+    memcpy(sc_session_log, &data[first], len - first);
+    sc_session_log_len += len;
 }
 
 static void
 sc_session_log_append(const char *prio_name, const char *message) {
     size_t prio_len = strlen(prio_name);
     size_t message_len = strlen(message);
-    size_t line_len = prio_len + 2 + message_len + 1; // "PRIO: MSG\n"
+    // "PRIO: MSG\n", truncated if it does not fit in the whole buffer
+    message_len = MIN(message_len, SC_SESSION_LOG_CAPACITY - prio_len - 3);
+    size_t line_len = prio_len + 2 + message_len + 1;
 
     SDL_AtomicLock(&sc_session_log_lock);
 
-    sc_session_log_trim(line_len);
-
-    size_t required = sc_session_log_len + line_len + 1;
-    bool ok = sc_session_log_reserve(required);
-    if (ok) {
-        char *dst = &sc_session_log[sc_session_log_len];
-        memcpy(dst, prio_name, prio_len);
-        memcpy(&dst[prio_len], ": ", 2);
-        memcpy(&dst[prio_len + 2], message, message_len);
-        dst[prio_len + 2 + message_len] = '\n';
-        sc_session_log_len += line_len;
-        sc_session_log[sc_session_log_len] = '\0';
+    if (!sc_session_log) {
+        sc_session_log = malloc(SC_SESSION_LOG_CAPACITY);
+        if (!sc_session_log) {
+            SDL_AtomicUnlock(&sc_session_log_lock);
+            return;
+        }
     }
 
+    while (sc_session_log_len + line_len > SC_SESSION_LOG_CAPACITY
+            || sc_session_log_lines_count == SC_SESSION_LOG_MAX_LINES) {
+        sc_session_log_drop_oldest_line();
+    }
+
+    sc_session_log_write(prio_name, prio_len);
+    sc_session_log_write(": ", 2);
+    sc_session_log_write(message, message_len);
+    sc_session_log_write("\n", 1);
+
+    size_t idx = (sc_session_log_lines_head + sc_session_log_lines_count)
+               % SC_SESSION_LOG_MAX_LINES;
+    sc_session_log_lines[idx] = line_len;
+    ++sc_session_log_lines_count;
+
     SDL_AtomicUnlock(&sc_session_log_lock);
 }
 
@@ -220,17 +217,195 @@ static const char *const sc_sdl_log_priority_names[SDL_NUM_LOG_PRIORITIES] = {
     [SDL_LOG_PRIORITY_CRITICAL] = "CRITICAL",
 };
 
+static void
+sc_log_output(SDL_LogPriority priority, const char *message) {
+    FILE *out = priority < SDL_LOG_PRIORITY_WARN ? stdout : stderr;
+    assert(priority < SDL_NUM_LOG_PRIORITIES);
+    const char *prio_name = sc_sdl_log_priority_names[priority];
+    sc_session_log_append(prio_name, message);
+    fprintf(out, "%s: %s\n", prio_name, message);
+}
+
+// The log writer uses the SDL primitives directly rather than util/thread,
+// which logs (and is not linked by the tests using util/log).
+struct sc_log_entry {
+    SDL_LogPriority priority;
+    char *message; // owned
+};
+
+static struct {
+    SDL_mutex *mutex;
+    SDL_cond *cond; // signaled when a message is pushed or on stop
+    SDL_cond *cond_idle; // signaled when all the messages are written
+    SDL_Thread *thread;
+    struct sc_log_entry queue[SC_LOG_QUEUE_CAPACITY];
+    size_t head; // index of the oldest entry
+    size_t count;
+    unsigned dropped;
+    bool running; // messages are queued only while running
+    bool stopped;
+    bool writing;
+} sc_log_writer;
+
+static int SDLCALL
+run_log_writer(void *data) {
+    (void) data;
+
+    SDL_LockMutex(sc_log_writer.mutex);
+    for (;;) {
+        while (!sc_log_writer.stopped && !sc_log_writer.count
+                && !sc_log_writer.dropped) {
+            SDL_CondWait(sc_log_writer.cond, sc_log_writer.mutex);
+        }
+
+        if (!sc_log_writer.count && !sc_log_writer.dropped) {
+            // stopped, and all the pending messages are written
+            assert(sc_log_writer.stopped);
+            break;
+        }
+
+        struct sc_log_entry entry = {0};
+        if (sc_log_writer.count) {
+            entry = sc_log_writer.queue[sc_log_writer.head];
+            sc_log_writer.head =
+                (sc_log_writer.head + 1) % SC_LOG_QUEUE_CAPACITY;
+            --sc_log_writer.count;
+        }
+        unsigned dropped = sc_log_writer.dropped;
+        sc_log_writer.dropped = 0;
+        sc_log_writer.writing = true;
+        SDL_UnlockMutex(sc_log_writer.mutex);
+
+        if (dropped) {
+            char msg[64];
+            snprintf(msg, sizeof(msg), "%u log messages dropped", dropped);
+            sc_log_output(SDL_LOG_PRIORITY_WARN, msg);
+        }
+
+        if (entry.message) {
+            sc_log_output(entry.priority, entry.message);
+            free(entry.message);
+        }
+
+        SDL_LockMutex(sc_log_writer.mutex);
+        sc_log_writer.writing = false;
+        if (!sc_log_writer.count && !sc_log_writer.dropped) {
+            SDL_CondBroadcast(sc_log_writer.cond_idle);
+        }
+    }
+    SDL_UnlockMutex(sc_log_writer.mutex);
+
+    return 0;
+}
+
+// Return false if the message must be written synchronously
+static bool
+sc_log_writer_push(SDL_LogPriority priority, const char *message) {
+    if (!sc_log_writer.mutex) {
+        // not configured
+        return false;
+    }
+
+    SDL_LockMutex(sc_log_writer.mutex);
+    if (!sc_log_writer.running) {
+        SDL_UnlockMutex(sc_log_writer.mutex);
+        return false;
+    }
+
+    if (sc_log_writer.count == SC_LOG_QUEUE_CAPACITY) {
+        // Never block the caller, the writer reports the dropped messages
+        ++sc_log_writer.dropped;
+        SDL_UnlockMutex(sc_log_writer.mutex);
+        return true;
+    }
+
+    char *copy = strdup(message);
+    if (!copy) {
+        SDL_UnlockMutex(sc_log_writer.mutex);
+        return false;
+    }
+
+    size_t idx = (sc_log_writer.head + sc_log_writer.count)
+               % SC_LOG_QUEUE_CAPACITY;
+    sc_log_writer.queue[idx].priority = priority;
+    sc_log_writer.queue[idx].message = copy;
+    if (!sc_log_writer.count++) {
+        SDL_CondSignal(sc_log_writer.cond);
+    }
+    SDL_UnlockMutex(sc_log_writer.mutex);
+
+    return true;
+}
+
+static void
+sc_log_writer_flush(void) {
+    if (!sc_log_writer.mutex) {
+        return;
+    }
+
+    SDL_LockMutex(sc_log_writer.mutex);
+    while (sc_log_writer.running && (sc_log_writer.count
+                                     || sc_log_writer.dropped
+                                     || sc_log_writer.writing)) {
+        SDL_CondWait(sc_log_writer.cond_idle, sc_log_writer.mutex);
+    }
+    SDL_UnlockMutex(sc_log_writer.mutex);
+}
+
+static bool
+sc_log_writer_start(void) {
+    // The mutex and the conditions are never destroyed, so that logging from
+    // a thread still running on shutdown remains safe
+    sc_log_writer.mutex = SDL_CreateMutex();
+    if (!sc_log_writer.mutex) {
+        return false;
+    }
+
+    sc_log_writer.cond = SDL_CreateCond();
+    sc_log_writer.cond_idle = SDL_CreateCond();
+    if (!sc_log_writer.cond || !sc_log_writer.cond_idle) {
+        goto error;
+    }
+
+    sc_log_writer.head = 0;
+    sc_log_writer.count = 0;
+    sc_log_writer.dropped = 0;
+    sc_log_writer.stopped = false;
+    sc_log_writer.writing = false;
+
+    sc_log_writer.thread =
+        SDL_CreateThread(run_log_writer, "scrcpy-log", NULL);
+    if (!sc_log_writer.thread) {
+        goto error;
+    }
+
+    SDL_LockMutex(sc_log_writer.mutex);
+    sc_log_writer.running = true;
+    SDL_UnlockMutex(sc_log_writer.mutex);
+
+    return true;
+
+error:
+    if (sc_log_writer.cond_idle) {
+        SDL_DestroyCond(sc_log_writer.cond_idle);
+    }
+    if (sc_log_writer.cond) {
+        SDL_DestroyCond(sc_log_writer.cond);
+    }
+    SDL_DestroyMutex(sc_log_writer.mutex);
+    sc_log_writer.mutex = NULL;
+    return false;
+}
+
 static void SDLCALL
 sc_sdl_log_print(void *userdata, int category, SDL_LogPriority priority,
                  const char *message) {
     (void) userdata;
     (void) category;
 
-    FILE *out = priority < SDL_LOG_PRIORITY_WARN ? stdout : stderr;
-    assert(priority < SDL_NUM_LOG_PRIORITIES);
-    const char *prio_name = sc_sdl_log_priority_names[priority];
-    sc_session_log_append(prio_name, message);
-    fprintf(out, "%s: %s\n", prio_name, message);
+    if (!sc_log_writer_push(priority, message)) {
+        sc_log_output(priority, message);
+    }
 }
 
 void
@@ -238,17 +413,48 @@ sc_log_configure(void) {
     SDL_LogSetOutputFunction(sc_sdl_log_print, NULL);
     // Redirect FFmpeg logs to SDL logs
     av_log_set_callback(sc_av_log_callback);
+
+    if (!sc_log_writer_start()) {
+        LOGW("Could not start log writer, logging synchronously");
+    }
+}
+
+void
+sc_log_shutdown(void) {
+    if (!sc_log_writer.mutex) {
+        return;
+    }
+
+    SDL_LockMutex(sc_log_writer.mutex);
+    bool running = sc_log_writer.running;
+    // The next messages are written synchronously
+    sc_log_writer.running = false;
+    sc_log_writer.stopped = true;
+    SDL_CondSignal(sc_log_writer.cond);
+    SDL_UnlockMutex(sc_log_writer.mutex);
+
+    if (running) {
+        // The pending messages are written before the thread terminates
+        SDL_WaitThread(sc_log_writer.thread, NULL);
+        sc_log_writer.thread = NULL;
+    }
 }
 
 char *
 sc_log_get_session_text(void) {
+    // Include the messages logged so far
+    sc_log_writer_flush();
+
     SDL_AtomicLock(&sc_session_log_lock);
 
     size_t len = sc_session_log_len;
     char *copy = malloc(len + 1);
     if (copy) {
-        if (len && sc_session_log) {
-            memcpy(copy, sc_session_log, len);
+        // Linearize the circular buffer
+        size_t first = MIN(len, SC_SESSION_LOG_CAPACITY - sc_session_log_head);
+        if (len) {
+            memcpy(copy, &sc_session_log[sc_session_log_head], first);
+            memcpy(&copy[first], sc_session_log, len - first);
         }
         copy[len] = '\0';
     }
@@ -3,7 +3,11 @@
 
 #include "common.h"
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL_atomic.h>
 #include <SDL2/SDL_log.h>
+#include <SDL2/SDL_timer.h>
 
 #include "options.h"
 
@@ -13,8 +17,64 @@
 #define LOGV(...) SDL_LogVerbose(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
 #define LOGD(...) SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
 #define LOGI(...) SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
-#define LOGW(...) SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
-#define LOGE(...) SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, __VA_ARGS__)
+#define LOGW(...) LOG_RATELIMITED_(SDL_LOG_PRIORITY_WARN, __VA_ARGS__)
+#define LOGE(...) LOG_RATELIMITED_(SDL_LOG_PRIORITY_ERROR, __VA_ARGS__)
+
+// Warnings and errors are rate limited per call site: at most
+// SC_LOG_RATELIMIT_BURST messages per SC_LOG_RATELIMIT_INTERVAL_MS are logged,
+// the next ones are only counted, and reported along with the next message
+// logged from the same call site.
+#define SC_LOG_RATELIMIT_INTERVAL_MS 5000
+#define SC_LOG_RATELIMIT_BURST 10
+
+struct sc_log_ratelimit {
+    SDL_SpinLock lock;
+    uint32_t window_start; // in SDL ticks (ms)
+    unsigned logged; // in the current window
+    unsigned suppressed; // in the current window
+};
+
+// Inline, so that logging does not require to link any additional source
+static inline bool
+sc_log_ratelimit_acquire(struct sc_log_ratelimit *rl, unsigned *suppressed) {
+    uint32_t now = SDL_GetTicks();
+
+    SDL_AtomicLock(&rl->lock);
+    *suppressed = 0;
+    if (!rl->logged
+            || now - rl->window_start >= SC_LOG_RATELIMIT_INTERVAL_MS) {
+        *suppressed = rl->suppressed;
+        rl->window_start = now;
+        rl->logged = 0;
+        rl->suppressed = 0;
+    }
+
+    bool ok = rl->logged < SC_LOG_RATELIMIT_BURST;
+    if (ok) {
+        ++rl->logged;
+    } else {
+        ++rl->suppressed;
+    }
+    SDL_AtomicUnlock(&rl->lock);
+
+    return ok;
+}
+
+#define LOG_RATELIMITED_(PRIORITY, ...) \
+    do { \
+        static struct sc_log_ratelimit sc_log_ratelimit_; \
+        unsigned sc_log_suppressed_; \
+        if (sc_log_ratelimit_acquire(&sc_log_ratelimit_, \
+                                     &sc_log_suppressed_)) { \
+            if (sc_log_suppressed_) { \
+                SDL_LogMessage(SDL_LOG_CATEGORY_APPLICATION, (PRIORITY), \
+                               "Message repeated %u times (%s:%d)", \
+                               sc_log_suppressed_, __FILE__, __LINE__); \
+            } \
+            SDL_LogMessage(SDL_LOG_CATEGORY_APPLICATION, (PRIORITY), \
+                           __VA_ARGS__); \
+        } \
+    } while (0)
 
 #define LOG_OOM() \
     LOGE("OOM: %s:%d %s()", __FILE__, __LINE__, __func__)
@@ -35,9 +95,25 @@ bool
 sc_log_windows_error(const char *prefix, int error);
 #endif
 
+/**
+ * Redirect the SDL and FFmpeg logs, and start the log writer thread
+ *
+ * Once configured, the messages are written to the console and to the session
+ * log asynchronously, so that logging never blocks the caller on the console
+ * output. If the writer does not keep up, the messages are dropped (and the
+ * number of dropped messages is reported).
+ */
 void
 sc_log_configure(void);
 
+/**
+ * Write all the pending messages, and stop the log writer thread
+ *
+ * The next messages are written synchronously.
+ */
+void
+sc_log_shutdown(void);
+
 // Return a heap-allocated copy of current session logs.
 // The caller must free() the returned pointer.
 char *
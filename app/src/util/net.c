@@ -1,6 +1,7 @@
 #include "net.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -12,9 +13,12 @@
 # include <fcntl.h>
 # include <netinet/in.h>
 # include <netinet/tcp.h>
+# include <poll.h>
 # include <unistd.h>
 # include <sys/socket.h>
+# include <sys/time.h>
 # include <sys/types.h>
+# include <sys/uio.h>
 # define SOCKET_ERROR -1
   typedef struct sockaddr_in SOCKADDR_IN;
   typedef struct sockaddr SOCKADDR;
@@ -117,12 +121,12 @@ net_perror(const char *s) {
 #endif
 }
 
-sc_socket
-net_socket(void) {
+static sc_socket
+net_socket_with_type(int type) {
 #ifdef HAVE_SOCK_CLOEXEC
-    sc_raw_socket raw_sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sc_raw_socket raw_sock = socket(AF_INET, type | SOCK_CLOEXEC, 0);
 #else
-    sc_raw_socket raw_sock = socket(AF_INET, SOCK_STREAM, 0);
+    sc_raw_socket raw_sock = socket(AF_INET, type, 0);
     if (raw_sock != SC_RAW_SOCKET_NONE && !set_cloexec_flag(raw_sock)) {
         sc_raw_socket_close(raw_sock);
         return SC_SOCKET_NONE;
@@ -136,6 +140,16 @@ net_socket(void) {
     return sock;
 }
 
+sc_socket
+net_socket(void) {
+    return net_socket_with_type(SOCK_STREAM);
+}
+
+sc_socket
+net_udp_socket(void) {
+    return net_socket_with_type(SOCK_DGRAM);
+}
+
 bool
 net_connect(sc_socket socket, uint32_t addr, uint16_t port) {
     sc_raw_socket raw_sock = unwrap(socket);
@@ -215,6 +229,24 @@ net_recv_all(sc_socket socket, void *buf, size_t len) {
     return recv(raw_sock, buf, len, MSG_WAITALL);
 }
 
+bool
+net_wait_readable(sc_socket socket, sc_tick timeout) {
+    sc_raw_socket raw_sock = unwrap(socket);
+    int timeout_ms = SC_TICK_TO_MS(timeout);
+#ifdef _WIN32
+    WSAPOLLFD pfd = {.fd = raw_sock, .events = POLLRDNORM};
+    int r = WSAPoll(&pfd, 1, timeout_ms);
+#else
+    struct pollfd pfd = {.fd = raw_sock, .events = POLLIN};
+    int r = poll(&pfd, 1, timeout_ms);
+#endif
+    if (r == SOCKET_ERROR) {
+        net_perror("poll");
+        return false;
+    }
+    return r > 0;
+}
+
 ssize_t
 net_send(sc_socket socket, const void *buf, size_t len) {
     sc_raw_socket raw_sock = unwrap(socket);
@@ -236,6 +268,76 @@ net_send_all(sc_socket socket, const void *buf, size_t len) {
     return copied;
 }
 
+ssize_t
+net_send_all_v(sc_socket socket, const struct sc_net_buf *bufs,
+               unsigned count) {
+    assert(count <= SC_NET_MAX_BUFS);
+
+    sc_raw_socket raw_sock = unwrap(socket);
+
+#ifdef _WIN32
+    WSABUF vec[SC_NET_MAX_BUFS];
+#else
+    struct iovec vec[SC_NET_MAX_BUFS];
+#endif
+    unsigned n = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        if (!bufs[i].len) {
+            continue;
+        }
+#ifdef _WIN32
+        // The buffers are never modified
+        vec[n].buf = (char *) bufs[i].data;
+        vec[n].len = (ULONG) bufs[i].len;
+#else
+        vec[n].iov_base = (void *) bufs[i].data;
+        vec[n].iov_len = bufs[i].len;
+#endif
+        ++n;
+    }
+
+    size_t copied = 0;
+    unsigned first = 0;
+    while (first < n) {
+#ifdef _WIN32
+        DWORD sent;
+        int ret = WSASend(raw_sock, &vec[first], n - first, &sent, 0, NULL,
+                          NULL);
+        ssize_t w = ret ? -1 : (ssize_t) sent;
+#else
+        ssize_t w = writev(raw_sock, &vec[first], n - first);
+#endif
+        if (w == -1) {
+            return copied ? (ssize_t) copied : -1;
+        }
+        copied += w;
+
+        // Skip the buffers fully sent, and advance in the partially sent one
+        size_t remaining = w;
+        while (first < n) {
+#ifdef _WIN32
+            size_t len = vec[first].len;
+#else
+            size_t len = vec[first].iov_len;
+#endif
+            if (remaining < len) {
+#ifdef _WIN32
+                vec[first].buf += remaining;
+                vec[first].len -= (ULONG) remaining;
+#else
+                vec[first].iov_base = (char *) vec[first].iov_base + remaining;
+                vec[first].iov_len -= remaining;
+#endif
+                break;
+            }
+            remaining -= len;
+            ++first;
+        }
+    }
+
+    return copied;
+}
+
 bool
 net_interrupt(sc_socket socket) {
     assert(socket != SC_SOCKET_NONE);
@@ -268,22 +370,87 @@ net_close(sc_socket socket) {
 #endif
 }
 
+static bool
+net_set_int_option(sc_socket socket, int level, int option, int value,
+                   const char *name) {
+    sc_raw_socket raw_sock = unwrap(socket);
+
+    int ret = setsockopt(raw_sock, level, option, (const void *) &value,
+                         sizeof(value));
+    if (ret == -1) {
+        net_perror(name);
+        return false;
+    }
+
+    assert(ret == 0);
+    return true;
+}
+
 bool
 net_set_tcp_nodelay(sc_socket socket, bool tcp_nodelay) {
+    return net_set_int_option(socket, IPPROTO_TCP, TCP_NODELAY,
+                              tcp_nodelay ? 1 : 0, "setsockopt(TCP_NODELAY)");
+}
+
+bool
+net_set_timeout(sc_socket socket, sc_tick timeout) {
+    assert(timeout >= 0);
     sc_raw_socket raw_sock = unwrap(socket);
 
-    int value = tcp_nodelay ? 1 : 0;
-    int ret = setsockopt(raw_sock, IPPROTO_TCP, TCP_NODELAY,
+#ifdef _WIN32
+    DWORD value = SC_TICK_TO_MS(timeout);
+#else
+    struct timeval value = {
+        .tv_sec = SC_TICK_TO_SEC(timeout),
+        .tv_usec = SC_TICK_TO_US(timeout % SC_TICK_FREQ),
+    };
+#endif
+
+    int ret = setsockopt(raw_sock, SOL_SOCKET, SO_RCVTIMEO,
                          (const void *) &value, sizeof(value));
     if (ret == -1) {
-        net_perror("setsockopt(TCP_NODELAY)");
+        net_perror("setsockopt(SO_RCVTIMEO)");
+        return false;
+    }
+
+    ret = setsockopt(raw_sock, SOL_SOCKET, SO_SNDTIMEO,
+                     (const void *) &value, sizeof(value));
+    if (ret == -1) {
+        net_perror("setsockopt(SO_SNDTIMEO)");
         return false;
     }
 
-    assert(ret == 0);
     return true;
 }
 
+bool
+net_set_recv_buffer_size(sc_socket socket, int size) {
+    assert(size > 0);
+    return net_set_int_option(socket, SOL_SOCKET, SO_RCVBUF, size,
+                              "setsockopt(SO_RCVBUF)");
+}
+
+bool
+net_set_send_buffer_size(sc_socket socket, int size) {
+    assert(size > 0);
+    return net_set_int_option(socket, SOL_SOCKET, SO_SNDBUF, size,
+                              "setsockopt(SO_SNDBUF)");
+}
+
+bool
+net_set_busy_poll(sc_socket socket, unsigned us) {
+#ifdef SO_BUSY_POLL
+    assert(us <= INT_MAX);
+    return net_set_int_option(socket, SOL_SOCKET, SO_BUSY_POLL, (int) us,
+                              "setsockopt(SO_BUSY_POLL)");
+#else
+    (void) socket;
+    (void) us;
+    LOGW("Socket busy polling is not supported on this platform");
+    return false;
+#endif
+}
+
 bool
 net_parse_ipv4(const char *s, uint32_t *ipv4) {
     struct in_addr addr;
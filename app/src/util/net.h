@@ -8,6 +8,8 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include "util/tick.h"
+
 #ifdef _WIN32
 # include <winsock2.h>
   typedef SOCKET sc_raw_socket;
@@ -51,6 +53,13 @@ net_cleanup(void);
 sc_socket
 net_socket(void);
 
+// Create a UDP socket
+//
+// Once connected by net_connect(), net_send() and net_recv() send and receive
+// one datagram.
+sc_socket
+net_udp_socket(void);
+
 bool
 net_connect(sc_socket socket, uint32_t addr, uint16_t port);
 
@@ -73,6 +82,27 @@ net_send(sc_socket socket, const void *buf, size_t len);
 ssize_t
 net_send_all(sc_socket socket, const void *buf, size_t len);
 
+// Wait up to `timeout` (0 not to wait) until data can be received without
+// blocking (or the connection is closed by the peer)
+//
+// Return false on timeout or error.
+bool
+net_wait_readable(sc_socket socket, sc_tick timeout);
+
+#define SC_NET_MAX_BUFS 8
+
+struct sc_net_buf {
+    const void *data;
+    size_t len;
+};
+
+// Send the concatenation of `count` buffers (at most SC_NET_MAX_BUFS), with
+// as few system calls as possible (writev() or WSASend()), without copying
+// them into a single buffer
+ssize_t
+net_send_all_v(sc_socket socket, const struct sc_net_buf *bufs,
+               unsigned count);
+
 // Shutdown the socket (or close on Windows) so that any blocking send() or
 // recv() are interrupted.
 bool
@@ -87,6 +117,29 @@ net_close(sc_socket socket);
 bool
 net_set_tcp_nodelay(sc_socket socket, bool tcp_nodelay);
 
+// Make blocking send() and recv() calls fail once `timeout` expires
+// (0 to disable)
+bool
+net_set_timeout(sc_socket socket, sc_tick timeout);
+
+// Set the size of the kernel receive buffer (SO_RCVBUF)
+//
+// The kernel may adjust the value (Linux doubles it, and caps it to
+// net.core.rmem_max).
+bool
+net_set_recv_buffer_size(sc_socket socket, int size);
+
+// Set the size of the kernel send buffer (SO_SNDBUF)
+bool
+net_set_send_buffer_size(sc_socket socket, int size);
+
+// Busy poll the network device queue for up to `us` microseconds on blocking
+// receive, rather than sleeping until the interrupt (SO_BUSY_POLL)
+//
+// Only supported on Linux, fail on other platforms.
+bool
+net_set_busy_poll(sc_socket socket, unsigned us);
+
 /**
  * Parse `ip` "xxx.xxx.xxx.xxx" to an IPv4 host representation
  */
@@ -0,0 +1,46 @@
+#include "percentile.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+void
+sc_percentile_window_init(struct sc_percentile_window *window) {
+    window->count = 0;
+    window->head = 0;
+}
+
+void
+sc_percentile_window_push(struct sc_percentile_window *window, int64_t value) {
+    window->values[window->head] = value;
+    window->head = (window->head + 1) % SC_PERCENTILE_WINDOW_SIZE;
+    if (window->count < SC_PERCENTILE_WINDOW_SIZE) {
+        ++window->count;
+    }
+}
+
+static int
+compare_int64(const void *a, const void *b) {
+    int64_t va = *(const int64_t *) a;
+    int64_t vb = *(const int64_t *) b;
+    return (va > vb) - (va < vb);
+}
+
+int64_t
+sc_percentile_window_get(const struct sc_percentile_window *window,
+                         unsigned p) {
+    assert(window->count);
+    assert(p <= 100);
+
+    // The order of the values in the window must be preserved, sort a copy
+    int64_t sorted[SC_PERCENTILE_WINDOW_SIZE];
+    unsigned count = window->count;
+    memcpy(sorted, window->values, count * sizeof(*sorted));
+    qsort(sorted, count, sizeof(*sorted), compare_int64);
+
+    // Nearest-rank: the smallest value such that at least p% of the values
+    // are less than or equal to it
+    unsigned rank = (p * count + 99) / 100;
+    unsigned index = rank ? rank - 1 : 0;
+    return sorted[index];
+}
@@ -0,0 +1,41 @@
+#ifndef SC_PERCENTILE_H
+#define SC_PERCENTILE_H
+
+#include "common.h"
+
+#include <stdint.h>
+
+#define SC_PERCENTILE_WINDOW_SIZE 512
+
+/**
+ * Rolling window of the last SC_PERCENTILE_WINDOW_SIZE values, to compute
+ * percentiles (e.g. p50, p95, p99 of measured latencies)
+ */
+struct sc_percentile_window {
+    int64_t values[SC_PERCENTILE_WINDOW_SIZE];
+    unsigned count; // number of valid values (count <= SIZE)
+    unsigned head; // index of the next value to write
+};
+
+void
+sc_percentile_window_init(struct sc_percentile_window *window);
+
+/**
+ * Push a new value, replacing the oldest one if the window is full
+ */
+void
+sc_percentile_window_push(struct sc_percentile_window *window, int64_t value);
+
+/**
+ * Get the p-th percentile (nearest-rank method) of the values in the window
+ *
+ * The percentile p must be between 0 and 100.
+ *
+ * It is an error to call this function if sc_percentile_window_push() has not
+ * been called at least once.
+ */
+int64_t
+sc_percentile_window_get(const struct sc_percentile_window *window,
+                         unsigned p);
+
+#endif
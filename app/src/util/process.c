@@ -1,6 +1,9 @@
 #include "process.h"
 
 #include <assert.h>
+#include <SDL2/SDL_atomic.h>
+
+#include "util/log.h"
 
 enum sc_process_result
 sc_process_execute(const char *const argv[], sc_pid *pid, unsigned flags) {
@@ -22,20 +25,188 @@ sc_pipe_read_all(sc_pipe pipe, char *data, size_t len) {
     return copied;
 }
 
-static int
-run_observer(void *data) {
-    struct sc_process_observer *observer = data;
-    sc_process_wait(observer->pid, false); // ignore exit code
-
+static void
+sc_process_observer_notify(struct sc_process_observer *observer) {
     sc_mutex_lock(&observer->mutex);
     observer->terminated = true;
-    sc_cond_signal(&observer->cond_terminated);
+    sc_cond_broadcast(&observer->cond_terminated);
     sc_mutex_unlock(&observer->mutex);
 
     if (observer->listener) {
         observer->listener->on_terminated(observer->listener_userdata);
     }
 
+    sc_mutex_lock(&observer->mutex);
+    observer->notified = true;
+    sc_cond_broadcast(&observer->cond_terminated);
+    sc_mutex_unlock(&observer->mutex);
+}
+
+// The reaper thread waits for all the observed processes at once. It is
+// started with the first observer, and stopped once the last one is joined.
+static struct {
+    sc_mutex mutex;
+    sc_cond cond_stopped;
+    sc_thread thread;
+    struct sc_process_waitset waitset;
+    struct sc_process_observer *observers[SC_PROCESS_WAITSET_MAX];
+    unsigned count;
+    bool running;
+    bool stopping;
+} sc_reaper;
+
+static SDL_SpinLock sc_reaper_init_lock = 0;
+static bool sc_reaper_initialized;
+static bool sc_reaper_supported;
+
+static bool
+sc_process_reaper_init_once(void) {
+    SDL_AtomicLock(&sc_reaper_init_lock);
+    if (!sc_reaper_initialized) {
+        sc_reaper_initialized = true;
+        sc_reaper_supported = false;
+
+        if (sc_mutex_init(&sc_reaper.mutex)) {
+            if (sc_cond_init(&sc_reaper.cond_stopped)) {
+                if (sc_process_waitset_init(&sc_reaper.waitset)) {
+                    sc_reaper.count = 0;
+                    sc_reaper.running = false;
+                    sc_reaper.stopping = false;
+                    sc_reaper_supported = true;
+                } else {
+                    LOGD("Waiting for several processes is not supported, "
+                         "one thread per observed process");
+                    sc_cond_destroy(&sc_reaper.cond_stopped);
+                    sc_mutex_destroy(&sc_reaper.mutex);
+                }
+            } else {
+                sc_mutex_destroy(&sc_reaper.mutex);
+            }
+        }
+    }
+    bool supported = sc_reaper_supported;
+    SDL_AtomicUnlock(&sc_reaper_init_lock);
+
+    return supported;
+}
+
+static int
+run_reaper(void *data) {
+    (void) data;
+
+    sc_pid pids[SC_PROCESS_WAITSET_MAX];
+    struct sc_process_observer *waited[SC_PROCESS_WAITSET_MAX];
+
+    sc_mutex_lock(&sc_reaper.mutex);
+    while (!sc_reaper.stopping) {
+        // The observers are only removed once notified, so those not reaped
+        // yet remain valid while the mutex is released
+        unsigned count = 0;
+        for (unsigned i = 0; i < sc_reaper.count; ++i) {
+            struct sc_process_observer *observer = sc_reaper.observers[i];
+            if (!observer->reaped) {
+                pids[count] = observer->pid;
+                waited[count] = observer;
+                ++count;
+            }
+        }
+        sc_mutex_unlock(&sc_reaper.mutex);
+
+        int r = sc_process_waitset_wait(&sc_reaper.waitset, pids, count);
+        if (r == SC_PROCESS_WAITSET_ERROR && count) {
+            // Should never happen, degrade to waiting one process at a time
+            LOGW("Could not wait for processes");
+            sc_process_wait(pids[0], false); // ignore exit code
+            r = 0;
+        }
+
+        sc_mutex_lock(&sc_reaper.mutex);
+        if (r >= 0) {
+            assert((unsigned) r < count);
+            struct sc_process_observer *observer = waited[r];
+            observer->reaped = true;
+            sc_mutex_unlock(&sc_reaper.mutex);
+
+            sc_process_observer_notify(observer);
+
+            sc_mutex_lock(&sc_reaper.mutex);
+        }
+    }
+    sc_mutex_unlock(&sc_reaper.mutex);
+
+    return 0;
+}
+
+// Return false if the process must be observed by a separate thread
+static bool
+sc_process_reaper_add(struct sc_process_observer *observer) {
+    if (!sc_process_reaper_init_once()) {
+        return false;
+    }
+
+    sc_mutex_lock(&sc_reaper.mutex);
+    // The previous reaper thread may be terminating
+    while (sc_reaper.stopping) {
+        sc_cond_wait(&sc_reaper.cond_stopped, &sc_reaper.mutex);
+    }
+
+    if (sc_reaper.count == SC_PROCESS_WAITSET_MAX) {
+        sc_mutex_unlock(&sc_reaper.mutex);
+        return false;
+    }
+
+    if (!sc_reaper.running) {
+        bool ok = sc_thread_create(&sc_reaper.thread, run_reaper,
+                                   "scrcpy-reaper", NULL);
+        if (!ok) {
+            sc_mutex_unlock(&sc_reaper.mutex);
+            return false;
+        }
+        sc_reaper.running = true;
+    }
+
+    sc_reaper.observers[sc_reaper.count++] = observer;
+    sc_process_waitset_wakeup(&sc_reaper.waitset);
+    sc_mutex_unlock(&sc_reaper.mutex);
+
+    return true;
+}
+
+static void
+sc_process_reaper_remove(struct sc_process_observer *observer) {
+    sc_mutex_lock(&sc_reaper.mutex);
+    for (unsigned i = 0; i < sc_reaper.count; ++i) {
+        if (sc_reaper.observers[i] == observer) {
+            sc_reaper.observers[i] = sc_reaper.observers[--sc_reaper.count];
+            break;
+        }
+    }
+
+    bool stop = !sc_reaper.count;
+    if (stop) {
+        sc_reaper.stopping = true;
+        sc_process_waitset_wakeup(&sc_reaper.waitset);
+    }
+    sc_mutex_unlock(&sc_reaper.mutex);
+
+    if (stop) {
+        sc_thread_join(&sc_reaper.thread, NULL);
+
+        sc_mutex_lock(&sc_reaper.mutex);
+        sc_reaper.running = false;
+        sc_reaper.stopping = false;
+        sc_cond_broadcast(&sc_reaper.cond_stopped);
+        sc_mutex_unlock(&sc_reaper.mutex);
+    }
+}
+
+static int
+run_observer(void *data) {
+    struct sc_process_observer *observer = data;
+    sc_process_wait(observer->pid, false); // ignore exit code
+
+    sc_process_observer_notify(observer);
+
     return 0;
 }
 
@@ -61,6 +232,13 @@ sc_process_observer_init(struct sc_process_observer *observer, sc_pid pid,
     observer->listener = listener;
     observer->listener_userdata = listener_userdata;
     observer->terminated = false;
+    observer->notified = false;
+    observer->reaped = false;
+
+    observer->shared = sc_process_reaper_add(observer);
+    if (observer->shared) {
+        return true;
+    }
 
     ok = sc_thread_create(&observer->thread, run_observer, "scrcpy-proc",
                           observer);
@@ -90,7 +268,18 @@ sc_process_observer_timedwait(struct sc_process_observer *observer,
 
 void
 sc_process_observer_join(struct sc_process_observer *observer) {
-    sc_thread_join(&observer->thread, NULL);
+    if (!observer->shared) {
+        sc_thread_join(&observer->thread, NULL);
+        return;
+    }
+
+    sc_mutex_lock(&observer->mutex);
+    while (!observer->notified) {
+        sc_cond_wait(&observer->cond_terminated, &observer->mutex);
+    }
+    sc_mutex_unlock(&observer->mutex);
+
+    sc_process_reaper_remove(observer);
 }
 
 void
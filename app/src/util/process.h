@@ -20,6 +20,10 @@
   typedef DWORD sc_exit_code;
   typedef HANDLE sc_pipe;
 
+  struct sc_process_waitset {
+      HANDLE wakeup_event;
+  };
+
 #else
 
 # include <sys/types.h>
@@ -30,8 +34,17 @@
   typedef int sc_exit_code;
   typedef int sc_pipe;
 
+  struct sc_process_waitset {
+      int wakeup_pipe[2];
+  };
+
 #endif
 
+// Maximum number of processes in a single sc_process_waitset_wait() call
+#define SC_PROCESS_WAITSET_MAX 32
+#define SC_PROCESS_WAITSET_WAKEUP -1
+#define SC_PROCESS_WAITSET_ERROR -2
+
 struct sc_process_listener {
     void (*on_terminated)(void *userdata);
 };
@@ -39,12 +52,14 @@ struct sc_process_listener {
 /**
  * Tool to observe process termination
  *
- * To keep things simple and multiplatform, it runs a separate thread to wait
- * for process termination (without closing the process to avoid race
- * conditions).
+ * The processes are waited (without being closed, to avoid race conditions)
+ * by a single reaper thread shared by all the observers. If the platform
+ * does not support waiting for several processes at once, or if too many
+ * processes are observed, the observer runs its own thread instead.
  *
  * It allows a caller to block until the process is terminated (with a
- * timeout), and to be notified asynchronously from the observer thread.
+ * timeout), and to be notified asynchronously from the reaper (or observer)
+ * thread.
  *
  * The process is not owned by the observer (the observer will never close it).
  */
@@ -54,8 +69,14 @@ struct sc_process_observer {
     sc_mutex mutex;
     sc_cond cond_terminated;
     bool terminated;
-
-    sc_thread thread;
+    // The listener has been called, the observer may be joined
+    bool notified;
+
+    // Observed by the shared reaper (otherwise by its own thread)
+    bool shared;
+    // Termination detected by the reaper (protected by the reaper mutex)
+    bool reaped;
+    sc_thread thread; // only if !shared
     const struct sc_process_listener *listener;
     void *listener_userdata;
 };
@@ -118,6 +139,38 @@ sc_process_wait(sc_pid pid, bool close);
 void
 sc_process_close(sc_pid pid);
 
+/**
+ * Initialize a set of processes to wait for
+ *
+ * Return false if waiting for several processes from a single thread is not
+ * supported on this platform.
+ */
+bool
+sc_process_waitset_init(struct sc_process_waitset *ws);
+
+void
+sc_process_waitset_destroy(struct sc_process_waitset *ws);
+
+/**
+ * Wait until one of the `count` processes terminates (without closing it), or
+ * until sc_process_waitset_wakeup() is called
+ *
+ * A process already closed is considered terminated.
+ *
+ * Return the index of a terminated process, SC_PROCESS_WAITSET_WAKEUP or
+ * SC_PROCESS_WAITSET_ERROR.
+ */
+int
+sc_process_waitset_wait(struct sc_process_waitset *ws, const sc_pid *pids,
+                        unsigned count);
+
+/**
+ * Wake up the thread blocked in sc_process_waitset_wait() (callable from any
+ * thread)
+ */
+void
+sc_process_waitset_wakeup(struct sc_process_waitset *ws);
+
 /**
  * Read from the pipe
  *
@@ -163,7 +216,7 @@ sc_process_observer_timedwait(struct sc_process_observer *observer,
                               sc_tick deadline);
 
 /**
- * Join the observer thread
+ * Wait until the listener has been notified, and stop observing
  */
 void
 sc_process_observer_join(struct sc_process_observer *observer);
@@ -0,0 +1,101 @@
+#include "sha1.h"
+
+#include <string.h>
+
+// <https://en.wikipedia.org/wiki/SHA-1>
+
+static inline uint32_t
+rotl(uint32_t x, unsigned n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+static void
+sc_sha1_process_block(uint32_t state[5], const uint8_t *block) {
+    uint32_t w[80];
+    for (unsigned i = 0; i < 16; ++i) {
+        w[i] = ((uint32_t) block[i * 4] << 24)
+             | ((uint32_t) block[i * 4 + 1] << 16)
+             | ((uint32_t) block[i * 4 + 2] << 8)
+             | block[i * 4 + 3];
+    }
+    for (unsigned i = 16; i < 80; ++i) {
+        w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t e = state[4];
+
+    for (unsigned i = 0; i < 80; ++i) {
+        uint32_t f;
+        uint32_t k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+
+        uint32_t t = rotl(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotl(b, 30);
+        b = a;
+        a = t;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+void
+sc_sha1(const void *data, size_t len, uint8_t digest[SC_SHA1_DIGEST_SIZE]) {
+    uint32_t state[5] = {
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0,
+    };
+
+    const uint8_t *bytes = data;
+    uint64_t bit_length = (uint64_t) len * 8;
+
+    while (len >= 64) {
+        sc_sha1_process_block(state, bytes);
+        bytes += 64;
+        len -= 64;
+    }
+
+    // Append the bit '1', then pad with zeros so that 8 bytes remain for the
+    // length at the end of the last block
+    uint8_t block[64];
+    memcpy(block, bytes, len);
+    block[len++] = 0x80;
+    if (len > sizeof(block) - 8) {
+        memset(block + len, 0, sizeof(block) - len);
+        sc_sha1_process_block(state, block);
+        len = 0;
+    }
+    memset(block + len, 0, sizeof(block) - 8 - len);
+
+    for (unsigned i = 0; i < 8; ++i) {
+        block[56 + i] = bit_length >> (56 - i * 8);
+    }
+    sc_sha1_process_block(state, block);
+
+    for (unsigned i = 0; i < 5; ++i) {
+        digest[i * 4] = state[i] >> 24;
+        digest[i * 4 + 1] = state[i] >> 16;
+        digest[i * 4 + 2] = state[i] >> 8;
+        digest[i * 4 + 3] = state[i];
+    }
+}
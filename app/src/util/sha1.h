@@ -0,0 +1,20 @@
+#ifndef SC_SHA1_H
+#define SC_SHA1_H
+
+#include "common.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SC_SHA1_DIGEST_SIZE 20
+
+/**
+ * Compute the SHA-1 of data
+ *
+ * SHA-1 is broken for security purposes, it must only be used where a
+ * protocol requires it (e.g. the WebSocket handshake).
+ */
+void
+sc_sha1(const void *data, size_t len, uint8_t digest[SC_SHA1_DIGEST_SIZE]);
+
+#endif
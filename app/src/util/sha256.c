@@ -0,0 +1,200 @@
+#include "sha256.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "util/log.h"
+
+// <https://en.wikipedia.org/wiki/SHA-2>
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t
+rotr(uint32_t x, unsigned n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static void
+sc_sha256_process_block(struct sc_sha256 *sha, const uint8_t *block) {
+    uint32_t w[64];
+    for (unsigned i = 0; i < 16; ++i) {
+        w[i] = ((uint32_t) block[i * 4] << 24)
+             | ((uint32_t) block[i * 4 + 1] << 16)
+             | ((uint32_t) block[i * 4 + 2] << 8)
+             | block[i * 4 + 3];
+    }
+    for (unsigned i = 16; i < 64; ++i) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18)
+                    ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19)
+                    ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = sha->state[0];
+    uint32_t b = sha->state[1];
+    uint32_t c = sha->state[2];
+    uint32_t d = sha->state[3];
+    uint32_t e = sha->state[4];
+    uint32_t f = sha->state[5];
+    uint32_t g = sha->state[6];
+    uint32_t h = sha->state[7];
+
+    for (unsigned i = 0; i < 64; ++i) {
+        uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + K[i] + w[i];
+        uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    sha->state[0] += a;
+    sha->state[1] += b;
+    sha->state[2] += c;
+    sha->state[3] += d;
+    sha->state[4] += e;
+    sha->state[5] += f;
+    sha->state[6] += g;
+    sha->state[7] += h;
+}
+
+void
+sc_sha256_init(struct sc_sha256 *sha) {
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(sha->state, init, sizeof(init));
+    sha->length = 0;
+    sha->block_len = 0;
+}
+
+void
+sc_sha256_update(struct sc_sha256 *sha, const void *data, size_t len) {
+    const uint8_t *bytes = data;
+    sha->length += len;
+
+    if (sha->block_len) {
+        size_t n = sizeof(sha->block) - sha->block_len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(sha->block + sha->block_len, bytes, n);
+        sha->block_len += n;
+        bytes += n;
+        len -= n;
+
+        if (sha->block_len < sizeof(sha->block)) {
+            return;
+        }
+
+        sc_sha256_process_block(sha, sha->block);
+        sha->block_len = 0;
+    }
+
+    while (len >= sizeof(sha->block)) {
+        sc_sha256_process_block(sha, bytes);
+        bytes += sizeof(sha->block);
+        len -= sizeof(sha->block);
+    }
+
+    memcpy(sha->block, bytes, len);
+    sha->block_len = len;
+}
+
+void
+sc_sha256_final(struct sc_sha256 *sha, uint8_t digest[SC_SHA256_DIGEST_SIZE]) {
+    uint64_t bit_length = sha->length * 8;
+
+    // Append the bit '1', then pad with zeros so that 8 bytes remain for the
+    // length at the end of the last block
+    sha->block[sha->block_len++] = 0x80;
+    if (sha->block_len > sizeof(sha->block) - 8) {
+        memset(sha->block + sha->block_len, 0,
+               sizeof(sha->block) - sha->block_len);
+        sc_sha256_process_block(sha, sha->block);
+        sha->block_len = 0;
+    }
+    memset(sha->block + sha->block_len, 0,
+           sizeof(sha->block) - 8 - sha->block_len);
+
+    for (unsigned i = 0; i < 8; ++i) {
+        sha->block[56 + i] = bit_length >> (56 - i * 8);
+    }
+    sc_sha256_process_block(sha, sha->block);
+
+    for (unsigned i = 0; i < 8; ++i) {
+        digest[i * 4] = sha->state[i] >> 24;
+        digest[i * 4 + 1] = sha->state[i] >> 16;
+        digest[i * 4 + 2] = sha->state[i] >> 8;
+        digest[i * 4 + 3] = sha->state[i];
+    }
+}
+
+void
+sc_sha256_to_hex(const uint8_t digest[SC_SHA256_DIGEST_SIZE],
+                 char hex[SC_SHA256_HEX_SIZE]) {
+    static const char digits[] = "0123456789abcdef";
+    for (unsigned i = 0; i < SC_SHA256_DIGEST_SIZE; ++i) {
+        hex[i * 2] = digits[digest[i] >> 4];
+        hex[i * 2 + 1] = digits[digest[i] & 0xF];
+    }
+    hex[SC_SHA256_DIGEST_SIZE * 2] = '\0';
+}
+
+bool
+sc_sha256_file(const char *path, char hex[SC_SHA256_HEX_SIZE]) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        LOGE("Could not open file: %s", path);
+        return false;
+    }
+
+    struct sc_sha256 sha;
+    sc_sha256_init(&sha);
+
+    uint8_t buf[4096];
+    size_t r;
+    while ((r = fread(buf, 1, sizeof(buf), file)) > 0) {
+        sc_sha256_update(&sha, buf, r);
+    }
+
+    bool error = ferror(file);
+    fclose(file);
+    if (error) {
+        LOGE("Could not read file: %s", path);
+        return false;
+    }
+
+    uint8_t digest[SC_SHA256_DIGEST_SIZE];
+    sc_sha256_final(&sha, digest);
+    sc_sha256_to_hex(digest, hex);
+    return true;
+}
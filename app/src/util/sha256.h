@@ -0,0 +1,43 @@
+#ifndef SC_SHA256_H
+#define SC_SHA256_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SC_SHA256_DIGEST_SIZE 32
+// Hexadecimal representation, including the terminating '\0'
+#define SC_SHA256_HEX_SIZE (SC_SHA256_DIGEST_SIZE * 2 + 1)
+
+struct sc_sha256 {
+    uint32_t state[8];
+    uint64_t length; // in bytes
+    uint8_t block[64];
+    size_t block_len;
+};
+
+void
+sc_sha256_init(struct sc_sha256 *sha);
+
+void
+sc_sha256_update(struct sc_sha256 *sha, const void *data, size_t len);
+
+void
+sc_sha256_final(struct sc_sha256 *sha, uint8_t digest[SC_SHA256_DIGEST_SIZE]);
+
+/**
+ * Write the lowercase hexadecimal representation of digest into hex
+ */
+void
+sc_sha256_to_hex(const uint8_t digest[SC_SHA256_DIGEST_SIZE],
+                 char hex[SC_SHA256_HEX_SIZE]);
+
+/**
+ * Compute the hexadecimal SHA-256 of the file content
+ */
+bool
+sc_sha256_file(const char *path, char hex[SC_SHA256_HEX_SIZE]);
+
+#endif
@@ -0,0 +1,147 @@
+#include "spill_log.h"
+
+#include <assert.h>
+
+#include "util/binary.h"
+#include "util/log.h"
+
+// Each record starts with the size of its payload
+#define SC_SPILL_LOG_SIZE_LEN 4
+
+static bool
+sc_spill_log_seek(FILE *file, uint64_t offset) {
+#ifdef _WIN32
+    return !_fseeki64(file, (int64_t) offset, SEEK_SET);
+#else
+    return !fseeko(file, (off_t) offset, SEEK_SET);
+#endif
+}
+
+static bool
+sc_spill_log_write(struct sc_spill_log *log, const uint8_t *data, size_t len) {
+    if (len && fwrite(data, 1, len, log->file) != len) {
+        LOGE("Could not write to spill file");
+        return false;
+    }
+
+    log->write_offset += len;
+    return true;
+}
+
+static bool
+sc_spill_log_read(struct sc_spill_log *log, uint8_t *data, size_t len) {
+    if (len && fread(data, 1, len, log->file) != len) {
+        LOGE("Could not read from spill file");
+        return false;
+    }
+
+    log->read_offset += len;
+    return true;
+}
+
+bool
+sc_spill_log_init(struct sc_spill_log *log) {
+    log->file = tmpfile();
+    if (!log->file) {
+        LOGE("Could not create spill file");
+        return false;
+    }
+
+    log->read_offset = 0;
+    log->write_offset = 0;
+    log->count = 0;
+    log->pending_size = 0;
+    log->pending = false;
+    return true;
+}
+
+void
+sc_spill_log_destroy(struct sc_spill_log *log) {
+    fclose(log->file);
+}
+
+bool
+sc_spill_log_append(struct sc_spill_log *log, const uint8_t *header,
+                    size_t header_size, const uint8_t *payload,
+                    uint32_t payload_size) {
+    // The same stream is used for reading and writing, so the position must
+    // be set before each operation
+    if (!sc_spill_log_seek(log->file, log->write_offset)) {
+        LOGE("Could not seek in spill file");
+        return false;
+    }
+
+    uint8_t size[SC_SPILL_LOG_SIZE_LEN];
+    sc_write32be(size, payload_size);
+
+    uint64_t start = log->write_offset;
+    bool ok = sc_spill_log_write(log, size, sizeof(size))
+           && sc_spill_log_write(log, header, header_size)
+           && sc_spill_log_write(log, payload, payload_size);
+    if (!ok) {
+        // Discard the partial record
+        log->write_offset = start;
+        return false;
+    }
+
+    ++log->count;
+    return true;
+}
+
+bool
+sc_spill_log_read_header(struct sc_spill_log *log, uint8_t *header,
+                         size_t header_size, uint32_t *payload_size) {
+    assert(log->count);
+    assert(!log->pending);
+
+    if (!sc_spill_log_seek(log->file, log->read_offset)) {
+        LOGE("Could not seek in spill file");
+        return false;
+    }
+
+    uint8_t size[SC_SPILL_LOG_SIZE_LEN];
+    bool ok = sc_spill_log_read(log, size, sizeof(size))
+           && sc_spill_log_read(log, header, header_size);
+    if (!ok) {
+        return false;
+    }
+
+    log->pending_size = sc_read32be(size);
+    log->pending = true;
+    *payload_size = log->pending_size;
+    return true;
+}
+
+bool
+sc_spill_log_read_payload(struct sc_spill_log *log, uint8_t *payload) {
+    assert(log->count);
+    assert(log->pending);
+
+    // A record may have been appended since the header was read
+    if (!sc_spill_log_seek(log->file, log->read_offset)) {
+        LOGE("Could not seek in spill file");
+        return false;
+    }
+
+    if (!sc_spill_log_read(log, payload, log->pending_size)) {
+        return false;
+    }
+
+    log->pending = false;
+    if (!--log->count) {
+        // Everything has been read, reuse the file space
+        assert(log->read_offset == log->write_offset);
+        log->read_offset = 0;
+        log->write_offset = 0;
+    }
+
+    return true;
+}
+
+void
+sc_spill_log_clear(struct sc_spill_log *log) {
+    log->read_offset = 0;
+    log->write_offset = 0;
+    log->count = 0;
+    log->pending = false;
+}
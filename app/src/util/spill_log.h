@@ -0,0 +1,77 @@
+#ifndef SC_SPILL_LOG_H
+#define SC_SPILL_LOG_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * First-in first-out log of records in an anonymous temporary file
+ *
+ * It is used to keep data on disk instead of memory when a consumer does not
+ * keep up. Each record is made of a fixed-size header (whose size is known by
+ * the caller) and a variable-size payload.
+ *
+ * The records are appended at the end and read back sequentially. Once all
+ * the records have been read, the file space is reused from the start.
+ *
+ * It is not thread-safe.
+ */
+struct sc_spill_log {
+    FILE *file;
+    uint64_t read_offset;
+    uint64_t write_offset;
+    size_t count; // number of records not fully read
+    // Payload size of the record whose header has been read (if any)
+    uint32_t pending_size;
+    bool pending;
+};
+
+/**
+ * Create the temporary file (deleted automatically on close)
+ */
+bool
+sc_spill_log_init(struct sc_spill_log *log);
+
+void
+sc_spill_log_destroy(struct sc_spill_log *log);
+
+static inline bool
+sc_spill_log_is_empty(const struct sc_spill_log *log) {
+    return !log->count;
+}
+
+/**
+ * Append a record (the header is typically serialized by the caller)
+ */
+bool
+sc_spill_log_append(struct sc_spill_log *log, const uint8_t *header,
+                    size_t header_size, const uint8_t *payload,
+                    uint32_t payload_size);
+
+/**
+ * Read the header of the next record, and return the size of its payload
+ *
+ * The log must not be empty. The payload must then be read by
+ * sc_spill_log_read_payload().
+ */
+bool
+sc_spill_log_read_header(struct sc_spill_log *log, uint8_t *header,
+                         size_t header_size, uint32_t *payload_size);
+
+/**
+ * Read the payload of the record whose header has just been read
+ */
+bool
+sc_spill_log_read_payload(struct sc_spill_log *log, uint8_t *payload);
+
+/**
+ * Discard all the records
+ */
+void
+sc_spill_log_clear(struct sc_spill_log *log);
+
+#endif
@@ -5,11 +5,44 @@
 #include <stdlib.h>
 #include <string.h>
 #include <SDL2/SDL_thread.h>
+#ifdef __linux__
+# include <errno.h>
+# include <sched.h>
+#elif defined(_WIN32)
+# include <windows.h>
+#elif defined(__APPLE__)
+# include <pthread.h>
+# include <pthread/qos.h>
+#endif
 
 #include "util/log.h"
 
 sc_thread_id SC_MAIN_THREAD_ID;
 
+#ifdef SC_THREAD_HAS_CPU_AFFINITY
+// CPUs of the latency-critical threads, 0 if not restricted (written before
+// any thread is started, then read-only)
+static uint64_t sc_thread_critical_cpus;
+#endif
+
+// Name of the current thread, if created by sc_thread_create()
+static _Thread_local const char *sc_thread_name;
+
+struct sc_thread_start {
+    sc_thread_fn *fn;
+    const char *name;
+    void *userdata;
+};
+
+static int
+sc_thread_run(void *data) {
+    struct sc_thread_start start = *(struct sc_thread_start *) data;
+    free(data);
+
+    sc_thread_name = start.name;
+    return start.fn(start.userdata);
+}
+
 bool
 sc_thread_create(sc_thread *thread, sc_thread_fn fn, const char *name,
                  void *userdata) {
@@ -17,9 +50,20 @@ sc_thread_create(sc_thread *thread, sc_thread_fn fn, const char *name,
     // longer than 16 bytes (including the final '\0')
     assert(strlen(name) <= 15);
 
-    SDL_Thread *sdl_thread = SDL_CreateThread(fn, name, userdata);
+    struct sc_thread_start *start = malloc(sizeof(*start));
+    if (!start) {
+        LOG_OOM();
+        return false;
+    }
+
+    start->fn = fn;
+    start->name = name;
+    start->userdata = userdata;
+
+    SDL_Thread *sdl_thread = SDL_CreateThread(sc_thread_run, name, start);
     if (!sdl_thread) {
         LOG_OOM();
+        free(start);
         return false;
     }
 
@@ -27,6 +71,20 @@ sc_thread_create(sc_thread *thread, sc_thread_fn fn, const char *name,
     return true;
 }
 
+const char *
+sc_thread_get_name(void) {
+    if (sc_thread_name) {
+        return sc_thread_name;
+    }
+
+    if (sc_thread_get_id() == SC_MAIN_THREAD_ID) {
+        return "main";
+    }
+
+    // Thread not created by sc_thread_create() (e.g. the SDL audio thread)
+    return NULL;
+}
+
 static SDL_ThreadPriority
 to_sdl_thread_priority(enum sc_thread_priority priority) {
     switch (priority) {
@@ -48,8 +106,85 @@ to_sdl_thread_priority(enum sc_thread_priority priority) {
     }
 }
 
+#ifdef __APPLE__
+static bool
+sc_thread_set_qos_class(enum sc_thread_priority priority) {
+    qos_class_t qos_class;
+    switch (priority) {
+        case SC_THREAD_PRIORITY_LOW:
+            qos_class = QOS_CLASS_UTILITY;
+            break;
+        case SC_THREAD_PRIORITY_NORMAL:
+            qos_class = QOS_CLASS_DEFAULT;
+            break;
+        case SC_THREAD_PRIORITY_HIGH:
+            qos_class = QOS_CLASS_USER_INTERACTIVE;
+            break;
+        default:
+            // Real-time threads are scheduled by SDL
+            return false;
+    }
+
+    int r = pthread_set_qos_class_self_np(qos_class, 0);
+    if (r) {
+        LOGD("Could not set thread QoS class: %d", r);
+        return false;
+    }
+
+    return true;
+}
+#endif
+
+#ifdef SC_THREAD_HAS_CPU_AFFINITY
+void
+sc_thread_set_critical_cpus(uint64_t cpus) {
+    sc_thread_critical_cpus = cpus;
+}
+
+static bool
+sc_thread_set_affinity(uint64_t cpus) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned i = 0; i < 64; ++i) {
+        if (cpus & (UINT64_C(1) << i)) {
+            CPU_SET(i, &set);
+        }
+    }
+
+    // On Linux, pid 0 is the calling thread (not the whole process)
+    if (sched_setaffinity(0, sizeof(set), &set)) {
+        LOGW("Could not set CPU affinity: %s", strerror(errno));
+        return false;
+    }
+#else
+    if (!SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR) cpus)) {
+        LOGW("Could not set CPU affinity: error %lu", GetLastError());
+        return false;
+    }
+#endif
+
+    return true;
+}
+#endif
+
 bool
 sc_thread_set_priority(enum sc_thread_priority priority) {
+#ifdef SC_THREAD_HAS_CPU_AFFINITY
+    if (priority >= SC_THREAD_PRIORITY_HIGH && sc_thread_critical_cpus) {
+        bool ok = sc_thread_set_affinity(sc_thread_critical_cpus);
+        (void) ok; // The priority is set anyway
+    }
+#endif
+
+#ifdef __APPLE__
+    // Changing the scheduling policy (as SDL does) would opt the thread out of
+    // the QoS classes, which the macOS scheduler relies on
+    if (sc_thread_set_qos_class(priority)) {
+        return true;
+    }
+#endif
+
     SDL_ThreadPriority sdl_priority = to_sdl_thread_priority(priority);
     int r = SDL_SetThreadPriority(sdl_priority);
     if (r) {
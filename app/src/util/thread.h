@@ -5,6 +5,7 @@
 
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "tick.h"
 
@@ -17,6 +18,10 @@ typedef int sc_thread_fn(void *);
 typedef unsigned sc_thread_id;
 typedef atomic_uint sc_atomic_thread_id;
 
+#if defined(__linux__) || defined(_WIN32)
+# define SC_THREAD_HAS_CPU_AFFINITY
+#endif
+
 typedef struct sc_thread {
     SDL_Thread *thread;
 } sc_thread;
@@ -48,9 +53,23 @@ sc_thread_create(sc_thread *thread, sc_thread_fn fn, const char *name,
 void
 sc_thread_join(sc_thread *thread, int *status);
 
+// Set the priority of the current thread
+//
+// The threads set to SC_THREAD_PRIORITY_HIGH or above are considered
+// latency-critical, and are also restricted to the CPUs set by
+// sc_thread_set_critical_cpus().
 bool
 sc_thread_set_priority(enum sc_thread_priority priority);
 
+#ifdef SC_THREAD_HAS_CPU_AFFINITY
+// Set the CPUs (bitmask of CPU indices) on which the latency-critical threads
+// may run, 0 for no restriction
+//
+// It must be called before any thread is started.
+void
+sc_thread_set_critical_cpus(uint64_t cpus);
+#endif
+
 bool
 sc_mutex_init(sc_mutex *mutex);
 
@@ -66,6 +85,11 @@ sc_mutex_unlock(sc_mutex *mutex);
 sc_thread_id
 sc_thread_get_id(void);
 
+// Return the name of the current thread (the name passed to
+// sc_thread_create(), or "main"), or NULL if unknown
+const char *
+sc_thread_get_name(void);
+
 #ifndef NDEBUG
 bool
 sc_mutex_held(struct sc_mutex *mutex);
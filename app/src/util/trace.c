@@ -0,0 +1,240 @@
+#include "trace.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/log.h"
+#include "util/thread.h"
+
+#define SC_TRACE_CHUNK_EVENTS 4096
+// Limit the memory used by a single thread (~24 MiB)
+#define SC_TRACE_MAX_CHUNKS 256
+
+struct sc_trace_event {
+    const char *name;
+    sc_tick start;
+    sc_tick duration;
+};
+
+struct sc_trace_chunk {
+    struct sc_trace_chunk *next;
+    unsigned count;
+    struct sc_trace_event events[SC_TRACE_CHUNK_EVENTS];
+};
+
+struct sc_trace_buffer {
+    struct sc_trace_buffer *next; // in the global list
+    unsigned tid; // index of the buffer, used as trace thread id
+    const char *thread_name; // may be NULL
+    struct sc_trace_chunk *head;
+    struct sc_trace_chunk *tail; // the chunk being filled
+    unsigned chunk_count;
+    uint64_t dropped;
+};
+
+static struct {
+    atomic_bool enabled;
+    char *filename;
+    sc_tick origin;
+
+    // Protects the list of buffers (only locked once per thread)
+    sc_mutex mutex;
+    struct sc_trace_buffer *buffers;
+    unsigned buffer_count;
+} sc_trace;
+
+// The buffer of the current thread
+static _Thread_local struct sc_trace_buffer *sc_trace_thread_buffer;
+
+bool
+sc_trace_init(const char *filename) {
+    sc_trace.filename = strdup(filename);
+    if (!sc_trace.filename) {
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = sc_mutex_init(&sc_trace.mutex);
+    if (!ok) {
+        free(sc_trace.filename);
+        return false;
+    }
+
+    sc_trace.origin = sc_tick_now();
+    sc_trace.buffers = NULL;
+    sc_trace.buffer_count = 0;
+    atomic_store_explicit(&sc_trace.enabled, true, memory_order_release);
+
+    return true;
+}
+
+static struct sc_trace_chunk *
+sc_trace_chunk_new(void) {
+    struct sc_trace_chunk *chunk = malloc(sizeof(*chunk));
+    if (!chunk) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    chunk->next = NULL;
+    chunk->count = 0;
+    return chunk;
+}
+
+static struct sc_trace_buffer *
+sc_trace_get_thread_buffer(void) {
+    struct sc_trace_buffer *buffer = sc_trace_thread_buffer;
+    if (buffer) {
+        return buffer;
+    }
+
+    buffer = malloc(sizeof(*buffer));
+    if (!buffer) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    buffer->head = sc_trace_chunk_new();
+    if (!buffer->head) {
+        free(buffer);
+        return NULL;
+    }
+
+    buffer->tail = buffer->head;
+    buffer->chunk_count = 1;
+    buffer->dropped = 0;
+    buffer->thread_name = sc_thread_get_name();
+
+    sc_mutex_lock(&sc_trace.mutex);
+    buffer->tid = ++sc_trace.buffer_count;
+    buffer->next = sc_trace.buffers;
+    sc_trace.buffers = buffer;
+    sc_mutex_unlock(&sc_trace.mutex);
+
+    sc_trace_thread_buffer = buffer;
+    return buffer;
+}
+
+sc_tick
+sc_trace_begin(void) {
+    if (!atomic_load_explicit(&sc_trace.enabled, memory_order_relaxed)) {
+        return 0;
+    }
+
+    return sc_tick_now();
+}
+
+void
+sc_trace_end(const char *name, sc_tick start) {
+    if (!start) {
+        // Tracing disabled
+        return;
+    }
+
+    sc_tick now = sc_tick_now();
+
+    struct sc_trace_buffer *buffer = sc_trace_get_thread_buffer();
+    if (!buffer) {
+        return;
+    }
+
+    struct sc_trace_chunk *chunk = buffer->tail;
+    if (chunk->count == SC_TRACE_CHUNK_EVENTS) {
+        if (buffer->chunk_count == SC_TRACE_MAX_CHUNKS) {
+            ++buffer->dropped;
+            return;
+        }
+
+        chunk = sc_trace_chunk_new();
+        if (!chunk) {
+            ++buffer->dropped;
+            return;
+        }
+
+        buffer->tail->next = chunk;
+        buffer->tail = chunk;
+        ++buffer->chunk_count;
+    }
+
+    struct sc_trace_event *event = &chunk->events[chunk->count++];
+    event->name = name;
+    event->start = start;
+    event->duration = now - start;
+}
+
+static bool
+sc_trace_write(FILE *file) {
+    bool first = true;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+
+    for (struct sc_trace_buffer *buffer = sc_trace.buffers; buffer;
+            buffer = buffer->next) {
+        // Thread names from sc_thread_create() are string literals
+        const char *thread_name = buffer->thread_name;
+        if (thread_name) {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\","
+                          "\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", buffer->tid, thread_name);
+            first = false;
+        }
+
+        for (struct sc_trace_chunk *chunk = buffer->head; chunk;
+                chunk = chunk->next) {
+            for (unsigned i = 0; i < chunk->count; ++i) {
+                const struct sc_trace_event *event = &chunk->events[i];
+                fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+                              "\"tid\":%u,\"ts\":%" PRItick ",\"dur\":%"
+                              PRItick "}",
+                        first ? "" : ",\n", event->name, buffer->tid,
+                        SC_TICK_TO_US(event->start - sc_trace.origin),
+                        SC_TICK_TO_US(event->duration));
+                first = false;
+            }
+        }
+
+        if (buffer->dropped) {
+            LOGW("Trace: %" PRIu64 " events dropped for thread %s",
+                 buffer->dropped, thread_name ? thread_name : "(unknown)");
+        }
+    }
+
+    fputs("\n]}\n", file);
+    return !ferror(file);
+}
+
+void
+sc_trace_destroy(void) {
+    atomic_store_explicit(&sc_trace.enabled, false, memory_order_relaxed);
+
+    FILE *file = fopen(sc_trace.filename, "w");
+    if (file) {
+        bool ok = sc_trace_write(file);
+        ok &= !fclose(file);
+        if (ok) {
+            LOGI("Trace written to %s", sc_trace.filename);
+        } else {
+            LOGE("Could not write trace file: %s", sc_trace.filename);
+        }
+    } else {
+        LOGE("Could not open trace file: %s", sc_trace.filename);
+    }
+
+    struct sc_trace_buffer *buffer = sc_trace.buffers;
+    while (buffer) {
+        struct sc_trace_chunk *chunk = buffer->head;
+        while (chunk) {
+            struct sc_trace_chunk *next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+        struct sc_trace_buffer *next = buffer->next;
+        free(buffer);
+        buffer = next;
+    }
+
+    sc_mutex_destroy(&sc_trace.mutex);
+    free(sc_trace.filename);
+}
@@ -0,0 +1,45 @@
+#ifndef SC_TRACE_H
+#define SC_TRACE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+#include "util/tick.h"
+
+/**
+ * Session tracing (--trace-file), exported as Chrome trace-event JSON (which
+ * can be loaded in Perfetto or chrome://tracing)
+ *
+ * Each thread records its spans in its own buffer, without any lock: the
+ * buffers are only read by sc_trace_destroy(), once all the traced threads
+ * have terminated.
+ *
+ * Usage:
+ *
+ *     sc_tick start = sc_trace_begin();
+ *     // ...
+ *     sc_trace_end("decode", start);
+ *
+ * When tracing is disabled, sc_trace_begin() returns 0 and sc_trace_end() does
+ * nothing.
+ */
+
+// Enable tracing, the trace will be written to filename on destroy
+bool
+sc_trace_init(const char *filename);
+
+// Write the trace file and release the buffers
+//
+// All the threads which recorded spans must have terminated.
+void
+sc_trace_destroy(void);
+
+sc_tick
+sc_trace_begin(void);
+
+// The name must be statically allocated (e.g. a string literal)
+void
+sc_trace_end(const char *name, sc_tick start);
+
+#endif
@@ -34,6 +34,9 @@
  *
  *     struct SC_VECDEQUE(const char *) names;
  *
+ * The capacity is always 0 or a power of 2, so that an index in the ring
+ * buffer is wrapped by a mask rather than by a (much slower) modulo.
+ *
  * Functions and macros having name ending with '_' are private.
  */
 #define SC_VECDEQUE(type) { \
@@ -103,16 +106,40 @@
  *
  * Private.
  */
-#define SC_VECDEQUE_MINCAP_ ((size_t) 10)
+#define SC_VECDEQUE_MINCAP_ ((size_t) 16)
+
+/**
+ * Return the smallest power of 2 greater than or equal to `value`
+ *
+ * Private.
+ */
+static inline size_t
+sc_vecdeque_ceil_pow2_(size_t value) {
+    size_t pow2 = 1;
+    while (pow2 < value) {
+        pow2 <<= 1;
+    }
+    return pow2;
+}
 
 /**
  * The maximal allocation size, in number of items
  *
- * Use SIZE_MAX/2 to fit in ssize_t, and so that cap*1.5 does not overflow.
+ * It is a power of 2 such that the allocation size (in bytes) fits in
+ * SIZE_MAX/4, so that it fits in ssize_t and cap*2 does not overflow.
  *
  * Private.
  */
-#define sc_vecdeque_max_cap_(pv) (SIZE_MAX / 2 / sizeof(*(pv)->data))
+#define sc_vecdeque_max_cap_(pv) \
+    ((SIZE_MAX / 4 + 1) / sc_vecdeque_ceil_pow2_(sizeof(*(pv)->data)))
+
+/**
+ * Wrap an index in the ring buffer
+ *
+ * Private.
+ */
+#define sc_vecdeque_wrap_(pv, index) \
+    ((index) & ((pv)->cap - 1))
 
 /**
  * Realloc the internal array to a specific capacity
@@ -146,17 +173,17 @@ sc_vecdeque_reallocdata_(void *ptr, size_t newcap, size_t item_size,
     if (oldorigin + size <= oldcap) {
         // The current content will stay in place, just realloc
         //
-        // As an example, here is the content of a ring-buffer (oldcap=10)
+        // As an example, here is the content of a ring-buffer (oldcap=8)
         // before the realloc:
         //
-        //     _ _ 2 3 4 5 6 7 _ _
-        //         ^
-        //         origin
+        //     _ 1 2 3 4 5 _ _
+        //       ^
+        //       origin
         //
-        // It is resized (newcap=15), e.g. with sc_vecdeque_reserve():
+        // It is resized (newcap=16), e.g. with sc_vecdeque_reserve():
         //
-        //     _ _ 2 3 4 5 6 7 _ _ _ _ _ _ _
-        //         ^
+        //     _ 1 2 3 4 5 _ _ _ _ _ _ _ _ _ _
+        //       ^
         //         origin
 
         void *newptr = reallocarray(ptr, newcap, item_size);
@@ -170,16 +197,16 @@ sc_vecdeque_reallocdata_(void *ptr, size_t newcap, size_t item_size,
 
     // Copy the current content to the new array
     //
-    // As an example, here is the content of a ring-buffer (oldcap=10) before
+    // As an example, here is the content of a ring-buffer (oldcap=8) before
     // the realloc:
     //
-    //     5 6 7 _ _ 0 1 2 3 4
-    //               ^
-    //               origin
+    //     4 5 _ _ 0 1 2 3
+    //             ^
+    //             origin
     //
-    // It is resized (newcap=15), e.g. with sc_vecdeque_reserve():
+    // It is resized (newcap=16), e.g. with sc_vecdeque_reserve():
     //
-    //     0 1 2 3 4 5 6 7 _ _ _ _ _ _ _
+    //     0 1 2 3 4 5 _ _ _ _ _ _ _ _ _ _
     //     ^
     //     origin
 
@@ -225,16 +252,11 @@ sc_vecdeque_reallocdata_(void *ptr, size_t newcap, size_t item_size,
     (bool) p; \
 });
 
-static inline size_t
-sc_vecdeque_growsize_(size_t value)
-{
-    /* integer multiplication by 1.5 */
-    return value + (value >> 1);
-}
-
 /**
  * Increase the capacity of the VecDeque to at least `mincap`
  *
+ * The resulting capacity is rounded up to a power of 2.
+ *
  * \param pv a pointer to the VecDeque
  * \param mincap (`size_t`) the requested capacity
  * \retval true on success
@@ -251,8 +273,7 @@ sc_vecdeque_growsize_(size_t value)
         ok = true; \
     } else if (mincap_ <= sc_vecdeque_max_cap_(pv)) { \
         /* not too big */ \
-        size_t newsize = sc_vecdeque_growsize_((pv)->cap); \
-        newsize = CLAMP(newsize, mincap_, sc_vecdeque_max_cap_(pv)); \
+        size_t newsize = sc_vecdeque_ceil_pow2_(mincap_); \
         ok = sc_vecdeque_realloc_(pv, newsize); \
     } else { \
         ok = false; \
@@ -272,9 +293,7 @@ sc_vecdeque_growsize_(size_t value)
 ({ \
     bool ok; \
     if ((pv)->cap < sc_vecdeque_max_cap_(pv)) { \
-        size_t newsize = sc_vecdeque_growsize_((pv)->cap); \
-        newsize = CLAMP(newsize, SC_VECDEQUE_MINCAP_, \
-                        sc_vecdeque_max_cap_(pv)); \
+        size_t newsize = MAX((pv)->cap * 2, SC_VECDEQUE_MINCAP_); \
         ok = sc_vecdeque_realloc_(pv, newsize); \
     } else { \
         ok = false; \
@@ -306,7 +325,7 @@ sc_vecdeque_growsize_(size_t value)
 ({ \
     assert(!sc_vecdeque_is_full(pv)); \
     ++(pv)->size; \
-    &(pv)->data[((pv)->origin + (pv)->size - 1) % (pv)->cap]; \
+    &(pv)->data[sc_vecdeque_wrap_(pv, (pv)->origin + (pv)->size - 1)]; \
 })
 
 /**
@@ -333,7 +352,7 @@ sc_vecdeque_growsize_(size_t value)
 (void) ({ \
     assert(!sc_vecdeque_is_full(pv)); \
     ++(pv)->size; \
-    (pv)->data[((pv)->origin + (pv)->size - 1) % (pv)->cap] = item; \
+    (pv)->data[sc_vecdeque_wrap_(pv, (pv)->origin + (pv)->size - 1)] = item; \
 })
 
 /**
@@ -353,6 +372,28 @@ sc_vecdeque_growsize_(size_t value)
     ok; \
 })
 
+/**
+ * Return a pointer to the first item (the next one to be popped)
+ *
+ * It is an error to call this function if the VecDeque is empty.
+ */
+#define sc_vecdeque_front_ref(pv) \
+({ \
+    assert(!sc_vecdeque_is_empty(pv)); \
+    &(pv)->data[(pv)->origin]; \
+})
+
+/**
+ * Return a pointer to the last item (the most recently pushed)
+ *
+ * It is an error to call this function if the VecDeque is empty.
+ */
+#define sc_vecdeque_back_ref(pv) \
+({ \
+    assert(!sc_vecdeque_is_empty(pv)); \
+    &(pv)->data[sc_vecdeque_wrap_(pv, (pv)->origin + (pv)->size - 1)]; \
+})
+
 /**
  * Pop an item and return a pointer to it (still in the VecDeque)
  *
@@ -365,7 +406,7 @@ sc_vecdeque_growsize_(size_t value)
 ({ \
     assert(!sc_vecdeque_is_empty(pv)); \
     size_t pos = (pv)->origin; \
-    (pv)->origin = ((pv)->origin + 1) % (pv)->cap; \
+    (pv)->origin = sc_vecdeque_wrap_(pv, (pv)->origin + 1); \
     --(pv)->size; \
     &(pv)->data[pos]; \
 })
@@ -2,113 +2,298 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <linux/videodev2.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+
+#include "sws.h"
 #include "util/log.h"
-#include "util/str.h"
 
 /** Downcast frame_sink to sc_v4l2_sink */
 #define DOWNCAST(SINK) container_of(SINK, struct sc_v4l2_sink, frame_sink)
 
-static const AVRational SCRCPY_TIME_BASE = {1, 1000000}; // timestamps in us
+#define SC_V4L2_MAX_PLANES 3
+
+// Layout of a plane in the device buffer
+struct sc_v4l2_plane {
+    const uint8_t *data;
+    size_t linesize; // in the frame
+    size_t row_size; // useful bytes per row
+    size_t stride; // in the device buffer
+    size_t rows;
+};
+
+static uint32_t
+get_v4l2_pixelformat(enum AVPixelFormat format) {
+    switch (format) {
+        case AV_PIX_FMT_YUV420P:
+            return V4L2_PIX_FMT_YUV420;
+        case AV_PIX_FMT_NV12:
+            return V4L2_PIX_FMT_NV12;
+        case AV_PIX_FMT_YUYV422:
+            return V4L2_PIX_FMT_YUYV;
+        case AV_PIX_FMT_RGB24:
+            return V4L2_PIX_FMT_RGB24;
+        default:
+            assert(!"unexpected pixel format");
+            return 0;
+    }
+}
 
-static const AVOutputFormat *
-find_muxer(const char *name) {
-#ifdef SCRCPY_LAVF_HAS_NEW_MUXER_ITERATOR_API
-    void *opaque = NULL;
-#endif
-    const AVOutputFormat *oformat = NULL;
-    do {
-#ifdef SCRCPY_LAVF_HAS_NEW_MUXER_ITERATOR_API
-        oformat = av_muxer_iterate(&opaque);
-#else
-        oformat = av_oformat_next(oformat);
-#endif
-        // until null or containing the requested name
-    } while (oformat && !sc_str_list_contains(oformat->name, ',', name));
-    return oformat;
+// Number of bytes per pixel of the first plane
+static unsigned
+get_bytes_per_pixel(uint32_t pixelformat) {
+    switch (pixelformat) {
+        case V4L2_PIX_FMT_YUYV:
+            return 2;
+        case V4L2_PIX_FMT_RGB24:
+            return 3;
+        default:
+            return 1;
+    }
 }
 
 static bool
-write_header(struct sc_v4l2_sink *vs, const AVPacket *packet) {
-    AVStream *ostream = vs->format_ctx->streams[0];
-
-    uint8_t *extradata = av_malloc(packet->size * sizeof(uint8_t));
-    if (!extradata) {
-        LOG_OOM();
+set_device_format(struct sc_v4l2_sink *vs, const AVFrame *frame,
+                  uint32_t pixelformat) {
+    struct v4l2_format fmt = {
+        .type = V4L2_BUF_TYPE_VIDEO_OUTPUT,
+    };
+    if (ioctl(vs->fd, VIDIOC_G_FMT, &fmt) < 0) {
+        LOGE("Could not get v4l2 format of %s: %s", vs->device_name,
+             strerror(errno));
         return false;
     }
 
-    // copy the first packet to the extra data
-    memcpy(extradata, packet->data, packet->size);
-
-    ostream->codecpar->extradata = extradata;
-    ostream->codecpar->extradata_size = packet->size;
+    fmt.fmt.pix.width = frame->width;
+    fmt.fmt.pix.height = frame->height;
+    fmt.fmt.pix.pixelformat = pixelformat;
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    fmt.fmt.pix.bytesperline = 0; // let the driver choose
+    if (ioctl(vs->fd, VIDIOC_S_FMT, &fmt) < 0) {
+        LOGE("Could not set v4l2 format of %s: %s", vs->device_name,
+             strerror(errno));
+        return false;
+    }
 
-    int ret = avformat_write_header(vs->format_ctx, NULL);
-    if (ret < 0) {
-        LOGE("Failed to write header to %s", vs->device_name);
+    if (fmt.fmt.pix.width != (uint32_t) frame->width
+            || fmt.fmt.pix.height != (uint32_t) frame->height
+            || fmt.fmt.pix.pixelformat != pixelformat) {
+        LOGE("Format %dx%d not accepted by %s", frame->width, frame->height,
+             vs->device_name);
         return false;
     }
 
+    vs->width = frame->width;
+    vs->height = frame->height;
+    vs->pixelformat = pixelformat;
+    uint32_t row_size = frame->width * get_bytes_per_pixel(pixelformat);
+    vs->bytesperline = MAX(fmt.fmt.pix.bytesperline, row_size);
+    LOGD("v4l2 format: %dx%d %s, %" PRIu32 " bytes per line", vs->width,
+         vs->height, av_get_pix_fmt_name(frame->format), vs->bytesperline);
     return true;
 }
 
-static void
-rescale_packet(struct sc_v4l2_sink *vs, AVPacket *packet) {
-    AVStream *ostream = vs->format_ctx->streams[0];
-    av_packet_rescale_ts(packet, SCRCPY_TIME_BASE, ostream->time_base);
+static unsigned
+get_planes(struct sc_v4l2_sink *vs, const AVFrame *frame,
+           struct sc_v4l2_plane planes[SC_V4L2_MAX_PLANES]) {
+    size_t chroma_width = (frame->width + 1) / 2;
+    size_t chroma_height = (frame->height + 1) / 2;
+
+    planes[0] = (struct sc_v4l2_plane) {
+        .data = frame->data[0],
+        .linesize = frame->linesize[0],
+        .row_size = frame->width * get_bytes_per_pixel(vs->pixelformat),
+        .stride = vs->bytesperline,
+        .rows = frame->height,
+    };
+
+    if (vs->pixelformat == V4L2_PIX_FMT_YUYV
+            || vs->pixelformat == V4L2_PIX_FMT_RGB24) {
+        // Packed formats
+        return 1;
+    }
+
+    if (vs->pixelformat == V4L2_PIX_FMT_NV12) {
+        // Interleaved U and V
+        planes[1] = (struct sc_v4l2_plane) {
+            .data = frame->data[1],
+            .linesize = frame->linesize[1],
+            .row_size = 2 * chroma_width,
+            .stride = vs->bytesperline,
+            .rows = chroma_height,
+        };
+        return 2;
+    }
+
+    assert(vs->pixelformat == V4L2_PIX_FMT_YUV420);
+    for (unsigned i = 1; i < 3; ++i) {
+        planes[i] = (struct sc_v4l2_plane) {
+            .data = frame->data[i],
+            .linesize = frame->linesize[i],
+            .row_size = MIN(chroma_width, vs->bytesperline / 2),
+            .stride = vs->bytesperline / 2,
+            .rows = chroma_height,
+        };
+    }
+    return 3;
 }
 
 static bool
-write_packet(struct sc_v4l2_sink *vs, AVPacket *packet) {
-    if (!vs->header_written) {
-        bool ok = write_header(vs, packet);
-        if (!ok) {
+write_frame(struct sc_v4l2_sink *vs, const AVFrame *frame) {
+    uint32_t pixelformat = get_v4l2_pixelformat(frame->format);
+    if (frame->width != vs->width || frame->height != vs->height
+            || pixelformat != vs->pixelformat) {
+        if (!set_device_format(vs, frame, pixelformat)) {
             return false;
         }
-        vs->header_written = true;
-        return true;
     }
 
-    rescale_packet(vs, packet);
+    struct sc_v4l2_plane planes[SC_V4L2_MAX_PLANES];
+    unsigned count = get_planes(vs, frame, planes);
 
-    bool ok = av_write_frame(vs->format_ctx, packet) >= 0;
+    size_t size = 0;
+    bool packed = true;
+    for (unsigned i = 0; i < count; ++i) {
+        size += planes[i].stride * planes[i].rows;
+        packed &= planes[i].linesize == planes[i].stride
+               && planes[i].row_size == planes[i].stride;
+    }
 
-    // Failing to write the last frame is not very serious, no future frame may
-    // depend on it, so the resulting file will still be valid
-    (void) ok;
+    // The device expects a whole frame per write()
+    struct iovec iov[SC_V4L2_MAX_PLANES];
+    unsigned iovcnt;
+    if (packed) {
+        // The planes are written directly from the frame
+        for (unsigned i = 0; i < count; ++i) {
+            iov[i].iov_base = (void *) planes[i].data; // discard const
+            iov[i].iov_len = planes[i].stride * planes[i].rows;
+        }
+        iovcnt = count;
+    } else {
+        // The rows are padded, remove the padding in a single copy
+        if (size > vs->buffer_size) {
+            uint8_t *buffer = realloc(vs->buffer, size);
+            if (!buffer) {
+                LOG_OOM();
+                return false;
+            }
+            vs->buffer = buffer;
+            vs->buffer_size = size;
+        }
+
+        uint8_t *dst = vs->buffer;
+        for (unsigned i = 0; i < count; ++i) {
+            const struct sc_v4l2_plane *plane = &planes[i];
+            for (size_t row = 0; row < plane->rows; ++row) {
+                memcpy(dst, plane->data + row * plane->linesize,
+                       plane->row_size);
+                memset(dst + plane->row_size, 0,
+                       plane->stride - plane->row_size);
+                dst += plane->stride;
+            }
+        }
+        iov[0].iov_base = vs->buffer;
+        iov[0].iov_len = size;
+        iovcnt = 1;
+    }
+
+    ssize_t w;
+    do {
+        w = writev(vs->fd, iov, iovcnt);
+    } while (w < 0 && errno == EINTR);
+    if (w < 0) {
+        LOGE("Could not write frame to %s: %s", vs->device_name,
+             strerror(errno));
+        return false;
+    }
+
+    if ((size_t) w != size) {
+        // Not fatal, the next frame may be written entirely
+        LOGW("Partial frame written to %s (%" SC_PRIsizet "/%" SC_PRIsizet
+             " bytes)", vs->device_name, (size_t) w, size);
+    }
 
     return true;
 }
 
-static bool
-encode_and_write_frame(struct sc_v4l2_sink *vs, const AVFrame *frame) {
-    int ret = avcodec_send_frame(vs->encoder_ctx, frame);
-    if (ret < 0 && ret != AVERROR(EAGAIN)) {
-        LOGE("Could not send v4l2 video frame: %d", ret);
-        return false;
+static enum AVPixelFormat
+get_output_format(enum sc_v4l2_format format, enum AVPixelFormat input) {
+    switch (format) {
+        case SC_V4L2_FORMAT_NV12:
+            return AV_PIX_FMT_NV12;
+        case SC_V4L2_FORMAT_YUYV:
+            return AV_PIX_FMT_YUYV422;
+        case SC_V4L2_FORMAT_RGB24:
+            return AV_PIX_FMT_RGB24;
+        case SC_V4L2_FORMAT_YUV420:
+            return AV_PIX_FMT_YUV420P;
+        default:
+            assert(format == SC_V4L2_FORMAT_AUTO);
+            // NV12 frames from the hardware decoder are written as is
+            return input == AV_PIX_FMT_NV12 ? AV_PIX_FMT_NV12
+                                            : AV_PIX_FMT_YUV420P;
     }
+}
 
-    AVPacket *packet = vs->packet;
-    ret = avcodec_receive_packet(vs->encoder_ctx, packet);
-    if (ret == 0) {
-        // A packet was received
+// Return the frame in the output format and size, converted if necessary
+static const AVFrame *
+convert_frame(struct sc_v4l2_sink *vs, const AVFrame *frame) {
+    enum AVPixelFormat format = get_output_format(vs->format, frame->format);
+    int width = vs->output_width ? vs->output_width : frame->width;
+    int height = vs->output_height ? vs->output_height : frame->height;
 
-        bool ok = write_packet(vs, packet);
-        av_packet_unref(packet);
-        if (!ok) {
-            LOGW("Could not send packet to v4l2 sink");
-            return false;
+    if (frame->format == format && frame->width == width
+            && frame->height == height) {
+        return frame;
+    }
+
+    if (!vs->out_frame) {
+        vs->out_frame = av_frame_alloc();
+        if (!vs->out_frame) {
+            LOG_OOM();
+            return NULL;
         }
-    } else if (ret != AVERROR(EAGAIN)) {
-        LOGE("Could not receive v4l2 video packet: %d", ret);
-        return false;
     }
 
-    return true;
+    AVFrame *out = vs->out_frame;
+    if (out->format != format || out->width != width
+            || out->height != height) {
+        // The frame data is written synchronously, so the buffer is reused
+        av_frame_unref(out);
+        out->format = format;
+        out->width = width;
+        out->height = height;
+        if (av_frame_get_buffer(out, 0) < 0) {
+            LOG_OOM();
+            av_frame_unref(out);
+            return NULL;
+        }
+    }
+
+    bool scale = frame->width != width || frame->height != height;
+    vs->sws_ctx =
+        sc_sws_get_context(vs->sws_ctx, frame->width, frame->height,
+                           frame->format, width, height, format,
+                           scale ? SWS_BILINEAR : SWS_POINT);
+    if (!vs->sws_ctx) {
+        LOGE("Could not initialize v4l2 frame conversion");
+        return NULL;
+    }
+
+    sws_scale(vs->sws_ctx, (const uint8_t *const *) frame->data,
+              frame->linesize, 0, frame->height, out->data, out->linesize);
+    av_frame_copy_props(out, frame);
+
+    return out;
 }
 
 static int
@@ -127,13 +312,20 @@ run_v4l2_sink(void *data) {
             break;
         }
 
-        vs->has_frame = false;
-        sc_mutex_unlock(&vs->mutex);
-
-        sc_frame_buffer_consume(&vs->fb, vs->frame);
+        struct sc_shared_frame *shared;
+        if (vs->queued) {
+            shared = sc_vecdeque_pop(&vs->queue);
+            vs->has_frame = !sc_vecdeque_is_empty(&vs->queue);
+            sc_mutex_unlock(&vs->mutex);
+        } else {
+            vs->has_frame = false;
+            sc_mutex_unlock(&vs->mutex);
+            shared = sc_frame_buffer_consume(&vs->fb);
+        }
 
-        bool ok = encode_and_write_frame(vs, vs->frame);
-        av_frame_unref(vs->frame);
+        const AVFrame *frame = convert_frame(vs, shared->frame);
+        bool ok = frame && write_frame(vs, frame);
+        sc_shared_frame_release(shared);
         if (!ok) {
             LOGE("Could not send frame to v4l2 sink");
             break;
@@ -165,119 +357,41 @@ sc_v4l2_sink_open(struct sc_v4l2_sink *vs, const AVCodecContext *ctx) {
         goto error_mutex_destroy;
     }
 
-    const AVOutputFormat *format = find_muxer("v4l2");
-    if (!format) {
-        // Alternative name
-        format = find_muxer("video4linux2");
-    }
-    if (!format) {
-        LOGE("Could not find v4l2 muxer");
+    vs->fd = open(vs->device_name, O_WRONLY | O_CLOEXEC);
+    if (vs->fd < 0) {
+        LOGE("Failed to open output device %s: %s", vs->device_name,
+             strerror(errno));
         goto error_cond_destroy;
     }
 
-    const AVCodec *encoder = avcodec_find_encoder(AV_CODEC_ID_RAWVIDEO);
-    if (!encoder) {
-        LOGE("Raw video encoder not found");
-        return false;
-    }
-
-    vs->format_ctx = avformat_alloc_context();
-    if (!vs->format_ctx) {
-        LOG_OOM();
-        return false;
-    }
-
-    // contrary to the deprecated API (av_oformat_next()), av_muxer_iterate()
-    // returns (on purpose) a pointer-to-const, but AVFormatContext.oformat
-    // still expects a pointer-to-non-const (it has not be updated accordingly)
-    // <https://github.com/FFmpeg/FFmpeg/commit/0694d8702421e7aff1340038559c438b61bb30dd>
-    vs->format_ctx->oformat = (AVOutputFormat *) format;
-#ifdef SCRCPY_LAVF_HAS_AVFORMATCONTEXT_URL
-    vs->format_ctx->url = strdup(vs->device_name);
-    if (!vs->format_ctx->url) {
-        LOG_OOM();
-        goto error_avformat_free_context;
-    }
-#else
-    strncpy(vs->format_ctx->filename, vs->device_name,
-            sizeof(vs->format_ctx->filename));
-#endif
-
-    AVStream *ostream = avformat_new_stream(vs->format_ctx, encoder);
-    if (!ostream) {
-        LOG_OOM();
-        goto error_avformat_free_context;
-    }
-
-    int r = avcodec_parameters_from_context(ostream->codecpar, ctx);
-    if (r < 0) {
-        goto error_avformat_free_context;
-    }
-
-    // The codec is from the v4l2 encoder, not from the decoder
-    ostream->codecpar->codec_id = encoder->id;
-
-    int ret = avio_open(&vs->format_ctx->pb, vs->device_name, AVIO_FLAG_WRITE);
-    if (ret < 0) {
-        LOGE("Failed to open output device: %s", vs->device_name);
-        // ostream will be cleaned up during context cleaning
-        goto error_avformat_free_context;
-    }
-
-    vs->encoder_ctx = avcodec_alloc_context3(encoder);
-    if (!vs->encoder_ctx) {
-        LOG_OOM();
-        goto error_avio_close;
-    }
-
-    vs->encoder_ctx->width = ctx->width;
-    vs->encoder_ctx->height = ctx->height;
-    vs->encoder_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
-    vs->encoder_ctx->time_base.num = 1;
-    vs->encoder_ctx->time_base.den = 1;
-
-    if (avcodec_open2(vs->encoder_ctx, encoder, NULL) < 0) {
-        LOGE("Could not open codec for v4l2");
-        goto error_avcodec_free_context;
-    }
-
-    vs->frame = av_frame_alloc();
-    if (!vs->frame) {
-        LOG_OOM();
-        goto error_avcodec_free_context;
-    }
+    // The format is set on the first frame
+    vs->width = 0;
+    vs->height = 0;
+    vs->pixelformat = 0;
+    vs->bytesperline = 0;
 
-    vs->packet = av_packet_alloc();
-    if (!vs->packet) {
-        LOG_OOM();
-        goto error_av_frame_free;
-    }
+    vs->buffer = NULL;
+    vs->buffer_size = 0;
+    vs->out_frame = NULL;
+    vs->sws_ctx = NULL;
 
     vs->has_frame = false;
-    vs->header_written = false;
     vs->stopped = false;
+    sc_vecdeque_init(&vs->queue);
 
     LOGD("Starting v4l2 thread");
     ok = sc_thread_create(&vs->thread, run_v4l2_sink, "scrcpy-v4l2", vs);
     if (!ok) {
         LOGE("Could not start v4l2 thread");
-        goto error_av_packet_free;
+        goto error_close_fd;
     }
 
     LOGI("v4l2 sink started to device: %s", vs->device_name);
 
     return true;
 
-error_av_packet_free:
-    av_packet_free(&vs->packet);
-error_av_frame_free:
-    av_frame_free(&vs->frame);
-error_avcodec_free_context:
-    avcodec_free_context(&vs->encoder_ctx);
-error_avio_close:
-    avio_close(vs->format_ctx->pb);
-error_avformat_free_context:
-    avformat_free_context(vs->format_ctx);
+error_close_fd:
+    close(vs->fd);
 error_cond_destroy:
     sc_cond_destroy(&vs->cond);
 error_mutex_destroy:
@@ -297,24 +411,58 @@ sc_v4l2_sink_close(struct sc_v4l2_sink *vs) {
 
     sc_thread_join(&vs->thread, NULL);
 
-    av_packet_free(&vs->packet);
-    av_frame_free(&vs->frame);
-    avcodec_free_context(&vs->encoder_ctx);
-    avio_close(vs->format_ctx->pb);
-    avformat_free_context(vs->format_ctx);
+    sws_freeContext(vs->sws_ctx);
+    av_frame_free(&vs->out_frame);
+    free(vs->buffer);
+    close(vs->fd);
+    while (!sc_vecdeque_is_empty(&vs->queue)) {
+        sc_shared_frame_release(sc_vecdeque_pop(&vs->queue));
+    }
+    sc_vecdeque_destroy(&vs->queue);
     sc_cond_destroy(&vs->cond);
     sc_mutex_destroy(&vs->mutex);
     sc_frame_buffer_destroy(&vs->fb);
 }
 
 static bool
-sc_v4l2_sink_push(struct sc_v4l2_sink *vs, const AVFrame *frame) {
-    bool previous_skipped;
-    bool ok = sc_frame_buffer_push(&vs->fb, frame, &previous_skipped);
+sc_v4l2_sink_push_queued(struct sc_v4l2_sink *vs,
+                         struct sc_shared_frame *frame) {
+    struct sc_shared_frame *dropped = NULL;
+
+    sc_mutex_lock(&vs->mutex);
+    if (sc_vecdeque_size(&vs->queue) >= SC_V4L2_SINK_QUEUE_MAX) {
+        // The device does not keep up, drop the oldest frame rather than
+        // blocking the decoder
+        dropped = sc_vecdeque_pop(&vs->queue);
+    }
+    bool ok = sc_vecdeque_push(&vs->queue, frame);
+    if (ok) {
+        sc_shared_frame_acquire(frame);
+        vs->has_frame = true;
+        sc_cond_signal(&vs->cond);
+    }
+    sc_mutex_unlock(&vs->mutex);
+
+    if (dropped) {
+        LOGD("v4l2 sink queue full, frame dropped");
+        sc_shared_frame_release(dropped);
+    }
+
     if (!ok) {
-        return false;
+        LOG_OOM();
+    }
+    return ok;
+}
+
+static bool
+sc_v4l2_sink_push(struct sc_v4l2_sink *vs, struct sc_shared_frame *frame) {
+    if (vs->queued) {
+        return sc_v4l2_sink_push_queued(vs, frame);
     }
 
+    bool previous_skipped;
+    sc_frame_buffer_push(&vs->fb, frame, &previous_skipped);
+
     if (!previous_skipped) {
         sc_mutex_lock(&vs->mutex);
         vs->has_frame = true;
@@ -338,23 +486,31 @@ sc_v4l2_frame_sink_close(struct sc_frame_sink *sink) {
 }
 
 static bool
-sc_v4l2_frame_sink_push(struct sc_frame_sink *sink, const AVFrame *frame) {
+sc_v4l2_frame_sink_push_shared(struct sc_frame_sink *sink,
+                               struct sc_shared_frame *frame) {
     struct sc_v4l2_sink *vs = DOWNCAST(sink);
     return sc_v4l2_sink_push(vs, frame);
 }
 
 bool
-sc_v4l2_sink_init(struct sc_v4l2_sink *vs, const char *device_name) {
+sc_v4l2_sink_init(struct sc_v4l2_sink *vs, const char *device_name,
+                  enum sc_v4l2_format format, uint16_t width,
+                  uint16_t height) {
     vs->device_name = strdup(device_name);
     if (!vs->device_name) {
         LOGE("Could not strdup v4l2 device name");
         return false;
     }
 
+    vs->format = format;
+    vs->output_width = width;
+    vs->output_height = height;
+    vs->queued = false;
+
     static const struct sc_frame_sink_ops ops = {
         .open = sc_v4l2_frame_sink_open,
         .close = sc_v4l2_frame_sink_close,
-        .push = sc_v4l2_frame_sink_push,
+        .push_shared = sc_v4l2_frame_sink_push_shared,
     };
 
     vs->frame_sink.ops = &ops;
@@ -366,3 +522,8 @@ void
 sc_v4l2_sink_destroy(struct sc_v4l2_sink *vs) {
     free(vs->device_name);
 }
+
+void
+sc_v4l2_sink_set_queued(struct sc_v4l2_sink *vs) {
+    vs->queued = true;
+}
@@ -4,37 +4,74 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <libavcodec/avcodec.h>
-#include <libavformat/avformat.h>
 
 #include "frame_buffer.h"
+#include "options.h"
 #include "trait/frame_sink.h"
 #include "util/thread.h"
+#include "util/vecdeque.h"
+
+// Maximum number of frames queued in throughput mode
+#define SC_V4L2_SINK_QUEUE_MAX 16
 
 struct sc_v4l2_sink {
     struct sc_frame_sink frame_sink; // frame sink trait
 
     struct sc_frame_buffer fb;
-    AVFormatContext *format_ctx;
-    AVCodecContext *encoder_ctx;
+
+    // In throughput mode (see sc_v4l2_sink_set_queued()), the frames are
+    // queued (protected by the mutex) instead of going through fb
+    bool queued;
+    struct SC_VECDEQUE(struct sc_shared_frame *) queue;
 
     char *device_name;
+    int fd;
+
+    // Requested output (a 0 size means the size of the decoded frames)
+    enum sc_v4l2_format format;
+    uint16_t output_width;
+    uint16_t output_height;
+
+    // Current format of the device (set from the frames)
+    int width;
+    int height;
+    uint32_t pixelformat; // V4L2_PIX_FMT_*
+    uint32_t bytesperline;
 
     sc_thread thread;
     sc_mutex mutex;
     sc_cond cond;
     bool has_frame;
     bool stopped;
-    bool header_written;
 
-    AVFrame *frame;
-    AVPacket *packet;
+    // Frames with padded rows are copied to this buffer to be written in a
+    // single write()
+    uint8_t *buffer;
+    size_t buffer_size;
+
+    // Conversion of the frames not in the output format or size, lazily
+    // initialized (on the sink thread, so that it never blocks the other
+    // frame sinks)
+    AVFrame *out_frame;
+    struct SwsContext *sws_ctx;
 };
 
 bool
-sc_v4l2_sink_init(struct sc_v4l2_sink *vs, const char *device_name);
+sc_v4l2_sink_init(struct sc_v4l2_sink *vs, const char *device_name,
+                  enum sc_v4l2_format format, uint16_t width,
+                  uint16_t height);
 
 void
 sc_v4l2_sink_destroy(struct sc_v4l2_sink *vs);
 
+// Write every frame (up to SC_V4L2_SINK_QUEUE_MAX pending frames) rather than
+// only the latest one, for throughput rather than latency (--throughput)
+//
+// It must be called before the sink is opened.
+void
+sc_v4l2_sink_set_queued(struct sc_v4l2_sink *vs);
+
 #endif
@@ -0,0 +1,116 @@
+#include "video_feedback.h"
+
+#include <assert.h>
+#include <libavutil/avutil.h>
+
+#include "control_msg.h"
+#include "util/log.h"
+
+/** Downcast packet sink to sc_video_feedback */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_video_feedback, packet_sink)
+
+static void
+sc_video_feedback_start_period(struct sc_video_feedback *feedback,
+                               sc_tick now, sc_tick offset) {
+    feedback->period_start = now;
+    feedback->period_bytes = 0;
+    feedback->period_max_offset = offset;
+    feedback->period_min_offset = offset;
+}
+
+static void
+sc_video_feedback_send(struct sc_video_feedback *feedback, sc_tick now) {
+    sc_tick duration = now - feedback->period_start;
+    assert(duration > 0);
+
+    uint64_t bit_rate = feedback->period_bytes * 8 * SC_TICK_FREQ
+                      / (uint64_t) duration;
+
+    sc_tick min_offset = MIN(feedback->period_min_offset,
+                             feedback->prev_min_offset);
+    sc_tick delay_ms = SC_TICK_TO_MS(feedback->period_max_offset - min_offset);
+
+    unsigned backlog = feedback->frames
+                     ? sc_frame_source_sinks_get_backlog(feedback->frames)
+                     : 0;
+
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_VIDEO_FEEDBACK;
+    msg.video_feedback.bit_rate = MIN(bit_rate, UINT32_MAX);
+    msg.video_feedback.delay = MIN(delay_ms, UINT16_MAX);
+    msg.video_feedback.backlog = MIN(backlog, UINT16_MAX);
+
+    if (!sc_controller_push_msg(feedback->controller, &msg)) {
+        LOGW("Could not send video feedback");
+    }
+
+    feedback->prev_min_offset = feedback->period_min_offset;
+}
+
+static bool
+sc_video_feedback_packet_sink_open(struct sc_packet_sink *sink,
+                                   AVCodecContext *ctx) {
+    (void) sink;
+    (void) ctx;
+    return true;
+}
+
+static void
+sc_video_feedback_packet_sink_close(struct sc_packet_sink *sink) {
+    (void) sink;
+}
+
+static bool
+sc_video_feedback_packet_sink_push(struct sc_packet_sink *sink,
+                                   const AVPacket *packet) {
+    struct sc_video_feedback *feedback = DOWNCAST(sink);
+
+    bool is_config = packet->pts == AV_NOPTS_VALUE;
+    if (is_config) {
+        return true;
+    }
+
+    sc_tick now = sc_tick_now();
+    // The PTS is in microseconds, like sc_tick
+    sc_tick offset = now - SC_TICK_FROM_US(packet->pts);
+
+    if (!feedback->period_start) {
+        // First packet
+        sc_video_feedback_start_period(feedback, now, offset);
+        feedback->prev_min_offset = offset;
+    } else if (now - feedback->period_start >= SC_VIDEO_FEEDBACK_PERIOD) {
+        sc_video_feedback_send(feedback, now);
+        sc_video_feedback_start_period(feedback, now, offset);
+    }
+
+    feedback->period_bytes += packet->size;
+    if (offset > feedback->period_max_offset) {
+        feedback->period_max_offset = offset;
+    }
+    if (offset < feedback->period_min_offset) {
+        feedback->period_min_offset = offset;
+    }
+
+    return true;
+}
+
+void
+sc_video_feedback_init(struct sc_video_feedback *feedback,
+                       struct sc_controller *controller,
+                       struct sc_frame_source *frames) {
+    feedback->controller = controller;
+    feedback->frames = frames;
+    feedback->period_start = 0;
+    feedback->period_bytes = 0;
+    feedback->period_max_offset = 0;
+    feedback->period_min_offset = 0;
+    feedback->prev_min_offset = 0;
+
+    static const struct sc_packet_sink_ops ops = {
+        .open = sc_video_feedback_packet_sink_open,
+        .close = sc_video_feedback_packet_sink_close,
+        .push = sc_video_feedback_packet_sink_push,
+    };
+
+    feedback->packet_sink.ops = &ops;
+}
@@ -0,0 +1,47 @@
+#ifndef SC_VIDEO_FEEDBACK_H
+#define SC_VIDEO_FEEDBACK_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "controller.h"
+#include "trait/frame_source.h"
+#include "trait/packet_sink.h"
+#include "util/tick.h"
+
+// Interval between two feedback reports
+#define SC_VIDEO_FEEDBACK_PERIOD SC_TICK_FROM_SEC(1)
+
+/**
+ * Video feedback reporter (--video-bit-rate-adaptive)
+ *
+ * It is a packet sink of the video demuxer. Once per period, it sends to the
+ * device the received bit rate, the increase of the transit delay (packets
+ * queued in the network) and the backlog of the frame sinks (frames not
+ * rendered in time), so that the device can adapt the encoding bit rate.
+ */
+struct sc_video_feedback {
+    struct sc_packet_sink packet_sink; // packet sink trait
+
+    struct sc_controller *controller;
+    // The video decoder frame source (may be NULL), to report its backlog
+    struct sc_frame_source *frames;
+
+    sc_tick period_start; // 0 if no packet has been received yet
+    uint64_t period_bytes;
+    // Maximal (client reception - device PTS) offset during the period
+    sc_tick period_max_offset;
+    // Minimal offset during the current and the previous periods (the device
+    // and client clocks are not synchronized, and may drift)
+    sc_tick period_min_offset;
+    sc_tick prev_min_offset;
+};
+
+void
+sc_video_feedback_init(struct sc_video_feedback *feedback,
+                       struct sc_controller *controller,
+                       struct sc_frame_source *frames);
+
+#endif
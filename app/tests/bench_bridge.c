@@ -0,0 +1,715 @@
+#include "common.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+# include <signal.h>
+#endif
+
+#include "figma_bridge.h"
+#include "perf.h"
+#include "util/binary.h"
+#include "util/log.h"
+#include "util/net.h"
+#include "util/thread.h"
+#include "util/tick.h"
+#include "util/vector.h"
+
+/**
+ * Load generator for the Figma bridge
+ *
+ * A producer publishes screenshots (and live stream fragments) at a fixed
+ * rate, while concurrent clients:
+ *  - long poll /scrcpy-bridge/latest (like the Figma plugin);
+ *  - watch /scrcpy-bridge/stream.mp4.
+ *
+ * It reports the latency percentiles of the requests and of the delivery of
+ * the screenshots and fragments (from their publication), and the errors.
+ *
+ * Each connection holds a bridge worker: beyond SC_FIGMA_BRIDGE_WORKERS, the
+ * connections wait in the pending queue of the bridge (or are rejected with
+ * 503 when it is full), and the bridge closes the persistent connections after
+ * their response to serve them.
+ */
+
+#define BENCH_PORT_FIRST 27340
+#define BENCH_PORT_LAST 27349
+
+#define BENCH_SCREENSHOT_WIDTH 1080
+#define BENCH_SCREENSHOT_HEIGHT 2400
+
+#define BENCH_INIT_SIZE 1024
+#define BENCH_FRAGMENT_SIZE (16 * 1024)
+
+// Number of recent publications whose time is kept to compute the delivery
+// latencies
+#define BENCH_PUBLISHED_HISTORY 1024
+
+// Delay before reconnecting after an error
+#define BENCH_RETRY_DELAY SC_TICK_FROM_MS(10)
+
+#define BENCH_MAX_CLIENTS 64
+
+struct bench_latencies SC_VECTOR(int64_t);
+
+struct bench_client_stats {
+    uint64_t requests; // successful requests (or fragments for a viewer)
+    uint64_t connect_errors;
+    uint64_t busy_errors; // 503
+    uint64_t status_errors; // any other unexpected status
+    uint64_t io_errors;
+    struct bench_latencies request_latencies; // in microseconds
+    struct bench_latencies delivery_latencies; // in microseconds
+};
+
+struct bench;
+
+struct bench_client {
+    struct bench *bench;
+    sc_thread thread;
+    struct perf_http_client http;
+    bool connected; // protected by bench->mutex
+    struct bench_client_stats stats;
+};
+
+struct bench_options {
+    unsigned clients;
+    unsigned streams;
+    unsigned rate; // publications per second
+    unsigned duration; // in seconds
+    size_t size; // of the screenshots
+    bool keep_alive;
+};
+
+struct bench {
+    struct bench_options options;
+    struct sc_figma_bridge bridge;
+    uint16_t port;
+
+    sc_thread producer;
+    uint8_t *screenshot;
+    uint8_t *fragment;
+
+    sc_mutex mutex;
+    sc_cond cond; // signaled when stopped
+    bool stopped;
+    uint64_t first_sequence; // of the bridge screenshots
+    uint64_t published; // number of publications
+    sc_tick published_ticks[BENCH_PUBLISHED_HISTORY];
+
+    struct bench_client clients[BENCH_MAX_CLIENTS];
+};
+
+static bool
+bench_is_stopped(struct bench *bench) {
+    sc_mutex_lock(&bench->mutex);
+    bool stopped = bench->stopped;
+    sc_mutex_unlock(&bench->mutex);
+    return stopped;
+}
+
+// Return false if stopped meanwhile
+static bool
+bench_sleep_until(struct bench *bench, sc_tick deadline) {
+    sc_mutex_lock(&bench->mutex);
+    while (!bench->stopped && sc_tick_now() < deadline) {
+        sc_cond_timedwait(&bench->cond, &bench->mutex, deadline);
+    }
+    bool stopped = bench->stopped;
+    sc_mutex_unlock(&bench->mutex);
+    return !stopped;
+}
+
+// Return the latency (in microseconds) of the delivery of the publication
+// `index`, or -1 if it is too old to be known
+static int64_t
+bench_delivery_latency(struct bench *bench, uint64_t index, sc_tick now) {
+    int64_t latency = -1;
+    sc_mutex_lock(&bench->mutex);
+    if (index < bench->published
+            && bench->published - index <= BENCH_PUBLISHED_HISTORY) {
+        sc_tick tick = bench->published_ticks[index % BENCH_PUBLISHED_HISTORY];
+        latency = SC_TICK_TO_US(now - tick);
+    }
+    sc_mutex_unlock(&bench->mutex);
+    return latency;
+}
+
+static int
+run_producer(void *data) {
+    struct bench *bench = data;
+    struct sc_figma_bridge *bridge = &bench->bridge;
+
+    sc_tick period = SC_TICK_FREQ / bench->options.rate;
+    sc_tick start = sc_tick_now();
+
+    for (uint64_t index = 0;; ++index) {
+        // Fixed rate, even if a publication is late
+        if (!bench_sleep_until(bench, start + index * period)) {
+            break;
+        }
+
+        sc_mutex_lock(&bench->mutex);
+        bench->published_ticks[index % BENCH_PUBLISHED_HISTORY] =
+            sc_tick_now();
+        bench->published = index + 1;
+        sc_mutex_unlock(&bench->mutex);
+
+        // The viewers identify each fragment by its first bytes
+        sc_write64be(bench->fragment, index);
+
+        bool ok = sc_figma_bridge_publish_png(bridge, bench->screenshot,
+                                              bench->options.size,
+                                              BENCH_SCREENSHOT_WIDTH,
+                                              BENCH_SCREENSHOT_HEIGHT)
+               && sc_figma_bridge_publish_stream_fragment(bridge,
+                                                          bench->fragment,
+                                                          BENCH_FRAGMENT_SIZE,
+                                                          true);
+        if (!ok) {
+            fprintf(stderr, "Could not publish\n");
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static bool
+bench_client_connect(struct bench_client *client) {
+    struct bench *bench = client->bench;
+
+    if (!perf_http_connect(&client->http, bench->port)) {
+        ++client->stats.connect_errors;
+        return false;
+    }
+
+    sc_mutex_lock(&bench->mutex);
+    bool stopped = bench->stopped;
+    client->connected = !stopped;
+    sc_mutex_unlock(&bench->mutex);
+
+    if (stopped) {
+        // The socket has not been interrupted on stop
+        perf_http_close(&client->http);
+        return false;
+    }
+
+    return true;
+}
+
+static void
+bench_client_close(struct bench_client *client) {
+    struct bench *bench = client->bench;
+
+    sc_mutex_lock(&bench->mutex);
+    client->connected = false;
+    sc_mutex_unlock(&bench->mutex);
+
+    perf_http_close(&client->http);
+}
+
+static bool
+bench_push_latency(struct bench_latencies *latencies, int64_t latency) {
+    if (!sc_vector_push(latencies, latency)) {
+        LOG_OOM();
+        return false;
+    }
+    return true;
+}
+
+static int
+run_poller(void *data) {
+    struct bench_client *client = data;
+    struct bench *bench = client->bench;
+    struct bench_client_stats *stats = &client->stats;
+
+    uint64_t after = 0;
+    bool connected = false;
+    while (!bench_is_stopped(bench)) {
+        if (!connected) {
+            connected = bench_client_connect(client);
+            if (!connected) {
+                bench_sleep_until(bench, sc_tick_now() + BENCH_RETRY_DELAY);
+                continue;
+            }
+        }
+
+        char uri[128];
+        snprintf(uri, sizeof(uri),
+                 "/scrcpy-bridge/latest?after=%" PRIu64 "&wait=1000", after);
+
+        sc_tick start = sc_tick_now();
+        struct perf_http_response response;
+        bool ok = perf_http_get(&client->http, uri, bench->options.keep_alive,
+                                &response);
+        sc_tick now = sc_tick_now();
+
+        if (!ok) {
+            // An interrupted request is not an error
+            if (!bench_is_stopped(bench)) {
+                ++stats->io_errors;
+            }
+        } else if (response.status == 200 || response.status == 204) {
+            ++stats->requests;
+            if (!bench_push_latency(&stats->request_latencies,
+                                    SC_TICK_TO_US(now - start))) {
+                break;
+            }
+            if (response.status == 200 && response.seq > after) {
+                after = response.seq;
+                int64_t latency =
+                    bench_delivery_latency(bench, response.seq
+                                                - bench->first_sequence - 1,
+                                           now);
+                if (latency >= 0
+                        && !bench_push_latency(&stats->delivery_latencies,
+                                               latency)) {
+                    break;
+                }
+            }
+        } else if (response.status == 503) {
+            ++stats->busy_errors;
+            ok = false;
+        } else {
+            ++stats->status_errors;
+            ok = false;
+        }
+
+        // The bridge closes idle connections while other clients wait for a
+        // worker
+        if (!ok || response.close) {
+            bench_client_close(client);
+            connected = false;
+            if (!ok) {
+                bench_sleep_until(bench, sc_tick_now() + BENCH_RETRY_DELAY);
+            }
+        }
+    }
+
+    if (connected) {
+        bench_client_close(client);
+    }
+
+    return 0;
+}
+
+// Read exactly `len` bytes of the body, the beginning of which may have been
+// received along with the headers (in client->http.buf, from `*offset`)
+static bool
+bench_stream_read(struct bench_client *client, size_t *offset, uint8_t *dst,
+                  size_t len) {
+    struct perf_http_client *http = &client->http;
+
+    size_t buffered = http->len - *offset;
+    size_t n = buffered < len ? buffered : len;
+    memcpy(dst, http->buf + *offset, n);
+    *offset += n;
+
+    if (n < len) {
+        ssize_t r = net_recv_all(http->socket, dst + n, len - n);
+        if (r < 0 || (size_t) r != len - n) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Watch the stream until it fails, return the HTTP status (-1 on I/O error)
+static int
+bench_watch_stream(struct bench_client *client, uint8_t *fragment) {
+    struct bench *bench = client->bench;
+    struct perf_http_client *http = &client->http;
+    struct bench_client_stats *stats = &client->stats;
+
+    static const char request[] =
+        "GET /scrcpy-bridge/stream.mp4 HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    ssize_t w = net_send_all(http->socket, request, sizeof(request) - 1);
+    if (w != sizeof(request) - 1) {
+        return -1;
+    }
+
+    // Read the headers
+    char *end;
+    for (;;) {
+        http->buf[http->len] = '\0';
+        end = strstr(http->buf, "\r\n\r\n");
+        if (end) {
+            break;
+        }
+        if (http->len == PERF_HTTP_HEADERS_MAX) {
+            return -1;
+        }
+        ssize_t r = net_recv(http->socket, http->buf + http->len,
+                             PERF_HTTP_HEADERS_MAX - http->len);
+        if (r <= 0) {
+            return -1;
+        }
+        http->len += r;
+    }
+
+    int status;
+    if (sscanf(http->buf, "HTTP/1.1 %d", &status) != 1) {
+        return -1;
+    }
+    if (status != 200) {
+        return status;
+    }
+
+    size_t offset = end + 4 - http->buf;
+    if (!bench_stream_read(client, &offset, fragment, BENCH_INIT_SIZE)) {
+        return -1;
+    }
+
+    for (;;) {
+        if (!bench_stream_read(client, &offset, fragment,
+                               BENCH_FRAGMENT_SIZE)) {
+            return -1;
+        }
+        sc_tick now = sc_tick_now();
+
+        ++stats->requests;
+        uint64_t index = sc_read64be(fragment);
+        int64_t latency = bench_delivery_latency(bench, index, now);
+        if (latency >= 0
+                && !bench_push_latency(&stats->delivery_latencies, latency)) {
+            return -1;
+        }
+    }
+}
+
+static int
+run_viewer(void *data) {
+    struct bench_client *client = data;
+    struct bench *bench = client->bench;
+    struct bench_client_stats *stats = &client->stats;
+
+    uint8_t *fragment = malloc(BENCH_FRAGMENT_SIZE);
+    if (!fragment) {
+        LOG_OOM();
+        return 0;
+    }
+
+    while (!bench_is_stopped(bench)) {
+        if (!bench_client_connect(client)) {
+            bench_sleep_until(bench, sc_tick_now() + BENCH_RETRY_DELAY);
+            continue;
+        }
+
+        // The stream lasts until an error (or the interruption on stop)
+        int status = bench_watch_stream(client, fragment);
+        bench_client_close(client);
+
+        if (status == 503) {
+            ++stats->busy_errors;
+        } else if (status >= 0) {
+            ++stats->status_errors;
+        } else if (!bench_is_stopped(bench)) {
+            // Disconnected (e.g. the viewer was too slow)
+            ++stats->io_errors;
+        }
+
+        bench_sleep_until(bench, sc_tick_now() + BENCH_RETRY_DELAY);
+    }
+
+    free(fragment);
+    return 0;
+}
+
+static void
+bench_print_latencies(const char *name, struct bench_latencies *latencies) {
+    if (!latencies->size) {
+        printf("  %-18s -\n", name);
+        return;
+    }
+
+    int64_t *values = latencies->data;
+    size_t count = latencies->size;
+    printf("  %-18s p50 %8" PRIi64 " us, p90 %8" PRIi64 " us, "
+           "p99 %8" PRIi64 " us, max %8" PRIi64 " us\n", name,
+           perf_percentile(values, count, 50),
+           perf_percentile(values, count, 90),
+           perf_percentile(values, count, 99),
+           perf_percentile(values, count, 100));
+}
+
+// Merge the stats of the clients [first, first + count), into `first`
+static bool
+bench_merge_stats(struct bench_client *first, unsigned count) {
+    struct bench_client_stats *total = &first->stats;
+    for (unsigned i = 1; i < count; ++i) {
+        struct bench_client_stats *stats = &first[i].stats;
+        total->requests += stats->requests;
+        total->connect_errors += stats->connect_errors;
+        total->busy_errors += stats->busy_errors;
+        total->status_errors += stats->status_errors;
+        total->io_errors += stats->io_errors;
+
+        bool ok = sc_vector_push_all(&total->request_latencies,
+                                     stats->request_latencies.data,
+                                     stats->request_latencies.size)
+               && sc_vector_push_all(&total->delivery_latencies,
+                                     stats->delivery_latencies.data,
+                                     stats->delivery_latencies.size);
+        if (!ok) {
+            LOG_OOM();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static unsigned
+bench_count_starved(struct bench_client *first, unsigned count) {
+    unsigned starved = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        if (!first[i].stats.requests) {
+            ++starved;
+        }
+    }
+    return starved;
+}
+
+static void
+bench_report(struct bench_client *first, unsigned count, const char *name,
+             const char *unit, double seconds) {
+    unsigned starved = bench_count_starved(first, count);
+    if (!bench_merge_stats(first, count)) {
+        return;
+    }
+
+    struct bench_client_stats *total = &first->stats;
+    uint64_t errors = total->connect_errors + total->busy_errors
+                    + total->status_errors + total->io_errors;
+    uint64_t attempts = total->requests + errors;
+    double error_rate = attempts ? 100.0 * errors / attempts : 0;
+
+    printf("%u %s: %" PRIu64 " %s (%.1f/s), %u starved\n", count, name,
+           total->requests, unit, total->requests / seconds, starved);
+    printf("  errors: %" PRIu64 " (%.2f %%): connect %" PRIu64 ", busy (503) %"
+           PRIu64 ", status %" PRIu64 ", I/O %" PRIu64 "\n", errors,
+           error_rate, total->connect_errors, total->busy_errors,
+           total->status_errors, total->io_errors);
+    if (total->request_latencies.size) {
+        bench_print_latencies("request latency", &total->request_latencies);
+    }
+    bench_print_latencies("delivery latency", &total->delivery_latencies);
+}
+
+static bool
+bench_bridge_init(struct bench *bench) {
+    for (uint16_t p = BENCH_PORT_FIRST; p <= BENCH_PORT_LAST; ++p) {
+        if (sc_figma_bridge_init(&bench->bridge, p)) {
+            bench->port = p;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void
+usage(const char *arg0) {
+    fprintf(stderr,
+            "Usage: %s [--clients=N] [--streams=N] [--rate=HZ] "
+                "[--duration=SEC] [--size=BYTES] [--close]\n"
+            "  --clients   long polling clients (default 4, max %u)\n"
+            "  --streams   stream viewers (default 2)\n"
+            "  --rate      screenshots and fragments published per second "
+                "(default 30)\n"
+            "  --duration  in seconds (default 5)\n"
+            "  --size      of the screenshots (default 262144)\n"
+            "  --close     one connection per request (no keep-alive)\n",
+            arg0, BENCH_MAX_CLIENTS);
+}
+
+static bool
+parse_args(int argc, char *argv[], struct bench_options *options) {
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (!strncmp(arg, "--clients=", 10)) {
+            options->clients = strtoul(arg + 10, NULL, 10);
+        } else if (!strncmp(arg, "--streams=", 10)) {
+            options->streams = strtoul(arg + 10, NULL, 10);
+        } else if (!strncmp(arg, "--rate=", 7)) {
+            options->rate = strtoul(arg + 7, NULL, 10);
+        } else if (!strncmp(arg, "--duration=", 11)) {
+            options->duration = strtoul(arg + 11, NULL, 10);
+        } else if (!strncmp(arg, "--size=", 7)) {
+            options->size = strtoul(arg + 7, NULL, 10);
+        } else if (!strcmp(arg, "--close")) {
+            options->keep_alive = false;
+        } else {
+            return false;
+        }
+    }
+
+    return options->clients + options->streams <= BENCH_MAX_CLIENTS
+        && options->rate && options->rate <= 1000 && options->duration
+        && options->size >= 8;
+}
+
+int main(int argc, char *argv[]) {
+    static struct bench bench = {
+        .options = {
+            .clients = 4,
+            .streams = 2,
+            .rate = 30,
+            .duration = 5,
+            .size = 256 * 1024,
+            .keep_alive = true,
+        },
+        .stopped = false,
+        .published = 0,
+    };
+
+    if (!parse_args(argc, argv, &bench.options)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Do not log each screenshot
+    sc_set_log_level(SC_LOG_LEVEL_WARN);
+
+#ifndef _WIN32
+    // The bridge may be writing a response when the client disconnects
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    struct bench_options *options = &bench.options;
+    unsigned client_count = options->clients + options->streams;
+
+    bench.screenshot = malloc(options->size);
+    bench.fragment = calloc(1, BENCH_FRAGMENT_SIZE);
+    if (!bench.screenshot || !bench.fragment) {
+        free(bench.screenshot);
+        free(bench.fragment);
+        return 1;
+    }
+
+    // Synthetic screenshots: only their size matters
+    static const uint8_t png_signature[] = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n',
+    };
+    for (size_t i = 0; i < options->size; ++i) {
+        bench.screenshot[i] = i * 31;
+    }
+    memcpy(bench.screenshot, png_signature, sizeof(png_signature));
+
+    int ret = 1;
+
+    if (!net_init()) {
+        goto end_free;
+    }
+
+    if (!sc_mutex_init(&bench.mutex)) {
+        goto end_net_cleanup;
+    }
+
+    if (!sc_cond_init(&bench.cond)) {
+        goto end_destroy_mutex;
+    }
+
+    if (!bench_bridge_init(&bench)) {
+        fprintf(stderr, "Could not listen on a local port\n");
+        goto end_destroy_cond;
+    }
+
+    if (!sc_figma_bridge_start(&bench.bridge)) {
+        goto end_destroy_bridge;
+    }
+
+    uint8_t init[BENCH_INIT_SIZE] = {0};
+    if (!sc_figma_bridge_publish_stream_init(&bench.bridge, init,
+                                             sizeof(init))) {
+        goto end_stop_bridge;
+    }
+
+    sc_mutex_lock(&bench.bridge.mutex);
+    bench.first_sequence = bench.bridge.store.sequence;
+    sc_mutex_unlock(&bench.bridge.mutex);
+
+    if (!sc_thread_create(&bench.producer, run_producer, "bench-producer",
+                          &bench)) {
+        goto end_stop_bridge;
+    }
+
+    unsigned started = 0;
+    for (; started < client_count; ++started) {
+        struct bench_client *client = &bench.clients[started];
+        client->bench = &bench;
+        client->connected = false;
+        sc_vector_init(&client->stats.request_latencies);
+        sc_vector_init(&client->stats.delivery_latencies);
+
+        bool viewer = started >= options->clients;
+        if (!sc_thread_create(&client->thread,
+                              viewer ? run_viewer : run_poller,
+                              viewer ? "bench-viewer" : "bench-poller",
+                              client)) {
+            break;
+        }
+    }
+
+    if (started == client_count) {
+        printf("Figma bridge load: %u screenshots/s of %zu bytes and %u "
+               "fragments/s of %u bytes, for %u s%s\n", options->rate,
+               options->size, options->rate, BENCH_FRAGMENT_SIZE,
+               options->duration, options->keep_alive ? "" : ", no keep-alive");
+        bench_sleep_until(&bench, sc_tick_now()
+                                + SC_TICK_FROM_SEC(options->duration));
+    }
+
+    sc_mutex_lock(&bench.mutex);
+    bench.stopped = true;
+    sc_cond_broadcast(&bench.cond);
+    for (unsigned i = 0; i < started; ++i) {
+        if (bench.clients[i].connected) {
+            net_interrupt(bench.clients[i].http.socket);
+        }
+    }
+    sc_mutex_unlock(&bench.mutex);
+
+    sc_thread_join(&bench.producer, NULL);
+    for (unsigned i = 0; i < started; ++i) {
+        sc_thread_join(&bench.clients[i].thread, NULL);
+    }
+
+    if (started == client_count) {
+        double seconds = options->duration;
+        if (options->clients) {
+            bench_report(&bench.clients[0], options->clients,
+                         "long polling clients", "requests", seconds);
+        }
+        if (options->streams) {
+            bench_report(&bench.clients[options->clients], options->streams,
+                         "stream viewers", "fragments", seconds);
+        }
+        ret = 0;
+    }
+
+    for (unsigned i = 0; i < started; ++i) {
+        sc_vector_destroy(&bench.clients[i].stats.request_latencies);
+        sc_vector_destroy(&bench.clients[i].stats.delivery_latencies);
+    }
+
+end_stop_bridge:
+    sc_figma_bridge_stop(&bench.bridge);
+end_destroy_bridge:
+    sc_figma_bridge_destroy(&bench.bridge);
+end_destroy_cond:
+    sc_cond_destroy(&bench.cond);
+end_destroy_mutex:
+    sc_mutex_destroy(&bench.mutex);
+end_net_cleanup:
+    net_cleanup();
+end_free:
+    free(bench.fragment);
+    free(bench.screenshot);
+
+    return ret;
+}
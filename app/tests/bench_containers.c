@@ -0,0 +1,157 @@
+#include "common.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util/strbuf.h"
+#include "util/tick.h"
+#include "util/vecdeque.h"
+#include "util/vector.h"
+
+/**
+ * Microbenchmarks for the generic containers used on hot paths (controller
+ * queue, packet queues, delay buffer, HTTP responses...).
+ *
+ * Each benchmark prints the average time per operation, so that the results
+ * of two builds can be compared.
+ */
+
+#define BENCH_ITERATIONS 10000000
+
+// Consume results so that the compiler does not optimize the loops away
+static volatile uint64_t bench_sink;
+
+static void
+bench_report(const char *name, sc_tick start, uint64_t ops) {
+    sc_tick duration = sc_tick_now() - start;
+    printf("%-32s %8.2f ns/op\n", name,
+           (double) SC_TICK_TO_NS(duration) / ops);
+}
+
+static bool
+bench_vecdeque_steady(void) {
+    // Typical queue usage: a few items pushed then popped, forever (the
+    // indexes wrap around the ring buffer continuously)
+    struct SC_VECDEQUE(uint64_t) vdq = SC_VECDEQUE_INITIALIZER;
+    uint64_t sum = 0;
+
+    sc_tick start = sc_tick_now();
+    for (uint64_t i = 0; i < BENCH_ITERATIONS; i += 4) {
+        for (uint64_t j = 0; j < 4; ++j) {
+            if (!sc_vecdeque_push(&vdq, i + j)) {
+                sc_vecdeque_destroy(&vdq);
+                return false;
+            }
+        }
+        for (unsigned j = 0; j < 4; ++j) {
+            sum += sc_vecdeque_pop(&vdq);
+        }
+    }
+    bench_report("vecdeque push/pop (steady)", start, BENCH_ITERATIONS);
+
+    bench_sink = sum;
+    sc_vecdeque_destroy(&vdq);
+    return true;
+}
+
+static bool
+bench_vecdeque_grow(void) {
+    // Fill a queue from scratch (including the reallocations), then drain it
+    struct SC_VECDEQUE(uint64_t) vdq = SC_VECDEQUE_INITIALIZER;
+    uint64_t sum = 0;
+
+    sc_tick start = sc_tick_now();
+    for (uint64_t i = 0; i < BENCH_ITERATIONS; ++i) {
+        if (!sc_vecdeque_push(&vdq, i)) {
+            sc_vecdeque_destroy(&vdq);
+            return false;
+        }
+    }
+    while (!sc_vecdeque_is_empty(&vdq)) {
+        sum += sc_vecdeque_pop(&vdq);
+    }
+    bench_report("vecdeque push/pop (grow)", start, BENCH_ITERATIONS);
+
+    bench_sink = sum;
+    sc_vecdeque_destroy(&vdq);
+    return true;
+}
+
+static bool
+bench_vector_push(void) {
+    struct SC_VECTOR(uint64_t) vec = SC_VECTOR_INITIALIZER;
+
+    sc_tick start = sc_tick_now();
+    for (uint64_t i = 0; i < BENCH_ITERATIONS; ++i) {
+        if (!sc_vector_push(&vec, i)) {
+            sc_vector_destroy(&vec);
+            return false;
+        }
+    }
+    bench_report("vector push (grow)", start, BENCH_ITERATIONS);
+
+    bench_sink = vec.data[vec.size - 1];
+    sc_vector_destroy(&vec);
+    return true;
+}
+
+static bool
+bench_vector_swap_remove(void) {
+    struct SC_VECTOR(uint64_t) vec = SC_VECTOR_INITIALIZER;
+    if (!sc_vector_reserve(&vec, 64)) {
+        return false;
+    }
+
+    sc_tick start = sc_tick_now();
+    for (uint64_t i = 0; i < BENCH_ITERATIONS; i += 2) {
+        // Cannot fail, the capacity is reserved
+        sc_vector_push(&vec, i);
+        sc_vector_push(&vec, i + 1);
+        sc_vector_swap_remove(&vec, 0);
+    }
+    bench_report("vector push/swap_remove", start, BENCH_ITERATIONS);
+
+    bench_sink = vec.size;
+    sc_vector_destroy(&vec);
+    return true;
+}
+
+static bool
+bench_strbuf_append(void) {
+    struct sc_strbuf buf;
+    if (!sc_strbuf_init(&buf, 64)) {
+        return false;
+    }
+
+    sc_tick start = sc_tick_now();
+    for (uint64_t i = 0; i < BENCH_ITERATIONS; ++i) {
+        if (!sc_strbuf_append_staticstr(&buf, "scrcpy_")
+                || !sc_strbuf_append_char(&buf, '\n')) {
+            free(buf.s);
+            return false;
+        }
+    }
+    bench_report("strbuf append", start, BENCH_ITERATIONS);
+
+    bench_sink = buf.len;
+    free(buf.s);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    bool ok = bench_vecdeque_steady()
+           && bench_vecdeque_grow()
+           && bench_vector_push()
+           && bench_vector_swap_remove()
+           && bench_strbuf_append();
+    if (!ok) {
+        fprintf(stderr, "Allocation failed\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,594 @@
+#include "common.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavcodec/avcodec.h>
+
+#include "decoder.h"
+#include "demuxer.h"
+#include "frame_buffer.h"
+#include "latency.h"
+#include "perf.h"
+#include "recorder.h"
+#include "shared_frame.h"
+#include "stats.h"
+#include "util/file.h"
+#include "util/net.h"
+#include "util/thread.h"
+#include "util/tick.h"
+#ifdef HAVE_V4L2
+# include "v4l2_sink.h"
+#endif
+
+/**
+ * Replay a recorded video stream (in the format read by sc_demuxer, i.e. as
+ * sent by the server) through the client pipeline:
+ *
+ *     demuxer -> decoder -> frame buffer -> null display
+ *             -> recorder (--record=file.mkv)
+ *                decoder -> v4l2 sink (--v4l2=/dev/videoN)
+ *
+ * The stream is sent as fast as possible over a local TCP connection, so the
+ * result is the maximal throughput of the pipeline.
+ *
+ * To record a stream, see "Benchmarks" in doc/develop.md.
+ */
+
+// Exit code to report a skipped test to meson
+#define BENCH_SKIP 77
+
+#define BENCH_PORT_FIRST 27300
+#define BENCH_PORT_LAST 27309
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+# define BENCH_COUNT_ALLOCATIONS
+#endif
+
+#ifdef BENCH_COUNT_ALLOCATIONS
+// Count the allocations (including those from FFmpeg) by interposing the
+// glibc allocator
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static atomic_ulong bench_allocations;
+
+static inline void
+bench_count_allocation(void) {
+    atomic_fetch_add_explicit(&bench_allocations, 1, memory_order_relaxed);
+}
+
+void *
+malloc(size_t size) {
+    bench_count_allocation();
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size) {
+    bench_count_allocation();
+    return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size) {
+    bench_count_allocation();
+    return __libc_realloc(ptr, size);
+}
+
+void *
+memalign(size_t alignment, size_t size) {
+    bench_count_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+void *
+aligned_alloc(size_t alignment, size_t size) {
+    bench_count_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+int
+posix_memalign(void **memptr, size_t alignment, size_t size) {
+    bench_count_allocation();
+    void *ptr = __libc_memalign(alignment, size);
+    if (!ptr) {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+static unsigned long
+bench_get_allocations(void) {
+    return atomic_load_explicit(&bench_allocations, memory_order_relaxed);
+}
+#endif
+
+struct bench_feeder {
+    sc_thread thread;
+    uint16_t port;
+    const uint8_t *data;
+    size_t size;
+    bool success;
+};
+
+// Null display: consumes the frames from a frame buffer, like the screen
+struct bench_display {
+    struct sc_frame_sink frame_sink; // frame sink trait
+
+    struct sc_frame_buffer fb;
+    struct sc_latency *latency;
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    unsigned pending; // number of frames to consume
+    bool closed;
+    bool joined;
+
+    uint64_t consumed;
+    uint64_t skipped;
+};
+
+#define DOWNCAST(SINK) container_of(SINK, struct bench_display, frame_sink)
+
+static int
+run_feeder(void *data) {
+    struct bench_feeder *feeder = data;
+
+    sc_socket socket = net_socket();
+    if (socket == SC_SOCKET_NONE) {
+        return 0;
+    }
+
+    if (net_connect(socket, IPV4_LOCALHOST, feeder->port)) {
+        ssize_t r = net_send_all(socket, feeder->data, feeder->size);
+        feeder->success = r >= 0 && (size_t) r == feeder->size;
+    }
+
+    // The demuxer reaches the end of stream
+    net_close(socket);
+    return 0;
+}
+
+static int
+run_display(void *data) {
+    struct bench_display *display = data;
+
+    for (;;) {
+        sc_mutex_lock(&display->mutex);
+        while (!display->pending && !display->closed) {
+            sc_cond_wait(&display->cond, &display->mutex);
+        }
+        if (!display->pending) {
+            // closed and drained
+            sc_mutex_unlock(&display->mutex);
+            break;
+        }
+        --display->pending;
+        sc_mutex_unlock(&display->mutex);
+
+        struct sc_shared_frame *frame = sc_frame_buffer_consume(&display->fb);
+        sc_latency_on_uploaded(display->latency, frame->frame->pts);
+        sc_latency_on_presented(display->latency);
+        sc_shared_frame_release(frame);
+        ++display->consumed;
+    }
+
+    return 0;
+}
+
+static bool
+bench_display_frame_sink_open(struct sc_frame_sink *sink,
+                              const AVCodecContext *ctx) {
+    (void) sink;
+    (void) ctx;
+    return true;
+}
+
+static void
+bench_display_frame_sink_close(struct sc_frame_sink *sink) {
+    struct bench_display *display = DOWNCAST(sink);
+
+    sc_mutex_lock(&display->mutex);
+    display->closed = true;
+    sc_cond_signal(&display->cond);
+    sc_mutex_unlock(&display->mutex);
+}
+
+static bool
+bench_display_frame_sink_push_shared(struct sc_frame_sink *sink,
+                                     struct sc_shared_frame *frame) {
+    struct bench_display *display = DOWNCAST(sink);
+
+    bool skipped;
+    sc_frame_buffer_push(&display->fb, frame, &skipped);
+
+    sc_mutex_lock(&display->mutex);
+    if (skipped) {
+        ++display->skipped;
+    } else {
+        ++display->pending;
+        sc_cond_signal(&display->cond);
+    }
+    sc_mutex_unlock(&display->mutex);
+
+    return true;
+}
+
+static unsigned
+bench_display_frame_sink_get_backlog(struct sc_frame_sink *sink) {
+    struct bench_display *display = DOWNCAST(sink);
+    return sc_frame_buffer_get_skipped_count(&display->fb);
+}
+
+static bool
+bench_display_init(struct bench_display *display,
+                   struct sc_latency *latency) {
+    if (!sc_frame_buffer_init(&display->fb)) {
+        return false;
+    }
+
+    if (!sc_mutex_init(&display->mutex)) {
+        goto error_destroy_frame_buffer;
+    }
+
+    if (!sc_cond_init(&display->cond)) {
+        goto error_destroy_mutex;
+    }
+
+    display->latency = latency;
+    display->pending = 0;
+    display->closed = false;
+    display->joined = false;
+    display->consumed = 0;
+    display->skipped = 0;
+
+    if (!sc_thread_create(&display->thread, run_display, "bench-display",
+                          display)) {
+        goto error_destroy_cond;
+    }
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = bench_display_frame_sink_open,
+        .close = bench_display_frame_sink_close,
+        .push_shared = bench_display_frame_sink_push_shared,
+        .get_backlog = bench_display_frame_sink_get_backlog,
+    };
+
+    display->frame_sink.ops = &ops;
+    return true;
+
+error_destroy_cond:
+    sc_cond_destroy(&display->cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&display->mutex);
+error_destroy_frame_buffer:
+    sc_frame_buffer_destroy(&display->fb);
+    return false;
+}
+
+static void
+bench_display_join(struct bench_display *display) {
+    if (display->joined) {
+        return;
+    }
+    display->joined = true;
+
+    // In case the sink has never been opened (e.g. invalid stream)
+    bench_display_frame_sink_close(&display->frame_sink);
+    sc_thread_join(&display->thread, NULL);
+}
+
+static void
+bench_display_destroy(struct bench_display *display) {
+    sc_cond_destroy(&display->cond);
+    sc_mutex_destroy(&display->mutex);
+    sc_frame_buffer_destroy(&display->fb);
+}
+
+static void
+bench_on_demuxer_ended(struct sc_demuxer *demuxer,
+                       enum sc_demuxer_status status, void *userdata) {
+    (void) demuxer;
+    bool *success = userdata;
+    *success = status == SC_DEMUXER_STATUS_EOS;
+}
+
+static void
+bench_on_recorder_ended(struct sc_recorder *recorder, bool success,
+                        void *userdata) {
+    (void) recorder;
+    (void) userdata;
+    if (!success) {
+        fprintf(stderr, "Recording failed\n");
+    }
+}
+
+static uint8_t *
+bench_read_file(const char *path, size_t *size) {
+    uint64_t file_size;
+    if (!sc_file_get_size(path, &file_size) || file_size > SIZE_MAX) {
+        return NULL;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+
+    uint8_t *data = malloc(file_size ? file_size : 1);
+    if (data && fread(data, 1, file_size, file) != file_size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    *size = file_size;
+    return data;
+}
+
+static sc_socket
+bench_listen(uint16_t *port) {
+    for (uint16_t p = BENCH_PORT_FIRST; p <= BENCH_PORT_LAST; ++p) {
+        sc_socket socket = net_socket();
+        if (socket == SC_SOCKET_NONE) {
+            return SC_SOCKET_NONE;
+        }
+        if (net_listen(socket, IPV4_LOCALHOST, p, 1)) {
+            *port = p;
+            return socket;
+        }
+        net_close(socket);
+    }
+
+    return SC_SOCKET_NONE;
+}
+
+static void
+usage(const char *arg0) {
+    fprintf(stderr,
+            "Usage: %s [--hw] [--threads=N] [--record=file.mkv]"
+#ifdef HAVE_V4L2
+            " [--v4l2=/dev/videoN]"
+#endif
+            " [stream]\n"
+            "The stream may also be set by the environment variable "
+                "SCRCPY_BENCH_STREAM.\n", arg0);
+}
+
+int main(int argc, char *argv[]) {
+    const char *stream_path = getenv("SCRCPY_BENCH_STREAM");
+    const char *record_filename = NULL;
+    const char *v4l2_device = NULL;
+    bool hw = false;
+    unsigned threads = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (!strcmp(arg, "--hw")) {
+            hw = true;
+        } else if (!strncmp(arg, "--threads=", 10)) {
+            threads = strtoul(arg + 10, NULL, 10);
+        } else if (!strncmp(arg, "--record=", 9)) {
+            record_filename = arg + 9;
+#ifdef HAVE_V4L2
+        } else if (!strncmp(arg, "--v4l2=", 7)) {
+            v4l2_device = arg + 7;
+#endif
+        } else if (arg[0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            stream_path = arg;
+        }
+    }
+
+    if (!stream_path || !*stream_path) {
+        usage(argv[0]);
+        fprintf(stderr, "No stream, skipped\n");
+        return BENCH_SKIP;
+    }
+
+    size_t size;
+    uint8_t *data = bench_read_file(stream_path, &size);
+    if (!data) {
+        fprintf(stderr, "Could not read %s\n", stream_path);
+        return 1;
+    }
+
+    int ret = 1;
+
+    if (!net_init()) {
+        goto end_free_data;
+    }
+
+    struct bench_feeder feeder = {
+        .data = data,
+        .size = size,
+        .success = false,
+    };
+
+    sc_socket server_socket = bench_listen(&feeder.port);
+    if (server_socket == SC_SOCKET_NONE) {
+        fprintf(stderr, "Could not listen on a local port\n");
+        goto end_net_cleanup;
+    }
+
+    struct sc_latency latency;
+    if (!sc_latency_init(&latency)) {
+        net_close(server_socket);
+        goto end_net_cleanup;
+    }
+
+    struct bench_display display;
+    if (!bench_display_init(&display, &latency)) {
+        net_close(server_socket);
+        goto end_destroy_latency;
+    }
+
+    if (!sc_thread_create(&feeder.thread, run_feeder, "bench-feeder",
+                          &feeder)) {
+        net_close(server_socket);
+        goto end_destroy_display;
+    }
+
+    sc_socket socket = net_accept(server_socket);
+    net_close(server_socket);
+    if (socket == SC_SOCKET_NONE) {
+        goto end_join_feeder;
+    }
+
+    static const struct sc_demuxer_callbacks demuxer_cbs = {
+        .on_ended = bench_on_demuxer_ended,
+    };
+    bool demuxer_success = false;
+    struct sc_demuxer demuxer;
+    sc_demuxer_init(&demuxer, "video", socket, &demuxer_cbs,
+                    &demuxer_success);
+
+    struct sc_decoder decoder;
+    sc_decoder_init(&decoder, "video", hw, threads, NULL, NULL);
+
+    // Same order as in scrcpy.c: the latency tracer stamps the reception
+    // before the decoder
+    sc_packet_source_add_sink(&demuxer.packet_source, &latency.packet_sink);
+    sc_packet_source_add_sink(&demuxer.packet_source, &decoder.packet_sink);
+    sc_frame_source_add_sink(&decoder.frame_source, &latency.frame_sink);
+    sc_frame_source_add_sink(&decoder.frame_source, &display.frame_sink);
+
+    static const struct sc_recorder_callbacks recorder_cbs = {
+        .on_ended = bench_on_recorder_ended,
+    };
+    struct sc_recorder recorder;
+    bool recorder_started = false;
+    if (record_filename) {
+        if (!sc_recorder_init(&recorder, record_filename,
+                              SC_RECORD_FORMAT_MKV, 0, 0, 0, true, false,
+                              SC_ORIENTATION_0, &recorder_cbs, NULL)) {
+            goto end_close_socket;
+        }
+        if (!sc_recorder_start(&recorder)) {
+            sc_recorder_destroy(&recorder);
+            goto end_close_socket;
+        }
+        recorder_started = true;
+        sc_packet_source_add_sink(&demuxer.packet_source,
+                                  &recorder.video_packet_sink);
+    }
+
+#ifdef HAVE_V4L2
+    struct sc_v4l2_sink v4l2_sink;
+    bool v4l2_sink_initialized = false;
+    if (v4l2_device) {
+        if (!sc_v4l2_sink_init(&v4l2_sink, v4l2_device, SC_V4L2_FORMAT_AUTO,
+                               0, 0)) {
+            goto end_stop_recorder;
+        }
+        v4l2_sink_initialized = true;
+        sc_frame_source_add_sink(&decoder.frame_source, &v4l2_sink.frame_sink);
+    }
+#else
+    (void) v4l2_device;
+#endif
+
+#ifdef BENCH_COUNT_ALLOCATIONS
+    unsigned long allocations_start = bench_get_allocations();
+#endif
+    sc_tick start = sc_tick_now();
+
+    if (!sc_demuxer_start(&demuxer)) {
+        goto end_destroy_v4l2_sink;
+    }
+    sc_demuxer_join(&demuxer);
+    // The frame sinks are closed, wait for the display to consume the last
+    // frame
+    bench_display_join(&display);
+
+    sc_tick duration = sc_tick_now() - start;
+#ifdef BENCH_COUNT_ALLOCATIONS
+    unsigned long allocations = bench_get_allocations() - allocations_start;
+#endif
+
+    if (!demuxer_success) {
+        fprintf(stderr, "Could not replay the stream\n");
+        goto end_destroy_v4l2_sink;
+    }
+
+    uint32_t packets = sc_stats_get(SC_STAT_VIDEO_PACKETS);
+    uint32_t decoded = sc_stats_get(SC_STAT_FRAMES_DECODED);
+    uint32_t decode_time_us = sc_stats_get(SC_STAT_DECODE_TIME_US);
+    double seconds = (double) duration / SC_TICK_FREQ;
+
+    printf("%s: %zu bytes, %" PRIu32 " packets in %.3f s\n", stream_path,
+           size, packets, seconds);
+    printf("throughput: %.1f frames/s, %.2f Mbit/s\n",
+           seconds > 0 ? decoded / seconds : 0.,
+           seconds > 0 ? size * 8 / seconds / 1000000 : 0.);
+    printf("frames: %" PRIu32 " decoded (avg %.2f ms), %" PRIu64 " displayed, "
+           "%" PRIu64 " skipped\n", decoded,
+           decoded ? decode_time_us / 1000. / decoded : 0.,
+           display.consumed, display.skipped);
+#ifdef BENCH_COUNT_ALLOCATIONS
+    printf("allocations: %lu (%.1f per frame)\n", allocations,
+           decoded ? (double) allocations / decoded : 0.);
+#endif
+    fflush(stdout);
+    sc_latency_print(&latency);
+
+    // The baselines (if any) must have been measured with the same stream
+    // (see "meson test --suite perf")
+    double decode_avg_ms = decoded ? decode_time_us / 1000. / decoded : 0.;
+    bool ok1 = perf_check("replay.frames_per_s", "higher",
+                          seconds > 0 ? decoded / seconds : 0.);
+    bool ok2 = perf_check("replay.decode_avg_ms", "lower", decode_avg_ms);
+    bool ok3 = true;
+    struct sc_percentile_window *total =
+        &latency.stages[SC_LATENCY_STAGE_TOTAL];
+    if (total->count) {
+        sc_tick p99 = sc_percentile_window_get(total, 99);
+        ok3 = perf_check("replay.latency_p99_us", "lower",
+                         SC_TICK_TO_US(p99));
+    }
+
+    ret = ok1 && ok2 && ok3 ? 0 : 1;
+
+end_destroy_v4l2_sink:
+#ifdef HAVE_V4L2
+    if (v4l2_sink_initialized) {
+        sc_v4l2_sink_destroy(&v4l2_sink);
+    }
+end_stop_recorder:
+#endif
+    if (recorder_started) {
+        sc_recorder_stop(&recorder);
+        sc_recorder_join(&recorder);
+        sc_recorder_destroy(&recorder);
+    }
+end_close_socket:
+    net_close(socket);
+end_join_feeder:
+    sc_thread_join(&feeder.thread, NULL);
+    if (ret == 0 && !feeder.success) {
+        fprintf(stderr, "Could not send the whole stream\n");
+        ret = 1;
+    }
+end_destroy_display:
+    bench_display_join(&display);
+    bench_display_destroy(&display);
+end_destroy_latency:
+    sc_latency_destroy(&latency);
+end_net_cleanup:
+    net_cleanup();
+end_free_data:
+    free(data);
+
+    return ret;
+}
@@ -0,0 +1,247 @@
+#include "perf.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PERF_LINE_SIZE 256
+
+// Number of bytes of the body to read along with the headers, to parse the
+// "seq" field of a JSON body
+#define PERF_HTTP_BODY_PREFIX 64
+
+struct perf_baseline {
+    bool higher; // true if higher is better
+    double value;
+    double tolerance; // in %
+};
+
+static bool
+perf_parse_direction(const char *s, bool *higher) {
+    if (!strcmp(s, "higher")) {
+        *higher = true;
+        return true;
+    }
+    if (!strcmp(s, "lower")) {
+        *higher = false;
+        return true;
+    }
+    return false;
+}
+
+// Return false if there is no baseline for the metric
+static bool
+perf_find_baseline(const char *path, const char *metric,
+                   struct perf_baseline *baseline) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Could not open %s\n", path);
+        return false;
+    }
+
+    bool found = false;
+    char line[PERF_LINE_SIZE];
+    unsigned line_number = 0;
+    while (!found && fgets(line, sizeof(line), file)) {
+        ++line_number;
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+
+        char name[128];
+        char direction[8];
+        double value;
+        double tolerance;
+        int r = sscanf(line, "%127s %7s %lf %lf", name, direction, &value,
+                       &tolerance);
+        if (r != 4 || !perf_parse_direction(direction, &baseline->higher)) {
+            fprintf(stderr, "%s:%u: invalid baseline\n", path, line_number);
+            continue;
+        }
+
+        if (!strcmp(name, metric)) {
+            baseline->value = value;
+            baseline->tolerance = tolerance;
+            found = true;
+        }
+    }
+
+    fclose(file);
+    return found;
+}
+
+bool
+perf_check(const char *metric, const char *direction, double value) {
+    printf("%-32s %-6s %12.1f", metric, direction, value);
+
+    const char *path = getenv("SCRCPY_PERF_BASELINES");
+    struct perf_baseline baseline;
+    if (!path || !*path || !perf_find_baseline(path, metric, &baseline)) {
+        printf("  (no baseline)\n");
+        return true;
+    }
+
+    const char *tolerance_env = getenv("SCRCPY_PERF_TOLERANCE");
+    if (tolerance_env && *tolerance_env) {
+        baseline.tolerance = strtod(tolerance_env, NULL);
+    }
+
+    double limit;
+    bool regressed;
+    if (baseline.higher) {
+        limit = baseline.value * (1 - baseline.tolerance / 100);
+        regressed = value < limit;
+    } else {
+        limit = baseline.value * (1 + baseline.tolerance / 100);
+        regressed = value > limit;
+    }
+
+    printf("  (baseline %.1f, limit %.1f)%s\n", baseline.value, limit,
+           regressed ? "  REGRESSION" : "");
+    return !regressed;
+}
+
+static int
+perf_compare_int64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *) a;
+    int64_t y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+int64_t
+perf_percentile(int64_t *values, size_t count, unsigned p) {
+    assert(count);
+    assert(p <= 100);
+
+    qsort(values, count, sizeof(*values), perf_compare_int64);
+
+    // nearest-rank method
+    size_t rank = (p * count + 99) / 100;
+    return values[rank ? rank - 1 : 0];
+}
+
+bool
+perf_http_connect(struct perf_http_client *client, uint16_t port) {
+    client->socket = net_socket();
+    if (client->socket == SC_SOCKET_NONE) {
+        return false;
+    }
+
+    if (!net_connect(client->socket, IPV4_LOCALHOST, port)) {
+        net_close(client->socket);
+        return false;
+    }
+
+    client->len = 0;
+    return true;
+}
+
+void
+perf_http_close(struct perf_http_client *client) {
+    net_close(client->socket);
+}
+
+static uint64_t
+perf_http_get_header_u64(const char *headers, const char *name) {
+    const char *p = strstr(headers, name);
+    return p ? strtoull(p + strlen(name), NULL, 10) : 0;
+}
+
+// Receive until `len` bytes are buffered
+static bool
+perf_http_fill(struct perf_http_client *client, size_t len) {
+    assert(len <= PERF_HTTP_HEADERS_MAX);
+    while (client->len < len) {
+        ssize_t r = net_recv(client->socket, client->buf + client->len,
+                             PERF_HTTP_HEADERS_MAX - client->len);
+        if (r <= 0) {
+            return false;
+        }
+        client->len += r;
+    }
+    return true;
+}
+
+bool
+perf_http_get(struct perf_http_client *client, const char *uri,
+              bool keep_alive, struct perf_http_response *response) {
+    char request[256];
+    int n = snprintf(request, sizeof(request),
+                     "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\n%s\r\n", uri,
+                     keep_alive ? "" : "Connection: close\r\n");
+    if (n < 0 || (size_t) n >= sizeof(request)) {
+        return false;
+    }
+
+    ssize_t w = net_send_all(client->socket, request, n);
+    if (w != n) {
+        return false;
+    }
+
+    // Read the headers
+    char *end;
+    for (;;) {
+        client->buf[client->len] = '\0';
+        end = strstr(client->buf, "\r\n\r\n");
+        if (end) {
+            break;
+        }
+        if (client->len == PERF_HTTP_HEADERS_MAX
+                || !perf_http_fill(client, client->len + 1)) {
+            return false;
+        }
+    }
+
+    size_t headers_len = end + 4 - client->buf;
+    *end = '\0';
+
+    if (sscanf(client->buf, "HTTP/1.1 %d", &response->status) != 1) {
+        return false;
+    }
+
+    response->content_length =
+        perf_http_get_header_u64(client->buf, "Content-Length: ");
+    response->seq = perf_http_get_header_u64(client->buf, "X-Scrcpy-Seq: ");
+    response->close = strstr(client->buf, "\r\nConnection: close");
+
+    // The beginning of the body may have been received with the headers
+    size_t prefix_len = PERF_HTTP_BODY_PREFIX;
+    if (prefix_len > PERF_HTTP_HEADERS_MAX - headers_len) {
+        prefix_len = PERF_HTTP_HEADERS_MAX - headers_len;
+    }
+    if (prefix_len > response->content_length) {
+        prefix_len = response->content_length;
+    }
+    if (!perf_http_fill(client, headers_len + prefix_len)) {
+        return false;
+    }
+
+    size_t received = client->len - headers_len;
+    if (received > response->content_length) {
+        // Requests are not pipelined, nothing may follow the body
+        return false;
+    }
+
+    static const char json_seq[] = "{\"seq\":";
+    const char *body = client->buf + headers_len;
+    if (!response->seq && received >= sizeof(json_seq) - 1
+            && !memcmp(body, json_seq, sizeof(json_seq) - 1)) {
+        response->seq = strtoull(body + sizeof(json_seq) - 1, NULL, 10);
+    }
+
+    // Discard the rest of the body
+    uint64_t remaining = response->content_length - received;
+    while (remaining) {
+        size_t len = remaining < PERF_HTTP_HEADERS_MAX ? remaining
+                                                       : PERF_HTTP_HEADERS_MAX;
+        ssize_t r = net_recv(client->socket, client->buf, len);
+        if (r <= 0) {
+            return false;
+        }
+        remaining -= r;
+    }
+
+    client->len = 0;
+    return true;
+}
@@ -0,0 +1,88 @@
+#ifndef SC_PERF_H
+#define SC_PERF_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/net.h"
+
+/**
+ * Performance regression checks ("meson test --suite perf")
+ *
+ * Each perf test measures some metrics and compares them to the baselines
+ * listed in tests/perf_baselines.txt (whose path is given by the environment
+ * variable SCRCPY_PERF_BASELINES), one per line:
+ *
+ *     <metric> <higher|lower> <baseline> <tolerance in %>
+ *
+ * "higher" means that higher is better (a throughput), "lower" that lower is
+ * better (a latency). A metric regresses if it is worse than its baseline by
+ * more than the tolerance.
+ *
+ * The tolerance of all the metrics may be overridden by the environment
+ * variable SCRCPY_PERF_TOLERANCE (in %), e.g. on a slow or loaded machine.
+ */
+
+// Exit code to report a skipped test to meson
+#define PERF_SKIP 77
+
+/**
+ * Report a measured metric, and compare it to its baseline (if any)
+ *
+ * The value is printed in the format of the baselines file, so that the
+ * baselines may be updated from the output.
+ *
+ * Return false if the metric regressed.
+ */
+bool
+perf_check(const char *metric, const char *direction, double value);
+
+/**
+ * Get the p-th percentile (nearest-rank method, 0 <= p <= 100) of the `count`
+ * values (sorted in place)
+ */
+int64_t
+perf_percentile(int64_t *values, size_t count, unsigned p);
+
+// Size of the buffer of the HTTP response headers
+#define PERF_HTTP_HEADERS_MAX 4096
+
+// Client of the Figma bridge (or any HTTP/1.1 server sending Content-Length)
+struct perf_http_client {
+    sc_socket socket;
+    char buf[PERF_HTTP_HEADERS_MAX + 1]; // +1 for the NUL terminator
+    size_t len;
+};
+
+struct perf_http_response {
+    int status;
+    // The sequence of the screenshot, from the X-Scrcpy-Seq header or the
+    // "seq" field of a JSON body (0 if none)
+    uint64_t seq;
+    uint64_t content_length;
+    // The server closes the connection after the response
+    bool close;
+};
+
+bool
+perf_http_connect(struct perf_http_client *client, uint16_t port);
+
+void
+perf_http_close(struct perf_http_client *client);
+
+/**
+ * Send a GET request and read the whole response (its body is discarded)
+ *
+ * If `keep_alive` is false, the server closes the connection after the
+ * response.
+ *
+ * Return false on I/O error.
+ */
+bool
+perf_http_get(struct perf_http_client *client, const char *uri,
+              bool keep_alive, struct perf_http_response *response);
+
+#endif
@@ -0,0 +1,303 @@
+#include "common.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+# include <signal.h>
+#endif
+
+#include "figma_bridge.h"
+#include "perf.h"
+#include "util/log.h"
+#include "util/net.h"
+#include "util/thread.h"
+#include "util/tick.h"
+
+/**
+ * Fetch screenshots from the Figma bridge over a local HTTP/1.1 persistent
+ * connection, and measure:
+ *  - the serving throughput and latency of /scrcpy-bridge/latest.png;
+ *  - the latency of the delivery of bursts of screenshots to a client long
+ *    polling for them (like the Figma plugin).
+ *
+ * The screenshots are synthetic (only their size matters, the bridge does not
+ * decode them unless a variant is requested).
+ */
+
+#define PERF_PORT_FIRST 27330
+#define PERF_PORT_LAST 27339
+
+#define PERF_SCREENSHOT_WIDTH 1080
+#define PERF_SCREENSHOT_HEIGHT 2400
+#define PERF_SCREENSHOT_SIZE (512 * 1024)
+
+#define PERF_REQUEST_COUNT 2000
+
+#define PERF_BURST_SIZE 8
+#define PERF_BURST_COUNT 200
+
+// Client long polling for the screenshots
+struct perf_poller {
+    sc_thread thread;
+    struct perf_http_client http;
+
+    sc_mutex mutex;
+    sc_cond cond; // signaled when a screenshot is received
+    uint64_t sequence; // of the last screenshot received
+    sc_tick received_tick;
+    bool stopped;
+};
+
+static bool
+perf_bridge_init(struct sc_figma_bridge *bridge) {
+    for (uint16_t p = PERF_PORT_FIRST; p <= PERF_PORT_LAST; ++p) {
+        if (sc_figma_bridge_init(bridge, p)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool
+perf_publish(struct sc_figma_bridge *bridge, const uint8_t *screenshot) {
+    return sc_figma_bridge_publish_png(bridge, screenshot, PERF_SCREENSHOT_SIZE,
+                                       PERF_SCREENSHOT_WIDTH,
+                                       PERF_SCREENSHOT_HEIGHT);
+}
+
+static bool
+perf_serve(struct sc_figma_bridge *bridge, const uint8_t *screenshot,
+           int64_t *latencies) {
+    if (!perf_publish(bridge, screenshot)) {
+        return false;
+    }
+
+    struct perf_http_client client;
+    if (!perf_http_connect(&client, sc_figma_bridge_get_port(bridge))) {
+        fprintf(stderr, "Could not connect to the bridge\n");
+        return false;
+    }
+
+    bool ok = true;
+    sc_tick start = sc_tick_now();
+    for (unsigned i = 0; i < PERF_REQUEST_COUNT; ++i) {
+        sc_tick request_start = sc_tick_now();
+        struct perf_http_response response;
+        if (!perf_http_get(&client, "/scrcpy-bridge/latest.png", true,
+                           &response) || response.status != 200) {
+            fprintf(stderr, "Request failed\n");
+            ok = false;
+            break;
+        }
+        latencies[i] = SC_TICK_TO_US(sc_tick_now() - request_start);
+    }
+    sc_tick duration = sc_tick_now() - start;
+
+    perf_http_close(&client);
+
+    if (!ok) {
+        return false;
+    }
+
+    double seconds = (double) duration / SC_TICK_FREQ;
+    double requests_per_s = seconds > 0 ? PERF_REQUEST_COUNT / seconds : 0;
+    int64_t p50 = perf_percentile(latencies, PERF_REQUEST_COUNT, 50);
+    int64_t p99 = perf_percentile(latencies, PERF_REQUEST_COUNT, 99);
+
+    printf("%u screenshots of %u bytes served in %.3f s\n", PERF_REQUEST_COUNT,
+           PERF_SCREENSHOT_SIZE, seconds);
+    bool ok1 = perf_check("bridge.requests_per_s", "higher", requests_per_s);
+    bool ok2 = perf_check("bridge.request_p50_us", "lower", p50);
+    bool ok3 = perf_check("bridge.request_p99_us", "lower", p99);
+    return ok1 && ok2 && ok3;
+}
+
+static int
+run_poller(void *data) {
+    struct perf_poller *poller = data;
+
+    uint64_t after = 0;
+    for (;;) {
+        char uri[128];
+        snprintf(uri, sizeof(uri),
+                 "/scrcpy-bridge/latest.png?after=%" PRIu64 "&wait=5000",
+                 after);
+
+        struct perf_http_response response;
+        bool ok = perf_http_get(&poller->http, uri, true, &response);
+        sc_tick now = sc_tick_now();
+        if (!ok || (response.status != 200 && response.status != 204)) {
+            break;
+        }
+
+        if (response.status == 200) {
+            after = response.seq;
+            sc_mutex_lock(&poller->mutex);
+            poller->sequence = response.seq;
+            poller->received_tick = now;
+            sc_cond_signal(&poller->cond);
+            sc_mutex_unlock(&poller->mutex);
+        }
+    }
+
+    sc_mutex_lock(&poller->mutex);
+    poller->stopped = true;
+    sc_cond_signal(&poller->cond);
+    sc_mutex_unlock(&poller->mutex);
+
+    return 0;
+}
+
+static bool
+perf_bursts(struct sc_figma_bridge *bridge, const uint8_t *screenshot,
+            int64_t *latencies) {
+    struct perf_poller poller = {
+        .sequence = 0,
+        .stopped = false,
+    };
+
+    if (!sc_mutex_init(&poller.mutex)) {
+        return false;
+    }
+
+    if (!sc_cond_init(&poller.cond)) {
+        sc_mutex_destroy(&poller.mutex);
+        return false;
+    }
+
+    if (!perf_http_connect(&poller.http, sc_figma_bridge_get_port(bridge))) {
+        fprintf(stderr, "Could not connect to the bridge\n");
+        sc_cond_destroy(&poller.cond);
+        sc_mutex_destroy(&poller.mutex);
+        return false;
+    }
+
+    if (!sc_thread_create(&poller.thread, run_poller, "perf-poller",
+                          &poller)) {
+        perf_http_close(&poller.http);
+        sc_cond_destroy(&poller.cond);
+        sc_mutex_destroy(&poller.mutex);
+        return false;
+    }
+
+    sc_mutex_lock(&bridge->mutex);
+    uint64_t sequence = bridge->store.sequence;
+    sc_mutex_unlock(&bridge->mutex);
+
+    bool ok = true;
+    sc_tick publish_time = 0;
+    for (unsigned i = 0; ok && i < PERF_BURST_COUNT; ++i) {
+        sc_tick start = sc_tick_now();
+        for (unsigned j = 0; j < PERF_BURST_SIZE; ++j) {
+            if (!perf_publish(bridge, screenshot)) {
+                ok = false;
+                break;
+            }
+        }
+        publish_time += sc_tick_now() - start;
+        sequence += PERF_BURST_SIZE;
+
+        // Wait for the last screenshot of the burst to be delivered
+        sc_mutex_lock(&poller.mutex);
+        while (poller.sequence < sequence && !poller.stopped) {
+            sc_cond_wait(&poller.cond, &poller.mutex);
+        }
+        if (poller.sequence < sequence) {
+            fprintf(stderr, "Long polling failed\n");
+            ok = false;
+        } else {
+            latencies[i] = SC_TICK_TO_US(poller.received_tick - start);
+        }
+        sc_mutex_unlock(&poller.mutex);
+    }
+
+    // Interrupt the pending long polling request
+    net_interrupt(poller.http.socket);
+    sc_thread_join(&poller.thread, NULL);
+    perf_http_close(&poller.http);
+    sc_cond_destroy(&poller.cond);
+    sc_mutex_destroy(&poller.mutex);
+
+    if (!ok) {
+        return false;
+    }
+
+    unsigned publish_count = PERF_BURST_SIZE * PERF_BURST_COUNT;
+    double publish_seconds = (double) publish_time / SC_TICK_FREQ;
+    double publishes_per_s =
+        publish_seconds > 0 ? publish_count / publish_seconds : 0;
+    int64_t p50 = perf_percentile(latencies, PERF_BURST_COUNT, 50);
+    int64_t p99 = perf_percentile(latencies, PERF_BURST_COUNT, 99);
+
+    printf("%u bursts of %u screenshots delivered\n", PERF_BURST_COUNT,
+           PERF_BURST_SIZE);
+    bool ok1 = perf_check("bridge.publishes_per_s", "higher", publishes_per_s);
+    bool ok2 = perf_check("bridge.burst_p50_us", "lower", p50);
+    bool ok3 = perf_check("bridge.burst_p99_us", "lower", p99);
+    return ok1 && ok2 && ok3;
+}
+
+int main(void) {
+    // Do not log each screenshot
+    sc_set_log_level(SC_LOG_LEVEL_WARN);
+
+#ifndef _WIN32
+    // The bridge may be writing a response when the client disconnects
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    uint8_t *screenshot = malloc(PERF_SCREENSHOT_SIZE);
+    int64_t *latencies = malloc(PERF_REQUEST_COUNT * sizeof(*latencies));
+    if (!screenshot || !latencies) {
+        free(screenshot);
+        free(latencies);
+        return 1;
+    }
+
+    static const uint8_t png_signature[] = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n',
+    };
+    for (size_t i = 0; i < PERF_SCREENSHOT_SIZE; ++i) {
+        screenshot[i] = i * 31;
+    }
+    memcpy(screenshot, png_signature, sizeof(png_signature));
+
+    int ret = 1;
+
+    if (!net_init()) {
+        goto end_free;
+    }
+
+    struct sc_figma_bridge bridge;
+    if (!perf_bridge_init(&bridge)) {
+        fprintf(stderr, "Could not listen on a local port\n");
+        goto end_net_cleanup;
+    }
+
+    if (!sc_figma_bridge_start(&bridge)) {
+        goto end_destroy_bridge;
+    }
+
+    // Run both, to report all the regressions at once
+    static_assert(PERF_BURST_COUNT <= PERF_REQUEST_COUNT, "too many bursts");
+    bool ok1 = perf_serve(&bridge, screenshot, latencies);
+    bool ok2 = perf_bursts(&bridge, screenshot, latencies);
+    if (ok1 && ok2) {
+        ret = 0;
+    }
+
+    sc_figma_bridge_stop(&bridge);
+end_destroy_bridge:
+    sc_figma_bridge_destroy(&bridge);
+end_net_cleanup:
+    net_cleanup();
+end_free:
+    free(latencies);
+    free(screenshot);
+
+    return ret;
+}
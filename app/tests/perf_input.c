@@ -0,0 +1,279 @@
+#include "common.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "controller.h"
+#include "perf.h"
+#include "util/binary.h"
+#include "util/log.h"
+#include "util/net.h"
+#include "util/thread.h"
+#include "util/tick.h"
+
+/**
+ * Send bursts of input events through the controller, to a fake device on a
+ * local TCP connection, and measure the throughput and the latency from
+ * sc_controller_push_msg() to the reception by the device.
+ *
+ * Each event is a key event (which is never coalesced) carrying its index in
+ * its "repeat" field, so that the device identifies it.
+ */
+
+#define PERF_PORT_FIRST 27320
+#define PERF_PORT_LAST 27329
+
+// Below the controller queue limit, so that no event is dropped
+#define PERF_BURST_SIZE 32
+#define PERF_BURST_COUNT 2000
+#define PERF_EVENT_COUNT (PERF_BURST_SIZE * PERF_BURST_COUNT)
+
+// Serialized size of a key event
+#define PERF_KEYCODE_MSG_SIZE 14
+
+struct perf_device {
+    sc_thread thread;
+    sc_socket socket;
+
+    sc_mutex mutex;
+    sc_cond cond; // signaled when an event is received
+    uint32_t received; // number of events received
+    bool error;
+
+    const sc_tick *push_ticks;
+    int64_t *latencies; // in microseconds
+};
+
+static void
+perf_on_controller_ended(struct sc_controller *controller, bool error,
+                         void *userdata) {
+    (void) controller;
+    (void) error;
+    (void) userdata;
+    // the end is triggered by the test
+}
+
+static int
+run_device(void *data) {
+    struct perf_device *device = data;
+
+    uint8_t buf[PERF_KEYCODE_MSG_SIZE];
+    for (;;) {
+        ssize_t r = net_recv_all(device->socket, buf, sizeof(buf));
+        if (r != sizeof(buf)) {
+            break;
+        }
+        sc_tick now = sc_tick_now();
+
+        uint32_t index = sc_read32be(&buf[6]);
+        bool valid = buf[0] == SC_CONTROL_MSG_TYPE_INJECT_KEYCODE
+                  && index < PERF_EVENT_COUNT;
+
+        sc_mutex_lock(&device->mutex);
+        // The events are sent in order, none of them may be lost
+        if (!valid || index != device->received) {
+            device->error = true;
+            sc_cond_signal(&device->cond);
+            sc_mutex_unlock(&device->mutex);
+            break;
+        }
+        device->latencies[index] =
+            SC_TICK_TO_US(now - device->push_ticks[index]);
+        ++device->received;
+        sc_cond_signal(&device->cond);
+        sc_mutex_unlock(&device->mutex);
+    }
+
+    return 0;
+}
+
+static sc_socket
+perf_listen(uint16_t *port) {
+    for (uint16_t p = PERF_PORT_FIRST; p <= PERF_PORT_LAST; ++p) {
+        sc_socket socket = net_socket();
+        if (socket == SC_SOCKET_NONE) {
+            return SC_SOCKET_NONE;
+        }
+        if (net_listen(socket, IPV4_LOCALHOST, p, 1)) {
+            *port = p;
+            return socket;
+        }
+        net_close(socket);
+    }
+
+    return SC_SOCKET_NONE;
+}
+
+// Return false if the device did not receive the events
+static bool
+perf_wait_received(struct perf_device *device, uint32_t count) {
+    sc_mutex_lock(&device->mutex);
+    while (device->received < count && !device->error) {
+        sc_cond_wait(&device->cond, &device->mutex);
+    }
+    bool ok = !device->error;
+    sc_mutex_unlock(&device->mutex);
+    return ok;
+}
+
+static bool
+perf_run_bursts(struct sc_controller *controller, struct perf_device *device,
+                sc_tick *push_ticks) {
+    uint32_t index = 0;
+    for (unsigned i = 0; i < PERF_BURST_COUNT; ++i) {
+        for (unsigned j = 0; j < PERF_BURST_SIZE; ++j) {
+            struct sc_control_msg msg = {
+                .type = SC_CONTROL_MSG_TYPE_INJECT_KEYCODE,
+                .inject_keycode = {
+                    .action = j % 2 ? AKEY_EVENT_ACTION_UP
+                                    : AKEY_EVENT_ACTION_DOWN,
+                    .keycode = AKEYCODE_A,
+                    .repeat = index,
+                    .metastate = 0,
+                },
+            };
+
+            push_ticks[index] = sc_tick_now();
+            if (!sc_controller_push_msg(controller, &msg)) {
+                fprintf(stderr, "Could not push event %" PRIu32 "\n", index);
+                return false;
+            }
+            ++index;
+        }
+
+        // Wait for the whole burst, so that the queue never overflows
+        if (!perf_wait_received(device, index)) {
+            fprintf(stderr, "Invalid event received\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(void) {
+    // Do not log each event
+    sc_set_log_level(SC_LOG_LEVEL_WARN);
+
+    sc_tick *push_ticks = malloc(PERF_EVENT_COUNT * sizeof(*push_ticks));
+    int64_t *latencies = malloc(PERF_EVENT_COUNT * sizeof(*latencies));
+    if (!push_ticks || !latencies) {
+        free(push_ticks);
+        free(latencies);
+        return 1;
+    }
+
+    int ret = 1;
+
+    if (!net_init()) {
+        goto end_free;
+    }
+
+    uint16_t port;
+    sc_socket server_socket = perf_listen(&port);
+    if (server_socket == SC_SOCKET_NONE) {
+        fprintf(stderr, "Could not listen on a local port\n");
+        goto end_net_cleanup;
+    }
+
+    sc_socket control_socket = net_socket();
+    if (control_socket == SC_SOCKET_NONE) {
+        net_close(server_socket);
+        goto end_net_cleanup;
+    }
+
+    // The connection is queued by the listening socket, it may be accepted
+    // afterwards
+    bool ok = net_connect(control_socket, IPV4_LOCALHOST, port);
+    sc_socket device_socket = ok ? net_accept(server_socket) : SC_SOCKET_NONE;
+    net_close(server_socket);
+    if (device_socket == SC_SOCKET_NONE) {
+        fprintf(stderr, "Could not connect to the fake device\n");
+        goto end_close_control_socket;
+    }
+
+    // Like the actual control socket
+    net_set_tcp_nodelay(control_socket, true);
+
+    struct perf_device device = {
+        .socket = device_socket,
+        .received = 0,
+        .error = false,
+        .push_ticks = push_ticks,
+        .latencies = latencies,
+    };
+
+    if (!sc_mutex_init(&device.mutex)) {
+        goto end_close_device_socket;
+    }
+
+    if (!sc_cond_init(&device.cond)) {
+        goto end_destroy_device_mutex;
+    }
+
+    static const struct sc_controller_callbacks cbs = {
+        .on_ended = perf_on_controller_ended,
+    };
+    struct sc_controller controller;
+    if (!sc_controller_init(&controller, control_socket, &cbs, NULL)) {
+        goto end_destroy_device_cond;
+    }
+
+    if (!sc_thread_create(&device.thread, run_device, "perf-device",
+                          &device)) {
+        goto end_destroy_controller;
+    }
+
+    if (!sc_controller_start(&controller)) {
+        net_interrupt(device_socket);
+        goto end_join_device;
+    }
+
+    sc_tick start = sc_tick_now();
+    bool success = perf_run_bursts(&controller, &device, push_ticks);
+    sc_tick duration = sc_tick_now() - start;
+
+    sc_controller_stop(&controller);
+    // Unblock the receiver and the device
+    net_interrupt(control_socket);
+    net_interrupt(device_socket);
+    sc_controller_join(&controller);
+
+    if (success) {
+        double seconds = (double) duration / SC_TICK_FREQ;
+        double events_per_s = seconds > 0 ? PERF_EVENT_COUNT / seconds : 0;
+        int64_t p50 = perf_percentile(latencies, PERF_EVENT_COUNT, 50);
+        int64_t p99 = perf_percentile(latencies, PERF_EVENT_COUNT, 99);
+
+        printf("%u bursts of %u input events in %.3f s\n", PERF_BURST_COUNT,
+               PERF_BURST_SIZE, seconds);
+        // Check all the metrics, to report all the regressions at once
+        bool ok1 = perf_check("input.events_per_s", "higher", events_per_s);
+        bool ok2 = perf_check("input.latency_p50_us", "lower", p50);
+        bool ok3 = perf_check("input.latency_p99_us", "lower", p99);
+        if (ok1 && ok2 && ok3) {
+            ret = 0;
+        }
+    }
+
+end_join_device:
+    sc_thread_join(&device.thread, NULL);
+end_destroy_controller:
+    sc_controller_destroy(&controller);
+end_destroy_device_cond:
+    sc_cond_destroy(&device.cond);
+end_destroy_device_mutex:
+    sc_mutex_destroy(&device.mutex);
+end_close_device_socket:
+    net_close(device_socket);
+end_close_control_socket:
+    net_close(control_socket);
+end_net_cleanup:
+    net_cleanup();
+end_free:
+    free(latencies);
+    free(push_ticks);
+
+    return ret;
+}
@@ -253,6 +253,33 @@ static void test_get_ip_truncated(void) {
     assert(!ip);
 }
 
+static void test_sha256sum(void) {
+    char output[] = "0123456789abcdef0123456789abcdef"
+                    "0123456789abcdef0123456789abcdef  "
+                    "/data/local/tmp/scrcpy-server.jar\r\n";
+
+    bool ok = sc_adb_parse_sha256sum(output);
+    assert(ok);
+    assert(!strcmp(output, "0123456789abcdef0123456789abcdef"
+                           "0123456789abcdef0123456789abcdef"));
+}
+
+static void test_sha256sum_no_such_file(void) {
+    char output[] = "sha256sum: /data/local/tmp/scrcpy-server.jar: "
+                    "No such file or directory\n";
+
+    bool ok = sc_adb_parse_sha256sum(output);
+    assert(!ok);
+}
+
+static void test_sha256sum_truncated(void) {
+    char output[] = "0123456789abcdef0123456789abcdef  "
+                    "/data/local/tmp/scrcpy-server.jar\n";
+
+    bool ok = sc_adb_parse_sha256sum(output);
+    assert(!ok);
+}
+
 int main(int argc, char *argv[]) {
     (void) argc;
     (void) argv;
@@ -276,5 +303,9 @@ int main(int argc, char *argv[]) {
     test_get_ip_no_wlan_without_eol();
     test_get_ip_truncated();
 
+    test_sha256sum();
+    test_sha256sum_no_such_file();
+    test_sha256sum_truncated();
+
     return 0;
 }
@@ -0,0 +1,84 @@
+#include "common.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "util/audio_plc.h"
+
+static void test_audio_plc_conceal_silence_without_history(void) {
+    struct sc_audio_plc plc;
+    bool ok = sc_audio_plc_init(&plc, 2, 4, 8);
+    assert(ok);
+
+    float out[6] = {1, 1, 1, 1, 1, 1};
+    sc_audio_plc_conceal(&plc, out, 3);
+    for (int i = 0; i < 6; ++i) {
+        assert(out[i] == 0.f);
+    }
+
+    sc_audio_plc_destroy(&plc);
+}
+
+static void test_audio_plc_conceal_repeat_and_fade(void) {
+    struct sc_audio_plc plc;
+    bool ok = sc_audio_plc_init(&plc, 1, 2, 4);
+    assert(ok);
+
+    float samples[] = {5, 6, 7, 8};
+    sc_audio_plc_record(&plc, samples, 4);
+
+    // The last 2 samples are repeated, faded out over 4 samples
+    float out[6];
+    sc_audio_plc_conceal(&plc, out, 6);
+    assert(out[0] == 7.f);
+    assert(out[1] == 8.f * 0.75f);
+    assert(out[2] == 7.f * 0.5f);
+    assert(out[3] == 8.f * 0.25f);
+    assert(out[4] == 0.f);
+    assert(out[5] == 0.f);
+
+    // Once faded out, only silence is produced
+    sc_audio_plc_conceal(&plc, out, 2);
+    assert(out[0] == 0.f);
+    assert(out[1] == 0.f);
+
+    // A received sample restarts the concealment
+    float single = 2;
+    sc_audio_plc_record(&plc, &single, 1);
+    sc_audio_plc_conceal(&plc, out, 2);
+    assert(out[0] == 8.f);
+    assert(out[1] == 2.f * 0.75f);
+
+    sc_audio_plc_destroy(&plc);
+}
+
+static void test_audio_plc_record_partial(void) {
+    struct sc_audio_plc plc;
+    bool ok = sc_audio_plc_init(&plc, 2, 3, 100);
+    assert(ok);
+
+    float a[] = {1, -1};
+    float b[] = {2, -2, 3, -3};
+    float c[] = {4, -4};
+    sc_audio_plc_record(&plc, a, 1);
+    sc_audio_plc_record(&plc, b, 2);
+    sc_audio_plc_record(&plc, c, 1);
+
+    // Only the last 3 samples are kept
+    assert(plc.len == 3);
+    float expected[] = {2, -2, 3, -3, 4, -4};
+    assert(!memcmp(plc.history, expected, sizeof(expected)));
+
+    sc_audio_plc_destroy(&plc);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_audio_plc_conceal_silence_without_history();
+    test_audio_plc_conceal_repeat_and_fade();
+    test_audio_plc_record_partial();
+
+    return 0;
+}
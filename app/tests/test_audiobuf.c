@@ -4,6 +4,9 @@
 #include <string.h>
 
 #include "util/audiobuf.h"
+#include "util/thread.h"
+
+#define CONCURRENT_SAMPLES 1000000
 
 static void test_audiobuf_simple(void) {
     struct sc_audiobuf buf;
@@ -124,6 +127,95 @@ static void test_audiobuf_partial_read_write(void) {
     sc_audiobuf_destroy(&buf);
 }
 
+static void test_audiobuf_drop(void) {
+    struct sc_audiobuf buf;
+    uint32_t data[10];
+
+    bool ok = sc_audiobuf_init(&buf, 4, 10);
+    assert(ok);
+
+    uint32_t samples[] = {1, 2, 3, 4, 5, 6, 7, 8};
+    uint32_t w = sc_audiobuf_write(&buf, samples, 8);
+    assert(w == 8);
+
+    // drop the oldest samples
+    uint32_t d = sc_audiobuf_drop(&buf, 3);
+    assert(d == 3);
+    assert(sc_audiobuf_can_read(&buf) == 5);
+
+    // the space is available for writing (across the boundary)
+    uint32_t samples2[] = {9, 10, 11, 12, 13};
+    w = sc_audiobuf_write(&buf, samples2, 5);
+    assert(w == 5);
+
+    d = sc_audiobuf_drop(&buf, 2);
+    assert(d == 2);
+
+    uint32_t r = sc_audiobuf_read(&buf, data, 10);
+    assert(r == 8);
+    uint32_t expected[] = {6, 7, 8, 9, 10, 11, 12, 13};
+    assert(!memcmp(data, expected, 32));
+
+    // cannot drop more than available
+    d = sc_audiobuf_drop(&buf, 2);
+    assert(d == 0);
+
+    sc_audiobuf_destroy(&buf);
+}
+
+static int
+run_reader(void *data) {
+    struct sc_audiobuf *buf = data;
+
+    uint32_t samples[64];
+    uint32_t last = 0;
+    while (last != CONCURRENT_SAMPLES) {
+        uint32_t r = sc_audiobuf_read(buf, samples, 64);
+        for (uint32_t i = 0; i < r; ++i) {
+            // Samples may be dropped, but never reordered nor corrupted
+            assert(samples[i] > last);
+            last = samples[i];
+        }
+    }
+
+    return 0;
+}
+
+static void test_audiobuf_concurrent_drop(void) {
+    struct sc_audiobuf buf;
+
+    bool ok = sc_audiobuf_init(&buf, 4, 100);
+    assert(ok);
+
+    sc_thread thread;
+    ok = sc_thread_create(&thread, run_reader, "test-reader", &buf);
+    assert(ok);
+    (void) ok;
+
+    uint32_t next = 1;
+    while (next <= CONCURRENT_SAMPLES) {
+        uint32_t samples[32];
+        uint32_t count = MIN(32, CONCURRENT_SAMPLES - next + 1);
+        for (uint32_t i = 0; i < count; ++i) {
+            samples[i] = next + i;
+        }
+
+        uint32_t w = sc_audiobuf_write(&buf, samples, count);
+        if (w < count) {
+            // Like the audio regulator, drop old samples to make space
+            sc_audiobuf_drop(&buf, count - w);
+            uint32_t w2 = sc_audiobuf_write(&buf, samples + w, count - w);
+            assert(w2 == count - w);
+            (void) w2;
+        }
+        next += count;
+    }
+
+    sc_thread_join(&thread, NULL);
+
+    sc_audiobuf_destroy(&buf);
+}
+
 int main(int argc, char *argv[]) {
     (void) argc;
     (void) argv;
@@ -131,6 +223,8 @@ int main(int argc, char *argv[]) {
     test_audiobuf_simple();
     test_audiobuf_boundaries();
     test_audiobuf_partial_read_write();
+    test_audiobuf_drop();
+    test_audiobuf_concurrent_drop();
 
     return 0;
 }
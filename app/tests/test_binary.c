@@ -96,6 +96,14 @@ static void test_read32be(void) {
     assert(val == 0xABCD1234);
 }
 
+static void test_read32le(void) {
+    uint8_t buf[4] = {0x34, 0x12, 0xCD, 0xAB};
+
+    uint32_t val = sc_read32le(buf);
+
+    assert(val == 0xABCD1234);
+}
+
 static void test_read64be(void) {
     uint8_t buf[8] = {0xAB, 0xCD, 0x12, 0x34,
                       0x56, 0x78, 0x90, 0xEF};
@@ -149,6 +157,7 @@ int main(int argc, char *argv[]) {
     test_write16le();
     test_write32le();
     test_write64le();
+    test_read32le();
 
     test_float_to_u16fp();
     test_float_to_i16fp();
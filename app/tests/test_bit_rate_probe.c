@@ -0,0 +1,55 @@
+#include "common.h"
+
+#include <assert.h>
+
+#include "bit_rate_probe.h"
+
+static void test_bit_rate_probe_fast_link(void) {
+    // 100 Mbps
+    struct sc_bit_rate_probe_result r =
+        sc_bit_rate_probe_choose(100000000, 128000, 0);
+    assert(r.bit_rate == SC_BIT_RATE_PROBE_MAX_BIT_RATE);
+    assert(r.max_size == 0);
+}
+
+static void test_bit_rate_probe_slow_link(void) {
+    // 10 Mbps, 70% minus the audio
+    struct sc_bit_rate_probe_result r =
+        sc_bit_rate_probe_choose(10000000, 128000, 0);
+    assert(r.bit_rate == 6872000);
+    assert(r.max_size == 0);
+
+    // 4 Mbps
+    r = sc_bit_rate_probe_choose(4000000, 0, 0);
+    assert(r.bit_rate == 2800000);
+    assert(r.max_size == 1024);
+
+    // 1 Mbps
+    r = sc_bit_rate_probe_choose(1000000, 128000, 0);
+    assert(r.bit_rate == 572000);
+    assert(r.max_size == 720);
+
+    // Almost nothing
+    r = sc_bit_rate_probe_choose(100000, 128000, 0);
+    assert(r.bit_rate == SC_BIT_RATE_PROBE_MIN_BIT_RATE);
+    assert(r.max_size == 720);
+}
+
+static void test_bit_rate_probe_user_max_size(void) {
+    // The max size requested by the user is never changed
+    struct sc_bit_rate_probe_result r =
+        sc_bit_rate_probe_choose(1000000, 0, 1920);
+    assert(r.bit_rate == 700000);
+    assert(r.max_size == 0);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_bit_rate_probe_fast_link();
+    test_bit_rate_probe_slow_link();
+    test_bit_rate_probe_user_max_size();
+
+    return 0;
+}
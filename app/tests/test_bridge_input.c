@@ -0,0 +1,162 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bridge_input.h"
+
+static const struct sc_size frame_size = {1080, 2400};
+
+static void test_bridge_input_empty(void) {
+    struct sc_bridge_input_msgs msgs = SC_VECTOR_INITIALIZER;
+    const char *error;
+    bool ok = sc_bridge_input_parse(" [ ] ", frame_size, &msgs, &error);
+    assert(ok);
+    assert(msgs.size == 0);
+    sc_bridge_input_msgs_destroy(&msgs);
+}
+
+static void test_bridge_input_touch(void) {
+    struct sc_bridge_input_msgs msgs = SC_VECTOR_INITIALIZER;
+    const char *error;
+    bool ok = sc_bridge_input_parse(
+        "[{\"type\":\"touch\",\"action\":\"down\",\"x\":100,\"y\":200.5},"
+        " {\"type\":\"touch\",\"action\":\"move\",\"x\":110,\"y\":210,"
+          "\"pointer\":1,\"pressure\":0.5,\"comment\":{\"a\":[1,null]}},"
+        " {\"action\":\"up\",\"type\":\"touch\",\"x\":120,\"y\":220}]",
+        frame_size, &msgs, &error);
+    assert(ok);
+    assert(msgs.size == 3);
+
+    struct sc_control_msg *msg = &msgs.data[0];
+    assert(msg->type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT);
+    assert(msg->inject_touch_event.action == AMOTION_EVENT_ACTION_DOWN);
+    assert(msg->inject_touch_event.pointer_id == 0);
+    assert(msg->inject_touch_event.position.point.x == 100);
+    assert(msg->inject_touch_event.position.point.y == 200);
+    assert(msg->inject_touch_event.position.screen_size.width == 1080);
+    assert(msg->inject_touch_event.position.screen_size.height == 2400);
+    assert(msg->inject_touch_event.pressure == 1.f);
+
+    msg = &msgs.data[1];
+    assert(msg->inject_touch_event.action == AMOTION_EVENT_ACTION_MOVE);
+    assert(msg->inject_touch_event.pointer_id == 1);
+    assert(msg->inject_touch_event.pressure == 0.5f);
+
+    msg = &msgs.data[2];
+    assert(msg->inject_touch_event.action == AMOTION_EVENT_ACTION_UP);
+    assert(msg->inject_touch_event.position.point.x == 120);
+    assert(msg->inject_touch_event.pressure == 0.f);
+
+    sc_bridge_input_msgs_destroy(&msgs);
+}
+
+static void test_bridge_input_tap_and_key(void) {
+    struct sc_bridge_input_msgs msgs = SC_VECTOR_INITIALIZER;
+    const char *error;
+    bool ok = sc_bridge_input_parse(
+        "[{\"type\":\"tap\",\"x\":5,\"y\":6},"
+        " {\"type\":\"key\",\"keycode\":66,\"metastate\":1},"
+        " {\"type\":\"key\",\"action\":\"down\",\"keycode\":4,\"repeat\":2}]",
+        frame_size, &msgs, &error);
+    assert(ok);
+    assert(msgs.size == 5);
+
+    assert(msgs.data[0].inject_touch_event.action == AMOTION_EVENT_ACTION_DOWN);
+    assert(msgs.data[1].inject_touch_event.action == AMOTION_EVENT_ACTION_UP);
+
+    struct sc_control_msg *msg = &msgs.data[2];
+    assert(msg->type == SC_CONTROL_MSG_TYPE_INJECT_KEYCODE);
+    assert(msg->inject_keycode.action == AKEY_EVENT_ACTION_DOWN);
+    assert(msg->inject_keycode.keycode == AKEYCODE_ENTER);
+    assert(msg->inject_keycode.metastate == 1);
+    assert(msgs.data[3].inject_keycode.action == AKEY_EVENT_ACTION_UP);
+
+    msg = &msgs.data[4];
+    assert(msg->inject_keycode.action == AKEY_EVENT_ACTION_DOWN);
+    assert(msg->inject_keycode.keycode == AKEYCODE_BACK);
+    assert(msg->inject_keycode.repeat == 2);
+
+    sc_bridge_input_msgs_destroy(&msgs);
+}
+
+static void test_bridge_input_text(void) {
+    struct sc_bridge_input_msgs msgs = SC_VECTOR_INITIALIZER;
+    const char *error;
+    bool ok = sc_bridge_input_parse(
+        "[{\"type\":\"text\",\"text\":\"a\\\"b\\n\\u00e9\\ud83d\\ude00\"}]",
+        frame_size, &msgs, &error);
+    assert(ok);
+    assert(msgs.size == 1);
+    assert(msgs.data[0].type == SC_CONTROL_MSG_TYPE_INJECT_TEXT);
+    assert(!strcmp(msgs.data[0].inject_text.text,
+                   "a\"b\n\xc3\xa9\xf0\x9f\x98\x80"));
+    sc_bridge_input_msgs_destroy(&msgs);
+}
+
+static void test_bridge_input_long_text(void) {
+    char json[1024];
+    char text[SC_CONTROL_MSG_INJECT_TEXT_MAX_LENGTH + 11];
+    memset(text, 'x', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+    snprintf(json, sizeof(json), "[{\"type\":\"text\",\"text\":\"%s\"}]",
+             text);
+
+    struct sc_bridge_input_msgs msgs = SC_VECTOR_INITIALIZER;
+    const char *error;
+    bool ok = sc_bridge_input_parse(json, frame_size, &msgs, &error);
+    assert(ok);
+    assert(msgs.size == 2);
+    assert(strlen(msgs.data[0].inject_text.text)
+                == SC_CONTROL_MSG_INJECT_TEXT_MAX_LENGTH);
+    assert(strlen(msgs.data[1].inject_text.text) == 10);
+    sc_bridge_input_msgs_destroy(&msgs);
+}
+
+static void test_bridge_input_errors(void) {
+    static const char *const invalid[] = {
+        "",
+        "{}",
+        "[",
+        "[{\"type\":\"touch\",\"action\":\"down\",\"x\":1}]",
+        "[{\"type\":\"touch\",\"action\":\"down\",\"x\":1080,\"y\":0}]",
+        "[{\"type\":\"touch\",\"action\":\"down\",\"x\":-1,\"y\":0}]",
+        "[{\"type\":\"touch\",\"action\":\"hover\",\"x\":1,\"y\":1}]",
+        "[{\"type\":\"touch\",\"action\":\"down\",\"x\":1,\"y\":1,"
+          "\"pointer\":10}]",
+        "[{\"type\":\"key\"}]",
+        "[{\"type\":\"key\",\"keycode\":1.5}]",
+        "[{\"type\":\"text\",\"text\":\"\"}]",
+        "[{\"type\":\"text\",\"text\":\"\\u0000\"}]",
+        "[{\"type\":\"scroll\"}]",
+        "[{\"type\":\"tap\",\"x\":1,\"y\":1}] x",
+        "[{\"type\":\"tap\",\"x\":1,\"y\":1},]",
+        // Valid events before the invalid one must be released
+        "[{\"type\":\"text\",\"text\":\"abc\"},{\"type\":\"key\"}]",
+    };
+
+    for (size_t i = 0; i < ARRAY_LEN(invalid); ++i) {
+        struct sc_bridge_input_msgs msgs = SC_VECTOR_INITIALIZER;
+        const char *error = NULL;
+        bool ok = sc_bridge_input_parse(invalid[i], frame_size, &msgs, &error);
+        assert(!ok);
+        assert(error);
+        assert(msgs.size == 0);
+        sc_bridge_input_msgs_destroy(&msgs);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_bridge_input_empty();
+    test_bridge_input_touch();
+    test_bridge_input_tap_and_key();
+    test_bridge_input_text();
+    test_bridge_input_long_text();
+    test_bridge_input_errors();
+
+    return 0;
+}
@@ -1,10 +1,13 @@
 #include "common.h"
 
 #include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "cli.h"
 #include "options.h"
+#include "util/thread.h"
 
 static void test_flag_version(void) {
     struct scrcpy_cli_args args = {
@@ -108,6 +111,7 @@ static void test_options2(void) {
         "--no-control",
         "--no-playback",
         "--record", "file.mp4", // cannot enable --no-playback without recording
+        "--record-index",
     };
 
     bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
@@ -119,8 +123,109 @@ static void test_options2(void) {
     assert(!opts->audio_playback);
     assert(!strcmp(opts->record_filename, "file.mp4"));
     assert(opts->record_format == SC_RECORD_FORMAT_MP4);
+    assert(opts->record_index);
 }
 
+static void test_video_mode_thumbnail(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--video-mode=thumbnail",
+        "--thumbnail-interval=500",
+        "--max-size=480",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+
+    const struct scrcpy_options *opts = &args.opts;
+    assert(opts->video_mode == SC_VIDEO_MODE_THUMBNAIL);
+    assert(opts->thumbnail_interval == SC_TICK_FROM_MS(500));
+    // explicit values are kept, the others get the thumbnail defaults
+    assert(opts->max_size == 480);
+    assert(opts->video_bit_rate == 200000);
+}
+
+static void test_throughput(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--no-window",
+        "--record", "file.mkv",
+        "--record-buffer=64K",
+        "--throughput",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+
+    const struct scrcpy_options *opts = &args.opts;
+    assert(opts->throughput);
+    assert(!opts->video_playback);
+    assert(!opts->clipboard_autosync);
+    // explicit values are kept, the others get the throughput defaults
+    assert(opts->record_buffer == 64000);
+    assert(opts->video_socket_buffer == 4 * 1024 * 1024);
+
+    // --throughput requires --no-window
+    struct scrcpy_cli_args args2 = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+    char *argv2[] = {"scrcpy", "--record", "file.mkv", "--throughput"};
+    ok = scrcpy_parse_args(&args2, ARRAY_LEN(argv2), argv2);
+    assert(!ok);
+}
+
+#ifdef SC_THREAD_HAS_CPU_AFFINITY
+static bool parse_cpu_affinity(const char *value, uint64_t *cpus) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char arg[32];
+    snprintf(arg, sizeof(arg), "--cpu-affinity=%s", value);
+    char *argv[] = {"scrcpy", arg};
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    *cpus = args.opts.cpu_affinity;
+    return ok;
+}
+
+static void test_cpu_affinity(void) {
+    uint64_t cpus;
+
+    assert(parse_cpu_affinity("2", &cpus));
+    assert(cpus == 0x4);
+
+    assert(parse_cpu_affinity("0-3,6", &cpus));
+    assert(cpus == 0x4F);
+
+    assert(parse_cpu_affinity("63,1-1", &cpus));
+    assert(cpus == (UINT64_C(1) << 63 | 0x2));
+
+    assert(!parse_cpu_affinity("", &cpus));
+    assert(!parse_cpu_affinity("64", &cpus));
+    assert(!parse_cpu_affinity("3-1", &cpus));
+    assert(!parse_cpu_affinity("1,", &cpus));
+    assert(!parse_cpu_affinity("1-", &cpus));
+    assert(!parse_cpu_affinity("-1", &cpus));
+}
+#endif
+
 static void test_parse_shortcut_mods(void) {
     uint8_t mods;
     bool ok;
@@ -157,6 +262,11 @@ int main(int argc, char *argv[]) {
     test_flag_help();
     test_options();
     test_options2();
+    test_video_mode_thumbnail();
+    test_throughput();
+#ifdef SC_THREAD_HAS_CPU_AFFINITY
+    test_cpu_affinity();
+#endif
     test_parse_shortcut_mods();
     return 0;
 }
@@ -2,9 +2,12 @@
 
 #include <assert.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "control_msg.h"
+#include "hid/hid_keyboard.h"
+#include "hid/hid_mouse.h"
 
 static void test_serialize_inject_keycode(void) {
     struct sc_control_msg msg = {
@@ -446,6 +449,376 @@ static void test_serialize_reset_video(void) {
     assert(!memcmp(buf, expected, sizeof(expected)));
 }
 
+static void test_serialize_request_sync_frame(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_REQUEST_SYNC_FRAME,
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 1);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_REQUEST_SYNC_FRAME,
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
+static void test_serialize_video_feedback(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_VIDEO_FEEDBACK,
+        .video_feedback = {
+            .bit_rate = 0x01020304,
+            .delay = 150,
+            .backlog = 2,
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 9);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_VIDEO_FEEDBACK,
+        0x01, 0x02, 0x03, 0x04, // bit rate
+        0x00, 0x96, // delay
+        0x00, 0x02, // backlog
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
+static void test_serialize_inject_touch_batch(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_BATCH,
+        .inject_touch_batch = {
+            .pointer_id = UINT64_C(0x1234567887654321),
+            .screen_size = {
+                .width = 1080,
+                .height = 1920,
+            },
+            .buttons = AMOTION_EVENT_BUTTON_PRIMARY,
+            .count = 2,
+            .samples = {
+                {
+                    .point = {.x = 100, .y = 200},
+                    .pressure = 1.0f,
+                    .timestamp = 1000,
+                },
+                {
+                    .point = {.x = 110, .y = 220},
+                    .pressure = 0.0f,
+                    .timestamp = 9000,
+                },
+            },
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 46);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_INJECT_TOUCH_BATCH,
+        0x12, 0x34, 0x56, 0x78, 0x87, 0x65, 0x43, 0x21, // pointer id
+        0x04, 0x38, 0x07, 0x80, // 1080 1920
+        0x00, 0x00, 0x00, 0x01, // AMOTION_EVENT_BUTTON_PRIMARY (buttons)
+        2, // count
+        0x00, 0x00, 0x00, 0x64, 0x00, 0x00, 0x00, 0xc8, // 100 200
+        0xff, 0xff, // pressure
+        0x00, 0x00, 0x1f, 0x40, // age: 8000us
+        0x00, 0x00, 0x00, 0x6e, 0x00, 0x00, 0x00, 0xdc, // 110 220
+        0x00, 0x00, // pressure
+        0x00, 0x00, 0x00, 0x00, // age: 0
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
+static void test_serialize_input_probe(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INPUT_PROBE,
+        .input_probe = {
+            .sequence = UINT64_C(0x0102030405060708),
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 9);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_INPUT_PROBE,
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // sequence
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
+static void test_serialize_set_clipboard_chunk(void) {
+    const uint8_t data[] = {'h', 'e', 'l', 'l', 'o'};
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_SET_CLIPBOARD_CHUNK,
+        .set_clipboard_chunk = {
+            .sequence = UINT64_C(0x0102030405060708),
+            .flags = SC_CLIPBOARD_CHUNK_FLAG_FIRST
+                   | SC_CLIPBOARD_CHUNK_FLAG_PASTE,
+            .data = data,
+            .len = sizeof(data),
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 17);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_SET_CLIPBOARD_CHUNK,
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // sequence
+        0x05, // flags
+        0x00, 0x05, // length
+        'h', 'e', 'l', 'l', 'o', // data
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
+static void test_serialize_set_viewport_size(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_SET_VIEWPORT_SIZE,
+        .set_viewport_size = {
+            .width = 1920,
+            .height = 1080,
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 5);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_SET_VIEWPORT_SIZE,
+        0x07, 0x80, // width
+        0x04, 0x38, // height
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
+static void test_serialize_capture_screenshot(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_CAPTURE_SCREENSHOT,
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 1);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_CAPTURE_SCREENSHOT,
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
+static void test_serialize_latency_probe(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_LATENCY_PROBE,
+        .latency_probe = {
+            .code = 0xA5,
+        },
+    };
+
+    uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t size = sc_control_msg_serialize(&msg, buf);
+    assert(size == 2);
+
+    const uint8_t expected[] = {
+        SC_CONTROL_MSG_TYPE_LATENCY_PROBE,
+        0xA5, // code
+    };
+    assert(!memcmp(buf, expected, sizeof(expected)));
+}
+
+static void test_coalesce_touch_move(void) {
+    struct sc_control_msg prev = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT,
+        .inject_touch_event = {
+            .action = AMOTION_EVENT_ACTION_MOVE,
+            .pointer_id = 1,
+            .position = {
+                .point = {.x = 100, .y = 200},
+                .screen_size = {.width = 1080, .height = 1920},
+            },
+            .pressure = 1.0f,
+            .buttons = AMOTION_EVENT_BUTTON_PRIMARY,
+            .timestamp = 1000,
+        },
+    };
+
+    struct sc_control_msg msg = prev;
+    msg.inject_touch_event.position.point.x = 110;
+    msg.inject_touch_event.position.point.y = 220;
+    msg.inject_touch_event.timestamp = 2000;
+
+    // The moves are merged into a batch
+    assert(sc_control_msg_coalesce(&prev, &msg));
+    assert(prev.type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_BATCH);
+    assert(prev.inject_touch_batch.pointer_id == 1);
+    assert(prev.inject_touch_batch.count == 2);
+    assert(prev.inject_touch_batch.samples[0].point.x == 100);
+    assert(prev.inject_touch_batch.samples[0].timestamp == 1000);
+    assert(prev.inject_touch_batch.samples[1].point.x == 110);
+    assert(prev.inject_touch_batch.samples[1].point.y == 220);
+    assert(prev.inject_touch_batch.samples[1].timestamp == 2000);
+
+    msg.inject_touch_event.position.point.x = 120;
+    msg.inject_touch_event.timestamp = 3000;
+    assert(sc_control_msg_coalesce(&prev, &msg));
+    assert(prev.inject_touch_batch.count == 3);
+    assert(prev.inject_touch_batch.samples[2].point.x == 120);
+
+    // Another pointer must not be merged
+    msg.inject_touch_event.pointer_id = 2;
+    assert(!sc_control_msg_coalesce(&prev, &msg));
+
+    // UP must not be merged
+    msg.inject_touch_event.pointer_id = 1;
+    msg.inject_touch_event.action = AMOTION_EVENT_ACTION_UP;
+    assert(!sc_control_msg_coalesce(&prev, &msg));
+
+    // The number of samples is limited
+    msg.inject_touch_event.action = AMOTION_EVENT_ACTION_MOVE;
+    while (prev.inject_touch_batch.count
+            < SC_CONTROL_MSG_TOUCH_BATCH_MAX_SAMPLES) {
+        assert(sc_control_msg_coalesce(&prev, &msg));
+    }
+    assert(!sc_control_msg_coalesce(&prev, &msg));
+
+    // A move must not be merged into a DOWN
+    prev = msg;
+    prev.inject_touch_event.action = AMOTION_EVENT_ACTION_DOWN;
+    assert(!sc_control_msg_coalesce(&prev, &msg));
+}
+
+static void test_coalesce_hover_move(void) {
+    struct sc_control_msg prev = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT,
+        .inject_touch_event = {
+            .action = AMOTION_EVENT_ACTION_HOVER_MOVE,
+            .pointer_id = SC_POINTER_ID_MOUSE,
+            .position = {
+                .point = {.x = 100, .y = 200},
+                .screen_size = {.width = 1080, .height = 1920},
+            },
+        },
+    };
+
+    struct sc_control_msg msg = prev;
+    msg.inject_touch_event.position.point.x = 110;
+    msg.inject_touch_event.position.point.y = 220;
+
+    // Only the last position is kept
+    assert(sc_control_msg_coalesce(&prev, &msg));
+    assert(prev.type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT);
+    assert(prev.inject_touch_event.position.point.x == 110);
+    assert(prev.inject_touch_event.position.point.y == 220);
+}
+
+static void test_coalesce_scroll(void) {
+    struct sc_control_msg prev = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT,
+        .inject_scroll_event = {
+            .position = {
+                .point = {.x = 260, .y = 1026},
+                .screen_size = {.width = 1080, .height = 1920},
+            },
+            .hscroll = 0,
+            .vscroll = 1,
+        },
+    };
+
+    struct sc_control_msg msg = prev;
+    msg.inject_scroll_event.hscroll = 0.5f;
+    msg.inject_scroll_event.vscroll = 2;
+
+    assert(sc_control_msg_coalesce(&prev, &msg));
+    assert(prev.inject_scroll_event.hscroll == 0.5f);
+    assert(prev.inject_scroll_event.vscroll == 3);
+
+    // The sum would exceed the range
+    msg.inject_scroll_event.vscroll = 14;
+    assert(!sc_control_msg_coalesce(&prev, &msg));
+
+    // Other messages are never merged
+    struct sc_control_msg other = {
+        .type = SC_CONTROL_MSG_TYPE_RESET_VIDEO,
+    };
+    assert(!sc_control_msg_coalesce(&prev, &other));
+}
+
+static void test_coalesce_uhid_mouse_input(void) {
+    struct sc_control_msg prev = {
+        .type = SC_CONTROL_MSG_TYPE_UHID_INPUT,
+        .uhid_input = {
+            .id = SC_HID_ID_MOUSE,
+            .size = 5,
+            .data = {0x01, 5, (uint8_t) -4, 0, 0},
+        },
+    };
+
+    struct sc_control_msg msg = prev;
+    msg.uhid_input.data[1] = 100;
+    msg.uhid_input.data[2] = (uint8_t) -10;
+
+    // The relative motions are summed
+    assert(sc_control_msg_coalesce(&prev, &msg));
+    assert(prev.uhid_input.data[0] == 0x01);
+    assert(prev.uhid_input.data[1] == 105);
+    assert((int8_t) prev.uhid_input.data[2] == -14);
+
+    // The sum would exceed the range
+    assert(!sc_control_msg_coalesce(&prev, &msg));
+
+    // A button change must not be merged
+    msg.uhid_input.data[0] = 0x00;
+    msg.uhid_input.data[1] = 1;
+    assert(!sc_control_msg_coalesce(&prev, &msg));
+
+    // Other HID devices are never merged
+    msg.uhid_input.data[0] = 0x01;
+    msg.uhid_input.id = SC_HID_ID_KEYBOARD;
+    assert(!sc_control_msg_coalesce(&prev, &msg));
+}
+
+static void test_coalesce_inject_text(void) {
+    struct sc_control_msg prev = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TEXT,
+        .inject_text = {
+            .text = strdup("hello"),
+        },
+    };
+    assert(prev.inject_text.text);
+
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TEXT,
+        .inject_text = {
+            .text = strdup(" world"),
+        },
+    };
+    assert(msg.inject_text.text);
+
+    // The text of msg is released once merged
+    assert(sc_control_msg_coalesce(&prev, &msg));
+    assert(!strcmp(prev.inject_text.text, "hello world"));
+
+    // The merged text must not exceed the maximum length
+    char long_text[SC_CONTROL_MSG_INJECT_TEXT_MAX_LENGTH];
+    memset(long_text, 'a', sizeof(long_text) - 1);
+    long_text[sizeof(long_text) - 1] = '\0';
+    msg.inject_text.text = strdup(long_text);
+    assert(msg.inject_text.text);
+    assert(!sc_control_msg_coalesce(&prev, &msg));
+    assert(!strcmp(prev.inject_text.text, "hello world"));
+
+    sc_control_msg_destroy(&msg);
+    sc_control_msg_destroy(&prev);
+}
+
 int main(int argc, char *argv[]) {
     (void) argc;
     (void) argv;
@@ -470,5 +843,18 @@ int main(int argc, char *argv[]) {
     test_serialize_open_hard_keyboard();
     test_serialize_start_app();
     test_serialize_reset_video();
+    test_serialize_video_feedback();
+    test_serialize_request_sync_frame();
+    test_serialize_inject_touch_batch();
+    test_serialize_input_probe();
+    test_serialize_set_clipboard_chunk();
+    test_serialize_set_viewport_size();
+    test_serialize_capture_screenshot();
+    test_serialize_latency_probe();
+    test_coalesce_touch_move();
+    test_coalesce_hover_move();
+    test_coalesce_scroll();
+    test_coalesce_uhid_mouse_input();
+    test_coalesce_inject_text();
     return 0;
 }
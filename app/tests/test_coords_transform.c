@@ -0,0 +1,145 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#include "coords_transform.h"
+
+// Exact rational a/b, b > 0
+struct rational {
+    int64_t num;
+    int64_t den;
+};
+
+static int64_t
+floor_div(int64_t a, int64_t b) {
+    assert(b > 0);
+    int64_t q = a / b;
+    if (a % b && a < 0) {
+        --q;
+    }
+    return q;
+}
+
+// c - r
+static struct rational
+sub_from(int64_t c, struct rational r) {
+    return (struct rational) {c * r.den - r.num, r.den};
+}
+
+// Reference implementation, with exact arithmetic
+static struct sc_point
+reference(int32_t rect_x, int32_t rect_y, int32_t rect_w, int32_t rect_h,
+          struct sc_size size, enum sc_orientation orientation, int32_t num,
+          int32_t den, int32_t x, int32_t y,
+          struct rational *rx, struct rational *ry) {
+    int64_t w = size.width;
+    int64_t h = size.height;
+    struct rational u = {((int64_t) x * num - (int64_t) rect_x * den) * w,
+                         (int64_t) den * rect_w};
+    struct rational v = {((int64_t) y * num - (int64_t) rect_y * den) * h,
+                         (int64_t) den * rect_h};
+
+    switch (orientation) {
+        case SC_ORIENTATION_0: *rx = u; *ry = v; break;
+        case SC_ORIENTATION_90: *rx = v; *ry = sub_from(w, u); break;
+        case SC_ORIENTATION_180:
+            *rx = sub_from(w, u); *ry = sub_from(h, v); break;
+        case SC_ORIENTATION_270: *rx = sub_from(h, v); *ry = u; break;
+        case SC_ORIENTATION_FLIP_0: *rx = sub_from(w, u); *ry = v; break;
+        case SC_ORIENTATION_FLIP_90:
+            *rx = sub_from(h, v); *ry = sub_from(w, u); break;
+        case SC_ORIENTATION_FLIP_180: *rx = u; *ry = sub_from(h, v); break;
+        default: *rx = v; *ry = u; break;
+    }
+
+    return (struct sc_point) {
+        .x = floor_div(rx->num, rx->den),
+        .y = floor_div(ry->num, ry->den),
+    };
+}
+
+// Whether the exact value is just below an integer (where the bias may round
+// it up)
+static bool
+near_next_integer(struct rational r) {
+    int64_t frac = r.num - floor_div(r.num, r.den) * r.den;
+    return (frac + 1) * 256 > r.den * 255;
+}
+
+static void
+check(int32_t rect_x, int32_t rect_y, int32_t rect_w, int32_t rect_h,
+      struct sc_size size, int32_t num, int32_t den) {
+    for (unsigned o = 0; o < 8; ++o) {
+        struct sc_coords_transform t;
+        sc_coords_transform_init(&t, rect_x, rect_y, rect_w, rect_h, size, o);
+        if (num != den) {
+            struct sc_size from = {den * 1000, den * 1000};
+            struct sc_size to = {num * 1000, num * 1000};
+            sc_coords_transform_scale_input(&t, from, to);
+        }
+
+        for (int32_t y = -3; y < 1500; y += 7) {
+            for (int32_t x = -3; x < 1500; x += 5) {
+                struct rational rx;
+                struct rational ry;
+                struct sc_point expected =
+                    reference(rect_x, rect_y, rect_w, rect_h, size, o, num,
+                              den, x, y, &rx, &ry);
+                struct sc_point p = sc_coords_transform_apply(&t, x, y);
+                assert(p.x == expected.x
+                        || (near_next_integer(rx) && p.x == expected.x + 1));
+                assert(p.y == expected.y
+                        || (near_next_integer(ry) && p.y == expected.y + 1));
+            }
+        }
+    }
+}
+
+static void test_coords_transform_exact(void) {
+    struct sc_coords_transform t;
+    struct sc_size size = {1080, 2400};
+
+    // Content displayed at half size, at (100, 50)
+    sc_coords_transform_init(&t, 100, 50, 540, 1200, size, SC_ORIENTATION_0);
+    struct sc_point p = sc_coords_transform_apply(&t, 100, 50);
+    assert(p.x == 0 && p.y == 0);
+    p = sc_coords_transform_apply(&t, 639, 1249);
+    assert(p.x == 1078 && p.y == 2398);
+    // Just outside
+    p = sc_coords_transform_apply(&t, 99, 49);
+    assert(p.x == -2 && p.y == -2);
+
+    // HiDPI 2x: window coordinates are half the drawable coordinates
+    sc_coords_transform_init(&t, 100, 50, 540, 1200, size, SC_ORIENTATION_0);
+    sc_coords_transform_scale_input(&t, (struct sc_size) {800, 600},
+                                    (struct sc_size) {1600, 1200});
+    p = sc_coords_transform_apply(&t, 50, 25);
+    assert(p.x == 0 && p.y == 0);
+
+    // 180°: the top-left pixel of the window is the bottom-right pixel of the
+    // frame
+    sc_coords_transform_init(&t, 0, 0, 1080, 2400, size, SC_ORIENTATION_180);
+    p = sc_coords_transform_apply(&t, 0, 0);
+    assert(p.x == 1080 && p.y == 2400);
+    p = sc_coords_transform_apply(&t, 1079, 2399);
+    assert(p.x == 1 && p.y == 1);
+}
+
+static void test_coords_transform_reference(void) {
+    check(0, 0, 1080, 2400, (struct sc_size) {1080, 2400}, 1, 1);
+    check(137, 21, 500, 1111, (struct sc_size) {1080, 2400}, 1, 1);
+    check(137, 21, 1111, 500, (struct sc_size) {2400, 1080}, 2, 1);
+    check(40, 40, 777, 333, (struct sc_size) {1920, 1080}, 3, 2);
+    check(3, 5, 1400, 700, (struct sc_size) {640, 360}, 1, 1);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_coords_transform_exact();
+    test_coords_transform_reference();
+
+    return 0;
+}
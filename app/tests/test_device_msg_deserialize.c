@@ -83,6 +83,112 @@ static void test_deserialize_uhid_output(void) {
     sc_device_msg_destroy(&msg);
 }
 
+static void test_deserialize_video_idle(void) {
+    const uint8_t input[] = {
+        DEVICE_MSG_TYPE_VIDEO_IDLE,
+        1, // idle
+    };
+
+    struct sc_device_msg msg;
+    ssize_t r = sc_device_msg_deserialize(input, sizeof(input), &msg);
+    assert(r == 2);
+
+    assert(msg.type == DEVICE_MSG_TYPE_VIDEO_IDLE);
+    assert(msg.video_idle.idle);
+
+    // incomplete
+    r = sc_device_msg_deserialize(input, 1, &msg);
+    assert(r == 0);
+}
+
+static void test_deserialize_input_ack(void) {
+    const uint8_t input[] = {
+        DEVICE_MSG_TYPE_INPUT_ACK,
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // sequence
+        0x00, 0x00, 0x04, 0xd2, // inject_us
+    };
+
+    struct sc_device_msg msg;
+    ssize_t r = sc_device_msg_deserialize(input, sizeof(input), &msg);
+    assert(r == 13);
+
+    assert(msg.type == DEVICE_MSG_TYPE_INPUT_ACK);
+    assert(msg.input_ack.sequence == UINT64_C(0x0102030405060708));
+    assert(msg.input_ack.inject_us == 1234);
+
+    // incomplete
+    r = sc_device_msg_deserialize(input, 12, &msg);
+    assert(r == 0);
+}
+
+static void test_deserialize_screenshot_chunk(void) {
+    const uint8_t input[] = {
+        DEVICE_MSG_TYPE_SCREENSHOT_CHUNK,
+        SC_SCREENSHOT_CHUNK_FLAG_FIRST | SC_SCREENSHOT_CHUNK_FLAG_LAST,
+        0x00, 0x00, 0x00, 0x04, // size
+        0x89, 'P', 'N', 'G', // data
+    };
+
+    struct sc_device_msg msg;
+    ssize_t r = sc_device_msg_deserialize(input, sizeof(input), &msg);
+    assert(r == 10);
+
+    assert(msg.type == DEVICE_MSG_TYPE_SCREENSHOT_CHUNK);
+    assert(msg.screenshot_chunk.flags == (SC_SCREENSHOT_CHUNK_FLAG_FIRST
+                                        | SC_SCREENSHOT_CHUNK_FLAG_LAST));
+    assert(msg.screenshot_chunk.size == 4);
+    assert(!memcmp(msg.screenshot_chunk.data, &input[6], 4));
+
+    sc_device_msg_destroy(&msg);
+
+    // incomplete
+    r = sc_device_msg_deserialize(input, 9, &msg);
+    assert(r == 0);
+
+    // too big for the receiver buffer
+    const uint8_t too_big[] = {
+        DEVICE_MSG_TYPE_SCREENSHOT_CHUNK,
+        SC_SCREENSHOT_CHUNK_FLAG_FIRST,
+        0x7f, 0x00, 0x00, 0x00, // size
+    };
+    r = sc_device_msg_deserialize(too_big, sizeof(too_big), &msg);
+    assert(r == -1);
+}
+
+static void test_deserialize_thermal_state(void) {
+    const uint8_t input[] = {
+        DEVICE_MSG_TYPE_THERMAL_STATE,
+        2, // status
+        1, // level
+        0x00, 0x55, // headroom
+    };
+
+    struct sc_device_msg msg;
+    ssize_t r = sc_device_msg_deserialize(input, sizeof(input), &msg);
+    assert(r == 5);
+
+    assert(msg.type == DEVICE_MSG_TYPE_THERMAL_STATE);
+    assert(msg.thermal_state.status == 2);
+    assert(msg.thermal_state.level == 1);
+    assert(msg.thermal_state.headroom == 85);
+
+    // unknown values
+    const uint8_t unknown[] = {
+        DEVICE_MSG_TYPE_THERMAL_STATE,
+        0xff, // status
+        0, // level
+        0xff, 0xff, // headroom
+    };
+    r = sc_device_msg_deserialize(unknown, sizeof(unknown), &msg);
+    assert(r == 5);
+    assert(msg.thermal_state.status == -1);
+    assert(msg.thermal_state.headroom == -1);
+
+    // incomplete
+    r = sc_device_msg_deserialize(input, 4, &msg);
+    assert(r == 0);
+}
+
 int main(int argc, char *argv[]) {
     (void) argc;
     (void) argv;
@@ -91,5 +197,9 @@ int main(int argc, char *argv[]) {
     test_deserialize_clipboard_big();
     test_deserialize_ack_set_clipboard();
     test_deserialize_uhid_output();
+    test_deserialize_video_idle();
+    test_deserialize_input_ack();
+    test_deserialize_screenshot_chunk();
+    test_deserialize_thermal_state();
     return 0;
 }
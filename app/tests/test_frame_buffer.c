@@ -0,0 +1,470 @@
+#include "common.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <libavutil/frame.h>
+
+#include "frame_buffer.h"
+#include "trait/frame_source.h"
+#include "util/thread.h"
+#include "util/tick.h"
+
+#define BENCH_FPS 240
+#define BENCH_FRAMES 120
+// Time spent by the consumer to "render" each frame
+#define BENCH_RENDER_TIME SC_TICK_FROM_MS(6)
+#define BENCH_FANOUT_FRAMES 500
+
+static AVFrame *
+new_sized_frame(int width, int height, int64_t pts) {
+    AVFrame *frame = av_frame_alloc();
+    assert(frame);
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    int r = av_frame_get_buffer(frame, 0);
+    assert(!r);
+    (void) r;
+    frame->pts = pts;
+    return frame;
+}
+
+static AVFrame *
+new_frame(int64_t pts) {
+    return new_sized_frame(16, 16, pts);
+}
+
+static void test_frame_buffer_push_consume(void) {
+    struct sc_frame_buffer fb;
+    bool ok = sc_frame_buffer_init(&fb);
+    assert(ok);
+    (void) ok;
+
+    AVFrame *frame = new_frame(1);
+
+    struct sc_shared_frame *sf = sc_shared_frame_new(frame);
+    assert(sf);
+    bool skipped;
+    sc_frame_buffer_push(&fb, sf, &skipped);
+    sc_shared_frame_release(sf);
+    assert(!skipped);
+    assert(sc_frame_buffer_get_skipped_count(&fb) == 0);
+
+    frame->pts = 2;
+    sf = sc_shared_frame_new(frame);
+    assert(sf);
+    sc_frame_buffer_push(&fb, sf, &skipped);
+    sc_shared_frame_release(sf);
+    assert(skipped);
+    assert(sc_frame_buffer_get_skipped_count(&fb) == 1);
+
+    frame->pts = 3;
+    sf = sc_shared_frame_new(frame);
+    assert(sf);
+    sc_frame_buffer_push(&fb, sf, &skipped);
+    sc_shared_frame_release(sf);
+    assert(skipped);
+    assert(sc_frame_buffer_get_skipped_count(&fb) == 2);
+
+    // the last frame is consumed
+    struct sc_shared_frame *dst = sc_frame_buffer_consume(&fb);
+    assert(dst->frame->pts == 3);
+    assert(sc_frame_buffer_get_skipped_count(&fb) == 0);
+    sc_shared_frame_release(dst);
+
+    frame->pts = 4;
+    sf = sc_shared_frame_new(frame);
+    assert(sf);
+    sc_frame_buffer_push(&fb, sf, &skipped);
+    sc_shared_frame_release(sf);
+    assert(!skipped);
+
+    dst = sc_frame_buffer_consume(&fb);
+    assert(dst->frame->pts == 4);
+    sc_shared_frame_release(dst);
+
+    // the frame buffer only holds references
+    frame->pts = 5;
+    sf = sc_shared_frame_new(frame);
+    assert(sf);
+    av_frame_free(&frame);
+    sc_frame_buffer_push(&fb, sf, &skipped);
+    sc_shared_frame_release(sf);
+    assert(!skipped);
+
+    dst = sc_frame_buffer_consume(&fb);
+    assert(dst->frame->pts == 5);
+    assert(dst->frame->data[0]);
+    sc_shared_frame_release(dst);
+
+    sc_frame_buffer_destroy(&fb);
+}
+
+static void test_frame_buffer_shared(void) {
+    struct sc_frame_buffer fb1;
+    struct sc_frame_buffer fb2;
+    bool ok = sc_frame_buffer_init(&fb1);
+    assert(ok);
+    ok = sc_frame_buffer_init(&fb2);
+    assert(ok);
+    (void) ok;
+
+    AVFrame *frame = new_frame(1);
+    struct sc_shared_frame *sf = sc_shared_frame_new(frame);
+    assert(sf);
+    av_frame_free(&frame);
+
+    sc_frame_buffer_push(&fb1, sf, NULL);
+    sc_frame_buffer_push(&fb2, sf, NULL);
+    assert(atomic_load(&sf->refs) == 3);
+    sc_shared_frame_release(sf);
+
+    // both frame buffers provide the same frame, without any copy
+    struct sc_shared_frame *dst1 = sc_frame_buffer_consume(&fb1);
+    struct sc_shared_frame *dst2 = sc_frame_buffer_consume(&fb2);
+    assert(dst1 == sf);
+    assert(dst2 == sf);
+    assert(atomic_load(&sf->refs) == 2);
+
+    sc_shared_frame_release(dst1);
+    assert(dst2->frame->pts == 1);
+    sc_shared_frame_release(dst2);
+
+    sc_frame_buffer_destroy(&fb1);
+    sc_frame_buffer_destroy(&fb2);
+}
+
+/**
+ * Reference implementation: the previous mutex-based frame buffer, for the
+ * benchmark.
+ */
+struct mutex_frame_buffer {
+    struct sc_shared_frame *pending_frame;
+    sc_mutex mutex;
+    bool pending_frame_consumed;
+};
+
+static void
+mutex_frame_buffer_init(struct mutex_frame_buffer *fb) {
+    fb->pending_frame = NULL;
+    bool ok = sc_mutex_init(&fb->mutex);
+    assert(ok);
+    (void) ok;
+    fb->pending_frame_consumed = true;
+}
+
+static void
+mutex_frame_buffer_destroy(struct mutex_frame_buffer *fb) {
+    sc_mutex_destroy(&fb->mutex);
+    if (fb->pending_frame) {
+        sc_shared_frame_release(fb->pending_frame);
+    }
+}
+
+static void
+mutex_frame_buffer_push(void *userdata, struct sc_shared_frame *frame,
+                        bool *skipped) {
+    struct mutex_frame_buffer *fb = userdata;
+
+    sc_shared_frame_acquire(frame);
+
+    sc_mutex_lock(&fb->mutex);
+    struct sc_shared_frame *prev = fb->pending_frame;
+    fb->pending_frame = frame;
+    *skipped = !fb->pending_frame_consumed;
+    fb->pending_frame_consumed = false;
+    sc_mutex_unlock(&fb->mutex);
+
+    if (prev) {
+        sc_shared_frame_release(prev);
+    }
+}
+
+static struct sc_shared_frame *
+mutex_frame_buffer_consume(void *userdata) {
+    struct mutex_frame_buffer *fb = userdata;
+
+    sc_mutex_lock(&fb->mutex);
+    assert(!fb->pending_frame_consumed);
+    fb->pending_frame_consumed = true;
+    struct sc_shared_frame *frame = fb->pending_frame;
+    fb->pending_frame = NULL;
+    sc_mutex_unlock(&fb->mutex);
+
+    return frame;
+}
+
+static void
+triple_frame_buffer_push(void *userdata, struct sc_shared_frame *frame,
+                         bool *skipped) {
+    sc_frame_buffer_push(userdata, frame, skipped);
+}
+
+static struct sc_shared_frame *
+triple_frame_buffer_consume(void *userdata) {
+    return sc_frame_buffer_consume(userdata);
+}
+
+struct bench {
+    void (*push)(void *fb, struct sc_shared_frame *frame, bool *skipped);
+    struct sc_shared_frame *(*consume)(void *fb);
+    void *fb;
+
+    // number of frames to consume (like SC_EVENT_NEW_FRAME events)
+    atomic_uint events;
+    atomic_bool producer_done;
+
+    unsigned consumed;
+    unsigned skipped;
+    sc_tick push_time_total;
+    sc_tick push_time_max;
+};
+
+static void
+sleep_until(sc_tick deadline) {
+    sc_mutex mutex;
+    sc_cond cond;
+    bool ok = sc_mutex_init(&mutex);
+    assert(ok);
+    ok = sc_cond_init(&cond);
+    assert(ok);
+    (void) ok;
+
+    sc_mutex_lock(&mutex);
+    while (sc_tick_now() < deadline) {
+        sc_cond_timedwait(&cond, &mutex, deadline);
+    }
+    sc_mutex_unlock(&mutex);
+
+    sc_cond_destroy(&cond);
+    sc_mutex_destroy(&mutex);
+}
+
+static int
+run_consumer(void *data) {
+    struct bench *bench = data;
+
+    int64_t last_pts = -1;
+    for (;;) {
+        bool done = atomic_load(&bench->producer_done);
+        if (!atomic_load(&bench->events)) {
+            if (done) {
+                break;
+            }
+            sleep_until(sc_tick_now() + SC_TICK_FROM_MS(1));
+            continue;
+        }
+
+        atomic_fetch_sub(&bench->events, 1);
+        struct sc_shared_frame *frame = bench->consume(bench->fb);
+        assert(frame->frame->pts > last_pts);
+        last_pts = frame->frame->pts;
+        sc_shared_frame_release(frame);
+        ++bench->consumed;
+
+        sleep_until(sc_tick_now() + BENCH_RENDER_TIME);
+    }
+
+    return 0;
+}
+
+static void
+run_bench(const char *name, struct bench *bench) {
+    atomic_init(&bench->events, 0);
+    atomic_init(&bench->producer_done, false);
+    bench->consumed = 0;
+    bench->skipped = 0;
+    bench->push_time_total = 0;
+    bench->push_time_max = 0;
+
+    sc_thread thread;
+    bool ok = sc_thread_create(&thread, run_consumer, "test-consumer", bench);
+    assert(ok);
+    (void) ok;
+
+    AVFrame *frame = new_frame(0);
+
+    sc_tick next = sc_tick_now();
+    for (int i = 0; i < BENCH_FRAMES; ++i) {
+        frame->pts = i;
+
+        struct sc_shared_frame *sf = sc_shared_frame_new(frame);
+        assert(sf);
+
+        bool skipped;
+        sc_tick start = sc_tick_now();
+        bench->push(bench->fb, sf, &skipped);
+        sc_tick duration = sc_tick_now() - start;
+        sc_shared_frame_release(sf);
+
+        bench->push_time_total += duration;
+        if (duration > bench->push_time_max) {
+            bench->push_time_max = duration;
+        }
+
+        if (skipped) {
+            ++bench->skipped;
+        } else {
+            atomic_fetch_add(&bench->events, 1);
+        }
+
+        next += SC_TICK_FROM_US(1000000 / BENCH_FPS);
+        sleep_until(next);
+    }
+
+    atomic_store(&bench->producer_done, true);
+    sc_thread_join(&thread, NULL);
+
+    av_frame_free(&frame);
+
+    assert(bench->consumed + bench->skipped == BENCH_FRAMES);
+
+    printf("%s: %u frames pushed at %d fps, %u consumed, push avg %" PRItick
+           "us, max %" PRItick "us\n", name, BENCH_FRAMES, BENCH_FPS,
+           bench->consumed, bench->push_time_total / BENCH_FRAMES,
+           bench->push_time_max);
+}
+
+static void test_frame_buffer_bench(void) {
+    struct mutex_frame_buffer mutex_fb;
+    mutex_frame_buffer_init(&mutex_fb);
+
+    struct bench bench = {
+        .push = mutex_frame_buffer_push,
+        .consume = mutex_frame_buffer_consume,
+        .fb = &mutex_fb,
+    };
+    run_bench("mutex", &bench);
+
+    mutex_frame_buffer_destroy(&mutex_fb);
+
+    struct sc_frame_buffer fb;
+    bool ok = sc_frame_buffer_init(&fb);
+    assert(ok);
+    (void) ok;
+
+    bench.push = triple_frame_buffer_push;
+    bench.consume = triple_frame_buffer_consume;
+    bench.fb = &fb;
+    run_bench("triple buffer", &bench);
+
+    sc_frame_buffer_destroy(&fb);
+}
+
+/**
+ * Frame sinks for the fan-out benchmark: each one keeps the last frame, either
+ * by creating its own AVFrame reference (like the frame buffers did before
+ * frames were shared) or by acquiring the shared frame.
+ */
+struct bench_sink {
+    struct sc_frame_sink frame_sink;
+    AVFrame *frame;
+    struct sc_frame_buffer fb;
+};
+
+#define DOWNCAST(SINK) container_of(SINK, struct bench_sink, frame_sink)
+
+static bool
+bench_sink_open(struct sc_frame_sink *sink, const AVCodecContext *ctx) {
+    (void) sink;
+    (void) ctx;
+    return true;
+}
+
+static void
+bench_sink_close(struct sc_frame_sink *sink) {
+    (void) sink;
+}
+
+static bool
+bench_sink_push(struct sc_frame_sink *sink, const AVFrame *frame) {
+    struct bench_sink *bs = DOWNCAST(sink);
+    av_frame_unref(bs->frame);
+    return !av_frame_ref(bs->frame, frame);
+}
+
+static bool
+bench_sink_push_shared(struct sc_frame_sink *sink,
+                       struct sc_shared_frame *frame) {
+    struct bench_sink *bs = DOWNCAST(sink);
+    bool skipped;
+    sc_frame_buffer_push(&bs->fb, frame, &skipped);
+    if (!skipped) {
+        // consume immediately, like a consumer never late
+        sc_shared_frame_release(sc_frame_buffer_consume(&bs->fb));
+    }
+    return true;
+}
+
+static sc_tick
+run_fanout_bench(const struct sc_frame_sink_ops *ops, unsigned sink_count,
+                 const AVFrame *frame) {
+    struct bench_sink sinks[SC_FRAME_SOURCE_MAX_SINKS];
+    struct sc_frame_source source;
+    sc_frame_source_init(&source);
+
+    for (unsigned i = 0; i < sink_count; ++i) {
+        sinks[i].frame_sink.ops = ops;
+        sinks[i].frame = av_frame_alloc();
+        assert(sinks[i].frame);
+        bool ok = sc_frame_buffer_init(&sinks[i].fb);
+        assert(ok);
+        (void) ok;
+        sc_frame_source_add_sink(&source, &sinks[i].frame_sink);
+    }
+
+    sc_tick start = sc_tick_now();
+    for (int i = 0; i < BENCH_FANOUT_FRAMES; ++i) {
+        bool ok = sc_frame_source_sinks_push(&source, frame);
+        assert(ok);
+        (void) ok;
+    }
+    sc_tick duration = sc_tick_now() - start;
+
+    for (unsigned i = 0; i < sink_count; ++i) {
+        av_frame_free(&sinks[i].frame);
+        sc_frame_buffer_destroy(&sinks[i].fb);
+    }
+
+    return SC_TICK_TO_NS(duration) / BENCH_FANOUT_FRAMES;
+}
+
+static void test_frame_source_fanout_bench(void) {
+    static const struct sc_frame_sink_ops ref_ops = {
+        .open = bench_sink_open,
+        .close = bench_sink_close,
+        .push = bench_sink_push,
+    };
+    static const struct sc_frame_sink_ops shared_ops = {
+        .open = bench_sink_open,
+        .close = bench_sink_close,
+        .push_shared = bench_sink_push_shared,
+    };
+
+    // 4K frame
+    AVFrame *frame = new_sized_frame(3840, 2160, 0);
+
+    for (unsigned n = 1; n <= SC_FRAME_SOURCE_MAX_SINKS; ++n) {
+        sc_tick ref = run_fanout_bench(&ref_ops, n, frame);
+        sc_tick shared = run_fanout_bench(&shared_ops, n, frame);
+        printf("fan-out 3840x2160 to %u sink(s): av_frame_ref per sink %"
+               PRItick "ns/frame, shared %" PRItick "ns/frame\n", n, ref,
+               shared);
+    }
+
+    av_frame_free(&frame);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_frame_buffer_push_consume();
+    test_frame_buffer_shared();
+    test_frame_buffer_bench();
+    test_frame_source_fanout_bench();
+
+    return 0;
+}
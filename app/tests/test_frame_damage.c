@@ -0,0 +1,118 @@
+#include "common.h"
+
+#include <assert.h>
+#include <string.h>
+#include <libavutil/frame.h>
+
+#include "frame_damage.h"
+
+static AVFrame *
+new_frame(int width, int height) {
+    AVFrame *frame = av_frame_alloc();
+    assert(frame);
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    int r = av_frame_get_buffer(frame, 0);
+    assert(!r);
+    (void) r;
+
+    for (int plane = 0; plane < 3; ++plane) {
+        int h = plane ? (height + 1) / 2 : height;
+        memset(frame->data[plane], 0x80, (size_t) frame->linesize[plane] * h);
+    }
+    return frame;
+}
+
+static AVFrame *
+clone_frame(const AVFrame *frame) {
+    AVFrame *clone = new_frame(frame->width, frame->height);
+    int r = av_frame_copy(clone, frame);
+    assert(r >= 0);
+    (void) r;
+    return clone;
+}
+
+static void test_first_frame(void) {
+    struct sc_frame_damage damage;
+    bool ok = sc_frame_damage_init(&damage);
+    assert(ok);
+    (void) ok;
+
+    AVFrame *frame = new_frame(200, 100);
+
+    // No previous frame
+    assert(sc_frame_damage_compute(&damage, frame) == -1);
+    sc_frame_damage_set_previous(&damage, frame);
+
+    AVFrame *same = clone_frame(frame);
+    assert(sc_frame_damage_compute(&damage, same) == 0);
+    // 200x100 on a 64-pixel grid
+    assert(damage.columns == 4);
+    assert(damage.rows == 2);
+
+    sc_frame_damage_reset(&damage);
+    assert(sc_frame_damage_compute(&damage, same) == -1);
+
+    av_frame_free(&same);
+    av_frame_free(&frame);
+    sc_frame_damage_destroy(&damage);
+}
+
+static void test_changed_tiles(void) {
+    struct sc_frame_damage damage;
+    bool ok = sc_frame_damage_init(&damage);
+    assert(ok);
+    (void) ok;
+
+    AVFrame *frame = new_frame(200, 100);
+    sc_frame_damage_set_previous(&damage, frame);
+
+    // Change a luma pixel in the tile (1, 0)
+    AVFrame *next = clone_frame(frame);
+    next->data[0][10 * next->linesize[0] + 70] = 0;
+    assert(sc_frame_damage_compute(&damage, next) == 1);
+    assert(damage.tiles[1]);
+    assert(!damage.tiles[0]);
+    sc_frame_damage_set_previous(&damage, next);
+
+    // Change a chroma pixel in the last (partial) tile (3, 1)
+    AVFrame *next2 = clone_frame(next);
+    next2->data[2][49 * next2->linesize[2] + 99] = 0;
+    assert(sc_frame_damage_compute(&damage, next2) == 1);
+    assert(damage.tiles[1 * 4 + 3]);
+    assert(!damage.tiles[1]);
+
+    av_frame_free(&next2);
+    av_frame_free(&next);
+    av_frame_free(&frame);
+    sc_frame_damage_destroy(&damage);
+}
+
+static void test_size_changed(void) {
+    struct sc_frame_damage damage;
+    bool ok = sc_frame_damage_init(&damage);
+    assert(ok);
+    (void) ok;
+
+    AVFrame *frame = new_frame(200, 100);
+    sc_frame_damage_set_previous(&damage, frame);
+
+    AVFrame *rotated = new_frame(100, 200);
+    assert(sc_frame_damage_compute(&damage, rotated) == -1);
+
+    av_frame_free(&rotated);
+    av_frame_free(&frame);
+    sc_frame_damage_destroy(&damage);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_first_frame();
+    test_changed_tiles();
+    test_size_changed();
+
+    return 0;
+}
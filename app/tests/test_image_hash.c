@@ -0,0 +1,109 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/image_hash.h"
+
+#define WIDTH 128
+#define HEIGHT 96
+#define PITCH (WIDTH * 4 + 16) // with padding
+
+static uint8_t *
+create_image(uint8_t value) {
+    uint8_t *pixels = malloc(PITCH * HEIGHT);
+    assert(pixels);
+    memset(pixels, value, PITCH * HEIGHT);
+    return pixels;
+}
+
+static void
+set_pixel(uint8_t *pixels, unsigned x, unsigned y, uint8_t value) {
+    uint8_t *p = pixels + y * PITCH + x * 4;
+    p[0] = value;
+    p[1] = value;
+    p[2] = value;
+}
+
+static void test_image_hash_same(void) {
+    uint8_t *a = create_image(0x80);
+    uint8_t *b = create_image(0x80);
+
+    // The padding is ignored
+    memset(b + WIDTH * 4, 0x00, PITCH - WIDTH * 4);
+
+    assert(sc_image_hash_rgba8888(a, PITCH, WIDTH, HEIGHT)
+            == sc_image_hash_rgba8888(b, PITCH, WIDTH, HEIGHT));
+
+    free(a);
+    free(b);
+}
+
+static void test_image_hash_noise(void) {
+    uint8_t *a = create_image(0x80);
+    uint8_t *b = create_image(0x80);
+
+    // A slight change of a single pixel does not change the average luma of
+    // its cell significantly
+    set_pixel(b, 10, 10, 0x82);
+
+    assert(sc_image_hash_rgba8888(a, PITCH, WIDTH, HEIGHT)
+            == sc_image_hash_rgba8888(b, PITCH, WIDTH, HEIGHT));
+
+    free(a);
+    free(b);
+}
+
+static void test_image_hash_different(void) {
+    uint8_t *a = create_image(0x80);
+    uint8_t *b = create_image(0x80);
+
+    // A visible change in a cell (4x3 pixels here)
+    for (unsigned y = 30; y < 33; ++y) {
+        for (unsigned x = 60; x < 64; ++x) {
+            set_pixel(b, x, y, 0xFF);
+        }
+    }
+
+    assert(sc_image_hash_rgba8888(a, PITCH, WIDTH, HEIGHT)
+            != sc_image_hash_rgba8888(b, PITCH, WIDTH, HEIGHT));
+
+    // Uniform images of different colors
+    uint8_t *c = create_image(0x00);
+    assert(sc_image_hash_rgba8888(a, PITCH, WIDTH, HEIGHT)
+            != sc_image_hash_rgba8888(c, PITCH, WIDTH, HEIGHT));
+
+    // Same content, different size
+    assert(sc_image_hash_rgba8888(a, PITCH, WIDTH, HEIGHT)
+            != sc_image_hash_rgba8888(a, PITCH, WIDTH, HEIGHT - 1));
+
+    free(a);
+    free(b);
+    free(c);
+}
+
+static void test_image_hash_small(void) {
+    // Smaller than the grid
+    uint8_t *a = create_image(0x80);
+    uint64_t hash = sc_image_hash_rgba8888(a, PITCH, 3, 2);
+    assert(hash == sc_image_hash_rgba8888(a, PITCH, 3, 2));
+
+    set_pixel(a, 1, 1, 0x00);
+    assert(hash != sc_image_hash_rgba8888(a, PITCH, 3, 2));
+
+    free(a);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_image_hash_same();
+    test_image_hash_noise();
+    test_image_hash_different();
+    test_image_hash_small();
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "common.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "image_variant.h"
+
+static void test_image_format_parse(void) {
+    enum sc_image_format format;
+
+    assert(sc_image_format_parse("png", 3, &format));
+    assert(format == SC_IMAGE_FORMAT_PNG);
+
+    assert(sc_image_format_parse("jpeg", 4, &format));
+    assert(format == SC_IMAGE_FORMAT_JPEG);
+
+    assert(sc_image_format_parse("jpg", 3, &format));
+    assert(format == SC_IMAGE_FORMAT_JPEG);
+
+    // Only the first len chars are considered
+    assert(sc_image_format_parse("webp&scale=0.5", 4, &format));
+    assert(format == SC_IMAGE_FORMAT_WEBP);
+
+    assert(!sc_image_format_parse("gif", 3, &format));
+    assert(!sc_image_format_parse("pn", 2, &format));
+    assert(!sc_image_format_parse("", 0, &format));
+
+    assert(!strcmp(sc_image_format_get_name(SC_IMAGE_FORMAT_JPEG), "jpeg"));
+    assert(!strcmp(sc_image_format_get_mime_type(SC_IMAGE_FORMAT_WEBP),
+                   "image/webp"));
+}
+
+static void test_image_variant_compute_size(void) {
+    uint16_t w;
+    uint16_t h;
+
+    // No scaling
+    sc_image_variant_compute_size(1080, 2400, 0, 0, &w, &h);
+    assert(w == 1080 && h == 2400);
+
+    sc_image_variant_compute_size(1080, 2400, 0.5, 0, &w, &h);
+    assert(w == 540 && h == 1200);
+
+    sc_image_variant_compute_size(1080, 2400, 0, 360, &w, &h);
+    assert(w == 360 && h == 800);
+
+    // The smallest wins
+    sc_image_variant_compute_size(1080, 2400, 0.5, 360, &w, &h);
+    assert(w == 360 && h == 800);
+    sc_image_variant_compute_size(1080, 2400, 0.25, 360, &w, &h);
+    assert(w == 270 && h == 600);
+
+    // Rounded
+    sc_image_variant_compute_size(1080, 2340, 0, 100, &w, &h);
+    assert(w == 100 && h == 217);
+
+    // Never upscaled
+    sc_image_variant_compute_size(1080, 2400, 1, 4000, &w, &h);
+    assert(w == 1080 && h == 2400);
+
+    // Never empty
+    sc_image_variant_compute_size(2400, 10, 0.01, 0, &w, &h);
+    assert(w == 24 && h == 1);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_image_format_parse();
+    test_image_variant_compute_size();
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include "common.h"
+
+#include <assert.h>
+
+#include "util/log.h"
+
+static void test_log_ratelimit_burst(void) {
+    struct sc_log_ratelimit rl = {0};
+    unsigned suppressed;
+
+    for (int i = 0; i < SC_LOG_RATELIMIT_BURST; ++i) {
+        assert(sc_log_ratelimit_acquire(&rl, &suppressed));
+        assert(!suppressed);
+    }
+
+    for (int i = 0; i < 240; ++i) {
+        assert(!sc_log_ratelimit_acquire(&rl, &suppressed));
+        assert(!suppressed);
+    }
+    assert(rl.suppressed == 240);
+}
+
+static void test_log_ratelimit_next_window(void) {
+    struct sc_log_ratelimit rl = {0};
+    unsigned suppressed;
+
+    for (int i = 0; i < SC_LOG_RATELIMIT_BURST + 3; ++i) {
+        sc_log_ratelimit_acquire(&rl, &suppressed);
+    }
+
+    // simulate the end of the window
+    rl.window_start -= SC_LOG_RATELIMIT_INTERVAL_MS;
+
+    // the suppressed messages are reported with the next one
+    assert(sc_log_ratelimit_acquire(&rl, &suppressed));
+    assert(suppressed == 3);
+
+    assert(sc_log_ratelimit_acquire(&rl, &suppressed));
+    assert(!suppressed);
+    assert(rl.logged == 2);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_log_ratelimit_burst();
+    test_log_ratelimit_next_window();
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "common.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "mux.h"
+
+static void test_mux_buffer_push_pop(void) {
+    struct sc_mux_buffer buf;
+    sc_mux_buffer_init(&buf);
+
+    bool ok = sc_mux_buffer_push(&buf, (const uint8_t *) "abcdef", 6);
+    assert(ok);
+    ok = sc_mux_buffer_push(&buf, (const uint8_t *) "ghi", 3);
+    assert(ok);
+    assert(buf.size == 9);
+
+    uint8_t data[16];
+    size_t r = sc_mux_buffer_pop(&buf, data, 4);
+    assert(r == 4);
+    assert(!memcmp(data, "abcd", 4));
+    assert(buf.size == 5);
+
+    // Only the available data is consumed
+    r = sc_mux_buffer_pop(&buf, data, sizeof(data));
+    assert(r == 5);
+    assert(!memcmp(data, "efghi", 5));
+    assert(!buf.size);
+    assert(!buf.head);
+
+    r = sc_mux_buffer_pop(&buf, data, sizeof(data));
+    assert(!r);
+
+    sc_mux_buffer_destroy(&buf);
+}
+
+static void test_mux_buffer_grow(void) {
+    struct sc_mux_buffer buf;
+    sc_mux_buffer_init(&buf);
+
+    static uint8_t chunk[SC_MUX_MAX_CHUNK_SIZE];
+    for (size_t i = 0; i < sizeof(chunk); ++i) {
+        chunk[i] = i % 251;
+    }
+
+    bool ok = sc_mux_buffer_push(&buf, chunk, sizeof(chunk));
+    assert(ok);
+    assert(buf.cap == SC_MUX_MAX_CHUNK_SIZE);
+
+    // Leave some unread data at a non-zero offset
+    uint8_t data[SC_MUX_MAX_CHUNK_SIZE];
+    size_t r = sc_mux_buffer_pop(&buf, data, 1000);
+    assert(r == 1000);
+    assert(buf.head == 1000);
+
+    // Does not fit after the unread data, the unread data must be moved
+    ok = sc_mux_buffer_push(&buf, chunk, 500);
+    assert(ok);
+    assert(buf.head == 0);
+    assert(buf.cap == SC_MUX_MAX_CHUNK_SIZE);
+
+    // Does not fit at all, the buffer must grow
+    ok = sc_mux_buffer_push(&buf, chunk, sizeof(chunk));
+    assert(ok);
+    assert(buf.cap == 2 * SC_MUX_MAX_CHUNK_SIZE);
+    assert(buf.size == sizeof(chunk) - 1000 + 500 + sizeof(chunk));
+
+    r = sc_mux_buffer_pop(&buf, data, sizeof(chunk) - 1000);
+    assert(r == sizeof(chunk) - 1000);
+    assert(!memcmp(data, chunk + 1000, r));
+
+    r = sc_mux_buffer_pop(&buf, data, 500);
+    assert(r == 500);
+    assert(!memcmp(data, chunk, 500));
+
+    r = sc_mux_buffer_pop(&buf, data, sizeof(data));
+    assert(r == sizeof(chunk));
+    assert(!memcmp(data, chunk, r));
+    assert(!buf.size);
+
+    sc_mux_buffer_destroy(&buf);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_mux_buffer_push_pop();
+    test_mux_buffer_grow();
+
+    return 0;
+}
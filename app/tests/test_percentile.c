@@ -0,0 +1,66 @@
+#include "common.h"
+
+#include <assert.h>
+
+#include "util/percentile.h"
+
+static void test_percentile_single(void) {
+    struct sc_percentile_window window;
+    sc_percentile_window_init(&window);
+
+    sc_percentile_window_push(&window, 42);
+
+    assert(sc_percentile_window_get(&window, 0) == 42);
+    assert(sc_percentile_window_get(&window, 50) == 42);
+    assert(sc_percentile_window_get(&window, 100) == 42);
+}
+
+static void test_percentile_ranks(void) {
+    struct sc_percentile_window window;
+    sc_percentile_window_init(&window);
+
+    // push 100..1 in reverse order
+    for (int i = 100; i > 0; --i) {
+        sc_percentile_window_push(&window, i);
+    }
+
+    assert(sc_percentile_window_get(&window, 0) == 1);
+    assert(sc_percentile_window_get(&window, 1) == 1);
+    assert(sc_percentile_window_get(&window, 50) == 50);
+    assert(sc_percentile_window_get(&window, 95) == 95);
+    assert(sc_percentile_window_get(&window, 99) == 99);
+    assert(sc_percentile_window_get(&window, 100) == 100);
+}
+
+static void test_percentile_rolling(void) {
+    struct sc_percentile_window window;
+    sc_percentile_window_init(&window);
+
+    // large values, then enough small values to evict all of them
+    for (int i = 0; i < SC_PERCENTILE_WINDOW_SIZE; ++i) {
+        sc_percentile_window_push(&window, 1000);
+    }
+    assert(sc_percentile_window_get(&window, 50) == 1000);
+
+    for (int i = 0; i < SC_PERCENTILE_WINDOW_SIZE - 1; ++i) {
+        sc_percentile_window_push(&window, 1);
+    }
+    assert(window.count == SC_PERCENTILE_WINDOW_SIZE);
+    assert(sc_percentile_window_get(&window, 99) == 1);
+    // one large value remains
+    assert(sc_percentile_window_get(&window, 100) == 1000);
+
+    sc_percentile_window_push(&window, 1);
+    assert(sc_percentile_window_get(&window, 100) == 1);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_percentile_single();
+    test_percentile_ranks();
+    test_percentile_rolling();
+
+    return 0;
+}
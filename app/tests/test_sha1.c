@@ -0,0 +1,60 @@
+#include "common.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "util/sha1.h"
+
+static void assert_sha1(const char *data, const uint8_t expected[20]) {
+    uint8_t digest[SC_SHA1_DIGEST_SIZE];
+    sc_sha1(data, strlen(data), digest);
+    assert(!memcmp(digest, expected, SC_SHA1_DIGEST_SIZE));
+}
+
+static void test_sha1_empty(void) {
+    static const uint8_t expected[] = {
+        0xda, 0x39, 0xa3, 0xee, 0x5e, 0x6b, 0x4b, 0x0d, 0x32, 0x55,
+        0xbf, 0xef, 0x95, 0x60, 0x18, 0x90, 0xaf, 0xd8, 0x07, 0x09,
+    };
+    assert_sha1("", expected);
+}
+
+static void test_sha1_abc(void) {
+    static const uint8_t expected[] = {
+        0xa9, 0x99, 0x3e, 0x36, 0x47, 0x06, 0x81, 0x6a, 0xba, 0x3e,
+        0x25, 0x71, 0x78, 0x50, 0xc2, 0x6c, 0x9c, 0xd0, 0xd8, 0x9d,
+    };
+    assert_sha1("abc", expected);
+}
+
+static void test_sha1_two_blocks(void) {
+    // 56 bytes: the padding does not fit in the first block
+    static const uint8_t expected[] = {
+        0x84, 0x98, 0x3e, 0x44, 0x1c, 0x3b, 0xd2, 0x6e, 0xba, 0xae,
+        0x4a, 0xa1, 0xf9, 0x51, 0x29, 0xe5, 0xe5, 0x46, 0x70, 0xf1,
+    };
+    assert_sha1("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+                expected);
+}
+
+static void test_sha1_websocket_key(void) {
+    // Example of RFC 6455 (its base64 is "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=")
+    static const uint8_t expected[] = {
+        0xb3, 0x7a, 0x4f, 0x2c, 0xc0, 0x62, 0x4f, 0x16, 0x90, 0xf6,
+        0x46, 0x06, 0xcf, 0x38, 0x59, 0x45, 0xb2, 0xbe, 0xc4, 0xea,
+    };
+    assert_sha1("dGhlIHNhbXBsZSBub25jZQ==258EAFA5-E914-47DA-95CA-C5AB0DC85B11",
+                expected);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_sha1_empty();
+    test_sha1_abc();
+    test_sha1_two_blocks();
+    test_sha1_websocket_key();
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include "common.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "util/sha256.h"
+
+static void sha256_hex(const void *data, size_t len,
+                       char hex[SC_SHA256_HEX_SIZE]) {
+    struct sc_sha256 sha;
+    sc_sha256_init(&sha);
+    sc_sha256_update(&sha, data, len);
+
+    uint8_t digest[SC_SHA256_DIGEST_SIZE];
+    sc_sha256_final(&sha, digest);
+    sc_sha256_to_hex(digest, hex);
+}
+
+static void test_sha256_empty(void) {
+    char hex[SC_SHA256_HEX_SIZE];
+    sha256_hex("", 0, hex);
+    assert(!strcmp(hex, "e3b0c44298fc1c149afbf4c8996fb924"
+                        "27ae41e4649b934ca495991b7852b855"));
+}
+
+static void test_sha256_abc(void) {
+    char hex[SC_SHA256_HEX_SIZE];
+    sha256_hex("abc", 3, hex);
+    assert(!strcmp(hex, "ba7816bf8f01cfea414140de5dae2223"
+                        "b00361a396177a9cb410ff61f20015ad"));
+}
+
+static void test_sha256_two_blocks(void) {
+    // 56 bytes: the length does not fit in the first block
+    const char *s = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    char hex[SC_SHA256_HEX_SIZE];
+    sha256_hex(s, strlen(s), hex);
+    assert(!strcmp(hex, "248d6a61d20638b8e5c026930c3e6039"
+                        "a33ce45964ff2167f6ecedd419db06c1"));
+}
+
+static void test_sha256_incremental(void) {
+    // One million 'a', fed in chunks of various sizes
+    char chunk[997];
+    memset(chunk, 'a', sizeof(chunk));
+
+    struct sc_sha256 sha;
+    sc_sha256_init(&sha);
+
+    size_t remaining = 1000000;
+    size_t size = 1;
+    while (remaining) {
+        size_t n = size < remaining ? size : remaining;
+        sc_sha256_update(&sha, chunk, n);
+        remaining -= n;
+        size = size * 7 % sizeof(chunk) + 1;
+    }
+
+    uint8_t digest[SC_SHA256_DIGEST_SIZE];
+    sc_sha256_final(&sha, digest);
+
+    char hex[SC_SHA256_HEX_SIZE];
+    sc_sha256_to_hex(digest, hex);
+    assert(!strcmp(hex, "cdc76e5c9914fb9281a1c7e284d73e67"
+                        "f1809a48a497200e046d39ccc7112cd0"));
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_sha256_empty();
+    test_sha256_abc();
+    test_sha256_two_blocks();
+    test_sha256_incremental();
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "util/spill_log.h"
+
+#define HEADER_SIZE 8
+
+static void
+append(struct sc_spill_log *log, uint8_t id, const char *payload) {
+    uint8_t header[HEADER_SIZE];
+    memset(header, id, sizeof(header));
+
+    bool ok = sc_spill_log_append(log, header, sizeof(header),
+                                  (const uint8_t *) payload, strlen(payload));
+    assert(ok);
+}
+
+static void
+check_next(struct sc_spill_log *log, uint8_t id, const char *payload) {
+    uint8_t header[HEADER_SIZE];
+    uint32_t size;
+    bool ok = sc_spill_log_read_header(log, header, sizeof(header), &size);
+    assert(ok);
+
+    for (size_t i = 0; i < sizeof(header); ++i) {
+        assert(header[i] == id);
+    }
+    assert(size == strlen(payload));
+
+    char data[64];
+    assert(size < sizeof(data));
+    ok = sc_spill_log_read_payload(log, (uint8_t *) data);
+    assert(ok);
+    data[size] = '\0';
+    assert(!strcmp(data, payload));
+}
+
+static void test_spill_log_fifo(void) {
+    struct sc_spill_log log;
+    bool ok = sc_spill_log_init(&log);
+    assert(ok);
+
+    assert(sc_spill_log_is_empty(&log));
+
+    append(&log, 1, "hello");
+    append(&log, 2, "");
+    append(&log, 3, "world");
+    assert(!sc_spill_log_is_empty(&log));
+
+    check_next(&log, 1, "hello");
+    check_next(&log, 2, "");
+
+    // Interleave writes and reads
+    append(&log, 4, "scrcpy");
+    check_next(&log, 3, "world");
+    check_next(&log, 4, "scrcpy");
+    assert(sc_spill_log_is_empty(&log));
+
+    // The file space is reused once empty
+    assert(!log.write_offset);
+    assert(!log.read_offset);
+
+    append(&log, 5, "again");
+    check_next(&log, 5, "again");
+    assert(sc_spill_log_is_empty(&log));
+
+    sc_spill_log_destroy(&log);
+}
+
+static void test_spill_log_append_between_header_and_payload(void) {
+    struct sc_spill_log log;
+    bool ok = sc_spill_log_init(&log);
+    assert(ok);
+
+    append(&log, 1, "first");
+
+    uint8_t header[HEADER_SIZE];
+    uint32_t size;
+    ok = sc_spill_log_read_header(&log, header, sizeof(header), &size);
+    assert(ok);
+    assert(size == 5);
+
+    append(&log, 2, "second");
+
+    char data[8];
+    ok = sc_spill_log_read_payload(&log, (uint8_t *) data);
+    assert(ok);
+    assert(!memcmp(data, "first", 5));
+
+    check_next(&log, 2, "second");
+    assert(sc_spill_log_is_empty(&log));
+
+    sc_spill_log_destroy(&log);
+}
+
+static void test_spill_log_clear(void) {
+    struct sc_spill_log log;
+    bool ok = sc_spill_log_init(&log);
+    assert(ok);
+
+    append(&log, 1, "a");
+    append(&log, 2, "b");
+    sc_spill_log_clear(&log);
+    assert(sc_spill_log_is_empty(&log));
+
+    append(&log, 3, "c");
+    check_next(&log, 3, "c");
+
+    sc_spill_log_destroy(&log);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_spill_log_fifo();
+    test_spill_log_append_between_header_and_payload();
+    test_spill_log_clear();
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include "common.h"
+
+#include <assert.h>
+
+#include "stats.h"
+
+static void test_stats_rates(void) {
+    struct sc_stats_sampler sampler;
+    sc_stats_sampler_init(&sampler, SC_TICK_FROM_SEC(10));
+
+    sc_stats_add(SC_STAT_VIDEO_PACKETS, 30);
+    sc_stats_add(SC_STAT_VIDEO_BYTES, 500000);
+    sc_stats_set(SC_STAT_CONTROLLER_QUEUE, 3);
+
+    // half a second later
+    struct sc_stats_sample sample;
+    sc_stats_sampler_sample(&sampler, SC_TICK_FROM_MS(10500), &sample);
+
+    assert(sample.values[SC_STAT_VIDEO_PACKETS] == 60);
+    assert(sample.values[SC_STAT_VIDEO_BYTES] == 1000000);
+    assert(sample.values[SC_STAT_FRAMES_DECODED] == 0);
+    assert(sample.values[SC_STAT_CONTROLLER_QUEUE] == 3);
+
+    // the counters are only reported since the previous sample
+    sc_stats_add(SC_STAT_VIDEO_PACKETS, 60);
+    sc_stats_set(SC_STAT_CONTROLLER_QUEUE, 0);
+    sc_stats_sampler_sample(&sampler, SC_TICK_FROM_MS(11500), &sample);
+
+    assert(sample.values[SC_STAT_VIDEO_PACKETS] == 60);
+    assert(sample.values[SC_STAT_VIDEO_BYTES] == 0);
+    assert(sample.values[SC_STAT_CONTROLLER_QUEUE] == 0);
+}
+
+static void test_stats_wrap(void) {
+    struct sc_stats_sampler sampler;
+    sc_stats_sampler_init(&sampler, 0);
+
+    // make the counter wrap
+    sc_stats_add(SC_STAT_AUDIO_BYTES, UINT32_MAX - 10);
+    struct sc_stats_sample sample;
+    sc_stats_sampler_sample(&sampler, SC_TICK_FROM_SEC(1000), &sample);
+
+    sc_stats_add(SC_STAT_AUDIO_BYTES, 100);
+    sc_stats_sampler_sample(&sampler, SC_TICK_FROM_SEC(1001), &sample);
+    assert(sample.values[SC_STAT_AUDIO_BYTES] == 100);
+}
+
+static void test_stats_add_gauge(void) {
+    struct sc_stats_sampler sampler;
+    sc_stats_sampler_init(&sampler, 0);
+
+    // two components share the same gauge
+    sc_stats_add_gauge(SC_STAT_DELAY_BUFFER_BYTES, 1000);
+    sc_stats_add_gauge(SC_STAT_DELAY_BUFFER_BYTES, 500);
+    struct sc_stats_sample sample;
+    sc_stats_sampler_sample(&sampler, SC_TICK_FROM_SEC(1), &sample);
+    assert(sample.values[SC_STAT_DELAY_BUFFER_BYTES] == 1500);
+
+    sc_stats_add_gauge(SC_STAT_DELAY_BUFFER_BYTES, -1000);
+    sc_stats_sampler_sample(&sampler, SC_TICK_FROM_SEC(2), &sample);
+    assert(sample.values[SC_STAT_DELAY_BUFFER_BYTES] == 500);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_stats_rates();
+    test_stats_wrap();
+    test_stats_add_gauge();
+
+    return 0;
+}
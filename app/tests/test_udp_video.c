@@ -0,0 +1,136 @@
+#include "common.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "udp_video.h"
+#include "util/binary.h"
+
+static enum sc_udp_video_result
+push_fragment(struct sc_udp_video *udp, uint32_t seq, uint16_t index,
+              uint16_t count, const char *payload) {
+    uint8_t datagram[64];
+    size_t len = strlen(payload);
+    assert(SC_UDP_VIDEO_HEADER_SIZE + len <= sizeof(datagram));
+
+    sc_write32be(datagram, seq);
+    sc_write16be(&datagram[4], index);
+    sc_write16be(&datagram[6], count);
+    memcpy(&datagram[SC_UDP_VIDEO_HEADER_SIZE], payload, len);
+
+    return sc_udp_video_push(udp, datagram, SC_UDP_VIDEO_HEADER_SIZE + len);
+}
+
+static bool
+packet_equals(struct sc_udp_video *udp, const char *s) {
+    return udp->size == strlen(s) && !memcmp(udp->data, s, udp->size);
+}
+
+static void test_udp_video_reassemble(void) {
+    struct sc_udp_video udp;
+    bool ok = sc_udp_video_init(&udp, SC_SOCKET_NONE, 42);
+    assert(ok);
+
+    enum sc_udp_video_result r = push_fragment(&udp, 0, 0, 1, "single");
+    assert(r == SC_UDP_VIDEO_PACKET);
+    assert(packet_equals(&udp, "single"));
+    assert(!udp.lost);
+
+    r = push_fragment(&udp, 1, 0, 3, "abc");
+    assert(r == SC_UDP_VIDEO_INCOMPLETE);
+    r = push_fragment(&udp, 1, 1, 3, "def");
+    assert(r == SC_UDP_VIDEO_INCOMPLETE);
+    r = push_fragment(&udp, 1, 2, 3, "gh");
+    assert(r == SC_UDP_VIDEO_PACKET);
+    assert(packet_equals(&udp, "abcdefgh"));
+    assert(!udp.lost);
+
+    sc_udp_video_destroy(&udp);
+}
+
+static void test_udp_video_missing_packet(void) {
+    struct sc_udp_video udp;
+    bool ok = sc_udp_video_init(&udp, SC_SOCKET_NONE, 42);
+    assert(ok);
+
+    enum sc_udp_video_result r = push_fragment(&udp, 0, 0, 1, "first");
+    assert(r == SC_UDP_VIDEO_PACKET);
+
+    // packet 1 is never received
+    r = push_fragment(&udp, 2, 0, 1, "third");
+    assert(r == SC_UDP_VIDEO_PACKET);
+    assert(packet_equals(&udp, "third"));
+    assert(udp.lost);
+
+    sc_udp_video_destroy(&udp);
+}
+
+static void test_udp_video_missing_fragment(void) {
+    struct sc_udp_video udp;
+    bool ok = sc_udp_video_init(&udp, SC_SOCKET_NONE, 42);
+    assert(ok);
+
+    // the middle fragment is lost
+    enum sc_udp_video_result r = push_fragment(&udp, 0, 0, 3, "abc");
+    assert(r == SC_UDP_VIDEO_INCOMPLETE);
+    r = push_fragment(&udp, 0, 2, 3, "gh");
+    assert(r == SC_UDP_VIDEO_INCOMPLETE);
+    assert(udp.lost);
+
+    // the last fragment is lost
+    udp.lost = false;
+    r = push_fragment(&udp, 1, 0, 2, "ijk");
+    assert(r == SC_UDP_VIDEO_INCOMPLETE);
+    r = push_fragment(&udp, 2, 0, 1, "next");
+    assert(r == SC_UDP_VIDEO_PACKET);
+    assert(packet_equals(&udp, "next"));
+    assert(udp.lost);
+
+    // a late fragment of a previous packet is ignored
+    udp.lost = false;
+    r = push_fragment(&udp, 1, 1, 2, "lmn");
+    assert(r == SC_UDP_VIDEO_INCOMPLETE);
+    assert(!udp.lost);
+
+    r = push_fragment(&udp, 3, 0, 1, "last");
+    assert(r == SC_UDP_VIDEO_PACKET);
+    assert(packet_equals(&udp, "last"));
+    assert(!udp.lost);
+
+    sc_udp_video_destroy(&udp);
+}
+
+static void test_udp_video_invalid(void) {
+    struct sc_udp_video udp;
+    bool ok = sc_udp_video_init(&udp, SC_SOCKET_NONE, 42);
+    assert(ok);
+
+    uint8_t small[4] = {0};
+    enum sc_udp_video_result r = sc_udp_video_push(&udp, small, sizeof(small));
+    assert(r == SC_UDP_VIDEO_INCOMPLETE);
+
+    // index >= count
+    r = push_fragment(&udp, 0, 1, 1, "bad");
+    assert(r == SC_UDP_VIDEO_INCOMPLETE);
+    r = push_fragment(&udp, 0, 0, 0, "bad");
+    assert(r == SC_UDP_VIDEO_INCOMPLETE);
+
+    r = push_fragment(&udp, 0, 0, 1, "good");
+    assert(r == SC_UDP_VIDEO_PACKET);
+    assert(packet_equals(&udp, "good"));
+    assert(!udp.lost);
+
+    sc_udp_video_destroy(&udp);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_udp_video_reassemble();
+    test_udp_video_missing_packet();
+    test_udp_video_missing_fragment();
+    test_udp_video_invalid();
+
+    return 0;
+}
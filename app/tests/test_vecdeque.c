@@ -52,16 +52,17 @@ static void test_vecdeque_reserve(void) {
 
     bool ok = sc_vecdeque_reserve(&vdq, 20);
     assert(ok);
-    assert(vdq.cap == 20);
+    // Rounded up to a power of 2
+    assert(vdq.cap == 32);
 
     assert(sc_vecdeque_size(&vdq) == 0);
 
-    for (size_t i = 0; i < 20; ++i) {
+    for (size_t i = 0; i < 32; ++i) {
         ok = sc_vecdeque_push(&vdq, i);
         assert(ok);
     }
 
-    assert(sc_vecdeque_size(&vdq) == 20);
+    assert(sc_vecdeque_size(&vdq) == 32);
 
     // It is now full
 
@@ -69,29 +70,29 @@ static void test_vecdeque_reserve(void) {
         int v = sc_vecdeque_pop(&vdq);
         assert(v == i);
     }
-    assert(sc_vecdeque_size(&vdq) == 15);
+    assert(sc_vecdeque_size(&vdq) == 27);
 
-    for (int i = 20; i < 25; ++i) {
+    for (int i = 32; i < 37; ++i) {
         ok = sc_vecdeque_push(&vdq, i);
         assert(ok);
     }
 
-    assert(sc_vecdeque_size(&vdq) == 20);
-    assert(vdq.cap == 20);
+    assert(sc_vecdeque_size(&vdq) == 32);
+    assert(vdq.cap == 32);
 
     // Now, the content wraps around the ring buffer:
-    // 20 21 22 23 24  1  2  3  4  5  6  7  8  9 10 11 12 13 14 15 16 17 18 19
+    // 32 33 34 35 36  5  6  7  8  9 10 11 12 ... 27 28 29 30 31
     //                 ^
     //                 origin
 
     // It is now full, let's reserve some space
-    ok = sc_vecdeque_reserve(&vdq, 30);
+    ok = sc_vecdeque_reserve(&vdq, 40);
     assert(ok);
-    assert(vdq.cap == 30);
+    assert(vdq.cap == 64);
 
-    assert(sc_vecdeque_size(&vdq) == 20);
+    assert(sc_vecdeque_size(&vdq) == 32);
 
-    for (int i = 0; i < 20; ++i) {
+    for (int i = 0; i < 32; ++i) {
         // We should retrieve the items we inserted in order
         int v = sc_vecdeque_pop(&vdq);
         assert(v == i + 5);
@@ -107,7 +108,7 @@ static void test_vecdeque_grow(void) {
 
     bool ok = sc_vecdeque_reserve(&vdq, 20);
     assert(ok);
-    assert(vdq.cap == 20);
+    assert(vdq.cap == 32);
 
     assert(sc_vecdeque_size(&vdq) == 0);
 
@@ -117,6 +118,8 @@ static void test_vecdeque_grow(void) {
     }
 
     assert(sc_vecdeque_size(&vdq) == 500);
+    // The capacity remains a power of 2
+    assert(vdq.cap == 512);
 
     for (int i = 0; i < 100; ++i) {
         int v = sc_vecdeque_pop(&vdq);
@@ -147,7 +150,7 @@ static void test_vecdeque_push_hole(void) {
 
     bool ok = sc_vecdeque_reserve(&vdq, 20);
     assert(ok);
-    assert(vdq.cap == 20);
+    assert(vdq.cap == 32);
 
     assert(sc_vecdeque_size(&vdq) == 0);
 
@@ -174,6 +177,9 @@ static void test_vecdeque_push_hole(void) {
 
     assert(sc_vecdeque_size(&vdq) == 20);
 
+    assert(*sc_vecdeque_front_ref(&vdq) == 100);
+    assert(*sc_vecdeque_back_ref(&vdq) == 290);
+
     for (int i = 10; i < 30; ++i) {
         int v = sc_vecdeque_pop(&vdq);
         assert(v == i * 10);
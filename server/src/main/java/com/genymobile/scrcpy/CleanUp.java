@@ -4,6 +4,7 @@ import com.genymobile.scrcpy.device.Device;
 import com.genymobile.scrcpy.util.Ln;
 import com.genymobile.scrcpy.util.Settings;
 import com.genymobile.scrcpy.util.SettingsException;
+import com.genymobile.scrcpy.wrappers.ContentProvider;
 import com.genymobile.scrcpy.wrappers.ServiceManager;
 
 import android.os.BatteryManager;
@@ -51,51 +52,59 @@ public final class CleanUp {
 
     private void runCleanUp(Options options) {
         boolean disableShowTouches = false;
-        if (options.getShowTouches()) {
-            try {
-                String oldValue = Settings.getAndPutValue(Settings.TABLE_SYSTEM, "show_touches", "1");
-                // If "show touches" was disabled, it must be disabled back on clean up
-                disableShowTouches = !"1".equals(oldValue);
-            } catch (SettingsException e) {
-                Ln.e("Could not change \"show_touches\"", e);
-            }
-        }
-
         int restoreStayOn = -1;
-        if (options.getStayAwake()) {
-            int stayOn = BatteryManager.BATTERY_PLUGGED_AC | BatteryManager.BATTERY_PLUGGED_USB | BatteryManager.BATTERY_PLUGGED_WIRELESS;
-            try {
-                String oldValue = Settings.getAndPutValue(Settings.TABLE_GLOBAL, "stay_on_while_plugged_in", String.valueOf(stayOn));
-                try {
-                    int currentStayOn = Integer.parseInt(oldValue);
-                    // Restore only if the current value is different
-                    if (currentStayOn != stayOn) {
-                        restoreStayOn = currentStayOn;
+        int restoreScreenOffTimeout = -1;
+        int screenOffTimeout = options.getScreenOffTimeout();
+
+        if (options.getShowTouches() || options.getStayAwake() || screenOffTimeout != -1) {
+            // Acquire the settings provider once for all the changes
+            try (ContentProvider provider = Settings.openProvider()) {
+                if (options.getShowTouches()) {
+                    try {
+                        String oldValue = Settings.getAndPutValue(provider, Settings.TABLE_SYSTEM, "show_touches", "1");
+                        // If "show touches" was disabled, it must be disabled back on clean up
+                        disableShowTouches = !"1".equals(oldValue);
+                    } catch (SettingsException e) {
+                        Ln.e("Could not change \"show_touches\"", e);
                     }
-                } catch (NumberFormatException e) {
-                    // ignore
                 }
-            } catch (SettingsException e) {
-                Ln.e("Could not change \"stay_on_while_plugged_in\"", e);
-            }
-        }
 
-        int restoreScreenOffTimeout = -1;
-        int screenOffTimeout = options.getScreenOffTimeout();
-        if (screenOffTimeout != -1) {
-            try {
-                String oldValue = Settings.getAndPutValue(Settings.TABLE_SYSTEM, "screen_off_timeout", String.valueOf(screenOffTimeout));
-                try {
-                    int currentScreenOffTimeout = Integer.parseInt(oldValue);
-                    // Restore only if the current value is different
-                    if (currentScreenOffTimeout != screenOffTimeout) {
-                        restoreScreenOffTimeout = currentScreenOffTimeout;
+                if (options.getStayAwake()) {
+                    int stayOn = BatteryManager.BATTERY_PLUGGED_AC | BatteryManager.BATTERY_PLUGGED_USB | BatteryManager.BATTERY_PLUGGED_WIRELESS;
+                    try {
+                        String oldValue = Settings.getAndPutValue(provider, Settings.TABLE_GLOBAL, "stay_on_while_plugged_in",
+                                String.valueOf(stayOn));
+                        try {
+                            int currentStayOn = Integer.parseInt(oldValue);
+                            // Restore only if the current value is different
+                            if (currentStayOn != stayOn) {
+                                restoreStayOn = currentStayOn;
+                            }
+                        } catch (NumberFormatException e) {
+                            // ignore
+                        }
+                    } catch (SettingsException e) {
+                        Ln.e("Could not change \"stay_on_while_plugged_in\"", e);
+                    }
+                }
+
+                if (screenOffTimeout != -1) {
+                    try {
+                        String oldValue = Settings.getAndPutValue(provider, Settings.TABLE_SYSTEM, "screen_off_timeout",
+                                String.valueOf(screenOffTimeout));
+                        try {
+                            int currentScreenOffTimeout = Integer.parseInt(oldValue);
+                            // Restore only if the current value is different
+                            if (currentScreenOffTimeout != screenOffTimeout) {
+                                restoreScreenOffTimeout = currentScreenOffTimeout;
+                            }
+                        } catch (NumberFormatException e) {
+                            // ignore
+                        }
+                    } catch (SettingsException e) {
+                        Ln.e("Could not change \"screen_off_timeout\"", e);
                     }
-                } catch (NumberFormatException e) {
-                    // ignore
                 }
-            } catch (SettingsException e) {
-                Ln.e("Could not change \"screen_off_timeout\"", e);
             }
         }
 
@@ -185,6 +194,38 @@ public final class CleanUp {
         Looper.prepareMainLooper();
     }
 
+    private static void restoreSettings(boolean disableShowTouches, int restoreStayOn, int restoreScreenOffTimeout) {
+        // Acquire the settings provider once for all the changes
+        try (ContentProvider provider = Settings.openProvider()) {
+            if (disableShowTouches) {
+                Ln.i("Disabling \"show touches\"");
+                try {
+                    provider.putValue(Settings.TABLE_SYSTEM, "show_touches", "0");
+                } catch (SettingsException e) {
+                    Ln.e("Could not restore \"show_touches\"", e);
+                }
+            }
+
+            if (restoreStayOn != -1) {
+                Ln.i("Restoring \"stay awake\"");
+                try {
+                    provider.putValue(Settings.TABLE_GLOBAL, "stay_on_while_plugged_in", String.valueOf(restoreStayOn));
+                } catch (SettingsException e) {
+                    Ln.e("Could not restore \"stay_on_while_plugged_in\"", e);
+                }
+            }
+
+            if (restoreScreenOffTimeout != -1) {
+                Ln.i("Restoring \"screen off timeout\"");
+                try {
+                    provider.putValue(Settings.TABLE_SYSTEM, "screen_off_timeout", String.valueOf(restoreScreenOffTimeout));
+                } catch (SettingsException e) {
+                    Ln.e("Could not restore \"screen_off_timeout\"", e);
+                }
+            }
+        }
+    }
+
     public static void main(String... args) {
         try {
             // Start a new session to avoid being terminated along with the server process on some devices
@@ -208,6 +249,10 @@ public final class CleanUp {
         // Dynamic option
         boolean restoreDisplayPower = false;
 
+        // Resolve the services while the server is running, so that the restoration is fast once it dies
+        ServiceManager.getActivityManager();
+        ServiceManager.getWindowManager();
+
         try {
             // Wait for the server to die
             int msg;
@@ -222,31 +267,8 @@ public final class CleanUp {
 
         Ln.i("Cleaning up");
 
-        if (disableShowTouches) {
-            Ln.i("Disabling \"show touches\"");
-            try {
-                Settings.putValue(Settings.TABLE_SYSTEM, "show_touches", "0");
-            } catch (SettingsException e) {
-                Ln.e("Could not restore \"show_touches\"", e);
-            }
-        }
-
-        if (restoreStayOn != -1) {
-            Ln.i("Restoring \"stay awake\"");
-            try {
-                Settings.putValue(Settings.TABLE_GLOBAL, "stay_on_while_plugged_in", String.valueOf(restoreStayOn));
-            } catch (SettingsException e) {
-                Ln.e("Could not restore \"stay_on_while_plugged_in\"", e);
-            }
-        }
-
-        if (restoreScreenOffTimeout != -1) {
-            Ln.i("Restoring \"screen off timeout\"");
-            try {
-                Settings.putValue(Settings.TABLE_SYSTEM, "screen_off_timeout", String.valueOf(restoreScreenOffTimeout));
-            } catch (SettingsException e) {
-                Ln.e("Could not restore \"screen_off_timeout\"", e);
-            }
+        if (disableShowTouches || restoreStayOn != -1 || restoreScreenOffTimeout != -1) {
+            restoreSettings(disableShowTouches, restoreStayOn, restoreScreenOffTimeout);
         }
 
         if (restoreDisplayImePolicy != -1) {
@@ -7,16 +7,21 @@ import com.genymobile.scrcpy.device.NewDisplay;
 import com.genymobile.scrcpy.device.Orientation;
 import com.genymobile.scrcpy.device.Size;
 import com.genymobile.scrcpy.util.CodecOption;
+import com.genymobile.scrcpy.util.CodecUtils;
 import com.genymobile.scrcpy.util.Ln;
 import com.genymobile.scrcpy.video.CameraAspectRatio;
 import com.genymobile.scrcpy.video.CameraFacing;
 import com.genymobile.scrcpy.video.VideoCodec;
+import com.genymobile.scrcpy.video.VideoEncoderProfile;
+import com.genymobile.scrcpy.video.VideoMode;
 import com.genymobile.scrcpy.video.VideoSource;
 import com.genymobile.scrcpy.wrappers.WindowManager;
 
 import android.graphics.Rect;
 import android.util.Pair;
 
+import java.math.BigInteger;
+import java.util.ArrayList;
 import java.util.List;
 import java.util.Locale;
 
@@ -28,8 +33,12 @@ public class Options {
     private boolean audio = true;
     private int maxSize;
     private VideoCodec videoCodec = VideoCodec.H264;
+    private List<VideoCodec> videoCodecCandidates; // in order of preference, null if the codec is not negotiated
     private AudioCodec audioCodec = AudioCodec.OPUS;
     private VideoSource videoSource = VideoSource.DISPLAY;
+    private VideoEncoderProfile videoEncoderProfile = VideoEncoderProfile.DEFAULT;
+    private VideoMode videoMode = VideoMode.NORMAL;
+    private int thumbnailInterval = 1000; // ms
     private AudioSource audioSource = AudioSource.OUTPUT;
     private boolean audioDup;
     private int videoBitRate = 8000000;
@@ -58,10 +67,25 @@ public class Options {
     private boolean powerOffScreenOnClose;
     private boolean clipboardAutosync = true;
     private boolean downsizeOnError = true;
+    private boolean videoRoi;
+    private boolean videoSquare;
+    private boolean thermalThrottle;
+    private boolean multiplex;
+    private int videoIdleTimeout;
+    private int videoIntraRefresh;
+    private boolean videoHdr;
+    private boolean latencyProbe;
+    private int videoUdpPort;
+    private int directPort;
+    private long directToken;
+    private int videoSocketBuffer;
+    private boolean videoBitRateProbe;
     private boolean cleanup = true;
     private boolean powerOn = true;
+    private boolean keepServer;
 
     private NewDisplay newDisplay;
+    private float renderScale = 1f;
     private boolean vdDestroyContent = true;
     private boolean vdSystemDecorations = true;
 
@@ -69,6 +93,7 @@ public class Options {
     private Orientation captureOrientation = Orientation.Orient0;
 
     private boolean listEncoders;
+    private boolean benchmarkEncoders;
     private boolean listDisplays;
     private boolean listCameras;
     private boolean listCameraSizes;
@@ -104,6 +129,10 @@ public class Options {
         return videoCodec;
     }
 
+    public List<VideoCodec> getVideoCodecCandidates() {
+        return videoCodecCandidates;
+    }
+
     public AudioCodec getAudioCodec() {
         return audioCodec;
     }
@@ -112,6 +141,18 @@ public class Options {
         return videoSource;
     }
 
+    public VideoEncoderProfile getVideoEncoderProfile() {
+        return videoEncoderProfile;
+    }
+
+    public VideoMode getVideoMode() {
+        return videoMode;
+    }
+
+    public int getThumbnailInterval() {
+        return thumbnailInterval;
+    }
+
     public AudioSource getAudioSource() {
         return audioSource;
     }
@@ -220,6 +261,70 @@ public class Options {
         return downsizeOnError;
     }
 
+    public boolean getVideoRoi() {
+        return videoRoi;
+    }
+
+    public boolean getVideoSquare() {
+        return videoSquare;
+    }
+
+    public boolean getThermalThrottle() {
+        return thermalThrottle;
+    }
+
+    public boolean getMultiplex() {
+        return multiplex;
+    }
+
+    public int getVideoIdleTimeout() {
+        return videoIdleTimeout;
+    }
+
+    public int getVideoIntraRefresh() {
+        return videoIntraRefresh;
+    }
+
+    public boolean getVideoHdr() {
+        return videoHdr;
+    }
+
+    public boolean getLatencyProbe() {
+        return latencyProbe;
+    }
+
+    public int getVideoUdpPort() {
+        return videoUdpPort;
+    }
+
+    public int getDirectPort() {
+        return directPort;
+    }
+
+    public long getDirectToken() {
+        return directToken;
+    }
+
+    public int getVideoSocketBuffer() {
+        return videoSocketBuffer;
+    }
+
+    public boolean getVideoBitRateProbe() {
+        return videoBitRateProbe;
+    }
+
+    /**
+     * Apply the values chosen by the client from the throughput probe, before the capture and the encoder are created.
+     *
+     * @param maxSize the max size, or 0 to keep the current value
+     */
+    void applyBitRateProbe(int bitRate, int maxSize) {
+        videoBitRate = bitRate;
+        if (maxSize != 0) {
+            this.maxSize = maxSize & ~7; // multiple of 8
+        }
+    }
+
     public boolean getCleanup() {
         return cleanup;
     }
@@ -228,10 +333,18 @@ public class Options {
         return powerOn;
     }
 
+    public boolean getKeepServer() {
+        return keepServer;
+    }
+
     public NewDisplay getNewDisplay() {
         return newDisplay;
     }
 
+    public float getRenderScale() {
+        return renderScale;
+    }
+
     public Orientation getCaptureOrientation() {
         return captureOrientation;
     }
@@ -249,7 +362,7 @@ public class Options {
     }
 
     public boolean getList() {
-        return listEncoders || listDisplays || listCameras || listCameraSizes || listApps;
+        return listEncoders || listDisplays || listCameras || listCameraSizes || listApps || benchmarkEncoders;
     }
 
     public boolean getListEncoders() {
@@ -272,6 +385,10 @@ public class Options {
         return listApps;
     }
 
+    public boolean getBenchmarkEncoders() {
+        return benchmarkEncoders;
+    }
+
     public boolean getSendDeviceMeta() {
         return sendDeviceMeta;
     }
@@ -334,6 +451,9 @@ public class Options {
                     }
                     options.videoCodec = videoCodec;
                     break;
+                case "video_codecs":
+                    options.videoCodecCandidates = parseVideoCodecs(value);
+                    break;
                 case "audio_codec":
                     AudioCodec audioCodec = AudioCodec.findByName(value);
                     if (audioCodec == null) {
@@ -348,6 +468,23 @@ public class Options {
                     }
                     options.videoSource = videoSource;
                     break;
+                case "video_encoder_profile":
+                    VideoEncoderProfile videoEncoderProfile = VideoEncoderProfile.findByName(value);
+                    if (videoEncoderProfile == null) {
+                        throw new IllegalArgumentException("Video encoder profile " + value + " not supported");
+                    }
+                    options.videoEncoderProfile = videoEncoderProfile;
+                    break;
+                case "video_mode":
+                    VideoMode videoMode = VideoMode.findByName(value);
+                    if (videoMode == null) {
+                        throw new IllegalArgumentException("Video mode " + value + " not supported");
+                    }
+                    options.videoMode = videoMode;
+                    break;
+                case "thumbnail_interval":
+                    options.thumbnailInterval = Integer.parseInt(value);
+                    break;
                 case "audio_source":
                     AudioSource audioSource = AudioSource.findByName(value);
                     if (audioSource == null) {
@@ -423,12 +560,55 @@ public class Options {
                 case "downsize_on_error":
                     options.downsizeOnError = Boolean.parseBoolean(value);
                     break;
+                case "video_roi":
+                    options.videoRoi = Boolean.parseBoolean(value);
+                    break;
+                case "video_square":
+                    options.videoSquare = Boolean.parseBoolean(value);
+                    break;
+                case "thermal_throttle":
+                    options.thermalThrottle = Boolean.parseBoolean(value);
+                    break;
+                case "multiplex":
+                    options.multiplex = Boolean.parseBoolean(value);
+                    break;
+                case "video_idle_timeout":
+                    options.videoIdleTimeout = Integer.parseInt(value);
+                    break;
+                case "video_intra_refresh":
+                    options.videoIntraRefresh = Integer.parseInt(value);
+                    break;
+                case "video_hdr":
+                    options.videoHdr = Boolean.parseBoolean(value);
+                    break;
+                case "latency_probe":
+                    options.latencyProbe = Boolean.parseBoolean(value);
+                    break;
+                case "video_udp_port":
+                    options.videoUdpPort = Integer.parseInt(value);
+                    break;
+                case "video_bit_rate_probe":
+                    options.videoBitRateProbe = Boolean.parseBoolean(value);
+                    break;
+                case "video_socket_buffer":
+                    options.videoSocketBuffer = Integer.parseInt(value);
+                    break;
+                case "direct_port":
+                    options.directPort = Integer.parseInt(value);
+                    break;
+                case "direct_token":
+                    // 64-bit unsigned value in hexadecimal (Long.parseUnsignedLong() requires API 26)
+                    options.directToken = new BigInteger(value, 0x10).longValue();
+                    break;
                 case "cleanup":
                     options.cleanup = Boolean.parseBoolean(value);
                     break;
                 case "power_on":
                     options.powerOn = Boolean.parseBoolean(value);
                     break;
+                case "keep_server":
+                    options.keepServer = Boolean.parseBoolean(value);
+                    break;
                 case "list_encoders":
                     options.listEncoders = Boolean.parseBoolean(value);
                     break;
@@ -444,6 +624,9 @@ public class Options {
                 case "list_apps":
                     options.listApps = Boolean.parseBoolean(value);
                     break;
+                case "benchmark_encoders":
+                    options.benchmarkEncoders = Boolean.parseBoolean(value);
+                    break;
                 case "camera_id":
                     if (!value.isEmpty()) {
                         options.cameraId = value;
@@ -477,6 +660,12 @@ public class Options {
                 case "new_display":
                     options.newDisplay = parseNewDisplay(value);
                     break;
+                case "render_scale":
+                    options.renderScale = parseFloat("render_scale", value);
+                    if (!(options.renderScale > 0 && options.renderScale <= 1)) {
+                        throw new IllegalArgumentException("Invalid render scale: " + value);
+                    }
+                    break;
                 case "vd_destroy_content":
                     options.vdDestroyContent = Boolean.parseBoolean(value);
                     break;
@@ -523,9 +712,29 @@ public class Options {
             options.displayId = Device.DISPLAY_ID_NONE;
         }
 
+        if (options.video && options.videoCodecCandidates != null) {
+            VideoCodec videoCodec = CodecUtils.selectVideoCodec(options.videoCodecCandidates, options.videoEncoder);
+            if (videoCodec != null) {
+                options.videoCodec = videoCodec;
+            }
+        }
+
         return options;
     }
 
+    private static List<VideoCodec> parseVideoCodecs(String value) {
+        // input format: "codec1,codec2,...", in order of preference
+        List<VideoCodec> codecs = new ArrayList<>();
+        for (String name : value.split(",")) {
+            VideoCodec videoCodec = VideoCodec.findByName(name);
+            if (videoCodec == null) {
+                throw new IllegalArgumentException("Video codec " + name + " not supported");
+            }
+            codecs.add(videoCodec);
+        }
+        return codecs;
+    }
+
     private static Rect parseCrop(String crop) {
         // input format: "width:height:x:y"
         String[] tokens = crop.split(":");
@@ -0,0 +1,76 @@
+package com.genymobile.scrcpy;
+
+import com.genymobile.scrcpy.audio.AudioCodec;
+import com.genymobile.scrcpy.util.EncoderCache;
+import com.genymobile.scrcpy.util.Ln;
+import com.genymobile.scrcpy.video.VideoSource;
+import com.genymobile.scrcpy.wrappers.ServiceManager;
+
+import android.media.MediaCodec;
+import android.os.SystemClock;
+
+/**
+ * Warm up the system services and the media encoders in the background, while the client is connecting the sockets.
+ * <p>
+ * On first use, the service wrappers resolve their hidden methods by reflection, and the media server loads the encoder implementation. Doing
+ * this early reduces the time to the first frame.
+ * <p>
+ * The encoders are released immediately (some devices support a single hardware encoder instance), so the session must not start before
+ * {@link #join()} returns.
+ */
+public final class Prewarm {
+
+    private final Thread thread;
+
+    private Prewarm(Options options) {
+        thread = new Thread(() -> runPrewarm(options), "prewarm");
+        thread.start();
+    }
+
+    public static Prewarm start(Options options) {
+        return new Prewarm(options);
+    }
+
+    public void join() throws InterruptedException {
+        thread.join();
+    }
+
+    private static void runPrewarm(Options options) {
+        long start = SystemClock.uptimeMillis();
+
+        if (options.getVideo()) {
+            if (options.getVideoSource() == VideoSource.CAMERA) {
+                ServiceManager.getCameraManager();
+            } else {
+                ServiceManager.getDisplayManager();
+                ServiceManager.getWindowManager();
+            }
+        }
+        if (options.getControl()) {
+            ServiceManager.getInputManager();
+            ServiceManager.getPowerManager();
+        }
+
+        long servicesEnd = SystemClock.uptimeMillis();
+
+        if (options.getVideo()) {
+            prewarmEncoder(options.getVideoEncoder(), options.getVideoCodec().getMimeType());
+        }
+        if (options.getAudio() && options.getAudioCodec() != AudioCodec.RAW) {
+            prewarmEncoder(options.getAudioEncoder(), options.getAudioCodec().getMimeType());
+        }
+
+        long end = SystemClock.uptimeMillis();
+        Ln.d("Prewarm: services " + (servicesEnd - start) + " ms, encoders " + (end - servicesEnd) + " ms");
+    }
+
+    private static void prewarmEncoder(String encoderName, String mimeType) {
+        try {
+            MediaCodec mediaCodec = encoderName != null ? MediaCodec.createByCodecName(encoderName) : EncoderCache.createDefaultEncoder(mimeType);
+            mediaCodec.release();
+        } catch (Exception e) {
+            // The error, if any, will be reported on actual encoder creation
+            Ln.d("Could not prewarm encoder for " + mimeType + ": " + e.getMessage());
+        }
+    }
+}
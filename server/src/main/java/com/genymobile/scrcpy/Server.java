@@ -9,24 +9,33 @@ import com.genymobile.scrcpy.audio.AudioRawRecorder;
 import com.genymobile.scrcpy.audio.AudioSource;
 import com.genymobile.scrcpy.control.ControlChannel;
 import com.genymobile.scrcpy.control.Controller;
+import com.genymobile.scrcpy.device.BitRateProbe;
 import com.genymobile.scrcpy.device.ConfigurationException;
 import com.genymobile.scrcpy.device.DesktopConnection;
 import com.genymobile.scrcpy.device.Device;
 import com.genymobile.scrcpy.device.NewDisplay;
 import com.genymobile.scrcpy.device.Streamer;
+import com.genymobile.scrcpy.device.UdpVideoChannel;
 import com.genymobile.scrcpy.opengl.OpenGLRunner;
 import com.genymobile.scrcpy.util.Ln;
 import com.genymobile.scrcpy.util.LogUtils;
 import com.genymobile.scrcpy.video.CameraCapture;
+import com.genymobile.scrcpy.video.EncoderBenchmark;
+import com.genymobile.scrcpy.video.IdleMonitor;
 import com.genymobile.scrcpy.video.NewDisplayCapture;
 import com.genymobile.scrcpy.video.ScreenCapture;
 import com.genymobile.scrcpy.video.SurfaceCapture;
 import com.genymobile.scrcpy.video.SurfaceEncoder;
+import com.genymobile.scrcpy.video.ThermalMonitor;
 import com.genymobile.scrcpy.video.VideoSource;
 
 import android.annotation.SuppressLint;
+import android.net.LocalServerSocket;
 import android.os.Build;
 import android.os.Looper;
+import android.os.SystemClock;
+import android.system.ErrnoException;
+import android.system.Os;
 
 import java.io.File;
 import java.io.IOException;
@@ -47,9 +56,11 @@ public final class Server {
     private static class Completion {
         private int running;
         private boolean fatalError;
+        private final boolean persistent;
 
-        Completion(int running) {
+        Completion(int running, boolean persistent) {
             this.running = running;
+            this.persistent = persistent;
         }
 
         synchronized void addCompleted(boolean fatalError) {
@@ -58,7 +69,17 @@ public final class Server {
                 this.fatalError = true;
             }
             if (running == 0 || this.fatalError) {
-                Looper.getMainLooper().quitSafely();
+                if (persistent) {
+                    notify();
+                } else {
+                    Looper.getMainLooper().quitSafely();
+                }
+            }
+        }
+
+        synchronized void await() throws InterruptedException {
+            while (running > 0 && !fatalError) {
+                wait();
             }
         }
     }
@@ -84,6 +105,16 @@ public final class Server {
             }
         }
 
+        if (options.getKeepServer() && options.getDirectPort() != 0) {
+            Ln.e("Keeping the server is not supported with a direct connection");
+            throw new ConfigurationException("Keeping the server is not supported with a direct connection");
+        }
+
+        if (options.getKeepServer() && !options.isTunnelForward()) {
+            Ln.e("Keeping the server requires a forward tunnel");
+            throw new ConfigurationException("Keeping the server requires a forward tunnel");
+        }
+
         CleanUp cleanUp = null;
 
         if (options.getCleanup()) {
@@ -92,21 +123,102 @@ public final class Server {
 
         int scid = options.getScid();
         boolean tunnelForward = options.isTunnelForward();
-        boolean control = options.getControl();
         boolean video = options.getVideo();
         boolean audio = options.getAudio();
+        boolean control = options.getControl();
+        boolean multiplex = options.getMultiplex();
         boolean sendDummyByte = options.getSendDummyByte();
 
         Workarounds.apply();
 
+        if (video && options.getVideoCodecCandidates() != null) {
+            Ln.i("Negotiated video codec: " + options.getVideoCodec().getName());
+        }
+
+        // Warm up the services and the encoders while the client connects
+        Prewarm prewarm = Prewarm.start(options);
+
+        try {
+            if (options.getKeepServer()) {
+                try {
+                    // Do not be killed along with the "adb shell" process of the client which started the server
+                    Os.setsid();
+                } catch (ErrnoException e) {
+                    Ln.w("setsid() failed", e);
+                }
+
+                try (LocalServerSocket localServerSocket = DesktopConnection.listen(scid)) {
+                    while (true) {
+                        DesktopConnection connection = DesktopConnection.accept(localServerSocket, video, audio, control, multiplex,
+                                sendDummyByte);
+                        Ln.i("Client connected");
+                        joinPrewarm(prewarm);
+                        runSession(options, connection, cleanUp, true);
+                        Ln.i("Client disconnected, waiting for a new connection");
+                    }
+                }
+            }
+
+            long connectStart = SystemClock.uptimeMillis();
+            DesktopConnection connection;
+            int directPort = options.getDirectPort();
+            if (directPort != 0) {
+                connection = DesktopConnection.acceptDirect(directPort, options.getDirectToken(), video, audio, control, multiplex,
+                        sendDummyByte);
+            } else {
+                connection = DesktopConnection.open(scid, tunnelForward, video, audio, control, multiplex, sendDummyByte);
+            }
+            long connectEnd = SystemClock.uptimeMillis();
+            joinPrewarm(prewarm);
+            Ln.d("Connection: " + (connectEnd - connectStart) + " ms (+" + (SystemClock.uptimeMillis() - connectEnd) + " ms waiting for prewarm)");
+            runSession(options, connection, cleanUp, false);
+        } finally {
+            if (cleanUp != null) {
+                cleanUp.interrupt();
+                try {
+                    cleanUp.join();
+                } catch (InterruptedException e) {
+                    // ignore
+                }
+            }
+        }
+    }
+
+    private static void joinPrewarm(Prewarm prewarm) {
+        try {
+            prewarm.join();
+        } catch (InterruptedException e) {
+            // ignore
+        }
+    }
+
+    /**
+     * Mirror the device to a connected client until the end of the session.
+     *
+     * @param persistent whether other sessions will follow in the same process (the main looper is not run, and the OpenGL thread is kept)
+     */
+    private static void runSession(Options options, DesktopConnection connection, CleanUp cleanUp, boolean persistent) throws IOException {
+        boolean control = options.getControl();
+        boolean video = options.getVideo();
+        boolean audio = options.getAudio();
+
         List<AsyncProcessor> asyncProcessors = new ArrayList<>();
+        UdpVideoChannel udpVideoChannel = null;
 
-        DesktopConnection connection = DesktopConnection.open(scid, tunnelForward, video, audio, control, sendDummyByte);
         try {
             if (options.getSendDeviceMeta()) {
                 connection.sendDeviceMeta(Device.getDeviceName());
             }
 
+            if (video && options.getVideoBitRateProbe()) {
+                BitRateProbe probe = BitRateProbe.run(connection.getBitRateProbeFd());
+                int maxSize = probe.getMaxSize();
+                Ln.i("Throughput probe: video bit rate " + probe.getBitRate() + (maxSize != 0 ? ", max size " + maxSize : ""));
+                options.applyBitRateProbe(probe.getBitRate(), maxSize);
+            }
+
+            connection.startMultiplexer();
+
             Controller controller = null;
 
             if (control) {
@@ -136,8 +248,17 @@ public final class Server {
             }
 
             if (video) {
+                int videoSocketBuffer = options.getVideoSocketBuffer();
+                if (videoSocketBuffer > 0) {
+                    connection.setVideoSendBufferSize(videoSocketBuffer);
+                }
+
+                int videoUdpPort = options.getVideoUdpPort();
+                if (videoUdpPort != 0) {
+                    udpVideoChannel = UdpVideoChannel.open(videoUdpPort, options.getScid(), videoSocketBuffer);
+                }
                 Streamer videoStreamer = new Streamer(connection.getVideoFd(), options.getVideoCodec(), options.getSendCodecMeta(),
-                        options.getSendFrameMeta());
+                        options.getSendFrameMeta(), udpVideoChannel);
                 SurfaceCapture surfaceCapture;
                 if (options.getVideoSource() == VideoSource.DISPLAY) {
                     NewDisplay newDisplay = options.getNewDisplay();
@@ -155,42 +276,63 @@ public final class Server {
 
                 if (controller != null) {
                     controller.setSurfaceCapture(surfaceCapture);
+                    controller.setBitRateAdapter(surfaceEncoder.getBitRateAdapter());
+                    controller.setVideoSizeAdapter(surfaceEncoder.getVideoSizeAdapter());
+                    controller.setEncoderControl(surfaceEncoder.getEncoderControl());
+                    controller.setLatencyProbe(surfaceEncoder.getLatencyProbe());
+                    IdleMonitor idleMonitor = surfaceEncoder.getIdleMonitor();
+                    if (idleMonitor != null) {
+                        idleMonitor.setListener(controller::onVideoIdleChanged);
+                    }
+                    ThermalMonitor thermalMonitor = surfaceEncoder.getThermalMonitor();
+                    if (thermalMonitor != null) {
+                        thermalMonitor.setListener(controller::onThermalStateChanged);
+                    }
                 }
             }
 
-            Completion completion = new Completion(asyncProcessors.size());
+            Completion completion = new Completion(asyncProcessors.size(), persistent);
             for (AsyncProcessor asyncProcessor : asyncProcessors) {
                 asyncProcessor.start((fatalError) -> {
                     completion.addCompleted(fatalError);
                 });
             }
 
-            Looper.loop(); // interrupted by the Completion implementation
-        } finally {
-            if (cleanUp != null) {
-                cleanUp.interrupt();
+            if (persistent) {
+                try {
+                    completion.await();
+                } catch (InterruptedException e) {
+                    // ignore
+                }
+            } else {
+                Looper.loop(); // interrupted by the Completion implementation
             }
+        } finally {
             for (AsyncProcessor asyncProcessor : asyncProcessors) {
                 asyncProcessor.stop();
             }
 
-            OpenGLRunner.quit(); // quit the OpenGL thread, if any
+            if (!persistent) {
+                OpenGLRunner.quit(); // quit the OpenGL thread, if any
+            }
 
             connection.shutdown();
 
             try {
-                if (cleanUp != null) {
-                    cleanUp.join();
-                }
                 for (AsyncProcessor asyncProcessor : asyncProcessors) {
                     asyncProcessor.join();
                 }
-                OpenGLRunner.join();
+                if (!persistent) {
+                    OpenGLRunner.join();
+                }
             } catch (InterruptedException e) {
                 // ignore
             }
 
             connection.close();
+            if (udpVideoChannel != null) {
+                udpVideoChannel.close();
+            }
         }
     }
 
@@ -263,6 +405,10 @@ public final class Server {
                 Ln.i("Processing Android apps... (this may take some time)");
                 Ln.i(LogUtils.buildAppListMessage());
             }
+            if (options.getBenchmarkEncoders()) {
+                Ln.i("Benchmarking video encoders... (this may take some time)");
+                Ln.i(EncoderBenchmark.run());
+            }
             // Just print the requested data, do not mirror
             return;
         }
@@ -8,6 +8,7 @@ import com.genymobile.scrcpy.device.Streamer;
 import com.genymobile.scrcpy.util.Codec;
 import com.genymobile.scrcpy.util.CodecOption;
 import com.genymobile.scrcpy.util.CodecUtils;
+import com.genymobile.scrcpy.util.EncoderCache;
 import com.genymobile.scrcpy.util.IO;
 import com.genymobile.scrcpy.util.Ln;
 import com.genymobile.scrcpy.util.LogUtils;
@@ -337,7 +338,7 @@ public final class AudioEncoder implements AsyncProcessor {
         }
 
         try {
-            MediaCodec mediaCodec = MediaCodec.createEncoderByType(codec.getMimeType());
+            MediaCodec mediaCodec = EncoderCache.createDefaultEncoder(codec.getMimeType());
             Ln.d("Using audio encoder: '" + mediaCodec.getName() + "'");
             return mediaCodec;
         } catch (IOException | IllegalArgumentException e) {
@@ -31,7 +31,6 @@ public final class AudioRawRecorder implements AsyncProcessor {
             return;
         }
 
-        final ByteBuffer buffer = ByteBuffer.allocateDirect(AudioConfig.MAX_READ_SIZE);
         final MediaCodec.BufferInfo bufferInfo = new MediaCodec.BufferInfo();
 
         try {
@@ -45,14 +44,14 @@ public final class AudioRawRecorder implements AsyncProcessor {
 
             streamer.writeAudioHeader();
             while (!Thread.currentThread().isInterrupted()) {
-                buffer.position(0);
+                // Read directly into the streamer buffer, after the packet header, to avoid a copy
+                ByteBuffer buffer = streamer.getPayloadBuffer(AudioConfig.MAX_READ_SIZE);
                 int r = capture.read(buffer, bufferInfo);
                 if (r < 0) {
                     throw new IOException("Could not read audio: " + r);
                 }
-                buffer.limit(r);
 
-                streamer.writePacket(buffer, bufferInfo);
+                streamer.writePayload(r, bufferInfo.presentationTimeUs, false, false);
             }
         } catch (IOException e) {
             // Broken pipe is expected on close, because the socket is closed by the client
@@ -28,7 +28,8 @@ public class AudioRecordReader {
 
     @TargetApi(AndroidVersions.API_24_ANDROID_7_0)
     public int read(ByteBuffer outDirectBuffer, MediaCodec.BufferInfo outBufferInfo) {
-        int r = recorder.read(outDirectBuffer, AudioConfig.MAX_READ_SIZE);
+        // The buffer is provided by the caller (a MediaCodec input buffer or the streamer buffer), do not read more than its capacity
+        int r = recorder.read(outDirectBuffer, Math.min(outDirectBuffer.capacity(), AudioConfig.MAX_READ_SIZE));
         if (r <= 0) {
             return r;
         }
@@ -25,6 +25,14 @@ public final class ControlMessage {
     public static final int TYPE_OPEN_HARD_KEYBOARD_SETTINGS = 15;
     public static final int TYPE_START_APP = 16;
     public static final int TYPE_RESET_VIDEO = 17;
+    public static final int TYPE_VIDEO_FEEDBACK = 18;
+    public static final int TYPE_REQUEST_SYNC_FRAME = 19;
+    public static final int TYPE_INJECT_TOUCH_BATCH = 20;
+    public static final int TYPE_INPUT_PROBE = 21;
+    public static final int TYPE_SET_CLIPBOARD_CHUNK = 22;
+    public static final int TYPE_SET_VIEWPORT_SIZE = 23;
+    public static final int TYPE_CAPTURE_SCREENSHOT = 24;
+    public static final int TYPE_LATENCY_PROBE = 25;
 
     public static final long SEQUENCE_INVALID = 0;
 
@@ -32,6 +40,11 @@ public final class ControlMessage {
     public static final int COPY_KEY_COPY = 1;
     public static final int COPY_KEY_CUT = 2;
 
+    public static final int CLIPBOARD_CHUNK_FLAG_FIRST = 1;
+    public static final int CLIPBOARD_CHUNK_FLAG_LAST = 2;
+    public static final int CLIPBOARD_CHUNK_FLAG_PASTE = 4;
+    public static final int CLIPBOARD_CHUNK_FLAG_DEFLATE = 8; // the concatenated chunks are compressed (zlib format)
+
     private int type;
     private String text;
     private int metaState; // KeyEvent.META_*
@@ -53,18 +66,34 @@ public final class ControlMessage {
     private boolean on;
     private int vendorId;
     private int productId;
+    private int bitRate;
+    private int delay;
+    private int backlog;
+    private Position[] positions; // samples of a touch batch
+    private float[] pressures;
+    private int[] sampleAges; // in microseconds, relative to the last sample
+    private int flags; // CLIPBOARD_CHUNK_FLAG_*
+    private int width;
+    private int height;
+    private int code; // latency probe code
 
     private ControlMessage() {
     }
 
     public static ControlMessage createInjectKeycode(int action, int keycode, int repeat, int metaState) {
-        ControlMessage msg = new ControlMessage();
-        msg.type = TYPE_INJECT_KEYCODE;
-        msg.action = action;
-        msg.keycode = keycode;
-        msg.repeat = repeat;
-        msg.metaState = metaState;
-        return msg;
+        return new ControlMessage().setInjectKeycode(action, keycode, repeat, metaState);
+    }
+
+    // The set*() methods reinitialize an existing message, so that the reader may reuse it (all the fields relevant for the type are
+    // overwritten)
+
+    ControlMessage setInjectKeycode(int action, int keycode, int repeat, int metaState) {
+        type = TYPE_INJECT_KEYCODE;
+        this.action = action;
+        this.keycode = keycode;
+        this.repeat = repeat;
+        this.metaState = metaState;
+        return this;
     }
 
     public static ControlMessage createInjectText(String text) {
@@ -76,25 +105,42 @@ public final class ControlMessage {
 
     public static ControlMessage createInjectTouchEvent(int action, long pointerId, Position position, float pressure, int actionButton,
             int buttons) {
+        return new ControlMessage().setInjectTouchEvent(action, pointerId, position, pressure, actionButton, buttons);
+    }
+
+    ControlMessage setInjectTouchEvent(int action, long pointerId, Position position, float pressure, int actionButton, int buttons) {
+        type = TYPE_INJECT_TOUCH_EVENT;
+        this.action = action;
+        this.pointerId = pointerId;
+        this.pressure = pressure;
+        this.position = position;
+        this.actionButton = actionButton;
+        this.buttons = buttons;
+        return this;
+    }
+
+    public static ControlMessage createInjectTouchBatch(long pointerId, int buttons, Position[] positions, float[] pressures, int[] sampleAges) {
         ControlMessage msg = new ControlMessage();
-        msg.type = TYPE_INJECT_TOUCH_EVENT;
-        msg.action = action;
+        msg.type = TYPE_INJECT_TOUCH_BATCH;
         msg.pointerId = pointerId;
-        msg.pressure = pressure;
-        msg.position = position;
-        msg.actionButton = actionButton;
         msg.buttons = buttons;
+        msg.positions = positions;
+        msg.pressures = pressures;
+        msg.sampleAges = sampleAges;
         return msg;
     }
 
     public static ControlMessage createInjectScrollEvent(Position position, float hScroll, float vScroll, int buttons) {
-        ControlMessage msg = new ControlMessage();
-        msg.type = TYPE_INJECT_SCROLL_EVENT;
-        msg.position = position;
-        msg.hScroll = hScroll;
-        msg.vScroll = vScroll;
-        msg.buttons = buttons;
-        return msg;
+        return new ControlMessage().setInjectScrollEvent(position, hScroll, vScroll, buttons);
+    }
+
+    ControlMessage setInjectScrollEvent(Position position, float hScroll, float vScroll, int buttons) {
+        type = TYPE_INJECT_SCROLL_EVENT;
+        this.position = position;
+        this.hScroll = hScroll;
+        this.vScroll = vScroll;
+        this.buttons = buttons;
+        return this;
     }
 
     public static ControlMessage createBackOrScreenOn(int action) {
@@ -120,6 +166,15 @@ public final class ControlMessage {
         return msg;
     }
 
+    public static ControlMessage createSetClipboardChunk(long sequence, int flags, byte[] data) {
+        ControlMessage msg = new ControlMessage();
+        msg.type = TYPE_SET_CLIPBOARD_CHUNK;
+        msg.sequence = sequence;
+        msg.flags = flags;
+        msg.data = data;
+        return msg;
+    }
+
     public static ControlMessage createSetDisplayPower(boolean on) {
         ControlMessage msg = new ControlMessage();
         msg.type = TYPE_SET_DISPLAY_POWER;
@@ -127,6 +182,28 @@ public final class ControlMessage {
         return msg;
     }
 
+    public static ControlMessage createInputProbe(long sequence) {
+        ControlMessage msg = new ControlMessage();
+        msg.type = TYPE_INPUT_PROBE;
+        msg.sequence = sequence;
+        return msg;
+    }
+
+    public static ControlMessage createSetViewportSize(int width, int height) {
+        ControlMessage msg = new ControlMessage();
+        msg.type = TYPE_SET_VIEWPORT_SIZE;
+        msg.width = width;
+        msg.height = height;
+        return msg;
+    }
+
+    public static ControlMessage createLatencyProbe(int code) {
+        ControlMessage msg = new ControlMessage();
+        msg.type = TYPE_LATENCY_PROBE;
+        msg.code = code;
+        return msg;
+    }
+
     public static ControlMessage createEmpty(int type) {
         ControlMessage msg = new ControlMessage();
         msg.type = type;
@@ -166,6 +243,15 @@ public final class ControlMessage {
         return msg;
     }
 
+    public static ControlMessage createVideoFeedback(int bitRate, int delay, int backlog) {
+        ControlMessage msg = new ControlMessage();
+        msg.type = TYPE_VIDEO_FEEDBACK;
+        msg.bitRate = bitRate;
+        msg.delay = delay;
+        msg.backlog = backlog;
+        return msg;
+    }
+
     public int getType() {
         return type;
     }
@@ -230,6 +316,10 @@ public final class ControlMessage {
         return sequence;
     }
 
+    public int getCode() {
+        return code;
+    }
+
     public int getId() {
         return id;
     }
@@ -249,4 +339,40 @@ public final class ControlMessage {
     public int getProductId() {
         return productId;
     }
+
+    public int getBitRate() {
+        return bitRate;
+    }
+
+    public int getDelay() {
+        return delay;
+    }
+
+    public int getBacklog() {
+        return backlog;
+    }
+
+    public int getWidth() {
+        return width;
+    }
+
+    public int getHeight() {
+        return height;
+    }
+
+    public Position[] getPositions() {
+        return positions;
+    }
+
+    public float[] getPressures() {
+        return pressures;
+    }
+
+    public int[] getSampleAges() {
+        return sampleAges;
+    }
+
+    public int getFlags() {
+        return flags;
+    }
 }
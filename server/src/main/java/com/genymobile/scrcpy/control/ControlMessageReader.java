@@ -1,6 +1,8 @@
 package com.genymobile.scrcpy.control;
 
+import com.genymobile.scrcpy.device.Point;
 import com.genymobile.scrcpy.device.Position;
+import com.genymobile.scrcpy.device.Size;
 import com.genymobile.scrcpy.util.Binary;
 
 import java.io.BufferedInputStream;
@@ -16,12 +18,29 @@ public class ControlMessageReader {
     public static final int CLIPBOARD_TEXT_MAX_LENGTH = MESSAGE_MAX_SIZE - 14; // type: 1 byte; sequence: 8 bytes; paste flag: 1 byte; length: 4 bytes
     public static final int INJECT_TEXT_MAX_LENGTH = 300;
 
+    // The client sends all its pending messages with a single write, read them with as few syscalls as possible
+    private static final int READ_BUFFER_SIZE = 1 << 16; // 64k
+
     private final DataInputStream dis;
 
+    // The most frequent messages are parsed into reused instances, to avoid allocations (and GC pauses) on every mouse motion
+    private final ControlMessage keycodeMessage = ControlMessage.createEmpty(ControlMessage.TYPE_INJECT_KEYCODE);
+    private final ControlMessage touchEventMessage = ControlMessage.createEmpty(ControlMessage.TYPE_INJECT_TOUCH_EVENT);
+    private final ControlMessage scrollEventMessage = ControlMessage.createEmpty(ControlMessage.TYPE_INJECT_SCROLL_EVENT);
+
+    // The client screen size rarely changes, reuse the last one (Size is immutable)
+    private Size lastScreenSize;
+
     public ControlMessageReader(InputStream rawInputStream) {
-        dis = new DataInputStream(new BufferedInputStream(rawInputStream));
+        dis = new DataInputStream(new BufferedInputStream(rawInputStream, READ_BUFFER_SIZE));
     }
 
+    /**
+     * Read the next message.
+     * <p>
+     * The returned message may be reused by the reader, so it is only valid until the next call to {@code read()}. It must not be retained
+     * (but its {@link Position} may).
+     */
     public ControlMessage read() throws IOException {
         int type = dis.readUnsignedByte();
         switch (type) {
@@ -31,6 +50,8 @@ public class ControlMessageReader {
                 return parseInjectText();
             case ControlMessage.TYPE_INJECT_TOUCH_EVENT:
                 return parseInjectTouchEvent();
+            case ControlMessage.TYPE_INJECT_TOUCH_BATCH:
+                return parseInjectTouchBatch();
             case ControlMessage.TYPE_INJECT_SCROLL_EVENT:
                 return parseInjectScrollEvent();
             case ControlMessage.TYPE_BACK_OR_SCREEN_ON:
@@ -39,6 +60,8 @@ public class ControlMessageReader {
                 return parseGetClipboard();
             case ControlMessage.TYPE_SET_CLIPBOARD:
                 return parseSetClipboard();
+            case ControlMessage.TYPE_SET_CLIPBOARD_CHUNK:
+                return parseSetClipboardChunk();
             case ControlMessage.TYPE_SET_DISPLAY_POWER:
                 return parseSetDisplayPower();
             case ControlMessage.TYPE_EXPAND_NOTIFICATION_PANEL:
@@ -47,6 +70,8 @@ public class ControlMessageReader {
             case ControlMessage.TYPE_ROTATE_DEVICE:
             case ControlMessage.TYPE_OPEN_HARD_KEYBOARD_SETTINGS:
             case ControlMessage.TYPE_RESET_VIDEO:
+            case ControlMessage.TYPE_CAPTURE_SCREENSHOT:
+            case ControlMessage.TYPE_REQUEST_SYNC_FRAME:
                 return ControlMessage.createEmpty(type);
             case ControlMessage.TYPE_UHID_CREATE:
                 return parseUhidCreate();
@@ -56,6 +81,14 @@ public class ControlMessageReader {
                 return parseUhidDestroy();
             case ControlMessage.TYPE_START_APP:
                 return parseStartApp();
+            case ControlMessage.TYPE_VIDEO_FEEDBACK:
+                return parseVideoFeedback();
+            case ControlMessage.TYPE_INPUT_PROBE:
+                return parseInputProbe();
+            case ControlMessage.TYPE_SET_VIEWPORT_SIZE:
+                return parseSetViewportSize();
+            case ControlMessage.TYPE_LATENCY_PROBE:
+                return parseLatencyProbe();
             default:
                 throw new ControlProtocolException("Unknown event type: " + type);
         }
@@ -66,7 +99,7 @@ public class ControlMessageReader {
         int keycode = dis.readInt();
         int repeat = dis.readInt();
         int metaState = dis.readInt();
-        return ControlMessage.createInjectKeycode(action, keycode, repeat, metaState);
+        return keycodeMessage.setInjectKeycode(action, keycode, repeat, metaState);
     }
 
     private int parseBufferLength(int sizeBytes) throws IOException {
@@ -107,7 +140,30 @@ public class ControlMessageReader {
         float pressure = Binary.u16FixedPointToFloat(dis.readShort());
         int actionButton = dis.readInt();
         int buttons = dis.readInt();
-        return ControlMessage.createInjectTouchEvent(action, pointerId, position, pressure, actionButton, buttons);
+        return touchEventMessage.setInjectTouchEvent(action, pointerId, position, pressure, actionButton, buttons);
+    }
+
+    private ControlMessage parseInjectTouchBatch() throws IOException {
+        long pointerId = dis.readLong();
+        int screenWidth = dis.readUnsignedShort();
+        int screenHeight = dis.readUnsignedShort();
+        int buttons = dis.readInt();
+        int count = dis.readUnsignedByte();
+        if (count == 0) {
+            throw new ControlProtocolException("Empty touch batch");
+        }
+        Size screenSize = getScreenSize(screenWidth, screenHeight);
+        Position[] positions = new Position[count];
+        float[] pressures = new float[count];
+        int[] sampleAges = new int[count];
+        for (int i = 0; i < count; ++i) {
+            int x = dis.readInt();
+            int y = dis.readInt();
+            positions[i] = new Position(new Point(x, y), screenSize);
+            pressures[i] = Binary.u16FixedPointToFloat(dis.readShort());
+            sampleAges[i] = dis.readInt();
+        }
+        return ControlMessage.createInjectTouchBatch(pointerId, buttons, positions, pressures, sampleAges);
     }
 
     private ControlMessage parseInjectScrollEvent() throws IOException {
@@ -116,7 +172,7 @@ public class ControlMessageReader {
         float hScroll = Binary.i16FixedPointToFloat(dis.readShort()) * 16;
         float vScroll = Binary.i16FixedPointToFloat(dis.readShort()) * 16;
         int buttons = dis.readInt();
-        return ControlMessage.createInjectScrollEvent(position, hScroll, vScroll, buttons);
+        return scrollEventMessage.setInjectScrollEvent(position, hScroll, vScroll, buttons);
     }
 
     private ControlMessage parseBackOrScreenOnEvent() throws IOException {
@@ -136,6 +192,13 @@ public class ControlMessageReader {
         return ControlMessage.createSetClipboard(sequence, text, paste);
     }
 
+    private ControlMessage parseSetClipboardChunk() throws IOException {
+        long sequence = dis.readLong();
+        int flags = dis.readUnsignedByte();
+        byte[] data = parseByteArray(2);
+        return ControlMessage.createSetClipboardChunk(sequence, flags, data);
+    }
+
     private ControlMessage parseSetDisplayPower() throws IOException {
         boolean on = dis.readBoolean();
         return ControlMessage.createSetDisplayPower(on);
@@ -166,11 +229,41 @@ public class ControlMessageReader {
         return ControlMessage.createStartApp(name);
     }
 
+    private ControlMessage parseVideoFeedback() throws IOException {
+        int bitRate = dis.readInt();
+        int delay = dis.readUnsignedShort();
+        int backlog = dis.readUnsignedShort();
+        return ControlMessage.createVideoFeedback(bitRate, delay, backlog);
+    }
+
+    private ControlMessage parseSetViewportSize() throws IOException {
+        int width = dis.readUnsignedShort();
+        int height = dis.readUnsignedShort();
+        return ControlMessage.createSetViewportSize(width, height);
+    }
+
+    private ControlMessage parseInputProbe() throws IOException {
+        long sequence = dis.readLong();
+        return ControlMessage.createInputProbe(sequence);
+    }
+
+    private ControlMessage parseLatencyProbe() throws IOException {
+        int code = dis.readUnsignedByte();
+        return ControlMessage.createLatencyProbe(code);
+    }
+
     private Position parsePosition() throws IOException {
         int x = dis.readInt();
         int y = dis.readInt();
         int screenWidth = dis.readUnsignedShort();
         int screenHeight = dis.readUnsignedShort();
-        return new Position(x, y, screenWidth, screenHeight);
+        return new Position(new Point(x, y), getScreenSize(screenWidth, screenHeight));
+    }
+
+    private Size getScreenSize(int width, int height) {
+        if (lastScreenSize == null || lastScreenSize.getWidth() != width || lastScreenSize.getHeight() != height) {
+            lastScreenSize = new Size(width, height);
+        }
+        return lastScreenSize;
     }
 }
@@ -12,7 +12,12 @@ import com.genymobile.scrcpy.device.Position;
 import com.genymobile.scrcpy.device.Size;
 import com.genymobile.scrcpy.util.Ln;
 import com.genymobile.scrcpy.util.LogUtils;
+import com.genymobile.scrcpy.video.BitRateAdapter;
+import com.genymobile.scrcpy.video.DisplayScreenshot;
+import com.genymobile.scrcpy.video.EncoderControl;
+import com.genymobile.scrcpy.video.LatencyProbe;
 import com.genymobile.scrcpy.video.SurfaceCapture;
+import com.genymobile.scrcpy.video.VideoSizeAdapter;
 import com.genymobile.scrcpy.video.VirtualDisplayListener;
 import com.genymobile.scrcpy.wrappers.ClipboardManager;
 import com.genymobile.scrcpy.wrappers.InputManager;
@@ -27,7 +32,12 @@ import android.view.KeyCharacterMap;
 import android.view.KeyEvent;
 import android.view.MotionEvent;
 
+import java.io.ByteArrayOutputStream;
 import java.io.IOException;
+import java.nio.charset.StandardCharsets;
+import java.security.MessageDigest;
+import java.security.NoSuchAlgorithmException;
+import java.util.Arrays;
 import java.util.List;
 import java.util.concurrent.ExecutorService;
 import java.util.concurrent.Executors;
@@ -35,6 +45,8 @@ import java.util.concurrent.ScheduledExecutorService;
 import java.util.concurrent.TimeUnit;
 import java.util.concurrent.atomic.AtomicBoolean;
 import java.util.concurrent.atomic.AtomicReference;
+import java.util.zip.DataFormatException;
+import java.util.zip.Inflater;
 
 public class Controller implements AsyncProcessor, VirtualDisplayListener {
 
@@ -70,6 +82,7 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
 
     private static final ScheduledExecutorService EXECUTOR = Executors.newSingleThreadScheduledExecutor();
     private ExecutorService startAppExecutor;
+    private ExecutorService screenshotExecutor;
 
     private Thread thread;
 
@@ -86,6 +99,10 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
     private final KeyCharacterMap charMap = KeyCharacterMap.load(KeyCharacterMap.VIRTUAL_KEYBOARD);
 
     private final AtomicBoolean isSettingClipboard = new AtomicBoolean();
+    // SHA-256 of the last clipboard content synchronized between the device and the computer, to never send an unchanged clipboard
+    private final AtomicReference<byte[]> syncedClipboardDigest = new AtomicReference<>();
+    // Chunks of the clipboard transfer in progress (TYPE_SET_CLIPBOARD_CHUNK)
+    private final ByteArrayOutputStream clipboardChunks = new ByteArrayOutputStream();
 
     private final AtomicReference<DisplayData> displayData = new AtomicReference<>();
     private final Object displayDataAvailable = new Object(); // condition variable
@@ -95,10 +112,21 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
     private final MotionEvent.PointerProperties[] pointerProperties = new MotionEvent.PointerProperties[PointersState.MAX_POINTERS];
     private final MotionEvent.PointerCoords[] pointerCoords = new MotionEvent.PointerCoords[PointersState.MAX_POINTERS];
 
+    // Duration of the last input event injection (in microseconds), for --measure-input-latency
+    private int lastInjectionDuration;
+
     private boolean keepDisplayPowerOff;
 
     // Used for resetting video encoding on RESET_VIDEO message
     private SurfaceCapture surfaceCapture;
+    // Used for adapting the video bit rate on VIDEO_FEEDBACK message
+    private BitRateAdapter bitRateAdapter;
+    // Used for adapting the video size on SET_VIEWPORT_SIZE message
+    private VideoSizeAdapter videoSizeAdapter;
+    // Used for requesting sync frames and region-of-interest encoding
+    private EncoderControl encoderControl;
+    // Used for drawing the latency probe pattern on LATENCY_PROBE message
+    private LatencyProbe latencyProbe;
 
     public Controller(ControlChannel controlChannel, CleanUp cleanUp, Options options) {
         this.displayId = options.getDisplayId();
@@ -126,6 +154,11 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
                     }
                     String text = Device.getClipboardText();
                     if (text != null) {
+                        byte[] digest = sha256(text);
+                        if (Arrays.equals(digest, syncedClipboardDigest.getAndSet(digest))) {
+                            // The computer already has this content
+                            return;
+                        }
                         DeviceMessage msg = DeviceMessage.createClipboard(text);
                         sender.send(msg);
                     }
@@ -152,6 +185,30 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
         this.surfaceCapture = surfaceCapture;
     }
 
+    public void setBitRateAdapter(BitRateAdapter bitRateAdapter) {
+        this.bitRateAdapter = bitRateAdapter;
+    }
+
+    public void setVideoSizeAdapter(VideoSizeAdapter videoSizeAdapter) {
+        this.videoSizeAdapter = videoSizeAdapter;
+    }
+
+    public void setEncoderControl(EncoderControl encoderControl) {
+        this.encoderControl = encoderControl;
+    }
+
+    public void setLatencyProbe(LatencyProbe latencyProbe) {
+        this.latencyProbe = latencyProbe;
+    }
+
+    public void onVideoIdleChanged(boolean idle) {
+        sender.send(DeviceMessage.createVideoIdle(idle));
+    }
+
+    public void onThermalStateChanged(int status, int headroomPercent, int level) {
+        sender.send(DeviceMessage.createThermalState(status, headroomPercent, level));
+    }
+
     private UhidManager getUhidManager() {
         if (uhidManager == null) {
             int uhidDisplayId = displayId;
@@ -264,6 +321,8 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
             return false;
         }
 
+        long received = System.nanoTime();
+
         switch (msg.getType()) {
             case ControlMessage.TYPE_INJECT_KEYCODE:
                 if (supportsInputEvents) {
@@ -280,6 +339,11 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
                     injectTouch(msg.getAction(), msg.getPointerId(), msg.getPosition(), msg.getPressure(), msg.getActionButton(), msg.getButtons());
                 }
                 break;
+            case ControlMessage.TYPE_INJECT_TOUCH_BATCH:
+                if (supportsInputEvents) {
+                    injectTouchBatch(msg.getPointerId(), msg.getPositions(), msg.getPressures(), msg.getSampleAges(), msg.getButtons());
+                }
+                break;
             case ControlMessage.TYPE_INJECT_SCROLL_EVENT:
                 if (supportsInputEvents) {
                     injectScroll(msg.getPosition(), msg.getHScroll(), msg.getVScroll(), msg.getButtons());
@@ -305,6 +369,9 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
             case ControlMessage.TYPE_SET_CLIPBOARD:
                 setClipboard(msg.getText(), msg.getPaste(), msg.getSequence());
                 break;
+            case ControlMessage.TYPE_SET_CLIPBOARD_CHUNK:
+                setClipboardChunk(msg.getSequence(), msg.getFlags(), msg.getData());
+                break;
             case ControlMessage.TYPE_SET_DISPLAY_POWER:
                 if (supportsInputEvents) {
                     setDisplayPower(msg.getOn());
@@ -328,16 +395,60 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
             case ControlMessage.TYPE_START_APP:
                 startAppAsync(msg.getText());
                 break;
+            case ControlMessage.TYPE_VIDEO_FEEDBACK:
+                if (bitRateAdapter != null) {
+                    bitRateAdapter.onFeedback(msg.getBitRate(), msg.getDelay(), msg.getBacklog());
+                }
+                break;
             case ControlMessage.TYPE_RESET_VIDEO:
                 resetVideo();
                 break;
+            case ControlMessage.TYPE_CAPTURE_SCREENSHOT:
+                captureScreenshotAsync();
+                break;
+            case ControlMessage.TYPE_SET_VIEWPORT_SIZE:
+                if (videoSizeAdapter != null) {
+                    videoSizeAdapter.onViewportSize(msg.getWidth(), msg.getHeight());
+                }
+                break;
+            case ControlMessage.TYPE_REQUEST_SYNC_FRAME:
+                if (encoderControl != null) {
+                    encoderControl.requestSyncFrame();
+                }
+                break;
+            case ControlMessage.TYPE_INPUT_PROBE:
+                // The messages are handled in order, so the input event preceding the probe has been injected
+                sender.send(DeviceMessage.createInputAck(msg.getSequence(), lastInjectionDuration));
+                break;
+            case ControlMessage.TYPE_LATENCY_PROBE:
+                if (latencyProbe != null) {
+                    latencyProbe.setCode(msg.getCode());
+                }
+                break;
             default:
                 // do nothing
         }
 
+        if (isInputEvent(msg.getType())) {
+            lastInjectionDuration = (int) ((System.nanoTime() - received) / 1000);
+        }
+
         return true;
     }
 
+    private static boolean isInputEvent(int type) {
+        switch (type) {
+            case ControlMessage.TYPE_INJECT_KEYCODE:
+            case ControlMessage.TYPE_INJECT_TEXT:
+            case ControlMessage.TYPE_INJECT_TOUCH_EVENT:
+            case ControlMessage.TYPE_INJECT_TOUCH_BATCH:
+            case ControlMessage.TYPE_INJECT_SCROLL_EVENT:
+                return true;
+            default:
+                return false;
+        }
+    }
+
     private boolean injectKeycode(int action, int keycode, int repeat, int metaState) {
         if (keepDisplayPowerOff && action == KeyEvent.ACTION_UP && (keycode == KeyEvent.KEYCODE_POWER || keycode == KeyEvent.KEYCODE_WAKEUP)) {
             assert displayId != Device.DISPLAY_ID_NONE;
@@ -346,6 +457,16 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
         return injectKeyEvent(action, keycode, repeat, metaState, Device.INJECT_MODE_ASYNC);
     }
 
+    private boolean injectKeyEvents(KeyEvent[] events) {
+        int actionDisplayId = getActionDisplayId();
+        for (KeyEvent event : events) {
+            if (!Device.injectEvent(event, actionDisplayId, Device.INJECT_MODE_ASYNC)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
     private boolean injectChar(char c) {
         String decomposed = KeyComposition.decompose(c);
         char[] chars = decomposed != null ? decomposed.toCharArray() : new char[]{c};
@@ -354,16 +475,39 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
             return false;
         }
 
-        int actionDisplayId = getActionDisplayId();
-        for (KeyEvent event : events) {
-            if (!Device.injectEvent(event, actionDisplayId, Device.INJECT_MODE_ASYNC)) {
-                return false;
+        return injectKeyEvents(events);
+    }
+
+    private static char[] decomposeText(String text) {
+        StringBuilder builder = new StringBuilder(text.length());
+        for (int i = 0; i < text.length(); ++i) {
+            char c = text.charAt(i);
+            String decomposed = KeyComposition.decompose(c);
+            if (decomposed != null) {
+                builder.append(decomposed);
+            } else {
+                builder.append(c);
             }
         }
-        return true;
+        char[] chars = new char[builder.length()];
+        builder.getChars(0, chars.length, chars, 0);
+        return chars;
     }
 
     private int injectText(String text) {
+        if (text.length() > 1) {
+            // A single lookup for the whole text (typically several characters merged by the client), whose events are injected back to back
+            KeyEvent[] events = charMap.getEvents(decomposeText(text));
+            if (events != null) {
+                if (!injectKeyEvents(events)) {
+                    Ln.w("Could not inject text");
+                    return 0;
+                }
+                return text.length();
+            }
+            // Some characters cannot be generated, inject them one by one to inject the others
+        }
+
         int successCount = 0;
         for (char c : text.toCharArray()) {
             if (!injectChar(c)) {
@@ -408,6 +552,10 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
     private boolean injectTouch(int action, long pointerId, Position position, float pressure, int actionButton, int buttons) {
         long now = SystemClock.uptimeMillis();
 
+        if (encoderControl != null) {
+            encoderControl.onPointer(position);
+        }
+
         Pair<Point, Integer> pair = getEventPointAndDisplayId(position);
         if (pair == null) {
             return false;
@@ -516,6 +664,66 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
         return Device.injectEvent(event, targetDisplayId, Device.INJECT_MODE_ASYNC);
     }
 
+    /**
+     * Inject successive moves of a single pointer as one MotionEvent, the previous samples being added as historical data.
+     */
+    private boolean injectTouchBatch(long pointerId, Position[] positions, float[] pressures, int[] sampleAges, int buttons) {
+        long now = SystemClock.uptimeMillis();
+
+        if (encoderControl != null) {
+            encoderControl.onPointer(positions[positions.length - 1]);
+        }
+
+        int pointerIndex = pointersState.getPointerIndex(pointerId);
+        if (pointerIndex == -1) {
+            Ln.w("Too many pointers for touch event");
+            return false;
+        }
+        Pointer pointer = pointersState.get(pointerIndex);
+
+        int source;
+        if (pointerId == POINTER_ID_MOUSE && (buttons & ~MotionEvent.BUTTON_PRIMARY) != 0) {
+            // event incompatible with a finger
+            pointerProperties[pointerIndex].toolType = MotionEvent.TOOL_TYPE_MOUSE;
+            source = InputDevice.SOURCE_MOUSE;
+        } else {
+            pointerProperties[pointerIndex].toolType = MotionEvent.TOOL_TYPE_FINGER;
+            source = InputDevice.SOURCE_TOUCHSCREEN;
+            // Buttons must not be set for touch events
+            buttons = 0;
+        }
+
+        MotionEvent event = null;
+        int targetDisplayId = Device.DISPLAY_ID_NONE;
+        for (int i = 0; i < positions.length; ++i) {
+            Pair<Point, Integer> pair = getEventPointAndDisplayId(positions[i]);
+            if (pair == null) {
+                // All the samples have the same screen size, so they would all be ignored
+                break;
+            }
+
+            pointer.setPoint(pair.first);
+            pointer.setPressure(pressures[i]);
+            int pointerCount = pointersState.update(pointerProperties, pointerCoords);
+
+            // The samples are in chronological order, the last one is the most recent
+            long eventTime = Math.max(lastTouchDown, now - sampleAges[i] / 1000);
+            if (event == null) {
+                event = MotionEvent.obtain(lastTouchDown, eventTime, MotionEvent.ACTION_MOVE, pointerCount, pointerProperties, pointerCoords, 0,
+                        buttons, 1f, 1f, DEFAULT_DEVICE_ID, 0, source, 0);
+                targetDisplayId = pair.second;
+            } else {
+                event.addBatch(eventTime, pointerCoords, 0);
+            }
+        }
+
+        if (event == null) {
+            return false;
+        }
+
+        return Device.injectEvent(event, targetDisplayId, Device.INJECT_MODE_ASYNC);
+    }
+
     private boolean injectScroll(Position position, float hScroll, float vScroll, int buttons) {
         long now = SystemClock.uptimeMillis();
 
@@ -584,6 +792,7 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
         if (!clipboardAutosync) {
             String clipboardText = Device.getClipboardText();
             if (clipboardText != null) {
+                syncedClipboardDigest.set(sha256(clipboardText));
                 DeviceMessage msg = DeviceMessage.createClipboard(clipboardText);
                 sender.send(msg);
             }
@@ -595,6 +804,7 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
         boolean ok = Device.setClipboardText(text);
         isSettingClipboard.set(false);
         if (ok) {
+            syncedClipboardDigest.set(sha256(text));
             Ln.i("Device clipboard set");
         }
 
@@ -612,6 +822,70 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
         return ok;
     }
 
+    private void setClipboardChunk(long sequence, int flags, byte[] data) {
+        if ((flags & ControlMessage.CLIPBOARD_CHUNK_FLAG_FIRST) != 0) {
+            // A new transfer replaces any previous incomplete one
+            clipboardChunks.reset();
+        }
+
+        if (clipboardChunks.size() + data.length > ControlMessageReader.CLIPBOARD_TEXT_MAX_LENGTH) {
+            Ln.w("Clipboard transfer too big, ignored");
+            clipboardChunks.reset();
+            return;
+        }
+        clipboardChunks.write(data, 0, data.length);
+
+        if ((flags & ControlMessage.CLIPBOARD_CHUNK_FLAG_LAST) == 0) {
+            return;
+        }
+
+        byte[] payload = clipboardChunks.toByteArray();
+        clipboardChunks.reset();
+
+        if ((flags & ControlMessage.CLIPBOARD_CHUNK_FLAG_DEFLATE) != 0) {
+            try {
+                payload = inflate(payload, ControlMessageReader.CLIPBOARD_TEXT_MAX_LENGTH);
+            } catch (DataFormatException e) {
+                Ln.w("Could not decompress clipboard: " + e.getMessage());
+                return;
+            }
+        }
+
+        String text = new String(payload, StandardCharsets.UTF_8);
+        boolean paste = (flags & ControlMessage.CLIPBOARD_CHUNK_FLAG_PASTE) != 0;
+        setClipboard(text, paste, sequence);
+    }
+
+    private static byte[] inflate(byte[] data, int maxLength) throws DataFormatException {
+        Inflater inflater = new Inflater();
+        try {
+            inflater.setInput(data);
+            ByteArrayOutputStream out = new ByteArrayOutputStream(data.length * 4);
+            byte[] buffer = new byte[8192];
+            while (!inflater.finished()) {
+                int r = inflater.inflate(buffer);
+                if (r == 0 && (inflater.needsInput() || inflater.needsDictionary())) {
+                    throw new DataFormatException("Truncated data");
+                }
+                if (out.size() + r > maxLength) {
+                    throw new DataFormatException("Decompressed data too big");
+                }
+                out.write(buffer, 0, r);
+            }
+            return out.toByteArray();
+        } finally {
+            inflater.end();
+        }
+    }
+
+    private static byte[] sha256(String text) {
+        try {
+            return MessageDigest.getInstance("SHA-256").digest(text.getBytes(StandardCharsets.UTF_8));
+        } catch (NoSuchAlgorithmException e) {
+            throw new AssertionError("SHA-256 not available", e);
+        }
+    }
+
     private void openHardKeyboardSettings() {
         Intent intent = new Intent("android.settings.HARD_KEYBOARD_SETTINGS");
         ServiceManager.getActivityManager().startActivity(intent);
@@ -650,6 +924,29 @@ public class Controller implements AsyncProcessor, VirtualDisplayListener {
         startAppExecutor.submit(() -> startApp(name));
     }
 
+    private void captureScreenshotAsync() {
+        if (screenshotExecutor == null) {
+            screenshotExecutor = Executors.newSingleThreadExecutor();
+        }
+
+        // Do not block the processing of the following control messages
+        int screenshotDisplayId = getActionDisplayId();
+        screenshotExecutor.submit(() -> captureScreenshot(screenshotDisplayId));
+    }
+
+    private void captureScreenshot(int screenshotDisplayId) {
+        byte[] png;
+        try {
+            png = DisplayScreenshot.capture(screenshotDisplayId);
+            Ln.i("Screenshot captured (" + png.length + " bytes)");
+        } catch (IOException e) {
+            Ln.e("Could not capture screenshot", e);
+            // An empty image notifies the client of the failure
+            png = new byte[0];
+        }
+        sender.send(DeviceMessage.createScreenshot(png));
+    }
+
     private void startApp(String name) {
         boolean forceStopBeforeStart = name.startsWith("+");
         if (forceStopBeforeStart) {
@@ -5,12 +5,21 @@ public final class DeviceMessage {
     public static final int TYPE_CLIPBOARD = 0;
     public static final int TYPE_ACK_CLIPBOARD = 1;
     public static final int TYPE_UHID_OUTPUT = 2;
+    public static final int TYPE_VIDEO_IDLE = 3;
+    public static final int TYPE_INPUT_ACK = 4;
+    public static final int TYPE_SCREENSHOT_CHUNK = 5;
+    public static final int TYPE_THERMAL_STATE = 6;
 
     private int type;
     private String text;
     private long sequence;
     private int id;
     private byte[] data;
+    private boolean idle;
+    private int injectionDuration; // in microseconds
+    private int thermalStatus;
+    private int thermalHeadroom; // in percent, -1 if unknown
+    private int thermalLevel;
 
     private DeviceMessage() {
     }
@@ -37,6 +46,38 @@ public final class DeviceMessage {
         return event;
     }
 
+    public static DeviceMessage createVideoIdle(boolean idle) {
+        DeviceMessage event = new DeviceMessage();
+        event.type = TYPE_VIDEO_IDLE;
+        event.idle = idle;
+        return event;
+    }
+
+    public static DeviceMessage createInputAck(long sequence, int injectionDuration) {
+        DeviceMessage event = new DeviceMessage();
+        event.type = TYPE_INPUT_ACK;
+        event.sequence = sequence;
+        event.injectionDuration = injectionDuration;
+        return event;
+    }
+
+    // The whole image is stored in a single message, split into chunks on writing
+    public static DeviceMessage createScreenshot(byte[] png) {
+        DeviceMessage event = new DeviceMessage();
+        event.type = TYPE_SCREENSHOT_CHUNK;
+        event.data = png;
+        return event;
+    }
+
+    public static DeviceMessage createThermalState(int status, int headroomPercent, int level) {
+        DeviceMessage event = new DeviceMessage();
+        event.type = TYPE_THERMAL_STATE;
+        event.thermalStatus = status;
+        event.thermalHeadroom = headroomPercent;
+        event.thermalLevel = level;
+        return event;
+    }
+
     public int getType() {
         return type;
     }
@@ -56,4 +97,24 @@ public final class DeviceMessage {
     public byte[] getData() {
         return data;
     }
+
+    public boolean isIdle() {
+        return idle;
+    }
+
+    public int getInjectionDuration() {
+        return injectionDuration;
+    }
+
+    public int getThermalStatus() {
+        return thermalStatus;
+    }
+
+    public int getThermalHeadroom() {
+        return thermalHeadroom;
+    }
+
+    public int getThermalLevel() {
+        return thermalLevel;
+    }
 }
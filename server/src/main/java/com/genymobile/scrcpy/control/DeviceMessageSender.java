@@ -3,29 +3,67 @@ package com.genymobile.scrcpy.control;
 import com.genymobile.scrcpy.util.Ln;
 
 import java.io.IOException;
-import java.util.concurrent.ArrayBlockingQueue;
-import java.util.concurrent.BlockingQueue;
+import java.util.Iterator;
+import java.util.LinkedList;
 
 public final class DeviceMessageSender {
 
     private final ControlChannel controlChannel;
 
+    private static final int MAX_PENDING = 16;
+
     private Thread thread;
-    private final BlockingQueue<DeviceMessage> queue = new ArrayBlockingQueue<>(16);
+    private final LinkedList<DeviceMessage> queue = new LinkedList<>(); // guarded by this
 
     public DeviceMessageSender(ControlChannel controlChannel) {
         this.controlChannel = controlChannel;
     }
 
-    public void send(DeviceMessage msg) {
-        if (!queue.offer(msg)) {
+    /**
+     * Queue a message to be sent to the client, without blocking.
+     * <p>
+     * A pending message superseded by {@code msg} (the previous clipboard content, or the previous UHID output of the same device) is
+     * discarded, so that a burst of such messages (or a large clipboard) cannot fill the queue.
+     */
+    public synchronized void send(DeviceMessage msg) {
+        if (!removeSuperseded(msg) && queue.size() >= MAX_PENDING) {
             Ln.w("Device message dropped: " + msg.getType());
+            return;
+        }
+
+        // Append the new message (rather than replacing the old one in place) to preserve its order relative to the other messages
+        queue.addLast(msg);
+        notify();
+    }
+
+    private boolean removeSuperseded(DeviceMessage msg) {
+        int type = msg.getType();
+        if (type != DeviceMessage.TYPE_CLIPBOARD && type != DeviceMessage.TYPE_UHID_OUTPUT) {
+            return false;
+        }
+
+        Iterator<DeviceMessage> it = queue.iterator();
+        while (it.hasNext()) {
+            DeviceMessage pending = it.next();
+            if (pending.getType() == type && (type == DeviceMessage.TYPE_CLIPBOARD || pending.getId() == msg.getId())) {
+                it.remove();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    private synchronized DeviceMessage take() throws InterruptedException {
+        while (queue.isEmpty()) {
+            wait();
         }
+        return queue.removeFirst();
     }
 
     private void loop() throws IOException, InterruptedException {
         while (!Thread.currentThread().isInterrupted()) {
-            DeviceMessage msg = queue.take();
+            DeviceMessage msg = take();
             controlChannel.send(msg);
         }
     }
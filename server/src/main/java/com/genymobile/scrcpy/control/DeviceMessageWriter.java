@@ -12,6 +12,10 @@ public class DeviceMessageWriter {
 
     private static final int MESSAGE_MAX_SIZE = 1 << 18; // 256k
     public static final int CLIPBOARD_TEXT_MAX_LENGTH = MESSAGE_MAX_SIZE - 5; // type: 1 byte; length: 4 bytes
+    public static final int SCREENSHOT_CHUNK_SIZE = 1 << 16; // 64k
+
+    public static final int SCREENSHOT_CHUNK_FLAG_FIRST = 1;
+    public static final int SCREENSHOT_CHUNK_FLAG_LAST = 2;
 
     private final DataOutputStream dos;
 
@@ -21,6 +25,11 @@ public class DeviceMessageWriter {
 
     public void write(DeviceMessage msg) throws IOException {
         int type = msg.getType();
+        if (type == DeviceMessage.TYPE_SCREENSHOT_CHUNK) {
+            writeScreenshot(msg.getData());
+            return;
+        }
+
         dos.writeByte(type);
         switch (type) {
             case DeviceMessage.TYPE_CLIPBOARD:
@@ -39,9 +48,42 @@ public class DeviceMessageWriter {
                 dos.writeShort(data.length);
                 dos.write(data);
                 break;
+            case DeviceMessage.TYPE_VIDEO_IDLE:
+                dos.writeBoolean(msg.isIdle());
+                break;
+            case DeviceMessage.TYPE_INPUT_ACK:
+                dos.writeLong(msg.getSequence());
+                dos.writeInt(msg.getInjectionDuration());
+                break;
+            case DeviceMessage.TYPE_THERMAL_STATE:
+                dos.writeByte(msg.getThermalStatus());
+                dos.writeByte(msg.getThermalLevel());
+                dos.writeShort(msg.getThermalHeadroom());
+                break;
             default:
                 throw new ControlProtocolException("Unknown event type: " + type);
         }
         dos.flush();
     }
+
+    private void writeScreenshot(byte[] png) throws IOException {
+        // An empty image (a single empty chunk) reports a failure
+        int offset = 0;
+        do {
+            int len = Math.min(png.length - offset, SCREENSHOT_CHUNK_SIZE);
+            int flags = 0;
+            if (offset == 0) {
+                flags |= SCREENSHOT_CHUNK_FLAG_FIRST;
+            }
+            if (offset + len == png.length) {
+                flags |= SCREENSHOT_CHUNK_FLAG_LAST;
+            }
+            dos.writeByte(DeviceMessage.TYPE_SCREENSHOT_CHUNK);
+            dos.writeByte(flags);
+            dos.writeInt(len);
+            dos.write(png, offset, len);
+            offset += len;
+        } while (offset < png.length);
+        dos.flush();
+    }
 }
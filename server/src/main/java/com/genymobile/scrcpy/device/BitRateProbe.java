@@ -0,0 +1,64 @@
+package com.genymobile.scrcpy.device;
+
+import com.genymobile.scrcpy.util.IO;
+
+import java.io.FileDescriptor;
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.util.Random;
+
+/**
+ * Startup throughput probe (--video-bit-rate=auto on the client).
+ * <p>
+ * Send a burst of random (incompressible) data on the video socket, so that the client measures the throughput, then read the video bit rate
+ * and max size chosen by the client.
+ */
+public final class BitRateProbe {
+
+    // Large enough to fill the socket buffers and measure the actual link throughput, small enough to not delay the startup too much on a slow
+    // link (about 0.4 second at 10 Mbps)
+    private static final int PROBE_SIZE = 512 * 1024;
+
+    private static final int REPLY_SIZE = 6; // bit rate (4 bytes) and max size (2 bytes)
+
+    private final int bitRate;
+    private final int maxSize;
+
+    private BitRateProbe(int bitRate, int maxSize) {
+        this.bitRate = bitRate;
+        this.maxSize = maxSize;
+    }
+
+    public int getBitRate() {
+        return bitRate;
+    }
+
+    /**
+     * Return the max size chosen by the client, or 0 to keep the current value.
+     */
+    public int getMaxSize() {
+        return maxSize;
+    }
+
+    public static BitRateProbe run(FileDescriptor fd) throws IOException {
+        byte[] data = new byte[PROBE_SIZE];
+        new Random().nextBytes(data);
+
+        ByteBuffer probe = ByteBuffer.allocate(4 + PROBE_SIZE);
+        probe.putInt(PROBE_SIZE);
+        probe.put(data);
+        probe.flip();
+        IO.writeFully(fd, probe);
+
+        ByteBuffer reply = ByteBuffer.allocate(REPLY_SIZE);
+        IO.readFully(fd, reply);
+        reply.flip();
+
+        int bitRate = reply.getInt();
+        int maxSize = reply.getShort() & 0xFFFF;
+        if (bitRate <= 0) {
+            throw new IOException("Invalid video bit rate from the throughput probe: " + bitRate);
+        }
+        return new BitRateProbe(bitRate, maxSize);
+    }
+}
@@ -2,16 +2,28 @@ package com.genymobile.scrcpy.device;
 
 import com.genymobile.scrcpy.control.ControlChannel;
 import com.genymobile.scrcpy.util.IO;
+import com.genymobile.scrcpy.util.Ln;
 import com.genymobile.scrcpy.util.StringUtils;
 
 import android.net.LocalServerSocket;
 import android.net.LocalSocket;
 import android.net.LocalSocketAddress;
+import android.os.ParcelFileDescriptor;
+import android.system.ErrnoException;
+import android.system.Os;
+import android.system.OsConstants;
 
 import java.io.Closeable;
+import java.io.DataInputStream;
 import java.io.FileDescriptor;
+import java.io.FileInputStream;
+import java.io.FileOutputStream;
 import java.io.IOException;
+import java.net.ServerSocket;
+import java.net.Socket;
 import java.nio.charset.StandardCharsets;
+import java.util.ArrayList;
+import java.util.List;
 
 public final class DesktopConnection implements Closeable {
 
@@ -19,23 +31,122 @@ public final class DesktopConnection implements Closeable {
 
     private static final String SOCKET_NAME_PREFIX = "scrcpy";
 
-    private final LocalSocket videoSocket;
+    // Time for a client connected to the direct port to send its token
+    private static final int DIRECT_TOKEN_TIMEOUT_MS = 5000;
+
+    // Either a LocalSocket (through adb) or a DirectSocket (--direct-port)
+    private final Closeable videoSocket;
     private final FileDescriptor videoFd;
 
-    private final LocalSocket audioSocket;
+    private final Closeable audioSocket;
     private final FileDescriptor audioFd;
 
-    private final LocalSocket controlSocket;
+    private final Closeable controlSocket;
+    private final FileDescriptor controlFd;
     private final ControlChannel controlChannel;
 
+    // In multiplexed mode, the single socket carrying all the streams (the other sockets are null, and the fds are local socket pairs)
+    private final Closeable muxSocket;
+    private final FileDescriptor muxFd;
+    private final Multiplexer multiplexer;
+    private final List<FileDescriptor> pairFds = new ArrayList<>();
+
+    /**
+     * A TCP socket accepted on the direct port, along with a duplicate of its file descriptor (java.net.Socket does not expose it).
+     */
+    private static final class DirectSocket implements Closeable {
+        private final Socket socket;
+        private final ParcelFileDescriptor pfd;
+
+        DirectSocket(Socket socket) throws IOException {
+            this.socket = socket;
+            pfd = ParcelFileDescriptor.fromSocket(socket);
+        }
+
+        @Override
+        public void close() throws IOException {
+            pfd.close();
+            socket.close();
+        }
+    }
+
     private DesktopConnection(LocalSocket videoSocket, LocalSocket audioSocket, LocalSocket controlSocket) throws IOException {
+        muxSocket = null;
+        muxFd = null;
+        multiplexer = null;
+
         this.videoSocket = videoSocket;
         this.audioSocket = audioSocket;
         this.controlSocket = controlSocket;
 
         videoFd = videoSocket != null ? videoSocket.getFileDescriptor() : null;
         audioFd = audioSocket != null ? audioSocket.getFileDescriptor() : null;
-        controlChannel = controlSocket != null ? new ControlChannel(controlSocket) : null;
+        controlFd = controlSocket != null ? controlSocket.getFileDescriptor() : null;
+        controlChannel = controlSocket != null ? new ControlChannel(controlSocket.getInputStream(), controlSocket.getOutputStream()) : null;
+    }
+
+    private DesktopConnection(DirectSocket videoSocket, DirectSocket audioSocket, DirectSocket controlSocket) throws IOException {
+        muxSocket = null;
+        muxFd = null;
+        multiplexer = null;
+
+        this.videoSocket = videoSocket;
+        this.audioSocket = audioSocket;
+        this.controlSocket = controlSocket;
+
+        videoFd = videoSocket != null ? videoSocket.pfd.getFileDescriptor() : null;
+        audioFd = audioSocket != null ? audioSocket.pfd.getFileDescriptor() : null;
+        controlFd = controlSocket != null ? controlSocket.pfd.getFileDescriptor() : null;
+        controlChannel = controlSocket != null
+                ? new ControlChannel(controlSocket.socket.getInputStream(), controlSocket.socket.getOutputStream()) : null;
+    }
+
+    private DesktopConnection(Closeable muxSocket, FileDescriptor muxFd, boolean video, boolean audio, boolean control) throws IOException {
+        this.muxSocket = muxSocket;
+        this.muxFd = muxFd;
+        multiplexer = new Multiplexer(muxFd);
+
+        videoSocket = null;
+        audioSocket = null;
+        controlSocket = null;
+
+        try {
+            videoFd = video ? createStreamPair(Multiplexer.STREAM_VIDEO) : null;
+            audioFd = audio ? createStreamPair(Multiplexer.STREAM_AUDIO) : null;
+            controlFd = control ? createStreamPair(Multiplexer.STREAM_CONTROL) : null;
+        } catch (IOException e) {
+            closePairs();
+            throw e;
+        }
+        controlChannel = controlFd != null ? new ControlChannel(new FileInputStream(controlFd), new FileOutputStream(controlFd)) : null;
+    }
+
+    /**
+     * Create a local socket pair for a multiplexed stream, and return the end to use by the server.
+     */
+    private FileDescriptor createStreamPair(int stream) throws IOException {
+        FileDescriptor fd = new FileDescriptor();
+        FileDescriptor internalFd = new FileDescriptor();
+        try {
+            Os.socketpair(OsConstants.AF_UNIX, OsConstants.SOCK_STREAM, 0, fd, internalFd);
+        } catch (ErrnoException e) {
+            throw new IOException(e);
+        }
+        pairFds.add(fd);
+        pairFds.add(internalFd);
+        multiplexer.addOutput(stream, internalFd);
+        return fd;
+    }
+
+    private void closePairs() {
+        for (FileDescriptor fd : pairFds) {
+            try {
+                Os.close(fd);
+            } catch (ErrnoException e) {
+                Ln.w("Could not close socket pair", e);
+            }
+        }
+        pairFds.clear();
     }
 
     private static LocalSocket connect(String abstractName) throws IOException {
@@ -53,94 +164,265 @@ public final class DesktopConnection implements Closeable {
         return SOCKET_NAME_PREFIX + String.format("_%08x", scid);
     }
 
-    public static DesktopConnection open(int scid, boolean tunnelForward, boolean video, boolean audio, boolean control, boolean sendDummyByte)
-            throws IOException {
+    public static DesktopConnection open(int scid, boolean tunnelForward, boolean video, boolean audio, boolean control, boolean multiplex,
+            boolean sendDummyByte) throws IOException {
+        if (tunnelForward) {
+            try (LocalServerSocket localServerSocket = listen(scid)) {
+                return accept(localServerSocket, video, audio, control, multiplex, sendDummyByte);
+            }
+        }
+
         String socketName = getSocketName(scid);
 
+        if (multiplex) {
+            LocalSocket muxSocket = connect(socketName);
+            return createMultiplexed(muxSocket, muxSocket.getFileDescriptor(), video, audio, control);
+        }
+
         LocalSocket videoSocket = null;
         LocalSocket audioSocket = null;
         LocalSocket controlSocket = null;
         try {
-            if (tunnelForward) {
-                try (LocalServerSocket localServerSocket = new LocalServerSocket(socketName)) {
-                    if (video) {
-                        videoSocket = localServerSocket.accept();
-                        if (sendDummyByte) {
-                            // send one byte so the client may read() to detect a connection error
-                            videoSocket.getOutputStream().write(0);
-                            sendDummyByte = false;
-                        }
-                    }
-                    if (audio) {
-                        audioSocket = localServerSocket.accept();
-                        if (sendDummyByte) {
-                            // send one byte so the client may read() to detect a connection error
-                            audioSocket.getOutputStream().write(0);
-                            sendDummyByte = false;
-                        }
-                    }
-                    if (control) {
-                        controlSocket = localServerSocket.accept();
-                        if (sendDummyByte) {
-                            // send one byte so the client may read() to detect a connection error
-                            controlSocket.getOutputStream().write(0);
-                            sendDummyByte = false;
-                        }
-                    }
+            if (video) {
+                videoSocket = connect(socketName);
+            }
+            if (audio) {
+                audioSocket = connect(socketName);
+            }
+            if (control) {
+                controlSocket = connect(socketName);
+            }
+        } catch (IOException | RuntimeException e) {
+            closeAll(videoSocket, audioSocket, controlSocket);
+            throw e;
+        }
+
+        return new DesktopConnection(videoSocket, audioSocket, controlSocket);
+    }
+
+    /**
+     * Create the server socket for "adb forward" tunnels.
+     * <p>
+     * It may be kept open to accept several successive connections (see {@link #accept(LocalServerSocket, boolean, boolean, boolean, boolean,
+     * boolean)}).
+     */
+    public static LocalServerSocket listen(int scid) throws IOException {
+        return new LocalServerSocket(getSocketName(scid));
+    }
+
+    public static DesktopConnection accept(LocalServerSocket localServerSocket, boolean video, boolean audio, boolean control, boolean multiplex,
+            boolean sendDummyByte) throws IOException {
+        if (multiplex) {
+            LocalSocket muxSocket = localServerSocket.accept();
+            try {
+                if (sendDummyByte) {
+                    // send one byte so the client may read() to detect a connection error
+                    muxSocket.getOutputStream().write(0);
                 }
-            } else {
-                if (video) {
-                    videoSocket = connect(socketName);
+            } catch (IOException | RuntimeException e) {
+                muxSocket.close();
+                throw e;
+            }
+            return createMultiplexed(muxSocket, muxSocket.getFileDescriptor(), video, audio, control);
+        }
+
+        LocalSocket videoSocket = null;
+        LocalSocket audioSocket = null;
+        LocalSocket controlSocket = null;
+        try {
+            if (video) {
+                videoSocket = localServerSocket.accept();
+                if (sendDummyByte) {
+                    // send one byte so the client may read() to detect a connection error
+                    videoSocket.getOutputStream().write(0);
+                    sendDummyByte = false;
                 }
-                if (audio) {
-                    audioSocket = connect(socketName);
+            }
+            if (audio) {
+                audioSocket = localServerSocket.accept();
+                if (sendDummyByte) {
+                    // send one byte so the client may read() to detect a connection error
+                    audioSocket.getOutputStream().write(0);
+                    sendDummyByte = false;
                 }
-                if (control) {
-                    controlSocket = connect(socketName);
+            }
+            if (control) {
+                controlSocket = localServerSocket.accept();
+                if (sendDummyByte) {
+                    // send one byte so the client may read() to detect a connection error
+                    controlSocket.getOutputStream().write(0);
+                    sendDummyByte = false;
                 }
             }
         } catch (IOException | RuntimeException e) {
-            if (videoSocket != null) {
-                videoSocket.close();
+            closeAll(videoSocket, audioSocket, controlSocket);
+            throw e;
+        }
+
+        return new DesktopConnection(videoSocket, audioSocket, controlSocket);
+    }
+
+    /**
+     * Accept the connections directly on a TCP port of the device, without any adb tunnel.
+     * <p>
+     * Each connection must start with the 64-bit token passed by the client on the command line (through adb), any other connection is
+     * rejected.
+     */
+    public static DesktopConnection acceptDirect(int port, long token, boolean video, boolean audio, boolean control, boolean multiplex,
+            boolean sendDummyByte) throws IOException {
+        if (multiplex) {
+            DirectSocket muxSocket;
+            try (ServerSocket serverSocket = new ServerSocket(port)) {
+                muxSocket = acceptDirectSocket(serverSocket, token);
             }
-            if (audioSocket != null) {
-                audioSocket.close();
+            try {
+                if (sendDummyByte) {
+                    // send one byte so the client may read() to detect a connection error
+                    muxSocket.socket.getOutputStream().write(0);
+                }
+                // Disable Nagle's algorithm for the device messages
+                muxSocket.socket.setTcpNoDelay(true);
+            } catch (IOException | RuntimeException e) {
+                muxSocket.close();
+                throw e;
             }
-            if (controlSocket != null) {
-                controlSocket.close();
+            return createMultiplexed(muxSocket, muxSocket.pfd.getFileDescriptor(), video, audio, control);
+        }
+
+        DirectSocket videoSocket = null;
+        DirectSocket audioSocket = null;
+        DirectSocket controlSocket = null;
+        try (ServerSocket serverSocket = new ServerSocket(port)) {
+            if (video) {
+                videoSocket = acceptDirectSocket(serverSocket, token);
+                if (sendDummyByte) {
+                    // send one byte so the client may read() to detect a connection error
+                    videoSocket.socket.getOutputStream().write(0);
+                    sendDummyByte = false;
+                }
+            }
+            if (audio) {
+                audioSocket = acceptDirectSocket(serverSocket, token);
+                if (sendDummyByte) {
+                    // send one byte so the client may read() to detect a connection error
+                    audioSocket.socket.getOutputStream().write(0);
+                    sendDummyByte = false;
+                }
             }
+            if (control) {
+                controlSocket = acceptDirectSocket(serverSocket, token);
+                if (sendDummyByte) {
+                    // send one byte so the client may read() to detect a connection error
+                    controlSocket.socket.getOutputStream().write(0);
+                    sendDummyByte = false;
+                }
+                // Disable Nagle's algorithm for the device messages
+                controlSocket.socket.setTcpNoDelay(true);
+            }
+        } catch (IOException | RuntimeException e) {
+            closeAll(videoSocket, audioSocket, controlSocket);
             throw e;
         }
 
         return new DesktopConnection(videoSocket, audioSocket, controlSocket);
     }
 
-    private LocalSocket getFirstSocket() {
-        if (videoSocket != null) {
-            return videoSocket;
+    private static DesktopConnection createMultiplexed(Closeable muxSocket, FileDescriptor muxFd, boolean video, boolean audio, boolean control)
+            throws IOException {
+        try {
+            return new DesktopConnection(muxSocket, muxFd, video, audio, control);
+        } catch (IOException | RuntimeException e) {
+            muxSocket.close();
+            throw e;
         }
-        if (audioSocket != null) {
-            return audioSocket;
+    }
+
+    private static DirectSocket acceptDirectSocket(ServerSocket serverSocket, long token) throws IOException {
+        while (true) {
+            Socket socket = serverSocket.accept();
+            boolean accepted = false;
+            try {
+                socket.setSoTimeout(DIRECT_TOKEN_TIMEOUT_MS);
+                accepted = new DataInputStream(socket.getInputStream()).readLong() == token;
+                socket.setSoTimeout(0);
+            } catch (IOException e) {
+                // timeout or connection closed, rejected below
+            }
+
+            if (accepted) {
+                try {
+                    return new DirectSocket(socket);
+                } catch (IOException | RuntimeException e) {
+                    socket.close();
+                    throw e;
+                }
+            }
+
+            Ln.w("Rejected connection from " + socket.getRemoteSocketAddress());
+            socket.close();
         }
-        return controlSocket;
     }
 
-    public void shutdown() throws IOException {
+    private static void closeAll(Closeable videoSocket, Closeable audioSocket, Closeable controlSocket) throws IOException {
         if (videoSocket != null) {
-            videoSocket.shutdownInput();
-            videoSocket.shutdownOutput();
+            videoSocket.close();
         }
         if (audioSocket != null) {
-            audioSocket.shutdownInput();
-            audioSocket.shutdownOutput();
+            audioSocket.close();
         }
         if (controlSocket != null) {
-            controlSocket.shutdownInput();
-            controlSocket.shutdownOutput();
+            controlSocket.close();
+        }
+    }
+
+    private FileDescriptor getFirstFd() {
+        if (muxFd != null) {
+            return muxFd;
+        }
+        if (videoFd != null) {
+            return videoFd;
+        }
+        if (audioFd != null) {
+            return audioFd;
+        }
+        return controlFd;
+    }
+
+    private static void shutdown(FileDescriptor fd) throws IOException {
+        try {
+            Os.shutdown(fd, OsConstants.SHUT_RDWR);
+        } catch (ErrnoException e) {
+            throw new IOException(e);
+        }
+    }
+
+    public void shutdown() throws IOException {
+        if (muxFd != null) {
+            // Also unblocks the multiplexer threads
+            shutdown(muxFd);
+        }
+        if (videoFd != null) {
+            shutdown(videoFd);
+        }
+        if (audioFd != null) {
+            shutdown(audioFd);
+        }
+        if (controlFd != null) {
+            shutdown(controlFd);
         }
     }
 
     public void close() throws IOException {
+        if (multiplexer != null) {
+            // The socket pairs must not be closed while they are used by the multiplexer threads
+            try {
+                multiplexer.join();
+            } catch (InterruptedException e) {
+                // ignore
+            }
+            closePairs();
+            muxSocket.close();
+        }
         if (videoSocket != null) {
             videoSocket.close();
         }
@@ -160,14 +442,46 @@ public final class DesktopConnection implements Closeable {
         System.arraycopy(deviceNameBytes, 0, buffer, 0, len);
         // byte[] are always 0-initialized in java, no need to set '\0' explicitly
 
-        FileDescriptor fd = getFirstSocket().getFileDescriptor();
+        FileDescriptor fd = getFirstFd();
         IO.writeFully(fd, buffer, 0, buffer.length);
     }
 
+    /**
+     * Start forwarding the streams over the single socket in multiplexed mode (no-op otherwise).
+     * <p>
+     * The device meta and the throughput probe, if any, are exchanged on the socket before.
+     */
+    public void startMultiplexer() {
+        if (multiplexer != null) {
+            multiplexer.start();
+        }
+    }
+
+    /**
+     * Set the size of the kernel send buffer of the video socket (SO_SNDBUF).
+     * <p>
+     * In multiplexed mode, it applies to the socket shared by all the streams.
+     */
+    public void setVideoSendBufferSize(int size) throws IOException {
+        assert videoFd != null;
+        try {
+            Os.setsockoptInt(muxFd != null ? muxFd : videoFd, OsConstants.SOL_SOCKET, OsConstants.SO_SNDBUF, size);
+        } catch (ErrnoException e) {
+            throw new IOException(e);
+        }
+    }
+
     public FileDescriptor getVideoFd() {
         return videoFd;
     }
 
+    /**
+     * Return the socket to run the throughput probe on (before the streams are multiplexed).
+     */
+    public FileDescriptor getBitRateProbeFd() {
+        return muxFd != null ? muxFd : videoFd;
+    }
+
     public FileDescriptor getAudioFd() {
         return audioFd;
     }
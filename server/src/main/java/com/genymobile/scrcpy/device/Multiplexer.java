@@ -0,0 +1,241 @@
+package com.genymobile.scrcpy.device;
+
+import com.genymobile.scrcpy.util.IO;
+import com.genymobile.scrcpy.util.Ln;
+
+import android.system.ErrnoException;
+import android.system.Os;
+import android.system.OsConstants;
+
+import java.io.EOFException;
+import java.io.FileDescriptor;
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * Carry the video, audio and control streams over a single socket (--multiplex on the client).
+ * <p>
+ * Each stream is exposed to the rest of the server as one end of a local socket pair, so that the streamers and the control channel are
+ * unchanged. The data is forwarded in frames:
+ *
+ * <pre>
+ *     [stream id (1 byte)][length (4 bytes)][payload (length bytes)]
+ * </pre>
+ * <p>
+ * The frames are at most {@link #MAX_CHUNK_SIZE} bytes, and the control frames are written before any pending video or audio frame, so that a
+ * device message never waits for a whole video packet.
+ * <p>
+ * Each stream may have at most {@link #WINDOW_SIZE} bytes sent but not read by the client yet. The client returns the credit of the data it
+ * has read in frames without payload, whose stream id has the {@link #CREDIT} flag set and whose length field is the credit:
+ *
+ * <pre>
+ *     [CREDIT | stream id (1 byte)][credit (4 bytes)]
+ * </pre>
+ * <p>
+ * This way, a stream which is not read by the client only blocks its own writer, never the other streams.
+ */
+public final class Multiplexer {
+
+    public static final int STREAM_VIDEO = 0;
+    public static final int STREAM_AUDIO = 1;
+    public static final int STREAM_CONTROL = 2;
+
+    private static final int HEADER_SIZE = 5;
+    private static final int MAX_CHUNK_SIZE = 16384;
+    private static final int WINDOW_SIZE = 8 * 1024 * 1024;
+    private static final int CREDIT = 0x80;
+
+    private final FileDescriptor muxFd;
+    private final List<Thread> threads = new ArrayList<>();
+
+    // Write access to the mux socket
+    private final Object lock = new Object();
+    private boolean writing;
+    private int controlWaiting;
+
+    // Number of bytes each stream may still send, guarded by itself
+    private final int[] credits = {WINDOW_SIZE, WINDOW_SIZE, WINDOW_SIZE};
+    private boolean closed;
+
+    private FileDescriptor controlFd; // the internal end of the control socket pair, null if no control
+
+    public Multiplexer(FileDescriptor muxFd) {
+        this.muxFd = muxFd;
+    }
+
+    /**
+     * Forward the data written to the other end of the socket pair {@code fd} to the client.
+     */
+    public void addOutput(int stream, FileDescriptor fd) {
+        String name = stream == STREAM_VIDEO ? "mux-video" : stream == STREAM_AUDIO ? "mux-audio" : "mux-control";
+        threads.add(new Thread(() -> runOutput(stream, fd), name));
+        if (stream == STREAM_CONTROL) {
+            // The control stream is bidirectional
+            controlFd = fd;
+        }
+    }
+
+    public void start() {
+        // The input thread also receives the credits of all the streams
+        threads.add(new Thread(this::runInput, "mux-input"));
+        for (Thread thread : threads) {
+            thread.start();
+        }
+    }
+
+    public void join() throws InterruptedException {
+        for (Thread thread : threads) {
+            thread.join();
+        }
+    }
+
+    private void acquire(boolean control) throws InterruptedException {
+        synchronized (lock) {
+            if (control) {
+                ++controlWaiting;
+            }
+            try {
+                // The control frames have priority
+                while (writing || (!control && controlWaiting > 0)) {
+                    lock.wait();
+                }
+            } finally {
+                if (control) {
+                    --controlWaiting;
+                }
+            }
+            writing = true;
+        }
+    }
+
+    private void acquireCredit(int stream, int len) throws InterruptedException, EOFException {
+        synchronized (credits) {
+            while (!closed && credits[stream] < len) {
+                credits.wait();
+            }
+            if (closed) {
+                throw new EOFException();
+            }
+            credits[stream] -= len;
+        }
+    }
+
+    private void addCredit(int stream, int credit) throws IOException {
+        synchronized (credits) {
+            if (credit > WINDOW_SIZE - credits[stream]) {
+                throw new IOException("Invalid credit for stream " + stream + ": " + credit);
+            }
+            credits[stream] += credit;
+            credits.notifyAll();
+        }
+    }
+
+    private void release() {
+        synchronized (lock) {
+            writing = false;
+            lock.notifyAll();
+        }
+    }
+
+    private static int read(FileDescriptor fd, byte[] buffer, int offset, int len) throws IOException {
+        while (true) {
+            try {
+                return Os.read(fd, buffer, offset, len);
+            } catch (ErrnoException e) {
+                if (e.errno != OsConstants.EINTR) {
+                    throw new IOException(e);
+                }
+            }
+        }
+    }
+
+    private static void shutdown(FileDescriptor fd) {
+        try {
+            Os.shutdown(fd, OsConstants.SHUT_RDWR);
+        } catch (ErrnoException e) {
+            // ignore, the socket may already be closed
+        }
+    }
+
+    private void runOutput(int stream, FileDescriptor fd) {
+        boolean control = stream == STREAM_CONTROL;
+        byte[] buffer = new byte[HEADER_SIZE + MAX_CHUNK_SIZE];
+        ByteBuffer header = ByteBuffer.wrap(buffer, 0, HEADER_SIZE);
+        try {
+            while (true) {
+                int r = read(fd, buffer, HEADER_SIZE, MAX_CHUNK_SIZE);
+                if (r <= 0) {
+                    break;
+                }
+
+                acquireCredit(stream, r);
+
+                header.clear();
+                header.put((byte) stream);
+                header.putInt(r);
+
+                acquire(control);
+                try {
+                    IO.writeFully(muxFd, buffer, 0, HEADER_SIZE + r);
+                } finally {
+                    release();
+                }
+            }
+        } catch (EOFException e) {
+            // The connection is closed
+        } catch (IOException | InterruptedException e) {
+            // Broken pipe is expected on close, because the socket is closed by the client
+            if (!(e instanceof IOException && IO.isBrokenPipe((IOException) e))) {
+                Ln.e("Multiplexer error", e);
+            }
+        } finally {
+            // Report the end of the connection to the writer of the stream (and unblock the other threads)
+            shutdown(fd);
+            shutdown(muxFd);
+        }
+    }
+
+    private void runInput() {
+        // Only the control stream and the credits are sent by the client
+        byte[] buffer = new byte[MAX_CHUNK_SIZE];
+        ByteBuffer header = ByteBuffer.allocate(HEADER_SIZE);
+        try {
+            while (true) {
+                header.clear();
+                IO.readFully(muxFd, header);
+                header.flip();
+                int stream = header.get() & 0xff;
+                int len = header.getInt();
+                if ((stream & CREDIT) != 0 && (stream & ~CREDIT) <= STREAM_CONTROL && len > 0) {
+                    addCredit(stream & ~CREDIT, len);
+                    continue;
+                }
+                if (stream != STREAM_CONTROL || controlFd == null || len <= 0 || len > MAX_CHUNK_SIZE) {
+                    throw new IOException("Invalid multiplexed frame (stream " + stream + ", length " + len + ")");
+                }
+
+                ByteBuffer payload = ByteBuffer.wrap(buffer, 0, len);
+                IO.readFully(muxFd, payload);
+                IO.writeFully(controlFd, buffer, 0, len);
+            }
+        } catch (EOFException e) {
+            // The client closed the connection
+        } catch (IOException e) {
+            if (!IO.isBrokenPipe(e)) {
+                Ln.e("Multiplexer error", e);
+            }
+        } finally {
+            synchronized (credits) {
+                // Unblock the output threads waiting for credit
+                closed = true;
+                credits.notifyAll();
+            }
+            if (controlFd != null) {
+                shutdown(controlFd);
+            }
+            shutdown(muxFd);
+        }
+    }
+}
@@ -16,19 +16,46 @@ public final class Streamer {
 
     private static final long PACKET_FLAG_CONFIG = 1L << 63;
     private static final long PACKET_FLAG_KEY_FRAME = 1L << 62;
+    // The frame repeats the previous one (the screen did not change), the client may decode it without presenting it
+    private static final long PACKET_FLAG_REPEAT = 1L << 61;
 
     private final FileDescriptor fd;
     private final Codec codec;
     private final boolean sendCodecMeta;
     private final boolean sendFrameMeta;
+    private final UdpVideoChannel udpChannel;
 
-    private final ByteBuffer headerBuffer = ByteBuffer.allocate(12);
+    private static final int FRAME_META_SIZE = 12;
+    // Larger packets are not copied after the frame meta header: the copy would cost more than the syscall it saves, and the buffer would
+    // grow to the size of the largest packet
+    private static final int MAX_COALESCED_PACKET_SIZE = 64 * 1024;
+
+    // Reusable buffer containing the frame meta header followed by the packet payload, so that each packet is written by a single syscall.
+    // It is a direct buffer to avoid an additional copy in Os.write().
+    private ByteBuffer packetBuffer;
+    // Frame meta header written separately, before a packet larger than MAX_COALESCED_PACKET_SIZE
+    private final ByteBuffer headerBuffer = ByteBuffer.allocateDirect(FRAME_META_SIZE);
+    // Slice of packetBuffer after the frame meta header (if any), see getPayloadBuffer()
+    private ByteBuffer payloadBuffer;
+
+    // Over UDP, the last config packet is sent again before each key frame, since the client may have lost it
+    private byte[] lastConfigPacket;
+    private boolean lastPacketWasConfig;
 
     public Streamer(FileDescriptor fd, Codec codec, boolean sendCodecMeta, boolean sendFrameMeta) {
+        this(fd, codec, sendCodecMeta, sendFrameMeta, null);
+    }
+
+    /**
+     * @param udpChannel if not null, the packets are sent over UDP (the headers are still written to {@code fd})
+     */
+    public Streamer(FileDescriptor fd, Codec codec, boolean sendCodecMeta, boolean sendFrameMeta, UdpVideoChannel udpChannel) {
+        assert udpChannel == null || sendFrameMeta : "Frame meta are required over UDP";
         this.fd = fd;
         this.codec = codec;
         this.sendCodecMeta = sendCodecMeta;
         this.sendFrameMeta = sendFrameMeta;
+        this.udpChannel = udpChannel;
     }
 
     public Codec getCodec() {
@@ -67,6 +94,10 @@ public final class Streamer {
     }
 
     public void writePacket(ByteBuffer buffer, long pts, boolean config, boolean keyFrame) throws IOException {
+        writePacket(buffer, pts, config, keyFrame, false);
+    }
+
+    public void writePacket(ByteBuffer buffer, long pts, boolean config, boolean keyFrame, boolean repeat) throws IOException {
         if (config) {
             if (codec == AudioCodec.OPUS) {
                 fixOpusConfigPacket(buffer);
@@ -76,22 +107,103 @@ public final class Streamer {
         }
 
         if (sendFrameMeta) {
-            writeFrameMeta(fd, buffer.remaining(), pts, config, keyFrame);
-        }
+            int packetSize = buffer.remaining();
+            if (udpChannel == null && packetSize > MAX_COALESCED_PACKET_SIZE) {
+                headerBuffer.clear();
+                putFrameMeta(headerBuffer, packetSize, pts, config, keyFrame, repeat);
+                headerBuffer.flip();
+                IO.writeFully(fd, headerBuffer);
+                IO.writeFully(fd, buffer);
+                return;
+            }
 
-        IO.writeFully(fd, buffer);
+            ByteBuffer packet = getPacketBuffer(FRAME_META_SIZE + packetSize);
+            putFrameMeta(packet, packetSize, pts, config, keyFrame, repeat);
+            packet.put(buffer);
+            packet.flip();
+            if (udpChannel != null) {
+                sendUdp(packet, config, keyFrame);
+            } else {
+                IO.writeFully(fd, packet);
+            }
+        } else {
+            IO.writeFully(fd, buffer);
+        }
     }
 
     public void writePacket(ByteBuffer codecBuffer, MediaCodec.BufferInfo bufferInfo) throws IOException {
+        writePacket(codecBuffer, bufferInfo, false);
+    }
+
+    public void writePacket(ByteBuffer codecBuffer, MediaCodec.BufferInfo bufferInfo, boolean repeat) throws IOException {
         long pts = bufferInfo.presentationTimeUs;
         boolean config = (bufferInfo.flags & MediaCodec.BUFFER_FLAG_CODEC_CONFIG) != 0;
         boolean keyFrame = (bufferInfo.flags & MediaCodec.BUFFER_FLAG_KEY_FRAME) != 0;
-        writePacket(codecBuffer, pts, config, keyFrame);
+        writePacket(codecBuffer, pts, config, keyFrame, repeat);
+    }
+
+    /**
+     * Return a direct buffer to write the payload of the next packet into, so that it is sent without any copy by
+     * {@link #writePayload(int, long, boolean, boolean)}.
+     * <p>
+     * The payload must be written from position 0, and must not exceed {@code maxSize} bytes.
+     */
+    public ByteBuffer getPayloadBuffer(int maxSize) {
+        int headerSize = sendFrameMeta ? FRAME_META_SIZE : 0;
+        ByteBuffer packet = getPacketBuffer(headerSize + maxSize);
+        if (payloadBuffer == null) {
+            packet.position(headerSize);
+            payloadBuffer = packet.slice();
+        }
+        payloadBuffer.clear();
+        return payloadBuffer;
+    }
+
+    /**
+     * Write a packet whose payload has been written to the buffer returned by {@link #getPayloadBuffer(int)}.
+     */
+    public void writePayload(int size, long pts, boolean config, boolean keyFrame) throws IOException {
+        assert packetBuffer != null && payloadBuffer != null;
+        if (sendFrameMeta) {
+            packetBuffer.clear();
+            putFrameMeta(packetBuffer, size, pts, config, keyFrame, false);
+            packetBuffer.limit(FRAME_META_SIZE + size);
+            packetBuffer.position(0);
+        } else {
+            packetBuffer.clear();
+            packetBuffer.limit(size);
+        }
+        if (udpChannel != null) {
+            sendUdp(packetBuffer, config, keyFrame);
+        } else {
+            IO.writeFully(fd, packetBuffer);
+        }
     }
 
-    private void writeFrameMeta(FileDescriptor fd, int packetSize, long pts, boolean config, boolean keyFrame) throws IOException {
-        headerBuffer.clear();
+    private void sendUdp(ByteBuffer packet, boolean config, boolean keyFrame) throws IOException {
+        if (config) {
+            lastConfigPacket = new byte[packet.remaining()];
+            packet.duplicate().get(lastConfigPacket);
+        } else if (keyFrame && !lastPacketWasConfig && lastConfigPacket != null) {
+            udpChannel.send(ByteBuffer.wrap(lastConfigPacket));
+        }
+        lastPacketWasConfig = config;
+
+        udpChannel.send(packet);
+    }
 
+    private ByteBuffer getPacketBuffer(int size) {
+        if (packetBuffer == null || packetBuffer.capacity() < size) {
+            // Allocate more than necessary to avoid reallocating on every slightly bigger packet
+            packetBuffer = ByteBuffer.allocateDirect(size + size / 2);
+            // The payload slice must be recreated
+            payloadBuffer = null;
+        }
+        packetBuffer.clear();
+        return packetBuffer;
+    }
+
+    private static void putFrameMeta(ByteBuffer buffer, int packetSize, long pts, boolean config, boolean keyFrame, boolean repeat) {
         long ptsAndFlags;
         if (config) {
             ptsAndFlags = PACKET_FLAG_CONFIG; // non-media data packet
@@ -100,12 +212,13 @@ public final class Streamer {
             if (keyFrame) {
                 ptsAndFlags |= PACKET_FLAG_KEY_FRAME;
             }
+            if (repeat) {
+                ptsAndFlags |= PACKET_FLAG_REPEAT;
+            }
         }
 
-        headerBuffer.putLong(ptsAndFlags);
-        headerBuffer.putInt(packetSize);
-        headerBuffer.flip();
-        IO.writeFully(fd, headerBuffer);
+        buffer.putLong(ptsAndFlags);
+        buffer.putInt(packetSize);
     }
 
     private static void fixOpusConfigPacket(ByteBuffer buffer) throws IOException {
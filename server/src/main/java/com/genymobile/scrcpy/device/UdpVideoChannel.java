@@ -0,0 +1,119 @@
+package com.genymobile.scrcpy.device;
+
+import com.genymobile.scrcpy.util.Ln;
+
+import java.io.Closeable;
+import java.io.IOException;
+import java.net.DatagramPacket;
+import java.net.DatagramSocket;
+import java.nio.ByteBuffer;
+
+/**
+ * Send the video packets over UDP (the client must be connected over TCP/IP).
+ * <p>
+ * Each packet is split into fragments, each sent in its own datagram prefixed by an 8-byte header:
+ * <pre>
+ *     [. . . .|. .|. .]. . . . . . . . . . ...
+ *      &lt;-----&gt; &lt;-&gt; &lt;-&gt; &lt;---------------------...
+ *        seq  index count      fragment
+ * </pre>
+ * The client sends a "hello" datagram containing the scid, and the device acknowledges it by sending it back, which also tells where to send
+ * the stream.
+ */
+public final class UdpVideoChannel implements Closeable {
+
+    private static final int HEADER_SIZE = 8;
+    // Keep the datagrams below the usual MTU to avoid IP fragmentation
+    private static final int MAX_DATAGRAM_SIZE = 1400;
+    private static final int MAX_FRAGMENT_SIZE = MAX_DATAGRAM_SIZE - HEADER_SIZE;
+
+    private static final int HELLO_SIZE = 4;
+    private static final int HELLO_TIMEOUT_MS = 10000;
+    private static final int ACK_COUNT = 3;
+
+    private final DatagramSocket socket;
+
+    private final byte[] datagram = new byte[MAX_DATAGRAM_SIZE];
+    private final DatagramPacket datagramPacket = new DatagramPacket(datagram, datagram.length);
+
+    private int seq;
+
+    private UdpVideoChannel(DatagramSocket socket) {
+        this.socket = socket;
+    }
+
+    /**
+     * @param sendBufferSize the size of the kernel send buffer, or 0 for the system default
+     */
+    public static UdpVideoChannel open(int port, int scid, int sendBufferSize) throws IOException {
+        DatagramSocket socket = new DatagramSocket(port);
+        try {
+            if (sendBufferSize > 0) {
+                socket.setSendBufferSize(sendBufferSize);
+            }
+            waitForClient(socket, scid);
+        } catch (IOException e) {
+            socket.close();
+            throw e;
+        }
+        return new UdpVideoChannel(socket);
+    }
+
+    private static void waitForClient(DatagramSocket socket, int scid) throws IOException {
+        socket.setSoTimeout(HELLO_TIMEOUT_MS);
+
+        byte[] hello = new byte[HELLO_SIZE];
+        DatagramPacket packet = new DatagramPacket(hello, hello.length);
+        while (true) {
+            socket.receive(packet); // throws SocketTimeoutException if the client never comes
+            int id = ByteBuffer.wrap(hello).getInt();
+            if (packet.getLength() == HELLO_SIZE && (scid == -1 || id == scid)) {
+                break;
+            }
+            Ln.w("Unexpected datagram from " + packet.getSocketAddress());
+            packet.setLength(hello.length);
+        }
+
+        socket.setSoTimeout(0);
+        socket.connect(packet.getSocketAddress());
+
+        // The client retries until it receives an acknowledgement, but once streaming, the device does not read the socket anymore
+        for (int i = 0; i < ACK_COUNT; ++i) {
+            socket.send(new DatagramPacket(hello, HELLO_SIZE));
+        }
+
+        Ln.d("UDP video: sending to " + packet.getSocketAddress());
+    }
+
+    /**
+     * Send a whole packet (from its position to its limit).
+     */
+    public void send(ByteBuffer packet) throws IOException {
+        int remaining = packet.remaining();
+        int count = Math.max(1, (remaining + MAX_FRAGMENT_SIZE - 1) / MAX_FRAGMENT_SIZE);
+        if (count > 0xFFFF) {
+            throw new IOException("Packet too big to be sent over UDP: " + remaining + " bytes");
+        }
+
+        ByteBuffer header = ByteBuffer.wrap(datagram, 0, HEADER_SIZE);
+        for (int index = 0; index < count; ++index) {
+            int len = Math.min(MAX_FRAGMENT_SIZE, packet.remaining());
+
+            header.clear();
+            header.putInt(seq);
+            header.putShort((short) index);
+            header.putShort((short) count);
+            packet.get(datagram, HEADER_SIZE, len);
+
+            datagramPacket.setData(datagram, 0, HEADER_SIZE + len);
+            socket.send(datagramPacket);
+        }
+
+        ++seq;
+    }
+
+    @Override
+    public void close() {
+        socket.close();
+    }
+}
@@ -21,6 +21,20 @@ import java.util.concurrent.Semaphore;
 
 public final class OpenGLRunner {
 
+    public interface FrameListener {
+        /**
+         * Called on the OpenGL thread when a new input frame is available, before it is rendered.
+         */
+        void onFrame();
+    }
+
+    public interface RenderListener {
+        /**
+         * Called on the OpenGL thread when a frame is rendered to the output surface, with its presentation timestamp (in nanoseconds).
+         */
+        void onRender(long timestampNs);
+    }
+
     private static HandlerThread handlerThread;
     private static Handler handler;
     private static boolean quit;
@@ -38,6 +52,18 @@ public final class OpenGLRunner {
 
     private boolean stopped;
 
+    private FrameListener frameListener;
+    private RenderListener renderListener;
+
+    // The following fields are only accessed from the OpenGL thread
+
+    // Number of input frames available but not latched yet
+    private int pendingFrames;
+    private boolean renderPosted;
+    private Runnable renderRunnable;
+    private final float[] transformMatrix = new float[16];
+    private long lastTimestamp;
+
     public OpenGLRunner(OpenGLFilter filter, float[] overrideTransformMatrix) {
         this.filter = filter;
         this.overrideTransformMatrix = overrideTransformMatrix;
@@ -47,6 +73,20 @@ public final class OpenGLRunner {
         this(filter, null);
     }
 
+    /**
+     * Must be called before {@link #start(Size, Size, Surface)}.
+     */
+    public void setFrameListener(FrameListener frameListener) {
+        this.frameListener = frameListener;
+    }
+
+    /**
+     * Must be called before {@link #start(Size, Size, Surface)}.
+     */
+    public void setRenderListener(RenderListener renderListener) {
+        this.renderListener = renderListener;
+    }
+
     public static synchronized void initOnce() {
         if (handlerThread == null) {
             if (quit) {
@@ -161,6 +201,11 @@ public final class OpenGLRunner {
             throw new OpenGLException("Failed to make EGL context current");
         }
 
+        // Do not block in eglSwapBuffers() until the encoder releases a buffer: if the encoder is late, the frame not consumed yet is replaced
+        // by the new one (like when the display renders directly to the encoder surface). The buffers are still synchronized by the native
+        // fences attached by the BufferQueue, so this never waits on the CPU for the GPU to complete.
+        EGL14.eglSwapInterval(eglDisplay, 0);
+
         int[] textures = new int[1];
         GLES20.glGenTextures(1, textures, 0);
         GLUtils.checkGlError();
@@ -181,33 +226,85 @@ public final class OpenGLRunner {
 
         filter.init();
 
-        surfaceTexture.setOnFrameAvailableListener(surfaceTexture -> {
+        renderRunnable = () -> {
+            renderPosted = false;
             if (stopped) {
                 // Make sure to never render after resources have been released
                 return;
             }
 
+            if (frameListener != null) {
+                frameListener.onFrame();
+            }
             render(outputSize);
+        };
+
+        surfaceTexture.setOnFrameAvailableListener(surfaceTexture -> {
+            if (stopped) {
+                return;
+            }
+
+            // Do not render immediately: the callbacks for the frames already queued by the producer are handled first, so that only the most
+            // recent frame is rendered if the OpenGL thread is late
+            ++pendingFrames;
+            postRender();
         }, handler);
     }
 
+    private void postRender() {
+        if (!renderPosted) {
+            renderPosted = true;
+            handler.post(renderRunnable);
+        }
+    }
+
+    /**
+     * Render the current input frame again, for example if the filter output changed.
+     * <p>
+     * May be called from any thread.
+     */
+    public void requestRender() {
+        handler.post(() -> {
+            if (!stopped && renderRunnable != null) {
+                postRender();
+            }
+        });
+    }
+
     private void render(Size outputSize) {
         GLES20.glViewport(0, 0, outputSize.getWidth(), outputSize.getHeight());
         GLUtils.checkGlError();
 
-        surfaceTexture.updateTexImage();
+        // Latch all the pending frames (each call releases the previous buffer to the producer), only the last one is drawn. There may be
+        // none if the render was requested explicitly.
+        while (pendingFrames > 0) {
+            surfaceTexture.updateTexImage();
+            --pendingFrames;
+        }
 
         float[] matrix;
         if (overrideTransformMatrix != null) {
             matrix = overrideTransformMatrix;
         } else {
-            matrix = new float[16];
+            matrix = transformMatrix;
             surfaceTexture.getTransformMatrix(matrix);
         }
 
         filter.draw(textureId, matrix);
 
-        EGLExt.eglPresentationTimeANDROID(eglDisplay, eglSurface, surfaceTexture.getTimestamp());
+        long timestamp = surfaceTexture.getTimestamp();
+        if (timestamp <= lastTimestamp) {
+            // Same input frame rendered again, the encoder requires increasing timestamps
+            timestamp = Math.max(System.nanoTime(), lastTimestamp + 1);
+        }
+        lastTimestamp = timestamp;
+
+        if (renderListener != null) {
+            // Before the frame is submitted, so that it is known before the encoder outputs it
+            renderListener.onRender(timestamp);
+        }
+
+        EGLExt.eglPresentationTimeANDROID(eglDisplay, eglSurface, timestamp);
         EGL14.eglSwapBuffers(eglDisplay, eglSurface);
     }
 
@@ -1,8 +1,12 @@
 package com.genymobile.scrcpy.util;
 
+import com.genymobile.scrcpy.AndroidVersions;
+import com.genymobile.scrcpy.video.VideoCodec;
+
 import android.media.MediaCodecInfo;
 import android.media.MediaCodecList;
 import android.media.MediaFormat;
+import android.os.Build;
 
 import java.util.ArrayList;
 import java.util.Arrays;
@@ -10,6 +14,12 @@ import java.util.List;
 
 public final class CodecUtils {
 
+    // Vendor-specific keys to request low latency from an encoder, by encoder name prefix
+    private static final String[][] VENDOR_LOW_LATENCY_KEYS = {
+            {"c2.qti.", "vendor.qti-ext-enc-low-latency.enable"},
+            {"OMX.qcom.", "vendor.qti-ext-enc-low-latency.enable"},
+    };
+
     private CodecUtils() {
         // not instantiable
     }
@@ -26,6 +36,68 @@ public final class CodecUtils {
         }
     }
 
+    /**
+     * Request the encoder to output each frame as soon as possible.
+     * <p>
+     * The keys not supported by the Android version are not set. The vendor keys are selected from the encoder name; the encoder may reject
+     * them on {@code configure()}.
+     *
+     * @return {@code true} if vendor-specific keys have been set
+     */
+    public static boolean setLowLatencyOptions(MediaFormat format, String encoderName) {
+        if (Build.VERSION.SDK_INT >= AndroidVersions.API_23_ANDROID_6_0) {
+            format.setInteger(MediaFormat.KEY_PRIORITY, 0); // realtime
+        }
+        if (Build.VERSION.SDK_INT >= AndroidVersions.API_26_ANDROID_8_0) {
+            format.setInteger(MediaFormat.KEY_LATENCY, 1); // in frames
+        }
+        if (Build.VERSION.SDK_INT >= AndroidVersions.API_29_ANDROID_10) {
+            format.setInteger(MediaFormat.KEY_MAX_B_FRAMES, 0);
+        }
+        if (Build.VERSION.SDK_INT >= AndroidVersions.API_30_ANDROID_11) {
+            format.setInteger(MediaFormat.KEY_LOW_LATENCY, 1);
+        }
+
+        boolean vendorKeys = false;
+        for (String[] entry : VENDOR_LOW_LATENCY_KEYS) {
+            if (encoderName.startsWith(entry[0])) {
+                format.setInteger(entry[1], 1);
+                vendorKeys = true;
+            }
+        }
+        return vendorKeys;
+    }
+
+    /**
+     * Select the first video codec of the list (in order of preference) for which the device has a hardware encoder.
+     * <p>
+     * If an encoder name is given, select the first codec supported by this encoder instead.
+     *
+     * @return the selected codec, or {@code null} if none is supported
+     */
+    public static VideoCodec selectVideoCodec(List<VideoCodec> candidates, String encoderName) {
+        MediaCodecList codecList = new MediaCodecList(MediaCodecList.REGULAR_CODECS);
+        for (VideoCodec codec : candidates) {
+            for (MediaCodecInfo info : getEncoders(codecList, codec.getMimeType())) {
+                boolean match = encoderName != null ? encoderName.equals(info.getName()) : isHardwareEncoder(info);
+                if (match) {
+                    return codec;
+                }
+            }
+        }
+        return null;
+    }
+
+    private static boolean isHardwareEncoder(MediaCodecInfo info) {
+        if (Build.VERSION.SDK_INT >= AndroidVersions.API_29_ANDROID_10) {
+            return info.isHardwareAccelerated();
+        }
+
+        // Before Android 10, the software codecs provided by the platform are only identified by their name
+        String name = info.getName();
+        return !name.startsWith("OMX.google.") && !name.startsWith("c2.android.");
+    }
+
     public static MediaCodecInfo[] getEncoders(MediaCodecList codecs, String mimeType) {
         List<MediaCodecInfo> result = new ArrayList<>();
         for (MediaCodecInfo codecInfo : codecs.getCodecInfos()) {
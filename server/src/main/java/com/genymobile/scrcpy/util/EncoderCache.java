@@ -0,0 +1,117 @@
+package com.genymobile.scrcpy.util;
+
+import android.media.MediaCodec;
+import android.os.Build;
+
+import java.io.BufferedReader;
+import java.io.File;
+import java.io.FileInputStream;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.InputStreamReader;
+import java.io.OutputStreamWriter;
+import java.io.Writer;
+import java.nio.charset.StandardCharsets;
+import java.util.HashMap;
+import java.util.Map;
+
+/**
+ * Cache of the default encoder selected for each mime type, persisted across runs.
+ * <p>
+ * Creating an encoder by type requires the system to look up the codec list, which is slow on some devices. Once the default encoder is
+ * known, it is created directly by name. The cache is invalidated when the build fingerprint changes (on system update).
+ * <p>
+ * File format: the build fingerprint on the first line, then one {@code mimeType=encoderName} line per entry.
+ */
+public final class EncoderCache {
+
+    private static final String PATH = "/data/local/tmp/scrcpy-encoders.cache";
+
+    private static Map<String, String> entries; // lazily loaded
+
+    private EncoderCache() {
+        // not instantiable
+    }
+
+    /**
+     * Create the default encoder for the given mime type, by name if it is cached.
+     */
+    public static MediaCodec createDefaultEncoder(String mimeType) throws IOException {
+        String name = get(mimeType);
+        if (name != null) {
+            try {
+                return MediaCodec.createByCodecName(name);
+            } catch (IOException | IllegalArgumentException e) {
+                Ln.w("Cached encoder '" + name + "' for " + mimeType + " is not available");
+                // fall through, the entry will be replaced
+            }
+        }
+
+        MediaCodec mediaCodec = MediaCodec.createEncoderByType(mimeType);
+        put(mimeType, mediaCodec.getName());
+        return mediaCodec;
+    }
+
+    private static synchronized String get(String mimeType) {
+        if (entries == null) {
+            entries = load();
+        }
+        return entries.get(mimeType);
+    }
+
+    private static synchronized void put(String mimeType, String encoderName) {
+        if (entries == null) {
+            entries = load();
+        }
+        if (!encoderName.equals(entries.put(mimeType, encoderName))) {
+            save(entries);
+        }
+    }
+
+    private static Map<String, String> load() {
+        Map<String, String> map = new HashMap<>();
+        File file = new File(PATH);
+        if (!file.exists()) {
+            return map;
+        }
+
+        try (BufferedReader reader = new BufferedReader(new InputStreamReader(new FileInputStream(file), StandardCharsets.UTF_8))) {
+            if (!Build.FINGERPRINT.equals(reader.readLine())) {
+                // Stale cache, from a previous system version
+                return map;
+            }
+
+            String line;
+            while ((line = reader.readLine()) != null) {
+                int index = line.indexOf('=');
+                if (index > 0) {
+                    map.put(line.substring(0, index), line.substring(index + 1));
+                }
+            }
+        } catch (IOException e) {
+            Ln.w("Could not read encoder cache: " + e.getMessage());
+            map.clear();
+        }
+
+        return map;
+    }
+
+    private static void save(Map<String, String> map) {
+        // Write to a temporary file, then rename, so that a concurrent server never reads a partial file
+        File tmp = new File(PATH + ".tmp");
+        try (Writer writer = new OutputStreamWriter(new FileOutputStream(tmp), StandardCharsets.UTF_8)) {
+            writer.write(Build.FINGERPRINT + "\n");
+            for (Map.Entry<String, String> entry : map.entrySet()) {
+                writer.write(entry.getKey() + "=" + entry.getValue() + "\n");
+            }
+        } catch (IOException e) {
+            Ln.w("Could not write encoder cache: " + e.getMessage());
+            return;
+        }
+
+        if (!tmp.renameTo(new File(PATH))) {
+            Ln.w("Could not write encoder cache");
+            tmp.delete();
+        }
+    }
+}
@@ -8,6 +8,7 @@ import android.system.ErrnoException;
 import android.system.Os;
 import android.system.OsConstants;
 
+import java.io.EOFException;
 import java.io.FileDescriptor;
 import java.io.IOException;
 import java.io.InputStream;
@@ -55,6 +56,28 @@ public final class IO {
         }
     }
 
+    /**
+     * Read until the buffer is full (from its position to its limit).
+     */
+    public static void readFully(FileDescriptor fd, ByteBuffer to) throws IOException {
+        while (to.hasRemaining()) {
+            int r;
+            try {
+                // Use the array variant, the ByteBuffer position is not updated as expected by Os.read() on old Android versions
+                r = Os.read(fd, to.array(), to.arrayOffset() + to.position(), to.remaining());
+            } catch (ErrnoException e) {
+                if (e.errno == OsConstants.EINTR) {
+                    continue;
+                }
+                throw new IOException(e);
+            }
+            if (r == 0) {
+                throw new EOFException("Unexpected end of stream");
+            }
+            to.position(to.position() + r);
+        }
+    }
+
     public static void writeFully(FileDescriptor fd, byte[] buffer, int offset, int len) throws IOException {
         writeFully(fd, ByteBuffer.wrap(buffer, offset, len));
     }
@@ -27,12 +27,25 @@ public final class Settings {
     }
 
     public static String getAndPutValue(String table, String key, String value) throws SettingsException {
-        try (ContentProvider provider = ServiceManager.getActivityManager().createSettingsProvider()) {
-            String oldValue = provider.getValue(table, key);
-            if (!value.equals(oldValue)) {
-                provider.putValue(table, key, value);
-            }
-            return oldValue;
+        try (ContentProvider provider = openProvider()) {
+            return getAndPutValue(provider, table, key, value);
+        }
+    }
+
+    /**
+     * Acquire the settings provider, to access several settings without acquiring and releasing it for each one.
+     * <p>
+     * The caller must close it.
+     */
+    public static ContentProvider openProvider() {
+        return ServiceManager.getActivityManager().createSettingsProvider();
+    }
+
+    public static String getAndPutValue(ContentProvider provider, String table, String key, String value) throws SettingsException {
+        String oldValue = provider.getValue(table, key);
+        if (!value.equals(oldValue)) {
+            provider.putValue(table, key, value);
         }
+        return oldValue;
     }
 }
@@ -0,0 +1,103 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.util.Ln;
+
+import java.util.concurrent.atomic.AtomicBoolean;
+
+/**
+ * Adapt the video bit rate (and the video size under sustained congestion) from the periodic feedback reports sent by the client.
+ */
+public class BitRateAdapter {
+
+    private static final int MIN_BIT_RATE = 500_000;
+
+    // The connection is considered congested if the packets are delayed (queued) by at least this value
+    private static final int CONGESTION_DELAY_MS = 150;
+    // or if the client could not decode/render in time
+    private static final int CONGESTION_BACKLOG = 2;
+
+    // Number of consecutive non-congested reports before increasing the bit rate
+    private static final int STABLE_REPORTS_BEFORE_INCREASE = 3;
+    // Number of consecutive congested reports at the minimal bit rate before requesting a smaller video size
+    private static final int CONGESTED_REPORTS_BEFORE_DOWNSIZE = 5;
+
+    private final int maxBitRate;
+    private final CaptureReset reset;
+    private final EncoderControl encoderControl;
+
+    private int bitRate;
+    // Upper bound of the bit rate, lowered to reduce the encoder load when the device heats up
+    private int limitBitRate;
+    private int stableReports;
+    private int congestedReports;
+
+    private final AtomicBoolean downsizeRequested = new AtomicBoolean();
+
+    public BitRateAdapter(int maxBitRate, CaptureReset reset, EncoderControl encoderControl) {
+        this.maxBitRate = maxBitRate;
+        this.reset = reset;
+        this.encoderControl = encoderControl;
+        this.bitRate = maxBitRate;
+        this.limitBitRate = maxBitRate;
+    }
+
+    public synchronized int getBitRate() {
+        return bitRate;
+    }
+
+    public boolean consumeDownsizeRequest() {
+        return downsizeRequested.getAndSet(false);
+    }
+
+    public synchronized void onFeedback(int receivedBitRate, int delayMs, int backlog) {
+        boolean congested = delayMs >= CONGESTION_DELAY_MS || backlog >= CONGESTION_BACKLOG;
+        if (congested) {
+            stableReports = 0;
+            if (bitRate > MIN_BIT_RATE) {
+                congestedReports = 0;
+                // Do not exceed what the client actually received
+                int target = bitRate * 3 / 4;
+                if (receivedBitRate > 0) {
+                    target = Math.min(target, receivedBitRate);
+                }
+                Ln.d("Video congestion (delay=" + delayMs + "ms, backlog=" + backlog + ")");
+                setBitRate(Math.max(target, MIN_BIT_RATE));
+            } else if (++congestedReports >= CONGESTED_REPORTS_BEFORE_DOWNSIZE) {
+                congestedReports = 0;
+                Ln.i("Sustained video congestion, reducing the video size");
+                downsizeRequested.set(true);
+                // Restart the encoding with a smaller size (the bit rate is kept)
+                reset.reset();
+            }
+        } else {
+            congestedReports = 0;
+            if (bitRate < limitBitRate && ++stableReports >= STABLE_REPORTS_BEFORE_INCREASE) {
+                stableReports = 0;
+                setBitRate(Math.min(bitRate + bitRate / 10, limitBitRate));
+            }
+        }
+    }
+
+    /**
+     * Limit the bit rate to a percentage of the maximum bit rate (100 to remove the limit).
+     */
+    public synchronized void setThermalLimit(int percent) {
+        int oldLimitBitRate = limitBitRate;
+        limitBitRate = Math.max((int) ((long) maxBitRate * percent / 100), Math.min(MIN_BIT_RATE, maxBitRate));
+        if (bitRate > limitBitRate || bitRate >= oldLimitBitRate) {
+            // If the bit rate was only bounded by the previous limit, follow the new one
+            setBitRate(limitBitRate);
+        }
+    }
+
+    private void setBitRate(int newBitRate) {
+        if (newBitRate == bitRate) {
+            return;
+        }
+
+        Ln.d("Video bit rate: " + bitRate + " -> " + newBitRate);
+        bitRate = newBitRate;
+        // If no encoder is running, the new bit rate will be applied on the next configuration
+        encoderControl.setBitRate(newBitRate);
+    }
+}
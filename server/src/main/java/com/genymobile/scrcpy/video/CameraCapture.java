@@ -252,6 +252,7 @@ public class CameraCapture extends SurfaceCapture {
 
     @Override
     public void start(Surface surface) throws IOException {
+        // Without any filter, the camera renders directly to the encoder surface (no OpenGL pass, no additional thread)
         if (transform != null) {
             assert glRunner == null;
             OpenGLFilter glFilter = new AffineOpenGLFilter(transform);
@@ -414,6 +415,12 @@ public class CameraCapture extends SurfaceCapture {
         }
     }
 
+    @Override
+    public int getOperatingRate() {
+        // In high speed mode, the camera delivers frames in batches (one batch per preview frame), at the requested fps on average
+        return highSpeed ? fps : 0;
+    }
+
     @Override
     public boolean isClosed() {
         return disconnected.get();
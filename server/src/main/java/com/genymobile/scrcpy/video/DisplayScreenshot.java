@@ -0,0 +1,110 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.device.DisplayInfo;
+import com.genymobile.scrcpy.device.Size;
+import com.genymobile.scrcpy.wrappers.ServiceManager;
+
+import android.graphics.Bitmap;
+import android.graphics.PixelFormat;
+import android.hardware.display.VirtualDisplay;
+import android.media.Image;
+import android.media.ImageReader;
+import android.os.Handler;
+import android.os.HandlerThread;
+
+import java.io.ByteArrayOutputStream;
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.util.concurrent.CountDownLatch;
+import java.util.concurrent.TimeUnit;
+
+/**
+ * Capture a single lossless image of a display at its full resolution, independently of the video stream (which may be downscaled).
+ */
+public final class DisplayScreenshot {
+
+    private static final int TIMEOUT_MS = 1000;
+
+    private DisplayScreenshot() {
+        // not instantiable
+    }
+
+    /**
+     * Capture the display content as a PNG image.
+     */
+    public static byte[] capture(int displayId) throws IOException {
+        DisplayInfo displayInfo = ServiceManager.getDisplayManager().getDisplayInfo(displayId);
+        if (displayInfo == null) {
+            throw new IOException("Unknown display id: " + displayId);
+        }
+
+        Size size = displayInfo.getSize();
+        int width = size.getWidth();
+        int height = size.getHeight();
+
+        HandlerThread thread = new HandlerThread("screenshot");
+        thread.start();
+
+        ImageReader reader = ImageReader.newInstance(width, height, PixelFormat.RGBA_8888, 1);
+        VirtualDisplay virtualDisplay = null;
+        try {
+            CountDownLatch latch = new CountDownLatch(1);
+            reader.setOnImageAvailableListener(r -> latch.countDown(), new Handler(thread.getLooper()));
+
+            try {
+                virtualDisplay = ServiceManager.getDisplayManager()
+                        .createVirtualDisplay("scrcpy-screenshot", width, height, displayId, reader.getSurface());
+            } catch (Exception e) {
+                throw new IOException("Could not create display", e);
+            }
+
+            if (!latch.await(TIMEOUT_MS, TimeUnit.MILLISECONDS)) {
+                throw new IOException("Timeout waiting for the display content");
+            }
+
+            Bitmap bitmap;
+            try (Image image = reader.acquireLatestImage()) {
+                if (image == null) {
+                    throw new IOException("No image available");
+                }
+                bitmap = toBitmap(image, width, height);
+            }
+
+            ByteArrayOutputStream out = new ByteArrayOutputStream();
+            boolean ok = bitmap.compress(Bitmap.CompressFormat.PNG, 100, out);
+            bitmap.recycle();
+            if (!ok) {
+                throw new IOException("Could not encode PNG");
+            }
+            return out.toByteArray();
+        } catch (InterruptedException e) {
+            Thread.currentThread().interrupt();
+            throw new IOException("Interrupted", e);
+        } finally {
+            if (virtualDisplay != null) {
+                virtualDisplay.release();
+            }
+            reader.close();
+            thread.quitSafely();
+        }
+    }
+
+    private static Bitmap toBitmap(Image image, int width, int height) {
+        Image.Plane plane = image.getPlanes()[0];
+        ByteBuffer buffer = plane.getBuffer();
+        int pixelStride = plane.getPixelStride();
+        int rowStride = plane.getRowStride();
+
+        // The rows may be padded: copy them to a larger bitmap, then crop
+        int paddedWidth = rowStride / pixelStride;
+        Bitmap bitmap = Bitmap.createBitmap(paddedWidth, height, Bitmap.Config.ARGB_8888);
+        bitmap.copyPixelsFromBuffer(buffer);
+        if (paddedWidth == width) {
+            return bitmap;
+        }
+
+        Bitmap cropped = Bitmap.createBitmap(bitmap, 0, 0, width, height);
+        bitmap.recycle();
+        return cropped;
+    }
+}
@@ -21,17 +21,24 @@ public class DisplaySizeMonitor {
         void onDisplaySizeChanged();
     }
 
-    // On Android 14, DisplayListener may be broken (it never sends events). This is fixed in recent Android 14 upgrades, but we can't really
-    // detect it directly, so register a DisplayWindowListener (introduced in Android 11) to listen to configuration changes instead.
-    // It has been broken again after an Android 15 upgrade: <https://github.com/Genymobile/scrcpy/issues/5908>
-    // So use the default method only before Android 14.
-    private static final boolean USE_DEFAULT_METHOD = Build.VERSION.SDK_INT < AndroidVersions.API_34_ANDROID_14;
+    private enum Method {
+        DISPLAY_LISTENER, DISPLAY_WINDOW_LISTENER, POLLING,
+    }
+
+    // Polling intervals: reset to the minimum on change, doubled on each check without change
+    private static final long POLL_INTERVAL_MIN_MS = 100;
+    private static final long POLL_INTERVAL_MAX_MS = 1000;
+
+    private Method method;
 
     private DisplayManager.DisplayListenerHandle displayListenerHandle;
     private HandlerThread handlerThread;
+    private Handler handler;
 
     private IDisplayWindowListener displayWindowListener;
 
+    private long pollInterval = POLL_INTERVAL_MIN_MS;
+
     private int displayId = Device.DISPLAY_ID_NONE;
 
     private Size sessionDisplaySize;
@@ -46,10 +53,20 @@ public class DisplaySizeMonitor {
         assert this.displayId == Device.DISPLAY_ID_NONE;
         this.displayId = displayId;
 
-        if (USE_DEFAULT_METHOD) {
-            handlerThread = new HandlerThread("DisplayListener");
-            handlerThread.start();
-            Handler handler = new Handler(handlerThread.getLooper());
+        // On Android 14, DisplayListener may be broken (it never sends events). This is fixed in recent Android 14 upgrades, but we can't really
+        // detect it directly, and it has been broken again after an Android 15 upgrade: <https://github.com/Genymobile/scrcpy/issues/5908>
+        // So listen to configuration changes with a DisplayWindowListener (introduced in Android 11) whenever possible.
+        if (Build.VERSION.SDK_INT >= AndroidVersions.API_30_ANDROID_11 && registerDisplayWindowListener()) {
+            method = Method.DISPLAY_WINDOW_LISTENER;
+            return;
+        }
+
+        handlerThread = new HandlerThread("DisplaySizeMonitor");
+        handlerThread.start();
+        handler = new Handler(handlerThread.getLooper());
+
+        if (Build.VERSION.SDK_INT < AndroidVersions.API_34_ANDROID_14) {
+            method = Method.DISPLAY_LISTENER;
             displayListenerHandle = ServiceManager.getDisplayManager().registerDisplayListener(eventDisplayId -> {
                 if (Ln.isEnabled(Ln.Level.VERBOSE)) {
                     Ln.v("DisplaySizeMonitor: onDisplayChanged(" + eventDisplayId + ")");
@@ -60,20 +77,38 @@ public class DisplaySizeMonitor {
                 }
             }, handler);
         } else {
-            displayWindowListener = new DisplayWindowListener() {
-                @Override
-                public void onDisplayConfigurationChanged(int eventDisplayId, Configuration newConfig) {
-                    if (Ln.isEnabled(Ln.Level.VERBOSE)) {
-                        Ln.v("DisplaySizeMonitor: onDisplayConfigurationChanged(" + eventDisplayId + ")");
-                    }
-
-                    if (eventDisplayId == displayId) {
-                        checkDisplaySizeChanged();
-                    }
+            // No listener can be trusted, the only option left is to check the display size periodically
+            Ln.w("Could not listen to display changes, polling the display size");
+            method = Method.POLLING;
+            handler.postDelayed(this::poll, pollInterval);
+        }
+    }
+
+    private boolean registerDisplayWindowListener() {
+        displayWindowListener = new DisplayWindowListener() {
+            @Override
+            public void onDisplayConfigurationChanged(int eventDisplayId, Configuration newConfig) {
+                if (Ln.isEnabled(Ln.Level.VERBOSE)) {
+                    Ln.v("DisplaySizeMonitor: onDisplayConfigurationChanged(" + eventDisplayId + ")");
+                }
+
+                if (eventDisplayId == displayId) {
+                    checkDisplaySizeChanged();
                 }
-            };
-            ServiceManager.getWindowManager().registerDisplayWindowListener(displayWindowListener);
+            }
+        };
+        if (ServiceManager.getWindowManager().registerDisplayWindowListener(displayWindowListener) == null) {
+            displayWindowListener = null;
+            return false;
         }
+        return true;
+    }
+
+    private void poll() {
+        boolean changed = checkDisplaySizeChanged();
+        // React quickly to consecutive changes (e.g. a rotation animation), but avoid binder calls on an idle device
+        pollInterval = changed ? POLL_INTERVAL_MIN_MS : Math.min(pollInterval * 2, POLL_INTERVAL_MAX_MS);
+        handler.postDelayed(this::poll, pollInterval);
     }
 
     /**
@@ -83,18 +118,20 @@ public class DisplaySizeMonitor {
      * It is ok to call this method even if {@link #start(int, Listener)} was not called.
      */
     public void stopAndRelease() {
-        if (USE_DEFAULT_METHOD) {
-            // displayListenerHandle may be null if registration failed
-            if (displayListenerHandle != null) {
-                ServiceManager.getDisplayManager().unregisterDisplayListener(displayListenerHandle);
-                displayListenerHandle = null;
-            }
-
-            if (handlerThread != null) {
-                handlerThread.quitSafely();
-            }
-        } else if (displayWindowListener != null) {
+        if (method == Method.DISPLAY_WINDOW_LISTENER) {
             ServiceManager.getWindowManager().unregisterDisplayWindowListener(displayWindowListener);
+            return;
+        }
+
+        // displayListenerHandle may be null if registration failed
+        if (displayListenerHandle != null) {
+            ServiceManager.getDisplayManager().unregisterDisplayListener(displayListenerHandle);
+            displayListenerHandle = null;
+        }
+
+        if (handlerThread != null) {
+            // Pending polls are discarded
+            handlerThread.quitSafely();
         }
     }
 
@@ -106,9 +143,18 @@ public class DisplaySizeMonitor {
         this.sessionDisplaySize = sessionDisplaySize;
     }
 
-    private void checkDisplaySizeChanged() {
+    /**
+     * Check the display size, and notify the listener if it changed.
+     *
+     * @return {@code true} if the listener has been notified
+     */
+    private boolean checkDisplaySizeChanged() {
         DisplayInfo di = ServiceManager.getDisplayManager().getDisplayInfo(displayId);
         if (di == null) {
+            if (method == Method.POLLING && getSessionDisplaySize() == null) {
+                // Already reset when the display became unavailable: do not reset again on every poll until it is back
+                return false;
+            }
             Ln.w("DisplayInfo for " + displayId + " cannot be retrieved");
             // We can't compare with the current size, so reset unconditionally
             if (Ln.isEnabled(Ln.Level.VERBOSE)) {
@@ -116,6 +162,7 @@ public class DisplaySizeMonitor {
             }
             setSessionDisplaySize(null);
             listener.onDisplaySizeChanged();
+            return true;
         } else {
             Size size = di.getSize();
 
@@ -133,9 +180,11 @@ public class DisplaySizeMonitor {
                 // considers that the current size is the requested size (to avoid a duplicate requestReset())
                 setSessionDisplaySize(size);
                 listener.onDisplaySizeChanged();
+                return true;
             } else if (Ln.isEnabled(Ln.Level.VERBOSE)) {
                 Ln.v("DisplaySizeMonitor: Size not changed (" + size + "): do not requestReset()");
             }
+            return false;
         }
     }
 }
@@ -0,0 +1,263 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.AndroidVersions;
+import com.genymobile.scrcpy.util.CodecUtils;
+import com.genymobile.scrcpy.util.Ln;
+
+import android.graphics.Canvas;
+import android.graphics.Color;
+import android.graphics.Paint;
+import android.media.MediaCodec;
+import android.media.MediaCodecInfo;
+import android.media.MediaCodecList;
+import android.media.MediaFormat;
+import android.os.Build;
+import android.view.Surface;
+
+import java.io.IOException;
+import java.util.Locale;
+
+/**
+ * Benchmark of the video encoders (for --benchmark-encoders).
+ * <p>
+ * Each encoder encodes a synthetic animation, drawn on its input surface at a fixed frame rate (like a screen capture), for several sizes and
+ * bit rates.
+ * <p>
+ * The input timestamps are set by the Surface on queueBuffer() (monotonic clock), and are forwarded by the encoder as output presentation
+ * timestamps, so the latency of each frame is the time between its submission and the dequeue of its output buffer.
+ */
+public final class EncoderBenchmark {
+
+    private static final int[][] SIZES = {{2560, 1440}, {1920, 1080}, {1280, 720}};
+    private static final int[] BIT_RATES = {4_000_000, 8_000_000};
+
+    private static final int FRAME_RATE = 60;
+    private static final int FRAME_COUNT = 60;
+    // The output bit rate is measured over windows of this number of frames
+    private static final int BIT_RATE_WINDOW = 10;
+
+    private static final long DEQUEUE_TIMEOUT_US = 100_000;
+    private static final long DRAIN_TIMEOUT_MS = 3000;
+    private static final long MAX_VALID_LATENCY_US = 10_000_000;
+
+    private static final class Result {
+        private final int[] frameSizes = new int[FRAME_COUNT];
+        private int frames;
+        private long latencySumUs;
+        private long latencyCount;
+        private long maxLatencyUs;
+        private long firstOutputNs;
+        private long lastOutputNs;
+        private boolean eos;
+    }
+
+    private EncoderBenchmark() {
+        // not instantiable
+    }
+
+    public static String run() {
+        StringBuilder builder = new StringBuilder("Video encoder benchmark (").append(FRAME_COUNT).append(" frames at ").append(FRAME_RATE)
+                .append(" fps, output bit rate measured over ").append(BIT_RATE_WINDOW).append("-frame windows):");
+
+        MediaCodecList codecList = new MediaCodecList(MediaCodecList.REGULAR_CODECS);
+        for (VideoCodec codec : VideoCodec.values()) {
+            String mimeType = codec.getMimeType();
+            for (MediaCodecInfo info : CodecUtils.getEncoders(codecList, mimeType)) {
+                if (Build.VERSION.SDK_INT >= AndroidVersions.API_29_ANDROID_10 && info.isAlias()) {
+                    // Same encoder as its canonical name
+                    continue;
+                }
+
+                builder.append("\n    --video-codec=").append(codec.getName()).append(" --video-encoder=").append(info.getName());
+                MediaCodecInfo.VideoCapabilities videoCapabilities = info.getCapabilitiesForType(mimeType).getVideoCapabilities();
+                for (int[] size : SIZES) {
+                    for (int bitRate : BIT_RATES) {
+                        builder.append(String.format(Locale.US, "\n        %4dx%-4d %2d Mbps: ", size[0], size[1], bitRate / 1_000_000));
+                        if (videoCapabilities != null && !videoCapabilities.isSizeSupported(size[0], size[1])) {
+                            builder.append("size not supported");
+                            continue;
+                        }
+                        Ln.d("Benchmarking " + info.getName() + " at " + size[0] + "x" + size[1] + ", " + bitRate + " bps");
+                        builder.append(benchmark(info.getName(), mimeType, size[0], size[1], bitRate));
+                    }
+                }
+            }
+        }
+
+        return builder.toString();
+    }
+
+    private static String benchmark(String encoderName, String mimeType, int width, int height, int bitRate) {
+        MediaCodec mediaCodec;
+        try {
+            mediaCodec = MediaCodec.createByCodecName(encoderName);
+        } catch (IOException | IllegalArgumentException e) {
+            return "could not create encoder: " + e.getMessage();
+        }
+
+        Surface surface = null;
+        Thread drainThread = null;
+        try {
+            MediaFormat format = new MediaFormat();
+            format.setString(MediaFormat.KEY_MIME, mimeType);
+            format.setInteger(MediaFormat.KEY_WIDTH, width);
+            format.setInteger(MediaFormat.KEY_HEIGHT, height);
+            format.setInteger(MediaFormat.KEY_BIT_RATE, bitRate);
+            format.setInteger(MediaFormat.KEY_FRAME_RATE, FRAME_RATE);
+            format.setInteger(MediaFormat.KEY_COLOR_FORMAT, MediaCodecInfo.CodecCapabilities.COLOR_FormatSurface);
+            format.setInteger(MediaFormat.KEY_I_FRAME_INTERVAL, 10);
+
+            mediaCodec.configure(format, null, null, MediaCodec.CONFIGURE_FLAG_ENCODE);
+            surface = mediaCodec.createInputSurface();
+            mediaCodec.start();
+
+            Result result = new Result();
+            MediaCodec codec = mediaCodec;
+            drainThread = new Thread(() -> drain(codec, result), "benchmark");
+            drainThread.start();
+
+            produce(surface, width, height);
+            mediaCodec.signalEndOfInputStream();
+
+            drainThread.join(DRAIN_TIMEOUT_MS);
+            if (drainThread.isAlive()) {
+                return "timeout";
+            }
+
+            return formatResult(result);
+        } catch (IllegalStateException | IllegalArgumentException | Surface.OutOfResourcesException e) {
+            return "error: " + e.getMessage();
+        } catch (InterruptedException e) {
+            Thread.currentThread().interrupt();
+            return "interrupted";
+        } finally {
+            try {
+                // Also interrupts the drain thread, if still running
+                mediaCodec.stop();
+            } catch (IllegalStateException e) {
+                // ignore
+            }
+            if (drainThread != null) {
+                try {
+                    drainThread.join();
+                } catch (InterruptedException e) {
+                    Thread.currentThread().interrupt();
+                }
+            }
+            mediaCodec.release();
+            if (surface != null) {
+                surface.release();
+            }
+        }
+    }
+
+    private static void produce(Surface surface, int width, int height) throws InterruptedException {
+        Paint paint = new Paint();
+        long frameIntervalNs = 1_000_000_000L / FRAME_RATE;
+        long start = System.nanoTime();
+        for (int i = 0; i < FRAME_COUNT; ++i) {
+            long waitNs = start + i * frameIntervalNs - System.nanoTime();
+            if (waitNs > 0) {
+                Thread.sleep(waitNs / 1_000_000, (int) (waitNs % 1_000_000));
+            }
+
+            Canvas canvas = Build.VERSION.SDK_INT >= AndroidVersions.API_23_ANDROID_6_0 ? surface.lockHardwareCanvas() : surface.lockCanvas(null);
+            try {
+                drawFrame(canvas, paint, width, height, i);
+            } finally {
+                surface.unlockCanvasAndPost(canvas);
+            }
+        }
+    }
+
+    private static void drawFrame(Canvas canvas, Paint paint, int width, int height, int index) {
+        // Some moving content, so that each frame must actually be encoded
+        canvas.drawColor(Color.HSVToColor(new float[] {(index * 3) % 360, 0.5f, 0.8f}));
+        int cellSize = height / 8;
+        for (int y = 0; y < height; y += cellSize) {
+            for (int x = 0; x < width; x += cellSize) {
+                int cell = x / cellSize + y / cellSize + index;
+                paint.setColor(Color.HSVToColor(new float[] {(cell * 37) % 360, 1f, (cell % 2) == 0 ? 1f : 0.3f}));
+                int offset = (index * 8) % cellSize;
+                canvas.drawRect(x + offset, y, x + offset + cellSize / 2f, y + cellSize / 2f, paint);
+            }
+        }
+        paint.setColor(Color.WHITE);
+        paint.setTextSize(cellSize);
+        canvas.drawText(Integer.toString(index), cellSize, height - cellSize, paint);
+    }
+
+    private static void drain(MediaCodec codec, Result result) {
+        MediaCodec.BufferInfo bufferInfo = new MediaCodec.BufferInfo();
+        try {
+            while (!result.eos) {
+                int index = codec.dequeueOutputBuffer(bufferInfo, DEQUEUE_TIMEOUT_US);
+                if (index < 0) {
+                    continue;
+                }
+
+                long nowNs = System.nanoTime();
+                result.eos = (bufferInfo.flags & MediaCodec.BUFFER_FLAG_END_OF_STREAM) != 0;
+                boolean isConfig = (bufferInfo.flags & MediaCodec.BUFFER_FLAG_CODEC_CONFIG) != 0;
+                if (!isConfig && bufferInfo.size > 0 && result.frames < FRAME_COUNT) {
+                    if (result.frames == 0) {
+                        result.firstOutputNs = nowNs;
+                    }
+                    result.lastOutputNs = nowNs;
+                    result.frameSizes[result.frames++] = bufferInfo.size;
+
+                    long latencyUs = nowNs / 1000 - bufferInfo.presentationTimeUs;
+                    if (latencyUs >= 0 && latencyUs < MAX_VALID_LATENCY_US) {
+                        result.latencySumUs += latencyUs;
+                        ++result.latencyCount;
+                        result.maxLatencyUs = Math.max(result.maxLatencyUs, latencyUs);
+                    }
+                }
+                codec.releaseOutputBuffer(index, false);
+            }
+        } catch (IllegalStateException e) {
+            // The codec has been stopped
+        }
+    }
+
+    private static String formatResult(Result result) {
+        if (result.frames < 2) {
+            return "no output";
+        }
+
+        StringBuilder builder = new StringBuilder();
+
+        double durationSec = (result.lastOutputNs - result.firstOutputNs) / 1e9;
+        double fps = (result.frames - 1) / durationSec;
+        builder.append(String.format(Locale.US, "%5.1f fps", fps));
+        if (result.frames < FRAME_COUNT) {
+            builder.append(" (").append(FRAME_COUNT - result.frames).append(" frames dropped)");
+        }
+
+        if (result.latencyCount > 0) {
+            double avgMs = result.latencySumUs / 1000.0 / result.latencyCount;
+            builder.append(String.format(Locale.US, ", latency %5.1f ms (max %5.1f ms)", avgMs, result.maxLatencyUs / 1000.0));
+        }
+
+        // Output bit rate of each window, at the nominal frame rate
+        int windows = result.frames / BIT_RATE_WINDOW;
+        if (windows > 0) {
+            double sum = 0;
+            double sumSquares = 0;
+            for (int w = 0; w < windows; ++w) {
+                long bytes = 0;
+                for (int i = w * BIT_RATE_WINDOW; i < (w + 1) * BIT_RATE_WINDOW; ++i) {
+                    bytes += result.frameSizes[i];
+                }
+                double bps = bytes * 8.0 * FRAME_RATE / BIT_RATE_WINDOW;
+                sum += bps;
+                sumSquares += bps * bps;
+            }
+            double mean = sum / windows;
+            double stddev = Math.sqrt(Math.max(0, sumSquares / windows - mean * mean));
+            builder.append(String.format(Locale.US, ", %5.2f Mbps (±%.0f%%)", mean / 1e6, 100 * stddev / mean));
+        }
+
+        return builder.toString();
+    }
+}
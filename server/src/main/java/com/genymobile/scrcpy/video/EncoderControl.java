@@ -0,0 +1,160 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.AndroidVersions;
+import com.genymobile.scrcpy.device.Point;
+import com.genymobile.scrcpy.device.Position;
+import com.genymobile.scrcpy.device.Size;
+import com.genymobile.scrcpy.util.Ln;
+
+import android.annotation.TargetApi;
+import android.media.MediaCodec;
+import android.os.Build;
+import android.os.Bundle;
+import android.os.SystemClock;
+
+/**
+ * Update the parameters of the running video encoder (from the controller thread).
+ */
+public class EncoderControl {
+
+    // The region of interest is a rectangle of 1/ROI_FRACTION of the video size in each dimension, centered on the pointer
+    private static final int ROI_FRACTION = 4;
+    // Negative QP offset (i.e. better quality) of the region of interest
+    private static final int ROI_QP_OFFSET = -6;
+    // Minimal interval between two region-of-interest updates
+    private static final long ROI_UPDATE_INTERVAL_MS = 100;
+    // Rectangles are aligned on macroblocks, so that small moves do not cause updates
+    private static final int ROI_ALIGN = 16;
+
+    private final boolean roiEnabled;
+
+    // Current instance of MediaCodec to update live
+    private MediaCodec runningMediaCodec;
+    private Size runningSize;
+
+    private String lastRoi;
+    private long lastRoiUpdate;
+
+    public EncoderControl(boolean roiEnabled) {
+        this.roiEnabled = roiEnabled && Build.VERSION.SDK_INT >= AndroidVersions.API_34_ANDROID_14;
+        if (roiEnabled && !this.roiEnabled) {
+            Ln.w("Video region of interest requires Android 14, ignored");
+        }
+    }
+
+    public synchronized void setRunningMediaCodec(MediaCodec runningMediaCodec, Size size) {
+        this.runningMediaCodec = runningMediaCodec;
+        this.runningSize = size;
+        // The parameters are not kept across configurations
+        lastRoi = null;
+    }
+
+    private boolean setParameters(Bundle params) {
+        if (runningMediaCodec == null) {
+            return false;
+        }
+
+        try {
+            runningMediaCodec.setParameters(params);
+            return true;
+        } catch (IllegalStateException e) {
+            // The encoder is being stopped, ignore
+            return false;
+        }
+    }
+
+    public synchronized void requestSyncFrame() {
+        Bundle params = new Bundle();
+        params.putInt(MediaCodec.PARAMETER_KEY_REQUEST_SYNC_FRAME, 0);
+        if (setParameters(params)) {
+            Ln.d("Sync frame requested");
+        }
+    }
+
+    public synchronized void setSuspended(boolean suspended) {
+        Bundle params = new Bundle();
+        params.putInt(MediaCodec.PARAMETER_KEY_SUSPEND, suspended ? 1 : 0);
+        setParameters(params);
+    }
+
+    public synchronized void setBitRate(int bitRate) {
+        Bundle params = new Bundle();
+        params.putInt(MediaCodec.PARAMETER_KEY_VIDEO_BITRATE, bitRate);
+        setParameters(params);
+    }
+
+    /**
+     * Give more bits to the region around the pointer.
+     *
+     * @param position the pointer position, relative to the video size
+     */
+    public synchronized void onPointer(Position position) {
+        if (!roiEnabled || runningMediaCodec == null) {
+            return;
+        }
+
+        long now = SystemClock.uptimeMillis();
+        if (now - lastRoiUpdate < ROI_UPDATE_INTERVAL_MS) {
+            return;
+        }
+
+        String roi = formatRoi(position, runningSize);
+        if (roi == null || roi.equals(lastRoi)) {
+            return;
+        }
+
+        if (setQpOffsetRects(roi)) {
+            lastRoi = roi;
+            lastRoiUpdate = now;
+        }
+    }
+
+    @TargetApi(AndroidVersions.API_34_ANDROID_14)
+    private boolean setQpOffsetRects(String roi) {
+        Bundle params = new Bundle();
+        params.putString(MediaCodec.PARAMETER_KEY_QP_OFFSET_RECTS, roi);
+        try {
+            return setParameters(params);
+        } catch (IllegalArgumentException e) {
+            // The encoder does not support it
+            return false;
+        }
+    }
+
+    private static String formatRoi(Position position, Size videoSize) {
+        Size screenSize = position.getScreenSize();
+        if (screenSize.getWidth() == 0 || screenSize.getHeight() == 0) {
+            return null;
+        }
+
+        int width = videoSize.getWidth();
+        int height = videoSize.getHeight();
+
+        // The position is relative to the size known by the client, which may differ from the encoder size (e.g. just after a resize)
+        Point point = position.getPoint();
+        int x = (int) ((long) point.getX() * width / screenSize.getWidth());
+        int y = (int) ((long) point.getY() * height / screenSize.getHeight());
+
+        int halfWidth = width / ROI_FRACTION / 2;
+        int halfHeight = height / ROI_FRACTION / 2;
+
+        int left = clamp(align(x - halfWidth), width);
+        int top = clamp(align(y - halfHeight), height);
+        int right = clamp(align(x + halfWidth), width);
+        int bottom = clamp(align(y + halfHeight), height);
+        if (left >= right || top >= bottom) {
+            return null;
+        }
+
+        // Format: "top,left-bottom,right=offset" (see MediaCodec.PARAMETER_KEY_QP_OFFSET_RECTS)
+        return top + "," + left + "-" + bottom + "," + right + "=" + ROI_QP_OFFSET;
+    }
+
+    private static int align(int value) {
+        return value / ROI_ALIGN * ROI_ALIGN;
+    }
+
+    private static int clamp(int value, int max) {
+        return Math.max(0, Math.min(value, max));
+    }
+}
@@ -0,0 +1,78 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.util.Ln;
+
+import android.os.SystemClock;
+
+/**
+ * Suspend the video encoder when no new frames have been captured for a given delay, and resume it on the next frame.
+ * <p>
+ * The frames are observed on the OpenGL thread (before they are rendered to the encoder surface), the timeout is checked from the encoder
+ * thread.
+ */
+public class IdleMonitor {
+
+    public interface Listener {
+        void onIdleChanged(boolean idle);
+    }
+
+    private final long timeoutMs;
+    private final EncoderControl encoderControl;
+
+    private long lastFrameTime;
+    private boolean idle;
+
+    private Listener listener;
+
+    public IdleMonitor(long timeoutMs, EncoderControl encoderControl) {
+        this.timeoutMs = timeoutMs;
+        this.encoderControl = encoderControl;
+    }
+
+    public synchronized void setListener(Listener listener) {
+        this.listener = listener;
+    }
+
+    /**
+     * Called when a new encoder is started (it is not suspended).
+     */
+    public synchronized void reset() {
+        lastFrameTime = SystemClock.uptimeMillis();
+        setIdle(false);
+    }
+
+    /**
+     * Called on each new captured frame, before it is rendered to the encoder surface.
+     */
+    public synchronized void onFrame() {
+        lastFrameTime = SystemClock.uptimeMillis();
+        if (idle) {
+            // Resume before the frame is rendered, so that it is encoded
+            encoderControl.setSuspended(false);
+            setIdle(false);
+        }
+    }
+
+    /**
+     * Called periodically from the encoder thread.
+     */
+    public synchronized void check() {
+        if (!idle && SystemClock.uptimeMillis() - lastFrameTime >= timeoutMs) {
+            // The last frame has already been repeated by the encoder (KEY_REPEAT_PREVIOUS_FRAME_AFTER)
+            encoderControl.setSuspended(true);
+            setIdle(true);
+        }
+    }
+
+    private void setIdle(boolean idle) {
+        if (this.idle == idle) {
+            return;
+        }
+
+        this.idle = idle;
+        Ln.d(idle ? "Video idle, encoder suspended" : "Video active, encoder resumed");
+        if (listener != null) {
+            listener.onIdleChanged(idle);
+        }
+    }
+}
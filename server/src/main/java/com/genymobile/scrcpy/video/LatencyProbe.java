@@ -0,0 +1,101 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.opengl.OpenGLException;
+import com.genymobile.scrcpy.opengl.OpenGLFilter;
+import com.genymobile.scrcpy.opengl.OpenGLRunner;
+
+import android.opengl.GLES20;
+
+/**
+ * Test pattern drawn over the captured frames to measure the end-to-end latency (for --latency-probe).
+ * <p>
+ * The client sends a code (1..255) in a control message, and measures the delay until a frame containing this code is presented. The pattern is
+ * a row of square cells in the top-left corner: a white marker, a black marker, then the 8 bits of the code (MSB first, white for 1). Code 0
+ * draws nothing.
+ * <p>
+ * The client must use the same layout (see latency_probe.c).
+ */
+public class LatencyProbe {
+
+    public static final int CELL_COUNT = 10;
+    private static final int MIN_CELL_SIZE = 16;
+
+    private volatile int code;
+    private OpenGLRunner runner;
+
+    public void setCode(int code) {
+        this.code = code;
+        OpenGLRunner currentRunner;
+        synchronized (this) {
+            currentRunner = runner;
+        }
+        if (currentRunner != null) {
+            // Do not wait for the next captured frame, the screen content may be static
+            currentRunner.requestRender();
+        }
+    }
+
+    /**
+     * Set the OpenGL runner drawing the frames to the encoder ({@code null} when it is released).
+     */
+    public synchronized void setRunner(OpenGLRunner runner) {
+        this.runner = runner;
+    }
+
+    /**
+     * Return the size of the cells, in pixels, for a frame size (a multiple of 16, to match the macroblocks).
+     */
+    public static int getCellSize(int width, int height) {
+        return Math.max(MIN_CELL_SIZE, (Math.min(width, height) / 24) & ~15);
+    }
+
+    /**
+     * Wrap a filter to draw the pattern over its output.
+     */
+    public OpenGLFilter wrap(OpenGLFilter filter) {
+        return new OpenGLFilter() {
+            private final int[] viewport = new int[4];
+
+            @Override
+            public void init() throws OpenGLException {
+                filter.init();
+            }
+
+            @Override
+            public void draw(int textureId, float[] texMatrix) {
+                filter.draw(textureId, texMatrix);
+
+                int value = code;
+                if (value != 0) {
+                    GLES20.glGetIntegerv(GLES20.GL_VIEWPORT, viewport, 0);
+                    drawPattern(value, viewport[2], viewport[3]);
+                }
+            }
+
+            @Override
+            public void release() {
+                filter.release();
+            }
+        };
+    }
+
+    private static void drawPattern(int code, int width, int height) {
+        int cellSize = getCellSize(width, height);
+
+        // Clear each cell to its color (the OpenGL origin is the bottom-left corner)
+        GLES20.glEnable(GLES20.GL_SCISSOR_TEST);
+        for (int i = 0; i < CELL_COUNT; ++i) {
+            boolean white;
+            if (i < 2) {
+                white = i == 0;
+            } else {
+                white = ((code >> (CELL_COUNT - 1 - i)) & 1) != 0;
+            }
+            float c = white ? 1f : 0f;
+            GLES20.glScissor(i * cellSize, height - cellSize, cellSize, cellSize);
+            GLES20.glClearColor(c, c, c, 1f);
+            GLES20.glClear(GLES20.GL_COLOR_BUFFER_BIT);
+        }
+        GLES20.glDisable(GLES20.GL_SCISSOR_TEST);
+    }
+}
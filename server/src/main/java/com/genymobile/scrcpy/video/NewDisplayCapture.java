@@ -50,6 +50,7 @@ public class NewDisplayCapture extends SurfaceCapture {
     private Size mainDisplaySize;
     private int mainDisplayDpi;
     private int maxSize;
+    private final float renderScale;
     private int displayImePolicy;
     private final Rect crop;
     private final boolean captureOrientationLocked;
@@ -70,6 +71,7 @@ public class NewDisplayCapture extends SurfaceCapture {
         this.newDisplay = options.getNewDisplay();
         assert newDisplay != null;
         this.maxSize = options.getMaxSize();
+        this.renderScale = options.getRenderScale();
         this.displayImePolicy = options.getDisplayImePolicy();
         this.crop = options.getCrop();
         assert options.getCaptureOrientationLock() != null;
@@ -111,6 +113,12 @@ public class NewDisplayCapture extends SurfaceCapture {
             if (!newDisplay.hasExplicitDpi()) {
                 dpi = scaleDpi(mainDisplaySize, mainDisplayDpi, displaySize);
             }
+            if (renderScale != 1) {
+                // Render fewer pixels with the same layout (the client upscales the video)
+                Size scaledSize = scaleSize(displaySize, renderScale);
+                dpi = scaleDpi(displaySize, dpi, scaledSize);
+                displaySize = scaledSize;
+            }
 
             videoSize = displaySize;
             displayRotation = 0;
@@ -256,6 +264,12 @@ public class NewDisplayCapture extends SurfaceCapture {
         return true;
     }
 
+    private static Size scaleSize(Size size, float scale) {
+        int width = Math.max(8, Math.round(size.getWidth() * scale));
+        int height = Math.max(8, Math.round(size.getHeight() * scale));
+        return new Size(width, height);
+    }
+
     private static int scaleDpi(Size initialSize, int initialDpi, Size size) {
         int den = initialSize.getMax();
         int num = size.getMax();
@@ -0,0 +1,72 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.util.Ln;
+
+/**
+ * Detect the frames produced by the encoder to repeat the last frame (KEY_REPEAT_PREVIOUS_FRAME_AFTER) while the screen did not change.
+ * <p>
+ * The timestamps of the frames rendered to the encoder surface are recorded on the OpenGL thread. An output frame whose timestamp was never
+ * rendered has been produced by the encoder itself.
+ */
+public class RepeatFrameDetector {
+
+    // Largely enough for the frames queued in the encoder
+    private static final int TIMESTAMP_COUNT = 32;
+
+    // Ring buffer of the last rendered timestamps, in microseconds (the unit of the output presentation timestamps)
+    private final long[] timestamps = new long[TIMESTAMP_COUNT];
+    private int head;
+    private int count;
+
+    // The first output frame of an encoder session must have been rendered, otherwise the timestamps are not preserved by the encoder
+    private boolean verified;
+    private boolean disabled;
+
+    /**
+     * Called when a new encoder is started.
+     */
+    public synchronized void reset() {
+        head = 0;
+        count = 0;
+        verified = false;
+    }
+
+    /**
+     * Called on the OpenGL thread for each frame rendered to the encoder surface.
+     */
+    public synchronized void onRender(long timestampNs) {
+        timestamps[head] = timestampNs / 1000;
+        head = (head + 1) % TIMESTAMP_COUNT;
+        if (count < TIMESTAMP_COUNT) {
+            ++count;
+        }
+    }
+
+    /**
+     * Called from the encoder thread for each output frame.
+     */
+    public synchronized boolean isRepeat(long ptsUs) {
+        if (disabled) {
+            return false;
+        }
+
+        boolean rendered = false;
+        for (int i = 0; i < count; ++i) {
+            if (timestamps[i] == ptsUs) {
+                rendered = true;
+                break;
+            }
+        }
+
+        if (!verified) {
+            if (!rendered) {
+                Ln.w("Encoder timestamps do not match the rendered frames, repeated frames are not flagged");
+                disabled = true;
+                return false;
+            }
+            verified = true;
+        }
+
+        return !rendered;
+    }
+}
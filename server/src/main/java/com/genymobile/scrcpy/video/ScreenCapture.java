@@ -34,6 +34,8 @@ public class ScreenCapture extends SurfaceCapture {
     private Orientation.Lock captureOrientationLock;
     private Orientation captureOrientation;
     private final float angle;
+    // Reset to false if a filter is required (the content could not be moved within the video without restarting the encoder)
+    private boolean square;
 
     private DisplayInfo displayInfo;
     private Size videoSize;
@@ -46,6 +48,8 @@ public class ScreenCapture extends SurfaceCapture {
     private AffineMatrix transform;
     private OpenGLRunner glRunner;
 
+    private boolean started;
+
     public ScreenCapture(VirtualDisplayListener vdListener, Options options) {
         this.vdListener = vdListener;
         this.displayId = options.getDisplayId();
@@ -57,15 +61,16 @@ public class ScreenCapture extends SurfaceCapture {
         assert captureOrientationLock != null;
         assert captureOrientation != null;
         this.angle = options.getAngle();
+        this.square = options.getVideoSquare();
     }
 
     @Override
     public void init() {
-        displaySizeMonitor.start(displayId, this::invalidate);
+        displaySizeMonitor.start(displayId, this::onDisplaySizeChanged);
     }
 
     @Override
-    public void prepare() throws ConfigurationException {
+    public synchronized void prepare() throws ConfigurationException {
         displayInfo = ServiceManager.getDisplayManager().getDisplayInfo(displayId);
         if (displayInfo == null) {
             Ln.e("Display " + displayId + " not found\n" + LogUtils.buildDisplayListMessage());
@@ -97,11 +102,26 @@ public class ScreenCapture extends SurfaceCapture {
         filter.addAngle(angle);
 
         transform = filter.getInverseTransform();
-        videoSize = filter.getOutputSize().limit(maxSize).round8();
+        if (square && transform != null) {
+            Ln.w("Square video is not supported with crop, capture orientation or angle, the encoder will be restarted on rotation");
+            square = false;
+        }
+
+        if (square) {
+            videoSize = getSquareVideoSize(displaySize);
+        } else {
+            videoSize = filter.getOutputSize().limit(maxSize).round8();
+        }
+    }
+
+    private Size getSquareVideoSize(Size displaySize) {
+        // Large enough for both orientations, so that a rotation only moves the content within the video
+        int side = displaySize.getMax();
+        return new Size(side, side).limit(maxSize).round8();
     }
 
     @Override
-    public void start(Surface surface) throws IOException {
+    public synchronized void start(Surface surface) throws IOException {
         if (display != null) {
             SurfaceControl.destroyDisplay(display);
             display = null;
@@ -134,7 +154,8 @@ public class ScreenCapture extends SurfaceCapture {
 
                 Size deviceSize = displayInfo.getSize();
                 int layerStack = displayInfo.getLayerStack();
-                setDisplaySurface(display, surface, deviceSize.toRect(), inputSize.toRect(), layerStack);
+                Rect displayRect = square ? getContentRect(deviceSize, inputSize) : inputSize.toRect();
+                setDisplaySurface(display, surface, deviceSize.toRect(), displayRect, layerStack);
                 Ln.d("Display: using SurfaceControl API");
             } catch (Exception surfaceControlException) {
                 Ln.e("Could not create display using DisplayManager", displayManagerException);
@@ -143,13 +164,22 @@ public class ScreenCapture extends SurfaceCapture {
             }
         }
 
+        notifyVirtualDisplay(inputSize);
+        started = true;
+    }
+
+    private void notifyVirtualDisplay(Size inputSize) {
         if (vdListener != null) {
             int virtualDisplayId;
             PositionMapper positionMapper;
             if (virtualDisplay == null || displayId == 0) {
                 // Surface control or main display: send all events to the original display, relative to the device size
                 Size deviceSize = displayInfo.getSize();
-                positionMapper = PositionMapper.create(videoSize, transform, deviceSize);
+                if (square) {
+                    positionMapper = createSquarePositionMapper(videoSize, deviceSize);
+                } else {
+                    positionMapper = PositionMapper.create(videoSize, transform, deviceSize);
+                }
                 virtualDisplayId = displayId;
             } else {
                 // The positions are relative to the virtual display, not the original display (so use inputSize, not deviceSize!)
@@ -160,8 +190,72 @@ public class ScreenCapture extends SurfaceCapture {
         }
     }
 
+    private void onDisplaySizeChanged() {
+        if (!square || !updateSquareContent()) {
+            invalidate();
+        }
+    }
+
+    /**
+     * In square mode, move the content within the video on rotation, without restarting the capture and the encoder.
+     *
+     * @return {@code true} if the content has been updated, {@code false} if a reset is necessary
+     */
+    private synchronized boolean updateSquareContent() {
+        if (!started) {
+            return false;
+        }
+
+        DisplayInfo newDisplayInfo = ServiceManager.getDisplayManager().getDisplayInfo(displayId);
+        if (newDisplayInfo == null) {
+            return false;
+        }
+
+        Size deviceSize = newDisplayInfo.getSize();
+        if (!getSquareVideoSize(deviceSize).equals(videoSize)) {
+            // Not just a rotation
+            return false;
+        }
+
+        displayInfo = newDisplayInfo;
+        if (display != null) {
+            // A display mirrored by DisplayManager is letterboxed by the system, but the SurfaceControl projection must be set explicitly
+            setDisplayProjection(display, deviceSize.toRect(), getContentRect(deviceSize, videoSize));
+        }
+        notifyVirtualDisplay(videoSize);
+
+        Ln.d("Display rotated: content moved within the square video");
+        return true;
+    }
+
+    private static Rect getContentRect(Size deviceSize, Size videoSize) {
+        // Fit and center, like the system does for mirrored displays
+        int dw = deviceSize.getWidth();
+        int dh = deviceSize.getHeight();
+        int vw = videoSize.getWidth();
+        int vh = videoSize.getHeight();
+        if ((long) vw * dh < (long) vh * dw) {
+            int h = dh * vw / dw;
+            int top = (vh - h) / 2;
+            return new Rect(0, top, vw, top + h);
+        }
+
+        int w = dw * vh / dh;
+        int left = (vw - w) / 2;
+        return new Rect(left, 0, left + w, vh);
+    }
+
+    private static PositionMapper createSquarePositionMapper(Size videoSize, Size deviceSize) {
+        Rect content = getContentRect(deviceSize, videoSize);
+        double scaleX = (double) deviceSize.getWidth() / content.width();
+        double scaleY = (double) deviceSize.getHeight() / content.height();
+        AffineMatrix videoToDevice = AffineMatrix.scale(scaleX, scaleY).multiply(AffineMatrix.translate(-content.left, -content.top));
+        return new PositionMapper(videoSize, videoToDevice);
+    }
+
     @Override
-    public void stop() {
+    public synchronized void stop() {
+        started = false;
         if (glRunner != null) {
             glRunner.stopAndRelease();
             glRunner = null;
@@ -169,7 +263,7 @@ public class ScreenCapture extends SurfaceCapture {
     }
 
     @Override
-    public void release() {
+    public synchronized void release() {
         displaySizeMonitor.stopAndRelease();
 
         if (display != null) {
@@ -201,6 +295,15 @@ public class ScreenCapture extends SurfaceCapture {
         return SurfaceControl.createDisplay("scrcpy", secure);
     }
 
+    private static void setDisplayProjection(IBinder display, Rect deviceRect, Rect displayRect) {
+        SurfaceControl.openTransaction();
+        try {
+            SurfaceControl.setDisplayProjection(display, 0, deviceRect, displayRect);
+        } finally {
+            SurfaceControl.closeTransaction();
+        }
+    }
+
     private static void setDisplaySurface(IBinder display, Surface surface, Rect deviceRect, Rect displayRect, int layerStack) {
         SurfaceControl.openTransaction();
         try {
@@ -71,6 +71,17 @@ public abstract class SurfaceCapture {
      */
     public abstract Size getSize();
 
+    /**
+     * Return the rate at which frames are produced, if it is known and higher than usual.
+     * <p>
+     * The encoder is then configured to process frames at this rate.
+     *
+     * @return the frame rate, or 0 if unknown
+     */
+    public int getOperatingRate() {
+        return 0;
+    }
+
     /**
      * Set the maximum capture size (set by the encoder if it does not support the current size).
      *
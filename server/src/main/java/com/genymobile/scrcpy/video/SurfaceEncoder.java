@@ -6,9 +6,14 @@ import com.genymobile.scrcpy.Options;
 import com.genymobile.scrcpy.device.ConfigurationException;
 import com.genymobile.scrcpy.device.Size;
 import com.genymobile.scrcpy.device.Streamer;
+import com.genymobile.scrcpy.opengl.AffineOpenGLFilter;
+import com.genymobile.scrcpy.opengl.OpenGLFilter;
+import com.genymobile.scrcpy.opengl.OpenGLRunner;
+import com.genymobile.scrcpy.util.AffineMatrix;
 import com.genymobile.scrcpy.util.Codec;
 import com.genymobile.scrcpy.util.CodecOption;
 import com.genymobile.scrcpy.util.CodecUtils;
+import com.genymobile.scrcpy.util.EncoderCache;
 import com.genymobile.scrcpy.util.IO;
 import com.genymobile.scrcpy.util.Ln;
 import com.genymobile.scrcpy.util.LogUtils;
@@ -29,8 +34,14 @@ import java.util.concurrent.atomic.AtomicBoolean;
 public class SurfaceEncoder implements AsyncProcessor {
 
     private static final int DEFAULT_I_FRAME_INTERVAL = 10; // seconds
+    // With intra refresh, keyframes are only produced on request (in practice)
+    private static final int INTRA_REFRESH_I_FRAME_INTERVAL = 3600; // seconds
     private static final int REPEAT_FRAME_DELAY_US = 100_000; // repeat after 100ms
+    // In thumbnail mode, every frame is a keyframe
+    private static final int THUMBNAIL_I_FRAME_INTERVAL = 0;
     private static final String KEY_MAX_FPS_TO_ENCODER = "max-fps-to-encoder";
+    // Interval to check the idle timeout, if enabled
+    private static final long IDLE_CHECK_INTERVAL_US = 100_000;
 
     // Keep the values in descending order
     private static final int[] MAX_SIZE_FALLBACK = {2560, 1920, 1600, 1280, 1024, 800};
@@ -43,6 +54,13 @@ public class SurfaceEncoder implements AsyncProcessor {
     private final int videoBitRate;
     private final float maxFps;
     private final boolean downsizeOnError;
+    private final int intraRefreshPeriod; // in frames, 0 if disabled
+    private final int thumbnailInterval; // in ms, 0 if not in thumbnail mode
+    private long nextSyncFrameTime; // in thumbnail mode, uptime in ms
+    // Reset to false if the encoder rejects the low-latency configuration
+    private boolean lowLatency;
+    // Encode in 10-bit (HEVC Main10), reset to false if the encoder rejects it
+    private boolean hdr;
 
     private boolean firstFrameSent;
     private int consecutiveErrors;
@@ -51,21 +69,40 @@ public class SurfaceEncoder implements AsyncProcessor {
     private final AtomicBoolean stopped = new AtomicBoolean();
 
     private final CaptureReset reset = new CaptureReset();
+    private final EncoderControl encoderControl;
+    private final BitRateAdapter bitRateAdapter;
+    private final VideoSizeAdapter videoSizeAdapter;
+    private final IdleMonitor idleMonitor; // null if disabled
+    private final LatencyProbe latencyProbe; // null if disabled
+    private final ThermalMonitor thermalMonitor; // null if not supported
+    // Only used if the frames are rendered by OpenGL (the rendered timestamps are not observable otherwise)
+    private final RepeatFrameDetector repeatFrameDetector = new RepeatFrameDetector();
 
     public SurfaceEncoder(SurfaceCapture capture, Streamer streamer, Options options) {
         this.capture = capture;
         this.streamer = streamer;
         this.videoBitRate = options.getVideoBitRate();
-        this.maxFps = options.getMaxFps();
+        this.encoderControl = new EncoderControl(options.getVideoRoi());
+        this.bitRateAdapter = new BitRateAdapter(videoBitRate, reset, encoderControl);
+        this.videoSizeAdapter = new VideoSizeAdapter(options.getMaxSize(), reset);
+        int idleTimeout = options.getVideoIdleTimeout();
+        this.idleMonitor = idleTimeout > 0 ? new IdleMonitor(idleTimeout, encoderControl) : null;
+        this.latencyProbe = options.getLatencyProbe() ? new LatencyProbe() : null;
+        this.thermalMonitor = createThermalMonitor(options, bitRateAdapter, reset);
+        this.thumbnailInterval = options.getVideoMode() == VideoMode.THUMBNAIL ? options.getThumbnailInterval() : 0;
+        this.maxFps = getMaxFps(options.getMaxFps(), thumbnailInterval);
         this.codecOptions = options.getVideoCodecOptions();
         this.encoderName = options.getVideoEncoder();
         this.downsizeOnError = options.getDownsizeOnError();
+        this.intraRefreshPeriod = options.getVideoIntraRefresh();
+        this.lowLatency = options.getVideoEncoderProfile() == VideoEncoderProfile.LOW_LATENCY;
+        this.hdr = options.getVideoHdr();
     }
 
     private void streamCapture() throws IOException, ConfigurationException {
         Codec codec = streamer.getCodec();
         MediaCodec mediaCodec = createMediaCodec(codec, encoderName);
-        MediaFormat format = createFormat(codec.getMimeType(), videoBitRate, maxFps, codecOptions);
+        int refreshPeriod = getSupportedIntraRefreshPeriod(mediaCodec, codec.getMimeType());
 
         capture.init(reset);
 
@@ -75,24 +112,68 @@ public class SurfaceEncoder implements AsyncProcessor {
 
             do {
                 reset.consumeReset(); // If a capture reset was requested, it is implicitly fulfilled
+                int requestedMaxSize = videoSizeAdapter.consumeMaxSizeRequest();
+                if (requestedMaxSize != -1 && capture.setMaxSize(requestedMaxSize)) {
+                    Ln.i("Viewport changed: continuing with -m" + requestedMaxSize);
+                }
                 capture.prepare();
                 Size size = capture.getSize();
+                if (bitRateAdapter.consumeDownsizeRequest()) {
+                    size = downsize(size);
+                }
+                videoSizeAdapter.setVideoSize(size);
                 if (!headerWritten) {
                     streamer.writeVideoHeader(size);
                     headerWritten = true;
                 }
 
+                // Recreated on each iteration, since the low-latency keys or the HDR profile may have to be dropped
+                String lowLatencyEncoderName = lowLatency ? mediaCodec.getName() : null;
+                // The frame rate may be capped to reduce the device temperature
+                float configuredMaxFps = thermalMonitor != null ? thermalMonitor.limitMaxFps(maxFps) : maxFps;
+                MediaFormat format = createFormat(codec.getMimeType(), videoBitRate, configuredMaxFps, refreshPeriod, thumbnailInterval,
+                        lowLatencyEncoderName, hdr, codecOptions);
                 format.setInteger(MediaFormat.KEY_WIDTH, size.getWidth());
                 format.setInteger(MediaFormat.KEY_HEIGHT, size.getHeight());
+                // The bit rate may have been adapted from the client feedback
+                format.setInteger(MediaFormat.KEY_BIT_RATE, bitRateAdapter.getBitRate());
+                int operatingRate = capture.getOperatingRate();
+                if (operatingRate > 0 && Build.VERSION.SDK_INT >= AndroidVersions.API_23_ANDROID_6_0) {
+                    // Frames may be produced in bursts (e.g. high speed camera), the encoder must keep up with the peak rate
+                    format.setInteger(MediaFormat.KEY_OPERATING_RATE, operatingRate);
+                    format.setInteger(MediaFormat.KEY_PRIORITY, 0); // realtime
+                }
 
                 Surface surface = null;
+                OpenGLRunner glRunner = null;
+                boolean mediaCodecConfigured = false;
                 boolean mediaCodecStarted = false;
                 boolean captureStarted = false;
                 try {
                     mediaCodec.configure(format, null, null, MediaCodec.CONFIGURE_FLAG_ENCODE);
+                    mediaCodecConfigured = true;
                     surface = mediaCodec.createInputSurface();
 
-                    capture.start(surface);
+                    Surface captureSurface = surface;
+                    if (idleMonitor != null || latencyProbe != null) {
+                        // The frames produced by the capture are not observable (or modifiable) if it renders directly to the encoder surface
+                        OpenGLFilter filter = new AffineOpenGLFilter(AffineMatrix.IDENTITY);
+                        if (latencyProbe != null) {
+                            filter = latencyProbe.wrap(filter);
+                        }
+                        glRunner = new OpenGLRunner(filter);
+                        if (idleMonitor != null) {
+                            glRunner.setFrameListener(idleMonitor::onFrame);
+                        }
+                        repeatFrameDetector.reset();
+                        glRunner.setRenderListener(repeatFrameDetector::onRender);
+                        captureSurface = glRunner.start(size, size, surface);
+                        if (latencyProbe != null) {
+                            latencyProbe.setRunner(glRunner);
+                        }
+                    }
+
+                    capture.start(captureSurface);
                     captureStarted = true;
 
                     mediaCodec.start();
@@ -100,6 +181,11 @@ public class SurfaceEncoder implements AsyncProcessor {
 
                     // Set the MediaCodec instance to "interrupt" (by signaling an EOS) on reset
                     reset.setRunningMediaCodec(mediaCodec);
+                    encoderControl.setRunningMediaCodec(mediaCodec, size);
+                    if (idleMonitor != null) {
+                        idleMonitor.reset();
+                    }
+                    nextSyncFrameTime = 0;
 
                     if (stopped.get()) {
                         alive = false;
@@ -107,7 +193,7 @@ public class SurfaceEncoder implements AsyncProcessor {
                         boolean resetRequested = reset.consumeReset();
                         if (!resetRequested) {
                             // If a reset is requested during encode(), it will interrupt the encoding by an EOS
-                            encode(mediaCodec, streamer);
+                            encode(mediaCodec, streamer, glRunner != null);
                         }
                         // The capture might have been closed internally (for example if the camera is disconnected)
                         alive = !stopped.get() && !capture.isClosed();
@@ -117,6 +203,19 @@ public class SurfaceEncoder implements AsyncProcessor {
                         // Do not retry on broken pipe, which is expected on close because the socket is closed by the client
                         throw e;
                     }
+                    if (lowLatency && !mediaCodecConfigured) {
+                        // Some encoders reject the keys they do not support
+                        Ln.w("Encoder rejected the low-latency configuration, using the default one: " + e.getMessage());
+                        lowLatency = false;
+                        alive = true;
+                        continue;
+                    }
+                    if (hdr && !mediaCodecConfigured) {
+                        Ln.w("Encoder rejected the HEVC Main10 profile, encoding in 8-bit: " + e.getMessage());
+                        hdr = false;
+                        alive = true;
+                        continue;
+                    }
                     Ln.e("Capture/encoding error: " + e.getClass().getName() + ": " + e.getMessage());
                     if (!prepareRetry(size)) {
                         throw e;
@@ -124,9 +223,16 @@ public class SurfaceEncoder implements AsyncProcessor {
                     alive = true;
                 } finally {
                     reset.setRunningMediaCodec(null);
+                    encoderControl.setRunningMediaCodec(null, null);
                     if (captureStarted) {
                         capture.stop();
                     }
+                    if (glRunner != null) {
+                        if (latencyProbe != null) {
+                            latencyProbe.setRunner(null);
+                        }
+                        glRunner.stopAndRelease();
+                    }
                     if (mediaCodecStarted) {
                         try {
                             mediaCodec.stop();
@@ -182,6 +288,18 @@ public class SurfaceEncoder implements AsyncProcessor {
         return true;
     }
 
+    private Size downsize(Size currentSize) throws ConfigurationException, IOException {
+        int newMaxSize = chooseMaxSizeFallback(currentSize);
+        if (newMaxSize == 0 || !capture.setMaxSize(newMaxSize)) {
+            // Keep the current size
+            return currentSize;
+        }
+
+        Ln.i("Congestion: continuing with -m" + newMaxSize);
+        capture.prepare();
+        return capture.getSize();
+    }
+
     private static int chooseMaxSizeFallback(Size failedSize) {
         int currentMaxSize = Math.max(failedSize.getWidth(), failedSize.getHeight());
         for (int value : MAX_SIZE_FALLBACK) {
@@ -194,12 +312,26 @@ public class SurfaceEncoder implements AsyncProcessor {
         return 0;
     }
 
-    private void encode(MediaCodec codec, Streamer streamer) throws IOException {
+    private void encode(MediaCodec codec, Streamer streamer, boolean detectRepeats) throws IOException {
         MediaCodec.BufferInfo bufferInfo = new MediaCodec.BufferInfo();
 
+        // If the idle monitor is enabled, wake up periodically to check the timeout
+        long timeoutUs = -1;
+        if (idleMonitor != null) {
+            timeoutUs = IDLE_CHECK_INTERVAL_US;
+        } else if (thumbnailInterval > 0) {
+            timeoutUs = thumbnailInterval * 1000L;
+        }
+
         boolean eos;
         do {
-            int outputBufferId = codec.dequeueOutputBuffer(bufferInfo, -1);
+            int outputBufferId = codec.dequeueOutputBuffer(bufferInfo, timeoutUs);
+            if (idleMonitor != null) {
+                idleMonitor.check();
+            }
+            if (thumbnailInterval > 0) {
+                requestThumbnailSyncFrame();
+            }
             try {
                 eos = (bufferInfo.flags & MediaCodec.BUFFER_FLAG_END_OF_STREAM) != 0;
                 // On EOS, there might be data or not, depending on bufferInfo.size
@@ -207,13 +339,15 @@ public class SurfaceEncoder implements AsyncProcessor {
                     ByteBuffer codecBuffer = codec.getOutputBuffer(outputBufferId);
 
                     boolean isConfig = (bufferInfo.flags & MediaCodec.BUFFER_FLAG_CODEC_CONFIG) != 0;
+                    boolean repeat = false;
                     if (!isConfig) {
                         // If this is not a config packet, then it contains a frame
                         firstFrameSent = true;
                         consecutiveErrors = 0;
+                        repeat = detectRepeats && repeatFrameDetector.isRepeat(bufferInfo.presentationTimeUs);
                     }
 
-                    streamer.writePacket(codecBuffer, bufferInfo);
+                    streamer.writePacket(codecBuffer, bufferInfo, repeat);
                 }
             } finally {
                 if (outputBufferId >= 0) {
@@ -223,6 +357,39 @@ public class SurfaceEncoder implements AsyncProcessor {
         } while (!eos);
     }
 
+    private void requestThumbnailSyncFrame() {
+        long now = SystemClock.uptimeMillis();
+        if (now >= nextSyncFrameTime) {
+            // Some encoders ignore an I-frame interval of 0, request each keyframe explicitly
+            encoderControl.requestSyncFrame();
+            nextSyncFrameTime = now + thumbnailInterval;
+        }
+    }
+
+    private static ThermalMonitor createThermalMonitor(Options options, BitRateAdapter bitRateAdapter, CaptureReset reset) {
+        boolean throttle = options.getThermalThrottle();
+        if (Build.VERSION.SDK_INT < AndroidVersions.API_29_ANDROID_10) {
+            if (throttle) {
+                Ln.w("Thermal throttling requires Android 10, ignored");
+            }
+            return null;
+        }
+        // Without control, the thermal state could not be reported to the client
+        if (!throttle && !options.getControl()) {
+            return null;
+        }
+        return new ThermalMonitor(throttle, bitRateAdapter, reset);
+    }
+
+    private static float getMaxFps(float maxFps, int thumbnailInterval) {
+        if (thumbnailInterval == 0) {
+            return maxFps;
+        }
+
+        float thumbnailFps = 1000f / thumbnailInterval;
+        return maxFps > 0 ? Math.min(maxFps, thumbnailFps) : thumbnailFps;
+    }
+
     private static MediaCodec createMediaCodec(Codec codec, String encoderName) throws IOException, ConfigurationException {
         if (encoderName != null) {
             Ln.d("Creating encoder by name: '" + encoderName + "'");
@@ -244,7 +411,7 @@ public class SurfaceEncoder implements AsyncProcessor {
         }
 
         try {
-            MediaCodec mediaCodec = MediaCodec.createEncoderByType(codec.getMimeType());
+            MediaCodec mediaCodec = EncoderCache.createDefaultEncoder(codec.getMimeType());
             Ln.d("Using video encoder: '" + mediaCodec.getName() + "'");
             return mediaCodec;
         } catch (IOException | IllegalArgumentException e) {
@@ -253,7 +420,32 @@ public class SurfaceEncoder implements AsyncProcessor {
         }
     }
 
-    private static MediaFormat createFormat(String videoMimeType, int bitRate, float maxFps, List<CodecOption> codecOptions) {
+    private int getSupportedIntraRefreshPeriod(MediaCodec mediaCodec, String mimeType) {
+        if (intraRefreshPeriod == 0) {
+            return 0;
+        }
+
+        if (thumbnailInterval > 0) {
+            Ln.w("Intra refresh is not used in thumbnail mode");
+            return 0;
+        }
+
+        if (Build.VERSION.SDK_INT < AndroidVersions.API_24_ANDROID_7_0) {
+            Ln.w("Intra refresh requires Android 7+, using periodic keyframes");
+            return 0;
+        }
+
+        MediaCodecInfo.CodecCapabilities capabilities = mediaCodec.getCodecInfo().getCapabilitiesForType(mimeType);
+        if (!capabilities.isFeatureSupported(MediaCodecInfo.CodecCapabilities.FEATURE_IntraRefresh)) {
+            Ln.w("Encoder '" + mediaCodec.getName() + "' does not support intra refresh, using periodic keyframes");
+            return 0;
+        }
+
+        return intraRefreshPeriod;
+    }
+
+    private static MediaFormat createFormat(String videoMimeType, int bitRate, float maxFps, int intraRefreshPeriod, int thumbnailInterval,
+            String lowLatencyEncoderName, boolean hdr, List<CodecOption> codecOptions) {
         MediaFormat format = new MediaFormat();
         format.setString(MediaFormat.KEY_MIME, videoMimeType);
         format.setInteger(MediaFormat.KEY_BIT_RATE, bitRate);
@@ -263,9 +455,19 @@ public class SurfaceEncoder implements AsyncProcessor {
         if (Build.VERSION.SDK_INT >= AndroidVersions.API_24_ANDROID_7_0) {
             format.setInteger(MediaFormat.KEY_COLOR_RANGE, MediaFormat.COLOR_RANGE_LIMITED);
         }
-        format.setInteger(MediaFormat.KEY_I_FRAME_INTERVAL, DEFAULT_I_FRAME_INTERVAL);
+        if (thumbnailInterval > 0) {
+            format.setInteger(MediaFormat.KEY_I_FRAME_INTERVAL, THUMBNAIL_I_FRAME_INTERVAL);
+        } else if (intraRefreshPeriod > 0 && Build.VERSION.SDK_INT >= AndroidVersions.API_24_ANDROID_7_0) {
+            // Refresh the picture progressively, to avoid the bit rate spikes of keyframes
+            format.setInteger(MediaFormat.KEY_INTRA_REFRESH_PERIOD, intraRefreshPeriod);
+            format.setInteger(MediaFormat.KEY_I_FRAME_INTERVAL, INTRA_REFRESH_I_FRAME_INTERVAL);
+        } else {
+            format.setInteger(MediaFormat.KEY_I_FRAME_INTERVAL, DEFAULT_I_FRAME_INTERVAL);
+        }
         // display the very first frame, and recover from bad quality when no new frames
-        format.setLong(MediaFormat.KEY_REPEAT_PREVIOUS_FRAME_AFTER, REPEAT_FRAME_DELAY_US); // µs
+        // (in thumbnail mode, a static screen is still refreshed at the configured interval)
+        long repeatDelayUs = thumbnailInterval > 0 ? thumbnailInterval * 1000L : REPEAT_FRAME_DELAY_US;
+        format.setLong(MediaFormat.KEY_REPEAT_PREVIOUS_FRAME_AFTER, repeatDelayUs); // µs
         if (maxFps > 0) {
             // The key existed privately before Android 10:
             // <https://android.googlesource.com/platform/frameworks/base/+/625f0aad9f7a259b6881006ad8710adce57d1384%5E%21/>
@@ -273,6 +475,19 @@ public class SurfaceEncoder implements AsyncProcessor {
             format.setFloat(KEY_MAX_FPS_TO_ENCODER, maxFps);
         }
 
+        if (hdr && MediaFormat.MIMETYPE_VIDEO_HEVC.equals(videoMimeType)) {
+            // 10-bit encoding, so that the HDR content rendered by the device is not truncated to 8-bit (the color standard and transfer
+            // are those of the captured surface, the client tone maps the frames if they are PQ or HLG)
+            format.setInteger(MediaFormat.KEY_PROFILE, MediaCodecInfo.CodecProfileLevel.HEVCProfileMain10);
+            Ln.d("Video encoded in 10-bit (HEVC Main10)");
+        }
+
+        if (lowLatencyEncoderName != null) {
+            // Before the codec options, so that they may override these values
+            boolean vendorKeys = CodecUtils.setLowLatencyOptions(format, lowLatencyEncoderName);
+            Ln.d("Low-latency encoder profile" + (vendorKeys ? " (with vendor keys)" : ""));
+        }
+
         if (codecOptions != null) {
             for (CodecOption option : codecOptions) {
                 String key = option.getKey();
@@ -285,6 +500,30 @@ public class SurfaceEncoder implements AsyncProcessor {
         return format;
     }
 
+    public EncoderControl getEncoderControl() {
+        return encoderControl;
+    }
+
+    public IdleMonitor getIdleMonitor() {
+        return idleMonitor;
+    }
+
+    public LatencyProbe getLatencyProbe() {
+        return latencyProbe;
+    }
+
+    public ThermalMonitor getThermalMonitor() {
+        return thermalMonitor;
+    }
+
+    public BitRateAdapter getBitRateAdapter() {
+        return bitRateAdapter;
+    }
+
+    public VideoSizeAdapter getVideoSizeAdapter() {
+        return videoSizeAdapter;
+    }
+
     @Override
     public void start(TerminationListener listener) {
         thread = new Thread(() -> {
@@ -307,6 +546,9 @@ public class SurfaceEncoder implements AsyncProcessor {
             }
         }, "video");
         thread.start();
+        if (thermalMonitor != null) {
+            thermalMonitor.start();
+        }
     }
 
     @Override
@@ -315,6 +557,9 @@ public class SurfaceEncoder implements AsyncProcessor {
             stopped.set(true);
             reset.reset();
         }
+        if (thermalMonitor != null) {
+            thermalMonitor.stop();
+        }
     }
 
     @Override
@@ -322,5 +567,8 @@ public class SurfaceEncoder implements AsyncProcessor {
         if (thread != null) {
             thread.join();
         }
+        if (thermalMonitor != null) {
+            thermalMonitor.join();
+        }
     }
 }
@@ -0,0 +1,171 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.util.Ln;
+import com.genymobile.scrcpy.wrappers.PowerManager;
+import com.genymobile.scrcpy.wrappers.ServiceManager;
+
+/**
+ * Periodically read the thermal status and headroom of the device, and (if enabled) step down the video encoding before the device
+ * throttles itself.
+ * <p>
+ * The system throttling (lower CPU/GPU/encoder clocks) is not controllable and causes frame drops and latency spikes, so it is better to reduce
+ * the encoder load progressively, earlier.
+ */
+public class ThermalMonitor {
+
+    public interface Listener {
+        /**
+         * @param status          one of the {@code PowerManager.THERMAL_STATUS_*} values
+         * @param headroomPercent the forecasted thermal headroom in percent (100 means throttled), or -1 if unknown
+         * @param level           the current throttle level
+         */
+        void onThermalStateChanged(int status, int headroomPercent, int level);
+    }
+
+    public static final int LEVEL_NONE = 0;
+    // Bit rate reduced to 3/4
+    public static final int LEVEL_REDUCED = 1;
+    // Bit rate reduced to 1/2, frame rate capped
+    public static final int LEVEL_LOW = 2;
+
+    private static final long POLL_INTERVAL_MS = 5000;
+    // Forecast the headroom in the next seconds, to react before the device throttles
+    private static final int HEADROOM_FORECAST_SECONDS = 10;
+
+    private static final float REDUCED_HEADROOM = 0.8f;
+    private static final float LOW_HEADROOM = 0.9f;
+    // Do not switch back and forth around a threshold
+    private static final float HEADROOM_HYSTERESIS = 0.1f;
+
+    private static final int REDUCED_BIT_RATE_PERCENT = 75;
+    private static final int LOW_BIT_RATE_PERCENT = 50;
+    private static final float LOW_MAX_FPS = 30;
+
+    private final boolean throttle;
+    private final BitRateAdapter bitRateAdapter;
+    private final CaptureReset reset;
+
+    private Thread thread;
+    private Listener listener;
+
+    private int level = LEVEL_NONE;
+    private int lastStatus = PowerManager.THERMAL_STATUS_UNKNOWN;
+    private int lastHeadroomPercent = -1;
+
+    public ThermalMonitor(boolean throttle, BitRateAdapter bitRateAdapter, CaptureReset reset) {
+        this.throttle = throttle;
+        this.bitRateAdapter = bitRateAdapter;
+        this.reset = reset;
+    }
+
+    public synchronized void setListener(Listener listener) {
+        this.listener = listener;
+    }
+
+    /**
+     * Return the maximum frame rate to configure, given the requested one (0 if unlimited).
+     */
+    public synchronized float limitMaxFps(float maxFps) {
+        if (level < LEVEL_LOW) {
+            return maxFps;
+        }
+        return maxFps > 0 ? Math.min(maxFps, LOW_MAX_FPS) : LOW_MAX_FPS;
+    }
+
+    static int getLevel(int status, float headroom) {
+        // The comparisons are false if the headroom is NaN (unknown)
+        if (status >= PowerManager.THERMAL_STATUS_MODERATE || headroom >= LOW_HEADROOM) {
+            return LEVEL_LOW;
+        }
+        if (status == PowerManager.THERMAL_STATUS_LIGHT || headroom >= REDUCED_HEADROOM) {
+            return LEVEL_REDUCED;
+        }
+        return LEVEL_NONE;
+    }
+
+    static int getNextLevel(int currentLevel, int status, float headroom) {
+        int level = getLevel(status, headroom);
+        if (level < currentLevel) {
+            // Only release the throttling once the headroom is sufficiently below the threshold
+            level = Math.min(currentLevel, getLevel(status, headroom + HEADROOM_HYSTERESIS));
+        }
+        return level;
+    }
+
+    private void poll(PowerManager powerManager) {
+        int status = powerManager.getThermalStatus();
+        float headroom = powerManager.getThermalHeadroom(HEADROOM_FORECAST_SECONDS);
+        int headroomPercent = Float.isNaN(headroom) ? -1 : Math.round(headroom * 100);
+
+        Listener listenerToNotify;
+        int newLevel;
+        synchronized (this) {
+            newLevel = throttle ? getNextLevel(level, status, headroom) : LEVEL_NONE;
+            if (newLevel == level && status == lastStatus && headroomPercent == lastHeadroomPercent) {
+                return;
+            }
+
+            if (newLevel != level) {
+                applyLevel(newLevel);
+            }
+            lastStatus = status;
+            lastHeadroomPercent = headroomPercent;
+            listenerToNotify = listener;
+        }
+
+        if (listenerToNotify != null) {
+            listenerToNotify.onThermalStateChanged(status, headroomPercent, newLevel);
+        }
+    }
+
+    private void applyLevel(int newLevel) {
+        Ln.i("Thermal throttle level: " + level + " -> " + newLevel);
+
+        int bitRatePercent;
+        if (newLevel == LEVEL_LOW) {
+            bitRatePercent = LOW_BIT_RATE_PERCENT;
+        } else if (newLevel == LEVEL_REDUCED) {
+            bitRatePercent = REDUCED_BIT_RATE_PERCENT;
+        } else {
+            bitRatePercent = 100;
+        }
+        bitRateAdapter.setThermalLimit(bitRatePercent);
+
+        boolean fpsChanged = (level >= LEVEL_LOW) != (newLevel >= LEVEL_LOW);
+        level = newLevel;
+        if (fpsChanged) {
+            // The max frame rate can only be changed by reconfiguring the encoder
+            reset.reset();
+        }
+    }
+
+    private void run() {
+        PowerManager powerManager = ServiceManager.getPowerManager();
+        try {
+            while (!Thread.currentThread().isInterrupted()) {
+                poll(powerManager);
+                Thread.sleep(POLL_INTERVAL_MS);
+            }
+        } catch (InterruptedException e) {
+            // stopped
+        }
+    }
+
+    public void start() {
+        thread = new Thread(this::run, "thermal");
+        thread.setDaemon(true);
+        thread.start();
+    }
+
+    public void stop() {
+        if (thread != null) {
+            thread.interrupt();
+        }
+    }
+
+    public void join() throws InterruptedException {
+        if (thread != null) {
+            thread.join();
+        }
+    }
+}
@@ -0,0 +1,22 @@
+package com.genymobile.scrcpy.video;
+
+public enum VideoEncoderProfile {
+    DEFAULT("default"),
+    LOW_LATENCY("low-latency");
+
+    private final String name;
+
+    VideoEncoderProfile(String name) {
+        this.name = name;
+    }
+
+    public static VideoEncoderProfile findByName(String name) {
+        for (VideoEncoderProfile profile : VideoEncoderProfile.values()) {
+            if (name.equals(profile.name)) {
+                return profile;
+            }
+        }
+
+        return null;
+    }
+}
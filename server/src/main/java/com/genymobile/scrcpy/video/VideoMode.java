@@ -0,0 +1,22 @@
+package com.genymobile.scrcpy.video;
+
+public enum VideoMode {
+    NORMAL("normal"),
+    THUMBNAIL("thumbnail");
+
+    private final String name;
+
+    VideoMode(String name) {
+        this.name = name;
+    }
+
+    public static VideoMode findByName(String name) {
+        for (VideoMode mode : VideoMode.values()) {
+            if (name.equals(mode.name)) {
+                return mode;
+            }
+        }
+
+        return null;
+    }
+}
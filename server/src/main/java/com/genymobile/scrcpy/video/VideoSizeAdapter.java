@@ -0,0 +1,74 @@
+package com.genymobile.scrcpy.video;
+
+import com.genymobile.scrcpy.device.Size;
+import com.genymobile.scrcpy.util.Ln;
+
+import java.util.concurrent.atomic.AtomicInteger;
+
+/**
+ * Adapt the video size to the size of the client viewport (--auto-size), so that the device does not encode more pixels than displayed.
+ */
+public class VideoSizeAdapter {
+
+    // Hysteresis: restarting the encoder is expensive, so ignore small changes
+    // Grow if the viewport exceeds the video size by more than 15%
+    private static final float GROW_RATIO = 1.15f;
+    // Shrink if the viewport is smaller than 70% of the video size
+    private static final float SHRINK_RATIO = 0.7f;
+
+    private static final int NO_REQUEST = -1;
+
+    private final int userMaxSize; // 0 if unlimited
+    private final CaptureReset reset;
+
+    private int maxSize; // the max size currently applied (0 if unlimited)
+    private int videoMaxSide; // the current video size (0 if unknown)
+
+    private final AtomicInteger requestedMaxSize = new AtomicInteger(NO_REQUEST);
+
+    public VideoSizeAdapter(int userMaxSize, CaptureReset reset) {
+        this.userMaxSize = userMaxSize;
+        this.reset = reset;
+        this.maxSize = userMaxSize;
+    }
+
+    /**
+     * Return the max size to apply before the next capture, or -1 if unchanged.
+     */
+    public int consumeMaxSizeRequest() {
+        return requestedMaxSize.getAndSet(NO_REQUEST);
+    }
+
+    public synchronized void setVideoSize(Size size) {
+        videoMaxSide = size.getMax();
+    }
+
+    public synchronized void onViewportSize(int width, int height) {
+        if (videoMaxSide == 0 || width == 0 || height == 0) {
+            return;
+        }
+
+        int target = Math.max(width, height);
+        if (target < videoMaxSide * SHRINK_RATIO) {
+            Ln.d("Viewport " + width + "x" + height + ": reducing the video size");
+        } else if (target > videoMaxSide * GROW_RATIO && maxSize != 0 && maxSize < target) {
+            // Only if the video is currently limited by the max size (otherwise, it is already at the device resolution)
+            Ln.d("Viewport " + width + "x" + height + ": increasing the video size");
+        } else {
+            return;
+        }
+
+        // Must be a multiple of 8
+        int newMaxSize = (target + 7) & ~7;
+        if (userMaxSize != 0 && newMaxSize >= userMaxSize) {
+            newMaxSize = userMaxSize;
+        }
+        if (newMaxSize == maxSize) {
+            return;
+        }
+
+        maxSize = newMaxSize;
+        requestedMaxSize.set(newMaxSize);
+        reset.reset();
+    }
+}
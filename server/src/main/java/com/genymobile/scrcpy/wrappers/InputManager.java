@@ -22,6 +22,8 @@ public final class InputManager {
     private final android.hardware.input.InputManager manager;
     private long lastPermissionLogDate;
 
+    // The methods called for every injected event are resolved once, with access checks suppressed. MethodHandle.invokeExact() would be
+    // cheaper still, but it is rejected by the dexer below Android 8 (minSdk is 21).
     private static Method injectInputEventMethod;
     private static Method setDisplayIdMethod;
     private static Method setActionButtonMethod;
@@ -40,7 +42,9 @@ public final class InputManager {
 
     private static Method getInjectInputEventMethod() throws NoSuchMethodException {
         if (injectInputEventMethod == null) {
-            injectInputEventMethod = android.hardware.input.InputManager.class.getMethod("injectInputEvent", InputEvent.class, int.class);
+            Method method = android.hardware.input.InputManager.class.getMethod("injectInputEvent", InputEvent.class, int.class);
+            method.setAccessible(true);
+            injectInputEventMethod = method;
         }
         return injectInputEventMethod;
     }
@@ -74,7 +78,9 @@ public final class InputManager {
 
     private static Method getSetDisplayIdMethod() throws NoSuchMethodException {
         if (setDisplayIdMethod == null) {
-            setDisplayIdMethod = InputEvent.class.getMethod("setDisplayId", int.class);
+            Method method = InputEvent.class.getMethod("setDisplayId", int.class);
+            method.setAccessible(true);
+            setDisplayIdMethod = method;
         }
         return setDisplayIdMethod;
     }
@@ -92,7 +98,9 @@ public final class InputManager {
 
     private static Method getSetActionButtonMethod() throws NoSuchMethodException {
         if (setActionButtonMethod == null) {
-            setActionButtonMethod = MotionEvent.class.getMethod("setActionButton", int.class);
+            Method method = MotionEvent.class.getMethod("setActionButton", int.class);
+            method.setAccessible(true);
+            setActionButtonMethod = method;
         }
         return setActionButtonMethod;
     }
@@ -9,9 +9,23 @@ import android.os.IInterface;
 import java.lang.reflect.Method;
 
 public final class PowerManager {
+
+    // Values of android.os.PowerManager.THERMAL_STATUS_*
+    public static final int THERMAL_STATUS_UNKNOWN = -1;
+    public static final int THERMAL_STATUS_NONE = 0;
+    public static final int THERMAL_STATUS_LIGHT = 1;
+    public static final int THERMAL_STATUS_MODERATE = 2;
+    public static final int THERMAL_STATUS_SEVERE = 3;
+
     private final IInterface manager;
     private Method isScreenOnMethod;
 
+    // The thermal status is exposed by a separate service (used by android.os.PowerManager internally)
+    private IInterface thermalService;
+    private boolean thermalServiceUnavailable;
+    private Method getCurrentThermalStatusMethod;
+    private Method getThermalHeadroomMethod;
+
     static PowerManager create() {
         IInterface manager = ServiceManager.getService("power", "android.os.IPowerManager");
         return new PowerManager(manager);
@@ -45,4 +59,82 @@ public final class PowerManager {
             return false;
         }
     }
+
+    private IInterface getThermalService() {
+        if (thermalService == null && !thermalServiceUnavailable) {
+            try {
+                thermalService = ServiceManager.getService("thermalservice", "android.os.IThermalService");
+            } catch (AssertionError e) {
+                Ln.w("Could not access the thermal service", e);
+            }
+            thermalServiceUnavailable = thermalService == null;
+        }
+        return thermalService;
+    }
+
+    private Method getGetCurrentThermalStatusMethod(IInterface service) throws NoSuchMethodException {
+        if (getCurrentThermalStatusMethod == null) {
+            getCurrentThermalStatusMethod = service.getClass().getMethod("getCurrentThermalStatus");
+        }
+        return getCurrentThermalStatusMethod;
+    }
+
+    private Method getGetThermalHeadroomMethod(IInterface service) throws NoSuchMethodException {
+        if (getThermalHeadroomMethod == null) {
+            getThermalHeadroomMethod = service.getClass().getMethod("getThermalHeadroom", int.class);
+        }
+        return getThermalHeadroomMethod;
+    }
+
+    /**
+     * Return the current thermal status (one of the {@code THERMAL_STATUS_*} values), or {@link #THERMAL_STATUS_UNKNOWN} if not available.
+     */
+    public synchronized int getThermalStatus() {
+        if (Build.VERSION.SDK_INT < AndroidVersions.API_29_ANDROID_10) {
+            return THERMAL_STATUS_UNKNOWN;
+        }
+
+        IInterface service = getThermalService();
+        if (service == null) {
+            return THERMAL_STATUS_UNKNOWN;
+        }
+
+        try {
+            Method method = getGetCurrentThermalStatusMethod(service);
+            return (int) method.invoke(service);
+        } catch (ReflectiveOperationException e) {
+            Ln.e("Could not invoke method", e);
+            // Do not retry (and log) on every call
+            thermalServiceUnavailable = true;
+            thermalService = null;
+            return THERMAL_STATUS_UNKNOWN;
+        }
+    }
+
+    /**
+     * Return the forecasted thermal headroom in {@code forecastSeconds} (1.0 means that the device will be throttled), or {@code NaN} if not
+     * available.
+     * <p>
+     * The value is not available if it is requested more than once per second.
+     */
+    public synchronized float getThermalHeadroom(int forecastSeconds) {
+        if (Build.VERSION.SDK_INT < AndroidVersions.API_30_ANDROID_11) {
+            return Float.NaN;
+        }
+
+        IInterface service = getThermalService();
+        if (service == null) {
+            return Float.NaN;
+        }
+
+        try {
+            Method method = getGetThermalHeadroomMethod(service);
+            return (float) method.invoke(service, forecastSeconds);
+        } catch (ReflectiveOperationException e) {
+            Ln.e("Could not invoke method", e);
+            thermalServiceUnavailable = true;
+            thermalService = null;
+            return Float.NaN;
+        }
+    }
 }
@@ -191,10 +191,18 @@ public final class WindowManager {
         }
     }
 
+    /**
+     * Register a display window listener.
+     *
+     * @return the ids of the current displays (always empty on Android 11, which does not report them), or {@code null} if the registration
+     * failed
+     */
     @TargetApi(AndroidVersions.API_30_ANDROID_11)
     public int[] registerDisplayWindowListener(IDisplayWindowListener listener) {
         try {
-            return (int[]) manager.getClass().getMethod("registerDisplayWindowListener", IDisplayWindowListener.class).invoke(manager, listener);
+            Object displayIds = manager.getClass().getMethod("registerDisplayWindowListener", IDisplayWindowListener.class).invoke(manager, listener);
+            // The method returns void on Android 11
+            return displayIds != null ? (int[]) displayIds : new int[0];
         } catch (Exception e) {
             Ln.e("Could not register display window listener", e);
         }
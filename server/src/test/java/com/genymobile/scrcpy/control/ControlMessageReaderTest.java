@@ -1,5 +1,7 @@
 package com.genymobile.scrcpy.control;
 
+import com.genymobile.scrcpy.device.Position;
+
 import android.view.KeyEvent;
 import android.view.MotionEvent;
 import org.junit.Assert;
@@ -115,6 +117,88 @@ public class ControlMessageReaderTest {
         Assert.assertEquals(-1, bis.read()); // EOS
     }
 
+    @Test
+    public void testParseReusedTouchEvents() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        for (int i = 0; i < 2; ++i) {
+            dos.writeByte(ControlMessage.TYPE_INJECT_TOUCH_EVENT);
+            dos.writeByte(i == 0 ? MotionEvent.ACTION_DOWN : MotionEvent.ACTION_MOVE);
+            dos.writeLong(-42); // pointerId
+            dos.writeInt(100 + i);
+            dos.writeInt(200 + i);
+            dos.writeShort(1080);
+            dos.writeShort(1920);
+            dos.writeShort(0xffff); // pressure
+            dos.writeInt(0); // action button
+            dos.writeInt(0); // buttons
+        }
+
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Position position = event.getPosition();
+
+        event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_INJECT_TOUCH_EVENT, event.getType());
+        Assert.assertEquals(MotionEvent.ACTION_MOVE, event.getAction());
+        Assert.assertEquals(101, event.getPosition().getPoint().getX());
+        Assert.assertEquals(201, event.getPosition().getPoint().getY());
+
+        // The position of the previous message must not be overwritten
+        Assert.assertEquals(100, position.getPoint().getX());
+        Assert.assertEquals(200, position.getPoint().getY());
+        Assert.assertSame(position.getScreenSize(), event.getPosition().getScreenSize());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseTouchBatch() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_INJECT_TOUCH_BATCH);
+        dos.writeLong(-42); // pointerId
+        dos.writeShort(1080);
+        dos.writeShort(1920);
+        dos.writeInt(MotionEvent.BUTTON_PRIMARY); // buttons
+        dos.writeByte(2); // count
+        dos.writeInt(100);
+        dos.writeInt(200);
+        dos.writeShort(0xffff); // pressure
+        dos.writeInt(8000); // age
+        dos.writeInt(110);
+        dos.writeInt(220);
+        dos.writeShort(0); // pressure
+        dos.writeInt(0); // age
+
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_INJECT_TOUCH_BATCH, event.getType());
+        Assert.assertEquals(-42, event.getPointerId());
+        Assert.assertEquals(MotionEvent.BUTTON_PRIMARY, event.getButtons());
+        Assert.assertEquals(2, event.getPositions().length);
+        Assert.assertEquals(100, event.getPositions()[0].getPoint().getX());
+        Assert.assertEquals(200, event.getPositions()[0].getPoint().getY());
+        Assert.assertEquals(110, event.getPositions()[1].getPoint().getX());
+        Assert.assertEquals(220, event.getPositions()[1].getPoint().getY());
+        Assert.assertEquals(1080, event.getPositions()[1].getScreenSize().getWidth());
+        Assert.assertEquals(1920, event.getPositions()[1].getScreenSize().getHeight());
+        Assert.assertEquals(1f, event.getPressures()[0], 0f); // must be exact
+        Assert.assertEquals(0f, event.getPressures()[1], 0f);
+        Assert.assertEquals(8000, event.getSampleAges()[0]);
+        Assert.assertEquals(0, event.getSampleAges()[1]);
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
     @Test
     public void testParseScrollEvent() throws IOException {
         ByteArrayOutputStream bos = new ByteArrayOutputStream();
@@ -422,6 +506,124 @@ public class ControlMessageReaderTest {
         Assert.assertEquals(-1, bis.read()); // EOS
     }
 
+    @Test
+    public void testParseRequestSyncFrame() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_REQUEST_SYNC_FRAME);
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_REQUEST_SYNC_FRAME, event.getType());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseVideoFeedback() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_VIDEO_FEEDBACK);
+        dos.writeInt(4_000_000); // bit rate
+        dos.writeShort(0xFFFF); // delay
+        dos.writeShort(3); // backlog
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_VIDEO_FEEDBACK, event.getType());
+        Assert.assertEquals(4_000_000, event.getBitRate());
+        Assert.assertEquals(0xFFFF, event.getDelay());
+        Assert.assertEquals(3, event.getBacklog());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseInputProbe() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_INPUT_PROBE);
+        dos.writeLong(0x0102030405060708L); // sequence
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_INPUT_PROBE, event.getType());
+        Assert.assertEquals(0x0102030405060708L, event.getSequence());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseSetViewportSize() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_SET_VIEWPORT_SIZE);
+        dos.writeShort(1920);
+        dos.writeShort(1080);
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_SET_VIEWPORT_SIZE, event.getType());
+        Assert.assertEquals(1920, event.getWidth());
+        Assert.assertEquals(1080, event.getHeight());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseLatencyProbe() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_LATENCY_PROBE);
+        dos.writeByte(0xA5); // code
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_LATENCY_PROBE, event.getType());
+        Assert.assertEquals(0xA5, event.getCode());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
+    @Test
+    public void testParseSetClipboardChunk() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(ControlMessage.TYPE_SET_CLIPBOARD_CHUNK);
+        dos.writeLong(0x0102030405060708L); // sequence
+        dos.writeByte(ControlMessage.CLIPBOARD_CHUNK_FLAG_FIRST | ControlMessage.CLIPBOARD_CHUNK_FLAG_LAST);
+        byte[] data = {1, 2, 3};
+        dos.writeShort(data.length);
+        dos.write(data);
+        byte[] packet = bos.toByteArray();
+
+        ByteArrayInputStream bis = new ByteArrayInputStream(packet);
+        ControlMessageReader reader = new ControlMessageReader(bis);
+
+        ControlMessage event = reader.read();
+        Assert.assertEquals(ControlMessage.TYPE_SET_CLIPBOARD_CHUNK, event.getType());
+        Assert.assertEquals(0x0102030405060708L, event.getSequence());
+        Assert.assertEquals(ControlMessage.CLIPBOARD_CHUNK_FLAG_FIRST | ControlMessage.CLIPBOARD_CHUNK_FLAG_LAST, event.getFlags());
+        Assert.assertArrayEquals(data, event.getData());
+
+        Assert.assertEquals(-1, bis.read()); // EOS
+    }
+
     @Test
     public void testMultiEvents() throws IOException {
         ByteArrayOutputStream bos = new ByteArrayOutputStream();
@@ -72,4 +72,113 @@ public class DeviceMessageWriterTest {
 
         Assert.assertArrayEquals(expected, actual);
     }
+
+    @Test
+    public void testSerializeVideoIdle() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(DeviceMessage.TYPE_VIDEO_IDLE);
+        dos.writeByte(1); // idle
+        byte[] expected = bos.toByteArray();
+
+        bos = new ByteArrayOutputStream();
+        DeviceMessageWriter writer = new DeviceMessageWriter(bos);
+
+        DeviceMessage msg = DeviceMessage.createVideoIdle(true);
+        writer.write(msg);
+
+        byte[] actual = bos.toByteArray();
+
+        Assert.assertArrayEquals(expected, actual);
+    }
+
+    @Test
+    public void testSerializeThermalState() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(DeviceMessage.TYPE_THERMAL_STATE);
+        dos.writeByte(2); // status
+        dos.writeByte(1); // level
+        dos.writeShort(85); // headroom
+        byte[] expected = bos.toByteArray();
+
+        bos = new ByteArrayOutputStream();
+        DeviceMessageWriter writer = new DeviceMessageWriter(bos);
+
+        DeviceMessage msg = DeviceMessage.createThermalState(2, 85, 1);
+        writer.write(msg);
+
+        byte[] actual = bos.toByteArray();
+
+        Assert.assertArrayEquals(expected, actual);
+    }
+
+    @Test
+    public void testSerializeInputAck() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(DeviceMessage.TYPE_INPUT_ACK);
+        dos.writeLong(0x0102030405060708L); // sequence
+        dos.writeInt(1234); // injection duration
+        byte[] expected = bos.toByteArray();
+
+        bos = new ByteArrayOutputStream();
+        DeviceMessageWriter writer = new DeviceMessageWriter(bos);
+
+        DeviceMessage msg = DeviceMessage.createInputAck(0x0102030405060708L, 1234);
+        writer.write(msg);
+
+        byte[] actual = bos.toByteArray();
+
+        Assert.assertArrayEquals(expected, actual);
+    }
+
+    @Test
+    public void testSerializeScreenshot() throws IOException {
+        byte[] png = new byte[DeviceMessageWriter.SCREENSHOT_CHUNK_SIZE + 3];
+        png[0] = 42;
+        png[png.length - 1] = 43;
+
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(DeviceMessage.TYPE_SCREENSHOT_CHUNK);
+        dos.writeByte(DeviceMessageWriter.SCREENSHOT_CHUNK_FLAG_FIRST);
+        dos.writeInt(DeviceMessageWriter.SCREENSHOT_CHUNK_SIZE);
+        dos.write(png, 0, DeviceMessageWriter.SCREENSHOT_CHUNK_SIZE);
+        dos.writeByte(DeviceMessage.TYPE_SCREENSHOT_CHUNK);
+        dos.writeByte(DeviceMessageWriter.SCREENSHOT_CHUNK_FLAG_LAST);
+        dos.writeInt(3);
+        dos.write(png, DeviceMessageWriter.SCREENSHOT_CHUNK_SIZE, 3);
+        byte[] expected = bos.toByteArray();
+
+        bos = new ByteArrayOutputStream();
+        DeviceMessageWriter writer = new DeviceMessageWriter(bos);
+
+        DeviceMessage msg = DeviceMessage.createScreenshot(png);
+        writer.write(msg);
+
+        byte[] actual = bos.toByteArray();
+
+        Assert.assertArrayEquals(expected, actual);
+    }
+
+    @Test
+    public void testSerializeScreenshotFailure() throws IOException {
+        ByteArrayOutputStream bos = new ByteArrayOutputStream();
+        DataOutputStream dos = new DataOutputStream(bos);
+        dos.writeByte(DeviceMessage.TYPE_SCREENSHOT_CHUNK);
+        dos.writeByte(DeviceMessageWriter.SCREENSHOT_CHUNK_FLAG_FIRST | DeviceMessageWriter.SCREENSHOT_CHUNK_FLAG_LAST);
+        dos.writeInt(0);
+        byte[] expected = bos.toByteArray();
+
+        bos = new ByteArrayOutputStream();
+        DeviceMessageWriter writer = new DeviceMessageWriter(bos);
+
+        DeviceMessage msg = DeviceMessage.createScreenshot(new byte[0]);
+        writer.write(msg);
+
+        byte[] actual = bos.toByteArray();
+
+        Assert.assertArrayEquals(expected, actual);
+    }
 }